@@ -0,0 +1,412 @@
+/* polysynaptic-batch.cc - Headless inventory and apply for automation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program reports the packages installed from every backend as
+ * JSON and brings a machine to a desired state list, without GTK, so
+ * configuration management can drive PolySynaptic across a fleet.
+ *
+ *   polysynaptic-batch inventory [--backends=apt,snap,flatpak]
+ *   polysynaptic-batch apply <file|-> [--dry-run]
+ *
+ * The result goes to stdout as one JSON object and progress to stderr.
+ * Exit status is 0 when everything succeeded, 1 when an operation
+ * failed and 2 for usage, configuration or list errors.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "config.h"
+
+#include "backendmanager.h"
+#include "desiredstate.h"
+#include "rconfiguration.h"
+#include "rinstallprogress.h"
+#include "rpackagelister.h"
+#include "ruserdialog.h"
+#include "structuredlog.h"
+
+#include <apt-pkg/acquire.h>
+#include <apt-pkg/error.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+
+using namespace PolySynaptic;
+
+enum ExitCode {
+    EXIT_OK = 0,
+    EXIT_FAILED = 1,
+    EXIT_USAGE = 2
+};
+
+// ============================================================================
+// Output
+// ============================================================================
+
+static void appendString(string& out, const string& s)
+{
+    out += '"';
+    appendJsonEscaped(out, s);
+    out += '"';
+}
+
+static const char* statusName(InstallStatus status)
+{
+    switch (status) {
+        case InstallStatus::INSTALLED:        return "installed";
+        case InstallStatus::UPDATE_AVAILABLE: return "upgradable";
+        case InstallStatus::BROKEN:           return "broken";
+        case InstallStatus::NOT_INSTALLED:    return "available";
+        default:                              return "unknown";
+    }
+}
+
+static const char* actionName(const Transaction::Operation& op)
+{
+    switch (op.type) {
+        case Transaction::Operation::Type::INSTALL: return "install";
+        case Transaction::Operation::Type::UPDATE:  return "update";
+        case Transaction::Operation::Type::REMOVE:  return op.purge ? "purge" : "remove";
+    }
+    return "install";
+}
+
+static long elapsedMs(chrono::steady_clock::time_point start)
+{
+    return (long)chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - start).count();
+}
+
+// Progress lines for whoever watches stderr, one per message
+static ProgressCallback stderrProgress()
+{
+    auto last = make_shared<string>();
+    return [last](double, const string& message) {
+        if (!message.empty() && message != *last) {
+            cerr << message << endl;
+            *last = message;
+        }
+        return true;
+    };
+}
+
+static int usage(const char* error = nullptr)
+{
+    if (error) cerr << "polysynaptic-batch: " << error << endl;
+    cerr << "Usage: polysynaptic-batch inventory [--backends=apt,snap,flatpak]" << endl
+         << "       polysynaptic-batch apply <file|-> [--dry-run]" << endl;
+    return EXIT_USAGE;
+}
+
+// ============================================================================
+// APT Commit
+// ============================================================================
+
+/**
+ * QuietAcquireStatus - Download progress for a run without a terminal
+ *
+ * Media changes cannot be answered, so they fail the download.
+ */
+class QuietAcquireStatus : public pkgAcquireStatus {
+public:
+    bool MediaChange(string media, string drive) override
+    {
+        cerr << "Cannot ask for medium '" << media << "' in " << drive << endl;
+        return false;
+    }
+};
+
+/**
+ * BatchUserDialog - Answers the lister's questions without a user
+ *
+ * Messages go to stderr. Questions get "no", so a run never goes on
+ * past something that would have needed someone to agree to it.
+ */
+class BatchUserDialog : public RUserDialog {
+public:
+    bool message(const char* msg, DialogType dialog = DialogInfo,
+                 ButtonsType buttons = ButtonsDefault, bool defres = true) override
+    {
+        cerr << msg << endl;
+        return dialog != DialogQuestion && buttons != ButtonsYesNo;
+    }
+};
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+static bool parseBackends(const string& list, BackendFilter& filter)
+{
+    filter.includeApt = filter.includeSnap = filter.includeFlatpak = false;
+
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) end = list.size();
+        string name = list.substr(start, end - start);
+        if (name == "apt" || name == "deb") {
+            filter.includeApt = true;
+        } else if (name == "snap") {
+            filter.includeSnap = true;
+        } else if (name == "flatpak") {
+            filter.includeFlatpak = true;
+        } else {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+// Open the APT cache only when the command needs it; it dominates startup
+static bool openLister(RPackageLister& lister)
+{
+    if (!lister.openCache()) {
+        _error->DumpErrors();
+        return false;
+    }
+    return true;
+}
+
+static int inventory(const BackendFilter& filter)
+{
+    auto start = chrono::steady_clock::now();
+
+    RPackageLister lister;
+    if (filter.includeApt && !openLister(lister)) return EXIT_USAGE;
+
+    BackendManager manager(filter.includeApt ? &lister : NULL);
+    vector<PackageInfo> installed = manager.getInstalledPackages(filter, stderrProgress());
+
+    string out = "{\"backends\":[";
+    bool first = true;
+    for (const auto& status : manager.getBackendStatuses()) {
+        if (!filter.includes(status.type)) continue;
+        if (!first) out += ',';
+        first = false;
+        out += "{\"backend\":";
+        appendString(out, backendTypeToBadge(status.type));
+        out += ",\"available\":";
+        out += status.available && status.enabled ? "true" : "false";
+        out += ",\"version\":";
+        appendString(out, status.version);
+        if (!status.available) {
+            out += ",\"reason\":";
+            appendString(out, status.unavailableReason);
+        }
+        out += '}';
+    }
+
+    out += "],\"packages\":[";
+    out.reserve(out.size() + installed.size() * 96);
+    first = true;
+    for (const auto& pkg : installed) {
+        if (!first) out += ',';
+        first = false;
+        out += "{\"backend\":";
+        appendString(out, backendTypeToBadge(pkg.backend));
+        out += ",\"id\":";
+        appendString(out, pkg.id);
+        out += ",\"name\":";
+        appendString(out, pkg.name);
+        out += ",\"installed_version\":";
+        appendString(out, pkg.installedVersion);
+        out += ",\"version\":";
+        appendString(out, pkg.version);
+        out += ",\"status\":";
+        appendString(out, statusName(pkg.installStatus));
+        out += '}';
+    }
+    out += "],\"elapsed_ms\":" + to_string(elapsedMs(start)) + "}";
+
+    cout << out << endl;
+    return EXIT_OK;
+}
+
+static int apply(const string& path, bool dryRun)
+{
+    auto start = chrono::steady_clock::now();
+
+    DesiredState desired;
+    string error;
+    bool parsed;
+    if (path == "-") {
+        parsed = desired.parse(cin, error);
+    } else {
+        ifstream in(path);
+        if (!in) {
+            cerr << "polysynaptic-batch: cannot read " << path << endl;
+            return EXIT_USAGE;
+        }
+        parsed = desired.parse(in, error);
+    }
+    if (!parsed) {
+        cerr << "polysynaptic-batch: " << path << ": " << error << endl;
+        return EXIT_USAGE;
+    }
+
+    bool useApt = desired.uses(BackendType::APT);
+
+    if (!dryRun && getuid() != 0) {
+        cerr << "polysynaptic-batch: apply must be run as root" << endl;
+        return EXIT_USAGE;
+    }
+
+    BatchUserDialog dialog;
+    RPackageLister lister;
+    lister.setUserDialog(&dialog);
+    if (useApt && !openLister(lister)) return EXIT_USAGE;
+
+    BackendManager manager(useApt ? &lister : NULL);
+    ProgressCallback progress = stderrProgress();
+
+    TransactionResult result;
+    result.success = true;
+    result.successCount = 0;
+    result.failureCount = 0;
+
+    Reconciliation plan = desired.reconcile(manager, progress);
+    const vector<Transaction::Operation>& operations = plan.transaction.operations;
+
+    // Entries for a backend this machine lacks cannot be satisfied
+    for (const auto& want : plan.unavailable) {
+        result.success = false;
+        result.failureCount++;
+        result.errors.push_back({want.id, string(backendTypeToString(want.backend)) +
+                                          " is not available"});
+    }
+
+    if (!dryRun && !operations.empty()) {
+        auto merge = [&result](const TransactionResult& part) {
+            result.success = result.success && part.success;
+            result.successCount += part.successCount;
+            result.failureCount += part.failureCount;
+            result.errors.insert(result.errors.end(), part.errors.begin(), part.errors.end());
+        };
+
+        // The APT backend only marks packages; the lister runs dpkg once
+        // for all of them before the other backends start
+        bool aptQueued = false;
+        for (const auto& op : operations) {
+            if (op.backend != BackendType::APT) continue;
+            manager.queueOperation(op);
+            aptQueued = true;
+        }
+        if (aptQueued) {
+            TransactionResult marked = manager.commitTransaction(progress);
+            if (marked.failureCount == 0) {
+                QuietAcquireStatus acquire;
+                RInstallProgress install;
+                if (!lister.commitChanges(&acquire, &install)) {
+                    string message = "APT transaction failed";
+                    string detail;
+                    if (_error->PopMessage(detail)) message += ": " + detail;
+                    _error->Discard();
+                    marked.success = false;
+                    marked.failureCount = marked.successCount;
+                    marked.successCount = 0;
+                    marked.errors.push_back({"apt", message});
+                }
+            }
+            merge(marked);
+        }
+
+        bool othersQueued = false;
+        for (const auto& op : operations) {
+            if (op.backend == BackendType::APT) continue;
+            manager.queueOperation(op);
+            othersQueued = true;
+        }
+        if (othersQueued) merge(manager.commitTransaction(progress));
+    }
+
+    string out = "{\"dry_run\":";
+    out += dryRun ? "true" : "false";
+    out += ",\"unchanged\":" + to_string(plan.unchanged);
+    out += ",\"operations\":[";
+    bool first = true;
+    for (const auto& op : operations) {
+        if (!first) out += ',';
+        first = false;
+        out += "{\"backend\":";
+        appendString(out, backendTypeToBadge(op.backend));
+        out += ",\"id\":";
+        appendString(out, op.packageId);
+        out += ",\"action\":";
+        appendString(out, actionName(op));
+        if (!op.target.empty()) {
+            out += ",\"target\":";
+            appendString(out, op.target);
+        }
+        out += '}';
+    }
+    out += "],\"success\":";
+    out += result.success ? "true" : "false";
+    out += ",\"succeeded\":" + to_string(result.successCount);
+    out += ",\"failed\":" + to_string(result.failureCount);
+    out += ",\"errors\":[";
+    first = true;
+    for (const auto& err : result.errors) {
+        if (!first) out += ',';
+        first = false;
+        out += "{\"id\":";
+        appendString(out, err.first);
+        out += ",\"message\":";
+        appendString(out, err.second);
+        out += '}';
+    }
+    out += "],\"elapsed_ms\":" + to_string(elapsedMs(start)) + "}";
+
+    cout << out << endl;
+    return result.success ? EXIT_OK : EXIT_FAILED;
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) return usage();
+
+    string command = argv[1];
+    BackendFilter filter;
+    string path;
+    bool dryRun = false;
+
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (command == "inventory" && arg.compare(0, 11, "--backends=") == 0) {
+            if (!parseBackends(arg.substr(11), filter)) {
+                return usage("unknown backend in --backends");
+            }
+        } else if (command == "apply" && arg == "--dry-run") {
+            dryRun = true;
+        } else if (command == "apply" && path.empty() && (arg == "-" || arg[0] != '-')) {
+            path = arg;
+        } else {
+            return usage(("unexpected argument " + arg).c_str());
+        }
+    }
+
+    if (command != "inventory" && command != "apply") return usage();
+    if (command == "apply" && path.empty()) return usage("apply needs a list");
+
+    if (!RInitConfiguration("polysynaptic.conf")) {
+        _error->DumpErrors();
+        return EXIT_USAGE;
+    }
+
+    return command == "inventory" ? inventory(filter) : apply(path, dryRun);
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,1122 @@
+/* appstreamindex.cc - Categories, keywords and screenshots from AppStream
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "config.h"
+#include "appstreamindex.h"
+#include "flatpakbackend.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace PolySynaptic {
+
+namespace {
+
+// The distribution's catalogs: AppStream 1.0 locations, then the older ones
+const char *const DISTRIBUTION_DIRS[] = {
+    "/var/lib/swcatalog/xml",
+    "/var/lib/swcatalog/yaml",
+    "/usr/share/swcatalog/xml",
+    "/usr/share/swcatalog/yaml",
+    "/var/lib/app-info/xmls",
+    "/var/lib/app-info/yaml",
+    "/var/cache/app-info/xmls",
+    "/var/cache/app-info/yaml",
+    "/usr/share/app-info/xmls",
+    "/usr/share/app-info/yaml"
+};
+
+bool endsWith(string_view s, string_view suffix)
+{
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool startsWith(string_view s, string_view prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+string_view trim(string_view s)
+{
+    while (!s.empty() && isSpace(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isSpace(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+bool isCatalog(string_view name)
+{
+    if (endsWith(name, ".gz")) {
+        name.remove_suffix(3);
+    }
+    return endsWith(name, ".xml") || endsWith(name, ".yml") || endsWith(name, ".yaml");
+}
+
+vector<string> directoryEntries(const string& dir)
+{
+    vector<string> names;
+    DIR *entries = opendir(dir.c_str());
+    if (!entries) {
+        return names;
+    }
+    while (struct dirent *entry = readdir(entries)) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(entries);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+// Catalogs of a directory; flatpak keeps a gzipped copy next to each
+// appstream.xml, and the mapped one is cheaper. The distribution's
+// directories link to the same apt lists, and links may dangle.
+void addCatalogs(const string& dir, vector<string>& files, set<string>& targets)
+{
+    vector<string> names = directoryEntries(dir);
+    set<string> present(names.begin(), names.end());
+    for (const auto& name : names) {
+        if (!isCatalog(name)) {
+            continue;
+        }
+        if (endsWith(name, ".gz") && present.count(name.substr(0, name.size() - 3))) {
+            continue;
+        }
+        string path = dir + "/" + name;
+        char *target = realpath(path.c_str(), nullptr);
+        if (!target) {
+            continue;
+        }
+        bool added = targets.insert(target).second;
+        free(target);
+        if (added) {
+            files.push_back(path);
+        }
+    }
+}
+
+string absoluteUrl(const string& url, const string& base)
+{
+    if (base.empty() || url.empty() || url.find("://") != string::npos) {
+        return url;
+    }
+    string_view root(base);
+    while (!root.empty() && root.back() == '/') root.remove_suffix(1);
+    string_view path(url);
+    while (!path.empty() && path.front() == '/') path.remove_prefix(1);
+    return string(root) + "/" + string(path);
+}
+
+// ============================================================================
+// Files
+// ============================================================================
+
+/**
+ * A catalog file mapped read-only for one pass
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (base != MAP_FAILED) {
+                madvise(base, st.st_size, MADV_SEQUENTIAL);
+                _base = base;
+                _size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (_base) {
+            munmap(_base, _size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return _base != nullptr; }
+    string_view data() const { return string_view(static_cast<const char*>(_base), _size); }
+
+private:
+    void *_base = nullptr;
+    size_t _size = 0;
+};
+
+#ifdef HAVE_ZLIB
+bool gunzip(string_view in, string& out)
+{
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    // The trailer holds the uncompressed size modulo 4 GiB
+    if (in.size() >= 4) {
+        const unsigned char *t = reinterpret_cast<const unsigned char*>(in.data()) + in.size() - 4;
+        size_t hint = t[0] | (t[1] << 8) | (t[2] << 16) | (size_t(t[3]) << 24);
+        if (hint / 64 < in.size()) {
+            out.reserve(hint);
+        }
+    }
+
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    z.avail_in = in.size();
+    char buffer[64 * 1024];
+    int status;
+    do {
+        z.next_out = reinterpret_cast<Bytef*>(buffer);
+        z.avail_out = sizeof(buffer);
+        status = inflate(&z, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            inflateEnd(&z);
+            return false;
+        }
+        out.append(buffer, sizeof(buffer) - z.avail_out);
+        // Concatenated members
+        if (status == Z_STREAM_END && z.avail_in > 0) {
+            inflateReset(&z);
+            status = Z_OK;
+        }
+    } while (status != Z_STREAM_END);
+
+    inflateEnd(&z);
+    return true;
+}
+#endif
+
+// ============================================================================
+// XML Scanning
+// ============================================================================
+
+struct XmlAttribute {
+    string_view name;
+    string_view value;      // Entities not replaced
+};
+
+string_view attribute(const vector<XmlAttribute>& attributes, string_view name)
+{
+    for (const auto& a : attributes) {
+        if (a.name == name) return a.value;
+    }
+    return string_view();
+}
+
+void appendUtf8(string& out, unsigned long code)
+{
+    if (code < 0x80) {
+        out += char(code);
+    } else if (code < 0x800) {
+        out += char(0xC0 | (code >> 6));
+        out += char(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += char(0xE0 | (code >> 12));
+        out += char(0x80 | ((code >> 6) & 0x3F));
+        out += char(0x80 | (code & 0x3F));
+    } else if (code < 0x110000) {
+        out += char(0xF0 | (code >> 18));
+        out += char(0x80 | ((code >> 12) & 0x3F));
+        out += char(0x80 | ((code >> 6) & 0x3F));
+        out += char(0x80 | (code & 0x3F));
+    }
+}
+
+// Text with the predefined entities and character references replaced
+void appendDecoded(string& out, string_view raw)
+{
+    size_t i = 0;
+    while (i < raw.size()) {
+        size_t amp = raw.find('&', i);
+        if (amp == string_view::npos) {
+            out.append(raw.substr(i));
+            return;
+        }
+        out.append(raw.substr(i, amp - i));
+        size_t semi = raw.find(';', amp);
+        if (semi == string_view::npos || semi - amp > 12) {
+            out += '&';
+            i = amp + 1;
+            continue;
+        }
+
+        string_view name = raw.substr(amp + 1, semi - amp - 1);
+        if (name == "amp") out += '&';
+        else if (name == "lt") out += '<';
+        else if (name == "gt") out += '>';
+        else if (name == "quot") out += '"';
+        else if (name == "apos") out += '\'';
+        else if (name.size() > 1 && name[0] == '#') {
+            string digits(name.substr(1));
+            bool hex = digits[0] == 'x' || digits[0] == 'X';
+            appendUtf8(out, strtoul(digits.c_str() + (hex ? 1 : 0), nullptr, hex ? 16 : 10));
+        } else {
+            out.append(raw.substr(amp, semi - amp + 1));
+        }
+        i = semi + 1;
+    }
+}
+
+const char* findMarker(const char *from, const char *end, string_view marker)
+{
+    const void *at = memmem(from, end - from, marker.data(), marker.size());
+    return static_cast<const char*>(at);
+}
+
+/**
+ * One pass over a document, reporting to the handler:
+ *
+ *     start(name, attributes)   an element opens
+ *     end(name)                 an element closes
+ *     text(raw, cdata)          character data, entities not replaced
+ *                               unless cdata
+ *
+ * Comments, processing instructions and the doctype are skipped.
+ * Nothing is checked beyond what the pass needs to stay in step; false
+ * means the document ended inside markup.
+ */
+template <typename Handler>
+bool scanXml(string_view data, Handler& handler)
+{
+    const char *p = data.data();
+    const char *end = p + data.size();
+    vector<XmlAttribute> attributes;
+
+    while (p < end) {
+        const char *lt = static_cast<const char*>(memchr(p, '<', end - p));
+        if (!lt) {
+            handler.text(string_view(p, end - p), false);
+            break;
+        }
+        if (lt > p) {
+            handler.text(string_view(p, lt - p), false);
+        }
+        p = lt + 1;
+        if (p == end) {
+            return false;
+        }
+
+        string_view rest(p, end - p);
+        if (*p == '?') {
+            const char *close = findMarker(p, end, "?>");
+            if (!close) return false;
+            p = close + 2;
+        } else if (startsWith(rest, "!--")) {
+            const char *close = findMarker(p + 3, end, "-->");
+            if (!close) return false;
+            p = close + 3;
+        } else if (startsWith(rest, "![CDATA[")) {
+            const char *start = p + 8;
+            const char *close = findMarker(start, end, "]]>");
+            if (!close) return false;
+            handler.text(string_view(start, close - start), true);
+            p = close + 3;
+        } else if (*p == '!') {
+            // A doctype, perhaps with an internal subset
+            int depth = 0;
+            for (; p < end && (*p != '>' || depth > 0); p++) {
+                if (*p == '[') depth++;
+                else if (*p == ']') depth--;
+            }
+            if (p == end) return false;
+            p++;
+        } else if (*p == '/') {
+            const char *start = p + 1;
+            const char *gt = static_cast<const char*>(memchr(start, '>', end - start));
+            if (!gt) return false;
+            const char *nameEnd = start;
+            while (nameEnd < gt && !isSpace(*nameEnd)) nameEnd++;
+            handler.end(string_view(start, nameEnd - start));
+            p = gt + 1;
+        } else {
+            const char *start = p;
+            while (p < end && !isSpace(*p) && *p != '>' && *p != '/') p++;
+            string_view name(start, p - start);
+
+            attributes.clear();
+            bool empty = false;
+            for (;;) {
+                while (p < end && isSpace(*p)) p++;
+                if (p == end) return false;
+                if (*p == '>') {
+                    p++;
+                    break;
+                }
+                if (*p == '/') {
+                    empty = true;
+                    p++;
+                    continue;
+                }
+
+                const char *attrStart = p;
+                while (p < end && *p != '=' && !isSpace(*p) && *p != '>' && *p != '/') p++;
+                string_view attrName(attrStart, p - attrStart);
+                while (p < end && isSpace(*p)) p++;
+                if (p == end || *p != '=') {
+                    continue;
+                }
+                p++;
+                while (p < end && isSpace(*p)) p++;
+                if (p == end || (*p != '"' && *p != '\'')) return false;
+                char quote = *p++;
+                const char *valueEnd = static_cast<const char*>(memchr(p, quote, end - p));
+                if (!valueEnd) return false;
+                attributes.push_back({attrName, string_view(p, valueEnd - p)});
+                p = valueEnd + 1;
+            }
+
+            handler.start(name, attributes);
+            if (empty) {
+                handler.end(name);
+            }
+        }
+    }
+    return true;
+}
+
+// Keywords that are not a translation
+bool untranslated(const vector<XmlAttribute>& attributes)
+{
+    string_view lang = attribute(attributes, "xml:lang");
+    return lang.empty() || lang == "C";
+}
+
+} // anonymous namespace
+
+void AppstreamIndex::Pending::clear()
+{
+    id.clear();
+    package.clear();
+    for (auto& list : lists) {
+        list.clear();
+    }
+}
+
+// ============================================================================
+// Collection XML
+// ============================================================================
+
+/**
+ * Handler of scanXml() for an AppStream collection:
+ *
+ *     <components media_baseurl="...">
+ *       <component>
+ *         <id>, <pkgname>, <bundle type="flatpak">app/ID/ARCH/BRANCH</bundle>
+ *         <categories><category>...
+ *         <keywords><keyword>...
+ *         <screenshots><screenshot type="default"><image type="source">URL
+ */
+class AppstreamIndex::XmlReader {
+public:
+    explicit XmlReader(AppstreamIndex& index) : _index(index) {}
+
+    void start(string_view name, const vector<XmlAttribute>& attributes)
+    {
+        size_t depth = _path.size();
+        string_view parent = depth > 0 ? _path.back() : string_view();
+        _path.push_back(name);
+
+        if (depth == 0 && name == "components") {
+            appendDecoded(_mediaBase, attribute(attributes, "media_baseurl"));
+            return;
+        }
+        if (_component < 0) {
+            if (name == "component") {
+                _component = depth;
+                _pending.clear();
+                _bundleId.clear();
+            }
+            return;
+        }
+        if (_capture >= 0) {
+            return;
+        }
+
+        size_t level = depth - _component;
+        if (level == 1) {
+            if (name == "id") {
+                capture(ID);
+            } else if (name == "pkgname") {
+                capture(PACKAGE);
+            } else if (name == "bundle" && attribute(attributes, "type") == "flatpak") {
+                capture(BUNDLE);
+            } else if (name == "keywords") {
+                _keywordsTranslated = !untranslated(attributes);
+            }
+        } else if (level == 2) {
+            if (name == "category" && parent == "categories") {
+                capture(CATEGORY);
+            } else if (name == "keyword" && parent == "keywords" &&
+                       !_keywordsTranslated && untranslated(attributes)) {
+                capture(KEYWORD);
+            } else if (name == "screenshot" && parent == "screenshots") {
+                _source.clear();
+                _thumbnail.clear();
+                _defaultShot = attribute(attributes, "type") == "default";
+            }
+        } else if (level == 3 && name == "image" && parent == "screenshot") {
+            if (attribute(attributes, "type") == "thumbnail") {
+                if (_thumbnail.empty()) capture(THUMBNAIL);
+            } else if (_source.empty()) {
+                capture(SOURCE);
+            }
+        }
+    }
+
+    void end(string_view name)
+    {
+        if (_path.empty()) {
+            return;
+        }
+        int depth = _path.size() - 1;
+        _path.pop_back();
+
+        if (depth == _capture) {
+            captured();
+            _capture = -1;
+        }
+        if (_component < 0) {
+            return;
+        }
+
+        if (depth == _component + 2 && name == "screenshot") {
+            string url = absoluteUrl(_source.empty() ? _thumbnail : _source, _mediaBase);
+            if (!url.empty()) {
+                auto& shots = _pending.lists[SCREENSHOTS];
+                shots.insert(_defaultShot ? shots.begin() : shots.end(), std::move(url));
+            }
+        } else if (depth == _component) {
+            if (!_bundleId.empty()) {
+                _pending.id = _bundleId;
+            }
+            _index.add(_pending);
+            _component = -1;
+        }
+    }
+
+    void text(string_view raw, bool cdata)
+    {
+        if (_capture < 0) {
+            return;
+        }
+        if (cdata) {
+            _text.append(raw);
+        } else {
+            appendDecoded(_text, raw);
+        }
+    }
+
+private:
+    enum Target { ID, PACKAGE, BUNDLE, CATEGORY, KEYWORD, SOURCE, THUMBNAIL };
+
+    AppstreamIndex& _index;
+    vector<string_view> _path;          // Open elements, outermost first
+    string _mediaBase;
+    Pending _pending;
+    int _component = -1;                // Depth of the open <component>
+    string _bundleId;
+    bool _keywordsTranslated = false;
+    string _source;                     // Images of the open <screenshot>
+    string _thumbnail;
+    bool _defaultShot = false;
+
+    int _capture = -1;                  // Depth of the element read as text
+    Target _target = ID;
+    string _text;
+
+    void capture(Target target)
+    {
+        _capture = _path.size() - 1;
+        _target = target;
+        _text.clear();
+    }
+
+    void captured()
+    {
+        string value(trim(_text));
+        switch (_target) {
+        case ID:
+            _pending.id = std::move(value);
+            break;
+        case PACKAGE:
+            _pending.package = std::move(value);
+            break;
+        case BUNDLE:
+            // app/<id>/<arch>/<branch>; runtimes are not apps
+            if (startsWith(value, "app/")) {
+                _bundleId = value.substr(4, value.find('/', 4) - 4);
+            }
+            break;
+        case CATEGORY:
+            _pending.lists[CATEGORIES].push_back(std::move(value));
+            break;
+        case KEYWORD:
+            _pending.lists[KEYWORDS].push_back(std::move(value));
+            break;
+        case SOURCE:
+            _source = std::move(value);
+            break;
+        case THUMBNAIL:
+            _thumbnail = std::move(value);
+            break;
+        }
+    }
+};
+
+bool AppstreamIndex::addXml(string_view data)
+{
+    XmlReader reader(*this);
+    return scanXml(data, reader);
+}
+
+// ============================================================================
+// DEP-11 YAML
+// ============================================================================
+
+/**
+ * Reader of a DEP-11 file, line by line. Only the block style the
+ * generators write is understood:
+ *
+ *     ---
+ *     MediaBaseUrl: https://...        (header document)
+ *     ---
+ *     ID: org.example.App.desktop
+ *     Package: example
+ *     Categories:
+ *     - Utility
+ *     Keywords:
+ *       C:
+ *       - example
+ *     Screenshots:
+ *     - default: true
+ *       thumbnails:
+ *       - url: path/624x351.png
+ *       source-image:
+ *         url: path/orig.png
+ */
+class AppstreamIndex::YamlReader {
+public:
+    explicit YamlReader(AppstreamIndex& index) : _index(index) {}
+
+    void line(string_view line)
+    {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line == "---" || startsWith(line, "--- ")) {
+            document();
+            return;
+        }
+
+        size_t indent = line.find_first_not_of(' ');
+        if (indent == string_view::npos || line[indent] == '#') {
+            return;
+        }
+        string_view content = line.substr(indent);
+        bool dash = content == "-" || startsWith(content, "- ");
+        if (dash) {
+            content = trim(content.substr(1));
+        }
+
+        if (indent == 0 && !dash) {
+            screenshot();
+            string_view value;
+            _key = string(split(content, value));
+            _lang.clear();
+            _shotIndent = string_view::npos;
+            if (_key == "ID") {
+                _pending.id = unquote(value);
+            } else if (_key == "Package") {
+                _pending.package = unquote(value);
+            } else if (_key == "MediaBaseUrl") {
+                _mediaBase = unquote(value);
+            }
+            return;
+        }
+
+        if (_key == "Categories") {
+            if (dash) {
+                _pending.lists[CATEGORIES].push_back(unquote(content));
+            }
+        } else if (_key == "Keywords") {
+            if (dash) {
+                if (_lang == "C") {
+                    _pending.lists[KEYWORDS].push_back(unquote(content));
+                }
+            } else {
+                string_view value;
+                _lang = string(split(content, value));
+            }
+        } else if (_key == "Screenshots") {
+            screenshotLine(indent, dash, content);
+        }
+    }
+
+    void finish()
+    {
+        document();
+    }
+
+private:
+    AppstreamIndex& _index;
+    Pending _pending;
+    string _mediaBase;
+    string _key;                        // Top-level key of the lines that follow
+    string _lang;                       // Language of the open Keywords block
+
+    size_t _shotIndent = string_view::npos;     // Of the screenshot items' dash
+    bool _inShot = false;
+    string _shotKey;                    // Field of the item the lines are in
+    string _source;
+    string _thumbnail;
+    bool _defaultShot = false;
+
+    void screenshotLine(size_t indent, bool dash, string_view content)
+    {
+        if (dash && (_shotIndent == string_view::npos || indent == _shotIndent)) {
+            screenshot();
+            _inShot = true;
+            _shotIndent = indent;
+            _shotKey.clear();
+            _source.clear();
+            _thumbnail.clear();
+            _defaultShot = false;
+            // The dash carries the item's first field
+            indent += 2;
+            dash = false;
+        }
+        if (!_inShot) {
+            return;
+        }
+
+        string_view value;
+        string_view key = split(content, value);
+        if (!dash && indent == _shotIndent + 2) {
+            _shotKey = string(key);
+            if (key == "default") {
+                _defaultShot = value == "true" || value == "yes";
+            }
+            return;
+        }
+        if (key == "url") {
+            if (_shotKey == "source-image" && _source.empty()) {
+                _source = unquote(value);
+            } else if (_shotKey == "thumbnails" && _thumbnail.empty()) {
+                _thumbnail = unquote(value);
+            }
+        }
+    }
+
+    void screenshot()
+    {
+        if (!_inShot) {
+            return;
+        }
+        _inShot = false;
+        string url = absoluteUrl(_source.empty() ? _thumbnail : _source, _mediaBase);
+        if (!url.empty()) {
+            auto& shots = _pending.lists[SCREENSHOTS];
+            shots.insert(_defaultShot ? shots.begin() : shots.end(), std::move(url));
+        }
+    }
+
+    void document()
+    {
+        screenshot();
+        _index.add(_pending);
+        _pending.clear();
+        _key.clear();
+        _lang.clear();
+        _shotIndent = string_view::npos;
+    }
+
+    // "key: value" into its key, with value set to the trimmed rest
+    static string_view split(string_view content, string_view& value)
+    {
+        size_t colon = content.find(": ");
+        if (colon == string_view::npos) {
+            value = string_view();
+            if (!content.empty() && content.back() == ':') {
+                content.remove_suffix(1);
+            }
+            return trim(content);
+        }
+        value = trim(content.substr(colon + 2));
+        return trim(content.substr(0, colon));
+    }
+
+    static string unquote(string_view value)
+    {
+        value = trim(value);
+        if (value.size() >= 2 && (value.front() == '\'' || value.front() == '"') &&
+            value.back() == value.front()) {
+            value = value.substr(1, value.size() - 2);
+        }
+        return string(value);
+    }
+};
+
+bool AppstreamIndex::addYaml(string_view data)
+{
+    YamlReader reader(*this);
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == string_view::npos) {
+            end = data.size();
+        }
+        reader.line(data.substr(start, end - start));
+        start = end + 1;
+    }
+    reader.finish();
+    return true;
+}
+
+// ============================================================================
+// Building
+// ============================================================================
+
+bool AppstreamIndex::addFile(const string& path)
+{
+    string_view name(path);
+    bool gzipped = endsWith(name, ".gz");
+    if (gzipped) {
+        name.remove_suffix(3);
+    }
+    bool xml = endsWith(name, ".xml");
+    if (!xml && !endsWith(name, ".yml") && !endsWith(name, ".yaml")) {
+        return false;
+    }
+
+    MappedFile file(path);
+    if (!file.ok()) {
+        return false;
+    }
+    if (!gzipped) {
+        return xml ? addXml(file.data()) : addYaml(file.data());
+    }
+
+#ifdef HAVE_ZLIB
+    string data;
+    if (!gunzip(file.data(), data)) {
+        return false;
+    }
+    return xml ? addXml(data) : addYaml(data);
+#else
+    return false;
+#endif
+}
+
+string_view AppstreamIndex::canonicalId(string_view id)
+{
+    id = trim(id);
+    if (endsWith(id, ".desktop")) {
+        id.remove_suffix(8);
+    }
+    return id;
+}
+
+AppstreamIndex::Span AppstreamIndex::store(const string& s)
+{
+    Span span;
+    span.offset = _text.size();
+    span.length = s.size();
+    _text += s;
+    return span;
+}
+
+AppstreamIndex::Span AppstreamIndex::intern(const string& s)
+{
+    auto it = _interned.find(s);
+    if (it != _interned.end()) {
+        return it->second;
+    }
+    Span span = store(s);
+    _interned.emplace(s, span);
+    return span;
+}
+
+void AppstreamIndex::add(Pending& component)
+{
+    string id(canonicalId(component.id));
+    if (id.empty() || !_seen.insert(id).second) {
+        return;
+    }
+
+    Record record;
+    record.id = store(id);
+    record.package = store(component.package);
+    record.items = _items.size();
+    for (int list = 0; list < LIST_COUNT; list++) {
+        // Categories and keywords repeat across components, URLs do not
+        bool repeats = list != SCREENSHOTS;
+        uint8_t count = 0;
+        for (const auto& item : component.lists[list]) {
+            if (count == MAX_ITEMS) {
+                break;
+            }
+            if (!item.empty()) {
+                _items.push_back(repeats ? intern(item) : store(item));
+                count++;
+            }
+        }
+        record.counts[list] = count;
+    }
+    _records.push_back(record);
+}
+
+void AppstreamIndex::finish()
+{
+    sort(_records.begin(), _records.end(), [this](const Record& a, const Record& b) {
+        return view(a.id) < view(b.id);
+    });
+
+    _byPackage.clear();
+    for (uint32_t i = 0; i < _records.size(); i++) {
+        if (_records[i].package.length > 0) {
+            _byPackage.push_back(i);
+        }
+    }
+    stable_sort(_byPackage.begin(), _byPackage.end(), [this](uint32_t a, uint32_t b) {
+        return view(_records[a].package) < view(_records[b].package);
+    });
+
+    unordered_map<string, Span>().swap(_interned);
+    unordered_set<string>().swap(_seen);
+    _text.shrink_to_fit();
+    _items.shrink_to_fit();
+    _records.shrink_to_fit();
+}
+
+size_t AppstreamIndex::memoryBytes() const
+{
+    return sizeof(*this) + _text.capacity() + _items.capacity() * sizeof(Span) +
+           _records.capacity() * sizeof(Record) + _byPackage.capacity() * sizeof(uint32_t);
+}
+
+// ============================================================================
+// Lookups
+// ============================================================================
+
+AppstreamIndex::Component AppstreamIndex::find(string_view id) const
+{
+    id = canonicalId(id);
+    auto it = lower_bound(_records.begin(), _records.end(), id,
+        [this](const Record& r, string_view key) { return view(r.id) < key; });
+    if (it == _records.end() || view(it->id) != id) {
+        return Component();
+    }
+    return Component(this, &*it);
+}
+
+AppstreamIndex::Component AppstreamIndex::findPackage(string_view name) const
+{
+    auto it = lower_bound(_byPackage.begin(), _byPackage.end(), name,
+        [this](uint32_t r, string_view key) { return view(_records[r].package) < key; });
+    if (name.empty() || it == _byPackage.end() || view(_records[*it].package) != name) {
+        return Component();
+    }
+    return Component(this, &_records[*it]);
+}
+
+AppstreamIndex::Component AppstreamIndex::lookup(const PackageInfo& info) const
+{
+    switch (info.backend) {
+    case BackendType::FLATPAK:
+        return find(info.id);
+    case BackendType::APT:
+        return findPackage(info.name);
+    default:
+        return Component();
+    }
+}
+
+void AppstreamIndex::enrich(PackageInfo& info) const
+{
+    Component component = lookup(info);
+    if (!component) {
+        return;
+    }
+    if (info.keywords.empty()) {
+        info.keywords = component.joined(KEYWORDS, ' ');
+    }
+    if (info.section.empty() && component.count(CATEGORIES) > 0) {
+        info.section = component.joined(CATEGORIES, ';');
+    }
+}
+
+string_view AppstreamIndex::Component::id() const
+{
+    return _index->view(static_cast<const Record*>(_record)->id);
+}
+
+string_view AppstreamIndex::Component::package() const
+{
+    return _index->view(static_cast<const Record*>(_record)->package);
+}
+
+size_t AppstreamIndex::Component::count(List list) const
+{
+    return static_cast<const Record*>(_record)->counts[list];
+}
+
+string_view AppstreamIndex::Component::item(List list, size_t i) const
+{
+    const Record *record = static_cast<const Record*>(_record);
+    size_t at = record->items + i;
+    for (int l = 0; l < list; l++) {
+        at += record->counts[l];
+    }
+    return _index->view(_index->_items[at]);
+}
+
+string AppstreamIndex::Component::joined(List list, char sep) const
+{
+    string result;
+    for (size_t i = 0; i < count(list); i++) {
+        if (i > 0) result += sep;
+        result.append(item(list, i));
+    }
+    return result;
+}
+
+// ============================================================================
+// Catalogs On Disk
+// ============================================================================
+
+vector<string> AppstreamIndex::catalogFiles()
+{
+    vector<string> files;
+    set<string> targets;
+
+    // <installation>/appstream/<remote>/<arch>/active/appstream.xml
+    for (auto scope : {FlatpakBackend::Scope::USER, FlatpakBackend::Scope::SYSTEM}) {
+        string base = FlatpakBackend::installationPath(scope);
+        if (base.empty()) {
+            continue;
+        }
+        string appstream = base + "/appstream";
+        for (const auto& remote : directoryEntries(appstream)) {
+            for (const auto& arch : directoryEntries(appstream + "/" + remote)) {
+                addCatalogs(appstream + "/" + remote + "/" + arch + "/active", files, targets);
+            }
+        }
+    }
+
+    for (const char *dir : DISTRIBUTION_DIRS) {
+        addCatalogs(dir, files, targets);
+    }
+    return files;
+}
+
+namespace {
+
+struct SharedIndex {
+    mutex buildMutex;                   // Held while checking and building
+    string stamp;
+    std::chrono::steady_clock::time_point checkedAt;
+
+    mutex indexMutex;
+    shared_ptr<const AppstreamIndex> index;
+
+    shared_ptr<const AppstreamIndex> current()
+    {
+        lock_guard<mutex> lock(indexMutex);
+        return index;
+    }
+};
+
+// Function-local so it is ready for users during static initialization
+SharedIndex& sharedIndex()
+{
+    static SharedIndex state;
+    return state;
+}
+
+} // anonymous namespace
+
+shared_ptr<const AppstreamIndex> AppstreamIndex::shared()
+{
+    SharedIndex& state = sharedIndex();
+
+    // Concurrent callers wait for one build
+    lock_guard<mutex> lock(state.buildMutex);
+    shared_ptr<const AppstreamIndex> index = state.current();
+    auto now = std::chrono::steady_clock::now();
+    if (index && now - state.checkedAt < std::chrono::seconds(RECHECK_SECONDS)) {
+        return index;
+    }
+
+    vector<string> files = catalogFiles();
+    string stamp;
+    for (const auto& file : files) {
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0) {
+            stamp += file + "@" + to_string(st.st_size) + "." +
+                     to_string(st.st_mtim.tv_sec) + "." + to_string(st.st_mtim.tv_nsec) + ";";
+        }
+    }
+
+    if (!index || stamp != state.stamp) {
+        auto built = make_shared<AppstreamIndex>();
+        for (const auto& file : files) {
+            built->addFile(file);
+        }
+        built->finish();
+        index = built;
+        state.stamp = stamp;
+
+        lock_guard<mutex> swap(state.indexMutex);
+        state.index = index;
+    }
+    // Counted from the end of the build, which may itself take a while
+    state.checkedAt = std::chrono::steady_clock::now();
+    return index;
+}
+
+shared_ptr<const AppstreamIndex> AppstreamIndex::peek()
+{
+    static const shared_ptr<const AppstreamIndex> empty = make_shared<AppstreamIndex>();
+    shared_ptr<const AppstreamIndex> index = sharedIndex().current();
+    return index ? index : empty;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
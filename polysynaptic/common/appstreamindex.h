@@ -0,0 +1,216 @@
+/* appstreamindex.h - Categories, keywords and screenshots from AppStream
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the table of store metadata the backends do
+ * not report themselves. The AppStream catalogs the distribution and
+ * the Flatpak remotes already keep on disk describe every component
+ * with its categories, keywords and screenshots; here they are mapped
+ * and scanned once, in a single pass per file, into a compact table
+ * keyed by component id and package name, instead of each package
+ * being asked for them with another CLI call.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _APPSTREAMINDEX_H_
+#define _APPSTREAMINDEX_H_
+
+#include "ipackagebackend.h"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace PolySynaptic {
+
+/**
+ * AppstreamIndex - Per-component metadata from the AppStream catalogs
+ *
+ *     shared_ptr<const AppstreamIndex> appstream = AppstreamIndex::shared();
+ *     AppstreamIndex::Component c = appstream->lookup(info);
+ *     for (size_t i = 0; c && i < c.count(AppstreamIndex::KEYWORDS); i++)
+ *         ... c.item(AppstreamIndex::KEYWORDS, i) ...
+ *
+ * Catalogs are collection XML (*.xml) or DEP-11 YAML (*.yml); either
+ * may be gzipped if PolySynaptic was built with zlib. Uncompressed
+ * files are memory-mapped and scanned in place. Only untranslated
+ * keywords are kept, and one image per screenshot - the source image,
+ * or the first thumbnail if there is none - with the catalog's media
+ * base URL applied. A component listed by several catalogs keeps the
+ * entry of the first file added.
+ *
+ * Strings live in one shared text block, and a category or keyword is
+ * stored once however many components list it, so the table costs
+ * little more than the text it holds.
+ *
+ * Thread Safety:
+ *   Building is single-threaded; after finish() the index is read-only
+ *   and may be read from any thread.
+ */
+class AppstreamIndex {
+public:
+    enum List : uint8_t {
+        CATEGORIES,
+        KEYWORDS,
+        SCREENSHOTS,        // Image URLs, the default screenshot first
+        LIST_COUNT
+    };
+
+    // Longest list kept per component and kind
+    static constexpr size_t MAX_ITEMS = 255;
+
+    /**
+     * Component - One entry of the index, valid as long as the index
+     */
+    class Component {
+    public:
+        Component() = default;
+
+        explicit operator bool() const { return _record != nullptr; }
+
+        string_view id() const;
+        string_view package() const;    // Distribution package, "" if none
+
+        size_t count(List list) const;
+        string_view item(List list, size_t i) const;
+
+        /**
+         * The items of a list separated by sep
+         */
+        string joined(List list, char sep) const;
+
+    private:
+        friend class AppstreamIndex;
+
+        Component(const AppstreamIndex* index, const void* record)
+            : _index(index), _record(record) {}
+
+        const AppstreamIndex* _index = nullptr;
+        const void* _record = nullptr;
+    };
+
+    AppstreamIndex() = default;
+
+    AppstreamIndex(const AppstreamIndex&) = delete;
+    AppstreamIndex& operator=(const AppstreamIndex&) = delete;
+
+    /**
+     * Add the components of a catalog file, by its extension
+     *
+     * @return false if the file could not be read or is not a catalog
+     */
+    bool addFile(const string& path);
+
+    /**
+     * Add the components of a catalog in memory
+     */
+    bool addXml(string_view data);
+    bool addYaml(string_view data);
+
+    /**
+     * Sort the table for lookups; call once, after the last add
+     */
+    void finish();
+
+    /**
+     * The component with this id; a ".desktop" suffix on either side
+     * is ignored
+     */
+    Component find(string_view id) const;
+
+    /**
+     * The component shipped in this distribution package
+     */
+    Component findPackage(string_view name) const;
+
+    /**
+     * The component describing a backend's package: Flatpak packages
+     * by app id, APT packages by name; Snap has no AppStream catalog
+     */
+    Component lookup(const PackageInfo& info) const;
+
+    /**
+     * Fill in the package's keywords and section (categories joined by
+     * ';') where its backend left them empty
+     */
+    void enrich(PackageInfo& info) const;
+
+    size_t size() const { return _records.size(); }
+    bool empty() const { return _records.empty(); }
+    size_t memoryBytes() const;
+
+    /**
+     * The catalogs on this system, the Flatpak remotes' (user before
+     * system installation) before the distribution's
+     */
+    static vector<string> catalogFiles();
+
+    /**
+     * The index of catalogFiles(), rebuilt when one of them changed;
+     * the files are checked at most every RECHECK_SECONDS
+     */
+    static shared_ptr<const AppstreamIndex> shared();
+
+    /**
+     * The index shared() last returned, without looking at the files
+     * or building it; an empty index before the first shared()
+     */
+    static shared_ptr<const AppstreamIndex> peek();
+
+    static constexpr int RECHECK_SECONDS = 10;
+
+private:
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct Record {
+        Span id;
+        Span package;
+        uint32_t items = 0;                 // First of its entries in _items
+        uint8_t counts[LIST_COUNT] = {};
+    };
+
+    // A component while its catalog is scanned
+    struct Pending {
+        string id;
+        string package;
+        vector<string> lists[LIST_COUNT];
+
+        void clear();
+    };
+
+    string _text;                           // All strings, those of lists once
+    vector<Span> _items;                    // The lists of all records
+    vector<Record> _records;                // Sorted by id after finish()
+    vector<uint32_t> _byPackage;            // Record indexes by package
+
+    // Only while building
+    unordered_map<string, Span> _interned;
+    unordered_set<string> _seen;
+
+    class XmlReader;
+    class YamlReader;
+
+    void add(Pending& component);
+    Span store(const string& s);
+    Span intern(const string& s);       // store() once per distinct string
+    string_view view(const Span& span) const {
+        return string_view(_text).substr(span.offset, span.length);
+    }
+
+    static string_view canonicalId(string_view id);
+};
+
+} // namespace PolySynaptic
+
+#endif // _APPSTREAMINDEX_H_
+
+// vim:ts=4:sw=4:et
@@ -13,10 +13,14 @@
 #include "rsources.h"
 
 #include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
 #include <apt-pkg/pkgcache.h>
 
 #include <regex>
 #include <sstream>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 namespace PolySynaptic {
 
@@ -26,10 +30,27 @@ namespace PolySynaptic {
 
 AptBackend::AptBackend(RPackageLister* lister)
     : _lister(lister)
+    , _textScanGeneration(0)
 {
     if (!_lister) {
         _unavailableReason = "No package lister provided";
     }
+
+    // A trimmed scan is rebuilt by the next search that needs it
+    _textScanAccount.assign("search text",
+        [this](MemoryUsage& usage) {
+            lock_guard<mutex> lock(_textScanMutex);
+            if (_textScan) {
+                usage.bytes = _textScan->memoryBytes();
+                usage.items = _textScan->size();
+            }
+        },
+        [this]() {
+            lock_guard<mutex> lock(_textScanMutex);
+            uint64_t freed = _textScan ? _textScan->memoryBytes() : 0;
+            _textScan.reset();
+            return freed;
+        });
 }
 
 AptBackend::~AptBackend()
@@ -75,26 +96,59 @@ vector<PackageInfo> AptBackend::searchPackages(
     const SearchOptions& options,
     ProgressCallback progress)
 {
-    lock_guard<mutex> lock(_mutex);
+    shared_lock<shared_mutex> lock(_mutex);
     vector<PackageInfo> results;
 
     if (!_lister) {
         return results;
     }
 
-    // Use existing Synaptic search functionality
-    // limitBySearch() sets up the filter and populates _viewPackages
-    if (!options.query.empty()) {
-        _lister->limitBySearch(options.query);
+    // The Xapian index if there is one, otherwise the built-in scan of
+    // names and summaries; neither touches the lister's view, so the
+    // classic view and other searches can run at the same time
+    // installedOnly/availableOnly drop hits below, so the limit can
+    // only be pushed down when neither is set
+    unsigned limit = (options.installedOnly || options.availableOnly)
+        ? 0 : options.maxResults;
+    vector<RPackage*> candidates;
+    if (options.query.empty()) {
+        int count = _lister->packagesSize();
+        for (int i = 0; i < count; i++) {
+            RPackage* pkg = _lister->getPackage(i);
+            if (pkg) candidates.push_back(pkg);
+        }
+    } else if (!_lister->searchPackages(options.query, candidates, limit)) {
+        vector<string> terms;
+        istringstream words(options.query);
+        string word;
+        while (words >> word) {
+            terms.push_back(word);
+        }
+        vector<RTextScan::Hit> hits;
+        textScan()->search(terms, limit, hits);
+        candidates.clear();
+        for (const auto& hit : hits) {
+            RPackage* pkg = _lister->getPackage(hit.id);
+            if (pkg) candidates.push_back(pkg);
+        }
     }
 
-    int total = _lister->viewPackagesSize();
-    int current = 0;
+    int total = candidates.size();
     int added = 0;
+    const string status = "Searching APT packages...";
 
     for (int i = 0; i < total && (options.maxResults == 0 || added < options.maxResults); i++) {
-        RPackage* pkg = _lister->getViewPackage(i);
-        if (!pkg) continue;
+        // Asked every few hundred packages, not per package
+        if ((i & 0xff) == 0) {
+            if (options.isCancelled && options.isCancelled()) {
+                break;
+            }
+            if (progress && !progress(static_cast<double>(i) / total, status)) {
+                break;
+            }
+        }
+
+        RPackage* pkg = candidates[i];
 
         // Apply installed/available filters
         int flags = pkg->getFlags();
@@ -103,19 +157,10 @@ vector<PackageInfo> AptBackend::searchPackages(
         if (options.installedOnly && !isInstalled) continue;
         if (options.availableOnly && isInstalled) continue;
 
-        // Convert to PackageInfo
-        PackageInfo info = rpackageToPackageInfo(pkg);
+        // Convert to PackageInfo; the list only needs the cheap fields
+        PackageInfo info = rpackageToPackageInfo(pkg, true);
         results.push_back(info);
         added++;
-
-        // Report progress
-        if (progress) {
-            double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Searching APT packages...")) {
-                break;  // Cancelled
-            }
-        }
-        current++;
     }
 
     return results;
@@ -124,7 +169,7 @@ vector<PackageInfo> AptBackend::searchPackages(
 vector<PackageInfo> AptBackend::getInstalledPackages(
     ProgressCallback progress)
 {
-    lock_guard<mutex> lock(_mutex);
+    shared_lock<shared_mutex> lock(_mutex);
     vector<PackageInfo> results;
 
     if (!_lister) {
@@ -133,6 +178,7 @@ vector<PackageInfo> AptBackend::getInstalledPackages(
 
     int total = _lister->packagesSize();
     int current = 0;
+    const string status = "Loading installed APT packages...";
 
     for (int i = 0; i < total; i++) {
         RPackage* pkg = _lister->getPackage(i);
@@ -140,14 +186,14 @@ vector<PackageInfo> AptBackend::getInstalledPackages(
 
         int flags = pkg->getFlags();
         if (flags & RPackage::FInstalled) {
-            PackageInfo info = rpackageToPackageInfo(pkg);
+            PackageInfo info = rpackageToPackageInfo(pkg, true);
             results.push_back(info);
         }
 
         // Report progress periodically
         if (progress && (current % 100 == 0)) {
             double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Loading installed APT packages...")) {
+            if (!progress(pct, status)) {
                 break;
             }
         }
@@ -157,9 +203,41 @@ vector<PackageInfo> AptBackend::getInstalledPackages(
     return results;
 }
 
+shared_ptr<const RTextScan> AptBackend::textScan()
+{
+    lock_guard<mutex> lock(_textScanMutex);
+    unsigned long generation = _lister->getCacheGeneration();
+    if (_textScan && _textScanGeneration == generation) {
+        return _textScan;
+    }
+
+    // Ids are lister positions, which stay the same until the next open
+    auto scan = make_shared<RTextScan>();
+    int count = _lister->packagesSize();
+    vector<RPackage*> packages(count);
+    for (int i = 0; i < count; i++) {
+        packages[i] = _lister->getPackage(i);
+    }
+
+    // Every summary at once, read in file order rather than by name
+    vector<string> summaries(count);
+    RPackage::readRecords(packages, true,
+                          [&summaries](unsigned int i, const RRecord& record) {
+        summaries[i] = record.shortDescription();
+    });
+
+    scan->reserve(count, count * 64);
+    for (int i = 0; i < count; i++) {
+        scan->add(packages[i] ? packages[i]->name() : "", summaries[i].c_str());
+    }
+    _textScan = scan;
+    _textScanGeneration = generation;
+    return _textScan;
+}
+
 PackageInfo AptBackend::getPackageDetails(const string& packageId)
 {
-    lock_guard<mutex> lock(_mutex);
+    lock_guard<shared_mutex> lock(_mutex);
     PackageInfo info;
 
     if (!_lister || !isValidPackageName(packageId)) {
@@ -174,9 +252,73 @@ PackageInfo AptBackend::getPackageDetails(const string& packageId)
     return info;
 }
 
+void AptBackend::resolveDeferredFields(PackageInfo& info, unsigned fields)
+{
+    lock_guard<shared_mutex> lock(_mutex);
+
+    if (!_lister) return;
+
+    // Look up by name rather than keeping the RPackage: a cache reopen
+    // after a commit replaces every RPackage the list might still point at
+    RPackage* pkg = _lister->getPackage(info.id);
+    if (!pkg) return;
+
+    if (fields & PackageInfo::DEFER_SUMMARY) {
+        const char* summary = pkg->summary();
+        info.summary = summary ? summary : "";
+    }
+    if (fields & PackageInfo::DEFER_DESCRIPTION) {
+        const char* desc = pkg->description();
+        info.description = desc ? desc : "";
+    }
+    if (fields & PackageInfo::DEFER_HOMEPAGE) {
+        const char* homepage = pkg->homepage();
+        info.homepage = homepage ? homepage : "";
+    }
+    if (fields & PackageInfo::DEFER_MAINTAINER) {
+        const char* maintainer = pkg->maintainer();
+        info.maintainer = maintainer ? maintainer : "";
+    }
+}
+
+void AptBackend::forEachSection(
+    const function<void(const char* name, const char* section)>& fn)
+{
+    shared_lock<shared_mutex> lock(_mutex);
+
+    if (!_lister) return;
+
+    int total = _lister->packagesSize();
+    for (int i = 0; i < total; i++) {
+        RPackage* pkg = _lister->getPackage(i);
+        if (!pkg) continue;
+        const char* section = pkg->section();
+        fn(pkg->name(), section ? section : "");
+    }
+}
+
+vector<PackageInfo> AptBackend::getPackages(const vector<string>& names)
+{
+    shared_lock<shared_mutex> lock(_mutex);
+    vector<PackageInfo> results;
+
+    if (!_lister) {
+        return results;
+    }
+
+    results.reserve(names.size());
+    for (const auto& name : names) {
+        RPackage* pkg = _lister->getPackage(name);
+        if (pkg) {
+            results.push_back(rpackageToPackageInfo(pkg, true));
+        }
+    }
+    return results;
+}
+
 InstallStatus AptBackend::getInstallStatus(const string& packageId)
 {
-    lock_guard<mutex> lock(_mutex);
+    shared_lock<shared_mutex> lock(_mutex);
 
     if (!_lister || !isValidPackageName(packageId)) {
         return InstallStatus::UNKNOWN;
@@ -193,7 +335,7 @@ InstallStatus AptBackend::getInstallStatus(const string& packageId)
 vector<PackageInfo> AptBackend::getUpgradablePackages(
     ProgressCallback progress)
 {
-    lock_guard<mutex> lock(_mutex);
+    shared_lock<shared_mutex> lock(_mutex);
     vector<PackageInfo> results;
 
     if (!_lister) {
@@ -202,6 +344,7 @@ vector<PackageInfo> AptBackend::getUpgradablePackages(
 
     int total = _lister->packagesSize();
     int current = 0;
+    const string status = "Checking for APT updates...";
 
     for (int i = 0; i < total; i++) {
         RPackage* pkg = _lister->getPackage(i);
@@ -210,14 +353,14 @@ vector<PackageInfo> AptBackend::getUpgradablePackages(
         int flags = pkg->getFlags();
         // Package is installed and has an outdated version
         if ((flags & RPackage::FInstalled) && (flags & RPackage::FOutdated)) {
-            PackageInfo info = rpackageToPackageInfo(pkg);
+            PackageInfo info = rpackageToPackageInfo(pkg, true);
             info.installStatus = InstallStatus::UPDATE_AVAILABLE;
             results.push_back(info);
         }
 
         if (progress && (current % 100 == 0)) {
             double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Checking for APT updates...")) {
+            if (!progress(pct, status)) {
                 break;
             }
         }
@@ -291,6 +434,110 @@ OperationResult AptBackend::updatePackage(
     return installPackage(packageId, progress);
 }
 
+OperationResult AptBackend::installPackageVersion(
+    const string& packageId,
+    const string& target,
+    ProgressCallback progress)
+{
+    if (!_lister) {
+        return OperationResult::Failure("APT backend not initialized");
+    }
+
+    if (!isValidPackageName(packageId)) {
+        return OperationResult::Failure("Invalid package name: " + packageId);
+    }
+
+    lock_guard<shared_mutex> lock(_mutex);
+
+    RPackage* pkg = findPackageByName(packageId);
+    if (!pkg) {
+        return OperationResult::Failure("Package not found: " + packageId);
+    }
+
+    if (!pkg->setVersion(target)) {
+        return OperationResult::Failure("Version " + target + " of " + packageId +
+                                        " is not available");
+    }
+    pkg->setInstall();
+
+    return OperationResult::Success("Package marked for installation: " + packageId +
+                                    " " + target);
+}
+
+AptBackend::MarkGroup::MarkGroup(AptBackend& backend)
+{
+    if (backend._lister) {
+        _batch.reset(new RPackageLister::MarkBatch(backend._lister));
+    }
+}
+
+OperationResult AptBackend::markPackages(
+    const vector<string>& packageIds,
+    const function<void(RPackage*)>& mark,
+    const string& action)
+{
+    if (!_lister) {
+        return OperationResult::Failure("APT backend not initialized");
+    }
+
+    lock_guard<shared_mutex> lock(_mutex);
+
+    vector<RPackage*> pkgs;
+    pkgs.reserve(packageIds.size());
+    for (const auto& id : packageIds) {
+        if (!isValidPackageName(id)) {
+            return OperationResult::Failure("Invalid package name: " + id);
+        }
+        RPackage* pkg = findPackageByName(id);
+        if (!pkg) {
+            return OperationResult::Failure("Package not found: " + id);
+        }
+        pkgs.push_back(pkg);
+    }
+
+    // The batch defers the auto-removal sweep and the resolver until
+    // every mark is set, and notifies the lister's observers once,
+    // instead of doing all three per package
+    {
+        RPackageLister::MarkBatch batch(_lister);
+        for (auto* pkg : pkgs) {
+            mark(pkg);
+        }
+    }
+
+    return OperationResult::Success(
+        to_string(pkgs.size()) + " packages marked for " + action);
+}
+
+OperationResult AptBackend::installPackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    return markPackages(packageIds,
+                        [](RPackage* pkg) { pkg->setInstall(); },
+                        "installation");
+}
+
+OperationResult AptBackend::removePackages(
+    const vector<string>& packageIds,
+    bool purge,
+    ProgressCallback progress)
+{
+    return markPackages(packageIds,
+                        [purge](RPackage* pkg) { pkg->setRemove(purge); },
+                        "removal");
+}
+
+OperationResult AptBackend::updatePackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    // As with updatePackage(), updating means installing the candidate
+    return markPackages(packageIds,
+                        [](RPackage* pkg) { pkg->setInstall(); },
+                        "upgrade");
+}
+
 OperationResult AptBackend::refreshCache(ProgressCallback progress)
 {
     if (!_lister) {
@@ -345,6 +592,69 @@ OperationResult AptBackend::removeRepository(const string& repo)
         "Repository management should be done through the Repositories dialog");
 }
 
+// ============================================================================
+// Pre-download
+// ============================================================================
+
+// Idle CPU and I/O priority for the calling thread, and so for the
+// acquire methods it starts, as long as it lives; the way
+// Subprocess::Options::lowPriority runs a command
+class LowPriorityScope {
+public:
+    LowPriorityScope()
+        : _tid(syscall(SYS_gettid))
+        , _nice(getpriority(PRIO_PROCESS, _tid))
+        , _ioprio(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, _tid))
+    {
+        setpriority(PRIO_PROCESS, _tid, 19);
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, _tid, IOPRIO_IDLE);
+    }
+    ~LowPriorityScope()
+    {
+        setpriority(PRIO_PROCESS, _tid, _nice);
+        if (_ioprio >= 0) {
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, _tid, _ioprio);
+        }
+    }
+
+private:
+    static const int IOPRIO_WHO_PROCESS = 1;
+    static const int IOPRIO_IDLE = 3 << 13;     // Class 3, no data
+    pid_t _tid;
+    int _nice;
+    long _ioprio;
+};
+
+OperationResult AptBackend::predownloadUpdates(
+    const vector<string>& packageIds,
+    const function<bool()>& cancelled,
+    int rateLimitKBps)
+{
+    if (packageIds.empty()) {
+        return OperationResult::Success("Nothing to download");
+    }
+    if (_config->FindB("Synaptic::CleanCache", false)) {
+        return OperationResult::Failure(
+            "The package cache is emptied after every commit; not downloading ahead");
+    }
+    if (geteuid() != 0) {
+        return OperationResult::Failure("Downloading into the package cache needs root");
+    }
+
+    // In this process: running as root the lister holds the system
+    // lock for the whole session, so apt-get would find it taken
+    LowPriorityScope lowPriority;
+    string error;
+    if (!_lister->fetchArchives(packageIds, cancelled, rateLimitKBps, error)) {
+        if (cancelled && cancelled()) {
+            return OperationResult::Failure("Download cancelled");
+        }
+        return OperationResult::Failure("Failed to download APT updates", error);
+    }
+    return OperationResult::Success(
+        "Downloaded " + to_string(packageIds.size()) + " package updates");
+}
+
 // ============================================================================
 // APT-Specific Methods
 // ============================================================================
@@ -365,7 +675,7 @@ RPackage* AptBackend::findPackageByName(const string& name)
     return nullptr;
 }
 
-PackageInfo AptBackend::rpackageToPackageInfo(RPackage* pkg)
+PackageInfo AptBackend::rpackageToPackageInfo(RPackage* pkg, bool deferText)
 {
     PackageInfo info;
 
@@ -375,12 +685,24 @@ PackageInfo AptBackend::rpackageToPackageInfo(RPackage* pkg)
     info.id = pkg->name();
     info.name = pkg->name();
 
-    // Summary and description
-    const char* summary = pkg->summary();
-    info.summary = summary ? summary : "";
+    // Summary, description, homepage and maintainer each cost a record
+    // lookup; list results fetch them on first display instead
+    if (deferText) {
+        info.deferredFields = PackageInfo::DEFER_ALL;
+        info.deferredSource = this;
+    } else {
+        const char* summary = pkg->summary();
+        info.summary = summary ? summary : "";
+
+        const char* desc = pkg->description();
+        info.description = desc ? desc : "";
 
-    const char* desc = pkg->description();
-    info.description = desc ? desc : "";
+        const char* homepage = pkg->homepage();
+        info.homepage = homepage ? homepage : "";
+
+        const char* maintainer = pkg->maintainer();
+        info.maintainer = maintainer ? maintainer : "";
+    }
 
     // Versions
     const char* availVer = pkg->availableVersion();
@@ -396,12 +718,6 @@ PackageInfo AptBackend::rpackageToPackageInfo(RPackage* pkg)
     const char* section = pkg->section();
     info.section = section ? section : "";
 
-    const char* homepage = pkg->homepage();
-    info.homepage = homepage ? homepage : "";
-
-    const char* maintainer = pkg->maintainer();
-    info.maintainer = maintainer ? maintainer : "";
-
     // Sizes
     info.downloadSize = pkg->availablePackageSize();
     info.installedSize = pkg->availableInstalledSize();
@@ -449,7 +765,7 @@ OperationResult AptBackend::commitChanges(ProgressCallback progress)
 
 vector<PackageInfo> AptBackend::getMarkedPackages()
 {
-    lock_guard<mutex> lock(_mutex);
+    lock_guard<shared_mutex> lock(_mutex);
     vector<PackageInfo> results;
 
     if (!_lister) return results;
@@ -463,7 +779,7 @@ vector<PackageInfo> AptBackend::getMarkedPackages()
         if ((flags & RPackage::FInstall) ||
             (flags & RPackage::FRemove) ||
             (flags & RPackage::FUpgrade)) {
-            results.push_back(rpackageToPackageInfo(pkg));
+            results.push_back(rpackageToPackageInfo(pkg, true));
         }
     }
 
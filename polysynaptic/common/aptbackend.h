@@ -21,11 +21,14 @@
 #include "rpackage.h"
 #include "rpackagelister.h"
 #include "rpackagecache.h"
+#include "rtextscan.h"
 
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/version.h>
 
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 
 namespace PolySynaptic {
 
@@ -87,6 +90,8 @@ public:
     vector<PackageInfo> getUpgradablePackages(
         ProgressCallback progress = nullptr) override;
 
+    void resolveDeferredFields(PackageInfo& info, unsigned fields) override;
+
     // ========================================================================
     // Package Operations
     // ========================================================================
@@ -107,6 +112,44 @@ public:
     OperationResult refreshCache(
         ProgressCallback progress = nullptr) override;
 
+    // ========================================================================
+    // Batch Operations
+    // ========================================================================
+
+    OperationResult installPackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult removePackages(
+        const vector<string>& packageIds,
+        bool purge = false,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult updatePackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    // Marks the given version (e.g. "2.4.1-1") as candidate and installs it
+    OperationResult installPackageVersion(
+        const string& packageId,
+        const string& target,
+        ProgressCallback progress = nullptr) override;
+
+    /**
+     * MarkGroup - One lister mark batch over a run of marks
+     *
+     * Every mark set while it lives, through any number of calls, shares
+     * a single auto-removal sweep, resolver run and change notification
+     * when it goes away (see RPackageLister::MarkBatch).
+     */
+    class MarkGroup {
+    public:
+        explicit MarkGroup(AptBackend& backend);
+
+    private:
+        unique_ptr<RPackageLister::MarkBatch> _batch;
+    };
+
     // ========================================================================
     // Repository Management
     // ========================================================================
@@ -116,6 +159,21 @@ public:
     OperationResult addRepository(const string& repo) override;
     OperationResult removeRepository(const string& repo) override;
 
+    // ========================================================================
+    // Pre-download
+    // ========================================================================
+
+    /**
+     * RPackageLister::fetchArchives() into the archive cache; needs
+     * root, and is refused when Synaptic::CleanCache empties the cache
+     * after every commit anyway
+     */
+    bool supportsPredownload() const override { return true; }
+    OperationResult predownloadUpdates(
+        const vector<string>& packageIds,
+        const function<bool()>& cancelled,
+        int rateLimitKBps = 0) override;
+
     // ========================================================================
     // APT-Specific Methods
     // ========================================================================
@@ -125,6 +183,19 @@ public:
      */
     RPackageLister* getLister() { return _lister; }
 
+    /**
+     * Call fn with the name and section of every package, holding the
+     * shared lock; for the category index
+     */
+    void forEachSection(const function<void(const char* name,
+                                            const char* section)>& fn);
+
+    /**
+     * The packages with these names as list results (text deferred), in
+     * the order asked; names the cache does not hold are left out
+     */
+    vector<PackageInfo> getPackages(const vector<string>& names);
+
     /**
      * Find an RPackage by name
      */
@@ -132,8 +203,12 @@ public:
 
     /**
      * Convert RPackage to PackageInfo
+     *
+     * With deferText the record-backed fields (summary, description,
+     * homepage, maintainer) are left for resolveDeferredFields(), saving
+     * four pkgRecords lookups per package in list-sized results.
      */
-    PackageInfo rpackageToPackageInfo(RPackage* pkg);
+    PackageInfo rpackageToPackageInfo(RPackage* pkg, bool deferText = false);
 
     /**
      * Mark a package for installation (deferred transaction)
@@ -172,14 +247,33 @@ public:
 
 private:
     RPackageLister* _lister;        // Borrowed reference (not owned)
-    mutable mutex _mutex;           // Thread safety lock
+    // Listings that only read the cache (search, installed, upgradable,
+    // status) share it; marking and anything reading package records,
+    // which go through one shared pkgRecords parser, hold it alone
+    mutable shared_mutex _mutex;
     string _unavailableReason;      // Cached reason if unavailable
 
+    // Names and summaries of all packages for searches without a
+    // Xapian index, built on the first such search after every cache
+    // (re)open. Building reads every package record, so it is
+    // serialized by its own mutex rather than the shared lock.
+    shared_ptr<const RTextScan> _textScan;
+    unsigned long _textScanGeneration;
+    mutex _textScanMutex;
+    shared_ptr<const RTextScan> textScan();
+    MemoryAccount _textScanAccount;
+
     // Helper to get package flags as InstallStatus
     InstallStatus flagsToInstallStatus(int flags);
 
     // Helper to validate package name (prevent injection)
     bool isValidPackageName(const string& name);
+
+    // Look up every package first, then apply mark to all of them in
+    // one depcache action group; marks nothing if any id is unknown
+    OperationResult markPackages(const vector<string>& packageIds,
+                                 const function<void(RPackage*)>& mark,
+                                 const string& action);
 };
 
 } // namespace PolySynaptic
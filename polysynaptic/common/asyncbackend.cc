@@ -0,0 +1,134 @@
+/* asyncbackend.cc - Asynchronous package backend adapter
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "asyncbackend.h"
+
+namespace PolySynaptic {
+
+AsyncBackendAdapter::AsyncBackendAdapter(IPackageBackend* backend,
+                                         TaskPool& pool,
+                                         Dispatcher dispatcher)
+    : _backend(backend)
+    , _pool(pool)
+    , _dispatcher(std::move(dispatcher))
+{
+}
+
+SearchOptions AsyncBackendAdapter::scopedOptions(const SearchOptions& options,
+                                                 const CancellationToken& token)
+{
+    SearchOptions scoped = options;
+    function<bool()> outer = options.isCancelled;
+    scoped.isCancelled = [token, outer]() {
+        return token.isCancelled() || (outer && outer());
+    };
+    return scoped;
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+AsyncPackages AsyncBackendAdapter::searchPackages(
+    const SearchOptions& options,
+    AsyncCallback<vector<PackageInfo>> onDone,
+    ProgressCallback progress)
+{
+    return run<vector<PackageInfo>>(TaskPriority::INTERACTIVE, progress, onDone,
+        [options](IPackageBackend* backend, const CancellationToken& token,
+                  ProgressCallback guarded) {
+            return backend->searchPackages(scopedOptions(options, token), guarded);
+        });
+}
+
+AsyncPackages AsyncBackendAdapter::getInstalledPackages(
+    AsyncCallback<vector<PackageInfo>> onDone,
+    ProgressCallback progress)
+{
+    return run<vector<PackageInfo>>(TaskPriority::NORMAL, progress, onDone,
+        [](IPackageBackend* backend, const CancellationToken&, ProgressCallback guarded) {
+            return backend->getInstalledPackages(guarded);
+        });
+}
+
+AsyncPackages AsyncBackendAdapter::getUpgradablePackages(
+    AsyncCallback<vector<PackageInfo>> onDone,
+    ProgressCallback progress)
+{
+    return run<vector<PackageInfo>>(TaskPriority::NORMAL, progress, onDone,
+        [](IPackageBackend* backend, const CancellationToken&, ProgressCallback guarded) {
+            return backend->getUpgradablePackages(guarded);
+        });
+}
+
+AsyncCall<PackageInfo> AsyncBackendAdapter::getPackageDetails(
+    const string& packageId,
+    AsyncCallback<PackageInfo> onDone)
+{
+    return run<PackageInfo>(TaskPriority::INTERACTIVE, nullptr, onDone,
+        [packageId](IPackageBackend* backend, const CancellationToken&, ProgressCallback) {
+            return backend->getPackageDetails(packageId);
+        });
+}
+
+// ============================================================================
+// Operations
+// ============================================================================
+
+AsyncOperation AsyncBackendAdapter::installPackages(
+    const vector<string>& packageIds,
+    AsyncCallback<OperationResult> onDone,
+    ProgressCallback progress)
+{
+    return run<OperationResult>(TaskPriority::NORMAL, progress, onDone,
+        [packageIds](IPackageBackend* backend, const CancellationToken&,
+                     ProgressCallback guarded) {
+            return backend->installPackages(packageIds, guarded);
+        });
+}
+
+AsyncOperation AsyncBackendAdapter::removePackages(
+    const vector<string>& packageIds,
+    bool purge,
+    AsyncCallback<OperationResult> onDone,
+    ProgressCallback progress)
+{
+    return run<OperationResult>(TaskPriority::NORMAL, progress, onDone,
+        [packageIds, purge](IPackageBackend* backend, const CancellationToken&,
+                            ProgressCallback guarded) {
+            return backend->removePackages(packageIds, purge, guarded);
+        });
+}
+
+AsyncOperation AsyncBackendAdapter::updatePackages(
+    const vector<string>& packageIds,
+    AsyncCallback<OperationResult> onDone,
+    ProgressCallback progress)
+{
+    return run<OperationResult>(TaskPriority::NORMAL, progress, onDone,
+        [packageIds](IPackageBackend* backend, const CancellationToken&,
+                     ProgressCallback guarded) {
+            return backend->updatePackages(packageIds, guarded);
+        });
+}
+
+AsyncOperation AsyncBackendAdapter::refreshCache(
+    AsyncCallback<OperationResult> onDone,
+    ProgressCallback progress)
+{
+    return run<OperationResult>(TaskPriority::BACKGROUND, progress, onDone,
+        [](IPackageBackend* backend, const CancellationToken&, ProgressCallback guarded) {
+            return backend->refreshCache(guarded);
+        });
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
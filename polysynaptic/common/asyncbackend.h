@@ -0,0 +1,254 @@
+/* asyncbackend.h - Asynchronous package backend interface
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file defines an asynchronous counterpart of IPackageBackend:
+ * every call returns at once with a cancellable handle and delivers
+ * its result through a callback and a future. AsyncBackendAdapter
+ * provides it for any synchronous backend by running the calls on a
+ * TaskPool.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _ASYNCBACKEND_H_
+#define _ASYNCBACKEND_H_
+
+#include "ipackagebackend.h"
+#include "taskpool.h"
+
+#include <chrono>
+#include <future>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Handles and Delivery
+// ============================================================================
+
+/**
+ * Dispatcher - Runs a completion callback where the caller wants it
+ *
+ * UI code passes one that posts to its main loop (see rgasync.h for
+ * GTK); without one, callbacks run on the worker thread.
+ */
+using Dispatcher = function<void(function<void()> task)>;
+
+/**
+ * AsyncCall - Handle of one asynchronous call and its pending result
+ *
+ * Copies share the same call. Cancelling a call that has not started
+ * keeps it from running and its future yields a default constructed
+ * result; a running one sees the cancellation through its progress
+ * callback and SearchOptions::isCancelled. A cancelled call never
+ * invokes its completion callback.
+ */
+template <typename T>
+struct AsyncCall {
+    CancellationToken token;
+    std::shared_future<T> result;
+
+    void cancel() { token.cancel(); }
+    bool isCancelled() const { return token.isCancelled(); }
+
+    bool isReady() const {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // False if the call was still running after timeoutMs
+    bool waitFor(int timeoutMs) const {
+        return result.wait_for(std::chrono::milliseconds(timeoutMs)) ==
+               std::future_status::ready;
+    }
+
+    T get() const { return result.get(); }
+};
+
+template <typename T>
+using AsyncCallback = function<void(const T& result)>;
+
+using AsyncPackages = AsyncCall<vector<PackageInfo>>;
+using AsyncOperation = AsyncCall<OperationResult>;
+
+// ============================================================================
+// Asynchronous Backend Interface
+// ============================================================================
+
+/**
+ * IAsyncPackageBackend - Non-blocking view of a package backend
+ *
+ * Mirrors the queries and operations of IPackageBackend. Each call
+ * returns immediately; onDone, if set, is called exactly once with the
+ * result unless the call was cancelled, through the implementation's
+ * Dispatcher. Progress callbacks run on the worker thread.
+ */
+class IAsyncPackageBackend {
+public:
+    virtual ~IAsyncPackageBackend() = default;
+
+    virtual BackendType getType() const = 0;
+
+    virtual AsyncPackages searchPackages(
+        const SearchOptions& options,
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncPackages getInstalledPackages(
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncPackages getUpgradablePackages(
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncCall<PackageInfo> getPackageDetails(
+        const string& packageId,
+        AsyncCallback<PackageInfo> onDone = nullptr) = 0;
+
+    virtual AsyncOperation installPackages(
+        const vector<string>& packageIds,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncOperation removePackages(
+        const vector<string>& packageIds,
+        bool purge = false,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncOperation updatePackages(
+        const vector<string>& packageIds,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+
+    virtual AsyncOperation refreshCache(
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) = 0;
+};
+
+// ============================================================================
+// Adapter for Synchronous Backends
+// ============================================================================
+
+/**
+ * AsyncBackendAdapter - IAsyncPackageBackend over an IPackageBackend
+ *
+ * Searches and details run at INTERACTIVE priority, lists and
+ * operations at NORMAL, cache refreshes at BACKGROUND. The backend
+ * and pool must outlive every call started.
+ */
+class AsyncBackendAdapter : public IAsyncPackageBackend {
+public:
+    AsyncBackendAdapter(IPackageBackend* backend, TaskPool& pool,
+                        Dispatcher dispatcher = nullptr);
+
+    IPackageBackend* getBackend() const { return _backend; }
+    BackendType getType() const override { return _backend->getType(); }
+
+    AsyncPackages searchPackages(
+        const SearchOptions& options,
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncPackages getInstalledPackages(
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncPackages getUpgradablePackages(
+        AsyncCallback<vector<PackageInfo>> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncCall<PackageInfo> getPackageDetails(
+        const string& packageId,
+        AsyncCallback<PackageInfo> onDone = nullptr) override;
+
+    AsyncOperation installPackages(
+        const vector<string>& packageIds,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncOperation removePackages(
+        const vector<string>& packageIds,
+        bool purge = false,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncOperation updatePackages(
+        const vector<string>& packageIds,
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+    AsyncOperation refreshCache(
+        AsyncCallback<OperationResult> onDone = nullptr,
+        ProgressCallback progress = nullptr) override;
+
+protected:
+    // options, also cancelled through token
+    static SearchOptions scopedOptions(const SearchOptions& options,
+                                       const CancellationToken& token);
+
+    // Run body on the pool and deliver its result; body gets a
+    // progress callback that also reports cancellation
+    template <typename T>
+    AsyncCall<T> run(TaskPriority priority,
+                     ProgressCallback progress,
+                     AsyncCallback<T> onDone,
+                     function<T(IPackageBackend*, const CancellationToken&,
+                                ProgressCallback)> body);
+
+private:
+    IPackageBackend* _backend;
+    TaskPool& _pool;
+    Dispatcher _dispatcher;
+};
+
+// ============================================================================
+// Template Implementation
+// ============================================================================
+
+template <typename T>
+AsyncCall<T> AsyncBackendAdapter::run(
+    TaskPriority priority,
+    ProgressCallback progress,
+    AsyncCallback<T> onDone,
+    function<T(IPackageBackend*, const CancellationToken&, ProgressCallback)> body)
+{
+    AsyncCall<T> call;
+    CancellationToken token = call.token;
+    IPackageBackend* backend = _backend;
+    Dispatcher dispatcher = _dispatcher;
+
+    // Captures no pointer to the adapter, so it may go away first
+    auto task = [token, backend, dispatcher, progress, onDone, body]() -> T {
+        ProgressCallback guarded = [token, progress](double current, const string& message) {
+            if (token.isCancelled()) return false;
+            return !progress || progress(current, message);
+        };
+
+        T result = body(backend, token, guarded);
+
+        if (onDone && !token.isCancelled()) {
+            if (dispatcher) {
+                dispatcher([token, onDone, result]() {
+                    // Cancelled while waiting for the main loop
+                    if (!token.isCancelled()) onDone(result);
+                });
+            } else {
+                onDone(result);
+            }
+        }
+        return result;
+    };
+
+    call.result = _pool.submit(priority, token, std::move(task)).share();
+    return call;
+}
+
+} // namespace PolySynaptic
+
+#endif // _ASYNCBACKEND_H_
+
+// vim:ts=4:sw=4:et
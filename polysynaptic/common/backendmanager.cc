@@ -9,14 +9,42 @@
  */
 
 #include "backendmanager.h"
+#include "appstreamindex.h"
+#include "fuzzyindex.h"
 #include "rconfiguration.h"
+#include "tracing.h"
+#include "latency.h"
+#include "metrics.h"
+#include "operationhistory.h"
+#include "processgovernor.h"
+#include "progressaggregator.h"
+#include "startupprofile.h"
+#include "structuredlog.h"
+#include "transactionjournal.h"
 
 #include <fstream>
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <chrono>
+#include <queue>
+#include <sstream>
+#include <unordered_set>
+
+#include <sys/stat.h>
 
 namespace PolySynaptic {
 
+// Entries the details cache and the log buffer keep, normally and in
+// low-memory mode
+static const unsigned int DETAILS_ENTRIES = 64;
+static const unsigned int LOW_MEMORY_DETAILS_ENTRIES = 8;
+static const size_t LOG_ENTRIES = 1000;
+static const size_t LOW_MEMORY_LOG_ENTRIES = 200;
+
+// A search finding fewer packages than this gets near matches as well
+static const size_t NEAR_MATCHES_BELOW = 5;
+
 // ============================================================================
 // Constructor / Destructor
 // ============================================================================
@@ -25,14 +53,81 @@ BackendManager::BackendManager(RPackageLister* lister)
     : _aptEnabled(true)
     , _snapEnabled(true)
     , _flatpakEnabled(true)
+    , _journal(new TransactionJournal(getJournalPath()))
+    , _history(new OperationHistory(getHistoryPath()))
+    , _commitEtaMs(-1)
+    , _storeIndexLoaded(false)
+    , _categoryQueued(false)
+    , _fuzzyQueued(false)
+    , _details(DETAILS_ENTRIES)
+    , _updates(_pool, chrono::minutes(30), chrono::hours(8))
+    , _predownloads(_pool,
+                    [this](BackendType type) { return getBackend(type); },
+                    [this](BackendType type) {
+                        vector<string> ids;
+                        for (const auto& pkg : _updates.getSnapshot(type)) {
+                            ids.push_back(pkg.id);
+                        }
+                        return ids;
+                    })
+    , _lowMemory(false)
+    , _popularityRanking(false)
+    , _searchSession(0)
+    , _snapChanged(false)
+    , _catalogLoaded(false)
 {
     initializeBackends(lister);
     loadConfiguration();
+    addUpdateSources();
+    addChangeWatches();
+
+    _detailsAccount.assign("package details cache",
+        [this](MemoryUsage& usage) {
+            lock_guard<mutex> lock(_detailsMutex);
+            for (const auto& entry : _details) {
+                usage.bytes += heapBytes(entry.first) + entry.second.memoryBytes();
+                usage.items++;
+            }
+        },
+        [this]() {
+            lock_guard<mutex> lock(_detailsMutex);
+            uint64_t freed = 0;
+            for (const auto& entry : _details) {
+                freed += heapBytes(entry.first) + entry.second.memoryBytes();
+            }
+            _details.clear();
+            return freed;
+        });
+
+    _categoryAccount.assign("category index",
+        [this](MemoryUsage& usage) {
+            lock_guard<mutex> lock(_categoryMutex);
+            if (_categories) {
+                usage.bytes += _categories->memoryBytes();
+                usage.items++;
+            }
+        });
+
+    _fuzzyAccount.assign("near match index",
+        [this](MemoryUsage& usage) {
+            lock_guard<mutex> lock(_fuzzyMutex);
+            if (_fuzzy) {
+                usage.bytes += _fuzzy->memoryBytes();
+                usage.items++;
+            }
+        });
 }
 
 BackendManager::~BackendManager()
 {
+    if (_snapWatcher) {
+        _snapWatcher->stop();
+    }
+    _storeRefresh.cancel();
+    _updates.cancel();
+    _predownloads.stop();
     saveConfiguration();
+    _history->save();
 }
 
 void BackendManager::initializeBackends(RPackageLister* lister)
@@ -43,13 +138,18 @@ void BackendManager::initializeBackends(RPackageLister* lister)
     }
 
     // Initialize Snap backend
-    _snapBackend = make_unique<SnapBackend>();
+    _snapBackend = SnapBackend::shared();
 
     // Initialize Flatpak backend
-    _flatpakBackend = make_unique<FlatpakBackend>();
+    _flatpakBackend = FlatpakBackend::shared();
 
     // Detect availability
     detectBackendAvailability();
+
+    if (_snapBackend && _snapBackend->isAvailable() && !_snapWatcher) {
+        _snapWatcher.reset(new SnapChangeWatcher());
+        _snapWatcher->start([this](const SnapChangeEvent& event) { onSnapChange(event); });
+    }
 }
 
 void BackendManager::detectBackendAvailability()
@@ -92,6 +192,111 @@ IPackageBackend* BackendManager::getBackend(BackendType type)
     return nullptr;
 }
 
+/**
+ * AsyncView - A backend's asynchronous view, searching like the manager
+ *
+ * Searches go through searchBackend() so they use the store index and
+ * get ranked, the same as results of searchPackages(); the other
+ * queries share runs and details with the manager's own.
+ */
+class BackendManager::AsyncView : public AsyncBackendAdapter {
+public:
+    AsyncView(BackendManager* manager, IPackageBackend* backend)
+        : AsyncBackendAdapter(backend, manager->_pool,
+              [manager](function<void()> task) { manager->dispatch(std::move(task)); })
+        , _manager(manager)
+    {}
+
+    AsyncPackages searchPackages(
+        const SearchOptions& options,
+        AsyncCallback<vector<PackageInfo>> onDone,
+        ProgressCallback progress) override
+    {
+        BackendManager* manager = _manager;
+        return run<vector<PackageInfo>>(TaskPriority::INTERACTIVE, progress, onDone,
+            [manager, options](IPackageBackend* backend, const CancellationToken& token,
+                               ProgressCallback guarded) {
+                return manager->searchBackend(backend, scopedOptions(options, token),
+                                              guarded);
+            });
+    }
+
+    AsyncPackages getInstalledPackages(
+        AsyncCallback<vector<PackageInfo>> onDone,
+        ProgressCallback progress) override
+    {
+        BackendManager* manager = _manager;
+        return run<vector<PackageInfo>>(TaskPriority::NORMAL, progress, onDone,
+            [manager](IPackageBackend* backend, const CancellationToken&,
+                      ProgressCallback guarded) {
+                return manager->sharedInstalled(backend, guarded);
+            });
+    }
+
+    AsyncPackages getUpgradablePackages(
+        AsyncCallback<vector<PackageInfo>> onDone,
+        ProgressCallback progress) override
+    {
+        BackendManager* manager = _manager;
+        return run<vector<PackageInfo>>(TaskPriority::NORMAL, progress, onDone,
+            [manager](IPackageBackend* backend, const CancellationToken&,
+                      ProgressCallback guarded) {
+                return manager->sharedUpgradable(backend, guarded);
+            });
+    }
+
+    AsyncCall<PackageInfo> getPackageDetails(
+        const string& packageId,
+        AsyncCallback<PackageInfo> onDone) override
+    {
+        BackendManager* manager = _manager;
+        return run<PackageInfo>(TaskPriority::INTERACTIVE, nullptr, onDone,
+            [manager, packageId](IPackageBackend* backend, const CancellationToken&,
+                                 ProgressCallback) {
+                return manager->getPackageDetails(packageId, backend->getType());
+            });
+    }
+
+private:
+    BackendManager* _manager;
+};
+
+IAsyncPackageBackend* BackendManager::getAsyncBackend(BackendType type)
+{
+    IPackageBackend* backend = getBackend(type);
+    if (!backend) {
+        return nullptr;
+    }
+
+    lock_guard<mutex> lock(_asyncMutex);
+    auto& adapter = _asyncBackends[type];
+    if (!adapter) {
+        adapter.reset(new AsyncView(this, backend));
+    }
+    return adapter.get();
+}
+
+void BackendManager::setDispatcher(Dispatcher dispatcher)
+{
+    lock_guard<mutex> lock(_asyncMutex);
+    _dispatcher = std::move(dispatcher);
+}
+
+void BackendManager::dispatch(function<void()> task)
+{
+    Dispatcher dispatcher;
+    {
+        lock_guard<mutex> lock(_asyncMutex);
+        dispatcher = _dispatcher;
+    }
+
+    if (dispatcher) {
+        dispatcher(std::move(task));
+    } else {
+        task();
+    }
+}
+
 vector<IPackageBackend*> BackendManager::getAllBackends()
 {
     vector<IPackageBackend*> backends;
@@ -214,392 +419,1640 @@ void BackendManager::setBackendEnabled(BackendType type, bool enabled)
 
 void BackendManager::refreshBackendDetection()
 {
+    // An explicit refresh probes again instead of trusting the caches
+    for (IPackageBackend *backend : getAllBackends()) {
+        backend->invalidateAvailability();
+    }
     detectBackendAvailability();
 }
 
+void BackendManager::probeBackendsInBackground()
+{
+    vector<IPackageBackend*> backends;
+    if (_snapBackend) backends.push_back(_snapBackend.get());
+    if (_flatpakBackend) backends.push_back(_flatpakBackend.get());
+
+    for (auto* backend : backends) {
+        _pool.submit(TaskPriority::BACKGROUND, [backend]() {
+            ScopedStartupPhase phase(backend->getType() == BackendType::SNAP
+                                     ? "snap-probe" : "flatpak-probe");
+            ScopedLatency latency(backend->getName(), "Probing");
+            return backend->isAvailable();
+        });
+    }
+}
+
 // ============================================================================
-// Unified Package Operations
+// Backend Fan-out
 // ============================================================================
 
-vector<PackageInfo> BackendManager::searchPackages(
-    const SearchOptions& options,
+template <typename R>
+vector<R> BackendManager::fanOut(
     const BackendFilter& filter,
-    ProgressCallback progress)
+    TaskPriority priority,
+    CancellationToken token,
+    ProgressCallback progress,
+    const string& verb,
+    function<R(IPackageBackend*, ProgressCallback)> call)
 {
-    lock_guard<mutex> lock(_mutex);
-    vector<PackageInfo> results;
-
-    auto backends = getEnabledBackends();
-    if (backends.empty()) {
-        return results;
-    }
-
-    // Filter backends
-    vector<IPackageBackend*> filteredBackends;
-    for (auto* backend : backends) {
+    vector<IPackageBackend*> backends;
+    for (auto* backend : getEnabledBackends()) {
         if (filter.includes(backend->getType())) {
-            filteredBackends.push_back(backend);
+            backends.push_back(backend);
         }
     }
 
-    if (filteredBackends.empty()) {
-        return results;
-    }
+    // Workers report progress concurrently; the aggregator merges the
+    // backends, keeps the caller's callback single-threaded and calls
+    // it a few times a frame, and a false return becomes cancellation
+    ProgressAggregator aggregator(progress);
+
+    // The workers' spans hang off whatever the caller has open
+    uint64_t parentSpan = Tracer::currentSpan();
 
-    // Launch parallel searches
-    // Note: We capture options by value to ensure it remains valid even if
-    // the caller's stack frame changes. Backend pointers are guaranteed valid
-    // because we hold _mutex and getEnabledBackends returns owned pointers.
-    vector<future<vector<PackageInfo>>> futures;
-    auto completedCount = make_shared<atomic<int>>(0);
-    int totalBackends = filteredBackends.size();
-
-    for (auto* backend : filteredBackends) {
-        // Capture options by value, backend by raw pointer (valid while lock held)
-        // Capture progress by value (it's a std::function, copyable)
-        SearchOptions capturedOptions = options;  // Copy for thread safety
-        futures.push_back(async(launch::async, [backend, capturedOptions, progress, completedCount, totalBackends]() {
-            // Create backend-specific progress wrapper
-            ProgressCallback backendProgress = nullptr;
-            if (progress) {
-                backendProgress = [progress, completedCount, totalBackends, backend](double pct, const string& msg) {
-                    int completed = completedCount->load();
-                    double overallPct = (completed + pct) / totalBackends;
-                    string fullMsg = "[" + backend->getName() + "] " + msg;
-                    return progress(overallPct, fullMsg);
-                };
+    vector<ProgressCallback> backendProgress;
+    for (auto* backend : backends) {
+        ProgressCallback source = progress ? aggregator.source(backend->getName()) : nullptr;
+        backendProgress.push_back([source, token](double pct, const string& msg) mutable {
+            if (token.isCancelled()) {
+                return false;
+            }
+            if (source && !source(pct, msg)) {
+                token.cancel();
+                return false;
             }
+            return true;
+        });
+    }
 
-            auto pkgs = backend->searchPackages(capturedOptions, backendProgress);
-            (*completedCount)++;
-            return pkgs;
-        }));
+    vector<future<R>> futures;
+    for (size_t i = 0; i < backends.size(); i++) {
+        IPackageBackend* backend = backends[i];
+        ProgressCallback report = backendProgress[i];
+        futures.push_back(_pool.submit(priority, token,
+            [backend, call, report, verb, parentSpan]() {
+                ScopedSpan span("backend", "manager", parentSpan);
+                if (span.isActive()) span.setDetail(verb + " " + backend->getName());
+                ScopedLatency latency(backend->getName(), verb);
+                report(0.0, verb + " " + backend->getName() + "...");
+                R result = call(backend, report);
+                report(1.0, "");
+                return result;
+            }));
     }
 
-    // Collect results
+    // Backend pointers stay valid because callers hold _mutex until
+    // every future has been collected
+    vector<R> results;
     for (auto& future : futures) {
         try {
-            auto pkgs = future.get();
-            results.insert(results.end(), pkgs.begin(), pkgs.end());
+            results.push_back(future.get());
         } catch (const exception& e) {
             // Log error but continue
         }
     }
 
-    // Sort results by relevance/name
-    sort(results.begin(), results.end(), [](const PackageInfo& a, const PackageInfo& b) {
-        return a.name < b.name;
-    });
+    aggregator.finish();
+    return results;
+}
+
+// ============================================================================
+// Unified Package Operations
+// ============================================================================
 
-    // Apply overall result limit
-    if (options.maxResults > 0 && results.size() > static_cast<size_t>(options.maxResults)) {
-        results.resize(options.maxResults);
+CancellationToken BackendManager::beginSearch(uint64_t* session)
+{
+    // A newer search makes any one still running pointless
+    CancellationToken token;
+    lock_guard<mutex> searchLock(_searchMutex);
+    _activeSearch.cancel();
+    _activeSearch = token;
+    uint64_t id = ++_searchSession;
+    if (session) *session = id;
+
+    static MetricCounter& searches = MetricsRegistry::instance()
+        .counter("polysynaptic_searches", "Unified searches started");
+    searches.inc();
+    return token;
+}
+
+int BackendManager::searchRelevance(const PackageInfo& pkg, const string& query,
+                                    const PopularityIndex* popularity)
+{
+    auto lower = [](string s) {
+        transform(s.begin(), s.end(), s.begin(),
+                  [](unsigned char c) { return tolower(c); });
+        return s;
+    };
+    string name = lower(pkg.name);
+    string summary = lower(pkg.summary);
+    // Store and AppStream keywords weigh like the summary
+    string keywords = lower(pkg.keywords);
+
+    int score = 0;
+    istringstream words(lower(query));
+    string term;
+    while (words >> term) {
+        size_t at = name.find(term);
+        if (at == string::npos) {
+            score += summary.find(term) != string::npos ||
+                     keywords.find(term) != string::npos ? 1 : 0;
+        } else if (term.size() == name.size()) {
+            score += 100;
+        } else if (at == 0) {
+            score += 30;
+        } else {
+            score += 10;
+        }
     }
 
-    if (progress) {
-        progress(1.0, "Found " + to_string(results.size()) + " packages");
+    if (popularity && score > 0) {
+        PopularityIndex::Source source = PopularityIndex::SOURCE_COUNT;
+        switch (pkg.backend) {
+            case BackendType::APT:     source = PopularityIndex::POPCON; break;
+            case BackendType::FLATPAK: source = PopularityIndex::FLATHUB; break;
+            case BackendType::SNAP:    source = PopularityIndex::SNAP; break;
+            default: break;
+        }
+        double popular;
+        if (source != PopularityIndex::SOURCE_COUNT &&
+            popularity->find(source, pkg.id, popular)) {
+            score += static_cast<int>(popular * POPULARITY_POINTS + 0.5);
+        }
+    }
+    return score;
+}
+
+vector<PackageInfo> BackendManager::mergeSearchResults(
+    vector<vector<PackageInfo>>& perBackend,
+    const SearchOptions& options)
+{
+    size_t total = 0;
+    for (auto& pkgs : perBackend) {
+        // The backend's own order (Xapian or store ranking) breaks ties
+        stable_sort(pkgs.begin(), pkgs.end(), [](const PackageInfo& a, const PackageInfo& b) {
+            return a.relevance > b.relevance;
+        });
+        total += pkgs.size();
+    }
+    size_t limit = options.maxResults > 0 ? min(total, static_cast<size_t>(options.maxResults))
+                                          : total;
+
+    // (backend, position) of the next entry of every non-empty list
+    using Head = pair<size_t, size_t>;
+    auto worse = [&perBackend](const Head& a, const Head& b) {
+        const PackageInfo& x = perBackend[a.first][a.second];
+        const PackageInfo& y = perBackend[b.first][b.second];
+        if (x.relevance != y.relevance) return x.relevance < y.relevance;
+        if (x.name != y.name) return x.name > y.name;
+        return a.first > b.first;
+    };
+    priority_queue<Head, vector<Head>, decltype(worse)> heads(worse);
+    for (size_t i = 0; i < perBackend.size(); i++) {
+        if (!perBackend[i].empty()) heads.push(Head(i, 0));
+    }
+
+    vector<PackageInfo> results;
+    results.reserve(limit);
+    while (results.size() < limit && !heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        results.push_back(std::move(perBackend[head.first][head.second]));
+        if (head.second + 1 < perBackend[head.first].size()) {
+            heads.push(Head(head.first, head.second + 1));
+        }
     }
 
     return results;
 }
 
-vector<PackageInfo> BackendManager::getInstalledPackages(
+vector<PackageInfo> BackendManager::searchPackages(
+    const SearchOptions& options,
     const BackendFilter& filter,
     ProgressCallback progress)
 {
-    lock_guard<mutex> lock(_mutex);
-    vector<PackageInfo> results;
+    CancellationToken token = beginSearch(nullptr);
 
-    auto backends = getEnabledBackends();
-    int current = 0;
-    int total = backends.size();
+    ScopedSpan span("search", "manager");
+    if (span.isActive()) span.setDetail(options.query);
 
-    for (auto* backend : backends) {
-        if (!filter.includes(backend->getType())) {
-            continue;
-        }
+    lock_guard<mutex> lock(_mutex);
 
-        if (progress) {
-            double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Loading " + backend->getName() + " packages...")) {
-                break;
-            }
-        }
+    SearchOptions capturedOptions = options;  // Copy for thread safety
+    capturedOptions.isCancelled = [token]() { return token.isCancelled(); };
 
-        auto pkgs = backend->getInstalledPackages(nullptr);
-        results.insert(results.end(), pkgs.begin(), pkgs.end());
+    auto perBackend = fanOut<vector<PackageInfo>>(
+        filter, TaskPriority::INTERACTIVE, token, progress, "Searching",
+        [this, capturedOptions](IPackageBackend* backend, ProgressCallback backendProgress) {
+            return searchBackend(backend, capturedOptions, backendProgress);
+        });
+
+    vector<PackageInfo> results = mergeSearchResults(perBackend, options);
 
-        current++;
+    vector<BackendType> types;
+    for (auto* backend : getEnabledBackends()) {
+        if (filter.includes(backend->getType())) types.push_back(backend->getType());
     }
+    addNearMatches(results, options, types);
 
     if (progress) {
-        progress(1.0, "Loaded " + to_string(results.size()) + " installed packages");
+        progress(1.0, "Found " + to_string(results.size()) + " packages");
     }
 
     return results;
 }
 
-vector<PackageInfo> BackendManager::getUpgradablePackages(
+uint64_t BackendManager::startSearch(
+    const SearchOptions& options,
     const BackendFilter& filter,
-    ProgressCallback progress)
+    SearchResultCallback onResults,
+    SearchPartialCallback onPartial)
 {
-    lock_guard<mutex> lock(_mutex);
-    vector<PackageInfo> results;
-
-    auto backends = getEnabledBackends();
-    int current = 0;
-    int total = backends.size();
+    uint64_t session = 0;
+    CancellationToken token = beginSearch(&session);
 
-    for (auto* backend : backends) {
-        if (!filter.includes(backend->getType())) {
-            continue;
-        }
+    // Only covers the dispatch; the backends' spans name it as parent
+    ScopedSpan span("startSearch", "manager");
+    if (span.isActive()) span.setDetail(options.query);
+    uint64_t parentSpan = span.id();
 
-        if (progress) {
-            double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Checking " + backend->getName() + " updates...")) {
-                break;
+    vector<IPackageBackend*> backends;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto* backend : getEnabledBackends()) {
+            if (filter.includes(backend->getType())) {
+                backends.push_back(backend);
             }
         }
+    }
 
-        auto pkgs = backend->getUpgradablePackages(nullptr);
-        results.insert(results.end(), pkgs.begin(), pkgs.end());
+    if (backends.empty()) {
+        if (onResults) onResults(session, vector<PackageInfo>());
+        return session;
+    }
 
-        current++;
+    // Workers never wait on each other: the last backend to answer
+    // merges and delivers
+    struct SessionState {
+        SearchOptions options;
+        vector<BackendType> types;
+        vector<vector<PackageInfo>> perBackend;
+        atomic<int> remaining;
+        SearchResultCallback onResults;
+        SearchPartialCallback onPartial;
+    };
+    auto state = make_shared<SessionState>();
+    state->options = options;
+    state->options.isCancelled = [token]() { return token.isCancelled(); };
+    for (auto* backend : backends) {
+        state->types.push_back(backend->getType());
     }
+    state->perBackend.resize(backends.size());
+    state->remaining = backends.size();
+    state->onResults = onResults;
+    state->onPartial = onPartial;
 
-    if (progress) {
-        progress(1.0, "Found " + to_string(results.size()) + " updates");
+    ProgressCallback backendProgress = [token](double, const string&) {
+        return !token.isCancelled();
+    };
+
+    for (size_t i = 0; i < backends.size(); i++) {
+        IPackageBackend* backend = backends[i];
+
+        // Backends live as long as the manager and the pool is torn
+        // down first, so the raw pointer outlives every task
+        _pool.submit(TaskPriority::INTERACTIVE, token,
+            [this, state, backend, i, token, session, backendProgress, parentSpan]() {
+                ScopedSpan span("backend", "manager", parentSpan);
+                if (span.isActive()) span.setDetail("Searching " + backend->getName());
+                ScopedLatency latency(backend->getName(), "Searching");
+                try {
+                    state->perBackend[i] =
+                        searchBackend(backend, state->options, backendProgress);
+                } catch (const exception& e) {
+                    // Treat a failing backend as having no results
+                }
+
+                if (state->onPartial && !token.isCancelled() && isCurrentSearch(session)) {
+                    state->onPartial(session, backend->getType(), state->perBackend[i]);
+                }
+
+                if (--state->remaining == 0 && !token.isCancelled() &&
+                    isCurrentSearch(session) && state->onResults) {
+                    ScopedSpan merge("merge", "manager");
+                    vector<PackageInfo> results =
+                        mergeSearchResults(state->perBackend, state->options);
+                    addNearMatches(results, state->options, state->types);
+                    state->onResults(session, std::move(results));
+                }
+                return 0;
+            });
     }
 
-    return results;
+    return session;
 }
 
-PackageInfo BackendManager::getPackageDetails(const string& packageId, BackendType backend)
+// Whether a backend's search was answered by the store index
+static void countIndexSearch(BackendType type, bool hit)
 {
-    auto* be = getBackend(backend);
-    if (be) {
-        return be->getPackageDetails(packageId);
-    }
-    return PackageInfo();
+    MetricsRegistry::instance()
+        .counter("polysynaptic_store_index_searches",
+                 "Backend searches, by whether the store index answered them",
+                 {{"backend", backendTypeToString(type)},
+                  {"result", hit ? "hit" : "miss"}})
+        .inc();
 }
 
-// ============================================================================
-// Transaction Management
-// ============================================================================
-
-Transaction BackendManager::getCurrentTransaction() const
+shared_ptr<const PopularityIndex> BackendManager::popularityRanking() const
 {
-    lock_guard<mutex> lock(_txMutex);
-    return _currentTransaction;
+    if (!_popularityRanking) {
+        return nullptr;
+    }
+    shared_ptr<const PopularityIndex> index = PopularityIndex::peek();
+    return index->empty() ? nullptr : index;
 }
 
-void BackendManager::queueInstall(const PackageInfo& package)
+vector<PackageInfo> BackendManager::searchBackend(
+    IPackageBackend* backend,
+    const SearchOptions& options,
+    ProgressCallback progress)
 {
-    lock_guard<mutex> lock(_txMutex);
-
-    Transaction::Operation op;
-    op.backend = package.backend;
-    op.packageId = package.id;
-    op.packageName = package.name;
-    op.type = Transaction::Operation::Type::INSTALL;
+    BackendType type = backend->getType();
+    bool installedKnown;
+    {
+        lock_guard<mutex> lock(_storeMutex);
+        installedKnown = _storeInstalled.count(type) > 0;
+    }
 
-    _currentTransaction.operations.push_back(op);
-    notifyTransactionChanged();
-}
+    // Results without installed state would be wrong, not just stale
+    if (options.remoteRanking || options.query.empty() || !installedKnown ||
+        type == BackendType::APT || !_storeIndex.hasSection(type)) {
+        countIndexSearch(type, false);
+        vector<PackageInfo> results = backend->searchPackages(options, progress);
+        // Whatever index is built; a search does not wait for a rebuild
+        shared_ptr<const AppstreamIndex> appstream = AppstreamIndex::peek();
+        shared_ptr<const PopularityIndex> popularity = popularityRanking();
+        for (auto& pkg : results) {
+            appstream->enrich(pkg);
+            pkg.relevance = searchRelevance(pkg, options.query, popularity.get());
+        }
+        return results;
+    }
 
-void BackendManager::queueRemove(const PackageInfo& package, bool purge)
-{
-    lock_guard<mutex> lock(_txMutex);
+    countIndexSearch(type, true);
+    ScopedSpan span("storeIndex", "manager");
 
-    Transaction::Operation op;
-    op.backend = package.backend;
-    op.packageId = package.id;
-    op.packageName = package.name;
-    op.type = Transaction::Operation::Type::REMOVE;
-    op.purge = purge;
+    // Limit only after filtering, or installed hits could crowd it out
+    SearchOptions local = options;
+    local.maxResults = 0;
+    vector<PackageInfo> found = _storeIndex.search(type, local);
 
-    _currentTransaction.operations.push_back(op);
-    notifyTransactionChanged();
-}
+    vector<PackageInfo> results;
+    shared_ptr<const PopularityIndex> popularity = popularityRanking();
+    {
+        lock_guard<mutex> lock(_storeMutex);
+        const map<string, string>& installed = _storeInstalled.at(type);
+        for (auto& pkg : found) {
+            auto it = installed.find(pkg.id);
+            if (it != installed.end()) {
+                pkg.installStatus = InstallStatus::INSTALLED;
+                pkg.installedVersion = it->second;
+            } else {
+                pkg.installStatus = InstallStatus::NOT_INSTALLED;
+            }
 
-void BackendManager::queueUpdate(const PackageInfo& package)
-{
-    lock_guard<mutex> lock(_txMutex);
+            if (options.installedOnly && !pkg.isInstalled()) continue;
+            if (options.availableOnly && pkg.isInstalled()) continue;
+            pkg.relevance = searchRelevance(pkg, options.query, popularity.get());
+            results.push_back(std::move(pkg));
 
-    Transaction::Operation op;
-    op.backend = package.backend;
-    op.packageId = package.id;
-    op.packageName = package.name;
-    op.type = Transaction::Operation::Type::UPDATE;
+            if (options.maxResults > 0 &&
+                results.size() >= static_cast<size_t>(options.maxResults)) {
+                break;
+            }
+        }
+    }
 
-    _currentTransaction.operations.push_back(op);
-    notifyTransactionChanged();
+    if (progress) {
+        progress(1.0, "Search complete");
+    }
+    return results;
 }
 
-void BackendManager::unqueue(const string& packageId, BackendType backend)
+void BackendManager::noteInstalled(BackendType type, const vector<PackageInfo>& pkgs)
 {
-    lock_guard<mutex> lock(_txMutex);
-
-    _currentTransaction.operations.erase(
-        remove_if(_currentTransaction.operations.begin(),
-                  _currentTransaction.operations.end(),
-                  [&](const Transaction::Operation& op) {
-                      return op.packageId == packageId && op.backend == backend;
-                  }),
-        _currentTransaction.operations.end());
+    map<string, string> installed;
+    for (const auto& pkg : pkgs) {
+        installed[pkg.id] = pkg.installedVersion.empty() ? pkg.version
+                                                         : pkg.installedVersion;
+    }
 
-    notifyTransactionChanged();
+    lock_guard<mutex> lock(_storeMutex);
+    _storeInstalled[type].swap(installed);
 }
 
-void BackendManager::clearTransaction()
+void BackendManager::enrich(vector<PackageInfo>& pkgs)
 {
-    lock_guard<mutex> lock(_txMutex);
-    _currentTransaction.clear();
-    notifyTransactionChanged();
+    shared_ptr<const AppstreamIndex> appstream = AppstreamIndex::shared();
+    for (auto& pkg : pkgs) {
+        appstream->enrich(pkg);
+    }
 }
 
-TransactionResult BackendManager::commitTransaction(ProgressCallback progress)
+void BackendManager::cancelSearch()
 {
-    lock_guard<mutex> lock(_txMutex);
-    TransactionResult result;
-    result.success = true;
-    result.successCount = 0;
-    result.failureCount = 0;
-
-    int total = _currentTransaction.operations.size();
-    int current = 0;
-
-    // Process APT operations first (they may have dependencies)
-    if (_aptBackend && _aptEnabled) {
-        auto aptOps = _currentTransaction.getOperationsForBackend(BackendType::APT);
-
-        for (const auto& op : aptOps) {
-            if (progress) {
-                double pct = static_cast<double>(current) / total;
-                string action = (op.type == Transaction::Operation::Type::INSTALL) ? "Installing" :
-                               (op.type == Transaction::Operation::Type::REMOVE) ? "Removing" : "Updating";
-                if (!progress(pct, "[APT] " + action + " " + op.packageName + "...")) {
-                    result.success = false;
-                    result.errors.push_back({"", "Operation cancelled"});
-                    return result;
-                }
-            }
+    lock_guard<mutex> searchLock(_searchMutex);
+    _activeSearch.cancel();
+}
 
-            OperationResult opResult;
-            switch (op.type) {
-                case Transaction::Operation::Type::INSTALL:
-                    opResult = _aptBackend->installPackage(op.packageId, nullptr);
-                    break;
-                case Transaction::Operation::Type::REMOVE:
-                    opResult = _aptBackend->removePackage(op.packageId, op.purge, nullptr);
-                    break;
-                case Transaction::Operation::Type::UPDATE:
-                    opResult = _aptBackend->updatePackage(op.packageId, nullptr);
-                    break;
-            }
+vector<PackageInfo> BackendManager::getInstalledPackages(
+    const BackendFilter& filter,
+    ProgressCallback progress)
+{
+    lock_guard<mutex> lock(_mutex);
+    vector<PackageInfo> results;
 
-            if (opResult.success) {
-                result.successCount++;
-            } else {
-                result.failureCount++;
-                result.errors.push_back({op.packageId, opResult.message});
-                result.success = false;
-            }
+    auto perBackend = fanOut<vector<PackageInfo>>(
+        filter, TaskPriority::NORMAL, CancellationToken(), progress, "Loading",
+        [this](IPackageBackend* backend, ProgressCallback backendProgress) {
+            return sharedInstalled(backend, backendProgress);
+        });
 
-            current++;
-        }
+    for (auto& pkgs : perBackend) {
+        results.insert(results.end(), pkgs.begin(), pkgs.end());
+    }
 
-        // APT requires a commit step
-        if (!aptOps.empty()) {
-            _aptBackend->commitChanges(nullptr);
-        }
+    if (progress) {
+        progress(1.0, "Loaded " + to_string(results.size()) + " installed packages");
     }
 
-    // Process Snap operations
-    if (_snapBackend && _snapEnabled) {
-        auto snapOps = _currentTransaction.getOperationsForBackend(BackendType::SNAP);
+    return results;
+}
 
-        for (const auto& op : snapOps) {
-            if (progress) {
-                double pct = static_cast<double>(current) / total;
-                string action = (op.type == Transaction::Operation::Type::INSTALL) ? "Installing" :
-                               (op.type == Transaction::Operation::Type::REMOVE) ? "Removing" : "Updating";
-                if (!progress(pct, "[Snap] " + action + " " + op.packageName + "...")) {
-                    result.success = false;
-                    result.errors.push_back({"", "Operation cancelled"});
-                    return result;
-                }
-            }
+vector<PackageInfo> BackendManager::getCachedInstalledPackages(
+    const BackendFilter& filter)
+{
+    lock_guard<mutex> lock(_catalogMutex);
+    vector<PackageInfo> results;
 
-            OperationResult opResult;
-            switch (op.type) {
-                case Transaction::Operation::Type::INSTALL:
-                    opResult = _snapBackend->installPackage(op.packageId, nullptr);
-                    break;
-                case Transaction::Operation::Type::REMOVE:
-                    opResult = _snapBackend->removePackage(op.packageId, op.purge, nullptr);
-                    break;
-                case Transaction::Operation::Type::UPDATE:
-                    opResult = _snapBackend->updatePackage(op.packageId, nullptr);
-                    break;
-            }
+    if (!_catalogLoaded) {
+        _catalog.load(getCatalogPath());
+        _catalogLoaded = true;
+        noteCatalogCounts();
+    }
 
-            if (opResult.success) {
-                result.successCount++;
-            } else {
-                result.failureCount++;
-                result.errors.push_back({op.packageId, opResult.message});
-                result.success = false;
-            }
+    for (auto* backend : getEnabledBackends()) {
+        if (!filter.includes(backend->getType())) {
+            continue;
+        }
+        const auto& pkgs = _catalog.getPackages(backend->getType());
+        size_t first = results.size();
+        results.insert(results.end(), pkgs.begin(), pkgs.end());
 
-            current++;
+        // Deferred fields outlive the run that captured them; the
+        // backend resolves them by id on first display
+        for (size_t i = first; i < results.size(); i++) {
+            if (results[i].deferredFields) {
+                results[i].deferredSource = backend;
+            }
         }
     }
 
-    // Process Flatpak operations
-    if (_flatpakBackend && _flatpakEnabled) {
-        auto flatpakOps = _currentTransaction.getOperationsForBackend(BackendType::FLATPAK);
+    return results;
+}
+
+CatalogDelta BackendManager::revalidateInstalledPackages(
+    const BackendFilter& filter,
+    ProgressCallback progress)
+{
+    lock_guard<mutex> lock(_catalogMutex);
+    CatalogDelta delta;
+    bool dirty = false;
+
+    if (!_catalogLoaded) {
+        _catalog.load(getCatalogPath());
+        _catalogLoaded = true;
+        noteCatalogCounts();
+    }
+
+    // An empty stamp means we cannot tell, so always ask the backend
+    BackendFilter stale;
+    stale.includeApt = stale.includeSnap = stale.includeFlatpak = false;
+    vector<pair<BackendType, string>> generations;
+    for (auto* backend : getEnabledBackends()) {
+        BackendType type = backend->getType();
+        if (!filter.includes(type)) {
+            continue;
+        }
+        string generation = PackageCatalog::computeGeneration(type);
+        if (!generation.empty() && _catalog.hasSection(type) &&
+            _catalog.getGeneration(type) == generation) {
+            continue;
+        }
+        BackendFilter only = BackendFilter::Only(type);
+        stale.includeApt |= only.includeApt;
+        stale.includeSnap |= only.includeSnap;
+        stale.includeFlatpak |= only.includeFlatpak;
+        generations.emplace_back(type, generation);
+    }
+
+    if (generations.empty()) {
+        if (progress) {
+            progress(1.0, "0 installed packages changed");
+        }
+        return delta;
+    }
+    if (progress && !progress(0.0, "Checking installed packages...")) {
+        return delta;
+    }
+
+    // `snap list` and `flatpak list` run side by side; fanOut keeps
+    // the order of getEnabledBackends(), as generations does
+    vector<vector<PackageInfo>> perBackend;
+    {
+        lock_guard<mutex> backendLock(_mutex);
+        perBackend = fanOut<vector<PackageInfo>>(
+            stale, TaskPriority::NORMAL, CancellationToken(), nullptr, "Checking",
+            [this](IPackageBackend* backend, ProgressCallback) {
+                return sharedInstalled(backend, nullptr);
+            });
+    }
+
+    for (size_t i = 0; i < generations.size() && i < perBackend.size(); i++) {
+        BackendType type = generations[i].first;
+        const vector<PackageInfo>& pkgs = perBackend[i];
+
+        CatalogDelta backendDelta = _catalog.update(type, generations[i].second, pkgs);
+        noteInstalled(type, pkgs);
+        dirty = true;
+
+        int installed = pkgs.size();
+        int available = -1;
+        if (type == BackendType::APT && _aptBackend->getLister()) {
+            available = _aptBackend->getLister()->packagesSize();
+        }
+        noteCounts(type, [installed, available](SourceCounts& counts) {
+            counts.installed = installed;
+            if (available >= 0) {
+                counts.available = available;
+            }
+        });
+
+        delta.added.insert(delta.added.end(),
+                           backendDelta.added.begin(), backendDelta.added.end());
+        delta.changed.insert(delta.changed.end(),
+                             backendDelta.changed.begin(), backendDelta.changed.end());
+        delta.removed.insert(delta.removed.end(),
+                             backendDelta.removed.begin(), backendDelta.removed.end());
+    }
+
+    if (dirty) {
+        _catalog.save(getCatalogPath());
+    }
+
+    if (progress) {
+        progress(1.0, to_string(delta.size()) + " installed packages changed");
+    }
+
+    return delta;
+}
+
+vector<PackageInfo> BackendManager::getUpgradablePackages(
+    const BackendFilter& filter,
+    ProgressCallback progress)
+{
+    lock_guard<mutex> lock(_mutex);
+    vector<PackageInfo> results;
+
+    auto perBackend = fanOut<vector<PackageInfo>>(
+        filter, TaskPriority::NORMAL, CancellationToken(), progress, "Checking",
+        [this](IPackageBackend* backend, ProgressCallback backendProgress) {
+            return sharedUpgradable(backend, backendProgress);
+        });
+
+    for (auto& pkgs : perBackend) {
+        results.insert(results.end(), pkgs.begin(), pkgs.end());
+    }
+
+    if (progress) {
+        progress(1.0, "Found " + to_string(results.size()) + " updates");
+    }
+
+    return results;
+}
+
+string BackendManager::detailsKey(BackendType backend, const string& packageId)
+{
+    return string(backendTypeToString(backend)) + '\n' + packageId;
+}
+
+bool BackendManager::findDetails(const string& key, const string& version,
+                                 PackageInfo* info)
+{
+    lock_guard<mutex> lock(_detailsMutex);
+    PackageInfo* cached = _details.find(key);
+    if (!cached) {
+        return false;
+    }
+    if (!version.empty() && version != cached->version &&
+        version != cached->installedVersion) {
+        _details.erase(key);
+        return false;
+    }
+    if (info) {
+        *info = *cached;
+    }
+    return true;
+}
+
+PackageInfo BackendManager::getPackageDetails(const string& packageId, BackendType backend,
+                                              const string& version)
+{
+    string key = detailsKey(backend, packageId);
+    PackageInfo info;
+    if (findDetails(key, version, &info)) {
+        return info;
+    }
+
+    auto* be = getBackend(backend);
+    if (!be) {
+        return PackageInfo();
+    }
+    // snap info and flatpak info take a while; two callers asking for
+    // the same package at once share one
+    info = _detailFlights.run(key, [be, &packageId]() {
+        return be->getPackageDetails(packageId);
+    });
+    if (!info.id.empty()) {
+        lock_guard<mutex> lock(_detailsMutex);
+        _details.put(key, info);
+    }
+    return info;
+}
+
+// A joined caller gets what the first one got, so a run whose caller
+// cancelled it through progress answers the others partially too; only
+// the update checks and shutdown cancel these
+vector<PackageInfo> BackendManager::sharedInstalled(IPackageBackend* backend,
+                                                    ProgressCallback progress)
+{
+    return _listFlights.run(string(backendTypeToString(backend->getType())) + "\ninstalled",
+        [backend, &progress]() { return backend->getInstalledPackages(progress); });
+}
+
+vector<PackageInfo> BackendManager::sharedUpgradable(IPackageBackend* backend,
+                                                     ProgressCallback progress)
+{
+    return _listFlights.run(string(backendTypeToString(backend->getType())) + "\nupgradable",
+        [backend, &progress]() { return backend->getUpgradablePackages(progress); });
+}
+
+void BackendManager::forgetFlights()
+{
+    _listFlights.forget();
+    _detailFlights.forget();
+}
+
+void BackendManager::forgetDetails(BackendType backend)
+{
+    string prefix = string(backendTypeToString(backend)) + '\n';
+    lock_guard<mutex> lock(_detailsMutex);
+    vector<string> keys;
+    for (const auto& entry : _details) {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0) {
+            keys.push_back(entry.first);
+        }
+    }
+    for (const auto& key : keys) {
+        _details.erase(key);
+    }
+}
+
+void BackendManager::prefetchPackageDetails(const vector<PackageInfo>& packages)
+{
+    for (const auto& pkg : packages) {
+        if (findDetails(detailsKey(pkg.backend, pkg.id), pkg.getDisplayVersion(), nullptr)) {
+            continue;
+        }
+        BackendType backend = pkg.backend;
+        string id = pkg.id;
+        string version = pkg.getDisplayVersion();
+        _pool.submit(TaskPriority::BACKGROUND, [this, backend, id, version]() {
+            ProcessGovernor::PriorityScope scope(ProcessPriority::PREFETCH);
+            return !getPackageDetails(id, backend, version).id.empty();
+        });
+    }
+}
+
+// Only snap and flatpak downloads are estimated; the lister sizes APT's
+static bool needsDownload(const Transaction::Operation& op)
+{
+    return op.backend != BackendType::APT &&
+           op.type != Transaction::Operation::Type::REMOVE;
+}
+
+void BackendManager::prefetchTransactionDetails()
+{
+    vector<PackageInfo> packages;
+    for (const auto& op : getCurrentTransaction().operations) {
+        if (!needsDownload(op)) {
+            continue;
+        }
+        PackageInfo pkg;
+        pkg.id = op.packageId;
+        pkg.backend = op.backend;
+        packages.push_back(pkg);
+    }
+    prefetchPackageDetails(packages);
+}
+
+bool BackendManager::fillDownloadSizes(Transaction& tx)
+{
+    bool complete = true;
+    for (auto& op : tx.operations) {
+        if (!needsDownload(op)) {
+            continue;
+        }
+        PackageInfo info;
+        if (findDetails(detailsKey(op.backend, op.packageId), "", &info)) {
+            op.downloadSize = info.downloadSize;
+        } else {
+            op.downloadSize = 0;
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+// ============================================================================
+// Update Checks
+// ============================================================================
+
+void BackendManager::addUpdateSources()
+{
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        // APT only reads the open cache, so it is cheap but has to stay
+        // on the thread that polls (the one marking); the others ask a
+        // store and go to the pool
+        chrono::seconds base = type == BackendType::APT ?
+            chrono::seconds(chrono::minutes(5)) : chrono::seconds(0);
+        _updates.addSource(type,
+            [this, type](vector<PackageInfo>& packages, const CancellationToken& token) {
+                IPackageBackend* backend = getBackend(type);
+                if (!backend) {
+                    return false;
+                }
+                packages = sharedUpgradable(backend,
+                    [token](double, const string&) { return !token.isCancelled(); });
+                return true;
+            }, base, type == BackendType::APT);
+    }
+
+    _updates.setChangedCallback([this](BackendType type) {
+        _predownloads.schedule(type);
+        int upgradable = _updates.getCount(type);
+        noteCounts(type, [upgradable](SourceCounts& counts) {
+            counts.upgradable = upgradable;
+        });
+        dispatch([this, type]() {
+            if (_updatesCallback) {
+                _updatesCallback(type);
+            }
+        });
+    });
+}
+
+void BackendManager::pollUpdateChecks()
+{
+    _updates.poll();
+}
+
+void BackendManager::invalidateUpdateCheck(BackendType backend)
+{
+    _updates.invalidate(backend);
+}
+
+vector<PackageInfo> BackendManager::getCachedUpgradablePackages(const BackendFilter& filter)
+{
+    vector<PackageInfo> packages;
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        if (!filter.includes(type)) {
+            continue;
+        }
+        vector<PackageInfo> part = _updates.getSnapshot(type);
+        packages.insert(packages.end(), part.begin(), part.end());
+    }
+    return packages;
+}
+
+int BackendManager::getCachedUpgradeCount(BackendType backend)
+{
+    if (!_updates.hasChecked(backend)) {
+        return -1;
+    }
+    return _updates.getCount(backend);
+}
+
+void BackendManager::setUpdatesChangedCallback(UpdatesChangedCallback cb)
+{
+    _updatesCallback = cb;
+}
+
+// ============================================================================
+// Source Counts
+// ============================================================================
+
+SourceCounts BackendManager::getSourceCounts(BackendType backend)
+{
+    lock_guard<mutex> lock(_countsMutex);
+    auto it = _counts.find(backend);
+    return it != _counts.end() ? it->second : SourceCounts();
+}
+
+void BackendManager::setSourceCountsCallback(SourceCountsCallback cb)
+{
+    lock_guard<mutex> lock(_countsMutex);
+    _countsCallback = cb;
+}
+
+void BackendManager::noteCounts(BackendType type,
+                                const function<void(SourceCounts&)>& change)
+{
+    SourceCounts counts;
+    {
+        lock_guard<mutex> lock(_countsMutex);
+        SourceCounts& current = _counts[type];
+        SourceCounts before = current;
+        change(current);
+        if (current == before || !_countsCallback) {
+            return;
+        }
+        counts = current;
+    }
+
+    dispatch([this, type, counts]() {
+        SourceCountsCallback cb;
+        {
+            lock_guard<mutex> lock(_countsMutex);
+            cb = _countsCallback;
+        }
+        if (cb) {
+            cb(type, counts);
+        }
+    });
+}
+
+void BackendManager::noteStoreCounts(BackendType type)
+{
+    if (!_storeIndex.hasSection(type)) {
+        return;
+    }
+    int available = _storeIndex.size(type);
+    noteCounts(type, [available](SourceCounts& counts) {
+        counts.available = available;
+    });
+}
+
+void BackendManager::noteCatalogCounts()
+{
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        if (!_catalog.hasSection(type)) {
+            continue;
+        }
+        int installed = _catalog.getPackages(type).size();
+        noteCounts(type, [installed](SourceCounts& counts) {
+            counts.installed = installed;
+        });
+    }
+}
+
+// ============================================================================
+// Pre-download
+// ============================================================================
+
+void BackendManager::setPredownloadEnabled(bool enabled)
+{
+    _predownloads.setEnabled(enabled);
+    saveConfiguration();
+
+    if (!enabled) {
+        return;
+    }
+    // What the last checks found is pending already
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        if (_updates.getCount(type) > 0) {
+            _predownloads.schedule(type);
+        }
+    }
+}
+
+void BackendManager::setPredownloadRateLimit(int kbps)
+{
+    _predownloads.setRateLimit(kbps);
+    saveConfiguration();
+}
+
+void BackendManager::setConnectionMetered(bool metered)
+{
+    _predownloads.setMetered(metered);
+}
+
+void BackendManager::cancelPredownloads()
+{
+    _predownloads.cancel();
+}
+
+size_t BackendManager::getPredownloadCount() const
+{
+    return _predownloads.getCount();
+}
+
+// ============================================================================
+// Low-Memory Mode
+// ============================================================================
+
+// The fields trimForList() drops, those summary records leave out
+static const unsigned TRIMMED_FIELDS = PackageInfo::DEFER_DETAILS;
+
+void BackendManager::setLowMemoryMode(bool enabled)
+{
+    _lowMemory = enabled;
+    saveConfiguration();
+    applyLowMemoryMode();
+}
+
+void BackendManager::applyLowMemoryMode()
+{
+    {
+        lock_guard<mutex> lock(_detailsMutex);
+        _details.setCapacity(_lowMemory ? LOW_MEMORY_DETAILS_ENTRIES : DETAILS_ENTRIES);
+    }
+    Logger::instance().getMemorySink()->setCapacity(
+        _lowMemory ? LOW_MEMORY_LOG_ENTRIES : LOG_ENTRIES);
+}
+
+void BackendManager::trimForList(vector<PackageInfo>& packages)
+{
+    if (!_lowMemory) {
+        return;
+    }
+
+    IPackageBackend* apt = getBackend(BackendType::APT);
+    for (auto& pkg : packages) {
+        if ((pkg.deferredFields & TRIMMED_FIELDS) == TRIMMED_FIELDS) {
+            continue;
+        }
+        // Swapped out rather than cleared, so the buffers are freed
+        string().swap(pkg.description);
+        string().swap(pkg.homepage);
+        string().swap(pkg.keywords);
+        pkg.deferredFields |= TRIMMED_FIELDS;
+        // APT fills deferred fields from the open cache; the others
+        // only through the details cache, see resolveDetails()
+        if (pkg.backend == BackendType::APT) {
+            pkg.deferredSource = apt;
+        }
+    }
+}
+
+bool BackendManager::resolveDetails(PackageInfo& pkg)
+{
+    if (pkg.backend == BackendType::APT || !pkg.isDeferred(TRIMMED_FIELDS)) {
+        pkg.resolve();
+        return true;
+    }
+
+    PackageInfo details;
+    if (!findDetails(detailsKey(pkg.backend, pkg.id), pkg.getDisplayVersion(), &details)) {
+        prefetchPackageDetails({pkg});
+        return false;
+    }
+    if (pkg.isDeferred(PackageInfo::DEFER_DESCRIPTION)) {
+        pkg.description = details.description;
+    }
+    if (pkg.isDeferred(PackageInfo::DEFER_HOMEPAGE)) {
+        pkg.homepage = details.homepage;
+    }
+    pkg.deferredFields &= ~TRIMMED_FIELDS;
+    pkg.resolve();
+    return true;
+}
+
+// ============================================================================
+// Cache Cleanup
+// ============================================================================
+
+void BackendManager::cleanCaches(const RetentionPolicy& policy,
+                                 function<void(uint64_t)> done)
+{
+    _pool.submit(TaskPriority::BACKGROUND, [this, policy, done]() {
+        uint64_t freed = 0;
+        for (BackendType type : {BackendType::SNAP, BackendType::FLATPAK}) {
+            IPackageBackend* backend = getBackend(type);
+            if (!backend || !backend->supportsCacheCleanup()) {
+                continue;
+            }
+
+            vector<CachedItem> items = backend->getCachedItems();
+            vector<const CachedItem*> chosen = CacheRetention::select(items, policy);
+            if (chosen.empty()) {
+                continue;
+            }
+            vector<CachedItem> removing;
+            for (const CachedItem* item : chosen) {
+                removing.push_back(*item);
+            }
+
+            OperationResult result = backend->removeCachedItems(removing);
+            if (result.success) {
+                freed += CacheRetention::totalSize(chosen);
+                LOG_INFO(backend->getName() + ": " + result.message);
+            } else {
+                LOG_WARN(backend->getName() + ": " + result.message +
+                         (result.errorDetails.empty() ? "" : ": " + result.errorDetails));
+            }
+        }
+
+        if (done) {
+            dispatch([done, freed]() { done(freed); });
+        }
+        return 0;
+    });
+}
+
+// ============================================================================
+// External Changes
+// ============================================================================
+
+void BackendManager::addChangeWatches()
+{
+    // The same places the catalog's generation stamps look at
+    vector<string> flatpak = {"/var/lib/flatpak/.changed"};
+    const char* home = getenv("HOME");
+    if (home) {
+        flatpak.push_back(string(home) + "/.local/share/flatpak/.changed");
+    }
+
+    _changeWatches[BackendType::APT].reset(
+        new PathWatch({"/var/lib/dpkg/status", "/var/lib/apt/lists/"}));
+    _changeWatches[BackendType::SNAP].reset(
+        new PathWatch({"/var/lib/snapd/state.json"}));
+    _changeWatches[BackendType::FLATPAK].reset(new PathWatch(flatpak));
+}
+
+vector<BackendType> BackendManager::checkExternalChanges()
+{
+    vector<BackendType> changed;
+    for (auto& entry : _changeWatches) {
+        if (!entry.second->changed()) {
+            continue;
+        }
+        forgetDetails(entry.first);
+        _updates.invalidate(entry.first);
+        forgetFlights();
+        changed.push_back(entry.first);
+    }
+    if (_snapChanged.exchange(false) &&
+        find(changed.begin(), changed.end(), BackendType::SNAP) == changed.end()) {
+        changed.push_back(BackendType::SNAP);
+    }
+    return changed;
+}
+
+void BackendManager::setSnapChangeCallback(SnapChangeCallback cb)
+{
+    lock_guard<mutex> lock(_snapChangeMutex);
+    _snapChangeCallback = cb;
+}
+
+void BackendManager::onSnapChange(const SnapChangeEvent& event)
+{
+    // On the watcher's thread
+    if (event.isReady()) {
+        forgetDetails(BackendType::SNAP);
+        _updates.invalidate(BackendType::SNAP);
+        forgetFlights();
+        _snapChanged = true;
+    }
+
+    {
+        lock_guard<mutex> lock(_snapChangeMutex);
+        if (!_snapChangeCallback) {
+            return;
+        }
+    }
+    dispatch([this, event]() {
+        SnapChangeCallback cb;
+        {
+            lock_guard<mutex> lock(_snapChangeMutex);
+            cb = _snapChangeCallback;
+        }
+        if (cb) {
+            cb(event);
+        }
+    });
+}
+
+// ============================================================================
+// Transaction Management
+// ============================================================================
+
+Transaction BackendManager::getCurrentTransaction() const
+{
+    lock_guard<mutex> lock(_txMutex);
+    return _currentTransaction;
+}
+
+void BackendManager::queueInstall(const PackageInfo& package)
+{
+    lock_guard<mutex> lock(_txMutex);
+
+    Transaction::Operation op;
+    op.backend = package.backend;
+    op.packageId = package.id;
+    op.packageName = package.name;
+    op.identity = package.identity();
+    op.type = Transaction::Operation::Type::INSTALL;
+
+    _currentTransaction.operations.push_back(op);
+    notifyTransactionChanged();
+}
+
+void BackendManager::queueRemove(const PackageInfo& package, bool purge)
+{
+    lock_guard<mutex> lock(_txMutex);
+
+    Transaction::Operation op;
+    op.backend = package.backend;
+    op.packageId = package.id;
+    op.packageName = package.name;
+    op.identity = package.identity();
+    op.type = Transaction::Operation::Type::REMOVE;
+    op.purge = purge;
+
+    _currentTransaction.operations.push_back(op);
+    notifyTransactionChanged();
+}
+
+void BackendManager::queueUpdate(const PackageInfo& package)
+{
+    lock_guard<mutex> lock(_txMutex);
+
+    Transaction::Operation op;
+    op.backend = package.backend;
+    op.packageId = package.id;
+    op.packageName = package.name;
+    op.identity = package.identity();
+    op.type = Transaction::Operation::Type::UPDATE;
+
+    _currentTransaction.operations.push_back(op);
+    notifyTransactionChanged();
+}
+
+void BackendManager::queueOperation(const Transaction::Operation& op)
+{
+    lock_guard<mutex> lock(_txMutex);
+
+    _currentTransaction.operations.push_back(op);
+    _currentTransaction.operations.back().identity =
+        packageIdentity(op.backend, op.packageId);
+    notifyTransactionChanged();
+}
+
+void BackendManager::unqueue(const string& packageId, BackendType backend)
+{
+    lock_guard<mutex> lock(_txMutex);
+
+    uint64_t identity = packageIdentity(backend, packageId);
+    _currentTransaction.operations.erase(
+        remove_if(_currentTransaction.operations.begin(),
+                  _currentTransaction.operations.end(),
+                  [identity](const Transaction::Operation& op) {
+                      return op.identity == identity;
+                  }),
+        _currentTransaction.operations.end());
+
+    notifyTransactionChanged();
+}
+
+void BackendManager::clearTransaction()
+{
+    lock_guard<mutex> lock(_txMutex);
+    _currentTransaction.clear();
+    notifyTransactionChanged();
+}
+
+static MetricGauge& commitGauge(const char* name, const char* help)
+{
+    return MetricsRegistry::instance().gauge(name, help);
+}
+
+struct BackendManager::CommitPlan {
+    unordered_map<uint64_t, int64_t> weights;   // Predicted ms, by identity
+    int64_t total = 0;
+    atomic<int64_t> done{0};                    // Weight of the batches that ran
+
+    int64_t weight(const Transaction::Operation& op) const
+    {
+        auto it = weights.find(op.identity);
+        return it != weights.end() ? it->second : 1;
+    }
+};
+
+bool BackendManager::commitBackendOperations(
+    IPackageBackend* backend,
+    const vector<Transaction::Operation>& ops,
+    CommitPlan& plan,
+    ProgressCallback progress,
+    TransactionResult& result)
+{
+    using Type = Transaction::Operation::Type;
+    using Clock = chrono::steady_clock;
+
+    // One batch per kind of operation, so each backend sees a single
+    // install, update and removal request (purges are a separate one)
+    struct Batch {
+        Type type;
+        bool purge;
+        const char* action;
+        vector<string> ids;
+        vector<const Transaction::Operation*> ops;
+        int64_t weight;
+    };
+    vector<Batch> batches = {
+        {Type::INSTALL, false, "Installing", {}, {}, 0},
+        {Type::UPDATE, false, "Updating", {}, {}, 0},
+        {Type::REMOVE, false, "Removing", {}, {}, 0},
+        {Type::REMOVE, true, "Purging", {}, {}, 0},
+    };
+    // Operations asking for a version, channel or branch each take
+    // their own call after the batches
+    vector<const Transaction::Operation*> targeted;
+    for (const auto& op : ops) {
+        if (!op.target.empty() && op.type != Type::REMOVE) {
+            targeted.push_back(&op);
+            continue;
+        }
+        for (auto& batch : batches) {
+            if (batch.type == op.type && (op.type != Type::REMOVE || batch.purge == op.purge)) {
+                batch.ids.push_back(op.packageId);
+                batch.ops.push_back(&op);
+                batch.weight += plan.weight(op);
+                break;
+            }
+        }
+    }
+
+    // APT only sets marks here; the Synaptic commit is what takes time
+    bool timed = backend->getType() != BackendType::APT;
+    auto elapsedSince = [](Clock::time_point start) {
+        return chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    for (const auto& batch : batches) {
+        if (batch.ids.empty()) {
+            continue;
+        }
 
-        for (const auto& op : flatpakOps) {
-            if (progress) {
-                double pct = static_cast<double>(current) / total;
-                string action = (op.type == Transaction::Operation::Type::INSTALL) ? "Installing" :
-                               (op.type == Transaction::Operation::Type::REMOVE) ? "Removing" : "Updating";
-                if (!progress(pct, "[Flatpak] " + action + " " + op.packageName + "...")) {
-                    result.success = false;
-                    result.errors.push_back({"", "Operation cancelled"});
-                    return result;
-                }
+        if (progress) {
+            double pct = static_cast<double>(plan.done.load()) / plan.total;
+            string what = batch.ids.size() == 1 ? batch.ids.front()
+                                                : to_string(batch.ids.size()) + " packages";
+            if (!progress(pct, "[" + backend->getName() + "] " + batch.action + " " + what + "...")) {
+                result.success = false;
+                result.errors.push_back({"", "Operation cancelled"});
+                return false;
+            }
+        }
+
+        // The backend reports 0..1 of its batch; show it as the share of
+        // the whole transaction the batch is predicted to take
+        ProgressCallback batchProgress;
+        if (progress) {
+            double before = plan.done.load();
+            double size = batch.weight;
+            double total = plan.total;
+            string prefix = "[" + backend->getName() + "] ";
+            batchProgress = [&progress, before, size, total, prefix](
+                double fraction, const string& message) {
+                return progress((before + fraction * size) / total, prefix + message);
+            };
+        }
+
+        Clock::time_point start = Clock::now();
+        OperationResult opResult;
+        switch (batch.type) {
+            case Type::INSTALL:
+                opResult = backend->installPackages(batch.ids, batchProgress);
+                break;
+            case Type::REMOVE:
+                opResult = backend->removePackages(batch.ids, batch.purge, batchProgress);
+                break;
+            case Type::UPDATE:
+                opResult = backend->updatePackages(batch.ids, batchProgress);
+                break;
+        }
+
+        if (timed) {
+            _journal->checkpoint(backend->getType(), batch.ids,
+                                 opResult.success ? TransactionJournal::State::DONE
+                                                  : TransactionJournal::State::FAILED);
+        }
+        if (timed && opResult.success) {
+            // A batch's time is shared out as it was predicted to be
+            double seconds = elapsedSince(start);
+            for (const auto* op : batch.ops) {
+                _history->record(*op, seconds * plan.weight(*op) / batch.weight);
+            }
+        }
+        if (opResult.success) {
+            result.successCount += batch.ids.size();
+        } else {
+            // A batch stands or falls as a whole
+            result.failureCount += batch.ids.size();
+            for (const auto& id : batch.ids) {
+                result.errors.push_back({id, opResult.message});
+            }
+            result.success = false;
+        }
+
+        plan.done += batch.weight;
+    }
+
+    for (const auto* op : targeted) {
+        string prefix = "[" + backend->getName() + "] ";
+        if (progress &&
+            !progress(static_cast<double>(plan.done.load()) / plan.total,
+                      prefix + "Installing " + op->packageId + " " + op->target + "...")) {
+            result.success = false;
+            result.errors.push_back({"", "Operation cancelled"});
+            return false;
+        }
+
+        ProgressCallback opProgress;
+        if (progress) {
+            double before = plan.done.load();
+            double size = plan.weight(*op);
+            double total = plan.total;
+            opProgress = [&progress, before, size, total, prefix](
+                double fraction, const string& message) {
+                return progress((before + fraction * size) / total, prefix + message);
+            };
+        }
+
+        Clock::time_point start = Clock::now();
+        OperationResult opResult = backend->installPackageVersion(op->packageId, op->target,
+                                                                  opProgress);
+        if (timed) {
+            _journal->checkpoint(backend->getType(), {op->packageId},
+                                 opResult.success ? TransactionJournal::State::DONE
+                                                  : TransactionJournal::State::FAILED);
+        }
+        if (timed && opResult.success) {
+            _history->record(*op, elapsedSince(start));
+        }
+        if (opResult.success) {
+            result.successCount++;
+        } else {
+            result.failureCount++;
+            result.errors.push_back({op->packageId, opResult.message});
+            result.success = false;
+        }
+
+        plan.done += plan.weight(*op);
+    }
+
+    return true;
+}
+
+TransactionResult BackendManager::commitTransaction(ProgressCallback progress)
+{
+    // The commit fetches the rest itself, and needs the cache locks
+    cancelPredownloads();
+
+    lock_guard<mutex> lock(_txMutex);
+    TransactionResult result;
+    result.success = true;
+    result.successCount = 0;
+    result.failureCount = 0;
+
+    // Each operation counts for the time it is predicted to take
+    fillDownloadSizes(_currentTransaction);
+    CommitPlan plan;
+    for (const auto& op : _currentTransaction.operations) {
+        int64_t ms = static_cast<int64_t>(_history->estimate(op) * 1000);
+        plan.weights[op.identity] = ms;
+        plan.total += ms;
+    }
+    plan.total = max<int64_t>(plan.total, 1);
+    _commitEtaMs = plan.total;
+    commitGauge("polysynaptic_transaction_predicted_seconds",
+                "Predicted seconds for the running commit").set(plan.total / 1000);
+    MetricGauge& etaGauge = commitGauge("polysynaptic_transaction_eta_seconds",
+                                        "Predicted seconds left in the running commit");
+    etaGauge.set(plan.total / 1000);
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    // dpkg, snapd and the flatpak repo lock independently, so the
+    // backends' shares run concurrently. Progress reports are
+    // serialized, and a false return stops every backend before its
+    // next batch.
+    mutex progressMutex;
+    atomic<bool> cancelled(false);
+    ProgressCallback sharedProgress = [&](double pct, const string& msg) {
+        lock_guard<mutex> progressLock(progressMutex);
+        if (cancelled) {
+            return false;
+        }
+
+        // Once a tenth is in, the prediction is held to how it did so far
+        double left = plan.total * (1 - pct);
+        double elapsed = chrono::duration<double, milli>(
+            chrono::steady_clock::now() - started).count();
+        if (pct >= 0.1) {
+            left *= min(max(elapsed / (plan.total * pct), 0.25), 4.0);
+        }
+        _commitEtaMs = static_cast<int64_t>(max(left, 0.0));
+        etaGauge.set(_commitEtaMs / 1000);
+
+        if (progress && !progress(pct, msg)) {
+            cancelled = true;
+            return false;
+        }
+        return true;
+    };
+
+    auto aptOps = _currentTransaction.getOperationsForBackend(BackendType::APT);
+    auto snapOps = _currentTransaction.getOperationsForBackend(BackendType::SNAP);
+    auto flatpakOps = _currentTransaction.getOperationsForBackend(BackendType::FLATPAK);
+
+    // APT's share only sets marks here, the Synaptic commit journals
+    // itself; the rest is written down before any of it runs
+    bool snapRuns = _snapBackend && _snapEnabled && !snapOps.empty();
+    bool flatpakRuns = _flatpakBackend && _flatpakEnabled && !flatpakOps.empty();
+    vector<Transaction::Operation> journaled;
+    if (snapRuns) journaled.insert(journaled.end(), snapOps.begin(), snapOps.end());
+    if (flatpakRuns) journaled.insert(journaled.end(), flatpakOps.begin(), flatpakOps.end());
+    if (!journaled.empty()) {
+        _journal->record(journaled);
+    }
+
+    // The one real ordering: changes to the daemon's own deb have to
+    // land before the snaps or flatpaks that use it
+    unordered_set<uint64_t> aptIdentities;
+    for (const auto& op : aptOps) {
+        aptIdentities.insert(op.identity);
+    }
+    auto touches = [&aptIdentities](const string& packageId) {
+        return aptIdentities.count(packageIdentity(BackendType::APT, packageId)) > 0;
+    };
+
+    TransactionResult aptResult = result;
+    TransactionResult snapResult = result;
+    TransactionResult flatpakResult = result;
+    bool aptDone = true, snapDone = true, flatpakDone = true;
+
+    // APT's share runs on the calling thread: its marks and the commit
+    // use the cache the caller's thread owns (the depcache of the main
+    // loop for the GUI). Snap and flatpak get their own threads rather
+    // than _pool: a commit can take many minutes and must not starve
+    // interactive searches of workers.
+    future<void> snapFuture;
+    future<void> flatpakFuture;
+    // Declared after the futures, so that if APT's share throws the
+    // waiting threads are released before the futures join them
+    promise<bool> aptFinished;
+    shared_future<bool> aptFuture = aptFinished.get_future().share();
+
+    // A share that waits on APT only runs if APT's went through; if it
+    // failed or threw, the share fails without being started
+    auto aptSucceeded = [&aptFuture]() {
+        try {
+            return aptFuture.get();
+        } catch (const future_error&) {
+            return false;
+        }
+    };
+    auto skipShare = [this](BackendType type, const vector<Transaction::Operation>& ops,
+                            TransactionResult& part) {
+        vector<string> ids;
+        for (const auto& op : ops) {
+            ids.push_back(op.packageId);
+            part.errors.push_back({op.packageId, "Not run: the APT changes it needs failed"});
+            part.failureCount++;
+        }
+        part.success = false;
+        _journal->checkpoint(type, ids, TransactionJournal::State::FAILED);
+    };
+
+    bool snapWaits = touches("snapd");
+    if (snapRuns) {
+        snapFuture = async(launch::async, [&]() {
+            if (snapWaits && !aptSucceeded()) {
+                skipShare(BackendType::SNAP, snapOps, snapResult);
+                snapDone = false;
+                return;
             }
+            snapDone = commitBackendOperations(_snapBackend.get(), snapOps, plan,
+                                               sharedProgress, snapResult);
+        });
+    }
 
-            OperationResult opResult;
-            switch (op.type) {
-                case Transaction::Operation::Type::INSTALL:
-                    opResult = _flatpakBackend->installPackage(op.packageId, nullptr);
-                    break;
-                case Transaction::Operation::Type::REMOVE:
-                    opResult = _flatpakBackend->removePackage(op.packageId, op.purge, nullptr);
-                    break;
-                case Transaction::Operation::Type::UPDATE:
-                    opResult = _flatpakBackend->updatePackage(op.packageId, nullptr);
-                    break;
+    bool flatpakWaits = touches("flatpak");
+    if (flatpakRuns) {
+        flatpakFuture = async(launch::async, [&]() {
+            if (flatpakWaits && !aptSucceeded()) {
+                skipShare(BackendType::FLATPAK, flatpakOps, flatpakResult);
+                flatpakDone = false;
+                return;
             }
+            flatpakDone = commitBackendOperations(_flatpakBackend.get(), flatpakOps, plan,
+                                                  sharedProgress, flatpakResult);
+        });
+    }
 
-            if (opResult.success) {
-                result.successCount++;
+    if (_aptBackend && _aptEnabled && !aptOps.empty()) {
+        {
+            // All of the marks share one auto-removal sweep
+            AptBackend::MarkGroup group(*_aptBackend);
+            aptDone = commitBackendOperations(_aptBackend.get(), aptOps, plan,
+                                              sharedProgress, aptResult);
+        }
+        // APT only marks above; everything goes through one commit,
+        // whose time is shared out as it was predicted to be
+        if (aptDone) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            OperationResult committed = _aptBackend->commitChanges(nullptr);
+            if (committed.success) {
+                double seconds = chrono::duration<double>(
+                    chrono::steady_clock::now() - start).count();
+                int64_t weight = 0;
+                for (const auto& op : aptOps) weight += plan.weight(op);
+                for (const auto& op : aptOps) {
+                    _history->record(op, seconds * plan.weight(op) / max<int64_t>(weight, 1));
+                }
             } else {
-                result.failureCount++;
-                result.errors.push_back({op.packageId, opResult.message});
-                result.success = false;
+                aptDone = false;
+                aptResult.success = false;
+                aptResult.errors.push_back({"", committed.message.empty()
+                                                    ? "APT commit failed" : committed.message});
             }
+        }
+    }
+    aptFinished.set_value(aptDone);
+
+    if (snapFuture.valid()) snapFuture.wait();
+    if (flatpakFuture.valid()) flatpakFuture.wait();
+
+    _commitEtaMs = -1;
+    etaGauge.set(0);
+    _history->save();
+
+    // Whatever was committed has other versions and status now
+    {
+        lock_guard<mutex> lock(_detailsMutex);
+        for (const auto& op : _currentTransaction.operations) {
+            _details.erase(detailsKey(op.backend, op.packageId));
+        }
+    }
+    for (const auto& op : _currentTransaction.operations) {
+        _updates.invalidate(op.backend);
+    }
+
+    // Lists and details asked for during the run may predate it
+    forgetFlights();
+
+    // Merge in backend order so errors read the same as before
+    for (const TransactionResult* part : {&aptResult, &snapResult, &flatpakResult}) {
+        result.success = result.success && part->success;
+        result.successCount += part->successCount;
+        result.failureCount += part->failureCount;
+        result.errors.insert(result.errors.end(), part->errors.begin(), part->errors.end());
+    }
 
-            current++;
+    if (!aptDone || !snapDone || !flatpakDone) {
+        // What got done before the cancel is not done again
+        unordered_set<uint64_t> done;
+        for (const auto& entry : _journal->entries()) {
+            if (entry.state == TransactionJournal::State::DONE) {
+                done.insert(entry.op.identity);
+            }
         }
+        auto& ops = _currentTransaction.operations;
+        ops.erase(remove_if(ops.begin(), ops.end(),
+                            [&done](const Transaction::Operation& op) {
+                                return op.backend != BackendType::APT &&
+                                       done.count(op.identity) > 0;
+                            }),
+                  ops.end());
+        notifyTransactionChanged();
+        return result;
     }
 
     // Clear completed transaction
     _currentTransaction.clear();
+    if (snapRuns) _journal->complete(BackendType::SNAP);
+    if (flatpakRuns) _journal->complete(BackendType::FLATPAK);
 
     if (progress) {
         progress(1.0, result.getSummary());
@@ -608,6 +2061,45 @@ TransactionResult BackendManager::commitTransaction(ProgressCallback progress)
     return result;
 }
 
+double BackendManager::estimateTransaction(const Transaction& tx) const
+{
+    double seconds = 0;
+    for (const auto& op : tx.operations) {
+        seconds += _history->estimate(op);
+    }
+    return seconds;
+}
+
+double BackendManager::getCommitEta() const
+{
+    int64_t ms = _commitEtaMs.load();
+    return ms < 0 ? -1 : ms / 1000.0;
+}
+
+Transaction BackendManager::getInterruptedTransaction() const
+{
+    return _journal->unfinished();
+}
+
+void BackendManager::discardInterruptedTransaction()
+{
+    _journal->discard();
+}
+
+void BackendManager::recordAptCommit(const vector<Transaction::Operation>& ops)
+{
+    if (ops.empty()) {
+        _journal->complete(BackendType::APT);
+        return;
+    }
+    _journal->record(ops);
+}
+
+void BackendManager::completeAptCommit()
+{
+    _journal->complete(BackendType::APT);
+}
+
 bool BackendManager::hasQueuedOperations() const
 {
     lock_guard<mutex> lock(_txMutex);
@@ -680,31 +2172,40 @@ string BackendManager::getTransactionSummary() const
 
 OperationResult BackendManager::refreshAllCaches(ProgressCallback progress)
 {
-    auto backends = getEnabledBackends();
-    int current = 0;
-    int total = backends.size();
-    int failures = 0;
+    CancellationToken token;
+    auto results = fanOut<OperationResult>(
+        BackendFilter::All(), TaskPriority::BACKGROUND, token, progress, "Refreshing",
+        [](IPackageBackend* backend, ProgressCallback backendProgress) {
+            return backend->refreshCache(backendProgress);
+        });
+
+    // New metadata may change any package's details and updates
+    forgetFlights();
+    {
+        lock_guard<mutex> lock(_detailsMutex);
+        _details.clear();
+    }
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        _updates.invalidate(type);
+    }
 
-    for (auto* backend : backends) {
-        if (progress) {
-            double pct = static_cast<double>(current) / total;
-            if (!progress(pct, "Refreshing " + backend->getName() + " cache...")) {
-                return OperationResult::Failure("Cancelled");
-            }
-        }
+    if (token.isCancelled()) {
+        return OperationResult::Failure("Cancelled");
+    }
 
-        auto result = backend->refreshCache(nullptr);
+    int failures = 0;
+    for (const auto& result : results) {
         if (!result.success) {
             failures++;
         }
-
-        current++;
     }
 
     if (progress) {
         progress(1.0, "Cache refresh complete");
     }
 
+    refreshStoreIndex();
+
     if (failures > 0) {
         return OperationResult::Failure("Some caches failed to refresh");
     }
@@ -712,6 +2213,336 @@ OperationResult BackendManager::refreshAllCaches(ProgressCallback progress)
     return OperationResult::Success("All caches refreshed");
 }
 
+void BackendManager::refreshStoreIndex(bool force)
+{
+    {
+        lock_guard<mutex> lock(_storeMutex);
+        if (!_storeIndexLoaded) {
+            _storeIndex.load(getStoreIndexPath());
+            _storeIndexLoaded = true;
+        }
+    }
+    for (BackendType type : {BackendType::SNAP, BackendType::FLATPAK}) {
+        noteStoreCounts(type);
+    }
+
+    vector<IPackageBackend*> backends;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto* backend : getEnabledBackends()) {
+            if (backend->getType() != BackendType::APT) {
+                backends.push_back(backend);
+            }
+        }
+    }
+
+    CancellationToken token = _storeRefresh;
+
+    // Searches only use an index that is already built
+    _pool.submit(TaskPriority::BACKGROUND, token, []() {
+        AppstreamIndex::shared();
+        return 0;
+    });
+
+    for (auto* backend : backends) {
+        _pool.submit(TaskPriority::BACKGROUND, token,
+            [this, backend, force, token]() {
+                BackendType type = backend->getType();
+                auto isCancelled = [token]() { return token.isCancelled(); };
+
+                noteInstalled(type, backend->getInstalledPackages(nullptr));
+
+                // An empty stamp means the backend cannot list its store
+                string generation = backend->getStoreCatalogGeneration();
+                if (generation.empty() || token.isCancelled()) {
+                    return 0;
+                }
+                if (!force && _storeIndex.hasSection(type) &&
+                    _storeIndex.getGeneration(type) == generation) {
+                    return 0;
+                }
+
+                // Someone else already listed this generation for us
+                bool shared = !force &&
+                    _storeIndex.loadSection(SHARED_STORE_INDEX, type, generation);
+
+                // Otherwise only the apps that differ from the section
+                // are refolded, and the indexes over it rebuilt only if
+                // any did
+                bool moved = shared;
+                vector<PackageInfo> packages;
+                if (!shared) {
+                    if (!backend->getStoreCatalog(packages, isCancelled)) {
+                        return 0;
+                    }
+                    enrich(packages);
+                    moved = !_storeIndex.refresh(type, generation, packages).empty();
+                }
+                if (!token.isCancelled()) {
+                    if (moved) {
+                        noteStoreCounts(type);
+                        refreshCategoryIndex();
+                        refreshFuzzyIndex();
+                    }
+                    lock_guard<mutex> saveLock(_storeSaveMutex);
+                    _storeIndex.save(getStoreIndexPath());
+                }
+                return 0;
+            });
+    }
+
+    // From the sections loaded so far; the ones refetched rebuild them again
+    refreshCategoryIndex();
+    refreshFuzzyIndex();
+}
+
+// ============================================================================
+// Categories
+// ============================================================================
+
+void BackendManager::refreshCategoryIndex()
+{
+    if (_categoryQueued.exchange(true)) {
+        return;
+    }
+
+    CancellationToken token = _storeRefresh;
+    _pool.submit(TaskPriority::BACKGROUND, token, [this]() {
+        // Changes from now on need another build
+        _categoryQueued = false;
+
+        ScopedSpan span("categoryIndex", "manager");
+        auto index = make_shared<CategoryIndex>();
+
+        if (_aptBackend) {
+            // Whatever AppStream index is built; the store refresh
+            // builds it first
+            shared_ptr<const AppstreamIndex> appstream = AppstreamIndex::peek();
+            CategoryIndex::Debtags debtags = CategoryIndex::loadDebtags();
+
+            PackageInfo info;
+            info.backend = BackendType::APT;
+            _aptBackend->forEachSection([&](const char* name, const char* section) {
+                info.id = info.name = name;
+                info.section = section;
+                index->add(info, CategoryIndex::categoriesOf(info, appstream.get(),
+                                                             &debtags));
+            });
+        }
+
+        for (BackendType type : {BackendType::SNAP, BackendType::FLATPAK}) {
+            _storeIndex.forEach(type, [&](const PackageInfo& pkg) {
+                index->add(pkg, CategoryIndex::categoriesOf(pkg));
+            });
+        }
+
+        lock_guard<mutex> lock(_categoryMutex);
+        _categories = index;
+        return 0;
+    });
+}
+
+shared_ptr<const CategoryIndex> BackendManager::getCategoryIndex()
+{
+    lock_guard<mutex> lock(_categoryMutex);
+    return _categories;
+}
+
+vector<PackageInfo> BackendManager::getCategoryPackages(
+    Category category,
+    const BackendFilter& filter)
+{
+    vector<PackageInfo> results;
+    shared_ptr<const CategoryIndex> index = getCategoryIndex();
+    if (!index) {
+        return results;
+    }
+
+    vector<IPackageBackend*> backends;
+    {
+        lock_guard<mutex> lock(_mutex);
+        backends = getEnabledBackends();
+    }
+
+    for (auto* backend : backends) {
+        BackendType type = backend->getType();
+        if (!filter.includes(type)) {
+            continue;
+        }
+        vector<PackageInfo> packages = lookupPackages(type, index->ids(category, type));
+        results.insert(results.end(),
+                       make_move_iterator(packages.begin()),
+                       make_move_iterator(packages.end()));
+    }
+
+    return results;
+}
+
+vector<PackageInfo> BackendManager::lookupPackages(BackendType type,
+                                                   const vector<string>& ids)
+{
+    if (type == BackendType::APT) {
+        return _aptBackend ? _aptBackend->getPackages(ids) : vector<PackageInfo>();
+    }
+
+    vector<PackageInfo> packages = _storeIndex.lookup(type, ids);
+    lock_guard<mutex> lock(_storeMutex);
+    auto known = _storeInstalled.find(type);
+    if (known == _storeInstalled.end()) {
+        return packages;
+    }
+    for (auto& pkg : packages) {
+        auto it = known->second.find(pkg.id);
+        if (it != known->second.end()) {
+            pkg.installStatus = InstallStatus::INSTALLED;
+            pkg.installedVersion = it->second;
+        } else {
+            pkg.installStatus = InstallStatus::NOT_INSTALLED;
+        }
+    }
+    return packages;
+}
+
+// ============================================================================
+// Near Matches
+// ============================================================================
+
+void BackendManager::refreshFuzzyIndex()
+{
+    if (_fuzzyQueued.exchange(true)) {
+        return;
+    }
+
+    CancellationToken token = _storeRefresh;
+    _pool.submit(TaskPriority::BACKGROUND, token, [this]() {
+        _fuzzyQueued = false;
+
+        ScopedSpan span("fuzzyIndex", "manager");
+        auto index = make_shared<FuzzyIndex>();
+        if (_aptBackend) {
+            _aptBackend->forEachSection([&](const char* name, const char*) {
+                index->add(BackendType::APT, name, name);
+            });
+        }
+        for (BackendType type : {BackendType::SNAP, BackendType::FLATPAK}) {
+            _storeIndex.forEach(type, [&](const PackageInfo& pkg) {
+                index->add(type, pkg.id, pkg.name);
+            });
+        }
+        index->build();
+
+        lock_guard<mutex> lock(_fuzzyMutex);
+        _fuzzy = index;
+        return 0;
+    });
+}
+
+shared_ptr<const FuzzyIndex> BackendManager::getFuzzyIndex()
+{
+    lock_guard<mutex> lock(_fuzzyMutex);
+    return _fuzzy;
+}
+
+void BackendManager::addNearMatches(vector<PackageInfo>& results,
+                                    const SearchOptions& options,
+                                    const vector<BackendType>& types)
+{
+    shared_ptr<const FuzzyIndex> index = getFuzzyIndex();
+    if (!index || results.size() >= NEAR_MATCHES_BELOW || options.query.empty()) {
+        return;
+    }
+    vector<FuzzyIndex::Match> matches = index->search(options.query);
+    if (matches.empty()) {
+        return;
+    }
+
+    unordered_set<uint64_t> found;
+    for (const auto& pkg : results) {
+        found.insert(packageIdentity(pkg.backend, pkg.id));
+    }
+
+    // Looked up per backend, then put back in the index's order
+    map<BackendType, vector<string>> ids;
+    for (const auto& match : matches) {
+        if (find(types.begin(), types.end(), match.backend) != types.end() &&
+            found.insert(packageIdentity(match.backend, match.id)).second) {
+            ids[match.backend].push_back(match.id);
+        }
+    }
+    unordered_map<uint64_t, PackageInfo> looked;
+    for (const auto& entry : ids) {
+        for (auto& pkg : lookupPackages(entry.first, entry.second)) {
+            uint64_t identity = packageIdentity(pkg.backend, pkg.id);
+            looked.emplace(identity, std::move(pkg));
+        }
+    }
+
+    size_t limit = options.maxResults > 0 ? options.maxResults : matches.size() + results.size();
+    for (const auto& match : matches) {
+        if (results.size() >= limit) break;
+        auto it = looked.find(packageIdentity(match.backend, match.id));
+        if (it == looked.end()) continue;
+        PackageInfo& pkg = it->second;
+        if (options.installedOnly && !pkg.isInstalled()) continue;
+        if (options.availableOnly && pkg.isInstalled()) continue;
+        // Below every package the query itself found
+        pkg.relevance = -match.distance;
+        results.push_back(std::move(pkg));
+        looked.erase(it);
+    }
+}
+
+OperationResult BackendManager::refreshSharedStoreIndex(const string& path)
+{
+    // Only what every user sees goes into the shared file
+    StoreIndex index;
+    index.load(path);
+
+    int listed = 0;
+    int failures = 0;
+    for (auto* backend : getEnabledBackends()) {
+        BackendType type = backend->getType();
+        if (type == BackendType::APT) {
+            continue;
+        }
+
+        string generation = backend->getStoreCatalogGeneration();
+        if (generation.empty()) {
+            continue;
+        }
+        if (index.hasSection(type) && index.getGeneration(type) == generation) {
+            listed++;
+            continue;
+        }
+
+        vector<PackageInfo> packages;
+        if (!backend->getStoreCatalog(packages, nullptr)) {
+            failures++;
+            continue;
+        }
+        enrich(packages);
+        // Installed state differs per user; sessions fill it in
+        for (auto& pkg : packages) {
+            pkg.installStatus = InstallStatus::NOT_INSTALLED;
+            pkg.installedVersion.clear();
+        }
+        index.update(type, generation, packages);
+        listed++;
+    }
+
+    string dir = path.substr(0, path.rfind('/'));
+    if (!dir.empty()) {
+        mkdir(dir.c_str(), 0755);
+    }
+    if (listed > 0 && !index.save(path)) {
+        return OperationResult::Failure("Could not write " + path);
+    }
+    if (failures > 0) {
+        return OperationResult::Failure("Some store catalogs could not be listed");
+    }
+    return OperationResult::Success(to_string(listed) + " store catalogs shared");
+}
+
 // ============================================================================
 // Configuration
 // ============================================================================
@@ -722,6 +2553,26 @@ string BackendManager::getConfigDir()
     return RConfDir();
 }
 
+string BackendManager::getCatalogPath()
+{
+    return getConfigDir() + "/polysynaptic-catalog.bin";
+}
+
+string BackendManager::getStoreIndexPath()
+{
+    return getConfigDir() + "/polysynaptic-store.bin";
+}
+
+string BackendManager::getJournalPath()
+{
+    return getConfigDir() + "/polysynaptic-transaction.journal";
+}
+
+string BackendManager::getHistoryPath()
+{
+    return getConfigDir() + "/polysynaptic-operations.history";
+}
+
 void BackendManager::loadConfiguration(const string& path)
 {
     string configPath = path.empty() ? getConfigDir() + "/polysynaptic.conf" : path;
@@ -759,8 +2610,15 @@ void BackendManager::loadConfiguration(const string& path)
             _snapEnabled = (value == "true" || value == "1");
         } else if (key == "flatpak_enabled") {
             _flatpakEnabled = (value == "true" || value == "1");
+        } else if (key == "predownload_enabled") {
+            _predownloads.setEnabled(value == "true" || value == "1");
+        } else if (key == "predownload_rate_limit") {
+            _predownloads.setRateLimit(atoi(value.c_str()));
+        } else if (key == "low_memory") {
+            _lowMemory = (value == "true" || value == "1");
         }
     }
+    applyLowMemoryMode();
 }
 
 void BackendManager::saveConfiguration(const string& path)
@@ -778,6 +2636,9 @@ void BackendManager::saveConfiguration(const string& path)
     file << "apt_enabled=" << (_aptEnabled ? "true" : "false") << "\n";
     file << "snap_enabled=" << (_snapEnabled ? "true" : "false") << "\n";
     file << "flatpak_enabled=" << (_flatpakEnabled ? "true" : "false") << "\n";
+    file << "predownload_enabled=" << (_predownloads.isEnabled() ? "true" : "false") << "\n";
+    file << "predownload_rate_limit=" << _predownloads.getRateLimit() << "\n";
+    file << "low_memory=" << (_lowMemory ? "true" : "false") << "\n";
 }
 
 void BackendManager::notifyTransactionChanged()
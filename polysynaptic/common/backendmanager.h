@@ -22,9 +22,21 @@
 #define _BACKENDMANAGER_H_
 
 #include "ipackagebackend.h"
+#include "asyncbackend.h"
 #include "aptbackend.h"
+#include "categoryindex.h"
 #include "snapbackend.h"
+#include "snapchangewatcher.h"
 #include "flatpakbackend.h"
+#include "packagecatalog.h"
+#include "popularityindex.h"
+#include "probecache.h"
+#include "storeindex.h"
+#include "taskpool.h"
+#include "rsearchcache.h"
+#include "singleflight.h"
+#include "predownloadqueue.h"
+#include "updatechecker.h"
 
 #include <memory>
 #include <map>
@@ -33,12 +45,17 @@
 #include <thread>
 #include <future>
 #include <atomic>
+#include <condition_variable>
 
 // Forward declaration in global namespace (RPackageLister is a legacy Synaptic class)
 class RPackageLister;
 
 namespace PolySynaptic {
 
+class TransactionJournal;
+class OperationHistory;
+class FuzzyIndex;
+
 /**
  * Transaction - Represents a set of pending package operations
  *
@@ -52,8 +69,13 @@ struct Transaction {
         string packageName;
         enum class Type { INSTALL, REMOVE, UPDATE } type;
         bool purge;  // For removals
+        string target;  // Version, channel or branch to install; empty for the default
+        long downloadSize;  // Bytes to fetch, 0 if unknown (see fillDownloadSizes())
+        uint64_t identity;  // packageIdentity() of backend and packageId, set when queued
 
-        Operation() : backend(BackendType::UNKNOWN), type(Type::INSTALL), purge(false) {}
+        Operation()
+            : backend(BackendType::UNKNOWN), type(Type::INSTALL), purge(false)
+            , downloadSize(0), identity(0) {}
     };
 
     vector<Operation> operations;
@@ -66,6 +88,9 @@ struct Transaction {
     // Filter operations by backend
     vector<Operation> getOperationsForBackend(BackendType backend) const;
 
+    // Whether a package has an operation queued
+    bool contains(BackendType backend, const string& packageId) const;
+
     // Clear all operations
     void clear() { operations.clear(); }
 
@@ -128,6 +153,23 @@ struct BackendStatus {
     int packageCount;  // Number of packages known to this backend
 };
 
+/**
+ * SourceCounts - Package counts of one backend for the sources pane
+ *
+ * Each count is -1 until the event that sets it first happened.
+ */
+struct SourceCounts {
+    int installed = -1;
+    int upgradable = -1;
+    int available = -1;         // Everything the source offers
+
+    bool operator==(const SourceCounts& other) const {
+        return installed == other.installed && upgradable == other.upgradable &&
+               available == other.available;
+    }
+    bool operator!=(const SourceCounts& other) const { return !(*this == other); }
+};
+
 /**
  * BackendManager - Coordinates multiple package backends
  *
@@ -192,6 +234,24 @@ public:
      */
     vector<IPackageBackend*> getEnabledBackends();
 
+    /**
+     * Get the asynchronous view of a backend
+     *
+     * Its calls run on the manager's worker pool and complete through
+     * the dispatcher set with setDispatcher(), if any.
+     *
+     * @return Backend pointer or nullptr if not available/enabled
+     */
+    IAsyncPackageBackend* getAsyncBackend(BackendType type);
+
+    /**
+     * Set where completion callbacks of asynchronous calls run
+     *
+     * UI code passes one posting to its main loop. Applies to calls
+     * finishing from now on, including ones already started.
+     */
+    void setDispatcher(Dispatcher dispatcher);
+
     // ========================================================================
     // Backend Status & Configuration
     // ========================================================================
@@ -221,6 +281,12 @@ public:
      */
     void refreshBackendDetection();
 
+    /**
+     * Probe Snap and Flatpak on the pool, so startup does not wait for
+     * their tools; later availability checks find the cached result
+     */
+    void probeBackendsInBackground();
+
     // ========================================================================
     // Unified Package Operations
     // ========================================================================
@@ -228,6 +294,9 @@ public:
     /**
      * Search all enabled backends in parallel
      *
+     * Runs on the shared worker pool at interactive priority and
+     * supersedes any search still in flight.
+     *
      * @param options Search options
      * @param filter Backend filter
      * @param progress Progress callback
@@ -238,6 +307,84 @@ public:
         const BackendFilter& filter = BackendFilter::All(),
         ProgressCallback progress = nullptr);
 
+    /**
+     * Cancel the search currently in flight, if any
+     *
+     * Running snap/flatpak subprocesses are terminated and APT stops
+     * iterating. An interrupted searchPackages() call returns whatever
+     * the backends had found so far; an interrupted search session
+     * never delivers. Starting a new search does this implicitly.
+     */
+    void cancelSearch();
+
+    using SearchResultCallback =
+        function<void(uint64_t session, const vector<PackageInfo>& results)>;
+    using SearchPartialCallback =
+        function<void(uint64_t session, BackendType backend,
+                      const vector<PackageInfo>& results)>;
+
+    /**
+     * Start an asynchronous search session
+     *
+     * Returns immediately. Once every backend has answered, onResults
+     * is called exactly once with the merged results - on a worker
+     * thread, so UI callers must marshal to their main loop and check
+     * isCurrentSearch() there. A superseded or cancelled session does
+     * not call onResults at all.
+     *
+     * If onPartial is set, it is called on the same terms with each
+     * backend's own results as soon as that backend answers, so fast
+     * backends can be shown without waiting for slow ones. All partial
+     * calls happen before onResults.
+     *
+     * @return Session id, increasing with every call
+     */
+    uint64_t startSearch(const SearchOptions& options,
+                         const BackendFilter& filter,
+                         SearchResultCallback onResults,
+                         SearchPartialCallback onPartial = nullptr);
+
+    /**
+     * Check whether a session is the most recently started one
+     */
+    bool isCurrentSearch(uint64_t session) const {
+        return session == _searchSession.load();
+    }
+
+    /**
+     * Merge per-backend search results into the global top results
+     *
+     * Each backend's list is ordered by relevance (keeping the
+     * backend's own order among equals) and the lists are merged
+     * through a heap, so only options.maxResults entries are ever
+     * taken. Equal relevance across backends goes by name. The
+     * per-backend vectors are moved from.
+     */
+    static vector<PackageInfo> mergeSearchResults(
+        vector<vector<PackageInfo>>& perBackend,
+        const SearchOptions& options);
+
+    /**
+     * Score a search result for the merge: for every term of the
+     * query, more for matching the whole name than the start of it,
+     * more for that than anywhere in it, least for the summary
+     * or keywords. With a popularity index, up to POPULARITY_POINTS
+     * more by how popular the package is in its source's dataset,
+     * fewer than a better kind of match is worth.
+     */
+    static int searchRelevance(const PackageInfo& pkg, const string& query,
+                               const PopularityIndex* popularity = nullptr);
+
+    static const int POPULARITY_POINTS = 8;
+
+    /**
+     * Add popularity to the relevance of search results, from the
+     * shared PopularityIndex as it is loaded; off by default, the GUI
+     * follows Synaptic::Popularity::Enabled
+     */
+    void setPopularityRanking(bool enabled) { _popularityRanking = enabled; }
+    bool isPopularityRanking() const { return _popularityRanking; }
+
     /**
      * Get all installed packages from enabled backends
      */
@@ -245,6 +392,28 @@ public:
         const BackendFilter& filter = BackendFilter::All(),
         ProgressCallback progress = nullptr);
 
+    /**
+     * Get the last known installed packages from the on-disk catalog
+     *
+     * Never queries a backend, so it is cheap enough to paint the
+     * unified view at startup. Pair with revalidateInstalledPackages().
+     */
+    vector<PackageInfo> getCachedInstalledPackages(
+        const BackendFilter& filter = BackendFilter::All());
+
+    /**
+     * Bring the catalog up to date with the backends
+     *
+     * Backends whose generation stamp matches the catalog are skipped;
+     * the others are asked at the same time. The catalog is saved if
+     * anything changed.
+     *
+     * @return Differences from the previously cached package set
+     */
+    CatalogDelta revalidateInstalledPackages(
+        const BackendFilter& filter = BackendFilter::All(),
+        ProgressCallback progress = nullptr);
+
     /**
      * Get packages with available updates
      */
@@ -256,8 +425,229 @@ public:
      * Get details for a specific package
      *
      * Automatically routes to the correct backend based on package ID.
+     * The answers for recently viewed packages are kept until a cache
+     * refresh or a commit that touches the package; a version, if
+     * given, must also match the cached entry's installed or available
+     * version. Callers asking for the same package at the same time
+     * share one backend query.
+     */
+    PackageInfo getPackageDetails(const string& packageId, BackendType backend,
+                                  const string& version = "");
+
+    /**
+     * Fetch the details of packages the user is likely to select next
+     * (the rows around the selection) on the pool, so selecting them
+     * finds the details cached
+     */
+    void prefetchPackageDetails(const vector<PackageInfo>& packages);
+
+    /**
+     * Fetch on the pool the details of every Snap and Flatpak package
+     * the current transaction installs or updates, so that
+     * fillDownloadSizes() finds their sizes when the summary is shown
+     */
+    void prefetchTransactionDetails();
+
+    /**
+     * Set the download size of the Snap and Flatpak installs and
+     * updates of tx from the details cache
+     *
+     * Never asks a backend, so it does not hold up the summary.
+     *
+     * @return False if some size was not cached (left at 0)
+     */
+    bool fillDownloadSizes(Transaction& tx);
+
+    // ========================================================================
+    // Update Checks
+    // ========================================================================
+
+    /**
+     * Start the background update checks that are due
+     *
+     * Snap and Flatpak are asked for their upgradable packages on the
+     * pool at background priority, APT on the calling thread, which
+     * must be the one that owns the lister. One check per backend runs
+     * at a time. A backend whose answer did not change is asked half as
+     * often as before, down to once every few hours; see UpdateChecker.
+     * Callers poll from a timer (the GUI) or not at all (a one-shot tool).
+     */
+    void pollUpdateChecks();
+
+    /**
+     * Check a backend again at the next poll, at the base interval
+     *
+     * Done after commits and cache refreshes; call it after changing a
+     * backend's packages some other way (APT commits via the lister).
+     */
+    void invalidateUpdateCheck(BackendType backend);
+
+    /**
+     * The upgradable packages the last update checks found
+     *
+     * Never asks a backend. Empty for a backend not checked yet.
+     */
+    vector<PackageInfo> getCachedUpgradablePackages(
+        const BackendFilter& filter = BackendFilter::All());
+
+    /**
+     * Number of upgradable packages of a backend, -1 if not checked yet
+     */
+    int getCachedUpgradeCount(BackendType backend);
+
+    using UpdatesChangedCallback = function<void(BackendType)>;
+
+    /**
+     * Called through the dispatcher when a check found a different set
+     * of upgradable packages for a backend
      */
-    PackageInfo getPackageDetails(const string& packageId, BackendType backend);
+    void setUpdatesChangedCallback(UpdatesChangedCallback cb);
+
+    // ========================================================================
+    // Source Counts
+    // ========================================================================
+
+    /**
+     * Installed, upgradable and available packages of a backend
+     *
+     * Kept from the events that change them anyway: catalog loads and
+     * revalidations, update checks and store index refreshes. Reading
+     * them never asks a backend.
+     */
+    SourceCounts getSourceCounts(BackendType backend);
+
+    using SourceCountsCallback = function<void(BackendType, const SourceCounts&)>;
+
+    /**
+     * Called through the dispatcher whenever a backend's counts change
+     */
+    void setSourceCountsCallback(SourceCountsCallback cb);
+
+    // ========================================================================
+    // Pre-download
+    // ========================================================================
+
+    /**
+     * Fetch pending updates ahead of their commit
+     *
+     * When on, an update check that finds a new set of upgradable
+     * packages for a backend that supportsPredownload() queues their
+     * download on the pool at background priority, so committing them
+     * later is mostly install time. Nothing is fetched while the
+     * connection is metered. Off by default; saved with the
+     * configuration.
+     */
+    void setPredownloadEnabled(bool enabled);
+    bool isPredownloadEnabled() const { return _predownloads.isEnabled(); }
+
+    /**
+     * Download rate limit in KB/s where the backend's tool has one
+     * (APT), 0 for none
+     */
+    void setPredownloadRateLimit(int kbps);
+
+    /**
+     * What the GUI learns from the network monitor; becoming metered
+     * stops the downloads running
+     */
+    void setConnectionMetered(bool metered);
+
+    /**
+     * Stop the downloads running and wait until they have; commits do
+     * this first, since they lock the caches the downloads write to
+     */
+    void cancelPredownloads();
+
+    /**
+     * Backends whose download is queued or running
+     */
+    size_t getPredownloadCount() const;
+
+    // ========================================================================
+    // Low-Memory Mode
+    // ========================================================================
+
+    /**
+     * Keep only what the package lists show resident
+     *
+     * When on, trimForList() drops the long fields of the packages the
+     * lists hold, resolveDetails() brings them back through the details
+     * cache for the package being looked at, and that cache and the
+     * log buffer keep fewer entries. Off by default; saved with the
+     * configuration.
+     */
+    void setLowMemoryMode(bool enabled);
+    bool isLowMemoryMode() const { return _lowMemory; }
+
+    /**
+     * Drop the description, homepage and keywords of packages, marking
+     * them deferred; does nothing unless in low-memory mode
+     *
+     * Packages already trimmed are skipped, so it can be run again
+     * over a list after more was added to it.
+     */
+    void trimForList(vector<PackageInfo>& packages);
+
+    /**
+     * Fill in the fields trimForList() or the backend deferred
+     *
+     * APT reads them from the open cache. Snap and Flatpak fields come
+     * from the details cache only, never from a backend query on the
+     * caller's thread: on a miss the details are prefetched on the
+     * pool and false is returned, to be asked again once they are in.
+     */
+    bool resolveDetails(PackageInfo& pkg);
+
+    // ========================================================================
+    // Cache Cleanup
+    // ========================================================================
+
+    /**
+     * Remove what the backends keep unused (disabled snap revisions,
+     * runtimes no app needs) as far as the policy lets it go
+     *
+     * Runs on the pool at background priority. The tools ask for
+     * authentication to remove system-wide items, so this is for the
+     * user to start, not for after every commit; APT's archives are
+     * cleaned by the package lister.
+     *
+     * @param done Called through the dispatcher with the bytes freed
+     */
+    void cleanCaches(const RetentionPolicy& policy,
+                     function<void(uint64_t)> done = nullptr);
+
+    // ========================================================================
+    // External Changes
+    // ========================================================================
+
+    /**
+     * Find the backends whose packages changed on disk since last asked
+     *
+     * inotify watches the dpkg status, the APT lists, snapd's state and
+     * the system and user flatpak installations, so this is one
+     * non-blocking read and nothing is looked at again when nothing
+     * changed, whichever tool did it. For every backend that changed,
+     * its cached details are dropped and its update check invalidated;
+     * its installed catalog goes by generation stamps and notices by
+     * itself at the next revalidation.
+     *
+     * @return The backends that changed
+     */
+    vector<BackendType> checkExternalChanges();
+
+    using SnapChangeCallback = function<void(const SnapChangeEvent&)>;
+
+    /**
+     * Called through the dispatcher for every snapd change that moved,
+     * whichever tool started it, as snapd pushes it to the watcher
+     * started with the Snap backend
+     *
+     * Once a change is done or failed the cached details of the Snap
+     * backend are dropped, its update check is invalidated and the next
+     * checkExternalChanges() reports it, so the catalog is revalidated
+     * without a "snap list" being asked first.
+     */
+    void setSnapChangeCallback(SnapChangeCallback cb);
 
     // ========================================================================
     // Transaction Management
@@ -283,6 +673,11 @@ public:
      */
     void queueUpdate(const PackageInfo& package);
 
+    /**
+     * Add a planned operation (e.g. one pinned to a version) as it is
+     */
+    void queueOperation(const Transaction::Operation& op);
+
     /**
      * Remove a package from the queue
      */
@@ -296,14 +691,54 @@ public:
     /**
      * Commit all pending operations
      *
-     * Operations are executed backend by backend. APT operations
-     * are handled through the existing Synaptic transaction system.
+     * APT operations run on the calling thread, through the existing
+     * Synaptic transaction system; snap and flatpak operations run as
+     * batches on their own threads, concurrently with APT, and only
+     * wait for it when APT changes the snapd or flatpak deb. If APT's
+     * marks or its commit fail, a share that waits for it is not run
+     * and its operations fail. progress is called from all of these
+     * threads, one call at a time.
+     *
+     * progress is weighed by each operation's predicted time (see
+     * OperationHistory), and what each took is recorded for the next.
      *
      * @param progress Progress callback
      * @return Transaction result
      */
     TransactionResult commitTransaction(ProgressCallback progress = nullptr);
 
+    /**
+     * Predicted seconds for all of tx, and the ones left in the running
+     * commit (-1 when none runs), as polysynaptic_transaction_eta_seconds
+     * exports them
+     */
+    double estimateTransaction(const Transaction& tx) const;
+    double getCommitEta() const;
+
+    /**
+     * What operations took before; the Synaptic commit records APT's
+     */
+    OperationHistory& getOperationHistory() { return *_history; }
+
+    /**
+     * The operations an interrupted commit did not get done, from this
+     * run or an earlier one; empty once every commit finished
+     *
+     * Snap and Flatpak operations are journaled here as their batches
+     * complete; APT's through recordAptCommit() around the Synaptic
+     * commit. Queue them again to resume (APT ones as marks), or
+     * discardInterruptedTransaction().
+     */
+    Transaction getInterruptedTransaction() const;
+    void discardInterruptedTransaction();
+
+    /**
+     * Journal the changes the Synaptic commit is about to make, and
+     * drop them again once it went through
+     */
+    void recordAptCommit(const vector<Transaction::Operation>& ops);
+    void completeAptCommit();
+
     /**
      * Check if any operations are pending
      */
@@ -323,6 +758,85 @@ public:
      */
     OperationResult refreshAllCaches(ProgressCallback progress = nullptr);
 
+    /**
+     * Bring the local store search index up to date in the background
+     *
+     * Refetches the store catalog of every backend whose
+     * getStoreCatalogGeneration() changed (or all of them with force)
+     * and saves the index. Until a backend's section exists, searches
+     * keep asking that backend directly. The AppStream index the
+     * results are joined with is brought up to date as well.
+     */
+    void refreshStoreIndex(bool force = false);
+
+    /**
+     * System-wide store index, written by `polysynaptic
+     * --refresh-shared-cache` (the polysynaptic-cached unit) and read
+     * by every session
+     */
+    static constexpr const char* SHARED_STORE_INDEX =
+        "/var/cache/polysynaptic/store.bin";
+
+    /**
+     * Fetch every store catalog now and write them to path for all
+     * users; blocks until done
+     *
+     * refreshStoreIndex() takes a backend's section from this file
+     * instead of fetching it whenever the generation there is the one
+     * the session sees, so on a shared machine the stores are listed
+     * and parsed once rather than once per user.
+     */
+    OperationResult refreshSharedStoreIndex(const string& path = SHARED_STORE_INDEX);
+
+    // ========================================================================
+    // Categories
+    // ========================================================================
+
+    /**
+     * Rebuild the category index on the pool at background priority
+     *
+     * Built from the APT cache, debtags and the store index, so no
+     * backend is asked; refreshStoreIndex() calls it and again for
+     * every store section it brings up to date. A request while a
+     * rebuild is still queued is folded into that one.
+     */
+    void refreshCategoryIndex();
+
+    /**
+     * The category index last built; empty until the first build is done
+     */
+    shared_ptr<const CategoryIndex> getCategoryIndex();
+
+    /**
+     * Every package of the enabled, filtered backends in a category
+     *
+     * From the category index, the APT cache and the store index, with
+     * installed state as the store refresh last saw it; never asks a
+     * backend, so it is fast enough to run as a category is clicked.
+     */
+    vector<PackageInfo> getCategoryPackages(
+        Category category,
+        const BackendFilter& filter = BackendFilter::All());
+
+    // ========================================================================
+    // Near Matches
+    // ========================================================================
+
+    /**
+     * Rebuild the near match index on the pool at background priority
+     *
+     * Over the names in the APT cache and the store index, like the
+     * category index and alongside it. A search that finds only a few
+     * packages, or none, is given the packages whose names are a typo
+     * or two away after them, nearest first.
+     */
+    void refreshFuzzyIndex();
+
+    /**
+     * The near match index last built; empty until the first build is done
+     */
+    shared_ptr<const FuzzyIndex> getFuzzyIndex();
+
     // ========================================================================
     // Configuration
     // ========================================================================
@@ -342,6 +856,26 @@ public:
      */
     static string getConfigDir();
 
+    /**
+     * Get the package catalog path
+     */
+    static string getCatalogPath();
+
+    /**
+     * Get the store search index path
+     */
+    static string getStoreIndexPath();
+
+    /**
+     * Get the transaction journal path
+     */
+    static string getJournalPath();
+
+    /**
+     * Get the operation history path
+     */
+    static string getHistoryPath();
+
     // ========================================================================
     // Callbacks for UI integration
     // ========================================================================
@@ -355,8 +889,8 @@ public:
 private:
     // Backend instances
     unique_ptr<AptBackend> _aptBackend;
-    unique_ptr<SnapBackend> _snapBackend;
-    unique_ptr<FlatpakBackend> _flatpakBackend;
+    shared_ptr<SnapBackend> _snapBackend;        // Shared with SnapProvider
+    shared_ptr<FlatpakBackend> _flatpakBackend;  // Shared with FlatpakProvider
 
     // Enable flags (user can disable even if available)
     bool _aptEnabled;
@@ -366,10 +900,115 @@ private:
     // Current transaction
     Transaction _currentTransaction;
 
+    // What commits have left to do, on disk
+    unique_ptr<TransactionJournal> _journal;
+
+    // How long operations took, and the predicted time the running
+    // commit has left in milliseconds (-1 when none runs)
+    unique_ptr<OperationHistory> _history;
+    atomic<int64_t> _commitEtaMs;
+
     // Thread safety
     mutable mutex _mutex;
     mutable mutex _txMutex;
 
+    // Local index of the snap and flatpak stores; declared before the
+    // pool so its refresh tasks never outlive it
+    StoreIndex _storeIndex;
+    bool _storeIndexLoaded;
+    map<BackendType, map<string, string>> _storeInstalled;   // id -> version
+    mutex _storeMutex;
+    mutex _storeSaveMutex;          // Refresh tasks share one temp file
+    CancellationToken _storeRefresh;
+
+    // Package IDs per category, swapped in whole once a rebuild is done;
+    // the rebuild runs on the pool under _storeRefresh
+    shared_ptr<const CategoryIndex> _categories;
+    mutex _categoryMutex;
+    atomic<bool> _categoryQueued;
+    MemoryAccount _categoryAccount;
+
+    // Names a typo or two from a query, rebuilt like the categories
+    shared_ptr<const FuzzyIndex> _fuzzy;
+    mutex _fuzzyMutex;
+    atomic<bool> _fuzzyQueued;
+    MemoryAccount _fuzzyAccount;
+
+    // Details of recently viewed packages by backend and id; declared
+    // before the pool so prefetch tasks never outlive it
+    RSearchCache<PackageInfo> _details;
+    mutex _detailsMutex;
+    static string detailsKey(BackendType backend, const string& packageId);
+    bool findDetails(const string& key, const string& version, PackageInfo* info);
+    void forgetDetails(BackendType backend);
+    MemoryAccount _detailsAccount;
+
+    // Identical backend queries asked at the same time, by the update
+    // checks, the prefetches and the UI, share one run of the backend
+    SingleFlight<vector<PackageInfo>> _listFlights;
+    SingleFlight<PackageInfo> _detailFlights;
+    vector<PackageInfo> sharedInstalled(IPackageBackend* backend, ProgressCallback progress);
+    vector<PackageInfo> sharedUpgradable(IPackageBackend* backend, ProgressCallback progress);
+    // Queries started from now on do not join the ones running, which
+    // may answer from before a change
+    void forgetFlights();
+
+    // Where asynchronous calls complete; declared before the pool so
+    // completing tasks never outlive it
+    Dispatcher _dispatcher;
+    mutex _asyncMutex;
+    void dispatch(function<void()> task);
+
+    // Background update checks; they run on the pool, which is only
+    // bound here and joined before the checker goes away
+    UpdateChecker _updates;
+    UpdatesChangedCallback _updatesCallback;
+    void addUpdateSources();
+
+    // Package counts per backend for the sources pane
+    mutex _countsMutex;
+    map<BackendType, SourceCounts> _counts;
+    SourceCountsCallback _countsCallback;
+    void noteCounts(BackendType type, const function<void(SourceCounts&)>& change);
+    void noteCatalogCounts();       // With _catalogMutex held
+    void noteStoreCounts(BackendType type);
+
+    // Downloads ahead of commits, on the pool like the checks
+    PredownloadQueue _predownloads;
+
+    // Low-memory mode, see setLowMemoryMode()
+    atomic<bool> _lowMemory;
+
+    // See setPopularityRanking()
+    atomic<bool> _popularityRanking;
+    void applyLowMemoryMode();
+
+    // Shared workers for per-backend fan-out
+    TaskPool _pool;
+    CancellationToken _activeSearch;
+    atomic<uint64_t> _searchSession;
+    mutex _searchMutex;
+
+    // Asynchronous views of the backends, made on first use
+    class AsyncView;
+    map<BackendType, unique_ptr<AsyncView>> _asyncBackends;
+
+    // What each backend's packages are kept in, for checkExternalChanges()
+    map<BackendType, unique_ptr<PathWatch>> _changeWatches;
+    void addChangeWatches();
+
+    // snapd's changes as they move; stopped first on destruction
+    unique_ptr<SnapChangeWatcher> _snapWatcher;
+    mutex _snapChangeMutex;
+    SnapChangeCallback _snapChangeCallback;
+    atomic<bool> _snapChanged;      // A change finished since last checked
+    void onSnapChange(const SnapChangeEvent& event);
+
+    // Persistent installed package catalog
+    PackageCatalog _catalog;
+    bool _catalogLoaded;
+    mutable mutex _catalogMutex;
+
     // Callbacks
     BackendStatusCallback _statusCallback;
     TransactionChangedCallback _txCallback;
@@ -378,6 +1017,53 @@ private:
     void initializeBackends(RPackageLister* lister);
     void detectBackendAvailability();
 
+    // Run call on every filtered backend through the pool, in order
+    template <typename R>
+    vector<R> fanOut(const BackendFilter& filter,
+                     TaskPriority priority,
+                     CancellationToken token,
+                     ProgressCallback progress,
+                     const string& verb,
+                     function<R(IPackageBackend*, ProgressCallback)> call);
+
+    // Supersede the active search; returns the new session's token
+    CancellationToken beginSearch(uint64_t* session);
+
+    // The shared popularity index if ranking by it is on and one is loaded
+    shared_ptr<const PopularityIndex> popularityRanking() const;
+
+    // One backend's share of a search, from the store index if possible
+    vector<PackageInfo> searchBackend(IPackageBackend* backend,
+                                      const SearchOptions& options,
+                                      ProgressCallback progress);
+
+    // Packages by id from the APT cache or the store index, with the
+    // installed state the store refresh last saw
+    vector<PackageInfo> lookupPackages(BackendType type, const vector<string>& ids);
+
+    // Append the near matches of a search that found little, from the
+    // backends in types
+    void addNearMatches(vector<PackageInfo>& results, const SearchOptions& options,
+                        const vector<BackendType>& types);
+
+    // Remember which packages are installed for store index results
+    void noteInstalled(BackendType type, const vector<PackageInfo>& pkgs);
+
+    // Join a store listing with the AppStream catalogs (rebuilt first
+    // if they changed) before it is indexed
+    static void enrich(vector<PackageInfo>& pkgs);
+
+    // Each operation's predicted share of a commit, and what is done
+    struct CommitPlan;
+
+    // Commit one backend's share of the transaction as batches; returns
+    // false if the user cancelled. Runs concurrently for each backend.
+    bool commitBackendOperations(IPackageBackend* backend,
+                                 const vector<Transaction::Operation>& ops,
+                                 CommitPlan& plan,
+                                 ProgressCallback progress,
+                                 TransactionResult& result);
+
     // Helper to notify transaction changes
     void notifyTransactionChanged();
 };
@@ -420,6 +1106,16 @@ inline vector<Transaction::Operation> Transaction::getOperationsForBackend(Backe
     return result;
 }
 
+inline bool Transaction::contains(BackendType backend, const string& packageId) const {
+    uint64_t identity = packageIdentity(backend, packageId);
+    for (const auto& op : operations) {
+        if (op.identity == identity) {
+            return true;
+        }
+    }
+    return false;
+}
+
 inline string TransactionResult::getSummary() const {
     ostringstream ss;
     if (success) {
@@ -0,0 +1,247 @@
+/* backendprovider.cc - PackageSourceProvider over a package backend
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "backendprovider.h"
+#include "latency.h"
+#include "metrics.h"
+
+#include <chrono>
+
+namespace PolySynaptic {
+
+BackendProvider::BackendProvider(shared_ptr<IPackageBackend> engine, SourceType type)
+    : _engine(std::move(engine))
+    , _type(type)
+{
+}
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+PackageStatus BackendProvider::toStatus(InstallStatus status)
+{
+    switch (status) {
+        case InstallStatus::NOT_INSTALLED:    return PackageStatus::AVAILABLE;
+        case InstallStatus::INSTALLED:        return PackageStatus::INSTALLED;
+        case InstallStatus::UPDATE_AVAILABLE: return PackageStatus::UPGRADABLE;
+        case InstallStatus::INSTALLING:       return PackageStatus::INSTALLING;
+        case InstallStatus::REMOVING:         return PackageStatus::REMOVING;
+        case InstallStatus::BROKEN:           return PackageStatus::BROKEN;
+        case InstallStatus::UNKNOWN:          return PackageStatus::UNKNOWN;
+    }
+    return PackageStatus::UNKNOWN;
+}
+
+ProviderResult BackendProvider::toResult(const OperationResult& result)
+{
+    if (result.success) {
+        return ProviderResult::Success(result.message);
+    }
+    return ProviderResult::Failure(result.message, "", result.errorDetails,
+                                   result.exitCode);
+}
+
+UnifiedPackage BackendProvider::convert(const PackageInfo& info) const
+{
+    return convert(info, *AppstreamIndex::shared());
+}
+
+UnifiedPackage BackendProvider::convert(const PackageInfo& info,
+                                        const AppstreamIndex& appstream) const
+{
+    UnifiedPackage pkg(info.id, info.name, _type);
+    pkg.summary = info.summary;
+    pkg.description = info.description;
+    pkg.availableVersion = info.version;
+    pkg.installedVersion = info.installedVersion;
+    pkg.status = toStatus(info.installStatus);
+    pkg.downloadSize = info.downloadSize;
+    pkg.installedSize = info.installedSize;
+    pkg.homepage = info.homepage;
+    pkg.maintainer = info.maintainer;
+    pkg.publisher = info.publisher;
+    pkg.license = info.license;
+    pkg.section = info.section;
+    pkg.architecture = info.architecture;
+
+    if (!info.keywords.empty()) {
+        CompactStringList& keywords = pkg.metadata.editList(MetadataList::KEYWORDS);
+        size_t start = 0;
+        while (start < info.keywords.size()) {
+            size_t end = info.keywords.find(' ', start);
+            if (end == string::npos) end = info.keywords.size();
+            if (end > start) {
+                keywords.push_back(string_view(info.keywords).substr(start, end - start));
+            }
+            start = end + 1;
+        }
+    }
+
+    // What the backend does not report, from the catalogs on disk
+    if (AppstreamIndex::Component component = appstream.lookup(info)) {
+        static const pair<MetadataList, AppstreamIndex::List> lists[] = {
+            {MetadataList::CATEGORIES, AppstreamIndex::CATEGORIES},
+            {MetadataList::KEYWORDS, AppstreamIndex::KEYWORDS},
+            {MetadataList::SCREENSHOTS, AppstreamIndex::SCREENSHOTS}
+        };
+        for (const auto& list : lists) {
+            size_t count = component.count(list.second);
+            if (count == 0 || !pkg.metadata.list(list.first).empty()) {
+                continue;
+            }
+            CompactStringList& items = pkg.metadata.editList(list.first);
+            for (size_t i = 0; i < count; i++) {
+                items.push_back(component.item(list.second, i));
+            }
+        }
+    }
+
+    fill(pkg, info);
+    return pkg;
+}
+
+vector<UnifiedPackage> BackendProvider::convertAll(const vector<PackageInfo>& infos) const
+{
+    shared_ptr<const AppstreamIndex> appstream = AppstreamIndex::shared();
+    vector<UnifiedPackage> packages;
+    packages.reserve(infos.size());
+    for (const auto& info : infos) {
+        packages.push_back(convert(info, *appstream));
+    }
+    return packages;
+}
+
+// ============================================================================
+// Package Discovery
+// ============================================================================
+
+vector<UnifiedPackage> BackendProvider::search(const SearchQuery& query,
+                                               ProgressCallback progress)
+{
+    vector<PackageInfo> found;
+    if (query.upgradableOnly) {
+        // The engine has no upgradable filter; there are only a few
+        found = _engine->getUpgradablePackages(progress);
+        vector<PackageInfo> matching;
+        for (auto& info : found) {
+            if (query.text.empty() || info.name.find(query.text) != string::npos ||
+                (query.searchDescriptions && info.summary.find(query.text) != string::npos)) {
+                matching.push_back(std::move(info));
+            }
+        }
+        found.swap(matching);
+    } else {
+        SearchOptions options;
+        options.query = query.text;
+        options.searchNames = query.searchNames;
+        options.searchDescriptions = query.searchDescriptions;
+        options.installedOnly = query.installedOnly;
+        options.maxResults = query.limit > 0 ? query.offset + query.limit : 0;
+        found = _engine->searchPackages(options, progress);
+    }
+
+    size_t offset = query.offset > 0 ? query.offset : 0;
+    if (offset >= found.size()) {
+        return {};
+    }
+    found.erase(found.begin(), found.begin() + offset);
+    if (query.limit > 0 && found.size() > static_cast<size_t>(query.limit)) {
+        found.resize(query.limit);
+    }
+    return convertAll(found);
+}
+
+vector<UnifiedPackage> BackendProvider::getInstalled(ProgressCallback progress)
+{
+    return convertAll(_engine->getInstalledPackages(progress));
+}
+
+vector<UnifiedPackage> BackendProvider::getUpgradable(ProgressCallback progress)
+{
+    return convertAll(_engine->getUpgradablePackages(progress));
+}
+
+UnifiedPackage BackendProvider::getPackageDetails(const string& id)
+{
+    PackageInfo info = _engine->getPackageDetails(id);
+    if (info.id.empty()) {
+        return UnifiedPackage();
+    }
+    return convert(info);
+}
+
+// ============================================================================
+// Package Operations
+// ============================================================================
+
+// The engine's result, with how long the operation took; the time
+// and the outcome go to the latency histograms and the metrics too
+static ProviderResult timed(const string& provider, const char *operation,
+                            std::chrono::steady_clock::time_point start,
+                            const OperationResult& outcome)
+{
+    ProviderResult result = BackendProvider::toResult(outcome);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+
+    LatencyRegistry::instance().histogram(provider, operation).record(elapsed);
+    MetricsRegistry::instance()
+        .counter("polysynaptic_provider_operations",
+                 "Provider operations, by outcome",
+                 {{"provider", provider}, {"operation", operation},
+                  {"result", outcome.success ? "success" : "failure"}})
+        .inc();
+    return result;
+}
+
+ProviderResult BackendProvider::install(const string& id,
+                                        const map<string, string>& options,
+                                        ProgressCallback progress)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    string target;
+    for (const char* key : {"version", "channel", "branch"}) {
+        auto it = options.find(key);
+        if (it != options.end() && !it->second.empty()) {
+            target = it->second;
+            break;
+        }
+    }
+
+    return timed(getName(), "install", start, target.empty()
+        ? _engine->installPackage(id, progress)
+        : _engine->installPackageVersion(id, target, progress));
+}
+
+ProviderResult BackendProvider::remove(const string& id, bool purge,
+                                       ProgressCallback progress)
+{
+    auto start = std::chrono::steady_clock::now();
+    return timed(getName(), "remove", start,
+                 _engine->removePackage(id, purge, progress));
+}
+
+ProviderResult BackendProvider::update(const string& id, ProgressCallback progress)
+{
+    auto start = std::chrono::steady_clock::now();
+    return timed(getName(), "update", start, _engine->updatePackage(id, progress));
+}
+
+ProviderResult BackendProvider::refreshCache(ProgressCallback progress)
+{
+    auto start = std::chrono::steady_clock::now();
+    return timed(getName(), "refresh", start, _engine->refreshCache(progress));
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
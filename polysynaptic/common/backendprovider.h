@@ -0,0 +1,95 @@
+/* backendprovider.h - PackageSourceProvider over a package backend
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the provider interface on top of an
+ * IPackageBackend, so each ecosystem has one engine - the backend,
+ * which runs the tools, parses their output and caches availability -
+ * and the provider stack is a thin view of it. A fix or speed-up in
+ * SnapBackend or FlatpakBackend reaches both interfaces.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _BACKENDPROVIDER_H_
+#define _BACKENDPROVIDER_H_
+
+#include "appstreamindex.h"
+#include "ipackagebackend.h"
+#include "packagesourceprovider.h"
+
+#include <memory>
+
+namespace PolySynaptic {
+
+/**
+ * BackendProvider - Provider answering from a backend engine
+ *
+ * Queries and operations go to the engine and their answers are
+ * converted; subclasses add the capabilities, trust and extra methods
+ * of their ecosystem. Install options understood here are "version",
+ * "channel" and "branch", all passed on as the engine's version target.
+ * Categories, keywords and screenshots the engine leaves out are taken
+ * from AppstreamIndex.
+ *
+ * Thread Safety:
+ *   As thread safe as the engine; the provider keeps no state of its own.
+ */
+class BackendProvider : public PackageSourceProvider {
+public:
+    BackendProvider(shared_ptr<IPackageBackend> engine, SourceType type);
+
+    SourceType getSourceType() const override { return _type; }
+    string getName() const override { return _engine->getName(); }
+    string getVersion() const override { return _engine->getVersion(); }
+
+    bool isAvailable() const override { return _engine->isAvailable(); }
+    string getUnavailableReason() const override { return _engine->getUnavailableReason(); }
+
+    vector<UnifiedPackage> search(const SearchQuery& query,
+                                  ProgressCallback progress = nullptr) override;
+    vector<UnifiedPackage> getInstalled(ProgressCallback progress = nullptr) override;
+    vector<UnifiedPackage> getUpgradable(ProgressCallback progress = nullptr) override;
+    UnifiedPackage getPackageDetails(const string& id) override;
+
+    ProviderResult install(const string& id,
+                           const map<string, string>& options = {},
+                           ProgressCallback progress = nullptr) override;
+    ProviderResult remove(const string& id, bool purge = false,
+                          ProgressCallback progress = nullptr) override;
+    ProviderResult update(const string& id,
+                          ProgressCallback progress = nullptr) override;
+    ProviderResult refreshCache(ProgressCallback progress = nullptr) override;
+
+    /**
+     * The backend this provider is a view of
+     */
+    IPackageBackend* getEngine() const { return _engine.get(); }
+
+    static PackageStatus toStatus(InstallStatus status);
+    static ProviderResult toResult(const OperationResult& result);
+
+protected:
+    /**
+     * Convert a backend record, joined with its AppStream entry; fill()
+     * adds the ecosystem's fields
+     */
+    UnifiedPackage convert(const PackageInfo& info) const;
+    UnifiedPackage convert(const PackageInfo& info, const AppstreamIndex& appstream) const;
+    virtual void fill(UnifiedPackage& pkg, const PackageInfo& info) const {}
+
+    shared_ptr<IPackageBackend> _engine;
+    SourceType _type;
+
+private:
+    vector<UnifiedPackage> convertAll(const vector<PackageInfo>& infos) const;
+};
+
+} // namespace PolySynaptic
+
+#endif // _BACKENDPROVIDER_H_
+
+// vim:ts=4:sw=4:et
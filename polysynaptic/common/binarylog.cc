@@ -0,0 +1,397 @@
+/* binarylog.cc - Compact binary log sink and its reader
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "binarylog.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+const char MAGIC[] = "PSLOG";
+const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+const unsigned char FORMAT_VERSION = 1;
+
+enum RecordKind : unsigned char {
+    RECORD_SEGMENT = 1,
+    RECORD_STRING = 2,
+    RECORD_ENTRY = 3
+};
+
+// String references: empty, spelled out in place, or table id + 2
+const uint64_t REF_EMPTY = 0;
+const uint64_t REF_INLINE = 1;
+const uint64_t REF_TABLE = 2;
+
+// Messages and values rarely repeat; past this many distinct interned
+// strings the rest are written in place
+const size_t MAX_STRINGS = 4096;
+
+void putVarint(string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+void putSigned(string& out, int64_t v)
+{
+    putVarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+}
+
+bool getVarint(const char *&p, const char *end, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getSigned(const char *&p, const char *end, int64_t& v)
+{
+    uint64_t u;
+    if (!getVarint(p, end, u)) {
+        return false;
+    }
+    v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+    return true;
+}
+
+bool getString(const char *&p, const char *end, string& s)
+{
+    uint64_t size;
+    if (!getVarint(p, end, size) || size > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    s.assign(p, size);
+    p += size;
+    return true;
+}
+
+int64_t toMicros(std::chrono::system_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        t.time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+BinaryLogSink::BinaryLogSink(const string& path, size_t bufferSize)
+    : _file(fopen(path.c_str(), "ab")), _bufferSize(bufferSize), _lastMicros(0)
+{
+    if (_file != NULL) {
+        _buffer.reserve(_bufferSize + 4096);
+        beginSegment();
+    }
+}
+
+BinaryLogSink::~BinaryLogSink()
+{
+    if (_file != NULL) {
+        flush();
+        fclose(_file);
+    }
+}
+
+void BinaryLogSink::beginSegment()
+{
+    // The string table and timestamp base of an earlier run in the
+    // same file do not carry over
+    _strings.clear();
+    _lastMicros = 0;
+
+    _record.clear();
+    _record += static_cast<char>(RECORD_SEGMENT);
+    _record.append(MAGIC, MAGIC_SIZE);
+    _record += static_cast<char>(FORMAT_VERSION);
+    appendRecord();
+}
+
+void BinaryLogSink::appendRecord()
+{
+    putVarint(_buffer, _record.size());
+    _buffer += _record;
+}
+
+void BinaryLogSink::putString(const string& s)
+{
+    putVarint(_record, s.size());
+    _record += s;
+}
+
+void BinaryLogSink::putInterned(const string& s)
+{
+    if (s.empty()) {
+        putVarint(_record, REF_EMPTY);
+        return;
+    }
+
+    auto it = _strings.find(s);
+    if (it != _strings.end()) {
+        putVarint(_record, REF_TABLE + it->second);
+        return;
+    }
+    if (_strings.size() >= MAX_STRINGS) {
+        putVarint(_record, REF_INLINE);
+        putString(s);
+        return;
+    }
+
+    // The definition goes out ahead of the entry being encoded
+    uint32_t id = _strings.size();
+    _strings.emplace(s, id);
+    string define;
+    define += static_cast<char>(RECORD_STRING);
+    define += s;
+    putVarint(_buffer, define.size());
+    _buffer += define;
+
+    putVarint(_record, REF_TABLE + id);
+}
+
+void BinaryLogSink::write(const LogEntry& entry)
+{
+    if (_file == NULL) {
+        return;
+    }
+
+    int64_t micros = toMicros(entry.timestamp);
+
+    _record.clear();
+    _record += static_cast<char>(RECORD_ENTRY);
+    // The wall clock may step back, hence signed
+    putSigned(_record, micros - _lastMicros);
+    _lastMicros = micros;
+    _record += static_cast<char>(entry.level);
+
+    putInterned(entry.provider);
+    putInterned(entry.operation);
+    putInterned(entry.component);
+    putString(entry.message);
+    putString(entry.packageId);
+    putString(entry.errorCode);
+    putString(entry.rawStderr);
+    putSigned(_record, entry.exitCode);
+    putVarint(_record, entry.duration.count() > 0 ? entry.duration.count() : 0);
+
+    putVarint(_record, entry.fields.size());
+    for (const auto& [key, value] : entry.fields) {
+        putInterned(key);
+        putString(value);
+    }
+    appendRecord();
+
+    if (_buffer.size() >= _bufferSize) {
+        fwrite(_buffer.data(), 1, _buffer.size(), _file);
+        _buffer.clear();
+    }
+}
+
+void BinaryLogSink::flush()
+{
+    if (_file == NULL) {
+        return;
+    }
+    if (!_buffer.empty()) {
+        fwrite(_buffer.data(), 1, _buffer.size(), _file);
+        _buffer.clear();
+    }
+    fflush(_file);
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+BinaryLogReader::BinaryLogReader(const string& path)
+    : _pos(0), _valid(false), _lastMicros(0)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    _data = contents.str();
+
+    // Anything else than a segment up front means this is no binary log
+    const char *payload;
+    size_t size;
+    _valid = readRecord(payload, size) && readSegment(payload, payload + size);
+}
+
+bool BinaryLogReader::readRecord(const char *&payload, size_t &size)
+{
+    const char *p = _data.data() + _pos;
+    const char *end = _data.data() + _data.size();
+    uint64_t length;
+    if (!getVarint(p, end, length) || length == 0 ||
+        length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    payload = p;
+    size = length;
+    _pos = (p - _data.data()) + length;
+    return true;
+}
+
+bool BinaryLogReader::readSegment(const char *p, const char *end)
+{
+    if (end - p != static_cast<ptrdiff_t>(1 + MAGIC_SIZE + 1) ||
+        *p != RECORD_SEGMENT || memcmp(p + 1, MAGIC, MAGIC_SIZE) != 0 ||
+        static_cast<unsigned char>(p[1 + MAGIC_SIZE]) != FORMAT_VERSION) {
+        return false;
+    }
+    _strings.clear();
+    _lastMicros = 0;
+    return true;
+}
+
+bool BinaryLogReader::next(LogEntry& entry)
+{
+    if (!_valid) {
+        return false;
+    }
+
+    const char *payload;
+    size_t size;
+    while (readRecord(payload, size)) {
+        const char *end = payload + size;
+        switch (static_cast<unsigned char>(*payload)) {
+        case RECORD_SEGMENT:
+            if (!readSegment(payload, end)) {
+                return false;
+            }
+            break;
+        case RECORD_STRING:
+            _strings.emplace_back(payload + 1, end);
+            break;
+        case RECORD_ENTRY:
+            return readEntry(payload + 1, end, entry);
+        default:
+            // From a newer writer; the length lets us step over it
+            break;
+        }
+    }
+    return false;
+}
+
+bool BinaryLogReader::readEntry(const char *p, const char *end, LogEntry& entry)
+{
+    auto interned = [this, &p, end](string& s) {
+        uint64_t ref;
+        if (!getVarint(p, end, ref)) {
+            return false;
+        }
+        if (ref == REF_EMPTY) {
+            s.clear();
+            return true;
+        }
+        if (ref == REF_INLINE) {
+            return getString(p, end, s);
+        }
+        if (ref - REF_TABLE >= _strings.size()) {
+            return false;
+        }
+        s = _strings[ref - REF_TABLE];
+        return true;
+    };
+
+    entry = LogEntry();
+
+    int64_t delta;
+    if (!getSigned(p, end, delta) || p >= end) {
+        return false;
+    }
+    _lastMicros += delta;
+    entry.timestamp = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::microseconds(_lastMicros)));
+
+    unsigned char level = static_cast<unsigned char>(*p++);
+    if (level > static_cast<unsigned char>(LogLevel::FATAL)) {
+        return false;
+    }
+    entry.level = static_cast<LogLevel>(level);
+
+    int64_t exitCode;
+    uint64_t duration, fields;
+    if (!interned(entry.provider) || !interned(entry.operation) ||
+        !interned(entry.component) ||
+        !getString(p, end, entry.message) || !getString(p, end, entry.packageId) ||
+        !getString(p, end, entry.errorCode) || !getString(p, end, entry.rawStderr) ||
+        !getSigned(p, end, exitCode) || !getVarint(p, end, duration) ||
+        !getVarint(p, end, fields)) {
+        return false;
+    }
+    entry.exitCode = static_cast<int>(exitCode);
+    entry.duration = std::chrono::milliseconds(duration);
+
+    string key;
+    for (uint64_t i = 0; i < fields; i++) {
+        if (!interned(key) || !getString(p, end, entry.fields[key])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Conversion
+// ============================================================================
+
+long convertBinaryLog(const string& binaryPath, const string& jsonPath)
+{
+    BinaryLogReader reader(binaryPath);
+    if (!reader.isValid()) {
+        return -1;
+    }
+
+    FILE *out = fopen(jsonPath.c_str(), "w");
+    if (out == NULL) {
+        return -1;
+    }
+
+    long count = 0;
+    string buffer;
+    LogEntry entry;
+    while (reader.next(entry)) {
+        entry.appendJson(buffer);
+        buffer += '\n';
+        count++;
+        if (buffer.size() >= 64 * 1024) {
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+    fwrite(buffer.data(), 1, buffer.size(), out);
+
+    bool ok = ferror(out) == 0;
+    ok = fclose(out) == 0 && ok;
+    return ok ? count : -1;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,129 @@
+/* binarylog.h - Compact binary log sink and its reader
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements a LogSink for high-volume traces (every parsed
+ * row of a provider listing, say) where JSON lines are too big and too
+ * slow to write. Records are length-prefixed, repeated strings are
+ * written once and referred to by number, and integers are varints.
+ * BinaryLogReader turns a file back into LogEntry values, and
+ * convertBinaryLog() writes it out as the JSON lines FileSink would
+ * have produced.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _BINARYLOG_H_
+#define _BINARYLOG_H_
+
+#include "structuredlog.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * BinaryLogSink - Append log entries to a file in the binary format
+ *
+ * File layout: a sequence of records, each a varint payload length
+ * followed by the payload, whose first byte is the record kind:
+ *
+ *   SEGMENT  "PSLOG" and a format version; starts a new string table
+ *            and timestamp base, written whenever a sink opens the file
+ *   STRING   defines the next string table id
+ *   ENTRY    one LogEntry: timestamp delta in microseconds (zigzag),
+ *            level, interned provider/operation/component, the other
+ *            strings, exit code, duration, and key/value fields with
+ *            interned keys
+ *
+ * A crash can only lose the tail of the last buffered write; readers
+ * stop at the first incomplete record.
+ *
+ * Thread Safety:
+ *   Like every sink, only called by one thread at a time.
+ */
+class BinaryLogSink : public LogSink {
+public:
+    /**
+     * @param path       File to append to (created if missing)
+     * @param bufferSize Bytes collected before each write to the file
+     */
+    explicit BinaryLogSink(const string& path, size_t bufferSize = 64 * 1024);
+    ~BinaryLogSink() override;
+
+    BinaryLogSink(const BinaryLogSink&) = delete;
+    BinaryLogSink& operator=(const BinaryLogSink&) = delete;
+
+    bool isOpen() const { return _file != NULL; }
+
+    void write(const LogEntry& entry) override;
+    void flush() override;
+
+private:
+    FILE *_file;
+    size_t _bufferSize;
+    string _buffer;         // Records not written yet
+    string _record;         // Payload being encoded
+
+    std::unordered_map<string, uint32_t> _strings;
+    int64_t _lastMicros;
+
+    void beginSegment();
+    void appendRecord();
+    void putString(const string& s);
+    void putInterned(const string& s);
+};
+
+/**
+ * BinaryLogReader - Read back what a BinaryLogSink wrote
+ */
+class BinaryLogReader {
+public:
+    explicit BinaryLogReader(const string& path);
+
+    /**
+     * False if the file is missing or not a binary log
+     */
+    bool isValid() const { return _valid; }
+
+    /**
+     * Decode the next entry; false at the end of the file or at a
+     * damaged record
+     */
+    bool next(LogEntry& entry);
+
+private:
+    string _data;
+    size_t _pos;
+    bool _valid;
+
+    vector<string> _strings;
+    int64_t _lastMicros;
+
+    bool readRecord(const char *&payload, size_t &size);
+    bool readSegment(const char *p, const char *end);
+    bool readEntry(const char *p, const char *end, LogEntry& entry);
+};
+
+/**
+ * Convert a binary log to JSON lines, in the FileSink format
+ *
+ * @return Number of entries written, or -1 if binaryPath is not a
+ *         binary log or jsonPath cannot be written
+ */
+long convertBinaryLog(const string& binaryPath, const string& jsonPath);
+
+} // namespace PolySynaptic
+
+#endif // _BINARYLOG_H_
+
+// vim:ts=4:sw=4:et
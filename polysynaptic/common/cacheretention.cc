@@ -0,0 +1,184 @@
+/* cacheretention.cc - What to keep of the packages kept around
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "cacheretention.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Policy
+// ============================================================================
+
+vector<const CachedItem*> CacheRetention::select(const vector<CachedItem>& items,
+                                                 const RetentionPolicy& policy,
+                                                 const VersionCompare& compare)
+{
+    vector<bool> removed(items.size(), false);
+    auto pinned = [&](size_t i) { return policy.keepHeld && items[i].held; };
+
+    map<string, vector<size_t>> byName;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (policy.dropObsolete && items[i].obsolete && !pinned(i)) {
+            removed[i] = true;
+            continue;
+        }
+        byName[items[i].name].push_back(i);
+    }
+
+    // Held versions count towards the newest ones, they are just never
+    // the ones to go
+    if (policy.keepVersions >= 0) {
+        for (auto& name : byName) {
+            vector<size_t>& versions = name.second;
+            stable_sort(versions.begin(), versions.end(), [&](size_t a, size_t b) {
+                if (compare) {
+                    return compare(items[a].version, items[b].version) > 0;
+                }
+                return items[a].mtime > items[b].mtime;
+            });
+            for (size_t v = policy.keepVersions; v < versions.size(); v++) {
+                if (!pinned(versions[v])) {
+                    removed[versions[v]] = true;
+                }
+            }
+        }
+    }
+
+    if (policy.maxBytes > 0) {
+        uint64_t kept = 0;
+        vector<size_t> candidates;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (removed[i]) continue;
+            kept += items[i].size;
+            if (!pinned(i)) {
+                candidates.push_back(i);
+            }
+        }
+        stable_sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+            return items[a].mtime < items[b].mtime;
+        });
+        for (size_t i = 0; i < candidates.size() && kept > policy.maxBytes; i++) {
+            removed[candidates[i]] = true;
+            kept -= items[candidates[i]].size;
+        }
+    }
+
+    vector<const CachedItem*> result;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (removed[i]) {
+            result.push_back(&items[i]);
+        }
+    }
+    return result;
+}
+
+uint64_t CacheRetention::totalSize(const vector<const CachedItem*>& items)
+{
+    uint64_t total = 0;
+    for (const CachedItem* item : items) {
+        total += item->size;
+    }
+    return total;
+}
+
+// ============================================================================
+// APT Archives
+// ============================================================================
+
+bool CacheRetention::parseArchiveName(const string& file, string& name,
+                                      string& version, string& arch)
+{
+    static const string suffix = ".deb";
+    if (file.size() <= suffix.size() ||
+        file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+
+    string base = file.substr(0, file.size() - suffix.size());
+    size_t first = base.find('_');
+    size_t last = base.rfind('_');
+    if (first == string::npos || first == last || first == 0) {
+        return false;
+    }
+
+    name = base.substr(0, first);
+    arch = base.substr(last + 1);
+    version.clear();
+    for (size_t i = first + 1; i < last; i++) {
+        // apt's QuoteString() escapes the epoch's ':' as "%3a"
+        if (base[i] == '%' && i + 2 < last) {
+            string hex = base.substr(i + 1, 2);
+            char* end = nullptr;
+            long c = strtol(hex.c_str(), &end, 16);
+            if (end == hex.c_str() + 2) {
+                version += (char) c;
+                i += 2;
+                continue;
+            }
+        }
+        version += base[i];
+    }
+    return !version.empty() && !arch.empty();
+}
+
+bool CacheRetention::scanArchives(const string& dir, vector<CachedItem>& items)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        CachedItem item;
+        string arch;
+        if (!parseArchiveName(entry->d_name, item.name, item.version, arch)) {
+            continue;
+        }
+
+        item.location = dir + entry->d_name;
+        struct stat st;
+        if (stat(item.location.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        item.size = st.st_size;
+        item.mtime = st.st_mtime;
+        items.push_back(std::move(item));
+    }
+    closedir(d);
+    return true;
+}
+
+uint64_t CacheRetention::removeFiles(const vector<const CachedItem*>& items,
+                                     const function<bool()>& stop)
+{
+    uint64_t freed = 0;
+    for (const CachedItem* item : items) {
+        if (stop && stop()) {
+            break;
+        }
+        if (unlink(item->location.c_str()) == 0) {
+            freed += item->size;
+        }
+    }
+    return freed;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,137 @@
+/* cacheretention.h - What to keep of the packages kept around
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the retention policy shared by the cache
+ * cleanups: the APT archives in /var/cache/apt/archives, the disabled
+ * revisions snapd keeps of each snap and the Flatpak runtimes no
+ * installed app uses any more. Each source lists what it has as
+ * CachedItems; the policy picks which of them go.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _CACHERETENTION_H_
+#define _CACHERETENTION_H_
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * CachedItem - One thing a backend keeps that could be removed
+ */
+struct CachedItem {
+    string name;                // Package, snap or runtime ID
+    string version;             // Version, revision or branch
+    string location;            // File path, or what the backend removes it by
+    uint64_t size = 0;          // Bytes it takes
+    time_t mtime = 0;           // When it was fetched
+    bool held = false;          // Its package is held at a version
+    bool obsolete = false;      // It can no longer be downloaded again
+};
+
+/**
+ * RetentionPolicy - Which cached items to keep
+ *
+ * The defaults keep everything. An item of a held package stays when
+ * keepHeld is set, whatever else the policy asks for.
+ */
+struct RetentionPolicy {
+    int keepVersions = -1;      // Newest versions kept of each name, -1 all
+    uint64_t maxBytes = 0;      // Oldest items go until the rest fit, 0 no cap
+    bool keepHeld = true;
+    bool dropObsolete = false;  // Remove what cannot be downloaded again
+
+    /**
+     * Whether this policy removes anything at all
+     */
+    bool removesAnything() const {
+        return keepVersions >= 0 || maxBytes > 0 || dropObsolete;
+    }
+
+    /**
+     * Keep nothing, held or not
+     */
+    static RetentionPolicy everything() {
+        RetentionPolicy policy;
+        policy.keepVersions = 0;
+        policy.keepHeld = false;
+        return policy;
+    }
+};
+
+/**
+ * CacheRetention - Applying a policy to a list of cached items
+ *
+ *     vector<CachedItem> archives;
+ *     CacheRetention::scanArchives("/var/cache/apt/archives/", archives);
+ *     CacheRetention::removeFiles(CacheRetention::select(archives, policy, cmp));
+ *
+ * Thread Safety:
+ *   Stateless; the archive helpers only touch the files they are given.
+ */
+class CacheRetention {
+public:
+    /**
+     * Orders two versions of one name: < 0 if a is older than b
+     */
+    using VersionCompare = function<int(const string& a, const string& b)>;
+
+    /**
+     * The items the policy removes, in the order given
+     *
+     * Versions of a name are ranked by compare, or by mtime without
+     * one. The size cap goes last, over what the rest of the policy
+     * keeps, and removes the oldest items first.
+     */
+    static vector<const CachedItem*> select(const vector<CachedItem>& items,
+                                            const RetentionPolicy& policy,
+                                            const VersionCompare& compare = nullptr);
+
+    /**
+     * Total size of the items
+     */
+    static uint64_t totalSize(const vector<const CachedItem*>& items);
+
+    // ========================================================================
+    // APT Archives
+    // ========================================================================
+
+    /**
+     * Split an archive file name, "name_version_arch.deb" with the
+     * epoch's colon escaped as "%3a", into its parts
+     */
+    static bool parseArchiveName(const string& file, string& name,
+                                 string& version, string& arch);
+
+    /**
+     * List the *.deb files in dir (which ends with a '/')
+     *
+     * @return false if dir cannot be read
+     */
+    static bool scanArchives(const string& dir, vector<CachedItem>& items);
+
+    /**
+     * Unlink the items' files, stopping early if stop returns true
+     *
+     * @return Bytes freed
+     */
+    static uint64_t removeFiles(const vector<const CachedItem*>& items,
+                                const function<bool()>& stop = nullptr);
+};
+
+} // namespace PolySynaptic
+
+#endif // _CACHERETENTION_H_
+
+// vim:ts=4:sw=4:et
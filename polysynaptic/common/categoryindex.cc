@@ -0,0 +1,336 @@
+/* categoryindex.cc - One set of categories over every backend
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "categoryindex.h"
+#include "appstreamindex.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+using Mask = CategoryIndex::Mask;
+
+const Mask AUDIO_VIDEO = CategoryIndex::bit(Category::AUDIO_VIDEO);
+const Mask DEVELOPMENT = CategoryIndex::bit(Category::DEVELOPMENT);
+const Mask EDUCATION = CategoryIndex::bit(Category::EDUCATION);
+const Mask GAMES = CategoryIndex::bit(Category::GAMES);
+const Mask GRAPHICS = CategoryIndex::bit(Category::GRAPHICS);
+const Mask INTERNET = CategoryIndex::bit(Category::INTERNET);
+const Mask OFFICE = CategoryIndex::bit(Category::OFFICE);
+const Mask SCIENCE = CategoryIndex::bit(Category::SCIENCE);
+const Mask SYSTEM = CategoryIndex::bit(Category::SYSTEM);
+const Mask UTILITIES = CategoryIndex::bit(Category::UTILITIES);
+const Mask LIBRARIES = CategoryIndex::bit(Category::LIBRARIES);
+const Mask FONTS = CategoryIndex::bit(Category::FONTS);
+
+struct Label {
+    const char* name;
+    Mask categories;
+};
+
+// Archive sections as Debian and Ubuntu use them
+const Label APT_SECTIONS[] = {
+    {"sound", AUDIO_VIDEO}, {"video", AUDIO_VIDEO},
+    {"devel", DEVELOPMENT}, {"vcs", DEVELOPMENT}, {"debug", DEVELOPMENT},
+    {"interpreters", DEVELOPMENT}, {"java", DEVELOPMENT},
+    {"javascript", DEVELOPMENT}, {"golang", DEVELOPMENT},
+    {"haskell", DEVELOPMENT}, {"lisp", DEVELOPMENT}, {"ocaml", DEVELOPMENT},
+    {"perl", DEVELOPMENT}, {"php", DEVELOPMENT}, {"python", DEVELOPMENT},
+    {"ruby", DEVELOPMENT}, {"rust", DEVELOPMENT}, {"zope", DEVELOPMENT},
+    {"education", EDUCATION}, {"localization", EDUCATION},
+    {"games", GAMES},
+    {"graphics", GRAPHICS},
+    {"net", INTERNET}, {"web", INTERNET}, {"httpd", INTERNET},
+    {"mail", INTERNET}, {"news", INTERNET}, {"comm", INTERNET},
+    {"tex", OFFICE}, {"database", OFFICE},
+    {"math", SCIENCE}, {"science", SCIENCE}, {"electronics", SCIENCE},
+    {"gnu-r", SCIENCE}, {"hamradio", SCIENCE},
+    {"admin", SYSTEM}, {"kernel", SYSTEM}, {"shells", SYSTEM},
+    {"x11", SYSTEM}, {"gnome", SYSTEM}, {"kde", SYSTEM}, {"xfce", SYSTEM},
+    {"otherosfs", SYSTEM},
+    {"utils", UTILITIES}, {"editors", UTILITIES}, {"text", UTILITIES},
+    {"libs", LIBRARIES}, {"oldlibs", LIBRARIES}, {"libdevel", LIBRARIES},
+    {"fonts", FONTS},
+};
+
+// Debtags by prefix; the first match wins
+const Label DEBTAG_PREFIXES[] = {
+    {"game::", GAMES},
+    {"role::devel-lib", LIBRARIES}, {"role::shared-lib", LIBRARIES},
+    {"made-of::font", FONTS},
+    {"devel::", DEVELOPMENT},
+    {"sound::", AUDIO_VIDEO}, {"works-with::audio", AUDIO_VIDEO},
+    {"works-with::video", AUDIO_VIDEO},
+    {"works-with::image", GRAPHICS}, {"works-with-format::svg", GRAPHICS},
+    {"web::", INTERNET}, {"mail::", INTERNET}, {"network::", INTERNET},
+    {"office::", OFFICE}, {"works-with::spreadsheet", OFFICE},
+    {"field::", SCIENCE},
+    {"admin::", SYSTEM}, {"hardware::", SYSTEM},
+};
+
+// The main and additional categories of the freedesktop menu
+// specification, as AppStream data carries them
+const Label FREEDESKTOP[] = {
+    {"AudioVideo", AUDIO_VIDEO}, {"Audio", AUDIO_VIDEO}, {"Video", AUDIO_VIDEO},
+    {"Midi", AUDIO_VIDEO}, {"Player", AUDIO_VIDEO}, {"Recorder", AUDIO_VIDEO},
+    {"Development", DEVELOPMENT}, {"IDE", DEVELOPMENT},
+    {"Debugger", DEVELOPMENT}, {"RevisionControl", DEVELOPMENT},
+    {"WebDevelopment", DEVELOPMENT}, {"Building", DEVELOPMENT},
+    {"Education", EDUCATION}, {"Languages", EDUCATION},
+    {"Game", GAMES},
+    {"Graphics", GRAPHICS}, {"2DGraphics", GRAPHICS}, {"3DGraphics", GRAPHICS},
+    {"RasterGraphics", GRAPHICS}, {"VectorGraphics", GRAPHICS},
+    {"Photography", GRAPHICS}, {"Scanning", GRAPHICS},
+    {"Network", INTERNET}, {"WebBrowser", INTERNET}, {"Email", INTERNET},
+    {"Chat", INTERNET}, {"InstantMessaging", INTERNET},
+    {"IRCClient", INTERNET}, {"FileTransfer", INTERNET}, {"P2P", INTERNET},
+    {"Feed", INTERNET}, {"News", INTERNET},
+    {"Office", OFFICE}, {"Finance", OFFICE}, {"WordProcessor", OFFICE},
+    {"Spreadsheet", OFFICE}, {"Presentation", OFFICE}, {"Calendar", OFFICE},
+    {"ContactManagement", OFFICE}, {"Database", OFFICE},
+    {"Science", SCIENCE}, {"Math", SCIENCE}, {"Astronomy", SCIENCE},
+    {"Biology", SCIENCE}, {"Chemistry", SCIENCE}, {"Physics", SCIENCE},
+    {"Electronics", SCIENCE}, {"Engineering", SCIENCE},
+    {"DataVisualization", SCIENCE},
+    {"System", SYSTEM}, {"Settings", SYSTEM}, {"Security", SYSTEM},
+    {"Monitor", SYSTEM}, {"Emulator", SYSTEM}, {"FileManager", SYSTEM},
+    {"TerminalEmulator", SYSTEM}, {"PackageManager", SYSTEM},
+    {"Utility", UTILITIES}, {"TextEditor", UTILITIES},
+    {"Archiving", UTILITIES}, {"Compression", UTILITIES},
+    {"Accessibility", UTILITIES}, {"Calculator", UTILITIES},
+};
+
+// The Snap Store's sections
+const Label SNAP_SECTIONS[] = {
+    {"art-and-design", GRAPHICS},
+    {"photo-and-video", GRAPHICS | AUDIO_VIDEO},
+    {"music-and-audio", AUDIO_VIDEO}, {"entertainment", AUDIO_VIDEO},
+    {"development", DEVELOPMENT},
+    {"education", EDUCATION}, {"books-and-reference", EDUCATION},
+    {"games", GAMES},
+    {"news-and-weather", INTERNET}, {"social", INTERNET},
+    {"finance", OFFICE}, {"productivity", OFFICE},
+    {"science", SCIENCE},
+    {"devices-and-iot", SYSTEM}, {"personalisation", SYSTEM},
+    {"security", SYSTEM}, {"server-and-cloud", SYSTEM},
+    {"utilities", UTILITIES}, {"health-and-fitness", UTILITIES},
+};
+
+template <size_t N>
+Mask find(const Label (&labels)[N], const string& name)
+{
+    for (const Label& label : labels) {
+        if (name == label.name) {
+            return label.categories;
+        }
+    }
+    return 0;
+}
+
+// Store sections and freedesktop categories never share a spelling, so
+// a store label may be either
+Mask fromStoreLabels(const string& labels)
+{
+    Mask categories = 0;
+    size_t start = 0;
+    while (start < labels.size()) {
+        size_t end = labels.find(';', start);
+        if (end == string::npos) {
+            end = labels.size();
+        }
+        string label = labels.substr(start, end - start);
+        categories |= CategoryIndex::fromSnapSection(label) |
+                      CategoryIndex::fromFreedesktop(label);
+        start = end + 1;
+    }
+    return categories;
+}
+
+} // namespace
+
+// ============================================================================
+// Mappings
+// ============================================================================
+
+const char* CategoryIndex::name(Category category)
+{
+    switch (category) {
+        case Category::AUDIO_VIDEO: return "Audio & Video";
+        case Category::DEVELOPMENT: return "Development";
+        case Category::EDUCATION:   return "Education";
+        case Category::GAMES:       return "Games";
+        case Category::GRAPHICS:    return "Graphics";
+        case Category::INTERNET:    return "Internet";
+        case Category::OFFICE:      return "Office";
+        case Category::SCIENCE:     return "Science";
+        case Category::SYSTEM:      return "System";
+        case Category::UTILITIES:   return "Utilities";
+        case Category::LIBRARIES:   return "Libraries";
+        case Category::FONTS:       return "Fonts";
+        default:                    return "";
+    }
+}
+
+Mask CategoryIndex::fromAptSection(const string& section)
+{
+    size_t slash = section.rfind('/');
+    return find(APT_SECTIONS, slash == string::npos ? section
+                                                    : section.substr(slash + 1));
+}
+
+Mask CategoryIndex::fromDebtag(const string& tag)
+{
+    for (const Label& label : DEBTAG_PREFIXES) {
+        if (tag.compare(0, strlen(label.name), label.name) == 0) {
+            return label.categories;
+        }
+    }
+    return 0;
+}
+
+Mask CategoryIndex::fromFreedesktop(const string& category)
+{
+    // Every kind of game ends in it: ActionGame, BoardGame, ...
+    if (category.size() > 4 &&
+        category.compare(category.size() - 4, 4, "Game") == 0) {
+        return GAMES;
+    }
+    return find(FREEDESKTOP, category);
+}
+
+Mask CategoryIndex::fromSnapSection(const string& section)
+{
+    return find(SNAP_SECTIONS, section);
+}
+
+Mask CategoryIndex::categoriesOf(const PackageInfo& pkg,
+                                 const AppstreamIndex* appstream,
+                                 const Debtags* debtags)
+{
+    if (pkg.backend != BackendType::APT) {
+        return fromStoreLabels(pkg.section);
+    }
+
+    Mask categories = fromAptSection(pkg.section);
+    if (appstream) {
+        AppstreamIndex::Component c = appstream->lookup(pkg);
+        for (size_t i = 0; c && i < c.count(AppstreamIndex::CATEGORIES); i++) {
+            categories |= fromFreedesktop(string(c.item(AppstreamIndex::CATEGORIES, i)));
+        }
+    }
+    if (debtags) {
+        auto it = debtags->find(pkg.name);
+        if (it != debtags->end()) {
+            categories |= it->second;
+        }
+    }
+    return categories;
+}
+
+CategoryIndex::Debtags CategoryIndex::loadDebtags(const string& path)
+{
+    Debtags tags;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        size_t colon = line.find(':');
+        // Tags hold "::", a package name never does
+        if (colon == string::npos || line.compare(colon, 2, "::") == 0) {
+            continue;
+        }
+
+        Mask categories = 0;
+        size_t start = colon + 1;
+        while (start < line.size()) {
+            size_t end = line.find(',', start);
+            if (end == string::npos) {
+                end = line.size();
+            }
+            size_t first = line.find_first_not_of(' ', start);
+            if (first < end) {
+                categories |= fromDebtag(line.substr(first, end - first));
+            }
+            start = end + 1;
+        }
+        if (categories) {
+            tags[line.substr(0, colon)] = categories;
+        }
+    }
+    return tags;
+}
+
+// ============================================================================
+// Index
+// ============================================================================
+
+void CategoryIndex::add(const PackageInfo& pkg, Mask categories)
+{
+    unsigned backend = static_cast<unsigned>(pkg.backend);
+    if (backend >= NUM_BACKENDS) {
+        return;
+    }
+    for (unsigned c = 0; c < NUM_CATEGORIES; c++) {
+        if (categories & (Mask(1) << c)) {
+            _ids[c][backend].push_back(pkg.id);
+        }
+    }
+}
+
+const vector<string>& CategoryIndex::ids(Category category,
+                                         BackendType backend) const
+{
+    static const vector<string> none;
+    unsigned c = static_cast<unsigned>(category);
+    unsigned b = static_cast<unsigned>(backend);
+    if (c >= NUM_CATEGORIES || b >= NUM_BACKENDS) {
+        return none;
+    }
+    return _ids[c][b];
+}
+
+size_t CategoryIndex::count(Category category) const
+{
+    size_t total = 0;
+    for (unsigned b = 0; b < NUM_BACKENDS; b++) {
+        total += ids(category, static_cast<BackendType>(b)).size();
+    }
+    return total;
+}
+
+bool CategoryIndex::empty() const
+{
+    for (unsigned c = 0; c < NUM_CATEGORIES; c++) {
+        if (count(static_cast<Category>(c)) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t CategoryIndex::memoryBytes() const
+{
+    size_t bytes = 0;
+    for (unsigned c = 0; c < NUM_CATEGORIES; c++) {
+        for (unsigned b = 0; b < NUM_BACKENDS; b++) {
+            bytes += _ids[c][b].capacity() * sizeof(string);
+            for (const string& id : _ids[c][b]) {
+                bytes += id.capacity();
+            }
+        }
+    }
+    return bytes;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,153 @@
+/* categoryindex.h - One set of categories over every backend
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the category browser of the unified view. APT
+ * files its packages under archive sections and debtags, Flatpak apps
+ * carry freedesktop categories from their AppStream data and snaps the
+ * Snap Store's sections; each is mapped onto one shared set of
+ * categories. The index keeps the package IDs of every category per
+ * backend, built in the background from what is already cached (the
+ * APT cache, the store index), so listing a category asks no backend.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _CATEGORYINDEX_H_
+#define _CATEGORYINDEX_H_
+
+#include "ipackagebackend.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+class AppstreamIndex;
+
+/**
+ * Category - The shared categories, in the order they are shown
+ */
+enum class Category : uint8_t {
+    AUDIO_VIDEO,
+    DEVELOPMENT,
+    EDUCATION,
+    GAMES,
+    GRAPHICS,
+    INTERNET,
+    OFFICE,
+    SCIENCE,
+    SYSTEM,
+    UTILITIES,
+    LIBRARIES,
+    FONTS,
+    COUNT
+};
+
+/**
+ * CategoryIndex - Package IDs per category and backend
+ *
+ *     CategoryIndex::Debtags tags = CategoryIndex::loadDebtags();
+ *     CategoryIndex index;
+ *     for (const auto& pkg : packages)
+ *         index.add(pkg, CategoryIndex::categoriesOf(pkg, appstream, &tags));
+ *     index.ids(Category::GAMES, BackendType::FLATPAK);
+ *
+ * A package may be in several categories, or in none when nothing it
+ * carries maps onto one.
+ *
+ * Thread Safety:
+ *   Not thread-safe while being built; BackendManager builds one on
+ *   the pool and only shares it once done, as a const index.
+ */
+class CategoryIndex {
+public:
+    using Mask = uint32_t;              // 1 << Category
+
+    /**
+     * Debian package name -> the categories of its debtags
+     */
+    using Debtags = unordered_map<string, Mask>;
+
+    static constexpr const char* DEBTAGS_PATH = "/var/lib/debtags/package-tags";
+
+    static constexpr Mask bit(Category category) {
+        return Mask(1) << static_cast<unsigned>(category);
+    }
+
+    /**
+     * Name of a category for the UI, untranslated
+     */
+    static const char* name(Category category);
+
+    /**
+     * The categories of one label of each scheme
+     *
+     * An APT section may carry its component ("universe/games"). Labels
+     * no category covers map to 0.
+     */
+    static Mask fromAptSection(const string& section);
+    static Mask fromDebtag(const string& tag);
+    static Mask fromFreedesktop(const string& category);
+    static Mask fromSnapSection(const string& section);
+
+    /**
+     * The categories of a package from everything it carries
+     *
+     * APT packages go by section, their AppStream categories if
+     * appstream is given and their debtags if debtags is; Snap and
+     * Flatpak packages by the ';'-separated store sections or
+     * freedesktop categories in PackageInfo::section.
+     */
+    static Mask categoriesOf(const PackageInfo& pkg,
+                             const AppstreamIndex* appstream = nullptr,
+                             const Debtags* debtags = nullptr);
+
+    /**
+     * Read the debtags database ("package: tag, tag, ..." per line);
+     * empty if it is not installed
+     */
+    static Debtags loadDebtags(const string& path = DEBTAGS_PATH);
+
+    /**
+     * File a package under categories
+     */
+    void add(const PackageInfo& pkg, Mask categories);
+
+    /**
+     * The IDs of one backend's packages in a category, in the order
+     * they were added
+     */
+    const vector<string>& ids(Category category, BackendType backend) const;
+
+    /**
+     * Packages of every backend in a category
+     */
+    size_t count(Category category) const;
+
+    bool empty() const;
+
+    /**
+     * Bytes held by the index, for the memory registry
+     */
+    size_t memoryBytes() const;
+
+private:
+    static const unsigned NUM_CATEGORIES = static_cast<unsigned>(Category::COUNT);
+    static const unsigned NUM_BACKENDS = static_cast<unsigned>(BackendType::UNKNOWN);
+
+    vector<string> _ids[NUM_CATEGORIES][NUM_BACKENDS];
+};
+
+} // namespace PolySynaptic
+
+#endif // _CATEGORYINDEX_H_
+
+// vim:ts=4:sw=4:et
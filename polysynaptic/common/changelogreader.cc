@@ -0,0 +1,113 @@
+/* changelogreader.cc - Debian changelog entries as the text comes in
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "changelogreader.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace PolySynaptic {
+
+ChangelogReader::ChangelogReader(const string& installed, Compare compare)
+    : _installed(installed)
+    , _compare(std::move(compare))
+    , _started(false)
+    , _reachedInstalled(false)
+{
+}
+
+string ChangelogReader::headerVersion(const string& line)
+{
+    // "<source> (<version>) <distribution>...; urgency=..."
+    if (line.empty() || isspace(static_cast<unsigned char>(line[0]))) {
+        return string();
+    }
+    size_t open = line.find(" (");
+    if (open == string::npos) {
+        return string();
+    }
+    size_t close = line.find(')', open + 2);
+    if (close == string::npos || close == open + 2 ||
+        line.find(';', close) == string::npos) {
+        return string();
+    }
+    for (size_t i = 0; i < open; i++) {
+        if (isspace(static_cast<unsigned char>(line[i]))) {
+            return string();
+        }
+    }
+    return line.substr(open + 2, close - open - 2);
+}
+
+void ChangelogReader::feed(const char* data, size_t size)
+{
+    const char* end = data + size;
+    while (data < end) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!newline) {
+            _line.append(data, end - data);
+            return;
+        }
+        _line.append(data, newline + 1 - data);
+        addLine(_line);
+        _line.clear();
+        data = newline + 1;
+    }
+}
+
+void ChangelogReader::finish()
+{
+    if (!_line.empty()) {
+        addLine(_line);
+        _line.clear();
+    }
+    closeEntry();
+}
+
+bool ChangelogReader::next(Entry& entry)
+{
+    if (_ready.empty()) {
+        return false;
+    }
+    entry = std::move(_ready.front());
+    _ready.pop_front();
+    return true;
+}
+
+void ChangelogReader::addLine(const string& line)
+{
+    string version = headerVersion(line);
+    if (!version.empty()) {
+        closeEntry();
+        _current.version = version;
+        if (!_reachedInstalled && !_installed.empty() && _compare &&
+            _compare(version, _installed) <= 0) {
+            _reachedInstalled = true;
+        }
+        _current.newer = !_reachedInstalled;
+    }
+    _current.text += line;
+    _started = true;
+}
+
+void ChangelogReader::closeEntry()
+{
+    if (!_started) {
+        return;
+    }
+    _ready.push_back(std::move(_current));
+    _current = Entry();
+    _current.newer = !_reachedInstalled;
+    _started = false;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
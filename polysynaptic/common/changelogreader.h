@@ -0,0 +1,111 @@
+/* changelogreader.h - Debian changelog entries as the text comes in
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the splitting of a changelog into its entries
+ * while it is still downloading, so the changelog dialog can show the
+ * first ones before the rest is there. The changelogs of the kernel or
+ * of LibreOffice run to megabytes, while what a user looks for is
+ * mostly what changed since the installed version: the entries are
+ * marked newer until the first one at or below that version.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _CHANGELOGREADER_H_
+#define _CHANGELOGREADER_H_
+
+#include <deque>
+#include <functional>
+#include <string>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * ChangelogReader - Splits a changelog into entries, chunk by chunk
+ *
+ *     ChangelogReader reader(pkg->installedVersion(), compareVersions);
+ *     reader.feed(data, size);       // as often as data comes in
+ *     reader.finish();               // at the end of the file
+ *     ChangelogReader::Entry entry;
+ *     while (reader.next(entry))
+ *         ... entry.text, entry.newer ...
+ *
+ * An entry starts at a line like "vlc (3.0.20-1) unstable; urgency=low"
+ * in the first column and runs up to the next one. Text ahead of the
+ * first entry, or a file without any (an error page), comes out as an
+ * entry without a version. Lines are kept as they are, newlines
+ * included; a line is only looked at once it is complete.
+ *
+ * The comparison is left to the caller, which keeps this class free of
+ * APT.
+ */
+class ChangelogReader {
+public:
+    /**
+     * Negative, zero or positive as a is older than, the same as or
+     * newer than b
+     */
+    using Compare = std::function<int(const string& a, const string& b)>;
+
+    struct Entry {
+        string version;             // Empty for text outside any entry
+        string text;
+        bool newer = true;          // Than the installed version
+    };
+
+    /**
+     * @param installed Version to mark the entries from; empty marks
+     *                  them all newer
+     * @param compare   Orders two versions; without it every entry is
+     *                  newer
+     */
+    explicit ChangelogReader(const string& installed = "", Compare compare = nullptr);
+
+    void feed(const char* data, size_t size);
+
+    /**
+     * The last entry is complete
+     */
+    void finish();
+
+    /**
+     * The next complete entry; false until there is one
+     */
+    bool next(Entry& entry);
+
+    /**
+     * Whether an entry at or below the installed version came by, so
+     * the rest is older too
+     */
+    bool reachedInstalled() const { return _reachedInstalled; }
+
+    /**
+     * The version a header line names, or an empty string if it is no
+     * header (exposed for tests)
+     */
+    static string headerVersion(const string& line);
+
+private:
+    string _installed;
+    Compare _compare;
+    string _line;                   // Incomplete last line
+    Entry _current;
+    bool _started;                  // _current holds a line
+    bool _reachedInstalled;
+    deque<Entry> _ready;
+
+    void addLine(const string& line);
+    void closeEntry();
+};
+
+} // namespace PolySynaptic
+
+#endif // _CHANGELOGREADER_H_
+
+// vim:ts=4:sw=4:et
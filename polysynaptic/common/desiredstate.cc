@@ -0,0 +1,296 @@
+/* desiredstate.cc - Desired package state lists for batch mode
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "desiredstate.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace PolySynaptic {
+
+static string lowered(string s)
+{
+    for (auto& c : s) c = tolower((unsigned char)c);
+    return s;
+}
+
+static bool parseBackend(const string& word, BackendType& backend)
+{
+    string name = lowered(word);
+    if (name == "apt" || name == "deb") {
+        backend = BackendType::APT;
+    } else if (name == "snap") {
+        backend = BackendType::SNAP;
+    } else if (name == "flatpak") {
+        backend = BackendType::FLATPAK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parseState(const string& word, DesiredPackage::State& state)
+{
+    string name = lowered(word);
+    if (name == "present" || name == "installed") {
+        state = DesiredPackage::State::PRESENT;
+    } else if (name == "latest") {
+        state = DesiredPackage::State::LATEST;
+    } else if (name == "absent" || name == "removed") {
+        state = DesiredPackage::State::ABSENT;
+    } else if (name == "purged") {
+        state = DesiredPackage::State::PURGED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* DesiredState::stateToString(DesiredPackage::State state)
+{
+    switch (state) {
+        case DesiredPackage::State::PRESENT: return "present";
+        case DesiredPackage::State::LATEST:  return "latest";
+        case DesiredPackage::State::ABSENT:  return "absent";
+        case DesiredPackage::State::PURGED:  return "purged";
+    }
+    return "present";
+}
+
+bool DesiredState::parse(std::istream& in, string& error)
+{
+    vector<DesiredPackage> packages;
+    set<pair<BackendType, string>> seen;
+
+    string text;
+    int line = 0;
+    while (getline(in, text)) {
+        line++;
+
+        size_t start = text.find_first_not_of(" \t\r");
+        if (start == string::npos || text[start] == '#') continue;
+
+        string where = "line " + to_string(line) + ": ";
+        istringstream words(text);
+        string backend, id, word;
+        words >> backend >> id;
+
+        DesiredPackage pkg;
+        pkg.line = line;
+        pkg.id = id;
+        if (id.empty() || id[0] == '#') {
+            error = where + "expected <backend> <id> [state] [pin]";
+            return false;
+        }
+        if (!parseBackend(backend, pkg.backend)) {
+            error = where + "unknown backend '" + backend + "'";
+            return false;
+        }
+
+        bool haveState = false;
+        while (words >> word && word[0] != '#') {
+            size_t eq = word.find('=');
+            if (eq == string::npos) {
+                if (haveState || !parseState(word, pkg.state)) {
+                    error = where + (haveState ? "unexpected '" : "unknown state '") +
+                            word + "'";
+                    return false;
+                }
+                haveState = true;
+                continue;
+            }
+
+            string key = lowered(word.substr(0, eq));
+            string value = word.substr(eq + 1);
+            string* pin = nullptr;
+            BackendType pinned = BackendType::UNKNOWN;
+            if (key == "version") {
+                pin = &pkg.version;
+                pinned = BackendType::APT;
+            } else if (key == "channel") {
+                pin = &pkg.channel;
+                pinned = BackendType::SNAP;
+            } else if (key == "branch") {
+                pin = &pkg.branch;
+                pinned = BackendType::FLATPAK;
+            }
+            if (!pin || value.empty()) {
+                error = where + "unknown pin '" + word + "'";
+                return false;
+            }
+            if (pinned != pkg.backend) {
+                error = where + key + " does not apply to " +
+                        backendTypeToBadge(pkg.backend) + " packages";
+                return false;
+            }
+            *pin = value;
+        }
+
+        if (!pkg.target().empty()) {
+            bool removed = pkg.state == DesiredPackage::State::ABSENT ||
+                           pkg.state == DesiredPackage::State::PURGED;
+            // A fixed APT version cannot also follow the newest one
+            if (removed || (pkg.state == DesiredPackage::State::LATEST && !pkg.version.empty())) {
+                error = where + stateToString(pkg.state) + " cannot be pinned";
+                return false;
+            }
+        }
+        if (!seen.insert({pkg.backend, pkg.id}).second) {
+            error = where + id + " is listed twice";
+            return false;
+        }
+
+        packages.push_back(std::move(pkg));
+    }
+
+    _packages.swap(packages);
+    return true;
+}
+
+bool DesiredState::uses(BackendType backend) const
+{
+    return any_of(_packages.begin(), _packages.end(),
+                  [backend](const DesiredPackage& pkg) { return pkg.backend == backend; });
+}
+
+bool DesiredState::wantsLatest(BackendType backend) const
+{
+    return any_of(_packages.begin(), _packages.end(),
+                  [backend](const DesiredPackage& pkg) {
+                      return pkg.backend == backend &&
+                             pkg.state == DesiredPackage::State::LATEST;
+                  });
+}
+
+bool DesiredState::channelMatches(const string& tracking, const string& wanted)
+{
+    auto normalized = [](const string& channel) {
+        static const set<string> risks = {"stable", "candidate", "beta", "edge"};
+        size_t slash = channel.find('/');
+        if (slash != string::npos) return channel;
+        return risks.count(channel) ? "latest/" + channel : channel + "/stable";
+    };
+    return normalized(tracking) == normalized(wanted);
+}
+
+// Whether an installed package already has the entry's pin
+static bool hasPin(const PackageInfo& pkg, const DesiredPackage& want)
+{
+    if (!want.version.empty()) return pkg.installedVersion == want.version;
+    if (!want.channel.empty()) return DesiredState::channelMatches(pkg.channel.str(), want.channel);
+    if (!want.branch.empty()) return pkg.branch.str() == want.branch;
+    return true;
+}
+
+Transaction DesiredState::plan(const vector<PackageInfo>& installed,
+                               const vector<PackageInfo>& upgradable,
+                               size_t* unchanged) const
+{
+    using Type = Transaction::Operation::Type;
+
+    // APT ids carry the architecture for foreign packages; names do not
+    map<pair<BackendType, string>, const PackageInfo*> have;
+    set<pair<BackendType, string>> outdated;
+    for (const auto& pkg : installed) {
+        have.insert({{pkg.backend, pkg.id}, &pkg});
+        have.insert({{pkg.backend, pkg.name}, &pkg});
+    }
+    for (const auto& pkg : upgradable) {
+        outdated.insert({pkg.backend, pkg.id});
+        outdated.insert({pkg.backend, pkg.name});
+    }
+
+    Transaction tx;
+    size_t same = 0;
+    for (const auto& want : _packages) {
+        auto found = have.find({want.backend, want.id});
+        const PackageInfo* current = found != have.end() ? found->second : nullptr;
+
+        Transaction::Operation op;
+        op.backend = want.backend;
+        op.packageId = want.id;
+        op.packageName = want.id;
+
+        switch (want.state) {
+            case DesiredPackage::State::PRESENT:
+            case DesiredPackage::State::LATEST:
+                if (!current) {
+                    op.type = Type::INSTALL;
+                    op.target = want.target();
+                } else if (!hasPin(*current, want)) {
+                    op.type = Type::UPDATE;
+                    op.target = want.target();
+                } else if (want.state == DesiredPackage::State::LATEST &&
+                           outdated.count({want.backend, want.id}) > 0) {
+                    op.type = Type::UPDATE;
+                } else {
+                    same++;
+                    continue;
+                }
+                break;
+            case DesiredPackage::State::ABSENT:
+            case DesiredPackage::State::PURGED:
+                if (!current) {
+                    same++;
+                    continue;
+                }
+                op.type = Type::REMOVE;
+                op.purge = want.state == DesiredPackage::State::PURGED;
+                break;
+        }
+        tx.operations.push_back(std::move(op));
+    }
+
+    if (unchanged) *unchanged = same;
+    return tx;
+}
+
+Reconciliation DesiredState::reconcile(BackendManager& manager,
+                                       ProgressCallback progress) const
+{
+    Reconciliation result;
+
+    BackendFilter filter, latest;
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        bool use = uses(type) && manager.getBackend(type);
+        bool update = use && wantsLatest(type);
+        switch (type) {
+            case BackendType::APT:     filter.includeApt = use; latest.includeApt = update; break;
+            case BackendType::SNAP:    filter.includeSnap = use; latest.includeSnap = update; break;
+            default:                   filter.includeFlatpak = use; latest.includeFlatpak = update; break;
+        }
+    }
+
+    DesiredState available;
+    for (const auto& want : _packages) {
+        if (filter.includes(want.backend)) {
+            available._packages.push_back(want);
+        } else {
+            result.unavailable.push_back(want);
+        }
+    }
+    if (available._packages.empty()) return result;
+
+    vector<PackageInfo> installed = manager.getInstalledPackages(filter, progress);
+    vector<PackageInfo> upgradable;
+    if (latest.includeApt || latest.includeSnap || latest.includeFlatpak) {
+        upgradable = manager.getUpgradablePackages(latest, progress);
+    }
+
+    result.transaction = available.plan(installed, upgradable, &result.unchanged);
+    return result;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,124 @@
+/* desiredstate.h - Desired package state lists for batch mode
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file reads the package lists fleet automation hands to
+ * polysynaptic-batch and works out the transaction that gets a machine
+ * from what it has installed to what the list asks for.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _DESIREDSTATE_H_
+#define _DESIREDSTATE_H_
+
+#include "backendmanager.h"
+
+#include <istream>
+
+namespace PolySynaptic {
+
+/**
+ * DesiredPackage - One entry of a desired state list
+ */
+struct DesiredPackage {
+    enum class State {
+        PRESENT,        // Installed, any version
+        LATEST,         // Installed and updated
+        ABSENT,         // Not installed
+        PURGED          // Not installed, configuration and data removed
+    };
+
+    BackendType backend = BackendType::UNKNOWN;
+    string id;
+    State state = State::PRESENT;
+    string version;                 // APT version to have, empty for any
+    string channel;                 // Snap channel to track, empty for any
+    string branch;                  // Flatpak branch to have, empty for any
+    int line = 0;                   // Where it was read, for errors
+
+    // Whichever of version, channel and branch the entry pins
+    const string& target() const {
+        return !version.empty() ? version : !channel.empty() ? channel : branch;
+    }
+};
+
+/**
+ * Reconciliation - What it takes to reach a desired state
+ */
+struct Reconciliation {
+    Transaction transaction;        // Operations, for available backends only
+    size_t unchanged = 0;           // Entries already satisfied
+    vector<DesiredPackage> unavailable; // Entries for backends this machine lacks
+};
+
+/**
+ * DesiredState - What a machine should have installed
+ *
+ * The list has one package per line; blank lines and lines starting
+ * with '#' are ignored:
+ *
+ *   # backend  id               state    pin
+ *   apt        htop             present  version=3.0.5-7
+ *   snap       vlc              latest   channel=beta
+ *   flatpak    org.gimp.GIMP    present  branch=beta
+ *   flatpak    org.gnome.Maps   absent
+ *
+ * A package id may only appear once per backend. Pins only apply to
+ * installed packages: version for APT, channel for Snap and branch
+ * for Flatpak.
+ */
+class DesiredState {
+public:
+    /**
+     * Read a list, replacing the current one
+     *
+     * @return false with error naming the line if the list is malformed
+     */
+    bool parse(std::istream& in, string& error);
+
+    const vector<DesiredPackage>& packages() const { return _packages; }
+
+    // Whether any entry is for backend; for latest entries only
+    bool uses(BackendType backend) const;
+    bool wantsLatest(BackendType backend) const;
+
+    /**
+     * Operations taking installed to the desired state
+     *
+     * upgradable lists the installed packages that have an update;
+     * only latest entries look at it. Entries already satisfied are
+     * counted in unchanged. A pinned entry installed at another
+     * version, channel or branch becomes an update to its pin.
+     */
+    Transaction plan(const vector<PackageInfo>& installed,
+                     const vector<PackageInfo>& upgradable,
+                     size_t* unchanged = nullptr) const;
+
+    /**
+     * Plan against what the manager's backends have installed
+     *
+     * Only the backends the list uses are queried, and upgradable
+     * packages only for those with latest entries.
+     */
+    Reconciliation reconcile(BackendManager& manager,
+                             ProgressCallback progress = nullptr) const;
+
+    // Whether an installed snap tracks the channel asked for; "beta"
+    // means "latest/beta" and a bare track its stable risk
+    static bool channelMatches(const string& tracking, const string& wanted);
+
+    static const char* stateToString(DesiredPackage::State state);
+
+private:
+    vector<DesiredPackage> _packages;
+};
+
+} // namespace PolySynaptic
+
+#endif // _DESIREDSTATE_H_
+
+// vim:ts=4:sw=4:et
@@ -9,39 +9,82 @@
  */
 
 #include "flatpakbackend.h"
+#include "tracing.h"
+#include "latency.h"
 
+#include <dirent.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <spawn.h>
 #include <fcntl.h>
-#include <poll.h>
 
+#include <cctype>
 #include <cstring>
 #include <sstream>
 #include <regex>
 #include <algorithm>
 #include <climits>
+#include <future>
+#include <thread>
 
 namespace PolySynaptic {
 
+// Availability is probed again after this even without a file change
+static const std::chrono::minutes AVAILABILITY_TTL(10);
+
+// A remote listing is run again after this even if its appstream did
+// not change, since remote-ls also sees commits published in between
+static const std::chrono::minutes LISTING_TTL(30);
+
+// The binary and the remote configuration of both installations
+static vector<string> availabilityPaths()
+{
+    vector<string> paths = {"/usr/bin/flatpak", "/var/lib/flatpak/repo/config"};
+    const char *home = getenv("HOME");
+    if (home != nullptr) {
+        paths.push_back(string(home) + "/.local/share/flatpak/repo/config");
+    }
+    return paths;
+}
+
 // ============================================================================
 // Constructor / Destructor
 // ============================================================================
 
 FlatpakBackend::FlatpakBackend()
-    : _availabilityChecked(false)
+    : _availability(availabilityPaths(), AVAILABILITY_TTL)
     , _isAvailable(false)
     , _defaultScope(Scope::USER)
     , _defaultRemote("flathub")
     , _timeoutSeconds(120)
+    , _engine(new FlatpakEngine())
+    , _useEngine(true)
+    , _engineAvailable(false)
 {
+    _engineAvailable = FlatpakEngine::isCompiledIn() && _engine->isAvailable();
 }
 
 FlatpakBackend::~FlatpakBackend()
 {
 }
 
+shared_ptr<FlatpakBackend> FlatpakBackend::shared()
+{
+    static mutex lock;
+    static weak_ptr<FlatpakBackend> current;
+
+    lock_guard<mutex> guard(lock);
+    shared_ptr<FlatpakBackend> engine = current.lock();
+    if (!engine) {
+        engine = make_shared<FlatpakBackend>();
+        current = engine;
+    }
+    return engine;
+}
+
 // ============================================================================
 // Backend Information
 // ============================================================================
@@ -55,39 +98,39 @@ bool FlatpakBackend::isAvailable() const
 string FlatpakBackend::getUnavailableReason() const
 {
     checkAvailability();
+    lock_guard<mutex> lock(_mutex);
     return _unavailableReason;
 }
 
 string FlatpakBackend::getVersion() const
 {
     checkAvailability();
+    lock_guard<mutex> lock(_mutex);
     return _version;
 }
 
 void FlatpakBackend::checkAvailability() const
 {
-    // Use acquire memory order for first check (pairs with release below)
-    if (_availabilityChecked.load(std::memory_order_acquire)) return;
+    // Cached until it expires or flatpak or a remote configuration changes
+    if (_availability.isFresh()) return;
 
     lock_guard<mutex> lock(_mutex);
     // Second check inside lock
-    if (_availabilityChecked.load(std::memory_order_relaxed)) return;
+    if (_availability.isFresh()) return;
 
-    // Note: We set this to true AFTER initialization completes (at end of function)
-    // to ensure all data is visible to other threads
+    _unavailableReason.clear();
+    _version.clear();
 
     // Check if flatpak command exists
-    auto result = executeCommand({"which", "flatpak"}, 5);
-    if (!result.success || result.exitCode != 0) {
+    if (Subprocess::findProgram("flatpak").empty()) {
         _isAvailable = false;
         _unavailableReason = "flatpak command not found. Install flatpak to enable Flatpak support.";
-        // Use release memory order to ensure all writes are visible
-        _availabilityChecked.store(true, std::memory_order_release);
+        _availability.markFresh();
         return;
     }
 
     // Get version
-    result = executeCommand({"flatpak", "--version"}, 10);
+    auto result = executeCommand({"flatpak", "--version"}, 10);
     if (result.success && result.exitCode == 0) {
         // Output: "Flatpak 1.14.1"
         size_t pos = result.stdout.rfind(' ');
@@ -102,47 +145,220 @@ void FlatpakBackend::checkAvailability() const
 
     // Check if any remotes are configured
     refreshRemotesCache();
-    if (_remotes.empty()) {
+    if (remotes().empty()) {
         _isAvailable = true;  // Still available, but warn user
         _unavailableReason = "No Flatpak remotes configured. Add flathub with: flatpak remote-add --if-not-exists flathub https://dl.flathub.org/repo/flathub.flatpakrepo";
     } else {
         _isAvailable = true;
     }
 
-    // Use release memory order to ensure all writes are visible to threads
-    // that subsequently read _availabilityChecked with acquire semantics
-    _availabilityChecked.store(true, std::memory_order_release);
+    // Publishes the results to threads that see isFresh()
+    _availability.markFresh();
+}
+
+// Names from `flatpak remotes --columns=name`
+static vector<string> parseRemoteNames(const string& output)
+{
+    vector<string> names;
+    istringstream iss(output);
+    string line;
+    while (getline(iss, line)) {
+        // Skip header if present
+        if (line.empty() || line.find("Name") != string::npos) continue;
+
+        // Trim whitespace
+        size_t start = line.find_first_not_of(" \t");
+        size_t end = line.find_last_not_of(" \t\r\n");
+        if (start != string::npos && end != string::npos) {
+            names.push_back(line.substr(start, end - start + 1));
+        }
+    }
+    return names;
 }
 
 void FlatpakBackend::refreshRemotesCache() const
 {
-    auto result = executeCommand({"flatpak", "remotes", "--columns=name"}, 30);
-    _remotes.clear();
+    // Both installations at once
+    auto system = async(launch::async, [this]() {
+        return executeCommand({"flatpak", "remotes", "--system", "--columns=name"}, 30);
+    });
+    auto user = executeCommand({"flatpak", "remotes", "--user", "--columns=name"}, 30);
 
-    if (result.success && result.exitCode == 0) {
-        istringstream iss(result.stdout);
-        string line;
-        while (getline(iss, line)) {
-            // Skip header if present
-            if (line.empty() || line.find("Name") != string::npos) continue;
+    vector<string> scoped[2];
+    if (user.success && user.exitCode == 0) {
+        scoped[static_cast<int>(Scope::USER)] = parseRemoteNames(user.stdout);
+    }
+    auto systemResult = system.get();
+    if (systemResult.success && systemResult.exitCode == 0) {
+        scoped[static_cast<int>(Scope::SYSTEM)] = parseRemoteNames(systemResult.stdout);
+    }
 
-            // Trim whitespace
-            size_t start = line.find_first_not_of(" \t");
-            size_t end = line.find_last_not_of(" \t\r\n");
-            if (start != string::npos && end != string::npos) {
-                string remote = line.substr(start, end - start + 1);
-                if (!remote.empty()) {
-                    _remotes.push_back(remote);
-                }
+    vector<string> names;
+    for (const auto& scope : {Scope::USER, Scope::SYSTEM}) {
+        for (const auto& name : scoped[static_cast<int>(scope)]) {
+            if (find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
             }
         }
     }
+
+    lock_guard<mutex> lock(_remotesMutex);
+    _remotes.swap(names);
+    for (int i = 0; i < 2; i++) {
+        _scopeRemotes[i].swap(scoped[i]);
+    }
+}
+
+vector<string> FlatpakBackend::remotes() const
+{
+    lock_guard<mutex> lock(_remotesMutex);
+    return _remotes;
+}
+
+vector<string> FlatpakBackend::remotes(Scope scope) const
+{
+    lock_guard<mutex> lock(_remotesMutex);
+    return _scopeRemotes[static_cast<int>(scope)];
+}
+
+// ============================================================================
+// Listing Cache
+// ============================================================================
+
+string FlatpakBackend::installationPath(Scope scope)
+{
+    if (scope == Scope::SYSTEM) {
+        const char *dir = getenv("FLATPAK_SYSTEM_DIR");
+        return dir ? dir : "/var/lib/flatpak";
+    }
+
+    const char *dir = getenv("FLATPAK_USER_DIR");
+    if (dir) {
+        return dir;
+    }
+    const char *data = getenv("XDG_DATA_HOME");
+    if (data && *data) {
+        return string(data) + "/flatpak";
+    }
+    const char *home = getenv("HOME");
+    return home ? string(home) + "/.local/share/flatpak" : "";
+}
+
+static string mtimeOf(const struct stat& st)
+{
+    return to_string(st.st_mtim.tv_sec) + "." + to_string(st.st_mtim.tv_nsec);
+}
+
+string FlatpakBackend::listingStamp(Scope scope, const string& remote)
+{
+    // flatpak touches .changed whenever it changes the installation
+    string base = installationPath(scope);
+    struct stat st;
+    if (base.empty() || stat((base + "/.changed").c_str(), &st) != 0) {
+        return "";
+    }
+    string stamp = mtimeOf(st);
+    if (remote.empty()) {
+        return stamp;
+    }
+
+    // appstream/<remote>/<arch>/active is replaced by each update of it
+    string dir = base + "/appstream/" + remote;
+    DIR *entries = opendir(dir.c_str());
+    if (!entries) {
+        return "";
+    }
+    vector<string> arches;
+    while (struct dirent *entry = readdir(entries)) {
+        if (entry->d_name[0] != '.') {
+            arches.push_back(entry->d_name);
+        }
+    }
+    closedir(entries);
+    sort(arches.begin(), arches.end());
+
+    bool found = false;
+    for (const auto& arch : arches) {
+        if (lstat((dir + "/" + arch + "/active").c_str(), &st) == 0) {
+            stamp += ";" + arch + "@" + mtimeOf(st);
+            found = true;
+        }
+    }
+    return found ? stamp : "";
+}
+
+bool FlatpakBackend::listCached(Scope scope, const string& remote,
+                                const vector<string>& args,
+                                FlatpakOutputParser::Table table,
+                                vector<PackageInfo>& results) const
+{
+    string key = string(scope == Scope::USER ? "user" : "system") + "\n" + remote;
+    string stamp = listingStamp(scope, remote);
+    auto now = std::chrono::steady_clock::now();
+
+    if (!stamp.empty()) {
+        lock_guard<mutex> lock(_listingsMutex);
+        auto it = _listings.find(key);
+        if (it != _listings.end() && it->second.stamp == stamp &&
+            (remote.empty() || now - it->second.listedAt < LISTING_TTL)) {
+            results.insert(results.end(), it->second.packages.begin(),
+                           it->second.packages.end());
+            return true;
+        }
+    }
+
+    vector<PackageInfo> listed;
+    if (!streamCommand(args, table, listed)) {
+        return false;
+    }
+
+    if (!stamp.empty()) {
+        lock_guard<mutex> lock(_listingsMutex);
+        Listing& listing = _listings[key];
+        listing.stamp = stamp;
+        listing.listedAt = now;
+        listing.packages = listed;
+    }
+    results.insert(results.end(), std::make_move_iterator(listed.begin()),
+                   std::make_move_iterator(listed.end()));
+    return true;
+}
+
+PackageInfo FlatpakBackend::fromFlatpakRef(const FlatpakRefInfo& ref)
+{
+    PackageInfo info;
+    info.backend = BackendType::FLATPAK;
+    info.id = ref.appId;
+    info.name = ref.name.empty() ? ref.appId : ref.name;
+    info.summary = ref.summary;
+    info.version = ref.version;
+    info.branch = ref.branch;
+    info.architecture = ref.arch;
+    info.remote = ref.origin;
+    info.origin = ref.origin;
+    info.ref = ref.ref;
+    info.runtimeRef = ref.runtimeRef;
+    info.section = ref.categories;
+    info.keywords = ref.keywords;
+    info.installedSize = ref.installedSize;
+    info.downloadSize = ref.downloadSize;
+    info.confinement = "sandboxed";
+
+    if (ref.installed) {
+        info.installStatus = InstallStatus::INSTALLED;
+        info.installedVersion = ref.version;
+    } else {
+        info.installStatus = InstallStatus::NOT_INSTALLED;
+    }
+
+    return info;
 }
 
 bool FlatpakBackend::hasRemote(const string& remoteName)
 {
     checkAvailability();
-    return find(_remotes.begin(), _remotes.end(), remoteName) != _remotes.end();
+    vector<string> known = remotes();
+    return find(known.begin(), known.end(), remoteName) != known.end();
 }
 
 // ============================================================================
@@ -155,7 +371,7 @@ vector<PackageInfo> FlatpakBackend::searchPackages(
 {
     vector<PackageInfo> results;
 
-    if (!isAvailable() || _remotes.empty()) {
+    if (!isAvailable() || remotes().empty()) {
         return results;
     }
 
@@ -172,26 +388,29 @@ vector<PackageInfo> FlatpakBackend::searchPackages(
         progress(0.1, "Searching Flatpak repositories...");
     }
 
-    // Execute flatpak search
-    auto result = executeCommand(
-        {"flatpak", "search", "--columns=application,name,description,version,remotes", options.query},
-        _timeoutSeconds);
-
-    if (!result.success || result.exitCode != 0) {
-        return results;
-    }
-
-    if (progress) {
-        progress(0.5, "Parsing Flatpak results...");
+    vector<FlatpakRefInfo> refs;
+    if (isUsingEngine() && _engine->search(options.query, refs)) {
+        for (const auto& ref : refs) {
+            results.push_back(fromFlatpakRef(ref));
+        }
+    } else {
+        // Execute flatpak search, parsing while it prints
+        if (!streamCommand(
+                {"flatpak", "search", "--columns=application,name,description,version,remotes", options.query},
+                FlatpakOutputParser::Table::SEARCH, results, options.isCancelled)) {
+            return results;
+        }
     }
 
-    results = parseFlatpakSearch(result.stdout);
-
     // Apply result limit
     if (options.maxResults > 0 && results.size() > static_cast<size_t>(options.maxResults)) {
         results.resize(options.maxResults);
     }
 
+    if (options.isCancelled && options.isCancelled()) {
+        return results;
+    }
+
     // Check installation status for each result
     auto installed = getInstalledPackages(nullptr);
     set<string> installedIds;
@@ -212,6 +431,38 @@ vector<PackageInfo> FlatpakBackend::searchPackages(
     return results;
 }
 
+string FlatpakBackend::getStoreCatalogGeneration()
+{
+    // Only libflatpak reads the cached appstream directly
+    if (!isAvailable() || !isUsingEngine()) {
+        return "";
+    }
+    return _engine->getAppstreamStamp();
+}
+
+bool FlatpakBackend::getStoreCatalog(vector<PackageInfo>& packages,
+                                     const function<bool()>& isCancelled)
+{
+    packages.clear();
+    if (!isAvailable() || !isUsingEngine()) {
+        return false;
+    }
+
+    vector<FlatpakRefInfo> refs;
+    if (!_engine->listRemoteApps(refs)) {
+        return false;
+    }
+
+    packages.reserve(refs.size());
+    for (const auto& ref : refs) {
+        if (isCancelled && isCancelled()) {
+            return false;
+        }
+        packages.push_back(fromFlatpakRef(ref));
+    }
+    return true;
+}
+
 vector<PackageInfo> FlatpakBackend::getInstalledPackages(
     ProgressCallback progress)
 {
@@ -225,27 +476,30 @@ vector<PackageInfo> FlatpakBackend::getInstalledPackages(
         progress(0.1, "Loading installed Flatpaks...");
     }
 
-    // Get both user and system installations
-    auto userResult = executeCommand(
-        {"flatpak", "list", "--user", "--columns=application,name,version,branch,origin,size"},
-        _timeoutSeconds);
-
-    auto systemResult = executeCommand(
-        {"flatpak", "list", "--system", "--columns=application,name,version,branch,origin,size"},
-        _timeoutSeconds);
-
-    if (progress) {
-        progress(0.5, "Parsing installed Flatpaks...");
+    vector<FlatpakRefInfo> refs;
+    if (isUsingEngine() && _engine->listInstalled(refs)) {
+        for (const auto& ref : refs) {
+            results.push_back(fromFlatpakRef(ref));
+        }
+        if (progress) {
+            progress(1.0, "Loaded " + to_string(results.size()) + " installed Flatpaks");
+        }
+        return results;
     }
 
-    if (userResult.success && userResult.exitCode == 0) {
-        auto userApps = parseFlatpakList(userResult.stdout);
-        results.insert(results.end(), userApps.begin(), userApps.end());
-    }
+    // Both installations at once, each listed again only once it changed
+    vector<PackageInfo> systemApps;
+    auto system = async(launch::async, [this, &systemApps]() {
+        return listCached(Scope::SYSTEM, "",
+                          {"flatpak", "list", "--system", "--columns=application,name,version,branch,origin,size"},
+                          FlatpakOutputParser::Table::LIST, systemApps);
+    });
+    listCached(Scope::USER, "",
+               {"flatpak", "list", "--user", "--columns=application,name,version,branch,origin,size"},
+               FlatpakOutputParser::Table::LIST, results);
 
-    if (systemResult.success && systemResult.exitCode == 0) {
-        auto systemApps = parseFlatpakList(systemResult.stdout);
-        // Mark as system-installed and avoid duplicates
+    if (system.get()) {
+        // Avoid duplicates; the user installation wins
         set<string> userIds;
         for (const auto& pkg : results) {
             userIds.insert(pkg.id);
@@ -282,7 +536,7 @@ PackageInfo FlatpakBackend::getPackageDetails(const string& packageId)
     if (!result.success || result.exitCode != 0) {
         // Package not installed, try to get info from remote
         // flatpak remote-info <remote> <app-id>
-        for (const auto& remote : _remotes) {
+        for (const auto& remote : remotes()) {
             result = executeCommand({"flatpak", "remote-info", remote, packageId}, _timeoutSeconds);
             if (result.success && result.exitCode == 0) {
                 break;
@@ -303,6 +557,13 @@ InstallStatus FlatpakBackend::getInstallStatus(const string& packageId)
         return InstallStatus::UNKNOWN;
     }
 
+    // A miss may be an engine error or an installation it does not
+    // enumerate, so only a hit is taken without asking the CLI
+    FlatpakRefInfo ref;
+    if (isUsingEngine() && _engine->findInstalled(packageId, ref)) {
+        return InstallStatus::INSTALLED;
+    }
+
     // Check if installed (user or system)
     auto result = executeCommand({"flatpak", "info", "--user", packageId}, 30);
     if (result.success && result.exitCode == 0) {
@@ -330,33 +591,56 @@ vector<PackageInfo> FlatpakBackend::getUpgradablePackages(
         progress(0.1, "Checking for Flatpak updates...");
     }
 
-    // Check user and system updates
-    auto userResult = executeCommand(
-        {"flatpak", "remote-ls", "--user", "--updates", "--columns=application,name,version,branch,origin"},
-        _timeoutSeconds);
-
-    auto systemResult = executeCommand(
-        {"flatpak", "remote-ls", "--system", "--updates", "--columns=application,name,version,branch,origin"},
-        _timeoutSeconds);
+    vector<FlatpakRefInfo> refs;
+    if (isUsingEngine() && _engine->listUpdates(refs)) {
+        for (const auto& ref : refs) {
+            PackageInfo info = fromFlatpakRef(ref);
+            info.installStatus = InstallStatus::UPDATE_AVAILABLE;
+            results.push_back(info);
+        }
+        if (progress) {
+            progress(1.0, "Found " + to_string(results.size()) + " Flatpak updates");
+        }
+        return results;
+    }
 
-    if (progress) {
-        progress(0.5, "Parsing updates...");
+    // Every remote of both installations at once, so the slowest
+    // remote does not hold up the others, each cached by its appstream
+    struct Part {
+        Scope scope;
+        string remote;
+        vector<PackageInfo> updates;
+    };
+    vector<Part> parts;
+    for (const auto& scope : {Scope::USER, Scope::SYSTEM}) {
+        for (const auto& remote : remotes(scope)) {
+            parts.push_back(Part{scope, remote, {}});
+        }
     }
 
-    if (userResult.success && userResult.exitCode == 0) {
-        auto userUpdates = parseFlatpakUpdate(userResult.stdout);
-        results.insert(results.end(), userUpdates.begin(), userUpdates.end());
+    auto list = [this](Part& part) {
+        listCached(part.scope, part.remote,
+                   {"flatpak", "remote-ls", part.scope == Scope::USER ? "--user" : "--system",
+                    "--updates", "--columns=application,name,version,branch,origin", part.remote},
+                   FlatpakOutputParser::Table::UPDATES, part.updates);
+    };
+    vector<future<void>> running;
+    for (size_t i = 1; i < parts.size(); i++) {
+        running.push_back(async(launch::async, list, std::ref(parts[i])));
+    }
+    if (!parts.empty()) {
+        list(parts[0]);
     }
 
-    if (systemResult.success && systemResult.exitCode == 0) {
-        auto systemUpdates = parseFlatpakUpdate(systemResult.stdout);
-        set<string> userIds;
-        for (const auto& pkg : results) {
-            userIds.insert(pkg.id);
+    // User remotes come first and win for an app in both installations
+    set<string> seen;
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (i > 0) {
+            running[i - 1].wait();
         }
-        for (auto& pkg : systemUpdates) {
-            if (userIds.count(pkg.id) == 0) {
-                results.push_back(pkg);
+        for (auto& pkg : parts[i].updates) {
+            if (seen.insert(pkg.id).second) {
+                results.push_back(std::move(pkg));
             }
         }
     }
@@ -399,6 +683,10 @@ OperationResult FlatpakBackend::installFlatpak(
         return OperationResult::Failure("Invalid remote name: " + useRemote);
     }
 
+    if (!branch.empty() && !isValidBranch(branch)) {
+        return OperationResult::Failure("Invalid branch: " + branch);
+    }
+
     if (progress) {
         progress(0.1, "Installing " + appId + "...");
     }
@@ -415,7 +703,8 @@ OperationResult FlatpakBackend::installFlatpak(
         args.push_back(useRemote);
     }
 
-    args.push_back(appId);
+    // Leave the usual branch to flatpak, which also picks the architecture
+    args.push_back(branch.empty() || branch == "stable" ? appId : appId + "//" + branch);
 
     // System-wide installation requires root
     vector<string> execArgs;
@@ -426,7 +715,7 @@ OperationResult FlatpakBackend::installFlatpak(
         execArgs = args;
     }
 
-    auto result = executeCommand(execArgs, 600);  // 10 minute timeout for large apps
+    auto result = executeWithProgress(execArgs, 600, progress);  // 10 minute timeout for large apps
 
     if (progress) {
         progress(1.0, result.success && result.exitCode == 0 ?
@@ -443,6 +732,36 @@ OperationResult FlatpakBackend::installFlatpak(
     }
 }
 
+OperationResult FlatpakBackend::installPackageVersion(
+    const string& packageId,
+    const string& target,
+    ProgressCallback progress)
+{
+    OperationResult result = installFlatpak(packageId, _defaultRemote, target,
+                                            _defaultScope, progress);
+    if (!result.success) {
+        return result;
+    }
+
+    // An app installed from another branch keeps it next to the new one;
+    // the new one is what runs from now on
+    vector<string> args = {"flatpak", "make-current",
+                           _defaultScope == Scope::USER ? "--user" : "--system",
+                           packageId, target};
+    if (_defaultScope == Scope::SYSTEM) {
+        args.insert(args.begin(), "pkexec");
+    }
+    auto current = executeCommand(args, 60);
+    if (!current.success || current.exitCode != 0) {
+        return OperationResult::Failure(
+            "Installed " + packageId + " " + target + " but could not make it current",
+            current.stderr.empty() ? current.stdout : current.stderr,
+            current.exitCode);
+    }
+
+    return OperationResult::Success("Installed " + packageId + " " + target);
+}
+
 OperationResult FlatpakBackend::removePackage(
     const string& packageId,
     bool purge,
@@ -511,12 +830,12 @@ OperationResult FlatpakBackend::updatePackage(
 
     // Try user first
     vector<string> userArgs = {"flatpak", "update", "-y", "--user", packageId};
-    auto result = executeCommand(userArgs, 600);
+    auto result = executeWithProgress(userArgs, 600, progress);
 
     if (!result.success || result.exitCode != 0) {
         // Try system-wide
         vector<string> systemArgs = {"pkexec", "flatpak", "update", "-y", "--system", packageId};
-        result = executeCommand(systemArgs, 600);
+        result = executeWithProgress(systemArgs, 600, progress);
     }
 
     if (progress) {
@@ -534,6 +853,152 @@ OperationResult FlatpakBackend::updatePackage(
     }
 }
 
+// ============================================================================
+// Batch Operations
+// ============================================================================
+
+FlatpakBackend::CommandResult FlatpakBackend::runBatch(
+    vector<string> args,
+    const vector<string>& appIds,
+    Scope scope,
+    int timeoutSeconds,
+    ProgressCallback progress) const
+{
+    args.insert(args.begin(), "flatpak");
+    args.push_back(scope == Scope::USER ? "--user" : "--system");
+    args.insert(args.end(), appIds.begin(), appIds.end());
+
+    if (scope == Scope::SYSTEM) {
+        args.insert(args.begin(), "pkexec");
+    }
+    return executeWithProgress(args, timeoutSeconds, progress);
+}
+
+OperationResult FlatpakBackend::installPackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available", _unavailableReason);
+    }
+
+    for (const auto& id : packageIds) {
+        if (!isValidAppId(id)) {
+            return OperationResult::Failure("Invalid application ID: " + id);
+        }
+    }
+
+    if (!_defaultRemote.empty() && !isValidRemoteName(_defaultRemote)) {
+        return OperationResult::Failure("Invalid remote name: " + _defaultRemote);
+    }
+
+    string count = to_string(packageIds.size()) + " applications";
+    if (progress) {
+        progress(0.1, "Installing " + count + "...");
+    }
+
+    // One transaction resolves and pulls each shared runtime only once
+    vector<string> args = {"install", "-y"};
+    vector<string> refs;
+    if (!_defaultRemote.empty()) {
+        refs.push_back(_defaultRemote);
+    }
+    refs.insert(refs.end(), packageIds.begin(), packageIds.end());
+
+    auto result = runBatch(args, refs, _defaultScope, 600, progress);
+    bool ok = result.success && result.exitCode == 0;
+
+    if (progress) {
+        progress(1.0, ok ? "Installed " + count : "Failed to install " + count);
+    }
+
+    if (ok) {
+        return OperationResult::Success("Successfully installed " + count);
+    }
+    return OperationResult::Failure(
+        "Failed to install " + count,
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
+}
+
+OperationResult FlatpakBackend::removePackages(
+    const vector<string>& packageIds,
+    bool purge,
+    ProgressCallback progress)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
+    }
+
+    for (const auto& id : packageIds) {
+        if (!isValidAppId(id)) {
+            return OperationResult::Failure("Invalid application ID: " + id);
+        }
+    }
+
+    string count = to_string(packageIds.size()) + " applications";
+    if (progress) {
+        progress(0.1, "Removing " + count + "...");
+    }
+
+    vector<string> args = {"uninstall", "-y"};
+    if (purge) {
+        args.push_back("--delete-data");
+    }
+
+    // Try user first, then system, like removePackage()
+    auto result = runBatch(args, packageIds, Scope::USER, 300);
+    if (!result.success || result.exitCode != 0) {
+        result = runBatch(args, packageIds, Scope::SYSTEM, 300);
+    }
+
+    if (!result.success || result.exitCode != 0) {
+        // The apps are spread over both installations
+        return IPackageBackend::removePackages(packageIds, purge, progress);
+    }
+
+    if (progress) {
+        progress(1.0, "Removed " + count);
+    }
+    return OperationResult::Success("Successfully removed " + count);
+}
+
+OperationResult FlatpakBackend::updatePackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
+    }
+
+    for (const auto& id : packageIds) {
+        if (!isValidAppId(id)) {
+            return OperationResult::Failure("Invalid application ID: " + id);
+        }
+    }
+
+    string count = to_string(packageIds.size()) + " applications";
+    if (progress) {
+        progress(0.1, "Updating " + count + "...");
+    }
+
+    vector<string> args = {"update", "-y"};
+    auto result = runBatch(args, packageIds, Scope::USER, 600, progress);
+    if (!result.success || result.exitCode != 0) {
+        result = runBatch(args, packageIds, Scope::SYSTEM, 600, progress);
+    }
+
+    if (!result.success || result.exitCode != 0) {
+        // The apps are spread over both installations
+        return IPackageBackend::updatePackages(packageIds, progress);
+    }
+
+    if (progress) {
+        progress(1.0, "Updated " + count);
+    }
+    return OperationResult::Success("Successfully updated " + count);
+}
+
 OperationResult FlatpakBackend::refreshCache(ProgressCallback progress)
 {
     if (!isAvailable()) {
@@ -544,6 +1009,48 @@ OperationResult FlatpakBackend::refreshCache(ProgressCallback progress)
         progress(0.1, "Refreshing Flatpak appstream data...");
     }
 
+    // Remote by remote, so those whose summary has not moved are left
+    // alone and keep their listings (and store index stamp) as they are
+    if (isUsingEngine()) {
+        vector<string> names = remotes();
+        vector<string> failed;
+        size_t changed = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            if (progress) {
+                progress(0.1 + 0.8 * i / names.size(), "Checking " + names[i] + "...");
+            }
+            bool moved = false;
+            if (!_engine->updateAppstream(names[i], moved)) {
+                failed.push_back(names[i]);
+            } else if (moved) {
+                changed++;
+            }
+        }
+
+        // The CLI gets another go at the ones libflatpak could not do
+        string errors;
+        for (const auto& name : failed) {
+            auto retry = executeCommand({"flatpak", "update", "--appstream", name},
+                                        _timeoutSeconds);
+            if (!retry.success || retry.exitCode != 0) {
+                errors += retry.stderr.empty() ? retry.stdout : retry.stderr;
+            } else {
+                changed++;
+            }
+        }
+
+        refreshRemotesCache();
+        if (progress) {
+            progress(1.0, "Flatpak data refreshed");
+        }
+        if (!errors.empty()) {
+            return OperationResult::Failure("Failed to refresh Flatpak data", errors);
+        }
+        return OperationResult::Success(changed == 0
+            ? "Flatpak data already up to date"
+            : "Refreshed appstream data of " + to_string(changed) + " Flatpak remote(s)");
+    }
+
     // Update appstream data from all remotes
     auto result = executeCommand({"flatpak", "update", "--appstream"}, _timeoutSeconds);
 
@@ -564,6 +1071,112 @@ OperationResult FlatpakBackend::refreshCache(ProgressCallback progress)
     }
 }
 
+// ============================================================================
+// Pre-download
+// ============================================================================
+
+OperationResult FlatpakBackend::predownloadUpdates(
+    const vector<string>& packageIds,
+    const function<bool()>& cancelled,
+    int rateLimitKBps)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
+    }
+    if (packageIds.empty()) {
+        return OperationResult::Success("Nothing to download");
+    }
+
+    // Not through pkexec: nobody is there to authenticate, and pulling
+    // into the system installation is allowed without it
+    string errors;
+    for (Scope scope : {Scope::USER, Scope::SYSTEM}) {
+        if (access(installationPath(scope).c_str(), F_OK) != 0) {
+            continue;
+        }
+        vector<string> args = {"flatpak", "update", "--no-deploy", "--noninteractive",
+                               "-y", scope == Scope::USER ? "--user" : "--system"};
+        auto result = executeCommand(args, 3600, cancelled, nullptr, true);
+        if (cancelled && cancelled()) {
+            return OperationResult::Failure("Download cancelled");
+        }
+        if (!result.success || result.exitCode != 0) {
+            errors += result.stderr.empty() ? result.stdout : result.stderr;
+        }
+    }
+
+    if (!errors.empty()) {
+        return OperationResult::Failure("Failed to download Flatpak updates", errors);
+    }
+    return OperationResult::Success("Downloaded Flatpak updates");
+}
+
+// ============================================================================
+// Cache Cleanup
+// ============================================================================
+
+vector<CachedItem> FlatpakBackend::getCachedItems()
+{
+    vector<FlatpakRefInfo> refs;
+    if (!isUsingEngine() || !_engine->listUnused(refs)) {
+        return {};
+    }
+
+    vector<CachedItem> items;
+    for (const auto& ref : refs) {
+        CachedItem item;
+        item.name = ref.appId;
+        item.version = ref.branch;
+        item.location = string(ref.systemInstallation ? "system:" : "user:") + ref.ref;
+        item.size = ref.installedSize;
+
+        // When it was last deployed, for the newest branches to stay
+        struct stat st;
+        string deploy = installationPath(ref.systemInstallation ? Scope::SYSTEM : Scope::USER) +
+                        "/" + ref.ref + "/active";
+        if (stat(deploy.c_str(), &st) == 0) {
+            item.mtime = st.st_mtime;
+        }
+        items.push_back(item);
+    }
+    return items;
+}
+
+OperationResult FlatpakBackend::removeCachedItems(const vector<CachedItem>& items)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
+    }
+
+    // One uninstall per installation
+    vector<string> refs[2];
+    for (const auto& item : items) {
+        size_t colon = item.location.find(':');
+        if (colon == string::npos) continue;
+        bool system = item.location.compare(0, colon, "system") == 0;
+        refs[system ? 1 : 0].push_back(item.location.substr(colon + 1));
+    }
+
+    string errors;
+    for (int system = 0; system < 2; system++) {
+        if (refs[system].empty()) continue;
+        vector<string> args;
+        if (system) args.push_back("pkexec");
+        args.insert(args.end(), {"flatpak", "uninstall", "--noninteractive", "-y",
+                                 system ? "--system" : "--user"});
+        args.insert(args.end(), refs[system].begin(), refs[system].end());
+        auto result = executeCommand(args, 600);
+        if (!result.success || result.exitCode != 0) {
+            errors += result.stderr.empty() ? result.stdout : result.stderr;
+        }
+    }
+
+    if (!errors.empty()) {
+        return OperationResult::Failure("Failed to remove unused Flatpak runtimes", errors);
+    }
+    return OperationResult::Success("Removed " + to_string(items.size()) + " unused Flatpak runtimes");
+}
+
 // ============================================================================
 // Repository/Remote Management
 // ============================================================================
@@ -572,7 +1185,7 @@ vector<string> FlatpakBackend::getRepositories()
 {
     checkAvailability();
     refreshRemotesCache();
-    return _remotes;
+    return remotes();
 }
 
 vector<pair<string, string>> FlatpakBackend::getRemotesWithUrls()
@@ -709,295 +1322,306 @@ vector<string> FlatpakBackend::getBranches(const string& appId, const string& re
     return branches;
 }
 
-// ============================================================================
-// CLI Execution
-// ============================================================================
-
-// Maximum output size to prevent memory exhaustion (10 MB)
-static const size_t MAX_OUTPUT_SIZE = 10 * 1024 * 1024;
-
-FlatpakBackend::CommandResult FlatpakBackend::executeCommand(
-    const vector<string>& args,
-    int timeoutSeconds) const
+vector<PackageInfo> FlatpakBackend::getRuntimes()
 {
-    CommandResult result;
-    result.success = false;
-    result.exitCode = -1;
-
-    if (args.empty()) {
-        result.stderr = "No command specified";
-        return result;
+    vector<PackageInfo> results;
+    if (!isAvailable()) {
+        return results;
     }
+    streamCommand({"flatpak", "list", "--runtime", "--columns=application,name,version,branch,origin,size"},
+                  FlatpakOutputParser::Table::LIST, results);
+    return results;
+}
 
-    // Use safe timeout value, prevent overflow
-    long timeout = (timeoutSeconds > 0) ? timeoutSeconds : _timeoutSeconds;
-    if (timeout > 3600) timeout = 3600;  // Cap at 1 hour
-
-    // Create pipes for stdout and stderr
-    int stdoutPipe[2] = {-1, -1};
-    int stderrPipe[2] = {-1, -1};
-
-    if (pipe(stdoutPipe) != 0) {
-        result.stderr = "Failed to create stdout pipe";
-        return result;
+OperationResult FlatpakBackend::overridePermission(
+    const string& appId,
+    const string& permission,
+    bool grant)
+{
+    if (!isValidAppId(appId)) {
+        return OperationResult::Failure("Invalid app ID: " + appId);
     }
-    if (pipe(stderrPipe) != 0) {
-        result.stderr = "Failed to create stderr pipe";
-        close(stdoutPipe[0]);
-        close(stdoutPipe[1]);
-        return result;
+    if (!isValidPermission(permission)) {
+        return OperationResult::Failure("Invalid permission: " + permission);
     }
 
-    pid_t pid = fork();
-
-    if (pid < 0) {
-        result.stderr = "Failed to fork process";
-        close(stdoutPipe[0]); close(stdoutPipe[1]);
-        close(stderrPipe[0]); close(stderrPipe[1]);
-        return result;
+    // The opposite of --share is --unshare, of the others --no<option>
+    string option;
+    if (grant) {
+        option = "--" + permission;
+    } else if (permission.compare(0, 6, "share=") == 0) {
+        option = "--un" + permission;
+    } else {
+        option = "--no" + permission;
     }
 
-    if (pid == 0) {
-        // Child process
-        close(stdoutPipe[0]);
-        close(stderrPipe[0]);
-
-        dup2(stdoutPipe[1], STDOUT_FILENO);
-        dup2(stderrPipe[1], STDERR_FILENO);
+    auto result = executeCommand({"flatpak", "override", "--user", option, appId}, 10);
 
-        close(stdoutPipe[1]);
-        close(stderrPipe[1]);
-
-        // Convert to C-style args
-        vector<char*> cargs;
-        for (const auto& arg : args) {
-            cargs.push_back(const_cast<char*>(arg.c_str()));
-        }
-        cargs.push_back(nullptr);
-
-        // Execute directly without shell (prevents command injection)
-        execvp(cargs[0], cargs.data());
+    if (result.success && result.exitCode == 0) {
+        return OperationResult::Success(
+            string(grant ? "Granted " : "Revoked ") + permission + " for " + appId);
+    }
+    return OperationResult::Failure(
+        "Failed to override permission",
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
+}
 
-        // If we get here, exec failed
-        _exit(127);
+OperationResult FlatpakBackend::resetPermissions(const string& appId)
+{
+    if (!isValidAppId(appId)) {
+        return OperationResult::Failure("Invalid app ID: " + appId);
     }
 
-    // Parent process
-    close(stdoutPipe[1]);
-    close(stderrPipe[1]);
+    auto result = executeCommand({"flatpak", "override", "--user", "--reset", appId}, 10);
 
-    // Set non-blocking with error checking
-    if (fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK) == -1 ||
-        fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK) == -1) {
-        // Non-fatal: continue with blocking I/O but log warning
-        // This could cause hangs but is better than failing entirely
+    if (result.success && result.exitCode == 0) {
+        return OperationResult::Success("Reset permissions for " + appId);
     }
+    return OperationResult::Failure(
+        "Failed to reset permissions",
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
+}
 
-    // Read output with timeout
-    auto startTime = chrono::steady_clock::now();
-    bool timedOut = false;
-    bool outputTruncated = false;
+map<string, string> FlatpakBackend::getAppMetadata(const string& appId)
+{
+    if (!isAvailable() || !isValidAppId(appId)) {
+        return {};
+    }
 
-    while (true) {
-        auto elapsedMs = chrono::duration_cast<chrono::milliseconds>(
-            chrono::steady_clock::now() - startTime).count();
-        long elapsedSec = elapsedMs / 1000;
+    auto result = executeCommand({"flatpak", "info", "--show-metadata", appId}, 10);
+    if (!result.success || result.exitCode != 0) {
+        return {};
+    }
+    return parseMetadata(result.stdout);
+}
 
-        if (elapsedSec >= timeout) {
-            timedOut = true;
-            kill(pid, SIGTERM);
-            break;
+map<string, string> FlatpakBackend::parseMetadata(const string& output)
+{
+    map<string, string> metadata;
+    istringstream lines(output);
+    string line;
+    string section;
+    while (getline(lines, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
         }
-
-        pollfd fds[2];
-        fds[0].fd = stdoutPipe[0];
-        fds[0].events = POLLIN;
-        fds[1].fd = stderrPipe[0];
-        fds[1].events = POLLIN;
-
-        // Calculate remaining time safely (avoid overflow)
-        int remainingMs = static_cast<int>(min((timeout * 1000) - elapsedMs, (long)INT_MAX));
-        int pollTimeout = min(remainingMs, 100);
-        if (pollTimeout < 0) pollTimeout = 0;
-
-        int ret = poll(fds, 2, pollTimeout);
-
-        if (ret > 0) {
-            char buffer[4096];
-
-            if (fds[0].revents & POLLIN) {
-                ssize_t n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0 && !outputTruncated) {
-                    buffer[n] = '\0';
-                    if (result.stdout.size() + n < MAX_OUTPUT_SIZE) {
-                        result.stdout += buffer;
-                    } else {
-                        outputTruncated = true;
-                        result.stdout += "\n... output truncated (exceeded 10MB limit) ...";
-                    }
-                }
-            }
-
-            if (fds[1].revents & POLLIN) {
-                ssize_t n = read(stderrPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0 && !outputTruncated) {
-                    buffer[n] = '\0';
-                    if (result.stderr.size() + n < MAX_OUTPUT_SIZE) {
-                        result.stderr += buffer;
-                    } else {
-                        outputTruncated = true;
-                        result.stderr += "\n... output truncated (exceeded 10MB limit) ...";
-                    }
-                }
+        if (line[0] == '[') {
+            size_t end = line.find(']');
+            if (end != string::npos) {
+                section = line.substr(1, end - 1);
             }
+            continue;
         }
+        size_t eq = line.find('=');
+        if (eq != string::npos) {
+            metadata[section + "." + line.substr(0, eq)] = line.substr(eq + 1);
+        }
+    }
+    return metadata;
+}
 
-        int status;
-        pid_t w = waitpid(pid, &status, WNOHANG);
-        if (w > 0) {
-            // Read any remaining output
-            char buffer[4096];
-            ssize_t n;
-            while ((n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1)) > 0) {
-                if (!outputTruncated && result.stdout.size() + n < MAX_OUTPUT_SIZE) {
-                    buffer[n] = '\0';
-                    result.stdout += buffer;
-                }
-            }
-            while ((n = read(stderrPipe[0], buffer, sizeof(buffer) - 1)) > 0) {
-                if (!outputTruncated && result.stderr.size() + n < MAX_OUTPUT_SIZE) {
-                    buffer[n] = '\0';
-                    result.stderr += buffer;
-                }
-            }
+OperationResult FlatpakBackend::run(const string& appId, const vector<string>& args)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
+    }
+    if (!isValidAppId(appId)) {
+        return OperationResult::Failure("Invalid app ID: " + appId);
+    }
 
-            if (WIFEXITED(status)) {
-                result.exitCode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                result.exitCode = 128 + WTERMSIG(status);
-            }
-            result.success = true;
-            break;
-        }
+    vector<string> command = {"flatpak", "run", appId};
+    command.insert(command.end(), args.begin(), args.end());
+    vector<char *> argv;
+    for (auto& arg : command) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
     }
+    argv.push_back(nullptr);
 
-    close(stdoutPipe[0]);
-    close(stderrPipe[0]);
+    // Started in a session of its own with no terminal, so it outlives
+    // us; a thread reaps it once it exits
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_t attrs;
+    posix_spawnattr_init(&attrs);
+    posix_spawnattr_setflags(&attrs, POSIX_SPAWN_SETSID);
 
-    if (timedOut) {
-        // Wait for child with a short timeout to prevent zombies
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], &actions, &attrs, argv.data(), environ);
+    posix_spawnattr_destroy(&attrs);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error != 0) {
+        return OperationResult::Failure("Failed to launch " + appId, strerror(error));
+    }
+    thread([pid]() {
         int status;
-        int waitAttempts = 0;
-        while (waitpid(pid, &status, WNOHANG) == 0 && waitAttempts < 50) {
-            usleep(100000);  // 100ms
-            waitAttempts++;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
         }
-        // If still not reaped, send SIGKILL and wait
-        if (waitAttempts >= 50) {
-            kill(pid, SIGKILL);
-            waitpid(pid, &status, 0);
-        }
-        result.stderr = "Command timed out after " + to_string(timeout) + " seconds";
-        result.exitCode = -1;
-        result.success = false;
+    }).detach();
+
+    return OperationResult::Success("Launched " + appId);
+}
+
+OperationResult FlatpakBackend::repair()
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Flatpak backend not available");
     }
 
-    return result;
+    auto result = executeCommand({"pkexec", "flatpak", "repair", "--system"}, 300);
+
+    if (result.success && result.exitCode == 0) {
+        return OperationResult::Success("Flatpak installation repaired");
+    }
+    return OperationResult::Failure(
+        "Repair failed",
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
 }
 
 // ============================================================================
-// Parsing Helpers
+// CLI Execution
 // ============================================================================
 
-vector<PackageInfo> FlatpakBackend::parseFlatpakSearch(const string& output)
+// Maximum output size to prevent memory exhaustion (10 MB)
+static const size_t MAX_OUTPUT_SIZE = 10 * 1024 * 1024;
+
+// Commands that only read, so a background one may be stopped and rerun
+static bool isQuery(const vector<string>& args)
 {
-    vector<PackageInfo> results;
+    if (args.size() < 2 || args[0] != "flatpak") {
+        return false;
+    }
+    const string& verb = args[1];
+    return verb == "list" || verb == "info" || verb == "search" ||
+           verb == "remote-ls" || verb == "remote-info" || verb == "remotes" ||
+           verb == "--version";
+}
 
-    /*
-     * flatpak search --columns=application,name,description,version,remotes output:
-     * org.gnome.Calculator	Calculator	Perform calculations	42.1	flathub
-     */
+FlatpakBackend::CommandResult FlatpakBackend::executeCommand(
+    const vector<string>& args,
+    int timeoutSeconds,
+    const function<bool()>& cancelled,
+    const Subprocess::OutputCallback& onStdout,
+    bool background) const
+{
+    CommandResult result;
+    result.success = false;
+    result.exitCode = -1;
 
-    istringstream iss(output);
-    string line;
+    if (args.empty()) {
+        result.stderr = "No command specified";
+        return result;
+    }
 
-    while (getline(iss, line)) {
-        if (line.empty()) continue;
-
-        // Tab-separated columns
-        vector<string> cols;
-        istringstream lineStream(line);
-        string col;
-        while (getline(lineStream, col, '\t')) {
-            cols.push_back(col);
-        }
+    ScopedSpan span("subprocess", "flatpak");
+    if (span.isActive()) {
+        span.setDetail(args.size() > 1 ? args[0] + " " + args[1] : args[0]);
+    }
+    ScopedLatency latency("Flatpak", args.size() > 1 ? args[0] + " " + args[1] : args[0]);
 
-        if (cols.size() >= 4) {
-            PackageInfo info;
-            info.backend = BackendType::FLATPAK;
-            info.id = cols[0];
-            info.name = cols.size() > 1 ? cols[1] : cols[0];
-            info.summary = cols.size() > 2 ? cols[2] : "";
-            info.version = cols.size() > 3 ? cols[3] : "";
-            info.remote = cols.size() > 4 ? cols[4] : "";
-            info.installStatus = InstallStatus::NOT_INSTALLED;
+    // Use safe timeout value, prevent overflow
+    int timeout = (timeoutSeconds > 0) ? timeoutSeconds : _timeoutSeconds;
+    if (timeout > 3600) timeout = 3600;  // Cap at 1 hour
 
-            results.push_back(info);
-        }
+    Subprocess::Options options;
+    options.timeoutSeconds = timeout;
+    options.cancelled = cancelled;
+    options.pool = "flatpak";
+    options.preemptible = background || isQuery(args);
+    options.lowPriority = background;
+    if (onStdout) {
+        // Streamed to the caller instead of collected
+        options.onStdout = onStdout;
+        options.keepStdout = false;
+    }
+    options.maxOutput = MAX_OUTPUT_SIZE;
+
+    Subprocess::Result run = Subprocess::run(args, options);
+    result.stdout = std::move(run.stdout);
+    result.stderr = std::move(run.stderr);
+    result.usage = run.usage;
+
+    if (!run.started) {
+        result.stderr = run.error;
+        return result;
     }
 
-    return results;
+    if (run.truncated) {
+        string& cut = result.stdout.size() >= MAX_OUTPUT_SIZE ? result.stdout : result.stderr;
+        cut += "\n... output truncated (exceeded 10MB limit) ...";
+    }
+
+    if (run.timedOut || run.cancelled) {
+        result.stderr = run.cancelled ? "Command cancelled"
+                                      : "Command timed out after " + to_string(timeout) + " seconds";
+    } else {
+        result.exitCode = run.exitCode;
+        result.success = true;
+    }
+
+    result.usage.report(span, "Flatpak", args, result.exitCode);
+    return result;
 }
 
-vector<PackageInfo> FlatpakBackend::parseFlatpakList(const string& output)
+FlatpakBackend::CommandResult FlatpakBackend::executeWithProgress(
+    const vector<string>& args,
+    int timeoutSeconds,
+    ProgressCallback progress) const
 {
-    vector<PackageInfo> results;
-
-    /*
-     * flatpak list --columns=application,name,version,branch,origin,size:
-     * org.gnome.Calculator	Calculator	42.1	stable	flathub	98.7 MB
-     */
+    if (!progress) {
+        return executeCommand(args, timeoutSeconds);
+    }
 
-    istringstream iss(output);
-    string line;
+    ProgressThrottle throttle(progress);
+    FlatpakProgressParser parser([&](double fraction, const string& message) {
+        throttle.report(0.1 + 0.85 * fraction, message);
+    });
 
-    while (getline(iss, line)) {
-        if (line.empty()) continue;
+    auto result = executeCommand(args, timeoutSeconds,
+        [&]() { return throttle.cancelled(); },
+        [&](const char *data, size_t size) { parser.feed(data, size); });
+    parser.finish();
 
-        vector<string> cols;
-        istringstream lineStream(line);
-        string col;
-        while (getline(lineStream, col, '\t')) {
-            cols.push_back(col);
-        }
+    // stdout was not kept; the last progress line usually names the error
+    if (result.stdout.empty()) {
+        result.stdout = parser.lastLine();
+    }
+    return result;
+}
 
-        if (cols.size() >= 2) {
-            PackageInfo info;
-            info.backend = BackendType::FLATPAK;
-            info.id = cols[0];
-            info.name = cols.size() > 1 ? cols[1] : cols[0];
-            info.version = cols.size() > 2 ? cols[2] : "";
-            info.installedVersion = info.version;
-            info.branch = cols.size() > 3 ? cols[3] : "stable";
-            info.remote = cols.size() > 4 ? cols[4] : "";
-            info.installStatus = InstallStatus::INSTALLED;
+bool FlatpakBackend::streamCommand(const vector<string>& args,
+                                   FlatpakOutputParser::Table table,
+                                   vector<PackageInfo>& results,
+                                   const function<bool()>& cancelled) const
+{
+    size_t before = results.size();
+    FlatpakOutputParser parser(table,
+        [&](PackageInfo&& info) { results.push_back(std::move(info)); });
 
-            // Parse size if available
-            if (cols.size() > 5) {
-                string sizeStr = cols[5];
-                // Parse "98.7 MB" format
-                // TODO: Convert to bytes
-            }
+    auto result = executeCommand(args, _timeoutSeconds, cancelled,
+        [&](const char *data, size_t size) { parser.feed(data, size); });
 
-            results.push_back(info);
-        }
+    if (!result.success || result.exitCode != 0) {
+        results.erase(results.begin() + before, results.end());
+        return false;
     }
-
-    return results;
+    parser.finish();
+    return true;
 }
 
+// ============================================================================
+// Parsing Helpers
+// ============================================================================
+
 PackageInfo FlatpakBackend::parseFlatpakInfo(const string& output, const string& appId)
 {
+    ScopedSpan span("parse", "flatpak");
     PackageInfo info;
     info.backend = BackendType::FLATPAK;
     info.id = appId;
@@ -1068,18 +1692,6 @@ PackageInfo FlatpakBackend::parseFlatpakInfo(const string& output, const string&
     return info;
 }
 
-vector<PackageInfo> FlatpakBackend::parseFlatpakUpdate(const string& output)
-{
-    // Similar to parseFlatpakList but for updates
-    vector<PackageInfo> results = parseFlatpakList(output);
-
-    for (auto& pkg : results) {
-        pkg.installStatus = InstallStatus::UPDATE_AVAILABLE;
-    }
-
-    return results;
-}
-
 vector<pair<string, string>> FlatpakBackend::parseFlatpakRemotes(const string& output)
 {
     vector<pair<string, string>> results;
@@ -1118,6 +1730,182 @@ vector<pair<string, string>> FlatpakBackend::parseFlatpakRemotes(const string& o
     return results;
 }
 
+// ============================================================================
+// Streaming Output Parser
+// ============================================================================
+
+FlatpakOutputParser::FlatpakOutputParser(Table table, PackageCallback onPackage)
+    : _table(table),
+      _onPackage(std::move(onPackage)),
+      _lines([this](const string& line) { parseLine(line); }),
+      _count(0)
+{
+}
+
+void FlatpakOutputParser::parseLine(const string& line)
+{
+    /*
+     * flatpak search --columns=application,name,description,version,remotes output:
+     * org.gnome.Calculator	Calculator	Perform calculations	42.1	flathub
+     *
+     * flatpak list --columns=application,name,version,branch,origin,size:
+     * org.gnome.Calculator	Calculator	42.1	stable	flathub	98.7 MB
+     *
+     * remote-ls --updates prints the same columns without the size.
+     */
+
+    if (line.empty()) return;
+
+    // Tab-separated columns
+    _columns.clear();
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        _columns.emplace_back(line, start, tab == string::npos ? string::npos : tab - start);
+        if (tab == string::npos) break;
+        start = tab + 1;
+    }
+    // getline() dropped an empty last column; keep the column counts as before
+    if (_columns.back().empty()) {
+        _columns.pop_back();
+    }
+    const vector<string>& cols = _columns;
+    if (cols[0].empty()) return;     // A line of empty columns
+
+    PackageInfo info;
+    info.backend = BackendType::FLATPAK;
+
+    if (_table == Table::SEARCH) {
+        if (cols.size() < 4) return;
+        info.id = cols[0];
+        info.name = cols[1];
+        info.summary = cols[2];
+        info.version = cols[3];
+        info.remote = cols.size() > 4 ? cols[4] : "";
+        info.installStatus = InstallStatus::NOT_INSTALLED;
+    } else {
+        if (cols.size() < 2) return;
+        info.id = cols[0];
+        info.name = cols[1];
+        info.version = cols.size() > 2 ? cols[2] : "";
+        info.installedVersion = info.version;
+        info.branch = cols.size() > 3 ? cols[3] : "stable";
+        info.remote = cols.size() > 4 ? cols[4] : "";
+        info.installStatus = _table == Table::UPDATES ? InstallStatus::UPDATE_AVAILABLE
+                                                      : InstallStatus::INSTALLED;
+        // cols[5] is the size as "98.7 MB"; not converted to bytes yet
+    }
+
+    _count++;
+    _onPackage(std::move(info));
+}
+
+// ============================================================================
+// Progress Parser
+// ============================================================================
+
+FlatpakProgressParser::FlatpakProgressParser(Callback onProgress)
+    : _onProgress(std::move(onProgress)),
+      _fraction(0.0)
+{
+}
+
+void FlatpakProgressParser::feed(const char *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        char c = data[i];
+        if (c == '\r' || c == '\n') {
+            parseLine(_line);
+            _line.clear();
+        } else {
+            _line += c;
+        }
+    }
+}
+
+void FlatpakProgressParser::finish()
+{
+    parseLine(_line);
+    _line.clear();
+}
+
+void FlatpakProgressParser::parseLine(const string& line)
+{
+    if (line.find_first_not_of(" \t") == string::npos) return;
+    _lastLine = line;
+
+    // Tokens are separated by spaces; the bar itself is one or more
+    // tokens of block characters and is skipped
+    vector<string> tokens;
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find(' ', start);
+        if (end == string::npos) end = line.size();
+        if (end > start) tokens.emplace_back(line, start, end - start);
+        start = end + 1;
+    }
+
+    string verb;
+    int step = 0, steps = 0;
+    double percent = -1;
+    string rate;
+
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const string& t = tokens[i];
+
+        // "Installing", "Installing…" or "Installing..."
+        if (i == 0 && isalpha((unsigned char)t[0])) {
+            size_t len = 0;
+            while (len < t.size() && isalpha((unsigned char)t[len])) len++;
+            verb = t.substr(0, len);
+            if (len == t.size()) continue;
+        }
+
+        // "2/3", possibly glued to the ellipsis
+        if (steps == 0) {
+            size_t slash = t.find('/');
+            if (slash != string::npos && slash > 0) {
+                size_t b = slash;
+                while (b > 0 && isdigit((unsigned char)t[b - 1])) b--;
+                size_t e = slash + 1;
+                while (e < t.size() && isdigit((unsigned char)t[e])) e++;
+                if (b < slash && e > slash + 1) {
+                    step = atoi(t.c_str() + b);
+                    steps = atoi(t.c_str() + slash + 1);
+                    continue;
+                }
+            }
+        }
+
+        // "45%"; the last one wins
+        if (t.size() > 1 && t.back() == '%' &&
+            isdigit((unsigned char)t[0])) {
+            percent = atof(t.c_str());
+            continue;
+        }
+
+        // "1.2 MB/s"
+        if (t.size() > 2 && t.compare(t.size() - 2, 2, "/s") == 0 && i > 0 &&
+            isdigit((unsigned char)tokens[i - 1][0])) {
+            rate = tokens[i - 1] + " " + t;
+        }
+    }
+
+    if (steps <= 0 || step <= 0 || step > steps) return;
+
+    double within = percent >= 0 ? min(percent, 100.0) / 100.0 : 0.0;
+    _fraction = ((step - 1) + within) / steps;
+
+    string message = (verb.empty() ? string("Step") : verb) + " " +
+                     to_string(step) + "/" + to_string(steps);
+    if (percent >= 0) {
+        message += " (" + to_string((int)percent) + "%";
+        if (!rate.empty()) message += ", " + rate;
+        message += ")";
+    }
+    _onProgress(_fraction, message);
+}
+
 // ============================================================================
 // Validation
 // ============================================================================
@@ -1147,6 +1935,29 @@ bool FlatpakBackend::isValidRemoteName(const string& name) const
     return regex_match(name, validName);
 }
 
+bool FlatpakBackend::isValidBranch(const string& branch) const
+{
+    // Branches: "stable", "beta", "23.08", ...
+    if (branch.empty() || branch.length() > 64) {
+        return false;
+    }
+
+    static const regex validBranch("^[a-zA-Z0-9][a-zA-Z0-9._-]*$");
+    return regex_match(branch, validBranch);
+}
+
+bool FlatpakBackend::isValidPermission(const string& permission) const
+{
+    // An override option and its value: "share=network",
+    // "filesystem=~/Music:ro", "env=FOO=bar", ...
+    if (permission.empty() || permission.length() > 256) {
+        return false;
+    }
+
+    static const regex validPermission("^[a-z][a-z-]*=[^\\s]+$");
+    return regex_match(permission, validPermission);
+}
+
 } // namespace PolySynaptic
 
 // vim:ts=4:sw=4:et
@@ -3,7 +3,8 @@
  * Copyright (c) 2024 PolySynaptic Contributors
  *
  * This file implements the IPackageBackend interface for Flatpak packages.
- * It uses the flatpak CLI tool to discover, install, and manage flatpaks.
+ * Queries use the in-process libflatpak engine when it is compiled in,
+ * and the flatpak CLI tool otherwise.
  *
  * Requirements:
  *   - flatpak installed
@@ -19,16 +20,97 @@
 #define _FLATPAKBACKEND_H_
 
 #include "ipackagebackend.h"
+#include "flatpakengine.h"
+#include "subprocess.h"
+#include "probecache.h"
+#include <map>
 #include <mutex>
+#include <memory>
 #include <set>
 #include <atomic>
 
 namespace PolySynaptic {
 
+/**
+ * FlatpakOutputParser - Reads the tab-separated --columns output
+ *
+ * Fed chunk by chunk like SnapOutputParser; each package is handed on
+ * as soon as its line is complete.
+ */
+class FlatpakOutputParser {
+public:
+    enum class Table {
+        SEARCH,     // search --columns=application,name,description,version,remotes
+        LIST,       // list --columns=application,name,version,branch,origin,size
+        UPDATES     // remote-ls --updates, the same columns
+    };
+
+    using PackageCallback = std::function<void(PackageInfo&& info)>;
+
+    FlatpakOutputParser(Table table, PackageCallback onPackage);
+
+    FlatpakOutputParser(const FlatpakOutputParser&) = delete;
+    FlatpakOutputParser& operator=(const FlatpakOutputParser&) = delete;
+
+    void feed(const char *data, size_t size) { _lines.feed(data, size); }
+    void finish() { _lines.finish(); }
+
+    size_t count() const { return _count; }
+
+private:
+    Table _table;
+    PackageCallback _onPackage;
+    LineSplitter _lines;
+    vector<string> _columns;    // Reused for every line
+    size_t _count;
+
+    void parseLine(const string& line);
+};
+
+/**
+ * FlatpakProgressParser - Reads the progress of install/update/uninstall
+ *
+ * Without a terminal flatpak still redraws its progress line with
+ * carriage returns, e.g.
+ *
+ *   Installing 2/3… ████████▌            45%  1.2 MB/s  00:12
+ *
+ * so input is split on both '\r' and '\n'. Each line with a step count
+ * is turned into the fraction of the whole transaction done and a
+ * short message, handed on as it arrives.
+ */
+class FlatpakProgressParser {
+public:
+    using Callback = std::function<void(double fraction, const string& message)>;
+
+    explicit FlatpakProgressParser(Callback onProgress);
+
+    void feed(const char *data, size_t size);
+    void finish();
+
+    // Fraction of the transaction done, 0 until a step was seen
+    double fraction() const { return _fraction; }
+
+    // The last non-empty line, for error details when output is
+    // streamed instead of collected
+    const string& lastLine() const { return _lastLine; }
+
+private:
+    Callback _onProgress;
+    string _line;
+    string _lastLine;
+    double _fraction;
+
+    void parseLine(const string& line);
+};
+
 /**
  * FlatpakBackend - Flatpak package management backend
  *
  * Uses the flatpak CLI to manage Flatpak applications and runtimes.
+ * When built with libflatpak, listing, update checks and search go
+ * through FlatpakEngine instead, reading installations and the local
+ * appstream cache directly without spawning a process.
  *
  * CLI Commands Used:
  *   flatpak search <query>              - Search for apps
@@ -59,6 +141,13 @@ public:
     FlatpakBackend();
     ~FlatpakBackend() override;
 
+    /**
+     * The engine of the process, which BackendManager and FlatpakProvider
+     * share so the tool runs, caches and availability probe are one;
+     * made on first use and freed with its last holder
+     */
+    static shared_ptr<FlatpakBackend> shared();
+
     // ========================================================================
     // Backend Information
     // ========================================================================
@@ -68,6 +157,7 @@ public:
     bool isAvailable() const override;
     string getUnavailableReason() const override;
     string getVersion() const override;
+    void invalidateAvailability() override { _availability.invalidate(); }
 
     // ========================================================================
     // Package Discovery & Search
@@ -87,6 +177,10 @@ public:
     vector<PackageInfo> getUpgradablePackages(
         ProgressCallback progress = nullptr) override;
 
+    string getStoreCatalogGeneration() override;
+    bool getStoreCatalog(vector<PackageInfo>& packages,
+                         const function<bool()>& isCancelled) override;
+
     // ========================================================================
     // Package Operations
     // ========================================================================
@@ -107,6 +201,29 @@ public:
     OperationResult refreshCache(
         ProgressCallback progress = nullptr) override;
 
+    // ========================================================================
+    // Batch Operations
+    // ========================================================================
+
+    OperationResult installPackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult removePackages(
+        const vector<string>& packageIds,
+        bool purge = false,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult updatePackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    // Installs the branch given as target and makes it the current one
+    OperationResult installPackageVersion(
+        const string& packageId,
+        const string& target,
+        ProgressCallback progress = nullptr) override;
+
     // ========================================================================
     // Repository/Remote Management
     // ========================================================================
@@ -116,6 +233,35 @@ public:
     OperationResult addRepository(const string& repo) override;
     OperationResult removeRepository(const string& repo) override;
 
+    // ========================================================================
+    // Pre-download
+    // ========================================================================
+
+    /**
+     * flatpak update --no-deploy on each installation: the new commits
+     * are pulled into its repository, and the update that deploys them
+     * later has nothing left to fetch. Pulls every pending update of
+     * the installation, which are the packages given in practice.
+     */
+    bool supportsPredownload() const override { return true; }
+    OperationResult predownloadUpdates(
+        const vector<string>& packageIds,
+        const function<bool()>& cancelled,
+        int rateLimitKBps = 0) override;
+
+    // ========================================================================
+    // Cache Cleanup
+    // ========================================================================
+
+    /**
+     * Runtimes no installed app uses any more; location is the ref
+     * with its scope in front ("system:runtime/..."). Listed through
+     * libflatpak only: the CLI cannot list them without removing them.
+     */
+    bool supportsCacheCleanup() const override { return isUsingEngine(); }
+    vector<CachedItem> getCachedItems() override;
+    OperationResult removeCachedItems(const vector<CachedItem>& items) override;
+
     // ========================================================================
     // Flatpak-Specific Methods
     // ========================================================================
@@ -151,6 +297,47 @@ public:
      */
     vector<string> getBranches(const string& appId, const string& remote = "");
 
+    /**
+     * Installed runtimes of both installations
+     */
+    vector<PackageInfo> getRuntimes();
+
+    /**
+     * Grant or revoke one permission of an app for this user, as in
+     * `flatpak override --user`; permission is an option without its
+     * dashes, e.g. "share=network" or "filesystem=home"
+     */
+    OperationResult overridePermission(
+        const string& appId,
+        const string& permission,
+        bool grant);
+
+    /**
+     * Drop this user's overrides of an app
+     */
+    OperationResult resetPermissions(const string& appId);
+
+    /**
+     * Deployed metadata of an app, keyed "section.key"
+     */
+    map<string, string> getAppMetadata(const string& appId);
+
+    /**
+     * The keys of `flatpak info --show-metadata` output, as
+     * "section.key" -> value
+     */
+    static map<string, string> parseMetadata(const string& output);
+
+    /**
+     * Start an app in the background, not waiting for it to exit
+     */
+    OperationResult run(const string& appId, const vector<string>& args = {});
+
+    /**
+     * Verify the system installation and repair what is broken
+     */
+    OperationResult repair();
+
     /**
      * Set default installation scope
      */
@@ -173,46 +360,119 @@ public:
      */
     bool hasRemote(const string& remoteName);
 
+    /**
+     * Enable or disable the libflatpak engine (default: enabled)
+     *
+     * Has no effect if PolySynaptic was built without libflatpak.
+     */
+    void setUseEngine(bool enabled) { _useEngine = enabled; }
+    bool isUsingEngine() const { return _useEngine && _engineAvailable; }
+
+    /**
+     * Convert a libflatpak ref record to a PackageInfo
+     */
+    static PackageInfo fromFlatpakRef(const FlatpakRefInfo& ref);
+
+    /**
+     * Installation directory of a scope, as the flatpak CLI finds it
+     */
+    static string installationPath(Scope scope);
+
 private:
     mutable mutex _mutex;
-    mutable std::atomic<bool> _availabilityChecked;
-    mutable bool _isAvailable;
+    mutable ProbeCache _availability;   // Guards the three below
+    mutable std::atomic<bool> _isAvailable;
     mutable string _unavailableReason;
     mutable string _version;
-    mutable vector<string> _remotes;
+
+    mutable mutex _remotesMutex;
+    mutable vector<string> _remotes;        // Of both scopes, user ones first
+    mutable vector<string> _scopeRemotes[2];    // Indexed by Scope
+    vector<string> remotes() const;
+    vector<string> remotes(Scope scope) const;
+
+    // The last CLI listing of each installation and remote, used as
+    // long as what it was based on has not changed
+    struct Listing {
+        string stamp;
+        std::chrono::steady_clock::time_point listedAt;
+        vector<PackageInfo> packages;
+    };
+    mutable mutex _listingsMutex;
+    mutable map<string, Listing> _listings;    // "<scope>\n<remote>" -> listing
 
     Scope _defaultScope;
     string _defaultRemote;
     int _timeoutSeconds;
 
+    // In-process libflatpak engine
+    unique_ptr<FlatpakEngine> _engine;
+    std::atomic<bool> _useEngine;
+    bool _engineAvailable;
+
     // CLI execution helpers
     struct CommandResult {
         bool success;
         int exitCode;
         string stdout;
         string stderr;
+        ProcessUsage usage;
     };
 
+    // background: idle priority, and stopped for interactive commands
     CommandResult executeCommand(
         const vector<string>& args,
-        int timeoutSeconds = 0) const;
+        int timeoutSeconds = 0,
+        const function<bool()>& cancelled = nullptr,
+        const Subprocess::OutputCallback& onStdout = nullptr,
+        bool background = false) const;
+
+    // Run a CLI listing, appending its packages as the lines arrive;
+    // false, with results as before, if the command failed
+    bool streamCommand(const vector<string>& args,
+                       FlatpakOutputParser::Table table,
+                       vector<PackageInfo>& results,
+                       const function<bool()>& cancelled = nullptr) const;
+
+    // streamCommand through the listing cache; remote is "" for a
+    // listing of the installation itself
+    bool listCached(Scope scope, const string& remote, const vector<string>& args,
+                    FlatpakOutputParser::Table table,
+                    vector<PackageInfo>& results) const;
+
+    // What a listing was based on: the installation's .changed file
+    // and, for a remote, its appstream; "" if that cannot be told
+    static string listingStamp(Scope scope, const string& remote);
 
     // Parsing helpers
-    vector<PackageInfo> parseFlatpakSearch(const string& output);
-    vector<PackageInfo> parseFlatpakList(const string& output);
     PackageInfo parseFlatpakInfo(const string& output, const string& appId);
-    vector<PackageInfo> parseFlatpakUpdate(const string& output);
     vector<pair<string, string>> parseFlatpakRemotes(const string& output);
 
     // Validation
     bool isValidAppId(const string& appId) const;
     bool isValidRemoteName(const string& name) const;
+    bool isValidBranch(const string& branch) const;
+    bool isValidPermission(const string& permission) const;
 
     // Check availability (cached)
     void checkAvailability() const;
 
     // Refresh remotes cache
     void refreshRemotesCache() const;
+
+    // Run an install/update/uninstall, reporting its progress between
+    // 0.1 and 0.95 as flatpak prints it; cancelled when progress asks to
+    CommandResult executeWithProgress(const vector<string>& args,
+                                      int timeoutSeconds,
+                                      ProgressCallback progress) const;
+
+    // Run `flatpak <args> id...` in one transaction, through pkexec
+    // for the system installation
+    CommandResult runBatch(vector<string> args,
+                           const vector<string>& appIds,
+                           Scope scope,
+                           int timeoutSeconds,
+                           ProgressCallback progress = nullptr) const;
 };
 
 } // namespace PolySynaptic
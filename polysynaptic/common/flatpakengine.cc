@@ -0,0 +1,867 @@
+/* flatpakengine.cc - In-process libflatpak engine implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "config.h"
+#include "flatpakengine.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#ifdef HAVE_LIBFLATPAK
+#include <flatpak.h>
+#include <gio/gio.h>
+#include <sys/stat.h>
+#include <cstring>
+#endif
+
+namespace PolySynaptic {
+
+#ifdef HAVE_LIBFLATPAK
+
+// ============================================================================
+// Appstream Catalog
+// ============================================================================
+
+namespace {
+
+struct AppstreamEntry {
+    std::string appId;
+    std::string name;
+    std::string summary;
+    std::string version;
+    std::string keywords;       // Space-separated <keyword>s
+    std::string categories;     // ';'-separated <category>s
+};
+
+struct AppstreamCatalog {
+    time_t mtime = 0;
+    std::vector<AppstreamEntry> entries;
+};
+
+// The apps listRemoteApps() found on one remote
+struct RemoteListing {
+    time_t mtime = 0;           // Of the catalog they were named from
+    std::vector<FlatpakRefInfo> refs;
+};
+
+// GMarkup state while walking appstream.xml
+struct AppstreamParseState {
+    std::vector<AppstreamEntry>* entries;
+    AppstreamEntry current;
+    bool inComponent = false;
+    int depth = 0;              // Depth inside the current <component>
+    std::string element;        // Direct child element being read
+    bool localized = false;     // Child carries xml:lang
+    std::string bundle;
+    std::string text;
+    std::string item;           // <keyword>/<category> inside that child
+    std::string itemText;
+};
+
+void appstreamStart(GMarkupParseContext*, const gchar* element,
+                    const gchar** attrNames, const gchar** attrValues,
+                    gpointer userData, GError**)
+{
+    auto* state = static_cast<AppstreamParseState*>(userData);
+
+    if (!state->inComponent) {
+        if (strcmp(element, "component") == 0) {
+            state->inComponent = true;
+            state->depth = 0;
+            state->current = AppstreamEntry();
+            state->bundle.clear();
+        }
+        return;
+    }
+
+    state->depth++;
+
+    if (state->depth == 1) {
+        state->element = element;
+        state->text.clear();
+        state->localized = false;
+        for (int i = 0; attrNames[i]; i++) {
+            if (strcmp(attrNames[i], "xml:lang") == 0) {
+                state->localized = true;
+            }
+        }
+    } else if (state->depth == 2 && !state->localized &&
+               ((state->element == "keywords" && strcmp(element, "keyword") == 0) ||
+                (state->element == "categories" && strcmp(element, "category") == 0))) {
+        state->item = element;
+        state->itemText.clear();
+        for (int i = 0; attrNames[i]; i++) {
+            if (strcmp(attrNames[i], "xml:lang") == 0) {
+                state->item.clear();    // Only the untranslated keywords
+            }
+        }
+    } else if (state->depth == 2 && strcmp(element, "release") == 0 &&
+               state->current.version.empty()) {
+        // First <release> is the newest one
+        for (int i = 0; attrNames[i]; i++) {
+            if (strcmp(attrNames[i], "version") == 0) {
+                state->current.version = attrValues[i];
+            }
+        }
+    }
+}
+
+void appstreamEnd(GMarkupParseContext*, const gchar* element,
+                  gpointer userData, GError**)
+{
+    auto* state = static_cast<AppstreamParseState*>(userData);
+    if (!state->inComponent) return;
+
+    if (state->depth == 0 && strcmp(element, "component") == 0) {
+        state->inComponent = false;
+
+        // Prefer the flatpak bundle ref (app/<id>/<arch>/<branch>)
+        if (state->bundle.compare(0, 4, "app/") == 0) {
+            size_t end = state->bundle.find('/', 4);
+            state->current.appId = state->bundle.substr(4, end - 4);
+        } else if (state->current.appId.size() > 8 &&
+                   state->current.appId.compare(
+                       state->current.appId.size() - 8, 8, ".desktop") == 0) {
+            state->current.appId.resize(state->current.appId.size() - 8);
+        }
+
+        if (!state->current.appId.empty()) {
+            state->entries->push_back(state->current);
+        }
+        return;
+    }
+
+    if (state->depth == 1 && !state->localized) {
+        if (state->element == "id") {
+            state->current.appId = state->text;
+        } else if (state->element == "name") {
+            state->current.name = state->text;
+        } else if (state->element == "summary") {
+            state->current.summary = state->text;
+        } else if (state->element == "bundle") {
+            state->bundle = state->text;
+        }
+    } else if (state->depth == 2 && !state->item.empty()) {
+        std::string& list = state->item == "keyword" ? state->current.keywords
+                                                     : state->current.categories;
+        if (!list.empty()) list += state->item == "keyword" ? " " : ";";
+        list += state->itemText;
+        state->item.clear();
+    }
+
+    state->depth--;
+}
+
+void appstreamText(GMarkupParseContext*, const gchar* text, gsize len,
+                   gpointer userData, GError**)
+{
+    auto* state = static_cast<AppstreamParseState*>(userData);
+    if (state->inComponent && state->depth == 1) {
+        state->text.append(text, len);
+    } else if (state->inComponent && state->depth == 2 && !state->item.empty()) {
+        state->itemText.append(text, len);
+    }
+}
+
+bool loadAppstream(const std::string& path, std::vector<AppstreamEntry>& entries,
+                   std::string& error)
+{
+    static const GMarkupParser parser = {
+        appstreamStart, appstreamEnd, appstreamText, nullptr, nullptr
+    };
+
+    GFile* file = g_file_new_for_path(path.c_str());
+    GError* gerror = nullptr;
+    GFileInputStream* raw = g_file_read(file, nullptr, &gerror);
+    g_object_unref(file);
+
+    if (!raw) {
+        error = gerror ? gerror->message : "cannot open " + path;
+        g_clear_error(&gerror);
+        return false;
+    }
+
+    GZlibDecompressor* gunzip = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+    GInputStream* stream = g_converter_input_stream_new(
+        G_INPUT_STREAM(raw), G_CONVERTER(gunzip));
+    g_object_unref(gunzip);
+    g_object_unref(raw);
+
+    AppstreamParseState state;
+    state.entries = &entries;
+
+    GMarkupParseContext* context = g_markup_parse_context_new(
+        &parser, G_MARKUP_PREFIX_ERROR_POSITION, &state, nullptr);
+
+    bool ok = true;
+    char buffer[65536];
+    gssize n;
+    while ((n = g_input_stream_read(stream, buffer, sizeof(buffer), nullptr, &gerror)) > 0) {
+        if (!g_markup_parse_context_parse(context, buffer, n, &gerror)) {
+            ok = false;
+            break;
+        }
+    }
+    if (n < 0) ok = false;
+    if (ok && !g_markup_parse_context_end_parse(context, &gerror)) ok = false;
+
+    if (!ok) {
+        error = gerror ? gerror->message : "cannot parse " + path;
+    }
+
+    g_clear_error(&gerror);
+    g_markup_parse_context_free(context);
+    g_object_unref(stream);
+    return ok;
+}
+
+std::string lowercase(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+std::string refString(FlatpakRef* ref)
+{
+    gchar* formatted = flatpak_ref_format_ref(ref);
+    std::string result = formatted ? formatted : "";
+    g_free(formatted);
+    return result;
+}
+
+const char* safe(const char* s)
+{
+    return s ? s : "";
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Private State
+// ============================================================================
+
+struct FlatpakEngine::Private {
+    FlatpakInstallation* user = nullptr;
+    FlatpakInstallation* system = nullptr;
+    std::string lastError;
+
+    // "<installation>:<remote>" -> parsed appstream
+    std::map<std::string, AppstreamCatalog> catalogs;
+    std::map<std::string, RemoteListing> listings;
+
+    ~Private() {
+        if (user) g_object_unref(user);
+        if (system) g_object_unref(system);
+    }
+
+    void open() {
+        GError* error = nullptr;
+        if (!user) {
+            user = flatpak_installation_new_user(nullptr, &error);
+            g_clear_error(&error);
+        }
+        if (!system) {
+            system = flatpak_installation_new_system(nullptr, &error);
+            g_clear_error(&error);
+        }
+        if (!user && !system) {
+            lastError = "Cannot open any Flatpak installation";
+        }
+    }
+
+    std::vector<std::pair<FlatpakInstallation*, bool>> installations() {
+        std::vector<std::pair<FlatpakInstallation*, bool>> result;
+        if (user) result.push_back({user, false});
+        if (system) result.push_back({system, true});
+        return result;
+    }
+
+    void setError(GError* error) {
+        if (error) lastError = error->message;
+    }
+
+    FlatpakRefInfo fromInstalled(FlatpakInstalledRef* installed, bool isSystem) {
+        FlatpakRef* ref = FLATPAK_REF(installed);
+        FlatpakRefInfo info;
+        info.appId = safe(flatpak_ref_get_name(ref));
+        info.arch = safe(flatpak_ref_get_arch(ref));
+        info.branch = safe(flatpak_ref_get_branch(ref));
+        info.ref = refString(ref);
+        info.origin = safe(flatpak_installed_ref_get_origin(installed));
+        info.name = safe(flatpak_installed_ref_get_appdata_name(installed));
+        info.summary = safe(flatpak_installed_ref_get_appdata_summary(installed));
+        info.version = safe(flatpak_installed_ref_get_appdata_version(installed));
+        info.installedSize = flatpak_installed_ref_get_installed_size(installed);
+        info.installed = true;
+        info.systemInstallation = isSystem;
+        if (info.name.empty()) info.name = info.appId;
+        return info;
+    }
+
+    const AppstreamCatalog* catalogFor(bool isSystem, FlatpakRemote* remote) {
+        GFile* dir = flatpak_remote_get_appstream_dir(remote, nullptr);
+        if (!dir) return nullptr;
+
+        gchar* dirPath = g_file_get_path(dir);
+        g_object_unref(dir);
+        if (!dirPath) return nullptr;
+
+        std::string path = std::string(dirPath) + "/appstream.xml.gz";
+        g_free(dirPath);
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return nullptr;     // Never fetched; nothing cached yet
+        }
+
+        std::string key = std::string(isSystem ? "system:" : "user:") +
+                          safe(flatpak_remote_get_name(remote));
+
+        auto it = catalogs.find(key);
+        if (it != catalogs.end() && it->second.mtime == st.st_mtime) {
+            return &it->second;
+        }
+
+        AppstreamCatalog catalog;
+        catalog.mtime = st.st_mtime;
+        std::string error;
+        if (!loadAppstream(path, catalog.entries, error)) {
+            lastError = error;
+            return nullptr;
+        }
+
+        catalogs[key] = std::move(catalog);
+        return &catalogs[key];
+    }
+};
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+FlatpakEngine::FlatpakEngine()
+    : d(new Private())
+{
+}
+
+FlatpakEngine::~FlatpakEngine()
+{
+}
+
+bool FlatpakEngine::isCompiledIn()
+{
+    return true;
+}
+
+bool FlatpakEngine::isAvailable()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    return d->user || d->system;
+}
+
+std::string FlatpakEngine::getVersion() const
+{
+    return std::to_string(FLATPAK_MAJOR_VERSION) + "." +
+           std::to_string(FLATPAK_MINOR_VERSION) + "." +
+           std::to_string(FLATPAK_MICRO_VERSION);
+}
+
+std::string FlatpakEngine::getLastError() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return d->lastError;
+}
+
+// ============================================================================
+// Installed Refs
+// ============================================================================
+
+bool FlatpakEngine::listInstalled(std::vector<FlatpakRefInfo>& refs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    refs.clear();
+
+    std::set<std::string> seen;
+    bool any = false;
+
+    // User installations shadow system ones with the same app ID
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* installed = flatpak_installation_list_installed_refs_by_kind(
+            inst.first, FLATPAK_REF_KIND_APP, nullptr, &error);
+        if (!installed) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        any = true;
+        for (guint i = 0; i < installed->len; i++) {
+            auto* ref = FLATPAK_INSTALLED_REF(g_ptr_array_index(installed, i));
+            FlatpakRefInfo info = d->fromInstalled(ref, inst.second);
+            if (seen.insert(info.appId).second) {
+                refs.push_back(info);
+            }
+        }
+        g_ptr_array_unref(installed);
+    }
+
+    return any;
+}
+
+bool FlatpakEngine::findInstalled(const std::string& appId, FlatpakRefInfo& ref)
+{
+    std::vector<FlatpakRefInfo> refs;
+    if (!listInstalled(refs)) return false;
+
+    for (const auto& info : refs) {
+        if (info.appId == appId) {
+            ref = info;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FlatpakEngine::listUpdates(std::vector<FlatpakRefInfo>& refs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    refs.clear();
+
+    std::set<std::string> seen;
+    bool any = false;
+
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* updates = flatpak_installation_list_installed_refs_for_update(
+            inst.first, nullptr, &error);
+        if (!updates) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        any = true;
+        for (guint i = 0; i < updates->len; i++) {
+            auto* ref = FLATPAK_INSTALLED_REF(g_ptr_array_index(updates, i));
+            if (flatpak_ref_get_kind(FLATPAK_REF(ref)) != FLATPAK_REF_KIND_APP) {
+                continue;
+            }
+            FlatpakRefInfo info = d->fromInstalled(ref, inst.second);
+            if (seen.insert(info.appId).second) {
+                refs.push_back(info);
+            }
+        }
+        g_ptr_array_unref(updates);
+    }
+
+    return any;
+}
+
+bool FlatpakEngine::listUnused(std::vector<FlatpakRefInfo>& refs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    refs.clear();
+
+    bool any = false;
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* unused = flatpak_installation_list_unused_refs(
+            inst.first, nullptr, nullptr, &error);
+        if (!unused) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        any = true;
+        for (guint i = 0; i < unused->len; i++) {
+            auto* ref = FLATPAK_INSTALLED_REF(g_ptr_array_index(unused, i));
+            refs.push_back(d->fromInstalled(ref, inst.second));
+        }
+        g_ptr_array_unref(unused);
+    }
+
+    return any;
+}
+
+// ============================================================================
+// Remotes & Appstream
+// ============================================================================
+
+std::vector<std::string> FlatpakEngine::listRemotes()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+
+    std::vector<std::string> names;
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* remotes = flatpak_installation_list_remotes(inst.first, nullptr, &error);
+        if (!remotes) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        for (guint i = 0; i < remotes->len; i++) {
+            auto* remote = FLATPAK_REMOTE(g_ptr_array_index(remotes, i));
+            if (flatpak_remote_get_disabled(remote)) continue;
+            std::string name = safe(flatpak_remote_get_name(remote));
+            if (find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
+            }
+        }
+        g_ptr_array_unref(remotes);
+    }
+
+    return names;
+}
+
+std::string FlatpakEngine::getAppstreamStamp()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+
+    std::string stamp;
+    for (auto& inst : d->installations()) {
+        GPtrArray* remotes = flatpak_installation_list_remotes(inst.first, nullptr, nullptr);
+        if (!remotes) continue;
+
+        for (guint r = 0; r < remotes->len; r++) {
+            auto* remote = FLATPAK_REMOTE(g_ptr_array_index(remotes, r));
+            if (flatpak_remote_get_disabled(remote)) continue;
+
+            GFile* dir = flatpak_remote_get_appstream_dir(remote, nullptr);
+            gchar* dirPath = dir ? g_file_get_path(dir) : nullptr;
+            if (dir) g_object_unref(dir);
+            if (!dirPath) continue;
+
+            std::string path = std::string(dirPath) + "/appstream.xml.gz";
+            g_free(dirPath);
+
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0) {
+                if (!stamp.empty()) stamp += ";";
+                stamp += path + "@" + std::to_string(st.st_mtime);
+            }
+        }
+        g_ptr_array_unref(remotes);
+    }
+
+    return stamp;
+}
+
+bool FlatpakEngine::updateAppstream(const std::string& remote, bool& changed)
+{
+    changed = false;
+
+    // Not the shared installations: the fetch may take a while
+    FlatpakInstallation* opened[] = {
+        flatpak_installation_new_user(nullptr, nullptr),
+        flatpak_installation_new_system(nullptr, nullptr)
+    };
+
+    bool any = false;
+    std::string lastError;
+    for (FlatpakInstallation* inst : opened) {
+        if (!inst) continue;
+
+        FlatpakRemote* found = flatpak_installation_get_remote_by_name(
+            inst, remote.c_str(), nullptr, nullptr);
+        bool enabled = found && !flatpak_remote_get_disabled(found);
+        if (found) g_object_unref(found);
+
+        // libflatpak compares the remote's summary with what it has
+        // and pulls the appstream branch only if that moved
+        if (enabled) {
+            GError* error = nullptr;
+            gboolean moved = FALSE;
+            if (flatpak_installation_update_appstream_full_sync(
+                    inst, remote.c_str(), nullptr, nullptr, nullptr,
+                    &moved, nullptr, &error)) {
+                any = true;
+                changed = changed || moved;
+            } else if (error) {
+                lastError = error->message;
+            }
+            g_clear_error(&error);
+        }
+        g_object_unref(inst);
+    }
+
+    if (!any && !lastError.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        d->lastError = lastError;
+    }
+    return any;
+}
+
+bool FlatpakEngine::listRemoteApps(std::vector<FlatpakRefInfo>& refs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    refs.clear();
+
+    std::set<std::string> seen;
+    bool any = false;
+
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* remotes = flatpak_installation_list_remotes(inst.first, nullptr, &error);
+        if (!remotes) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        for (guint r = 0; r < remotes->len; r++) {
+            auto* remote = FLATPAK_REMOTE(g_ptr_array_index(remotes, r));
+            if (flatpak_remote_get_disabled(remote) ||
+                flatpak_remote_get_noenumerate(remote)) {
+                continue;
+            }
+
+            const char* remoteName = flatpak_remote_get_name(remote);
+            const AppstreamCatalog* catalog = d->catalogFor(inst.second, remote);
+
+            // A remote whose appstream stayed as it was lists the same
+            std::string key = std::string(inst.second ? "system:" : "user:") +
+                              safe(remoteName);
+            auto listed = d->listings.find(key);
+            if (catalog && listed != d->listings.end() &&
+                listed->second.mtime == catalog->mtime) {
+                any = true;
+                for (const auto& info : listed->second.refs) {
+                    if (seen.insert(info.appId + "/" + info.origin).second) {
+                        refs.push_back(info);
+                    }
+                }
+                continue;
+            }
+
+            GPtrArray* remoteRefs = flatpak_installation_list_remote_refs_sync_full(
+                inst.first, remoteName, FLATPAK_QUERY_FLAGS_ONLY_CACHED,
+                nullptr, &error);
+            if (!remoteRefs) {
+                d->setError(error);
+                g_clear_error(&error);
+                continue;
+            }
+
+            // Names and summaries come from the cached appstream data
+            std::map<std::string, const AppstreamEntry*> byId;
+            if (catalog) {
+                for (const auto& entry : catalog->entries) {
+                    byId[entry.appId] = &entry;
+                }
+            }
+
+            RemoteListing listing;
+            any = true;
+            for (guint i = 0; i < remoteRefs->len; i++) {
+                auto* remoteRef = FLATPAK_REMOTE_REF(g_ptr_array_index(remoteRefs, i));
+                FlatpakRef* ref = FLATPAK_REF(remoteRef);
+                if (flatpak_ref_get_kind(ref) != FLATPAK_REF_KIND_APP) continue;
+
+                FlatpakRefInfo info;
+                info.appId = safe(flatpak_ref_get_name(ref));
+                info.arch = safe(flatpak_ref_get_arch(ref));
+                info.branch = safe(flatpak_ref_get_branch(ref));
+                info.ref = refString(ref);
+                info.origin = safe(remoteName);
+                info.downloadSize = flatpak_remote_ref_get_download_size(remoteRef);
+                info.installedSize = flatpak_remote_ref_get_installed_size(remoteRef);
+                info.systemInstallation = inst.second;
+
+                if (info.arch != flatpak_get_default_arch()) continue;
+
+                auto it = byId.find(info.appId);
+                if (it != byId.end()) {
+                    info.name = it->second->name;
+                    info.summary = it->second->summary;
+                    info.version = it->second->version;
+                    info.keywords = it->second->keywords;
+                    info.categories = it->second->categories;
+                }
+                if (info.name.empty()) info.name = info.appId;
+
+                listing.refs.push_back(info);
+                if (seen.insert(info.appId + "/" + info.origin).second) {
+                    refs.push_back(info);
+                }
+            }
+            g_ptr_array_unref(remoteRefs);
+
+            if (catalog) {
+                listing.mtime = catalog->mtime;
+                d->listings[key] = std::move(listing);
+            }
+        }
+        g_ptr_array_unref(remotes);
+    }
+
+    return any;
+}
+
+bool FlatpakEngine::search(const std::string& query,
+                           std::vector<FlatpakRefInfo>& refs,
+                           size_t maxResults)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    d->open();
+    refs.clear();
+
+    std::string needle = lowercase(query);
+    std::set<std::string> seen;
+    bool any = false;
+
+    for (auto& inst : d->installations()) {
+        GError* error = nullptr;
+        GPtrArray* remotes = flatpak_installation_list_remotes(inst.first, nullptr, &error);
+        if (!remotes) {
+            d->setError(error);
+            g_clear_error(&error);
+            continue;
+        }
+
+        for (guint r = 0; r < remotes->len; r++) {
+            auto* remote = FLATPAK_REMOTE(g_ptr_array_index(remotes, r));
+            if (flatpak_remote_get_disabled(remote)) continue;
+
+            const AppstreamCatalog* catalog = d->catalogFor(inst.second, remote);
+            if (!catalog) continue;
+
+            any = true;
+            std::string remoteName = safe(flatpak_remote_get_name(remote));
+
+            for (const auto& entry : catalog->entries) {
+                if (lowercase(entry.appId).find(needle) == std::string::npos &&
+                    lowercase(entry.name).find(needle) == std::string::npos &&
+                    lowercase(entry.summary).find(needle) == std::string::npos) {
+                    continue;
+                }
+                if (!seen.insert(entry.appId).second) continue;
+
+                FlatpakRefInfo info;
+                info.appId = entry.appId;
+                info.name = entry.name.empty() ? entry.appId : entry.name;
+                info.summary = entry.summary;
+                info.version = entry.version;
+                info.origin = remoteName;
+                info.systemInstallation = inst.second;
+                refs.push_back(info);
+
+                if (maxResults > 0 && refs.size() >= maxResults) {
+                    g_ptr_array_unref(remotes);
+                    return true;
+                }
+            }
+        }
+        g_ptr_array_unref(remotes);
+    }
+
+    return any;
+}
+
+#else // !HAVE_LIBFLATPAK
+
+// ============================================================================
+// Stub Engine (built without libflatpak)
+// ============================================================================
+
+struct FlatpakEngine::Private {
+};
+
+FlatpakEngine::FlatpakEngine()
+    : d(new Private())
+{
+}
+
+FlatpakEngine::~FlatpakEngine()
+{
+}
+
+bool FlatpakEngine::isCompiledIn()
+{
+    return false;
+}
+
+bool FlatpakEngine::isAvailable()
+{
+    return false;
+}
+
+std::string FlatpakEngine::getVersion() const
+{
+    return "";
+}
+
+std::string FlatpakEngine::getLastError() const
+{
+    return "PolySynaptic was built without libflatpak";
+}
+
+bool FlatpakEngine::listInstalled(std::vector<FlatpakRefInfo>&)
+{
+    return false;
+}
+
+bool FlatpakEngine::findInstalled(const std::string&, FlatpakRefInfo&)
+{
+    return false;
+}
+
+bool FlatpakEngine::listUpdates(std::vector<FlatpakRefInfo>&)
+{
+    return false;
+}
+
+bool FlatpakEngine::listUnused(std::vector<FlatpakRefInfo>&)
+{
+    return false;
+}
+
+std::string FlatpakEngine::getAppstreamStamp()
+{
+    return "";
+}
+
+bool FlatpakEngine::updateAppstream(const std::string&, bool& changed)
+{
+    changed = false;
+    return false;
+}
+
+bool FlatpakEngine::listRemoteApps(std::vector<FlatpakRefInfo>&)
+{
+    return false;
+}
+
+bool FlatpakEngine::search(const std::string&, std::vector<FlatpakRefInfo>&, size_t)
+{
+    return false;
+}
+
+std::vector<std::string> FlatpakEngine::listRemotes()
+{
+    return {};
+}
+
+#endif // HAVE_LIBFLATPAK
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,160 @@
+/* flatpakengine.h - In-process libflatpak engine for PolySynaptic
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements read-only Flatpak queries on top of libflatpak,
+ * so that listing installed refs, browsing remotes and searching the
+ * appstream catalog do not have to spawn the flatpak CLI.
+ *
+ * The engine is only functional when PolySynaptic is built with
+ * HAVE_LIBFLATPAK. Otherwise every query reports failure and callers
+ * fall back to the CLI path.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _FLATPAKENGINE_H_
+#define _FLATPAKENGINE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Flatpak Ref Record
+// ============================================================================
+
+/**
+ * FlatpakRefInfo - An installed or remote application ref
+ *
+ * Neutral record that FlatpakBackend (PackageInfo) and FlatpakProvider
+ * (UnifiedPackage) convert from.
+ */
+struct FlatpakRefInfo {
+    std::string appId;          // e.g. org.gnome.Calculator
+    std::string name;           // Display name from appstream
+    std::string summary;
+    std::string version;
+    std::string branch;
+    std::string arch;
+    std::string origin;         // Remote name
+    std::string ref;            // Full ref: app/<id>/<arch>/<branch>
+    std::string runtimeRef;
+    std::string keywords;       // Space-separated appstream keywords
+    std::string categories;     // ';'-separated appstream categories
+    uint64_t installedSize = 0;
+    uint64_t downloadSize = 0;
+    bool installed = false;
+    bool systemInstallation = false;
+};
+
+// ============================================================================
+// libflatpak Engine
+// ============================================================================
+
+/**
+ * FlatpakEngine - Flatpak queries through libflatpak
+ *
+ * Installed refs and pending updates come from the user and system
+ * FlatpakInstallation objects. Remote browsing and search only use
+ * the locally cached remote summaries and appstream data, so they
+ * never touch the network; the cache is refreshed per remote by
+ * updateAppstream() (see FlatpakBackend::refreshCache).
+ *
+ * Parsed appstream catalogs, and the apps listed from them, are kept
+ * in memory per remote and redone only when that remote's appstream
+ * file on disk changes.
+ *
+ * Thread Safety:
+ *   All methods are serialized by an internal lock.
+ */
+class FlatpakEngine {
+public:
+    FlatpakEngine();
+    ~FlatpakEngine();
+
+    FlatpakEngine(const FlatpakEngine&) = delete;
+    FlatpakEngine& operator=(const FlatpakEngine&) = delete;
+
+    /**
+     * Whether this build links libflatpak
+     */
+    static bool isCompiledIn();
+
+    /**
+     * Whether at least one installation could be opened
+     */
+    bool isAvailable();
+
+    /**
+     * libflatpak version this build was compiled against
+     */
+    std::string getVersion() const;
+
+    bool listInstalled(std::vector<FlatpakRefInfo>& refs);
+    bool findInstalled(const std::string& appId, FlatpakRefInfo& ref);
+    bool listUpdates(std::vector<FlatpakRefInfo>& refs);
+
+    /**
+     * Runtimes and extensions no installed app needs any more, as
+     * `flatpak uninstall --unused` would remove them
+     */
+    bool listUnused(std::vector<FlatpakRefInfo>& refs);
+
+    /**
+     * "<path>@<mtime>" of the cached appstream file of every enabled
+     * remote; changes whenever listRemoteApps() may return new data
+     */
+    std::string getAppstreamStamp();
+
+    /**
+     * Fetch a remote's appstream data into every installation that has
+     * it enabled, unless the remote's summary says it is the one
+     * fetched last
+     *
+     * Goes to the network, on installations of its own so that
+     * queries are not held up meanwhile.
+     *
+     * @param changed Set if new appstream data was deployed
+     * @return false if no installation could update it
+     */
+    bool updateAppstream(const std::string& remote, bool& changed);
+
+    /**
+     * List applications on all enabled remotes from the local cache
+     */
+    bool listRemoteApps(std::vector<FlatpakRefInfo>& refs);
+
+    /**
+     * Case-insensitive match on app ID, name and summary against the
+     * cached appstream catalogs of all enabled remotes
+     */
+    bool search(const std::string& query,
+                std::vector<FlatpakRefInfo>& refs,
+                size_t maxResults = 0);
+
+    /**
+     * Names of enabled remotes across user and system installations
+     */
+    std::vector<std::string> listRemotes();
+
+    std::string getLastError() const;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> d;
+    mutable std::mutex _mutex;
+};
+
+} // namespace PolySynaptic
+
+#endif // _FLATPAKENGINE_H_
+
+// vim:ts=4:sw=4:et
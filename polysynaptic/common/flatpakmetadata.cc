@@ -0,0 +1,303 @@
+/* flatpakmetadata.cc - Permissions of installed Flatpak apps, read in bulk
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "flatpakmetadata.h"
+#include "flatpakbackend.h"
+#include "rparallel.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+// Keyfiles are a few hundred bytes; below this many a thread costs more
+const unsigned MIN_PER_THREAD = 32;
+
+vector<string> entries(const string& dir)
+{
+    vector<string> names;
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return names;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(d);
+    return names;
+}
+
+string linkTarget(const string& path)
+{
+    char target[512];
+    ssize_t length = readlink(path.c_str(), target, sizeof(target) - 1);
+    if (length <= 0) {
+        return "";
+    }
+    return string(target, length);
+}
+
+vector<string> splitList(const string& value)
+{
+    vector<string> items;
+    istringstream in(value);
+    string item;
+    while (getline(in, item, ';')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void grant(FlatpakAppMetadata& meta, const string& key, const string& item)
+{
+    PackagePermissions& p = meta.permissions;
+
+    // "!x" revokes what the runtime or an override grants
+    if (item[0] == '!') {
+        return;
+    }
+
+    if (key == "shared") {
+        if (item == "network") p.hasNetworkAccess = true;
+    } else if (key == "sockets") {
+        if (item == "x11" || item == "fallback-x11" || item == "wayland") {
+            p.hasDisplayAccess = true;
+        } else if (item == "pulseaudio") {
+            p.hasAudioAccess = true;
+        } else if (item == "session-bus") {
+            p.hasSessionBusAccess = true;
+        } else if (item == "system-bus") {
+            p.hasSystemBusAccess = true;
+        } else {
+            p.customPermissions.push_back("Socket: " + item);
+        }
+    } else if (key == "devices") {
+        if (item == "dri") {
+            p.hasGpuAccess = true;
+        } else if (item == "all") {
+            p.hasDeviceAccess = true;
+        } else if (item == "usb") {
+            p.hasUsbAccess = true;
+        } else {
+            p.customPermissions.push_back("Device: " + item);
+        }
+    } else if (key == "features") {
+        if (item == "bluetooth") {
+            p.hasBluetoothAccess = true;
+        } else {
+            p.customPermissions.push_back("Feature: " + item);
+        }
+    } else if (key == "filesystems") {
+        // Access modes (":ro", ":create") do not change the answer
+        string path = item.substr(0, item.find(':'));
+        if (path == "home" || path == "~") {
+            p.hasHomeAccess = true;
+        } else if (path == "host") {
+            p.hasFileSystemAccess = true;
+            p.hasHomeAccess = true;
+            meta.escapesSandbox = true;
+        } else if (path.compare(0, 4, "host") == 0) {
+            p.hasFileSystemAccess = true;
+        } else {
+            p.customPermissions.push_back("Files: " + path);
+        }
+    }
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// FlatpakMetadataIndex
+// ============================================================================
+
+constexpr std::chrono::milliseconds FlatpakMetadataIndex::TTL;
+
+static vector<string> watchedPaths(const vector<string>& installations)
+{
+    vector<string> paths;
+    for (const auto& installation : installations) {
+        paths.push_back(installation + "/app/");
+    }
+    return paths;
+}
+
+FlatpakMetadataIndex::FlatpakMetadataIndex(const vector<string>& installations,
+                                           size_t userCount)
+    : _installations(installations)
+    , _userCount(userCount)
+    , _fresh(watchedPaths(installations), TTL)
+{
+}
+
+FlatpakMetadataIndex& FlatpakMetadataIndex::shared()
+{
+    static FlatpakMetadataIndex index(
+        {FlatpakBackend::installationPath(FlatpakBackend::Scope::USER),
+         FlatpakBackend::installationPath(FlatpakBackend::Scope::SYSTEM)}, 1);
+    return index;
+}
+
+bool FlatpakMetadataIndex::parse(const string& keyfile, FlatpakAppMetadata& meta)
+{
+    istringstream in(keyfile);
+    string line;
+    string group;
+    bool application = false;
+
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') {
+            group = line.substr(1, line.find(']') - 1);
+            application = application || group == "Application";
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == string::npos) {
+            continue;
+        }
+        string key = line.substr(0, equals);
+        string value = line.substr(equals + 1);
+
+        if (group == "Application") {
+            if (key == "name" && meta.appId.empty()) meta.appId = value;
+            else if (key == "runtime") meta.runtime = value;
+            else if (key == "sdk") meta.sdk = value;
+        } else if (group == "Context") {
+            for (const auto& item : splitList(value)) {
+                grant(meta, key, item);
+            }
+        } else if (group == "Session Bus Policy" || group == "System Bus Policy") {
+            // org.freedesktop.Flatpak runs commands on the host
+            if (key == "org.freedesktop.Flatpak" && value == "talk") {
+                meta.escapesSandbox = true;
+                meta.permissions.customPermissions.push_back("Host commands");
+            }
+        }
+    }
+    return application;
+}
+
+void FlatpakMetadataIndex::refreshLocked()
+{
+    struct Deploy {
+        FlatpakAppMetadata meta;
+        string path;
+        string key;                     // Checksum in its installation
+        shared_ptr<const FlatpakAppMetadata> known;
+    };
+    vector<Deploy> deploys;
+
+    for (size_t i = 0; i < _installations.size(); i++) {
+        string apps = _installations[i] + "/app";
+        for (const auto& id : entries(apps)) {
+            for (const auto& arch : entries(apps + "/" + id)) {
+                if (arch == "current") continue;
+                for (const auto& branch : entries(apps + "/" + id + "/" + arch)) {
+                    string dir = apps + "/" + id + "/" + arch + "/" + branch;
+                    string checksum = linkTarget(dir + "/active");
+                    if (checksum.empty()) continue;
+
+                    Deploy deploy;
+                    deploy.meta.appId = id;
+                    deploy.meta.arch = arch;
+                    deploy.meta.branch = branch;
+                    deploy.meta.checksum = checksum;
+                    deploy.meta.userInstallation = i < _userCount;
+                    deploy.path = dir + "/active/metadata";
+                    deploy.key = checksum + "@" + _installations[i];
+                    auto known = _byChecksum.find(deploy.key);
+                    if (known != _byChecksum.end()) {
+                        deploy.known = known->second;
+                    }
+                    deploys.push_back(deploy);
+                }
+            }
+        }
+    }
+
+    // The new deploys only, a share of them per thread
+    vector<size_t> pending;
+    for (size_t i = 0; i < deploys.size(); i++) {
+        if (!deploys[i].known) pending.push_back(i);
+    }
+    RParallelFor(RParallelChunks(pending.size(), MIN_PER_THREAD), pending.size(),
+                 [&deploys, &pending](unsigned, unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            Deploy& deploy = deploys[pending[i]];
+            ifstream file(deploy.path.c_str());
+            if (!file) continue;
+            ostringstream text;
+            text << file.rdbuf();
+            FlatpakAppMetadata meta = deploy.meta;
+            if (parse(text.str(), meta)) {
+                deploy.known = make_shared<const FlatpakAppMetadata>(meta);
+            }
+        }
+    });
+    _parsed += pending.size();
+
+    // Deploys that are gone are dropped from the cache with them
+    _apps.clear();
+    _byChecksum.clear();
+    for (const auto& deploy : deploys) {
+        if (deploy.known) {
+            _apps.push_back(deploy.known);
+            _byChecksum[deploy.key] = deploy.known;
+        }
+    }
+}
+
+shared_ptr<const FlatpakAppMetadata> FlatpakMetadataIndex::find(const string& appId,
+                                                                const string& branch)
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!_fresh.isFresh()) {
+        refreshLocked();
+        _fresh.markFresh();
+    }
+    for (const auto& app : _apps) {
+        if (app->appId == appId && (branch.empty() || app->branch == branch)) {
+            return app;
+        }
+    }
+    return nullptr;
+}
+
+vector<shared_ptr<const FlatpakAppMetadata>> FlatpakMetadataIndex::apps()
+{
+    lock_guard<mutex> lock(_mutex);
+    if (!_fresh.isFresh()) {
+        refreshLocked();
+        _fresh.markFresh();
+    }
+    return _apps;
+}
+
+uint64_t FlatpakMetadataIndex::parsedCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _parsed;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
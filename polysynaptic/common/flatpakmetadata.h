@@ -0,0 +1,120 @@
+/* flatpakmetadata.h - Permissions of installed Flatpak apps, read in bulk
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the permission data behind the Flatpak trust
+ * badges and ranking. Every deployed app has its metadata keyfile at
+ * <installation>/app/<id>/<arch>/<branch>/active/metadata, "active"
+ * linking to the deploy's checksum. One scan of the user and system
+ * installations finds them all; the keyfiles are parsed on several
+ * threads, and kept by checksum so a rescan only parses the deploys
+ * that changed. It replaces one `flatpak info --show-permissions` per
+ * app.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _FLATPAKMETADATA_H_
+#define _FLATPAKMETADATA_H_
+
+#include "packagesourceprovider.h"
+#include "probecache.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * FlatpakAppMetadata - What one deployed app's metadata says
+ */
+struct FlatpakAppMetadata {
+    string appId;
+    string arch;
+    string branch;
+    string checksum;                    // Of the deploy
+    bool userInstallation = false;
+
+    string runtime;                     // [Application] runtime=
+    string sdk;
+
+    PackagePermissions permissions;
+
+    // Host filesystem or org.freedesktop.Flatpak: the sandbox does not
+    // hold the app in
+    bool escapesSandbox = false;
+};
+
+/**
+ * FlatpakMetadataIndex - Deployed apps of the installations, by app id
+ *
+ * Scanned on first use and again once the TTL is over or an app
+ * directory changed; invalidate() after installs and removals forces it.
+ *
+ * Thread Safety:
+ *   All methods are thread-safe.
+ */
+class FlatpakMetadataIndex {
+public:
+    // Updates deploy a new checksum without touching app/; they are
+    // seen this much later at most
+    static constexpr std::chrono::milliseconds TTL{30000};
+
+    /**
+     * Over installation directories in the order they take precedence,
+     * flagging the userCount first ones as user installations
+     */
+    FlatpakMetadataIndex(const vector<string>& installations, size_t userCount);
+
+    /**
+     * The user installation, then the system one, as the flatpak CLI
+     * finds them
+     */
+    static FlatpakMetadataIndex& shared();
+
+    /**
+     * The deploy of appId on branch (any branch if ""), from the first
+     * installation that has it; null if none does
+     */
+    shared_ptr<const FlatpakAppMetadata> find(const string& appId,
+                                              const string& branch = "");
+
+    vector<shared_ptr<const FlatpakAppMetadata>> apps();
+
+    void invalidate() { _fresh.invalidate(); }
+
+    // Keyfiles parsed so far; a rescan of unchanged deploys adds none
+    uint64_t parsedCount() const;
+
+    /**
+     * Fill meta from a metadata keyfile: [Application], [Context] and
+     * the bus policies. False if it is not an application's.
+     */
+    static bool parse(const string& keyfile, FlatpakAppMetadata& meta);
+
+private:
+    vector<string> _installations;
+    size_t _userCount;
+    ProbeCache _fresh;
+
+    mutable mutex _mutex;               // Guards the three below
+    vector<shared_ptr<const FlatpakAppMetadata>> _apps;
+    map<string, shared_ptr<const FlatpakAppMetadata>> _byChecksum;   // checksum@installation
+    uint64_t _parsed = 0;
+
+    void refreshLocked();
+};
+
+} // namespace PolySynaptic
+
+#endif // _FLATPAKMETADATA_H_
+
+// vim:ts=4:sw=4:et
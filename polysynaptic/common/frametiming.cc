@@ -0,0 +1,105 @@
+/* frametiming.cc - How long the package views take to show a change
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "frametiming.h"
+#include "latency.h"
+#include "metrics.h"
+
+namespace PolySynaptic {
+
+// ============================================================================
+// FrameTiming
+// ============================================================================
+
+FrameTiming& FrameTiming::instance()
+{
+    static FrameTiming timing;
+    return timing;
+}
+
+void FrameTiming::modelChanged(const string& operation, int64_t nowMicros)
+{
+    if (_pending.empty()) {
+        _pending = operation;
+        _pendingSince = nowMicros;
+    }
+}
+
+void FrameTiming::frameCompleted(int64_t frameStartMicros, int64_t paintEndMicros,
+                                 int64_t refreshMicros)
+{
+    LatencyRegistry& latencies = LatencyRegistry::instance();
+    int64_t refresh = refreshMicros > 0 ? refreshMicros : DEFAULT_REFRESH_MICROS;
+    int64_t paint = paintEndMicros > frameStartMicros ? paintEndMicros - frameStartMicros : 0;
+
+    _frames++;
+    _lastFrameMs = paint / 1000.0;
+    latencies.histogram("Frames", "paint").record(static_cast<uint64_t>(paint));
+
+    if (!_operation.empty() && frameStartMicros > _operationUntil) {
+        _operation.clear();
+    }
+
+    if (!_pending.empty()) {
+        // The change is on screen now; anything past the first refresh
+        // is a frame the user did not get
+        int64_t shown = paintEndMicros > _pendingSince ? paintEndMicros - _pendingSince : 0;
+        latencies.histogram("Frames", _pending).record(static_cast<uint64_t>(shown));
+        if (shown > 0) {
+            dropped(_pending, (shown - 1) / refresh);
+        }
+        _operation = _pending;
+        _operationUntil = paintEndMicros + ATTRIBUTION_MICROS;
+        _pending.clear();
+    } else if (!_operation.empty() && _lastFrameStart > 0) {
+        // Row validation and scrolling keep frames coming for a while;
+        // a gap between them is a frame missed. Outside that window a
+        // gap only means nothing wanted painting.
+        int64_t gap = frameStartMicros - _lastFrameStart;
+        if (gap > refresh * 3 / 2) {
+            dropped(_operation, (gap + refresh / 2) / refresh - 1);
+        }
+    }
+
+    if (!_operation.empty()) {
+        latencies.histogram("Frames", _operation + " paint")
+            .record(static_cast<uint64_t>(paint));
+    }
+    _lastFrameStart = frameStartMicros;
+}
+
+void FrameTiming::dropped(const string& operation, uint64_t frames)
+{
+    if (frames == 0) {
+        return;
+    }
+    _dropped += frames;
+    MetricsRegistry::instance()
+        .counter("polysynaptic_ui_dropped_frames",
+                 "Frames the main window missed while showing a change",
+                 {{"operation", operation}})
+        .inc(frames);
+}
+
+void FrameTiming::reset()
+{
+    _pending.clear();
+    _pendingSince = 0;
+    _operation.clear();
+    _operationUntil = 0;
+    _lastFrameStart = 0;
+    _frames = 0;
+    _dropped = 0;
+    _lastFrameMs = 0;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,100 @@
+/* frametiming.h - How long the package views take to show a change
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the account behind the UI render time. The main
+ * window's frame clock reports every frame it paints; the views report
+ * when their model changes and why (search results, a filter, a sort).
+ * Each change is timed to the end of the next frame, and the frames
+ * shortly after it are attributed to it, so a change to GtkPkgList or
+ * RGUnifiedPkgList shows up in the "Frames" latency histograms:
+ *
+ *   Frames / paint           every frame, from its start to painted
+ *   Frames / <op>            the change to the end of the next frame
+ *   Frames / <op> paint      the frames attributed to the change
+ *
+ * Frames the display could have shown in the meantime are counted as
+ * dropped, per operation, in the metrics.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _FRAMETIMING_H_
+#define _FRAMETIMING_H_
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * FrameTiming - Frames of the main window and the changes they show
+ *
+ * Times are the monotonic clock in microseconds, as the frame clock
+ * gives them; the account never reads a clock itself.
+ *
+ * Thread Safety:
+ *   Main thread only, like the frame clock it listens to.
+ */
+class FrameTiming {
+public:
+    // Frames this long after the first frame of a change belong to it
+    static const int64_t ATTRIBUTION_MICROS = 250000;
+
+    // When the frame clock does not know the display's
+    static const int64_t DEFAULT_REFRESH_MICROS = 16667;
+
+    static FrameTiming& instance();
+
+    /**
+     * The model behind a view changed for operation; the next frame is
+     * timed from now. A change before that frame keeps the first one,
+     * which is what the user is waiting to see.
+     */
+    void modelChanged(const string& operation, int64_t nowMicros);
+
+    /**
+     * A frame that started at frameStartMicros finished painting at
+     * paintEndMicros, on a display refreshing every refreshMicros
+     */
+    void frameCompleted(int64_t frameStartMicros, int64_t paintEndMicros,
+                        int64_t refreshMicros = 0);
+
+    uint64_t frames() const { return _frames; }
+    uint64_t droppedFrames() const { return _dropped; }
+    double lastFrameMs() const { return _lastFrameMs; }
+
+    // The change the frames are attributed to now, "" for none
+    const string& currentOperation() const { return _operation; }
+    bool changePending() const { return !_pending.empty(); }
+
+    void reset();
+
+private:
+    FrameTiming() = default;
+    FrameTiming(const FrameTiming&) = delete;
+    FrameTiming& operator=(const FrameTiming&) = delete;
+
+    void dropped(const string& operation, uint64_t frames);
+
+    string _pending;                    // Changed, not painted yet
+    int64_t _pendingSince = 0;
+    string _operation;                  // Attributed until _operationUntil
+    int64_t _operationUntil = 0;
+    int64_t _lastFrameStart = 0;
+
+    uint64_t _frames = 0;
+    uint64_t _dropped = 0;
+    double _lastFrameMs = 0;
+};
+
+} // namespace PolySynaptic
+
+#endif // _FRAMETIMING_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,217 @@
+/* fuzzyindex.cc - Package names within a typo or two of a query
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "fuzzyindex.h"
+#include "packageranking.h"
+
+#include <algorithm>
+
+namespace PolySynaptic {
+
+namespace {
+
+// Edits allowed for a query of this many characters
+int allowedEdits(size_t length)
+{
+    int most = FuzzyIndex::MAX_DISTANCE;
+    return length <= 4 ? 1 : most;
+}
+
+} // anonymous namespace
+
+string FuzzyIndex::normalize(const string& name)
+{
+    return DuplicateDetector::normalizeName(name);
+}
+
+uint32_t FuzzyIndex::hash(const string& s)
+{
+    // FNV-1a; a collision only adds a name to compare
+    uint32_t h = 2166136261u;
+    for (unsigned char c : s) {
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+void FuzzyIndex::deletions(const string& word, int edits, vector<string>& out)
+{
+    out.clear();
+    out.push_back(word);
+    size_t begin = 0;
+    for (int e = 0; e < edits; e++) {
+        size_t end = out.size();
+        for (size_t i = begin; i < end; i++) {
+            for (size_t at = 0; at < out[i].size(); at++) {
+                string shorter = out[i];
+                shorter.erase(at, 1);
+                out.push_back(std::move(shorter));
+            }
+        }
+        begin = end;
+    }
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+void FuzzyIndex::addName(const string& name, BackendType backend, const string& id)
+{
+    if (name.empty()) {
+        return;
+    }
+    auto it = _byName.emplace(name, static_cast<uint32_t>(_names.size()));
+    if (it.second) {
+        _names.push_back(name);
+        _owners.emplace_back();
+    }
+    vector<Owner>& owners = _owners[it.first->second];
+    for (const auto& owner : owners) {
+        if (owner.backend == backend && owner.id == id) return;
+    }
+    owners.push_back({backend, id});
+}
+
+void FuzzyIndex::add(BackendType backend, const string& id, const string& name)
+{
+    addName(normalize(name), backend, id);
+    size_t dot = id.rfind('.');
+    if (dot != string::npos && dot + 1 < id.size()) {
+        addName(normalize(id.substr(dot + 1)), backend, id);
+    }
+}
+
+void FuzzyIndex::build()
+{
+    _byName.clear();
+    _deletes.clear();
+    vector<string> dels;
+    for (uint32_t i = 0; i < _names.size(); i++) {
+        deletions(_names[i].substr(0, PREFIX_LENGTH), MAX_DISTANCE, dels);
+        for (const auto& del : dels) {
+            _deletes.push_back(make_pair(hash(del), i));
+        }
+    }
+    sort(_deletes.begin(), _deletes.end());
+    _deletes.erase(unique(_deletes.begin(), _deletes.end()), _deletes.end());
+    _deletes.shrink_to_fit();
+}
+
+vector<FuzzyIndex::Match> FuzzyIndex::search(const string& query, size_t limit) const
+{
+    vector<Match> matches;
+    string q = normalize(query);
+    if (q.size() < MIN_QUERY_LENGTH || _deletes.empty()) {
+        return matches;
+    }
+    int edits = allowedEdits(q.size());
+
+    // Every name sharing a deletion with the query's prefix
+    vector<string> dels;
+    deletions(q.substr(0, PREFIX_LENGTH), edits, dels);
+    vector<uint32_t> candidates;
+    for (const auto& del : dels) {
+        uint32_t h = hash(del);
+        auto range = equal_range(_deletes.begin(), _deletes.end(), make_pair(h, 0u),
+                                 [](const pair<uint32_t, uint32_t>& a,
+                                    const pair<uint32_t, uint32_t>& b) {
+                                     return a.first < b.first;
+                                 });
+        for (auto it = range.first; it != range.second; ++it) {
+            candidates.push_back(it->second);
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    struct Near {
+        uint32_t name;
+        int distance;
+        size_t lengthDiff;
+    };
+    vector<Near> near;
+    for (uint32_t i : candidates) {
+        const string& name = _names[i];
+        size_t lengthDiff = name.size() > q.size() ? name.size() - q.size()
+                                                   : q.size() - name.size();
+        if (lengthDiff > static_cast<size_t>(edits)) {
+            continue;
+        }
+        int d = distance(q, name, edits);
+        if (d <= edits) {
+            near.push_back({i, d, lengthDiff});
+        }
+    }
+    sort(near.begin(), near.end(), [this](const Near& a, const Near& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        if (a.lengthDiff != b.lengthDiff) return a.lengthDiff < b.lengthDiff;
+        return _names[a.name] < _names[b.name];
+    });
+    if (near.size() > limit) {
+        near.resize(limit);
+    }
+
+    for (const auto& n : near) {
+        for (const auto& owner : _owners[n.name]) {
+            matches.push_back({owner.backend, owner.id, _names[n.name], n.distance});
+        }
+    }
+    return matches;
+}
+
+int FuzzyIndex::distance(const string& a, const string& b, int max)
+{
+    // Optimal string alignment, three rows; stops once a whole row is
+    // past max
+    size_t n = a.size(), m = b.size();
+    if ((n > m ? n - m : m - n) > static_cast<size_t>(max)) {
+        return max + 1;
+    }
+    vector<int> before(m + 1), previous(m + 1), current(m + 1);
+    for (size_t j = 0; j <= m; j++) {
+        previous[j] = j;
+    }
+    for (size_t i = 1; i <= n; i++) {
+        current[0] = i;
+        int best = current[0];
+        for (size_t j = 1; j <= m; j++) {
+            int cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            int d = min(min(previous[j] + 1, current[j - 1] + 1), previous[j - 1] + cost);
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1]) {
+                d = min(d, before[j - 2] + 1);
+            }
+            current[j] = d;
+            best = min(best, d);
+        }
+        if (best > max) {
+            return max + 1;
+        }
+        before.swap(previous);
+        previous.swap(current);
+    }
+    return min(previous[m], max + 1);
+}
+
+size_t FuzzyIndex::memoryBytes() const
+{
+    size_t bytes = _names.capacity() * sizeof(string) +
+                   _owners.capacity() * sizeof(vector<Owner>) +
+                   _deletes.capacity() * sizeof(pair<uint32_t, uint32_t>);
+    for (size_t i = 0; i < _names.size(); i++) {
+        bytes += _names[i].capacity() + _owners[i].capacity() * sizeof(Owner);
+        for (const auto& owner : _owners[i]) {
+            bytes += owner.id.capacity();
+        }
+    }
+    return bytes;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,125 @@
+/* fuzzyindex.h - Package names within a typo or two of a query
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the near matches a search falls back to when
+ * it finds little or nothing, as for "libreofice" or "thunderbrid".
+ * Comparing the query with every one of the hundred thousand names
+ * would take far too long per keystroke, so the names are indexed
+ * ahead by symmetric deletion: every name is filed under each string
+ * it turns into with up to MAX_DISTANCE characters deleted, and so is
+ * the query, so names within that many edits share a key with it and
+ * only those few are compared. Names are normalized by the rules
+ * DuplicateDetector compares them by.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _FUZZYINDEX_H_
+#define _FUZZYINDEX_H_
+
+#include "ipackagebackend.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * FuzzyIndex - Names by their deletions, for edit-distance lookups
+ *
+ *     FuzzyIndex index;
+ *     index.add(pkg.backend, pkg.id, pkg.name);    // for every package
+ *     index.build();
+ *     for (const auto& match : index.search("thunderbrid"))
+ *         ... match.backend, match.id, match.distance ...
+ *
+ * Distances count insertions, deletions, substitutions and swaps of
+ * two neighbouring characters as one edit each. Queries of up to four
+ * characters allow one edit, longer ones two. Only the first
+ * PREFIX_LENGTH characters are indexed, which keeps the deletions of a
+ * long name few; the full names are compared before they are returned.
+ *
+ * Thread Safety:
+ *   add() and build() before any search(); a built index is only read.
+ */
+class FuzzyIndex {
+public:
+    static const int MAX_DISTANCE = 2;
+    static const size_t PREFIX_LENGTH = 7;
+
+    // Shorter queries match too much of everything
+    static const size_t MIN_QUERY_LENGTH = 3;
+
+    struct Match {
+        BackendType backend;
+        string id;
+        string name;                // As normalized
+        int distance;
+    };
+
+    /**
+     * File a package under its normalized name; a Flatpak style id
+     * ("org.libreoffice.LibreOffice") is filed under its last part too
+     */
+    void add(BackendType backend, const string& id, const string& name);
+
+    /**
+     * Index what was added; searches find nothing until then
+     */
+    void build();
+
+    /**
+     * The packages whose names are within the allowed edits of query,
+     * nearest first, then those of a length closer to the query's, then
+     * by name; at most limit names, with every package filed under them
+     */
+    vector<Match> search(const string& query, size_t limit = 20) const;
+
+    /**
+     * DuplicateDetector::normalizeName(), so both compare names by
+     * the same rules
+     */
+    static string normalize(const string& name);
+
+    /**
+     * The edits between a and b, or max + 1 if there are more
+     */
+    static int distance(const string& a, const string& b, int max);
+
+    size_t size() const { return _names.size(); }
+
+    /**
+     * Bytes held by the index, for the memory registry
+     */
+    size_t memoryBytes() const;
+
+private:
+    struct Owner {
+        BackendType backend;
+        string id;
+    };
+
+    vector<string> _names;                      // Normalized, each once
+    vector<vector<Owner>> _owners;              // Per name
+    vector<pair<uint32_t, uint32_t>> _deletes;  // (hash of a deletion, name), sorted
+    unordered_map<string, uint32_t> _byName;    // Until build()
+
+    void addName(const string& name, BackendType backend, const string& id);
+    static void deletions(const string& word, int edits, vector<string>& out);
+    static uint32_t hash(const string& s);
+};
+
+} // namespace PolySynaptic
+
+#endif // _FUZZYINDEX_H_
+
+// vim:ts=4:sw=4:et
@@ -47,11 +47,17 @@
 #undef Success
 #endif
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <map>
+#include <chrono>
+
+#include "cacheretention.h"
+#include "memoryusage.h"
+#include "stringpool.h"
 
 using namespace std;
 
@@ -88,6 +94,19 @@ inline const char* backendTypeToBadge(BackendType type) {
     }
 }
 
+// Hash of a package's identity, its backend and ID, for sets and maps
+// of packages; FNV-1a 64, so no key string is built. Among the few
+// hundred thousand packages of every backend together a collision is
+// about one in 10^8, so it stands in for the pair on its own
+inline uint64_t packageIdentity(BackendType backend, const string& id) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ static_cast<uint64_t>(backend)) * 1099511628211ull;
+    for (unsigned char c : id) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
 // ============================================================================
 // Package Installation Status
 // ============================================================================
@@ -118,6 +137,8 @@ inline const char* installStatusToString(InstallStatus status) {
 // Unified Package Information Structure
 // ============================================================================
 
+class IPackageBackend;
+
 /**
  * PackageInfo - Unified package representation across all backends
  *
@@ -126,6 +147,15 @@ inline const char* installStatusToString(InstallStatus status) {
  *
  * Not all fields may be available for all backends - check for empty
  * strings or 0 values where appropriate.
+ *
+ * Text fields that are expensive to fetch (APT reads them from the
+ * package records) may be deferred: the backend leaves them empty, sets
+ * the matching DEFER_* bits and names itself in deferredSource. Call
+ * resolve() before reading a deferred field.
+ *
+ * Listings and searches return summary records: the description and
+ * homepage (DEFER_DETAILS) are left deferred by every backend, and only
+ * getPackageDetails() or resolve() fills them for the row being shown.
  */
 struct PackageInfo {
     // === Identification ===
@@ -143,29 +173,32 @@ struct PackageInfo {
     InstallStatus installStatus; // Current installation status
 
     // === Metadata ===
-    string section;             // Category/section (e.g., "utils", "games")
+    // Fields drawn from a small set of values are interned (see
+    // stringpool.h); copies of a package share one pooled value
+    InternedString section;     // Category/section (e.g., "utils", "games")
     string homepage;            // Project homepage URL
-    string maintainer;          // Package maintainer
-    string license;             // License type (if available)
+    InternedString maintainer;  // Package maintainer
+    InternedString license;     // License type (if available)
+    string keywords;            // Space-separated search keywords (store metadata)
 
     // === Size Information ===
     long downloadSize;          // Download size in bytes (0 if unknown)
     long installedSize;         // Installed size in bytes (0 if unknown)
 
     // === Backend-Specific Data ===
-    string origin;              // Package origin/repository
-    string architecture;        // Target architecture
+    InternedString origin;      // Package origin/repository
+    InternedString architecture; // Target architecture
 
     // === Snap-Specific ===
-    string channel;             // Snap channel (stable/beta/edge)
-    string confinement;         // Snap confinement (strict/classic/devmode)
-    string publisher;           // Snap publisher name
+    InternedString channel;     // Snap channel (stable/beta/edge)
+    InternedString confinement; // Snap confinement (strict/classic/devmode)
+    InternedString publisher;   // Snap publisher name
     bool isClassic;             // Requires --classic flag
 
     // === Flatpak-Specific ===
-    string remote;              // Flatpak remote name (e.g., "flathub")
+    InternedString remote;      // Flatpak remote name (e.g., "flathub")
     string ref;                 // Full flatpak ref (e.g., "app/org.example.App/x86_64/stable")
-    string branch;              // Flatpak branch (usually "stable")
+    InternedString branch;      // Flatpak branch (usually "stable")
     string runtimeRef;          // Required runtime ref
 
     // === UI State ===
@@ -173,6 +206,23 @@ struct PackageInfo {
     bool isMarkedForRemoval;    // User has marked for removal
     bool isMarkedForUpgrade;    // User has marked for upgrade
 
+    // === Search ===
+    int relevance;              // How well it matches the search that
+                                // found it, higher first (0 otherwise)
+
+    // === Deferred Fields ===
+    enum DeferredField : unsigned {
+        DEFER_SUMMARY     = 1 << 0,
+        DEFER_DESCRIPTION = 1 << 1,
+        DEFER_HOMEPAGE    = 1 << 2,
+        DEFER_MAINTAINER  = 1 << 3,
+        DEFER_DETAILS     = DEFER_DESCRIPTION | DEFER_HOMEPAGE,
+        DEFER_ALL         = DEFER_SUMMARY | DEFER_DESCRIPTION |
+                            DEFER_HOMEPAGE | DEFER_MAINTAINER
+    };
+    unsigned deferredFields;    // DEFER_* bits not fetched yet
+    IPackageBackend* deferredSource; // Backend that fills them (may be null)
+
     // Default constructor
     PackageInfo()
         : backend(BackendType::UNKNOWN)
@@ -183,6 +233,9 @@ struct PackageInfo {
         , isMarkedForInstall(false)
         , isMarkedForRemoval(false)
         , isMarkedForUpgrade(false)
+        , relevance(0)
+        , deferredFields(0)
+        , deferredSource(nullptr)
     {}
 
     // Convenience constructor with basic fields
@@ -197,6 +250,9 @@ struct PackageInfo {
         , isMarkedForInstall(false)
         , isMarkedForRemoval(false)
         , isMarkedForUpgrade(false)
+        , relevance(0)
+        , deferredFields(0)
+        , deferredSource(nullptr)
     {}
 
     // Check if package is installed (any version)
@@ -211,10 +267,34 @@ struct PackageInfo {
         return installedVersion.empty() ? version : installedVersion;
     }
 
-    // Get unique key for deduplication across backends
+    // Bytes held by this package and its own strings; interned fields
+    // are shared through the pool and not counted
+    size_t memoryBytes() const {
+        return sizeof(PackageInfo) + heapBytes(id) + heapBytes(name) +
+               heapBytes(summary) + heapBytes(description) +
+               heapBytes(version) + heapBytes(installedVersion) +
+               heapBytes(homepage) + heapBytes(keywords) + heapBytes(ref) +
+               heapBytes(runtimeRef);
+    }
+
+    // Get unique key for deduplication across backends; the display
+    // name is not unique within a backend, so this goes by ID
     string getUniqueKey() const {
-        return name + ":" + backendTypeToString(backend);
+        return id + ":" + backendTypeToString(backend);
+    }
+
+    // Hashed identity (backend and ID), see packageIdentity()
+    uint64_t identity() const {
+        return packageIdentity(backend, id);
     }
+
+    // Check whether any of the given fields still has to be fetched
+    bool isDeferred(unsigned fields) const {
+        return (deferredFields & fields) != 0;
+    }
+
+    // Fetch the given deferred fields from their backend (no-op once done)
+    inline void resolve(unsigned fields = DEFER_ALL);
 };
 
 // ============================================================================
@@ -266,6 +346,46 @@ struct OperationResult {
  */
 using ProgressCallback = function<bool(double current, const string& message)>;
 
+/**
+ * ProgressThrottle - Rate-limits reports to a ProgressCallback
+ *
+ * Backends parsing CLI output or polling snapd can produce hundreds of
+ * updates a second; the throttle passes one through per interval, plus
+ * any forced one (start, end, a new step). Once the callback has asked
+ * to cancel, cancelled() stays true and nothing more is reported.
+ */
+class ProgressThrottle {
+public:
+    explicit ProgressThrottle(ProgressCallback callback, int intervalMs = 200)
+        : _callback(std::move(callback))
+        , _interval(chrono::milliseconds(intervalMs))
+    {}
+
+    // Report unless the last report was less than an interval ago;
+    // false once the operation should be cancelled
+    bool report(double fraction, const string& message, bool force = false) {
+        if (_cancelled) return false;
+        if (!_callback) return true;
+
+        auto now = chrono::steady_clock::now();
+        if (!force && _reported && now - _last < _interval) return true;
+
+        _reported = true;
+        _last = now;
+        if (!_callback(fraction, message)) _cancelled = true;
+        return !_cancelled;
+    }
+
+    bool cancelled() const { return _cancelled; }
+
+private:
+    ProgressCallback _callback;
+    chrono::steady_clock::duration _interval;
+    chrono::steady_clock::time_point _last;
+    bool _reported = false;
+    bool _cancelled = false;
+};
+
 // ============================================================================
 // Backend Query Options
 // ============================================================================
@@ -280,6 +400,12 @@ struct SearchOptions {
     bool installedOnly;         // Only return installed packages
     bool availableOnly;         // Only return non-installed packages
     int maxResults;             // Maximum results to return (0 = unlimited)
+    bool remoteRanking;         // Ask the store for its ranking instead of
+                                // answering from the local store index
+
+    // Polled by backends during long-running work (subprocesses, socket
+    // reads, package iteration); returning true abandons the search
+    function<bool()> isCancelled;
 
     SearchOptions()
         : searchNames(true)
@@ -287,6 +413,7 @@ struct SearchOptions {
         , installedOnly(false)
         , availableOnly(false)
         , maxResults(500)
+        , remoteRanking(false)
     {}
 };
 
@@ -342,6 +469,11 @@ public:
      */
     virtual string getVersion() const = 0;
 
+    /**
+     * Forget a cached availability check, so the next call probes again
+     */
+    virtual void invalidateAvailability() {}
+
     // ========================================================================
     // Package Discovery & Search
     // ========================================================================
@@ -391,6 +523,47 @@ public:
     virtual vector<PackageInfo> getUpgradablePackages(
         ProgressCallback progress = nullptr) = 0;
 
+    /**
+     * Fill text fields this backend deferred when it built the package
+     *
+     * Only called for fields whose DEFER_* bit is set; the caller clears
+     * the bits afterwards. Backends that never defer keep the default.
+     *
+     * @param info Package to complete, looked up by its id
+     * @param fields DEFER_* bits to fetch
+     */
+    virtual void resolveDeferredFields(PackageInfo& info, unsigned fields) {
+        (void)info;
+        (void)fields;
+    }
+
+    /**
+     * Stamp of the backend's store listing for the local search index
+     *
+     * Cheap: compares local files only. It changes whenever
+     * getStoreCatalog() would return something new. An empty stamp
+     * means the backend offers no store listing.
+     */
+    virtual string getStoreCatalogGeneration() { return ""; }
+
+    /**
+     * Every package the store offers, for the local search index
+     *
+     * May be slow (network, large appstream files). It runs in the
+     * background, see BackendManager::refreshStoreIndex().
+     *
+     * @param packages Filled with the store's packages; installStatus
+     *                 is left UNKNOWN
+     * @param isCancelled Polled between requests
+     * @return false on failure or if unsupported
+     */
+    virtual bool getStoreCatalog(vector<PackageInfo>& packages,
+                                 const function<bool()>& isCancelled) {
+        (void)packages;
+        (void)isCancelled;
+        return false;
+    }
+
     // ========================================================================
     // Package Operations
     // ========================================================================
@@ -467,6 +640,35 @@ public:
         bool purge = false,
         ProgressCallback progress = nullptr);
 
+    /**
+     * Update multiple packages to their latest versions
+     *
+     * @param packageIds Package identifiers to update
+     * @param progress Progress callback
+     * @return Operation result
+     */
+    virtual OperationResult updatePackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr);
+
+    /**
+     * Install a package, or move an installed one, to a given target
+     *
+     * The target is what the backend pins: an APT version, a snap
+     * channel or a flatpak branch.
+     *
+     * @param packageId Package identifier
+     * @param target Version, channel or branch
+     * @param progress Progress callback
+     * @return Operation result
+     */
+    virtual OperationResult installPackageVersion(
+        const string& packageId,
+        const string& target,
+        ProgressCallback progress = nullptr) {
+        return OperationResult::Failure("Not supported by this backend");
+    }
+
     // ========================================================================
     // Repository/Source Management (optional)
     // ========================================================================
@@ -494,8 +696,65 @@ public:
     virtual OperationResult removeRepository(const string& repo) {
         return OperationResult::Failure("Not supported by this backend");
     }
+
+    // ========================================================================
+    // Pre-download (optional)
+    // ========================================================================
+
+    /**
+     * Check if this backend can fetch updates ahead of their commit
+     */
+    virtual bool supportsPredownload() const { return false; }
+
+    /**
+     * Fetch what updating the packages needs into the backend's own
+     * cache without changing the system, at idle I/O and CPU priority,
+     * so that updating them later is mostly install time
+     *
+     * @param cancelled Polled while fetching; true stops it
+     * @param rateLimitKBps Download rate limit where the tool has one, 0 for none
+     */
+    virtual OperationResult predownloadUpdates(
+        const vector<string>& packageIds,
+        const function<bool()>& cancelled,
+        int rateLimitKBps = 0) {
+        return OperationResult::Failure("Not supported by this backend");
+    }
+
+    // ========================================================================
+    // Cache Cleanup (optional)
+    // ========================================================================
+
+    /**
+     * Check if this backend keeps things nothing uses that can go
+     */
+    virtual bool supportsCacheCleanup() const { return false; }
+
+    /**
+     * What the backend keeps without using it (disabled snap revisions,
+     * runtimes no app needs), for a RetentionPolicy to choose from
+     */
+    virtual vector<CachedItem> getCachedItems() { return {}; }
+
+    /**
+     * Remove items getCachedItems() returned
+     */
+    virtual OperationResult removeCachedItems(const vector<CachedItem>& items) {
+        return OperationResult::Failure("Not supported by this backend");
+    }
 };
 
+inline void PackageInfo::resolve(unsigned fields)
+{
+    fields &= deferredFields;
+    if (fields == 0) return;
+
+    if (deferredSource) {
+        deferredSource->resolveDeferredFields(*this, fields);
+    }
+    deferredFields &= ~fields;
+}
+
 // Default implementation for batch operations (can be overridden)
 inline OperationResult IPackageBackend::installPackages(
     const vector<string>& packageIds,
@@ -550,6 +809,32 @@ inline OperationResult IPackageBackend::removePackages(
     return OperationResult::Success("Removed " + to_string(total) + " packages");
 }
 
+inline OperationResult IPackageBackend::updatePackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    int total = packageIds.size();
+    int current = 0;
+
+    for (const auto& id : packageIds) {
+        if (progress) {
+            double pct = static_cast<double>(current) / total;
+            if (!progress(pct, "Updating " + id + "...")) {
+                return OperationResult::Failure("Operation cancelled");
+            }
+        }
+
+        auto result = updatePackage(id, nullptr);
+        if (!result.success) {
+            return result;
+        }
+
+        current++;
+    }
+
+    return OperationResult::Success("Updated " + to_string(total) + " packages");
+}
+
 } // namespace PolySynaptic
 
 #endif // _IPACKAGEBACKEND_H_
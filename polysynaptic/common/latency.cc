@@ -0,0 +1,254 @@
+/* latency.cc - Latency histograms per backend and operation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "latency.h"
+#include "structuredlog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Histogram
+// ============================================================================
+
+LatencyHistogram::LatencyHistogram()
+    : _count(0), _sum(0), _max(0)
+{
+    for (auto& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketFor(uint64_t micros)
+{
+    if (micros < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<int>(micros);
+    }
+    if (micros >> MAX_BITS) {
+        return BUCKETS - 1;
+    }
+
+    // The top SUB_BUCKET_BITS + 1 bits pick the bucket within the octave
+    int magnitude = 63 - __builtin_clzll(micros);
+    int shift = magnitude - SUB_BUCKET_BITS;
+    int sub = static_cast<int>(micros >> shift) - SUB_BUCKETS;
+    return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    _buckets[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (micros > max &&
+           !_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration elapsed)
+{
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    record(static_cast<uint64_t>(micros > 0 ? micros : 0));
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    // Sum the buckets rather than trusting _count, which may be ahead
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * total));
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // Never report more than was actually seen
+            return std::min(bucketUpperBound(i), _max.load(std::memory_order_relaxed));
+        }
+    }
+    return _max.load(std::memory_order_relaxed);
+}
+
+LatencyStats LatencyHistogram::stats() const
+{
+    LatencyStats stats;
+    stats.count = count();
+    if (stats.count == 0) {
+        return stats;
+    }
+    stats.mean = _sum.load(std::memory_order_relaxed) / 1000.0 / stats.count;
+    stats.p50 = percentile(50) / 1000.0;
+    stats.p95 = percentile(95) / 1000.0;
+    stats.p99 = percentile(99) / 1000.0;
+    stats.max = _max.load(std::memory_order_relaxed) / 1000.0;
+    return stats;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < BUCKETS; i++) {
+        uint64_t n = other._buckets[i].load(std::memory_order_relaxed);
+        if (n > 0) {
+            _buckets[i].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    _count.fetch_add(other.count(), std::memory_order_relaxed);
+    _sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    uint64_t theirs = other._max.load(std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (theirs > max &&
+           !_max.compare_exchange_weak(max, theirs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::clear()
+{
+    for (auto& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+vector<pair<int, uint64_t>> LatencyHistogram::buckets() const
+{
+    vector<pair<int, uint64_t>> result;
+    for (int i = 0; i < BUCKETS; i++) {
+        uint64_t n = _buckets[i].load(std::memory_order_relaxed);
+        if (n > 0) {
+            result.emplace_back(i, n);
+        }
+    }
+    return result;
+}
+
+// ============================================================================
+// Registry
+// ============================================================================
+
+LatencyRegistry& LatencyRegistry::instance()
+{
+    static LatencyRegistry registry;
+    return registry;
+}
+
+LatencyHistogram& LatencyRegistry::histogram(const string& backend, const string& operation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& slot = _histograms[make_pair(backend, operation)];
+    if (!slot) {
+        slot.reset(new LatencyHistogram());
+    }
+    return *slot;
+}
+
+vector<LatencyRegistry::Entry> LatencyRegistry::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    vector<Entry> entries;
+    for (const auto& item : _histograms) {
+        entries.push_back({item.first.first, item.first.second, item.second->stats()});
+    }
+    return entries;
+}
+
+void LatencyRegistry::clear()
+{
+    // References handed out stay valid, so empty them in place
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& item : _histograms) {
+        item.second->clear();
+    }
+}
+
+string LatencyRegistry::toJson() const
+{
+    auto number = [](double value) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.3f", value);
+        return string(text);
+    };
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    string out = "{\"unit\":\"us\",\"subBucketBits\":" +
+                 std::to_string(LatencyHistogram::SUB_BUCKET_BITS) +
+                 ",\"histograms\":[";
+    bool first = true;
+    for (const auto& item : _histograms) {
+        const LatencyHistogram& histogram = *item.second;
+        LatencyStats stats = histogram.stats();
+        if (!first) out += ',';
+        first = false;
+
+        out += "\n{\"backend\":\"";
+        appendJsonEscaped(out, item.first.first);
+        out += "\",\"operation\":\"";
+        appendJsonEscaped(out, item.first.second);
+        out += "\",\"count\":" + std::to_string(stats.count);
+        out += ",\"p50Ms\":" + number(stats.p50);
+        out += ",\"p95Ms\":" + number(stats.p95);
+        out += ",\"p99Ms\":" + number(stats.p99);
+        out += ",\"maxMs\":" + number(stats.max);
+        out += ",\"buckets\":[";
+        bool firstBucket = true;
+        for (const auto& bucket : histogram.buckets()) {
+            if (!firstBucket) out += ',';
+            firstBucket = false;
+            out += "[" + std::to_string(bucket.first) + "," +
+                   std::to_string(bucket.second) + "]";
+        }
+        out += "]}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool LatencyRegistry::exportJson(const string& path) const
+{
+    string json = toJson();
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,162 @@
+/* latency.h - Latency histograms per backend and operation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements HDR-style latency histograms: buckets grow
+ * exponentially, with 16 linear steps inside each power of two, so any
+ * recorded time is known to within about 6% from a microsecond to
+ * days. Recording is a couple of relaxed atomic adds, cheap enough to
+ * leave on in every backend call; the debug panel shows p50/p95/p99
+ * and the maximum, and the raw buckets can be exported and summed
+ * across machines.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * LatencyStats - Summary of one histogram, times in milliseconds
+ */
+struct LatencyStats {
+    uint64_t count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+/**
+ * LatencyHistogram - Lock-free histogram of durations
+ *
+ * Thread Safety:
+ *   record() may run concurrently with everything else; readers see
+ *   each bucket at some recent value.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_BITS = 40;         // 2^40 us, about 12 days
+    static const int BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t micros);
+    void record(std::chrono::steady_clock::duration elapsed);
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+    /**
+     * Upper bound of the bucket holding the given percentile, in us
+     */
+    uint64_t percentile(double percent) const;
+
+    LatencyStats stats() const;
+
+    /**
+     * Add another histogram's counts to this one
+     */
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    /**
+     * Non-empty buckets as (index, count)
+     */
+    vector<pair<int, uint64_t>> buckets() const;
+
+    static int bucketFor(uint64_t micros);
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    std::atomic<uint64_t> _buckets[BUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+};
+
+/**
+ * LatencyRegistry - Every histogram of the process, by backend and
+ * operation
+ *
+ * Histograms are created on first use and live as long as the
+ * process, so callers may keep the reference.
+ */
+class LatencyRegistry {
+public:
+    struct Entry {
+        string backend;
+        string operation;
+        LatencyStats stats;
+    };
+
+    static LatencyRegistry& instance();
+
+    LatencyHistogram& histogram(const string& backend, const string& operation);
+
+    vector<Entry> snapshot() const;
+    void clear();
+
+    /**
+     * All histograms as JSON, with their raw buckets for aggregation
+     */
+    string toJson() const;
+    bool exportJson(const string& path) const;
+
+private:
+    LatencyRegistry() = default;
+
+    mutable std::mutex _mutex;
+    std::map<pair<string, string>, std::unique_ptr<LatencyHistogram>> _histograms;
+};
+
+/**
+ * ScopedLatency - Records the lifetime of the block into a histogram
+ */
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram& histogram)
+        : _histogram(histogram), _start(std::chrono::steady_clock::now()) {}
+
+    ScopedLatency(const string& backend, const string& operation)
+        : ScopedLatency(LatencyRegistry::instance().histogram(backend, operation)) {}
+
+    ~ScopedLatency() {
+        _histogram.record(std::chrono::steady_clock::now() - _start);
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyHistogram& _histogram;
+    std::chrono::steady_clock::time_point _start;
+};
+
+} // namespace PolySynaptic
+
+#endif // _LATENCY_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,325 @@
+/* mediacache.cc - Disk-backed cache of package screenshots and changelogs
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "mediacache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace PolySynaptic {
+
+namespace {
+
+const char PART_SUFFIX[] = ".part";
+
+bool endsWith(const string& s, const string& suffix)
+{
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Package names and versions never contain '_', so it can separate them
+string sanitize(const string& s)
+{
+    string out(s);
+    for (auto& c : out) {
+        if (!isalnum(static_cast<unsigned char>(c)) &&
+            c != '.' && c != '+' && c != '-' && c != '~') {
+            c = '_';
+        }
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+MediaCache::MediaCache(const string& dir, uint64_t maxBytes, Fetcher fetcher,
+                       unsigned workers)
+    : _dir(dir), _maxBytes(maxBytes), _fetcher(std::move(fetcher)),
+      _size(0), _pool(workers)
+{
+    scan();
+}
+
+MediaCache::~MediaCache()
+{
+}
+
+// ============================================================================
+// Lookup and Requests
+// ============================================================================
+
+string MediaCache::lookup(MediaKind kind, const string& name, const string& version)
+{
+    string key = keyFor(kind, name, version);
+    string path = pathFor(key);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        return string();
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        // Removed behind our back
+        _size -= it->second.size;
+        _lru.erase(it->second.use);
+        _entries.erase(it);
+        return string();
+    }
+
+    _lru.splice(_lru.begin(), _lru, it->second.use);
+    // The mtime carries the order over to the next start
+    utime(path.c_str(), NULL);
+    return path;
+}
+
+void MediaCache::request(MediaKind kind, const string& name, const string& version,
+                         const string& uri, TaskPriority priority, Callback callback)
+{
+    string file = lookup(kind, name, version);
+    if (!file.empty() || uri.empty()) {
+        if (callback) callback(file);
+        return;
+    }
+
+    string key = keyFor(kind, name, version);
+    bool submit = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_entries.count(key)) {
+            // Finished since the lookup
+            file = pathFor(key);
+        } else {
+            auto it = _pending.find(key);
+            bool queued = it != _pending.end();
+            Pending& pending = _pending[key];
+            if (callback) {
+                pending.waiters.push_back(std::move(callback));
+            }
+
+            // Someone waiting on a prefetch should not queue behind all
+            // the other prefetches; a second task at the higher priority
+            // takes over and the first one finds the key started
+            bool urgent = priority == TaskPriority::INTERACTIVE;
+            submit = !queued || (urgent && !pending.urgent && !pending.started);
+            if (urgent) {
+                pending.urgent = true;
+            }
+        }
+    }
+
+    if (!file.empty()) {
+        if (callback) callback(file);
+        return;
+    }
+    if (submit) {
+        _pool.submit(priority, [this, key, uri]() {
+            fetch(key, uri);
+            return true;
+        });
+    }
+}
+
+void MediaCache::prefetch(MediaKind kind, const string& name, const string& version,
+                          const string& uri)
+{
+    string key = keyFor(kind, name, version);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_entries.count(key) || _pending.count(key)) {
+            return;
+        }
+    }
+    request(kind, name, version, uri, TaskPriority::BACKGROUND, Callback());
+}
+
+bool MediaCache::isPending(MediaKind kind, const string& name,
+                           const string& version) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending.count(keyFor(kind, name, version)) > 0;
+}
+
+string MediaCache::partialFile(MediaKind kind, const string& name,
+                               const string& version) const
+{
+    string key = keyFor(kind, name, version);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _pending.find(key);
+    if (it == _pending.end() || !it->second.writing) {
+        return string();
+    }
+    return pathFor(key) + PART_SUFFIX;
+}
+
+void MediaCache::fetch(const string& key, const string& uri)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _pending.find(key);
+        if (it == _pending.end() || it->second.started) {
+            return;
+        }
+        it->second.started = true;
+    }
+
+    string path = pathFor(key);
+    string part = path + PART_SUFFIX;
+    unlink(part.c_str());
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending[key].writing = true;
+    }
+
+    bool ok = _fetcher(uri, part);
+    struct stat st;
+    ok = ok && stat(part.c_str(), &st) == 0 && st.st_size > 0 &&
+         rename(part.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        unlink(part.c_str());
+    }
+
+    std::vector<Callback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (ok) {
+            insertLocked(key, st.st_size);
+            trimLocked();
+        }
+        auto it = _pending.find(key);
+        waiters.swap(it->second.waiters);
+        _pending.erase(it);
+    }
+
+    string file = ok ? path : string();
+    for (auto& waiter : waiters) {
+        waiter(file);
+    }
+}
+
+// ============================================================================
+// Size Limit
+// ============================================================================
+
+void MediaCache::setMaxBytes(uint64_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxBytes = maxBytes;
+    trimLocked();
+}
+
+uint64_t MediaCache::getSize() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
+size_t MediaCache::getEntryCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+void MediaCache::insertLocked(const string& key, uint64_t size)
+{
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        _size -= it->second.size;
+        _lru.erase(it->second.use);
+        _entries.erase(it);
+    }
+
+    _lru.push_front(key);
+    _entries[key] = Entry{_lru.begin(), size};
+    _size += size;
+}
+
+void MediaCache::trimLocked()
+{
+    // The newest file stays even if it alone is over the limit
+    while (_maxBytes > 0 && _size > _maxBytes && _lru.size() > 1) {
+        const string& key = _lru.back();
+        unlink(pathFor(key).c_str());
+        auto it = _entries.find(key);
+        _size -= it->second.size;
+        _entries.erase(it);
+        _lru.pop_back();
+    }
+}
+
+// ============================================================================
+// Files
+// ============================================================================
+
+string MediaCache::keyFor(MediaKind kind, const string& name, const string& version)
+{
+    const char *prefix = "changelog_";
+    switch (kind) {
+    case MediaKind::THUMBNAIL:  prefix = "thumb_"; break;
+    case MediaKind::SCREENSHOT: prefix = "shot_"; break;
+    case MediaKind::CHANGELOG:  break;
+    }
+    return prefix + sanitize(name) + "_" + sanitize(version);
+}
+
+string MediaCache::pathFor(const string& key) const
+{
+    return _dir + "/" + key;
+}
+
+void MediaCache::scan()
+{
+    mkdir(_dir.c_str(), 0755);
+
+    DIR *dir = opendir(_dir.c_str());
+    if (dir == NULL) {
+        return;
+    }
+
+    // (mtime, name, size) of every finished download
+    std::vector<std::pair<time_t, std::pair<string, uint64_t>>> files;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        string name = ent->d_name;
+        if (name == "." || name == "..") continue;
+
+        string path = pathFor(name);
+        if (endsWith(name, PART_SUFFIX)) {
+            // Left over from an interrupted download
+            unlink(path.c_str());
+            continue;
+        }
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        files.push_back({st.st_mtime, {name, static_cast<uint64_t>(st.st_size)}});
+    }
+    closedir(dir);
+
+    // Oldest first, so the most recent ends up in front
+    sort(files.begin(), files.end());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& file : files) {
+        insertLocked(file.second.first, file.second.second);
+    }
+    trimLocked();
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
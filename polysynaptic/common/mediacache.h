@@ -0,0 +1,162 @@
+/* mediacache.h - Disk-backed cache of package screenshots and changelogs
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements a size-bounded, least-recently-used store of the
+ * screenshots, thumbnails and changelogs shown in the package details.
+ * Downloads run on a small worker pool so the UI never waits on the
+ * network, and a file is fetched at most once no matter how many
+ * callers ask for it at the same time.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _MEDIACACHE_H_
+#define _MEDIACACHE_H_
+
+#include "taskpool.h"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * MediaKind - What a cached file holds
+ */
+enum class MediaKind {
+    THUMBNAIL,
+    SCREENSHOT,
+    CHANGELOG
+};
+
+/**
+ * MediaCache - Package media on disk, fetched in the background
+ *
+ * Files are keyed by kind, package name and version, so a new upload
+ * of a package gets a fresh changelog while the old one ages out. The
+ * least recently used files are deleted once the directory grows past
+ * the byte limit; the order survives restarts through the files'
+ * mtimes.
+ *
+ * The download itself is left to the Fetcher, which keeps this class
+ * free of APT and of the GUI toolkit.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. Callbacks run on a
+ *   worker thread, or on the calling thread when the file is already
+ *   cached; GUI callers hand the result to their main loop.
+ */
+class MediaCache {
+public:
+    /**
+     * Download uri into dest; false if it failed or came back empty
+     */
+    using Fetcher = std::function<bool(const string& uri, const string& dest)>;
+
+    /**
+     * Receives the cached file, or an empty string if the fetch failed
+     */
+    using Callback = std::function<void(const string& file)>;
+
+    /**
+     * @param dir      Cache directory (created if missing)
+     * @param maxBytes Size the directory is trimmed to (0 = unbounded)
+     * @param fetcher  Does the actual downloads
+     * @param workers  Concurrent downloads
+     */
+    MediaCache(const string& dir, uint64_t maxBytes, Fetcher fetcher,
+               unsigned workers = 2);
+    ~MediaCache();
+
+    MediaCache(const MediaCache&) = delete;
+    MediaCache& operator=(const MediaCache&) = delete;
+
+    /**
+     * The cached file, or an empty string; a hit counts as a use
+     */
+    string lookup(MediaKind kind, const string& name, const string& version);
+
+    /**
+     * Get a file, downloading it from uri if it is not cached yet
+     *
+     * A request for a file that is already being fetched waits for
+     * that download instead of starting another one.
+     */
+    void request(MediaKind kind, const string& name, const string& version,
+                 const string& uri, TaskPriority priority, Callback callback);
+
+    /**
+     * Fetch a file nobody is waiting for yet (visible rows)
+     *
+     * Does nothing if the file is cached or already on its way.
+     */
+    void prefetch(MediaKind kind, const string& name, const string& version,
+                  const string& uri);
+
+    bool isPending(MediaKind kind, const string& name, const string& version) const;
+
+    /**
+     * The file a running download writes into, for a caller that reads
+     * along while it grows (a long changelog); empty unless one does
+     *
+     * It is renamed to the cached file when the download is done, so a
+     * descriptor opened on it reads on to the end. Only useful with a
+     * Fetcher that writes dest as the data comes in, as APT's does.
+     */
+    string partialFile(MediaKind kind, const string& name, const string& version) const;
+
+    void setMaxBytes(uint64_t maxBytes);
+    uint64_t getSize() const;
+    size_t getEntryCount() const;
+
+private:
+    struct Entry {
+        std::list<string>::iterator use;    // Position in _lru
+        uint64_t size;
+    };
+
+    string _dir;
+    uint64_t _maxBytes;
+    Fetcher _fetcher;
+
+    struct Pending {
+        std::vector<Callback> waiters;
+        bool started = false;
+        bool writing = false;       // Past the removal of an old part file
+        bool urgent = false;        // Queued at INTERACTIVE already
+    };
+
+    std::list<string> _lru;                 // Keys, most recent first
+    std::map<string, Entry> _entries;
+    uint64_t _size;
+    std::map<string, Pending> _pending;
+    mutable std::mutex _mutex;
+
+    // Last, so the workers stop before anything they use goes away
+    TaskPool _pool;
+
+    static string keyFor(MediaKind kind, const string& name, const string& version);
+    string pathFor(const string& key) const;
+
+    void scan();
+    void fetch(const string& key, const string& uri);
+    void insertLocked(const string& key, uint64_t size);
+    void trimLocked();
+};
+
+} // namespace PolySynaptic
+
+#endif // _MEDIACACHE_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,120 @@
+/* memoryusage.cc - Memory accounting per subsystem
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "memoryusage.h"
+#include "structuredlog.h"
+
+#include <cstdio>
+
+namespace PolySynaptic {
+
+MemoryRegistry& MemoryRegistry::instance()
+{
+    static MemoryRegistry registry;
+    return registry;
+}
+
+int MemoryRegistry::add(const string& subsystem, Probe probe, Trim trim)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    int handle = _nextHandle++;
+    _sources[handle] = Source{subsystem, std::move(probe), std::move(trim)};
+    return handle;
+}
+
+void MemoryRegistry::remove(int handle)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sources.erase(handle);
+}
+
+vector<MemoryRegistry::Source> MemoryRegistry::sources() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    vector<Source> copy;
+    for (const auto& item : _sources) {
+        copy.push_back(item.second);
+    }
+    return copy;
+}
+
+vector<MemoryUsage> MemoryRegistry::snapshot() const
+{
+    std::map<string, MemoryUsage> byName;
+    for (const auto& source : sources()) {
+        MemoryUsage usage;
+        if (source.probe) {
+            source.probe(usage);
+        }
+
+        MemoryUsage& total = byName[source.subsystem];
+        total.subsystem = source.subsystem;
+        total.bytes += usage.bytes;
+        total.items += usage.items;
+        total.onDisk = total.onDisk || usage.onDisk;
+        total.trimmable = total.trimmable || source.trim != nullptr;
+    }
+
+    vector<MemoryUsage> result;
+    for (auto& item : byName) {
+        result.push_back(item.second);
+    }
+    return result;
+}
+
+uint64_t MemoryRegistry::trim()
+{
+    uint64_t freed = 0;
+    for (const auto& source : sources()) {
+        if (source.trim) {
+            freed += source.trim();
+        }
+    }
+    return freed;
+}
+
+string MemoryRegistry::toJson() const
+{
+    string out = "{\"unit\":\"bytes\",\"subsystems\":[";
+    bool first = true;
+    for (const auto& usage : snapshot()) {
+        if (!first) out += ',';
+        first = false;
+
+        out += "\n{\"subsystem\":\"";
+        appendJsonEscaped(out, usage.subsystem);
+        out += "\",\"bytes\":" + std::to_string(usage.bytes);
+        out += ",\"items\":" + std::to_string(usage.items);
+        out += ",\"onDisk\":";
+        out += usage.onDisk ? "true" : "false";
+        out += ",\"trimmable\":";
+        out += usage.trimmable ? "true" : "false";
+        out += '}';
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool MemoryRegistry::exportJson(const string& path) const
+{
+    string json = toJson();
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,148 @@
+/* memoryusage.h - Memory accounting per subsystem
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file lets the caches and big containers of the process say how
+ * much they hold, so the debug panel can break the footprint down by
+ * subsystem instead of showing one number. Accounting is explicit:
+ * each subsystem registers a probe that counts its own bytes when
+ * asked, so nothing is paid while nobody looks. Subsystems that are
+ * only caches also register a trim that drops what they can rebuild.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _MEMORYUSAGE_H_
+#define _MEMORYUSAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * MemoryUsage - What one subsystem holds
+ */
+struct MemoryUsage {
+    string subsystem;
+    uint64_t bytes = 0;
+    uint64_t items = 0;         // Entries, packages, rows...
+    bool onDisk = false;        // Bytes are on disk, not in memory
+    bool trimmable = false;
+};
+
+/**
+ * Heap bytes owned by a string beyond the object itself
+ *
+ * Short strings live inside the object and own nothing.
+ */
+inline size_t heapBytes(const string& s)
+{
+    return s.capacity() > string().capacity() ? s.capacity() + 1 : 0;
+}
+
+/**
+ * MemoryRegistry - The accounted subsystems of the process
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. Probes and trims run on
+ *   the caller's thread with the registry unlocked, so a probe must
+ *   take whatever locks its subsystem needs and may not outlive its
+ *   registration; subsystems used only on the main loop are probed from
+ *   the main loop by the debug panel.
+ */
+class MemoryRegistry {
+public:
+    using Probe = function<void(MemoryUsage& usage)>;
+
+    // Drops what can be rebuilt; returns the bytes it freed
+    using Trim = function<uint64_t()>;
+
+    static MemoryRegistry& instance();
+
+    /**
+     * Account a subsystem; several may share a name and are summed
+     *
+     * @return Handle for remove()
+     */
+    int add(const string& subsystem, Probe probe, Trim trim = nullptr);
+    void remove(int handle);
+
+    /**
+     * Current usage by subsystem name
+     */
+    vector<MemoryUsage> snapshot() const;
+
+    /**
+     * Run every trim; returns the bytes freed
+     */
+    uint64_t trim();
+
+    string toJson() const;
+    bool exportJson(const string& path) const;
+
+private:
+    MemoryRegistry() = default;
+
+    struct Source {
+        string subsystem;
+        Probe probe;
+        Trim trim;
+    };
+
+    mutable std::mutex _mutex;
+    std::map<int, Source> _sources;
+    int _nextHandle = 1;
+
+    vector<Source> sources() const;
+};
+
+/**
+ * MemoryAccount - Registration that ends with its owner
+ */
+class MemoryAccount {
+public:
+    MemoryAccount() = default;
+    MemoryAccount(const string& subsystem, MemoryRegistry::Probe probe,
+                  MemoryRegistry::Trim trim = nullptr) {
+        assign(subsystem, std::move(probe), std::move(trim));
+    }
+    ~MemoryAccount() { reset(); }
+
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    // Register (again, replacing the previous registration)
+    void assign(const string& subsystem, MemoryRegistry::Probe probe,
+                MemoryRegistry::Trim trim = nullptr) {
+        reset();
+        _handle = MemoryRegistry::instance().add(subsystem, std::move(probe),
+                                                 std::move(trim));
+    }
+
+    void reset() {
+        if (_handle != 0) {
+            MemoryRegistry::instance().remove(_handle);
+            _handle = 0;
+        }
+    }
+
+private:
+    int _handle = 0;
+};
+
+} // namespace PolySynaptic
+
+#endif // _MEMORYUSAGE_H_
+
+// vim:ts=4:sw=4:et
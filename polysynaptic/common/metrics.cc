@@ -0,0 +1,257 @@
+/* metrics.cc - Counters and gauges, exported as OpenMetrics text
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "metrics.h"
+#include "latency.h"
+#include "memoryusage.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+// Upper bounds of the exported histogram buckets, in seconds; the
+// latency histograms are far finer and are summed into these
+const double EXPORT_BOUNDS[] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+    0.25, 0.5, 1, 2.5, 5, 10, 30, 60,
+};
+
+string formatSeconds(double seconds)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", seconds);
+    return buf;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// MetricsRegistry
+// ============================================================================
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    stopExport();
+}
+
+string MetricsRegistry::escapeLabel(const string& value)
+{
+    string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"':  out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default:   out += c; break;
+        }
+    }
+    return out;
+}
+
+string MetricsRegistry::labelText(const MetricLabels& labels)
+{
+    string text;
+    for (const auto& label : labels) {
+        text += (text.empty() ? "" : ",") + label.first + "=\"" +
+                escapeLabel(label.second) + "\"";
+    }
+    return text;
+}
+
+MetricsRegistry::Family& MetricsRegistry::family(const string& name, const char *type,
+                                                 const string& help)
+{
+    Family& found = _families[name];
+    if (found.type.empty()) {
+        found.type = type;
+        found.help = help;
+    }
+    return found;
+}
+
+MetricCounter& MetricsRegistry::counter(const string& name, const string& help,
+                                        const MetricLabels& labels)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto& slot = family(name, "counter", help).counters[labelText(labels)];
+    if (!slot) {
+        slot.reset(new MetricCounter());
+    }
+    return *slot;
+}
+
+MetricGauge& MetricsRegistry::gauge(const string& name, const string& help,
+                                    const MetricLabels& labels)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto& slot = family(name, "gauge", help).gauges[labelText(labels)];
+    if (!slot) {
+        slot.reset(new MetricGauge());
+    }
+    return *slot;
+}
+
+void MetricsRegistry::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+    for (auto& entry : _families) {
+        for (auto& counter : entry.second.counters) {
+            counter.second->reset();
+        }
+        for (auto& gauge : entry.second.gauges) {
+            gauge.second->set(0);
+        }
+    }
+}
+
+string MetricsRegistry::toOpenMetrics() const
+{
+    std::ostringstream out;
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (const auto& entry : _families) {
+            const string& name = entry.first;
+            const Family& family = entry.second;
+            out << "# TYPE " << name << " " << family.type << "\n"
+                << "# HELP " << name << " " << family.help << "\n";
+            for (const auto& counter : family.counters) {
+                out << name << "_total";
+                if (!counter.first.empty()) {
+                    out << "{" << counter.first << "}";
+                }
+                out << " " << counter.second->value() << "\n";
+            }
+            for (const auto& gauge : family.gauges) {
+                out << name;
+                if (!gauge.first.empty()) {
+                    out << "{" << gauge.first << "}";
+                }
+                out << " " << gauge.second->value() << "\n";
+            }
+        }
+    }
+
+    LatencyRegistry& latencies = LatencyRegistry::instance();
+    vector<LatencyRegistry::Entry> timed = latencies.snapshot();
+    if (!timed.empty()) {
+        const char *name = "polysynaptic_operation_duration_seconds";
+        out << "# TYPE " << name << " histogram\n"
+            << "# HELP " << name << " Time of backend, provider and UI operations\n";
+    }
+    for (const auto& entry : timed) {
+        string labels = labelText({{"backend", entry.backend},
+                                   {"operation", entry.operation}});
+        vector<pair<int, uint64_t>> buckets =
+            latencies.histogram(entry.backend, entry.operation).buckets();
+
+        uint64_t below = 0;
+        size_t next = 0;
+        for (double bound : EXPORT_BOUNDS) {
+            uint64_t micros = static_cast<uint64_t>(bound * 1e6);
+            while (next < buckets.size() &&
+                   LatencyHistogram::bucketUpperBound(buckets[next].first) <= micros) {
+                below += buckets[next].second;
+                next++;
+            }
+            out << "polysynaptic_operation_duration_seconds_bucket{" << labels
+                << ",le=\"" << formatSeconds(bound) << "\"} " << below << "\n";
+        }
+        out << "polysynaptic_operation_duration_seconds_bucket{" << labels
+            << ",le=\"+Inf\"} " << entry.stats.count << "\n"
+            << "polysynaptic_operation_duration_seconds_count{" << labels << "} "
+            << entry.stats.count << "\n"
+            << "polysynaptic_operation_duration_seconds_sum{" << labels << "} "
+            << formatSeconds(entry.stats.mean * entry.stats.count / 1000.0) << "\n";
+    }
+
+    vector<MemoryUsage> memory = MemoryRegistry::instance().snapshot();
+    if (!memory.empty()) {
+        out << "# TYPE polysynaptic_memory_bytes gauge\n"
+            << "# HELP polysynaptic_memory_bytes Memory held per subsystem\n";
+    }
+    for (const auto& usage : memory) {
+        out << "polysynaptic_memory_bytes{"
+            << labelText({{"subsystem", usage.subsystem},
+                          {"on_disk", usage.onDisk ? "true" : "false"}})
+            << "} " << usage.bytes << "\n";
+    }
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+bool MetricsRegistry::writeFile(const string& path) const
+{
+    // Scrapers must never see half a file
+    string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp.c_str(), std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << toOpenMetrics();
+        if (!file.good()) {
+            return false;
+        }
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void MetricsRegistry::startExport(const string& path, unsigned intervalSeconds)
+{
+    stopExport();
+
+    lock_guard<mutex> lock(_exportMutex);
+    _exportStopping = false;
+    _exporter = std::thread([this, path, intervalSeconds]() {
+        unique_lock<mutex> lock(_exportMutex);
+        while (true) {
+            bool stopping = _exportWakeup.wait_for(
+                lock, std::chrono::seconds(intervalSeconds),
+                [this]() { return _exportStopping; });
+            lock.unlock();
+            writeFile(path);
+            lock.lock();
+            if (stopping) {
+                return;
+            }
+        }
+    });
+}
+
+void MetricsRegistry::stopExport()
+{
+    {
+        lock_guard<mutex> lock(_exportMutex);
+        if (!_exporter.joinable()) {
+            return;
+        }
+        _exportStopping = true;
+    }
+    _exportWakeup.notify_all();
+    _exporter.join();
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
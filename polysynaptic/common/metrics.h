@@ -0,0 +1,142 @@
+/* metrics.h - Counters and gauges, exported as OpenMetrics text
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the registry behind the metrics file a node
+ * exporter's textfile collector scrapes. BackendManager, the providers,
+ * the lister, the subprocess runner and the stall watchdog count what
+ * they do here (searches, store index hits, subprocesses by tool,
+ * query cache hits, stalls); the export adds the latency histograms
+ * (search latency is one of them) and the memory per subsystem, so
+ * none of it has to be read off the debug panel machine by machine.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+// Label names and values, in the order they are written
+using MetricLabels = vector<pair<string, string>>;
+
+/**
+ * MetricCounter - Only goes up
+ */
+class MetricCounter {
+public:
+    void inc(uint64_t by = 1) { _value.fetch_add(by, std::memory_order_relaxed); }
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    // MetricsRegistry::clear() only; scrapers expect counters to grow
+    void reset() { _value.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> _value{0};
+};
+
+/**
+ * MetricGauge - Goes up and down
+ */
+class MetricGauge {
+public:
+    void set(int64_t value) { _value.store(value, std::memory_order_relaxed); }
+    void add(int64_t by) { _value.fetch_add(by, std::memory_order_relaxed); }
+    int64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> _value{0};
+};
+
+/**
+ * MetricsRegistry - Every counter and gauge of the process
+ *
+ * Metrics are created on first use and live as long as the process,
+ * so callers may keep the reference for the hot paths. Names are
+ * OpenMetrics names without the _total suffix; a family keeps the
+ * help text it was first created with.
+ *
+ *     static MetricCounter& searches = MetricsRegistry::instance()
+ *         .counter("polysynaptic_searches", "Unified searches started");
+ *     searches.inc();
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    MetricCounter& counter(const string& name, const string& help,
+                           const MetricLabels& labels = {});
+    MetricGauge& gauge(const string& name, const string& help,
+                       const MetricLabels& labels = {});
+
+    /**
+     * The counters, the gauges, the latency histograms and the memory
+     * per subsystem, in the OpenMetrics text format
+     */
+    string toOpenMetrics() const;
+
+    /**
+     * Replace path with toOpenMetrics(), atomically for scrapers
+     */
+    bool writeFile(const string& path) const;
+
+    /**
+     * Write the file every intervalSeconds from a thread of its own,
+     * and once more on stopExport(); a second call moves it
+     */
+    void startExport(const string& path, unsigned intervalSeconds);
+    void stopExport();
+
+    // Zero every counter and gauge; for the tests
+    void clear();
+
+    static string escapeLabel(const string& value);
+
+private:
+    MetricsRegistry() = default;
+    ~MetricsRegistry();
+
+    struct Family {
+        string type;                    // "counter" or "gauge"
+        string help;
+        map<string, unique_ptr<MetricCounter>> counters;    // By label text
+        map<string, unique_ptr<MetricGauge>> gauges;
+    };
+
+    Family& family(const string& name, const char *type, const string& help);
+    static string labelText(const MetricLabels& labels);
+
+    mutable std::mutex _mutex;
+    map<string, Family> _families;
+
+    std::mutex _exportMutex;            // Guards the three below
+    std::condition_variable _exportWakeup;
+    bool _exportStopping = false;
+    std::thread _exporter;
+};
+
+} // namespace PolySynaptic
+
+#endif // _METRICS_H_
+
+// vim:ts=4:sw=4:et
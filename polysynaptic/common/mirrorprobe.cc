@@ -0,0 +1,405 @@
+/* mirrorprobe.cc - Finding the fastest archive mirror
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "mirrorprobe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <set>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace PolySynaptic {
+
+using Clock = chrono::steady_clock;
+
+double MirrorResult::cost(uint64_t size) const
+{
+    if (!healthy || bytesPerSecond <= 0) {
+        return numeric_limits<double>::infinity();
+    }
+    return firstByteMs / 1000.0 + size / bytesPerSecond;
+}
+
+MirrorProbe::MirrorProbe(unsigned parallel)
+    : _ttlSeconds(DEFAULT_TTL_SECONDS), _pool(max(parallel, 1u))
+{
+}
+
+string MirrorProbe::cacheKey(const string& mirror, const string& probePath)
+{
+    return mirror + "\n" + probePath;
+}
+
+// ============================================================================
+// Measuring
+// ============================================================================
+
+namespace {
+
+struct HttpTarget {
+    string host;
+    string port = "80";
+    string path;                    // Always starts with '/'
+};
+
+bool parseHttpUri(const string& uri, HttpTarget& target, string& error)
+{
+    static const string scheme = "http://";
+    if (uri.compare(0, scheme.size(), scheme) != 0) {
+        error = "only http:// mirrors can be measured";
+        return false;
+    }
+
+    size_t slash = uri.find('/', scheme.size());
+    string authority = uri.substr(scheme.size(), slash - scheme.size());
+    target.path = slash == string::npos ? "/" : uri.substr(slash);
+
+    size_t at = authority.rfind('@');
+    if (at != string::npos) {
+        authority.erase(0, at + 1);
+    }
+
+    size_t colon;
+    if (!authority.empty() && authority[0] == '[') {
+        size_t close = authority.find(']');
+        if (close == string::npos) {
+            error = "malformed address in " + uri;
+            return false;
+        }
+        target.host = authority.substr(1, close - 1);
+        colon = authority.find(':', close);
+    } else {
+        colon = authority.find(':');
+        target.host = authority.substr(0, colon);
+    }
+    if (colon != string::npos && colon + 1 < authority.size()) {
+        target.port = authority.substr(colon + 1);
+    }
+
+    if (target.host.empty()) {
+        error = "no host in " + uri;
+        return false;
+    }
+    return true;
+}
+
+int remainingMs(Clock::time_point deadline)
+{
+    auto left = chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now());
+    return max<int>(left.count(), 0);
+}
+
+double msSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Wait for the socket; false on timeout, with errno set
+bool waitFor(int fd, short events, int timeoutMs)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    for (;;) {
+        int ret = poll(&pfd, 1, timeoutMs);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret == 0) errno = ETIMEDOUT;
+        return ret > 0;
+    }
+}
+
+int connectTo(const HttpTarget& target, Clock::time_point deadline, string& error)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    int gai = getaddrinfo(target.host.c_str(), target.port.c_str(), &hints, &addresses);
+    if (gai != 0) {
+        error = "cannot resolve " + target.host + ": " + gai_strerror(gai);
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                    a->ai_protocol);
+        if (fd < 0) continue;
+
+        int timeout = min(remainingMs(deadline), (int) MirrorProbe::CONNECT_TIMEOUT_MS);
+        bool ok = connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+        if (!ok && errno == EINPROGRESS && waitFor(fd, POLLOUT, timeout)) {
+            int soError = 0;
+            socklen_t len = sizeof(soError);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soError, &len);
+            ok = soError == 0;
+            errno = soError;
+        }
+        if (!ok) {
+            error = "cannot connect to " + target.host + ": " + strerror(errno);
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+bool sendAll(int fd, const string& data, Clock::time_point deadline)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) {
+            if (!waitFor(fd, POLLOUT, remainingMs(deadline))) return false;
+            continue;
+        }
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+} // namespace
+
+MirrorResult MirrorProbe::measure(const string& mirror, const string& probePath,
+                                  int timeoutMs, string *body)
+{
+    MirrorResult result;
+    result.uri = mirror;
+    result.probedAt = Clock::now();
+    Clock::time_point deadline = result.probedAt + chrono::milliseconds(timeoutMs);
+
+    HttpTarget target;
+    if (!parseHttpUri(mirror, target, result.error)) {
+        return result;
+    }
+    if (target.path.back() != '/') {
+        target.path += '/';
+    }
+    size_t relative = probePath.find_first_not_of('/');
+    if (relative != string::npos) {
+        target.path += probePath.substr(relative);
+    }
+
+    Clock::time_point connectStart = Clock::now();
+    int fd = connectTo(target, deadline, result.error);
+    if (fd < 0) {
+        return result;
+    }
+    result.latencyMs = msSince(connectStart);
+
+    // HTTP/1.0, so the body is never chunked and ends with the connection
+    string request = "GET " + target.path + " HTTP/1.0\r\n"
+                     "Host: " + target.host + "\r\n"
+                     "User-Agent: PolySynaptic mirror probe\r\n"
+                     "Cache-Control: no-cache\r\n"
+                     "\r\n";
+    Clock::time_point sentAt = Clock::now();
+    if (!sendAll(fd, request, deadline)) {
+        result.error = string("cannot send the request: ") + strerror(errno);
+        close(fd);
+        return result;
+    }
+
+    string header;
+    bool inBody = false;
+    bool ended = false;
+    Clock::time_point firstAt, lastAt;
+    char buffer[65536];
+
+    while (result.bytes < MAX_PROBE_BYTES) {
+        if (!waitFor(fd, POLLIN, remainingMs(deadline))) {
+            break;
+        }
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n <= 0) {
+            ended = n == 0;
+            if (n < 0) {
+                result.error = string("receive failed: ") + strerror(errno);
+            }
+            break;
+        }
+
+        lastAt = Clock::now();
+        if (header.empty() && !inBody) {
+            firstAt = lastAt;
+            result.firstByteMs = chrono::duration<double, milli>(firstAt - sentAt).count();
+        }
+        if (inBody) {
+            result.bytes += n;
+            if (body) body->append(buffer, n);
+            continue;
+        }
+
+        header.append(buffer, n);
+        size_t end = header.find("\r\n\r\n");
+        if (end == string::npos) {
+            if (header.size() > sizeof(buffer)) {
+                result.error = "response header too long";
+                break;
+            }
+            continue;
+        }
+
+        // "HTTP/1.1 200 OK"
+        size_t space = header.find(' ');
+        int status = space == string::npos ? 0 : atoi(header.c_str() + space + 1);
+        if (status != 200) {
+            result.error = "HTTP status " + to_string(status);
+            break;
+        }
+        inBody = true;
+        result.bytes = header.size() - (end + 4);
+        if (body) body->assign(header, end + 4, string::npos);
+    }
+    close(fd);
+
+    if (!inBody) {
+        if (result.error.empty()) {
+            result.error = ended ? "connection closed without a response"
+                                 : "timed out waiting for a response";
+        }
+        return result;
+    }
+    if (result.bytes == 0) {
+        result.error = "empty response";
+        return result;
+    }
+
+    // Over the whole transfer; at least a millisecond, for local mirrors
+    double seconds = max(chrono::duration<double>(lastAt - firstAt).count(), 0.001);
+    result.bytesPerSecond = result.bytes / seconds;
+    result.healthy = true;
+    result.error.clear();
+    return result;
+}
+
+// ============================================================================
+// Cache
+// ============================================================================
+
+vector<MirrorResult> MirrorProbe::probe(const vector<string>& mirrors,
+                                        const string& probePath, bool force)
+{
+    vector<MirrorResult> results;
+    vector<string> stale;
+    set<string> seen;
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        Clock::time_point now = Clock::now();
+        for (const string& mirror : mirrors) {
+            if (!seen.insert(mirror).second) continue;
+
+            auto found = _cache.find(cacheKey(mirror, probePath));
+            if (!force && found != _cache.end() && found->second.expires > now) {
+                results.push_back(found->second.result);
+            } else {
+                stale.push_back(mirror);
+            }
+        }
+    }
+
+    vector<future<MirrorResult>> pending;
+    for (const string& mirror : stale) {
+        pending.push_back(_pool.submit(TaskPriority::NORMAL, [mirror, probePath]() {
+            return measure(mirror, probePath);
+        }));
+    }
+
+    vector<MirrorResult> measured;
+    for (auto& result : pending) {
+        measured.push_back(result.get());
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    for (MirrorResult& result : measured) {
+        int ttl = result.healthy ? _ttlSeconds : min(_ttlSeconds, (int) FAILURE_TTL_SECONDS);
+        Cached& entry = _cache[cacheKey(result.uri, probePath)];
+        entry.result = result;
+        entry.expires = result.probedAt + chrono::seconds(ttl);
+        results.push_back(std::move(result));
+    }
+
+    rank(results);
+    return results;
+}
+
+bool MirrorProbe::cached(const string& mirror, const string& probePath,
+                         MirrorResult& result)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto found = _cache.find(cacheKey(mirror, probePath));
+    if (found == _cache.end() || found->second.expires <= Clock::now()) {
+        return false;
+    }
+    result = found->second.result;
+    return true;
+}
+
+void MirrorProbe::setTtl(int seconds)
+{
+    lock_guard<mutex> lock(_mutex);
+    _ttlSeconds = max(seconds, 0);
+    // Entries made under the old TTL keep their expiry
+}
+
+void MirrorProbe::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+    _cache.clear();
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+void MirrorProbe::rank(vector<MirrorResult>& results)
+{
+    stable_sort(results.begin(), results.end(),
+                [](const MirrorResult& a, const MirrorResult& b) {
+        if (a.healthy != b.healthy) {
+            return a.healthy;
+        }
+        return a.cost(REFERENCE_BYTES) < b.cost(REFERENCE_BYTES);
+    });
+}
+
+vector<string> MirrorProbe::readMirrorList(const string& path)
+{
+    vector<string> mirrors;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') continue;
+
+        size_t end = line.find_first_of(" \t\r", start);
+        mirrors.push_back(line.substr(start, end - start));
+    }
+    return mirrors;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,144 @@
+/* mirrorprobe.h - Finding the fastest archive mirror
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the measurements behind choosing a mirror for
+ * an APT source. A sources.list entry names one archive URI and APT
+ * fetches from it however slow it is from here; here each candidate
+ * mirror is asked for the same index file, in parallel, and ranked by
+ * its round trip and the rate it sent the file at, so the source can
+ * be pointed at the mirror that would finish an update first.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _MIRRORPROBE_H_
+#define _MIRRORPROBE_H_
+
+#include "taskpool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * MirrorResult - One mirror's measurement
+ */
+struct MirrorResult {
+    string uri;                     // Base URI, as a sources.list would name it
+    bool healthy = false;           // Sent the probe file
+    string error;                   // Why not, otherwise
+    double latencyMs = 0;           // TCP connect round trip
+    double firstByteMs = 0;         // Request to first response byte
+    double bytesPerSecond = 0;      // Rate the body arrived at
+    uint64_t bytes = 0;             // Body bytes read
+    chrono::steady_clock::time_point probedAt;
+
+    /**
+     * Estimated seconds to fetch this many bytes; unhealthy mirrors
+     * never finish
+     */
+    double cost(uint64_t size) const;
+};
+
+/**
+ * MirrorProbe - Measures and ranks candidate mirrors, with a cache
+ *
+ *     vector<MirrorResult> ranked =
+ *         probe.probe(candidates, "dists/" + dist + "/InRelease");
+ *     if (!ranked.empty() && ranked[0].healthy)
+ *         sources.ReplaceURI(record->URI, ranked[0].uri);
+ *
+ * Each candidate is connected to and sent a GET for the probe path
+ * under its base URI; the file is read up to MAX_PROBE_BYTES or until
+ * the deadline, whichever is first. Results are kept for the TTL, and
+ * failures for at most FAILURE_TTL so a mirror that was down is given
+ * another chance soon. Only http:// mirrors can be measured; others
+ * are reported unhealthy with the reason.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. probe() blocks until
+ *   every candidate answered or timed out.
+ */
+class MirrorProbe {
+public:
+    static const int CONNECT_TIMEOUT_MS = 3000;
+    static const int PROBE_TIMEOUT_MS = 8000;       // Whole probe, connect included
+    static const uint64_t MAX_PROBE_BYTES = 1 << 20;
+    // What an update fetches, roughly; weighs latency against rate
+    static const uint64_t REFERENCE_BYTES = 8 << 20;
+    static const int DEFAULT_TTL_SECONDS = 3600;
+    static const int FAILURE_TTL_SECONDS = 300;
+
+    explicit MirrorProbe(unsigned parallel = 4);
+
+    MirrorProbe(const MirrorProbe&) = delete;
+    MirrorProbe& operator=(const MirrorProbe&) = delete;
+
+    /**
+     * Measure the mirrors not measured recently, or all if force
+     *
+     * @return One result per distinct mirror, the fastest healthy first
+     */
+    vector<MirrorResult> probe(const vector<string>& mirrors, const string& probePath,
+                               bool force = false);
+
+    /**
+     * The cached result for a mirror, if it has not expired
+     */
+    bool cached(const string& mirror, const string& probePath, MirrorResult& result);
+
+    void setTtl(int seconds);
+    void clear();
+
+    /**
+     * Measure one mirror now, without the cache; with a body, what the
+     * mirror sent of the file is kept in it (up to MAX_PROBE_BYTES)
+     */
+    static MirrorResult measure(const string& mirror, const string& probePath,
+                                int timeoutMs = PROBE_TIMEOUT_MS,
+                                string *body = nullptr);
+
+    /**
+     * Order results by cost(REFERENCE_BYTES), healthy before unhealthy
+     */
+    static void rank(vector<MirrorResult>& results);
+
+    /**
+     * The mirrors of a list file in APT's mirror method format: one URI
+     * per line, optionally followed by tab separated metadata; '#'
+     * starts a comment
+     */
+    static vector<string> readMirrorList(const string& path);
+
+private:
+    struct Cached {
+        MirrorResult result;
+        chrono::steady_clock::time_point expires;
+    };
+
+    mutex _mutex;
+    map<string, Cached> _cache;             // By mirror and probe path
+    int _ttlSeconds;
+
+    // Last, so the workers stop before the cache goes away
+    TaskPool _pool;
+
+    static string cacheKey(const string& mirror, const string& probePath);
+};
+
+} // namespace PolySynaptic
+
+#endif // _MIRRORPROBE_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,314 @@
+/* operationhistory.cc - How long operations took before, to tell how long
+ *                       the next ones will
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "operationhistory.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace PolySynaptic {
+
+namespace {
+
+const char HISTORY_MAGIC[] = "# PolySynaptic operation history 1";
+
+using Type = Transaction::Operation::Type;
+
+// Nothing is predicted to take less
+const double MIN_SECONDS = 0.5;
+
+// Smaller downloads say more about the overhead than about the rate
+const int64_t MIN_RATE_BYTES = 1 << 20;
+
+// Until measured: a middling connection, and the time each backend
+// takes per install, removal and update besides the download
+const double DEFAULT_THROUGHPUT = 2.0 * (1 << 20);
+const double DEFAULT_OVERHEAD[3][3] = {
+    {3, 2, 3},      // APT: unpacking and configuring a deb
+    {20, 5, 15},    // Snap: mounting, connecting interfaces, hooks
+    {10, 3, 8},     // Flatpak: deploying and exporting
+};
+
+int backendIndex(BackendType backend)
+{
+    switch (backend) {
+        case BackendType::SNAP:     return 1;
+        case BackendType::FLATPAK:  return 2;
+        default:                    return 0;
+    }
+}
+
+int typeIndex(Type type)
+{
+    switch (type) {
+        case Type::REMOVE:  return 1;
+        case Type::UPDATE:  return 2;
+        default:            return 0;
+    }
+}
+
+const char* const BADGES[] = {"deb", "snap", "flatpak"};
+const char* const TYPE_NAMES[] = {"install", "remove", "update"};
+
+int indexOf(const char* const* names, const string& name)
+{
+    for (int i = 0; i < 3; i++) {
+        if (name == names[i]) return i;
+    }
+    return -1;
+}
+
+vector<string> split(const string& line)
+{
+    vector<string> fields;
+    size_t begin = 0;
+    while (true) {
+        size_t tab = line.find('\t', begin);
+        fields.push_back(line.substr(begin, tab - begin));
+        if (tab == string::npos) {
+            return fields;
+        }
+        begin = tab + 1;
+    }
+}
+
+} // anonymous namespace
+
+void OperationHistory::Average::add(double sample)
+{
+    value = runs == 0 ? sample : (value + sample) / 2;
+    runs++;
+}
+
+OperationHistory::OperationHistory(const string& path)
+    : _path(path)
+{
+    if (!_path.empty()) {
+        ifstream in(_path.c_str());
+        if (in) {
+            parse(in);
+        }
+    }
+}
+
+string OperationHistory::key(const Transaction::Operation& op)
+{
+    return string(BADGES[backendIndex(op.backend)]) + "\t" + TYPE_NAMES[typeIndex(op.type)] +
+           "\t" + op.packageId;
+}
+
+int64_t OperationHistory::bytesOf(const Transaction::Operation& op)
+{
+    if (op.type == Type::REMOVE) {
+        return 0;
+    }
+    return op.downloadSize > 0 ? op.downloadSize : -1;
+}
+
+double OperationHistory::throughputLocked(BackendType backend) const
+{
+    const Average& rate = _throughput[backendIndex(backend)];
+    return rate.runs > 0 && rate.value > 0 ? rate.value : DEFAULT_THROUGHPUT;
+}
+
+double OperationHistory::overheadLocked(const Transaction::Operation& op) const
+{
+    int b = backendIndex(op.backend), t = typeIndex(op.type);
+    const Average& overhead = _overhead[b][t];
+    return overhead.runs > 0 ? overhead.value : DEFAULT_OVERHEAD[b][t];
+}
+
+double OperationHistory::estimate(const Transaction::Operation& op) const
+{
+    lock_guard<mutex> lock(_mutex);
+    int64_t bytes = bytesOf(op);
+    double rate = throughputLocked(op.backend);
+
+    auto it = _entries.find(key(op));
+    if (it != _entries.end()) {
+        double seconds = it->second.seconds.value;
+        if (bytes >= 0 && it->second.bytes >= 0) {
+            seconds += (bytes - it->second.bytes) / rate;
+        }
+        return max(seconds, MIN_SECONDS);
+    }
+    return max(overheadLocked(op) + max<int64_t>(bytes, 0) / rate, MIN_SECONDS);
+}
+
+bool OperationHistory::known(const Transaction::Operation& op) const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _entries.count(key(op)) > 0;
+}
+
+void OperationHistory::record(const Transaction::Operation& op, double seconds,
+                              int64_t fetched)
+{
+    if (seconds < 0) {
+        return;
+    }
+    lock_guard<mutex> lock(_mutex);
+    int64_t bytes = fetched >= 0 ? fetched : bytesOf(op);
+    int b = backendIndex(op.backend), t = typeIndex(op.type);
+
+    // What the download took is what remains of the time the backend
+    // usually needs anyway; what it did not is that time
+    double overhead = overheadLocked(op);
+    if (bytes >= MIN_RATE_BYTES && seconds > overhead) {
+        _throughput[b].add(bytes / (seconds - overhead));
+    }
+    if (bytes >= 0) {
+        _overhead[b][t].add(max(seconds - bytes / throughputLocked(op.backend), 0.0));
+    }
+
+    Entry& entry = _entries[key(op)];
+    entry.seconds.add(seconds);
+    entry.bytes = bytes;
+    entry.used = ++_clock;
+    _dirty = true;
+    trimLocked();
+}
+
+void OperationHistory::recordThroughput(BackendType backend, int64_t bytes, double seconds)
+{
+    if (bytes < MIN_RATE_BYTES || seconds <= 0) {
+        return;
+    }
+    lock_guard<mutex> lock(_mutex);
+    _throughput[backendIndex(backend)].add(bytes / seconds);
+    _dirty = true;
+}
+
+double OperationHistory::throughput(BackendType backend) const
+{
+    lock_guard<mutex> lock(_mutex);
+    return throughputLocked(backend);
+}
+
+void OperationHistory::trimLocked()
+{
+    if (_entries.size() <= MAX_ENTRIES) {
+        return;
+    }
+    // Down to nine tenths, so it is not sorted again on the next run
+    vector<uint64_t> used;
+    used.reserve(_entries.size());
+    for (const auto& entry : _entries) {
+        used.push_back(entry.second.used);
+    }
+    size_t drop = _entries.size() - MAX_ENTRIES * 9 / 10;
+    nth_element(used.begin(), used.begin() + (drop - 1), used.end());
+    uint64_t oldest = used[drop - 1];
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        it = it->second.used <= oldest ? _entries.erase(it) : next(it);
+    }
+}
+
+void OperationHistory::write(ostream& out) const
+{
+    lock_guard<mutex> lock(_mutex);
+    out << HISTORY_MAGIC << "\n";
+    for (int b = 0; b < BACKENDS; b++) {
+        if (_throughput[b].runs > 0) {
+            out << "rate\t" << BADGES[b] << "\t" << _throughput[b].value << "\t"
+                << _throughput[b].runs << "\n";
+        }
+        for (int t = 0; t < TYPES; t++) {
+            if (_overhead[b][t].runs > 0) {
+                out << "overhead\t" << BADGES[b] << "\t" << TYPE_NAMES[t] << "\t"
+                    << _overhead[b][t].value << "\t" << _overhead[b][t].runs << "\n";
+            }
+        }
+    }
+    for (const auto& entry : _entries) {
+        out << "op\t" << entry.first << "\t" << entry.second.seconds.value << "\t"
+            << entry.second.seconds.runs << "\t" << entry.second.bytes << "\t"
+            << entry.second.used << "\n";
+    }
+}
+
+bool OperationHistory::parse(istream& in)
+{
+    lock_guard<mutex> lock(_mutex);
+    _entries.clear();
+    _clock = 0;
+    string line;
+    if (!getline(in, line) || line != HISTORY_MAGIC) {
+        return false;
+    }
+    while (getline(in, line)) {
+        vector<string> f = split(line);
+        int b = f.size() > 1 ? indexOf(BADGES, f[1]) : -1;
+        if (b < 0) {
+            continue;
+        }
+        if (f[0] == "rate" && f.size() == 4) {
+            _throughput[b].value = atof(f[2].c_str());
+            _throughput[b].runs = strtoul(f[3].c_str(), nullptr, 10);
+        } else if (f[0] == "overhead" && f.size() == 5) {
+            int t = indexOf(TYPE_NAMES, f[2]);
+            if (t < 0) continue;
+            _overhead[b][t].value = atof(f[3].c_str());
+            _overhead[b][t].runs = strtoul(f[4].c_str(), nullptr, 10);
+        } else if (f[0] == "op" && f.size() == 8 && !f[3].empty() &&
+                   indexOf(TYPE_NAMES, f[2]) >= 0) {
+            Entry& entry = _entries[f[1] + "\t" + f[2] + "\t" + f[3]];
+            entry.seconds.value = atof(f[4].c_str());
+            entry.seconds.runs = strtoul(f[5].c_str(), nullptr, 10);
+            entry.bytes = strtoll(f[6].c_str(), nullptr, 10);
+            entry.used = strtoull(f[7].c_str(), nullptr, 10);
+            _clock = max(_clock, entry.used);
+        }
+    }
+    return true;
+}
+
+bool OperationHistory::save()
+{
+    if (_path.empty()) {
+        return true;
+    }
+    ostringstream text;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_dirty) {
+            return true;
+        }
+        _dirty = false;
+    }
+    write(text);
+
+    // Only estimates depend on it, so a rename without a sync will do
+    string tmp = _path + ".tmp";
+    {
+        ofstream out(tmp.c_str(), ios::trunc);
+        out << text.str();
+        if (out.flush()) {
+            if (rename(tmp.c_str(), _path.c_str()) == 0) {
+                return true;
+            }
+        }
+    }
+    unlink(tmp.c_str());
+    lock_guard<mutex> lock(_mutex);
+    _dirty = true;
+    return false;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
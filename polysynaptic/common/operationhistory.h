@@ -0,0 +1,141 @@
+/* operationhistory.h - How long operations took before, to tell how long
+ *                      the next ones will
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the history the progress of a commit is weighed
+ * by. Each operation that ran is remembered by backend, kind and
+ * package with how long it took and how much it fetched, along with
+ * each backend's download rate and the time its operations take
+ * besides the download. A transaction's share for each operation is
+ * then its predicted time rather than one in however many, so a 2 GB
+ * runtime fills most of the bar instead of a fifteenth of it, and the
+ * remaining predicted time is the estimate shown and exported.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _OPERATIONHISTORY_H_
+#define _OPERATIONHISTORY_H_
+
+#include "backendmanager.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * OperationHistory - Past durations and sizes, and the estimates from them
+ *
+ *     double seconds = history.estimate(op);     // before it runs
+ *     history.record(op, elapsed);               // after it ran
+ *     history.save();
+ *
+ * An operation seen before is predicted from its own last runs, moved
+ * by the difference in size at the backend's download rate; one never
+ * seen from the backend's time per operation of its kind plus its size
+ * at the rate. Until a backend has a history of its own, defaults in
+ * the order of what each takes stand in. Sizes are the operation's
+ * downloadSize, where 0 means not known; removals fetch nothing.
+ *
+ * The file holds at most MAX_ENTRIES packages, the least recently
+ * used going first.
+ *
+ * Thread Safety:
+ *   All methods are thread-safe.
+ */
+class OperationHistory {
+public:
+    static const size_t MAX_ENTRIES = 4096;
+
+    /**
+     * Over the history at path, loading what it holds; "" keeps it in memory
+     */
+    explicit OperationHistory(const string& path);
+
+    /**
+     * Predicted seconds for op
+     */
+    double estimate(const Transaction::Operation& op) const;
+
+    /**
+     * Whether op itself has run before, rather than only its backend
+     */
+    bool known(const Transaction::Operation& op) const;
+
+    /**
+     * Note that op took seconds, fetching fetched bytes, or its
+     * downloadSize if that is -1
+     */
+    void record(const Transaction::Operation& op, double seconds, int64_t fetched = -1);
+
+    /**
+     * Note a download of bytes that took seconds, as the fetch of a
+     * commit reports it apart from the operations
+     */
+    void recordThroughput(BackendType backend, int64_t bytes, double seconds);
+
+    /**
+     * Bytes per second backend downloads at, measured or assumed
+     */
+    double throughput(BackendType backend) const;
+
+    /**
+     * Write it out if it changed since it was loaded or last saved
+     */
+    bool save();
+
+    /**
+     * Text form, one backend rate or package per line; parse() skips
+     * lines it does not understand and returns false only if it is not
+     * a history
+     */
+    void write(ostream& out) const;
+    bool parse(istream& in);
+
+private:
+    // Moving averages; a run counts for half against what came before
+    struct Average {
+        double value = 0;
+        unsigned runs = 0;
+        void add(double sample);
+    };
+
+    struct Entry {
+        Average seconds;
+        int64_t bytes = -1;         // Fetched by the last run, -1 if not known
+        uint64_t used = 0;          // _clock when last recorded
+    };
+
+    static const int BACKENDS = 3;
+    static const int TYPES = 3;
+
+    string _path;
+    mutable mutex _mutex;
+    unordered_map<string, Entry> _entries;
+    Average _throughput[BACKENDS];           // Bytes per second
+    Average _overhead[BACKENDS][TYPES];      // Seconds besides the download
+    uint64_t _clock = 0;
+    bool _dirty = false;
+
+    static string key(const Transaction::Operation& op);
+    static int64_t bytesOf(const Transaction::Operation& op);
+    double throughputLocked(BackendType backend) const;
+    double overheadLocked(const Transaction::Operation& op) const;
+    void trimLocked();
+};
+
+} // namespace PolySynaptic
+
+#endif // _OPERATIONHISTORY_H_
+
+// vim:ts=4:sw=4:et
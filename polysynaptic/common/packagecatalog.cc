@@ -0,0 +1,421 @@
+/* packagecatalog.cc - Persistent unified package catalog implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "packagecatalog.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace PolySynaptic {
+
+static const char CATALOG_MAGIC[8] = {'P', 'S', 'C', 'A', 'T', 'L', 'G', '\0'};
+
+// ============================================================================
+// Serialization Helpers
+// ============================================================================
+
+namespace {
+
+class Writer {
+public:
+    explicit Writer(ofstream& out) : _out(out) {}
+
+    void u32(uint32_t v) { _out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void i64(int64_t v) { _out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void u8(uint8_t v) { _out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+    void str(const string& s) {
+        u32(static_cast<uint32_t>(s.size()));
+        _out.write(s.data(), s.size());
+    }
+
+private:
+    ofstream& _out;
+};
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : _p(data), _end(data + size), _ok(true) {}
+
+    bool ok() const { return _ok; }
+
+    uint32_t u32() { uint32_t v = 0; raw(&v, sizeof(v)); return v; }
+    int64_t i64() { int64_t v = 0; raw(&v, sizeof(v)); return v; }
+    uint8_t u8() { uint8_t v = 0; raw(&v, sizeof(v)); return v; }
+
+    string str() {
+        uint32_t len = u32();
+        if (!_ok || static_cast<size_t>(_end - _p) < len) {
+            _ok = false;
+            return string();
+        }
+        string s(_p, len);
+        _p += len;
+        return s;
+    }
+
+    bool bytes(const char* expected, size_t len) {
+        if (static_cast<size_t>(_end - _p) < len || memcmp(_p, expected, len) != 0) {
+            _ok = false;
+            return false;
+        }
+        _p += len;
+        return true;
+    }
+
+private:
+    const char* _p;
+    const char* _end;
+    bool _ok;
+
+    void raw(void* out, size_t len) {
+        if (!_ok || static_cast<size_t>(_end - _p) < len) {
+            _ok = false;
+            return;
+        }
+        memcpy(out, _p, len);
+        _p += len;
+    }
+};
+
+void writePackage(Writer& w, const PackageInfo& pkg)
+{
+    w.str(pkg.id);
+    w.str(pkg.name);
+    w.str(pkg.summary);
+    w.str(pkg.description);
+    w.str(pkg.version);
+    w.str(pkg.installedVersion);
+    w.u8(static_cast<uint8_t>(pkg.installStatus));
+    w.str(pkg.section);
+    w.str(pkg.homepage);
+    w.str(pkg.maintainer);
+    w.str(pkg.license);
+    w.str(pkg.keywords);
+    w.i64(pkg.downloadSize);
+    w.i64(pkg.installedSize);
+    w.str(pkg.origin);
+    w.str(pkg.architecture);
+    w.str(pkg.channel);
+    w.str(pkg.confinement);
+    w.str(pkg.publisher);
+    w.u8(pkg.isClassic ? 1 : 0);
+    w.str(pkg.remote);
+    w.str(pkg.ref);
+    w.str(pkg.branch);
+    w.str(pkg.runtimeRef);
+    w.u8(static_cast<uint8_t>(pkg.deferredFields));
+}
+
+PackageInfo readPackage(Reader& r, BackendType backend)
+{
+    PackageInfo pkg;
+    pkg.backend = backend;
+    pkg.id = r.str();
+    pkg.name = r.str();
+    pkg.summary = r.str();
+    pkg.description = r.str();
+    pkg.version = r.str();
+    pkg.installedVersion = r.str();
+    pkg.installStatus = static_cast<InstallStatus>(r.u8());
+    pkg.section = r.str();
+    pkg.homepage = r.str();
+    pkg.maintainer = r.str();
+    pkg.license = r.str();
+    pkg.keywords = r.str();
+    pkg.downloadSize = r.i64();
+    pkg.installedSize = r.i64();
+    pkg.origin = r.str();
+    pkg.architecture = r.str();
+    pkg.channel = r.str();
+    pkg.confinement = r.str();
+    pkg.publisher = r.str();
+    pkg.isClassic = r.u8() != 0;
+    pkg.remote = r.str();
+    pkg.ref = r.str();
+    pkg.branch = r.str();
+    pkg.runtimeRef = r.str();
+    // The owning backend re-attaches itself as the source when the
+    // section is handed out (see BackendManager)
+    pkg.deferredFields = r.u8();
+    return pkg;
+}
+
+bool samePackageState(const PackageInfo& a, const PackageInfo& b)
+{
+    return a.version == b.version &&
+           a.installedVersion == b.installedVersion &&
+           a.installStatus == b.installStatus &&
+           a.name == b.name &&
+           // A deferred summary is unknown rather than empty
+           (a.isDeferred(PackageInfo::DEFER_SUMMARY) ||
+            b.isDeferred(PackageInfo::DEFER_SUMMARY) ||
+            a.summary == b.summary) &&
+           a.channel == b.channel &&
+           a.installedSize == b.installedSize;
+}
+
+// Append "<path>@<mtime>" for every path that exists
+void stampPath(string& stamp, const string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        if (!stamp.empty()) stamp += ";";
+        stamp += path + "@" + to_string(st.st_mtim.tv_sec) + "." +
+                 to_string(st.st_mtim.tv_nsec);
+    }
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Load / Save
+// ============================================================================
+
+bool PackageCatalog::load(const string& path)
+{
+    _sections.clear();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    Reader r(static_cast<const char*>(base), st.st_size);
+    map<BackendType, Section> sections;
+
+    if (r.bytes(CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) &&
+        r.u32() == FORMAT_VERSION) {
+        uint32_t sectionCount = r.u32();
+        for (uint32_t s = 0; r.ok() && s < sectionCount; s++) {
+            BackendType backend = static_cast<BackendType>(r.u32());
+            Section section;
+            section.generation = r.str();
+            uint32_t count = r.u32();
+            for (uint32_t i = 0; r.ok() && i < count; i++) {
+                section.packages.push_back(readPackage(r, backend));
+            }
+            sections[backend] = std::move(section);
+        }
+    }
+
+    bool ok = r.ok();
+    munmap(base, st.st_size);
+
+    if (!ok) {
+        return false;
+    }
+
+    _sections.swap(sections);
+    return true;
+}
+
+bool PackageCatalog::save(const string& path) const
+{
+    string tmpPath = path + ".tmp";
+
+    {
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+
+        Writer w(out);
+        out.write(CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+        w.u32(FORMAT_VERSION);
+        w.u32(static_cast<uint32_t>(_sections.size()));
+
+        for (const auto& entry : _sections) {
+            w.u32(static_cast<uint32_t>(entry.first));
+            w.str(entry.second.generation);
+            w.u32(static_cast<uint32_t>(entry.second.packages.size()));
+            for (const auto& pkg : entry.second.packages) {
+                writePackage(w, pkg);
+            }
+        }
+
+        if (!out.good()) {
+            out.close();
+            unlink(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================================
+// Sections
+// ============================================================================
+
+bool PackageCatalog::hasSection(BackendType backend) const
+{
+    return _sections.count(backend) > 0;
+}
+
+string PackageCatalog::getGeneration(BackendType backend) const
+{
+    auto it = _sections.find(backend);
+    return it != _sections.end() ? it->second.generation : string();
+}
+
+const vector<PackageInfo>& PackageCatalog::getPackages(BackendType backend) const
+{
+    static const vector<PackageInfo> empty;
+    auto it = _sections.find(backend);
+    return it != _sections.end() ? it->second.packages : empty;
+}
+
+CatalogDelta PackageCatalog::update(
+    BackendType backend,
+    const string& generation,
+    const vector<PackageInfo>& packages)
+{
+    Section& section = _sections[backend];
+    CatalogDelta delta = diff(section.packages, packages);
+
+    section.generation = generation;
+    section.packages = packages;
+
+    return delta;
+}
+
+// ============================================================================
+// Generation Stamps
+// ============================================================================
+
+string PackageCatalog::computeGeneration(BackendType backend)
+{
+    string stamp;
+
+    switch (backend) {
+        case BackendType::APT:
+            stampPath(stamp, "/var/cache/apt/pkgcache.bin");
+            stampPath(stamp, "/var/lib/dpkg/status");
+            break;
+        case BackendType::SNAP:
+            // Every install, removal and refresh adds or removes a blob
+            stampPath(stamp, "/var/lib/snapd/snaps");
+            break;
+        case BackendType::FLATPAK: {
+            // flatpak touches .changed after every deploy or uninstall
+            stampPath(stamp, "/var/lib/flatpak/.changed");
+            const char* home = getenv("HOME");
+            if (home) {
+                stampPath(stamp, string(home) + "/.local/share/flatpak/.changed");
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    return stamp;
+}
+
+// ============================================================================
+// Deltas
+// ============================================================================
+
+CatalogDelta PackageCatalog::diff(
+    const vector<PackageInfo>& before,
+    const vector<PackageInfo>& after)
+{
+    CatalogDelta delta;
+
+    unordered_map<uint64_t, const PackageInfo*> previous;
+    previous.reserve(before.size());
+    for (const auto& pkg : before) {
+        previous[pkg.identity()] = &pkg;
+    }
+
+    for (const auto& pkg : after) {
+        auto it = previous.find(pkg.identity());
+        if (it == previous.end()) {
+            delta.added.push_back(pkg);
+        } else {
+            if (!samePackageState(*it->second, pkg)) {
+                delta.changed.push_back(pkg);
+            }
+            previous.erase(it);
+        }
+    }
+
+    // Whatever is left disappeared
+    for (const auto& pkg : before) {
+        if (previous.count(pkg.identity()) > 0) {
+            delta.removed.push_back(pkg);
+        }
+    }
+
+    return delta;
+}
+
+void PackageCatalog::applyDelta(vector<PackageInfo>& packages, const CatalogDelta& delta)
+{
+    if (delta.empty()) {
+        return;
+    }
+
+    unordered_map<uint64_t, const PackageInfo*> changed;
+    for (const auto& pkg : delta.changed) {
+        changed[pkg.identity()] = &pkg;
+    }
+
+    unordered_set<uint64_t> removed;
+    for (const auto& pkg : delta.removed) {
+        removed.insert(pkg.identity());
+    }
+
+    vector<PackageInfo> result;
+    result.reserve(packages.size() + delta.added.size());
+
+    for (auto& pkg : packages) {
+        uint64_t key = pkg.identity();
+        if (removed.count(key) > 0) {
+            continue;
+        }
+        auto it = changed.find(key);
+        result.push_back(it != changed.end() ? *it->second : std::move(pkg));
+    }
+
+    result.insert(result.end(), delta.added.begin(), delta.added.end());
+    packages.swap(result);
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,149 @@
+/* packagecatalog.h - Persistent unified package catalog for PolySynaptic
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements an on-disk cache of the last known installed
+ * package set of every backend. It lets the UI paint the unified view
+ * immediately at startup and revalidate against the backends later.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PACKAGECATALOG_H_
+#define _PACKAGECATALOG_H_
+
+#include "ipackagebackend.h"
+
+#include <cstdint>
+
+namespace PolySynaptic {
+
+/**
+ * CatalogDelta - Difference between two package sets
+ */
+struct CatalogDelta {
+    vector<PackageInfo> added;
+    vector<PackageInfo> changed;     // Same id/backend, different state
+    vector<PackageInfo> removed;
+
+    bool empty() const {
+        return added.empty() && changed.empty() && removed.empty();
+    }
+
+    size_t size() const {
+        return added.size() + changed.size() + removed.size();
+    }
+};
+
+/**
+ * PackageCatalog - Versioned, memory-mapped package catalog
+ *
+ * The catalog holds one section per backend. Each section records the
+ * backend's generation stamp at the time it was captured, so callers
+ * can tell whether the cached set is still current without querying
+ * the backend at all.
+ *
+ * Generation Stamps:
+ *   APT      - mtimes of pkgcache.bin and the dpkg status file
+ *   Snap     - mtime of snapd's snap blob directory
+ *   Flatpak  - mtimes of the user and system ".changed" markers
+ *
+ * File Format (host byte order, FORMAT_VERSION 3):
+ *   char[8]  magic "PSCATLG\0"
+ *   uint32   format version
+ *   uint32   section count
+ *   per section:
+ *     uint32 backend, string generation, uint32 package count,
+ *     per package: all PackageInfo fields, strings as uint32 length
+ *     followed by the bytes, then the uint8 deferredFields bits
+ *
+ * The file is read through mmap and written atomically (temp file and
+ * rename). Files with another magic or version are ignored.
+ *
+ * Thread Safety:
+ *   Not thread-safe; BackendManager serializes access.
+ */
+class PackageCatalog {
+public:
+    static const uint32_t FORMAT_VERSION = 3;
+
+    PackageCatalog() = default;
+
+    /**
+     * Load the catalog from disk, replacing the current contents
+     *
+     * @return false if the file is missing, truncated or of another version
+     */
+    bool load(const string& path);
+
+    /**
+     * Write the catalog to disk atomically
+     */
+    bool save(const string& path) const;
+
+    /**
+     * Check whether a section exists for the backend
+     */
+    bool hasSection(BackendType backend) const;
+
+    /**
+     * Get the generation stamp recorded for a backend ("" if none)
+     */
+    string getGeneration(BackendType backend) const;
+
+    /**
+     * Get the cached packages of a backend (empty if none)
+     */
+    const vector<PackageInfo>& getPackages(BackendType backend) const;
+
+    /**
+     * Replace a backend's section
+     *
+     * @return Differences between the previous and the new package set
+     */
+    CatalogDelta update(BackendType backend,
+                        const string& generation,
+                        const vector<PackageInfo>& packages);
+
+    /**
+     * Drop all sections
+     */
+    void clear() { _sections.clear(); }
+
+    /**
+     * Compute the current generation stamp of a backend
+     *
+     * Returns an empty string if no stamp can be determined, in which
+     * case the cached section must always be revalidated.
+     */
+    static string computeGeneration(BackendType backend);
+
+    /**
+     * Compute the differences between two package sets
+     */
+    static CatalogDelta diff(const vector<PackageInfo>& before,
+                             const vector<PackageInfo>& after);
+
+    /**
+     * Apply a delta to a package list in place
+     */
+    static void applyDelta(vector<PackageInfo>& packages,
+                           const CatalogDelta& delta);
+
+private:
+    struct Section {
+        string generation;
+        vector<PackageInfo> packages;
+    };
+
+    map<BackendType, Section> _sections;
+};
+
+} // namespace PolySynaptic
+
+#endif // _PACKAGECATALOG_H_
+
+// vim:ts=4:sw=4:et
@@ -11,7 +11,10 @@
 #include "packageranking.h"
 
 #include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <regex>
 
 namespace PolySynaptic {
@@ -20,70 +23,340 @@ namespace PolySynaptic {
 // PackageRanker Implementation
 // ============================================================================
 
+namespace {
+
+// Names and descriptions of the score components, in evaluation order
+const struct {
+    const char* name;
+    const char* description;
+} COMPONENTS[] = {
+    {"Trust", "Publisher trust and verification status"},
+    {"Confinement", "Sandboxing and isolation level"},
+    {"Permissions", "Requested permissions and access"},
+    {"Update Frequency", "How frequently the package is updated"},
+    {"Version Recency", "How recent the available version is"},
+    {"Provider Preference", "User's preferred package source"},
+    {"Popularity", "Usage and community adoption"},
+};
+
+// Names setCustomScorer() takes, in component order
+const char* const SCORER_NAMES[] = {
+    "Trust", "Confinement", "Permissions", "UpdateFrequency",
+    "VersionRecency", "ProviderPreference", "Popularity",
+};
+
+enum Component {
+    TRUST, CONFINEMENT, PERMISSIONS, UPDATE_FREQUENCY,
+    VERSION_RECENCY, PROVIDER_PREFERENCE, POPULARITY
+};
+
+// The providers the built-in rules tell apart
+enum ProviderKind {
+    KIND_APT, KIND_FLATPAK, KIND_SNAP, KIND_OTHER
+};
+
+ProviderKind providerKind(const std::string& providerId) {
+    if (providerId == "apt") return KIND_APT;
+    if (providerId == "flatpak") return KIND_FLATPAK;
+    if (providerId == "snap") return KIND_SNAP;
+    return KIND_OTHER;
+}
+
+ProviderKind providerKind(SourceType source) {
+    switch (source) {
+        case SourceType::APT:       return KIND_APT;
+        case SourceType::FLATPAK:   return KIND_FLATPAK;
+        case SourceType::SNAP:      return KIND_SNAP;
+        default:                    return KIND_OTHER;
+    }
+}
+
+// The provider id RankingConfig::providerPriority names a source by
+std::string providerIdOf(SourceType source) {
+    std::string id = sourceTypeToString(source);
+    for (char& c : id) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return id;
+}
+
+size_t permissionCount(const PackagePermissions& perms) {
+    return perms.hasNetworkAccess + perms.hasHomeAccess + perms.hasSystemBusAccess +
+           perms.hasSessionBusAccess + perms.hasDeviceAccess + perms.hasAudioAccess +
+           perms.hasDisplayAccess + perms.hasGpuAccess + perms.hasCameraAccess +
+           perms.hasBluetoothAccess + perms.hasUsbAccess + perms.hasFileSystemAccess +
+           perms.customPermissions.size();
+}
+
+// The built-in rules, shared by the scoring kernel and the score methods
+
+double trustScore(TrustLevel level) {
+    switch (level) {
+        case TrustLevel::SYSTEM:
+        case TrustLevel::OFFICIAL:
+            return 1.0;
+        case TrustLevel::VERIFIED:
+            return 0.85;
+        case TrustLevel::COMMUNITY:
+            return 0.6;
+        case TrustLevel::UNTRUSTED:
+        default:
+            return 0.2;
+    }
+}
+
+double confinementScore(ConfinementLevel level, ProviderKind kind) {
+    switch (level) {
+        case ConfinementLevel::STRICT:
+            return 1.0;
+        case ConfinementLevel::CLASSIC:
+            return 0.5;
+        case ConfinementLevel::DEVMODE:
+            return 0.3;
+        case ConfinementLevel::NONE:
+            // APT packages are unconfined but this isn't necessarily bad
+            // as they're usually from trusted repos
+            if (kind == KIND_APT) {
+                return 0.7;  // APT gets partial credit due to repo trust
+            }
+            return 0.2;
+        case ConfinementLevel::CUSTOM:
+        default:
+            return 0.4;
+    }
+}
+
+double permissionScore(size_t permCount, ProviderKind kind) {
+    // APT packages have full access, but from trusted sources
+    if (kind == KIND_APT) {
+        return 0.7;  // Middle ground
+    }
+
+    // For Snap/Flatpak, fewer permissions = higher score
+    if (permCount == 0) {
+        return 1.0;  // No special permissions
+    } else if (permCount <= 3) {
+        return 0.9;
+    } else if (permCount <= 5) {
+        return 0.7;
+    } else if (permCount <= 10) {
+        return 0.5;
+    } else {
+        return 0.3;  // Many permissions
+    }
+}
+
+// These would ideally check actual update history and compare versions
+// across providers; for now each provider gets a score by its typical
+// pattern, by ProviderKind
+const double UPDATE_FREQUENCY_BY_KIND[] = {
+    0.7,    // APT depends on distro maintainers
+    0.9,    // Flatpak apps are often updated directly by devs
+    0.85,   // Snaps auto-update
+    0.5,
+};
+const double VERSION_RECENCY_BY_KIND[] = {
+    0.6,    // Often behind upstream
+    0.9,    // Usually have latest versions
+    0.9,
+    0.5,
+};
+
+// Providers not in the preference list
+const double UNLISTED_PREFERENCE = 0.3;
+
+double popularityScore(const PopularityIndex* popularity, const UnifiedPackage& pkg) {
+    PopularityIndex::Source source = PopularityIndex::sourceFor(providerIdOf(pkg.source));
+    if (!popularity || source == PopularityIndex::SOURCE_COUNT ||
+        !popularity->hasSource(source)) {
+        return 0.5;  // Nothing known; neutral
+    }
+
+    double score;
+    if (popularity->find(source, pkg.id, score)) {
+        return score;
+    }
+    // Fewer installs than anything the dataset lists
+    return 0.1;
+}
+
+// RankingConfig's defaults as normalize() leaves them, summed in its
+// order, and the provider preference its priority gives each kind. A
+// configuration is taken for the default only if it matches these
+// exactly, so were the defaults to move apart the kernel would merely
+// stop being specialized for them.
+constexpr double DEFAULT_SUM = 0.30 + 0.15 + 0.10 + 0.10 + 0.10 + 0.15 + 0.10;
+constexpr double DEFAULT_WEIGHTS[] = {
+    0.30 / DEFAULT_SUM, 0.15 / DEFAULT_SUM, 0.10 / DEFAULT_SUM, 0.10 / DEFAULT_SUM,
+    0.10 / DEFAULT_SUM, 0.15 / DEFAULT_SUM, 0.10 / DEFAULT_SUM,
+};
+constexpr double DEFAULT_PREFERENCE[] = {
+    1.0 - 0 * 0.6 / 3, 1.0 - 1 * 0.6 / 3, 1.0 - 2 * 0.6 / 3, UNLISTED_PREFERENCE,
+};
+
+} // anonymous namespace
+
 PackageRanker::PackageRanker() : _config() {
     _config.normalize();
+    prepareKernel();
 }
 
 PackageRanker::PackageRanker(const RankingConfig& config) : _config(config) {
     _config.normalize();
+    prepareKernel();
+}
+
+void PackageRanker::prepareKernel() {
+    getWeights(_weights);
+
+    // Score decreases with position (first = 1.0, last = 0.4)
+    const auto& prefs = _config.providerPriority;
+    size_t total = prefs.size();
+    std::fill(_preference, _preference + PROVIDER_KINDS, UNLISTED_PREFERENCE);
+    bool known = true;
+    for (size_t pos = total; pos-- > 0;) {
+        ProviderKind kind = providerKind(prefs[pos]);
+        if (kind == KIND_OTHER) {
+            known = false;
+        } else {
+            _preference[kind] = 1.0 - (pos * 0.6 / total);   // First position wins
+        }
+    }
+
+    _kernelUsable = known;
+    for (const auto& scorer : _customScorers) {
+        if (scorer) {
+            _kernelUsable = false;
+        }
+    }
+    _defaultConfig = std::equal(_weights, _weights + COMPONENT_COUNT, DEFAULT_WEIGHTS) &&
+                     std::equal(_preference, _preference + PROVIDER_KINDS,
+                                DEFAULT_PREFERENCE);
+}
+
+template <bool DefaultConfig, bool HasPopularity>
+void PackageRanker::kernelScores(const UnifiedPackage& pkg,
+                                 double raw[COMPONENT_COUNT]) const
+{
+    const ProviderKind kind = providerKind(pkg.source);
+    raw[TRUST] = trustScore(pkg.metadata.trustLevel);
+    raw[CONFINEMENT] = confinementScore(pkg.metadata.confinement, kind);
+    raw[PERMISSIONS] = permissionScore(permissionCount(pkg.metadata.permissions), kind);
+    raw[UPDATE_FREQUENCY] = UPDATE_FREQUENCY_BY_KIND[kind];
+    raw[VERSION_RECENCY] = VERSION_RECENCY_BY_KIND[kind];
+    raw[PROVIDER_PREFERENCE] = DefaultConfig ? DEFAULT_PREFERENCE[kind] : _preference[kind];
+    raw[POPULARITY] = HasPopularity ? popularityScore(_popularity.get(), pkg) : 0.5;
+}
+
+template <bool DefaultConfig, bool HasPopularity>
+void PackageRanker::kernelTotals(const std::vector<UnifiedPackage>& packages,
+                                 std::vector<double>& totals) const
+{
+    const double* weights = DefaultConfig ? DEFAULT_WEIGHTS : _weights;
+    totals.resize(packages.size());
+    for (size_t i = 0; i < packages.size(); i++) {
+        double raw[COMPONENT_COUNT];
+        kernelScores<DefaultConfig, HasPopularity>(packages[i], raw);
+
+        // Summed in the order totalScore() sums, for the same rounding
+        double total = 0.0;
+        for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+            total += weights[c] * raw[c];
+        }
+        totals[i] = total;
+    }
+}
+
+void PackageRanker::kernelScores(const UnifiedPackage& pkg,
+                                 double raw[COMPONENT_COUNT]) const
+{
+    bool popularity = _popularity != nullptr;
+    if (_defaultConfig) {
+        popularity ? kernelScores<true, true>(pkg, raw) : kernelScores<true, false>(pkg, raw);
+    } else {
+        popularity ? kernelScores<false, true>(pkg, raw) : kernelScores<false, false>(pkg, raw);
+    }
+}
+
+void PackageRanker::kernelTotals(const std::vector<UnifiedPackage>& packages,
+                                 std::vector<double>& totals) const
+{
+    bool popularity = _popularity != nullptr;
+    if (_defaultConfig) {
+        popularity ? kernelTotals<true, true>(packages, totals)
+                   : kernelTotals<true, false>(packages, totals);
+    } else {
+        popularity ? kernelTotals<false, true>(packages, totals)
+                   : kernelTotals<false, false>(packages, totals);
+    }
+}
+
+const PackageRanker::ComponentScores& PackageRanker::componentScores(
+    const UnifiedPackage& pkg)
+{
+    auto [it, inserted] = _componentCache.try_emplace(providerIdOf(pkg.source) + ":" + pkg.id);
+    ComponentScores& scores = it->second;
+
+    if (inserted || scores.revision != pkg.metadata.revision) {
+        scores.revision = pkg.metadata.revision;
+        scores.raw[0] = scoreTrust(pkg);
+        scores.raw[1] = scoreConfinement(pkg);
+        scores.raw[2] = scorePermissions(pkg);
+        scores.raw[3] = scoreUpdateFrequency(pkg);
+        scores.raw[4] = scoreVersionRecency(pkg);
+        scores.raw[5] = scoreProviderPreference(pkg);
+        scores.raw[6] = scorePopularity(pkg);
+    }
+
+    return scores;
+}
+
+void PackageRanker::getWeights(double weights[COMPONENT_COUNT]) const {
+    weights[0] = _config.trustWeight;
+    weights[1] = _config.confinementWeight;
+    weights[2] = _config.permissionWeight;
+    weights[3] = _config.updateFrequencyWeight;
+    weights[4] = _config.versionRecencyWeight;
+    weights[5] = _config.providerPreferenceWeight;
+    weights[6] = _config.popularityWeight;
+}
+
+int PackageRanker::totalScore(const double raw[COMPONENT_COUNT]) const {
+    double totalWeighted = 0.0;
+    for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+        totalWeighted += _weights[c] * raw[c];
+    }
+
+    int total = static_cast<int>(std::round(totalWeighted * 100));
+    return std::max(0, std::min(100, total));
 }
 
 PackageScore PackageRanker::scorePackage(const UnifiedPackage& package) {
+    return explainPackage(package);
+}
+
+PackageScore PackageRanker::explainPackage(const UnifiedPackage& package) {
+    syncPopularity();
+
     PackageScore score;
     score.packageId = package.id;
-    score.providerId = package.providerId;
-
-    // Calculate individual components
-    score.components.push_back(ScoreComponent(
-        "Trust",
-        "Publisher trust and verification status",
-        _config.trustWeight,
-        scoreTrust(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Confinement",
-        "Sandboxing and isolation level",
-        _config.confinementWeight,
-        scoreConfinement(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Permissions",
-        "Requested permissions and access",
-        _config.permissionWeight,
-        scorePermissions(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Update Frequency",
-        "How frequently the package is updated",
-        _config.updateFrequencyWeight,
-        scoreUpdateFrequency(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Version Recency",
-        "How recent the available version is",
-        _config.versionRecencyWeight,
-        scoreVersionRecency(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Provider Preference",
-        "User's preferred package source",
-        _config.providerPreferenceWeight,
-        scoreProviderPreference(package)));
-
-    score.components.push_back(ScoreComponent(
-        "Popularity",
-        "Usage and community adoption",
-        _config.popularityWeight,
-        scorePopularity(package)));
-
-    // Calculate total score
-    double totalWeighted = 0.0;
-    for (const auto& comp : score.components) {
-        totalWeighted += comp.weightedScore;
+    score.providerId = providerIdOf(package.source);
+
+    double kernelRaw[COMPONENT_COUNT];
+    const double* raw = kernelRaw;
+    if (_kernelUsable) {
+        kernelScores(package, kernelRaw);
+    } else {
+        raw = componentScores(package).raw;
     }
 
-    score.totalScore = static_cast<int>(std::round(totalWeighted * 100));
-    score.totalScore = std::max(0, std::min(100, score.totalScore));
+    score.components.reserve(COMPONENT_COUNT);
+    for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+        score.components.push_back(ScoreComponent(
+            COMPONENTS[c].name, COMPONENTS[c].description, _weights[c], raw[c]));
+    }
+
+    score.totalScore = totalScore(raw);
 
     // Determine recommendation
     score.recommendation = getRecommendation(score.totalScore, package);
@@ -98,20 +371,74 @@ PackageScore PackageRanker::scorePackage(const UnifiedPackage& package) {
 std::vector<PackageScore> PackageRanker::rankPackages(
     const std::vector<UnifiedPackage>& packages)
 {
+    auto ranked = rankBatch(packages);
+
     std::vector<PackageScore> scores;
-    scores.reserve(packages.size());
+    scores.reserve(ranked.size());
+    for (const auto& entry : ranked) {
+        scores.push_back(explainPackage(packages[entry.index]));
+    }
 
-    for (const auto& pkg : packages) {
-        scores.push_back(scorePackage(pkg));
+    return scores;
+}
+
+int PackageRanker::rankScore(const UnifiedPackage& package) {
+    syncPopularity();
+    if (_kernelUsable) {
+        double raw[COMPONENT_COUNT];
+        kernelScores(package, raw);
+        return totalScore(raw);
+    }
+    return totalScore(componentScores(package).raw);
+}
+
+std::vector<RankedPackage> PackageRanker::rankBatch(
+    const std::vector<UnifiedPackage>& packages)
+{
+    syncPopularity();
+    const size_t count = packages.size();
+
+    std::vector<double> totals(count, 0.0);
+    if (_kernelUsable) {
+        kernelTotals(packages, totals);
+    } else {
+        // Gather the components column by column
+        std::vector<double> columns[COMPONENT_COUNT];
+        for (auto& column : columns) {
+            column.resize(count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            const double* raw = componentScores(packages[i]).raw;
+            for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+                columns[c][i] = raw[c];
+            }
+        }
+
+        for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+            const double w = _weights[c];
+            const double* column = columns[c].data();
+            for (size_t i = 0; i < count; i++) {
+                totals[i] += w * column[i];
+            }
+        }
+    }
+
+    std::vector<RankedPackage> ranked(count);
+    for (size_t i = 0; i < count; i++) {
+        int total = static_cast<int>(std::round(totals[i] * 100));
+        ranked[i].index = i;
+        ranked[i].totalScore = std::max(0, std::min(100, total));
+        ranked[i].recommendation = getRecommendation(ranked[i].totalScore,
+                                                     packages[i]);
     }
 
     // Sort by total score (descending)
-    std::sort(scores.begin(), scores.end(),
-              [](const PackageScore& a, const PackageScore& b) {
-                  return a.totalScore > b.totalScore;
-              });
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const RankedPackage& a, const RankedPackage& b) {
+                         return a.totalScore > b.totalScore;
+                     });
 
-    return scores;
+    return ranked;
 }
 
 std::optional<PackageScore> PackageRanker::getBestPackage(
@@ -121,8 +448,8 @@ std::optional<PackageScore> PackageRanker::getBestPackage(
         return std::nullopt;
     }
 
-    auto ranked = rankPackages(packages);
-    return ranked.front();
+    auto ranked = rankBatch(packages);
+    return explainPackage(packages[ranked.front().index]);
 }
 
 PackageRanker::ComparisonResult PackageRanker::comparePackages(
@@ -134,9 +461,9 @@ PackageRanker::ComparisonResult PackageRanker::comparePackages(
     result.second = scorePackage(b);
 
     if (result.first.totalScore > result.second.totalScore) {
-        result.winner = a.providerId;
+        result.winner = providerIdOf(a.source);
     } else if (result.second.totalScore > result.first.totalScore) {
-        result.winner = b.providerId;
+        result.winner = providerIdOf(b.source);
     } else {
         result.winner = "";  // Tie
     }
@@ -151,9 +478,9 @@ PackageRanker::ComparisonResult PackageRanker::comparePackages(
         if (std::abs(diff) > 0.1) {
             std::string reason = compA.name + ": ";
             if (diff > 0) {
-                reason += a.providerId + " scores higher";
+                reason += providerIdOf(a.source) + " scores higher";
             } else {
-                reason += b.providerId + " scores higher";
+                reason += providerIdOf(b.source) + " scores higher";
             }
             result.reasons.push_back(reason);
         }
@@ -165,7 +492,33 @@ PackageRanker::ComparisonResult PackageRanker::comparePackages(
 void PackageRanker::setCustomScorer(const std::string& component,
                                      ScoringFunction fn)
 {
-    _customScorers[component] = std::move(fn);
+    for (size_t c = 0; c < COMPONENT_COUNT; c++) {
+        if (component == SCORER_NAMES[c]) {
+            _customScorers[c] = std::move(fn);
+            _componentCache.clear();
+            prepareKernel();
+            return;
+        }
+    }
+}
+
+void PackageRanker::setPopularityIndex(std::shared_ptr<const PopularityIndex> index)
+{
+    _popularity = std::move(index);
+    _popularityPinned = true;
+    _componentCache.clear();
+}
+
+void PackageRanker::syncPopularity()
+{
+    if (_popularityPinned) {
+        return;
+    }
+    std::shared_ptr<const PopularityIndex> current = PopularityIndex::peek();
+    if (current != _popularity) {
+        _popularity = std::move(current);
+        _componentCache.clear();
+    }
 }
 
 // ============================================================================
@@ -173,123 +526,52 @@ void PackageRanker::setCustomScorer(const std::string& component,
 // ============================================================================
 
 double PackageRanker::scoreTrust(const UnifiedPackage& pkg) {
-    if (_customScorers.count("Trust") > 0) {
-        return _customScorers["Trust"](pkg);
-    }
-
-    switch (pkg.trustLevel) {
-        case TrustLevel::OFFICIAL:
-            return 1.0;
-        case TrustLevel::VERIFIED:
-            return 0.85;
-        case TrustLevel::COMMUNITY:
-            return 0.6;
-        case TrustLevel::THIRD_PARTY:
-            return 0.4;
-        case TrustLevel::UNKNOWN:
-        default:
-            return 0.2;
+    if (_customScorers[TRUST]) {
+        return _customScorers[TRUST](pkg);
     }
+    return trustScore(pkg.metadata.trustLevel);
 }
 
 double PackageRanker::scoreConfinement(const UnifiedPackage& pkg) {
-    if (_customScorers.count("Confinement") > 0) {
-        return _customScorers["Confinement"](pkg);
-    }
-
-    switch (pkg.confinement) {
-        case ConfinementLevel::STRICT:
-            return 1.0;
-        case ConfinementLevel::CLASSIC:
-            return 0.5;
-        case ConfinementLevel::DEVMODE:
-            return 0.3;
-        case ConfinementLevel::UNCONFINED:
-            // APT packages are unconfined but this isn't necessarily bad
-            // as they're usually from trusted repos
-            if (pkg.providerId == "apt") {
-                return 0.7;  // APT gets partial credit due to repo trust
-            }
-            return 0.2;
-        case ConfinementLevel::UNKNOWN:
-        default:
-            return 0.4;
+    if (_customScorers[CONFINEMENT]) {
+        return _customScorers[CONFINEMENT](pkg);
     }
+    return confinementScore(pkg.metadata.confinement, providerKind(pkg.source));
 }
 
 double PackageRanker::scorePermissions(const UnifiedPackage& pkg) {
-    if (_customScorers.count("Permissions") > 0) {
-        return _customScorers["Permissions"](pkg);
-    }
-
-    // APT packages have full access, but from trusted sources
-    if (pkg.providerId == "apt") {
-        return 0.7;  // Middle ground
-    }
-
-    // For Snap/Flatpak, fewer permissions = higher score
-    size_t permCount = pkg.permissions.permissions.size();
-
-    if (permCount == 0) {
-        return 1.0;  // No special permissions
-    } else if (permCount <= 3) {
-        return 0.9;
-    } else if (permCount <= 5) {
-        return 0.7;
-    } else if (permCount <= 10) {
-        return 0.5;
-    } else {
-        return 0.3;  // Many permissions
+    if (_customScorers[PERMISSIONS]) {
+        return _customScorers[PERMISSIONS](pkg);
     }
+    return permissionScore(permissionCount(pkg.metadata.permissions),
+                           providerKind(pkg.source));
 }
 
 double PackageRanker::scoreUpdateFrequency(const UnifiedPackage& pkg) {
-    if (_customScorers.count("UpdateFrequency") > 0) {
-        return _customScorers["UpdateFrequency"](pkg);
-    }
-
-    // This would ideally check actual update history
-    // For now, give providers default scores based on typical update patterns
-
-    if (pkg.providerId == "flatpak") {
-        return 0.9;  // Flatpak apps are often updated directly by devs
-    } else if (pkg.providerId == "snap") {
-        return 0.85;  // Snaps auto-update
-    } else if (pkg.providerId == "apt") {
-        return 0.7;  // APT depends on distro maintainers
+    if (_customScorers[UPDATE_FREQUENCY]) {
+        return _customScorers[UPDATE_FREQUENCY](pkg);
     }
-
-    return 0.5;
+    return UPDATE_FREQUENCY_BY_KIND[providerKind(pkg.source)];
 }
 
 double PackageRanker::scoreVersionRecency(const UnifiedPackage& pkg) {
-    if (_customScorers.count("VersionRecency") > 0) {
-        return _customScorers["VersionRecency"](pkg);
+    if (_customScorers[VERSION_RECENCY]) {
+        return _customScorers[VERSION_RECENCY](pkg);
     }
-
-    // Would ideally compare versions across providers
-    // For now, give default scores based on typical patterns
-
-    if (pkg.providerId == "flatpak" || pkg.providerId == "snap") {
-        return 0.9;  // Usually have latest versions
-    } else if (pkg.providerId == "apt") {
-        return 0.6;  // Often behind upstream
-    }
-
-    return 0.5;
+    return VERSION_RECENCY_BY_KIND[providerKind(pkg.source)];
 }
 
 double PackageRanker::scoreProviderPreference(const UnifiedPackage& pkg) {
-    if (_customScorers.count("ProviderPreference") > 0) {
-        return _customScorers["ProviderPreference"](pkg);
+    if (_customScorers[PROVIDER_PREFERENCE]) {
+        return _customScorers[PROVIDER_PREFERENCE](pkg);
     }
 
     // Find position in preference list
     const auto& prefs = _config.providerPriority;
-    auto it = std::find(prefs.begin(), prefs.end(), pkg.providerId);
+    auto it = std::find(prefs.begin(), prefs.end(), providerIdOf(pkg.source));
 
     if (it == prefs.end()) {
-        return 0.3;  // Not in preference list
+        return UNLISTED_PREFERENCE;
     }
 
     size_t pos = std::distance(prefs.begin(), it);
@@ -300,13 +582,10 @@ double PackageRanker::scoreProviderPreference(const UnifiedPackage& pkg) {
 }
 
 double PackageRanker::scorePopularity(const UnifiedPackage& pkg) {
-    if (_customScorers.count("Popularity") > 0) {
-        return _customScorers["Popularity"](pkg);
+    if (_customScorers[POPULARITY]) {
+        return _customScorers[POPULARITY](pkg);
     }
-
-    // Would ideally use download counts, ratings, etc.
-    // For now, return neutral score
-    return 0.5;
+    return popularityScore(_popularity.get(), pkg);
 }
 
 PackageScore::Recommendation PackageRanker::getRecommendation(
@@ -314,11 +593,11 @@ PackageScore::Recommendation PackageRanker::getRecommendation(
     const UnifiedPackage& pkg)
 {
     // Check for disqualifying factors
-    if (pkg.confinement == ConfinementLevel::DEVMODE) {
+    if (pkg.metadata.confinement == ConfinementLevel::DEVMODE) {
         return PackageScore::Recommendation::CAUTION;
     }
 
-    if (pkg.trustLevel == TrustLevel::UNKNOWN) {
+    if (pkg.metadata.trustLevel == TrustLevel::UNTRUSTED) {
         return PackageScore::Recommendation::CAUTION;
     }
 
@@ -342,34 +621,20 @@ std::vector<std::string> PackageRanker::generateWarnings(
     std::vector<std::string> warnings;
 
     // Trust warnings
-    if (pkg.trustLevel == TrustLevel::UNKNOWN) {
+    if (pkg.metadata.trustLevel == TrustLevel::UNTRUSTED) {
         warnings.push_back("Publisher is not verified");
-    } else if (pkg.trustLevel == TrustLevel::THIRD_PARTY) {
-        warnings.push_back("Package is from a third-party source");
     }
 
     // Confinement warnings
-    if (pkg.confinement == ConfinementLevel::CLASSIC) {
+    if (pkg.metadata.confinement == ConfinementLevel::CLASSIC) {
         warnings.push_back("Runs without sandboxing (classic confinement)");
-    } else if (pkg.confinement == ConfinementLevel::DEVMODE) {
+    } else if (pkg.metadata.confinement == ConfinementLevel::DEVMODE) {
         warnings.push_back("Development mode - not suitable for production");
     }
 
     // Permission warnings
-    bool hasNetworkAccess = false;
-    bool hasFullFilesystem = false;
-
-    for (const auto& perm : pkg.permissions.permissions) {
-        if (perm.name.find("network") != std::string::npos) {
-            hasNetworkAccess = true;
-        }
-        if (perm.name.find("home") != std::string::npos ||
-            perm.name.find("host") != std::string::npos) {
-            hasFullFilesystem = true;
-        }
-    }
-
-    if (hasNetworkAccess && hasFullFilesystem) {
+    const PackagePermissions& perms = pkg.metadata.permissions;
+    if (perms.hasNetworkAccess && (perms.hasHomeAccess || perms.hasFileSystemAccess)) {
         warnings.push_back("Has network access and can read your files");
     }
 
@@ -382,25 +647,26 @@ std::vector<std::string> PackageRanker::generateAdvantages(
     std::vector<std::string> advantages;
 
     // Trust advantages
-    if (pkg.trustLevel == TrustLevel::OFFICIAL) {
+    if (pkg.metadata.trustLevel == TrustLevel::OFFICIAL ||
+        pkg.metadata.trustLevel == TrustLevel::SYSTEM) {
         advantages.push_back("From official distribution repositories");
-    } else if (pkg.trustLevel == TrustLevel::VERIFIED) {
+    } else if (pkg.metadata.trustLevel == TrustLevel::VERIFIED) {
         advantages.push_back("Verified publisher");
     }
 
     // Confinement advantages
-    if (pkg.confinement == ConfinementLevel::STRICT) {
+    if (pkg.metadata.confinement == ConfinementLevel::STRICT) {
         advantages.push_back("Runs in a secure sandbox");
     }
 
     // Provider-specific advantages
-    if (pkg.providerId == "apt") {
+    if (pkg.source == SourceType::APT) {
         advantages.push_back("Well-tested with your system");
         advantages.push_back("Integrated with system package manager");
-    } else if (pkg.providerId == "flatpak") {
+    } else if (pkg.source == SourceType::FLATPAK) {
         advantages.push_back("Isolated from system");
         advantages.push_back("Usually latest version");
-    } else if (pkg.providerId == "snap") {
+    } else if (pkg.source == SourceType::SNAP) {
         advantages.push_back("Automatic updates");
         advantages.push_back("Works across distributions");
     }
@@ -412,65 +678,75 @@ std::vector<std::string> PackageRanker::generateAdvantages(
 // DuplicateDetector Implementation
 // ============================================================================
 
-const std::map<std::string, std::vector<std::string>>
-DuplicateDetector::knownMappings = {
-    // Firefox
-    {"firefox", {"org.mozilla.firefox", "firefox"}},
-    // Chromium
-    {"chromium", {"org.chromium.Chromium", "chromium-browser"}},
-    // LibreOffice
-    {"libreoffice", {"org.libreoffice.LibreOffice", "libreoffice"}},
-    // VLC
-    {"vlc", {"org.videolan.VLC", "vlc"}},
-    // GIMP
-    {"gimp", {"org.gimp.GIMP", "gimp"}},
-    // VS Code
-    {"code", {"com.visualstudio.code", "code"}},
-    // Spotify
-    {"spotify", {"com.spotify.Client", "spotify-client"}},
-    // Slack
-    {"slack", {"com.slack.Slack", "slack-desktop"}},
-    // Discord
-    {"discord", {"com.discordapp.Discord", "discord"}},
-    // Telegram
-    {"telegram-desktop", {"org.telegram.desktop", "telegram-desktop"}},
-};
-
-std::vector<DuplicateGroup> DuplicateDetector::findDuplicates(
-    const std::vector<UnifiedPackage>& packages)
+const std::map<std::string, std::vector<std::string>>&
+DuplicateDetector::knownMappings()
 {
-    std::map<std::string, DuplicateGroup> groups;
-
-    for (const auto& pkg : packages) {
-        std::string canonical = getCanonicalName(pkg);
-
-        if (groups.count(canonical) == 0) {
-            groups[canonical].canonicalName = canonical;
-        }
+    static const std::map<std::string, std::vector<std::string>> mappings = {
+        // Firefox
+        {"firefox", {"org.mozilla.firefox", "firefox"}},
+        // Chromium
+        {"chromium", {"org.chromium.Chromium", "chromium-browser"}},
+        // LibreOffice
+        {"libreoffice", {"org.libreoffice.LibreOffice", "libreoffice"}},
+        // VLC
+        {"vlc", {"org.videolan.VLC", "vlc"}},
+        // GIMP
+        {"gimp", {"org.gimp.GIMP", "gimp"}},
+        // VS Code
+        {"code", {"com.visualstudio.code", "code"}},
+        // Spotify
+        {"spotify", {"com.spotify.Client", "spotify-client"}},
+        // Slack
+        {"slack", {"com.slack.Slack", "slack-desktop"}},
+        // Discord
+        {"discord", {"com.discordapp.Discord", "discord"}},
+        // Telegram
+        {"telegram-desktop", {"org.telegram.desktop", "telegram-desktop"}},
+    };
+    return mappings;
+}
 
-        groups[canonical].packages.push_back(pkg);
-    }
+DuplicateDetector::DuplicateDetector()
+    : _ranker(std::make_shared<PackageRanker>())
+{}
 
-    // Filter to only groups with multiple packages
-    std::vector<DuplicateGroup> result;
-    for (auto& [name, group] : groups) {
-        if (group.packages.size() > 1) {
-            // Rank and find recommended
-            PackageRanker ranker;
-            auto best = ranker.getBestPackage(group.packages);
-            group.recommended = best;
+DuplicateDetector::DuplicateDetector(std::shared_ptr<PackageRanker> ranker)
+    : _ranker(std::move(ranker))
+{}
 
-            result.push_back(std::move(group));
+const std::unordered_map<std::string, std::string>&
+DuplicateDetector::variantIndex()
+{
+    // Insertion order reproduces the lookup order of a linear scan:
+    // earlier canonical names win, and within an entry the variants
+    // are tried before the canonical name itself
+    static const std::unordered_map<std::string, std::string> index = [] {
+        std::unordered_map<std::string, std::string> idx;
+        for (const auto& [canonical, variants] : knownMappings()) {
+            for (const auto& variant : variants) {
+                idx.emplace(normalizeName(variant), canonical);
+            }
+            idx.emplace(canonical, canonical);
         }
-    }
+        return idx;
+    }();
+    return index;
+}
 
-    return result;
+std::vector<DuplicateGroup> DuplicateDetector::findDuplicates(
+    const std::vector<UnifiedPackage>& packages)
+{
+    DuplicateStream stream(_ranker);
+    for (const auto& pkg : packages) {
+        stream.add(pkg);
+    }
+    return stream.duplicates();
 }
 
 bool DuplicateDetector::isSameApp(const UnifiedPackage& a,
                                    const UnifiedPackage& b)
 {
-    if (a.providerId == b.providerId) {
+    if (a.source == b.source) {
         return a.id == b.id;
     }
 
@@ -478,60 +754,137 @@ bool DuplicateDetector::isSameApp(const UnifiedPackage& a,
 }
 
 std::string DuplicateDetector::getCanonicalName(const UnifiedPackage& pkg) {
+    if (!pkg.canonicalName.empty()) {
+        return pkg.canonicalName;
+    }
+
     std::string normalized = normalizeName(pkg.id);
 
     // Check known mappings
-    for (const auto& [canonical, variants] : knownMappings) {
-        for (const auto& variant : variants) {
-            if (normalizeName(variant) == normalized) {
-                return canonical;
-            }
-        }
-        if (canonical == normalized) {
-            return canonical;
-        }
-    }
-
-    // For Flatpak IDs, extract app name
-    if (pkg.providerId == "flatpak") {
+    const auto& index = variantIndex();
+    auto it = index.find(normalized);
+    if (it != index.end()) {
+        pkg.canonicalName = it->second;
+    } else if (pkg.source == SourceType::FLATPAK &&
+               pkg.id.rfind('.') != std::string::npos) {
         // org.example.AppName -> appname
-        size_t lastDot = pkg.id.rfind('.');
-        if (lastDot != std::string::npos) {
-            return normalizeName(pkg.id.substr(lastDot + 1));
-        }
+        pkg.canonicalName = normalizeName(pkg.id.substr(pkg.id.rfind('.') + 1));
+    } else {
+        pkg.canonicalName = std::move(normalized);
     }
 
-    return normalized;
+    return pkg.canonicalName;
 }
 
 std::string DuplicateDetector::normalizeName(const std::string& name) {
-    std::string normalized = name;
+    // Lowercase into a single buffer
+    std::string normalized(name.size(), '\0');
+    std::transform(name.begin(), name.end(), normalized.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
 
-    // Convert to lowercase
-    std::transform(normalized.begin(), normalized.end(),
-                  normalized.begin(), ::tolower);
-
-    // Remove common suffixes
-    static std::vector<std::string> suffixes = {
+    // Remove common suffixes (each at most once, in this order)
+    static const char* const suffixes[] = {
         "-desktop", "-browser", "-client", "-app"
     };
 
-    for (const auto& suffix : suffixes) {
-        if (normalized.length() > suffix.length() &&
-            normalized.substr(normalized.length() - suffix.length()) == suffix) {
-            normalized = normalized.substr(0, normalized.length() - suffix.length());
+    size_t length = normalized.size();
+    for (const char* suffix : suffixes) {
+        size_t suffixLength = std::strlen(suffix);
+        if (length > suffixLength &&
+            normalized.compare(length - suffixLength, suffixLength, suffix) == 0) {
+            length -= suffixLength;
         }
     }
+    normalized.resize(length);
 
-    // Remove hyphens and underscores for comparison
+    // Remove separators for comparison; spaces only come from typed
+    // queries, so that "libre office" finds libreoffice
     normalized.erase(
         std::remove_if(normalized.begin(), normalized.end(),
-                      [](char c) { return c == '-' || c == '_' || c == '.'; }),
+                      [](unsigned char c) { return c == '-' || c == '_' || c == '.' ||
+                                                   std::isspace(c); }),
         normalized.end());
 
     return normalized;
 }
 
+// ============================================================================
+// DuplicateStream Implementation
+// ============================================================================
+
+DuplicateStream::DuplicateStream()
+    : DuplicateStream(std::make_shared<PackageRanker>())
+{}
+
+DuplicateStream::DuplicateStream(std::shared_ptr<PackageRanker> ranker)
+    : _ranker(ranker)
+    , _detector(std::move(ranker))
+{}
+
+DuplicateStream::Update DuplicateStream::add(const UnifiedPackage& pkg)
+{
+    Update update;
+
+    auto [it, inserted] = _groupIndex.emplace(_detector.getCanonicalName(pkg),
+                                              _groups.size());
+    update.group = it->second;
+    update.created = inserted;
+    if (inserted) {
+        _groups.emplace_back();
+        _groups.back().canonicalName = it->first;
+        _bestScore.push_back(-1);
+    }
+
+    DuplicateGroup& group = _groups[update.group];
+    group.packages.push_back(pkg);
+    if (group.packages.size() < 2) {
+        return update;
+    }
+
+    // A single package needs no recommendation, so the first one is
+    // only scored once it has company
+    int& best = _bestScore[update.group];
+    size_t bestIndex = SIZE_MAX;
+    if (best < 0) {
+        best = _ranker->rankScore(group.packages.front());
+        bestIndex = 0;
+    }
+    int score = _ranker->rankScore(group.packages.back());
+    if (score > best) {
+        best = score;
+        bestIndex = group.packages.size() - 1;
+    }
+
+    if (bestIndex != SIZE_MAX) {
+        group.recommended = _ranker->explainPackage(group.packages[bestIndex]);
+        update.recommendedChanged = true;
+    }
+    return update;
+}
+
+std::vector<DuplicateGroup> DuplicateStream::duplicates() const
+{
+    std::vector<DuplicateGroup> result;
+    for (const auto& group : _groups) {
+        if (group.packages.size() > 1) {
+            result.push_back(group);
+        }
+    }
+
+    std::sort(result.begin(), result.end(),
+              [](const DuplicateGroup& a, const DuplicateGroup& b) {
+                  return a.canonicalName < b.canonicalName;
+              });
+    return result;
+}
+
+void DuplicateStream::clear()
+{
+    _groups.clear();
+    _groupIndex.clear();
+    _bestScore.clear();
+}
+
 // ============================================================================
 // InstallationAdvisor Implementation
 // ============================================================================
@@ -599,7 +952,7 @@ InstallationAdvisor::MigrationAdvice InstallationAdvisor::checkMigration(
     const std::vector<UnifiedPackage>& available)
 {
     MigrationAdvice advice;
-    advice.currentProviderId = installed.providerId;
+    advice.currentProviderId = providerIdOf(installed.source);
 
     auto best = _ranker->getBestPackage(available);
     if (!best) {
@@ -613,7 +966,7 @@ InstallationAdvisor::MigrationAdvice InstallationAdvisor::checkMigration(
 
     int scoreDiff = best->totalScore - currentScore.totalScore;
 
-    if (scoreDiff >= 15 && best->providerId != installed.providerId) {
+    if (scoreDiff >= 15 && best->providerId != advice.currentProviderId) {
         advice.shouldMigrate = true;
         advice.reason = "A better version is available from " +
                        best->providerId + " (score: " +
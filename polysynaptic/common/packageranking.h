@@ -17,12 +17,15 @@
 #define _PACKAGERANKING_H_
 
 #include "packagesourceprovider.h"
+#include "popularityindex.h"
 
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <memory>
+#include <optional>
 
 namespace PolySynaptic {
 
@@ -106,6 +109,19 @@ struct PackageScore {
     }
 };
 
+/**
+ * RankedPackage - Position of a package in a batch ranking
+ *
+ * Carries only what ordering needs. Use PackageRanker::explainPackage()
+ * for the components, warnings and advantages of the rows on screen.
+ */
+struct RankedPackage {
+    size_t index = 0;           // Position in the ranked input list
+    int totalScore = 0;         // Same value scorePackage() reports
+    PackageScore::Recommendation recommendation =
+        PackageScore::Recommendation::ACCEPTABLE;
+};
+
 // ============================================================================
 // Ranking Configuration
 // ============================================================================
@@ -183,6 +199,32 @@ public:
     std::vector<PackageScore> rankPackages(
         const std::vector<UnifiedPackage>& packages);
 
+    /**
+     * Rank packages without building any explanation text
+     *
+     * Without custom scorers every package goes through the scoring
+     * kernel; with one, component scores are evaluated column by column
+     * and memoized per package (see explainPackage()). Returns entries
+     * sorted by score, highest first; equal scores keep their input
+     * order.
+     */
+    std::vector<RankedPackage> rankBatch(
+        const std::vector<UnifiedPackage>& packages);
+
+    /**
+     * Full score of one package, from the scoring kernel or, with a
+     * custom scorer set, reusing memoized component scores
+     *
+     * Meant for the rows actually displayed after rankBatch().
+     */
+    PackageScore explainPackage(const UnifiedPackage& package);
+
+    /**
+     * Total score of one package, the same value rankBatch() reports,
+     * without building any explanation text
+     */
+    int rankScore(const UnifiedPackage& package);
+
     /**
      * Get the best package from a list
      */
@@ -204,18 +246,83 @@ public:
     /**
      * Configuration
      */
-    void setConfig(const RankingConfig& config) { _config = config; }
+    void setConfig(const RankingConfig& config) {
+        _config = config;
+        _componentCache.clear();
+        prepareKernel();
+    }
     const RankingConfig& getConfig() const { return _config; }
 
     /**
-     * Set custom scoring function for a component
+     * Set custom scoring function for a component, by the name its
+     * score method goes by ("Trust", ..., "UpdateFrequency", ...,
+     * "Popularity"); other names are ignored
      */
     using ScoringFunction = std::function<double(const UnifiedPackage&)>;
     void setCustomScorer(const std::string& component, ScoringFunction fn);
 
+    /**
+     * Score popularity from this index instead of the shared one
+     * (PopularityIndex::peek()), which is otherwise picked up anew by
+     * each ranking call
+     */
+    void setPopularityIndex(std::shared_ptr<const PopularityIndex> index);
+
 private:
     RankingConfig _config;
-    std::map<std::string, ScoringFunction> _customScorers;
+
+    // Raw component scores in scorePackage() order
+    static const size_t COMPONENT_COUNT = 7;
+
+    // Custom scorers in component order; empty where none is set
+    ScoringFunction _customScorers[COMPONENT_COUNT];
+
+    std::shared_ptr<const PopularityIndex> _popularity;
+    bool _popularityPinned = false;         // Set by setPopularityIndex()
+
+    // Follow the shared popularity index, dropping the scores made
+    // with the previous one
+    void syncPopularity();
+    struct ComponentScores {
+        uint64_t revision = 0;      // PackageMetadata::revision when computed
+        double raw[COMPONENT_COUNT];
+    };
+
+    // Memoized component scores by "<providerId>:<id>"; dropped when
+    // the configuration or a custom scorer changes. Only custom scorers
+    // are slow enough to be worth it; the kernel is not memoized.
+    std::unordered_map<std::string, ComponentScores> _componentCache;
+
+    const ComponentScores& componentScores(const UnifiedPackage& pkg);
+
+    // Component weights from the configuration, in component order
+    void getWeights(double weights[COMPONENT_COUNT]) const;
+
+    // What the scoring kernel works from, set by prepareKernel() whenever
+    // the configuration or a custom scorer changes
+    static const size_t PROVIDER_KINDS = 4;     // apt, flatpak, snap, other
+    double _weights[COMPONENT_COUNT];
+    double _preference[PROVIDER_KINDS];         // Provider preference per kind
+    bool _kernelUsable = false;     // No custom scorer, priority of known kinds
+    bool _defaultConfig = false;    // Weights and priority as the defaults
+    void prepareKernel();
+
+    // Built-in component scores with no scorer lookups or string
+    // compares but the provider's kind, specialized for the default
+    // weights and priority and for whether popularity is known
+    template <bool DefaultConfig, bool HasPopularity>
+    void kernelScores(const UnifiedPackage& pkg, double raw[COMPONENT_COUNT]) const;
+    template <bool DefaultConfig, bool HasPopularity>
+    void kernelTotals(const std::vector<UnifiedPackage>& packages,
+                      std::vector<double>& totals) const;
+
+    // Either of the above, picking the specialization
+    void kernelScores(const UnifiedPackage& pkg, double raw[COMPONENT_COUNT]) const;
+    void kernelTotals(const std::vector<UnifiedPackage>& packages,
+                      std::vector<double>& totals) const;
+
+    // Weighted, rounded and clamped total (0-100)
+    int totalScore(const double raw[COMPONENT_COUNT]) const;
 
     // Individual scoring functions
     double scoreTrust(const UnifiedPackage& pkg);
@@ -252,11 +359,21 @@ struct DuplicateGroup {
 
 /**
  * DuplicateDetector - Finds duplicate packages across providers
+ *
+ * Canonical names are resolved through a reverse index from every
+ * normalized known variant to its canonical name, built once per
+ * process, and cached on the package (UnifiedPackage::canonicalName).
  */
 class DuplicateDetector {
 public:
+    DuplicateDetector();
+    explicit DuplicateDetector(std::shared_ptr<PackageRanker> ranker);
+
     /**
      * Find duplicate packages in a list
+     *
+     * Groups are ordered by canonical name. All grouped packages are
+     * scored once by the shared ranker.
      */
     std::vector<DuplicateGroup> findDuplicates(
         const std::vector<UnifiedPackage>& packages);
@@ -271,12 +388,79 @@ public:
      */
     std::string getCanonicalName(const UnifiedPackage& pkg);
 
+    /**
+     * Normalize name for comparison: lowercased, without a "-desktop",
+     * "-browser", "-client" or "-app" suffix, hyphens, underscores,
+     * dots and spaces; FuzzyIndex files names by it too
+     */
+    static std::string normalizeName(const std::string& name);
+
 private:
-    // Normalize name for comparison
-    std::string normalizeName(const std::string& name);
+    std::shared_ptr<PackageRanker> _ranker;
+
+    // Known app ID mappings (snap name -> flatpak ID -> apt package),
+    // built on first use so a detector works from static initializers
+    static const std::map<std::string, std::vector<std::string>>& knownMappings();
+
+    // Normalized variant (or canonical name) -> canonical name
+    static const std::unordered_map<std::string, std::string>& variantIndex();
+};
+
+/**
+ * DuplicateStream - Groups packages by canonical name as they arrive
+ *
+ * The incremental form of DuplicateDetector::findDuplicates(). Each
+ * add() files one package under its canonical name and compares it
+ * only with its group's current recommendation, so results can be
+ * collapsed into "one app, several sources" rows while backends are
+ * still answering, without ranking the whole set again.
+ *
+ * Groups keep the order in which their first package arrived. A
+ * group's recommended entry is filled in once it has a second package
+ * and is replaced only by a strictly better score, so among equal
+ * scores the earliest arrival wins as it does in rankBatch().
+ */
+class DuplicateStream {
+public:
+    DuplicateStream();
+    explicit DuplicateStream(std::shared_ptr<PackageRanker> ranker);
+
+    /**
+     * What an add() changed
+     */
+    struct Update {
+        size_t group = 0;               // Index into groups()
+        bool created = false;           // First package of its group
+        bool recommendedChanged = false; // group.recommended was set anew
+    };
+
+    /**
+     * Add one package to its group
+     */
+    Update add(const UnifiedPackage& pkg);
+
+    /**
+     * All groups so far, including single-package ones
+     */
+    const std::vector<DuplicateGroup>& groups() const { return _groups; }
+
+    /**
+     * The groups with more than one package, by canonical name
+     */
+    std::vector<DuplicateGroup> duplicates() const;
+
+    void clear();
+
+private:
+    std::shared_ptr<PackageRanker> _ranker;
+    DuplicateDetector _detector;
+
+    std::vector<DuplicateGroup> _groups;
+    std::unordered_map<std::string, size_t> _groupIndex;
 
-    // Known app ID mappings (snap name -> flatpak ID -> apt package)
-    static const std::map<std::string, std::vector<std::string>> knownMappings;
+    // Score of each group's recommended package; unset (-1) until the
+    // group has a second package
+    std::vector<int> _bestScore;
 };
 
 // ============================================================================
@@ -0,0 +1,116 @@
+/* packagesnapshot.cc - Published package lists for the unified view
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "packagesnapshot.h"
+
+namespace PolySynaptic {
+
+PackageSnapshot::PackageSnapshot(vector<PackageInfo> packages, uint64_t generation,
+                                 uint64_t lineage)
+    : _packages(std::move(packages))
+    , _generation(generation)
+    , _lineage(lineage)
+{
+}
+
+size_t PackageSnapshot::memoryBytes() const
+{
+    size_t bytes = sizeof(*this) +
+                   (_packages.capacity() - _packages.size()) * sizeof(PackageInfo);
+    for (const auto& pkg : _packages) {
+        bytes += pkg.memoryBytes();
+    }
+    return bytes;
+}
+
+// ============================================================================
+// SnapshotPublisher
+// ============================================================================
+
+SnapshotPublisher::SnapshotPublisher()
+    : _current(make_shared<const PackageSnapshot>(vector<PackageInfo>(), 0, 0))
+    , _nextLineage(1)
+{
+}
+
+PackageSnapshotPtr SnapshotPublisher::current() const
+{
+    return atomic_load(&_current);
+}
+
+template <typename Build>
+PackageSnapshotPtr SnapshotPublisher::update(Build build)
+{
+    PackageSnapshotPtr seen = atomic_load(&_current);
+    for (;;) {
+        PackageSnapshotPtr next = build(*seen);
+        if (!next) {
+            return seen;
+        }
+        // On failure seen is reloaded, and the next one built on it
+        if (atomic_compare_exchange_weak(&_current, &seen, next)) {
+            return next;
+        }
+    }
+}
+
+PackageSnapshotPtr SnapshotPublisher::publish(vector<PackageInfo> packages,
+                                              uint64_t generation)
+{
+    // Built once; a retry only has to look at the generation again
+    uint64_t lineage = _nextLineage++;
+    auto next = make_shared<const PackageSnapshot>(std::move(packages), generation,
+                                                   lineage);
+    return update([&](const PackageSnapshot& seen) -> PackageSnapshotPtr {
+        if (generation < seen.generation()) {
+            return nullptr;
+        }
+        return next;
+    });
+}
+
+PackageSnapshotPtr SnapshotPublisher::append(const vector<PackageInfo>& packages,
+                                             uint64_t generation)
+{
+    uint64_t fresh = _nextLineage++;
+    return update([&](const PackageSnapshot& seen) -> PackageSnapshotPtr {
+        if (generation < seen.generation()) {
+            return nullptr;
+        }
+        if (generation > seen.generation()) {
+            return make_shared<const PackageSnapshot>(packages, generation, fresh);
+        }
+        vector<PackageInfo> joined;
+        joined.reserve(seen.size() + packages.size());
+        joined.insert(joined.end(), seen.packages().begin(), seen.packages().end());
+        joined.insert(joined.end(), packages.begin(), packages.end());
+        return make_shared<const PackageSnapshot>(std::move(joined), generation,
+                                                  seen.lineage());
+    });
+}
+
+PackageSnapshotPtr SnapshotPublisher::applyDelta(const CatalogDelta& delta,
+                                                 uint64_t generation)
+{
+    uint64_t lineage = _nextLineage++;
+    return update([&](const PackageSnapshot& seen) -> PackageSnapshotPtr {
+        if (generation != seen.generation() || delta.empty()) {
+            return nullptr;
+        }
+        vector<PackageInfo> packages = seen.packages();
+        PackageCatalog::applyDelta(packages, delta);
+        return make_shared<const PackageSnapshot>(std::move(packages), generation,
+                                                  lineage);
+    });
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
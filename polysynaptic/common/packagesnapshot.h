@@ -0,0 +1,136 @@
+/* packagesnapshot.h - Published package lists for the unified view
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the hand-over of a package list from the thread
+ * that builds it to the main loop that shows it. A list, once
+ * published, is never changed again: whoever has a new one builds it
+ * apart and swaps it in with an atomic pointer store, and the model
+ * moves from the list it shows to the new one by a diff of the two. A
+ * refresh thus never waits for the main loop, nor the main loop for a
+ * refresh. A list is handed over without being copied; one that adds
+ * to or revises the last is copied by the thread that builds it.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PACKAGESNAPSHOT_H_
+#define _PACKAGESNAPSHOT_H_
+
+#include "packagecatalog.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace PolySynaptic {
+
+/**
+ * PackageSnapshot - One published package list
+ *
+ * Every snapshot belongs to a generation, the load (category, search,
+ * installed list) it is the result of. Snapshots that only add to an
+ * earlier one of the same load share its lineage, so a reader can tell
+ * that the packages it has are still the first ones of the new list.
+ *
+ * Nothing in a snapshot is written once it is built, deferred fields
+ * included: a reader that resolves them does so on a copy of its own,
+ * so any thread may copy the packages while another shows them.
+ */
+class PackageSnapshot {
+public:
+    PackageSnapshot(vector<PackageInfo> packages, uint64_t generation,
+                    uint64_t lineage = 0);
+
+    const vector<PackageInfo>& packages() const { return _packages; }
+    const PackageInfo& operator[](size_t i) const { return _packages[i]; }
+    size_t size() const { return _packages.size(); }
+    bool empty() const { return _packages.empty(); }
+
+    uint64_t generation() const { return _generation; }
+    uint64_t lineage() const { return _lineage; }
+
+    /**
+     * Whether this snapshot holds all packages of other, in their
+     * places, followed by its own
+     */
+    bool extends(const PackageSnapshot& other) const {
+        return _lineage == other._lineage && _generation == other._generation &&
+               _packages.size() >= other._packages.size();
+    }
+
+    size_t memoryBytes() const;
+
+private:
+    vector<PackageInfo> _packages;
+    uint64_t _generation;
+    uint64_t _lineage;                      // Snapshot the appends began with
+};
+
+typedef shared_ptr<const PackageSnapshot> PackageSnapshotPtr;
+
+/**
+ * SnapshotPublisher - The latest package list of a view
+ *
+ *     // Any thread, with the generation of the load it works for
+ *     publisher.publish(std::move(packages), generation);
+ *     publisher.append(backendResults, generation);
+ *
+ *     // Main loop
+ *     PackageSnapshotPtr latest = publisher.current();
+ *     if (latest != shown) ... diff shown against latest ...
+ *
+ * Generations only grow: a snapshot for an older generation than the
+ * one published is dropped, so a slow refresh cannot undo a newer
+ * load. append() and applyDelta() build on what is published for
+ * their generation; for another generation append() starts the list
+ * afresh and applyDelta() drops the delta. Publishers run concurrently,
+ * each retrying its swap if another got in first.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class SnapshotPublisher {
+public:
+    SnapshotPublisher();
+
+    PackageSnapshotPtr current() const;
+
+    /**
+     * Replace the list
+     *
+     * @return What is published now, the new list unless a newer
+     *         generation was published already
+     */
+    PackageSnapshotPtr publish(vector<PackageInfo> packages, uint64_t generation);
+
+    /**
+     * Add to the list of generation (@see publish)
+     */
+    PackageSnapshotPtr append(const vector<PackageInfo>& packages, uint64_t generation);
+
+    /**
+     * Apply a revalidation to the list of generation (@see publish)
+     */
+    PackageSnapshotPtr applyDelta(const CatalogDelta& delta, uint64_t generation);
+
+private:
+    PackageSnapshotPtr _current;            // Only through atomic_load/store
+    atomic<uint64_t> _nextLineage;
+
+    /**
+     * Swap in what build makes of the current snapshot, unless it
+     * returns nullptr; retried if another publisher got in between
+     */
+    template <typename Build>
+    PackageSnapshotPtr update(Build build);
+};
+
+} // namespace PolySynaptic
+
+#endif // _PACKAGESNAPSHOT_H_
+
+// vim:ts=4:sw=4:et
@@ -30,8 +30,11 @@
 #include <map>
 #include <set>
 #include <chrono>
+#include <exception>
 #include <mutex>
-#include <any>
+#include <string_view>
+#include <thread>
+#include <variant>
 
 namespace PolySynaptic {
 
@@ -234,10 +237,148 @@ struct PackagePermissions {
 // Unified Package Metadata
 // ============================================================================
 
+/**
+ * CompactStringList - Short list of strings in a single buffer
+ *
+ * Entries are stored back to back, each followed by a NUL byte. Lists
+ * attached to package metadata hold a handful of short values, so
+ * indexing scans the buffer instead of keeping an offset table.
+ */
+class CompactStringList {
+public:
+    size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+
+    void push_back(std::string_view value) {
+        _data.append(value.data(), value.size());
+        _data.push_back('\0');
+        _count++;
+    }
+
+    void clear() {
+        _data.clear();
+        _count = 0;
+    }
+
+    std::string_view operator[](size_t index) const {
+        const char* p = _data.data();
+        for (size_t i = 0; i < index; i++) {
+            p += std::char_traits<char>::length(p) + 1;
+        }
+        return std::string_view(p);
+    }
+
+    bool contains(std::string_view value) const {
+        for (size_t i = 0, pos = 0; i < _count; i++) {
+            std::string_view entry(_data.data() + pos);
+            if (entry == value) return true;
+            pos += entry.size() + 1;
+        }
+        return false;
+    }
+
+    std::vector<std::string> toVector() const {
+        std::vector<std::string> values;
+        values.reserve(_count);
+        for (size_t i = 0, pos = 0; i < _count; i++) {
+            values.emplace_back(_data.data() + pos);
+            pos += values.back().size() + 1;
+        }
+        return values;
+    }
+
+private:
+    std::string _data;
+    uint32_t _count = 0;
+};
+
+/**
+ * MetadataKey - Interned name of a provider-specific metadata value
+ *
+ * Keys are registered once per process and compared as integers.
+ */
+class MetadataKey {
+public:
+    explicit MetadataKey(const std::string& name) : _id(intern(name)) {}
+
+    uint32_t id() const { return _id; }
+    const std::string& name() const { return names()[_id]; }
+
+    bool operator==(const MetadataKey& other) const { return _id == other._id; }
+    bool operator<(const MetadataKey& other) const { return _id < other._id; }
+
+private:
+    uint32_t _id;
+
+    static std::vector<std::string>& names() {
+        static std::vector<std::string> table;
+        return table;
+    }
+
+    static uint32_t intern(const std::string& name) {
+        static std::mutex mutex;
+        static std::map<std::string, uint32_t> ids;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names().size());
+        names().push_back(name);
+        ids.emplace(name, id);
+        return id;
+    }
+};
+
+/**
+ * MetadataValue - Typed value of provider-specific metadata
+ */
+using MetadataValue = std::variant<bool, int64_t, double, std::string>;
+
+/**
+ * MetadataText / MetadataList - Rarely set metadata fields
+ *
+ * These live out of line in PackageMetadata and only cost memory when
+ * a provider actually fills them in.
+ */
+enum class MetadataText : uint8_t {
+    SIGNATURE_INFO,
+    REMOTE_NAME,        // Flatpak remote
+    CHANNEL,            // Snap channel
+    BRANCH,             // Flatpak branch
+    RUNTIME,            // Required runtime
+    CHANGELOG_URL,
+    SUPPORT_URL,
+    BUG_TRACKER_URL,
+    DONATION_URL
+};
+
+enum class MetadataList : uint8_t {
+    SCREENSHOTS,
+    CATEGORIES,
+    KEYWORDS,
+    DEPENDENCIES,
+    RECOMMENDS,
+    CONFLICTS
+};
+
 /**
  * PackageMetadata - Extended metadata for package comparison and display
+ *
+ * Fields read while ranking and filtering are stored inline. Text,
+ * lists and provider-specific values are kept in a shared out-of-line
+ * block that is only allocated once one of them is set, and copied on
+ * the first write after the metadata itself was copied. Copying a
+ * package therefore never copies those fields.
+ *
+ * Thread Safety:
+ *   Like the rest of UnifiedPackage, not safe for concurrent writes.
  */
 struct PackageMetadata {
+    // Bumped by providers whenever they change the metadata, so cached
+    // values derived from it (ranking components) can be revalidated
+    uint64_t revision = 0;
+
     // Timestamps
     std::chrono::system_clock::time_point publishedAt;
     std::chrono::system_clock::time_point lastUpdatedAt;
@@ -247,39 +388,106 @@ struct PackageMetadata {
     TrustLevel trustLevel = TrustLevel::COMMUNITY;
     bool isVerifiedPublisher = false;
     bool hasValidSignature = false;
-    std::string signatureInfo;
 
     // Sandboxing
     ConfinementLevel confinement = ConfinementLevel::NONE;
     PackagePermissions permissions;
 
-    // Source-specific
-    std::string remoteName;         // Flatpak remote
-    std::string channel;            // Snap channel
-    std::string branch;             // Flatpak branch
-    std::string runtime;            // Required runtime
-
     // Statistics
     int downloadCount = 0;
     double rating = 0.0;
     int ratingCount = 0;
 
-    // Extended info
-    std::vector<std::string> screenshots;
-    std::vector<std::string> categories;
-    std::vector<std::string> keywords;
-    std::string changelogUrl;
-    std::string supportUrl;
-    std::string bugTrackerUrl;
-    std::string donationUrl;
-
-    // Dependencies
-    std::vector<std::string> dependencies;
-    std::vector<std::string> recommends;
-    std::vector<std::string> conflicts;
-
-    // Arbitrary provider-specific data
-    std::map<std::string, std::any> customData;
+    /**
+     * Out-of-line text fields ("" if unset)
+     */
+    const std::string& text(MetadataText field) const {
+        static const std::string empty;
+        if (_extra) {
+            for (const auto& entry : _extra->texts) {
+                if (entry.first == field) return entry.second;
+            }
+        }
+        return empty;
+    }
+
+    void setText(MetadataText field, std::string value) {
+        auto& texts = extra().texts;
+        for (auto& entry : texts) {
+            if (entry.first == field) {
+                entry.second = std::move(value);
+                return;
+            }
+        }
+        texts.emplace_back(field, std::move(value));
+    }
+
+    /**
+     * Out-of-line string lists (empty if unset)
+     */
+    const CompactStringList& list(MetadataList field) const {
+        static const CompactStringList empty;
+        if (_extra) {
+            for (const auto& entry : _extra->lists) {
+                if (entry.first == field) return entry.second;
+            }
+        }
+        return empty;
+    }
+
+    CompactStringList& editList(MetadataList field) {
+        auto& lists = extra().lists;
+        for (auto& entry : lists) {
+            if (entry.first == field) return entry.second;
+        }
+        lists.emplace_back(field, CompactStringList());
+        return lists.back().second;
+    }
+
+    /**
+     * Provider-specific values
+     *
+     * @return nullptr if the key is unset or holds another type
+     */
+    template <typename T>
+    const T* custom(const MetadataKey& key) const {
+        if (_extra) {
+            for (const auto& entry : _extra->custom) {
+                if (entry.first == key.id()) return std::get_if<T>(&entry.second);
+            }
+        }
+        return nullptr;
+    }
+
+    void setCustom(const MetadataKey& key, MetadataValue value) {
+        auto& custom = extra().custom;
+        for (auto& entry : custom) {
+            if (entry.first == key.id()) {
+                entry.second = std::move(value);
+                return;
+            }
+        }
+        custom.emplace_back(key.id(), std::move(value));
+    }
+
+private:
+    struct Extra {
+        std::vector<std::pair<MetadataText, std::string>> texts;
+        std::vector<std::pair<MetadataList, CompactStringList>> lists;
+        std::vector<std::pair<uint32_t, MetadataValue>> custom;
+    };
+
+    std::shared_ptr<Extra> _extra;
+
+    // Writable out-of-line block, unshared first if a copy still uses it
+    Extra& extra() {
+        if (!_extra) {
+            _extra = std::make_shared<Extra>();
+        } else if (_extra.use_count() > 1) {
+            _extra = std::make_shared<Extra>(*_extra);
+        }
+        return *_extra;
+    }
 };
 
 // ============================================================================
@@ -329,6 +537,9 @@ struct UnifiedPackage {
     double rankingScore = 0.0;
     std::string rankingExplanation;
 
+    // Duplicate detection key, filled in by DuplicateDetector on first use
+    mutable std::string canonicalName;
+
     // Default constructor
     UnifiedPackage() = default;
 
@@ -664,18 +875,72 @@ public:
         return types;
     }
 
+    /**
+     * Called as each provider of createAllProviders() has been created
+     * and has answered isAvailable(), from the thread that probed it;
+     * calls are serialized. provider is null if the factory made none.
+     */
+    using ProbeCallback = std::function<void(SourceType type,
+                                             const PackageSourceProvider* provider,
+                                             bool available)>;
+
     /**
      * Create all registered providers
+     *
+     * Each factory runs, and its provider is first asked isAvailable(),
+     * on a thread of its own and outside the registry lock, since either
+     * may have to run "snap version" or "flatpak --version". A slow or
+     * hung daemon then delays only its own provider's report; the call
+     * returns once all are done, in registration order.
      */
-    std::vector<std::unique_ptr<PackageSourceProvider>> createAllProviders() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        std::vector<std::unique_ptr<PackageSourceProvider>> providers;
-        for (const auto& [type, factory] : _factories) {
-            if (factory) {
-                auto provider = factory();
-                if (provider) {
-                    providers.push_back(std::move(provider));
+    std::vector<std::unique_ptr<PackageSourceProvider>> createAllProviders(
+        ProbeCallback onProbed = nullptr)
+    {
+        std::vector<std::pair<SourceType, ProviderFactory>> factories;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto& [type, factory] : _factories) {
+                if (factory) {
+                    factories.emplace_back(type, factory);
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<PackageSourceProvider>> created(factories.size());
+        std::vector<std::exception_ptr> errors(factories.size());
+        std::mutex reportMutex;
+        std::vector<std::thread> probes;
+        probes.reserve(factories.size());
+        for (size_t i = 0; i < factories.size(); i++) {
+            probes.emplace_back([&, i]() {
+                try {
+                    auto provider = factories[i].second();
+                    bool available = provider && provider->isAvailable();
+                    if (onProbed) {
+                        std::lock_guard<std::mutex> lock(reportMutex);
+                        onProbed(factories[i].first, provider.get(), available);
+                    }
+                    created[i] = std::move(provider);
+                } catch (...) {
+                    errors[i] = std::current_exception();
                 }
+            });
+        }
+        for (auto& probe : probes) {
+            probe.join();
+        }
+
+        // What a factory threw reaches the caller as it did serially
+        for (auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        std::vector<std::unique_ptr<PackageSourceProvider>> providers;
+        for (auto& provider : created) {
+            if (provider) {
+                providers.push_back(std::move(provider));
             }
         }
         return providers;
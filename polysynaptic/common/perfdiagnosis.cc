@@ -0,0 +1,313 @@
+/* perfdiagnosis.cc - Times the backends' core operations on this machine
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "perfdiagnosis.h"
+#include "structuredlog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <sys/utsname.h>
+#include <thread>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Budgets and Hints
+// ============================================================================
+
+// What a desktop with a warm page cache does comfortably
+static const struct {
+    const char *operation;
+    double ms;
+} DEFAULT_BUDGETS[] = {
+    {"availability", 250},
+    {"installed", 1500},
+    {"search", 800},
+    {"details", 500},
+    {"cache-open", 3000},
+    {"xapian-query", 200},
+};
+
+static const double FALLBACK_BUDGET_MS = 1000;
+
+string PerfDiagnosis::hintFor(BackendType type, const string& operation)
+{
+    switch (type) {
+        case BackendType::SNAP:
+            if (operation == "availability") {
+                return "snapd is slow to answer on /run/snapd.socket; "
+                       "see `systemctl status snapd.socket snapd`";
+            }
+            return "snapd answers slowly, often while it refreshes or seeds; "
+                   "see `snap changes`";
+        case BackendType::FLATPAK:
+            if (operation == "search") {
+                return "a remote with a very large catalog; "
+                       "see `flatpak remotes` and `flatpak remote-ls --app`";
+            }
+            if (operation == "installed") {
+                return "many installed refs or unused runtimes; "
+                       "see `flatpak uninstall --unused`";
+            }
+            return "the flatpak command is slow to start; "
+                   "see `flatpak --verbose list`";
+        case BackendType::APT:
+            if (operation == "availability") {
+                return "the dpkg status file is slow to read";
+            }
+            return "a large package cache or many sources; "
+                   "see `apt-cache stats`";
+        default:
+            return "";
+    }
+}
+
+// ============================================================================
+// PerfDiagnosis
+// ============================================================================
+
+PerfDiagnosis::PerfDiagnosis()
+    : _query("editor")
+{
+    for (const auto& budget : DEFAULT_BUDGETS) {
+        _budgets[budget.operation] = budget.ms;
+    }
+}
+
+void PerfDiagnosis::setBudget(const string& operation, double ms)
+{
+    _budgets[operation] = ms;
+}
+
+double PerfDiagnosis::getBudget(const string& operation) const
+{
+    auto it = _budgets.find(operation);
+    return it != _budgets.end() ? it->second : FALLBACK_BUDGET_MS;
+}
+
+void PerfDiagnosis::addProbe(const string& component, const string& operation,
+                             Probe probe, const string& hint)
+{
+    Step step;
+    step.component = component;
+    step.operation = operation;
+    step.probe = std::move(probe);
+    step.hint = hint;
+    _steps.push_back(std::move(step));
+}
+
+void PerfDiagnosis::addBackend(IPackageBackend* backend)
+{
+    // What the later probes need from the earlier ones
+    struct Seen {
+        bool available = false;
+        string reason;
+        string packageId;
+    };
+    auto seen = std::make_shared<Seen>();
+    BackendType type = backend->getType();
+    string component = backendTypeToString(type);
+    string query = _query;
+
+    auto unavailable = [seen]() {
+        return seen->available ? string() : "not available: " + seen->reason;
+    };
+
+    addProbe(component, "availability", [backend, seen](string& detail) {
+        // A remembered answer would time nothing
+        backend->invalidateAvailability();
+        seen->available = backend->isAvailable();
+        if (!seen->available) {
+            seen->reason = backend->getUnavailableReason();
+            detail = seen->reason;
+            return false;
+        }
+        detail = backend->getVersion();
+        return true;
+    }, hintFor(type, "availability"));
+
+    addProbe(component, "installed", [backend, seen](string& detail) {
+        vector<PackageInfo> pkgs = backend->getInstalledPackages();
+        if (!pkgs.empty()) {
+            seen->packageId = pkgs.front().id;
+        }
+        detail = std::to_string(pkgs.size()) + " packages";
+        return true;
+    }, hintFor(type, "installed"));
+    _steps.back().skip = unavailable;
+
+    addProbe(component, "search", [backend, seen, query](string& detail) {
+        SearchOptions options;
+        options.query = query;
+        vector<PackageInfo> pkgs = backend->searchPackages(options);
+        if (seen->packageId.empty() && !pkgs.empty()) {
+            seen->packageId = pkgs.front().id;
+        }
+        detail = std::to_string(pkgs.size()) + " results for \"" + query + "\"";
+        return true;
+    }, hintFor(type, "search"));
+    _steps.back().skip = unavailable;
+
+    addProbe(component, "details", [backend, seen](string& detail) {
+        PackageInfo info = backend->getPackageDetails(seen->packageId);
+        detail = seen->packageId;
+        if (info.id.empty()) {
+            detail += " not found";
+            return false;
+        }
+        return true;
+    }, hintFor(type, "details"));
+    _steps.back().skip = [seen, unavailable]() {
+        string why = unavailable();
+        if (why.empty() && seen->packageId.empty()) {
+            why = "no package to look up";
+        }
+        return why;
+    };
+}
+
+vector<DiagnosisResult> PerfDiagnosis::run(ProgressCallback progress)
+{
+    vector<DiagnosisResult> results;
+
+    for (size_t i = 0; i < _steps.size(); i++) {
+        const Step& step = _steps[i];
+        if (progress &&
+            !progress(static_cast<double>(i) / _steps.size(),
+                      step.component + " " + step.operation + "...")) {
+            break;
+        }
+
+        DiagnosisResult result;
+        result.component = step.component;
+        result.operation = step.operation;
+        result.budgetMs = getBudget(step.operation);
+
+        string skip = step.skip ? step.skip() : string();
+        if (!skip.empty()) {
+            result.skipped = true;
+            result.detail = skip;
+            results.push_back(result);
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            result.ok = step.probe(result.detail);
+        } catch (const std::exception& e) {
+            result.ok = false;
+            result.detail = e.what();
+        } catch (...) {
+            result.ok = false;
+            result.detail = "unknown exception";
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        result.ms = std::chrono::duration<double, std::milli>(elapsed).count();
+        if (!result.ok || result.overBudget()) {
+            result.hint = step.hint;
+        }
+
+        LogBuilder(result.ok ? LogLevel::INFO : LogLevel::WARN)
+            .component("Diagnosis")
+            .provider(result.component)
+            .operation(result.operation)
+            .duration(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed))
+            .field("budgetMs", std::to_string(static_cast<long>(result.budgetMs)))
+            .message(result.detail)
+            .emit();
+        results.push_back(result);
+    }
+
+    if (progress) {
+        progress(1.0, "");
+    }
+    return results;
+}
+
+const DiagnosisResult* PerfDiagnosis::slowest(const vector<DiagnosisResult>& results)
+{
+    const DiagnosisResult* worst = nullptr;
+    double worstRatio = 1.0;
+    for (const auto& result : results) {
+        if (result.skipped) {
+            continue;
+        }
+        if (!result.ok) {
+            return &result;
+        }
+        double ratio = result.budgetMs > 0 ? result.ms / result.budgetMs : 0;
+        if (ratio > worstRatio) {
+            worst = &result;
+            worstRatio = ratio;
+        }
+    }
+    return worst;
+}
+
+string PerfDiagnosis::report(const vector<DiagnosisResult>& results)
+{
+    char line[256];
+    string out = "PolySynaptic performance diagnosis\n";
+
+    struct utsname host;
+    if (uname(&host) == 0) {
+        snprintf(line, sizeof(line), "Machine: %s %s %s, %u CPUs\n",
+                 host.sysname, host.release, host.machine,
+                 std::thread::hardware_concurrency());
+        out += line;
+    }
+    out += "\n";
+
+    snprintf(line, sizeof(line), "%-8s %-13s %10s %8s  %-6s %s\n",
+             "where", "operation", "ms", "budget", "result", "detail");
+    out += line;
+    for (const auto& result : results) {
+        const char *verdict = result.skipped ? "skip"
+                            : !result.ok ? "FAIL"
+                            : result.overBudget() ? "SLOW" : "ok";
+        if (result.skipped) {
+            snprintf(line, sizeof(line), "%-8s %-13s %10s %8.0f  %-6s %s\n",
+                     result.component.c_str(), result.operation.c_str(), "-",
+                     result.budgetMs, verdict, result.detail.c_str());
+        } else {
+            snprintf(line, sizeof(line), "%-8s %-13s %10.1f %8.0f  %-6s %s\n",
+                     result.component.c_str(), result.operation.c_str(), result.ms,
+                     result.budgetMs, verdict, result.detail.c_str());
+        }
+        out += line;
+    }
+    out += "\n";
+
+    const DiagnosisResult* worst = slowest(results);
+    if (!worst) {
+        out += "Everything is within its budget.\n";
+        return out;
+    }
+    if (!worst->ok) {
+        snprintf(line, sizeof(line), "Failed: %s %s after %.0f ms: %s\n",
+                 worst->component.c_str(), worst->operation.c_str(), worst->ms,
+                 worst->detail.c_str());
+    } else {
+        snprintf(line, sizeof(line), "Slowest: %s %s took %.0f ms, %.1fx its budget of %.0f ms\n",
+                 worst->component.c_str(), worst->operation.c_str(), worst->ms,
+                 worst->ms / worst->budgetMs, worst->budgetMs);
+    }
+    out += line;
+    if (!worst->hint.empty()) {
+        out += "Likely cause: " + worst->hint + "\n";
+    }
+    return out;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
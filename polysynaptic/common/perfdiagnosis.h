@@ -0,0 +1,124 @@
+/* perfdiagnosis.h - Times the backends' core operations on this machine
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the performance diagnosis users run when the
+ * window is slow for them and not for us: it times the availability
+ * probe, the installed list, a search and a details lookup of every
+ * backend, and whatever else the caller adds (the APT cache open, a
+ * Xapian query), compares each with a budget and writes a report
+ * that names the slowest component and what usually makes it slow,
+ * such as a snapd socket that takes seconds to answer or a Flatpak
+ * remote with a very large catalog. `polysynaptic --diagnose-performance`
+ * prints it; the debug panel runs it from its console.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PERFDIAGNOSIS_H_
+#define _PERFDIAGNOSIS_H_
+
+#include "ipackagebackend.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace PolySynaptic {
+
+/**
+ * DiagnosisResult - One timed operation
+ */
+struct DiagnosisResult {
+    string component;                   // "Snap", "APT", "Xapian"
+    string operation;                   // "availability", "installed", ...
+    double ms = 0;
+    double budgetMs = 0;
+    bool ok = true;                     // The operation succeeded
+    bool skipped = false;               // Not run; detail says why
+    string detail;                      // "812 packages", or the failure
+    string hint;                        // Likely cause, if slow or failed
+
+    bool overBudget() const { return !skipped && ms > budgetMs; }
+};
+
+/**
+ * PerfDiagnosis - Times a list of probes against their budgets
+ *
+ * Probes run one at a time, in the order they were added, so one
+ * slow component does not make the others look slow. addBackend()
+ * adds the four backend operations; a backend that is not available
+ * only gets its availability probe timed.
+ *
+ * Thread Safety:
+ *   Not thread-safe; run() blocks for as long as the probes take.
+ */
+class PerfDiagnosis {
+public:
+    // Fills detail on success and failure alike; false if it failed
+    using Probe = function<bool(string& detail)>;
+
+    PerfDiagnosis();
+
+    /**
+     * Budget of an operation, the same for every component
+     */
+    void setBudget(const string& operation, double ms);
+    double getBudget(const string& operation) const;
+
+    // What the search probes look for
+    void setSearchQuery(const string& query) { _query = query; }
+
+    /**
+     * Time probe as component's operation
+     *
+     * @param hint Shown when it is over budget or fails
+     */
+    void addProbe(const string& component, const string& operation,
+                  Probe probe, const string& hint = "");
+
+    /**
+     * Time backend's availability, installed list, search and details
+     */
+    void addBackend(IPackageBackend* backend);
+
+    vector<DiagnosisResult> run(ProgressCallback progress = nullptr);
+
+    /**
+     * The result that most needs looking at: the first failure, else
+     * the one furthest over its budget; nullptr if all are fine
+     */
+    static const DiagnosisResult* slowest(const vector<DiagnosisResult>& results);
+
+    /**
+     * Plain text to paste into a bug report: the machine, a table of
+     * every result and the slowest one with its likely cause
+     */
+    static string report(const vector<DiagnosisResult>& results);
+
+    // What usually makes the operation slow on that kind of backend
+    static string hintFor(BackendType type, const string& operation);
+
+private:
+    struct Step {
+        string component;
+        string operation;
+        Probe probe;
+        string hint;
+        function<string()> skip;        // Why not to run, "" to run
+    };
+
+    vector<Step> _steps;
+    map<string, double> _budgets;
+    string _query;
+};
+
+} // namespace PolySynaptic
+
+#endif // _PERFDIAGNOSIS_H_
+
+// vim:ts=4:sw=4:et
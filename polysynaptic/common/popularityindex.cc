@@ -0,0 +1,641 @@
+/* popularityindex.cc - How widely each package is installed
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "popularityindex.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+namespace PolySynaptic {
+
+static const char POPULARITY_MAGIC[8] = {'P', 'S', 'P', 'O', 'P', 'U', 'L', '\0'};
+
+// Magic, version, entry count, bucket bits, then the per-source counts
+static const size_t HEADER_SIZE = 8 + 3 * 4 + PopularityIndex::SOURCE_COUNT * 4;
+
+static const uint32_t MIN_BUCKET_BITS = 4;
+static const uint32_t MAX_BUCKET_BITS = 24;
+
+// Dataset file names in the refresh directory, by source
+static const char *const SOURCE_NAMES[PopularityIndex::SOURCE_COUNT] = {
+    "popcon", "flathub", "snap"
+};
+
+namespace {
+
+size_t align8(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+size_t bucketCount(uint32_t bits)
+{
+    return (size_t(1) << bits) + 1;
+}
+
+struct SharedIndex {
+    mutex lock;
+    shared_ptr<const PopularityIndex> index;
+};
+
+SharedIndex& sharedIndex()
+{
+    static SharedIndex state;
+    return state;
+}
+
+// ============================================================================
+// Text
+// ============================================================================
+
+/**
+ * Lines of a text dataset, split into whitespace separated fields
+ */
+class FieldReader {
+public:
+    explicit FieldReader(string_view data) : _data(data) {}
+
+    // The fields of the next line that is not blank or a comment
+    bool next(vector<string_view>& fields)
+    {
+        while (_pos < _data.size()) {
+            size_t end = _data.find('\n', _pos);
+            if (end == string_view::npos) {
+                end = _data.size();
+            }
+            string_view line = _data.substr(_pos, end - _pos);
+            _pos = end + 1;
+
+            fields.clear();
+            size_t i = 0;
+            while (i < line.size()) {
+                i = skipSpace(line, i);
+                if (i >= line.size() || line[i] == '#') break;
+                size_t start = i;
+                while (i < line.size() && !isSpace(line[i])) i++;
+                fields.push_back(line.substr(start, i - start));
+            }
+            if (!fields.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    string_view _data;
+    size_t _pos = 0;
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static size_t skipSpace(string_view line, size_t i)
+    {
+        while (i < line.size() && isSpace(line[i])) i++;
+        return i;
+    }
+};
+
+bool parseCount(string_view field, uint64_t& count)
+{
+    if (field.empty()) {
+        return false;
+    }
+    count = 0;
+    for (char c : field) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        count = count * 10 + (c - '0');
+    }
+    return true;
+}
+
+// ============================================================================
+// JSON
+// ============================================================================
+
+/**
+ * Just enough JSON for the Flathub stats: strings without escapes
+ * that matter in app ids, numbers, and skipping anything else
+ */
+class JsonCursor {
+public:
+    explicit JsonCursor(string_view data) : _data(data) {}
+
+    bool ok() const { return _ok; }
+    size_t pos() const { return _pos; }
+    void seek(size_t pos) { _pos = pos; }
+
+    char peek()
+    {
+        space();
+        return _pos < _data.size() ? _data[_pos] : '\0';
+    }
+
+    bool take(char c)
+    {
+        if (peek() != c) {
+            return false;
+        }
+        _pos++;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if (!take(c)) {
+            _ok = false;
+        }
+    }
+
+    string_view str()
+    {
+        if (!take('"')) {
+            _ok = false;
+            return string_view();
+        }
+        size_t start = _pos;
+        while (_pos < _data.size() && _data[_pos] != '"') {
+            _pos += _data[_pos] == '\\' ? 2 : 1;
+        }
+        if (_pos >= _data.size()) {
+            _ok = false;
+            return string_view();
+        }
+        return _data.substr(start, _pos++ - start);
+    }
+
+    uint64_t number()
+    {
+        space();
+        uint64_t value = 0;
+        bool any = false;
+        while (_pos < _data.size() && _data[_pos] >= '0' && _data[_pos] <= '9') {
+            value = value * 10 + (_data[_pos++] - '0');
+            any = true;
+        }
+        if (!any) {
+            _ok = false;
+        }
+        // Fractions and exponents are not counts; skipped
+        while (_pos < _data.size() && strchr(".eE+-0123456789", _data[_pos])) {
+            _pos++;
+        }
+        return value;
+    }
+
+    void skipValue()
+    {
+        char c = peek();
+        if (c == '"') {
+            str();
+        } else if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            _pos++;
+            if (take(close)) {
+                return;
+            }
+            do {
+                if (c == '{') {
+                    str();
+                    expect(':');
+                }
+                skipValue();
+            } while (_ok && take(','));
+            expect(close);
+        } else if (c != '\0') {
+            // Numbers, true, false, null
+            while (_pos < _data.size() && !strchr(",}] \t\r\n", _data[_pos])) {
+                _pos++;
+            }
+        } else {
+            _ok = false;
+        }
+    }
+
+private:
+    string_view _data;
+    size_t _pos = 0;
+    bool _ok = true;
+
+    void space()
+    {
+        while (_pos < _data.size() && strchr(" \t\r\n", _data[_pos])) {
+            _pos++;
+        }
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// Lookups
+// ============================================================================
+
+PopularityIndex::~PopularityIndex()
+{
+    unmap();
+}
+
+void PopularityIndex::unmap()
+{
+    if (_base) {
+        munmap(const_cast<void*>(_base), _mapped);
+    }
+    _base = nullptr;
+    _mapped = 0;
+    _count = 0;
+    _bucketBits = 0;
+    memset(_sourceCounts, 0, sizeof(_sourceCounts));
+    _buckets = nullptr;
+    _hashes = nullptr;
+    _scores = nullptr;
+}
+
+bool PopularityIndex::load(const string& path)
+{
+    unmap();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    const char* bytes = static_cast<const char*>(base);
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(bytes + 8);
+    uint32_t count = header[1];
+    uint32_t bits = header[2];
+
+    size_t hashesOffset = 0, scoresOffset = 0;
+    bool ok = memcmp(bytes, POPULARITY_MAGIC, sizeof(POPULARITY_MAGIC)) == 0 &&
+              header[0] == FORMAT_VERSION &&
+              bits >= MIN_BUCKET_BITS && bits <= MAX_BUCKET_BITS;
+    if (ok) {
+        hashesOffset = align8(HEADER_SIZE + bucketCount(bits) * 4);
+        scoresOffset = hashesOffset + size_t(count) * 8;
+        ok = scoresOffset + size_t(count) * 2 <= (size_t) st.st_size;
+    }
+    if (ok) {
+        // The bucket bounds are trusted by find(); check them once here
+        const uint32_t* buckets = reinterpret_cast<const uint32_t*>(bytes + HEADER_SIZE);
+        size_t bucketTotal = bucketCount(bits);
+        ok = buckets[0] == 0 && buckets[bucketTotal - 1] == count;
+        for (size_t b = 1; ok && b < bucketTotal; b++) {
+            ok = buckets[b - 1] <= buckets[b];
+        }
+    }
+    if (!ok) {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    _base = base;
+    _mapped = st.st_size;
+    _count = count;
+    _bucketBits = bits;
+    memcpy(_sourceCounts, header + 3, sizeof(_sourceCounts));
+    _buckets = reinterpret_cast<const uint32_t*>(bytes + HEADER_SIZE);
+    _hashes = reinterpret_cast<const uint64_t*>(bytes + hashesOffset);
+    _scores = reinterpret_cast<const uint16_t*>(bytes + scoresOffset);
+    return true;
+}
+
+bool PopularityIndex::find(Source source, string_view name, double& score) const
+{
+    if (_count == 0 || source >= SOURCE_COUNT) {
+        return false;
+    }
+
+    uint64_t hash = keyHash(source, name);
+    uint64_t bucket = hash >> (64 - _bucketBits);
+    const uint64_t* begin = _hashes + _buckets[bucket];
+    const uint64_t* end = _hashes + _buckets[bucket + 1];
+
+    const uint64_t* found = lower_bound(begin, end, hash);
+    if (found == end || *found != hash) {
+        return false;
+    }
+    score = _scores[found - _hashes] / 65535.0;
+    return true;
+}
+
+PopularityIndex::Source PopularityIndex::sourceFor(string_view providerId)
+{
+    if (providerId == "apt") return POPCON;
+    if (providerId == "flatpak") return FLATHUB;
+    if (providerId == "snap") return SNAP;
+    return SOURCE_COUNT;
+}
+
+uint64_t PopularityIndex::keyHash(Source source, string_view name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ source) * 1099511628211ull;
+    for (char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ (unsigned char) c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// ============================================================================
+// Building
+// ============================================================================
+
+void PopularityIndex::Builder::add(Source source, string_view name, uint64_t count)
+{
+    if (source >= SOURCE_COUNT || name.empty()) {
+        return;
+    }
+    _counts[source][keyHash(source, name)] += count;
+}
+
+size_t PopularityIndex::Builder::addPopcon(string_view data)
+{
+    // "#rank name                            inst  vote   old recent no-files (maintainer)"
+    FieldReader reader(data);
+    vector<string_view> fields;
+    size_t packages = 0;
+    uint64_t rank, inst;
+    while (reader.next(fields)) {
+        // Past the separator comes a "Total" line; package names are
+        // lowercase, so it cannot be one
+        if (fields.size() < 3 || !parseCount(fields[0], rank) ||
+            !parseCount(fields[2], inst) || fields[1] == "Total") {
+            continue;
+        }
+        add(POPCON, fields[1], inst);
+        packages++;
+    }
+    return packages;
+}
+
+size_t PopularityIndex::Builder::addFlathubStats(string_view data)
+{
+    static const string_view key = "\"refs\"";
+    size_t at = data.find(key);
+    if (at == string_view::npos) {
+        return 0;
+    }
+
+    JsonCursor json(data);
+    json.seek(at + key.size());
+    json.expect(':');
+    json.expect('{');
+
+    size_t apps = 0;
+    if (json.take('}')) {
+        return 0;
+    }
+    do {
+        string_view app = json.str();
+        json.expect(':');
+        json.expect('{');
+
+        uint64_t downloads = 0;
+        if (!json.take('}')) {
+            do {
+                json.str();
+                json.expect(':');
+                size_t value = json.pos();
+                if (json.take('[')) {
+                    downloads += json.number();
+                }
+                json.seek(value);
+                json.skipValue();
+            } while (json.ok() && json.take(','));
+            json.expect('}');
+        }
+
+        if (!json.ok()) {
+            break;
+        }
+        add(FLATHUB, app, downloads);
+        apps++;
+    } while (json.take(','));
+
+    return apps;
+}
+
+size_t PopularityIndex::Builder::addCounts(Source source, string_view data)
+{
+    FieldReader reader(data);
+    vector<string_view> fields;
+    size_t packages = 0;
+    uint64_t count;
+    while (reader.next(fields)) {
+        if (fields.size() >= 2 && parseCount(fields[1], count)) {
+            add(source, fields[0], count);
+            packages++;
+        }
+    }
+    return packages;
+}
+
+bool PopularityIndex::Builder::addFile(Source source, const string& path)
+{
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    switch (source) {
+        case POPCON:
+            return addPopcon(data) > 0;
+        case FLATHUB:
+            return addFlathubStats(data) > 0;
+        default:
+            return addCounts(source, data) > 0;
+    }
+}
+
+bool PopularityIndex::Builder::write(const string& path) const
+{
+    vector<pair<uint64_t, uint16_t>> entries;
+    uint32_t sourceCounts[SOURCE_COUNT] = {};
+
+    for (int s = 0; s < SOURCE_COUNT; s++) {
+        uint64_t most = 0;
+        for (const auto& counted : _counts[s]) {
+            most = max(most, counted.second);
+        }
+        // Installs spread over orders of magnitude; linear scores would
+        // leave all but the top few packages at zero
+        double scale = most > 0 ? 65535.0 / log1p((double) most) : 0;
+        for (const auto& counted : _counts[s]) {
+            entries.emplace_back(counted.first,
+                                 (uint16_t) lround(log1p((double) counted.second) * scale));
+        }
+        sourceCounts[s] = _counts[s].size();
+    }
+
+    sort(entries.begin(), entries.end());
+    // Two names of one hash: keep the higher score
+    auto last = unique(entries.rbegin(), entries.rend(),
+                       [](const pair<uint64_t, uint16_t>& a,
+                          const pair<uint64_t, uint16_t>& b) {
+        return a.first == b.first;
+    });
+    entries.erase(entries.begin(), last.base());
+
+    uint32_t bits = MIN_BUCKET_BITS;
+    while (bits < MAX_BUCKET_BITS && (size_t(1) << bits) < entries.size()) {
+        bits++;
+    }
+
+    vector<uint32_t> buckets(bucketCount(bits), 0);
+    size_t next = 0;
+    for (size_t b = 0; b + 1 < buckets.size(); b++) {
+        buckets[b] = next;
+        while (next < entries.size() && (entries[next].first >> (64 - bits)) == b) {
+            next++;
+        }
+    }
+    buckets.back() = entries.size();
+
+    string tmpPath = path + ".tmp";
+    {
+        ofstream out(tmpPath, ios::binary | ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+
+        uint32_t header[3] = {FORMAT_VERSION, (uint32_t) entries.size(), bits};
+        out.write(POPULARITY_MAGIC, sizeof(POPULARITY_MAGIC));
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(sourceCounts), sizeof(sourceCounts));
+        out.write(reinterpret_cast<const char*>(buckets.data()), buckets.size() * 4);
+
+        size_t written = HEADER_SIZE + buckets.size() * 4;
+        static const char padding[8] = {};
+        out.write(padding, align8(written) - written);
+
+        for (const auto& entry : entries) {
+            out.write(reinterpret_cast<const char*>(&entry.first), sizeof(entry.first));
+        }
+        for (const auto& entry : entries) {
+            out.write(reinterpret_cast<const char*>(&entry.second), sizeof(entry.second));
+        }
+
+        if (!out.good()) {
+            out.close();
+            unlink(tmpPath.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Datasets
+// ============================================================================
+
+bool PopularityIndex::refresh(const string& dir, const vector<Dataset>& datasets,
+                              const Fetcher& fetcher, int maxAgeSeconds)
+{
+    mkdir(dir.c_str(), 0755);
+
+    time_t now = time(nullptr);
+    time_t yesterday = now - 24 * 3600;
+    struct tm day;
+    gmtime_r(&yesterday, &day);
+
+    bool changed = false;
+    for (const Dataset& dataset : datasets) {
+        if (dataset.source >= SOURCE_COUNT || dataset.uri.empty()) {
+            continue;
+        }
+        string file = dir + "/" + SOURCE_NAMES[dataset.source] + ".data";
+
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0 && now - st.st_mtime < maxAgeSeconds) {
+            continue;
+        }
+
+        char uri[1024];
+        if (strftime(uri, sizeof(uri), dataset.uri.c_str(), &day) == 0) {
+            continue;
+        }
+
+        string part = file + ".part";
+        if (fetcher(uri, part) && rename(part.c_str(), file.c_str()) == 0) {
+            changed = true;
+        } else {
+            unlink(part.c_str());
+        }
+    }
+
+    string index = indexPath(dir);
+    if (!changed && loadShared(index)) {
+        return true;
+    }
+
+    Builder builder;
+    for (int s = 0; s < SOURCE_COUNT; s++) {
+        builder.addFile((Source) s, dir + "/" + SOURCE_NAMES[s] + ".data");
+    }
+    return builder.write(index) && loadShared(index);
+}
+
+bool PopularityIndex::loadShared(const string& path)
+{
+    auto index = make_shared<PopularityIndex>();
+    if (!index->load(path)) {
+        return false;
+    }
+
+    SharedIndex& state = sharedIndex();
+    lock_guard<mutex> lock(state.lock);
+    state.index = index;
+    return true;
+}
+
+shared_ptr<const PopularityIndex> PopularityIndex::peek()
+{
+    static const shared_ptr<const PopularityIndex> empty = make_shared<PopularityIndex>();
+    SharedIndex& state = sharedIndex();
+    lock_guard<mutex> lock(state.lock);
+    return state.index ? state.index : empty;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
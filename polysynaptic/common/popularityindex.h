@@ -0,0 +1,220 @@
+/* popularityindex.h - How widely each package is installed
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the table the ranker's popularity score is read
+ * from. Debian's popularity contest, Flathub's download statistics and
+ * store metrics are published as large text and JSON files; here they
+ * are fetched every few days, reduced to one small score per package,
+ * and written out as a sorted hash table that is memory-mapped and
+ * looked up in constant time, so ranking never waits on the network.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _POPULARITYINDEX_H_
+#define _POPULARITYINDEX_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * PopularityIndex - Install counts as scores, by source and package
+ *
+ *     shared_ptr<const PopularityIndex> popularity = PopularityIndex::peek();
+ *     double score;
+ *     if (popularity->find(PopularityIndex::FLATHUB, appId, score))
+ *         ...
+ *
+ * A package's score is its count on a log scale relative to the most
+ * installed package of the same source, from 0 to 1. Names are matched
+ * case-insensitively and per source, so the Debian and the Snap package
+ * of one name keep their own scores.
+ *
+ * File Format (host byte order, FORMAT_VERSION 1):
+ *   char[8]  magic "PSPOPUL\0"
+ *   uint32   format version
+ *   uint32   entry count
+ *   uint32   bucket bits
+ *   uint32   entries per source, SOURCE_COUNT of them
+ *   uint32   first entry of each bucket, (1 << bucket bits) + 1 of them
+ *   uint64   key hashes, ascending, at an 8 byte aligned offset
+ *   uint16   scores, in the same order, 0 - 65535
+ *
+ * A bucket holds the hashes sharing their top bits, of which there are
+ * about as many as entries, so a lookup reads one bucket bound pair and
+ * one or two hashes. The file is written atomically (temp file and
+ * rename); files with another magic or version are ignored.
+ *
+ * Thread Safety:
+ *   Building is single-threaded; a loaded index is read-only and may
+ *   be read from any thread.
+ */
+class PopularityIndex {
+public:
+    enum Source : uint8_t {
+        POPCON,             // Debian packages, by installations
+        FLATHUB,            // Flatpak apps, by downloads
+        SNAP,               // Snaps, by whatever the configured metrics count
+        SOURCE_COUNT
+    };
+
+    static const uint32_t FORMAT_VERSION = 1;
+
+    PopularityIndex() = default;
+    ~PopularityIndex();
+
+    PopularityIndex(const PopularityIndex&) = delete;
+    PopularityIndex& operator=(const PopularityIndex&) = delete;
+
+    /**
+     * Map an index file, replacing what was loaded before
+     *
+     * @return false if it is missing, truncated or of another version
+     */
+    bool load(const string& path);
+
+    /**
+     * The package's score, if its source has it
+     */
+    bool find(Source source, string_view name, double& score) const;
+
+    /**
+     * Whether the source's dataset was part of the build at all, so a
+     * package missing from it is less popular rather than unknown
+     */
+    bool hasSource(Source source) const { return _sourceCounts[source] > 0; }
+
+    size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+
+    /**
+     * The source of a provider id ("apt", "flatpak", "snap"), or
+     * SOURCE_COUNT if there is none
+     */
+    static Source sourceFor(string_view providerId);
+
+    /**
+     * The key of a package: FNV-1a over the source and the lowercased name
+     */
+    static uint64_t keyHash(Source source, string_view name);
+
+    // ========================================================================
+    // Building
+    // ========================================================================
+
+    /**
+     * Builder - Counts from the datasets, written out as an index
+     */
+    class Builder {
+    public:
+        /**
+         * Count installations of a package; counts of a name add up
+         */
+        void add(Source source, string_view name, uint64_t count);
+
+        /**
+         * A popcon "by_inst" listing: rank, name, then the inst column
+         *
+         * @return Packages read
+         */
+        size_t addPopcon(string_view data);
+
+        /**
+         * A Flathub stats day file: {"refs": {"app.Id": {"arch":
+         * [downloads, updates], ...}, ...}, ...}; downloads of all
+         * architectures are counted
+         */
+        size_t addFlathubStats(string_view data);
+
+        /**
+         * "name count" lines, for metrics without a format of their own;
+         * '#' starts a comment
+         */
+        size_t addCounts(Source source, string_view data);
+
+        /**
+         * Add a dataset file in the format of its source
+         */
+        bool addFile(Source source, const string& path);
+
+        bool write(const string& path) const;
+
+    private:
+        unordered_map<uint64_t, uint64_t> _counts[SOURCE_COUNT];
+    };
+
+    // ========================================================================
+    // Datasets
+    // ========================================================================
+
+    /**
+     * Dataset - Where one source's counts are downloaded from
+     *
+     * The URI goes through strftime() with yesterday's UTC date first,
+     * for statistics published per day.
+     */
+    struct Dataset {
+        Source source;
+        string uri;
+    };
+
+    /**
+     * Downloads uri to dest; false if nothing usable was written
+     */
+    using Fetcher = function<bool(const string& uri, const string& dest)>;
+
+    /**
+     * Download the datasets older than maxAgeSeconds into dir and,
+     * if any was new, rebuild dir's index from all of them and make it
+     * the shared one. A dataset that fails to download keeps its last
+     * copy. Blocks for the downloads; call it off the main loop.
+     *
+     * @return false if the index could not be built
+     */
+    static bool refresh(const string& dir, const vector<Dataset>& datasets,
+                        const Fetcher& fetcher, int maxAgeSeconds);
+
+    static string indexPath(const string& dir) { return dir + "/popularity.idx"; }
+
+    /**
+     * Load an index file and make it the shared one, if it loads
+     */
+    static bool loadShared(const string& path);
+
+    /**
+     * The shared index; an empty one before anything was loaded
+     */
+    static shared_ptr<const PopularityIndex> peek();
+
+private:
+    const void* _base = nullptr;
+    size_t _mapped = 0;
+
+    uint32_t _count = 0;
+    uint32_t _bucketBits = 0;
+    uint32_t _sourceCounts[SOURCE_COUNT] = {};
+    const uint32_t* _buckets = nullptr;
+    const uint64_t* _hashes = nullptr;
+    const uint16_t* _scores = nullptr;
+
+    void unmap();
+};
+
+} // namespace PolySynaptic
+
+#endif // _POPULARITYINDEX_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,133 @@
+/* predownloadqueue.cc - Background downloads of pending updates
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "predownloadqueue.h"
+#include "structuredlog.h"
+
+namespace PolySynaptic {
+
+PredownloadQueue::PredownloadQueue(TaskPool& pool, BackendLookup backends,
+                                   PendingUpdates pending)
+    : _pool(pool)
+    , _shared(make_shared<Shared>())
+{
+    _shared->backends = std::move(backends);
+    _shared->pending = std::move(pending);
+}
+
+PredownloadQueue::~PredownloadQueue()
+{
+    stop();
+}
+
+void PredownloadQueue::setEnabled(bool enabled)
+{
+    _shared->enabled = enabled;
+    if (!enabled) {
+        stop();
+    }
+}
+
+void PredownloadQueue::setMetered(bool metered)
+{
+    if (_shared->metered.exchange(metered) != metered && metered) {
+        stop();
+    }
+}
+
+void PredownloadQueue::stop()
+{
+    lock_guard<mutex> lock(_shared->lock);
+    _shared->token.cancel();
+    _shared->token = CancellationToken();
+}
+
+void PredownloadQueue::cancel()
+{
+    unique_lock<mutex> lock(_shared->lock);
+    _shared->token.cancel();
+    _shared->idle.wait(lock, [this]() { return _shared->running.empty(); });
+    _shared->token = CancellationToken();
+}
+
+size_t PredownloadQueue::getCount() const
+{
+    lock_guard<mutex> lock(_shared->lock);
+    return _shared->running.size();
+}
+
+void PredownloadQueue::schedule(BackendType backend)
+{
+    if (!_shared->enabled || _shared->metered) {
+        return;
+    }
+    IPackageBackend* target = _shared->backends(backend);
+    if (!target || !target->supportsPredownload()) {
+        return;
+    }
+
+    CancellationToken token;
+    {
+        lock_guard<mutex> lock(_shared->lock);
+        auto running = _shared->running.find(backend);
+        if (running != _shared->running.end()) {
+            // Fetch the newer set once this one is done
+            running->second = true;
+            return;
+        }
+        _shared->running[backend] = false;
+        token = _shared->token;
+    }
+
+    // Not cancelled through the pool: the task has to run to the end
+    // to take itself out of running
+    shared_ptr<Shared> shared = _shared;
+    _pool.submit(TaskPriority::BACKGROUND, [shared, backend, token]() {
+        run(shared, backend, token);
+        return 0;
+    });
+}
+
+void PredownloadQueue::run(const shared_ptr<Shared>& shared, BackendType backend,
+                           CancellationToken token)
+{
+    auto stopped = [&shared, token]() { return token.isCancelled() || shared->metered; };
+
+    for (;;) {
+        IPackageBackend* target = stopped() ? nullptr : shared->backends(backend);
+        vector<string> ids;
+        if (target) {
+            ids = shared->pending(backend);
+        }
+        if (target && !ids.empty()) {
+            OperationResult result =
+                target->predownloadUpdates(ids, stopped, shared->rateKBps);
+            if (result.success) {
+                LOG_INFO(target->getName() + ": " + result.message);
+            } else if (!stopped()) {
+                LOG_WARN(target->getName() + ": " + result.message +
+                         (result.errorDetails.empty() ? "" : ": " + result.errorDetails));
+            }
+        }
+
+        lock_guard<mutex> lock(shared->lock);
+        auto entry = shared->running.find(backend);
+        if (!entry->second || stopped()) {
+            shared->running.erase(entry);
+            shared->idle.notify_all();
+            return;
+        }
+        entry->second = false;
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,126 @@
+/* predownloadqueue.h - Background downloads of pending updates
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file provides the PredownloadQueue that fetches the updates a
+ * check found into the backends' caches on a pool at background
+ * priority, one download per backend at a time, while they wait to be
+ * committed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PREDOWNLOADQUEUE_H_
+#define _PREDOWNLOADQUEUE_H_
+
+#include "ipackagebackend.h"
+#include "taskpool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+namespace PolySynaptic {
+
+/**
+ * PredownloadQueue - One predownloadUpdates() per backend at a time
+ *
+ * schedule() starts the download of a backend's pending updates, or,
+ * when one is running already, another one right after it, so a newer
+ * update set is fetched too without two downloads writing the same
+ * cache. Nothing starts while the queue is off or the connection is
+ * metered, and going metered stops what runs.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. The backends are asked
+ *   on the pool's workers.
+ */
+class PredownloadQueue {
+public:
+    // The backend of a type, nullptr if it is not there or not enabled
+    using BackendLookup = function<IPackageBackend*(BackendType backend)>;
+    // The ids of the updates of a backend waiting to be committed
+    using PendingUpdates = function<vector<string>(BackendType backend)>;
+
+    /**
+     * @param pool Pool the downloads run on; only kept by reference, so
+     *             it may be constructed after the queue
+     */
+    PredownloadQueue(TaskPool& pool, BackendLookup backends, PendingUpdates pending);
+    ~PredownloadQueue();
+
+    PredownloadQueue(const PredownloadQueue&) = delete;
+    PredownloadQueue& operator=(const PredownloadQueue&) = delete;
+
+    /**
+     * Off by default; turning it off stops the downloads running
+     */
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return _shared->enabled; }
+
+    /**
+     * Rate limit in KB/s passed to the backends, 0 for none
+     */
+    void setRateLimit(int kbps) { _shared->rateKBps = kbps > 0 ? kbps : 0; }
+    int getRateLimit() const { return _shared->rateKBps; }
+
+    /**
+     * Becoming metered stops the downloads running and starts no more
+     */
+    void setMetered(bool metered);
+    bool isMetered() const { return _shared->metered; }
+
+    /**
+     * Download the pending updates of a backend that
+     * supportsPredownload(), or once more after the running download
+     */
+    void schedule(BackendType backend);
+
+    /**
+     * Stop the downloads running through their tokens, not waiting for
+     * them; done by the destructor
+     */
+    void stop();
+
+    /**
+     * stop() and wait until no download is queued or running; later
+     * schedule() calls start downloads again
+     */
+    void cancel();
+
+    /**
+     * Backends whose download is queued or running
+     */
+    size_t getCount() const;
+
+private:
+    // Everything a download touches; the downloads hold it too, so the
+    // queue may go away before they finish
+    struct Shared {
+        BackendLookup backends;
+        PendingUpdates pending;
+        std::atomic<bool> enabled{false};
+        std::atomic<int> rateKBps{0};
+        std::atomic<bool> metered{false};
+        mutable mutex lock;
+        std::condition_variable idle;
+        CancellationToken token;            // Replaced by every stop()
+        map<BackendType, bool> running;     // Running -> another one due after it
+    };
+
+    TaskPool& _pool;
+    shared_ptr<Shared> _shared;
+
+    static void run(const shared_ptr<Shared>& shared, BackendType backend,
+                    CancellationToken token);
+};
+
+} // namespace PolySynaptic
+
+#endif // _PREDOWNLOADQUEUE_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,136 @@
+/* probecache.cc - Remembering whether a backend's tools are present
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "probecache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace PolySynaptic {
+
+namespace {
+
+const uint32_t WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                              IN_CLOSE_WRITE | IN_ATTRIB;
+
+int64_t steadyMillis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Path Watch
+// ============================================================================
+
+PathWatch::PathWatch(const vector<string>& paths)
+    : _fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    if (_fd < 0) {
+        return;
+    }
+
+    for (const auto& path : paths) {
+        size_t slash = path.rfind('/');
+        if (slash == string::npos) {
+            continue;
+        }
+        string dir = slash == 0 ? "/" : path.substr(0, slash);
+        if (slash + 1 == path.size() && dir == "/") {
+            continue;
+        }
+
+        // Adding a directory twice returns the same descriptor
+        int wd = inotify_add_watch(_fd, dir.c_str(), WATCH_EVENTS);
+        if (wd >= 0) {
+            _names[wd].push_back(path.substr(slash + 1));
+        }
+    }
+}
+
+PathWatch::~PathWatch()
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool PathWatch::changed()
+{
+    if (_names.empty()) {
+        return false;
+    }
+
+    // Events for the other files in /usr/bin or /run are read and dropped
+    alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
+    for (;;) {
+        ssize_t n = read(_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (char *p = buffer; p < buffer + n; ) {
+            auto *event = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed = true;
+                continue;
+            }
+            auto it = _names.find(event->wd);
+            if (it == _names.end() || event->len == 0) {
+                continue;
+            }
+            const vector<string>& names = it->second;
+            if (std::find(names.begin(), names.end(), "") != names.end() ||
+                std::find(names.begin(), names.end(), event->name) != names.end()) {
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// ============================================================================
+// Probe Cache
+// ============================================================================
+
+ProbeCache::ProbeCache(const vector<string>& watchedPaths, std::chrono::milliseconds ttl)
+    : _watch(watchedPaths), _ttl(ttl), _valid(false), _expiresAt(0)
+{
+}
+
+bool ProbeCache::isFresh()
+{
+    if (_watch.changed()) {
+        _valid.store(false, std::memory_order_release);
+    }
+    if (!_valid.load(std::memory_order_acquire)) {
+        return false;
+    }
+    return steadyMillis() < _expiresAt.load(std::memory_order_relaxed);
+}
+
+void ProbeCache::markFresh()
+{
+    _expiresAt.store(steadyMillis() + _ttl.count(), std::memory_order_relaxed);
+    _valid.store(true, std::memory_order_release);
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,103 @@
+/* probecache.h - Remembering whether a backend's tools are present
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the cache behind the backends' availability
+ * checks. Finding out whether snap or flatpak is installed, and which
+ * version, spawns processes or talks to a daemon; the answer is kept
+ * until it expires or inotify reports that the binary, socket or
+ * configuration it was based on was created, replaced or removed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PROBECACHE_H_
+#define _PROBECACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * PathWatch - Notices changes to a few files
+ *
+ * The directories holding the paths are watched rather than the paths
+ * themselves, so a file that does not exist yet, or is replaced by
+ * rename as package managers do, is still seen. A path ending in '/'
+ * stands for every entry of that directory. Directories that do not
+ * exist are skipped.
+ *
+ * Nothing runs in the background: changed() is one non-blocking read.
+ *
+ * Thread Safety:
+ *   changed() may be called from any thread; each change is reported
+ *   to one caller.
+ */
+class PathWatch {
+public:
+    explicit PathWatch(const vector<string>& paths);
+    ~PathWatch();
+
+    PathWatch(const PathWatch&) = delete;
+    PathWatch& operator=(const PathWatch&) = delete;
+
+    /**
+     * Whether any of the paths changed since the last call
+     */
+    bool changed();
+
+    /**
+     * False if inotify is unavailable or none of the directories exist
+     */
+    bool isWatching() const { return !_names.empty(); }
+
+private:
+    int _fd;
+    map<int, vector<string>> _names;    // Watch descriptor -> file names in it, "" for all
+};
+
+/**
+ * ProbeCache - Validity of one cached probe result
+ *
+ *     if (_availability.isFresh()) return;
+ *     lock_guard<mutex> lock(_mutex);
+ *     if (_availability.isFresh()) return;
+ *     ... probe, store the results ...
+ *     _availability.markFresh();
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. markFresh() releases
+ *   the results written before it to threads that see isFresh().
+ */
+class ProbeCache {
+public:
+    ProbeCache(const vector<string>& watchedPaths, std::chrono::milliseconds ttl);
+
+    bool isFresh();
+    void markFresh();
+    void invalidate() { _valid.store(false, std::memory_order_release); }
+
+    bool isWatching() const { return _watch.isWatching(); }
+
+private:
+    PathWatch _watch;
+    std::chrono::milliseconds _ttl;
+    std::atomic<bool> _valid;
+    std::atomic<int64_t> _expiresAt;    // Steady clock, milliseconds
+};
+
+} // namespace PolySynaptic
+
+#endif // _PROBECACHE_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,199 @@
+/* processgovernor.cc - How many snap and flatpak children run at once
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "processgovernor.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace PolySynaptic {
+
+namespace {
+
+// How often a waiting command asks its cancellation callback
+const int CANCEL_CHECK_MS = 100;
+
+thread_local ProcessPriority t_priority = ProcessPriority::INTERACTIVE;
+
+} // anonymous namespace
+
+ProcessGovernor& ProcessGovernor::instance()
+{
+    static ProcessGovernor governor;
+    return governor;
+}
+
+void ProcessGovernor::setLimit(const string& pool, int limit)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _pools[pool].limit = limit;
+    }
+    // A higher limit may let waiting commands start
+    _released.notify_all();
+}
+
+int ProcessGovernor::getLimit(const string& pool) const
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _pools.find(pool);
+    return it == _pools.end() ? DEFAULT_LIMIT : it->second.limit;
+}
+
+// ============================================================================
+// Slots
+// ============================================================================
+
+ProcessGovernor::Slot::Slot(const string& pool, ProcessPriority priority,
+                            bool preemptible, const function<bool()>& cancelled)
+    : _pool(pool)
+    , _priority(priority)
+    , _preemptible(preemptible && priority == ProcessPriority::BACKGROUND)
+    , _acquired(false)
+    , _preempted(false)
+{
+    _acquired = ProcessGovernor::instance().acquire(this, cancelled);
+}
+
+ProcessGovernor::Slot::~Slot()
+{
+    if (_acquired) {
+        ProcessGovernor::instance().release(this);
+    }
+}
+
+// Called with the lock held
+bool ProcessGovernor::isNext(const Pool& pool, const Slot* slot)
+{
+    if (pool.limit > 0 && pool.running >= pool.limit) {
+        return false;
+    }
+    for (const auto& queue : pool.waiting) {
+        if (!queue.empty()) {
+            return queue.front() == slot;
+        }
+    }
+    return false;
+}
+
+bool ProcessGovernor::acquire(Slot* slot, const function<bool()>& cancelled)
+{
+    unique_lock<mutex> lock(_mutex);
+    Pool& pool = _pools[slot->_pool];
+    deque<Slot*>& queue = pool.waiting[static_cast<int>(slot->_priority)];
+    queue.push_back(slot);
+
+    if (slot->_priority == ProcessPriority::INTERACTIVE && !isNext(pool, slot)) {
+        preemptFor(pool);
+    }
+
+    while (!isNext(pool, slot)) {
+        if (!cancelled) {
+            _released.wait(lock);
+            continue;
+        }
+        _released.wait_for(lock, std::chrono::milliseconds(CANCEL_CHECK_MS));
+        if (!isNext(pool, slot) && cancelled()) {
+            queue.erase(find(queue.begin(), queue.end(), slot));
+            // Whoever queued behind this one may be next now
+            lock.unlock();
+            _released.notify_all();
+            return false;
+        }
+    }
+
+    queue.pop_front();
+    pool.running++;
+    pool.holders.push_back(slot);
+    lock.unlock();
+    // The limit may leave room for the next one as well
+    _released.notify_all();
+    return true;
+}
+
+void ProcessGovernor::release(Slot* slot)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        Pool& pool = _pools[slot->_pool];
+        pool.running--;
+        pool.holders.erase(find(pool.holders.begin(), pool.holders.end(), slot));
+    }
+    _released.notify_all();
+}
+
+// Called with the lock held. The slot that started last has done the
+// least work, so it is the one asked to stop.
+void ProcessGovernor::preemptFor(Pool& pool)
+{
+    for (auto it = pool.holders.rbegin(); it != pool.holders.rend(); ++it) {
+        Slot* holder = *it;
+        if (holder->_preemptible && !holder->preempted()) {
+            holder->_preempted.store(true, std::memory_order_relaxed);
+            _preemptions++;
+            return;
+        }
+    }
+}
+
+// ============================================================================
+// Thread Priority
+// ============================================================================
+
+ProcessGovernor::PriorityScope::PriorityScope(ProcessPriority priority)
+    : _previous(t_priority)
+{
+    t_priority = priority;
+}
+
+ProcessGovernor::PriorityScope::~PriorityScope()
+{
+    t_priority = _previous;
+}
+
+ProcessPriority ProcessGovernor::currentPriority()
+{
+    return t_priority;
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+int ProcessGovernor::getRunning(const string& pool) const
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _pools.find(pool);
+    return it == _pools.end() ? 0 : it->second.running;
+}
+
+int ProcessGovernor::getWaiting(const string& pool) const
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _pools.find(pool);
+    if (it == _pools.end()) {
+        return 0;
+    }
+    int waiting = 0;
+    for (const auto& queue : it->second.waiting) {
+        waiting += queue.size();
+    }
+    return waiting;
+}
+
+uint64_t ProcessGovernor::getPreemptedCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _preemptions;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
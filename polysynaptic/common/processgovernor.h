@@ -0,0 +1,158 @@
+/* processgovernor.h - How many snap and flatpak children run at once
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the limit every command of the CLI backends
+ * goes through. Refreshes, availability probes, details lookups and a
+ * search would otherwise all start their tool at the same moment and
+ * queue on snapd and the ostree repository lock, which leaves the
+ * query the user is waiting for the slowest of them. Here each backend
+ * gets a few slots, handed out by priority, and background work that
+ * holds a slot an interactive command wants is stopped and run again
+ * once the slot is free.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PROCESSGOVERNOR_H_
+#define _PROCESSGOVERNOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * ProcessPriority - Who is waiting for a command
+ */
+enum class ProcessPriority {
+    INTERACTIVE = 0,    // The user is (search, details, foreground loads)
+    PREFETCH = 1,       // Someone may soon be (details of visible rows)
+    BACKGROUND = 2      // Nobody is (cache refreshes, update checks)
+};
+
+/**
+ * ProcessGovernor - Slots for the children of each backend
+ *
+ * A pool per backend ("snap", "flatpak") has a limit of children
+ * running at once. Waiting commands get a free slot highest priority
+ * first, in arrival order within a priority. An interactive command
+ * that finds its pool full asks one preemptible background command
+ * to stop; Subprocess sends it SIGTERM and starts it again when it
+ * gets a slot back.
+ *
+ * The priority of a command is that of the thread running it: the
+ * TaskPool workers take theirs from the task, PriorityScope sets it
+ * for other code, and a thread that never set one is interactive.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class ProcessGovernor {
+public:
+    // Slots of a pool nobody set a limit for
+    static const int DEFAULT_LIMIT = 2;
+
+    static ProcessGovernor& instance();
+
+    /**
+     * Slots of a pool; 0 or less for no limit
+     */
+    void setLimit(const string& pool, int limit);
+    int getLimit(const string& pool) const;
+
+    /**
+     * Slot - One running child, held for the life of the object
+     *
+     * The constructor waits for the slot; acquired() is false if
+     * cancelled said to stop waiting first.
+     */
+    class Slot {
+    public:
+        Slot(const string& pool, ProcessPriority priority, bool preemptible,
+             const function<bool()>& cancelled = nullptr);
+        ~Slot();
+
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+        bool acquired() const { return _acquired; }
+        bool preemptible() const { return _preemptible; }
+
+        /**
+         * Whether an interactive command asked this one to stop
+         */
+        bool preempted() const { return _preempted.load(std::memory_order_relaxed); }
+
+    private:
+        friend class ProcessGovernor;
+
+        string _pool;
+        ProcessPriority _priority;
+        bool _preemptible;
+        bool _acquired;
+        atomic<bool> _preempted;
+    };
+
+    /**
+     * PriorityScope - The priority of the commands this thread starts
+     * until the scope ends
+     */
+    class PriorityScope {
+    public:
+        explicit PriorityScope(ProcessPriority priority);
+        ~PriorityScope();
+
+        PriorityScope(const PriorityScope&) = delete;
+        PriorityScope& operator=(const PriorityScope&) = delete;
+
+    private:
+        ProcessPriority _previous;
+    };
+
+    static ProcessPriority currentPriority();
+
+    // Statistics
+    int getRunning(const string& pool) const;
+    int getWaiting(const string& pool) const;
+    uint64_t getPreemptedCount() const;
+
+private:
+    ProcessGovernor() = default;
+
+    struct Pool {
+        int limit = DEFAULT_LIMIT;
+        int running = 0;
+        deque<Slot*> waiting[3];       // Indexed by ProcessPriority
+        vector<Slot*> holders;          // Running, in the order they started
+    };
+
+    mutable mutex _mutex;
+    condition_variable _released;
+    map<string, Pool> _pools;
+    uint64_t _preemptions = 0;
+
+    bool acquire(Slot* slot, const function<bool()>& cancelled);
+    void release(Slot* slot);
+    void preemptFor(Pool& pool);
+
+    static bool isNext(const Pool& pool, const Slot* slot);
+};
+
+} // namespace PolySynaptic
+
+#endif // _PROCESSGOVERNOR_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,152 @@
+/* progressaggregator.cc - One progress report out of many reporters
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "progressaggregator.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace PolySynaptic {
+
+ProgressAggregator::ProgressAggregator(ProgressCallback target, Dispatcher dispatcher,
+                                       int intervalMs)
+    : _shared(make_shared<Shared>())
+{
+    _shared->target = std::move(target);
+    _shared->dispatcher = std::move(dispatcher);
+    _shared->interval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::milliseconds(max(intervalMs, 0))).count();
+    // The first report is delivered at once
+    _shared->deliveredAt = now() - _shared->interval;
+}
+
+int64_t ProgressAggregator::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ProgressCallback ProgressAggregator::source(const string& label, double weight)
+{
+    _shared->sources.emplace_back();
+    Source& source = _shared->sources.back();
+    source.label = label;
+    source.weight = max(weight, 0.0);
+    source.messageAt = now() - _shared->interval;
+    _shared->totalWeight += source.weight;
+
+    shared_ptr<Shared> shared = _shared;
+    size_t index = _shared->sources.size() - 1;
+    return [shared, index](double fraction, const string& message) {
+        return report(shared, index, fraction, message);
+    };
+}
+
+// ============================================================================
+// Reporting
+// ============================================================================
+
+bool ProgressAggregator::report(const shared_ptr<Shared>& shared, size_t index,
+                                double fraction, const string& message)
+{
+    if (shared->cancelled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    Source& source = shared->sources[index];
+    source.fraction.store(fraction, std::memory_order_relaxed);
+
+    int64_t t = now();
+    // Skipped if the consumer is reading it; a later one gets through
+    if (!message.empty() &&
+        t - source.messageAt.load(std::memory_order_relaxed) >= shared->interval &&
+        !source.busy.test_and_set(std::memory_order_acquire)) {
+        source.message = message;
+        source.busy.clear(std::memory_order_release);
+        source.messageAt.store(t, std::memory_order_relaxed);
+        shared->latest.store(index, std::memory_order_relaxed);
+    }
+
+    if (!shared->target || shared->finished.load(std::memory_order_relaxed)) {
+        return !shared->cancelled.load(std::memory_order_relaxed);
+    }
+
+    if (t - shared->deliveredAt.load(std::memory_order_relaxed) >= shared->interval &&
+        !shared->pending.exchange(true, std::memory_order_acquire)) {
+        shared->deliveredAt.store(t, std::memory_order_relaxed);
+        if (shared->dispatcher) {
+            shared->dispatcher([shared]() { deliver(shared, false); });
+        } else {
+            deliver(shared, false);
+        }
+    }
+    return !shared->cancelled.load(std::memory_order_relaxed);
+}
+
+void ProgressAggregator::deliver(const shared_ptr<Shared>& shared, bool last)
+{
+    if (!last && shared->finished.load(std::memory_order_relaxed)) {
+        shared->pending.store(false, std::memory_order_release);
+        return;
+    }
+
+    double overall = 0;
+    for (const auto& source : shared->sources) {
+        double fraction = source.fraction.load(std::memory_order_relaxed);
+        overall += source.weight * min(max(fraction, 0.0), 1.0);
+    }
+    if (shared->totalWeight > 0) {
+        overall /= shared->totalWeight;
+    }
+
+    string message;
+    int latest = shared->latest.load(std::memory_order_relaxed);
+    if (latest >= 0) {
+        Source& source = shared->sources[latest];
+        // Held by a reporter only for the copy of one message
+        while (source.busy.test_and_set(std::memory_order_acquire)) {
+        }
+        message = source.message;
+        source.busy.clear(std::memory_order_release);
+        if (!source.label.empty()) {
+            message = "[" + source.label + "] " + message;
+        }
+    }
+
+    if (!shared->target(overall, message)) {
+        shared->cancelled.store(true, std::memory_order_relaxed);
+    }
+    if (!last) {
+        shared->pending.store(false, std::memory_order_release);
+    }
+}
+
+void ProgressAggregator::finish()
+{
+    if (!_shared->target || _shared->finished.exchange(true)) {
+        return;
+    }
+
+    if (_shared->dispatcher) {
+        // Runs after any delivery dispatched before it
+        shared_ptr<Shared> shared = _shared;
+        _shared->dispatcher([shared]() { deliver(shared, true); });
+        return;
+    }
+
+    // A reporter may be delivering on its thread; wait for it to return
+    while (_shared->pending.exchange(true, std::memory_order_acquire)) {
+    }
+    deliver(_shared, true);
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,116 @@
+/* progressaggregator.h - One progress report out of many reporters
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the progress path of operations that run on
+ * several workers at once. The backends report per package or per
+ * line of tool output, from whichever thread they run on; here those
+ * reports cost a couple of atomic stores, are merged into one overall
+ * fraction, and reach the caller's callback a few times per frame on a
+ * single thread - the GTK main loop, given its dispatcher.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PROGRESSAGGREGATOR_H_
+#define _PROGRESSAGGREGATOR_H_
+
+#include "ipackagebackend.h"
+#include "asyncbackend.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace PolySynaptic {
+
+/**
+ * ProgressAggregator - Merges and rate-limits concurrent progress
+ *
+ *     ProgressAggregator progress(callback, dispatcher);
+ *     ProgressCallback snap = progress.source("Snap");
+ *     ProgressCallback flatpak = progress.source("Flatpak");
+ *     ... hand them to the workers ...
+ *     progress.finish();
+ *
+ * The target gets the weighted mean of the sources' fractions and
+ * the latest message, prefixed with its source's label. It is called
+ * at most once an interval, never from two threads at once, through
+ * the dispatcher if there is one and otherwise on the reporting thread
+ * that found the interval over. An empty message keeps the source's
+ * previous one. Once the target returns false every source returns
+ * false as well.
+ *
+ * Reports in between only update the source's state; the message is
+ * copied once an interval per source, so the last one before a pause
+ * may show late or not at all. finish() delivers the final state.
+ *
+ * Thread Safety:
+ *   The sources may be called from any thread and never block; they
+ *   must all be made with source() before any of them reports.
+ */
+class ProgressAggregator {
+public:
+    // About a frame at 60 Hz
+    static const int DEFAULT_INTERVAL_MS = 16;
+
+    explicit ProgressAggregator(ProgressCallback target,
+                                Dispatcher dispatcher = nullptr,
+                                int intervalMs = DEFAULT_INTERVAL_MS);
+
+    ProgressAggregator(const ProgressAggregator&) = delete;
+    ProgressAggregator& operator=(const ProgressAggregator&) = delete;
+
+    /**
+     * A reporter whose fraction counts weight times in the overall one;
+     * the callback may outlive the aggregator
+     */
+    ProgressCallback source(const string& label = "", double weight = 1.0);
+
+    /**
+     * Deliver the current state now, and nothing after it
+     */
+    void finish();
+
+    bool cancelled() const { return _shared->cancelled.load(std::memory_order_relaxed); }
+
+private:
+    struct Source {
+        string label;
+        double weight = 1.0;
+        atomic<double> fraction{0.0};
+        atomic<int64_t> messageAt{INT64_MIN};  // When message was last set
+        atomic_flag busy = ATOMIC_FLAG_INIT;     // Guards message
+        string message;
+    };
+
+    struct Shared {
+        ProgressCallback target;
+        Dispatcher dispatcher;
+        int64_t interval = 0;                  // Nanoseconds
+        deque<Source> sources;
+        double totalWeight = 0;
+        atomic<int> latest{-1};                // Source of the newest message
+        atomic<int64_t> deliveredAt{INT64_MIN};
+        atomic<bool> pending{false};           // A delivery is on its way
+        atomic<bool> finished{false};
+        atomic<bool> cancelled{false};
+    };
+
+    shared_ptr<Shared> _shared;
+
+    static bool report(const shared_ptr<Shared>& shared, size_t index,
+                       double fraction, const string& message);
+    static void deliver(const shared_ptr<Shared>& shared, bool last);
+    static int64_t now();
+};
+
+} // namespace PolySynaptic
+
+#endif // _PROGRESSAGGREGATOR_H_
+
+// vim:ts=4:sw=4:et
@@ -25,7 +25,10 @@
 #include "config.h"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include <apt-pkg/error.h>
 #include <apt-pkg/configuration.h>
@@ -57,18 +60,40 @@ istream &operator>>(istream &is, RAPTOptions::packageOptions &o)
 }
 
 
+// mtime and size of path, empty if it does not exist
+static string fileStamp(const char *path)
+{
+   struct stat st;
+   if (stat(path, &st) != 0)
+      return string();
+   ostringstream stamp;
+   stamp << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec << ":" << st.st_size;
+   return stamp.str();
+}
+
 bool RAPTOptions::store()
 {
-   ofstream out;
-   if (!RPackageOptionsFile(out))
-      return false;
+   if (!_dirty)
+      return true;
 
-   for (packageOptionsIter it = _roptions->_packageOptions.begin();
-        it != _roptions->_packageOptions.end(); it++) {
-      // we only write out if it's new and the pkgname is not empty
+   // we only write out if it's new and the pkgname is not empty
+   vector<string> names;
+   for (packageOptionsIter it = _packageOptions.begin();
+        it != _packageOptions.end(); it++) {
       if ((*it).second.isNew && !(*it).first.empty())
-         out << (*it).first << " " << (*it).second << endl;
+         names.push_back((*it).first);
    }
+   sort(names.begin(), names.end());
+
+   ostringstream out;
+   for (unsigned int i = 0; i < names.size(); i++)
+      out << names[i] << " " << _packageOptions[names[i]] << endl;
+
+   if (!RWriteFileAtomic(RPackageOptionsPath(), out.str()))
+      return _error->Errno("ofstream",
+                           _("ERROR: couldn't open %s for writing"),
+                           RPackageOptionsPath().c_str());
+   _dirty = false;
    return true;
 }
 
@@ -91,6 +116,7 @@ bool RAPTOptions::restore()
       strstr >> pkg >> o >> ws;
       _packageOptions[pkg] = o;
    }
+   _dirty = false;
 
    // upgrade code for older synaptic versions, can go away in the future
    if(FileExists(RConfDir()+"/preferences"))
@@ -149,13 +175,12 @@ bool RAPTOptions::restore()
 
 bool RAPTOptions::getPackageDebconf(const char *package)
 {
-   string tmp = string(package);
-
-   if (_packageOptions.find(tmp) == _packageOptions.end())
+   packageOptionsIter it = _packageOptions.find(package);
+   if (it == _packageOptions.end())
       return false;
 
    //cout << "getPackageOrphaned("<<package<<") called"<<endl;
-   return _packageOptions[tmp].isDebconf;
+   return it->second.isDebconf;
 }
 
 
@@ -169,6 +194,14 @@ void RAPTOptions::rereadDebconf()
 {
    //cout << "void RAPTOptions::rereadDebconf()" << endl;
 
+   // a package with a .config script can only come or go with a
+   // file in the directory, which changes its mtime
+   const char infodir[] = "/var/lib/dpkg/info";
+   string stamp = fileStamp(infodir);
+   if (!stamp.empty() && stamp == _debconfStamp)
+      return;
+   _debconfStamp = stamp;
+
    // forget about any previously debconf packages
    for (packageOptionsIter it = _roptions->_packageOptions.begin();
         it != _roptions->_packageOptions.end(); it++) {
@@ -176,7 +209,6 @@ void RAPTOptions::rereadDebconf()
    }
 
    // read dir
-   const char infodir[] = "/var/lib/dpkg/info";
    const char configext[] = ".config";
 
    DIR *dir;
@@ -201,6 +233,13 @@ void RAPTOptions::rereadDebconf()
 
 void RAPTOptions::rereadOrphaned()
 {
+   // deborphan only looks at what is installed and at its keep list
+   string stamp = fileStamp("/var/lib/dpkg/status") + ";" +
+                  fileStamp("/var/lib/deborphan/keep");
+   if (stamp == _orphanedStamp)
+      return;
+   _orphanedStamp = stamp;
+
    // forget about any previously orphaned packages
    for (packageOptionsIter it = _roptions->_packageOptions.begin();
         it != _roptions->_packageOptions.end(); it++) {
@@ -232,13 +271,12 @@ void RAPTOptions::rereadOrphaned()
 
 bool RAPTOptions::getPackageOrphaned(const char *package)
 {
-   string tmp = string(package);
-
-   if (_packageOptions.find(tmp) == _packageOptions.end())
+   packageOptionsIter it = _packageOptions.find(package);
+   if (it == _packageOptions.end())
       return false;
 
    //cout << "getPackageOrphaned("<<package<<") called"<<endl;
-   return _packageOptions[tmp].isOrphaned;
+   return it->second.isOrphaned;
 }
 
 
@@ -251,12 +289,11 @@ void RAPTOptions::setPackageOrphaned(const char *package, bool flag)
 
 bool RAPTOptions::getPackageLock(const char *package)
 {
-   string tmp = string(package);
-
-   if (_packageOptions.find(tmp) == _packageOptions.end())
+   packageOptionsIter it = _packageOptions.find(package);
+   if (it == _packageOptions.end())
       return false;
 
-   return _packageOptions[tmp].isLocked;
+   return it->second.isLocked;
 }
 
 
@@ -267,23 +304,27 @@ void RAPTOptions::setPackageLock(const char *package, bool lock)
 
 bool RAPTOptions::getPackageNew(const char *package)
 {
-   string tmp = string(package);
-
-   if (_packageOptions.find(tmp) == _packageOptions.end())
+   packageOptionsIter it = _packageOptions.find(package);
+   if (it == _packageOptions.end())
       return false;
 
-   return _packageOptions[tmp].isNew;
+   return it->second.isNew;
 }
 
 void RAPTOptions::setPackageNew(const char *package, bool lock)
 {
-   _packageOptions[string(package)].isNew = lock;
+   bool &isNew = _packageOptions[string(package)].isNew;
+   if (isNew != lock)
+      _dirty = true;
+   isNew = lock;
 }
 
 void RAPTOptions::forgetNewPackages()
 {
    for (packageOptionsIter it = _roptions->_packageOptions.begin();
         it != _roptions->_packageOptions.end(); it++) {
+      if ((*it).second.isNew)
+         _dirty = true;
       (*it).second.isNew = false;
    }
 }
@@ -26,6 +26,7 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <apt-pkg/configuration.h>
 
 using namespace std;
@@ -46,6 +47,9 @@ class RAPTOptions {
       bool isDebconf;
    };
 
+   RAPTOptions() : _dirty(false) {}
+
+   // store() only writes when a package's "new" mark changed
    bool store();
    bool restore();
 
@@ -71,13 +75,22 @@ class RAPTOptions {
    void setString(const char *key, string value);
 
  private:
-   map<string, packageOptions> _packageOptions;
+   // looked up for every package at each openCache()
+   unordered_map<string, packageOptions> _packageOptions;
    map<string, string> _options;
+
+   // isNew changed since the options file was read or written
+   bool _dirty;
+
+   // what deborphan and the debconf scan were last run against, to
+   // skip rerunning them when nothing was installed or removed since
+   string _orphanedStamp;
+   string _debconfStamp;
 };
 
 extern RAPTOptions *_roptions;
 
-typedef map<string, RAPTOptions::packageOptions>::iterator packageOptionsIter;
+typedef unordered_map<string, RAPTOptions::packageOptions>::iterator packageOptionsIter;
 
 ostream &operator<<(ostream &os, const RAPTOptions::packageOptions &);
 istream &operator>>(istream &is, RAPTOptions::packageOptions &o);
@@ -0,0 +1,128 @@
+/* rarena.h - Chunked object arena
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RARENA_H
+#define RARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Hands out objects of one type from a few large chunks instead of one
+// heap block each. reserve() the expected count up front and the
+// objects end up next to each other in memory. Destroyed objects leave
+// their slot to the next create(), so a long-lived arena does not grow
+// with churn.
+//
+// Objects keep their address for the lifetime of the arena. Freeing the
+// arena (release() or the destructor) returns all chunks at once
+// without running the destructors of the objects still in it; only put
+// objects there whose destructors do nothing the process needs.
+template<class T>
+class RArena {
+ public:
+   RArena(size_t chunkSize = 1024)
+      : _chunkSize(chunkSize ? chunkSize : 1), _free(NULL),
+        _cursor(NULL), _limit(NULL), _live(0), _reserved(0) {}
+   ~RArena() { release(); }
+
+   // make sure the next count objects come from one contiguous chunk
+   void reserve(size_t count) {
+      if ((size_t)(_limit - _cursor) < count)
+         grow(count);
+   }
+
+   template<class... Args>
+   T *create(Args&&... args) {
+      Slot *slot;
+      if (_free != NULL) {
+         slot = _free;
+         _free = _free->next;
+      } else {
+         if (_cursor == _limit)
+            grow(_chunkSize);
+         slot = _cursor++;
+      }
+      T *obj = new (slot->storage) T(std::forward<Args>(args)...);
+      _live++;
+      return obj;
+   }
+
+   void destroy(T *obj) {
+      if (obj == NULL)
+         return;
+      obj->~T();
+      Slot *slot = reinterpret_cast<Slot *>(obj);
+      slot->next = _free;
+      _free = slot;
+      _live--;
+   }
+
+   // drop every chunk in one go, see above
+   void release() {
+      for (size_t i = 0; i < _chunks.size(); i++)
+         ::operator delete(_chunks[i]);
+      _chunks.clear();
+      _free = _cursor = _limit = NULL;
+      _live = 0;
+      _reserved = 0;
+   }
+
+   // number of objects currently alive
+   size_t size() const { return _live; }
+
+   // bytes of every chunk allocated so far, in use or not
+   size_t reservedBytes() const { return _reserved; }
+
+ private:
+   union Slot {
+      Slot *next;
+      alignas(T) unsigned char storage[sizeof(T)];
+   };
+
+   void grow(size_t count) {
+      // the rest of the current chunk is given up
+      Slot *chunk = static_cast<Slot *>(::operator new(count * sizeof(Slot)));
+      _chunks.push_back(chunk);
+      _reserved += count * sizeof(Slot);
+      _cursor = chunk;
+      _limit = chunk + count;
+   }
+
+   // not copyable, objects point into the chunks
+   RArena(const RArena &);
+   RArena &operator=(const RArena &);
+
+   size_t _chunkSize;
+   vector<Slot *> _chunks;
+   Slot *_free;
+   Slot *_cursor;
+   Slot *_limit;
+   size_t _live;
+   size_t _reserved;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,157 @@
+/* rautoremove.cc - The auto-removable packages, kept up to date
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#include "rautoremove.h"
+
+#include <algorithm>
+
+void RAutoRemoveTracker::clear()
+{
+   _states.clear();
+   _installed.clear();
+   _marked.clear();
+   _kept.clear();
+   _affected.clear();
+   _touched = 0;
+}
+
+void RAutoRemoveTracker::mark(Graph &graph, vector<unsigned int> &queue)
+{
+   while (!queue.empty()) {
+      unsigned int id = queue.back();
+      queue.pop_back();
+      if (_marked[id])
+         continue;
+      _marked[id] = 1;
+      _touched++;
+      _kept[id].clear();
+      graph.kept(id, _kept[id]);
+      for (unsigned int k : _kept[id]) {
+         if (!_marked[k])
+            queue.push_back(k);
+      }
+   }
+}
+
+void RAutoRemoveTracker::rebuild(Graph &graph)
+{
+   unsigned int size = graph.size();
+   _states.resize(size);
+   _installed.assign(size, 0);
+   _marked.assign(size, 0);
+   _kept.assign(size, vector<unsigned int>());
+   _affected.assign(size, 0);
+   _touched = 0;
+
+   vector<unsigned int> queue;
+   for (unsigned int id = 0; id < size; id++) {
+      _states[id] = graph.state(id);
+      _installed[id] = graph.isInstalled(id);
+      if (_installed[id] && graph.isRoot(id))
+         queue.push_back(id);
+   }
+   mark(graph, queue);
+}
+
+void RAutoRemoveTracker::update(Graph &graph)
+{
+   _touched = 0;
+   if (graph.size() != _states.size()) {
+      rebuild(graph);
+      return;
+   }
+
+   vector<unsigned int> affected;
+   for (unsigned int id = 0; id < _states.size(); id++) {
+      uint64_t state = graph.state(id);
+      if (state != _states[id]) {
+         _states[id] = state;
+         _affected[id] = 1;
+         affected.push_back(id);
+      }
+   }
+   if (affected.empty())
+      return;
+
+   // unmark what the changed packages kept, as they kept it before
+   vector<unsigned int> stack(affected);
+   while (!stack.empty()) {
+      unsigned int id = stack.back();
+      stack.pop_back();
+      if (!_marked[id])
+         continue;
+      _marked[id] = 0;
+      for (unsigned int k : _kept[id]) {
+         if (_marked[k] && !_affected[k]) {
+            _affected[k] = 1;
+            affected.push_back(k);
+            stack.push_back(k);
+         }
+      }
+      _kept[id].clear();
+   }
+
+   // mark again what is a root or is still kept from outside; asking
+   // the keeper afresh, what it keeps may have changed with the marks
+   vector<unsigned int> queue;
+   vector<unsigned int> keepers;
+   vector<unsigned int> kept;
+   for (unsigned int id : affected) {
+      _touched++;
+      _installed[id] = graph.isInstalled(id);
+      if (!_installed[id])
+         continue;
+      if (graph.isRoot(id)) {
+         queue.push_back(id);
+         continue;
+      }
+      keepers.clear();
+      graph.keepers(id, keepers);
+      for (unsigned int p : keepers) {
+         if (!_marked[p] || _affected[p])
+            continue;
+         kept.clear();
+         graph.kept(p, kept);
+         if (find(kept.begin(), kept.end(), id) != kept.end()) {
+            _kept[p].swap(kept);
+            queue.push_back(id);
+            break;
+         }
+      }
+   }
+   mark(graph, queue);
+
+   for (unsigned int id : affected)
+      _affected[id] = 0;
+}
+
+vector<unsigned int> RAutoRemoveTracker::garbage() const
+{
+   vector<unsigned int> ids;
+   for (unsigned int id = 0; id < _marked.size(); id++) {
+      if (isGarbage(id))
+         ids.push_back(id);
+   }
+   return ids;
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,93 @@
+/* rautoremove.h - The auto-removable packages, kept up to date
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#ifndef RAUTOREMOVE_H
+#define RAUTOREMOVE_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Which packages are auto-removable (installed automatically and kept
+// by nothing installed any more), as apt's mark and sweep finds them,
+// but updated after a change instead of recomputed: apt marks from
+// every root over the whole installed graph after each action group,
+// here only the packages a change can reach are looked at again.
+//
+// The packages whose state changed are found by comparing their
+// Graph::state() with what it was. Everything that was kept through
+// them is unmarked, and then marked again if something still keeps
+// it ("delete and re-derive"): removing a leaf touches the leaf, and
+// only removing e.g. a desktop task touches the libraries it pulled in.
+class RAutoRemoveTracker {
+ public:
+   // the packages as the tracker needs them, ids 0..size()-1
+   class Graph {
+    public:
+      virtual ~Graph() {}
+      virtual unsigned int size() = 0;
+      // differs whenever the version to be installed, the auto flag or
+      // the mark of id changes
+      virtual uint64_t state(unsigned int id) = 0;
+      // installed or to be installed, and not to be removed
+      virtual bool isInstalled(unsigned int id) = 0;
+      // kept whatever else happens: installed by hand, essential...
+      virtual bool isRoot(unsigned int id) = 0;
+      // the installed packages the version of id to be installed keeps
+      virtual void kept(unsigned int id, vector<unsigned int> &out) = 0;
+      // the packages that might keep id (more does no harm)
+      virtual void keepers(unsigned int id, vector<unsigned int> &out) = 0;
+   };
+
+   RAutoRemoveTracker() : _touched(0) {}
+
+   // everything marked from the roots, as after opening the cache
+   void rebuild(Graph &graph);
+   // catch up with the changes since the last rebuild() or update()
+   void update(Graph &graph);
+   void clear();
+
+   bool isGarbage(unsigned int id) const {
+      return id < _marked.size() && _installed[id] && !_marked[id];
+   }
+   vector<unsigned int> garbage() const;
+
+   // packages the last rebuild() or update() looked at
+   unsigned int touched() const { return _touched; }
+
+ private:
+   vector<uint64_t> _states;
+   vector<char> _installed;
+   vector<char> _marked;
+   // of every marked package, what it kept when it was marked: what
+   // a change has to unmark
+   vector<vector<unsigned int> > _kept;
+   vector<char> _affected;         // scratch of update(), all 0 between
+   unsigned int _touched;
+
+   void mark(Graph &graph, vector<unsigned int> &queue);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -114,6 +114,7 @@ void RCacheActorRecommends::setLanguageCache()
       return;
 
    _langCache.clear();
+   _langExpanded.clear();
 
    if (LangList.empty())
       return;
@@ -140,55 +141,79 @@ void RCacheActorRecommends::setLanguageCache()
 
 void RCacheActorRecommends::notifyCachePostChange()
 {
-   if (_config->FindB("Synaptic::UseRecommends", true) == true)
+   if (_config->FindB("Synaptic::UseRecommends", true) == true) {
+      setLanguageCache();
       RCacheActor::notifyCachePostChange();
+   }
 }
 
-void RCacheActorRecommends::run(vector<RPackage *> &PkgList, int Action)
+const RCacheActorRecommends::ListType *
+RCacheActorRecommends::findRecommends(const char *name)
 {
-   setLanguageCache();
-   const char *name;
-   const ListType *List;
-   MapType::const_iterator MapI;
-   for (vector<RPackage *>::const_iterator PkgI = PkgList.begin();
-        PkgI != PkgList.end(); PkgI++) {
-      name = (*PkgI)->name();
-      List = NULL;
-      MapI = _map.find(name);
-      if (MapI != _map.end()) {
-         List = &MapI->second;
-      } else {
-         if (_map_wildcard.empty() == false) {
-            for (MapI = _map_wildcard.begin();
-                 MapI != _map_wildcard.end(); MapI++) {
-               if (fnmatch(MapI->first.c_str(), name, 0) == 0) {
-                  List = &MapI->second;
-                  break;
-               }
-            }
+   unordered_map<string, const ListType *>::iterator M = _matched.find(name);
+   if (M != _matched.end())
+      return M->second;
+
+   const ListType *List = NULL;
+   unordered_map<string, ListType>::const_iterator MapI = _map.find(name);
+   if (MapI != _map.end()) {
+      List = &MapI->second;
+   } else {
+      for (MapType::const_iterator WildI = _map_wildcard.begin();
+           WildI != _map_wildcard.end(); WildI++) {
+         if (fnmatch(WildI->first.c_str(), name, 0) == 0) {
+            List = &WildI->second;
+            break;
          }
-         if (List == NULL && _map_regex.empty() == false) {
-            for (RegexMapType::const_iterator RMapI = _map_regex.begin();
-                 RMapI != _map_regex.end(); RMapI++) {
-               if (regexec(RMapI->first, name, 0, 0, 0) == 0) {
-                  List = &RMapI->second;
-                  break;
-               }
+      }
+      if (List == NULL) {
+         for (RegexMapType::const_iterator RMapI = _map_regex.begin();
+              RMapI != _map_regex.end(); RMapI++) {
+            if (regexec(RMapI->first, name, 0, 0, 0) == 0) {
+               List = &RMapI->second;
+               break;
             }
          }
       }
-      if (List != NULL) {
-         for (ListType::const_iterator ListI = List->begin();
-              ListI != List->end(); ListI++) {
-            const string &Recommends = *ListI;
-            if (actOnPkg(Recommends, Action) == false
-                && Recommends.find("$(LANG)") != string::npos) {
-               for (vector < string >::const_iterator LI = _langCache.begin();
-                    LI != _langCache.end(); LI++) {
-                  string Parsed = SubstVar(Recommends, "$(LANG)", *LI);
-                  actOnPkg(Parsed, Action);
-               }
-            }
+   }
+
+   _matched[name] = List;
+   return List;
+}
+
+const RCacheActorRecommends::ListType &
+RCacheActorRecommends::expandLanguages(const string &recommends)
+{
+   unordered_map<string, ListType>::iterator E =
+      _langExpanded.find(recommends);
+   if (E != _langExpanded.end())
+      return E->second;
+
+   ListType &Parsed = _langExpanded[recommends];
+   for (ListType::const_iterator LI = _langCache.begin();
+        LI != _langCache.end(); LI++)
+      Parsed.push_back(SubstVar(recommends, "$(LANG)", *LI));
+   return Parsed;
+}
+
+void RCacheActorRecommends::run(vector<RPackage *> &PkgList, int Action)
+{
+   // PkgList only holds the packages whose marks the last action changed
+   for (vector<RPackage *>::const_iterator PkgI = PkgList.begin();
+        PkgI != PkgList.end(); PkgI++) {
+      const ListType *List = findRecommends((*PkgI)->name());
+      if (List == NULL)
+         continue;
+
+      for (ListType::const_iterator ListI = List->begin();
+           ListI != List->end(); ListI++) {
+         const string &Recommends = *ListI;
+         if (actOnPkg(Recommends, Action) == false
+             && Recommends.find("$(LANG)") != string::npos) {
+            const ListType &Parsed = expandLanguages(Recommends);
+            for (ListType::const_iterator PI = Parsed.begin();
+                 PI != Parsed.end(); PI++)
+               actOnPkg(*PI, Action);
          }
       }
    }
@@ -27,6 +27,7 @@
 
 #include "rpackagelister.h"
 #include <regex.h>
+#include <unordered_map>
 
 class RCacheActor:public RCacheObserver {
  public:
@@ -79,13 +80,24 @@ class RCacheActorRecommends:public RCacheActor {
    typedef map<string, ListType> MapType;
    typedef map<regex_t *, ListType> RegexMapType;
 
-   MapType _map;
+   unordered_map<string, ListType> _map;
    MapType _map_wildcard;
    RegexMapType _map_regex;
 
+   // the recommends of every package name run() was asked about (NULL
+   // if no rule matches it); the rules never change, so a name is only
+   // matched against the wildcards and expressions once
+   unordered_map<string, const ListType *> _matched;
+   const ListType *findRecommends(const char *name);
+
    string _langLast;
    ListType _langCache;
 
+   // recommends with $(LANG) in them, with it replaced by every entry
+   // of _langCache; emptied when the languages change
+   unordered_map<string, ListType> _langExpanded;
+   const ListType &expandLanguages(const string &recommends);
+
    void setLanguageCache();
 
    inline bool actOnPkg(string name, int Action) {
@@ -40,6 +40,7 @@
 
 #include "i18n.h"
 #include "rcdscanner.h"
+#include "rparallel.h"
 
 #ifdef HAVE_RPM
 #include "rpmindexcopy.h"
@@ -300,18 +301,12 @@ bool RCDScanner::start(RCDScanProgress *progress)
 
    progress->update(_("Scanning disc..."), STEP_SCAN);
 
-   string cwd = SafeGetCWD();
-
    _pkgList.clear();
    _srcList.clear();
    _infoDir = "";
 
-   if (!scanDirectory(CDROM, progress)) {
-      chdir(cwd.c_str());
+   if (!scanDirectory(CDROM, progress))
       return false;
-   }
-
-   chdir(cwd.c_str());
 
    progress->update(_("Cleaning package lists..."), STEP_CLEAN);
 
@@ -611,56 +606,64 @@ static int strrcmp_(const char *a, const char *b)
 }
 #endif
 
-bool RCDScanner::scanDirectory(string CD, RCDScanProgress *progress,
-                               int Depth)
+// what one part of the disc turned out to hold; each thread scanning
+// a subtree fills its own, so nothing is shared while the disc is read
+struct RCDScanResult {
+   vector<string> pkgList;
+   vector<string> srcList;
+   string infoDir;
+   string unreadable;           // first directory that could not be read
+};
+
+// look at the directory CD (ending in '/') and put the subdirectories
+// to descend into, with their inodes, into subdirs
+static void scanOne(const string &CD, RCDScanResult &res,
+                    vector<pair<string, ino_t> > &subdirs)
 {
-   static ino_t Inodes[9];
-   if (Depth >= 7)
-      return true;
-
-   if (CD[CD.length() - 1] != '/')
-      CD += '/';
-
-   if (chdir(CD.c_str()) != 0)
-      return _error->Errno("chdir", _("Unable to change to %s"), CD.c_str());
+   bool thorough = _config->FindB("APT::CDROM::Thorough", false);
+   struct stat Buf;
 
    // Look for a .disk subdirectory
-   struct stat Buf;
-   if (stat(".disk", &Buf) == 0) {
-      if (_infoDir.empty() == true)
-         _infoDir = CD + ".disk/";
+   if (stat((CD + ".disk").c_str(), &Buf) == 0) {
+      if (res.infoDir.empty() == true)
+         res.infoDir = CD + ".disk/";
    }
    // Don't look into directories that have been marked to ingore.
-   if (stat(".aptignr", &Buf) == 0)
-      return true;
+   if (stat((CD + ".aptignr").c_str(), &Buf) == 0)
+      return;
 
 #ifdef HAVE_RPM
    bool Found = false;
-   if (stat("release", &Buf) == 0)
+   if (stat((CD + "release").c_str(), &Buf) == 0)
       Found = true;
 #else
    /* Aha! We found some package files. We assume that everything under 
       this dir is controlled by those package files so we don't look down
       anymore */
-   if (stat("Packages", &Buf) == 0 || stat("Packages.gz", &Buf) == 0) {
-      _pkgList.push_back(CD);
+   if (stat((CD + "Packages").c_str(), &Buf) == 0 ||
+       stat((CD + "Packages.gz").c_str(), &Buf) == 0) {
+      res.pkgList.push_back(CD);
 
       // Continue down if thorough is given
-      if (_config->FindB("APT::CDROM::Thorough", false) == false)
-         return true;
+      if (thorough == false)
+         return;
    }
-   if (stat("Sources.gz", &Buf) == 0 || stat("Sources", &Buf) == 0) {
-      _srcList.push_back(CD);
+   if (stat((CD + "Sources.gz").c_str(), &Buf) == 0 ||
+       stat((CD + "Sources").c_str(), &Buf) == 0) {
+      res.srcList.push_back(CD);
 
       // Continue down if thorough is given
-      if (_config->FindB("APT::CDROM::Thorough", false) == false)
-         return true;
+      if (thorough == false)
+         return;
    }
 #endif
 
-   DIR *D = opendir(".");
-   if (D == 0)
-      return _error->Errno("opendir", _("Unable to read %s"), CD.c_str());
+   DIR *D = opendir(CD.c_str());
+   if (D == 0) {
+      if (res.unreadable.empty())
+         res.unreadable = CD;
+      return;
+   }
 
    // Run over the directory
    for (struct dirent * Dir = readdir(D); Dir != 0; Dir = readdir(D)) {
@@ -680,49 +683,97 @@ bool RCDScanner::scanDirectory(string CD, RCDScanProgress *progress,
 #ifdef HAVE_RPM
       if (strncmp(Dir->d_name, "pkglist.", 8) == 0 &&
           strcmp(Dir->d_name + strlen(Dir->d_name) - 4, ".bz2") == 0) {
-         _pkgList.push_back(CD + string(Dir->d_name));
+         res.pkgList.push_back(CD + string(Dir->d_name));
          Found = true;
          continue;
       }
       if (strncmp(Dir->d_name, "srclist.", 8) == 0 &&
           strcmp(Dir->d_name + strlen(Dir->d_name) - 4, ".bz2") == 0) {
-         _srcList.push_back(CD + string(Dir->d_name));
+         res.srcList.push_back(CD + string(Dir->d_name));
          Found = true;
          continue;
       }
-      if (_config->FindB("APT::CDROM::Thorough", false) == false &&
-          Found == true)
+      if (thorough == false && Found == true)
          continue;
 #endif
 
       // See if the name is a sub directory
-      struct stat Buf;
-      if (stat(Dir->d_name, &Buf) != 0)
+      if (fstatat(dirfd(D), Dir->d_name, &Buf, 0) != 0)
          continue;
 
       if (S_ISDIR(Buf.st_mode) == 0)
          continue;
 
-      int I;
-      for (I = 0; I != Depth; I++)
-         if (Inodes[I] == Buf.st_ino)
-            break;
-      if (I != Depth)
-         continue;
+      subdirs.push_back(make_pair(CD + Dir->d_name + "/", Buf.st_ino));
+   }
 
-      // Store the inodes weve seen
-      Inodes[Depth] = Buf.st_ino;
+   closedir(D);
+}
 
-      // Descend
-      if (scanDirectory(CD + Dir->d_name, progress, Depth + 1) == false)
-         break;
+// scan CD and everything below it; inodes are the directories on the
+// way down, to not go around in circles through bind mounts or links
+static void scanTree(const string &CD, int Depth, vector<ino_t> &inodes,
+                     RCDScanResult &res)
+{
+   if (Depth >= 7)
+      return;
+
+   vector<pair<string, ino_t> > subdirs;
+   scanOne(CD, res, subdirs);
+
+   for (unsigned int i = 0; i < subdirs.size(); i++) {
+      if (find(inodes.begin(), inodes.end(), subdirs[i].second) != inodes.end())
+         continue;
 
-      if (chdir(CD.c_str()) != 0)
-         return _error->Errno("chdir", _("Unable to change to %s"),
-                              CD.c_str());
+      // Descend
+      inodes.push_back(subdirs[i].second);
+      scanTree(subdirs[i].first, Depth + 1, inodes, res);
+      inodes.pop_back();
+      if (res.unreadable.empty() == false)
+         return;
    }
+}
 
-   closedir(D);
+// The directories below the top of the disc are scanned on a thread
+// each (up to one per core); on a DVD set or a USB mirror most of the
+// time goes to waiting for the medium, and the waits overlap. The
+// results are merged in directory order, as a walk on one thread
+// would have found them.
+bool RCDScanner::scanDirectory(string CD, RCDScanProgress *progress,
+                               int Depth)
+{
+   if (Depth >= 7)
+      return true;
+
+   if (CD[CD.length() - 1] != '/')
+      CD += '/';
+
+   RCDScanResult top;
+   vector<pair<string, ino_t> > subdirs;
+   scanOne(CD, top, subdirs);
+
+   vector<RCDScanResult> results(subdirs.size());
+   unsigned int chunks = RParallelChunks(subdirs.size(), 1);
+   RParallelFor(chunks, subdirs.size(),
+                [&subdirs, &results, Depth](unsigned int c, unsigned int begin,
+                                            unsigned int end) {
+      for (unsigned int i = begin; i < end; i++) {
+         vector<ino_t> inodes(1, subdirs[i].second);
+         scanTree(subdirs[i].first, Depth + 1, inodes, results[i]);
+      }
+   });
+
+   results.insert(results.begin(), top);
+   for (unsigned int i = 0; i < results.size(); i++) {
+      RCDScanResult &res = results[i];
+      if (res.unreadable.empty() == false)
+         return _error->Errno("opendir", _("Unable to read %s"),
+                              res.unreadable.c_str());
+      if (_infoDir.empty() == true)
+         _infoDir = res.infoDir;
+      _pkgList.insert(_pkgList.end(), res.pkgList.begin(), res.pkgList.end());
+      _srcList.insert(_srcList.end(), res.srcList.begin(), res.srcList.end());
+   }
 
    return !_error->PendingError();
 }
@@ -0,0 +1,130 @@
+/* rcommitlog.cc - The log of one commit, written as it happens
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rcommitlog.h"
+
+#include <sstream>
+
+#include <unistd.h>
+
+RCommitLog::RCommitLog()
+   : _file(NULL), _failed(false)
+{
+}
+
+RCommitLog::~RCommitLog()
+{
+   discard();
+}
+
+string RCommitLog::fileName(time_t when)
+{
+   char name[32];
+   strftime(name, sizeof(name), "%Y-%m-%d.%H%M%S.log", localtime(&when));
+   return name;
+}
+
+string RCommitLog::partPath() const
+{
+   return _dir + _record.entry().file + ".part";
+}
+
+bool RCommitLog::open(const string &dir, time_t when)
+{
+   discard();
+
+   _dir = dir;
+   _failed = false;
+   _record.start(fileName(when));
+   _file = fopen(partPath().c_str(), "w");
+   if (_file == NULL)
+      return false;
+
+   // ctime() ends with a newline already
+   char date[64];
+   ctime_r(&when, date);
+   string header = string("Commit Log for ") + date;
+   write(header + "\n");
+   _record.line(header, false);
+   return true;
+}
+
+void RCommitLog::write(const string &text)
+{
+   if (_file != NULL && fputs(text.c_str(), _file) == EOF)
+      _failed = true;
+}
+
+void RCommitLog::section(const string &title)
+{
+   write(title);
+   record(title);
+}
+
+void RCommitLog::package(const string &line)
+{
+   write(line + "\n");
+   _record.line(line, true);
+}
+
+void RCommitLog::note(const string &text)
+{
+   write(text);
+   if (!text.empty() && text[text.size() - 1] != '\n')
+      write("\n");
+   record(text);
+}
+
+void RCommitLog::record(const string &text)
+{
+   istringstream lines(text);
+   string line;
+   while (getline(lines, line))
+      _record.line(line, false);
+}
+
+bool RCommitLog::close()
+{
+   if (_file == NULL)
+      return false;
+
+   string part = partPath();
+   bool ok = fclose(_file) == 0 && !_failed;
+   _file = NULL;
+   if (!ok || rename(part.c_str(), (_dir + _record.entry().file).c_str()) != 0) {
+      unlink(part.c_str());
+      return false;
+   }
+
+   // the history window lists the logs from the index
+   RHistoryIndex(_dir).add(_record.entry());
+   return true;
+}
+
+void RCommitLog::discard()
+{
+   if (_file == NULL)
+      return;
+   fclose(_file);
+   _file = NULL;
+   unlink(partPath().c_str());
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,81 @@
+/* rcommitlog.h - The log of one commit, written as it happens
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RCOMMITLOG_H
+#define RCOMMITLOG_H
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+#include "rhistoryindex.h"
+
+using namespace std;
+
+// Writes a commit log to disk line by line instead of building it in
+// memory first, which for a dist-upgrade is one large string copied
+// around while the commit needs the memory most. The history index
+// entry is recorded along the way, so the log is not read back either.
+//
+// The log is written to "<name>.part" and only moved to its name, and
+// added to the index, by close(); a commit that never gets there leaves
+// nothing behind.
+class RCommitLog {
+ public:
+   RCommitLog();
+   // discards a log that was not closed
+   ~RCommitLog();
+
+   // start the log of a commit made at when, in dir (ending with a '/')
+   bool open(const string &dir, time_t when);
+   bool isOpen() const { return _file != NULL; }
+
+   // a section header, with its own line breaks as the translations
+   // have them ("\nInstalled the following packages:\n")
+   void section(const string &title);
+   // one line of a section, naming the package it starts with
+   void package(const string &line);
+   // anything else, such as what went wrong on the way
+   void note(const string &text);
+
+   // move it into place and add it to the history index; false if any
+   // of it could not be written
+   bool close();
+   void discard();
+
+   // YYYY-MM-DD.HHMMSS.log, local time
+   static string fileName(time_t when);
+
+ private:
+   string _dir;
+   FILE *_file;
+   bool _failed;
+   RHistoryIndex::Recorder _record;
+
+   string partPath() const;
+   void write(const string &text);
+   // the words of lines naming no package
+   void record(const string &text);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -31,6 +31,10 @@
 #include <sys/types.h>
 
 #include <unistd.h>
+#include <stdio.h>
+
+#include <sstream>
+#include <algorithm>
 
 #include <apt-pkg/init.h>
 #include <apt-pkg/error.h>
@@ -93,17 +97,12 @@ bool RWriteConfigFile(Configuration &Conf)
                          + "99polysynaptic";
 
       int old_umask = umask(0022);
-      ofstream aptfile(aptConfPath.c_str(), ios::out);
-      if (!aptfile != 0) {
+      string recommends = _config->FindB("APT::Install-Recommends", false)
+                        ? "APT::Install-Recommends \"true\";\n"
+                        : "APT::Install-Recommends \"false\";\n";
+      if (!RWriteFileAtomic(aptConfPath, recommends))
          cerr << "cannot open " << aptConfPath.c_str() <<
                  " to write APT::Install-Recommends" << endl;
-      } else {
-         if (_config->FindB("APT::Install-Recommends", false))
-            aptfile << "APT::Install-Recommends \"true\";" << endl;
-         else
-            aptfile << "APT::Install-Recommends \"false\";" << endl;
-         aptfile.close();
-      }
       umask(old_umask);
    }
    // and backup Install-Recommends to config of synaptic
@@ -112,25 +111,48 @@ bool RWriteConfigFile(Configuration &Conf)
                 _config->FindB("Synaptic::Install-Recommends",
                 false)));
 
-   ofstream cfile(ConfigFilePath.c_str(), ios::out);
-   if (!cfile != 0)
-      return _error->Errno("ofstream",
-                           _("ERROR: couldn't open %s for writing"),
-                           ConfigFilePath.c_str());
-
    Synaptic = Conf.Tree(0);
    while (Synaptic) {
       if (Synaptic->Tag == "Synaptic")
          break;
       Synaptic = Synaptic->Next;
    }
+   ostringstream cfile;
    dumpToFile(Synaptic, cfile, "");
 
-   cfile.close();
+   // the window geometry is saved on every exit, but mostly the same
+   if (!RWriteFileAtomic(ConfigFilePath, cfile.str()))
+      return _error->Errno("ofstream",
+                           _("ERROR: couldn't open %s for writing"),
+                           ConfigFilePath.c_str());
 
    return true;
 }
 
+bool RWriteFileAtomic(string path, const string &text)
+{
+   ifstream in(path.c_str(), ios::in | ios::binary);
+   if (in) {
+      ostringstream old;
+      old << in.rdbuf();
+      if (old.str() == text)
+         return true;
+   }
+   in.close();
+
+   string tmpPath = path + ".new";
+   ofstream out(tmpPath.c_str(), ios::out | ios::trunc);
+   if (!out != 0)
+      return false;
+   out << text;
+   out.close();
+   if (out.fail() || rename(tmpPath.c_str(), path.c_str()) != 0) {
+      unlink(tmpPath.c_str());
+      return false;
+   }
+   return true;
+}
+
 static bool checkConfigDir(string &path)
 {
    struct stat stbuf;
@@ -261,6 +283,26 @@ string RLogDir()
 }
 
 
+static RHotSettings HotSettings = { false, false, 15, 200, true };
+
+const RHotSettings &RSettings()
+{
+   return HotSettings;
+}
+
+void RReloadSettings()
+{
+   HotSettings.debugView = _config->FindB("Debug::Synaptic::View", false);
+   HotSettings.debugXapian = _config->FindB("Debug::Synaptic::Xapian", false);
+   HotSettings.xapianQualityCutoff =
+      _config->FindI("Synaptic::Xapian::qualityCutoff", 15);
+   HotSettings.xapianPageSize =
+      max(_config->FindI("Synaptic::Xapian::PageSize", 200), 1);
+   HotSettings.useStatusColors =
+      _config->FindB("Synaptic::UseStatusColors", true);
+}
+
+
 bool RInitConfiguration(string confFileName)
 {
    string configDir;
@@ -297,6 +339,7 @@ bool RInitConfiguration(string confFileName)
                    false)));
    }
 
+   RReloadSettings();
    return true;
 }
 
@@ -318,9 +361,14 @@ bool RReadFilterData(Configuration &config)
    return true;
 }
 
+string RPackageOptionsPath()
+{
+   return ConfigFileDir + "/options";
+}
+
 bool RPackageOptionsFile(ofstream &out)
 {
-   string path = ConfigFileDir + "/options";
+   string path = RPackageOptionsPath();
    out.open(path.c_str());
    if (!out != 0)
       return _error->Errno("ofstream",
@@ -331,7 +379,7 @@ bool RPackageOptionsFile(ofstream &out)
 
 bool RPackageOptionsFile(ifstream &in)
 {
-   string path = ConfigFileDir + "/options";
+   string path = RPackageOptionsPath();
    in.open(path.c_str());
    if (!in != 0)
       return false;
@@ -42,6 +42,28 @@ bool RFilterDataOutFile(ofstream &out);
 
 bool RPackageOptionsFile(ofstream &out);
 bool RPackageOptionsFile(ifstream &in);
+string RPackageOptionsPath();
+
+// replace path by text through a temp file renamed over it, so a crash
+// never leaves half a file; a file that already holds text is not
+// touched at all
+bool RWriteFileAtomic(string path, const string &text);
+
+
+// settings read in loops over every package or row, copied out of
+// _config so those read plain fields instead of walking the tree by
+// string key; RInitConfiguration() fills it and RReloadSettings() must
+// follow any change of these keys (the preferences window saving)
+struct RHotSettings {
+   bool debugView;               // Debug::Synaptic::View
+   bool debugXapian;             // Debug::Synaptic::Xapian
+   int xapianQualityCutoff;      // Synaptic::Xapian::qualityCutoff
+   unsigned int xapianPageSize;  // Synaptic::Xapian::PageSize
+   bool useStatusColors;         // Synaptic::UseStatusColors
+};
+
+const RHotSettings &RSettings();
+void RReloadSettings();
 
 
 // get the default conf dir
@@ -0,0 +1,136 @@
+/* rdepindex.cc - Flat dependency graph of the package cache
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "config.h"
+
+#include "rdepindex.h"
+#include "rparallel.h"
+
+// below this many nodes per worker threads cost more than they save
+static const unsigned int MinNodesPerThread = 4096;
+
+template<class F>
+void RDependencyIndex::fill(Adjacency &adj, unsigned int count,
+                            unsigned int threads, F collect)
+{
+   struct Chunk {
+      unsigned int begin;
+      vector<uint32_t> counts;
+      vector<Edge> edges;
+   };
+
+   unsigned int chunks = RParallelChunks(count, MinNodesPerThread, threads);
+   vector<Chunk> parts(chunks);
+
+   // the cache is only read here, so the workers need no locking
+   RParallelFor(chunks, count,
+                [&parts, &collect](unsigned int c, unsigned int begin,
+                                   unsigned int end) {
+      Chunk &part = parts[c];
+      part.begin = begin;
+      part.counts.reserve(end - begin);
+      for (unsigned int id = begin; id < end; id++) {
+         size_t before = part.edges.size();
+         collect(id, part.edges);
+         part.counts.push_back(part.edges.size() - before);
+      }
+   });
+
+   // the chunks are consecutive id ranges, so they append in order
+   size_t total = 0;
+   for (unsigned int c = 0; c < chunks; c++)
+      total += parts[c].edges.size();
+
+   adj.offsets.assign(count + 1, 0);
+   adj.edges.clear();
+   adj.edges.reserve(total);
+   for (unsigned int c = 0; c < chunks; c++) {
+      Chunk &part = parts[c];
+      for (unsigned int k = 0; k < part.counts.size(); k++)
+         adj.offsets[part.begin + k + 1] = adj.offsets[part.begin + k] +
+                                           part.counts[k];
+      adj.edges.insert(adj.edges.end(), part.edges.begin(), part.edges.end());
+   }
+}
+
+void RDependencyIndex::build(pkgCache &cache, unsigned int threads)
+{
+   // ids are not positions in the cache arrays, map them first
+   unsigned int packageCount = cache.HeaderP->PackageCount;
+   unsigned int versionCount = cache.HeaderP->VersionCount;
+   _packages.assign(packageCount, 0);
+   _versions.assign(versionCount, 0);
+   for (pkgCache::PkgIterator P = cache.PkgBegin(); P.end() == false; P++) {
+      _packages[P->ID] = P.operator->() - cache.PkgP;
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; V++)
+         _versions[V->ID] = V.operator->() - cache.VerP;
+   }
+
+   fill(_rdepends, packageCount, threads,
+        [this, &cache](unsigned int id, vector<Edge> &edges) {
+      pkgCache::PkgIterator P(cache, cache.PkgP + _packages[id]);
+      for (pkgCache::DepIterator D = P.RevDependsList(); D.end() == false; D++) {
+         Edge e = { (uint32_t)(D.operator->() - cache.DepP),
+                    (uint32_t)D.ParentPkg()->ID };
+         edges.push_back(e);
+      }
+   });
+
+   fill(_providers, packageCount, threads,
+        [this, &cache](unsigned int id, vector<Edge> &edges) {
+      pkgCache::PkgIterator P(cache, cache.PkgP + _packages[id]);
+      for (pkgCache::PrvIterator Prv = P.ProvidesList(); Prv.end() == false; Prv++) {
+         Edge e = { (uint32_t)(Prv.OwnerVer().operator->() - cache.VerP),
+                    (uint32_t)Prv.OwnerPkg()->ID };
+         edges.push_back(e);
+      }
+   });
+
+   fill(_depends, versionCount, threads,
+        [this, &cache](unsigned int id, vector<Edge> &edges) {
+      pkgCache::VerIterator V(cache, cache.VerP + _versions[id]);
+      for (pkgCache::DepIterator D = V.DependsList(); D.end() == false; D++) {
+         Edge e = { (uint32_t)(D.operator->() - cache.DepP),
+                    (uint32_t)D.TargetPkg()->ID };
+         edges.push_back(e);
+      }
+   });
+
+   fill(_provides, versionCount, threads,
+        [this, &cache](unsigned int id, vector<Edge> &edges) {
+      pkgCache::VerIterator V(cache, cache.VerP + _versions[id]);
+      for (pkgCache::PrvIterator Prv = V.ProvidesList(); Prv.end() == false; Prv++) {
+         Edge e = { _versions[id], (uint32_t)Prv.ParentPkg()->ID };
+         edges.push_back(e);
+      }
+   });
+}
+
+void RDependencyIndex::clear()
+{
+   _packages.clear();
+   _versions.clear();
+   _rdepends = Adjacency();
+   _depends = Adjacency();
+   _provides = Adjacency();
+   _providers = Adjacency();
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,128 @@
+/* rdepindex.h - Flat dependency graph of the package cache
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RDEPINDEX_H
+#define RDEPINDEX_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <apt-pkg/pkgcache.h>
+
+using namespace std;
+
+// The dependency graph of one cache as arrays, built once per open.
+// apt keeps reverse dependencies and provides as linked lists spread
+// over the whole cache; here the edges of a node are next to each
+// other (offsets into one array per relation, "CSR" style), so walking
+// them is a scan instead of a chain of pointer chases.
+//
+// Nodes are pkgCache::Package::ID or pkgCache::Version::ID. An edge
+// holds the record it came from (its offset into cache.DepP or
+// cache.VerP), to get the apt iterator back when more than the ids is
+// needed, and the id of the package at its other end.
+//
+// The index only holds ids, it must be rebuilt whenever the cache is
+// reopened.
+class RDependencyIndex {
+ public:
+   struct Edge {
+      uint32_t record;
+      uint32_t pkg;
+   };
+
+   struct Edges {
+      const Edge *first;
+      const Edge *last;
+
+      const Edge *begin() const { return first; }
+      const Edge *end() const { return last; }
+      unsigned int size() const { return last - first; }
+      bool empty() const { return first == last; }
+   };
+
+   // index cache with up to threads workers, 0 picks one per core
+   void build(pkgCache &cache, unsigned int threads = 0);
+   void clear();
+
+   // back from ids to apt iterators
+   pkgCache::PkgIterator package(pkgCache &cache, unsigned int id) const {
+      return pkgCache::PkgIterator(cache, cache.PkgP + _packages[id]);
+   }
+   static pkgCache::DepIterator dependency(pkgCache &cache, const Edge &e) {
+      return pkgCache::DepIterator(cache, cache.DepP + e.record);
+   }
+   static pkgCache::VerIterator version(pkgCache &cache, const Edge &e) {
+      return pkgCache::VerIterator(cache, cache.VerP + e.record);
+   }
+
+   // dependencies on package id, from any version of any package:
+   // record is the pkgCache::Dependency, pkg the depending package
+   Edges reverseDepends(unsigned int id) const { return edges(_rdepends, id); }
+
+   // dependencies of version id: record is the pkgCache::Dependency,
+   // pkg its target (possibly virtual)
+   Edges depends(unsigned int id) const { return edges(_depends, id); }
+
+   // what version id provides: record is the version, pkg the
+   // provided (usually virtual) package
+   Edges provides(unsigned int id) const { return edges(_provides, id); }
+
+   // who provides package id: record is the providing version, pkg
+   // the package that version belongs to
+   Edges providers(unsigned int id) const { return edges(_providers, id); }
+
+ private:
+   struct Adjacency {
+      vector<uint32_t> offsets;     // node i is edges[offsets[i]..offsets[i+1])
+      vector<Edge> edges;
+   };
+
+   static Edges edges(const Adjacency &adj, unsigned int id) {
+      Edges e;
+      if (id + 1 >= adj.offsets.size()) {
+         e.first = e.last = NULL;
+      } else {
+         e.first = adj.edges.data() + adj.offsets[id];
+         e.last = adj.edges.data() + adj.offsets[id + 1];
+      }
+      return e;
+   }
+
+   // fill adj for the nodes 0..count-1, collect(id, edges) appends the
+   // edges of one node; the id ranges are split over the workers
+   template<class F>
+   static void fill(Adjacency &adj, unsigned int count, unsigned int threads,
+                    F collect);
+
+   // offsets into cache.PkgP and cache.VerP by id
+   vector<uint32_t> _packages;
+   vector<uint32_t> _versions;
+
+   Adjacency _rdepends;
+   Adjacency _depends;
+   Adjacency _provides;
+   Adjacency _providers;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,310 @@
+/* resultfilter.cc - Narrowing the unified results without asking the backends
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "resultfilter.h"
+
+#include <cctype>
+#include <string_view>
+
+namespace PolySynaptic {
+
+namespace {
+
+enum Facet : unsigned {
+    FACET_BACKEND,
+    FACET_STATUS,
+    FACET_CONFINEMENT,
+    FACET_TRUST
+};
+
+// The values each facet can take, as bits
+const unsigned ALL_BACKENDS = (1u << (static_cast<unsigned>(BackendType::UNKNOWN) + 1)) - 1;
+const unsigned ALL_TRUSTS = (1u << (static_cast<unsigned>(TrustLevel::SYSTEM) + 1)) - 1;
+
+string lowered(const string& text)
+{
+    string result(text);
+    for (char& c : result) {
+        c = tolower((unsigned char) c);
+    }
+    return result;
+}
+
+unsigned bitIndex(unsigned bit)
+{
+    return bit ? __builtin_ctz(bit) : 0;
+}
+
+} // namespace
+
+// ============================================================================
+// ResultQuery
+// ============================================================================
+
+bool ResultQuery::keepsAll() const
+{
+    return text.empty() &&
+           (backends & ALL_BACKENDS) == ALL_BACKENDS &&
+           (statuses & STATUS_ANY) == STATUS_ANY &&
+           (confinements & CONFINEMENT_ANY) == CONFINEMENT_ANY &&
+           (trusts & ALL_TRUSTS) == ALL_TRUSTS;
+}
+
+bool ResultQuery::narrows(const ResultQuery& other) const
+{
+    return (backends & ~other.backends) == 0 &&
+           (statuses & ~other.statuses) == 0 &&
+           (confinements & ~other.confinements) == 0 &&
+           (trusts & ~other.trusts) == 0 &&
+           lowered(text).find(lowered(other.text)) != string::npos;
+}
+
+bool ResultQuery::operator==(const ResultQuery& other) const
+{
+    return text == other.text && backends == other.backends &&
+           statuses == other.statuses && confinements == other.confinements &&
+           trusts == other.trusts;
+}
+
+// ============================================================================
+// Facet Values
+// ============================================================================
+
+unsigned ResultFilter::statusOf(const PackageInfo& pkg)
+{
+    switch (pkg.installStatus) {
+        case InstallStatus::INSTALLED:        return ResultQuery::STATUS_INSTALLED;
+        case InstallStatus::UPDATE_AVAILABLE: return ResultQuery::STATUS_UPDATABLE;
+        case InstallStatus::NOT_INSTALLED:    return ResultQuery::STATUS_AVAILABLE;
+        default:                              return ResultQuery::STATUS_OTHER;
+    }
+}
+
+unsigned ResultFilter::confinementOf(const PackageInfo& pkg)
+{
+    if (pkg.backend == BackendType::FLATPAK) {
+        return ResultQuery::CONFINEMENT_STRICT;
+    }
+    if (pkg.backend != BackendType::SNAP) {
+        return ResultQuery::CONFINEMENT_NONE;
+    }
+    // As SnapProvider reads it
+    if (pkg.isClassic || pkg.confinement == "classic") {
+        return ResultQuery::CONFINEMENT_CLASSIC;
+    }
+    if (pkg.confinement == "devmode") {
+        return ResultQuery::CONFINEMENT_DEVMODE;
+    }
+    return ResultQuery::CONFINEMENT_STRICT;
+}
+
+TrustLevel ResultFilter::trustOf(const PackageInfo& pkg)
+{
+    if (pkg.backend == BackendType::APT) {
+        const string& origin = pkg.origin;
+        if (origin.find("Ubuntu") != string::npos ||
+            origin.find("Debian") != string::npos) {
+            return TrustLevel::OFFICIAL;
+        }
+    }
+    return TrustLevel::COMMUNITY;
+}
+
+// ============================================================================
+// Indexing
+// ============================================================================
+
+ResultFilter::ResultFilter(TrustOf trust)
+    : _trust(trust ? trust : TrustOf(trustOf))
+    , _count(0)
+    , _haveLast(false)
+{
+    _textStart.push_back(0);
+}
+
+void ResultFilter::clear()
+{
+    for (unsigned f = 0; f < NUM_FACETS; f++) {
+        for (unsigned v = 0; v < MAX_VALUES; v++) {
+            _bits[f][v].clear();
+        }
+    }
+    _values.clear();
+    _text.clear();
+    _textStart.assign(1, 0);
+    _count = 0;
+    _haveLast = false;
+    _lastRows.clear();
+}
+
+void ResultFilter::index(const vector<PackageInfo>& packages)
+{
+    clear();
+    _values.reserve(packages.size());
+    _textStart.reserve(packages.size() + 1);
+    append(packages);
+}
+
+void ResultFilter::append(const vector<PackageInfo>& packages)
+{
+    for (size_t i = _count; i < packages.size(); i++) {
+        add(packages[i]);
+    }
+    // What the last query kept no longer covers the new packages
+    _haveLast = false;
+}
+
+void ResultFilter::add(const PackageInfo& pkg)
+{
+    unsigned values[NUM_FACETS];
+    values[FACET_BACKEND] = static_cast<unsigned>(pkg.backend);
+    values[FACET_STATUS] = bitIndex(statusOf(pkg));
+    values[FACET_CONFINEMENT] = bitIndex(confinementOf(pkg));
+    values[FACET_TRUST] = static_cast<unsigned>(_trust(pkg));
+
+    uint32_t packed = 0;
+    for (unsigned f = 0; f < NUM_FACETS; f++) {
+        unsigned v = values[f] < MAX_VALUES ? values[f] : MAX_VALUES - 1;
+        vector<uint64_t>& bits = _bits[f][v];
+        bits.resize(_count / 64 + 1, 0);
+        bits[_count / 64] |= uint64_t(1) << (_count % 64);
+        packed |= v << (8 * f);
+    }
+    _values.push_back(packed);
+
+    // A deferred summary is not fetched for this; the name and ID
+    // still match
+    _text += lowered(pkg.name);
+    _text += '\n';
+    _text += lowered(pkg.id);
+    if (!pkg.isDeferred(PackageInfo::DEFER_SUMMARY)) {
+        _text += '\n';
+        _text += lowered(pkg.summary);
+    }
+    _textStart.push_back(_text.size());
+    _count++;
+}
+
+size_t ResultFilter::memoryBytes() const
+{
+    size_t bytes = _text.capacity() + _textStart.capacity() * sizeof(uint32_t) +
+                   _values.capacity() * sizeof(uint32_t) +
+                   _lastRows.capacity() * sizeof(int);
+    for (unsigned f = 0; f < NUM_FACETS; f++) {
+        for (unsigned v = 0; v < MAX_VALUES; v++) {
+            bytes += _bits[f][v].capacity() * sizeof(uint64_t);
+        }
+    }
+    return bytes;
+}
+
+// ============================================================================
+// Matching
+// ============================================================================
+
+unsigned ResultFilter::maskOf(const ResultQuery& query, unsigned facet)
+{
+    switch (facet) {
+        case FACET_BACKEND:     return query.backends;
+        case FACET_STATUS:      return query.statuses;
+        case FACET_CONFINEMENT: return query.confinements;
+        default:                return query.trusts;
+    }
+}
+
+bool ResultFilter::textMatches(size_t i, const string& needle) const
+{
+    // The fields are joined with '\n', which a needle never holds, so a
+    // match cannot run from one field into the next
+    string_view text(_text.data() + _textStart[i], _textStart[i + 1] - _textStart[i]);
+    return text.find(needle) != string_view::npos;
+}
+
+bool ResultFilter::passes(const ResultQuery& query, size_t i,
+                          const string& needle) const
+{
+    for (unsigned f = 0; f < NUM_FACETS; f++) {
+        unsigned v = (_values[i] >> (8 * f)) & 0xff;
+        if (!(maskOf(query, f) & (1u << v))) {
+            return false;
+        }
+    }
+    return needle.empty() || textMatches(i, needle);
+}
+
+bool ResultFilter::includes(const ResultQuery& query, size_t i) const
+{
+    return i < _count && passes(query, i, lowered(query.text));
+}
+
+void ResultFilter::matches(const ResultQuery& query, vector<int>& rows)
+{
+    rows.clear();
+    string needle = lowered(query.text);
+
+    if (_haveLast && query.narrows(_lastQuery)) {
+        // Only what the broader query kept can pass this one
+        for (int i : _lastRows) {
+            if (passes(query, i, needle)) {
+                rows.push_back(i);
+            }
+        }
+    } else {
+        size_t words = (_count + 63) / 64;
+        vector<uint64_t> keep(words, ~uint64_t(0));
+        if (_count % 64) {
+            keep[words - 1] = (uint64_t(1) << (_count % 64)) - 1;
+        }
+
+        for (unsigned f = 0; f < NUM_FACETS; f++) {
+            unsigned mask = maskOf(query, f);
+
+            // A facet keeping every value the packages have drops nothing
+            bool drops = false;
+            for (unsigned v = 0; v < MAX_VALUES && !drops; v++) {
+                drops = !_bits[f][v].empty() && !(mask & (1u << v));
+            }
+            if (!drops) {
+                continue;
+            }
+
+            vector<uint64_t> any(words, 0);
+            for (unsigned v = 0; v < MAX_VALUES; v++) {
+                if (!(mask & (1u << v))) continue;
+                const vector<uint64_t>& bits = _bits[f][v];
+                for (size_t w = 0; w < bits.size(); w++) {
+                    any[w] |= bits[w];
+                }
+            }
+            for (size_t w = 0; w < words; w++) {
+                keep[w] &= any[w];
+            }
+        }
+
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = keep[w];
+            while (bits) {
+                size_t i = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (needle.empty() || textMatches(i, needle)) {
+                    rows.push_back(i);
+                }
+            }
+        }
+    }
+
+    _lastQuery = query;
+    _lastRows = rows;
+    _haveLast = true;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
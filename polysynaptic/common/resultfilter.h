@@ -0,0 +1,186 @@
+/* resultfilter.h - Narrowing the unified results without asking the backends
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the "filter within results" engine of the
+ * unified view. It indexes the packages a search or an installed-list
+ * load already fetched: a lowercased copy of the text a refinement
+ * matches against, and one bitset per value of each facet (backend,
+ * install status, confinement and trust). A refinement then ANDs the
+ * facet bitsets a word at a time and checks the text of what is left,
+ * so narrowing the list never reruns the search against the slow CLI
+ * backends.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RESULTFILTER_H_
+#define _RESULTFILTER_H_
+
+#include "ipackagebackend.h"
+#include "packagesourceprovider.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * ResultQuery - What a refinement keeps
+ *
+ * Each facet is a mask of the values it keeps; a package passes when
+ * every facet keeps its value and the text is part of its name, ID or
+ * summary, ignoring case. The defaults keep everything.
+ */
+struct ResultQuery {
+    enum Status : unsigned {
+        STATUS_INSTALLED    = 1 << 0,   // Installed and up to date
+        STATUS_UPDATABLE    = 1 << 1,
+        STATUS_AVAILABLE    = 1 << 2,   // Not installed
+        STATUS_OTHER        = 1 << 3,   // Broken, in progress or unknown
+        STATUS_ANY          = 0xf
+    };
+
+    enum Confinement : unsigned {
+        CONFINEMENT_NONE    = 1 << 0,   // APT packages
+        CONFINEMENT_STRICT  = 1 << 1,   // Strict snaps, Flatpak sandboxes
+        CONFINEMENT_CLASSIC = 1 << 2,
+        CONFINEMENT_DEVMODE = 1 << 3,
+        CONFINEMENT_ANY     = 0xf
+    };
+
+    string text;
+    unsigned backends = ~0u;            // 1 << BackendType
+    unsigned statuses = STATUS_ANY;
+    unsigned confinements = CONFINEMENT_ANY;
+    unsigned trusts = ~0u;              // 1 << TrustLevel
+
+    static constexpr unsigned backendBit(BackendType type) {
+        return 1u << static_cast<unsigned>(type);
+    }
+    static constexpr unsigned trustBit(TrustLevel level) {
+        return 1u << static_cast<unsigned>(level);
+    }
+
+    /**
+     * Whether this query keeps every package
+     */
+    bool keepsAll() const;
+
+    /**
+     * Whether everything this query keeps, other also keeps
+     */
+    bool narrows(const ResultQuery& other) const;
+
+    bool operator==(const ResultQuery& other) const;
+    bool operator!=(const ResultQuery& other) const { return !(*this == other); }
+};
+
+/**
+ * ResultFilter - The refinement index over a fetched result list
+ *
+ *     ResultFilter filter;
+ *     filter.index(packages);
+ *     ResultQuery query;
+ *     query.text = "editor";
+ *     query.statuses = ResultQuery::STATUS_INSTALLED;
+ *     vector<int> rows;
+ *     filter.matches(query, rows);    // indices into packages, ascending
+ *
+ * Typing more of a word only rescans what the previous, broader query
+ * kept.
+ *
+ * Thread Safety:
+ *   Not thread-safe; the unified view uses it from the main loop only.
+ */
+class ResultFilter {
+public:
+    /**
+     * How trusted a package is; trustOf() when none is given
+     */
+    using TrustOf = function<TrustLevel(const PackageInfo&)>;
+
+    explicit ResultFilter(TrustOf trust = nullptr);
+
+    /**
+     * Index packages, replacing what was indexed
+     */
+    void index(const vector<PackageInfo>& packages);
+
+    /**
+     * Index packages[size()...], appended since the last call
+     */
+    void append(const vector<PackageInfo>& packages);
+
+    void clear();
+
+    size_t size() const { return _count; }
+
+    /**
+     * The indices query keeps, ascending
+     */
+    void matches(const ResultQuery& query, vector<int>& rows);
+
+    /**
+     * Whether query keeps the package at i
+     */
+    bool includes(const ResultQuery& query, size_t i) const;
+
+    /**
+     * Bytes held by the index, for the memory registry
+     */
+    size_t memoryBytes() const;
+
+    /**
+     * The facet values of a package
+     */
+    static unsigned statusOf(const PackageInfo& pkg);
+    static unsigned confinementOf(const PackageInfo& pkg);
+
+    /**
+     * Coarse trust from the fields every package carries: distribution
+     * origins are official, everything else community
+     */
+    static TrustLevel trustOf(const PackageInfo& pkg);
+
+private:
+    static const unsigned NUM_FACETS = 4;
+    static const unsigned MAX_VALUES = 8;
+
+    TrustOf _trust;
+    size_t _count;
+
+    // One bitset per facet value, a bit per package; a value no
+    // package has has no words
+    vector<uint64_t> _bits[NUM_FACETS][MAX_VALUES];
+
+    // The value of each facet per package, a byte each
+    vector<uint32_t> _values;
+
+    // Lowercased "name\nid\nsummary" of every package, back to back
+    string _text;
+    vector<uint32_t> _textStart;        // _count + 1 offsets into _text
+
+    // The last query and what it kept, to build on when narrowing
+    ResultQuery _lastQuery;
+    vector<int> _lastRows;
+    bool _haveLast;
+
+    void add(const PackageInfo& pkg);
+    bool textMatches(size_t i, const string& needle) const;
+    bool passes(const ResultQuery& query, size_t i, const string& needle) const;
+    static unsigned maskOf(const ResultQuery& query, unsigned facet);
+};
+
+} // namespace PolySynaptic
+
+#endif // _RESULTFILTER_H_
+
+// vim:ts=4:sw=4:et
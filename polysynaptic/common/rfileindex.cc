@@ -0,0 +1,606 @@
+/* rfileindex.cc - Which package owns which file
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rfileindex.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+using namespace std;
+
+static const char IndexMagic[8] = {'R', 'F', 'I', 'L', 'E', 'I', 'X', '\0'};
+
+namespace {
+
+// reads from the mapped file; any read past the end makes ok() false
+// and returns zeros from then on
+class IndexReader {
+ public:
+   IndexReader(const char *data, size_t size)
+      : _p(data), _end(data + size), _ok(true) {}
+
+   bool ok() const { return _ok; }
+   void fail() { _ok = false; }
+
+   uint32_t u32() {
+      uint32_t v = 0;
+      if (left(sizeof(v))) {
+         memcpy(&v, _p, sizeof(v));
+         _p += sizeof(v);
+      }
+      return v;
+   }
+
+   uint64_t u64() {
+      uint64_t v = 0;
+      if (left(sizeof(v))) {
+         memcpy(&v, _p, sizeof(v));
+         _p += sizeof(v);
+      }
+      return v;
+   }
+
+   string str() {
+      uint32_t len = u32();
+      if (!left(len))
+         return string();
+      string s(_p, len);
+      _p += len;
+      return s;
+   }
+
+   // len bytes left in place, NULL if there aren't that many
+   const char *skip(size_t len) {
+      if (!left(len))
+         return NULL;
+      const char *p = _p;
+      _p += len;
+      return p;
+   }
+
+   bool magic() {
+      if (!left(sizeof(IndexMagic)) ||
+          memcmp(_p, IndexMagic, sizeof(IndexMagic)) != 0)
+         return _ok = false;
+      _p += sizeof(IndexMagic);
+      return true;
+   }
+
+ private:
+   const char *_p;
+   const char *_end;
+   bool _ok;
+
+   bool left(size_t len) {
+      if (_ok && (size_t)(_end - _p) < len)
+         _ok = false;
+      return _ok;
+   }
+};
+
+void writeU32(ofstream &out, uint32_t v)
+{
+   out.write((const char *)&v, sizeof(v));
+}
+
+void writeU64(ofstream &out, uint64_t v)
+{
+   out.write((const char *)&v, sizeof(v));
+}
+
+void writeStr(ofstream &out, const string &s)
+{
+   writeU32(out, s.size());
+   out.write(s.data(), s.size());
+}
+
+void putVarint(vector<char> &out, uint32_t v)
+{
+   while (v >= 0x80) {
+      out.push_back((char)(v | 0x80));
+      v >>= 7;
+   }
+   out.push_back((char)v);
+}
+
+uint32_t getVarint(const char *data, uint32_t &pos)
+{
+   uint32_t v = 0;
+   for (int shift = 0; shift < 35; shift += 7) {
+      unsigned char c = data[pos++];
+      v |= (uint32_t)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+         break;
+   }
+   return v;
+}
+
+// getVarint() that doesn't read past size
+bool checkedVarint(const char *data, uint32_t size, uint32_t &pos,
+                   uint32_t &v)
+{
+   v = 0;
+   for (int shift = 0; shift < 35 && pos < size; shift += 7) {
+      unsigned char c = data[pos++];
+      v |= (uint32_t)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+         return true;
+   }
+   return false;
+}
+
+struct SourceStamp {
+   uint64_t sec;
+   uint64_t nsec;
+   uint64_t size;
+   // the dpkg package name for a list, the export dir number otherwise
+   string owner;
+   int exportDir;
+};
+
+bool stampOf(const string &path, SourceStamp &stamp)
+{
+   struct stat st;
+   if (stat(path.c_str(), &st) != 0)
+      return false;
+   stamp.sec = st.st_mtim.tv_sec;
+   stamp.nsec = st.st_mtim.tv_nsec;
+   stamp.size = st.st_size;
+   return true;
+}
+
+bool matchAllTerms(const char *path, void *data)
+{
+   const vector<string> &terms = *(const vector<string> *)data;
+   for (unsigned int i = 0; i < terms.size(); i++)
+      if (strcasestr(path, terms[i].c_str()) == NULL)
+         return false;
+   return true;
+}
+
+}
+
+RFileIndex::RFileIndex()
+   : _blob(NULL), _blobSize(0), _restarts(NULL), _restartCount(0),
+     _count(0), _map(NULL), _mapSize(0), _stale(true), _loaded(false)
+{
+}
+
+RFileIndex::~RFileIndex()
+{
+   unmap();
+}
+
+void RFileIndex::unmap()
+{
+   if (_map != NULL)
+      munmap(_map, _mapSize);
+   _map = NULL;
+   _mapSize = 0;
+}
+
+void RFileIndex::configure(const string &infoDir,
+                           const vector<ExportDir> &exports,
+                           const string &cachePath)
+{
+   _infoDir = infoDir;
+   _exports = exports;
+   _cachePath = cachePath;
+   _stale = true;
+}
+
+void RFileIndex::ensure()
+{
+   if (!_stale)
+      return;
+   if (!_loaded) {
+      _loaded = true;
+      if (!_cachePath.empty())
+         load(_cachePath);
+   }
+   if (refresh() && !_cachePath.empty())
+      save(_cachePath);
+}
+
+uint32_t RFileIndex::restart(uint32_t i) const
+{
+   uint32_t v;
+   memcpy(&v, _restarts + i * sizeof(v), sizeof(v));
+   return v;
+}
+
+uint32_t RFileIndex::decode(uint32_t pos, string &path, uint32_t &owner) const
+{
+   uint32_t shared = getVarint(_blob, pos);
+   uint32_t rest = getVarint(_blob, pos);
+   path.resize(shared);
+   path.append(_blob + pos, rest);
+   pos += rest;
+   owner = getVarint(_blob, pos);
+   return pos;
+}
+
+void RFileIndex::decodeAll(vector<Entry> &entries) const
+{
+   entries.reserve(entries.size() + _count);
+   string path;
+   uint32_t owner;
+   uint32_t pos = 0;
+   for (uint32_t i = 0; i < _count; i++) {
+      pos = decode(pos, path, owner);
+      entries.push_back(Entry(path, owner));
+   }
+}
+
+bool RFileIndex::valid() const
+{
+   uint32_t pos = 0, prevLen = 0;
+   for (uint32_t i = 0; i < _count; i++) {
+      bool restartsHere = i % RestartInterval == 0;
+      if (restartsHere && restart(i / RestartInterval) != pos)
+         return false;
+      uint32_t shared, rest, owner;
+      if (!checkedVarint(_blob, _blobSize, pos, shared) ||
+          !checkedVarint(_blob, _blobSize, pos, rest) ||
+          shared > prevLen || (restartsHere && shared != 0) ||
+          rest > _blobSize - pos)
+         return false;
+      pos += rest;
+      if (!checkedVarint(_blob, _blobSize, pos, owner) ||
+          owner >= _owners.size())
+         return false;
+      prevLen = shared + rest;
+   }
+   return pos == _blobSize;
+}
+
+void RFileIndex::build(vector<Entry> &entries)
+{
+   sort(entries.begin(), entries.end());
+   entries.erase(unique(entries.begin(), entries.end()), entries.end());
+
+   unmap();
+   _data.clear();
+   _restartData.clear();
+   for (unsigned int i = 0; i < entries.size(); i++) {
+      const string &path = entries[i].first;
+      uint32_t shared = 0;
+      if (i % RestartInterval == 0) {
+         _restartData.push_back(_data.size());
+      } else {
+         const string &prev = entries[i - 1].first;
+         while (shared < prev.size() && shared < path.size() &&
+                prev[shared] == path[shared])
+            shared++;
+      }
+      putVarint(_data, shared);
+      putVarint(_data, path.size() - shared);
+      _data.insert(_data.end(), path.begin() + shared, path.end());
+      putVarint(_data, entries[i].second);
+   }
+
+   _count = entries.size();
+   _blob = _data.empty() ? NULL : &_data[0];
+   _blobSize = _data.size();
+   _restarts = _restartData.empty() ? NULL : (const char *)&_restartData[0];
+   _restartCount = _restartData.size();
+}
+
+bool RFileIndex::refresh()
+{
+   _stale = false;
+
+   // what the index should be built from right now, by path
+   map<string, SourceStamp> sources;
+   DIR *dir = _infoDir.empty() ? NULL : opendir(_infoDir.c_str());
+   if (dir != NULL) {
+      struct dirent *ent;
+      while ((ent = readdir(dir)) != NULL) {
+         size_t len = strlen(ent->d_name);
+         if (len <= 5 || strcmp(ent->d_name + len - 5, ".list") != 0)
+            continue;
+         string path = _infoDir + "/" + ent->d_name;
+         SourceStamp stamp;
+         if (!stampOf(path, stamp))
+            continue;
+         stamp.owner.assign(ent->d_name, len - 5);
+         stamp.exportDir = -1;
+         sources[path] = stamp;
+      }
+      closedir(dir);
+   }
+   for (unsigned int i = 0; i < _exports.size(); i++) {
+      SourceStamp stamp;
+      if (!stampOf(_exports[i].dir, stamp))
+         continue;
+      stamp.exportDir = i;
+      sources[_exports[i].dir] = stamp;
+   }
+
+   // owners of an unchanged source keep their entries, the rest go
+   vector<int> keep(_owners.size(), -1);
+   vector<Owner> owners;
+   set<string> covered;
+   for (unsigned int i = 0; i < _owners.size(); i++) {
+      const Owner &o = _owners[i];
+      map<string, SourceStamp>::const_iterator S = sources.find(o.source);
+      if (S == sources.end() || S->second.sec != o.sec ||
+          S->second.nsec != o.nsec || S->second.size != o.size)
+         continue;
+      keep[i] = owners.size();
+      owners.push_back(o);
+      covered.insert(o.source);
+   }
+   if (owners.size() == _owners.size() && covered.size() == sources.size())
+      return false;
+
+   vector<Entry> entries;
+   if (_count > 0) {
+      vector<Entry> old;
+      decodeAll(old);
+      entries.reserve(old.size());
+      for (unsigned int i = 0; i < old.size(); i++) {
+         if (old[i].second < keep.size() && keep[old[i].second] >= 0) {
+            entries.push_back(old[i]);
+            entries.back().second = keep[old[i].second];
+         }
+      }
+   }
+
+   for (map<string, SourceStamp>::const_iterator S = sources.begin();
+        S != sources.end(); S++) {
+      if (covered.find(S->first) != covered.end())
+         continue;
+      const SourceStamp &stamp = S->second;
+      Owner o;
+      o.source = S->first;
+      o.sec = stamp.sec;
+      o.nsec = stamp.nsec;
+      o.size = stamp.size;
+
+      if (stamp.exportDir < 0) {
+         o.name = stamp.owner;
+         uint32_t id = owners.size();
+         owners.push_back(o);
+         ifstream in(S->first.c_str());
+         string line;
+         while (getline(in, line))
+            if (!line.empty())
+               entries.push_back(Entry(line, id));
+         continue;
+      }
+
+      // the dir itself carries the stamp, so an empty one stays covered
+      owners.push_back(o);
+      const ExportDir &exp = _exports[stamp.exportDir];
+      DIR *edir = opendir(exp.dir.c_str());
+      if (edir == NULL)
+         continue;
+      map<string, uint32_t> ids;
+      struct dirent *ent;
+      while ((ent = readdir(edir)) != NULL) {
+         if (ent->d_name[0] == '.')
+            continue;
+         string name = ent->d_name;
+         if (exp.cut != 0 && name.find(exp.cut) != string::npos)
+            name.erase(name.find(exp.cut));
+         map<string, uint32_t>::iterator I = ids.find(name);
+         if (I == ids.end()) {
+            Owner eo = o;
+            eo.name = exp.prefix + name;
+            I = ids.insert(make_pair(name, (uint32_t)owners.size())).first;
+            owners.push_back(eo);
+         }
+         entries.push_back(Entry(exp.dir + "/" + ent->d_name, I->second));
+      }
+      closedir(edir);
+   }
+
+   _owners.swap(owners);
+   build(entries);
+   return true;
+}
+
+vector<string> RFileIndex::owners(const string &path) const
+{
+   vector<string> result;
+   if (_count == 0)
+      return result;
+
+   // the last block that starts before path; equal paths may begin in
+   // the block before the one that starts with path
+   uint32_t lo = 0, hi = _restartCount;
+   string first;
+   uint32_t owner;
+   while (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      first.clear();
+      decode(restart(mid), first, owner);
+      if (first < path)
+         lo = mid;
+      else
+         hi = mid;
+   }
+
+   string cur;
+   uint32_t pos = restart(lo);
+   for (uint32_t i = lo * RestartInterval; i < _count; i++) {
+      pos = decode(pos, cur, owner);
+      if (cur > path)
+         break;
+      if (cur == path && owner < _owners.size())
+         result.push_back(_owners[owner].name);
+   }
+   sort(result.begin(), result.end());
+   return result;
+}
+
+void RFileIndex::ownersWhere(bool (*match)(const char *path, void *data),
+                             void *data, set<string> &owners) const
+{
+   string path, prev;
+   uint32_t owner;
+   uint32_t pos = 0;
+   bool matched = false;
+   for (uint32_t i = 0; i < _count; i++) {
+      pos = decode(pos, path, owner);
+      // directories are listed once per package that has files there
+      if (i == 0 || path != prev) {
+         matched = match(path.c_str(), data);
+         prev = path;
+      }
+      if (matched && owner < _owners.size())
+         owners.insert(_owners[owner].name);
+   }
+}
+
+void RFileIndex::ownersContaining(const vector<string> &terms,
+                                  set<string> &owners) const
+{
+   ownersWhere(matchAllTerms, (void *)&terms, owners);
+}
+
+bool RFileIndex::load(const string &path)
+{
+   int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+   }
+   void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED)
+      return false;
+
+   IndexReader r((const char *)base, st.st_size);
+   vector<Owner> owners;
+   uint32_t count = 0, restartCount = 0, blobSize = 0;
+   const char *restarts = NULL, *blob = NULL;
+
+   if (r.magic() && r.u32() == FormatVersion) {
+      uint32_t ownerCount = r.u32();
+      // a broken count must not reserve gigabytes
+      if (ownerCount > st.st_size / sizeof(uint32_t))
+         r.fail();
+      else
+         owners.reserve(ownerCount);
+      for (uint32_t i = 0; r.ok() && i < ownerCount; i++) {
+         Owner o;
+         o.name = r.str();
+         o.source = r.str();
+         o.sec = r.u64();
+         o.nsec = r.u64();
+         o.size = r.u64();
+         owners.push_back(o);
+      }
+      count = r.u32();
+      restartCount = r.u32();
+      if (restartCount != (count + RestartInterval - 1) / RestartInterval)
+         r.fail();
+      restarts = r.skip((size_t)restartCount * sizeof(uint32_t));
+      blobSize = r.u32();
+      blob = r.skip(blobSize);
+   } else {
+      r.fail();
+   }
+
+   if (!r.ok()) {
+      munmap(base, st.st_size);
+      return false;
+   }
+
+   unmap();
+   _data.clear();
+   _restartData.clear();
+   _map = base;
+   _mapSize = st.st_size;
+   _owners.swap(owners);
+   _count = count;
+   _restarts = restarts;
+   _restartCount = restartCount;
+   _blob = blob;
+   _blobSize = blobSize;
+
+   // everything after this trusts the data, so check it once here
+   if (!valid()) {
+      unmap();
+      _owners.clear();
+      _count = _restartCount = _blobSize = 0;
+      _blob = _restarts = NULL;
+      return false;
+   }
+   return true;
+}
+
+bool RFileIndex::save(const string &path) const
+{
+   string tmpPath = path + ".tmp";
+
+   {
+      ofstream out(tmpPath.c_str(), ios::binary | ios::trunc);
+      if (!out.is_open())
+         return false;
+
+      out.write(IndexMagic, sizeof(IndexMagic));
+      writeU32(out, FormatVersion);
+      writeU32(out, _owners.size());
+      for (unsigned int i = 0; i < _owners.size(); i++) {
+         writeStr(out, _owners[i].name);
+         writeStr(out, _owners[i].source);
+         writeU64(out, _owners[i].sec);
+         writeU64(out, _owners[i].nsec);
+         writeU64(out, _owners[i].size);
+      }
+      writeU32(out, _count);
+      writeU32(out, _restartCount);
+      if (_restartCount > 0)
+         out.write(_restarts, _restartCount * sizeof(uint32_t));
+      writeU32(out, _blobSize);
+      if (_blobSize > 0)
+         out.write(_blob, _blobSize);
+
+      if (!out.good()) {
+         out.close();
+         unlink(tmpPath.c_str());
+         return false;
+      }
+   }
+
+   if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+      unlink(tmpPath.c_str());
+      return false;
+   }
+   return true;
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,147 @@
+/* rfileindex.h - Which package owns which file
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RFILEINDEX_H
+#define RFILEINDEX_H
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Every path of every dpkg file list (<info dir>/<package>.list) and of
+// the export dirs of the other backends (/snap/bin, the flatpak exports),
+// with the owner of each, so "who owns this path" and "which packages
+// ship a file matching this" don't have to read thousands of lists.
+//
+// The paths are kept sorted and front coded: each entry stores how many
+// bytes it shares with the one before and the rest, and every
+// RestartInterval-th entry is stored whole so a lookup can binary
+// search those and decode at most one block. Paths listed by many
+// packages (/usr, /usr/bin) cost a few bytes per owner.
+//
+// refresh() stats the lists and only rereads those whose mtime or size
+// changed, so after a commit only the packages that were touched are
+// read again. The index is saved to and mapped back from a file, which
+// keeps the first search of a session from reading every list.
+//
+// File format (host byte order):
+//   char[8] magic "RFILEIX\0", uint32 version, uint32 owner count,
+//   per owner: string name, string source (the list or export dir it
+//   was read from), uint64 mtime sec, uint64 mtime nsec, uint64 size of
+//   the source, then uint32 entry count, uint32 restart count,
+//   uint32 restart offsets, uint32 data size, data
+// strings are a uint32 length followed by the bytes.
+class RFileIndex {
+ public:
+   static const uint32_t FormatVersion = 1;
+   static const unsigned int RestartInterval = 16;
+
+   // a directory whose entries are owned by prefix + their name, cut at
+   // the first "cut" character if any (/snap/bin/foo.bar is "snap:foo")
+   struct ExportDir {
+      string dir;
+      string prefix;
+      char cut;
+   };
+
+   RFileIndex();
+   ~RFileIndex();
+
+   // where refresh() reads from and ensure() saves to
+   void configure(const string &infoDir, const vector<ExportDir> &exports,
+                  const string &cachePath);
+
+   // the lists may have changed (a commit ran); the next ensure() runs
+   // refresh()
+   void invalidate() { _stale = true; }
+
+   // load the saved index on first use, refresh it if it is stale and
+   // save it if that changed anything
+   void ensure();
+
+   // reread what changed, true if anything did
+   bool refresh();
+
+   bool load(const string &path);
+   bool save(const string &path) const;
+
+   unsigned int size() const { return _count; }
+   bool empty() const { return _count == 0; }
+
+   // the owners of exactly this path, sorted
+   vector<string> owners(const string &path) const;
+
+   // the owners of the paths for which match() returns true
+   void ownersWhere(bool (*match)(const char *path, void *data), void *data,
+                    set<string> &owners) const;
+
+   // the owners of the paths that contain every term
+   void ownersContaining(const vector<string> &terms,
+                         set<string> &owners) const;
+
+ private:
+   struct Owner {
+      string name;
+      string source;
+      uint64_t sec;
+      uint64_t nsec;
+      uint64_t size;
+   };
+   vector<Owner> _owners;
+
+   // either _blob points into _map or into _data
+   const char *_blob;
+   uint32_t _blobSize;
+   const char *_restarts;
+   uint32_t _restartCount;
+   uint32_t _count;
+   vector<char> _data;
+   vector<uint32_t> _restartData;
+   void *_map;
+   size_t _mapSize;
+
+   string _infoDir;
+   vector<ExportDir> _exports;
+   string _cachePath;
+   bool _stale;
+   bool _loaded;
+
+   RFileIndex(const RFileIndex &);
+   RFileIndex &operator=(const RFileIndex &);
+
+   typedef pair<string, uint32_t> Entry;
+
+   uint32_t restart(uint32_t i) const;
+   // decode the entry at offset pos after prev, return the next offset
+   uint32_t decode(uint32_t pos, string &path, uint32_t &owner) const;
+   void decodeAll(vector<Entry> &entries) const;
+   // false if the entries don't decode within the data
+   bool valid() const;
+   void build(vector<Entry> &entries);
+   void unmap();
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
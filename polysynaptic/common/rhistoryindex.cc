@@ -0,0 +1,343 @@
+/* rhistoryindex.cc - What each saved commit log holds
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rhistoryindex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RHistoryIndex::RHistoryIndex(const string &dir)
+   : _dir(dir)
+{
+}
+
+bool RHistoryIndex::parseName(const string &file, struct tm &when)
+{
+   // YYYY-MM-DD.HHMMSS.log, as writeCommitLog() names them
+   unsigned int year, month, day, hour, min, sec;
+   if (file.size() != 21 || file.compare(17, 4, ".log") != 0 ||
+       sscanf(file.c_str(), "%4u-%2u-%2u.%2u%2u%2u",
+              &year, &month, &day, &hour, &min, &sec) != 6)
+      return false;
+
+   memset(&when, 0, sizeof(when));
+   when.tm_year = year - 1900;
+   when.tm_mon = month - 1;
+   when.tm_mday = day;
+   when.tm_hour = hour;
+   when.tm_min = min;
+   when.tm_sec = sec;
+   when.tm_isdst = -1;
+
+   // fills in the weekday, on a copy so the fields stay as named
+   struct tm normalized = when;
+   mktime(&normalized);
+   when.tm_wday = normalized.tm_wday;
+   return true;
+}
+
+// ========================================================================
+// Reading the logs
+// ========================================================================
+
+bool RHistoryIndex::Recorder::start(const string &file)
+{
+   _entry = Entry();
+   _entry.file = file;
+   _entry.size = 0;
+   _entry.mtime = 0;
+   _entry.packages = 0;
+   _seen.clear();
+   _first = true;
+   return parseName(file, _entry.when);
+}
+
+void RHistoryIndex::Recorder::line(const string &text, bool package)
+{
+   _first = false;
+
+   istringstream words(text);
+   string word, lead;
+   while (words >> word) {
+      if (lead.empty())
+         lead = word;
+      if (_seen.insert(word).second) {
+         if (!_entry.words.empty())
+            _entry.words += ' ';
+         _entry.words += word;
+      }
+   }
+
+   if (!package || lead.empty())
+      return;
+   if (_entry.packages++ < MaxNames) {
+      if (!_entry.names.empty())
+         _entry.names += ", ";
+      _entry.names += lead;
+   }
+}
+
+void RHistoryIndex::Recorder::line(const string &text)
+{
+   // "Commit Log for <date>", then section headers ending in ':'
+   // each followed by one package per line
+   bool header = _first || text.empty() || text[text.size() - 1] == ':';
+   line(text, !header);
+}
+
+bool RHistoryIndex::scan(const string &file, Entry &entry) const
+{
+   string path = _dir + file;
+   struct stat st;
+   Recorder record;
+   if (!record.start(file) || stat(path.c_str(), &st) != 0)
+      return false;
+
+   ifstream in(path.c_str());
+   if (!in)
+      return false;
+
+   string line;
+   while (getline(in, line))
+      record.line(line);
+
+   entry = record.entry();
+   entry.size = st.st_size;
+   entry.mtime = st.st_mtime;
+   return true;
+}
+
+bool RHistoryIndex::read(const Entry &entry, string &text) const
+{
+   ifstream in((_dir + entry.file).c_str());
+   if (!in)
+      return false;
+   ostringstream out;
+   out << in.rdbuf();
+   text = out.str();
+   return true;
+}
+
+// ========================================================================
+// The index file
+// ========================================================================
+
+string RHistoryIndex::format(const Entry &entry)
+{
+   ostringstream line;
+   line << entry.file << '\t' << entry.size << '\t' << entry.mtime << '\t'
+        << entry.packages << '\t' << entry.names << '\t' << entry.words;
+   return line.str();
+}
+
+bool RHistoryIndex::parse(const string &line, Entry &entry)
+{
+   vector<string> fields;
+   size_t start = 0;
+   for (;;) {
+      size_t tab = line.find('\t', start);
+      fields.push_back(line.substr(start, tab - start));
+      if (tab == string::npos)
+         break;
+      start = tab + 1;
+   }
+   if (fields.size() != 6 || !parseName(fields[0], entry.when))
+      return false;
+
+   entry.file = fields[0];
+   entry.size = strtoull(fields[1].c_str(), NULL, 10);
+   entry.mtime = strtoull(fields[2].c_str(), NULL, 10);
+   entry.packages = strtoul(fields[3].c_str(), NULL, 10);
+   entry.names = fields[4];
+   entry.words = fields[5];
+   return true;
+}
+
+bool RHistoryIndex::load()
+{
+   map<string, Entry> indexed;
+   {
+      ifstream in((_dir + fileName()).c_str());
+      string line;
+      Entry entry;
+      while (getline(in, line)) {
+         // a later line for the same log is the newer one
+         if (parse(line, entry))
+            indexed[entry.file] = entry;
+      }
+   }
+
+   DIR *dir = opendir(_dir.c_str());
+   if (dir == NULL)
+      return false;
+
+   bool changed = false;
+   vector<Entry> entries;
+   struct dirent *dent;
+   while ((dent = readdir(dir)) != NULL) {
+      string file = dent->d_name;
+      struct tm when;
+      if (!parseName(file, when))
+         continue;
+
+      map<string, Entry>::iterator known = indexed.find(file);
+      struct stat st;
+      if (known != indexed.end() && stat((_dir + file).c_str(), &st) == 0 &&
+          known->second.size == (uint64_t)st.st_size &&
+          known->second.mtime == (uint64_t)st.st_mtime) {
+         entries.push_back(known->second);
+         indexed.erase(known);
+         continue;
+      }
+
+      Entry entry;
+      if (scan(file, entry))
+         entries.push_back(entry);
+      changed = true;
+   }
+   closedir(dir);
+
+   // what is left was deleted
+   if (!indexed.empty())
+      changed = true;
+
+   // the names sort by time
+   sort(entries.begin(), entries.end(),
+        [](const Entry &a, const Entry &b) { return a.file > b.file; });
+   _entries.swap(entries);
+
+   if (changed)
+      save();
+   return true;
+}
+
+bool RHistoryIndex::save() const
+{
+   string path = _dir + fileName();
+   string tmpPath = path + ".tmp";
+   {
+      ofstream out(tmpPath.c_str(), ios::trunc);
+      if (!out)
+         return false;
+      // oldest first, as add() would have written them
+      for (vector<Entry>::const_reverse_iterator e = _entries.rbegin();
+           e != _entries.rend(); e++)
+         out << format(*e) << '\n';
+      if (!out.good()) {
+         out.close();
+         unlink(tmpPath.c_str());
+         return false;
+      }
+   }
+   if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+      unlink(tmpPath.c_str());
+      return false;
+   }
+   return true;
+}
+
+bool RHistoryIndex::add(const string &file)
+{
+   Entry entry;
+   if (!scan(file, entry))
+      return false;
+   return add(entry);
+}
+
+bool RHistoryIndex::add(Entry entry)
+{
+   // as load() will find it, so it is not scanned again
+   struct stat st;
+   if (stat((_dir + entry.file).c_str(), &st) != 0)
+      return false;
+   entry.size = st.st_size;
+   entry.mtime = st.st_mtime;
+
+   ofstream out((_dir + fileName()).c_str(), ios::app);
+   if (!out)
+      return false;
+   out << format(entry) << '\n';
+   if (!out.good())
+      return false;
+
+   _entries.insert(_entries.begin(), entry);
+   return true;
+}
+
+// ========================================================================
+// Searching
+// ========================================================================
+
+vector<const RHistoryIndex::Entry *>
+RHistoryIndex::search(const string &text) const
+{
+   vector<const Entry *> found;
+   if (text.empty()) {
+      for (unsigned int i = 0; i < _entries.size(); i++)
+         found.push_back(&_entries[i]);
+      return found;
+   }
+
+   istringstream split(text);
+   vector<string> parts;
+   string part;
+   while (split >> part)
+      parts.push_back(part);
+
+   for (unsigned int i = 0; i < _entries.size(); i++) {
+      const Entry &entry = _entries[i];
+
+      // a line holding the text holds each of its words within words
+      // of its own
+      bool candidate = true;
+      for (unsigned int p = 0; candidate && p < parts.size(); p++)
+         candidate = entry.words.find(parts[p]) != string::npos;
+      if (!candidate)
+         continue;
+
+      // a single word is settled by the words; anything with blanks in
+      // it needs the lines themselves
+      if (parts.size() == 1 && parts[0] == text) {
+         found.push_back(&entry);
+         continue;
+      }
+
+      ifstream in((_dir + entry.file).c_str());
+      string line;
+      while (getline(in, line)) {
+         if (line.find(text) != string::npos) {
+            found.push_back(&entry);
+            break;
+         }
+      }
+   }
+   return found;
+}
+
+// vim:ts=3:sw=3:et
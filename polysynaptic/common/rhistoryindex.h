@@ -0,0 +1,124 @@
+/* rhistoryindex.h - What each saved commit log holds
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RHISTORYINDEX_H
+#define RHISTORYINDEX_H
+
+#include <stdint.h>
+#include <time.h>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The history window's table of contents: one line per commit log in
+// the log directory with its size and mtime, how many packages it names
+// and the first few of them, and every distinct word in it. Opening the
+// window reads this one file instead of every log, and a search reads
+// only the logs it cannot settle from the words.
+//
+// writeCommitLog() appends the log it wrote. load() picks up logs the
+// index does not know (written before it existed, or by another
+// version), drops those that were deleted, and rewrites the file when
+// it changed anything, so it never has to be trusted blindly.
+//
+// File format, one tab separated line per log:
+//   file name, size, mtime, package count, names (", " separated),
+//   words (space separated)
+// lines that do not have all six fields are ignored.
+class RHistoryIndex {
+ public:
+   // names shown per entry at most
+   static const unsigned int MaxNames = 5;
+
+   struct Entry {
+      string file;              // in the log directory
+      struct tm when;           // from the file name
+      uint64_t size;
+      uint64_t mtime;
+      unsigned int packages;    // lines naming a package
+      string names;             // the first MaxNames of them
+      string words;             // every distinct word, in order
+   };
+
+   // builds the entry of one log from its lines, while it is written or
+   // when it is read back
+   class Recorder {
+    public:
+      Recorder() : _first(true) {}
+
+      // start over, for the log of that name
+      bool start(const string &file);
+
+      // one line of the log; package tells whether it names one
+      void line(const string &text, bool package);
+      // the same, guessing from the layout: the first line, blank lines
+      // and section headers ending in ':' name none
+      void line(const string &text);
+
+      const Entry &entry() const { return _entry; }
+
+    private:
+      Entry _entry;
+      set<string> _seen;
+      bool _first;
+   };
+
+   // dir ends with a '/', as RLogDir() does
+   RHistoryIndex(const string &dir);
+
+   static const char *fileName() { return "history.idx"; }
+
+   // read the index and bring it up to date with the directory
+   bool load();
+
+   // newest first
+   const vector<Entry> &entries() const { return _entries; }
+
+   // the entries whose log has text on one of its lines, as searching
+   // the log itself would find them; newest first
+   vector<const Entry *> search(const string &text) const;
+
+   // the full text of one log
+   bool read(const Entry &entry, string &text) const;
+
+   // note a log just written to the directory
+   bool add(const string &file);
+   // the same, for a log whose entry was recorded as it was written
+   bool add(Entry entry);
+
+   // the time of a log by its name, false if it is not a log
+   static bool parseName(const string &file, struct tm &when);
+
+ private:
+   string _dir;
+   vector<Entry> _entries;
+
+   bool scan(const string &file, Entry &entry) const;
+   bool save() const;
+   static string format(const Entry &entry);
+   static bool parse(const string &line, Entry &entry);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
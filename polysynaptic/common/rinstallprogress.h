@@ -43,6 +43,9 @@ class RInstallProgress {
    // update is finished, we can close the window
    bool _updateFinished;
 
+   // this start() installs only part of the changes, more runs follow
+   bool _partialRun;
+
    static std::string finishMsg;
    static std::string errorMsg;
    static std::string incompleteMsg;
@@ -61,8 +64,17 @@ class RInstallProgress {
                                                 int numPackages = 0,
                                                 int numPackagesTotal = 0);
 
+   // pipelined commits: don't wrap up the interface after a run that
+   // stops early because archives are still downloading
+   void setPartialRun(bool partial) { _partialRun = partial; }
+
+   // called repeatedly while waiting for those archives
+   virtual void pulse() {
+   }
+
 
-   RInstallProgress():_donePackagesTotal(0), _numPackagesTotal(0),_updateFinished(false) {}
+   RInstallProgress():_donePackagesTotal(0), _numPackagesTotal(0),_updateFinished(false),
+                      _partialRun(false) {}
 };
 
 
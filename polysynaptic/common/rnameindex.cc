@@ -0,0 +1,138 @@
+/* rnameindex.cc - Package name lookups by prefix and exact name
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rnameindex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+// FNV-1a, good enough for names and cheap to compute
+unsigned int RNameIndex::hashOf(const char *name)
+{
+   unsigned int h = 2166136261u;
+   for (; *name != 0; name++)
+      h = (h ^ (unsigned char)*name) * 16777619u;
+   return h;
+}
+
+void RNameIndex::add(unsigned int id, const char *name)
+{
+   if (name == NULL)
+      return;
+
+   entry e;
+   e.name = _names.size();
+   e.folded = _folded.size();
+   e.id = id;
+   _entries.push_back(e);
+
+   _names.append(name);
+   _names.push_back(0);
+   for (; *name != 0; name++)
+      _folded.push_back(tolower((unsigned char)*name));
+   _folded.push_back(0);
+}
+
+void RNameIndex::finish()
+{
+   const char *folded = _folded.c_str();
+   // stable, so equal names keep the order they were added in
+   stable_sort(_entries.begin(), _entries.end(),
+               [folded](const entry &a, const entry &b) {
+                  return strcmp(folded + a.folded, folded + b.folded) < 0;
+               });
+
+   // at most half full, so probe sequences stay short
+   unsigned int slots = 16;
+   while (slots < _entries.size() * 2)
+      slots *= 2;
+   _mask = slots - 1;
+   _slots.assign(slots, -1);
+
+   // the earliest added of equal names takes the slot
+   vector<unsigned int> order(_entries.size());
+   for (unsigned int i = 0; i < order.size(); i++)
+      order[i] = i;
+   sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+      return _entries[a].name < _entries[b].name;
+   });
+
+   const char *names = _names.c_str();
+   for (unsigned int i = 0; i < order.size(); i++) {
+      const char *name = names + _entries[order[i]].name;
+      unsigned int s = hashOf(name) & _mask;
+      for (; _slots[s] != -1; s = (s + 1) & _mask) {
+         if (strcmp(names + _entries[_slots[s]].name, name) == 0)
+            break;
+      }
+      if (_slots[s] == -1)
+         _slots[s] = order[i];
+   }
+}
+
+void RNameIndex::clear()
+{
+   _names.clear();
+   _folded.clear();
+   _entries.clear();
+   _slots.clear();
+   _mask = 0;
+}
+
+int RNameIndex::find(const char *name) const
+{
+   if (_slots.empty() || name == NULL)
+      return -1;
+
+   const char *names = _names.c_str();
+   for (unsigned int s = hashOf(name) & _mask; _slots[s] != -1;
+        s = (s + 1) & _mask) {
+      const entry &e = _entries[_slots[s]];
+      if (strcmp(names + e.name, name) == 0)
+         return e.id;
+   }
+   return -1;
+}
+
+void RNameIndex::withPrefix(const char *prefix, vector<unsigned int> &ids) const
+{
+   ids.clear();
+
+   string key(prefix);
+   for (unsigned int i = 0; i < key.size(); i++)
+      key[i] = tolower((unsigned char)key[i]);
+
+   const char *folded = _folded.c_str();
+   vector<entry>::const_iterator I =
+      lower_bound(_entries.begin(), _entries.end(), key,
+                  [folded](const entry &e, const string &k) {
+                     return strcmp(folded + e.folded, k.c_str()) < 0;
+                  });
+   for (; I != _entries.end(); I++) {
+      if (strncmp(folded + I->folded, key.c_str(), key.size()) != 0)
+         break;
+      ids.push_back(I->id);
+   }
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,77 @@
+/* rnameindex.h - Package name lookups by prefix and exact name
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RNAMEINDEX_H
+#define RNAMEINDEX_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Package names with the ids they were added under, in two forms: a
+// table sorted by the case-folded name, where all names starting with
+// a prefix are one binary search away (typeahead), and an open
+// addressing hash over the exact names (name resolution). Built once
+// per cache, the names are copied in so they never dangle.
+//
+// Folding is done bytewise with tolower(), like strncasecmp.
+class RNameIndex {
+ public:
+   RNameIndex() : _mask(0) {}
+
+   // add a name; if an equal name was added before, find() keeps
+   // returning the earlier id
+   void add(unsigned int id, const char *name);
+
+   // sort and hash what was added; needed before the lookups
+   void finish();
+
+   void clear();
+
+   unsigned int size() const { return _entries.size(); }
+
+   // id of the name, or -1
+   int find(const char *name) const;
+
+   // ids of the names starting with prefix, ignoring case, in
+   // case-folded name order
+   void withPrefix(const char *prefix, vector<unsigned int> &ids) const;
+
+ private:
+   struct entry {
+      unsigned int name;        // offset of the exact name in _names
+      unsigned int folded;      // offset of the folded name in _folded
+      unsigned int id;
+   };
+
+   string _names;               // every name, NUL terminated
+   string _folded;
+   vector<entry> _entries;      // sorted by folded name after finish()
+   vector<int> _slots;          // index into _entries, -1 empty
+   unsigned int _mask;
+
+   static unsigned int hashOf(const char *name);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,65 @@
+/* rnameset.cc - Membership of package names without keeping the names
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rnameset.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// FNV-1a 64
+uint64_t RNameSet::hashOf(const char *name)
+{
+   uint64_t h = 14695981039346656037ull;
+   for (; *name != 0; name++)
+      h = (h ^ (unsigned char)*name) * 1099511628211ull;
+   return h;
+}
+
+void RNameSet::finish()
+{
+   if (_pending.empty())
+      return;
+
+   sort(_pending.begin(), _pending.end());
+   // a later open only adds the few new names, so merge them in
+   // rather than sorting everything again
+   size_t middle = _hashes.size();
+   _hashes.reserve(middle + _pending.size());
+   _hashes.insert(_hashes.end(), _pending.begin(), _pending.end());
+   inplace_merge(_hashes.begin(), _hashes.begin() + middle, _hashes.end());
+   _hashes.erase(unique(_hashes.begin(), _hashes.end()), _hashes.end());
+
+   _pending.clear();
+   _pending.shrink_to_fit();
+}
+
+bool RNameSet::seen(const char *name) const
+{
+   return binary_search(_hashes.begin(), _hashes.end(), hashOf(name));
+}
+
+void RNameSet::clear()
+{
+   vector<uint64_t>().swap(_hashes);
+   vector<uint64_t>().swap(_pending);
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,67 @@
+/* rnameset.h - Membership of package names without keeping the names
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RNAMESET_H
+#define RNAMESET_H
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// The names seen so far, as a sorted array of their 64 bit hashes: 8
+// bytes a name where a set<string> takes a tree node and a copy of the
+// name. The lister keeps every name of every cache it opened in one to
+// tell the new packages apart, so with large archives (several
+// architectures, many PPAs) this is one of the bigger side structures.
+//
+// A hash collision makes a name look seen; among a million names that
+// is about one chance in 10^7, and all it costs is a "new" flag.
+class RNameSet {
+ public:
+   // add a name; seen() only finds it after finish()
+   void add(const char *name) { _pending.push_back(hashOf(name)); }
+
+   // sort in what was added since the last call
+   void finish();
+
+   // whether the name was added before the last finish()
+   bool seen(const char *name) const;
+
+   void clear();
+
+   unsigned int size() const { return _hashes.size(); }
+
+   // heap bytes held
+   size_t memoryBytes() const {
+      return (_hashes.capacity() + _pending.capacity()) * sizeof(uint64_t);
+   }
+
+ private:
+   vector<uint64_t> _hashes;    // sorted, no duplicates
+   vector<uint64_t> _pending;
+
+   static uint64_t hashOf(const char *name);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
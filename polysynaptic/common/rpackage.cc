@@ -78,9 +78,9 @@ static char *parseDescription(string descr);
 RPackage::RPackage(RPackageLister *lister, pkgDepCache *depcache,
                    pkgRecords *records, pkgCache::PkgIterator &pkg)
 : _lister(lister), _records(records), _depcache(depcache),
-  _notify(true), _boolFlags(0)
+  _iter(pkg), _package(&_iter), _notify(true), _boolFlags(0),
+  _versionsListed(false)
 {
-   _package = new pkgCache::PkgIterator(pkg);
 
 #ifdef WITH_APT_MULTIARCH_SUPPORT
    fullname = _package->FullName(true);
@@ -94,7 +94,27 @@ RPackage::RPackage(RPackageLister *lister, pkgDepCache *depcache,
 
 RPackage::~RPackage()
 {
-   delete _package;
+}
+
+void RPackage::rebind(pkgDepCache *depcache, pkgRecords *records,
+                      pkgCache::PkgIterator &pkg)
+{
+   _records = records;
+   _depcache = depcache;
+   *_package = pkg;
+   _notify = true;
+   _boolFlags = 0;
+   _versions.clear();
+   _versionsListed = false;
+
+#ifdef WITH_APT_MULTIARCH_SUPPORT
+   fullname = _package->FullName(true);
+#endif
+
+   _defaultCandVer.clear();
+   pkgDepCache::StateCache & State = (*_depcache)[*_package];
+   if (State.CandVersion != NULL)
+      _defaultCandVer = State.CandVersion;
 }
 
 #if 0
@@ -123,8 +143,9 @@ const char *RPackage::srcPackage()
 
    pkgCache::VerIterator ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
    if (!ver.end()) {
-      pkgRecords::Parser &parser = _records->Lookup(ver.FileList());
-      _srcPkg = parser.SourcePkg().empty() ? name() : parser.SourcePkg();
+      _srcPkg = record(ver.FileList())->sourcePackage();
+      if (_srcPkg.empty())
+         _srcPkg = name();
       return _srcPkg.c_str();
    }
 
@@ -139,8 +160,7 @@ const char *RPackage::summary()
    pkgCache::VerIterator ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
    if (!ver.end()) {
       pkgCache::DescIterator Desc = ver.TranslatedDescription();
-      pkgRecords::Parser & parser = _records->Lookup(Desc.FileList());
-      _summary = parser.ShortDesc();
+      _summary = record(Desc.FileList())->shortDescription();
       return _summary.c_str();
    }
    return "";
@@ -152,8 +172,7 @@ const char *RPackage::maintainer()
    static string _maintainer;
    pkgCache::VerIterator ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
    if (!ver.end()) {
-      pkgRecords::Parser & parser = _records->Lookup(ver.FileList());
-      _maintainer = parser.Maintainer();
+      _maintainer = record(ver.FileList())->field("Maintainer");
       return _maintainer.c_str();
    }
    return "";
@@ -164,8 +183,7 @@ const char *RPackage::homepage()
    static string _homepage;
    pkgCache::VerIterator ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
    if (!ver.end()) {
-      pkgRecords::Parser & parser = _records->Lookup(ver.FileList());
-      _homepage = parser.Homepage();
+      _homepage = record(ver.FileList())->field("Homepage");
       return _homepage .c_str();
    }
    return "";
@@ -224,38 +242,58 @@ const char *RPackage::priority()
 }
 
 #ifndef HAVE_RPM
-const char *RPackage::installedFiles()
+string RPackage::installedFilesPath()
 {
-   static string filelist;
-   vector<string> sV;
-   string s;
-
-   filelist.erase(filelist.begin(), filelist.end());
-
    // try normal file first
    string f = "/var/lib/dpkg/info/" + string(name()) + ".list";
    // try multiarch name next
    if (!FileExists(f))
       f = "/var/lib/dpkg/info/" + string(name()) + ":" + arch() + ".list";
-   if (FileExists(f)) {
-      ifstream in(f.c_str());
-      if (!in != 0)
-         return "";
-      while (in.eof() == false) {
-         getline(in, s);
-         sV.push_back( s );
-      }
-      sort(sV.begin(), sV.end());
-      for (unsigned int i = 1; i < sV.size(); i++)
-         filelist += sV[i] + "\n";
+   if (!FileExists(f))
+      return "";
+   return f;
+}
+
+string RPackage::readInstalledFiles(const string &path)
+{
+   vector<string> sV;
+   string s, filelist;
+
+   if (path.empty())
+      return _("The list of installed files is only available for installed packages");
 
-      return filelist.c_str();
+   ifstream in(path.c_str());
+   if (!in != 0)
+      return "";
+   while (in.eof() == false) {
+      getline(in, s);
+      sV.push_back( s );
    }
-   filelist = _("The list of installed files is only available for installed packages");
+   sort(sV.begin(), sV.end());
+   for (unsigned int i = 1; i < sV.size(); i++)
+      filelist += sV[i] + "\n";
 
+   return filelist;
+}
+
+const char *RPackage::installedFiles()
+{
+   static string filelist;
+
+   filelist = readInstalledFiles(installedFilesPath());
    return filelist.c_str();
 }
 #else
+string RPackage::installedFilesPath()
+{
+   return "";
+}
+
+string RPackage::readInstalledFiles(const string &path)
+{
+   return "";
+}
+
 const char *RPackage::installedFiles()
 {
    return "";
@@ -270,8 +308,7 @@ const char *RPackage::description()
 
    if (!ver.end()) {
       pkgCache::DescIterator Desc = ver.TranslatedDescription();
-      pkgRecords::Parser & parser = _records->Lookup(Desc.FileList());
-      _description = parseDescription(parser.LongDesc());
+      _description = parseDescription(record(Desc.FileList())->description());
       return _description.c_str();
    } else {
       return "";
@@ -285,14 +322,8 @@ string RPackage::getRawRecord(bool useCandidateVersion)
       ver = (*_depcache)[*_package].InstVerIter(*_depcache);
    if(useCandidateVersion || ver.end())
       ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
-   if(ver.end() == false) {
-      const char *start, *stop;
-      unsigned long len;
-      pkgRecords::Parser &rec=_records->Lookup(ver.FileList());
-      rec.GetRec(start, stop);
-      len = stop-start;
-      return string(start, len);
-   }
+   if(ver.end() == false)
+      return record(ver.FileList())->text();
    return string();
 }
 
@@ -300,22 +331,70 @@ string RPackage::findTagFromPkgRecord(const char *tag)
 {
    pkgCache::VerIterator ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
 
-   if (!ver.end()) {
-      const char *start, *stop;
-      pkgTagSection sec;
-      unsigned long len;
-
-      pkgRecords::Parser &rec=_records->Lookup(ver.FileList());
-      rec.GetRec(start, stop);
-      len = stop-start;
-      // add +1 to ensure we have the double lineline in the buffer
-      if (start && sec.Scan(start, len+1))
-	 return sec.FindS(tag);
-   }
+   if (!ver.end())
+      return record(ver.FileList())->field(tag);
 
    return string();
 }
 
+void RPackage::readRecords(const vector<RPackage *> &pkgs, bool descriptions,
+                           const RRecordBatch::Handler &handle)
+{
+   unsigned int first = 0;
+   while (first < pkgs.size() && pkgs[first] == NULL)
+      first++;
+   if (first == pkgs.size())
+      return;
+
+   pkgDepCache *depcache = pkgs[first]->_depcache;
+   RRecordBatch batch(depcache->GetCache());
+   for (unsigned int i = first; i < pkgs.size(); i++) {
+      if (pkgs[i] == NULL)
+         continue;
+      pkgCache::VerIterator ver = (*depcache)[*pkgs[i]->_package].CandidateVerIter(*depcache);
+      if (ver.end())
+         continue;
+      if (descriptions) {
+         pkgCache::DescIterator Desc = ver.TranslatedDescription();
+         if (!Desc.end())
+            batch.add(i, Desc.FileList());
+      } else {
+         batch.add(i, ver.FileList());
+      }
+   }
+   batch.read(handle);
+}
+
+string RPackage::formatDescription(const string &descr)
+{
+   return parseDescription(descr);
+}
+
+// read once per cache open however many fields the list, the details
+// window, searches and exports want from it
+static string recordText(pkgRecords::Parser &parser)
+{
+   const char *start, *stop;
+   parser.GetRec(start, stop);
+   return start ? string(start, stop - start) : string();
+}
+
+RRecordCache::RecordPtr RPackage::record(pkgCache::VerFileIterator file)
+{
+   pkgRecords *records = _records;
+   return _lister->recordCache().get(
+      RRecordCache::key(file.File()->ID, file->Offset),
+      [records, &file]() { return recordText(records->Lookup(file)); });
+}
+
+RRecordCache::RecordPtr RPackage::record(pkgCache::DescFileIterator file)
+{
+   pkgRecords *records = _records;
+   return _lister->recordCache().get(
+      RRecordCache::key(file.File()->ID, file->Offset),
+      [records, &file]() { return recordText(records->Lookup(file)); });
+}
+
 
 long RPackage::installedSize()
 {
@@ -344,6 +423,13 @@ long RPackage::availablePackageSize()
 }
 
 int RPackage::getFlags()
+{
+   if (_lister == NULL)
+      return computeStateFlags() | _boolFlags;
+   return _lister->getStateFlags(this) | _boolFlags;
+}
+
+int RPackage::computeStateFlags()
 {
    int flags = 0;
 
@@ -402,7 +488,7 @@ int RPackage::getFlags()
    if (state.Flags & pkgCache::Flag::Auto)
       flags |= FIsAuto;
 
-   if (state.Garbage)
+   if (_lister ? _lister->isAutoRemovable((*_package)->ID) : state.Garbage)
       flags |= FIsGarbage;
 
    if (state.NowPolicyBroken())
@@ -411,7 +497,7 @@ int RPackage::getFlags()
    if (state.InstPolicyBroken())
       flags |= FInstPolicyBroken;
 
-   return flags | _boolFlags;
+   return flags;
 }
 
 const char* RPackage::name()
@@ -426,16 +512,6 @@ const char* RPackage::name()
 #endif
 }
 
-bool RPackage::isMultiArchDuplicate()
-{
-   // Installed packages are never "hidden"
-   if ((*_package)->CurrentVer != 0)
-      return false;
-   // find the "best" package for the given group, if that is different
-   // from our PkgIterator this is not a interessting pkg
-   return (_package->Group().FindPkg() != *_package);
-}
-
 #if 0
 bool RPackage::isWeakDep(pkgCache::DepIterator &dep)
 {
@@ -515,15 +591,22 @@ vector<DepInformation> RPackage::enumRDeps()
 {
    vector<DepInformation> deps;
    DepInformation dep;
-   pkgCache::VerIterator Cur;
+   pkgCache &cache = *_package->Cache();
+   const RDependencyIndex &index = _lister->getDependencyIndex();
+
+   // every reverse dependency targets this package
+   bool isVirtual = (*_package)->VersionList == 0;
+
+   RDependencyIndex::Edges rdeps = index.reverseDepends((*_package)->ID);
+   deps.reserve(rdeps.size());
+   for (const RDependencyIndex::Edge &e : rdeps) {
+      pkgCache::DepIterator D = RDependencyIndex::dependency(cache, e);
 
-   for(pkgCache::DepIterator D = _package->RevDependsList(); D.end() != true; D++) {
       // clear old values
       dep.isOr=dep.isVirtual=false;
       dep.name=dep.version=dep.versionComp=NULL;
 
-      // check target and or-depends status
-      pkgCache::PkgIterator Trg = D.TargetPkg();
+      // check or-depends status
       if ((D->CompareOp & pkgCache::Dep::Or) == pkgCache::Dep::Or) {
 	 dep.version = _("or dependency");
 	 dep.versionComp = "";
@@ -535,10 +618,8 @@ vector<DepInformation> RPackage::enumRDeps()
       // FIXME: make this less hacky
       int nr_elements = sizeof(DepTypeStr)/sizeof(char*);
       dep.type = (pkgCache::Dep::DepType)(nr_elements-1);
-      dep.name = D.ParentPkg().Name();
-
-      if(Trg->VersionList == 0)
-	 dep.isVirtual=true;
+      dep.name = index.package(cache, e.pkg).Name();
+      dep.isVirtual = isVirtual;
 
       deps.push_back(dep);
    }
@@ -818,32 +899,10 @@ bool RPackage::isTrusted()
       //cerr << "CanidateVer == 0" << endl;
       return false;
    }
-   pkgSourceList *Sources=_lister->getCache()->list();
-   std::map<pkgCache::PkgFileIterator, pkgIndexFile*>::iterator it;
+   // resolved once per index file in RPackageLister::indexPackageFiles()
    for (pkgCache::VerFileIterator i = Ver.FileList(); i.end() == false; i++)
-   {
-      pkgIndexFile *Index;
-
-      // FIXME: instead of doing his dance (he trust cache is just
-      //        a couple of items big, that should be done in apt itself
-      it = _lister->getCache()->trust_cache().find(i.File());
-      if (it == _lister->getCache()->trust_cache().end()) {
-         if (Sources->FindIndex(i.File(),Index) == false)
-            continue;
-      } else {
-            Index = (*it).second;
-      }
-      _lister->getCache()->trust_cache().insert(
-         pair<pkgCache::PkgFileIterator, pkgIndexFile*>(i.File(), Index) );
-
-      if (_config->FindB("Debug::pkgAcquire::Auth", false))
-      {
-         std::cerr << "Checking index: " << Index->Describe()
-                   << "(Trusted=" << Index->IsTrusted() << ")\n";
-      }
-      if (Index->IsTrusted())
+      if (_lister->getPackageFile(i->File).trusted)
          return true;
-   }
 
    return false;
 }
@@ -872,12 +931,14 @@ void RPackage::setNotify(bool flag)
 void RPackage::setAuto(bool flag)
 {
    _depcache->MarkAuto(*_package, flag);
+   _lister->invalidateStateFlags();
 }
 
 
 void RPackage::setKeep()
 {
    _depcache->MarkKeep(*_package, false);
+   _lister->invalidateStateFlags();
    if (_notify)
       _lister->notifyChange(this);
    setReInstall(false);
@@ -890,8 +951,11 @@ void RPackage::setInstall()
    pkgDepCache::StateCache & State = (*_depcache)[*_package];
 
    // FIXME: can't we get rid of it here?
-   // if there is something wrong, try to fix it
-   if (!State.Install() || _depcache->BrokenCount() > 0) {
+   // if there is something wrong, try to fix it; a mark batch does
+   // that once for all of its packages when it ends
+   if (_lister->inMarkBatch()) {
+      _lister->deferResolve(this, false);
+   } else if (!State.Install() || _depcache->BrokenCount() > 0) {
       pkgProblemResolver Fix(_depcache);
       Fix.Clear(*_package);
       Fix.Protect(*_package);
@@ -907,6 +971,7 @@ void RPackage::setInstall()
    _lua->ResetCaches();
 #endif
 
+   _lister->invalidateStateFlags();
    if (_notify)
       _lister->notifyChange(this);
 }
@@ -914,6 +979,7 @@ void RPackage::setInstall()
 void RPackage::setReInstall(bool flag)
 {
     _depcache->SetReInstall(*_package, flag);
+    _lister->invalidateStateFlags();
     if (_notify)
 	_lister->notifyChange(this);
 }
@@ -921,17 +987,22 @@ void RPackage::setReInstall(bool flag)
 
 void RPackage::setRemove(bool purge)
 {
-   pkgProblemResolver Fix(_depcache);
+   if (_lister->inMarkBatch()) {
+      _lister->deferResolve(this, true);
+   } else {
+      pkgProblemResolver Fix(_depcache);
 
-   Fix.Clear(*_package);
-   Fix.Protect(*_package);
-   Fix.Remove(*_package);
+      Fix.Clear(*_package);
+      Fix.Protect(*_package);
+      Fix.Remove(*_package);
 
-   Fix.Resolve(true);
+      Fix.Resolve(true);
+   }
 
    _depcache->SetReInstall(*_package, false);
    _depcache->MarkDelete(*_package, purge);
 
+   _lister->invalidateStateFlags();
    if (_notify)
       _lister->notifyChange(this);
 }
@@ -941,18 +1012,7 @@ string RPackage::getScreenshotFile(pkgAcquire *fetcher, bool thumb)
    string descr("Screenshot for ");
    descr+=name();
 
-   string verstr;
-   if(availableVersion() != NULL)
-      verstr = availableVersion();
-
-   if(verstr.find(':')!=verstr.npos)
-      verstr=string(verstr, verstr.find(':')+1);
-   char uri[512];
-   if(thumb)
-      snprintf(uri,512,"https://screenshots.debian.net/thumbnail/%s", name());
-   else
-      snprintf(uri,512,"https://screenshots.debian.net/screenshot/%s", name());
-
+   string uri = getScreenshotURI(thumb);
    //cerr << "uri is: " << uri << endl;
 
    string filename = RTmpDir()+"/tmp_sh";
@@ -965,13 +1025,30 @@ string RPackage::getScreenshotFile(pkgAcquire *fetcher, bool thumb)
    return filename;
 }
 
+string RPackage::getScreenshotURI(bool thumb)
+{
+   char uri[512];
+   if(thumb)
+      snprintf(uri,512,"https://screenshots.debian.net/thumbnail/%s", name());
+   else
+      snprintf(uri,512,"https://screenshots.debian.net/screenshot/%s", name());
+   return uri;
+}
+
+string RPackage::getChangelogURI()
+{
+   pkgCache::VerIterator Ver = availableVersionIter();
+   if (Ver.end())
+      return "";
+   return pkgAcqChangelog::URI(Ver);
+}
+
 string RPackage::getChangelogFile(pkgAcquire *fetcher)
 {
    string descr("Changelog for ");
    descr+=name();
 
-   pkgCache::VerIterator Ver = availableVersionIter();
-   std::string uri = pkgAcqChangelog::URI(Ver);
+   std::string uri = getChangelogURI();
    
    // no need to translate this, the changelog is in english anyway
    string filename = RTmpDir()+"/tmp_cl";
@@ -1004,15 +1081,21 @@ string RPackage::getChangelogFile(pkgAcquire *fetcher)
    return filename;
 }
 
+const RPackageFile *RPackage::candidateFile()
+{
+   pkgDepCache::StateCache & State = (*_depcache)[*_package];
+   if (State.CandidateVer == 0)
+      return NULL;
+   pkgCache::VerFileIterator VF = State.CandidateVerIter(*_depcache).FileList();
+   if (VF.end())
+      return NULL;
+   return &_lister->getPackageFile(VF->File);
+}
+
 string RPackage::getCandidateOriginStr()
 {
-   pkgCache::VerIterator Ver = (*_depcache)[*_package].CandidateVerIter(*_depcache);
-   if(Ver.end())
-      return "";
-   pkgCache::VerFileIterator VF = Ver.FileList();
-   if(!VF.end() && VF.File() && VF.File().Origin())
-      return VF.File().Origin();
-   return "";
+   const RPackageFile *File = candidateFile();
+   return File != NULL ? File->origin : "";
 }
 
 vector<string> RPackage::getCandidateOriginSuites()
@@ -1024,8 +1107,9 @@ vector<string> RPackage::getCandidateOriginSuites()
    pkgCache::VerFileIterator VF = Ver.FileList();
    for ( ; !VF.end(); VF++)
    {
-      if(VF.File() && VF.File().Archive())
-         res.push_back(string(VF.File().Archive()));
+      const RPackageFile &File = _lister->getPackageFile(VF->File);
+      if(File.hasArchive)
+         res.push_back(File.archive);
    }
 
    return res;
@@ -1040,13 +1124,32 @@ vector<string> RPackage::getCandidateOriginSiteUrls()
    pkgCache::VerFileIterator VF = Ver.FileList();
    for ( ; !VF.end(); VF++)
    {
-      if(VF.File() && VF.File().Site())
-         res.push_back(string(VF.File().Site()));
+      const RPackageFile &File = _lister->getPackageFile(VF->File);
+      if(File.hasSite)
+         res.push_back(File.site);
    }
    return res;
 }
 
 
+void RPackage::flagsChanged()
+{
+   if (_lister != NULL)
+      _lister->bumpFlagsGeneration();
+}
+
+void RPackage::setNew(bool flag)
+{
+   _boolFlags = flag ? (_boolFlags | FNew) : (_boolFlags & ~FNew);
+   flagsChanged();
+}
+
+void RPackage::setOrphaned(bool flag)
+{
+   _boolFlags = flag ? (_boolFlags | FOrphaned) : (_boolFlags & ~FOrphaned);
+   flagsChanged();
+}
+
 void RPackage::setPinned(bool flag)
 {
    FILE *out;
@@ -1055,6 +1158,7 @@ void RPackage::setPinned(bool flag)
    string File =RStateDir() + "/preferences";
 
    _boolFlags = flag ? (_boolFlags | FPinned) : (_boolFlags & FPinned);
+   flagsChanged();
 
    if (flag) {
       // pkg already in pin-file
@@ -1108,36 +1212,37 @@ void RPackage::setPinned(bool flag)
 }
 
 
-// FIXME: this function is broken right now (and it never really wasn't :/
-#if 0
+// true if nothing installed but this package needs pkg, neither by name
+// nor through what its installed version provides
 bool RPackage::isShallowDependency(RPackage *pkg)
 {
-   pkgCache::DepIterator rdepI;
+   pkgCache &cache = *_package->Cache();
+   const RDependencyIndex &index = _lister->getDependencyIndex();
+   unsigned int self = (*_package)->ID;
+   unsigned int id = (*pkg->_package)->ID;
 
-   // check whether someone else depends on a virtual pkg of this
-   for (int i = -1; i < (int)pkg->_virtualPackages.size(); i++) {
-      if (i < 0) {
-         rdepI = pkg->_package->RevDependsList();
-      } else {
-         pkgCache::PkgIterator it = pkg->_virtualPackages[i];
-         rdepI = it.RevDependsList();
-      }
+   vector<unsigned int> names(1, id);
+   pkgCache::VerIterator Cur = pkg->_package->CurrentVer();
+   if (Cur.end() == false) {
+      for (const RDependencyIndex::Edge &e : index.provides(Cur->ID))
+         names.push_back(e.pkg);
+   }
 
-      while (!rdepI.end()) {
+   for (unsigned int i = 0; i < names.size(); i++) {
+      for (const RDependencyIndex::Edge &e : index.reverseDepends(names[i])) {
+         if (e.pkg == self || e.pkg == id)
+            continue;
 
-         // check whether the dependant is installed
-         if (rdepI.ParentPkg().CurrentVer().end()) {    // not installed
-            // XXX check whether its marked for install
-            rdepI++;
+         // only what the installed version of the dependant asks for
+         pkgCache::DepIterator D = RDependencyIndex::dependency(cache, e);
+         pkgCache::PkgIterator Parent = D.ParentPkg();
+         if (Parent->CurrentVer == 0 ||
+             D.ParentVer().operator->() != Parent.CurrentVer().operator->())
             continue;
-         }
-         // check whether the dependant isn't the own package
-         if (rdepI.ParentPkg() == *_package) {
-            rdepI++;
+         // XXX check whether its marked for install
+
+         if (D.IsNegative() || !_depcache->IsImportantDep(D))
             continue;
-         }
-         // XXX should check for dependencies that depend on
-         // dependencies of the same package
 
          return false;
       }
@@ -1145,14 +1250,15 @@ bool RPackage::isShallowDependency(RPackage *pkg)
 
    return true;
 }
-#endif
 
 
 // format: first version, second archives
-vector<pair<string, string> > RPackage::getAvailableVersions()
+const vector<pair<string, string> > &RPackage::getAvailableVersions()
 {
-   string VerTag;
-   vector<pair<string, string> > versions;
+   // the versions and their files only change with the cache
+   if (_versionsListed)
+      return _versions;
+   _versionsListed = true;
 
    // Get available Versions.
    for (pkgCache::VerIterator Ver = _package->VersionList();
@@ -1164,15 +1270,20 @@ vector<pair<string, string> > RPackage::getAvailableVersions()
          pkgCache::PkgFileIterator File = VF.File();
 
          if (File.Archive() != 0)
-            versions.push_back(pair < string,
-                               string > (Ver.VerStr(), File.Archive()));
+            _versions.push_back(pair < string,
+                                string > (Ver.VerStr(), File.Archive()));
          else
-            versions.push_back(pair < string,
-                               string > (Ver.VerStr(), File.Site()));
+            _versions.push_back(pair < string,
+                                string > (Ver.VerStr(), File.Site()));
       }
    }
 
-   return versions;
+   return _versions;
+}
+
+unsigned int RPackage::availableVersionCount()
+{
+   return getAvailableVersions().size();
 }
 
 
@@ -1185,6 +1296,8 @@ bool RPackage::setVersion(string verTag)
       return false;
 
    _depcache->SetCandidateVersion(Ver);
+   _lister->invalidateStateFlags();
+   _lister->bumpCacheGeneration();
 
    string archive;
    for (pkgCache::VerFileIterator VF = Ver.FileList();
@@ -1201,6 +1314,7 @@ bool RPackage::setVersion(string verTag)
    }
 
    _boolFlags |= FOverrideVersion;
+   flagsChanged();
 
    return true;
 }
@@ -1210,6 +1324,7 @@ void RPackage::unsetVersion()
    //cout << "set version to " << _defaultCandVer << endl;
    setVersion(_defaultCandVer);
    _boolFlags &= ~FOverrideVersion;
+   flagsChanged();
 }
 
 vector<string> RPackage::provides()
@@ -1236,39 +1351,30 @@ void RPackage::setRemoveWithDeps(bool shallow, bool purge)
 {
    setRemove();
 
-   // remove packages that this one depends on, including this
-   pkgCache::DepIterator deps = _package->VersionList().DependsList();
-   pkgCache::DepIterator start, end;
-
-   deps.GlobOr(start, end);
+   pkgCache &cache = *_package->Cache();
+   const RDependencyIndex &index = _lister->getDependencyIndex();
 
-   while (1) {
-      if (start == end) {
-         deps++;
-         if (deps.end())
-            break;
-         deps.GlobOr(start, end);
-      } else {
-         start++;
-      }
+   // remove packages that the installed version depends on, every
+   // alternative of an or group included
+   pkgCache::VerIterator Ver = _package->CurrentVer();
+   if (Ver.end())
+      Ver = _package->VersionList();
+   if (Ver.end())
+      return;
 
-      if (!_depcache->IsImportantDep(start))
+   for (const RDependencyIndex::Edge &e : index.depends(Ver->ID)) {
+      pkgCache::DepIterator D = RDependencyIndex::dependency(cache, e);
+      if (D.IsNegative() || !_depcache->IsImportantDep(D))
          continue;
 
-
-      pkgCache::PkgIterator depPkg = start.TargetPkg();
-
       // get the real package, in case this is a virtual pkg
-      // mvo: does this actually work :) ?
-      if (depPkg->VersionList == 0) {
-         if (depPkg->ProvidesList != 0) {
-            depPkg = depPkg.ProvidesList().OwnerPkg();
-         } else {
+      RPackage *depackage = _lister->getPackageById(e.pkg);
+      if (!depackage) {
+         RDependencyIndex::Edges providers = index.providers(e.pkg);
+         if (providers.empty())
             continue;
-         }
+         depackage = _lister->getPackageById(providers.begin()->pkg);
       }
-
-      RPackage *depackage = _lister->getPackage(depPkg);
       //cout << "testing(RPackage): " << depackage->name() << endl;
 
       if (!depackage)
@@ -1280,9 +1386,9 @@ void RPackage::setRemoveWithDeps(bool shallow, bool purge)
 
       // skip dependencies that are dependants of other packages
       // if shallow=true
-      /*if (shallow && !isShallowDependency(depackage)) {
+      if (shallow && !isShallowDependency(depackage))
          continue;
-      }*/
+
       // set this package for removal
       depackage->setRemove(purge);
    }
@@ -1432,22 +1538,9 @@ string RPackage::component()
       src_section="main";
    res = src_section;
 #else
-   pkgCache::VerIterator Ver;
-   pkgDepCache::StateCache & State = (*_depcache)[*_package];
-   if (State.CandidateVer == 0) {
-      //cout << "CanidateVer == 0" << endl;
-      return "";
-   }
-   Ver = State.CandidateVerIter(*_depcache);
-   pkgCache::VerFileIterator VF = Ver.FileList();
-   pkgCache::PkgFileIterator File = VF.File();
-
-   if(File.Component() == NULL) {
-      //cout << "File.Component() == NULL" << endl;
-      return "";
-   }
-
-   res = File.Component();
+   const RPackageFile *File = candidateFile();
+   if (File != NULL)
+      res = File->component;
 #endif
    return res;
 }
@@ -1456,46 +1549,14 @@ string RPackage::component()
 
 string RPackage::label()
 {
-   string res;
-   pkgCache::VerIterator Ver;
-   pkgDepCache::StateCache & State = (*_depcache)[*_package];
-   if (State.CandidateVer == 0) {
-      //cout << "CanidateVer == 0" << endl;
-      return "";
-   }
-   Ver = State.CandidateVerIter(*_depcache);
-   pkgCache::VerFileIterator VF = Ver.FileList();
-   pkgCache::PkgFileIterator File = VF.File();
-
-   if(File.Label() == NULL) {
-      //cout << "File.Component() == NULL" << endl;
-      return "";
-   }
-
-   res = File.Label();
-
-   return res;
+   const RPackageFile *File = candidateFile();
+   return File != NULL ? File->label : "";
 }
 
 string RPackage::origin()
 {
-   string res;
-   pkgCache::VerIterator Ver;
-   pkgDepCache::StateCache & State = (*_depcache)[*_package];
-   if (State.CandidateVer == 0) {
-      return "";
-   }
-   Ver = State.CandidateVerIter(*_depcache);
-   pkgCache::VerFileIterator VF = Ver.FileList();
-   pkgCache::PkgFileIterator File = VF.File();
-
-   if(File.Origin() == NULL) {
-      return "";
-   }
-
-   res = File.Origin();
-
-   return res;
+   const RPackageFile *File = candidateFile();
+   return File != NULL ? File->origin : "";
 }
 
 static pkgCache::PkgFileIterator
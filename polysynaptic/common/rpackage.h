@@ -36,6 +36,7 @@
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/acquire.h>
 #include "rconfiguration.h"
+#include "rrecordbatch.h"
 #include "i18n.h"
 
 using namespace std;
@@ -79,6 +80,23 @@ typedef struct  {
    bool isOr;                   // or dependency (with next pkg)
 } DepInformation;
 
+// the release fields of one package file, resolved once per cache open
+// (see RPackageLister::getPackageFile()); a site or archive may be set
+// and still be empty
+struct RPackageFile {
+   string origin;
+   string label;
+   string component;
+   string site;
+   string archive;
+   bool hasSite;
+   bool hasArchive;
+   // whether the index file it comes from is signed by a trusted key
+   bool trusted;
+
+   RPackageFile() : hasSite(false), hasArchive(false), trusted(false) {}
+};
+
 
 class RPackage {
 
@@ -90,17 +108,29 @@ class RPackage {
    string fullname;
    pkgRecords *_records;
    pkgDepCache *_depcache;
+   // _package points at _iter; kept as a pointer for package()
+   pkgCache::PkgIterator _iter;
    pkgCache::PkgIterator *_package;
 
    // save the default candidate version to undo version selection
    string _defaultCandVer;
 
+   // getAvailableVersions(), once _versionsListed
+   vector<pair<string, string> > _versions;
+   bool _versionsListed;
+
    bool _notify;
 
-   // Virtual pkgs provided by this one.
-   // FIXME: broken right now
-   //bool isShallowDependency(RPackage *pkg);
+   // whether only this package needs pkg, see setRemoveWithDeps()
+   bool isShallowDependency(RPackage *pkg);
    int _boolFlags;
+   // _boolFlags or the candidate changed, see getFlagsGeneration()
+   void flagsChanged();
+
+   // the record of a version or of its description, parsed once and
+   // kept in the lister's RRecordCache
+   RRecordCache::RecordPtr record(pkgCache::VerFileIterator file);
+   RRecordCache::RecordPtr record(pkgCache::DescFileIterator file);
 
  public:
 
@@ -148,22 +178,28 @@ class RPackage {
    const char *summary();
    const char *description();
    const char *installedFiles();
+   // installedFiles() in two steps: find the file list here, read it
+   // with readInstalledFiles(), which is safe to run on any thread
+   string installedFilesPath();
+   static string readInstalledFiles(const string &path);
 
    string arch();
 
-   // package is also available for the native architecture
-   // (note that packages installed are never considered a duplicate
-   bool isMultiArchDuplicate();
-
    // get changelog file from the debian server
    string getChangelogFile(pkgAcquire *fetcher);
    // get screenshot file from the debian server
    string getScreenshotFile(pkgAcquire *fetcher, bool thumb = true);
+   // where the two above download from
+   string getChangelogURI();
+   string getScreenshotURI(bool thumb = true);
 
    vector<string> provides();
 
-   // get all available versions (version, release)
-   vector<pair<string, string> > getAvailableVersions();
+   // get all available versions (version, release), listed once
+   // per cache open
+   const vector<pair<string, string> > &getAvailableVersions();
+   // getAvailableVersions().size(), without the list after the first
+   unsigned int availableVersionCount();
 
    // get origins url of the package (e.g. http://security.ubuntu.com)
    vector<string> getCandidateOriginSiteUrls();
@@ -171,6 +207,9 @@ class RPackage {
    vector<string> getCandidateOriginSuites();
    // get origin "origin" release header (e.g. Ubuntu,
    string getCandidateOriginStr();
+   // the first package file of the candidate version, NULL if there
+   // is no candidate
+   const RPackageFile *candidateFile();
 
    // get the release file for the givel origin label string
    string getReleaseFileForOrigin(string label, string release);
@@ -197,6 +236,14 @@ class RPackage {
    // get the raw package record
    string getRawRecord(bool useCandidateVersion=true);
 
+   // handle(i, record) with the candidate record of every pkgs[i], or
+   // with the record of its translated description, all read in one
+   // RRecordBatch; handle runs on several threads at once
+   static void readRecords(const vector<RPackage *> &pkgs, bool descriptions,
+                           const RRecordBatch::Handler &handle);
+   // a description field as description() shows it; main thread only
+   static string formatDescription(const string &descr);
+
    // sourcepkg
    const char *srcPackage();
 
@@ -217,6 +264,10 @@ class RPackage {
 
    int getFlags();
 
+   // flags derived from the depcache state alone, without the cache
+   // kept by the lister (see RPackageLister::getStateFlags())
+   int computeStateFlags();
+
    bool wouldBreak();
 
    bool isTrusted();
@@ -228,12 +279,8 @@ class RPackage {
 
    void setPinned(bool flag);
 
-   void setNew(bool flag = true) {
-      _boolFlags = flag ? (_boolFlags | FNew) : (_boolFlags & ~FNew);
-   }
-   void setOrphaned(bool flag = true) {
-      _boolFlags = flag ? (_boolFlags | FOrphaned) : (_boolFlags & ~FOrphaned);
-   }
+   void setNew(bool flag = true);
+   void setOrphaned(bool flag = true);
 
    // set/unset the auto-installed flag
    void setAuto(bool flag = true);
@@ -252,8 +299,10 @@ class RPackage {
             pkgRecords *records, pkgCache::PkgIterator &pkg);
    ~RPackage();
 
-   private:
-   string getChangelogURI();
+   // point a package kept across a cache reopen at the new cache;
+   // resets everything the constructor would have computed
+   void rebind(pkgDepCache *depcache, pkgRecords *records,
+               pkgCache::PkgIterator &pkg);
 };
 
 
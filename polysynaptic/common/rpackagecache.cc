@@ -25,10 +25,16 @@
 
 #include "rpackagecache.h"
 #include "rconfiguration.h"
+#include "startupprofile.h"
 #include "i18n.h"
 
 #include <assert.h>
 #include <algorithm>
+#include <future>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/sourcelist.h>
 #include <apt-pkg/pkgcachegen.h>
@@ -53,8 +59,6 @@ bool RPackageCache::open(OpProgress *progress, bool locking)
    if (ReadPinFile(*cache.GetPolicy(), RStateDir() + "/preferences") == false)
       return false;
 
-   _trust_cache.clear();
-
    //progress.Done();
    if (_error->PendingError())
       return false;
@@ -66,6 +70,75 @@ bool RPackageCache::open(OpProgress *progress, bool locking)
    return true;
 }
 
+// readahead() in slices, so one call never holds the thread for long
+static const off_t PREFETCH_SLICE = 4 << 20;
+
+static void prefetchFile(const string &path, off_t size)
+{
+   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      return;
+#ifdef __linux__
+   for (off_t offset = 0; offset < size; offset += PREFETCH_SLICE)
+      readahead(fd, offset, PREFETCH_SLICE);
+#else
+   posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+#endif
+   close(fd);
+}
+
+static void prefetchFiles(vector<string> paths, unsigned long long budget)
+{
+   PolySynaptic::ScopedStartupPhase phase("prefetch");
+
+   for (unsigned int i = 0; i < paths.size(); i++) {
+      struct stat st;
+      if (stat(paths[i].c_str(), &st) != 0)
+         continue;
+
+      if (S_ISDIR(st.st_mode)) {
+         DIR *dir = opendir(paths[i].c_str());
+         if (dir == NULL)
+            continue;
+         vector<string> files;
+         struct dirent *entry;
+         while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.')
+               files.push_back(paths[i] + "/" + entry->d_name);
+         }
+         closedir(dir);
+         // the directory's files come next, before the other paths
+         sort(files.begin(), files.end());
+         paths.insert(paths.begin() + i + 1, files.begin(), files.end());
+         continue;
+      }
+
+      if (!S_ISREG(st.st_mode) || (unsigned long long)st.st_size > budget)
+         continue;
+      budget -= st.st_size;
+      prefetchFile(paths[i], st.st_size);
+   }
+}
+
+// waited for when the program exits, should it still be reading
+static std::future<void> _prefetching;
+
+void RPackageCache::prefetch(const vector<string> &extraPaths)
+{
+   if (!_config->FindB("Synaptic::PrefetchCacheFiles", true) ||
+       _prefetching.valid())
+      return;
+
+   vector<string> paths;
+   paths.push_back(_config->FindFile("Dir::Cache::pkgcache"));
+   paths.push_back(_config->FindFile("Dir::Cache::srcpkgcache"));
+   paths.insert(paths.end(), extraPaths.begin(), extraPaths.end());
+
+   unsigned long long budget =
+      (unsigned long long)_config->FindI("Synaptic::PrefetchLimitMB", 256) << 20;
+   _prefetching = std::async(std::launch::async, prefetchFiles, paths, budget);
+}
+
 vector<string> RPackageCache::getPolicyArchives(bool filenames_only=false)
 {
    //std::cout << "RPackageCache::getPolicyComponents() " << std::endl;
@@ -41,8 +41,6 @@ class pkgCache;
 
 class RPackageCache {
    pkgCacheFile cache;
-   // speed up IsTrusted()
-   std::map<pkgCache::PkgFileIterator, pkgIndexFile*> _trust_cache;
 
    bool _locked;
 
@@ -53,12 +51,21 @@ class RPackageCache {
    inline pkgSourceList *list() {
       return cache.GetSourceList();
    }
-   inline std::map<pkgCache::PkgFileIterator, pkgIndexFile*>& trust_cache() {
-      return _trust_cache;
+   inline pkgPolicy *policy() {
+      return cache.GetPolicy();
    }
 
    bool open(OpProgress *progress, bool lock=true);
 
+   // read pkgcache.bin, srcpkgcache.bin and the files in extraPaths
+   // (a directory stands for the files in it) into the page cache on a
+   // worker thread, so open() and the first searches do not fault them
+   // in a page at a time off a cold disk. Meant for as soon as the
+   // configuration is read; returns at once, and does nothing when
+   // Synaptic::PrefetchCacheFiles is false. Files are taken in order
+   // while they fit in Synaptic::PrefetchLimitMB.
+   static void prefetch(const std::vector<std::string> &extraPaths);
+
    std::vector<std::string> getPolicyArchives(bool filenames_only);
 
    bool lock();
@@ -55,6 +55,7 @@ const char *RPatternPackageFilter::TypeName[] = {
    N_("ReverseDepends"),
    N_("Origin"),
    N_("Component"),
+   N_("Files"),
    NULL
 };
 
@@ -144,7 +145,7 @@ bool RSectionPackageFilter::read(Configuration &conf, string key)
 }
 
 
-bool RPatternPackageFilter::filterName(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterName(const Pattern &pat, RPackage *pkg)
 {
    bool found=true;
 
@@ -165,7 +166,7 @@ bool RPatternPackageFilter::filterName(Pattern pat, RPackage *pkg)
 }
 
 
-bool RPatternPackageFilter::filterVersion(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterVersion(const Pattern &pat, RPackage *pkg)
 {
    bool found = true;
 
@@ -187,7 +188,7 @@ bool RPatternPackageFilter::filterVersion(Pattern pat, RPackage *pkg)
    return found;
 }
 
-bool RPatternPackageFilter::filterDescription(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterDescription(const Pattern &pat, RPackage *pkg)
 {
    bool found=true;
    const char *s1 = pkg->summary();
@@ -205,7 +206,7 @@ bool RPatternPackageFilter::filterDescription(Pattern pat, RPackage *pkg)
    return found;
 }
 
-bool RPatternPackageFilter::filterMaintainer(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterMaintainer(const Pattern &pat, RPackage *pkg)
 {
    bool found=true;
    const char *maint = pkg->maintainer();
@@ -219,7 +220,7 @@ bool RPatternPackageFilter::filterMaintainer(Pattern pat, RPackage *pkg)
    return found;
 }
 
-bool RPatternPackageFilter::filterDepends(Pattern pat, RPackage *pkg,
+bool RPatternPackageFilter::filterDepends(const Pattern &pat, RPackage *pkg,
 					  pkgCache::Dep::DepType filterType)
 {
    vector<DepInformation> deps = pkg->enumDeps();
@@ -238,7 +239,7 @@ bool RPatternPackageFilter::filterDepends(Pattern pat, RPackage *pkg,
    return false;
 }
 
-bool RPatternPackageFilter::filterProvides(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterProvides(const Pattern &pat, RPackage *pkg)
 {
    bool found = false;
    vector<string> provides = pkg->provides();
@@ -275,22 +276,33 @@ bool RPatternPackageFilter::filterWeakDepends(Pattern pat, RPackage *pkg)
 }
 #endif
 
-bool RPatternPackageFilter::filterRDepends(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterRDepends(Pattern &pat, RPackage *pkg)
 {
-   vector<DepInformation> deps = pkg->enumRDeps();
-
    if (pat.regexps.size() == 0) {
       return true;
    }
-   
-   for(unsigned int i=0;i<deps.size();i++) {
-      if (regexec(pat.regexps[0], deps[i].name, 0, NULL, 0) == 0) {
-	 return true;
+
+   // scan the dependants' ids instead of enumRDeps(), a package
+   // depended on by many others then costs one regexec per distinct
+   // dependant for the whole filter run, and cache records are only
+   // touched for ids not seen before
+   const RDependencyIndex &index = pkg->_lister->getDependencyIndex();
+   for (const RDependencyIndex::Edge &e :
+        index.reverseDepends((*pkg->package())->ID)) {
+      unsigned int id = e.pkg;
+      if (!pat.checked.contains(id)) {
+         pat.checked.insert(id);
+         pkgCache::PkgIterator Parent =
+            index.package(*pkg->package()->Cache(), id);
+         if (regexec(pat.regexps[0], Parent.Name(), 0, NULL, 0) == 0)
+            pat.matched.insert(id);
       }
+      if (pat.matched.contains(id))
+	 return true;
    }
    return false;
 }
-bool RPatternPackageFilter::filterOrigin(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterOrigin(const Pattern &pat, RPackage *pkg)
 {
    bool found = false;
    vector<string>origins = pkg->getCandidateOriginSiteUrls();
@@ -311,7 +323,7 @@ bool RPatternPackageFilter::filterOrigin(Pattern pat, RPackage *pkg)
    return found;
 }
 
-bool RPatternPackageFilter::filterComponent(Pattern pat, RPackage *pkg)
+bool RPatternPackageFilter::filterComponent(const Pattern &pat, RPackage *pkg)
 {
    bool found = false;
    string origin;
@@ -328,23 +340,129 @@ bool RPatternPackageFilter::filterComponent(Pattern pat, RPackage *pkg)
    return found;
 }
 
+static bool matchAllRegexps(const char *path, void *data)
+{
+   const vector<regex_t *> &regexps = *(const vector<regex_t *> *)data;
+   for (unsigned int i = 0; i < regexps.size(); i++)
+      if (regexec(regexps[i], path, 0, NULL, 0) != 0)
+         return false;
+   return true;
+}
+
+bool RPatternPackageFilter::filterFiles(Pattern &pat, RPackage *pkg)
+{
+   if (pat.regexps.size() == 0)
+      return true;
+
+   if (!pat.ownersKnown) {
+      pkg->_lister->fileIndex()->ownersWhere(matchAllRegexps,
+                                             (void *)&pat.regexps,
+                                             pat.owners);
+      pat.ownersKnown = true;
+   }
+   // foreign architecture lists are called <name>:<arch>.list
+   return pat.owners.find(pkg->name()) != pat.owners.end() ||
+          pat.owners.find(string(pkg->name()) + ":" + pkg->arch()) !=
+          pat.owners.end();
+}
+
+// rough cost of testing one package against each pattern type: name
+// and version are in the cache, origin and component walk the version
+// files, maintainer and description read the package records and the
+// dependency types enumerate dependency lists
+static int patternCost(RPatternPackageFilter::DepType where)
+{
+   switch(where) {
+   case RPatternPackageFilter::Name:
+      return 0;
+   case RPatternPackageFilter::Version:
+      return 1;
+   case RPatternPackageFilter::Component:
+   case RPatternPackageFilter::Origin:
+      return 2;
+   case RPatternPackageFilter::Maintainer:
+   case RPatternPackageFilter::Description:
+      return 3;
+   case RPatternPackageFilter::Provides:
+      return 4;
+   case RPatternPackageFilter::RDepends:
+   case RPatternPackageFilter::Files:
+      return 6;
+   default:
+      return 5;
+   }
+}
+
+struct patternCostLess {
+   const vector<int> &_costs;
+   patternCostLess(const vector<int> &costs) : _costs(costs) {}
+   bool operator() (unsigned int x, unsigned int y) const {
+      return _costs[x] < _costs[y];
+   }
+};
+
+void RPatternPackageFilter::compile()
+{
+   vector<int> costs(_patterns.size());
+   _plan.resize(_patterns.size());
+   for (unsigned int i = 0; i < _patterns.size(); i++) {
+      costs[i] = patternCost(_patterns[i].where);
+      _plan[i] = i;
+   }
+   // AND and OR don't care about the order, so test the cheap
+   // patterns first and stop as soon as the outcome is known
+   stable_sort(_plan.begin(), _plan.end(), patternCostLess(costs));
+   forget();
+}
+
+void RPatternPackageFilter::forget()
+{
+   _generation = 0;
+   _known.clear();
+   _results.clear();
+   for (unsigned int i = 0; i < _patterns.size(); i++) {
+      _patterns[i].checked.clear();
+      _patterns[i].matched.clear();
+      _patterns[i].ownersKnown = false;
+      _patterns[i].owners.clear();
+   }
+}
+
 bool RPatternPackageFilter::filter(RPackage *pkg)
+{
+   if (_patterns.size() == 0)
+      return true;
+
+   // patterns only look at the cache, so a result stays good until
+   // the cache is reopened or a candidate version is changed
+   unsigned long generation = pkg->_lister->getCacheGeneration();
+   if (generation != _generation) {
+      forget();
+      _generation = generation;
+   }
+
+   unsigned int id = (*pkg->package())->ID;
+   if (_known.contains(id))
+      return _results.contains(id);
+
+   bool found = evaluate(pkg);
+   _known.insert(id);
+   if (found)
+      _results.insert(id);
+   return found;
+}
+
+bool RPatternPackageFilter::evaluate(RPackage *pkg)
 {
    bool found;
    //   bool and_mode = _config->FindB("Synaptic::Filters::andMode", true);
    bool globalfound = and_mode;
-   bool useregexp = _config->FindB("Synaptic::UseRegexp", false);
 
    bool debug = _config->FindB("Debug::Synaptic::Filters", false);
 
-   if (_patterns.size() == 0)
-      return true;
-
-   for (vector<Pattern>::const_iterator iter = _patterns.begin();
-        iter != _patterns.end(); iter++) {
-      
-      Pattern pat = (*iter);
-      switch(iter->where) {
+   for (unsigned int i = 0; i < _plan.size(); i++) {
+      Pattern &pat = _patterns[_plan[i]];
+      switch(pat.where) {
       case Name:
 	 found = filterName(pat, pkg);
 	 break;
@@ -384,6 +502,9 @@ bool RPatternPackageFilter::filter(RPackage *pkg)
       case Component:
 	 found = filterComponent(pat, pkg);
 	 break;
+      case Files:
+	 found = filterFiles(pat, pkg);
+	 break;
       default:
 	 cerr << "unknown pattern package filter (shouldn't happen) " << endl;
       }
@@ -395,7 +516,7 @@ bool RPatternPackageFilter::filter(RPackage *pkg)
       // each filter is applied in AND fasion
       // that means a include depends "mono" and include name "sharp"
       // results in all packages that depends on "mono" AND have sharp in name
-      if (iter->exclusive) {
+      if (pat.exclusive) {
          found = !found;
       }
 
@@ -403,6 +524,10 @@ bool RPatternPackageFilter::filter(RPackage *pkg)
 	 globalfound &= found;
       else
 	 globalfound |= found;
+
+      // the remaining patterns can't change the outcome
+      if (globalfound != and_mode)
+	 break;
    }
 
    return globalfound;
@@ -417,6 +542,7 @@ void RPatternPackageFilter::addPattern(DepType type, string pattern,
    pat.where = type;
    pat.pattern = pattern;
    pat.exclusive = exclusive;
+   pat.ownersKnown = false;
 
    // compile the regexps
    string S;
@@ -440,6 +566,7 @@ void RPatternPackageFilter::addPattern(DepType type, string pattern,
    pat.regexps = regexps;
 
    _patterns.push_back(pat);
+   compile();
 }
 
 
@@ -502,6 +629,7 @@ bool RPatternPackageFilter::read(Configuration &conf, string key)
 
 // copy constructor
 RPatternPackageFilter::RPatternPackageFilter(RPatternPackageFilter &f)
+   : _generation(0)
 {
    //cout << "RPatternPackageFilter(&RPatternPackageFilter f)" << endl;
    for (unsigned int i = 0; i < f._patterns.size(); i++) {
@@ -522,6 +650,7 @@ void RPatternPackageFilter::clear()
    }
 
    _patterns.erase(_patterns.begin(), _patterns.end());
+   compile();
 }
 
 
@@ -636,19 +765,16 @@ bool RStatusPackageFilter::filter(RPackage *pkg)
    if (_status & NowPolicyBroken) {
       if (!(flags & RPackage::FInstalled))
       {
-	 pkgCache::DepIterator D;
-	 bool inOr = false;
 	 // FIXME: or-dependencies are not considered properly
-	 for (D = pkg->package()->RevDependsList(); D.end() == false; D++)
-	 {	    
-	    if ((D->CompareOp & pkgCache::Dep::Or) == pkgCache::Dep::Or)
-	       inOr = true;
-	    else
-	       inOr = false;
-	    pkgCache::PkgIterator parent = D.ParentPkg();
+	 const RDependencyIndex &index = pkg->_lister->getDependencyIndex();
+	 for (const RDependencyIndex::Edge &e :
+	      index.reverseDepends((*pkg->package())->ID))
+	 {
+	    pkgCache::PkgIterator parent =
+	       index.package(*pkg->package()->Cache(), e.pkg);
 	    if(parent->CurrentVer != 0)
 	    {
-	       RPackage *p = pkg->_lister->getPackage(parent);
+	       RPackage *p = pkg->_lister->getPackageById(e.pkg);
 	       if(p != NULL)
 		  if(p->getFlags() & RPackage::FNowPolicyBroken)
 		     return true;
@@ -114,7 +114,8 @@ class RPatternPackageFilter : public RPackageFilter {
       Suggests,
       RDepends,                  // reverse depends
       Origin,                   // package origin (like security.debian.org)
-      Component                   // package component (e.g. main)
+      Component,                  // package component (e.g. main)
+      Files                       // installed files (dpkg file lists)
    } DepType;
 
 
@@ -124,27 +125,49 @@ class RPatternPackageFilter : public RPackageFilter {
       string pattern;
       bool exclusive;
         vector<regex_t *> regexps;
+      // RDepends only: which reverse dependencies (by package id)
+      // were looked at and matched, so every one is tested only once
+      RPackageSet checked;
+      RPackageSet matched;
+      // Files only: the owners of the paths matching every regexp,
+      // looked up in the file index once per cache generation
+      bool ownersKnown;
+      set<string> owners;
    };
    vector<Pattern> _patterns;
 
    bool and_mode; // patterns are applied in "AND" mode if true, "OR" if false
 
-   inline bool filterName(Pattern pat, RPackage *pkg);
-   inline bool filterVersion(Pattern pat, RPackage *pkg);
-   inline bool filterDescription(Pattern pat, RPackage *pkg);
-   inline bool filterMaintainer(Pattern pat, RPackage *pkg);
-   inline bool filterDepends(Pattern pat, RPackage *pkg,
+   // indexes into _patterns, cheapest test first
+   vector<unsigned int> _plan;
+   void compile();
+
+   // the results of filter() for the cache generation they were
+   // computed in (see RPackageLister::getCacheGeneration())
+   unsigned long _generation;
+   RPackageSet _known;
+   RPackageSet _results;
+   void forget();
+
+   bool evaluate(RPackage *pkg);
+
+   inline bool filterName(const Pattern &pat, RPackage *pkg);
+   inline bool filterVersion(const Pattern &pat, RPackage *pkg);
+   inline bool filterDescription(const Pattern &pat, RPackage *pkg);
+   inline bool filterMaintainer(const Pattern &pat, RPackage *pkg);
+   inline bool filterDepends(const Pattern &pat, RPackage *pkg,
 			     pkgCache::Dep::DepType filterType);
-   inline bool filterProvides(Pattern pat, RPackage *pkg);
-   inline bool filterRDepends(Pattern pat, RPackage *pkg);
-   inline bool filterOrigin(Pattern pat, RPackage *pkg);
-   inline bool filterComponent(Pattern pat, RPackage *pkg);
+   inline bool filterProvides(const Pattern &pat, RPackage *pkg);
+   inline bool filterRDepends(Pattern &pat, RPackage *pkg);
+   inline bool filterOrigin(const Pattern &pat, RPackage *pkg);
+   inline bool filterComponent(const Pattern &pat, RPackage *pkg);
+   inline bool filterFiles(Pattern &pat, RPackage *pkg);
 
  public:
 
    static const char *TypeName[];
 
-   RPatternPackageFilter() : and_mode(true) {}
+   RPatternPackageFilter() : and_mode(true), _generation(0) {}
    RPatternPackageFilter(RPatternPackageFilter &f);
    virtual ~RPatternPackageFilter();
 
@@ -162,7 +185,7 @@ class RPatternPackageFilter : public RPackageFilter {
    }
    void clear();
    bool getAndMode() { return and_mode; }
-   void setAndMode(bool b) { and_mode=b; }
+   void setAndMode(bool b) { and_mode=b; forget(); }
 
    virtual bool filter(RPackage *pkg);
    virtual bool read(Configuration &conf, string key);
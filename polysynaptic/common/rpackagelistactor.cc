@@ -12,22 +12,51 @@
 
 void RPackageListActor::notifyPostFilteredChange()
 {
-   vector<RPackage *> removedList;
-   vector<RPackage *> insertedList;
+   RPackageListChange change;
 
    const vector<RPackage *> &currentList = _lister->getViewPackages();
 
-   removedList = _lastDisplayList;
+   // diff by package id instead of searching one list for every
+   // entry of the other; the position of every old package is kept
+   // to find its old flags
+   vector<int> lastIndex(_lister->packagesSize(), -1);
+   for (unsigned int i = 0; i < _lastDisplayList.size(); i++) {
+      unsigned int id = (*_lastDisplayList[i]->package())->ID;
+      if (id >= lastIndex.size())
+         lastIndex.resize(id + 1, -1);
+      lastIndex[id] = i;
+   }
 
-   vector<RPackage *>::iterator I;
+   RPackageSet current;
    for (unsigned int i = 0; i < currentList.size(); i++) {
-      I = find(removedList.begin(), removedList.end(), currentList[i]);
-      if (I != removedList.end())
-	 removedList.erase(I);
-      else
-         insertedList.push_back(currentList[i]);
+      RPackage *pkg = currentList[i];
+      unsigned int id = (*pkg->package())->ID;
+      current.insert(id);
+      if (id >= lastIndex.size() || lastIndex[id] == -1) {
+         change.added.push_back(pkg);
+         continue;
+      }
+      int before = _lastDisplayFlags[lastIndex[id]];
+      int after = pkg->getFlags();
+      if (before != after) {
+         RPackageListChange::FlagChange flags = { pkg, before, after };
+         change.changed.push_back(flags);
+      }
+   }
+   for (unsigned int i = 0; i < _lastDisplayList.size(); i++) {
+      if (!current.contains((*_lastDisplayList[i]->package())->ID))
+	 change.removed.push_back(_lastDisplayList[i]);
    }
 
+   if (change.empty() == false)
+      run(change);
+}
+
+void RPackageListActor::run(const RPackageListChange &change)
+{
+   vector<RPackage *> removedList(change.removed);
+   vector<RPackage *> insertedList(change.added);
+
    if (removedList.empty() == false)
       run(removedList, PKG_REMOVED);
    if (insertedList.empty() == false)
@@ -26,6 +26,25 @@
 #include "rpackagelister.h"
 #include <iostream>
 
+// what changed in the displayed list between notifyPreFilteredChange()
+// and notifyPostFilteredChange(), so an actor does work in proportion
+// to the change rather than to the list
+struct RPackageListChange {
+   struct FlagChange {
+      RPackage *pkg;
+      int before;
+      int after;
+   };
+
+   vector<RPackage *> added;      // in the order of the new list
+   vector<RPackage *> removed;    // in the order of the old list
+   vector<FlagChange> changed;    // in both lists, with other flags
+
+   bool empty() const {
+      return added.empty() && removed.empty() && changed.empty();
+   }
+};
+
 class RPackageListActor : public RPackageObserver {
 
    public:
@@ -39,11 +58,17 @@ class RPackageListActor : public RPackageObserver {
 
    RPackageLister *_lister;
    vector<RPackage *> _lastDisplayList;
+   // flags of _lastDisplayList, in the same order
+   vector<int> _lastDisplayFlags;
 
    public:
 
    virtual void run(vector<RPackage *> &List, int listEvent) = 0;
 
+   // called once per change that is not empty; the default hands the
+   // removed and then the added packages to run()
+   virtual void run(const RPackageListChange &change);
+
    virtual void notifyPreFilteredChange() {
       updateState();
    }
@@ -52,7 +77,10 @@ class RPackageListActor : public RPackageObserver {
    virtual void notifyChange(RPackage *pkg) {}
 
    virtual void updateState() {
-      _lastDisplayList = _lister->getPackages();
+      _lastDisplayList = _lister->getViewPackages();
+      _lastDisplayFlags.resize(_lastDisplayList.size());
+      for (unsigned int i = 0; i < _lastDisplayList.size(); i++)
+         _lastDisplayFlags[i] = _lastDisplayList[i]->getFlags();
    }
 
    RPackageListActor(RPackageLister *lister)
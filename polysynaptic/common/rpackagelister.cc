@@ -31,12 +31,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <map>
+#include <set>
 #include <sstream>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
+#include <locale.h>
 #include <algorithm>
+#ifndef HAVE_RPM
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#endif
 
 #include "rpackagelister.h"
 #include "rpackagecache.h"
@@ -45,6 +54,12 @@
 #include "raptoptions.h"
 #include "rinstallprogress.h"
 #include "rcacheactor.h"
+#include "rsortcmp.h"
+#include "rparallel.h"
+#include "rhistoryindex.h"
+#include "cacheretention.h"
+#include "startupprofile.h"
+#include "metrics.h"
 
 #include <apt-pkg/error.h>
 #include <apt-pkg/progress.h>
@@ -59,6 +74,7 @@
 #include <apt-pkg/upgrade.h>
 
 #include <apt-pkg/sourcelist.h>
+#include <apt-pkg/indexfile.h>
 #include <apt-pkg/pkgsystem.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/hashes.h>
@@ -84,7 +100,7 @@ using namespace std;
 RPackageLister::RPackageLister()
    : _records(0), _progMeter(new OpProgress)
 #ifdef HAVE_XAPIAN
-   , _xapianDatabase(0)
+   , _xapianDatabase(0), _xapianParser(0), _xapianEnquire(0)
 #endif
 {
    _cache = new RPackageCache();
@@ -92,8 +108,34 @@ RPackageLister::RPackageLister()
    _searchData.pattern = NULL;
    _searchData.isRegex = false;
    _viewMode = _config->FindI("Synaptic::ViewMode", 0);
+#ifdef HAVE_XAPIAN
+   _xapianResults.setCapacity(_config->FindI("Synaptic::SearchCacheSize", 16));
+#endif
    _updating = true;
+   _indexesChanged = true;
+   _fetchStop = false;
+#ifndef HAVE_RPM
+   _undoPending = false;
+#endif
+   _cacheGeneration = 1;
+   _flagsGeneration = 1;
+   _stateFlagsSize = 0;
+   _summary.generation = 0;
+   _downloadGeneration = 0;
+   _detailed.generation = 0;
+   _brokenGeneration = 0;
+   _viewGeneration = 0;
+   _viewFromSearch = false;
+   _staleView = NULL;
+   _viewBuiltFor = NULL;
+   _markBatchDepth = 0;
+   _markGroup = NULL;
+   _markBatchChangedAll = false;
+   _sweepGuard = NULL;
+   _rootSet = NULL;
+   _autoRemoveDirty = false;
    _sortMode = LIST_SORT_DEFAULT;
+   _multiArchGroups = false;
 
    // keep order in sync with rpackageview.h 
    _views.push_back(new RPackageViewSections(_nativeArchPackages));
@@ -106,7 +148,10 @@ RPackageLister::RPackageLister()
    // its import that we use "_packages" here instead of _nativeArchPackages
    _views.push_back(new RPackageViewArchitecture(_packages));
 #ifdef HAVE_XAPIAN
-   openXapianIndex();
+   _xapianOpening = std::async(std::launch::async, []() {
+      PolySynaptic::ScopedStartupPhase phase("xapian");
+      return openXapianDatabase();
+   });
 #endif
 
    if (_viewMode >= _views.size())
@@ -117,6 +162,37 @@ RPackageLister::RPackageLister()
 
    _pkgStatus.init();
 
+   // the arena only; the package data itself lives in the mapped cache
+   _memoryAccount.assign("package objects",
+      [this](PolySynaptic::MemoryUsage &usage) {
+         usage.bytes = _packageArena.reservedBytes() +
+                       _packages.capacity() * sizeof(RPackage *);
+         usage.items = _packageArena.size();
+      });
+#ifdef HAVE_XAPIAN
+   // Xapian's own memory is its page-cached database, which it does not
+   // report; what is accounted are the result lists kept here
+   _xapianMemoryAccount.assign("xapian results",
+      [this](PolySynaptic::MemoryUsage &usage) {
+         lock_guard<recursive_mutex> lock(_xapianMutex);
+         for (RSearchCache<xapianResult>::const_iterator I =
+                 _xapianResults.begin(); I != _xapianResults.end(); I++) {
+            usage.bytes += I->second.hits.capacity() * sizeof(xapianHit);
+            usage.items++;
+         }
+         usage.bytes += _xapianPackages.capacity() * sizeof(RPackage *);
+      },
+      [this]() {
+         lock_guard<recursive_mutex> lock(_xapianMutex);
+         uint64_t freed = 0;
+         for (RSearchCache<xapianResult>::const_iterator I =
+                 _xapianResults.begin(); I != _xapianResults.end(); I++)
+            freed += I->second.hits.capacity() * sizeof(xapianHit);
+         _xapianResults.clear();
+         return freed;
+      });
+#endif
+
    cleanCommitLog();
 #if 0
    string Recommends = _config->Find("Synaptic::RecommendsFile",
@@ -128,11 +204,21 @@ RPackageLister::RPackageLister()
 
 RPackageLister::~RPackageLister()
 {
+   waitForCacheClean();
+   std::unique_lock<std::mutex> noFetch = stopArchiveFetch();
+
    for (vector<RCacheActor *>::iterator I = _actors.begin();
         I != _actors.end(); I++)
       delete(*I);
 
+   releaseAutoRemovable();
    delete _cache;
+#ifdef HAVE_XAPIAN
+   adoptXapianIndex();
+   delete _xapianEnquire;
+   delete _xapianParser;
+   delete _xapianDatabase;
+#endif
 }
 
 void RPackageLister::setView(unsigned int index)
@@ -157,23 +243,35 @@ vector<string> RPackageLister::getViews()
 
 vector<string> RPackageLister::getSubViews()
 {
+   refreshStaleView();
    return _selectedView->getSubViews();
 }
 
+void RPackageLister::refreshStaleView()
+{
+   if (_staleView != NULL)
+      _staleView->refresh();
+   _staleView = NULL;
+}
+
 bool RPackageLister::setSubView(string newSubView)
 {
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "RPackageLister::setSubView(): newSubView '%s'\n", 
 	       newSubView.size() > 0 ? newSubView.c_str() : "(empty)");
 
+   refreshStaleView();
+
    if(newSubView.empty())
       _selectedView->showAll();
    else
       _selectedView->setSelected(newSubView);
 
-   notifyChange(NULL);
+   // only what is shown changed, the filter results are still good
+   notifyPreChange(NULL);
+   notifyViewChange(NULL);
 
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "/RPackageLister::setSubView(): newSubView '%s'\n", 
 	       newSubView.size() > 0 ? newSubView.c_str() : "(empty)");
 
@@ -192,8 +290,46 @@ static string getServerErrorMessage(string errm)
    return msg;
 }
 
+int RPackageLister::getStateFlags(RPackage *pkg)
+{
+   unsigned int id = (*pkg->package())->ID;
+   if (id >= _stateFlagsSize)
+      return pkg->computeStateFlags();
+
+   // two threads computing the same package store the same value
+   int flags = _stateFlags[id].load(memory_order_relaxed);
+   if (flags < 0) {
+      flags = pkg->computeStateFlags();
+      _stateFlags[id].store(flags, memory_order_relaxed);
+   }
+   return flags;
+}
+
+void RPackageLister::invalidateStateFlags()
+{
+   _autoRemoveDirty = true;
+   // a single mark may change the state of many other packages
+   for (unsigned int i = 0; i < _stateFlagsSize; i++)
+      _stateFlags[i].store(-1, memory_order_relaxed);
+   bumpFlagsGeneration();
+}
+
+const string &RPackageLister::getBrokenReason(RPackage *pkg)
+{
+   if (_brokenGeneration != _flagsGeneration) {
+      _brokenReasons.clear();
+      _brokenGeneration = _flagsGeneration;
+   }
+   unsigned long id = (*pkg->package())->ID;
+   map<unsigned long, string>::iterator it = _brokenReasons.find(id);
+   if (it == _brokenReasons.end())
+      it = _brokenReasons.insert(make_pair(id, pkg->showWhyInstBroken())).first;
+   return it->second;
+}
+
 void RPackageLister::notifyPreChange(RPackage *pkg)
 {
+   invalidateStateFlags();
    for (vector<RPackageObserver *>::const_iterator I =
         _packageObservers.begin(); I != _packageObservers.end(); I++) {
       (*I)->notifyPreFilteredChange();
@@ -202,12 +338,37 @@ void RPackageLister::notifyPreChange(RPackage *pkg)
 
 void RPackageLister::notifyPostChange(RPackage *pkg)
 {
-   if(_config->FindB("Debug::Synaptic::View",false))
+   _filterView->bumpGeneration();
+
+   // marks usually change a handful of packages; patch the view for
+   // those instead of rebuilding it
+   invalidateStateFlags();
+   if (_updating || !updateViewPackages()) {
+      notifyViewChange(pkg);
+      return;
+   }
+
+   if(RSettings().debugView)
+      ioprintf(clog, "RPackageLister::notifyPostChange(): '%s' (in place)\n",
+	       pkg == NULL ? "NULL" : pkg->name());
+
+   notifyPackageObservers(pkg);
+}
+
+void RPackageLister::notifyViewChange(RPackage *pkg)
+{
+   if(RSettings().debugView)
       ioprintf(clog, "RPackageLister::notifyPostChange(): '%s'\n",
 	       pkg == NULL ? "NULL" : pkg->name());
 
+   invalidateStateFlags();
    reapplyFilter();
 
+   notifyPackageObservers(pkg);
+}
+
+void RPackageLister::notifyPackageObservers(RPackage *pkg)
+{
    for (vector<RPackageObserver *>::const_iterator I =
         _packageObservers.begin(); I != _packageObservers.end(); I++) {
       (*I)->notifyPostFilteredChange();
@@ -223,10 +384,74 @@ void RPackageLister::notifyPostChange(RPackage *pkg)
 
 void RPackageLister::notifyChange(RPackage *pkg)
 {
+   if (_markBatchDepth > 0) {
+      if (pkg == NULL)
+         _markBatchChangedAll = true;
+      else
+         _markBatchChanged.insert(pkg);
+      return;
+   }
+
    notifyPreChange(pkg);
    notifyPostChange(pkg);
 }
 
+void RPackageLister::beginMarkBatch()
+{
+   if (_markBatchDepth++ > 0)
+      return;
+   if (_cacheValid && _cache->deps() != NULL)
+      _markGroup = new pkgDepCache::ActionGroup(*_cache->deps());
+}
+
+void RPackageLister::deferResolve(RPackage *pkg, bool remove)
+{
+   _markBatchResolve[pkg] = remove;
+}
+
+void RPackageLister::endMarkBatch()
+{
+   if (--_markBatchDepth > 0)
+      return;
+
+   if (!_markBatchResolve.empty() && _cacheValid) {
+      pkgDepCache &Cache = *_cache->deps();
+      bool resolve = Cache.BrokenCount() > 0;
+
+      // what each package's own mark would have resolved, all at once
+      pkgProblemResolver Fix(&Cache);
+      for (map<RPackage *, bool>::const_iterator I =
+           _markBatchResolve.begin(); I != _markBatchResolve.end(); I++) {
+         pkgCache::PkgIterator Pkg = *I->first->package();
+         Fix.Clear(Pkg);
+         Fix.Protect(Pkg);
+         if (I->second)
+            Fix.Remove(Pkg);
+         else if (!Cache[Pkg].Install())
+            resolve = true;
+      }
+      if (resolve)
+         Fix.Resolve(true);
+   }
+   _markBatchResolve.clear();
+
+   // releasing the group runs the auto-removal sweep, unless
+   // _sweepGuard holds one too
+   delete _markGroup;
+   _markGroup = NULL;
+   invalidateStateFlags();
+
+   bool all = _markBatchChangedAll;
+   set<RPackage *> changed;
+   changed.swap(_markBatchChanged);
+   _markBatchChangedAll = false;
+
+   if (all || changed.size() > 1)
+      notifyChange(NULL);
+   else if (changed.size() == 1)
+      notifyChange(*changed.begin());
+}
+
 void RPackageLister::unregisterObserver(RPackageObserver *observer)
 {
 
@@ -246,6 +471,10 @@ void RPackageLister::notifyCacheOpen()
 {
    undoStack.clear();
    redoStack.clear();
+#ifndef HAVE_RPM
+   _undoBase.clear();
+   _undoPending = false;
+#endif
    for (vector<RCacheObserver *>::const_iterator I =
         _cacheObservers.begin(); I != _cacheObservers.end(); I++) {
       (*I)->notifyCacheOpen();
@@ -255,6 +484,7 @@ void RPackageLister::notifyCacheOpen()
 
 void RPackageLister::notifyCachePreChange()
 {
+   invalidateStateFlags();
    for (vector<RCacheObserver *>::const_iterator I =
         _cacheObservers.begin(); I != _cacheObservers.end(); I++) {
       (*I)->notifyCachePreChange();
@@ -263,6 +493,8 @@ void RPackageLister::notifyCachePreChange()
 
 void RPackageLister::notifyCachePostChange()
 {
+   invalidateStateFlags();
+   _filterView->bumpGeneration();
    for (vector<RCacheObserver *>::const_iterator I =
         _cacheObservers.begin(); I != _cacheObservers.end(); I++) {
       (*I)->notifyCachePostChange();
@@ -302,18 +534,33 @@ bool RPackageLister::upgradable()
 bool RPackageLister::openCache()
 {
    static bool firstRun = true;
+   PolySynaptic::ScopedSpan span("openCache", "lister");
 
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       clog << "RPackageLister::openCache()" << endl;
 
    // Flush old errors
    _error->Discard();
 
+   // a fetch ahead reads the cache open() unmaps
+   std::unique_lock<std::mutex> noFetch = stopArchiveFetch();
+
    // only lock if we run as root
    bool lock = true;
    if(getuid() != 0)
       lock = false;
 
+   // index the packages of the previous cache by name, so the ones
+   // still there get rebound instead of reallocated; the names have
+   // to be read before open() unmaps the old cache
+   map<string, RPackage *> previous;
+   for (vector<RPackage *>::iterator I = _packages.begin();
+        I != _packages.end(); I++)
+      previous[(*I)->name()] = *I;
+
+   // the guard belongs to the depcache open() replaces
+   releaseAutoRemovable();
+
    if (!_cache->open(_progMeter,lock)) {
       _progMeter->Done();
       _cacheValid = false;
@@ -322,6 +569,7 @@ bool RPackageLister::openCache()
    _progMeter->Done();
 
    pkgDepCache *deps = _cache->deps();
+   bumpCacheGeneration();
 
    // Apply corrections for half-installed packages
    if (pkgApplyStatus(*deps) == false) {
@@ -339,6 +587,8 @@ bool RPackageLister::openCache()
    if (_records)
       delete _records;
    _records = new pkgRecords(*deps);
+   _recordCache.clear();
+   _brokenReasons.clear();
 
    if (_error->PendingError()) {
       _cacheValid = false;
@@ -346,19 +596,37 @@ bool RPackageLister::openCache()
                              "Please report."), 3);
    }
 
-   for (vector<RPackage *>::iterator I = _packages.begin();
-        I != _packages.end(); I++)
-      delete (*I);
+   _depIndex.build(deps->GetCache());
+   indexPackageFiles(deps->GetCache());
+   rebuildAutoRemovable();
 
    int packageCount = deps->Head().PackageCount;
+   // the first open gets all packages into one block; later ones
+   // mostly rebind and fill the slots of the packages that went away
+   if (_packageArena.size() == 0)
+      _packageArena.reserve(packageCount);
    _packages.clear();
    _packages.reserve(packageCount);
-
    _nativeArchPackages.clear();
-   _nativeArchPackages.reserve(packageCount);
 
    _packagesIndex.clear();
    _packagesIndex.resize(packageCount, -1);
+   _nameIndex.clear();
+   _archGroupOf.clear();
+   _archGroupOf.reserve(packageCount);
+   _otherArch.clear();
+   _otherArch.reserve(packageCount);
+
+   // the package a bare name means, by apt group: looked up once per
+   // name instead of once per architecture of it
+   unsigned int groupCount = deps->Head().GroupCount;
+   vector<int> groupChoice(groupCount, -1);
+
+   _stateFlags.reset(new atomic<int>[packageCount]);
+   _stateFlagsSize = packageCount;
+   for (unsigned int i = 0; i < _stateFlagsSize; i++)
+      _stateFlags[i].store(-1, memory_order_relaxed);
+   bumpFlagsGeneration();
 
    string pkgName;
    int count = 0;
@@ -367,11 +635,17 @@ bool RPackageLister::openCache()
 
    _installedCount = 0;
 
-   map<string, RPackage *> pkgmap;
    set<string> sectionSet;
 
    for (unsigned int i = 0; i != _views.size(); i++)
       _views[i]->clear();
+   _filterView->bumpGeneration();
+   _staleView = NULL;
+#ifdef HAVE_XAPIAN
+   // the cached hits point to the packages we are about to replace
+   _xapianResults.clear();
+   _xapianPackages.clear();
+#endif
 
    pkgCache::PkgIterator I;
    for (I = deps->PkgBegin(); I.end() != true; I++) {
@@ -381,29 +655,50 @@ bool RPackageLister::openCache()
       else if (I->VersionList == 0)
          continue; // Exclude virtual packages.
 
-      RPackage *pkg = new RPackage(this, deps, _records, I);
+      RPackage *pkg;
+#ifdef WITH_APT_MULTIARCH_SUPPORT
+      map<string, RPackage *>::iterator P = previous.find(I.FullName(true));
+#else
+      map<string, RPackage *>::iterator P = previous.find(I.Name());
+#endif
+      if (P != previous.end()) {
+         pkg = P->second;
+         pkg->rebind(deps, _records, I);
+         previous.erase(P);
+      } else {
+         pkg = _packageArena.create(this, deps, _records, I);
+      }
       _packagesIndex[I->ID] = count;
       _packages.push_back(pkg);
       count++;
 
-      // this is what is feed to the views
-      if (showAllMultiArch || !pkg->isMultiArchDuplicate())
-         _nativeArchPackages.push_back(pkg);
+      // a bare name means the arch FindPkg() would choose
+      pkgCache::GrpIterator group = I.Group();
+      int &choice = groupChoice[group->ID];
+      if (choice < 0) {
+         pkgCache::PkgIterator chosen = group.FindPkg();
+         choice = chosen.end() ? I->ID : chosen->ID;
+      }
+      _archGroupOf.push_back(group->ID);
+      _otherArch.push_back(choice != (int)I->ID);
 
       pkgName = pkg->name();
 
-      pkgmap[pkgName] = pkg;
+#ifdef WITH_APT_MULTIARCH_SUPPORT
+      if (!_otherArch.back())
+#endif
+         _nameIndex.add(count - 1, pkg->name());
 
       // Find out about new packages.
       if (firstRun) {
-         packageNames.insert(pkgName);
+         packageNames.add(pkgName.c_str());
 	 // check for saved-new status
 	 if (_roptions->getPackageNew(pkgName.c_str()))
 	    pkg->setNew(true);
-      } else if (packageNames.find(pkgName) == packageNames.end()) {
+      } else if (!packageNames.seen(pkgName.c_str())) {
          pkg->setNew();
          _roptions->setPackageNew(pkgName.c_str());
-         packageNames.insert(pkgName);
+         packageNames.add(pkgName.c_str());
       } else  if (_roptions->getPackageNew(pkgName.c_str())) {
 	 pkg->setNew(true);
       }
@@ -418,15 +713,44 @@ bool RPackageLister::openCache()
       }
    }
 
-   // refresh the views
-   for (unsigned int i = 0; i != _views.size(); i++)
-      _views[i]->refresh();
+#ifdef WITH_APT_MULTIARCH_SUPPORT
+   for (unsigned int i = 0; i < _packages.size(); i++) {
+      if (_otherArch[i])
+         _nameIndex.add(i, _packages[i]->name());
+   }
+#endif
+   _nameIndex.finish();
+
+   groupArchitectures(groupCount);
+   // this is what is feed to the views
+   collectNativeArchPackages(showAllMultiArch);
+   packageNames.finish();
+
+   // whatever is left is gone from the new cache
+   for (map<string, RPackage *>::iterator P = previous.begin();
+        P != previous.end(); P++)
+      _packageArena.destroy(P->second);
+   PolySynaptic::StartupProfile::instance().mark("cache");
+
+   refreshViews();
+
+   // a commit changes the dpkg file lists, and the next search or
+   // filter over files picks up the ones that changed
+   vector<RFileIndex::ExportDir> exports;
+   RFileIndex::ExportDir snapBin = {"/snap/bin", "snap:", '.'};
+   RFileIndex::ExportDir flatpakBin = {"/var/lib/flatpak/exports/bin",
+                                       "flatpak:", 0};
+   exports.push_back(snapBin);
+   exports.push_back(flatpakBin);
+   _fileIndex.configure(flNotFile(_config->FindFile("Dir::State::status")) +
+                        "info", exports, RStateDir() + "/fileindex.bin");
 
    applyInitialSelection();
 
    _updating = false;
 
    reapplyFilter();
+   PolySynaptic::StartupProfile::instance().mark("views");
 
    // mvo: put it here for now
    notifyCacheOpen();
@@ -437,6 +761,184 @@ bool RPackageLister::openCache()
    return true;
 }
 
+// the depcache as RAutoRemoveTracker sees it: the versions to be
+// installed, and the dependencies apt's MarkRequired() follows
+class RDepCacheGraph : public RAutoRemoveTracker::Graph {
+ public:
+   RDepCacheGraph(pkgDepCache &deps, const RDependencyIndex &index,
+                  pkgDepCache::InRootSetFunc *rootSet)
+      : _deps(deps), _cache(deps.GetCache()), _index(index), _rootSet(rootSet),
+        _recommends(_config->FindB("APT::AutoRemove::RecommendsImportant", true)),
+        _suggests(_config->FindB("APT::AutoRemove::SuggestsImportant", true))
+   {
+   }
+
+   unsigned int size() { return _cache.HeaderP->PackageCount; }
+
+   uint64_t state(unsigned int id) {
+      pkgDepCache::StateCache &S = _deps[_index.package(_cache, id)];
+      pkgCache::VerIterator V = S.InstVerIter(_deps);
+      uint64_t state = V.end() ? 0 : V->ID + 1;
+      if (S.Flags & pkgCache::Flag::Auto)
+         state |= 1ULL << 32;
+      if (S.Install())
+         state |= 1ULL << 33;
+      if (S.Delete())
+         state |= 1ULL << 34;
+      return state;
+   }
+
+   bool isInstalled(unsigned int id) {
+      pkgCache::PkgIterator P = _index.package(_cache, id);
+      pkgDepCache::StateCache &S = _deps[P];
+      return (P->CurrentVer != 0 || S.Install()) && !S.Delete();
+   }
+
+   bool isRoot(unsigned int id) {
+      pkgCache::PkgIterator P = _index.package(_cache, id);
+      if (!(_deps[P].Flags & pkgCache::Flag::Auto) ||
+          (P->Flags & (pkgCache::Flag::Essential | pkgCache::Flag::Important)))
+         return true;
+      // apt keeps an installed required package even when the policy
+      // would not (#583517)
+      if (P->CurrentVer != 0 &&
+          P.CurrentVer()->Priority == pkgCache::State::Required)
+         return true;
+      // APT::NeverAutoRemove, the running kernel...
+      return _rootSet != NULL && _rootSet->InRootSet(P);
+   }
+
+   void kept(unsigned int id, vector<unsigned int> &out) {
+      pkgCache::VerIterator V = installVersion(id);
+      if (V.end())
+         return;
+      for (const RDependencyIndex::Edge &e : _index.depends(V->ID)) {
+         pkgCache::DepIterator D = RDependencyIndex::dependency(_cache, e);
+         if (!follows(D))
+            continue;
+         pkgCache::VerIterator T = installVersion(e.pkg);
+         if (!T.end() && D.IsSatisfied(T))
+            out.push_back(e.pkg);
+         // like apt, every installed provider whose provides satisfies
+         // the dependency is kept, not just one
+         for (const RDependencyIndex::Edge &p : _index.providers(e.pkg)) {
+            pkgCache::VerIterator P = installVersion(p.pkg);
+            if (P.end() || P->ID != RDependencyIndex::version(_cache, p)->ID)
+               continue;
+            for (pkgCache::PrvIterator Prv = P.ProvidesList(); !Prv.end(); ++Prv) {
+               if (Prv.ParentPkg()->ID == e.pkg && D.IsSatisfied(Prv)) {
+                  out.push_back(p.pkg);
+                  break;
+               }
+            }
+         }
+      }
+   }
+
+   void keepers(unsigned int id, vector<unsigned int> &out) {
+      vector<unsigned int> names(1, id);
+      pkgCache::VerIterator V = installVersion(id);
+      if (!V.end()) {
+         for (const RDependencyIndex::Edge &e : _index.provides(V->ID))
+            names.push_back(e.pkg);
+      }
+      for (unsigned int name : names) {
+         for (const RDependencyIndex::Edge &e : _index.reverseDepends(name))
+            out.push_back(e.pkg);
+      }
+   }
+
+ private:
+   pkgDepCache &_deps;
+   pkgCache &_cache;
+   const RDependencyIndex &_index;
+   pkgDepCache::InRootSetFunc *_rootSet;
+   bool _recommends;
+   bool _suggests;
+
+   pkgCache::VerIterator installVersion(unsigned int id) {
+      return _deps[_index.package(_cache, id)].InstVerIter(_deps);
+   }
+
+   bool follows(pkgCache::DepIterator &D) {
+      switch (D->Type) {
+         case pkgCache::Dep::Depends:
+         case pkgCache::Dep::PreDepends:
+            return true;
+         case pkgCache::Dep::Recommends:
+            return _recommends;
+         case pkgCache::Dep::Suggests:
+            return _suggests;
+         default:
+            return false;
+      }
+   }
+};
+
+void RPackageLister::rebuildAutoRemovable()
+{
+   if (!_config->FindB("Synaptic::IncrementalAutoRemove", true))
+      return;
+
+   pkgDepCache *deps = _cache->deps();
+   lock_guard<std::mutex> lock(_autoRemoveMutex);
+   _sweepGuard = new pkgDepCache::ActionGroup(*deps);
+   _rootSet = deps->GetRootSetFunc();
+   RDepCacheGraph graph(*deps, _depIndex, _rootSet);
+   _autoRemove.rebuild(graph);
+   _autoRemoveDirty = false;
+}
+
+void RPackageLister::releaseAutoRemovable()
+{
+   lock_guard<std::mutex> lock(_autoRemoveMutex);
+   // apt sweeps once more as the guard goes, which the depcache being
+   // closed does not need; there is no way around it
+   delete _sweepGuard;
+   _sweepGuard = NULL;
+   delete _rootSet;
+   _rootSet = NULL;
+   _autoRemove.clear();
+}
+
+bool RPackageLister::isAutoRemovable(unsigned int id)
+{
+   pkgDepCache *deps = _cache->deps();
+   if (_sweepGuard == NULL) {
+      pkgCache::PkgIterator P = _depIndex.package(deps->GetCache(), id);
+      return (*deps)[P].Garbage;
+   }
+
+   lock_guard<std::mutex> lock(_autoRemoveMutex);
+   if (_autoRemoveDirty.exchange(false)) {
+      RDepCacheGraph graph(*deps, _depIndex, _rootSet);
+      _autoRemove.update(graph);
+      if(RSettings().debugView)
+         ioprintf(clog, "RPackageLister::isAutoRemovable(): %u packages updated\n",
+                  _autoRemove.touched());
+   }
+   return _autoRemove.isGarbage(id);
+}
+
+vector<RPackage *> RPackageLister::getAutoRemovable()
+{
+   vector<RPackage *> packages;
+   for (RPackage *pkg : _packages) {
+      if (isAutoRemovable((*pkg->package())->ID))
+         packages.push_back(pkg);
+   }
+   return packages;
+}
+
+void RPackageLister::prefetchCacheFiles()
+{
+   vector<string> extra;
+#ifdef HAVE_XAPIAN
+   extra.push_back(APT_XAPIAN_INDEX_DIR + "/index");
+#endif
+   RPackageCache::prefetch(extra);
+}
+
 #ifdef HAVE_XAPIAN
 time_t RPackageLister::xapianIndexTimestamp()
 {
@@ -450,13 +952,14 @@ bool RPackageLister::xapianIndexNeedsUpdate()
 {
    struct stat buf;
    
-   if(_config->FindB("Debug::Synaptic::Xapian",false))
+   if(RSettings().debugXapian)
       std::cerr << "xapainIndexNeedsUpdate()" << std::endl;
 
    // check the xapian index
-   if(FileExists("/usr/sbin/update-apt-xapian-index") && 
+   adoptXapianIndex();
+   if((nativeXapianIndex() || FileExists("/usr/sbin/update-apt-xapian-index")) &&
       (!_xapianDatabase )) {
-      if(_config->FindB("Debug::Synaptic::Xapian",false))
+      if(RSettings().debugXapian)
 	 std::cerr << "xapain index not build yet" << std::endl;
       return true;
    } 
@@ -465,7 +968,7 @@ bool RPackageLister::xapianIndexNeedsUpdate()
    // because we use u-a-x-i --update
    stat(_config->FindFile("Dir::Cache::pkgcache").c_str(), &buf);
    if(xapianIndexTimestamp() < buf.st_mtime) {
-      if(_config->FindB("Debug::Synaptic::Xapian",false))
+      if(RSettings().debugXapian)
 	 std::cerr << "xapian outdated " 
 		   << buf.st_mtime - xapianIndexTimestamp()  << std::endl;
       return true;
@@ -474,19 +977,190 @@ bool RPackageLister::xapianIndexNeedsUpdate()
    return false;
 }
 
-bool RPackageLister::openXapianIndex()
+bool RPackageLister::nativeXapianIndex()
+{
+   return _config->FindB("Synaptic::XapianNativeIndex", true);
+}
+
+string RPackageLister::xapianIndexDir()
+{
+   return APT_XAPIAN_INDEX_DIR;
+}
+
+void RPackageLister::xapianDocuments(vector<RXapianDocument> &documents)
+{
+   vector<RPackage *> pkgs;
+   for (RPackage *pkg : _packages) {
+      if (pkg->availableVersion() != NULL)
+         pkgs.push_back(pkg);
+   }
+
+   documents.assign(pkgs.size(), RXapianDocument());
+   vector<string> descriptions(pkgs.size());
+   // both passes read the index files in order on the worker threads;
+   // the tags are only in the package records, not the translations
+   RPackage::readRecords(pkgs, true,
+                         [&descriptions](unsigned int i, const RRecord &record) {
+      descriptions[i] = record.description();
+   });
+   RPackage::readRecords(pkgs, false,
+                         [&documents](unsigned int i, const RRecord &record) {
+      string tags = record.field("Tag");
+      size_t pos = 0;
+      while (pos < tags.size()) {
+         size_t end = tags.find(',', pos);
+         if (end == string::npos)
+            end = tags.size();
+         size_t begin = tags.find_first_not_of(" \n\t", pos);
+         if (begin < end) {
+            size_t last = tags.find_last_not_of(" \n\t", end - 1);
+            documents[i].tags.push_back(tags.substr(begin, last - begin + 1));
+         }
+         pos = end + 1;
+      }
+   });
+
+   for (unsigned int i = 0; i < pkgs.size(); i++) {
+      RXapianDocument &doc = documents[i];
+      doc.name = pkgs[i]->name();
+      doc.section = pkgs[i]->section();
+      // the first line is the summary; the markup of the rest (" ."
+      // for blank lines) is no word and needs no formatting
+      const string &descr = descriptions[i];
+      size_t eol = descr.find('\n');
+      doc.summary = descr.substr(0, eol);
+      if (eol != string::npos)
+         doc.description = descr.substr(eol + 1);
+   }
+}
+
+Xapian::Database *RPackageLister::openXapianDatabase()
 {
-   if(_xapianDatabase)
-      delete _xapianDatabase;
    try {
-      _xapianDatabase = new Xapian::Database(APT_XAPIAN_INDEX_DIR + "/index");
-   } catch (Xapian::DatabaseOpeningError) {
-      return false;
+      return new Xapian::Database(APT_XAPIAN_INDEX_DIR + "/index");
+   } catch (const Xapian::Error &) {
+      return NULL;
    };
+}
+
+void RPackageLister::adoptXapianIndex()
+{
+   if (_xapianOpening.valid())
+      installXapianIndex(_xapianOpening.get());
+}
+
+bool RPackageLister::openXapianIndex()
+{
+   adoptXapianIndex();
+   return installXapianIndex(openXapianDatabase());
+}
+
+bool RPackageLister::installXapianIndex(Xapian::Database *database)
+{
+   // open the new revision first and only then replace the old one, so
+   // a failed open (e.g. in the middle of a rebuild) keeps search working
+   if (database == NULL)
+      return false;
+
+   lock_guard<recursive_mutex> lock(_xapianMutex);
+   Xapian::Enquire *enquire = new Xapian::Enquire(*database);
+   Xapian::QueryParser *parser = new Xapian::QueryParser;
+   parser->set_database(*database);
+   parser->add_prefix("name","XP");
+   parser->add_prefix("section","XS");
+   // default op is AND to narrow down the resultset
+   parser->set_default_op( Xapian::Query::OP_AND );
+
+   // document ids and cached results belong to the old revision
+   _xapianResults.clear();
+   _xapianPackages.clear();
+   delete _xapianEnquire;
+   delete _xapianParser;
+   delete _xapianDatabase;
+   _xapianDatabase = database;
+   _xapianEnquire = enquire;
+   _xapianParser = parser;
    return true;
 }
+
+void RPackageLister::xapianMapPackages()
+{
+   Xapian::docid last = _xapianDatabase->get_lastdocid();
+   _xapianPackages.assign(last + 1, NULL);
+   for (Xapian::PostingIterator I = _xapianDatabase->postlist_begin("");
+        I != _xapianDatabase->postlist_end(""); ++I) {
+      Xapian::docid docid = *I;
+      _xapianPackages[docid] =
+         getPackage(_xapianDatabase->get_document(docid).get_data());
+   }
+}
 #endif
 
+string RPackageLister::viewSnapshotStamp()
+{
+   vector<string> files;
+   files.push_back(_config->FindFile("Dir::Cache::pkgcache"));
+   files.push_back(_config->FindFile("Dir::State::status"));
+   // a user without write access gets a cache built in memory when
+   // the lists or sources changed, with pkgcache.bin left as it was
+   files.push_back(_config->FindDir("Dir::State::lists"));
+   files.push_back(_config->FindFile("Dir::Etc::sourcelist"));
+   files.push_back(_config->FindDir("Dir::Etc::sourceparts"));
+   // pins change the candidates, and with them sections and origins
+   files.push_back(_config->FindFile("Dir::Etc::preferences"));
+   files.push_back(_config->FindDir("Dir::Etc::preferencesparts"));
+   files.push_back(RStateDir() + "/preferences");
+
+   const char *lang = setlocale(LC_MESSAGES, NULL);
+   ostringstream stamp;
+   stamp << RViewSnapshot::stampFiles(files)
+         << ";packages=" << _packages.size()
+         << ";multiarch=" << _config->FindB("Synaptic::ShowAllMultiArch", false)
+         << ";lang=" << (lang ? lang : "");
+   return stamp.str();
+}
+
+void RPackageLister::refreshViews()
+{
+   bool useSnapshot = _config->FindB("Synaptic::ViewSnapshot", true);
+   string path = RStateDir() + "/viewsnapshot.bin";
+   string stamp;
+   RViewSnapshot snapshot;
+   vector<RPackage *> byId;
+   bool changed = false;
+
+   if (useSnapshot) {
+      stamp = viewSnapshotStamp();
+      if (snapshot.load(path, stamp)) {
+         byId.resize(_packagesIndex.size(), NULL);
+         for (unsigned int i = 0; i < _packages.size(); i++)
+            byId[(*_packages[i]->package())->ID] = _packages[i];
+      }
+   }
+
+   for (unsigned int i = 0; i != _views.size(); i++) {
+      RPackageView *view = _views[i];
+      if (!useSnapshot || !view->snapshotable()) {
+         view->refresh();
+         continue;
+      }
+
+      const RViewSnapshot::SubViews *saved = snapshot.find(view->getName());
+      if (saved != NULL && view->restoreSubViews(*saved, byId))
+         continue;
+
+      view->refresh();
+      RViewSnapshot::SubViews subviews;
+      view->saveSubViews(subviews);
+      snapshot.set(view->getName(), subviews);
+      changed = true;
+   }
+
+   if (changed && !snapshot.save(path, stamp) &&
+       RSettings().debugView)
+      clog << "could not write " << path << endl;
+}
+
 void RPackageLister::applyInitialSelection()
 {
    _roptions->rereadOrphaned();
@@ -499,6 +1173,45 @@ void RPackageLister::applyInitialSelection()
    }
 }
 
+void RPackageLister::indexPackageFiles(pkgCache &cache)
+{
+   // there are only a few dozen files, but every package asks about
+   // the file of its candidate whenever it is sorted or filtered, and
+   // whether it is trusted for every summary
+#ifdef WITH_APT_AUTH
+   pkgSourceList *sources = _cache->list();
+   bool debugAuth = _config->FindB("Debug::pkgAcquire::Auth", false);
+#endif
+   _packageFiles.clear();
+   for (pkgCache::PkgFileIterator F = cache.FileBegin(); F.end() == false; F++) {
+      unsigned int offset = F.operator->() - cache.PkgFileP;
+      if (offset >= _packageFiles.size())
+         _packageFiles.resize(offset + 1);
+      RPackageFile &file = _packageFiles[offset];
+      if (F.Origin() != NULL)
+         file.origin = F.Origin();
+      if (F.Label() != NULL)
+         file.label = F.Label();
+      if (F.Component() != NULL)
+         file.component = F.Component();
+      file.hasSite = F.Site() != NULL;
+      if (file.hasSite)
+         file.site = F.Site();
+      file.hasArchive = F.Archive() != NULL;
+      if (file.hasArchive)
+         file.archive = F.Archive();
+#ifdef WITH_APT_AUTH
+      pkgIndexFile *index;
+      if (sources != NULL && sources->FindIndex(F, index)) {
+         file.trusted = index->IsTrusted();
+         if (debugAuth)
+            std::cerr << "Checking index: " << index->Describe()
+                      << "(Trusted=" << file.trusted << ")\n";
+      }
+#endif
+   }
+}
+
 RPackage *RPackageLister::getPackage(pkgCache::PkgIterator &iter)
 {
    if (iter->ID > _packagesIndex.size()) {
@@ -513,6 +1226,12 @@ RPackage *RPackageLister::getPackage(pkgCache::PkgIterator &iter)
 
 RPackage *RPackageLister::getPackage(string name)
 {
+   // arch qualified names are left to apt
+   if (name.find(':') == string::npos) {
+      int index = _nameIndex.find(name.c_str());
+      return index >= 0 ? _packages[index] : NULL;
+   }
+
    pkgCache::PkgIterator pkg = _cache->deps()->FindPkg(name);
    if (pkg.end() == false)
       return getPackage(pkg);
@@ -537,53 +1256,86 @@ bool RPackageLister::fixBroken()
    if (_cache->deps()->BrokenCount() == 0)
       return true;
 
-   if (pkgFixBroken(*_cache->deps()) == false
-       || _cache->deps()->BrokenCount() != 0)
-      return _error->Error(_("Unable to correct dependencies"));
-   if (pkgMinimizeUpgrade(*_cache->deps()) == false)
-      return _error->Error(_("Unable to mark upgrades\nCheck your system for errors."));
-
-   reapplyFilter();
-
-   return true;
+   bool res = resolve(RESOLVE_FIX_BROKEN);
+   resolved(RESOLVE_FIX_BROKEN);
+   return res;
 }
 
 
 bool RPackageLister::upgrade()
 {
-   if (APT::Upgrade::Upgrade(*_cache->deps(), APT::Upgrade::FORBID_REMOVE_PACKAGES | APT::Upgrade::FORBID_INSTALL_NEW_PACKAGES) == false) {
-      return _error->
-         Error(_("Internal Error, AllUpgrade broke stuff. Please report."));
-   }
-#ifdef WITH_LUA
-   _lua->SetDepCache(_cache->deps());
-   _lua->RunScripts("Scripts::Synaptic::Upgrade", false);
-   _lua->ResetCaches();
-#endif
+   bool res = resolve(RESOLVE_UPGRADE);
+   resolved(RESOLVE_UPGRADE);
+   return res;
+}
 
-   //reapplyFilter();
-   notifyChange(NULL);
 
-   return true;
+bool RPackageLister::distUpgrade()
+{
+   bool res = resolve(RESOLVE_DIST_UPGRADE);
+   resolved(RESOLVE_DIST_UPGRADE);
+   return res;
 }
 
 
-bool RPackageLister::distUpgrade()
+bool RPackageLister::resolve(ResolveKind kind)
 {
-   if (APT::Upgrade::Upgrade(*_cache->deps(), APT::Upgrade::ALLOW_EVERYTHING) == false) {
-      cout << _("dist upgrade Failed") << endl;
+   if (_cache->deps() == NULL)
       return false;
-   }
+
+   switch (kind) {
+   case RESOLVE_FIX_BROKEN:
+      if (_cache->deps()->BrokenCount() == 0)
+         return true;
+
+      if (pkgFixBroken(*_cache->deps()) == false
+          || _cache->deps()->BrokenCount() != 0)
+         return _error->Error(_("Unable to correct dependencies"));
+      if (pkgMinimizeUpgrade(*_cache->deps()) == false)
+         return _error->Error(_("Unable to mark upgrades\nCheck your system for errors."));
+      return true;
+
+   case RESOLVE_UPGRADE:
+      if (APT::Upgrade::Upgrade(*_cache->deps(), APT::Upgrade::FORBID_REMOVE_PACKAGES | APT::Upgrade::FORBID_INSTALL_NEW_PACKAGES) == false) {
+         return _error->
+            Error(_("Internal Error, AllUpgrade broke stuff. Please report."));
+      }
 #ifdef WITH_LUA
-   _lua->SetDepCache(_cache->deps());
-   _lua->RunScripts("Scripts::Synaptic::DistUpgrade", false);
-   _lua->ResetCaches();
+      _lua->SetDepCache(_cache->deps());
+      _lua->RunScripts("Scripts::Synaptic::Upgrade", false);
+      _lua->ResetCaches();
 #endif
+      return true;
 
-   //reapplyFilter();
-   notifyChange(NULL);
+   case RESOLVE_DIST_UPGRADE:
+      if (APT::Upgrade::Upgrade(*_cache->deps(), APT::Upgrade::ALLOW_EVERYTHING) == false) {
+         cout << _("dist upgrade Failed") << endl;
+         return false;
+      }
+#ifdef WITH_LUA
+      _lua->SetDepCache(_cache->deps());
+      _lua->RunScripts("Scripts::Synaptic::DistUpgrade", false);
+      _lua->ResetCaches();
+#endif
+      return true;
+   }
+   return false;
+}
 
-   return true;
+
+void RPackageLister::resolved(ResolveKind kind)
+{
+   if (_cache->deps() == NULL)
+      return;
+
+   // the resolver went over the depcache without telling anyone
+   invalidateStateFlags();
+   if (kind == RESOLVE_FIX_BROKEN) {
+      reapplyFilter();
+   } else {
+      //reapplyFilter();
+      notifyChange(NULL);
+   }
 }
 
 void RPackageLister::reapplyFilter()
@@ -591,99 +1343,174 @@ void RPackageLister::reapplyFilter()
    // PORTME
    if (_updating)
       return;
+   PolySynaptic::ScopedSpan span("reapplyFilter", "lister");
 
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       clog << "RPackageLister::reapplyFilter()" << endl;
 
    _selectedView->refresh();
+   if (_staleView == _selectedView)
+      _staleView = NULL;
    _viewPackages.clear();
-   _viewPackagesIndex.clear();
-   _viewPackagesIndex.resize(_packagesIndex.size(), -1);
-
-   for (RPackageView::iterator I = _selectedView->begin();
-        I != _selectedView->end(); I++) {
-      if (*I) {
-         _viewPackagesIndex[(*(*I)->package())->ID] = _viewPackages.size();
-         _viewPackages.push_back(*I);
-      }
-   }
-
+   _viewFromSearch = false;
+
+   // begin() brings the selection up to date; the packages are then
+   // read off its id set (in id order, sortPackages() orders them)
+   _selectedView->begin();
+   const RPackageSet &selected = _selectedView->getSelectedSet();
+   _viewPackages.reserve(selected.count());
+   selected.forEach([this](unsigned int id) {
+      int index = _packagesIndex[id];
+      if (index >= 0)
+         _viewPackages.push_back(_packages[index]);
+   });
 
    sortPackages(_sortMode);
+   reindexViewPackages();
+   _viewGeneration = _cacheGeneration;
+   _viewBuiltFor = _selectedView;
+
+   // the state updateViewPackages() compares against, for the views
+   // a mark can change
+   _viewFlags.clear();
+   if (_selectedView->stateDependent() || sortsByState()) {
+      _viewFlags.resize(_packagesIndex.size(), -1);
+      for (unsigned int i = 0; i < _packages.size(); i++)
+         _viewFlags[(*_packages[i]->package())->ID] = _packages[i]->getFlags();
+   }
 }
 
-static const int status_sort_magic = (  RPackage::FInstalled 
-				      | RPackage::FOutdated 
-				      | RPackage::FNew);
-struct statusSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return (x->getFlags() & (status_sort_magic))  <
-	     (y->getFlags() & (status_sort_magic));
-}};
-
-struct instSizeSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return x->installedSize() < y->installedSize();
-}};
-
-struct dlSizeSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return x->availablePackageSize() < y->availablePackageSize();
-}};
-
-struct componentSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return x->component() < y->component();
-}};
-
-struct sectionSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return std::strcmp(x->section(), y->section())<0;
-}};
-
-// version string compare
-int verstrcmp(const char *x, const char *y)
-{
-   if(x && y) 
-      return _system->VS->CmpVersion(x, y) < 0;
-   
-   // if we compare with a non-existring version
-   if(y == NULL)
-      return false;
-   return true;
+void RPackageLister::reindexViewPackages()
+{
+   _viewPackagesIndex.assign(_packagesIndex.size(), -1);
+   for (unsigned int i = 0; i < _viewPackages.size(); i++)
+      _viewPackagesIndex[(*_viewPackages[i]->package())->ID] = i;
 }
 
-struct versionSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return verstrcmp(y->availableVersion(),
-		       x->availableVersion());
-   }
-};
+bool RPackageLister::sortsByState()
+{
+   return _sortMode == LIST_SORT_STATUS_ASC ||
+          _sortMode == LIST_SORT_STATUS_DES;
+}
 
-struct instVersionSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return verstrcmp(y->installedVersion(),
-		       x->installedVersion());
-}};
+bool RPackageLister::updateViewPackages()
+{
+   bool stateSort = sortsByState();
+   bool stateView = _selectedView->stateDependent();
 
-struct supportedPartFunc {
- protected:
-   bool _ascent;
-   RPackageStatus _status;
- public:
-   supportedPartFunc(bool ascent, RPackageStatus &s) 
-      : _ascent(ascent), _status(s) {};
-   bool operator() (RPackage *x) {
-      return (_ascent==_status.isSupported(x));
+   // views built for another view mode, or before the cache or a
+   // candidate version changed, are redone from scratch
+   if (_viewBuiltFor != _selectedView || _viewGeneration != _cacheGeneration)
+      return false;
+   // neither what is shown nor its order depends on the marks
+   if (!stateSort && !stateView)
+      return true;
+   // nor are search results patched
+   if (_viewFromSearch || _viewFlags.size() != _packagesIndex.size())
+      return false;
+
+   vector<RPackage *> changed;
+   for (unsigned int i = 0; i < _packages.size(); i++) {
+      RPackage *pkg = _packages[i];
+      unsigned int id = (*pkg->package())->ID;
+      int flags = pkg->getFlags();
+      if (flags != _viewFlags[id]) {
+         _viewFlags[id] = flags;
+         changed.push_back(pkg);
+      }
+   }
+   if (changed.empty())
+      return true;
+
+   // a big change (dist-upgrade, undo) is cheaper to rebuild
+   if (changed.size() > _viewPackages.size() / 8 + 32)
+      return false;
+
+   bool reorder = stateSort;
+   bool removed = false;
+   for (unsigned int i = 0; stateView && i < changed.size(); i++) {
+      RPackage *pkg = changed[i];
+      unsigned int id = (*pkg->package())->ID;
+      bool shown = _viewPackagesIndex[id] >= 0;
+      if (_selectedView->matches(pkg) == shown)
+         continue;
+
+      // the other subviews of the view are fixed up when next asked for
+      _selectedView->updateSelected(pkg, !shown);
+      _staleView = _selectedView;
+      if (shown) {
+         _viewPackages[_viewPackagesIndex[id]] = NULL;
+         _viewPackagesIndex[id] = -1;
+         removed = true;
+      } else {
+         _viewPackagesIndex[id] = _viewPackages.size();
+         _viewPackages.push_back(pkg);
+         reorder = true;
+      }
+   }
+
+   if (removed)
+      _viewPackages.erase(remove(_viewPackages.begin(), _viewPackages.end(),
+                                 (RPackage *)NULL),
+                          _viewPackages.end());
+   if (reorder)
+      sortPackages(_sortMode);
+   if (removed || reorder)
+      reindexViewPackages();
+
+   return true;
+}
+
+static const int status_sort_magic = (  RPackage::FInstalled 
+				      | RPackage::FOutdated 
+				      | RPackage::FNew);
+
+// One entry per package with its sort key already extracted, so that
+// comparisons never go back to the depcache or the package records.
+// Strings are interned into ranks that sort like the strings.
+struct sortKey {
+   RPackage *pkg;
+   const char *name;
+   long key;
+};
+
+// packages stay ordered by name inside another sort criteria
+typedef sortLess<sortThen<sortByKey, sortByName> > sortKeyAsc;
+typedef sortLess<sortThen<sortReverse<sortByKey>, sortByName> > sortKeyDes;
+typedef sortLess<sortReverse<sortByName> > sortNameDes;
+
+struct strLess {
+   bool operator() (const string &x, const string &y) const {
+      return std::strcmp(x.c_str(), y.c_str()) < 0;
    }
 };
 
-struct nameSortFunc {
-   bool operator() (RPackage *x, RPackage *y) {
-      return std::strcmp(x->name(), y->name())<0;
-}};
+struct versionLess {
+   bool operator() (const string &x, const string &y) const {
+      return _system->VS->CmpVersion(x.c_str(), y.c_str()) < 0;
+   }
+};
 
+// Replace every string by its rank among the distinct values; values
+// the ordering considers equal share a rank. Missing values rank 0.
+template<class Less>
+static void internKeys(vector<sortKey> &keys, const vector<const char *> &values)
+{
+   typedef map<string, long, Less> rankMap;
+   rankMap ranks;
+   vector<typename rankMap::iterator> slots(values.size(), ranks.end());
+   for (unsigned int i = 0; i < values.size(); i++) {
+      if (values[i] != NULL)
+	 slots[i] = ranks.insert(make_pair(string(values[i]), 0L)).first;
+   }
 
+   long rank = 0;
+   for (typename rankMap::iterator I = ranks.begin(); I != ranks.end(); I++)
+      I->second = ++rank;
+
+   for (unsigned int i = 0; i < keys.size(); i++)
+      keys[i].key = (slots[i] != ranks.end()) ? slots[i]->second : 0;
+}
 
 void RPackageLister::sortPackages(vector<RPackage *> &packages, 
 				  listSortMode mode)
@@ -692,88 +1519,102 @@ void RPackageLister::sortPackages(vector<RPackage *> &packages,
    if (packages.empty())
       return;
 
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       clog << "RPackageLister::sortPackages(): " << packages.size() << endl;
 
-   /* Always sort by name to have packages ordered inside another sort 
-    * criteria */
-   sort(packages.begin(), packages.end(), 
-      sortFunc<nameSortFunc>(true));
+   vector<sortKey> keys(packages.size());
+   for (unsigned int i = 0; i < packages.size(); i++) {
+      keys[i].pkg = packages[i];
+      keys[i].name = packages[i]->name();
+      keys[i].key = 0;
+   }
 
+   bool ascent = true;
    switch(mode) {
+   case LIST_SORT_NAME_DES:
+      ascent = false;
    case LIST_SORT_NAME_ASC:
    case LIST_SORT_DEFAULT:
-      // Do nothing, already done
-      break;
-   case LIST_SORT_NAME_DES:
-      sort(packages.begin(), packages.end(), 
-		  sortFunc<nameSortFunc>(false));
-      break;
-   case LIST_SORT_SIZE_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<instSizeSortFunc>(true));
+      // name is the tie breaker
       break;
    case LIST_SORT_SIZE_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<instSizeSortFunc>(false));
+      ascent = false;
+   case LIST_SORT_SIZE_ASC:
+      for (unsigned int i = 0; i < keys.size(); i++)
+	 keys[i].key = keys[i].pkg->installedSize();
       break;
+   case LIST_SORT_DLSIZE_DES:
+      ascent = false;
    case LIST_SORT_DLSIZE_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<dlSizeSortFunc>(true));
+      for (unsigned int i = 0; i < keys.size(); i++)
+	 keys[i].key = keys[i].pkg->availablePackageSize();
       break;
-   case LIST_SORT_DLSIZE_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<dlSizeSortFunc>(false));
+   case LIST_SORT_SUPPORTED_DES:
+      ascent = false;
+   case LIST_SORT_SUPPORTED_ASC:
+      for (unsigned int i = 0; i < keys.size(); i++)
+	 keys[i].key = _pkgStatus.isSupported(keys[i].pkg) ? 1 : 0;
       break;
-   case LIST_SORT_COMPONENT_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<componentSortFunc>(true));
+   case LIST_SORT_STATUS_DES:
+      ascent = false;
+   case LIST_SORT_STATUS_ASC:
+      for (unsigned int i = 0; i < keys.size(); i++)
+	 keys[i].key = keys[i].pkg->getFlags() & status_sort_magic;
       break;
    case LIST_SORT_COMPONENT_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<componentSortFunc>(false));
-      break;
-   case LIST_SORT_SECTION_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<sectionSortFunc>(true));
+      ascent = false;
+   case LIST_SORT_COMPONENT_ASC: {
+      // component() returns a temporary, keep the strings alive
+      vector<string> components(keys.size());
+      vector<const char *> values(keys.size());
+      for (unsigned int i = 0; i < keys.size(); i++) {
+	 components[i] = keys[i].pkg->component();
+	 values[i] = components[i].c_str();
+      }
+      internKeys<strLess>(keys, values);
       break;
+   }
    case LIST_SORT_SECTION_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<sectionSortFunc>(false));
-      break;
-   case LIST_SORT_STATUS_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<statusSortFunc>(true));
-      break;
-   case LIST_SORT_STATUS_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<statusSortFunc>(false));
-      break;
-   case LIST_SORT_SUPPORTED_ASC:
-      stable_partition(packages.begin(), packages.end(), 
-		  supportedPartFunc(false, _pkgStatus));
-      break;
-   case LIST_SORT_SUPPORTED_DES:
-      stable_partition(packages.begin(), packages.end(), 
-		  supportedPartFunc(true, _pkgStatus));
+      ascent = false;
+   case LIST_SORT_SECTION_ASC: {
+      vector<const char *> values(keys.size());
+      for (unsigned int i = 0; i < keys.size(); i++) {
+	 const char *section = keys[i].pkg->section();
+	 values[i] = section ? section : "";
+      }
+      internKeys<strLess>(keys, values);
       break;
+   }
    case LIST_SORT_VERSION_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<versionSortFunc>(true));
-      break;
    case LIST_SORT_VERSION_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<versionSortFunc>(false));
-      break;
    case LIST_SORT_INST_VERSION_ASC:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<instVersionSortFunc>(true));
+   case LIST_SORT_INST_VERSION_DES: {
+      bool installed = (mode == LIST_SORT_INST_VERSION_ASC ||
+			mode == LIST_SORT_INST_VERSION_DES);
+      vector<const char *> values(keys.size());
+      for (unsigned int i = 0; i < keys.size(); i++)
+	 values[i] = installed ? keys[i].pkg->installedVersion()
+			       : keys[i].pkg->availableVersion();
+      internKeys<versionLess>(keys, values);
+      // "ascending" has always listed the newest version first
+      ascent = (mode == LIST_SORT_VERSION_DES ||
+		mode == LIST_SORT_INST_VERSION_DES);
       break;
-   case LIST_SORT_INST_VERSION_DES:
-      stable_sort(packages.begin(), packages.end(), 
-		  sortFunc<instVersionSortFunc>(false));
+   }
+   default:
       break;
    }
+
+   // one pass, the key and the name tie break in the same comparison
+   if (mode == LIST_SORT_NAME_DES)
+      sort(keys.begin(), keys.end(), sortNameDes());
+   else if (ascent)
+      sort(keys.begin(), keys.end(), sortKeyAsc());
+   else
+      sort(keys.begin(), keys.end(), sortKeyDes());
+
+   for (unsigned int i = 0; i < keys.size(); i++)
+      packages[i] = keys[i].pkg;
 }
 
 int RPackageLister::findPackage(const char *pattern)
@@ -806,21 +1647,27 @@ int RPackageLister::findNextPackage()
       return ++_searchData.last;
    }
 
-   int len = strlen(_searchData.pattern);
+   if (!_searchData.isRegex) {
+      // the packages with the prefix come from the name index, the
+      // first of them after the last hit is what a scan would find
+      vector<unsigned int> ids;
+      _nameIndex.withPrefix(_searchData.pattern, ids);
+      int next = -1;
+      for (unsigned int i = 0; i < ids.size(); i++) {
+         int index = getViewPackageIndex(_packages[ids[i]]);
+         if (index > _searchData.last && (next == -1 || index < next))
+            next = index;
+      }
+      if (next != -1)
+         _searchData.last = next;
+      return next;
+   }
 
    for (unsigned i = _searchData.last + 1; i < _viewPackages.size(); i++) {
-      if (_searchData.isRegex) {
-         if (regexec(&_searchData.regex, _viewPackages[i]->name(),
-                     0, NULL, 0) == 0) {
-            _searchData.last = i;
-            return i;
-         }
-      } else {
-         if (strncasecmp(_searchData.pattern, _viewPackages[i]->name(),
-                         len) == 0) {
-            _searchData.last = i;
-            return i;
-         }
+      if (regexec(&_searchData.regex, _viewPackages[i]->name(),
+                  0, NULL, 0) == 0) {
+         _searchData.last = i;
+         return i;
       }
    }
    return -1;
@@ -847,6 +1694,10 @@ void RPackageLister::getStats(int &installed, int &broken,
 void RPackageLister::getDownloadSummary(int &dlCount, double &dlSize)
 {
    dlCount = 0;
+   if (_downloadGeneration == _flagsGeneration) {
+      dlSize = _downloadSize;
+      return;
+   }
    dlSize = _cache->deps()->DebSize();
 
    pkgAcquire Fetcher;
@@ -857,6 +1708,9 @@ void RPackageLister::getDownloadSummary(int &dlCount, double &dlSize)
    }
    dlSize = Fetcher.FetchNeeded();
    delete PM;
+
+   _downloadSize = dlSize;
+   _downloadGeneration = _flagsGeneration;
 }
 
 
@@ -867,68 +1721,81 @@ void RPackageLister::getSummary(int &held, int &kept, int &essential,
 				double &sizeChange)
 {
    pkgDepCache *deps = _cache->deps();
-   unsigned i;
-
-   held = 0;
-   kept = 0;
-   essential = 0;
-   toInstall = 0;
-   toReInstall = 0;
-   toUpgrade = 0;
-   toDowngrade = 0;
-   toRemove = 0;
-   unauthenticated =0;
-
-   for (i = 0; i < _packages.size(); i++) {
-      int flags = _packages[i]->getFlags();
+   summaryCounts &c = _summary;
+
+   if (c.generation != _flagsGeneration) {
+      c.held = 0;
+      c.kept = 0;
+      c.essential = 0;
+      c.toInstall = 0;
+      c.toReInstall = 0;
+      c.toUpgrade = 0;
+      c.toDowngrade = 0;
+      c.toRemove = 0;
+      c.unauthenticated = 0;
+
+      for (unsigned i = 0; i < _packages.size(); i++) {
+         int flags = _packages[i]->getFlags();
 
-      // These flags will never be set together.
-      int status = flags & (RPackage::FKeep |
-                            RPackage::FNewInstall |
-                            RPackage::FReInstall |
-                            RPackage::FUpgrade |
-                            RPackage::FDowngrade |
-                            RPackage::FRemove);
+         // These flags will never be set together.
+         int status = flags & (RPackage::FKeep |
+                               RPackage::FNewInstall |
+                               RPackage::FReInstall |
+                               RPackage::FUpgrade |
+                               RPackage::FDowngrade |
+                               RPackage::FRemove);
 
 #ifdef WITH_APT_AUTH
-      switch(status) {
-      case RPackage::FNewInstall:
-      case RPackage::FInstall:
-      case RPackage::FReInstall:
-      case RPackage::FUpgrade:
-	 if(!_packages[i]->isTrusted()) 
-	    unauthenticated++;
-	 break;
-      }
-#endif
-
-      switch (status) {
-         case RPackage::FKeep:
-            if (flags & RPackage::FHeld)
-               held++;
-            else
-               kept++;
-            break;
+         switch(status) {
          case RPackage::FNewInstall:
-            toInstall++;
-            break;
+         case RPackage::FInstall:
          case RPackage::FReInstall:
-            toReInstall++;
-            break;
          case RPackage::FUpgrade:
-            toUpgrade++;
-            break;
-         case RPackage::FDowngrade:
-            toDowngrade++;
-            break;
-         case RPackage::FRemove:
-            if (flags & RPackage::FImportant)
-               essential++;
-            toRemove++;
-            break;
+	    if(!_packages[i]->isTrusted()) 
+	       c.unauthenticated++;
+	    break;
+         }
+#endif
+
+         switch (status) {
+            case RPackage::FKeep:
+               if (flags & RPackage::FHeld)
+                  c.held++;
+               else
+                  c.kept++;
+               break;
+            case RPackage::FNewInstall:
+               c.toInstall++;
+               break;
+            case RPackage::FReInstall:
+               c.toReInstall++;
+               break;
+            case RPackage::FUpgrade:
+               c.toUpgrade++;
+               break;
+            case RPackage::FDowngrade:
+               c.toDowngrade++;
+               break;
+            case RPackage::FRemove:
+               if (flags & RPackage::FImportant)
+                  c.essential++;
+               c.toRemove++;
+               break;
+         }
       }
+      c.generation = _flagsGeneration;
    }
 
+   held = c.held;
+   kept = c.kept;
+   essential = c.essential;
+   toInstall = c.toInstall;
+   toReInstall = c.toReInstall;
+   toUpgrade = c.toUpgrade;
+   toDowngrade = c.toDowngrade;
+   toRemove = c.toRemove;
+   unauthenticated = c.unauthenticated;
+
    sizeChange = deps->UsrSize();
 }
 
@@ -940,16 +1807,13 @@ struct bla:public binary_function<RPackage *, RPackage *, bool> {
    }
 };
 
+#ifdef HAVE_RPM
 void RPackageLister::saveUndoState(pkgState &state)
 {
    undoStack.push_front(state);
    redoStack.clear();
 
-#ifdef HAVE_RPM
    unsigned int maxStackSize = _config->FindI("Synaptic::undoStackSize", 3);
-#else
-   unsigned int maxStackSize = _config->FindI("Synaptic::undoStackSize", 20);
-#endif
    while (undoStack.size() > maxStackSize)
       undoStack.pop_back();
 }
@@ -992,6 +1856,116 @@ void RPackageLister::redo()
    redoStack.pop_front();
    restoreState(state);
 }
+#else
+// The undo stacks only keep what each action changed, so a step costs
+// a few entries instead of a copy of every package's flags, and undo
+// and redo only mark those packages, unless marking them moves others.
+void RPackageLister::saveUndoState(pkgState &state)
+{
+   // state is from before an action that is done now
+   closeUndoStep(&state);
+
+   pkgStateDelta delta;
+   diffState(state, NULL, delta);
+   pushUndoStep(delta);
+}
+
+void RPackageLister::saveUndoState()
+{
+   // an action is about to start, the step is made when it's over
+   closeUndoStep(NULL);
+   saveState(_undoBase);
+   _undoPending = true;
+}
+
+void RPackageLister::undo()
+{
+   closeUndoStep(NULL);
+   if (undoStack.empty())
+      return;
+
+   redoStack.splice(redoStack.begin(), undoStack, undoStack.begin());
+   applyStateDelta(redoStack.front(), true);
+}
+
+void RPackageLister::redo()
+{
+   closeUndoStep(NULL);
+   if (redoStack.empty())
+      return;
+
+   undoStack.splice(undoStack.begin(), redoStack, redoStack.begin());
+   applyStateDelta(undoStack.front(), false);
+}
+
+void RPackageLister::diffState(const pkgState &before, const pkgState *after,
+                               pkgStateDelta &delta)
+{
+   unsigned int count = min(before.size(), _packages.size());
+   for (unsigned int i = 0; i < count; i++) {
+      int flags = after != NULL ? (*after)[i] : _packages[i]->getFlags();
+      if (before[i] != flags) {
+         pkgStateChange change = { i, before[i], flags };
+         delta.push_back(change);
+      }
+   }
+}
+
+void RPackageLister::closeUndoStep(const pkgState *after)
+{
+   if (!_undoPending)
+      return;
+   _undoPending = false;
+
+   pkgStateDelta delta;
+   diffState(_undoBase, after, delta);
+   pkgState().swap(_undoBase);
+   pushUndoStep(delta);
+}
+
+void RPackageLister::pushUndoStep(pkgStateDelta &delta)
+{
+   // nothing changed, nothing to undo
+   if (delta.empty())
+      return;
+
+   undoStack.push_front(pkgStateDelta());
+   undoStack.front().swap(delta);
+   redoStack.clear();
+
+   unsigned int maxStackSize = _config->FindI("Synaptic::undoStackSize", 20);
+   while (undoStack.size() > maxStackSize)
+      undoStack.pop_back();
+}
+
+void RPackageLister::applyStateDelta(const pkgStateDelta &delta, bool before)
+{
+   pkgDepCache::ActionGroup group(*_cache->deps());
+
+   // the step only names what its action changed, so every other
+   // package is to stay as it is now
+   pkgState target;
+   saveState(target);
+   for (unsigned int i = 0; i < delta.size(); i++)
+      target[delta[i].index] = before ? delta[i].before : delta[i].after;
+
+   for (unsigned int i = 0; i < delta.size(); i++) {
+      RPackage *pkg = _packages[delta[i].index];
+      int flags = target[delta[i].index];
+      if (pkg->getFlags() != flags)
+         restoreFlags(pkg, flags);
+   }
+
+   // marking with auto-install may have moved packages outside the
+   // step (another alternative or provider); put those back as well
+   for (unsigned int i = 0; i < _packages.size(); i++) {
+      RPackage *pkg = _packages[i];
+      if (pkg->getFlags() != target[i])
+         restoreFlags(pkg, target[i]);
+   }
+   notifyChange(NULL);
+}
+#endif
 
 
 #ifdef HAVE_RPM
@@ -1083,32 +2057,36 @@ void RPackageLister::saveState(RPackageLister::pkgState &state)
 
 void RPackageLister::restoreState(RPackageLister::pkgState &state)
 {
-   pkgDepCache *deps = _cache->deps();
-   pkgDepCache::ActionGroup group(*deps);
+   pkgDepCache::ActionGroup group(*_cache->deps());
 
    for (unsigned i = 0; i < _packages.size(); i++) {
       RPackage *pkg = _packages[i];
-      int flags = pkg->getFlags();
-      int oldflags = state[i];
-
-      if (oldflags != flags) {
-         if (oldflags & RPackage::FReInstall) {
-            deps->MarkInstall(*(pkg->package()), true);
-            deps->SetReInstall(*(pkg->package()), false);
-         } else if (oldflags & RPackage::FInstall) {
-            deps->MarkInstall(*(pkg->package()), true);
-         } else if (oldflags & RPackage::FRemove) {
-            deps->MarkDelete(*(pkg->package()), oldflags & RPackage::FPurge);
-         } else if (oldflags & RPackage::FKeep) {
-            deps->MarkKeep(*(pkg->package()), false);
-	 }
-	 // fix the auto flag
-	 deps->MarkAuto(*pkg->package(), (oldflags & RPackage::FIsAuto));
-      }
+      if (state[i] != pkg->getFlags())
+         restoreFlags(pkg, state[i]);
    }
    notifyChange(NULL);
 }
 
+// mark pkg back the way the saved flags say
+void RPackageLister::restoreFlags(RPackage *pkg, int oldflags)
+{
+   pkgDepCache *deps = _cache->deps();
+
+   if (oldflags & RPackage::FReInstall) {
+      deps->MarkInstall(*(pkg->package()), true);
+      deps->SetReInstall(*(pkg->package()), false);
+   } else if (oldflags & RPackage::FInstall) {
+      deps->MarkInstall(*(pkg->package()), true);
+   } else if (oldflags & RPackage::FRemove) {
+      deps->MarkDelete(*(pkg->package()), oldflags & RPackage::FPurge);
+   } else if (oldflags & RPackage::FKeep) {
+      deps->MarkKeep(*(pkg->package()), false);
+   }
+   // fix the auto flag
+   deps->MarkAuto(*pkg->package(), (oldflags & RPackage::FIsAuto));
+   invalidateStateFlags();
+}
+
 
 bool RPackageLister::getStateChanges(RPackageLister::pkgState &state,
                                      vector<RPackage *> &toKeep,
@@ -1221,6 +2199,24 @@ void RPackageLister::getDetailedSummary(vector<RPackage *> &held,
                                         double &sizeChange)
 {
    pkgDepCache *deps = _cache->deps();
+   detailedSummary &d = _detailed;
+
+   if (d.generation == _flagsGeneration) {
+      held = d.held;
+      kept = d.kept;
+      essential = d.essential;
+      toInstall = d.toInstall;
+      toReInstall = d.toReInstall;
+      toUpgrade = d.toUpgrade;
+      toRemove = d.toRemove;
+      toPurge = d.toPurge;
+      toDowngrade = d.toDowngrade;
+#ifdef WITH_APT_AUTH
+      notAuthenticated = d.notAuthenticated;
+#endif
+      sizeChange = d.sizeChange;
+      return;
+   }
 
    for (unsigned int i = 0; i < _packages.size(); i++) {
       RPackage *pkg = _packages[i];
@@ -1292,17 +2288,89 @@ void RPackageLister::getDetailedSummary(vector<RPackage *> &held,
       }
    }
    delete PM;
+   d.notAuthenticated = notAuthenticated;
 #endif
    sizeChange = deps->UsrSize();
+
+   d.held = held;
+   d.kept = kept;
+   d.essential = essential;
+   d.toInstall = toInstall;
+   d.toReInstall = toReInstall;
+   d.toUpgrade = toUpgrade;
+   d.toRemove = toRemove;
+   d.toPurge = toPurge;
+   d.toDowngrade = toDowngrade;
+   d.sizeChange = sizeChange;
+   d.generation = _flagsGeneration;
 }
 
-bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error)
+void RPackageLister::precomputeSummary()
 {
-   assert(_cache->list() != NULL);
-   // Get the source list
-   //pkgSourceList List;
-   _cache->list()->ReadMainList();
+   if (!_cacheValid || _updating)
+      return;
+
+   int held, kept, essential, toInstall, toReInstall, toUpgrade;
+   int toRemove, toDowngrade, unAuthenticated, dlCount;
+   double sizeChange, dlSize;
+   getSummary(held, kept, essential, toInstall, toReInstall, toUpgrade,
+              toRemove, toDowngrade, unAuthenticated, sizeChange);
+   getDownloadSummary(dlCount, dlSize);
 
+   vector<RPackage *> heldList, keptList, essentialList;
+   vector<RPackage *> installList, reInstallList, upgradeList;
+   vector<RPackage *> removeList, purgeList, downgradeList;
+#ifdef WITH_APT_AUTH
+   vector<string> notAuthenticated;
+#endif
+   getDetailedSummary(heldList, keptList, essentialList,
+                      installList, reInstallList, upgradeList,
+                      removeList, purgeList, downgradeList,
+#ifdef WITH_APT_AUTH
+                      notAuthenticated,
+#endif
+                      sizeChange);
+}
+
+#ifndef HAVE_RPM
+// mtime and size of every index file and of the dpkg status; apt
+// leaves a list untouched when the server answers If-Modified-Since
+// with "not modified" (the IMS hits of the fetch progress) and
+// patches it in place when it applies pdiffs
+typedef map<string, pair<time_t, off_t> > indexSnapshot;
+
+static void snapshotIndexes(indexSnapshot &files)
+{
+   files.clear();
+
+   struct stat st;
+   string lists = _config->FindDir("Dir::State::Lists");
+   DIR *dir = opendir(lists.c_str());
+   if (dir != NULL) {
+      struct dirent *dent;
+      while ((dent = readdir(dir)) != NULL) {
+         string name = dent->d_name;
+         if (name == "lock" || name[0] == '.')
+            continue;
+         string file = lists + name;
+         if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            files[name] = make_pair(st.st_mtime, st.st_size);
+      }
+      closedir(dir);
+   }
+
+   string status = _config->FindFile("Dir::State::status");
+   if (stat(status.c_str(), &st) == 0)
+      files[status] = make_pair(st.st_mtime, st.st_size);
+}
+#endif
+
+static void applyFetchOptions();
+
+#ifndef HAVE_RPM
+bool RPackageLister::fetchIndexes(pkgAcquireStatus *status,
+                                  pkgSourceList &list, string &error)
+{
    // Lock the list directory
    FileFd Lock;
    if (_config->FindB("Debug::NoLocking", false) == false) {
@@ -1313,12 +2381,16 @@ bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error)
    }
 
    _updating = true;
+   _indexesChanged = true;
 
+   applyFetchOptions();
+
+   indexSnapshot before, after;
+   snapshotIndexes(before);
 
-#ifndef HAVE_RPM
 // apt-0.7.10 has the new UpdateList code in algorithms, we use it
    string s;
-   bool res = ListUpdate(*status, *_cache->list(), 5000);
+   bool res = ListUpdate(*status, list, 5000);
    if(res == false)
    {
       while(!_error->empty())
@@ -1327,8 +2399,88 @@ bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error)
 	 error += s;
       }
    }
+
+   snapshotIndexes(after);
+   _indexesChanged = (res == false || before != after);
+   // nothing to rebuild, so the current views stay valid
+   if (!_indexesChanged)
+      _updating = false;
+   return res;
+}
+#endif
+
+bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error,
+                                 const vector<string> &sources)
+{
+#ifndef HAVE_RPM
+   if (sources.empty())
+      return updateCache(status, error);
+
+   // the lines go through apt's own parser, from a file of their own
+   char file[] = "/tmp/polysynaptic-sources-XXXXXX";
+   int fd = mkstemp(file);
+   if (fd < 0)
+      return _error->Errno("mkstemp", _("Can't write %s"), file);
+   string text;
+   for (vector<string>::const_iterator it = sources.begin();
+        it != sources.end(); it++)
+      text += *it + "\n";
+   bool written = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+   close(fd);
+   pkgSourceList list;
+   bool read = written && list.Read(file);
+   unlink(file);
+   if (!read)
+      return _error->Error(_("Can't read %s"), file);
+
+   // the lists of every other source are current, not stale: keep
+   // apt from cleaning them out
+   string cleanup = _config->Find("APT::List-Cleanup");
+   string getCleanup = _config->Find("APT::Get::List-Cleanup");
+   _config->Set("APT::List-Cleanup", false);
+   _config->Set("APT::Get::List-Cleanup", false);
+   bool res = fetchIndexes(status, list, error);
+   if (cleanup.empty())
+      _config->Clear("APT::List-Cleanup");
+   else
+      _config->Set("APT::List-Cleanup", cleanup);
+   if (getCleanup.empty())
+      _config->Clear("APT::Get::List-Cleanup");
+   else
+      _config->Set("APT::Get::List-Cleanup", getCleanup);
    return res;
 #else
+   return updateCache(status, error);
+#endif
+}
+
+bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error)
+{
+   // the fetch ahead reads the source list this reads again
+   std::unique_lock<std::mutex> noFetch = stopArchiveFetch();
+
+   assert(_cache->list() != NULL);
+   // Get the source list
+   //pkgSourceList List;
+   _cache->list()->ReadMainList();
+
+#ifndef HAVE_RPM
+   return fetchIndexes(status, *_cache->list(), error);
+#else
+   // Lock the list directory
+   FileFd Lock;
+   if (_config->FindB("Debug::NoLocking", false) == false) {
+      Lock.Fd(GetLock(_config->FindDir("Dir::State::Lists") + "lock"));
+      //cout << "lock in : " << _config->FindDir("Dir::State::Lists") << endl;
+      if (_error->PendingError() == true)
+         return _error->Error(_("Unable to lock the list directory"));
+   }
+
+   _updating = true;
+   _indexesChanged = true;
+
+   applyFetchOptions();
+
    // Create the download object
    pkgAcquire Fetcher(status);
 
@@ -1344,68 +2496,379 @@ bool RPackageLister::updateCache(pkgAcquireStatus *status, string &error)
       (*I)->Finished();
       Failed = true;
    }
-   if (Failed == true)
-      _error->Warning(_("Release files for some repositories could not be "
-                        "retrieved or authenticated. Such repositories are "
-                        "being ignored."));
+   if (Failed == true)
+      _error->Warning(_("Release files for some repositories could not be "
+                        "retrieved or authenticated. Such repositories are "
+                        "being ignored."));
+
+   if (!_cache->list()->GetIndexes(&Fetcher))
+      return false;
+
+   // Run it
+   if (Fetcher.Run() == pkgAcquire::Failed)
+      return false;
+
+   //bool AuthFailed = false;
+   Failed = false;
+   string failedURI;/* = _("Some index files failed to download, they "
+			"have been ignored, or old ones used instead:\n");
+		    */
+   for (pkgAcquire::ItemIterator I = Fetcher.ItemsBegin();
+        I != Fetcher.ItemsEnd(); I++) {
+      if ((*I)->Status == pkgAcquire::Item::StatDone)
+         continue;
+      (*I)->Finished();
+      if((*I)->ErrorText.empty())
+	 failedURI += (*I)->DescURI() + "\n";
+      else
+	 failedURI += (*I)->DescURI() + ": " + (*I)->ErrorText + "\n";
+      Failed = true;
+   }
+
+   // Clean out any old list files
+   if (!Failed && _config->FindB("APT::Get::List-Cleanup", true) == true) {
+      if (Fetcher.Clean(_config->FindDir("Dir::State::lists")) == false ||
+          Fetcher.Clean(_config->FindDir("Dir::State::lists") + "partial/") ==
+          false)
+         return false;
+   }
+   if (Failed == true) {
+      //cout << failedURI << endl;
+      error = failedURI;
+      //_error->Error(failedURI.c_str());
+      return false; 
+   }
+   return true;
+#endif
+}
+
+bool RPackageLister::getDownloadUris(vector<string> &uris)
+{
+   pkgAcquire fetcher;
+   pkgPackageManager *PM = _system->CreatePM(_cache->deps());
+   if (!PM->GetArchives(&fetcher, _cache->list(), _records)) {
+      delete PM;
+      return false;
+   }
+   for (pkgAcquire::ItemIterator I = fetcher.ItemsBegin();
+	I != fetcher.ItemsEnd(); I++) {
+      uris.push_back((*I)->DescURI());
+   }
+
+   delete PM;
+   return true;
+}
+
+// Status of fetchArchives(): no interface, it only asks whether to go on
+class RFetchAheadStatus : public pkgAcquireStatus {
+   const std::function<bool()> &_cancelled;
+   const atomic<bool> &_stop;
+
+ public:
+   RFetchAheadStatus(const std::function<bool()> &cancelled,
+                     const atomic<bool> &stop)
+      : _cancelled(cancelled), _stop(stop) {}
+
+   virtual bool MediaChange(string, string) { return false; }
+   virtual bool Pulse(pkgAcquire *Owner) {
+      pkgAcquireStatus::Pulse(Owner);
+      return !_stop && !(_cancelled && _cancelled());
+   }
+};
+
+bool RPackageLister::fetchArchives(const vector<string> &names,
+                                   const std::function<bool()> &cancelled,
+                                   int kbps, string &error)
+{
+   std::unique_lock<std::mutex> guard(_fetchLock, std::try_to_lock);
+   if (!guard.owns_lock() || _cache->deps() == NULL) {
+      error = _("The package cache is in use");
+      return false;
+   }
+
+   FileFd lock;
+   if (!lockPackageCache(lock)) {
+      error = _("Unable to lock the download directory");
+      _error->Discard();
+      return false;
+   }
+
+   // the upgrades marked in a depcache of this thread's own, which
+   // only shares the mapped cache and the policy with the lister's
+   pkgDepCache deps(&_cache->deps()->GetCache(), _cache->policy());
+   if (!deps.Init(NULL)) {
+      error = _("Internal error opening cache");
+      _error->Discard();
+      return false;
+   }
+   pkgCache &cache = deps.GetCache();
+   for (vector<string>::const_iterator I = names.begin(); I != names.end(); I++) {
+      pkgCache::PkgIterator P = cache.FindPkg(*I);
+      if (!P.end() && !P.CurrentVer().end())
+         deps.MarkInstall(P, true);
+   }
+
+   pkgRecords records(deps);
+   RFetchAheadStatus status(cancelled, _fetchStop);
+   pkgAcquire fetcher(&status);
+   pkgPackageManager *PM = _system->CreatePM(&deps);
+   if (!PM->GetArchives(&fetcher, _cache->list(), &records)) {
+      delete PM;
+      error = _("Unable to find the archives to download");
+      _error->Discard();
+      return false;
+   }
+
+   // the methods read the limit when they start, so it only has to be
+   // set for this run; a commit waits for it to end
+   string httpLimit = _config->Find("Acquire::http::Dl-Limit");
+   string httpsLimit = _config->Find("Acquire::https::Dl-Limit");
+   if (kbps > 0) {
+      _config->Set("Acquire::http::Dl-Limit", kbps);
+      _config->Set("Acquire::https::Dl-Limit", kbps);
+   }
+   pkgAcquire::RunResult res = fetcher.Run();
+   if (kbps > 0) {
+      if (httpLimit.empty())
+         _config->Clear("Acquire::http::Dl-Limit");
+      else
+         _config->Set("Acquire::http::Dl-Limit", httpLimit);
+      if (httpsLimit.empty())
+         _config->Clear("Acquire::https::Dl-Limit");
+      else
+         _config->Set("Acquire::https::Dl-Limit", httpsLimit);
+   }
+
+   bool failed = res == pkgAcquire::Failed;
+   if (res == pkgAcquire::Cancelled) {
+      error = _("Download cancelled");
+      failed = true;
+   }
+   for (pkgAcquire::ItemIterator I = fetcher.ItemsBegin();
+        I != fetcher.ItemsEnd() && res != pkgAcquire::Cancelled; I++) {
+      if ((*I)->Status == pkgAcquire::Item::StatDone && (*I)->Complete)
+         continue;
+      error += (*I)->DescURI() + ": " + (*I)->ErrorText + "\n";
+      failed = true;
+   }
+   delete PM;
+   _error->Discard();
+   return !failed;
+}
+
+std::unique_lock<std::mutex> RPackageLister::stopArchiveFetch()
+{
+   _fetchStop = true;
+   std::unique_lock<std::mutex> guard(_fetchLock);
+   _fetchStop = false;
+   return guard;
+}
+
+// Synaptic::Fetch::* tune apt's download queues for updateCache() and
+// commitChanges(). apt keeps one connection per host queue, so
+// ParallelHosts bounds how many mirrors (hosts) are fetched from at
+// once, and PipelineDepth how many requests each of those connections
+// has in flight. Spreading archives over several mirrors is up to the
+// sources (e.g. apt's mirror+file: method); this only lets those hosts
+// run in parallel. Unset options leave apt's defaults alone.
+static void applyFetchOptions()
+{
+   int hosts = _config->FindI("Synaptic::Fetch::ParallelHosts", -1);
+   if (hosts >= 0) {
+      _config->Set("Acquire::Queue-Mode", "host");
+      _config->Set("Acquire::QueueHost::Limit", hosts);
+   }
+
+   int depth = _config->FindI("Synaptic::Fetch::PipelineDepth", -1);
+   if (depth >= 0) {
+      _config->Set("Acquire::http::Pipeline-Depth", depth);
+      _config->Set("Acquire::https::Pipeline-Depth", depth);
+   }
+}
+
+#ifndef HAVE_RPM
+// number of leading fetcher items (queued in unpack order) whose
+// archives are already there
+static unsigned int readyArchives(pkgAcquire &fetcher, unsigned int &total)
+{
+   unsigned int ready = 0;
+   bool gap = false;
+   total = 0;
+   for (pkgAcquire::ItemIterator I = fetcher.ItemsBegin();
+        I != fetcher.ItemsEnd(); I++) {
+      total++;
+      if (!gap && (*I)->Status == pkgAcquire::Item::StatDone && (*I)->Complete)
+         ready++;
+      else
+         gap = true;
+   }
+   return ready;
+}
 
-   if (!_cache->list()->GetIndexes(&Fetcher))
-      return false;
+// Shows the user's fetch progress for the first stage of a pipelined
+// commit, and ends that stage once the first batch of archives is in
+class RPipelineFirstStatus : public pkgAcquireStatus {
+   pkgAcquireStatus *_status;
+   unsigned int _batch;
 
-   // Run it
-   if (Fetcher.Run() == pkgAcquire::Failed)
-      return false;
+ public:
+   bool cut;
 
-   //bool AuthFailed = false;
-   Failed = false;
-   string failedURI;/* = _("Some index files failed to download, they "
-			"have been ignored, or old ones used instead:\n");
-		    */
-   for (pkgAcquire::ItemIterator I = Fetcher.ItemsBegin();
-        I != Fetcher.ItemsEnd(); I++) {
-      if ((*I)->Status == pkgAcquire::Item::StatDone)
-         continue;
-      (*I)->Finished();
-      if((*I)->ErrorText.empty())
-	 failedURI += (*I)->DescURI() + "\n";
-      else
-	 failedURI += (*I)->DescURI() + ": " + (*I)->ErrorText + "\n";
-      Failed = true;
+   RPipelineFirstStatus(pkgAcquireStatus *status, unsigned int batch)
+      : _status(status), _batch(batch), cut(false) {}
+
+   virtual bool MediaChange(string Media, string Drive) {
+      return _status->MediaChange(Media, Drive);
    }
+   virtual void IMSHit(pkgAcquire::ItemDesc &Itm) { _status->IMSHit(Itm); }
+   virtual void Fetch(pkgAcquire::ItemDesc &Itm) { _status->Fetch(Itm); }
+   virtual void Done(pkgAcquire::ItemDesc &Itm) { _status->Done(Itm); }
+   virtual void Fail(pkgAcquire::ItemDesc &Itm) { _status->Fail(Itm); }
+   virtual void Start() { pkgAcquireStatus::Start(); _status->Start(); }
+   virtual void Stop() { pkgAcquireStatus::Stop(); _status->Stop(); }
 
-   // Clean out any old list files
-   if (!Failed && _config->FindB("APT::Get::List-Cleanup", true) == true) {
-      if (Fetcher.Clean(_config->FindDir("Dir::State::lists")) == false ||
-          Fetcher.Clean(_config->FindDir("Dir::State::lists") + "partial/") ==
-          false)
+   virtual bool Pulse(pkgAcquire *Owner) {
+      if (!_status->Pulse(Owner))
          return false;
+
+      unsigned int total;
+      unsigned int ready = readyArchives(*Owner, total);
+      if (ready < total && ready >= _batch) {
+         cut = true;
+         return false;
+      }
+      return true;
    }
-   if (Failed == true) {
-      //cout << failedURI << endl;
-      error = failedURI;
-      //_error->Error(failedURI.c_str());
-      return false; 
+};
+
+// Status of the background fetcher: no interface, it only wakes up
+// the installing thread whenever an archive lands
+class RPipelineFetchStatus : public pkgAcquireStatus {
+ public:
+   mutex lock;
+   condition_variable changed;
+   unsigned int events;
+   bool finished;
+   atomic<bool> abort;
+
+   RPipelineFetchStatus() : events(0), finished(false), abort(false) {}
+
+   void notify(bool done = false) {
+      lock_guard<mutex> guard(lock);
+      events++;
+      if (done)
+         finished = true;
+      changed.notify_all();
    }
-   return true;
-#endif
-}
 
-bool RPackageLister::getDownloadUris(vector<string> &uris)
-{
-   pkgAcquire fetcher;
-   pkgPackageManager *PM = _system->CreatePM(_cache->deps());
-   if (!PM->GetArchives(&fetcher, _cache->list(), _records)) {
-      delete PM;
-      return false;
+   virtual bool MediaChange(string, string) { return false; }
+   virtual void Done(pkgAcquire::ItemDesc &) { notify(); }
+   virtual void Fail(pkgAcquire::ItemDesc &) { notify(); }
+   virtual bool Pulse(pkgAcquire *Owner) {
+      pkgAcquireStatus::Pulse(Owner);
+      return !abort;
    }
-   for (pkgAcquire::ItemIterator I = fetcher.ItemsBegin();
-	I != fetcher.ItemsEnd(); I++) {
-      uris.push_back((*I)->DescURI());
+};
+
+int RPackageLister::commitPipelined(pkgAcquire &fetcher,
+                                    pkgPackageManager *rPM,
+                                    pkgAcquireStatus *status,
+                                    RInstallProgress *iprog)
+{
+   unsigned int batch = _config->FindI("Synaptic::PipelinedCommit::Batch", 10);
+   if (batch == 0)
+      batch = 1;
+
+   // first stage in the foreground, so the fetch dialog shows it
+   RPipelineFirstStatus first(status, batch);
+   fetcher.SetLog(&first);
+   pkgAcquire::RunResult res = fetcher.Run(50000);
+   fetcher.SetLog(status);
+
+   if (res == pkgAcquire::Failed)
+      return -1;
+   if (!first.cut)
+      return 1;        // everything is in already
+
+   // the rest downloads in the background through its own package
+   // manager and records, so nothing here is shared with this thread
+   RPipelineFetchStatus background;
+   pkgRecords records(*_cache->deps());
+   pkgPackageManager *prefetchPM = _system->CreatePM(_cache->deps());
+   pkgAcquire prefetch(&background);
+   if (!prefetchPM->GetArchives(&prefetch, _cache->list(), &records)) {
+      delete prefetchPM;
+      return -1;
+   }
+   thread downloader([&prefetch, &background]() {
+      prefetch.Run(50000);
+      background.notify(true);
+   });
+
+   int result = 1;
+   unsigned int seen = 0;
+   while (true) {
+      // the package manager picks up every archive that is already
+      // there and stops at the first missing one in unpack order
+      fetcher.Shutdown();
+      if (!rPM->GetArchives(&fetcher, _cache->list(), _records)) {
+         result = -1;
+         break;
+      }
+
+      unsigned int total;
+      unsigned int ready = readyArchives(fetcher, total);
+      bool finished;
+      {
+         lock_guard<mutex> guard(background.lock);
+         finished = background.finished;
+      }
+
+      // download failures and the last run go through the normal loop
+      if (finished || ready == total)
+         break;
+
+      if (ready < batch) {
+         unique_lock<mutex> guard(background.lock);
+         background.changed.wait_for(guard, chrono::milliseconds(100), [&]() {
+            return background.events != seen || background.finished;
+         });
+         seen = background.events;
+         guard.unlock();
+         iprog->pulse();
+         continue;
+      }
+
+      iprog->setPartialRun(true);
+      _system->UnLockInner();
+      pkgPackageManager::OrderResult Res = iprog->start(rPM, ready, total);
+      _system->LockInner();
+      iprog->setPartialRun(false);
+
+      if (Res == pkgPackageManager::Failed || _error->PendingError()) {
+         result = -1;
+         break;
+      }
+      if (Res == pkgPackageManager::Completed) {
+         result = 0;
+         break;
+      }
    }
 
-   delete PM;
-   return true;
+   if (result == -1)
+      background.abort = true;
+   downloader.join();
+   delete prefetchPM;
+
+   if (result == 1) {
+      // hand the fetcher back queued, the way the normal loop expects it
+      fetcher.Shutdown();
+      if (!rPM->GetArchives(&fetcher, _cache->list(), _records))
+         return -1;
+   }
+   return result;
 }
+#endif
 
 bool RPackageLister::commitChanges(pkgAcquireStatus *status,
                                    RInstallProgress *iprog)
@@ -1417,12 +2880,17 @@ bool RPackageLister::commitChanges(pkgAcquireStatus *status,
 
    _updating = true;
 
+   // fcntl locks do not keep threads of one process apart: the fetch
+   // ahead has to be stopped here, not left to the archive lock
+   std::unique_lock<std::mutex> noFetch = stopArchiveFetch();
+   waitForCacheClean();
    if (!lockPackageCache(lock))
       return false;
 
    if(_config->FindB("Synaptic::Log::Changes",true))
       makeCommitLog();
 
+   applyFetchOptions();
    pkgAcquire fetcher(status);
 
    assert(_cache->list() != NULL);
@@ -1439,6 +2907,18 @@ bool RPackageLister::commitChanges(pkgAcquireStatus *status,
        _error->PendingError())
       goto gave_wood;
 
+#ifndef HAVE_RPM
+   // opt-in: start unpacking while the rest of the archives download
+   if (_config->FindB("Synaptic::PipelinedCommit", false) &&
+       !_config->FindB("Volatile::Download-Only", false)) {
+      int pipelined = commitPipelined(fetcher, rPM, status, iprog);
+      if (pipelined < 0)
+         goto gave_wood;
+      if (pipelined == 0)
+         goto finished;
+   }
+#endif
+
    // ripped from apt-get
    while (1) {
       bool Transient = false;
@@ -1486,10 +2966,12 @@ bool RPackageLister::commitChanges(pkgAcquireStatus *status,
          serverError = getServerErrorMessage(errm);
 
          _error->Warning("%s", tmp.str().c_str());
+         _commitLog.note(tmp.str());
          Failed = true;
       }
 
       if (_config->FindB("Volatile::Download-Only", false)) {
+         _commitLog.discard();
          _updating = false;
          return !Failed;
       }
@@ -1555,7 +3037,9 @@ bool RPackageLister::commitChanges(pkgAcquireStatus *status,
 
    //cout << _("Finished.")<<endl;
 
-
+#ifndef HAVE_RPM
+ finished:
+#endif
    // erase downloaded packages
    cleanPackageCache();
 
@@ -1566,26 +3050,18 @@ bool RPackageLister::commitChanges(pkgAcquireStatus *status,
    return Ret;
 
  gave_wood:
+   // nothing was committed to log
+   _commitLog.discard();
    delete rPM;
    return false;
 }
 
 void RPackageLister::writeCommitLog()
 {
-   struct tm *t = localtime(&_logTime);
-   ostringstream tmp;
-   ioprintf(tmp, "%.4i-%.2i-%.2i.%.2i%.2i%.2i.log", 1900+t->tm_year, 
-	    t->tm_mon+1, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec);
-
-   string logfile = RLogDir() + tmp.str();
-   FILE *f = fopen(logfile.c_str(),"w+");
-   if(f == NULL) {
-      _error->Error("Failed to write commit log");
+   if(!_commitLog.isOpen())
       return;
-   }
-   fputs(_logEntry.c_str(), f);
-   fclose(f);
-
+   if(!_commitLog.close())
+      _error->Error("Failed to write commit log");
 }
 
 void RPackageLister::cleanCommitLog()
@@ -1604,6 +3080,9 @@ void RPackageLister::cleanCommitLog()
       entry = string(dent->d_name);
       if(logfile == "." || logfile == "..")
 	 continue;
+      // not a log, and it lists the logs that remain
+      if(entry == RHistoryIndex::fileName())
+	 continue;
       logfile = RLogDir()+entry;
       if(stat(logfile.c_str(), &buf) != 0) {
 	 cerr << "logfile: " << logfile << endl;
@@ -1623,9 +3102,11 @@ void RPackageLister::cleanCommitLog()
 
 void RPackageLister::makeCommitLog()
 {
-   time(&_logTime);
-   _logEntry = string("Commit Log for ") + string(ctime(&_logTime)) + string("\n");
-   _logEntry.reserve(2*8192); // make it big by default 
+   // written out as it is made, see rcommitlog.h
+   if(!_commitLog.open(RLogDir(), time(NULL))) {
+      _error->Error("Failed to write commit log");
+      return;
+   }
 
    vector<RPackage *> held;
    vector<RPackage *> kept;
@@ -1651,69 +3132,62 @@ void RPackageLister::makeCommitLog()
 		      sizeChange);
 
    if(essential.size() > 0) {
-      //_logEntry += _("\n<b>Removed the following ESSENTIAL packages:</b>\n");
-      _logEntry += _("\nRemoved the following ESSENTIAL packages:\n");
+      _commitLog.section(_("\nRemoved the following ESSENTIAL packages:\n"));
       for (vector<RPackage *>::const_iterator p = essential.begin();
 	   p != essential.end(); p++) {
-	 _logEntry += (*p)->name() + string("\n");
+	 _commitLog.package((*p)->name());
       }
    }
    
    if(toDowngrade.size() > 0) {
-      //_logEntry += _("\n<b>Downgraded the following packages:</b>\n");
-      _logEntry += _("\nDowngraded the following packages:\n");
+      _commitLog.section(_("\nDowngraded the following packages:\n"));
       for (vector<RPackage *>::const_iterator p = toDowngrade.begin();
 	   p != toDowngrade.end(); p++) {
-	 _logEntry += (*p)->name() + string("\n");
+	 _commitLog.package((*p)->name());
       }
    }
 
    if(toPurge.size() > 0) {
-      //_logEntry += _("\n<b>Completely removed the following packages:</b>\n");
-      _logEntry += _("\nCompletely removed the following packages:\n");
+      _commitLog.section(_("\nCompletely removed the following packages:\n"));
       for (vector<RPackage *>::const_iterator p = toPurge.begin();
 	   p != toPurge.end(); p++) {
-	 _logEntry += (*p)->name() + string("\n");
+	 _commitLog.package((*p)->name());
       }
    }
 
    if(toRemove.size() > 0) {
-      //_logEntry += _("\n<b>Removed the following packages:</b>\n");
-      _logEntry += _("\nRemoved the following packages:\n");
+      _commitLog.section(_("\nRemoved the following packages:\n"));
       for (vector<RPackage *>::const_iterator p = toRemove.begin();
 	   p != toRemove.end(); p++) {
-	 _logEntry += (*p)->name() + string("\n");
+	 _commitLog.package((*p)->name());
       }
    }
 
    if(toUpgrade.size() > 0) {
-      //_logEntry += _("\n<b>Upgraded the following packages:</b>\n");
-      _logEntry += _("\nUpgraded the following packages:\n");
+      _commitLog.section(_("\nUpgraded the following packages:\n"));
       for (vector<RPackage *>::const_iterator p = toUpgrade.begin();
 	   p != toUpgrade.end(); p++) {
-	 _logEntry += (*p)->name() + string(" (") + (*p)->installedVersion() 
-	    + string(")") + string(" to ") + (*p)->availableVersion() 
-	    + string("\n");
+	 _commitLog.package((*p)->name() + string(" (") + 
+			    (*p)->installedVersion() + string(")") + 
+			    string(" to ") + (*p)->availableVersion());
       }
    }
 
    if(toInstall.size() > 0) {
-      //_logEntry += _("\n<b>Installed the following packages:</b>\n");
-      _logEntry += _("\nInstalled the following packages:\n");
+      _commitLog.section(_("\nInstalled the following packages:\n"));
       for (vector<RPackage *>::const_iterator p = toInstall.begin();
 	   p != toInstall.end(); p++) {
-	 _logEntry += (*p)->name() + string(" (") + (*p)->availableVersion() 
-	    + string(")") + string("\n");
+	 _commitLog.package((*p)->name() + string(" (") + 
+			    (*p)->availableVersion() + string(")"));
       }
    }
 
    if(toReInstall.size() > 0) {
-      //_logEntry += _("\n<b>Reinstalled the following packages:</b>\n");
-      _logEntry += _("\nReinstalled the following packages:\n");
+      _commitLog.section(_("\nReinstalled the following packages:\n"));
       for (vector<RPackage*>::const_iterator p = toReInstall.begin(); 
 	   p != toReInstall.end(); p++) {
-	 _logEntry += (*p)->name() + string(" (") + (*p)->availableVersion() 
-	    + string(")") + string("\n");
+	 _commitLog.package((*p)->name() + string(" (") + 
+			    (*p)->availableVersion() + string(")"));
       }
    }
 }
@@ -1735,52 +3209,101 @@ bool RPackageLister::lockPackageCache(FileFd &lock)
 
 bool RPackageLister::cleanPackageCache(bool forceClean)
 {
-   FileFd lock;
+   using PolySynaptic::CacheRetention;
+   using PolySynaptic::CachedItem;
+   using PolySynaptic::RetentionPolicy;
 
-   if (_config->FindB("Synaptic::CleanCache", false) || forceClean) {
+   // one at a time, the last one may still hold the lock
+   waitForCacheClean();
 
-      lockPackageCache(lock);
-
-      pkgAcquire Fetcher;
-      Fetcher.Clean(_config->FindDir("Dir::Cache::archives"));
-      Fetcher.Clean(_config->FindDir("Dir::Cache::archives") + "partial/");
-   } else if (_config->FindB("Synaptic::AutoCleanCache", false)) {
+   bool everything = forceClean || _config->FindB("Synaptic::CleanCache", false);
+   RetentionPolicy policy;
+   if (everything) {
+      policy = RetentionPolicy::everything();
+   } else {
+      policy.dropObsolete = _config->FindB("Synaptic::AutoCleanCache", false);
+      policy.keepVersions = _config->FindI("Synaptic::CacheRetention::KeepVersions", -1);
+      int maxMB = _config->FindI("Synaptic::CacheRetention::MaxSize", 0);
+      policy.maxBytes = (uint64_t)max(maxMB, 0) * 1024 * 1024;
+      policy.keepHeld = _config->FindB("Synaptic::CacheRetention::KeepHeld", true);
+   }
 
-      lockPackageCache(lock);
+   // short of everything it has to know what is held and available
+   bool haveCache = _cache != NULL && _cache->deps() != NULL;
+   if (!policy.removesAnything() || (!everything && !haveCache))
+      return true;
 
-      class SimpleCleaner : public pkgArchiveCleaner {
-#if APT_PKG_ABI >= 590
-         void Erase(int const dirfd, char const * const File, std::string const &Pkg, std::string const &Ver,struct stat const &St) override {
-            RemoveFileAt("Cleaner::Erase", dirfd, File);
-         }
-#else
-         void Erase(const char * File, std::string /*Pkg*/, std::string /*Ver*/, struct stat & /*St*/) override {
-            RemoveFile("Cleaner::Erase", File);
+   // what takes the cache is looked up here, the worker only gets names;
+   // the cache is reopened after a commit while it runs
+   set<string> held, downloadable;
+   if (!everything) {
+      pkgCache &cache = _cache->deps()->GetCache();
+      for (pkgCache::PkgIterator P = cache.PkgBegin(); !P.end(); P++) {
+         if (policy.keepHeld && P->SelectedState == pkgCache::State::Hold)
+            held.insert(P.Name());
+         if (!policy.dropObsolete)
+            continue;
+         // as pkgArchiveCleaner keeps them
+         for (pkgCache::VerIterator V = P.VersionList(); !V.end(); V++) {
+            if (V.Downloadable())
+               downloadable.insert(string(P.Name()) + " " + V.VerStr());
          }
-#endif
-      } cleaner;
-
-      bool res;
+      }
+      for (unsigned int i = 0; policy.keepHeld && i < _packages.size(); i++) {
+         if (_packages[i]->getFlags() & RPackage::FPinned)
+            held.insert(_packages[i]->name());
+      }
+   }
 
-      res = cleaner.Go(_config->FindDir("Dir::Cache::archives"),
-                       *_cache->deps());
+   string archives = _config->FindDir("Dir::Cache::archives");
+   bool locking = !_config->FindB("Debug::NoLocking", false);
+   pkgVersioningSystem *vs = _system->VS;
 
-      if (!res)
-         return false;
+   _cacheCleaning = std::async(std::launch::async,
+                               [=, held = std::move(held),
+                                downloadable = std::move(downloadable)]() {
+      FileFd lock;
+      if (locking) {
+         lock.Fd(GetLock(archives + "lock"));
+         if (_error->PendingError()) {
+            // busy with another apt, it cleans up after itself
+            _error->Discard();
+            return;
+         }
+      }
 
-      res = cleaner.Go(_config->FindDir("Dir::Cache::archives") + "partial/",
-                       *_cache->deps());
+      vector<CachedItem> items, partial;
+      CacheRetention::scanArchives(archives, items);
+      CacheRetention::scanArchives(archives + "partial/", partial);
+      for (vector<CachedItem> *list : {&items, &partial}) {
+         for (CachedItem &item : *list) {
+            item.held = held.count(item.name) > 0;
+            item.obsolete = everything ||
+               downloadable.count(item.name + " " + item.version) == 0;
+         }
+      }
 
-      if (!res)
-         return false;
+      CacheRetention::removeFiles(CacheRetention::select(items, policy,
+         [vs](const string &a, const string &b) {
+            return vs->CmpVersion(a.c_str(), b.c_str());
+         }));
 
-   } else {
-      // mvo: nothing?
-   }
+      // half-fetched archives are resumed later, unless they cannot be
+      RetentionPolicy dropPartial;
+      dropPartial.dropObsolete = policy.dropObsolete || everything;
+      dropPartial.keepHeld = policy.keepHeld;
+      CacheRetention::removeFiles(CacheRetention::select(partial, dropPartial));
+   });
 
    return true;
 }
 
+void RPackageLister::waitForCacheClean()
+{
+   if (_cacheCleaning.valid())
+      _cacheCleaning.get();
+}
+
 void RPackageLister::refreshView()
 {
    _selectedView->refresh();
@@ -1865,8 +3388,11 @@ bool RPackageLister::readSelections(istream &in)
       int Pos = 0;
       for (map<string, int>::const_iterator I = actionMap.begin();
            I != actionMap.end(); I++) {
-         Pkg = Cache.FindPkg((*I).first);
-         if (Pkg.end() == false) {
+         // through the name index, virtual packages have no RPackage
+         // and nothing to mark anyway
+         RPackage *rpkg = getPackage((*I).first);
+         if (rpkg != NULL) {
+            Pkg = *rpkg->package();
 	    Fix.Clear(Pkg);
 	    Fix.Protect(Pkg);
             switch ((*I).second) {
@@ -1901,6 +3427,7 @@ bool RPackageLister::readSelections(istream &in)
 #endif
       _progMeter->Done();
       Fix.Resolve(true);
+      invalidateStateFlags();
 
       // refresh all views
       for (unsigned int i = 0; i != _views.size(); i++)
@@ -1913,73 +3440,137 @@ bool RPackageLister::readSelections(istream &in)
 
 bool RPackageLister::addArchiveToCache(string archive, string &pkgname)
 {
+   vector<string> added;
+   if (addArchivesToCache(vector<string>(1, archive), added) == 0)
+      return false;
+   pkgname = added[0];
+   return true;
+}
+
 #ifndef HAVE_RPM
-   //cout << "addArchiveToCache() " << archive << endl;
+// what is known about one archive of a batch
+struct RArchiveImport {
+   string path;
+   bool usable;
+   string pkgname;
+   string version;
+   string arch;
+   HashStringList hashes;       // of the candidate, looked up serially
+};
 
-   // do sanity checking on the file (do we need this 
-   // version, arch, or a different one etc)
-   FileFd in(archive, FileFd::ReadOnly);
+// the control file of the archive; touches nothing shared
+static bool readArchiveControl(RArchiveImport &imp)
+{
+   FileFd in(imp.path, FileFd::ReadOnly);
    debDebFile deb(in);
    debDebFile::MemControlExtract Extract("control");
    if(!Extract.Read(deb)) {
-      cerr << "read failed" << endl;
+      cerr << "read failed: " << imp.path << endl;
       return false;
    }
    pkgTagSection tag;
    if(!tag.Scan(Extract.Control,Extract.Length+2)) {
-      cerr << "scan failed" << endl;
-      return false;
-   }
-   // do we have the pkg
-   pkgname = tag.FindS("Package");
-   RPackage *pkg = this->getPackage(pkgname);
-   if(pkg == NULL) {
-      cerr << "Can't find pkg " << pkgname << endl;
-      return false;
-   }
-   // is it the right architecture?
-   if(tag.FindS("Architecture") != "all" &&
-      tag.FindS("Architecture") != _config->Find("APT::Architecture")) {
-      cerr << "Ignoring different architecture for " << pkgname << endl;
-      return false;
-   }
-   
-   // correct version?
-   string debVer = tag.FindS("Version");
-   string candVer = "_invalid_";
-   if(pkg->availableVersion() != NULL)
-      candVer = pkg->availableVersion();
-   if(debVer != candVer) {
-      cerr << "Ignoring " << pkgname << " (different versions: "
-	   << debVer << " != " << candVer  << endl;
+      cerr << "scan failed: " << imp.path << endl;
       return false;
    }
+   imp.pkgname = tag.FindS("Package");
+   imp.version = tag.FindS("Version");
+   imp.arch = tag.FindS("Architecture");
+   return true;
+}
 
-   // md5sum check
-   // first get the md5 of the candidate
-   pkgDepCache *dcache = _cache->deps();
-   pkgCache::VerIterator ver = dcache->GetCandidateVersion(*pkg->package());
-   pkgCache::VerFileIterator Vf = ver.FileList(); 
-   pkgRecords::Parser &Parse = _records->Lookup(Vf);
-   HashStringList hashes = Parse.Hashes();
-   // then calc the hashes of the pkg
-   Hashes debHashes(hashes);
-   in.Seek(0);
+// check the archive against the candidate's hashes, which reads it
+// whole, and copy it to the cache; touches nothing shared either
+static bool copyVerifiedArchive(const RArchiveImport &imp, const string &archiveDir)
+{
+   FileFd in(imp.path, FileFd::ReadOnly);
+   Hashes debHashes(imp.hashes);
    debHashes.AddFD(in.Fd(),in.Size());
-   if(hashes != debHashes.GetHashStringList()) {
-      cerr << "Ignoring " << pkgname << " hashes does not match"<< endl;
+   if(imp.hashes != debHashes.GetHashStringList()) {
+      cerr << "Ignoring " << imp.pkgname << " hashes does not match"<< endl;
       return false;
    }
-      
-   // copy to the cache
+
    in.Seek(0);
-   FileFd out(_config->FindDir("Dir::Cache::archives")+string(flNotDir(archive)),
-	      FileFd::WriteAny);
-   CopyFile(in, out);
+   FileFd out(archiveDir+string(flNotDir(imp.path)), FileFd::WriteAny);
+   return CopyFile(in, out);
+}
+#endif
 
-   return true;
+int RPackageLister::addArchivesToCache(const vector<string> &archives,
+                                       vector<string> &pkgnames)
+{
+#ifndef HAVE_RPM
+   // it could be removing what is copied in
+   waitForCacheClean();
+
+   vector<RArchiveImport> imports(archives.size());
+   for (unsigned int i = 0; i < archives.size(); i++)
+      imports[i].path = archives[i];
+
+   // an archive per thread at most: each is a file of its own
+   unsigned int chunks = RParallelChunks(imports.size(), 1);
+
+   RParallelFor(chunks, imports.size(),
+                [&imports](unsigned int, unsigned int begin, unsigned int end) {
+      for (unsigned int i = begin; i < end; i++)
+         imports[i].usable = readArchiveControl(imports[i]);
+   });
+
+   // sanity checking against the cache (do we need this version, arch,
+   // or a different one etc); the records are not thread safe
+   pkgDepCache *dcache = _cache->deps();
+   for (RArchiveImport &imp : imports) {
+      if (!imp.usable)
+         continue;
+      imp.usable = false;
+
+      RPackage *pkg = this->getPackage(imp.pkgname);
+      if(pkg == NULL) {
+         cerr << "Can't find pkg " << imp.pkgname << endl;
+         continue;
+      }
+      if(imp.arch != "all" && imp.arch != _config->Find("APT::Architecture")) {
+         cerr << "Ignoring different architecture for " << imp.pkgname << endl;
+         continue;
+      }
+      string candVer = "_invalid_";
+      if(pkg->availableVersion() != NULL)
+         candVer = pkg->availableVersion();
+      if(imp.version != candVer) {
+         cerr << "Ignoring " << imp.pkgname << " (different versions: "
+              << imp.version << " != " << candVer  << endl;
+         continue;
+      }
+
+      pkgCache::VerIterator ver = dcache->GetCandidateVersion(*pkg->package());
+      pkgCache::VerFileIterator Vf = ver.FileList();
+      pkgRecords::Parser &Parse = _records->Lookup(Vf);
+      imp.hashes = Parse.Hashes();
+      imp.usable = true;
+   }
+
+   // the hash checks and the copies back on the workers
+   string archiveDir = _config->FindDir("Dir::Cache::archives");
+   RParallelFor(chunks, imports.size(),
+                [&imports, &archiveDir](unsigned int, unsigned int begin,
+                                        unsigned int end) {
+      for (unsigned int i = begin; i < end; i++) {
+         if (imports[i].usable)
+            imports[i].usable = copyVerifiedArchive(imports[i], archiveDir);
+      }
+   });
+
+   int added = 0;
+   for (const RArchiveImport &imp : imports) {
+      if (imp.usable) {
+         pkgnames.push_back(imp.pkgname);
+         added++;
+      }
+   }
+   return added;
 #else
-   return false;
+   return 0;
 #endif
 }
 
@@ -1993,115 +3584,192 @@ bool RPackageLister::limitBySearch(string searchString)
    return xapianSearch(searchString);
 }
 
-bool RPackageLister::xapianSearch(string unsplitSearchString)
-{
-   //std::cerr << "RPackageLister::xapianSearch()" << std::endl;
-   static const int defaultQualityCutoff = 15;
-   int qualityCutoff = _config->FindI("Synaptic::Xapian::qualityCutoff", 
-                                      defaultQualityCutoff);
-    if (xapianIndexTimestamp() == 0) 
-        return false;
+// build the query for a search string
+Xapian::Query RPackageLister::xapianQuery(string unsplitSearchString)
+{
+   /* Workaround to allow searching an hyphenated package name using a prefix (name:)
+    * LP: #282995
+    * Xapian currently doesn't support wildcard for boolean prefix and 
+    * doesn't handle implicit wildcards at the end of hypenated phrases.
+    *
+    * e.g searching for name:ubuntu-res will be equivalent to 'name:ubuntu res*'
+    * however 'name:(ubuntu* res*) won't return any result because the 
+    * index is built with the full package name
+    */
+   // Always search for the package name
+   string xpString = "name:";
+   string::size_type pos = unsplitSearchString.find_first_of(" ,;");
+   if (pos > 0) {
+       xpString += unsplitSearchString.substr(0,pos);
+   } else {
+       xpString += unsplitSearchString;
+   }
+   Xapian::Query xpQuery = _xapianParser->parse_query(xpString);
 
-   try {
-      int maxItems = _xapianDatabase->get_doccount();
-      Xapian::Enquire enquire(*_xapianDatabase);
-      Xapian::QueryParser parser;
-      parser.set_database(*_xapianDatabase);
-      parser.add_prefix("name","XP");
-      parser.add_prefix("section","XS");
-      // default op is AND to narrow down the resultset
-      parser.set_default_op( Xapian::Query::OP_AND );
+   pos = 0;
+   while ( (pos = unsplitSearchString.find("-", pos)) != string::npos ) {
+      unsplitSearchString.replace(pos, 1, " ");
+      pos+=1;
+   }
+
+   if(RSettings().debugXapian) 
+      std::cerr << "searching for : " << unsplitSearchString << std::endl;
    
-      /* Workaround to allow searching an hyphenated package name using a prefix (name:)
-       * LP: #282995
-       * Xapian currently doesn't support wildcard for boolean prefix and 
-       * doesn't handle implicit wildcards at the end of hypenated phrases.
-       *
-       * e.g searching for name:ubuntu-res will be equivalent to 'name:ubuntu res*'
-       * however 'name:(ubuntu* res*) won't return any result because the 
-       * index is built with the full package name
-       */
-      // Always search for the package name
-      string xpString = "name:";
-      string::size_type pos = unsplitSearchString.find_first_of(" ,;");
-      if (pos > 0) {
-          xpString += unsplitSearchString.substr(0,pos);
-      } else {
-          xpString += unsplitSearchString;
-      }
-      Xapian::Query xpQuery = parser.parse_query(xpString);
+   // Build the query
+   // apply a weight factor to XP term to increase relevancy on package name
+   Xapian::Query query = _xapianParser->parse_query(unsplitSearchString, 
+      Xapian::QueryParser::FLAG_WILDCARD |
+      Xapian::QueryParser::FLAG_BOOLEAN |
+      Xapian::QueryParser::FLAG_PARTIAL);
+   return Xapian::Query(Xapian::Query::OP_OR, query, 
+           Xapian::Query(Xapian::Query::OP_SCALE_WEIGHT, xpQuery, 3));
+}
 
-      pos = 0;
-      while ( (pos = unsplitSearchString.find("-", pos)) != string::npos ) {
-         unsplitSearchString.replace(pos, 1, " ");
-         pos+=1;
-      }
+// fetch the next page of matches, keeping those apt knows
+void RPackageLister::xapianFetch(xapianResult &result, unsigned int pageSize)
+{
+   // the enquire is shared by all cached results
+   _xapianEnquire->set_query(result.query);
+   Xapian::MSet matches = _xapianEnquire->get_mset(result.fetched, pageSize);
 
-      if(_config->FindB("Debug::Synaptic::Xapian",false)) 
-         std::cerr << "searching for : " << unsplitSearchString << std::endl;
-      
-      // Build the query
-      // apply a weight factor to XP term to increase relevancy on package name
-      Xapian::Query query = parser.parse_query(unsplitSearchString, 
-         Xapian::QueryParser::FLAG_WILDCARD |
-         Xapian::QueryParser::FLAG_BOOLEAN |
-         Xapian::QueryParser::FLAG_PARTIAL);
-      query = Xapian::Query(Xapian::Query::OP_OR, query, 
-              Xapian::Query(Xapian::Query::OP_SCALE_WEIGHT, xpQuery, 3));
-      enquire.set_query(query);
-      Xapian::MSet matches = enquire.get_mset(0, maxItems);
-
-      if(_config->FindB("Debug::Synaptic::Xapian",false)) {
-         cerr << "enquire: " << enquire.get_description() << endl;
-         cerr << "matches estimated: " << matches.get_matches_estimated() << " results found" << endl;
-      }
+   if(RSettings().debugXapian) {
+      cerr << "enquire: " << _xapianEnquire->get_description() << endl;
+      cerr << "matches estimated: " << matches.get_matches_estimated() << " results found" << endl;
+   }
 
-      // Retrieve the results
-      int top_percent = 0;
-      _viewPackages.clear();
-      for (Xapian::MSetIterator i = matches.begin(); i != matches.end(); ++i)
-      {
-         RPackage* pkg = getPackage(i.get_document().get_data());
-         // Filter out results that apt doesn't know
-         if (!pkg || !_selectedView->hasPackage(pkg))
-            continue;
+   for (Xapian::MSetIterator i = matches.begin(); i != matches.end(); ++i)
+   {
+      // Filter out results that apt doesn't know
+      Xapian::docid docid = *i;
+      RPackage* pkg = docid < _xapianPackages.size() ? _xapianPackages[docid] : NULL;
+      if (!pkg)
+         continue;
+      xapianHit hit;
+      hit.pkg = pkg;
+      hit.percent = i.get_percent();
+      result.hits.push_back(hit);
+   }
 
-         // Save the confidence interval of the top value, to use it as
-         // a reference to compute an adaptive quality cutoff
-         if (top_percent == 0)
-            top_percent = i.get_percent();
-   
-         // Stop producing if the quality goes below a cutoff point
-         if (i.get_percent() < qualityCutoff * top_percent / 100)
-         {
-            cerr << "Discarding: " << i.get_percent() << " over " << qualityCutoff * top_percent / 100 << endl;
-            break;
+   result.fetched += matches.size();
+   result.complete = matches.size() < pageSize;
+}
+
+bool RPackageLister::xapianMatches(const string &unsplitSearchString,
+                                   bool inView, unsigned int limit,
+                                   vector<RPackage *> &matches)
+{
+   int qualityCutoff = RSettings().xapianQualityCutoff;
+   // a caller that only wants the top few doesn't need a full page
+   unsigned int pageSize = RSettings().xapianPageSize;
+   if (limit > 0 && limit < pageSize)
+      pageSize = limit;
+   lock_guard<recursive_mutex> lock(_xapianMutex);
+   adoptXapianIndex();
+   if (xapianIndexTimestamp() == 0 || _xapianEnquire == NULL) 
+      return false;
+
+   for (int attempt = 0; ; attempt++) {
+      try {
+         if (_xapianPackages.empty())
+            xapianMapPackages();
+
+         // a query seen recently (the user backspacing) is not run again
+         xapianResult *result = _xapianResults.find(unsplitSearchString);
+         PolySynaptic::MetricsRegistry::instance()
+            .counter("polysynaptic_query_cache_lookups",
+                     "Search query cache lookups, by whether they hit",
+                     {{"cache", "xapian"}, {"result", result ? "hit" : "miss"}})
+            .inc();
+         if (result == NULL) {
+            xapianResult fresh;
+            fresh.query = xapianQuery(unsplitSearchString);
+            fresh.fetched = 0;
+            fresh.complete = false;
+            _xapianResults.put(unsplitSearchString, fresh);
+            result = _xapianResults.find(unsplitSearchString);
          }
+
+         // Retrieve the results
+         int top_percent = 0;
+         matches.clear();
+         for (unsigned int i = 0; limit == 0 || matches.size() < limit; i++)
+         {
+            // only ask Xapian for more while the cutoff has not been hit
+            while (i >= result->hits.size() && !result->complete)
+               xapianFetch(*result, pageSize);
+            if (i >= result->hits.size())
+               break;
+
+            RPackage* pkg = result->hits[i].pkg;
+            int percent = result->hits[i].percent;
+            // Filter out results that are not in the current view
+            if (inView && !_selectedView->hasPackage(pkg))
+               continue;
+
+            // Save the confidence interval of the top value, to use it as
+            // a reference to compute an adaptive quality cutoff
+            if (top_percent == 0)
+               top_percent = percent;
    
-         if(_config->FindB("Debug::Synaptic::Xapian",false)) 
-            cerr << i.get_rank() + 1 << ": " << i.get_percent() << "% docid=" << *i << "	[" << i.get_document().get_data() << "]" << endl;
-         _viewPackages.push_back(pkg);
-         }
-      // re-apply sort criteria only if an explicit search is set
-      if (_sortMode != LIST_SORT_DEFAULT)
-          sortPackages(_sortMode);
-      return true;
-   } catch (const Xapian::Error & error) {
-      /* We are here if a Xapian call failed. The main cause is a parser exception.
-       * The error message is always in English currently. 
-       * The possible parser errors are:
-       *    Unknown range operation
-       *    parse error
-       *    Syntax: <expression> AND <expression>
-       *    Syntax: <expression> AND NOT <expression>
-       *    Syntax: <expression> NOT <expression>
-       *    Syntax: <expression> OR <expression>
-       *    Syntax: <expression> XOR <expression>
-       */
-      cerr << "Exception in RPackageLister::xapianSearch():" << error.get_msg() << endl;
-      return false;
+            // Stop producing if the quality goes below a cutoff point
+            if (percent < qualityCutoff * top_percent / 100)
+            {
+               cerr << "Discarding: " << percent << " over " << qualityCutoff * top_percent / 100 << endl;
+               break;
+            }
+   
+            if(RSettings().debugXapian) 
+               cerr << i + 1 << ": " << percent << "%	[" << pkg->name() << "]" << endl;
+            matches.push_back(pkg);
+            }
+         return true;
+      } catch (const Xapian::DatabaseModifiedError & error) {
+         // update-apt-xapian-index replaced the revision we were reading
+         // (see RGMainWindow::xapianDoIndexUpdate()); move to the new one
+         if (attempt == 0 && openXapianIndex())
+            continue;
+         cerr << "Exception in RPackageLister::xapianSearch():" << error.get_msg() << endl;
+         return false;
+      } catch (const Xapian::Error & error) {
+         /* We are here if a Xapian call failed. The main cause is a parser exception.
+          * The error message is always in English currently. 
+          * The possible parser errors are:
+          *    Unknown range operation
+          *    parse error
+          *    Syntax: <expression> AND <expression>
+          *    Syntax: <expression> AND NOT <expression>
+          *    Syntax: <expression> NOT <expression>
+          *    Syntax: <expression> OR <expression>
+          *    Syntax: <expression> XOR <expression>
+          */
+         cerr << "Exception in RPackageLister::xapianSearch():" << error.get_msg() << endl;
+         return false;
+      }
    }
 }
+
+bool RPackageLister::xapianSearch(string unsplitSearchString)
+{
+   //std::cerr << "RPackageLister::xapianSearch()" << std::endl;
+   vector<RPackage *> matches;
+   if (!xapianMatches(unsplitSearchString, true, 0, matches))
+      return false;
+
+   _viewPackages.swap(matches);
+   // re-apply sort criteria only if an explicit search is set
+   if (_sortMode != LIST_SORT_DEFAULT)
+       sortPackages(_sortMode);
+   reindexViewPackages();
+   _viewFromSearch = true;
+   return true;
+}
+
+bool RPackageLister::searchPackages(string searchString,
+                                    vector<RPackage *> &result,
+                                    unsigned int limit)
+{
+   return xapianMatches(searchString, false, limit, result);
+}
 #else
 bool RPackageLister::limitBySearch(string searchString)
 {
@@ -2112,8 +3780,77 @@ bool RPackageLister::xapianSearch(string searchString)
 { 
    return false; 
 }
+
+bool RPackageLister::searchPackages(string searchString,
+                                    vector<RPackage *> &result,
+                                    unsigned int limit)
+{
+   return false;
+}
 #endif
 
+void RPackageLister::groupArchitectures(unsigned int groupCount)
+{
+   // counting sort of the _packages indexes by group
+   _archGroupStart.assign(groupCount + 1, 0);
+   for (unsigned int i = 0; i < _archGroupOf.size(); i++)
+      _archGroupStart[_archGroupOf[i] + 1]++;
+   for (unsigned int g = 0; g < groupCount; g++)
+      _archGroupStart[g + 1] += _archGroupStart[g];
+
+   _multiArchGroups = false;
+   for (unsigned int g = 0; g < groupCount && !_multiArchGroups; g++)
+      _multiArchGroups = _archGroupStart[g + 1] - _archGroupStart[g] > 1;
+
+   vector<unsigned int> fill(_archGroupStart.begin(), _archGroupStart.end() - 1);
+   _archGroupMembers.resize(_archGroupOf.size());
+   for (unsigned int i = 0; i < _archGroupOf.size(); i++)
+      _archGroupMembers[fill[_archGroupOf[i]]++] = i;
+}
+
+void RPackageLister::collectNativeArchPackages(bool showAll)
+{
+   _nativeArchPackages.clear();
+   _nativeArchPackages.reserve(_packages.size());
+   for (unsigned int i = 0; i < _packages.size(); i++) {
+      // installed packages are never "hidden"
+      if (showAll || !_otherArch[i] ||
+          (*_packages[i]->package())->CurrentVer != 0)
+         _nativeArchPackages.push_back(_packages[i]);
+   }
+}
+
+vector<RPackage *> RPackageLister::getArchSiblings(RPackage *pkg)
+{
+   vector<RPackage *> siblings;
+   unsigned int index = getPackageIndex(pkg);
+   if (index >= _archGroupOf.size())
+      return siblings;
+
+   unsigned int group = _archGroupOf[index];
+   for (unsigned int m = _archGroupStart[group];
+        m < _archGroupStart[group + 1]; m++) {
+      if (_archGroupMembers[m] != index)
+         siblings.push_back(_packages[_archGroupMembers[m]]);
+   }
+   return siblings;
+}
+
+void RPackageLister::setShowAllMultiArch(bool show)
+{
+   if (_config->FindB("Synaptic::ShowAllMultiArch", false) == show)
+      return;
+   _config->Set("Synaptic::ShowAllMultiArch", show);
+
+   collectNativeArchPackages(show);
+   for (unsigned int i = 0; i != _views.size(); i++)
+      _views[i]->clear();
+   _filterView->bumpGeneration();
+   _staleView = NULL;
+   refreshViews();
+   reapplyFilter();
+}
+
 bool RPackageLister::isMultiarchSystem()
 {
 #ifdef WITH_APT_MULTIARCH_SUPPORT
@@ -33,18 +33,36 @@
 #include <map>
 #include <set>
 #include <regex.h>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#ifdef HAVE_XAPIAN
+#include <future>
+#include <memory>
+#endif
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/acquire.h>
 #include <apt-pkg/progress.h>
 
 #ifdef HAVE_XAPIAN
 #include <xapian.h>
+#include "rxapianbuilder.h"
 #endif
 
 #include "rpackagecache.h"
 #include "rpackage.h"
 #include "rpackagestatus.h"
 #include "rpackageview.h"
+#include "rarena.h"
+#include "rdepindex.h"
+#include "rautoremove.h"
+#include "rrecordcache.h"
+#include "rsearchcache.h"
+#include "rfileindex.h"
+#include "rnameindex.h"
+#include "rnameset.h"
+#include "rcommitlog.h"
+#include "memoryusage.h"
 #include "ruserdialog.h"
 #include "config.h"
 
@@ -80,22 +98,8 @@ class RCacheObserver {
    virtual void notifyCachePostChange() = 0;
 };
 
-// base sort class
+// sort comparisons are composed from the pieces in rsortcmp.h
 // for a example use see sortPackages()
-template<class T>
-class sortFunc {
- protected:
-   bool _ascent;
-   T cmp;
- public:
-   sortFunc(bool ascent) : _ascent(ascent) {}
-   bool operator() (RPackage *x, RPackage *y) {
-      if(_ascent)
-	 return cmp(x,y);
-      else
-	 return cmp(y,x);
-   }
-};
 
 
 class RPackageLister {
@@ -109,26 +113,170 @@ class RPackageLister {
 
 #ifdef HAVE_XAPIAN
    Xapian::Database *_xapianDatabase;
+
+   // the constructor opens the index on a worker thread, overlapping
+   // the cache and the main window; the first user takes it over
+   std::future<Xapian::Database *> _xapianOpening;
+   void adoptXapianIndex();
+   bool installXapianIndex(Xapian::Database *database);
+   static Xapian::Database *openXapianDatabase();
+
+   // kept across queries, (re)created in openXapianIndex()
+   Xapian::QueryParser *_xapianParser;
+   Xapian::Enquire *_xapianEnquire;
+
+   // package of every document id (NULL if apt does not know it), built
+   // on the first query after the index or the cache was (re)opened
+   vector<RPackage *> _xapianPackages;
+
+   // ranked matches of the last few queries, before the view filter
+   // and the quality cutoff are applied. Matches are fetched a page at
+   // a time, only as far as the cutoff lets the results go
+   struct xapianHit {
+      RPackage *pkg;
+      int percent;
+   };
+   struct xapianResult {
+      Xapian::Query query;
+      vector<xapianHit> hits;
+      unsigned int fetched;     // MSet entries looked at so far
+      bool complete;            // nothing left to fetch
+   };
+   RSearchCache<xapianResult> _xapianResults;
 #endif
 
 
    // Other members.
+   // owns every RPackage in _packages; freed in one go with the lister
+   RArena<RPackage> _packageArena;
    vector<RPackage *> _packages;
    vector<int> _packagesIndex;
 
+   // the names of _packages by their index there, built in openCache();
+   // the package the group would pick comes first among equal names
+   RNameIndex _nameIndex;
+
+   // dependency graph of the open cache by package and version ID
+   RDependencyIndex _depIndex;
+
+   // the auto-removable packages, brought up to date after marks by
+   // updating the neighbourhood of what changed, instead of apt's
+   // sweep over the whole cache (Synaptic::IncrementalAutoRemove);
+   // while it is used it holds _sweepGuard, an action group that
+   // keeps the release of every other group from sweeping anyway
+   RAutoRemoveTracker _autoRemove;
+   pkgDepCache::ActionGroup *_sweepGuard;
+   pkgDepCache::InRootSetFunc *_rootSet;
+   std::mutex _autoRemoveMutex;
+   std::atomic<bool> _autoRemoveDirty;
+   void rebuildAutoRemovable();
+   void releaseAutoRemovable();
+
+   // records RPackage parsed from _records, cleared in openCache()
+   RRecordCache _recordCache;
+
+   // the fields of every package file by its offset in the cache,
+   // built in openCache()
+   vector<RPackageFile> _packageFiles;
+   void indexPackageFiles(pkgCache &cache);
+
+   // depcache state flags by package ID, computed on first use after
+   // every change (-1 = not computed yet), see getStateFlags(); atomic
+   // because the read-only queries (searchPackages() and AptBackend's
+   // listings) may fill them from several threads
+   unique_ptr<atomic<int>[]> _stateFlags;
+   unsigned int _stateFlagsSize;
+   // bumped whenever any package's flags may have changed
+   unsigned long _flagsGeneration;
+
+   // what getSummary() and getDownloadSummary() last counted, kept
+   // while the flags generation is the one they were counted for; the
+   // status bar and the summary ask after every action, most of which
+   // do not change any marks
+   struct summaryCounts {
+      unsigned long generation;
+      int held, kept, essential;
+      int toInstall, toReInstall, toUpgrade, toRemove, toDowngrade;
+      int unauthenticated;
+   };
+   summaryCounts _summary;
+   unsigned long _downloadGeneration;
+   double _downloadSize;
+
+   // what getDetailedSummary() last listed, kept the same way
+   struct detailedSummary {
+      unsigned long generation;
+      vector<RPackage *> held, kept, essential;
+      vector<RPackage *> toInstall, toReInstall, toUpgrade;
+      vector<RPackage *> toRemove, toPurge, toDowngrade;
+      vector<string> notAuthenticated;
+      double sizeChange;
+   };
+   detailedSummary _detailed;
+
+   // what showWhyInstBroken() said of each package by ID, for the
+   // flags generation in _brokenGeneration; a failed mark of a big
+   // upgrade asks for hundreds of them and the unmet dependencies
+   // dialog only formats the ones that get expanded
+   map<unsigned long, string> _brokenReasons;
+   unsigned long _brokenGeneration;
+
+   // open MarkBatch scopes; while any is open the marks share one
+   // action group, the resolver waits for the outermost to close and
+   // the packages changed are collected instead of notified
+   int _markBatchDepth;
+   pkgDepCache::ActionGroup *_markGroup;
+   map<RPackage *, bool> _markBatchResolve;   // package -> removed
+   set<RPackage *> _markBatchChanged;
+   bool _markBatchChangedAll;
+   void beginMarkBatch();
+   void endMarkBatch();
+
    vector<RPackage *> _viewPackages;
    vector<int> _viewPackagesIndex;
 
+   // package flags by ID when _viewPackages was built, kept only when
+   // marks can change it (see updateViewPackages())
+   vector<int> _viewFlags;
+   unsigned long _viewGeneration;
+   RPackageView *_viewBuiltFor;
+   // _viewPackages holds search results, not the selected view
+   bool _viewFromSearch;
+   // a view whose subview lists missed in place updates
+   RPackageView *_staleView;
+
    // this is what we feed to the views as "all packages" to avoid
    // to show all the multiarch versions by default, the user can
    // turn that off with a config option
    vector<RPackage *> _nativeArchPackages;
 
+   // the architectures of each name, as openCache() grouped them: per
+   // _packages index its apt group, and whether a bare name means
+   // another architecture; the _packages indexes of group g are
+   // _archGroupMembers[_archGroupStart[g] .. _archGroupStart[g + 1]]
+   vector<unsigned int> _archGroupOf;
+   vector<bool> _otherArch;
+   vector<unsigned int> _archGroupStart;
+   vector<unsigned int> _archGroupMembers;
+   // whether any name has more than one architecture
+   bool _multiArchGroups;
+
+   void groupArchitectures(unsigned int groupCount);
+   void collectNativeArchPackages(bool showAll);
+
    // It shouldn't be needed to control this inside this class. -- niemeyer
    bool _updating;
 
+   // whether the last updateCache() changed any file the cache is
+   // built from
+   bool _indexesChanged;
+
+   // bumped whenever what a package's records, versions or
+   // dependencies say may have changed, see getCacheGeneration()
+   unsigned long _cacheGeneration;
+
    // all known packages (needed identifing "new" pkgs)
-   set<string> packageNames;
+   RNameSet packageNames;
 
    bool _cacheValid;            // is the cache valid?
 
@@ -141,6 +289,20 @@ class RPackageLister {
 
    // helper for the limitBySearch() code
    bool xapianSearch(string searchString);
+#ifdef HAVE_XAPIAN
+   // the database, parser, enquire and cached results; held while a
+   // query runs and while a new index revision is installed
+   recursive_mutex _xapianMutex;
+   // the packages matching searchString, in relevance order down to
+   // the quality cutoff and at most limit of them (0 = no limit); with
+   // inView only those in the selected view
+   bool xapianMatches(const string &searchString, bool inView,
+                      unsigned int limit, vector<RPackage *> &matches);
+   Xapian::Query xapianQuery(string searchString);
+   // at least pageSize more matches if there are that many
+   void xapianFetch(xapianResult &result, unsigned int pageSize);
+   void xapianMapPackages();
+#endif
 
    public:
 
@@ -183,8 +345,52 @@ class RPackageLister {
 
    void applyInitialSelection();
 
+#ifndef HAVE_RPM
+   // ListUpdate() over list, under the list lock, noting whether any
+   // index file changed
+   bool fetchIndexes(pkgAcquireStatus *status, pkgSourceList &list,
+                     string &error);
+#endif
+
+   // refresh() the views after openCache(), taking the subviews that
+   // only depend on the cache from the snapshot of the last open when
+   // the files the cache is built from did not change since
+   void refreshViews();
+   string viewSnapshotStamp();
+
+   // owners of the installed files, refreshed on first use after each
+   // openCache()
+   RFileIndex _fileIndex;
+
+   // what the debug panel is told the package objects and the cached
+   // Xapian results take; after both, so it is unregistered first
+   PolySynaptic::MemoryAccount _memoryAccount;
+#ifdef HAVE_XAPIAN
+   PolySynaptic::MemoryAccount _xapianMemoryAccount;
+#endif
+
+   // notifyPostChange() without touching the filter results, for when
+   // only the selected (sub)view changed
+   void notifyViewChange(RPackage *pkg);
+   void notifyPackageObservers(RPackage *pkg);
+
+   // after marks changed: move the packages whose flags changed in or
+   // out of _viewPackages; false if the view has to be rebuilt
+   bool updateViewPackages();
+   void reindexViewPackages();
+   bool sortsByState();
+   void refreshStaleView();
+
    bool lockPackageCache(FileFd &lock);
 
+#ifndef HAVE_RPM
+   // Synaptic::PipelinedCommit: install archives in unpack order while
+   // the rest download; -1 failed, 0 all done, 1 go on with the normal
+   // fetch/install loop
+   int commitPipelined(pkgAcquire &fetcher, pkgPackageManager *rPM,
+                       pkgAcquireStatus *status, RInstallProgress *iprog);
+#endif
+
    void sortPackages(vector<RPackage *> &packages,listSortMode mode);
 
    struct {
@@ -201,17 +407,57 @@ class RPackageLister {
 
    void makeCommitLog();
    void writeCommitLog();
-   string _logEntry;
-   time_t _logTime;
+   RCommitLog _commitLog;
+
+   std::future<void> _cacheCleaning;
+
+   // held by fetchArchives() while it runs and by whatever stopped it,
+   // see stopArchiveFetch()
+   std::mutex _fetchLock;
+   std::atomic<bool> _fetchStop;
+   std::unique_lock<std::mutex> stopArchiveFetch();
 
    // undo/redo stuff
+#ifdef HAVE_RPM
    list<pkgState> undoStack;
    list<pkgState> redoStack;
+#else
+   // one undo step: the packages whose flags an action changed (index
+   // into _packages) with their flags before and after it
+   struct pkgStateChange {
+      unsigned int index;
+      int before;
+      int after;
+   };
+   typedef vector<pkgStateChange> pkgStateDelta;
+   list<pkgStateDelta> undoStack;
+   list<pkgStateDelta> redoStack;
+
+   // snapshot from saveUndoState(), made into a step once the action
+   // that follows it is over
+   pkgState _undoBase;
+   bool _undoPending;
+
+   // the changes from before to after, or to the current flags
+   void diffState(const pkgState &before, const pkgState *after,
+                  pkgStateDelta &delta);
+   void closeUndoStep(const pkgState *after);
+   void pushUndoStep(pkgStateDelta &delta);
+   void applyStateDelta(const pkgStateDelta &delta, bool before);
+   void restoreFlags(RPackage *pkg, int flags);
+#endif
 
    public:
    // limit what the current view displays
    bool limitBySearch(string searchString);
 
+   // the best (at most limit, 0 = all) packages a Xapian search finds,
+   // without touching the view; may run on several threads at once, as
+   // long as nothing is marked or reopened meanwhile. false if there is
+   // no index
+   bool searchPackages(string searchString, vector<RPackage *> &result,
+                       unsigned int limit = 0);
+
    // clean files older than "Synaptic::delHistory"
    void cleanCommitLog();
 
@@ -245,6 +491,22 @@ class RPackageLister {
    RPackage *getPackage(int index) { return _packages.at(index); }
    RPackage *getViewPackage(int index) { return _viewPackages.at(index); }
    RPackage *getPackage(pkgCache::PkgIterator &pkg);
+   // by pkgCache::Package::ID, NULL for virtual or unknown ids
+   RPackage *getPackageById(unsigned int id) {
+      if (id >= _packagesIndex.size() || _packagesIndex[id] == -1)
+         return NULL;
+      return _packages[_packagesIndex[id]];
+   }
+   const RDependencyIndex &getDependencyIndex() const { return _depIndex; }
+   // by pkgCache::Package::ID; any thread
+   bool isAutoRemovable(unsigned int id);
+   vector<RPackage *> getAutoRemovable();
+   RRecordCache &recordCache() { return _recordCache; }
+   // by pkgCache::VerFile::File, an empty entry for unknown files
+   const RPackageFile &getPackageFile(unsigned int file) {
+      static const RPackageFile none;
+      return file < _packageFiles.size() ? _packageFiles[file] : none;
+   }
    RPackage *getPackage(string name);
    int getPackageIndex(RPackage *pkg);
    int getViewPackageIndex(RPackage *pkg);
@@ -277,6 +539,11 @@ class RPackageLister {
 
    void getDownloadSummary(int &dlCount, double &dlSize);
 
+   // fill what the three summaries above keep for the current marks,
+   // so the summary window opens without computing them; cheap when
+   // they are current already
+   void precomputeSummary();
+
    void saveUndoState(pkgState &state);
    void saveUndoState();
    void undo();
@@ -294,6 +561,11 @@ class RPackageLister {
                         const vector<RPackage *> &exclude,
                         bool sorted = true);
 
+   // start reading the files openCache() and the first searches need
+   // into the page cache, see RPackageCache::prefetch(); before the
+   // lister is made, as early as the configuration allows
+   static void prefetchCacheFiles();
+
    // open (lock if run as root)
    bool openCache();
    bool fixBroken();
@@ -301,13 +573,64 @@ class RPackageLister {
    bool upgradable();
    bool upgrade();
    bool distUpgrade();
+
+   // upgrade(), distUpgrade() and fixBroken() in two steps: resolve()
+   // only runs the resolver over the depcache, so it may run on a
+   // worker while the main thread leaves the depcache alone (the
+   // interface locked and the package list detached); resolved() then
+   // tells the views and observers on the main thread, once
+   enum ResolveKind { RESOLVE_UPGRADE, RESOLVE_DIST_UPGRADE, RESOLVE_FIX_BROKEN };
+   bool resolve(ResolveKind kind);
+   void resolved(ResolveKind kind);
+   // remove the archives the cache settings (Synaptic::CleanCache,
+   // AutoCleanCache and CacheRetention::*) let go; the directory scan
+   // and the unlinks run on a worker holding the archive lock, which
+   // the next commit waits for
    bool cleanPackageCache(bool forceClean = false);
+   void waitForCacheClean();
+   // download what upgrading names to their candidate versions needs
+   // into the archive cache, through a depcache, records and fetcher
+   // of its own, so the marks stay as they are and it may run on a
+   // worker. Holds the archive lock meanwhile; openCache(),
+   // updateCache() and commitChanges() stop it and wait, and it fails
+   // at once while one of them runs. kbps over 0 limits the rate
+   bool fetchArchives(const vector<string> &names,
+                      const std::function<bool()> &cancelled,
+                      int kbps, string &error);
    bool updateCache(pkgAcquireStatus *status, string &error);
+   // fetch the indexes of just these sources.list lines (which must be
+   // in the main list too, for the cache to load them), leaving the
+   // lists of the other sources alone
+   bool updateCache(pkgAcquireStatus *status, string &error,
+                    const vector<string> &sources);
+   // false if the last updateCache() left every index file (and the
+   // dpkg status) as it was, in which case the open cache is current
+   // and does not need to be reopened
+   bool indexesChanged() const { return _indexesChanged; }
+
+   // changes when the cache is reopened or a candidate version is
+   // overridden; results that only depend on the cache contents (like
+   // RPatternPackageFilter's) stay valid while it is the same
+   unsigned long getCacheGeneration() const { return _cacheGeneration; }
+   void bumpCacheGeneration() { _cacheGeneration++; }
+
+   // which packages (and snaps and flatpaks) own which files; only the
+   // lists that changed since the last call are read again
+   RFileIndex *fileIndex() {
+      _fileIndex.ensure();
+      return &_fileIndex;
+   }
+
    bool commitChanges(pkgAcquireStatus *status, RInstallProgress *iprog);
 
    // some information
    bool getDownloadUris(vector<string> &uris);
    bool addArchiveToCache(string archiveDir, string &pkgname);
+   // the batch form: the archives are read and checked in parallel, and
+   // the names of those copied to the cache appended to pkgnames;
+   // returns how many they were
+   int addArchivesToCache(const vector<string> &archives,
+                          vector<string> &pkgnames);
 
    void setProgressMeter(OpProgress *progMeter) {
       if(_progMeter != NULL)
@@ -330,11 +653,51 @@ class RPackageLister {
    // multiarch
    bool isMultiarchSystem();
 
+   // the other architectures of pkg's name, from the groups openCache()
+   // recorded
+   vector<RPackage *> getArchSiblings(RPackage *pkg);
+   bool hasMultiArchGroups() const { return _multiArchGroups; }
+
+   // show every architecture in the views, or only the one a bare name
+   // means unless another is installed; regroups nothing
+   void setShowAllMultiArch(bool show);
+
+   // state flags of a package, cached until the next depcache change
+   int getStateFlags(RPackage *pkg);
+   void invalidateStateFlags();
+
+   // for caches of anything derived from RPackage::getFlags()
+   unsigned long getFlagsGeneration() const { return _flagsGeneration; }
+   void bumpFlagsGeneration() { _flagsGeneration++; }
+
+   // pkg->showWhyInstBroken(), worked out once per flags generation
+   const string &getBrokenReason(RPackage *pkg);
+
    // notification stuff about changes in packages
    void notifyPreChange(RPackage *pkg);
    void notifyPostChange(RPackage *pkg);
    void notifyChange(RPackage *pkg);
    void registerObserver(RPackageObserver *observer);
+
+   // Scope for marking many packages at once. Until the outermost batch
+   // goes away every mark shares one depcache action group, so the
+   // auto-removal sweep runs once; setInstall() and setRemove() leave
+   // their problem resolving to a single resolver run over all of the
+   // packages marked; and the changes are notified once, for the
+   // package changed or for NULL when there were several.
+   class MarkBatch {
+      RPackageLister *_lister;
+      MarkBatch(const MarkBatch &);
+      MarkBatch &operator=(const MarkBatch &);
+    public:
+      explicit MarkBatch(RPackageLister *lister) : _lister(lister) {
+         _lister->beginMarkBatch();
+      }
+      ~MarkBatch() { _lister->endMarkBatch(); }
+   };
+   bool inMarkBatch() const { return _markBatchDepth > 0; }
+   // called by RPackage for a mark whose resolving the batch took over
+   void deferResolve(RPackage *pkg, bool remove);
    void unregisterObserver(RPackageObserver *observer);
 
    // notification stuff about changes in cache
@@ -349,10 +712,17 @@ class RPackageLister {
 
    RPackageCache* getCache() { return _cache; }
 #ifdef HAVE_XAPIAN
-   Xapian::Database* xapiandatabase() { return _xapianDatabase; }
+   Xapian::Database* xapiandatabase() { adoptXapianIndex(); return _xapianDatabase; }
    time_t xapianIndexTimestamp();
    bool xapianIndexNeedsUpdate();
    bool openXapianIndex();
+
+   // the index is rebuilt by RXapianIndexBuilder rather than by
+   // update-apt-xapian-index (Synaptic::XapianNativeIndex, default on)
+   static bool nativeXapianIndex();
+   static string xapianIndexDir();
+   // a document for every package with a candidate, for the builder
+   void xapianDocuments(vector<RXapianDocument> &documents);
 #endif
 
    RPackageLister();
@@ -0,0 +1,111 @@
+/* rpackageset.h - Dense bitset over package ids
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RPACKAGESET_H
+#define RPACKAGESET_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// One bit per package id (pkgCache::Package::ID). Views and filter
+// results are kept as sets like this so that testing a package is a
+// bit lookup and combining two selections is a word-wise AND.
+//
+// The set grows on insert(); ids past its end are simply not in it.
+class RPackageSet {
+ public:
+   RPackageSet() {}
+   RPackageSet(unsigned int size) : _words((size + 63) / 64, 0) {}
+
+   void insert(unsigned int id) {
+      if (id / 64 >= _words.size())
+         _words.resize(id / 64 + 1, 0);
+      _words[id / 64] |= (uint64_t)1 << (id % 64);
+   }
+
+   void erase(unsigned int id) {
+      if (id / 64 < _words.size())
+         _words[id / 64] &= ~((uint64_t)1 << (id % 64));
+   }
+
+   bool contains(unsigned int id) const {
+      return id / 64 < _words.size() &&
+             (_words[id / 64] & ((uint64_t)1 << (id % 64))) != 0;
+   }
+
+   // remove everything but keep the storage
+   void clear() {
+      for (unsigned int i = 0; i < _words.size(); i++)
+         _words[i] = 0;
+   }
+
+   // keep only the ids also in other
+   void intersect(const RPackageSet &other) {
+      unsigned int n = other._words.size();
+      if (_words.size() > n)
+         _words.resize(n);
+      for (unsigned int i = 0; i < _words.size(); i++)
+         _words[i] &= other._words[i];
+   }
+
+   // add the ids in other
+   void unite(const RPackageSet &other) {
+      if (_words.size() < other._words.size())
+         _words.resize(other._words.size(), 0);
+      for (unsigned int i = 0; i < other._words.size(); i++)
+         _words[i] |= other._words[i];
+   }
+
+   unsigned int count() const {
+      unsigned int n = 0;
+      for (unsigned int i = 0; i < _words.size(); i++)
+         n += __builtin_popcountll(_words[i]);
+      return n;
+   }
+
+   bool empty() const {
+      for (unsigned int i = 0; i < _words.size(); i++)
+         if (_words[i] != 0)
+            return false;
+      return true;
+   }
+
+   // call f(id) for every id in the set, in ascending order
+   template<class F>
+   void forEach(F f) const {
+      for (unsigned int i = 0; i < _words.size(); i++) {
+         uint64_t word = _words[i];
+         while (word != 0) {
+            f(i * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+         }
+      }
+   }
+
+ private:
+   vector<uint64_t> _words;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
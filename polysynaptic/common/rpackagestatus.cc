@@ -29,6 +29,7 @@
 #include <apt-pkg/tagfile.h>
 #include <apt-pkg/strutl.h>
 #include "rpackagestatus.h"
+#include "rpackagelister.h"
 
 // init the static release array so that we need to
 // run lsb_release only once
@@ -62,6 +63,10 @@ void RPackageStatus::init()
    };
    memcpy(PackageStatusLongString, status_long, sizeof(status_long));
 
+   // the lists below may be read anew
+   _tablesGeneration = 0;
+   _supportedTuples.clear();
+
 
    // check for unsupported stuff
    if(_config->FindB("Synaptic::mark-unsupported", true)) {
@@ -114,44 +119,73 @@ void RPackageStatus::init()
    } 
 }
 
-bool RPackageStatus::isSupported(RPackage *pkg) 
+void RPackageStatus::checkTables(RPackage *pkg)
 {
-   bool res = true;
+   unsigned long generation = pkg->_lister->getCacheGeneration();
+   if (generation == _tablesGeneration)
+      return;
+   _tablesGeneration = generation;
+   _supported.clear();
+   _releaseDates.clear();
+   // an update may have brought newer release files
+   _releaseFileDates.clear();
+}
 
-   if(markUnsupported) {
-      bool sc, sl, so;
+bool RPackageStatus::isSupportedTuple(const string &origin,
+                                      const string &label,
+                                      const string &component)
+{
+   string key = origin + '\n' + label + '\n' + component;
+   map<string, bool>::const_iterator it = _supportedTuples.find(key);
+   if (it != _supportedTuples.end())
+      return it->second;
 
-      sc=sl=so=false;
+   bool sc, sl, so;
 
-      string component = pkg->component();
-      string label = pkg->label();
-      string origin = pkg->origin();
+   sc=sl=so=false;
 
-      for(unsigned int i=0;i<supportedComponents.size();i++) {
-	 if(supportedComponents[i] == component) {
-	    sc = true;
-	    break;
-	 }
+   for(unsigned int i=0;i<supportedComponents.size();i++) {
+      if(supportedComponents[i] == component) {
+	 sc = true;
+	 break;
       }
-      for(unsigned int i=0;i<supportedLabels.size();i++) {
-	 if(supportedLabels[i] == label) {
-	    sl = true;
-	    break;
-	 }
+   }
+   for(unsigned int i=0;i<supportedLabels.size();i++) {
+      if(supportedLabels[i] == label) {
+	 sl = true;
+	 break;
       }
-      for(unsigned int i=0;i<supportedOrigins.size();i++) {
-	 if(supportedOrigins[i] == origin) {
-	    so = true;
-	    break;
-	 }
+   }
+   for(unsigned int i=0;i<supportedOrigins.size();i++) {
+      if(supportedOrigins[i] == origin) {
+	 so = true;
+	 break;
       }
-
-      res = (sc & sl & so & pkg->isTrusted());
    }
 
+   bool res = sc & sl & so;
+   _supportedTuples[key] = res;
    return res;
 }
 
+bool RPackageStatus::isSupported(RPackage *pkg) 
+{
+   if(!markUnsupported)
+      return true;
+
+   checkTables(pkg);
+   unsigned int id = (*pkg->package())->ID;
+   if (id >= _supported.size())
+      _supported.resize(id + 1, -1);
+   if (_supported[id] < 0) {
+      bool res = isSupportedTuple(pkg->origin(), pkg->label(), pkg->component())
+                 && pkg->isTrusted();
+      _supported[id] = res ? 1 : 0;
+   }
+
+   return _supported[id] == 1;
+}
+
 int RPackageStatus::getStatus(RPackage *pkg)
 {
    int flags = pkg->getFlags();
@@ -190,28 +224,46 @@ int RPackageStatus::getStatus(RPackage *pkg)
    return ret;
 }
 
-bool RPackageStatus::maintenanceEndTime(RPackage *pkg, struct tm *res) 
+time_t RPackageStatus::releaseDate(RPackage *pkg)
 {
-   //cerr << "RPackageStatus::maintenanceEndTime()" << std::endl;
-
-   pkgTagSection sec;
-   time_t release_date = -1;
+   checkTables(pkg);
+   unsigned int id = (*pkg->package())->ID;
+   if (id >= _releaseDates.size())
+      _releaseDates.resize(id + 1, -1);
+   if (_releaseDates[id] != -1)
+      return _releaseDates[id];
 
    string distro = _config->Find("Synaptic::supported-label");
    string releaseFile = pkg->getReleaseFileForOrigin(distro, release);
-   if(!FileExists(releaseFile)) {
-      // happens e.g. when there is no release file and is harmless
-      //cerr << "mainenanceEndTime(): can not find file: " << releaseFile << endl;
-      return false;
+
+   map<string, time_t>::const_iterator it = _releaseFileDates.find(releaseFile);
+   if (it != _releaseFileDates.end())
+      return _releaseDates[id] = it->second;
+
+   time_t release_date = 0;
+   // happens e.g. when there is no release file and is harmless
+   if(FileExists(releaseFile)) {
+      // read the relase file
+      pkgTagSection sec;
+      FileFd fd(releaseFile, FileFd::ReadOnly);
+      pkgTagFile t(&fd);
+      t.Step(sec);
+
+      // get the time_t form the string
+      if(!RFC1123StrToTime(sec.FindS("Date").c_str(), release_date))
+         release_date = 0;
    }
-   
-   // read the relase file
-   FileFd fd(releaseFile, FileFd::ReadOnly);
-   pkgTagFile t(&fd);
-   t.Step(sec);
 
-   // get the time_t form the string
-   if(!RFC1123StrToTime(sec.FindS("Date").c_str(), release_date))
+   _releaseFileDates[releaseFile] = release_date;
+   return _releaseDates[id] = release_date;
+}
+
+bool RPackageStatus::maintenanceEndTime(RPackage *pkg, struct tm *res) 
+{
+   //cerr << "RPackageStatus::maintenanceEndTime()" << std::endl;
+
+   time_t release_date = releaseDate(pkg);
+   if (release_date == 0)
       return false;
 
    // if its not a supported package, return 0 
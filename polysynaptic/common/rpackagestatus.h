@@ -30,6 +30,7 @@
 #define _RPACKAGESTATUS_H_
 
 #include <time.h>
+#include <map>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -60,6 +61,24 @@ class RPackageStatus {
    vector<string> supportedComponents;
    bool markUnsupported;
 
+   // the verdicts of isSupported() and the release dates of
+   // maintenanceEndTime() per package ID, for the candidates of one
+   // cache generation (-1 while not known yet, the dates 0 if there
+   // is none); the candidates of most packages come from a handful of
+   // package files, so the lists above are matched once per (origin,
+   // label, component) tuple and a release file is read only once
+   vector<signed char> _supported;
+   vector<time_t> _releaseDates;
+   unsigned long _tablesGeneration;
+   map<string, bool> _supportedTuples;
+   map<string, time_t> _releaseFileDates;
+
+   // forget the tables if pkg comes from another cache generation
+   void checkTables(RPackage *pkg);
+   bool isSupportedTuple(const string &origin, const string &label,
+                         const string &component);
+   time_t releaseDate(RPackage *pkg);
+
    // this is the short string to load the icons
    const char *PackageStatusShortString[N_STATUS_COUNT];
    // this is the long string for the gui description of the state
@@ -70,7 +89,7 @@ class RPackageStatus {
 
 
  public:
-   RPackageStatus() : markUnsupported(false) {}
+   RPackageStatus() : markUnsupported(false), _tablesGeneration(0) {}
    virtual ~RPackageStatus() {}
 
    // this reads the pixmaps and the colors
@@ -27,6 +27,7 @@
 #include <apt-pkg/configuration.h>
 #include <rpackage.h>
 #include <rpackageview.h>
+#include <rpackagelister.h>
 #include <rconfiguration.h>
 
 #include <map>
@@ -35,16 +36,20 @@
 #include <algorithm>
 
 #include "sections_trans.h"
+#include "rparallel.h"
 
 using namespace std;
 
+// below this many packages per range a thread costs more than it saves
+static const unsigned int MinPackagesPerThread = 2048;
+
 bool RPackageView::setSelected(string name)
 {
    map<string, vector<RPackage *> >::iterator I = _view.find(name);
    if (I != _view.end()) {
       _hasSelection = true;
       _selectedName = name;
-      _selectedView = (*I).second;
+      select((*I).second);
    } else {
       clearSelection();
    }
@@ -63,12 +68,41 @@ vector<string> RPackageView::getSubViews()
 void RPackageView::clear()
 {
    clearSelection();
-   _view.clear();
+   // keep the subviews and their storage for the next refresh()
+   for (map<string, vector<RPackage *> >::iterator I = _view.begin();
+        I != _view.end(); I++)
+      I->second.clear();
+}
+
+void RPackageView::select(const vector<RPackage *> &packages)
+{
+   _selectedView = packages;
+   _selectedSet.clear();
+   for (unsigned int i = 0; i < packages.size(); i++) {
+      if (packages[i])
+         _selectedSet.insert((*packages[i]->package())->ID);
+   }
 }
 
 bool RPackageView::hasPackage(RPackage *pkg)
 {
-   return find(_selectedView.begin(), _selectedView.end(), pkg)  != _selectedView.end();
+   return _selectedSet.contains((*pkg->package())->ID);
+}
+
+void RPackageView::updateSelected(RPackage *pkg, bool selected)
+{
+   unsigned int id = (*pkg->package())->ID;
+   if (selected == _selectedSet.contains(id))
+      return;
+
+   if (selected) {
+      _selectedSet.insert(id);
+      _selectedView.push_back(pkg);
+   } else {
+      _selectedSet.erase(id);
+      _selectedView.erase(find(_selectedView.begin(), _selectedView.end(),
+                               pkg));
+   }
 }
 
 void RPackageView::clearSelection()
@@ -76,25 +110,91 @@ void RPackageView::clearSelection()
    _hasSelection = false;
    _selectedName.clear();
    _selectedView.clear();
+   _selectedSet.clear();
 }
 
 void RPackageView::refresh()
 {
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "RPackageView::refresh(): '%s'\n",
 	       getName().c_str());
 
-   _view.clear();
-   for(unsigned int i=0;i<_all.size();i++) {
-      if(_all[i])
-	 addPackage(_all[i]);
+   // empty the subviews but keep their storage, they usually get
+   // about as many packages as before
+   for (map<string, vector<RPackage *> >::iterator I = _view.begin();
+        I != _view.end(); I++)
+      I->second.clear();
+
+   // the packages are split into ranges, each sorted into buckets of
+   // its own on a thread, and the buckets are appended in range order
+   // so every subview keeps the order of _all. The first range goes
+   // straight into _view. Views are refreshed one at a time, so the
+   // state flags of a package are only ever computed by one thread.
+   unsigned int chunks = RParallelChunks(_all.size(), MinPackagesPerThread);
+   vector<map<string, vector<RPackage *> > > buckets(chunks);
+   RParallelFor(chunks, _all.size(),
+                [this, &buckets](unsigned int c, unsigned int begin,
+                                 unsigned int end) {
+      map<string, vector<RPackage *> > &view = c == 0 ? _view : buckets[c];
+      for (unsigned int i = begin; i < end; i++) {
+         if (_all[i])
+            addTo(view, _all[i]);
+      }
+   });
+   for (unsigned int c = 1; c < chunks; c++) {
+      for (map<string, vector<RPackage *> >::iterator I = buckets[c].begin();
+           I != buckets[c].end(); I++) {
+         vector<RPackage *> &packages = _view[I->first];
+         packages.insert(packages.end(), I->second.begin(), I->second.end());
+      }
+   }
+
+   // drop the subviews nothing landed in this time
+   for (map<string, vector<RPackage *> >::iterator I = _view.begin();
+        I != _view.end();) {
+      if (I->second.empty())
+         _view.erase(I++);
+      else
+         I++;
+   }
+}
+
+void RPackageView::saveSubViews(RViewSnapshot::SubViews &subviews)
+{
+   subviews.clear();
+   for (map<string, vector<RPackage *> >::iterator I = _view.begin();
+        I != _view.end(); I++) {
+      vector<uint32_t> &ids = subviews[I->first];
+      ids.reserve(I->second.size());
+      for (unsigned int i = 0; i < I->second.size(); i++)
+         ids.push_back((*I->second[i]->package())->ID);
    }
 }
 
-void RPackageViewSections::addPackage(RPackage *package)
+bool RPackageView::restoreSubViews(const RViewSnapshot::SubViews &subviews,
+                                   const vector<RPackage *> &byId)
+{
+   map<string, vector<RPackage *> > view;
+   for (RViewSnapshot::SubViews::const_iterator I = subviews.begin();
+        I != subviews.end(); I++) {
+      vector<RPackage *> &packages = view[I->first];
+      packages.reserve(I->second.size());
+      for (unsigned int i = 0; i < I->second.size(); i++) {
+         uint32_t id = I->second[i];
+         if (id >= byId.size() || byId[id] == NULL)
+            return false;
+         packages.push_back(byId[id]);
+      }
+   }
+   _view.swap(view);
+   return true;
+}
+
+void RPackageViewSections::addTo(map<string, vector<RPackage *> > &view,
+                                  RPackage *package)
 {
    string str = trans_section(package->section());
-   _view[str].push_back(package);
+   view[str].push_back(package);
 }
 
 RPackageViewStatus::RPackageViewStatus(vector<RPackage *> &allPkgs)
@@ -113,7 +213,26 @@ RPackageViewStatus::RPackageViewStatus(vector<RPackage *> &allPkgs)
    }
 }
 
-void RPackageViewStatus::addPackage(RPackage *pkg)
+void RPackageViewStatus::addTo(map<string, vector<RPackage *> > &view,
+                                RPackage *pkg)
+{
+   vector<string> names;
+   subViewsOf(pkg, names);
+   for (unsigned int i = 0; i < names.size(); i++)
+      view[names[i]].push_back(pkg);
+}
+
+bool RPackageViewStatus::matches(RPackage *pkg)
+{
+   if (!_hasSelection)
+      return hasPackage(pkg);
+
+   vector<string> names;
+   subViewsOf(pkg, names);
+   return find(names.begin(), names.end(), _selectedName) != names.end();
+}
+
+void RPackageViewStatus::subViewsOf(RPackage *pkg, vector<string> &names)
 {
    string str;
    int flags = pkg->getFlags();
@@ -142,13 +261,13 @@ void RPackageViewStatus::addPackage(RPackage *pkg)
       else
 	 str = _("Not installed");
    }
-   _view[str].push_back(pkg);
+   names.push_back(str);
 
    if ((flags & RPackage::FInstalled) &&
        (flags & RPackage::FIsGarbage))
    {
       str = _("Installed (auto removable)");
-      _view[str].push_back(pkg);
+      names.push_back(str);
    }
 
    if ((flags & RPackage::FInstalled) &&
@@ -156,7 +275,7 @@ void RPackageViewStatus::addPackage(RPackage *pkg)
        !(flags & RPackage::FImportant))
    {
       str = _("Installed (manual)");
-      _view[str].push_back(pkg);
+      names.push_back(str);
    }
 
    str.clear();
@@ -179,23 +298,19 @@ void RPackageViewStatus::addPackage(RPackage *pkg)
    }
 
    if(!str.empty())
-      _view[str].push_back(pkg);
+      names.push_back(str);
 }
 
 
 //------------------------------------------------------------------
 
-void RPackageViewSearch::addPackage(RPackage *pkg)
+string RPackageViewSearch::searchText(RPackage *pkg, int type)
 {
    string str;
    const char *tmp=NULL;
-   bool global_found=true;
-
-   if(!pkg || _currentSearchItem.searchStrings.empty())
-      return;
 
    // build the string
-   switch(_currentSearchItem.searchType) {
+   switch(type) {
    case RPatternPackageFilter::Name:
       tmp = pkg->name();
       break;
@@ -229,6 +344,139 @@ void RPackageViewSearch::addPackage(RPackage *pkg)
    if(tmp!=NULL)
       str = tmp;
 
+   return str;
+}
+
+RTrigramIndex *RPackageViewSearch::searchIndex(int type, OpProgress &progress)
+{
+   // versions are short and rarely searched, not worth the memory;
+   // files have their own index
+   if(type == RPatternPackageFilter::Version ||
+      type == RPatternPackageFilter::Files ||
+      !_config->FindB("Synaptic::SearchTrigramIndex", true))
+      return NULL;
+
+   map<int, RTrigramIndex>::iterator I = _indexes.find(type);
+   if(I != _indexes.end())
+      return &(*I).second;
+
+   // one full pass over the records, paid once per cache open instead
+   // of once per search
+   RTrigramIndex &index = _indexes[type];
+   progress.OverallProgress(0, _all.size(), 1, _("Indexing"));
+   if(type == RPatternPackageFilter::Description ||
+      type == RPatternPackageFilter::Maintainer) {
+      indexRecords(index, type, progress);
+      progress.Done();
+      return &index;
+   }
+   for(unsigned int i=0;i<_all.size();i++) {
+      if(_all[i]) {
+	 progress.Progress(i);
+	 index.add(i, searchText(_all[i], type).c_str());
+      } else {
+	 index.add(i, NULL);
+      }
+   }
+   progress.Done();
+   return &index;
+}
+
+void RPackageViewSearch::indexRecords(RTrigramIndex &index, int type,
+                                      OpProgress &progress)
+{
+   // the same texts searchText() makes, with the records read a block
+   // of packages at a time in file order instead of one seek each; the
+   // block bounds what is held besides the index
+   static const unsigned int BLOCK = 16384;
+   bool descriptions = type == RPatternPackageFilter::Description;
+
+   for(unsigned int begin=0;begin<_all.size();begin+=BLOCK) {
+      unsigned int end = min<size_t>(begin + BLOCK, _all.size());
+      vector<RPackage *> block(_all.begin() + begin, _all.begin() + end);
+      vector<string> summaries(block.size());
+      vector<string> texts(block.size());
+      RPackage::readRecords(block, descriptions,
+			    [&summaries, &texts, descriptions](unsigned int i,
+							       const RRecord &rec) {
+	 if(descriptions) {
+	    summaries[i] = rec.shortDescription();
+	    texts[i] = rec.description();
+	 } else {
+	    texts[i] = rec.field("Maintainer");
+	 }
+      });
+
+      for(unsigned int i=0;i<block.size();i++) {
+	 if(block[i] == NULL) {
+	    index.add(begin + i, NULL);
+	    continue;
+	 }
+	 progress.Progress(begin + i);
+	 if(descriptions) {
+	    string str = block[i]->name();
+	    str += summaries[i];
+	    str += RPackage::formatDescription(texts[i]);
+	    index.add(begin + i, str.c_str());
+	 } else {
+	    index.add(begin + i, texts[i].c_str());
+	 }
+      }
+   }
+}
+
+RPackageViewSearch::RPackageViewSearch(vector<RPackage *> &allPkgs)
+   : RPackageView(allPkgs),
+     _history(_config->FindI("Synaptic::SearchHistorySize", 32)),
+     found(0), _generation(1),
+     _results(_config->FindI("Synaptic::SearchCacheSize", 16))
+{
+}
+
+bool RPackageViewSearch::narrows(const vector<string> &previous,
+                                 const vector<string> &terms)
+{
+   // a text containing every term contains every substring of a term
+   for(unsigned int i=0;i<previous.size();i++) {
+      bool covered = false;
+      for(unsigned int j=0;j<terms.size() && !covered;j++)
+	 covered = strcasestr(terms[j].c_str(), previous[i].c_str()) != NULL;
+      if(!covered)
+	 return false;
+   }
+   return true;
+}
+
+void RPackageViewSearch::addPackage(RPackage *pkg)
+{
+   if(matches(pkg)) {
+      searchItem *item = _history.find(_currentSearchItem.searchName);
+      if(item)
+	 item->matches.insert((*pkg->package())->ID);
+      found++;
+   }
+}
+
+bool RPackageViewSearch::ownsFiles(RPackage *pkg)
+{
+   // foreign architecture lists are called <name>:<arch>.list
+   return _fileOwners.find(pkg->name()) != _fileOwners.end() ||
+          _fileOwners.find(string(pkg->name()) + ":" + pkg->arch()) !=
+          _fileOwners.end();
+}
+
+bool RPackageViewSearch::matches(RPackage *pkg)
+{
+   bool global_found=true;
+
+   if(!pkg || _currentSearchItem.searchStrings.empty())
+      return false;
+
+   if(_currentSearchItem.searchType == RPatternPackageFilter::Files)
+      return ownsFiles(pkg);
+
+   string str = searchText(pkg, _currentSearchItem.searchType);
+
    // find the search pattern in the string "str"
    for(unsigned int i=0;i<_currentSearchItem.searchStrings.size();i++) {
       string searchString = _currentSearchItem.searchStrings[i];
@@ -239,48 +487,53 @@ void RPackageViewSearch::addPackage(RPackage *pkg)
 	 global_found &= false;
       }
    }
-   if(global_found) {
-      _view[_currentSearchItem.searchName].push_back(pkg);
-      found++;
-   }
-
    // FIXME: we push a _lot_ of empty pkgs here :(
    // push a empty package in the view to make sure that the view is actually
    // displayed
    //_view[searchString].push_back(NULL);
+   return global_found;
 }
 
 bool RPackageViewSearch::setSelected(string name)
 {
-   // if we do not have the search name in the current view,
-   // check if we only have it in the searchHistory and if so,
-   // redo the search
-   if (_view.find(name) == _view.end()) {
-      map<string, searchItem>::iterator J = searchHistory.find(name);
-      if (J != searchHistory.end()) {
-	 //cerr << "found in search history, reapplying search" << endl;
-	 string s;
-	 OpProgress progress;
-	 for(int i=0;i < (*J).second.searchStrings.size();i++)
-	    s += string(" ") + (*J).second.searchStrings[i];
-	 // do search but do not add to history (we have it there already)
-	 setSearch((*J).second.searchName, (*J).second.searchType, s,
-		   // FIXME: re-use progress from setSearch()
-		   progress);
-      }
+   searchItem *item = _history.find(name);
+   if (item == NULL) {
+      clearSelection();
+      return false;
+   }
+
+   // a search from before the cache was reopened has to be redone,
+   // its ids may mean other packages now
+   if (item->generation != _generation) {
+      string s;
+      OpProgress progress;
+      for(unsigned int i=0;i < item->searchStrings.size();i++)
+	 s += string(" ") + item->searchStrings[i];
+      // FIXME: re-use progress from setSearch()
+      setSearch(item->searchName, item->searchType, s, progress);
+      item = _history.find(name);
    }
 
-   // call parent
-   return RPackageView::setSelected(name);
+   // the packages of the set, in the order of _all
+   vector<RPackage *> packages;
+   packages.reserve(item->matches.count());
+   for(unsigned int i=0;i<_all.size();i++) {
+      if(_all[i] && item->matches.contains((*_all[i]->package())->ID))
+	 packages.push_back(_all[i]);
+   }
+   select(packages);
+   _hasSelection = true;
+   _selectedName = name;
+   return true;
 }
 
 vector<string> RPackageViewSearch::getSubViews()
 {
    vector<string> subviews;
-   for(map<string, searchItem>::iterator I = searchHistory.begin();
-       I != searchHistory.end();
-       I++)
-     subviews.push_back((*I).first);
+   for(RSearchCache<searchItem>::const_iterator I = _history.begin();
+       I != _history.end(); I++)
+      subviews.push_back(I->first);
+   sort(subviews.begin(), subviews.end());
    return subviews;
 }
 
@@ -294,7 +547,6 @@ int RPackageViewSearch::setSearch(string aSearchName,
    _currentSearchItem.searchType = type;
    _currentSearchItem.searchName = aSearchName;
 
-   _view[_currentSearchItem.searchName].clear();
    _currentSearchItem.searchStrings.clear();
 
    // tokenize the str and add to the searchString vector
@@ -305,24 +557,90 @@ int RPackageViewSearch::setSearch(string aSearchName,
       _currentSearchItem.searchStrings.push_back(s);
    }
 
-   // overwrite existing ones
-   searchHistory[aSearchName] =  _currentSearchItem;
-
-   // setup search progress (0 done, _all.size() in total, 1 subtask)
-   searchProgress.OverallProgress(0, _all.size(), 1, _("Searching"));
-   // reapply search when a new search strng is given
-   for(unsigned int i=0;i<_all.size();i++)
-     if(_all[i]) {
-       searchProgress.Progress(i);
-       addPackage(_all[i]);
-     }
+   vector<string> &terms = _currentSearchItem.searchStrings;
+
+   // the packages found go into the history entry as ids only; the
+   // selection is made from them in setSelected()
+   _currentSearchItem.matches.clear();
+   _currentSearchItem.generation = _generation;
+   RPackageSet &view = _currentSearchItem.matches;
+
+   if(type == RPatternPackageFilter::Files) {
+      // the paths containing every term, looked up in the file index;
+      // matches() then only asks whether a package owns one of them
+      _fileOwners.clear();
+      RPackage *any = NULL;
+      for(unsigned int i=0;i<_all.size() && any == NULL;i++)
+	 any = _all[i];
+      if(any)
+	 any->_lister->fileIndex()->ownersContaining(terms, _fileOwners);
+   }
+
+   // the same search again (e.g. after a backspace): replay it
+   stringstream key;
+   key << type;
+   for(unsigned int i=0;i<terms.size();i++)
+      key << ' ' << terms[i];
+   searchResult *cached = _results.find(key.str());
+   if(cached) {
+      for(unsigned int i=0;i<cached->matches.size();i++)
+	 view.insert((*_all[cached->matches[i]]->package())->ID);
+      found = cached->matches.size();
+      // overwrite existing ones
+      _history.put(aSearchName, _currentSearchItem);
+      return found;
+   }
+
+   // candidate positions in _all; either the smallest earlier result
+   // this search refines ("fire" -> "firef"), or what the trigram
+   // index lets through, or everything. addPackage()'s exact match
+   // decides for each candidate
+   const vector<unsigned int> *base = NULL;
+   for(RSearchCache<searchResult>::const_iterator I = _results.begin();
+       I != _results.end() && type != RPatternPackageFilter::Files; I++) {
+      const searchResult &r = I->second;
+      if(r.searchType == type && narrows(r.searchStrings, terms) &&
+	 (base == NULL || r.matches.size() < base->size()))
+	 base = &r.matches;
+   }
+
+   vector<unsigned int> candidates;
+   bool all = false;
+   if(base != NULL) {
+      candidates = *base;
+   } else {
+      RTrigramIndex *index = searchIndex(type, searchProgress);
+      all = !(index && index->size() == _all.size() &&
+	      index->candidates(terms, candidates));
+   }
+
+   searchResult result;
+   result.searchType = type;
+   result.searchStrings = terms;
+
+   unsigned int total = all ? _all.size() : candidates.size();
+   // setup search progress (0 done, total, 1 subtask)
+   searchProgress.OverallProgress(0, total, 1, _("Searching"));
+   for(unsigned int i=0;i<total;i++) {
+      unsigned int pos = all ? i : candidates[i];
+      searchProgress.Progress(i);
+      if(matches(_all[pos])) {
+	 view.insert((*_all[pos]->package())->ID);
+	 result.matches.push_back(pos);
+      }
+   }
    searchProgress.Done();
+
+   found = result.matches.size();
+   _results.put(key.str(), result);
+   // overwrite existing ones
+   _history.put(aSearchName, _currentSearchItem);
    return found;
 }
 //------------------------------------------------------------------
 
 RPackageViewFilter::RPackageViewFilter(vector<RPackage *> &allPkgs)
-   : RPackageView(allPkgs)
+   : RPackageView(allPkgs), _generation(1)
 {
    // restore the filters
    restoreFilters();
@@ -331,6 +649,13 @@ RPackageViewFilter::RPackageViewFilter(vector<RPackage *> &allPkgs)
 }
 
 void RPackageViewFilter::refreshFilters()
+{
+   // the filters may have been edited
+   _results.clear();
+   buildSubViews();
+}
+
+void RPackageViewFilter::buildSubViews()
 {
    _view.clear();
 
@@ -361,23 +686,36 @@ RPackageViewFilter::iterator RPackageViewFilter::begin()
    RFilter *filter = findFilter(name);
 
    if(filter != NULL) {
-      _view[name].clear();
-
-      for(unsigned int i=0;i<_all.size();i++) {
-	 if(_all[i] && filter->apply(_all[i]))
-	    _view[name].push_back(_all[i]);
+      // a new entry starts out at generation 0, which is never current
+      filterResult &result = _results[filter];
+      if (result.generation != _generation) {
+         result.generation = _generation;
+         result.packages.clear();
+         for(unsigned int i=0;i<_all.size();i++) {
+            if(_all[i] && filter->apply(_all[i]))
+               result.packages.push_back(_all[i]);
+         }
       }
-      _selectedView = _view[name];
+      _view[name] = result.packages;
+      select(result.packages);
    }
 
    return _selectedView.begin();
 }
 
+bool RPackageViewFilter::matches(RPackage *pkg)
+{
+   RFilter *filter = findFilter(_selectedName);
+   if (!_hasSelection || filter == NULL)
+      return hasPackage(pkg);
+   return filter->apply(pkg);
+}
+
 void RPackageViewFilter::refresh()
 {
    //cout << "RPackageViewFilter::refresh() " << endl;
 
-   refreshFilters();
+   buildSubViews();
 }
 
 
@@ -466,6 +804,7 @@ void RPackageViewFilter::unregisterFilter(RFilter *filter)
         I != _filterL.end(); I++) {
       if (*I == filter) {
          _filterL.erase(I);
+         _results.erase(filter);
          return;
       }
    }
@@ -568,7 +907,8 @@ void RPackageViewFilter::makePresetFilters()
    registerFilter(filter);
 }
 
-void RPackageViewOrigin::addPackage(RPackage *package)
+void RPackageViewOrigin::addTo(map<string, vector<RPackage *> > &view,
+                               RPackage *package)
 {
    string subview;
    string component =  package->component();
@@ -590,7 +930,7 @@ void RPackageViewOrigin::addPackage(RPackage *package)
          if (package->getFlags() & RPackage::FNotInstallable)
          {
             origin_url = _("Local");
-            _view[origin_url].push_back(package);
+            view[origin_url].push_back(package);
          }
          continue;
       }
@@ -602,7 +942,7 @@ void RPackageViewOrigin::addPackage(RPackage *package)
          string suite = *it2;
          // PPAs are special too
          if(origin_str.find("LP-PPA-") != string::npos) {
-            _view[origin_str+"/"+suite].push_back(package);
+            view[origin_str+"/"+suite].push_back(package);
             continue;
          }
 
@@ -614,7 +954,7 @@ void RPackageViewOrigin::addPackage(RPackage *package)
 
          // normal package
          subview = suite+"/"+component+" ("+origin_url+")";
-         _view[subview].push_back(package);
+         view[subview].push_back(package);
       }
 
       // see if we have versions that are higher than the candidate
@@ -639,21 +979,23 @@ void RPackageViewOrigin::addPackage(RPackage *package)
          string suite = VF.File().Archive();
          string origin_url = VF.File().Site();
          string subview = prefix + suite + "(" + origin_url + ")";
-         _view[subview].push_back(package);
+         view[subview].push_back(package);
       }
    }
 }
 
 
-void RPackageViewArchitecture::addPackage(RPackage *package)
+void RPackageViewArchitecture::addTo(map<string, vector<RPackage *> > &view,
+                                     RPackage *package)
 {
    string arch = "arch: " + package->arch();
 
-   // FIXME: add pseudo arch for packages only in one group arch
-   //        but not the other
-
+   view[arch].push_back(package);
 
-   _view[arch].push_back(package);
+   // names no other architecture has, as openCache() grouped them
+   RPackageLister *lister = package->_lister;
+   if (lister->hasMultiArchGroups() && lister->getArchSiblings(package).empty())
+      view[arch + " only"].push_back(package);
 }
 
 
@@ -35,6 +35,10 @@
 
 #include "rpackage.h"
 #include "rpackagefilter.h"
+#include "rtrigramindex.h"
+#include "rsearchcache.h"
+#include "rpackageset.h"
+#include "rviewsnapshot.h"
 
 #include "i18n.h"
 
@@ -59,12 +63,22 @@ class RPackageView {
    bool _hasSelection;
    string _selectedName;
 
-   // packages in selected
+   // packages in selected, and the same as a set of package ids
    vector<RPackage *> _selectedView;
+   RPackageSet _selectedSet;
 
    // all packages in current global filter
    vector<RPackage *> &_all;
 
+   // make packages the current selection
+   void select(const vector<RPackage *> &packages);
+
+   // put package into its subviews in view; refresh() calls this from
+   // several threads at once, each with its own view and range of
+   // packages, so it must not change anything but view
+   virtual void addTo(map<string, vector<RPackage *> > &view,
+                      RPackage *package) {}
+
  public:
    RPackageView(vector<RPackage *> &allPackages): _all(allPackages) {}
    virtual ~RPackageView() {}
@@ -75,7 +89,7 @@ class RPackageView {
    virtual bool setSelected(string name);
 
    void showAll() {
-      _selectedView = _all;
+      select(_all);
       _hasSelection = false;
       _selectedName.clear();
    }
@@ -83,17 +97,46 @@ class RPackageView {
    virtual vector<string> getSubViews();
 
    virtual string getName() = 0;
-   virtual void addPackage(RPackage *package) = 0;
+   virtual void addPackage(RPackage *package) { addTo(_view, package); }
 
    typedef vector<RPackage *>::iterator iterator;
 
    virtual iterator begin() { return _selectedView.begin(); }
    virtual iterator end() { return _selectedView.end(); }
 
+   // the packages between begin() and end(), valid after begin()
+   const RPackageSet &getSelectedSet() { return _selectedSet; }
+
+   // every package the subviews are made of
+   const vector<RPackage *> &allPackages() { return _all; }
+
    virtual void clear();
    virtual void clearSelection();
 
+   // rebuild the subviews from all packages
    virtual void refresh();
+
+   // whether marking a package can move it in or out of a subview
+   virtual bool stateDependent() { return false; }
+
+   // whether the subviews only depend on the cache, so the ones of
+   // the last open can be kept in an RViewSnapshot
+   virtual bool snapshotable() { return false; }
+
+   // the subviews as package ids
+   void saveSubViews(RViewSnapshot::SubViews &subviews);
+   // instead of refresh(): take the subviews from a snapshot, byId
+   // giving the package of every id. False, with the view left as it
+   // was, if an id has no package
+   bool restoreSubViews(const RViewSnapshot::SubViews &subviews,
+                        const vector<RPackage *> &byId);
+
+   // whether pkg belongs to the selection given its current state;
+   // only differs from hasPackage() for state dependent views
+   virtual bool matches(RPackage *pkg) { return hasPackage(pkg); }
+
+   // add pkg to or drop it from the selection, without rebuilding it
+   void updateSelected(RPackage *pkg, bool selected);
 };
 
 
@@ -106,7 +149,10 @@ class RPackageViewSections : public RPackageView {
       return _("Sections");
    };
 
-   void addPackage(RPackage *package);
+   bool snapshotable() { return true; }
+
+ protected:
+   void addTo(map<string, vector<RPackage *> > &view, RPackage *package);
 };
 
 class RPackageViewAlphabetic : public RPackageView {
@@ -116,10 +162,11 @@ class RPackageViewAlphabetic : public RPackageView {
       return _("Alphabetic");
    }
 
-   void addPackage(RPackage *package) {
+ protected:
+   void addTo(map<string, vector<RPackage *> > &view, RPackage *package) {
       char letter[2] = { ' ', '\0' };
       letter[0] = toupper(package->name()[0]);
-      _view[letter].push_back(package);
+      view[letter].push_back(package);
    }
 };
 
@@ -130,7 +177,10 @@ class RPackageViewArchitecture : public RPackageView {
       return _("Architecture");
    }
 
-   void addPackage(RPackage *package);
+   bool snapshotable() { return true; }
+
+ protected:
+   void addTo(map<string, vector<RPackage *> > &view, RPackage *package);
 };
 
 class RPackageViewOrigin : public RPackageView {
@@ -140,7 +190,10 @@ class RPackageViewOrigin : public RPackageView {
       return _("Origin");
    }
 
-   void addPackage(RPackage *package);
+   bool snapshotable() { return true; }
+
+ protected:
+   void addTo(map<string, vector<RPackage *> > &view, RPackage *package);
 };
 
 class RPackageViewStatus:public RPackageView {
@@ -149,6 +202,11 @@ class RPackageViewStatus:public RPackageView {
    bool markUnsupported;
    vector<string> supportedComponents;
 
+   // the subviews a package with its current state goes into
+   void subViewsOf(RPackage *pkg, vector<string> &names);
+
+   void addTo(map<string, vector<RPackage *> > &view, RPackage *package);
+
  public:
    RPackageViewStatus(vector<RPackage *> &allPkgs);
 
@@ -156,7 +214,8 @@ class RPackageViewStatus:public RPackageView {
       return _("Status");
    }
 
-   void addPackage(RPackage *package);
+   bool stateDependent() { return true; }
+   bool matches(RPackage *pkg);
 };
 
 class RPackageViewSearch : public RPackageView {
@@ -164,17 +223,51 @@ class RPackageViewSearch : public RPackageView {
       vector<string> searchStrings;
       string searchName;
       int searchType;
+      // the ids of the packages found, valid while generation is the
+      // view's; a stale entry is searched again when selected
+      RPackageSet matches;
+      unsigned int generation;
    };
-   // the search history
-   map<string, searchItem> searchHistory;
+   // the search history by name, the least recently used dropped past
+   // Synaptic::SearchHistorySize
+   RSearchCache<searchItem> _history;
    searchItem _currentSearchItem;
    int found; // nr of found pkgs for the last search
 
+   // bumped by clear(), as the ids of a new cache need not be the same
+   unsigned int _generation;
+
+   // trigram indexes over _all, one per search type, built on the first
+   // search of that type after a cache (re)open
+   map<int, RTrigramIndex> _indexes;
+
+   // the matches (positions in _all) of the last few searches
+   struct searchResult {
+      int searchType;
+      vector<string> searchStrings;
+      vector<unsigned int> matches;
+   };
+   RSearchCache<searchResult> _results;
+
+   // the owners of the files the last "Files" search matched
+   set<string> _fileOwners;
+   bool ownsFiles(RPackage *pkg);
+
    bool xapianSearch();
 
+   // the text a search of the given type matches against
+   static string searchText(RPackage *pkg, int type);
+   RTrigramIndex *searchIndex(int type, OpProgress &progress);
+   // searchIndex() of the types whose text comes from the records
+   void indexRecords(RTrigramIndex &index, int type, OpProgress &progress);
+   bool matches(RPackage *pkg);
+
+   // true if everything matching "terms" also matches "previous"
+   static bool narrows(const vector<string> &previous,
+                       const vector<string> &terms);
+
  public:
- RPackageViewSearch(vector<RPackage *> &allPkgs)
-    : RPackageView(allPkgs), found(0) {}
+   RPackageViewSearch(vector<RPackage *> &allPkgs);
 
    int setSearch(string searchName, int type, string searchString,
 		 OpProgress &searchProgress);
@@ -189,6 +282,15 @@ class RPackageViewSearch : public RPackageView {
 
    void addPackage(RPackage *package);
 
+   // called when the cache is reopened; _all is rebuilt afterwards
+   virtual void clear() {
+      RPackageView::clear();
+      _view.clear();
+      _indexes.clear();
+      _results.clear();
+      _generation++;
+   }
+
    // no-op
    virtual void refresh() {}
 };
@@ -199,6 +301,17 @@ class RPackageViewFilter : public RPackageView {
    vector<RFilter *> _filterL;
    set<string> _sectionList;   // list of all available package sections
 
+   // the last result of each filter and the generation it was
+   // computed in; begin() reuses it while the generation is the same
+   struct filterResult {
+      unsigned long generation;
+      vector<RPackage *> packages;
+   };
+   map<RFilter *, filterResult> _results;
+   unsigned long _generation;
+
+   void buildSubViews();
+
  public:
    void storeFilters();
    void restoreFilters();
@@ -206,6 +319,9 @@ class RPackageViewFilter : public RPackageView {
    void refreshFilters();
    void refresh();
 
+   // the marks or the cache changed, so every filter result may have
+   void bumpGeneration() { _generation++; }
+
    bool registerFilter(RFilter *filter);
    void unregisterFilter(RFilter *filter);
 
@@ -234,6 +350,10 @@ class RPackageViewFilter : public RPackageView {
    // we never need to clear because we build the view "on-demand"
    virtual void clear() { clearSelection(); }
 
+   // filters may test the package status
+   bool stateDependent() { return true; }
+   bool matches(RPackage *pkg);
+
    string getName() {
       return _("Custom");
    }
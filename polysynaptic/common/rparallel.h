@@ -0,0 +1,105 @@
+/* rparallel.h - Split a loop over package ids across threads
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RPARALLEL_H
+#define RPARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// how many ranges to cut count items into: one per core at most (or
+// per thread, if given), and none shorter than minPerChunk
+inline unsigned int RParallelChunks(unsigned int count,
+                                    unsigned int minPerChunk,
+                                    unsigned int threads = 0)
+{
+   if (threads == 0)
+      threads = thread::hardware_concurrency();
+   unsigned int chunks = count / minPerChunk;
+   if (chunks > threads)
+      chunks = threads;
+   return chunks > 0 ? chunks : 1;
+}
+
+// call f(chunk, begin, end) for chunks consecutive ranges covering
+// [0, count), each on its own thread; chunk 0 runs on the calling
+// thread. Returns when all of them are done, so results the callers
+// keep per chunk can be merged in chunk order afterwards.
+template<class F>
+void RParallelFor(unsigned int chunks, unsigned int count, F f)
+{
+   vector<thread> workers;
+   for (unsigned int c = 1; c < chunks; c++) {
+      unsigned int begin = (unsigned long long)count * c / chunks;
+      unsigned int end = (unsigned long long)count * (c + 1) / chunks;
+      workers.push_back(thread([&f, c, begin, end]() { f(c, begin, end); }));
+   }
+   f(0, 0, (unsigned int)((unsigned long long)count / chunks));
+   for (unsigned int c = 0; c < workers.size(); c++)
+      workers[c].join();
+}
+
+// sort v by less, as sort() would: ranges of at least minPerChunk
+// items are sorted on their own threads and merged pairwise after, so
+// less is called from several threads and must only read
+template<class T, class Less>
+void RParallelSort(vector<T> &v, Less less, unsigned int minPerChunk)
+{
+   unsigned int count = v.size();
+   unsigned int chunks = RParallelChunks(count, minPerChunk);
+   if (chunks == 1) {
+      sort(v.begin(), v.end(), less);
+      return;
+   }
+
+   RParallelFor(chunks, count,
+                [&v, &less](unsigned int, unsigned int begin, unsigned int end) {
+      sort(v.begin() + begin, v.begin() + end, less);
+   });
+
+   // the same bounds RParallelFor cut the ranges at
+   vector<unsigned int> bounds;
+   for (unsigned int c = 0; c < chunks; c++)
+      bounds.push_back((unsigned long long)count * c / chunks);
+   bounds.push_back(count);
+
+   while (bounds.size() > 2) {
+      vector<unsigned int> merged;
+      unsigned int i;
+      for (i = 0; i + 2 < bounds.size(); i += 2) {
+         inplace_merge(v.begin() + bounds[i], v.begin() + bounds[i + 1],
+                       v.begin() + bounds[i + 2], less);
+         merged.push_back(bounds[i]);
+      }
+      // an odd range out waits for the next round
+      if (i + 1 < bounds.size())
+         merged.push_back(bounds[i]);
+      merged.push_back(count);
+      bounds.swap(merged);
+   }
+}
+
+#endif
+
+// vim:ts=3:sw=3:et
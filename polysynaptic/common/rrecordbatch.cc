@@ -0,0 +1,123 @@
+/* rrecordbatch.cc - Many package records read in file order
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#include "rrecordbatch.h"
+#include "rparallel.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <apt-pkg/pkgrecords.h>
+
+// below this many records per thread another pkgRecords (which opens
+// every package file) costs more than it saves
+static const unsigned int MIN_RECORDS_PER_READER = 2048;
+
+
+void RRecordBatch::add(unsigned int index, pkgCache::VerFileIterator file)
+{
+   if (file.end())
+      return;
+   Request r;
+   r.file = file.File()->ID;
+   r.offset = file->Offset;
+   r.index = index;
+   r.record = file - _cache.VerFileP;
+   r.description = false;
+   _requests.push_back(r);
+}
+
+void RRecordBatch::add(unsigned int index, pkgCache::DescFileIterator file)
+{
+   if (file.end())
+      return;
+   Request r;
+   r.file = file.File()->ID;
+   r.offset = file->Offset;
+   r.index = index;
+   r.record = file - _cache.DescFileP;
+   r.description = true;
+   _requests.push_back(r);
+}
+
+void RRecordBatch::readAhead() const
+{
+#ifdef POSIX_FADV_WILLNEED
+   // the span of every file the batch reads in; the kernel pages it in
+   // while the first records are parsed. Compressed indexes have other
+   // offsets than their files, there the hint is merely wasted
+   for (unsigned int i = 0; i < _requests.size();) {
+      unsigned int j = i;
+      while (j + 1 < _requests.size() && _requests[j + 1].file == _requests[i].file)
+         j++;
+
+      pkgCache::PkgFileIterator file(_cache, _cache.PkgFileP + _requests[i].file);
+      if (!file.end() && file.FileName() != NULL) {
+         int fd = open(file.FileName(), O_RDONLY);
+         if (fd >= 0) {
+            posix_fadvise(fd, _requests[i].offset,
+                          _requests[j].offset - _requests[i].offset + 65536,
+                          POSIX_FADV_WILLNEED);
+            close(fd);
+         }
+      }
+      i = j + 1;
+   }
+#endif
+}
+
+void RRecordBatch::read(const Handler &handle, unsigned int threads)
+{
+   sort(_requests.begin(), _requests.end(),
+        [](const Request &a, const Request &b) {
+      if (a.file != b.file)
+         return a.file < b.file;
+      return a.offset < b.offset;
+   });
+
+   readAhead();
+
+   unsigned int count = _requests.size();
+   unsigned int chunks = RParallelChunks(count, MIN_RECORDS_PER_READER, threads);
+   pkgCache &cache = _cache;
+   const vector<Request> &requests = _requests;
+   RParallelFor(chunks, count,
+                [&cache, &requests, &handle](unsigned int, unsigned int begin,
+                                             unsigned int end) {
+      pkgRecords records(cache);
+      for (unsigned int i = begin; i < end; i++) {
+         const Request &r = requests[i];
+         pkgRecords::Parser *parser;
+         if (r.description)
+            parser = &records.Lookup(pkgCache::DescFileIterator(cache, cache.DescFileP + r.record));
+         else
+            parser = &records.Lookup(pkgCache::VerFileIterator(cache, cache.VerFileP + r.record));
+
+         const char *start, *stop;
+         parser->GetRec(start, stop);
+         RRecord record(start ? string(start, stop - start) : string());
+         handle(r.index, record);
+      }
+   });
+}
+
+// vim:ts=3:sw=3:et
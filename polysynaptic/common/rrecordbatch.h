@@ -0,0 +1,83 @@
+/* rrecordbatch.h - Many package records read in file order
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#ifndef RRECORDBATCH_H
+#define RRECORDBATCH_H
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include <apt-pkg/pkgcache.h>
+
+#include "rrecordcache.h"
+
+using namespace std;
+
+// The records of many versions, read in the order they are in the
+// package files instead of the order they were asked for. Searches,
+// scans and exports go over the packages by name, which jumps all over
+// the Packages files; on a cold page cache every record is a seek.
+// Here the requests are sorted by (file, offset), the files are told
+// to read ahead over the span asked for, and the sorted requests are
+// split into ranges read by threads of their own, each with its own
+// pkgRecords.
+//
+// Like the pkgCache iterators it holds, a batch is only valid while
+// the cache it was made for stays open.
+class RRecordBatch {
+ public:
+   typedef function<void(unsigned int, const RRecord &)> Handler;
+
+   explicit RRecordBatch(pkgCache &cache) : _cache(cache) {}
+
+   // ask for a record as number index; the same index may be asked for
+   // more than once, under different records
+   void add(unsigned int index, pkgCache::VerFileIterator file);
+   void add(unsigned int index, pkgCache::DescFileIterator file);
+
+   unsigned int size() const { return _requests.size(); }
+
+   // handle(index, record) for every request, with up to threads
+   // readers (0 for one per core, fewer when there is little to read).
+   // handle is called from all of them at once, in file order within
+   // each, and must only touch what belongs to its index.
+   void read(const Handler &handle, unsigned int threads = 0);
+
+ private:
+   struct Request {
+      uint32_t file;
+      uint32_t offset;
+      uint32_t index;
+      uint32_t record;      // into cache.VerFileP or cache.DescFileP
+      bool description;
+   };
+
+   void readAhead() const;
+
+   pkgCache &_cache;
+   vector<Request> _requests;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
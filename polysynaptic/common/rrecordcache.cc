@@ -0,0 +1,233 @@
+/* rrecordcache.cc - Package records parsed once into their fields
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#include "rrecordcache.h"
+
+#include <cctype>
+#include <cstring>
+#include <strings.h>
+
+static bool isBlank(char c)
+{
+   return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+RRecord::RRecord(const string &text)
+   : _text(text)
+{
+   size_t size = _text.size();
+   size_t pos = 0;
+   while (pos < size) {
+      size_t eol = _text.find('\n', pos);
+      if (eol == string::npos)
+         eol = size;
+
+      // an empty line ends the record
+      if (eol == pos)
+         break;
+
+      if (isBlank(_text[pos])) {
+         // continuation of the field before
+         if (!_fields.empty()) {
+            Field &f = _fields.back();
+            f.valueLength = eol - f.value;
+         }
+      } else {
+         size_t colon = _text.find(':', pos);
+         if (colon != string::npos && colon < eol) {
+            Field f;
+            f.name = pos;
+            f.nameLength = colon - pos;
+            size_t value = colon + 1;
+            while (value < eol && isBlank(_text[value]))
+               value++;
+            f.value = value;
+            f.valueLength = eol - value;
+            _fields.push_back(f);
+         }
+      }
+      pos = eol + 1;
+   }
+
+   for (Field &f : _fields) {
+      while (f.valueLength > 0 && isspace((unsigned char) _text[f.value + f.valueLength - 1]))
+         f.valueLength--;
+   }
+   _fields.shrink_to_fit();
+}
+
+const RRecord::Field *RRecord::find(const char *name) const
+{
+   size_t length = strlen(name);
+   for (const Field &f : _fields) {
+      if (f.nameLength == length &&
+          strncasecmp(_text.c_str() + f.name, name, length) == 0)
+         return &f;
+   }
+   return NULL;
+}
+
+string RRecord::field(const char *name) const
+{
+   const Field *f = find(name);
+   return f ? value(*f) : string();
+}
+
+string RRecord::description() const
+{
+   static const char prefix[] = "Description";
+   static const size_t length = sizeof(prefix) - 1;
+
+   for (const Field &f : _fields) {
+      const char *name = _text.c_str() + f.name;
+      if (f.nameLength < length || strncasecmp(name, prefix, length) != 0)
+         continue;
+      if (f.nameLength == length)
+         return value(f);
+      // Description-de, not Description-md5
+      if (name[length] == '-' && !(f.nameLength == length + 4 &&
+                                   strncasecmp(name + length, "-md5", 4) == 0))
+         return value(f);
+   }
+   return string();
+}
+
+string RRecord::shortDescription() const
+{
+   string descr = description();
+   size_t eol = descr.find('\n');
+   if (eol != string::npos)
+      descr.erase(eol);
+   return descr;
+}
+
+string RRecord::sourcePackage() const
+{
+   string source = field("Source");
+   size_t end = source.find_first_of(" (");
+   if (end != string::npos)
+      source.erase(end);
+   return source;
+}
+
+size_t RRecord::memoryBytes() const
+{
+   return sizeof(*this) + PolySynaptic::heapBytes(_text) +
+          _fields.capacity() * sizeof(Field);
+}
+
+
+RRecordCache::RRecordCache(unsigned int capacity)
+   : _capacity(capacity), _bytes(0), _hits(0), _misses(0)
+{
+   _account.assign("package record cache",
+      [this](PolySynaptic::MemoryUsage &usage) {
+         lock_guard<std::mutex> lock(_mutex);
+         usage.bytes = _bytes;
+         usage.items = _entries.size();
+      },
+      [this]() {
+         lock_guard<std::mutex> lock(_mutex);
+         uint64_t freed = _bytes;
+         _entries.clear();
+         _index.clear();
+         _bytes = 0;
+         return freed;
+      });
+}
+
+RRecordCache::RecordPtr RRecordCache::get(uint64_t key,
+                                          const function<string()> &read)
+{
+   {
+      lock_guard<std::mutex> lock(_mutex);
+      auto it = _index.find(key);
+      if (it != _index.end()) {
+         _entries.splice(_entries.begin(), _entries, it->second);
+         _hits++;
+         return _entries.front().second;
+      }
+      _misses++;
+   }
+
+   // read outside the lock; the index files may have to be paged in
+   RecordPtr record = make_shared<const RRecord>(read());
+
+   lock_guard<std::mutex> lock(_mutex);
+   if (_capacity == 0 || _index.count(key) > 0)
+      return record;
+   _entries.push_front(make_pair(key, record));
+   _index[key] = _entries.begin();
+   _bytes += record->memoryBytes();
+   evictLocked();
+   return record;
+}
+
+void RRecordCache::evictLocked()
+{
+   while (_entries.size() > _capacity) {
+      _bytes -= _entries.back().second->memoryBytes();
+      _index.erase(_entries.back().first);
+      _entries.pop_back();
+   }
+}
+
+void RRecordCache::setCapacity(unsigned int capacity)
+{
+   lock_guard<std::mutex> lock(_mutex);
+   _capacity = capacity;
+   evictLocked();
+}
+
+void RRecordCache::clear()
+{
+   lock_guard<std::mutex> lock(_mutex);
+   _entries.clear();
+   _index.clear();
+   _bytes = 0;
+}
+
+unsigned int RRecordCache::size() const
+{
+   lock_guard<std::mutex> lock(_mutex);
+   return _entries.size();
+}
+
+uint64_t RRecordCache::hits() const
+{
+   lock_guard<std::mutex> lock(_mutex);
+   return _hits;
+}
+
+uint64_t RRecordCache::misses() const
+{
+   lock_guard<std::mutex> lock(_mutex);
+   return _misses;
+}
+
+size_t RRecordCache::memoryBytes() const
+{
+   lock_guard<std::mutex> lock(_mutex);
+   return _bytes;
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,122 @@
+/* rrecordcache.h - Package records parsed once into their fields
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RRECORDCACHE_H
+#define RRECORDCACHE_H
+
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memoryusage.h"
+
+using namespace std;
+
+// A control record ("Package: ...\nVersion: ...\n...") split into its
+// fields once. Field names match without regard to case, as in apt;
+// values are what pkgTagSection::FindS() gives, continuation lines
+// included and surrounding blanks dropped.
+class RRecord {
+ public:
+   explicit RRecord(const string &text);
+
+   const string &text() const { return _text; }
+
+   bool has(const char *name) const { return find(name) != NULL; }
+   string field(const char *name) const;
+
+   // the "Description" field, or the translated "Description-xx" one
+   // a Translation file record has instead
+   string description() const;
+   // its first line
+   string shortDescription() const;
+   // the package of "Source: name (version)", "" when there is none
+   string sourcePackage() const;
+
+   size_t memoryBytes() const;
+
+ private:
+   struct Field {
+      uint32_t name;
+      uint32_t nameLength;
+      uint32_t value;
+      uint32_t valueLength;
+   };
+
+   const Field *find(const char *name) const;
+   string value(const Field &f) const { return _text.substr(f.value, f.valueLength); }
+
+   string _text;
+   vector<Field> _fields;
+};
+
+// The records rows, the details window, searches and exports ask
+// RPackage for, by where they are in the index files, so a record is
+// looked up and parsed once however many of its fields are shown. The
+// least recently used go beyond the capacity.
+//
+// Keys are only meaningful for one open cache; owners clear() this
+// whenever it is reopened.
+class RRecordCache {
+ public:
+   typedef shared_ptr<const RRecord> RecordPtr;
+
+   RRecordCache(unsigned int capacity = 2048);
+
+   // the key of the record at offset in package file number file
+   static uint64_t key(unsigned long file, unsigned long offset) {
+      return ((uint64_t) file << 40) ^ offset;
+   }
+
+   // the record at key, calling read() for its text when it is not here
+   RecordPtr get(uint64_t key, const function<string()> &read);
+
+   void setCapacity(unsigned int capacity);
+   void clear();
+
+   unsigned int size() const;
+   uint64_t hits() const;
+   uint64_t misses() const;
+   size_t memoryBytes() const;
+
+ private:
+   typedef list<pair<uint64_t, RecordPtr> > entries;
+
+   void evictLocked();
+
+   mutable std::mutex _mutex;
+   entries _entries;     // most recently used first
+   unordered_map<uint64_t, entries::iterator> _index;
+   unsigned int _capacity;
+   size_t _bytes;
+   uint64_t _hits;
+   uint64_t _misses;
+   PolySynaptic::MemoryAccount _account;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,100 @@
+/* rsearchcache.h - Bounded LRU of recent search results
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RSEARCHCACHE_H
+#define RSEARCHCACHE_H
+
+#include <string>
+#include <list>
+#include <utility>
+
+using namespace std;
+
+// Keeps the results of the last few queries so that repeating one (the
+// user backspacing in the search entry) does not search again. The
+// most recently used entry comes first; iterating in that order lets a
+// caller find the latest result a new query refines.
+//
+// The cached values usually point into the package cache, so owners
+// clear() this whenever the cache is reopened.
+template<class T>
+class RSearchCache {
+ public:
+   typedef list<pair<string, T> > entries;
+   typedef typename entries::const_iterator const_iterator;
+
+   RSearchCache(unsigned int capacity = 16) : _capacity(capacity) {}
+
+   // the cached value for key (and mark it used), or NULL
+   T *find(const string &key) {
+      for (typename entries::iterator I = _entries.begin();
+           I != _entries.end(); I++) {
+         if (I->first == key) {
+            _entries.splice(_entries.begin(), _entries, I);
+            return &_entries.front().second;
+         }
+      }
+      return NULL;
+   }
+
+   // store a value, evicting the least recently used one when full
+   void put(const string &key, const T &value) {
+      if (_capacity == 0)
+         return;
+      if (find(key) != NULL) {
+         _entries.front().second = value;
+         return;
+      }
+      _entries.push_front(make_pair(key, value));
+      if (_entries.size() > _capacity)
+         _entries.pop_back();
+   }
+
+   void setCapacity(unsigned int capacity) {
+      _capacity = capacity;
+      while (_entries.size() > _capacity)
+         _entries.pop_back();
+   }
+
+   void erase(const string &key) {
+      for (typename entries::iterator I = _entries.begin();
+           I != _entries.end(); I++) {
+         if (I->first == key) {
+            _entries.erase(I);
+            return;
+         }
+      }
+   }
+
+   void clear() { _entries.clear(); }
+   unsigned int size() const { return _entries.size(); }
+
+   const_iterator begin() const { return _entries.begin(); }
+   const_iterator end() const { return _entries.end(); }
+
+ private:
+   entries _entries;
+   unsigned int _capacity;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
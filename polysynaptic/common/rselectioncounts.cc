@@ -0,0 +1,86 @@
+/* rselectioncounts.cc - What the selected packages allow, counted as it changes
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#include "rselectioncounts.h"
+
+RSelectionCounts::RSelectionCounts()
+{
+   clear();
+}
+
+void RSelectionCounts::account(unsigned int mask, int delta)
+{
+   for (unsigned int bit = 0; bit < BITS; bit++) {
+      if (mask & (1u << bit))
+         _counts[bit] += delta;
+   }
+}
+
+void RSelectionCounts::add(const void *key, unsigned int mask)
+{
+   unordered_map<const void *, unsigned int>::iterator it = _masks.find(key);
+   if (it != _masks.end()) {
+      account(it->second, -1);
+      it->second = mask;
+   } else {
+      _masks[key] = mask;
+   }
+   account(mask, 1);
+}
+
+void RSelectionCounts::remove(const void *key)
+{
+   unordered_map<const void *, unsigned int>::iterator it = _masks.find(key);
+   if (it == _masks.end())
+      return;
+   account(it->second, -1);
+   _masks.erase(it);
+}
+
+void RSelectionCounts::clear()
+{
+   _masks.clear();
+   for (unsigned int bit = 0; bit < BITS; bit++)
+      _counts[bit] = 0;
+}
+
+unsigned int RSelectionCounts::actions() const
+{
+   unsigned int mask = 0;
+   for (unsigned int bit = 0; bit < BITS; bit++) {
+      if (_counts[bit] > 0)
+         mask |= 1u << bit;
+   }
+   return mask;
+}
+
+void RSelectionCounts::refresh(const function<unsigned int(const void *)> &mask)
+{
+   for (unsigned int bit = 0; bit < BITS; bit++)
+      _counts[bit] = 0;
+   for (auto &entry : _masks) {
+      entry.second = mask(entry.first);
+      account(entry.second, 1);
+   }
+}
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,67 @@
+/* rselectioncounts.h - What the selected packages allow, counted as it changes
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#ifndef RSELECTIONCOUNTS_H
+#define RSELECTIONCOUNTS_H
+
+#include <functional>
+#include <unordered_map>
+
+using namespace std;
+
+// The selected rows of the package list as a count per action bit, so
+// the sensitivity of the actions does not need a walk over the whole
+// selection on every click. Each row is added with the mask of the
+// actions it allows and taken out again with that same mask, whatever
+// its flags became in between; refresh() asks every row for its mask
+// again, for when marks may have changed them.
+class RSelectionCounts {
+ public:
+   static const unsigned int BITS = 16;
+
+   RSelectionCounts();
+
+   // adding a key that is already there only replaces its mask
+   void add(const void *key, unsigned int mask);
+   void remove(const void *key);
+   void clear();
+
+   bool contains(const void *key) const { return _masks.count(key) > 0; }
+   unsigned int size() const { return _masks.size(); }
+
+   // how many of the rows allow the action with the given bit
+   unsigned int count(unsigned int bit) const { return _counts[bit]; }
+   // the bits that at least one row allows
+   unsigned int actions() const;
+
+   void refresh(const function<unsigned int(const void *)> &mask);
+
+ private:
+   unordered_map<const void *, unsigned int> _masks;
+   unsigned int _counts[BITS];
+
+   void account(unsigned int mask, int delta);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
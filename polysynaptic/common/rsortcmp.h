@@ -0,0 +1,86 @@
+/* rsortcmp.h - Sort comparisons composed at compile time
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RSORTCMP_H
+#define RSORTCMP_H
+
+#include <cstring>
+
+// A key comparison here is a three way one: cmp(x, y) is negative,
+// zero or positive as x sorts before, with or after y. They are put
+// together as types, so a sort over precomputed keys gets one inlined
+// comparison with the tie breakers in it and needs a single pass
+// instead of a sort by name plus a stable_sort by the key.
+
+// Primary decides, Tie only where Primary finds x and y equal
+template<class Primary, class Tie>
+struct sortThen {
+   Primary primary;
+   Tie tie;
+   sortThen(Primary p = Primary(), Tie t = Tie()) : primary(p), tie(t) {}
+   template<class T>
+   int operator() (const T &x, const T &y) const {
+      int c = primary(x, y);
+      return c != 0 ? c : tie(x, y);
+   }
+};
+
+// Cmp the other way round, for a descending key before an ascending
+// tie breaker
+template<class Cmp>
+struct sortReverse {
+   Cmp cmp;
+   sortReverse(Cmp c = Cmp()) : cmp(c) {}
+   template<class T>
+   int operator() (const T &x, const T &y) const {
+      return cmp(y, x);
+   }
+};
+
+// The less sort() wants, from a three way comparison
+template<class Cmp>
+struct sortLess {
+   Cmp cmp;
+   sortLess(Cmp c = Cmp()) : cmp(c) {}
+   template<class T>
+   bool operator() (const T &x, const T &y) const {
+      return cmp(x, y) < 0;
+   }
+};
+
+// The common keys, for anything with a `key` number or `name` string
+struct sortByKey {
+   template<class T>
+   int operator() (const T &x, const T &y) const {
+      return x.key < y.key ? -1 : (y.key < x.key ? 1 : 0);
+   }
+};
+
+struct sortByName {
+   template<class T>
+   int operator() (const T &x, const T &y) const {
+      return std::strcmp(x.name, y.name);
+   }
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
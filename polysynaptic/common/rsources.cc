@@ -24,7 +24,10 @@
  */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "rsources.h"
 #include <apt-pkg/configuration.h>
@@ -34,6 +37,10 @@
 #include <apt-pkg/error.h>
 #include <algorithm>
 #include <fstream>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include "config.h"
 #include "i18n.h"
 
@@ -56,115 +63,225 @@ SourcesList::SourceRecord *SourcesList::AddSourceNode(SourceRecord &rec)
    return newrec;
 }
 
-bool SourcesList::ReadSourcePart(string listpath)
-{
-   //cout << "SourcesList::ReadSourcePart() "<< listpath  << endl;
-   char buf[512];
-   const char *p;
-   ifstream ifs(listpath.c_str(), ios::in);
-   bool record_ok = true;
-
-   // cannot open file
-   if (!ifs != 0)
-      return _error->Error(_("Can't read %s"), listpath.c_str());
-
-   while (ifs.eof() == false) {
-      p = buf;
-      SourceRecord rec;
-      string Type;
-      string Section;
-      string VURI;
+// The records of the source files read so far, by path, with the
+// stat data they were read with. The repository window reads the
+// sources twice on every open and the backends on every query; files
+// that did not change are copied from here instead of parsed again.
+struct ParsedSourcePart {
+   struct timespec MTime;
+   off_t Size;
+   ino_t Inode;
+   bool Ok;
+   list<SourcesList::SourceRecord *> Records;
+
+   bool Matches(const struct stat &St) const {
+      return MTime.tv_sec == St.st_mtim.tv_sec &&
+             MTime.tv_nsec == St.st_mtim.tv_nsec &&
+             Size == St.st_size && Inode == St.st_ino;
+   }
+   ~ParsedSourcePart() {
+      for (list<SourcesList::SourceRecord *>::iterator it = Records.begin();
+           it != Records.end(); it++)
+         delete *it;
+   }
+};
 
-      ifs.getline(buf, sizeof(buf));
+static map<string, ParsedSourcePart *> ParsedParts;
+static mutex ParsedPartsLock;
 
-      rec.SourceFile = listpath;
+// parse one line of listpath into records; false if a record is broken
+// beyond turning it into a comment, which ends the file
+bool SourcesList::ParseSourceLine(const char *buf, const string &listpath,
+                                  list<SourceRecord *> &records,
+                                  bool &record_ok)
+{
+   const char *p = buf;
+   SourceRecord rec;
+   string Type;
+   string Section;
+   string VURI;
+
+   rec.SourceFile = listpath;
+   while (isspace(*p))
+      p++;
+   if (*p == '#') {
+      rec.Type = Disabled;
+      p++;
       while (isspace(*p))
          p++;
-      if (*p == '#') {
-         rec.Type = Disabled;
-         p++;
-         while (isspace(*p))
-            p++;
-      }
+   }
 
-      if (*p == '\r' || *p == '\n' || *p == 0) {
-         rec.Type = Comment;
-         rec.Comment = p;
+   if (*p == '\r' || *p == '\n' || *p == 0) {
+      rec.Type = Comment;
+      rec.Comment = p;
 
-         AddSourceNode(rec);
-         continue;
-      }
+      records.push_back(CopySourceRecord(rec));
+      return true;
+   }
 
-      bool Failed = true;
-      if (ParseQuoteWord(p, Type) == true &&
-          rec.SetType(Type) == true && ParseQuoteWord(p, VURI) == true) {
-         if (VURI[0] == '[') {
-            rec.VendorID = VURI.substr(1, VURI.length() - 2);
-            if (ParseQuoteWord(p, VURI) == true && rec.SetURI(VURI) == true)
-               Failed = false;
-         } else if (rec.SetURI(VURI) == true) {
+   bool Failed = true;
+   if (ParseQuoteWord(p, Type) == true &&
+       rec.SetType(Type) == true && ParseQuoteWord(p, VURI) == true) {
+      if (VURI[0] == '[') {
+         rec.VendorID = VURI.substr(1, VURI.length() - 2);
+         if (ParseQuoteWord(p, VURI) == true && rec.SetURI(VURI) == true)
             Failed = false;
-         }
-         if (Failed == false && ParseQuoteWord(p, rec.Dist) == false)
-            Failed = true;
+      } else if (rec.SetURI(VURI) == true) {
+         Failed = false;
       }
+      if (Failed == false && ParseQuoteWord(p, rec.Dist) == false)
+         Failed = true;
+   }
 
-      if (Failed == true) {
-         if (rec.Type == Disabled) {
-            // treat as a comment field
-            rec.Type = Comment;
-            rec.Comment = buf;
-         } else {
-            // syntax error on line
-            rec.Type = Comment;
-            string s = "#" + string(buf);
-            rec.Comment = s;
-            record_ok = false;
-            //return _error->Error(_("Syntax error in line %s"), buf);
-         }
+   if (Failed == true) {
+      if (rec.Type == Disabled) {
+         // treat as a comment field
+         rec.Type = Comment;
+         rec.Comment = buf;
+      } else {
+         // syntax error on line
+         rec.Type = Comment;
+         string s = "#" + string(buf);
+         rec.Comment = s;
+         record_ok = false;
+         //return _error->Error(_("Syntax error in line %s"), buf);
       }
+   }
 #ifndef HAVE_RPM
-      // check for absolute dist
-      if (rec.Dist.empty() == false && rec.Dist[rec.Dist.size() - 1] == '/') {
-         // make sure there's no section
-         if (ParseQuoteWord(p, Section) == true)
-            return _error->Error(_("Syntax error in line %s"), buf);
+   // check for absolute dist
+   if (rec.Dist.empty() == false && rec.Dist[rec.Dist.size() - 1] == '/') {
+      // make sure there's no section
+      if (ParseQuoteWord(p, Section) == true)
+         return _error->Error(_("Syntax error in line %s"), buf);
 
-         rec.Dist = SubstVar(rec.Dist, "$(ARCH)",
-                             _config->Find("APT::Architecture"));
+      rec.Dist = SubstVar(rec.Dist, "$(ARCH)",
+                          _config->Find("APT::Architecture"));
 
-         AddSourceNode(rec);
-         continue;
-      }
+      records.push_back(CopySourceRecord(rec));
+      return true;
+   }
 #endif
 
-      const char *tmp = p;
+   const char *tmp = p;
+   rec.NumSections = 0;
+   while (ParseQuoteWord(p, Section) == true)
+      rec.NumSections++;
+   if (rec.NumSections > 0) {
+      p = tmp;
+      rec.Sections = new string[rec.NumSections];
       rec.NumSections = 0;
-      while (ParseQuoteWord(p, Section) == true)
-         rec.NumSections++;
-      if (rec.NumSections > 0) {
-         p = tmp;
-         rec.Sections = new string[rec.NumSections];
-         rec.NumSections = 0;
-         while (ParseQuoteWord(p, Section) == true) {
-            // comments inside the record are preserved
-            if (Section[0] == '#') {
-               SourceRecord rec;
-               string s = Section + string(p);
-               rec.Type = Comment;
-               rec.Comment = s;
-               rec.SourceFile = listpath;
-               AddSourceNode(rec);
-               break;
-            } else {
-               rec.Sections[rec.NumSections++] = Section;
-            }
+      while (ParseQuoteWord(p, Section) == true) {
+         // comments inside the record are preserved
+         if (Section[0] == '#') {
+            SourceRecord rec;
+            string s = Section + string(p);
+            rec.Type = Comment;
+            rec.Comment = s;
+            rec.SourceFile = listpath;
+            records.push_back(CopySourceRecord(rec));
+            break;
+         } else {
+            rec.Sections[rec.NumSections++] = Section;
          }
       }
-      AddSourceNode(rec);
+   }
+   records.push_back(CopySourceRecord(rec));
+   return true;
+}
+
+SourcesList::SourceRecord *SourcesList::CopySourceRecord(const SourceRecord &rec)
+{
+   SourceRecord *newrec = new SourceRecord;
+   *newrec = rec;
+   return newrec;
+}
+
+// the contents of path, or an empty string if it cannot be read
+static string ReadWholeFile(const string &path)
+{
+   ifstream in(path.c_str(), ios::in | ios::binary);
+   ostringstream text;
+   if (in)
+      text << in.rdbuf();
+   return text.str();
+}
+
+bool SourcesList::ReadSourcePart(string listpath)
+{
+   //cout << "SourcesList::ReadSourcePart() "<< listpath  << endl;
+   int fd = open(listpath.c_str(), O_RDONLY | O_CLOEXEC);
+   struct stat St;
+
+   // cannot open file
+   if (fd < 0 || fstat(fd, &St) != 0) {
+      if (fd >= 0)
+         close(fd);
+      return _error->Error(_("Can't read %s"), listpath.c_str());
+   }
+
+   {
+      lock_guard<mutex> lock(ParsedPartsLock);
+      map<string, ParsedSourcePart *>::iterator C = ParsedParts.find(listpath);
+      if (C != ParsedParts.end() && C->second->Matches(St)) {
+         close(fd);
+         for (list<SourceRecord *>::iterator it = C->second->Records.begin();
+              it != C->second->Records.end(); it++)
+            AddSourceNode(**it);
+         return C->second->Ok;
+      }
    }
 
-   ifs.close();
+   // the file is mapped and split into lines in place; only the line
+   // being parsed is copied, to get the terminating 0
+   const char *data = "";
+   void *mapped = MAP_FAILED;
+   if (St.st_size > 0) {
+      mapped = mmap(NULL, St.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+         close(fd);
+         return _error->Errno("mmap", _("Can't read %s"), listpath.c_str());
+      }
+      data = (const char *)mapped;
+   }
+   close(fd);
+
+   ParsedSourcePart *part = new ParsedSourcePart;
+   part->MTime = St.st_mtim;
+   part->Size = St.st_size;
+   part->Inode = St.st_ino;
+
+   bool record_ok = true;
+   bool complete = true;
+   string line;
+   const char *end = data + St.st_size;
+   // unlike the getline() loop this replaces, the end of the file is
+   // no extra empty line, which UpdateSources() used to write back
+   // as one more blank line at every save
+   for (const char *start = data; complete && start < end; ) {
+      const char *nl = (const char *)memchr(start, '\n', end - start);
+      line.assign(start, nl ? nl : end);
+      complete = ParseSourceLine(line.c_str(), listpath, part->Records,
+                                 record_ok);
+      start = nl ? nl + 1 : end;
+   }
+
+   if (mapped != MAP_FAILED)
+      munmap(mapped, St.st_size);
+
+   for (list<SourceRecord *>::iterator it = part->Records.begin();
+        it != part->Records.end(); it++)
+      AddSourceNode(**it);
+
+   if (complete == false) {
+      delete part;
+      return false;
+   }
+
+   part->Ok = record_ok;
+   lock_guard<mutex> lock(ParsedPartsLock);
+   ParsedSourcePart *&slot = ParsedParts[listpath];
+   delete slot;
+   slot = part;
    return record_ok;
 }
 
@@ -289,6 +406,28 @@ void SourcesList::SwapSources( SourceRecord *&rec_one, SourceRecord *&rec_two )
   SourceRecords.erase( rec_n );
 }
 
+int SourcesList::ReplaceURI(string From, string To)
+{
+   if (From.empty() || To.empty())
+      return 0;
+
+   // compared the way SetURI() stores them
+   if (From[From.size() - 1] != '/')
+      From += '/';
+   if (To[To.size() - 1] != '/')
+      To += '/';
+
+   int count = 0;
+   for (list<SourceRecord *>::iterator it = SourceRecords.begin();
+        it != SourceRecords.end(); it++) {
+      if (((*it)->Type & Comment) == 0 && (*it)->URI == From) {
+         (*it)->URI = To;
+         count++;
+      }
+   }
+   return count;
+}
+
 bool SourcesList::UpdateSources()
 {
    list<string> filenames;
@@ -303,10 +442,7 @@ bool SourcesList::UpdateSources()
 
    for (list<string>::iterator fi = filenames.begin();
         fi != filenames.end(); fi++) {
-      ofstream ofs((*fi).c_str(), ios::out);
-      if (!ofs != 0)
-         return false;
-
+      ostringstream ofs;
       for (list<SourceRecord *>::iterator it = SourceRecords.begin();
            it != SourceRecords.end(); it++) {
          if ((*fi) != (*it)->SourceFile)
@@ -333,7 +469,18 @@ bool SourcesList::UpdateSources()
          }
          ofs << S << endl;
       }
-      ofs.close();
+
+      // leave the files the user did not touch alone, with their
+      // mtimes, so apt and the parse cache see them unchanged
+      string Text = ofs.str();
+      if (Text == ReadWholeFile(*fi))
+         continue;
+
+      ofstream out((*fi).c_str(), ios::out);
+      if (!out != 0)
+         return false;
+      out << Text;
+      out.close();
    }
    return true;
 }
@@ -82,6 +82,11 @@ class SourcesList {
    SourceRecord *AddSourceNode(SourceRecord &);
    VendorRecord *AddVendorNode(VendorRecord &);
 
+   static SourceRecord *CopySourceRecord(const SourceRecord &);
+   static bool ParseSourceLine(const char *buf, const string &listpath,
+                               list<SourceRecord *> &records,
+                               bool &record_ok);
+
  public:
    SourceRecord *AddSource(RecType Type,
                            string VendorID,
@@ -92,6 +97,8 @@ class SourcesList {
    SourceRecord *AddEmptySource();
    void RemoveSource(SourceRecord *&);
    void SwapSources( SourceRecord *&, SourceRecord *& );
+   // point every record fetching from From at To, returns how many
+   int ReplaceURI(string From, string To);
    bool ReadSourcePart(string listpath);
    bool ReadSourceDir(string Dir);
    bool ReadSources();
@@ -1,9 +1,46 @@
 // 
 
 #include "rswig.h"
+#include "rpackagelister.h"
 
 bool RInitSystem()
 {
    return pkgInitConfig(*_config) && pkgInitSystem(*_config,_system);
 
 }
+
+bool RPackageColumns::fill(RPackageLister *lister, bool viewOnly)
+{
+   names.clear();
+   versions.clear();
+   installedVersions.clear();
+   flags.clear();
+   installedSizes.clear();
+   downloadSizes.clear();
+   if (lister == NULL || lister->getCache() == NULL)
+      return false;
+
+   const vector<RPackage *> &packages =
+      viewOnly ? lister->getViewPackages() : lister->getPackages();
+   names.reserve(packages.size());
+   versions.reserve(packages.size());
+   installedVersions.reserve(packages.size());
+   flags.reserve(packages.size());
+   installedSizes.reserve(packages.size());
+   downloadSizes.reserve(packages.size());
+
+   for (unsigned int i = 0; i < packages.size(); i++) {
+      RPackage *pkg = packages[i];
+      if (pkg == NULL)
+         continue;
+      const char *version = pkg->availableVersion();
+      const char *installed = pkg->installedVersion();
+      names.push_back(pkg->name());
+      versions.push_back(version ? version : "");
+      installedVersions.push_back(installed ? installed : "");
+      flags.push_back(pkg->getFlags());
+      installedSizes.push_back(pkg->installedSize());
+      downloadSizes.push_back(pkg->availablePackageSize());
+   }
+   return true;
+}
@@ -6,8 +6,31 @@
 #include<apt-pkg/acquire.h>
 #include "rinstallprogress.h"
 
+#include <string>
+#include <vector>
+
 bool RInitSystem();
 
+class RPackageLister;
+
+// the packages of a lister, or only those of its current view, as one
+// array per field; filled in a single call so a script does not cross
+// into C++ once per field and package. The bindings hand out the
+// numeric columns as buffers without copying them.
+struct RPackageColumns {
+   vector<string> names;
+   vector<string> versions;            // available, "" if none
+   vector<string> installedVersions;   // "" if not installed
+   vector<int> flags;                  // RPackage::getFlags()
+   vector<long> installedSizes;
+   vector<long> downloadSizes;
+
+   unsigned int size() const { return names.size(); }
+
+   // replaces the columns; false if the lister has no open cache
+   bool fill(RPackageLister *lister, bool viewOnly = false);
+};
+
 class SwigOpProgress : public OpProgress {
  protected:
    virtual void Update() { UpdateStatus(Percent); }
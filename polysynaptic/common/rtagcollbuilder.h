@@ -22,6 +22,11 @@
  */
 
 #if 0 // PORTME
+// When this is ported, do not bring TagCollection<int> and the
+// HandleMaker back: keep one RPackageSet per facet and per tag, filled
+// from the tag database once when it is loaded, so the tag tree gets
+// intersections from RPackageSet::intersect() and its counts from
+// count() instead of per-item getElement() lookups.
 #ifdef HAVE_DEBTAGS
 //#pragma interface
 
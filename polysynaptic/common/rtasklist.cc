@@ -0,0 +1,189 @@
+/* rtasklist.cc - The tasksel tasks, read once
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#include "rtasklist.h"
+
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+
+static string runCommand(const string &cmd)
+{
+   string output;
+   FILE *f = popen(cmd.c_str(), "r");
+   if (f == NULL)
+      return output;
+   char buf[4096];
+   size_t n;
+   while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      output.append(buf, n);
+   pclose(f);
+   return output;
+}
+
+static string strip(const string &s)
+{
+   size_t begin = s.find_first_not_of(" \t\r\n");
+   if (begin == string::npos)
+      return string();
+   size_t end = s.find_last_not_of(" \t\r\n");
+   return s.substr(begin, end - begin + 1);
+}
+
+
+RTaskList::RTaskList(const string &program, const string &descDir)
+   : _program(program), _descDir(descDir), _loaded(false)
+{
+}
+
+RTaskList::~RTaskList()
+{
+   if (_loading.valid())
+      _loading.wait();
+}
+
+void RTaskList::prefetch()
+{
+   if (_loaded || _loading.valid())
+      return;
+   _loading = std::async(std::launch::async, [this]() { load(); });
+}
+
+void RTaskList::waitLoaded()
+{
+   if (_loaded)
+      return;
+   if (_loading.valid())
+      _loading.get();
+   else
+      load();
+   _loaded = true;
+}
+
+void RTaskList::load()
+{
+   parseList(runCommand(_program + " --list-tasks"), _tasks);
+
+   DIR *dir = opendir(_descDir.c_str());
+   if (dir == NULL)
+      return;
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      string name = entry->d_name;
+      if (name.size() < 5 || name.compare(name.size() - 5, 5, ".desc") != 0)
+         continue;
+      ifstream in((_descDir + "/" + name).c_str());
+      ostringstream text;
+      text << in.rdbuf();
+      parseDescriptions(text.str(), _descriptions);
+   }
+   closedir(dir);
+}
+
+const vector<RTaskList::Task> &RTaskList::tasks()
+{
+   waitLoaded();
+   return _tasks;
+}
+
+string RTaskList::description(const string &name)
+{
+   waitLoaded();
+   map<string, string>::const_iterator it = _descriptions.find(name);
+   if (it != _descriptions.end())
+      return it->second;
+
+   // tasks that come from elsewhere than the .desc files (the
+   // "new-install" or "manual" ones); kept, so asked about once
+   string descr = strip(runCommand(_program + " --task-desc " + name));
+   _descriptions[name] = descr;
+   return descr;
+}
+
+void RTaskList::parseList(const string &output, vector<Task> &tasks)
+{
+   tasks.clear();
+   istringstream in(output);
+   string line;
+   while (getline(in, line)) {
+      size_t tab = line.find('\t');
+      if (line.size() < 3 || line[1] != ' ' || tab == string::npos)
+         continue;
+      Task task;
+      task.installed = line[0] == 'i';
+      task.name = strip(line.substr(2, tab - 2));
+      task.summary = strip(line.substr(tab + 1));
+      tasks.push_back(task);
+   }
+}
+
+void RTaskList::parseDescriptions(const string &text,
+                                  map<string, string> &descriptions)
+{
+   istringstream in(text);
+   string line;
+   string task;
+   string descr;
+   bool described = false;
+   bool inDescription = false;
+
+   while (true) {
+      bool more = getline(in, line) ? true : false;
+      // an empty line (or the end) closes the stanza
+      if (!more || strip(line).empty()) {
+         if (!task.empty() && described)
+            descriptions[task] = descr;
+         task.clear();
+         descr.clear();
+         described = inDescription = false;
+         if (!more)
+            break;
+         continue;
+      }
+
+      if (line[0] == ' ' || line[0] == '\t') {
+         if (!inDescription)
+            continue;
+         // joined as tasksel joins them, which is also the msgid of
+         // the translation in the debian-tasks domain
+         if (!descr.empty())
+            descr += " ";
+         descr += strip(line);
+         continue;
+      }
+
+      inDescription = false;
+      size_t colon = line.find(':');
+      if (colon == string::npos)
+         continue;
+      string field = line.substr(0, colon);
+      if (field == "Task") {
+         task = strip(line.substr(colon + 1));
+      } else if (field == "Description") {
+         // the summary is in --list-tasks already
+         described = inDescription = true;
+      }
+   }
+}
+
+// vim:ts=3:sw=3:et
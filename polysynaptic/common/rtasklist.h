@@ -0,0 +1,83 @@
+/* rtasklist.h - The tasksel tasks, read once
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#ifndef RTASKLIST_H
+#define RTASKLIST_H
+
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The tasks tasksel offers, with their descriptions, for the tasks
+// window. One `tasksel --list-tasks` gives the tasks and whether they
+// are installed; the descriptions come from tasksel's .desc files, so
+// browsing the tasks does not run tasksel again. Only a task none of
+// the files describe is asked about with `tasksel --task-desc`, once.
+//
+// prefetch() loads on a worker, ahead of the window being opened;
+// everything else is for the main thread, and waits for that load.
+class RTaskList {
+ public:
+   struct Task {
+      string name;
+      string summary;
+      bool installed;
+   };
+
+   RTaskList(const string &program,
+             const string &descDir = "/usr/share/tasksel/descs");
+   ~RTaskList();
+
+   void prefetch();
+
+   const vector<Task> &tasks();
+
+   // the long description of the task, as `tasksel --task-desc` has
+   // it but untranslated: the text is the msgid in the debian-tasks
+   // domain for the .desc file tasks
+   string description(const string &name);
+
+   // "i name<TAB>summary" lines of --list-tasks ("u" if not installed)
+   static void parseList(const string &output, vector<Task> &tasks);
+   // the Task: and Description: stanzas of a .desc file, by task
+   static void parseDescriptions(const string &text,
+                                 map<string, string> &descriptions);
+
+ private:
+   string _program;
+   string _descDir;
+
+   future<void> _loading;
+   bool _loaded;
+   vector<Task> _tasks;
+   map<string, string> _descriptions;
+
+   void load();
+   void waitLoaded();
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,150 @@
+/* rtextscan.cc - Ranked substring search over package names and summaries
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rtextscan.h"
+#include "rparallel.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+static void appendFolded(string &out, const char *s)
+{
+   for (; s != NULL && *s != 0; s++) {
+      char c = (char)tolower((unsigned char)*s);
+      // keep the record and field separators unique
+      out += (c == '\n') ? ' ' : c;
+   }
+}
+
+static bool betterHit(const RTextScan::Hit &a, const RTextScan::Hit &b)
+{
+   if (a.score != b.score)
+      return a.score > b.score;
+   return a.id < b.id;
+}
+
+void RTextScan::reserve(unsigned int records, size_t bytes)
+{
+   _starts.reserve(records);
+   _nameLens.reserve(records);
+   _text.reserve(bytes);
+}
+
+void RTextScan::add(const char *name, const char *summary)
+{
+   _starts.push_back(_text.size());
+   appendFolded(_text, name);
+   _nameLens.push_back(_text.size() - _starts.back());
+   _text += '\n';
+   appendFolded(_text, summary);
+   _text += '\0';
+}
+
+int RTextScan::scoreRecord(unsigned int id, const vector<string> &terms) const
+{
+   const char *name = _text.data() + _starts[id];
+   size_t nameLen = _nameLens[id];
+   const char *end = id + 1 < _starts.size() ? _text.data() + _starts[id + 1]
+                                             : _text.data() + _text.size();
+   int score = 0;
+   for (unsigned int i = 0; i < terms.size(); i++) {
+      const string &t = terms[i];
+      const char *at = (const char *)memmem(name, end - name,
+                                            t.data(), t.size());
+      if (at == NULL)
+         return -1;
+      if (at >= name + nameLen)
+         score += 1;
+      else if (t.size() == nameLen)
+         score += 100;
+      else if (at == name)
+         score += 30;
+      else
+         score += 10;
+   }
+   return score;
+}
+
+void RTextScan::search(const vector<string> &rawTerms, unsigned int limit,
+                       vector<Hit> &hits, unsigned int threads) const
+{
+   hits.clear();
+
+   vector<string> terms;
+   for (unsigned int i = 0; i < rawTerms.size(); i++) {
+      if (rawTerms[i].empty())
+         continue;
+      string t;
+      appendFolded(t, rawTerms[i].c_str());
+      terms.push_back(t);
+   }
+   if (terms.empty() || _starts.empty())
+      return;
+
+   // the longest term occurs least often, so it drives the scan and
+   // the others are only checked in the records it is found in
+   unsigned int lead = 0;
+   for (unsigned int i = 1; i < terms.size(); i++)
+      if (terms[i].size() > terms[lead].size())
+         lead = i;
+   const string &needle = terms[lead];
+
+   unsigned int chunks = RParallelChunks(_starts.size(), 4096, threads);
+   vector<vector<Hit> > found(chunks);
+   RParallelFor(chunks, _starts.size(),
+                [&](unsigned int chunk, unsigned int begin, unsigned int end) {
+      const char *base = _text.data();
+      const char *p = base + _starts[begin];
+      const char *stop = end < _starts.size() ? base + _starts[end]
+                                              : base + _text.size();
+      vector<Hit> &out = found[chunk];
+      while (p < stop) {
+         const char *at = (const char *)memmem(p, stop - p, needle.data(),
+                                               needle.size());
+         if (at == NULL)
+            break;
+         // the record the match is in, then go on after it
+         unsigned int id = upper_bound(_starts.begin() + begin,
+                                       _starts.begin() + end,
+                                       (uint32_t)(at - base)) -
+                           _starts.begin() - 1;
+         Hit hit;
+         hit.id = id;
+         hit.score = scoreRecord(id, terms);
+         if (hit.score >= 0)
+            out.push_back(hit);
+         p = id + 1 < _starts.size() ? base + _starts[id + 1] : stop;
+      }
+   });
+
+   for (unsigned int c = 0; c < found.size(); c++)
+      hits.insert(hits.end(), found[c].begin(), found[c].end());
+   if (limit > 0 && hits.size() > limit) {
+      partial_sort(hits.begin(), hits.begin() + limit, hits.end(), betterHit);
+      hits.resize(limit);
+   } else {
+      sort(hits.begin(), hits.end(), betterHit);
+   }
+}
+
+// vim:ts=3:sw=3:et
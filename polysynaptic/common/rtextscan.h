@@ -0,0 +1,78 @@
+/* rtextscan.h - Ranked substring search over package names and summaries
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#ifndef RTEXTSCAN_H
+#define RTEXTSCAN_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The search used when there is no Xapian index: the case-folded name
+// and summary of every package in one contiguous buffer, scanned with
+// memmem() (which glibc vectorizes) by a few threads at once. Each
+// record is "name\nsummary\0", so no term (which has neither byte) can
+// match across two fields or two records.
+//
+// A record matches if it contains every term. Hits are ranked by where
+// the terms were found: the whole name, the start of the name,
+// anywhere in the name, the summary only.
+//
+// Folding is bytewise tolower(), like strcasestr().
+class RTextScan {
+ public:
+   struct Hit {
+      unsigned int id;          // the order add() was called in
+      int score;
+   };
+
+   RTextScan() {}
+
+   void add(const char *name, const char *summary);
+   void reserve(unsigned int records, size_t bytes);
+
+   // number of records that were added
+   unsigned int size() const { return _starts.size(); }
+
+   // heap bytes held by the buffer and the record tables
+   size_t memoryBytes() const {
+      return _text.capacity() +
+             (_starts.capacity() + _nameLens.capacity()) * sizeof(uint32_t);
+   }
+
+   // the records containing every term, best first (ties in id order),
+   // at most limit of them unless limit is 0; threads 0 picks the
+   // number of cores
+   void search(const vector<string> &terms, unsigned int limit,
+               vector<Hit> &hits, unsigned int threads = 0) const;
+
+ private:
+   string _text;
+   vector<uint32_t> _starts;     // where each record begins
+   vector<uint32_t> _nameLens;
+
+   int scoreRecord(unsigned int id, const vector<string> &terms) const;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
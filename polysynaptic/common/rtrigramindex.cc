@@ -0,0 +1,115 @@
+/* rtrigramindex.cc - Trigram prefilter for substring searches
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rtrigramindex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+
+using namespace std;
+
+// the folded trigram starting at s (which must have 3 bytes left)
+static inline unsigned int trigramAt(const char *s)
+{
+   return ((unsigned int)(unsigned char)tolower((unsigned char)s[0]) << 16) |
+          ((unsigned int)(unsigned char)tolower((unsigned char)s[1]) << 8) |
+          (unsigned int)(unsigned char)tolower((unsigned char)s[2]);
+}
+
+// the distinct trigrams of text, sorted
+static void trigramsOf(const char *text, size_t len, vector<unsigned int> &out)
+{
+   out.clear();
+   if (len < 3)
+      return;
+
+   out.reserve(len - 2);
+   for (size_t i = 0; i + 2 < len; i++)
+      out.push_back(trigramAt(text + i));
+
+   sort(out.begin(), out.end());
+   out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+void RTrigramIndex::add(unsigned int id, const char *text)
+{
+   _size++;
+   if (text == NULL)
+      return;
+
+   vector<unsigned int> grams;
+   trigramsOf(text, strlen(text), grams);
+
+   // ids arrive in ascending order, so every posting list stays sorted
+   for (unsigned int i = 0; i < grams.size(); i++)
+      _postings[grams[i]].push_back(id);
+}
+
+void RTrigramIndex::clear()
+{
+   _postings.clear();
+   _size = 0;
+}
+
+bool RTrigramIndex::candidates(const vector<string> &terms,
+                               vector<unsigned int> &result) const
+{
+   result.clear();
+
+   // gather the posting list of every trigram of every term
+   vector<const vector<unsigned int> *> lists;
+   vector<unsigned int> grams;
+   for (unsigned int t = 0; t < terms.size(); t++) {
+      trigramsOf(terms[t].c_str(), terms[t].size(), grams);
+      for (unsigned int i = 0; i < grams.size(); i++) {
+         unordered_map<unsigned int, vector<unsigned int> >::const_iterator I =
+            _postings.find(grams[i]);
+         // a trigram no text has: nothing can match
+         if (I == _postings.end())
+            return true;
+         lists.push_back(&I->second);
+      }
+   }
+
+   if (lists.empty())
+      return false;
+
+   // intersect starting with the shortest list to keep the work small
+   sort(lists.begin(), lists.end(),
+        [](const vector<unsigned int> *a, const vector<unsigned int> *b) {
+           return a->size() < b->size();
+        });
+
+   result = *lists[0];
+   vector<unsigned int> next;
+   for (unsigned int i = 1; i < lists.size() && !result.empty(); i++) {
+      next.clear();
+      set_intersection(result.begin(), result.end(),
+                       lists[i]->begin(), lists[i]->end(),
+                       back_inserter(next));
+      result.swap(next);
+   }
+
+   return true;
+}
+
+// vim:ts=3:sw=3:et
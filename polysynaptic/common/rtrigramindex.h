@@ -0,0 +1,64 @@
+/* rtrigramindex.h - Trigram prefilter for substring searches
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RTRIGRAMINDEX_H
+#define RTRIGRAMINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+// Maps every case-folded three byte sequence of a set of texts to the
+// ids of the texts containing it. A text can only contain a term as a
+// case-insensitive substring if it contains all of the term's
+// trigrams, so the index narrows a search down to a candidate set that
+// the caller then verifies with the exact match (strcasestr).
+//
+// Folding is done bytewise with tolower(), like strcasestr, so the
+// candidate set is never smaller than the exact result.
+class RTrigramIndex {
+ public:
+   RTrigramIndex() : _size(0) {}
+
+   // add a text; ids must be added in ascending order
+   void add(unsigned int id, const char *text);
+
+   void clear();
+
+   // number of texts that were added
+   unsigned int size() const { return _size; }
+
+   // collect the ids (ascending) of the texts that may contain every
+   // term; returns false if no term is long enough to narrow anything
+   // down, in which case every text is a candidate
+   bool candidates(const vector<string> &terms,
+                   vector<unsigned int> &result) const;
+
+ private:
+   unordered_map<unsigned int, vector<unsigned int> > _postings;
+   unsigned int _size;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
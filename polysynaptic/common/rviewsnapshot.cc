@@ -0,0 +1,215 @@
+/* rviewsnapshot.cc - Saved subviews of the package lister
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "rviewsnapshot.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const char SnapshotMagic[8] = {'R', 'V', 'I', 'E', 'W', 'S', 'N', '\0'};
+
+namespace {
+
+// reads from the mapped file; any read past the end makes ok() false
+// and returns zeros from then on
+class SnapshotReader {
+ public:
+   SnapshotReader(const char *data, size_t size)
+      : _p(data), _end(data + size), _ok(true) {}
+
+   bool ok() const { return _ok; }
+   void fail() { _ok = false; }
+
+   uint32_t u32() {
+      uint32_t v = 0;
+      if (left(sizeof(v))) {
+         memcpy(&v, _p, sizeof(v));
+         _p += sizeof(v);
+      }
+      return v;
+   }
+
+   string str() {
+      uint32_t len = u32();
+      if (!left(len))
+         return string();
+      string s(_p, len);
+      _p += len;
+      return s;
+   }
+
+   bool magic() {
+      if (!left(sizeof(SnapshotMagic)) ||
+          memcmp(_p, SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+         return _ok = false;
+      _p += sizeof(SnapshotMagic);
+      return true;
+   }
+
+ private:
+   const char *_p;
+   const char *_end;
+   bool _ok;
+
+   bool left(size_t len) {
+      if (_ok && (size_t)(_end - _p) < len)
+         _ok = false;
+      return _ok;
+   }
+};
+
+void writeU32(ofstream &out, uint32_t v)
+{
+   out.write((const char *)&v, sizeof(v));
+}
+
+void writeStr(ofstream &out, const string &s)
+{
+   writeU32(out, s.size());
+   out.write(s.data(), s.size());
+}
+
+}
+
+string RViewSnapshot::stampFiles(const vector<string> &paths)
+{
+   string stamp;
+   for (unsigned int i = 0; i < paths.size(); i++) {
+      struct stat st;
+      if (i > 0)
+         stamp += ";";
+      stamp += paths[i] + "@";
+      if (stat(paths[i].c_str(), &st) != 0) {
+         stamp += "-";
+         continue;
+      }
+      stamp += to_string(st.st_mtim.tv_sec) + "." +
+               to_string(st.st_mtim.tv_nsec) + ":" + to_string(st.st_size);
+   }
+   return stamp;
+}
+
+bool RViewSnapshot::load(const string &path, const string &stamp)
+{
+   _views.clear();
+
+   int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+   }
+   void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (base == MAP_FAILED)
+      return false;
+
+   SnapshotReader r((const char *)base, st.st_size);
+   map<string, SubViews> views;
+
+   if (r.magic() && r.u32() == FormatVersion && r.str() == stamp) {
+      uint32_t viewCount = r.u32();
+      for (uint32_t v = 0; r.ok() && v < viewCount; v++) {
+         SubViews &subviews = views[r.str()];
+         uint32_t subviewCount = r.u32();
+         for (uint32_t s = 0; r.ok() && s < subviewCount; s++) {
+            vector<uint32_t> &ids = subviews[r.str()];
+            uint32_t count = r.u32();
+            // a broken count must not reserve gigabytes
+            if (count > st.st_size / sizeof(uint32_t))
+               r.fail();
+            else
+               ids.reserve(count);
+            for (uint32_t i = 0; r.ok() && i < count; i++)
+               ids.push_back(r.u32());
+         }
+      }
+   } else {
+      r.fail();
+   }
+
+   bool ok = r.ok();
+   munmap(base, st.st_size);
+   if (!ok)
+      return false;
+
+   _views.swap(views);
+   return true;
+}
+
+bool RViewSnapshot::save(const string &path, const string &stamp) const
+{
+   string tmpPath = path + ".tmp";
+
+   {
+      ofstream out(tmpPath.c_str(), ios::binary | ios::trunc);
+      if (!out.is_open())
+         return false;
+
+      out.write(SnapshotMagic, sizeof(SnapshotMagic));
+      writeU32(out, FormatVersion);
+      writeStr(out, stamp);
+      writeU32(out, _views.size());
+      for (map<string, SubViews>::const_iterator V = _views.begin();
+           V != _views.end(); V++) {
+         writeStr(out, V->first);
+         writeU32(out, V->second.size());
+         for (SubViews::const_iterator S = V->second.begin();
+              S != V->second.end(); S++) {
+            writeStr(out, S->first);
+            writeU32(out, S->second.size());
+            if (!S->second.empty())
+               out.write((const char *)&S->second[0],
+                         S->second.size() * sizeof(uint32_t));
+         }
+      }
+
+      if (!out.good()) {
+         out.close();
+         unlink(tmpPath.c_str());
+         return false;
+      }
+   }
+
+   if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+      unlink(tmpPath.c_str());
+      return false;
+   }
+   return true;
+}
+
+const RViewSnapshot::SubViews *RViewSnapshot::find(const string &name) const
+{
+   map<string, SubViews>::const_iterator I = _views.find(name);
+   return I != _views.end() ? &I->second : NULL;
+}
+
+// vim:ts=3:sw=3:et
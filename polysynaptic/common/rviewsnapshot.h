@@ -0,0 +1,79 @@
+/* rviewsnapshot.h - Saved subviews of the package lister
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef RVIEWSNAPSHOT_H
+#define RVIEWSNAPSHOT_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The subviews of the views that only depend on the cache (sections,
+// origins, architectures), saved after openCache() computed them so
+// the next open of the same cache can read them back instead of
+// asking every package for its section and origins again.
+//
+// Packages are stored as pkgCache::Package::ID, which stay the same
+// as long as pkgcache.bin does. The stamp says what the subviews were
+// computed from: the mtime and size of every file given to
+// stampFiles() plus whatever the caller adds (package count, options,
+// language). A snapshot with another stamp is never loaded.
+//
+// File format (host byte order):
+//   char[8] magic "RVIEWSN\0", uint32 version, string stamp,
+//   uint32 view count, per view: string name, uint32 subview count,
+//   per subview: string name, uint32 package count, uint32 ids
+// strings are a uint32 length followed by the bytes. The file is read
+// through mmap and written to a temp file that is renamed over it.
+class RViewSnapshot {
+ public:
+   static const uint32_t FormatVersion = 1;
+
+   // subview name -> package ids, in view order
+   typedef map<string, vector<uint32_t> > SubViews;
+
+   // "<path>@<mtime>:<size>" for each file, "<path>@-" if it is missing
+   static string stampFiles(const vector<string> &paths);
+
+   // false if the file is missing, broken or was saved with another
+   // stamp; the snapshot is left empty then
+   bool load(const string &path, const string &stamp);
+   bool save(const string &path, const string &stamp) const;
+
+   bool empty() const { return _views.empty(); }
+   void clear() { _views.clear(); }
+
+   // the subviews saved for the view called name, NULL if none
+   const SubViews *find(const string &name) const;
+   void set(const string &name, const SubViews &subviews) {
+      _views[name] = subviews;
+   }
+
+ private:
+   map<string, SubViews> _views;
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
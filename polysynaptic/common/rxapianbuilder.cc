@@ -0,0 +1,211 @@
+/* rxapianbuilder.cc - The package search index, built natively
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_XAPIAN
+
+#include "rxapianbuilder.h"
+#include "rparallel.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <xapian.h>
+
+// term generation is cheap per package; threads only pay off in bulk
+static const unsigned int MIN_DOCUMENTS_PER_THREAD = 1024;
+
+// a Xapian database is a directory of tables, nothing below it
+static void removeDatabase(const string &dir)
+{
+   DIR *d = opendir(dir.c_str());
+   if (d == NULL)
+      return;
+   struct dirent *entry;
+   while ((entry = readdir(d)) != NULL) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+         unlink((dir + "/" + entry->d_name).c_str());
+   }
+   closedir(d);
+   rmdir(dir.c_str());
+}
+
+static Xapian::Document makeDocument(Xapian::TermGenerator &terms,
+                                     const RXapianDocument &source)
+{
+   Xapian::Document doc;
+   terms.set_document(doc);
+   terms.index_text(source.name);
+   terms.index_text(source.summary);
+   terms.index_text(source.description);
+
+   if (source.source.empty()) {
+      doc.set_data(source.name);
+      doc.add_term("XP" + source.name);
+   } else {
+      doc.set_data(source.source + ":" + source.name);
+      doc.add_term("XB" + source.source);
+      doc.add_term("XN" + source.name);
+   }
+   if (!source.section.empty())
+      doc.add_term("XS" + source.section);
+   for (unsigned int i = 0; i < source.tags.size(); i++)
+      doc.add_term("XT" + source.tags[i]);
+   return doc;
+}
+
+
+RXapianIndexBuilder::RXapianIndexBuilder(const string &indexDir)
+   : _dir(indexDir), _running(false), _succeeded(false), _cancelled(false)
+{
+}
+
+RXapianIndexBuilder::~RXapianIndexBuilder()
+{
+   cancel();
+   if (_worker.joinable())
+      _worker.join();
+}
+
+void RXapianIndexBuilder::start(vector<RXapianDocument> &documents,
+                                unsigned int threads)
+{
+   if (_worker.joinable())
+      _worker.join();
+   _running = true;
+   _succeeded = false;
+   _cancelled = false;
+
+   // the documents move to the worker, which owns them until it is done
+   vector<RXapianDocument> *owned = new vector<RXapianDocument>();
+   owned->swap(documents);
+   _worker = thread([this, owned, threads]() {
+      _succeeded = build(*owned, threads);
+      delete owned;
+      _running = false;
+   });
+}
+
+bool RXapianIndexBuilder::build(const vector<RXapianDocument> &documents,
+                                unsigned int threads)
+{
+   unsigned int count = documents.size();
+   vector<Xapian::Document> docs(count);
+   unsigned int chunks = RParallelChunks(count, MIN_DOCUMENTS_PER_THREAD, threads);
+   try {
+      RParallelFor(chunks, count,
+                   [this, &documents, &docs](unsigned int, unsigned int begin,
+                                             unsigned int end) {
+         // Xapian objects must not be shared between threads
+         Xapian::TermGenerator terms;
+         terms.set_stemmer(Xapian::Stem("english"));
+         for (unsigned int i = begin; i < end && !_cancelled; i++)
+            docs[i] = makeDocument(terms, documents[i]);
+      });
+   } catch (const Xapian::Error &) {
+      return false;
+   }
+   if (_cancelled)
+      return false;
+
+   // there is none before the first build without update-apt-xapian-index
+   mkdir(_dir.c_str(), 0755);
+
+   // next to the current database, under a name no earlier build used
+   char stamp[32];
+   snprintf(stamp, sizeof(stamp), "%ld.%d", (long)time(NULL), (int)getpid());
+   string database = _dir + "/index." + stamp;
+   try {
+      Xapian::WritableDatabase db(database, Xapian::DB_CREATE_OR_OVERWRITE);
+      // one transaction: nothing is flushed before the end
+      db.begin_transaction(false);
+      for (unsigned int i = 0; i < count && !_cancelled; i++)
+         db.add_document(docs[i]);
+      if (_cancelled) {
+         db.cancel_transaction();
+      } else {
+         db.commit_transaction();
+      }
+      db.close();
+   } catch (const Xapian::Error &) {
+      removeDatabase(database);
+      return false;
+   }
+
+   if (_cancelled || !install(database)) {
+      removeDatabase(database);
+      return false;
+   }
+   return true;
+}
+
+bool RXapianIndexBuilder::install(const string &database)
+{
+   string index = _dir + "/index";
+
+   // what the index is now: update-apt-xapian-index leaves a stub
+   // ("auto /var/lib/apt-xapian-index/index.1"), older ones a directory
+   string previous;
+   struct stat st;
+   if (lstat(index.c_str(), &st) == 0) {
+      if (S_ISDIR(st.st_mode)) {
+         previous = index + ".old";
+         if (rename(index.c_str(), previous.c_str()) != 0)
+            return false;
+      } else {
+         ifstream stub(index.c_str());
+         string backend;
+         stub >> backend >> previous;
+      }
+   }
+
+   string stub = index + ".tmp";
+   {
+      ofstream out(stub.c_str(), ios::trunc);
+      out << "auto " << database << "\n";
+      if (!out.good())
+         return false;
+   }
+   if (rename(stub.c_str(), index.c_str()) != 0)
+      return false;
+
+   // only what this directory holds, and never what was just built
+   if (!previous.empty() && previous != database &&
+       previous.compare(0, _dir.size() + 1, _dir + "/") == 0)
+      removeDatabase(previous);
+
+   // what RPackageLister::xapianIndexTimestamp() compares with the cache
+   string timestamp = _dir + "/update-timestamp";
+   ofstream(timestamp.c_str(), ios::app);
+   utime(timestamp.c_str(), NULL);
+   return true;
+}
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -0,0 +1,86 @@
+/* rxapianbuilder.h - The package search index, built natively
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+
+#ifndef RXAPIANBUILDER_H
+#define RXAPIANBUILDER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// One package as the index has it. The terms are those of
+// update-apt-xapian-index: the words of summary and description, the
+// name exact under "XP", the section under "XS" and the debtags under
+// "XT", so the lister's queries work on either index. The data is the
+// name, which is how the lister finds an apt package again.
+//
+// Snaps and flatpaks (source "snap" or "flatpak") are tagged "XB" and
+// their source, have their name under "XN" rather than "XP", and
+// "source:name" as data, so they never pass for an apt package.
+struct RXapianDocument {
+   string source;        // "" for apt
+   string name;
+   string summary;
+   string description;
+   string section;
+   vector<string> tags;
+};
+
+// Builds the index of the documents given on worker threads, in bulk
+// into a new database next to the current one, and swaps it in: the
+// "index" stub in the index directory is replaced to point to the new
+// database, and the old one deleted. Readers that have the old index
+// open go on searching it until they reopen.
+//
+// start() returns at once; isRunning() is false once the build is
+// done or failed, and succeeded() tells which.
+class RXapianIndexBuilder {
+ public:
+   explicit RXapianIndexBuilder(const string &indexDir);
+   ~RXapianIndexBuilder();
+
+   void start(vector<RXapianDocument> &documents, unsigned int threads = 0);
+   bool isRunning() const { return _running; }
+   bool succeeded() const { return _succeeded; }
+
+   // stop the build as soon as possible, leaving the index as it was
+   void cancel() { _cancelled = true; }
+
+   // the whole build, on the calling thread
+   bool build(const vector<RXapianDocument> &documents, unsigned int threads = 0);
+
+ private:
+   string _dir;
+   thread _worker;
+   atomic<bool> _running;
+   atomic<bool> _succeeded;
+   atomic<bool> _cancelled;
+
+   bool install(const string &database);
+};
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -4,6 +4,7 @@
  */
 
 #include <libintl.h>
+#include <unordered_map>
 
 #include "sections_trans.h"
 
@@ -142,8 +143,33 @@ const char *transtable[][2] = {
 };
 
 #ifndef HAVE_RPM
+typedef unordered_map<string, string> SectionNames;
+
+// the translated names of all sections in the table; made the first
+// time a section is shown, when the locale is set up, and only read
+// after that, so the views may ask from several threads at once
+static const SectionNames &section_names()
+{
+   struct Table : SectionNames {
+      Table() {
+         for (int i = 0; transtable[i][0] != NULL; i++)
+            (*this)[transtable[i][0]] = _(transtable[i][1]);
+      }
+   };
+   static const Table names;
+   return names;
+}
+
+static void translate(const SectionNames &names, string &sec)
+{
+   SectionNames::const_iterator it = names.find(sec);
+   if (it != names.end())
+      sec = it->second;
+}
+
 string trans_section(string sec)
 {
+   const SectionNames &names = section_names();
    string str = sec;
    string suffix;
    // if we have something like "contrib/web", make "contrib" the
@@ -152,19 +178,9 @@ string trans_section(string sec)
    if (n != string::npos) {
       suffix = str.substr(0, n);
       str.erase(0, n + 1);
-      for (int i = 0; transtable[i][0] != NULL; i++) {
-         if (suffix == transtable[i][0]) {
-            suffix = _(transtable[i][1]);
-            break;
-         }
-      }
-   }
-   for (int i = 0; transtable[i][0] != NULL; i++) {
-      if (str == transtable[i][0]) {
-         str = _(transtable[i][1]);
-         break;
-      }
+      translate(names, suffix);
    }
+   translate(names, str);
    // if we have a suffix, add it
    if (!suffix.empty()) {
       ostringstream out;
@@ -0,0 +1,117 @@
+/* singleflight.h - One run for identical concurrent queries
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the coalescing BackendManager puts in front of
+ * the backends' slow queries. `snap list`, `flatpak list` and `snap
+ * info` take a while, and the update checks, the prefetches and the
+ * UI panes often ask the same thing at the same moment; the callers
+ * that come while a query is running wait for it and share its answer
+ * instead of starting the tool once more each.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SINGLEFLIGHT_H_
+#define _SINGLEFLIGHT_H_
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace PolySynaptic {
+
+/**
+ * SingleFlight - Coalesces concurrent runs of the same key
+ *
+ * run() calls work unless a run of the same key is in progress, in
+ * which case it waits for that run and returns a copy of its result
+ * (or rethrows its exception). Nothing is kept once a run is done: a
+ * call after it starts a new one, so this never answers from a cache.
+ *
+ * Callers that join get no progress of their own, only the result;
+ * work must not run its own key again, that would wait for itself.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+template <typename T>
+class SingleFlight {
+public:
+    T run(const std::string& key, const std::function<T()>& work)
+    {
+        std::promise<T> mine;
+        std::shared_future<T> flight;
+        uint64_t serial = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _flights.find(key);
+            if (it != _flights.end()) {
+                flight = it->second.result;
+                _joined++;
+            } else {
+                flight = mine.get_future().share();
+                serial = ++_serial;
+                _flights[key] = Flight{flight, serial};
+            }
+        }
+
+        if (serial != 0) {
+            try {
+                mine.set_value(work());
+            } catch (...) {
+                mine.set_exception(std::current_exception());
+            }
+            // forget() may have let a newer run take the key
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _flights.find(key);
+            if (it != _flights.end() && it->second.serial == serial) {
+                _flights.erase(it);
+            }
+        }
+        return flight.get();
+    }
+
+    /**
+     * Let the next call of every key start a run of its own, after the
+     * answer of a running one may have been outdated by a change; the
+     * callers already waiting still get that answer
+     */
+    void forget()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flights.clear();
+    }
+
+    /**
+     * Number of calls that shared a run instead of starting one
+     */
+    uint64_t getJoinedCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _joined;
+    }
+
+private:
+    struct Flight {
+        std::shared_future<T> result;
+        uint64_t serial;
+    };
+
+    mutable std::mutex _mutex;
+    std::map<std::string, Flight> _flights;    // Key -> run in progress
+    uint64_t _serial = 0;
+    uint64_t _joined = 0;
+};
+
+} // namespace PolySynaptic
+
+#endif // _SINGLEFLIGHT_H_
+
+// vim:ts=4:sw=4:et
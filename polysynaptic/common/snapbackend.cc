@@ -9,29 +9,41 @@
  */
 
 #include "snapbackend.h"
+#include "snaplocalstate.h"
+#include "tracing.h"
+#include "latency.h"
+#include "structuredlog.h"
 
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <signal.h>
-#include <fcntl.h>
-#include <poll.h>
 
 #include <cstring>
+#include <fstream>
 #include <sstream>
 #include <regex>
 #include <algorithm>
+#include <chrono>
 
 namespace PolySynaptic {
 
+// Availability is probed again after this even without a file change
+static const std::chrono::minutes AVAILABILITY_TTL(10);
+
 // ============================================================================
 // Constructor / Destructor
 // ============================================================================
 
 SnapBackend::SnapBackend()
-    : _availabilityChecked(false)
+    : _availability({"/usr/bin/snap", SnapdClient::DEFAULT_SOCKET}, AVAILABILITY_TTL)
     , _isAvailable(false)
     , _timeoutSeconds(120)
+    , _snapd(new SnapdClient())
+    , _useRestApi(true)
+    , _useLocalState(true)
+    , _restState(-1)
 {
 }
 
@@ -39,6 +51,20 @@ SnapBackend::~SnapBackend()
 {
 }
 
+shared_ptr<SnapBackend> SnapBackend::shared()
+{
+    static mutex lock;
+    static weak_ptr<SnapBackend> current;
+
+    lock_guard<mutex> guard(lock);
+    shared_ptr<SnapBackend> engine = current.lock();
+    if (!engine) {
+        engine = make_shared<SnapBackend>();
+        current = engine;
+    }
+    return engine;
+}
+
 // ============================================================================
 // Backend Information
 // ============================================================================
@@ -52,33 +78,34 @@ bool SnapBackend::isAvailable() const
 string SnapBackend::getUnavailableReason() const
 {
     checkAvailability();
+    lock_guard<mutex> lock(_mutex);
     return _unavailableReason;
 }
 
 string SnapBackend::getVersion() const
 {
     checkAvailability();
+    lock_guard<mutex> lock(_mutex);
     return _version;
 }
 
 void SnapBackend::checkAvailability() const
 {
-    // Use acquire memory order for first check (pairs with release below)
-    if (_availabilityChecked.load(std::memory_order_acquire)) return;
+    // Cached until it expires or snap or the socket appear or go away
+    if (_availability.isFresh()) return;
 
     lock_guard<mutex> lock(_mutex);
     // Second check inside lock
-    if (_availabilityChecked.load(std::memory_order_relaxed)) return;
+    if (_availability.isFresh()) return;
 
-    // Note: We set this to true AFTER initialization completes (at end of function)
-    // to ensure all data is visible to other threads
+    _unavailableReason.clear();
+    _version.clear();
 
     // Check if snap command exists
-    auto result = executeCommand({"which", "snap"}, 5);
-    if (!result.success || result.exitCode != 0) {
+    if (Subprocess::findProgram("snap").empty()) {
         _isAvailable = false;
         _unavailableReason = "snap command not found. Install snapd to enable Snap support.";
-        _availabilityChecked.store(true, std::memory_order_release);
+        _availability.markFresh();
         return;
     }
 
@@ -86,12 +113,18 @@ void SnapBackend::checkAvailability() const
     if (!isSnapdRunning()) {
         _isAvailable = false;
         _unavailableReason = "snapd service is not running. Start it with: sudo systemctl start snapd";
-        _availabilityChecked.store(true, std::memory_order_release);
+        _availability.markFresh();
+        return;
+    }
+
+    // Get version, preferring the daemon's own report
+    if (restAvailable() && _snapd->getVersion(_version)) {
+        _isAvailable = true;
+        _availability.markFresh();
         return;
     }
 
-    // Get version
-    result = executeCommand({"snap", "version"}, 10);
+    auto result = executeCommand({"snap", "version"}, 10);
     if (result.success && result.exitCode == 0) {
         // Parse first line: "snap    X.Y.Z"
         istringstream iss(result.stdout);
@@ -105,12 +138,17 @@ void SnapBackend::checkAvailability() const
     }
 
     _isAvailable = true;
-    // Use release memory order to ensure all writes are visible
-    _availabilityChecked.store(true, std::memory_order_release);
+    // Publishes the results to threads that see isFresh()
+    _availability.markFresh();
 }
 
 bool SnapBackend::isSnapdRunning() const
 {
+    // A connectable socket means the daemon is up
+    if (_useRestApi && restAvailable()) {
+        return true;
+    }
+
     // Check if snapd socket exists and is accessible
     auto result = executeCommand({"snap", "list"}, 10);
     return result.success && result.exitCode == 0;
@@ -121,6 +159,64 @@ string SnapBackend::getStoreUrl() const
     return "https://snapcraft.io";
 }
 
+bool SnapBackend::restAvailable() const
+{
+    int state = _restState.load();
+    if (state < 0) {
+        state = _snapd->isAvailable() ? 1 : 0;
+        _restState.store(state);
+    }
+    return state == 1;
+}
+
+void SnapBackend::restFailed() const
+{
+    // Transport errors usually mean snapd restarted; probe again next time
+    if (_snapd->getLastStatus() == 0) {
+        _restState.store(-1);
+    }
+}
+
+PackageInfo SnapBackend::fromSnapdSnap(const SnapdSnap& snap, bool summaryOnly)
+{
+    PackageInfo info;
+    info.backend = BackendType::SNAP;
+    info.id = snap.name;
+    info.name = snap.name;
+    info.summary = snap.summary;
+    info.version = snap.version;
+    info.publisher = snap.publisher;
+    info.license = snap.license;
+    if (summaryOnly) {
+        info.deferredFields = PackageInfo::DEFER_DETAILS;
+    } else {
+        info.description = snap.description;
+        info.homepage = snap.storeUrl;
+    }
+    info.channel = snap.trackingChannel.empty() ? snap.channel : snap.trackingChannel;
+    info.installedSize = snap.installedSize;
+    info.downloadSize = snap.downloadSize;
+    info.origin = "snapcraft.io";
+
+    if (snap.confinement == "classic") {
+        info.isClassic = true;
+        info.confinement = "classic";
+    } else if (snap.devmode || snap.confinement == "devmode") {
+        info.confinement = "devmode";
+    } else {
+        info.confinement = snap.confinement.empty() ? "strict" : snap.confinement;
+    }
+
+    if (snap.isInstalled()) {
+        info.installStatus = InstallStatus::INSTALLED;
+        info.installedVersion = snap.version;
+    } else {
+        info.installStatus = InstallStatus::NOT_INSTALLED;
+    }
+
+    return info;
+}
+
 // ============================================================================
 // Package Discovery & Search
 // ============================================================================
@@ -158,23 +254,34 @@ vector<PackageInfo> SnapBackend::searchPackages(
         progress(0.1, "Searching Snap Store...");
     }
 
-    // Execute snap find
-    auto result = executeCommand({"snap", "find", sanitizedQuery}, _timeoutSeconds);
-
-    if (!result.success || result.exitCode != 0) {
-        return results;
-    }
+    vector<SnapdSnap> found;
+    if (_useRestApi && restAvailable() &&
+        _snapd->find(sanitizedQuery, found, options.isCancelled)) {
+        for (const auto& snap : found) {
+            results.push_back(fromSnapdSnap(snap, true));
+        }
+    } else {
+        if (options.isCancelled && options.isCancelled()) {
+            return results;
+        }
+        if (_useRestApi) restFailed();
 
-    if (progress) {
-        progress(0.5, "Parsing Snap results...");
+        // Execute snap find, parsing while it prints
+        if (!streamCommand({"snap", "find", sanitizedQuery}, SnapOutputParser::Table::FIND,
+                           results, options.isCancelled)) {
+            return results;
+        }
     }
 
-    results = parseSnapFind(result.stdout);
-
     // Apply result limit
     if (options.maxResults > 0 && results.size() > static_cast<size_t>(options.maxResults)) {
         results.resize(options.maxResults);
     }
+    deferDetails(results);
+
+    if (options.isCancelled && options.isCancelled()) {
+        return results;
+    }
 
     // Get installation status for each result
     auto installed = getInstalledPackages(nullptr);
@@ -198,10 +305,106 @@ vector<PackageInfo> SnapBackend::searchPackages(
     return results;
 }
 
+string SnapBackend::getStoreCatalogGeneration()
+{
+    if (!isAvailable()) {
+        return "";
+    }
+
+    struct stat st;
+    if (stat(STORE_NAMES_FILE, &st) != 0) {
+        return "";
+    }
+    return to_string(st.st_mtime) + ":" + to_string(st.st_size);
+}
+
+bool SnapBackend::getStoreCatalog(vector<PackageInfo>& packages,
+                                  const function<bool()>& isCancelled)
+{
+    packages.clear();
+    if (!isAvailable()) {
+        return false;
+    }
+
+    // Every store snap by name; the store has no bulk metadata export
+    ifstream names(STORE_NAMES_FILE);
+    if (!names) {
+        return false;
+    }
+
+    map<string, size_t> byName;
+    string line;
+    while (getline(names, line)) {
+        if (line.empty() || byName.count(line) > 0) continue;
+        PackageInfo info;
+        info.backend = BackendType::SNAP;
+        info.id = line;
+        info.name = line;
+        info.origin = "snapcraft.io";
+        byName[line] = packages.size();
+        packages.push_back(info);
+    }
+
+    // Summaries and categories of the snaps the store lists by section
+    vector<string> sections;
+    if (!_useRestApi || !restAvailable() || !_snapd->listSections(sections)) {
+        deferDetails(packages);
+        return true;
+    }
+
+    for (const auto& section : sections) {
+        if (isCancelled && isCancelled()) {
+            return false;
+        }
+
+        vector<SnapdSnap> found;
+        if (!_snapd->findSection(section, found, isCancelled)) {
+            continue;
+        }
+
+        for (const auto& snap : found) {
+            auto it = byName.find(snap.name);
+            if (it == byName.end()) {
+                byName[snap.name] = packages.size();
+                packages.push_back(fromSnapdSnap(snap, true));
+                packages.back().section = section;
+                continue;
+            }
+
+            PackageInfo& info = packages[it->second];
+            if (info.summary.empty()) {
+                InternedString category = info.section;
+                info = fromSnapdSnap(snap, true);
+                info.section = category;
+            }
+            info.section = info.section.str().empty() ? section
+                                                      : info.section + ";" + section;
+        }
+    }
+
+    deferDetails(packages);
+    return true;
+}
+
 vector<PackageInfo> SnapBackend::getInstalledPackages(
     ProgressCallback progress)
 {
     vector<PackageInfo> results;
+    vector<SnapdSnap> installed;
+
+    // The mounts and snapd's state file first: milliseconds, and right
+    // while snapd restarts or seeds. The store's fields come with the
+    // details, from snapd, as for any summary record
+    if (_useLocalState && SnapLocalState().listInstalled(installed)) {
+        for (const auto& snap : installed) {
+            results.push_back(fromSnapdSnap(snap, true));
+        }
+        deferDetails(results);
+        if (progress) {
+            progress(1.0, "Loaded " + to_string(results.size()) + " installed Snaps");
+        }
+        return results;
+    }
 
     if (!isAvailable()) {
         return results;
@@ -211,17 +414,22 @@ vector<PackageInfo> SnapBackend::getInstalledPackages(
         progress(0.1, "Loading installed Snaps...");
     }
 
-    auto result = executeCommand({"snap", "list"}, _timeoutSeconds);
-
-    if (!result.success || result.exitCode != 0) {
+    if (_useRestApi && restAvailable() && _snapd->listInstalled(installed)) {
+        for (const auto& snap : installed) {
+            results.push_back(fromSnapdSnap(snap, true));
+        }
+        deferDetails(results);
+        if (progress) {
+            progress(1.0, "Loaded " + to_string(results.size()) + " installed Snaps");
+        }
         return results;
     }
+    if (_useRestApi) restFailed();
 
-    if (progress) {
-        progress(0.5, "Parsing installed Snaps...");
+    if (!streamCommand({"snap", "list"}, SnapOutputParser::Table::LIST, results)) {
+        return results;
     }
-
-    results = parseSnapList(result.stdout);
+    deferDetails(results);
 
     if (progress) {
         progress(1.0, "Loaded " + to_string(results.size()) + " installed Snaps");
@@ -238,6 +446,31 @@ PackageInfo SnapBackend::getPackageDetails(const string& packageId)
         return info;
     }
 
+    if (_useRestApi && restAvailable()) {
+        // Store metadata first, then overlay the local install state
+        SnapdSnap storeSnap;
+        SnapdSnap localSnap;
+        bool haveStore = _snapd->findByName(packageId, storeSnap);
+        bool haveLocal = _snapd->getInstalled(packageId, localSnap);
+
+        if (haveStore || haveLocal) {
+            info = fromSnapdSnap(haveStore ? storeSnap : localSnap);
+            if (haveLocal) {
+                info.installStatus = InstallStatus::INSTALLED;
+                info.installedVersion = localSnap.version;
+                info.installedSize = localSnap.installedSize;
+                if (!localSnap.trackingChannel.empty()) {
+                    info.channel = localSnap.trackingChannel;
+                }
+            } else {
+                info.installStatus = InstallStatus::NOT_INSTALLED;
+                info.installedVersion.clear();
+            }
+            return info;
+        }
+        restFailed();
+    }
+
     auto result = executeCommand({"snap", "info", packageId}, _timeoutSeconds);
 
     if (!result.success || result.exitCode != 0) {
@@ -254,6 +487,24 @@ InstallStatus SnapBackend::getInstallStatus(const string& packageId)
         return InstallStatus::UNKNOWN;
     }
 
+    if (_useRestApi && restAvailable()) {
+        SnapdSnap snap;
+        if (_snapd->getInstalled(packageId, snap)) {
+            vector<SnapdSnap> candidates;
+            _snapd->listRefreshCandidates(candidates);
+            for (const auto& candidate : candidates) {
+                if (candidate.name == packageId) {
+                    return InstallStatus::UPDATE_AVAILABLE;
+                }
+            }
+            return InstallStatus::INSTALLED;
+        }
+        if (_snapd->getLastStatus() == 404) {
+            return InstallStatus::NOT_INSTALLED;
+        }
+        restFailed();
+    }
+
     // Check if in installed list
     auto result = executeCommand({"snap", "list", packageId}, 30);
 
@@ -284,16 +535,25 @@ vector<PackageInfo> SnapBackend::getUpgradablePackages(
         progress(0.1, "Checking for Snap updates...");
     }
 
-    auto result = executeCommand({"snap", "refresh", "--list"}, _timeoutSeconds);
-
-    if (!result.success) {
+    vector<SnapdSnap> candidates;
+    if (_useRestApi && restAvailable() && _snapd->listRefreshCandidates(candidates)) {
+        for (const auto& snap : candidates) {
+            PackageInfo info = fromSnapdSnap(snap, true);
+            info.installStatus = InstallStatus::UPDATE_AVAILABLE;
+            info.installedVersion.clear();
+            results.push_back(info);
+        }
+        deferDetails(results);
+        if (progress) {
+            progress(1.0, "Found " + to_string(results.size()) + " Snap updates");
+        }
         return results;
     }
+    if (_useRestApi) restFailed();
 
-    // If exit code is 0, there are updates; parse them
-    if (result.exitCode == 0 && !result.stdout.empty()) {
-        results = parseSnapRefreshList(result.stdout);
-    }
+    // If exit code is 0, there are updates
+    streamCommand({"snap", "refresh", "--list"}, SnapOutputParser::Table::REFRESH_LIST, results);
+    deferDetails(results);
 
     if (progress) {
         progress(1.0, "Found " + to_string(results.size()) + " Snap updates");
@@ -302,6 +562,24 @@ vector<PackageInfo> SnapBackend::getUpgradablePackages(
     return results;
 }
 
+void SnapBackend::resolveDeferredFields(PackageInfo& info, unsigned fields)
+{
+    if (!(fields & PackageInfo::DEFER_DETAILS)) {
+        return;
+    }
+
+    PackageInfo details = getPackageDetails(info.id);
+    if (details.id.empty()) {
+        return;
+    }
+    if (fields & PackageInfo::DEFER_DESCRIPTION) {
+        info.description = std::move(details.description);
+    }
+    if (fields & PackageInfo::DEFER_HOMEPAGE) {
+        info.homepage = std::move(details.homepage);
+    }
+}
+
 // ============================================================================
 // Package Operations
 // ============================================================================
@@ -345,7 +623,7 @@ OperationResult SnapBackend::installSnap(
     vector<string> sudoArgs = {"pkexec"};
     sudoArgs.insert(sudoArgs.end(), args.begin(), args.end());
 
-    auto result = executeCommand(sudoArgs, 600);  // 10 minute timeout for large snaps
+    auto result = executeWithProgress(sudoArgs, {snapName}, 600, progress);  // 10 minute timeout for large snaps
 
     if (progress) {
         progress(1.0, result.success ? "Installed " + snapName : "Failed to install " + snapName);
@@ -388,7 +666,7 @@ OperationResult SnapBackend::removePackage(
     vector<string> sudoArgs = {"pkexec"};
     sudoArgs.insert(sudoArgs.end(), args.begin(), args.end());
 
-    auto result = executeCommand(sudoArgs, 300);
+    auto result = executeWithProgress(sudoArgs, {packageId}, 300, progress);
 
     if (progress) {
         progress(1.0, result.success ? "Removed " + packageId : "Failed to remove " + packageId);
@@ -422,7 +700,7 @@ OperationResult SnapBackend::updatePackage(
 
     vector<string> sudoArgs = {"pkexec", "snap", "refresh", packageId};
 
-    auto result = executeCommand(sudoArgs, 600);
+    auto result = executeWithProgress(sudoArgs, {packageId}, 600, progress);
 
     if (progress) {
         progress(1.0, result.success ? "Updated " + packageId : "Failed to update " + packageId);
@@ -438,6 +716,129 @@ OperationResult SnapBackend::updatePackage(
     }
 }
 
+OperationResult SnapBackend::installPackageVersion(
+    const string& packageId,
+    const string& target,
+    ProgressCallback progress)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
+    }
+
+    if (!isValidSnapName(packageId)) {
+        return OperationResult::Failure("Invalid snap name: " + packageId);
+    }
+
+    if (!isValidChannel(target)) {
+        return OperationResult::Failure("Invalid channel: " + target);
+    }
+
+    if (getInstallStatus(packageId) == InstallStatus::NOT_INSTALLED) {
+        return installSnap(packageId, false, target, progress);
+    }
+
+    if (progress) {
+        progress(0.1, "Refreshing " + packageId + " from " + target + "...");
+    }
+
+    // Refreshing with --channel switches the tracked channel as well
+    vector<string> sudoArgs = {"pkexec", "snap", "refresh", "--channel=" + target, packageId};
+
+    auto result = executeWithProgress(sudoArgs, {packageId}, 600, progress);
+
+    if (progress) {
+        progress(1.0, result.success ? "Updated " + packageId : "Failed to update " + packageId);
+    }
+
+    if (result.success && result.exitCode == 0) {
+        return OperationResult::Success("Moved " + packageId + " to " + target);
+    } else {
+        return OperationResult::Failure(
+            "Failed to move " + packageId + " to " + target,
+            result.stderr.empty() ? result.stdout : result.stderr,
+            result.exitCode);
+    }
+}
+
+// ============================================================================
+// Batch Operations
+// ============================================================================
+
+OperationResult SnapBackend::runBatch(
+    const string& verb,
+    const vector<string>& snapNames,
+    const vector<string>& flags,
+    int timeoutSeconds,
+    ProgressCallback progress)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available", _unavailableReason);
+    }
+
+    if (snapNames.empty()) {
+        return OperationResult::Success("Nothing to do");
+    }
+
+    for (const auto& name : snapNames) {
+        if (!isValidSnapName(name)) {
+            return OperationResult::Failure("Invalid snap name: " + name);
+        }
+    }
+
+    string count = to_string(snapNames.size()) + " snaps";
+    if (progress) {
+        progress(0.1, "Running snap " + verb + " for " + count + "...");
+    }
+
+    // snapd turns a multi-snap request into a single change, so shared
+    // bases and content snaps are fetched once
+    vector<string> args = {"pkexec", "snap", verb};
+    args.insert(args.end(), flags.begin(), flags.end());
+    args.insert(args.end(), snapNames.begin(), snapNames.end());
+
+    auto result = executeWithProgress(args, snapNames, timeoutSeconds, progress);
+
+    bool ok = result.success && result.exitCode == 0;
+    if (progress) {
+        progress(1.0, ok ? "snap " + verb + " finished for " + count
+                         : "snap " + verb + " failed for " + count);
+    }
+
+    if (ok) {
+        return OperationResult::Success("snap " + verb + " finished for " + count);
+    }
+    return OperationResult::Failure(
+        "snap " + verb + " failed for " + count,
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
+}
+
+OperationResult SnapBackend::installPackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    return runBatch("install", packageIds, {}, 600, progress);
+}
+
+OperationResult SnapBackend::removePackages(
+    const vector<string>& packageIds,
+    bool purge,
+    ProgressCallback progress)
+{
+    vector<string> flags;
+    if (purge) {
+        flags.push_back("--purge");
+    }
+    return runBatch("remove", packageIds, flags, 300, progress);
+}
+
+OperationResult SnapBackend::updatePackages(
+    const vector<string>& packageIds,
+    ProgressCallback progress)
+{
+    return runBatch("refresh", packageIds, {}, 600, progress);
+}
+
 OperationResult SnapBackend::refreshCache(ProgressCallback progress)
 {
     // Snap doesn't have a separate cache refresh; it's automatic
@@ -448,6 +849,102 @@ OperationResult SnapBackend::refreshCache(ProgressCallback progress)
     return OperationResult::Success("Snap store refreshed");
 }
 
+// ============================================================================
+// Cache Cleanup
+// ============================================================================
+
+vector<CachedItem> SnapBackend::parseDisabledRevisions(const string& output)
+{
+    vector<CachedItem> items;
+    istringstream lines(output);
+    string line;
+    bool header = true;
+    while (getline(lines, line)) {
+        if (header) {
+            header = false;     // Name Version Rev Tracking Publisher Notes
+            continue;
+        }
+        istringstream fields(line);
+        vector<string> row;
+        string field;
+        while (fields >> field) {
+            row.push_back(field);
+        }
+        if (row.size() < 6) {
+            continue;
+        }
+
+        // Notes: "disabled", or with others as in "disabled,classic"
+        bool disabled = false;
+        istringstream notes(row.back());
+        while (getline(notes, field, ',')) {
+            disabled = disabled || field == "disabled";
+        }
+        if (!disabled) {
+            continue;
+        }
+
+        CachedItem item;
+        item.name = row[0];
+        item.version = row[1];
+        item.location = row[2];
+        items.push_back(item);
+    }
+    return items;
+}
+
+vector<CachedItem> SnapBackend::getCachedItems()
+{
+    if (!isAvailable()) {
+        return {};
+    }
+    auto result = executeCommand({"snap", "list", "--all"}, 30);
+    if (!result.success || result.exitCode != 0) {
+        return {};
+    }
+
+    vector<CachedItem> items = parseDisabledRevisions(result.stdout);
+    for (auto& item : items) {
+        struct stat st;
+        string path = "/var/lib/snapd/snaps/" + item.name + "_" + item.location + ".snap";
+        if (stat(path.c_str(), &st) == 0) {
+            item.size = st.st_size;
+            item.mtime = st.st_mtime;
+        }
+    }
+    return items;
+}
+
+OperationResult SnapBackend::removeCachedItems(const vector<CachedItem>& items)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
+    }
+
+    // --revision takes one snap at a time
+    string errors;
+    int removed = 0;
+    for (const auto& item : items) {
+        if (!isValidSnapName(item.name) || item.location.empty() ||
+            item.location.find_first_not_of("0123456789x") != string::npos) {
+            errors += "Invalid revision " + item.name + " " + item.location + "\n";
+            continue;
+        }
+        auto result = executeCommand({"pkexec", "snap", "remove", item.name,
+                                      "--revision=" + item.location}, 120);
+        if (result.success && result.exitCode == 0) {
+            removed++;
+        } else {
+            errors += result.stderr.empty() ? result.stdout : result.stderr;
+        }
+    }
+
+    if (!errors.empty()) {
+        return OperationResult::Failure("Failed to remove disabled snap revisions", errors);
+    }
+    return OperationResult::Success("Removed " + to_string(removed) + " disabled snap revisions");
+}
+
 // ============================================================================
 // Snap-Specific Methods
 // ============================================================================
@@ -460,6 +957,14 @@ vector<string> SnapBackend::getChannels(const string& snapName)
         return channels;
     }
 
+    SnapdSnap snap;
+    if (_useRestApi && restAvailable() && _snapd->findByName(snapName, snap)) {
+        for (const auto& channel : snap.channels) {
+            channels.push_back(channel.first);
+        }
+        return channels;
+    }
+
     auto result = executeCommand({"snap", "info", snapName}, _timeoutSeconds);
 
     if (!result.success || result.exitCode != 0) {
@@ -526,296 +1031,353 @@ OperationResult SnapBackend::switchChannel(
     }
 }
 
-// ============================================================================
-// CLI Execution
-// ============================================================================
-
-SnapBackend::CommandResult SnapBackend::executeCommand(
-    const vector<string>& args,
-    int timeoutSeconds) const
+OperationResult SnapBackend::connectPlug(
+    const string& snapName,
+    const string& plug,
+    const string& targetSnap,
+    const string& slot)
 {
-    CommandResult result;
-    result.success = false;
-    result.exitCode = -1;
-
-    if (args.empty()) {
-        result.stderr = "No command specified";
-        return result;
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
     }
 
-    int timeout = (timeoutSeconds > 0) ? timeoutSeconds : _timeoutSeconds;
-
-    // Create pipes for stdout and stderr
-    int stdoutPipe[2];
-    int stderrPipe[2];
-
-    if (pipe(stdoutPipe) != 0) {
-        result.stderr = "Failed to create stdout pipe";
-        return result;
-    }
-    if (pipe(stderrPipe) != 0) {
-        result.stderr = "Failed to create stderr pipe";
-        close(stdoutPipe[0]);
-        close(stdoutPipe[1]);
-        return result;
+    // Plug and slot names follow the rules of snap names
+    if (!isValidSnapName(snapName) || !isValidSnapName(plug) ||
+        (!targetSnap.empty() && !isValidSnapName(targetSnap)) ||
+        (!slot.empty() && !isValidSnapName(slot))) {
+        return OperationResult::Failure("Invalid snap, plug or slot name");
     }
 
-    pid_t pid = fork();
-
-    if (pid < 0) {
-        result.stderr = "Failed to fork process";
-        close(stdoutPipe[0]); close(stdoutPipe[1]);
-        close(stderrPipe[0]); close(stderrPipe[1]);
-        return result;
+    vector<string> args = {"pkexec", "snap", "connect", snapName + ":" + plug};
+    if (!targetSnap.empty() || !slot.empty()) {
+        args.push_back(targetSnap + ":" + slot);
     }
 
-    if (pid == 0) {
-        // Child process
-        close(stdoutPipe[0]);
-        close(stderrPipe[0]);
-
-        dup2(stdoutPipe[1], STDOUT_FILENO);
-        dup2(stderrPipe[1], STDERR_FILENO);
-
-        close(stdoutPipe[1]);
-        close(stderrPipe[1]);
-
-        // Convert to C-style args
-        vector<char*> cargs;
-        for (const auto& arg : args) {
-            cargs.push_back(const_cast<char*>(arg.c_str()));
-        }
-        cargs.push_back(nullptr);
-
-        // Execute
-        execvp(cargs[0], cargs.data());
+    return runPrivileged(args, 30, "Connected " + snapName + ":" + plug,
+                         "Failed to connect plug");
+}
 
-        // If we get here, exec failed
-        _exit(127);
+OperationResult SnapBackend::disconnectPlug(
+    const string& snapName,
+    const string& plug)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
     }
 
-    // Parent process
-    close(stdoutPipe[1]);
-    close(stderrPipe[1]);
+    if (!isValidSnapName(snapName) || !isValidSnapName(plug)) {
+        return OperationResult::Failure("Invalid snap or plug name");
+    }
 
-    // Set non-blocking
-    fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK);
-    fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK);
+    return runPrivileged({"pkexec", "snap", "disconnect", snapName + ":" + plug}, 30,
+                         "Disconnected " + snapName + ":" + plug,
+                         "Failed to disconnect plug");
+}
 
-    // Read output with timeout
-    auto startTime = chrono::steady_clock::now();
-    bool timedOut = false;
+vector<pair<string, bool>> SnapBackend::getConnections(const string& snapName)
+{
+    if (!isAvailable() || !isValidSnapName(snapName)) {
+        return {};
+    }
 
-    while (true) {
-        // Check timeout
-        auto elapsed = chrono::duration_cast<chrono::seconds>(
-            chrono::steady_clock::now() - startTime).count();
+    auto result = executeCommand({"snap", "connections", snapName}, 10);
+    if (!result.success || result.exitCode != 0) {
+        return {};
+    }
+    return parseConnections(result.stdout);
+}
 
-        if (elapsed >= timeout) {
-            timedOut = true;
-            kill(pid, SIGTERM);
-            break;
+vector<pair<string, bool>> SnapBackend::parseConnections(const string& output)
+{
+    vector<pair<string, bool>> connections;
+    istringstream lines(output);
+    string line;
+    bool header = true;
+    while (getline(lines, line)) {
+        if (header) {
+            header = false;     // Interface Plug Slot Notes
+            continue;
+        }
+        istringstream fields(line);
+        string interface, plug, slot;
+        if (!(fields >> interface >> plug >> slot)) {
+            continue;
         }
 
-        // Poll for data
-        pollfd fds[2];
-        fds[0].fd = stdoutPipe[0];
-        fds[0].events = POLLIN;
-        fds[1].fd = stderrPipe[0];
-        fds[1].events = POLLIN;
-
-        int ret = poll(fds, 2, 100);  // 100ms poll timeout
-
-        if (ret > 0) {
-            char buffer[4096];
-
-            if (fds[0].revents & POLLIN) {
-                ssize_t n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0) {
-                    buffer[n] = '\0';
-                    result.stdout += buffer;
-                }
-            }
-
-            if (fds[1].revents & POLLIN) {
-                ssize_t n = read(stderrPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0) {
-                    buffer[n] = '\0';
-                    result.stderr += buffer;
-                }
-            }
+        // "firefox:camera", or "-" for a slot of the snap with no plug
+        size_t colon = plug.find(':');
+        if (colon == string::npos) {
+            continue;
         }
+        connections.push_back({plug.substr(colon + 1), slot != "-"});
+    }
+    return connections;
+}
 
-        // Check if child has exited
-        int status;
-        pid_t w = waitpid(pid, &status, WNOHANG);
-        if (w > 0) {
-            // Read any remaining data
-            char buffer[4096];
-            ssize_t n;
-            while ((n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[n] = '\0';
-                result.stdout += buffer;
-            }
-            while ((n = read(stderrPipe[0], buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[n] = '\0';
-                result.stderr += buffer;
-            }
+OperationResult SnapBackend::enable(const string& snapName)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
+    }
+    if (!isValidSnapName(snapName)) {
+        return OperationResult::Failure("Invalid snap name");
+    }
+    return runPrivileged({"pkexec", "snap", "enable", snapName}, 30,
+                         "Enabled " + snapName, "Failed to enable snap");
+}
 
-            if (WIFEXITED(status)) {
-                result.exitCode = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                result.exitCode = 128 + WTERMSIG(status);
-            }
-            result.success = true;
-            break;
-        }
+OperationResult SnapBackend::disable(const string& snapName)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
     }
+    if (!isValidSnapName(snapName)) {
+        return OperationResult::Failure("Invalid snap name");
+    }
+    return runPrivileged({"pkexec", "snap", "disable", snapName}, 30,
+                         "Disabled " + snapName, "Failed to disable snap");
+}
 
-    close(stdoutPipe[0]);
-    close(stderrPipe[0]);
+OperationResult SnapBackend::revert(const string& snapName)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
+    }
+    if (!isValidSnapName(snapName)) {
+        return OperationResult::Failure("Invalid snap name");
+    }
+    return runPrivileged({"pkexec", "snap", "revert", snapName}, 120,
+                         "Reverted " + snapName, "Failed to revert snap");
+}
 
-    if (timedOut) {
-        waitpid(pid, nullptr, 0);
-        result.stderr = "Command timed out after " + to_string(timeout) + " seconds";
-        result.exitCode = -1;
-        result.success = false;
+OperationResult SnapBackend::holdUpdates(const string& snapName, bool hold)
+{
+    if (!isAvailable()) {
+        return OperationResult::Failure("Snap backend not available");
     }
+    if (!isValidSnapName(snapName)) {
+        return OperationResult::Failure("Invalid snap name");
+    }
+    return runPrivileged({"pkexec", "snap", "refresh", hold ? "--hold" : "--unhold", snapName}, 30,
+                         string(hold ? "Held" : "Unheld") + " updates for " + snapName,
+                         string("Failed to ") + (hold ? "hold" : "unhold") + " updates");
+}
 
-    return result;
+OperationResult SnapBackend::runPrivileged(const vector<string>& args,
+                                           int timeoutSeconds,
+                                           const string& succeeded,
+                                           const string& failed)
+{
+    auto result = executeCommand(args, timeoutSeconds);
+
+    if (result.success && result.exitCode == 0) {
+        return OperationResult::Success(succeeded);
+    }
+    return OperationResult::Failure(
+        failed,
+        result.stderr.empty() ? result.stdout : result.stderr,
+        result.exitCode);
 }
 
 // ============================================================================
-// Parsing Helpers
+// CLI Execution
 // ============================================================================
 
-vector<PackageInfo> SnapBackend::parseSnapFind(const string& output)
+// Commands that only read, so a background one may be stopped and rerun
+static bool isQuery(const vector<string>& args)
 {
-    vector<PackageInfo> results;
+    if (args.size() < 2 || args[0] != "snap") {
+        return false;
+    }
+    const string& verb = args[1];
+    if (verb == "refresh") {
+        return find(args.begin(), args.end(), "--list") != args.end();
+    }
+    return verb == "list" || verb == "info" || verb == "find" ||
+           verb == "version" || verb == "connections";
+}
 
-    /*
-     * snap find output format:
-     * Name       Version   Publisher   Notes   Summary
-     * hello      2.10      canonical*  -       GNU Hello, the "hello world" snap
-     */
+SnapBackend::CommandResult SnapBackend::executeCommand(
+    const vector<string>& args,
+    int timeoutSeconds,
+    const function<bool()>& cancelled,
+    const Subprocess::OutputCallback& onStdout) const
+{
+    CommandResult result;
+    result.success = false;
+    result.exitCode = -1;
 
-    istringstream iss(output);
-    string line;
-    bool headerSkipped = false;
+    if (args.empty()) {
+        result.stderr = "No command specified";
+        return result;
+    }
 
-    while (getline(iss, line)) {
-        // Skip header line
-        if (!headerSkipped) {
-            if (line.find("Name") != string::npos && line.find("Version") != string::npos) {
-                headerSkipped = true;
-            }
-            continue;
-        }
+    ScopedSpan span("subprocess", "snap");
+    if (span.isActive()) {
+        span.setDetail(args.size() > 1 ? args[0] + " " + args[1] : args[0]);
+    }
+    ScopedLatency latency("Snap", args.size() > 1 ? args[0] + " " + args[1] : args[0]);
 
-        // Skip empty lines
-        if (line.empty()) continue;
+    int timeout = (timeoutSeconds > 0) ? timeoutSeconds : _timeoutSeconds;
 
-        // Parse columns (space-separated, but summary can have spaces)
-        istringstream lineStream(line);
-        string name, version, publisher, notes;
+    Subprocess::Options options;
+    options.timeoutSeconds = timeout;
+    options.cancelled = cancelled;
+    options.pool = "snap";
+    options.preemptible = isQuery(args);
+    if (onStdout) {
+        // Streamed to the caller instead of collected
+        options.onStdout = onStdout;
+        options.keepStdout = false;
+    }
 
-        lineStream >> name >> version >> publisher >> notes;
+    Subprocess::Result run = Subprocess::run(args, options);
+    result.stdout = std::move(run.stdout);
+    result.stderr = std::move(run.stderr);
+    result.usage = run.usage;
 
-        // Rest is summary
-        string summary;
-        getline(lineStream, summary);
+    if (!run.started) {
+        result.stderr = run.error;
+        return result;
+    }
 
-        // Trim leading spaces from summary
-        size_t start = summary.find_first_not_of(" \t");
-        if (start != string::npos) {
-            summary = summary.substr(start);
-        }
-
-        if (!name.empty()) {
-            PackageInfo info;
-            info.backend = BackendType::SNAP;
-            info.id = name;
-            info.name = name;
-            info.version = version;
-            info.publisher = publisher;
-            info.summary = summary;
-            info.installStatus = InstallStatus::NOT_INSTALLED;
-
-            // Check for classic confinement note
-            if (notes.find("classic") != string::npos) {
-                info.isClassic = true;
-                info.confinement = "classic";
-            }
+    if (run.timedOut || run.cancelled) {
+        result.stderr = run.cancelled ? "Command cancelled"
+                                      : "Command timed out after " + to_string(timeout) + " seconds";
+    } else {
+        result.exitCode = run.exitCode;
+        result.success = true;
+    }
 
-            results.push_back(info);
+    result.usage.report(span, "Snap", args, result.exitCode);
+    return result;
+}
+
+// How often a running install polls snapd for its change
+static const chrono::milliseconds CHANGE_POLL_INTERVAL(500);
+
+double SnapBackend::changeFraction(const SnapdChange& change)
+{
+    if (change.tasks.empty()) return 0.0;
+
+    double done = 0.0;
+    for (const auto& task : change.tasks) {
+        if (task.isFinished()) {
+            done += 1.0;
+        } else if (task.status == "Doing" && task.total > 0) {
+            done += min(1.0, (double)task.done / task.total);
         }
     }
-
-    return results;
+    return done / change.tasks.size();
 }
 
-vector<PackageInfo> SnapBackend::parseSnapList(const string& output)
+SnapBackend::CommandResult SnapBackend::executeWithProgress(
+    const vector<string>& args,
+    const vector<string>& snapNames,
+    int timeoutSeconds,
+    ProgressCallback progress)
 {
-    vector<PackageInfo> results;
+    if (!progress) {
+        return executeCommand(args, timeoutSeconds);
+    }
+
+    ProgressThrottle throttle(progress);
+    bool poll = _useRestApi && restAvailable();
+    auto nextPoll = chrono::steady_clock::now() + CHANGE_POLL_INTERVAL;
+    int64_t lastBytes = -1;
+    auto lastBytesAt = nextPoll;
+    string rate;
+
+    // Subprocess polls this every 100 ms while the CLI runs; every
+    // CHANGE_POLL_INTERVAL it also asks snapd how far the change got
+    auto cancelled = [&]() {
+        if (throttle.cancelled()) return true;
+
+        auto now = chrono::steady_clock::now();
+        if (!poll || now < nextPoll) return false;
+        nextPoll = now + CHANGE_POLL_INTERVAL;
+
+        vector<SnapdChange> changes;
+        if (!_snapd->listChanges(changes)) {
+            poll = false;       // Old snapd or no access; just wait
+            return false;
+        }
 
-    /*
-     * snap list output format:
-     * Name        Version    Rev    Tracking       Publisher   Notes
-     * core20      20231123   2105   latest/stable  canonical*  base
-     */
+        for (const auto& change : changes) {
+            bool ours = any_of(change.snapNames.begin(), change.snapNames.end(),
+                [&](const string& name) {
+                    return find(snapNames.begin(), snapNames.end(), name) !=
+                           snapNames.end();
+                });
+            if (!ours) continue;
+
+            int64_t bytes = 0;
+            const SnapdTask* doing = nullptr;
+            for (const auto& task : change.tasks) {
+                if (task.kind == "download-snap") bytes += task.done;
+                if (task.status == "Doing" && doing == nullptr) doing = &task;
+            }
 
-    istringstream iss(output);
-    string line;
-    bool headerSkipped = false;
+            if (lastBytes >= 0 && bytes > lastBytes) {
+                double seconds = chrono::duration<double>(now - lastBytesAt).count();
+                if (seconds > 0) {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "%.1f MB/s",
+                             (bytes - lastBytes) / seconds / (1024.0 * 1024.0));
+                    rate = buf;
+                }
+            }
+            lastBytes = bytes;
+            lastBytesAt = now;
 
-    while (getline(iss, line)) {
-        if (!headerSkipped) {
-            if (line.find("Name") != string::npos && line.find("Rev") != string::npos) {
-                headerSkipped = true;
+            string message = doing ? doing->summary : change.summary;
+            if (doing && doing->kind == "download-snap" && !rate.empty()) {
+                message += " (" + rate + ")";
             }
-            continue;
+            throttle.report(0.1 + 0.85 * changeFraction(change), message);
+            break;
         }
+        return throttle.cancelled();
+    };
 
-        if (line.empty()) continue;
-
-        istringstream lineStream(line);
-        string name, version, rev, tracking, publisher, notes;
-
-        lineStream >> name >> version >> rev >> tracking >> publisher;
+    return executeCommand(args, timeoutSeconds, cancelled);
+}
 
-        // Rest is notes
-        getline(lineStream, notes);
+bool SnapBackend::streamCommand(const vector<string>& args,
+                                SnapOutputParser::Table table,
+                                vector<PackageInfo>& results,
+                                const function<bool()>& cancelled) const
+{
+    size_t before = results.size();
+    SnapOutputParser parser(table,
+        [&](PackageInfo&& info) { results.push_back(std::move(info)); });
 
-        if (!name.empty()) {
-            PackageInfo info;
-            info.backend = BackendType::SNAP;
-            info.id = name;
-            info.name = name;
-            info.version = version;
-            info.installedVersion = version;
-            info.installStatus = InstallStatus::INSTALLED;
-            info.publisher = publisher;
-            info.channel = tracking;
-
-            // Parse notes for confinement
-            if (notes.find("classic") != string::npos) {
-                info.isClassic = true;
-                info.confinement = "classic";
-            } else if (notes.find("devmode") != string::npos) {
-                info.confinement = "devmode";
-            } else {
-                info.confinement = "strict";
-            }
+    auto result = executeCommand(args, _timeoutSeconds, cancelled,
+        [&](const char *data, size_t size) { parser.feed(data, size); });
 
-            results.push_back(info);
-        }
+    if (!result.success || result.exitCode != 0) {
+        results.erase(results.begin() + before, results.end());
+        return false;
     }
+    parser.finish();
+    return true;
+}
 
-    return results;
+void SnapBackend::deferDetails(vector<PackageInfo>& results, size_t first)
+{
+    for (size_t i = first; i < results.size(); i++) {
+        results[i].deferredFields |= PackageInfo::DEFER_DETAILS;
+        results[i].deferredSource = this;
+    }
 }
 
+// ============================================================================
+// Parsing Helpers
+// ============================================================================
+
 PackageInfo SnapBackend::parseSnapInfo(const string& output)
 {
+    ScopedSpan span("parse", "snap");
     PackageInfo info;
     info.backend = BackendType::SNAP;
 
@@ -905,51 +1467,121 @@ PackageInfo SnapBackend::parseSnapInfo(const string& output)
     return info;
 }
 
-vector<PackageInfo> SnapBackend::parseSnapRefreshList(const string& output)
+// ============================================================================
+// Streaming Output Parser
+// ============================================================================
+
+SnapOutputParser::SnapOutputParser(Table table, PackageCallback onPackage)
+    : _table(table),
+      _onPackage(std::move(onPackage)),
+      _lines([this](const string& line) { parseLine(line); }),
+      _headerSkipped(false),
+      _done(false),
+      _count(0)
 {
-    vector<PackageInfo> results;
+}
+
+void SnapOutputParser::parseLine(const string& line)
+{
+    if (_done) {
+        return;
+    }
 
     /*
+     * snap find output format:
+     * Name       Version   Publisher   Notes   Summary
+     * hello      2.10      canonical*  -       GNU Hello, the "hello world" snap
+     *
+     * snap list output format:
+     * Name        Version    Rev    Tracking       Publisher   Notes
+     * core20      20231123   2105   latest/stable  canonical*  base
+     *
      * snap refresh --list output:
      * Name        Version  Rev   Publisher   Notes
      * firefox     123.0    3234  mozilla*    -
      */
 
-    istringstream iss(output);
-    string line;
-    bool headerSkipped = false;
-
-    while (getline(iss, line)) {
-        if (!headerSkipped) {
-            if (line.find("Name") != string::npos || line.find("All snaps up to date") != string::npos) {
-                headerSkipped = true;
-                if (line.find("All snaps up to date") != string::npos) {
-                    return results;  // No updates
-                }
-            }
-            continue;
+    // Skip header line; snap translates it ("Nom  Version  Éditeur..."
+    // under LANG=fr), so the first line is taken whatever it says
+    if (!_headerSkipped) {
+        if (line.find_first_not_of(" \t\r") == string::npos) {
+            return;
+        }
+        if (_table == Table::REFRESH_LIST &&
+            line.find("All snaps up to date") != string::npos) {
+            _done = true;   // No updates
         }
+        _headerSkipped = true;
+        return;
+    }
 
-        if (line.empty()) continue;
+    // Skip empty lines
+    if (line.empty()) return;
+
+    // Parse columns (space-separated, but the last one can have spaces)
+    istringstream lineStream(line);
+    string publisher;
+    PackageInfo info;
+    info.backend = BackendType::SNAP;
 
-        istringstream lineStream(line);
-        string name, version, rev, publisher;
+    switch (_table) {
+    case Table::FIND: {
+        string notes;
+        lineStream >> info.name >> info.version >> publisher >> notes;
 
-        lineStream >> name >> version >> rev >> publisher;
+        // Rest is summary
+        getline(lineStream, info.summary);
 
-        if (!name.empty()) {
-            PackageInfo info;
-            info.backend = BackendType::SNAP;
-            info.id = name;
-            info.name = name;
-            info.version = version;
-            info.installStatus = InstallStatus::UPDATE_AVAILABLE;
-            info.publisher = publisher;
-            results.push_back(info);
+        // Trim leading spaces from summary
+        size_t start = info.summary.find_first_not_of(" \t");
+        if (start != string::npos) {
+            info.summary.erase(0, start);
         }
+        info.installStatus = InstallStatus::NOT_INSTALLED;
+
+        // Check for classic confinement note
+        if (notes.find("classic") != string::npos) {
+            info.isClassic = true;
+            info.confinement = "classic";
+        }
+        break;
     }
+    case Table::LIST: {
+        string rev, tracking, notes;
+        lineStream >> info.name >> info.version >> rev >> tracking >> publisher;
+        info.channel = tracking;
 
-    return results;
+        // Rest is notes
+        getline(lineStream, notes);
+
+        info.installedVersion = info.version;
+        info.installStatus = InstallStatus::INSTALLED;
+
+        // Parse notes for confinement
+        if (notes.find("classic") != string::npos) {
+            info.isClassic = true;
+            info.confinement = "classic";
+        } else if (notes.find("devmode") != string::npos) {
+            info.confinement = "devmode";
+        } else {
+            info.confinement = "strict";
+        }
+        break;
+    }
+    case Table::REFRESH_LIST: {
+        string rev;
+        lineStream >> info.name >> info.version >> rev >> publisher;
+        info.installStatus = InstallStatus::UPDATE_AVAILABLE;
+        break;
+    }
+    }
+
+    if (!info.name.empty()) {
+        info.id = info.name;
+        info.publisher = publisher;
+        _count++;
+        _onPackage(std::move(info));
+    }
 }
 
 // ============================================================================
@@ -968,6 +1600,17 @@ bool SnapBackend::isValidSnapName(const string& name) const
     return regex_match(name, validName);
 }
 
+bool SnapBackend::isValidChannel(const string& channel) const
+{
+    // [track/]risk[/branch], e.g. "edge" or "3.x/stable/hotfix"
+    if (channel.empty() || channel.length() > 128) {
+        return false;
+    }
+
+    static const regex validChannel("^[a-zA-Z0-9][a-zA-Z0-9._-]*(/[a-zA-Z0-9][a-zA-Z0-9._-]*){0,2}$");
+    return regex_match(channel, validChannel);
+}
+
 } // namespace PolySynaptic
 
 // vim:ts=4:sw=4:et
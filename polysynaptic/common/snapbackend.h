@@ -3,7 +3,8 @@
  * Copyright (c) 2024 PolySynaptic Contributors
  *
  * This file implements the IPackageBackend interface for Snap packages.
- * It uses the snap CLI tool to discover, install, and manage snaps.
+ * It queries snapd's REST API directly when the daemon socket is
+ * reachable and falls back to the snap CLI otherwise.
  *
  * Requirements:
  *   - snapd installed and running
@@ -19,17 +20,62 @@
 #define _SNAPBACKEND_H_
 
 #include "ipackagebackend.h"
+#include "snapdclient.h"
+#include "subprocess.h"
+#include "probecache.h"
 #include <mutex>
+#include <memory>
 #include <chrono>
 #include <atomic>
 
 namespace PolySynaptic {
 
+/**
+ * SnapOutputParser - Reads the tables printed by the snap CLI
+ *
+ * Fed the output chunk by chunk as the pipe delivers it; each package
+ * is handed on as soon as its line is complete, so the listing never
+ * has to be held in memory and its size is not limited.
+ */
+class SnapOutputParser {
+public:
+    enum class Table {
+        FIND,           // snap find <query>
+        LIST,           // snap list
+        REFRESH_LIST    // snap refresh --list
+    };
+
+    using PackageCallback = std::function<void(PackageInfo&& info)>;
+
+    SnapOutputParser(Table table, PackageCallback onPackage);
+
+    SnapOutputParser(const SnapOutputParser&) = delete;
+    SnapOutputParser& operator=(const SnapOutputParser&) = delete;
+
+    void feed(const char *data, size_t size) { _lines.feed(data, size); }
+    void finish() { _lines.finish(); }
+
+    size_t count() const { return _count; }
+
+private:
+    Table _table;
+    PackageCallback _onPackage;
+    LineSplitter _lines;
+    bool _headerSkipped;
+    bool _done;             // "All snaps up to date"
+    size_t _count;
+
+    void parseLine(const string& line);
+};
+
 /**
  * SnapBackend - Snap package management backend
  *
- * Uses the snap CLI to manage Snap packages. All operations are
- * performed by invoking snap commands and parsing their output.
+ * Read-only queries (search, list, info, refresh candidates) go to
+ * snapd's JSON API over /run/snapd.socket through SnapdClient. If the
+ * socket is unreachable or a request fails at the transport level,
+ * the backend falls back to invoking the snap CLI and parsing its
+ * output. Privileged operations always use the CLI via pkexec.
  *
  * CLI Commands Used:
  *   snap find <query>       - Search for snaps
@@ -53,6 +99,13 @@ public:
     SnapBackend();
     ~SnapBackend() override;
 
+    /**
+     * The engine of the process, which BackendManager and SnapProvider
+     * share so the tool runs, caches and availability probe are one;
+     * made on first use and freed with its last holder
+     */
+    static shared_ptr<SnapBackend> shared();
+
     // ========================================================================
     // Backend Information
     // ========================================================================
@@ -62,6 +115,7 @@ public:
     bool isAvailable() const override;
     string getUnavailableReason() const override;
     string getVersion() const override;
+    void invalidateAvailability() override { _availability.invalidate(); }
 
     // ========================================================================
     // Package Discovery & Search
@@ -81,6 +135,12 @@ public:
     vector<PackageInfo> getUpgradablePackages(
         ProgressCallback progress = nullptr) override;
 
+    string getStoreCatalogGeneration() override;
+    bool getStoreCatalog(vector<PackageInfo>& packages,
+                         const function<bool()>& isCancelled) override;
+
+    void resolveDeferredFields(PackageInfo& info, unsigned fields) override;
+
     // ========================================================================
     // Package Operations
     // ========================================================================
@@ -101,6 +161,47 @@ public:
     OperationResult refreshCache(
         ProgressCallback progress = nullptr) override;
 
+    // ========================================================================
+    // Batch Operations
+    // ========================================================================
+
+    OperationResult installPackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult removePackages(
+        const vector<string>& packageIds,
+        bool purge = false,
+        ProgressCallback progress = nullptr) override;
+
+    OperationResult updatePackages(
+        const vector<string>& packageIds,
+        ProgressCallback progress = nullptr) override;
+
+    // Installs from, or refreshes an installed snap onto, the channel
+    // given as target (e.g. "beta" or "3.x/stable")
+    OperationResult installPackageVersion(
+        const string& packageId,
+        const string& target,
+        ProgressCallback progress = nullptr) override;
+
+    // ========================================================================
+    // Cache Cleanup
+    // ========================================================================
+
+    /**
+     * The disabled revisions snapd keeps to revert to, from
+     * `snap list --all`; location is the revision
+     */
+    bool supportsCacheCleanup() const override { return true; }
+    vector<CachedItem> getCachedItems() override;
+    OperationResult removeCachedItems(const vector<CachedItem>& items) override;
+
+    /**
+     * The disabled revisions in `snap list --all` output
+     */
+    static vector<CachedItem> parseDisabledRevisions(const string& output);
+
     // ========================================================================
     // Snap-Specific Methods
     // ========================================================================
@@ -131,6 +232,50 @@ public:
         const string& snapName,
         const string& channel);
 
+    /**
+     * Connect a plug of a snap, to the given slot or, with no target,
+     * to the one snapd picks
+     */
+    OperationResult connectPlug(
+        const string& snapName,
+        const string& plug,
+        const string& targetSnap = "",
+        const string& slot = "");
+
+    /**
+     * Disconnect a plug of a snap from whatever it is connected to
+     */
+    OperationResult disconnectPlug(
+        const string& snapName,
+        const string& plug);
+
+    /**
+     * The plugs of a snap and whether each is connected
+     */
+    vector<pair<string, bool>> getConnections(const string& snapName);
+
+    /**
+     * The plugs in `snap connections` output and whether each is
+     * connected
+     */
+    static vector<pair<string, bool>> parseConnections(const string& output);
+
+    /**
+     * Enable or disable a snap, keeping it installed
+     */
+    OperationResult enable(const string& snapName);
+    OperationResult disable(const string& snapName);
+
+    /**
+     * Go back to the revision a snap had before its last refresh
+     */
+    OperationResult revert(const string& snapName);
+
+    /**
+     * Hold a snap's automatic refreshes, or let them go on again
+     */
+    OperationResult holdUpdates(const string& snapName, bool hold);
+
     /**
      * Check if snapd is running
      */
@@ -146,34 +291,109 @@ public:
      */
     void setTimeout(int seconds) { _timeoutSeconds = seconds; }
 
+    /**
+     * Enable or disable the snapd REST API path (default: enabled)
+     *
+     * When disabled, every query goes through the snap CLI.
+     */
+    void setUseRestApi(bool enabled) { _useRestApi = enabled; }
+    bool isUsingRestApi() const { return _useRestApi && restAvailable(); }
+
+    /**
+     * Enable or disable listing installed snaps from /snap and snapd's
+     * state file (default: enabled), see SnapLocalState
+     *
+     * When disabled, the installed list comes from snapd.
+     */
+    void setUseLocalState(bool enabled) { _useLocalState = enabled; }
+
+    /**
+     * Store snap names snapd keeps for completion, refreshed daily
+     */
+    static constexpr const char* STORE_NAMES_FILE = "/var/cache/snapd/names";
+
+    /**
+     * Convert a snapd API record to a PackageInfo; a summary record
+     * leaves the DEFER_DETAILS fields unset and deferred
+     */
+    static PackageInfo fromSnapdSnap(const SnapdSnap& snap, bool summaryOnly = false);
+
+    /**
+     * Fraction of a snapd change done: finished tasks count whole, the
+     * running ones by their own progress
+     */
+    static double changeFraction(const SnapdChange& change);
+
 private:
     mutable mutex _mutex;           // Thread safety lock
-    mutable std::atomic<bool> _availabilityChecked;
-    mutable bool _isAvailable;
+    mutable ProbeCache _availability;   // Guards the three below
+    mutable std::atomic<bool> _isAvailable;
     mutable string _unavailableReason;
     mutable string _version;
     int _timeoutSeconds;
 
+    // snapd REST client
+    unique_ptr<SnapdClient> _snapd;
+    std::atomic<bool> _useRestApi;
+    std::atomic<bool> _useLocalState;
+    mutable std::atomic<int> _restState;   // -1 unknown, 0 down, 1 up
+
+    bool restAvailable() const;
+    void restFailed() const;
+
+    // One `pkexec snap <verb> [flags] name...` for every snap
+    OperationResult runBatch(const string& verb,
+                             const vector<string>& snapNames,
+                             const vector<string>& flags,
+                             int timeoutSeconds,
+                             ProgressCallback progress);
+
     // CLI execution helpers
     struct CommandResult {
         bool success;
         int exitCode;
         string stdout;
         string stderr;
+        ProcessUsage usage;
     };
 
     CommandResult executeCommand(
         const vector<string>& args,
-        int timeoutSeconds = 0) const;
+        int timeoutSeconds = 0,
+        const function<bool()>& cancelled = nullptr,
+        const Subprocess::OutputCallback& onStdout = nullptr) const;
+
+    // Run one privileged `pkexec snap ...`, reporting success or failure
+    OperationResult runPrivileged(const vector<string>& args,
+                                  int timeoutSeconds,
+                                  const string& succeeded,
+                                  const string& failed);
+
+    // Run a `snap install/remove/refresh`, reporting the progress of the
+    // snapd change for snapNames between 0.1 and 0.95 while it runs;
+    // cancelled when progress asks to
+    CommandResult executeWithProgress(const vector<string>& args,
+                                      const vector<string>& snapNames,
+                                      int timeoutSeconds,
+                                      ProgressCallback progress);
+
+    // Name this backend as the source of the details results[first...]
+    // leave deferred; the CLI tables carry none to begin with
+    void deferDetails(vector<PackageInfo>& results, size_t first = 0);
+
+    // Run a CLI listing, appending its packages as the lines arrive;
+    // false, with results as before, if the command failed
+    bool streamCommand(const vector<string>& args,
+                       SnapOutputParser::Table table,
+                       vector<PackageInfo>& results,
+                       const function<bool()>& cancelled = nullptr) const;
 
     // Parsing helpers
     PackageInfo parseSnapInfo(const string& output);
-    vector<PackageInfo> parseSnapFind(const string& output);
-    vector<PackageInfo> parseSnapList(const string& output);
-    vector<PackageInfo> parseSnapRefreshList(const string& output);
 
     // Validation
     bool isValidSnapName(const string& name) const;
+    bool isValidChannel(const string& channel) const;
 
     // Check availability (cached)
     void checkAvailability() const;
@@ -0,0 +1,182 @@
+/* snapchangewatcher.cc - snapd changes as they move, without polling
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "snapchangewatcher.h"
+#include "snapbackend.h"
+
+#include <chrono>
+
+namespace PolySynaptic {
+
+namespace {
+
+// Finished changes remembered so a repeated notice is not news; past
+// this many they are forgotten, the running ones kept
+const size_t MAX_REPORTED = 256;
+
+const char READY_MARK = '!';
+
+} // anonymous namespace
+
+SnapChangeWatcher::SnapChangeWatcher(const std::string& socketPath)
+    : _client(socketPath)
+    , _stopping(false)
+{
+    // snapd holds each wait for up to WAIT_SECONDS before answering
+    _client.setTimeout(WAIT_SECONDS + 15);
+}
+
+SnapChangeWatcher::~SnapChangeWatcher()
+{
+    stop();
+}
+
+void SnapChangeWatcher::start(Listener listener)
+{
+    if (_thread.joinable()) {
+        return;
+    }
+    _listener = std::move(listener);
+    _stopping = false;
+    _thread = std::thread(&SnapChangeWatcher::run, this);
+}
+
+void SnapChangeWatcher::stop()
+{
+    if (!_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _thread.join();
+}
+
+SnapChangeEvent::State SnapChangeWatcher::stateOf(const SnapdChange& change)
+{
+    if (!change.ready) {
+        return SnapChangeEvent::State::RUNNING;
+    }
+    return change.status == "Done" ? SnapChangeEvent::State::DONE
+                                   : SnapChangeEvent::State::FAILED;
+}
+
+bool SnapChangeWatcher::noteChange(const SnapdChange& change, SnapChangeEvent& event)
+{
+    std::string look = change.status;
+    if (change.ready) {
+        look += READY_MARK;
+    }
+    for (const auto& task : change.tasks) {
+        look += "," + task.status;
+    }
+
+    std::string& reported = _reported[change.id];
+    if (reported == look) {
+        return false;
+    }
+    reported = look;
+
+    if (_reported.size() > MAX_REPORTED) {
+        for (auto it = _reported.begin(); it != _reported.end();) {
+            bool finished = it->second.find(READY_MARK) != std::string::npos;
+            it = finished && it->first != change.id ? _reported.erase(it) : std::next(it);
+        }
+    }
+
+    event.change = change;
+    event.state = stateOf(change);
+    event.fraction = event.state == SnapChangeEvent::State::DONE
+                         ? 1.0 : SnapBackend::changeFraction(change);
+    return true;
+}
+
+void SnapChangeWatcher::report(const SnapdChange& change)
+{
+    SnapChangeEvent event;
+    if (noteChange(change, event) && _listener) {
+        _listener(event);
+    }
+}
+
+void SnapChangeWatcher::pause()
+{
+    int seconds = POLL_SECONDS;
+    std::unique_lock<std::mutex> lock(_wakeMutex);
+    _wake.wait_for(lock, std::chrono::seconds(seconds),
+                   [this]() { return _stopping.load(); });
+}
+
+void SnapChangeWatcher::run()
+{
+    bool notices = true;
+    bool primed = false;            // Past what happened before start()
+    std::string after;
+    std::set<std::string> running;
+
+    while (!_stopping) {
+        if (notices) {
+            std::vector<SnapdNotice> found;
+            auto cancelled = [this]() { return _stopping.load(); };
+            if (_client.waitForNotices(after, primed ? WAIT_SECONDS : 0, found, cancelled)) {
+                for (const auto& notice : found) {
+                    SnapdChange change;
+                    if (primed && notice.type == "change-update" &&
+                        _client.getChange(notice.key, change)) {
+                        report(change);
+                    }
+                }
+                // In the order they last occurred, which is what "after"
+                // goes by
+                if (!found.empty()) {
+                    after = found.back().lastOccurred;
+                }
+                primed = true;
+                continue;
+            }
+            int status = _client.getLastStatus();
+            if (status == 400 || status == 404) {
+                notices = false;    // snapd before 2.60
+                primed = false;
+                continue;
+            }
+        } else {
+            std::vector<SnapdChange> changes;
+            if (_client.listChanges(changes)) {
+                // The ones that left the list finished; read how
+                std::set<std::string> now;
+                for (const auto& change : changes) {
+                    now.insert(change.id);
+                    SnapChangeEvent event;
+                    if (primed) {
+                        report(change);
+                    } else {
+                        noteChange(change, event);
+                    }
+                }
+                for (const auto& id : running) {
+                    SnapdChange change;
+                    if (!now.count(id) && _client.getChange(id, change)) {
+                        report(change);
+                    }
+                }
+                running.swap(now);
+                primed = true;
+            }
+        }
+        pause();
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
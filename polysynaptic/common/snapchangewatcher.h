@@ -0,0 +1,119 @@
+/* snapchangewatcher.h - snapd changes as they move, without polling
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the watcher that tells when a snap install,
+ * removal or refresh starts, finishes or fails, whoever started it.
+ * Asking again whether a snap is installed costs a request, or a
+ * "snap list" without the API, each time; instead snapd's
+ * change-update notices are waited on over a connection of the
+ * watcher's own, which snapd holds open until a change moves. Each
+ * such change is then read once and reported. snapd before 2.60 has
+ * no notices, and there the changes in progress are listed every
+ * POLL_SECONDS, which is still no subprocess.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SNAPCHANGEWATCHER_H_
+#define _SNAPCHANGEWATCHER_H_
+
+#include "snapdclient.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace PolySynaptic {
+
+/**
+ * SnapChangeEvent - A change that moved, as snapd has it now
+ */
+struct SnapChangeEvent {
+    enum class State {
+        RUNNING,        // Spawned, or one of its tasks moved on
+        DONE,
+        FAILED          // Error, undone or aborted
+    };
+
+    SnapdChange change;
+    State state = State::RUNNING;
+    double fraction = 0;            // Of its tasks done, as SnapBackend sums it
+
+    bool isReady() const { return state != State::RUNNING; }
+};
+
+/**
+ * SnapChangeWatcher - Reports snapd's changes as they move
+ *
+ *     SnapChangeWatcher watcher;
+ *     watcher.start([](const SnapChangeEvent& event) {
+ *         ... event.change.snapNames, event.state ...
+ *     });
+ *
+ * The changes that moved before start() are not reported. A change is
+ * reported once per state of it and its tasks, so a notice repeated
+ * for nothing new is dropped; while snapd is down or restarting the
+ * watcher retries every POLL_SECONDS.
+ *
+ * Thread Safety:
+ *   start() and stop() from one thread; the listener is called on the
+ *   watcher's thread.
+ */
+class SnapChangeWatcher {
+public:
+    // How long snapd is asked to hold each wait for notices
+    static const int WAIT_SECONDS = 30;
+
+    // Between retries, and between listings without notices
+    static const int POLL_SECONDS = 5;
+
+    using Listener = std::function<void(const SnapChangeEvent& event)>;
+
+    explicit SnapChangeWatcher(const std::string& socketPath = SnapdClient::DEFAULT_SOCKET);
+    ~SnapChangeWatcher();
+
+    SnapChangeWatcher(const SnapChangeWatcher&) = delete;
+    SnapChangeWatcher& operator=(const SnapChangeWatcher&) = delete;
+
+    void start(Listener listener);
+    void stop();
+    bool isRunning() const { return _thread.joinable(); }
+
+    /**
+     * The event for change if it is news since the last one for it,
+     * remembering it either way (exposed for tests)
+     */
+    bool noteChange(const SnapdChange& change, SnapChangeEvent& event);
+
+    static SnapChangeEvent::State stateOf(const SnapdChange& change);
+
+private:
+    SnapdClient _client;
+    Listener _listener;
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+    std::mutex _wakeMutex;
+    std::condition_variable _wake;
+
+    // What each change looked like when last reported
+    std::map<std::string, std::string> _reported;
+
+    void run();
+    void report(const SnapdChange& change);
+    void pause();
+};
+
+} // namespace PolySynaptic
+
+#endif // _SNAPCHANGEWATCHER_H_
+
+// vim:ts=4:sw=4:et
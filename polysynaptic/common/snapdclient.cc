@@ -0,0 +1,1143 @@
+/* snapdclient.cc - Native snapd REST API client implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "snapdclient.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// JsonReader
+// ============================================================================
+
+JsonReader::JsonReader(const std::string& text)
+    : _text(text)
+    , _pos(0)
+    , _failed(false)
+{
+}
+
+void JsonReader::skipWhitespace()
+{
+    while (_pos < _text.size() &&
+           (_text[_pos] == ' ' || _text[_pos] == '\t' ||
+            _text[_pos] == '\n' || _text[_pos] == '\r')) {
+        _pos++;
+    }
+}
+
+bool JsonReader::expect(char c)
+{
+    skipWhitespace();
+    if (_failed || _pos >= _text.size() || _text[_pos] != c) {
+        return fail();
+    }
+    _pos++;
+    return true;
+}
+
+JsonReader::Type JsonReader::peek()
+{
+    skipWhitespace();
+    if (_failed || _pos >= _text.size()) return Type::NONE;
+
+    switch (_text[_pos]) {
+        case '{': return Type::OBJECT;
+        case '[': return Type::ARRAY;
+        case '"': return Type::STRING;
+        case 't': case 'f': return Type::BOOL;
+        case 'n': return Type::NUL;
+        default:
+            if (_text[_pos] == '-' || isdigit((unsigned char)_text[_pos])) {
+                return Type::NUMBER;
+            }
+            return Type::NONE;
+    }
+}
+
+bool JsonReader::beginObject()
+{
+    if (!expect('{')) return false;
+    _first.push_back(true);
+    return true;
+}
+
+bool JsonReader::nextMember(std::string& key)
+{
+    if (_failed || _first.empty()) return false;
+
+    skipWhitespace();
+    if (_pos < _text.size() && _text[_pos] == '}') {
+        _pos++;
+        _first.pop_back();
+        return false;
+    }
+
+    if (!_first.back() && !expect(',')) return false;
+    _first.back() = false;
+
+    if (!readString(key)) return false;
+    return expect(':');
+}
+
+bool JsonReader::beginArray()
+{
+    if (!expect('[')) return false;
+    _first.push_back(true);
+    return true;
+}
+
+bool JsonReader::nextElement()
+{
+    if (_failed || _first.empty()) return false;
+
+    skipWhitespace();
+    if (_pos < _text.size() && _text[_pos] == ']') {
+        _pos++;
+        _first.pop_back();
+        return false;
+    }
+
+    if (!_first.back() && !expect(',')) return false;
+    _first.back() = false;
+    return true;
+}
+
+static void appendUtf8(std::string& out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+bool JsonReader::readString(std::string& out)
+{
+    if (!expect('"')) return false;
+
+    out.clear();
+    while (_pos < _text.size()) {
+        char c = _text[_pos++];
+        if (c == '"') return true;
+
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+
+        if (_pos >= _text.size()) break;
+        char esc = _text[_pos++];
+        switch (esc) {
+            case '"':  out += '"';  break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/';  break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                if (_pos + 4 > _text.size()) return fail();
+                unsigned long cp = strtoul(_text.substr(_pos, 4).c_str(), nullptr, 16);
+                _pos += 4;
+                // Combine UTF-16 surrogate pairs
+                if (cp >= 0xD800 && cp <= 0xDBFF &&
+                    _pos + 6 <= _text.size() &&
+                    _text[_pos] == '\\' && _text[_pos + 1] == 'u') {
+                    unsigned long lo = strtoul(_text.substr(_pos + 2, 4).c_str(), nullptr, 16);
+                    if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        _pos += 6;
+                    }
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                return fail();
+        }
+    }
+
+    return fail();
+}
+
+bool JsonReader::readInt(int64_t& out)
+{
+    if (peek() != Type::NUMBER) return fail();
+
+    const char* start = _text.c_str() + _pos;
+    char* end = nullptr;
+    double value = strtod(start, &end);
+    if (end == start) return fail();
+
+    _pos += end - start;
+    out = static_cast<int64_t>(value);
+    return true;
+}
+
+bool JsonReader::readBool(bool& out)
+{
+    skipWhitespace();
+    if (_text.compare(_pos, 4, "true") == 0) {
+        _pos += 4;
+        out = true;
+        return true;
+    }
+    if (_text.compare(_pos, 5, "false") == 0) {
+        _pos += 5;
+        out = false;
+        return true;
+    }
+    return fail();
+}
+
+bool JsonReader::readScalar(std::string& out)
+{
+    out.clear();
+    switch (peek()) {
+        case Type::STRING:
+            return readString(out);
+        case Type::NUMBER: {
+            size_t start = _pos;
+            int64_t ignored;
+            if (!readInt(ignored)) return false;
+            out = _text.substr(start, _pos - start);
+            return true;
+        }
+        case Type::BOOL: {
+            bool value;
+            if (!readBool(value)) return false;
+            out = value ? "true" : "false";
+            return true;
+        }
+        default:
+            return skipValue();
+    }
+}
+
+bool JsonReader::skipValue()
+{
+    std::string ignored;
+
+    switch (peek()) {
+        case Type::OBJECT:
+            if (!beginObject()) return false;
+            while (nextMember(ignored)) {
+                if (!skipValue()) return false;
+            }
+            return !_failed;
+        case Type::ARRAY:
+            if (!beginArray()) return false;
+            while (nextElement()) {
+                if (!skipValue()) return false;
+            }
+            return !_failed;
+        case Type::STRING:
+            return readString(ignored);
+        case Type::NUMBER: {
+            int64_t value;
+            return readInt(value);
+        }
+        case Type::BOOL: {
+            bool value;
+            return readBool(value);
+        }
+        case Type::NUL:
+            if (_text.compare(_pos, 4, "null") != 0) return fail();
+            _pos += 4;
+            return true;
+        default:
+            return fail();
+    }
+}
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+SnapdClient::SnapdClient(const std::string& socketPath)
+    : _socketPath(socketPath)
+    , _fd(-1)
+    , _timeoutSeconds(30)
+    , _lastStatus(0)
+{
+}
+
+SnapdClient::~SnapdClient()
+{
+    closeSocket();
+}
+
+// ============================================================================
+// Connection Management
+// ============================================================================
+
+bool SnapdClient::isAvailable() const
+{
+    if (access(_socketPath.c_str(), F_OK) != 0) {
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    bool ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    close(fd);
+    return ok;
+}
+
+bool SnapdClient::connectSocket()
+{
+    if (_fd >= 0) return true;
+
+    if (_socketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+        _lastError = "snapd socket path too long";
+        return false;
+    }
+
+    _fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        _lastError = std::string("socket() failed: ") + strerror(errno);
+        return false;
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        _lastError = "Cannot connect to " + _socketPath + ": " + strerror(errno);
+        closeSocket();
+        return false;
+    }
+
+    return true;
+}
+
+void SnapdClient::closeSocket()
+{
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+std::string SnapdClient::getLastError() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _lastError;
+}
+
+int SnapdClient::getLastStatus() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _lastStatus;
+}
+
+// ============================================================================
+// HTTP Transport
+// ============================================================================
+
+bool SnapdClient::sendRequest(const std::string& request)
+{
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t n = send(_fd, request.data() + sent, request.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            _lastError = std::string("send() failed: ") + strerror(errno);
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool SnapdClient::readMore(std::string& buffer)
+{
+    pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+
+    // Wait in short slices so a cancelled request gives up promptly
+    int ret;
+    int waitedMs = 0;
+    for (;;) {
+        int sliceMs = _cancelled ? std::min(100, _timeoutSeconds * 1000 - waitedMs)
+                                 : _timeoutSeconds * 1000 - waitedMs;
+        ret = poll(&pfd, 1, std::max(sliceMs, 0));
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret != 0) break;
+
+        waitedMs += sliceMs;
+        if (waitedMs >= _timeoutSeconds * 1000) break;
+        if (_cancelled && _cancelled()) {
+            _lastError = "snapd request cancelled";
+            return false;
+        }
+    }
+
+    if (ret == 0) {
+        _lastError = "snapd request timed out after " +
+                     std::to_string(_timeoutSeconds) + " seconds";
+        return false;
+    }
+    if (ret < 0) {
+        _lastError = std::string("poll() failed: ") + strerror(errno);
+        return false;
+    }
+
+    char chunk[16384];
+    ssize_t n;
+    do {
+        n = recv(_fd, chunk, sizeof(chunk), 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        _lastError = (n == 0) ? "snapd closed the connection"
+                              : std::string("recv() failed: ") + strerror(errno);
+        return false;
+    }
+
+    buffer.append(chunk, n);
+    return true;
+}
+
+bool SnapdClient::readResponse(std::string& body, bool& keepAlive)
+{
+    std::string buffer;
+    size_t headerEnd;
+
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!readMore(buffer)) return false;
+    }
+
+    // Status line: HTTP/1.1 200 OK
+    size_t lineEnd = buffer.find("\r\n");
+    std::string statusLine = buffer.substr(0, lineEnd);
+    size_t sp = statusLine.find(' ');
+    if (sp == std::string::npos) {
+        _lastError = "Malformed HTTP status line from snapd";
+        return false;
+    }
+    _lastStatus = atoi(statusLine.c_str() + sp + 1);
+
+    // Headers
+    long contentLength = -1;
+    bool chunked = false;
+    keepAlive = true;
+
+    size_t pos = lineEnd + 2;
+    while (pos < headerEnd) {
+        size_t eol = buffer.find("\r\n", pos);
+        std::string header = buffer.substr(pos, eol - pos);
+        pos = eol + 2;
+
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) continue;
+
+        std::string name = header.substr(0, colon);
+        std::string value = header.substr(colon + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        value.erase(0, value.find_first_not_of(" \t"));
+
+        if (name == "content-length") {
+            contentLength = atol(value.c_str());
+        } else if (name == "transfer-encoding" &&
+                   value.find("chunked") != std::string::npos) {
+            chunked = true;
+        } else if (name == "connection" && value == "close") {
+            keepAlive = false;
+        }
+    }
+
+    buffer.erase(0, headerEnd + 4);
+    body.clear();
+
+    if (chunked) {
+        // Decode chunks as they arrive: <hex size>\r\n<data>\r\n ... 0\r\n\r\n
+        while (true) {
+            size_t eol;
+            while ((eol = buffer.find("\r\n")) == std::string::npos) {
+                if (!readMore(buffer)) return false;
+            }
+            unsigned long size = strtoul(buffer.c_str(), nullptr, 16);
+            buffer.erase(0, eol + 2);
+
+            while (buffer.size() < size + 2) {
+                if (!readMore(buffer)) return false;
+            }
+
+            if (size == 0) break;
+
+            body.append(buffer, 0, size);
+            buffer.erase(0, size + 2);
+        }
+    } else if (contentLength >= 0) {
+        while (buffer.size() < static_cast<size_t>(contentLength)) {
+            if (!readMore(buffer)) return false;
+        }
+        body.assign(buffer, 0, contentLength);
+    } else {
+        // No framing: body runs until the daemon closes the connection
+        while (readMore(buffer)) {}
+        body.swap(buffer);
+        keepAlive = false;
+    }
+
+    return true;
+}
+
+bool SnapdClient::get(const std::string& path, std::string& body,
+                      const CancelCheck& cancelled, int* status)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _lastStatus = 0;
+    _lastError.clear();
+
+    struct StatusScope {
+        const int& from;
+        int* to;
+        ~StatusScope() { if (to) *to = from; }
+    } reported{_lastStatus, status};
+
+    struct CancelScope {
+        CancelCheck& slot;
+        CancelScope(CancelCheck& s, const CancelCheck& c) : slot(s) { slot = c; }
+        ~CancelScope() { slot = nullptr; }
+    } scope(_cancelled, cancelled);
+
+    std::string request =
+        "GET " + path + " HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "User-Agent: PolySynaptic\r\n"
+        "Accept: application/json\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+    // A reused connection may have been closed by snapd while idle;
+    // retry once on a fresh connection in that case.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = (_fd >= 0);
+
+        if (!connectSocket()) return false;
+
+        bool keepAlive = false;
+        if (sendRequest(request) && readResponse(body, keepAlive)) {
+            if (!keepAlive) closeSocket();
+            return true;
+        }
+
+        closeSocket();
+        if (!reused || (cancelled && cancelled())) break;
+    }
+
+    return false;
+}
+
+std::string SnapdClient::urlEncode(const std::string& value)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+
+    for (unsigned char c : value) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0x0F];
+        }
+    }
+
+    return out;
+}
+
+// ============================================================================
+// API Calls
+// ============================================================================
+
+bool SnapdClient::getVersion(std::string& version)
+{
+    std::string body;
+    if (!get("/v2/system-info", body)) return false;
+
+    std::string error;
+    bool ok = parseEnvelope(body, [&](JsonReader& reader) {
+        std::string key;
+        if (!reader.beginObject()) return false;
+        while (reader.nextMember(key)) {
+            bool readOk = (key == "version") ? reader.readString(version)
+                                             : reader.skipValue();
+            if (!readOk) return false;
+        }
+        return !reader.failed();
+    }, error);
+
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _lastError = error;
+    }
+    return ok;
+}
+
+bool SnapdClient::find(const std::string& query, std::vector<SnapdSnap>& snaps,
+                       const CancelCheck& cancelled)
+{
+    std::string body;
+    int status = 0;
+    if (!get("/v2/find?q=" + urlEncode(query), body, cancelled, &status)) return false;
+
+    std::string error;
+    if (parseSnapList(body, snaps, error)) return true;
+
+    // snapd reports "no snaps found" as a 404 error
+    if (status == 404) {
+        snaps.clear();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::findSection(const std::string& section,
+                              std::vector<SnapdSnap>& snaps,
+                              const CancelCheck& cancelled)
+{
+    std::string body;
+    int status = 0;
+    if (!get("/v2/find?section=" + urlEncode(section), body, cancelled, &status)) {
+        return false;
+    }
+
+    std::string error;
+    if (parseSnapList(body, snaps, error)) return true;
+
+    // An empty category is reported like an empty search
+    if (status == 404) {
+        snaps.clear();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::listSections(std::vector<std::string>& sections)
+{
+    std::string body;
+    if (!get("/v2/sections", body)) return false;
+
+    std::string error;
+    if (parseStringList(body, sections, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::findByName(const std::string& name, SnapdSnap& snap)
+{
+    std::string body;
+    if (!get("/v2/find?name=" + urlEncode(name), body)) return false;
+
+    std::vector<SnapdSnap> snaps;
+    std::string error;
+    if (!parseSnapList(body, snaps, error) || snaps.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _lastError = error.empty() ? "snap not found: " + name : error;
+        return false;
+    }
+
+    snap = snaps.front();
+    return true;
+}
+
+bool SnapdClient::listInstalled(std::vector<SnapdSnap>& snaps)
+{
+    std::string body;
+    if (!get("/v2/snaps", body)) return false;
+
+    std::string error;
+    if (parseSnapList(body, snaps, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::getInstalled(const std::string& name, SnapdSnap& snap)
+{
+    std::string body;
+    if (!get("/v2/snaps/" + urlEncode(name), body)) return false;
+
+    std::string error;
+    if (parseSnap(body, snap, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::listChanges(std::vector<SnapdChange>& changes)
+{
+    std::string body;
+    if (!get("/v2/changes?select=in-progress", body)) return false;
+
+    std::string error;
+    if (parseChanges(body, changes, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::getChange(const std::string& id, SnapdChange& change)
+{
+    std::string body;
+    if (!get("/v2/changes/" + urlEncode(id), body)) return false;
+
+    std::string error;
+    if (parseChange(body, change, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::waitForNotices(const std::string& after, int waitSeconds,
+                                 std::vector<SnapdNotice>& notices,
+                                 const CancelCheck& cancelled)
+{
+    std::string path = "/v2/notices?types=change-update";
+    if (!after.empty()) {
+        path += "&after=" + urlEncode(after);
+    }
+    if (waitSeconds > 0) {
+        path += "&timeout=" + std::to_string(waitSeconds) + "s";
+    }
+
+    std::string body;
+    if (!get(path, body, cancelled)) return false;
+
+    std::string error;
+    if (parseNotices(body, notices, error)) return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+bool SnapdClient::listRefreshCandidates(std::vector<SnapdSnap>& snaps)
+{
+    std::string body;
+    int status = 0;
+    if (!get("/v2/find?select=refresh", body, nullptr, &status)) return false;
+
+    std::string error;
+    if (parseSnapList(body, snaps, error)) return true;
+
+    if (status == 404) {
+        snaps.clear();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastError = error;
+    return false;
+}
+
+// ============================================================================
+// Response Parsing
+// ============================================================================
+
+bool SnapdClient::parseEnvelope(
+    const std::string& body,
+    const std::function<bool(JsonReader&)>& readResult,
+    std::string& error)
+{
+    /*
+     * snapd response envelope:
+     * {"type":"sync","status-code":200,"status":"OK","result":...}
+     * {"type":"error","status-code":404,"result":{"message":"..."}}
+     */
+
+    JsonReader reader(body);
+    std::string key;
+    std::string type;
+    bool haveResult = false;
+
+    if (!reader.beginObject()) {
+        error = "snapd returned malformed JSON";
+        return false;
+    }
+
+    while (reader.nextMember(key)) {
+        bool ok;
+        if (key == "type") {
+            ok = reader.readString(type);
+        } else if (key == "result" && type == "error") {
+            std::string field;
+            ok = reader.beginObject();
+            while (ok && reader.nextMember(field)) {
+                ok = (field == "message") ? reader.readString(error)
+                                          : reader.skipValue();
+            }
+            ok = ok && !reader.failed();
+        } else if (key == "result") {
+            ok = readResult(reader);
+            haveResult = ok;
+        } else {
+            ok = reader.skipValue();
+        }
+
+        if (!ok) {
+            if (error.empty()) error = "snapd returned malformed JSON";
+            return false;
+        }
+    }
+
+    if (reader.failed()) {
+        error = "snapd returned malformed JSON";
+        return false;
+    }
+
+    if (type == "error") {
+        if (error.empty()) error = "snapd returned an error";
+        return false;
+    }
+
+    if (!haveResult) {
+        error = "snapd response has no result";
+        return false;
+    }
+
+    return true;
+}
+
+bool SnapdClient::readSnapObject(JsonReader& reader, SnapdSnap& snap)
+{
+    std::string key;
+
+    if (!reader.beginObject()) return false;
+
+    while (reader.nextMember(key)) {
+        bool ok;
+
+        if (key == "id") {
+            ok = reader.readString(snap.id);
+        } else if (key == "name") {
+            ok = reader.readString(snap.name);
+        } else if (key == "title") {
+            ok = reader.readString(snap.title);
+        } else if (key == "summary") {
+            ok = reader.readString(snap.summary);
+        } else if (key == "description") {
+            ok = reader.readString(snap.description);
+        } else if (key == "version") {
+            ok = reader.readString(snap.version);
+        } else if (key == "revision") {
+            ok = reader.readScalar(snap.revision);
+        } else if (key == "channel") {
+            ok = reader.readString(snap.channel);
+        } else if (key == "tracking-channel") {
+            ok = reader.readString(snap.trackingChannel);
+        } else if (key == "confinement") {
+            ok = reader.readString(snap.confinement);
+        } else if (key == "license") {
+            ok = reader.readString(snap.license);
+        } else if (key == "store-url") {
+            ok = reader.readString(snap.storeUrl);
+        } else if (key == "contact") {
+            ok = reader.readString(snap.contact);
+        } else if (key == "status") {
+            ok = reader.readString(snap.status);
+        } else if (key == "devmode") {
+            ok = reader.readBool(snap.devmode);
+        } else if (key == "hold") {
+            std::string until;
+            ok = reader.readScalar(until);
+            snap.held = !until.empty();
+        } else if (key == "installed-size") {
+            ok = reader.readInt(snap.installedSize);
+        } else if (key == "download-size") {
+            ok = reader.readInt(snap.downloadSize);
+        } else if (key == "developer" && snap.publisher.empty()) {
+            // Older snapd releases only report the developer name
+            ok = reader.readString(snap.publisher);
+        } else if (key == "publisher" &&
+                   reader.peek() == JsonReader::Type::OBJECT) {
+            std::string field;
+            ok = reader.beginObject();
+            while (ok && reader.nextMember(field)) {
+                if (field == "username") {
+                    ok = reader.readString(snap.publisher);
+                } else if (field == "validation") {
+                    ok = reader.readString(snap.publisherValidation);
+                } else {
+                    ok = reader.skipValue();
+                }
+            }
+            ok = ok && !reader.failed();
+        } else if (key == "channels" &&
+                   reader.peek() == JsonReader::Type::OBJECT) {
+            std::string channelName;
+            ok = reader.beginObject();
+            while (ok && reader.nextMember(channelName)) {
+                std::string field;
+                std::string version;
+                ok = reader.beginObject();
+                while (ok && reader.nextMember(field)) {
+                    ok = (field == "version") ? reader.readString(version)
+                                              : reader.skipValue();
+                }
+                ok = ok && !reader.failed();
+                snap.channels[channelName] = version;
+            }
+            ok = ok && !reader.failed();
+        } else {
+            ok = reader.skipValue();
+        }
+
+        if (!ok) return false;
+    }
+
+    return !reader.failed();
+}
+
+bool SnapdClient::parseSnapList(
+    const std::string& body,
+    std::vector<SnapdSnap>& snaps,
+    std::string& error)
+{
+    snaps.clear();
+
+    return parseEnvelope(body, [&snaps](JsonReader& reader) {
+        if (!reader.beginArray()) return false;
+        while (reader.nextElement()) {
+            SnapdSnap snap;
+            if (!readSnapObject(reader, snap)) return false;
+            snaps.push_back(std::move(snap));
+        }
+        return !reader.failed();
+    }, error);
+}
+
+bool SnapdClient::parseStringList(
+    const std::string& body,
+    std::vector<std::string>& values,
+    std::string& error)
+{
+    values.clear();
+
+    return parseEnvelope(body, [&values](JsonReader& reader) {
+        if (!reader.beginArray()) return false;
+        while (reader.nextElement()) {
+            std::string value;
+            if (!reader.readString(value)) return false;
+            values.push_back(std::move(value));
+        }
+        return !reader.failed();
+    }, error);
+}
+
+bool SnapdClient::readChangeObject(JsonReader& reader, SnapdChange& change)
+{
+    std::string key;
+
+    if (!reader.beginObject()) return false;
+
+    while (reader.nextMember(key)) {
+        bool ok;
+
+        if (key == "id") {
+            ok = reader.readScalar(change.id);
+        } else if (key == "kind") {
+            ok = reader.readString(change.kind);
+        } else if (key == "summary") {
+            ok = reader.readString(change.summary);
+        } else if (key == "status") {
+            ok = reader.readString(change.status);
+        } else if (key == "ready") {
+            ok = reader.readBool(change.ready);
+        } else if (key == "data" && reader.peek() == JsonReader::Type::OBJECT) {
+            std::string field;
+            ok = reader.beginObject();
+            while (ok && reader.nextMember(field)) {
+                if (field == "snap-names" &&
+                    reader.peek() == JsonReader::Type::ARRAY) {
+                    ok = reader.beginArray();
+                    while (ok && reader.nextElement()) {
+                        std::string name;
+                        ok = reader.readString(name);
+                        change.snapNames.push_back(std::move(name));
+                    }
+                } else {
+                    ok = reader.skipValue();
+                }
+            }
+        } else if (key == "tasks" && reader.peek() == JsonReader::Type::ARRAY) {
+            ok = reader.beginArray();
+            while (ok && reader.nextElement()) {
+                SnapdTask task;
+                std::string field;
+                ok = reader.beginObject();
+                while (ok && reader.nextMember(field)) {
+                    if (field == "kind") {
+                        ok = reader.readString(task.kind);
+                    } else if (field == "summary") {
+                        ok = reader.readString(task.summary);
+                    } else if (field == "status") {
+                        ok = reader.readString(task.status);
+                    } else if (field == "progress" &&
+                               reader.peek() == JsonReader::Type::OBJECT) {
+                        std::string part;
+                        ok = reader.beginObject();
+                        while (ok && reader.nextMember(part)) {
+                            if (part == "done") {
+                                ok = reader.readInt(task.done);
+                            } else if (part == "total") {
+                                ok = reader.readInt(task.total);
+                            } else {
+                                ok = reader.skipValue();
+                            }
+                        }
+                    } else {
+                        ok = reader.skipValue();
+                    }
+                }
+                change.tasks.push_back(std::move(task));
+            }
+        } else {
+            ok = reader.skipValue();
+        }
+
+        if (!ok) return false;
+    }
+
+    return !reader.failed();
+}
+
+bool SnapdClient::parseChanges(
+    const std::string& body,
+    std::vector<SnapdChange>& changes,
+    std::string& error)
+{
+    changes.clear();
+
+    return parseEnvelope(body, [&changes](JsonReader& reader) {
+        if (!reader.beginArray()) return false;
+        while (reader.nextElement()) {
+            SnapdChange change;
+            if (!readChangeObject(reader, change)) return false;
+            changes.push_back(std::move(change));
+        }
+        return !reader.failed();
+    }, error);
+}
+
+bool SnapdClient::parseChange(
+    const std::string& body,
+    SnapdChange& change,
+    std::string& error)
+{
+    change = SnapdChange();
+
+    return parseEnvelope(body, [&change](JsonReader& reader) {
+        return readChangeObject(reader, change);
+    }, error);
+}
+
+bool SnapdClient::parseNotices(
+    const std::string& body,
+    std::vector<SnapdNotice>& notices,
+    std::string& error)
+{
+    /*
+     * {"id":"7","user-id":null,"type":"change-update","key":"42",
+     *  "first-occurred":"...","last-occurred":"2024-03-01T10:00:00.5Z",
+     *  "occurrences":3,"last-data":{"kind":"install-snap"}}
+     */
+    notices.clear();
+
+    return parseEnvelope(body, [&notices](JsonReader& reader) {
+        if (!reader.beginArray()) return false;
+        while (reader.nextElement()) {
+            SnapdNotice notice;
+            std::string key;
+            if (!reader.beginObject()) return false;
+            while (reader.nextMember(key)) {
+                bool ok;
+                if (key == "id") {
+                    ok = reader.readScalar(notice.id);
+                } else if (key == "type") {
+                    ok = reader.readString(notice.type);
+                } else if (key == "key") {
+                    ok = reader.readScalar(notice.key);
+                } else if (key == "last-occurred") {
+                    ok = reader.readString(notice.lastOccurred);
+                } else {
+                    ok = reader.skipValue();
+                }
+                if (!ok) return false;
+            }
+            notices.push_back(std::move(notice));
+        }
+        return !reader.failed();
+    }, error);
+}
+
+bool SnapdClient::parseSnap(
+    const std::string& body,
+    SnapdSnap& snap,
+    std::string& error)
+{
+    snap = SnapdSnap();
+
+    return parseEnvelope(body, [&snap](JsonReader& reader) {
+        return readSnapObject(reader, snap);
+    }, error);
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,356 @@
+/* snapdclient.h - Native snapd REST API client for PolySynaptic
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements a small HTTP/1.1 client that talks to snapd's
+ * JSON API over its local UNIX socket. It lets the Snap backend and
+ * the Snap provider query the daemon without forking the snap CLI and
+ * scraping its tabular output.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SNAPDCLIENT_H_
+#define _SNAPDCLIENT_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Snap Record
+// ============================================================================
+
+/**
+ * SnapdSnap - A snap as reported by the snapd API
+ *
+ * This is a neutral record that both SnapBackend (PackageInfo) and
+ * SnapProvider (UnifiedPackage) convert from.
+ */
+struct SnapdSnap {
+    std::string id;                 // Store snap-id
+    std::string name;
+    std::string title;
+    std::string summary;
+    std::string description;
+    std::string version;
+    std::string revision;
+    std::string channel;            // Channel of the installed revision
+    std::string trackingChannel;    // Channel being tracked for refreshes
+    std::string confinement;        // strict, classic, devmode
+    std::string license;
+    std::string storeUrl;
+    std::string contact;
+    std::string publisher;          // Publisher username
+    std::string publisherValidation; // verified, starred, unproven
+    std::string status;             // available, installed, active
+    bool devmode = false;
+    bool held = false;
+    int64_t installedSize = 0;
+    int64_t downloadSize = 0;
+
+    // Channel name -> version published on that channel
+    std::map<std::string, std::string> channels;
+
+    bool isInstalled() const {
+        return status == "installed" || status == "active";
+    }
+
+    bool isPublisherVerified() const {
+        return publisherValidation == "verified" ||
+               publisherValidation == "starred";
+    }
+};
+
+/**
+ * SnapdChange - A change (one install, refresh, remove...) in snapd
+ *
+ * A change is a list of tasks; the tasks that fetch something report
+ * bytes in their progress, the others 0 or 1 of 1.
+ */
+struct SnapdTask {
+    std::string kind;               // download-snap, link-snap...
+    std::string summary;
+    std::string status;             // Do, Doing, Done, Error...
+    int64_t done = 0;
+    int64_t total = 0;
+
+    bool isFinished() const {
+        return status != "Do" && status != "Doing";
+    }
+};
+
+struct SnapdChange {
+    std::string id;
+    std::string kind;               // install-snap, refresh-snap...
+    std::string summary;
+    std::string status;
+    bool ready = false;
+    std::vector<std::string> snapNames;
+    std::vector<SnapdTask> tasks;
+};
+
+/**
+ * SnapdNotice - Something snapd noted as it happened
+ *
+ * Only "change-update" notices are asked for: one is recorded when a
+ * change is spawned and again whenever its status moves, keyed by the
+ * change's id.
+ */
+struct SnapdNotice {
+    std::string id;
+    std::string type;
+    std::string key;
+    std::string lastOccurred;       // RFC 3339, as snapd wants it back
+};
+
+// ============================================================================
+// Streaming JSON Reader
+// ============================================================================
+
+/**
+ * JsonReader - Pull-style JSON reader
+ *
+ * Walks a JSON document in place without building a tree. Callers
+ * step through objects and arrays and pick out the values they care
+ * about; everything else is skipped. All methods return false on
+ * malformed input, after which the reader stays in the failed state.
+ */
+class JsonReader {
+public:
+    enum class Type { NONE, OBJECT, ARRAY, STRING, NUMBER, BOOL, NUL };
+
+    explicit JsonReader(const std::string& text);
+
+    Type peek();
+
+    bool beginObject();
+    bool nextMember(std::string& key);   // false at end of object
+
+    bool beginArray();
+    bool nextElement();                  // false at end of array
+
+    bool readString(std::string& out);
+    bool readInt(int64_t& out);
+    bool readBool(bool& out);
+
+    // Read a string, number or bool as text; skip anything else
+    bool readScalar(std::string& out);
+
+    bool skipValue();
+
+    bool failed() const { return _failed; }
+
+private:
+    const std::string& _text;
+    size_t _pos;
+    bool _failed;
+    std::vector<bool> _first;            // Per-container "no element yet"
+
+    void skipWhitespace();
+    bool expect(char c);
+    bool fail() { _failed = true; return false; }
+};
+
+// ============================================================================
+// snapd Client
+// ============================================================================
+
+/**
+ * SnapdClient - snapd REST client over /run/snapd.socket
+ *
+ * Keeps a single persistent HTTP/1.1 connection to snapd and
+ * reconnects transparently when the daemon closes it. Only read-only
+ * endpoints are used; privileged operations still go through the CLI
+ * so that polkit authentication keeps working unchanged.
+ *
+ * Endpoints Used:
+ *   GET /v2/system-info           - Daemon version
+ *   GET /v2/find?q=<query>        - Search the store
+ *   GET /v2/find?name=<name>      - Exact store lookup
+ *   GET /v2/find?select=refresh   - Pending refreshes
+ *   GET /v2/snaps                 - Installed snaps
+ *   GET /v2/snaps/<name>          - One installed snap
+ *   GET /v2/changes?select=in-progress - Changes still running
+ *   GET /v2/changes/<id>          - One change, finished or not
+ *   GET /v2/notices?types=change-update - Changes that moved (snapd 2.60)
+ *
+ * Thread Safety:
+ *   Requests are serialized on the connection by an internal lock.
+ */
+class SnapdClient {
+public:
+    static constexpr const char* DEFAULT_SOCKET = "/run/snapd.socket";
+
+    explicit SnapdClient(const std::string& socketPath = DEFAULT_SOCKET);
+    ~SnapdClient();
+
+    SnapdClient(const SnapdClient&) = delete;
+    SnapdClient& operator=(const SnapdClient&) = delete;
+
+    /**
+     * Check whether the snapd socket exists and is connectable
+     */
+    bool isAvailable() const;
+
+    /**
+     * Get the snapd version from /v2/system-info
+     */
+    bool getVersion(std::string& version);
+
+    /**
+     * Polled while waiting for snapd; returning true aborts the request
+     */
+    using CancelCheck = std::function<bool()>;
+
+    bool find(const std::string& query, std::vector<SnapdSnap>& snaps,
+              const CancelCheck& cancelled = nullptr);
+    bool findByName(const std::string& name, SnapdSnap& snap);
+    bool listInstalled(std::vector<SnapdSnap>& snaps);
+    bool getInstalled(const std::string& name, SnapdSnap& snap);
+    bool listRefreshCandidates(std::vector<SnapdSnap>& snaps);
+
+    /**
+     * Store category names from /v2/sections
+     */
+    bool listSections(std::vector<std::string>& sections);
+
+    /**
+     * Every snap the store lists in one category
+     */
+    bool findSection(const std::string& section, std::vector<SnapdSnap>& snaps,
+                     const CancelCheck& cancelled = nullptr);
+
+    /**
+     * Changes still running, with their tasks
+     */
+    bool listChanges(std::vector<SnapdChange>& changes);
+
+    /**
+     * One change by id
+     */
+    bool getChange(const std::string& id, SnapdChange& change);
+
+    /**
+     * The change-update notices since after ("" for all snapd keeps),
+     * waiting up to waitSeconds for one if there are none yet
+     *
+     * snapd holds the request open while it waits, so the timeout set
+     * with setTimeout() must be longer, and the connection is busy for
+     * as long; a client to wait on should be one of its own. Older
+     * snapd answers 404.
+     */
+    bool waitForNotices(const std::string& after, int waitSeconds,
+                        std::vector<SnapdNotice>& notices,
+                        const CancelCheck& cancelled = nullptr);
+
+    /**
+     * Description of the last failure (transport or API error)
+     */
+    std::string getLastError() const;
+
+    /**
+     * HTTP status code of the last response, or 0 on transport error
+     */
+    int getLastStatus() const;
+
+    /**
+     * Set the per-request I/O timeout (default: 30 seconds)
+     */
+    void setTimeout(int seconds) { _timeoutSeconds = seconds; }
+
+    // ========================================================================
+    // Response Parsing (exposed for tests)
+    // ========================================================================
+
+    /**
+     * Parse a snapd response envelope whose "result" is a snap array
+     */
+    static bool parseSnapList(const std::string& body,
+                              std::vector<SnapdSnap>& snaps,
+                              std::string& error);
+
+    /**
+     * Parse a snapd response envelope whose "result" is a single snap
+     */
+    static bool parseSnap(const std::string& body,
+                          SnapdSnap& snap,
+                          std::string& error);
+
+    /**
+     * Parse a snapd response envelope whose "result" is a string array
+     */
+    static bool parseStringList(const std::string& body,
+                                std::vector<std::string>& values,
+                                std::string& error);
+
+    /**
+     * Parse a snapd response envelope whose "result" is a change array
+     */
+    static bool parseChanges(const std::string& body,
+                             std::vector<SnapdChange>& changes,
+                             std::string& error);
+
+    /**
+     * Parse a snapd response envelope whose "result" is a single change
+     */
+    static bool parseChange(const std::string& body,
+                            SnapdChange& change,
+                            std::string& error);
+
+    /**
+     * Parse a snapd response envelope whose "result" is a notice array
+     */
+    static bool parseNotices(const std::string& body,
+                             std::vector<SnapdNotice>& notices,
+                             std::string& error);
+
+    /**
+     * Percent-encode a query string component
+     */
+    static std::string urlEncode(const std::string& value);
+
+private:
+    std::string _socketPath;
+    int _fd;
+    int _timeoutSeconds;
+    int _lastStatus;
+    std::string _lastError;
+    mutable std::mutex _mutex;
+
+    bool connectSocket();
+    void closeSocket();
+
+    CancelCheck _cancelled;         // Only set for the request in flight
+
+    /**
+     * GET path; status, if given, receives the HTTP status of this
+     * request (0 if none was read), which getLastStatus() may already
+     * report for another thread's request
+     */
+    bool get(const std::string& path, std::string& body,
+             const CancelCheck& cancelled = nullptr, int* status = nullptr);
+    bool sendRequest(const std::string& request);
+    bool readResponse(std::string& body, bool& keepAlive);
+    bool readMore(std::string& buffer);
+
+    static bool readSnapObject(JsonReader& reader, SnapdSnap& snap);
+    static bool readChangeObject(JsonReader& reader, SnapdChange& change);
+    static bool parseEnvelope(const std::string& body,
+                              const std::function<bool(JsonReader&)>& readResult,
+                              std::string& error);
+};
+
+} // namespace PolySynaptic
+
+#endif // _SNAPDCLIENT_H_
+
+// vim:ts=4:sw=4:et
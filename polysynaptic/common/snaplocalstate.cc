@@ -0,0 +1,392 @@
+/* snaplocalstate.cc - Installed snaps read from disk, without snapd
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "snaplocalstate.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+namespace {
+
+bool readFile(const string& path, string& out)
+{
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) {
+        return false;
+    }
+    ostringstream text;
+    text << in.rdbuf();
+    out = text.str();
+    return true;
+}
+
+string trim(const string& s)
+{
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool isIndented(const string& line)
+{
+    return !line.empty() && (line[0] == ' ' || line[0] == '\t');
+}
+
+bool isBlank(const string& line)
+{
+    return line.find_first_not_of(" \t") == string::npos;
+}
+
+// The end of a double-quoted scalar that starts at text[0], npos if
+// it goes on past the text
+size_t closingQuote(const string& text, char quote)
+{
+    for (size_t i = 1; i < text.size(); i++) {
+        if (quote == '"' && text[i] == '\\') {
+            i++;
+        } else if (text[i] == quote) {
+            // '' inside single quotes is a quote, not the end
+            if (quote == '\'' && i + 1 < text.size() && text[i + 1] == '\'') {
+                i++;
+                continue;
+            }
+            return i;
+        }
+    }
+    return string::npos;
+}
+
+string unquote(const string& text, char quote)
+{
+    string out;
+    size_t end = closingQuote(text, quote);
+    if (end == string::npos) {
+        end = text.size();
+    }
+    for (size_t i = 1; i < end; i++) {
+        char c = text[i];
+        if (quote == '\'' && c == '\'') {
+            out += '\'';
+            i++;
+        } else if (quote == '"' && c == '\\' && i + 1 < end) {
+            char e = text[++i];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                default:  out += e; break;   // \" \\ \/
+            }
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// A "|" (literal) or ">" (folded) block of lines, without their
+// common indentation and the trailing newlines
+string blockScalar(const vector<string>& lines, size_t& next, bool folded)
+{
+    size_t indent = string::npos;
+    string out;
+    bool lineBreak = false;
+    while (next < lines.size() && (isIndented(lines[next]) || isBlank(lines[next]))) {
+        const string& line = lines[next++];
+        if (isBlank(line)) {
+            out += '\n';
+            lineBreak = true;
+            continue;
+        }
+        if (indent == string::npos) {
+            indent = line.find_first_not_of(" \t");
+        }
+        string content = line.size() > indent ? line.substr(indent) : trim(line);
+        // Folding turns a line break into a space, but keeps a blank line
+        if (!out.empty() && !(folded && lineBreak)) {
+            out += folded ? ' ' : '\n';
+        }
+        out += content;
+        lineBreak = false;
+    }
+    while (!out.empty() && out.back() == '\n') {
+        out.pop_back();
+    }
+    return out;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// SnapYaml
+// ============================================================================
+
+SnapYaml::SnapYaml(const string& text)
+{
+    vector<string> lines;
+    istringstream in(text);
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.push_back(line);
+    }
+
+    size_t i = 0;
+    while (i < lines.size()) {
+        const string& current = lines[i++];
+        // Nested blocks, sequences, comments and document markers
+        if (current.empty() || isIndented(current) || current[0] == '#' ||
+            current[0] == '-' || current[0] == '.') {
+            continue;
+        }
+        size_t colon = current.find(':');
+        while (colon != string::npos && colon + 1 < current.size() &&
+               current[colon + 1] != ' ' && current[colon + 1] != '\t') {
+            colon = current.find(':', colon + 1);
+        }
+        if (colon == string::npos) {
+            continue;
+        }
+
+        string key = trim(current.substr(0, colon));
+        string rest = trim(current.substr(colon + 1));
+        if (rest.empty()) {
+            // A mapping or sequence; its lines are skipped above
+            continue;
+        }
+
+        string value;
+        char first = rest[0];
+        if (first == '|' || first == '>') {
+            value = blockScalar(lines, i, first == '>');
+        } else if (first == '"' || first == '\'') {
+            // Quoted scalars may go on over indented lines, folded
+            while (closingQuote(rest, first) == string::npos &&
+                   i < lines.size() && isIndented(lines[i])) {
+                rest += " " + trim(lines[i++]);
+            }
+            value = unquote(rest, first);
+        } else {
+            size_t comment = rest.find(" #");
+            if (comment != string::npos) {
+                rest = trim(rest.substr(0, comment));
+            }
+            while (i < lines.size() && isIndented(lines[i]) && !isBlank(lines[i])) {
+                rest += " " + trim(lines[i++]);
+            }
+            value = rest;
+        }
+        _values[key] = value;
+    }
+}
+
+string SnapYaml::get(const string& key, const string& fallback) const
+{
+    auto it = _values.find(key);
+    return it != _values.end() ? it->second : fallback;
+}
+
+void SnapYaml::fill(SnapdSnap& snap) const
+{
+    snap.name = get("name", snap.name);
+    snap.version = get("version", snap.version);
+    snap.title = get("title", snap.title);
+    snap.summary = get("summary", snap.summary);
+    snap.description = get("description", snap.description);
+    snap.confinement = get("confinement", snap.confinement);
+    snap.license = get("license", snap.license);
+}
+
+// ============================================================================
+// SnapLocalState
+// ============================================================================
+
+SnapLocalState::SnapLocalState(const string& mountDir, const string& stateFile,
+                               const string& snapsDir)
+    : _mountDir(mountDir), _stateFile(stateFile), _snapsDir(snapsDir)
+{
+    if (_mountDir.empty()) {
+        struct stat st;
+        for (const char *dir : {"/snap", "/var/lib/snapd/snap"}) {
+            if (stat(dir, &st) == 0 && S_ISDIR(st.st_mode)) {
+                _mountDir = dir;
+                break;
+            }
+        }
+    }
+}
+
+bool SnapLocalState::parseState(const string& json, map<string, StateEntry>& entries)
+{
+    JsonReader reader(json);
+    string key;
+    if (!reader.beginObject()) {
+        return false;
+    }
+    while (reader.nextMember(key)) {
+        if (key != "data") {
+            reader.skipValue();
+            continue;
+        }
+        if (!reader.beginObject()) {
+            return false;
+        }
+        while (reader.nextMember(key)) {
+            if (key != "snaps") {
+                reader.skipValue();
+                continue;
+            }
+            if (!reader.beginObject()) {
+                return false;
+            }
+            string name;
+            while (reader.nextMember(name)) {
+                StateEntry entry;
+                // Revisions in the sequence, current picked out after
+                vector<map<string, string>> sequence;
+                if (!reader.beginObject()) {
+                    return false;
+                }
+                while (reader.nextMember(key)) {
+                    if (key == "current") {
+                        reader.readScalar(entry.current);
+                    } else if (key == "channel") {
+                        reader.readScalar(entry.trackingChannel);
+                    } else if (key == "devmode") {
+                        reader.readBool(entry.devmode);
+                    } else if (key == "active") {
+                        reader.readBool(entry.active);
+                    } else if (key == "sequence" &&
+                               reader.peek() == JsonReader::Type::ARRAY) {
+                        reader.beginArray();
+                        while (reader.nextElement()) {
+                            map<string, string> side;
+                            if (!reader.beginObject()) {
+                                return false;
+                            }
+                            string field;
+                            while (reader.nextMember(field)) {
+                                if (reader.peek() == JsonReader::Type::STRING ||
+                                    reader.peek() == JsonReader::Type::NUMBER) {
+                                    reader.readScalar(side[field]);
+                                } else {
+                                    reader.skipValue();
+                                }
+                            }
+                            sequence.push_back(side);
+                        }
+                    } else {
+                        reader.skipValue();
+                    }
+                }
+                for (auto& side : sequence) {
+                    if (side["revision"] == entry.current) {
+                        entry.id = side["snap-id"];
+                        entry.channel = side["channel"];
+                        entry.title = side["title"];
+                        entry.summary = side["summary"];
+                        entry.description = side["description"];
+                    }
+                }
+                entries[name] = entry;
+            }
+        }
+    }
+    return !reader.failed();
+}
+
+bool SnapLocalState::listInstalled(vector<SnapdSnap>& snaps) const
+{
+    snaps.clear();
+    if (_mountDir.empty()) {
+        return false;
+    }
+    DIR *dir = opendir(_mountDir.c_str());
+    if (!dir) {
+        return false;
+    }
+    vector<string> names;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    sort(names.begin(), names.end());
+
+    // Root only; the mounts alone still give name, version and revision
+    map<string, StateEntry> state;
+    string json;
+    if (readFile(_stateFile, json)) {
+        parseState(json, state);
+    }
+
+    for (const string& name : names) {
+        string current = _mountDir + "/" + name + "/current";
+        char target[256];
+        ssize_t length = readlink(current.c_str(), target, sizeof(target) - 1);
+        string yaml;
+        // /snap/bin and snaps still being mounted have neither
+        if (length <= 0 || !readFile(current + "/meta/snap.yaml", yaml)) {
+            continue;
+        }
+        target[length] = '\0';
+
+        SnapdSnap snap;
+        SnapYaml(yaml).fill(snap);
+        // The directory is the instance name (name_key for parallel
+        // installs), which is what snapd and the CLI go by
+        snap.name = name;
+        snap.revision = target;
+        size_t slash = snap.revision.rfind('/');
+        if (slash != string::npos) {
+            snap.revision.erase(0, slash + 1);
+        }
+        snap.status = "active";
+
+        auto known = state.find(name);
+        if (known != state.end()) {
+            const StateEntry& e = known->second;
+            snap.id = e.id;
+            snap.trackingChannel = e.trackingChannel;
+            snap.channel = e.channel;
+            snap.devmode = e.devmode;
+            if (!e.active) snap.status = "installed";
+            if (!e.title.empty()) snap.title = e.title;
+            if (!e.summary.empty()) snap.summary = e.summary;
+            if (!e.description.empty()) snap.description = e.description;
+        }
+
+        struct stat st;
+        string file = _snapsDir + "/" + name + "_" + snap.revision + ".snap";
+        if (stat(file.c_str(), &st) == 0) {
+            snap.installedSize = st.st_size;
+        }
+        snaps.push_back(snap);
+    }
+    return true;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
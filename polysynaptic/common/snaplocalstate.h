@@ -0,0 +1,121 @@
+/* snaplocalstate.h - Installed snaps read from disk, without snapd
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the offline view of the installed snaps. Every
+ * installed snap is mounted under /snap/<name>/<revision>, with a
+ * "current" link to the active revision and its metadata in
+ * meta/snap.yaml; snapd keeps the rest (store id, tracked channel,
+ * flags) in /var/lib/snapd/state.json. Reading those takes a few
+ * milliseconds and works while snapd is restarting or still seeding,
+ * when `snap list` and /v2/snaps fail or hang.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SNAPLOCALSTATE_H_
+#define _SNAPLOCALSTATE_H_
+
+#include "snapdclient.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// snap.yaml Reader
+// ============================================================================
+
+/**
+ * SnapYaml - The top-level scalars of a snap.yaml
+ *
+ * A YAML subset that is enough for snap.yaml: "key: value" at column
+ * 0, with plain, single- or double-quoted values, plain values folded
+ * over indented lines, and "|" or ">" block scalars. Nested mappings
+ * and sequences (apps, plugs, slots...) are skipped, not parsed.
+ */
+class SnapYaml {
+public:
+    explicit SnapYaml(const std::string& text);
+
+    bool has(const std::string& key) const { return _values.count(key) > 0; }
+    std::string get(const std::string& key, const std::string& fallback = "") const;
+
+    /**
+     * The fields of snap a snap.yaml has: name, version, summary,
+     * description, title, confinement and license
+     */
+    void fill(SnapdSnap& snap) const;
+
+private:
+    std::map<std::string, std::string> _values;
+};
+
+// ============================================================================
+// Local State
+// ============================================================================
+
+/**
+ * SnapLocalState - The installed snaps, from the mounts and snapd's state
+ *
+ * Records are what /v2/snaps would give, less the store's fields
+ * (publisher, store URL, channel map), which the details lookup still
+ * gets from snapd. state.json is only readable by root; without it a
+ * record has no store id and no tracked channel.
+ *
+ * Thread Safety:
+ *   Stateless beyond its paths; any thread.
+ */
+class SnapLocalState {
+public:
+    static constexpr const char* STATE_FILE = "/var/lib/snapd/state.json";
+    static constexpr const char* SNAPS_DIR = "/var/lib/snapd/snaps";
+
+    /**
+     * With an empty mountDir the first of /snap and /var/lib/snapd/snap
+     * (where distributions without /snap mount them) that exists
+     */
+    explicit SnapLocalState(const std::string& mountDir = "",
+                            const std::string& stateFile = STATE_FILE,
+                            const std::string& snapsDir = SNAPS_DIR);
+
+    /**
+     * Every snap with a current revision; false, with snaps left
+     * empty, when there is no mount directory to read
+     */
+    bool listInstalled(std::vector<SnapdSnap>& snaps) const;
+
+    /**
+     * What state.json says of each snap, by instance name
+     */
+    struct StateEntry {
+        std::string id;
+        std::string current;            // Revision
+        std::string trackingChannel;
+        std::string channel;            // Of the current revision
+        std::string title;              // Store-edited, "" for none
+        std::string summary;
+        std::string description;
+        bool devmode = false;
+        bool active = false;
+    };
+
+    static bool parseState(const std::string& json,
+                           std::map<std::string, StateEntry>& entries);
+
+private:
+    std::string _mountDir;
+    std::string _stateFile;
+    std::string _snapsDir;
+};
+
+} // namespace PolySynaptic
+
+#endif // _SNAPLOCALSTATE_H_
+
+// vim:ts=4:sw=4:et
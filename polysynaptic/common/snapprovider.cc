@@ -1,4 +1,4 @@
-/* snapprovider.cc - Snap package source provider implementation
+/* snapprovider.cc - Snap package source provider for PolySynaptic
  *
  * Copyright (c) 2024 PolySynaptic Contributors
  *
@@ -11,23 +11,15 @@
 #include "snapprovider.h"
 
 #include <algorithm>
-#include <sstream>
-#include <array>
-#include <cstring>
-#include <sys/wait.h>
-#include <signal.h>
-#include <poll.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <cctype>
 
 namespace PolySynaptic {
 
-// ============================================================================
-// Constructor
-// ============================================================================
+REGISTER_PROVIDER(SourceType::SNAP, SnapProvider);
 
-SnapProvider::SnapProvider() {
-    // Known verified publishers (Canonical ecosystem)
+SnapProvider::SnapProvider()
+    : BackendProvider(SnapBackend::shared(), SourceType::SNAP)
+{
     _verifiedPublishers = {
         "canonical",
         "snapcrafters",
@@ -40,979 +32,101 @@ SnapProvider::SnapProvider() {
     };
 }
 
-// ============================================================================
-// Availability & Configuration
-// ============================================================================
-
-bool SnapProvider::isAvailable() const {
-    // Check if snap command exists and snapd is running
-    return access("/usr/bin/snap", X_OK) == 0;
-}
-
-ProviderStatus SnapProvider::getStatus() const {
-    ProviderStatus status;
-    status.available = isAvailable();
-    status.enabled = status.available;
-    status.configured = status.available;
-
-    if (!status.available) {
-        status.errorMessage = "Snap is not available (snapd not installed)";
-        return status;
-    }
-
-    // Get snap version and counts
-    auto result = const_cast<SnapProvider*>(this)->executeCommand(
-        "snap version 2>/dev/null | head -1");
-
-    if (result.exitCode == 0) {
-        status.version = result.stdout;
-        // Remove newline
-        while (!status.version.empty() &&
-               (status.version.back() == '\n' || status.version.back() == '\r')) {
-            status.version.pop_back();
-        }
-    }
-
-    // Count installed snaps
-    result = const_cast<SnapProvider*>(this)->executeCommand(
-        "snap list 2>/dev/null | tail -n +2 | wc -l");
-    if (result.exitCode == 0) {
-        try {
-            status.installedCount = std::stoi(result.stdout);
-        } catch (...) {}
-    }
-
-    return status;
-}
-
-bool SnapProvider::configure() {
-    // Snap doesn't require additional configuration
-    return isAvailable();
-}
-
-// ============================================================================
-// Package Operations
-// ============================================================================
-
-std::vector<UnifiedPackage> SnapProvider::search(
-    const std::string& query,
-    const SearchOptions& options)
-{
-    LOG(LogLevel::DEBUG)
-        .provider("Snap")
-        .operation("search")
-        .field("query", query)
-        .message("Starting Snap search")
-        .emit();
-
-    auto startTime = std::chrono::steady_clock::now();
-
-    // If installed only, just filter installed list
-    if (options.installedOnly) {
-        auto installed = getInstalled();
-        std::vector<UnifiedPackage> filtered;
-
-        std::string lowerQuery = query;
-        std::transform(lowerQuery.begin(), lowerQuery.end(),
-                      lowerQuery.begin(), ::tolower);
-
-        for (const auto& pkg : installed) {
-            std::string name = pkg.name;
-            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-
-            if (name.find(lowerQuery) != std::string::npos) {
-                filtered.push_back(pkg);
-            }
-
-            if (filtered.size() >= options.maxResults) break;
-        }
-
-        return filtered;
-    }
-
-    // Search Snap store
-    if (!isValidSnapName(query) && query.find(' ') != std::string::npos) {
-        // Query contains spaces or invalid chars, can't search
-        return {};
-    }
-
-    std::string cmd = "snap find '" + query + "' 2>/dev/null";
-    auto result = executeCommand(cmd, 60000);  // 60s timeout for searches
-
-    if (result.exitCode != 0) {
-        LOG(LogLevel::WARN)
-            .provider("Snap")
-            .operation("search")
-            .field("query", query)
-            .exitCode(result.exitCode)
-            .stderr(result.stderr)
-            .message("Snap search failed")
-            .emit();
-        return {};
-    }
-
-    auto packages = parseSnapFind(result.stdout);
-
-    // Limit results
-    if (packages.size() > options.maxResults) {
-        packages.resize(options.maxResults);
-    }
-
-    auto endTime = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-        endTime - startTime);
-
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("search")
-        .field("query", query)
-        .field("results", std::to_string(packages.size()))
-        .duration(duration)
-        .message("Snap search completed")
-        .emit();
-
-    return packages;
-}
-
-std::vector<UnifiedPackage> SnapProvider::getInstalled() {
-    auto result = executeCommand("snap list 2>/dev/null", 30000);
-
-    if (result.exitCode != 0) {
-        LOG(LogLevel::WARN)
-            .provider("Snap")
-            .operation("list")
-            .exitCode(result.exitCode)
-            .message("Failed to list installed snaps")
-            .emit();
-        return {};
-    }
-
-    return parseSnapList(result.stdout);
-}
-
-std::vector<UnifiedPackage> SnapProvider::getUpdatable() {
-    auto result = executeCommand("snap refresh --list 2>/dev/null", 30000);
-
-    if (result.exitCode != 0) {
-        // No updates available returns non-zero
-        return {};
-    }
-
-    // Parse refresh list (similar format to snap list)
-    return parseSnapList(result.stdout);
-}
-
-std::optional<UnifiedPackage> SnapProvider::getPackageDetails(
-    const std::string& packageId)
-{
-    if (!isValidSnapName(packageId)) {
-        return std::nullopt;
-    }
-
-    std::string cmd = "snap info '" + packageId + "' 2>/dev/null";
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return std::nullopt;
-    }
-
-    return parseSnapInfo(result.stdout);
-}
-
-// ============================================================================
-// Install/Remove Operations
-// ============================================================================
-
-OperationResult SnapProvider::install(
-    const std::string& packageId,
-    const InstallOptions& options)
+ProviderCapabilities SnapProvider::getCapabilities() const
 {
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("install")
-        .package(packageId)
-        .message("Starting Snap install")
-        .emit();
-
-    if (!isValidSnapName(packageId)) {
-        return OperationResult::Failure(
-            "Invalid snap name: " + packageId, "", -1);
-    }
-
-    std::string cmd = "snap install '" + packageId + "'";
-
-    // Add channel if specified
-    if (!options.version.empty()) {
-        cmd += " --channel=" + options.version;
-    }
-
-    auto result = executeCommand(cmd, 300000);  // 5 minute timeout
-
-    if (result.exitCode != 0) {
-        LOG(LogLevel::ERROR)
-            .provider("Snap")
-            .operation("install")
-            .package(packageId)
-            .exitCode(result.exitCode)
-            .stderr(result.stderr)
-            .message("Snap install failed")
-            .emit();
-
-        return OperationResult::Failure(
-            "Failed to install " + packageId,
-            result.stderr,
-            result.exitCode);
-    }
-
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("install")
-        .package(packageId)
-        .message("Snap install completed")
-        .emit();
-
-    return OperationResult::Success("Successfully installed " + packageId);
-}
-
-OperationResult SnapProvider::remove(
-    const std::string& packageId,
-    const RemoveOptions& options)
+    ProviderCapabilities caps;
+    caps.canSearch = true;
+    caps.canInstall = true;
+    caps.canRemove = true;
+    caps.canUpdate = true;
+    caps.canListInstalled = true;
+    caps.supportsRollback = true;
+    caps.supportsChannels = true;
+    caps.supportsSystemInstall = true;
+    caps.supportsConfinement = true;
+    caps.supportsAutoUpdate = true;
+    caps.providesSize = true;
+    caps.providesLicense = true;
+    caps.verifiedPublisher = true;
+    caps.signedPackages = true;
+    return caps;
+}
+
+void SnapProvider::fill(UnifiedPackage& pkg, const PackageInfo& info) const
 {
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("remove")
-        .package(packageId)
-        .message("Starting Snap remove")
-        .emit();
-
-    if (!isValidSnapName(packageId)) {
-        return OperationResult::Failure(
-            "Invalid snap name: " + packageId, "", -1);
-    }
-
-    std::string cmd = "snap remove '" + packageId + "'";
-
-    if (options.purge) {
-        cmd += " --purge";
-    }
-
-    auto result = executeCommand(cmd, 120000);  // 2 minute timeout
-
-    if (result.exitCode != 0) {
-        LOG(LogLevel::ERROR)
-            .provider("Snap")
-            .operation("remove")
-            .package(packageId)
-            .exitCode(result.exitCode)
-            .stderr(result.stderr)
-            .message("Snap remove failed")
-            .emit();
-
-        return OperationResult::Failure(
-            "Failed to remove " + packageId,
-            result.stderr,
-            result.exitCode);
-    }
-
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("remove")
-        .package(packageId)
-        .message("Snap remove completed")
-        .emit();
-
-    return OperationResult::Success("Successfully removed " + packageId);
-}
-
-OperationResult SnapProvider::update(const std::string& packageId) {
-    LOG(LogLevel::INFO)
-        .provider("Snap")
-        .operation("refresh")
-        .package(packageId)
-        .message("Starting Snap refresh")
-        .emit();
-
-    if (!isValidSnapName(packageId)) {
-        return OperationResult::Failure(
-            "Invalid snap name: " + packageId, "", -1);
-    }
-
-    std::string cmd = "snap refresh '" + packageId + "'";
-    auto result = executeCommand(cmd, 300000);  // 5 minute timeout
+    string publisher = info.publisher;
+    transform(publisher.begin(), publisher.end(), publisher.begin(),
+              [](unsigned char c) { return tolower(c); });
 
-    if (result.exitCode != 0) {
-        LOG(LogLevel::ERROR)
-            .provider("Snap")
-            .operation("refresh")
-            .package(packageId)
-            .exitCode(result.exitCode)
-            .stderr(result.stderr)
-            .message("Snap refresh failed")
-            .emit();
-
-        return OperationResult::Failure(
-            "Failed to refresh " + packageId,
-            result.stderr,
-            result.exitCode);
+    if (_verifiedPublishers.count(publisher) > 0) {
+        pkg.metadata.trustLevel = TrustLevel::OFFICIAL;
+        pkg.metadata.isVerifiedPublisher = true;
+    } else {
+        pkg.metadata.trustLevel = TrustLevel::COMMUNITY;
     }
 
-    return OperationResult::Success("Successfully refreshed " + packageId);
-}
-
-// ============================================================================
-// Trust & Security
-// ============================================================================
-
-TrustLevel SnapProvider::getTrustLevel(const std::string& packageId) {
-    auto details = getPackageDetails(packageId);
-    if (details) {
-        return details->trustLevel;
+    const string& confinement = info.confinement;
+    if (info.isClassic || confinement == "classic") {
+        pkg.metadata.confinement = ConfinementLevel::CLASSIC;
+    } else if (confinement == "devmode") {
+        pkg.metadata.confinement = ConfinementLevel::DEVMODE;
+    } else {
+        pkg.metadata.confinement = ConfinementLevel::STRICT;
     }
-    return TrustLevel::UNKNOWN;
-}
-
-PackagePermissions SnapProvider::getPermissions(const std::string& packageId) {
-    PackagePermissions perms;
-
-    auto connections = getConnections(packageId);
-    for (const auto& [plug, connected] : connections) {
-        PackagePermissions::Permission p;
-        p.name = plug;
-        p.granted = connected;
-
-        // Categorize permissions
-        if (plug.find("network") != std::string::npos) {
-            p.description = "Network access";
-            p.category = "network";
-        } else if (plug.find("home") != std::string::npos ||
-                   plug.find("removable") != std::string::npos) {
-            p.description = "File system access";
-            p.category = "filesystem";
-        } else if (plug.find("audio") != std::string::npos ||
-                   plug.find("camera") != std::string::npos) {
-            p.description = "Hardware access";
-            p.category = "hardware";
-        } else {
-            p.description = plug;
-            p.category = "other";
-        }
 
-        perms.permissions.push_back(p);
+    if (!info.channel.empty()) {
+        pkg.metadata.setText(MetadataText::CHANNEL, info.channel);
     }
-
-    return perms;
 }
 
 // ============================================================================
 // Snap-Specific Methods
 // ============================================================================
 
-std::vector<std::string> SnapProvider::getChannels(const std::string& snapName) {
-    std::vector<std::string> channels;
-
-    auto details = getPackageDetails(snapName);
-    // Channels would be parsed from snap info output
-    // Common channels: stable, candidate, beta, edge
-
-    channels.push_back("stable");
-    channels.push_back("candidate");
-    channels.push_back("beta");
-    channels.push_back("edge");
-
-    return channels;
-}
-
-OperationResult SnapProvider::switchChannel(
-    const std::string& snapName,
-    const std::string& channel)
+vector<string> SnapProvider::getChannels(const string& snapName)
 {
-    if (!isValidSnapName(snapName)) {
-        return OperationResult::Failure("Invalid snap name", "", -1);
-    }
-
-    std::string cmd = "snap switch '" + snapName + "' --channel=" + channel;
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to switch channel",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success(
-        "Switched " + snapName + " to channel " + channel);
+    return snap()->getChannels(snapName);
 }
 
-OperationResult SnapProvider::connectPlug(
-    const std::string& snap,
-    const std::string& plug,
-    const std::string& targetSnap,
-    const std::string& slot)
+ProviderResult SnapProvider::switchChannel(const string& snapName, const string& channel)
 {
-    std::string cmd = "snap connect " + snap + ":" + plug;
-    if (!targetSnap.empty()) {
-        cmd += " " + targetSnap + ":" + slot;
-    }
-
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to connect plug",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success("Connected " + snap + ":" + plug);
+    return toResult(snap()->switchChannel(snapName, channel));
 }
 
-OperationResult SnapProvider::disconnectPlug(
-    const std::string& snap,
-    const std::string& plug)
+ProviderResult SnapProvider::connectPlug(const string& snapName, const string& plug,
+                                         const string& targetSnap, const string& slot)
 {
-    std::string cmd = "snap disconnect " + snap + ":" + plug;
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to disconnect plug",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success("Disconnected " + snap + ":" + plug);
+    return toResult(snap()->connectPlug(snapName, plug, targetSnap, slot));
 }
 
-std::vector<std::pair<std::string, bool>> SnapProvider::getConnections(
-    const std::string& snapName)
+ProviderResult SnapProvider::disconnectPlug(const string& snapName, const string& plug)
 {
-    std::vector<std::pair<std::string, bool>> connections;
-
-    std::string cmd = "snap connections '" + snapName + "' 2>/dev/null";
-    auto result = executeCommand(cmd, 10000);
-
-    if (result.exitCode != 0) {
-        return connections;
-    }
-
-    // Parse connections output
-    std::istringstream stream(result.stdout);
-    std::string line;
-
-    // Skip header
-    std::getline(stream, line);
-
-    while (std::getline(stream, line)) {
-        if (line.empty()) continue;
-
-        // Format: Interface  Plug  Slot  Notes
-        std::istringstream lineStream(line);
-        std::string interface, plug, slot, notes;
-        lineStream >> interface >> plug >> slot >> notes;
-
-        if (!plug.empty()) {
-            // Extract plug name after ':'
-            size_t colonPos = plug.find(':');
-            if (colonPos != std::string::npos) {
-                plug = plug.substr(colonPos + 1);
-            }
-
-            bool connected = (slot != "-");
-            connections.push_back({plug, connected});
-        }
-    }
-
-    return connections;
-}
-
-OperationResult SnapProvider::enable(const std::string& snapName) {
-    if (!isValidSnapName(snapName)) {
-        return OperationResult::Failure("Invalid snap name", "", -1);
-    }
-
-    std::string cmd = "snap enable '" + snapName + "'";
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to enable snap",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success("Enabled " + snapName);
-}
-
-OperationResult SnapProvider::disable(const std::string& snapName) {
-    if (!isValidSnapName(snapName)) {
-        return OperationResult::Failure("Invalid snap name", "", -1);
-    }
-
-    std::string cmd = "snap disable '" + snapName + "'";
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to disable snap",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success("Disabled " + snapName);
-}
-
-OperationResult SnapProvider::revert(const std::string& snapName) {
-    if (!isValidSnapName(snapName)) {
-        return OperationResult::Failure("Invalid snap name", "", -1);
-    }
-
-    std::string cmd = "snap revert '" + snapName + "'";
-    auto result = executeCommand(cmd, 120000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to revert snap",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success("Reverted " + snapName);
+    return toResult(snap()->disconnectPlug(snapName, plug));
 }
 
-OperationResult SnapProvider::holdUpdates(
-    const std::string& snapName,
-    bool hold)
+vector<pair<string, bool>> SnapProvider::getConnections(const string& snapName)
 {
-    if (!isValidSnapName(snapName)) {
-        return OperationResult::Failure("Invalid snap name", "", -1);
-    }
-
-    std::string cmd = hold
-        ? "snap refresh --hold '" + snapName + "'"
-        : "snap refresh --unhold '" + snapName + "'";
-
-    auto result = executeCommand(cmd, 30000);
-
-    if (result.exitCode != 0) {
-        return OperationResult::Failure(
-            "Failed to " + std::string(hold ? "hold" : "unhold") + " updates",
-            result.stderr,
-            result.exitCode);
-    }
-
-    return OperationResult::Success(
-        std::string(hold ? "Held" : "Unheld") + " updates for " + snapName);
+    return snap()->getConnections(snapName);
 }
 
-// ============================================================================
-// Private Helpers
-// ============================================================================
-
-// Maximum output size to prevent memory exhaustion (10 MB)
-static const size_t MAX_SNAP_OUTPUT_SIZE = 10 * 1024 * 1024;
-
-// Safe command execution using argument vector (no shell)
-SnapProvider::CommandResult SnapProvider::executeCommandArgs(
-    const std::vector<std::string>& args,
-    int timeoutMs)
+ProviderResult SnapProvider::enable(const string& snapName)
 {
-    CommandResult result;
-    result.exitCode = -1;
-
-    if (args.empty()) {
-        result.stderr = "No command specified";
-        return result;
-    }
-
-    // Cap timeout to reasonable value
-    if (timeoutMs > 3600000) timeoutMs = 3600000;  // 1 hour max
-    if (timeoutMs <= 0) timeoutMs = 30000;  // 30s default
-
-    int stdoutPipe[2] = {-1, -1};
-    int stderrPipe[2] = {-1, -1};
-
-    if (pipe(stdoutPipe) < 0) {
-        result.stderr = "Failed to create stdout pipe";
-        return result;
-    }
-    if (pipe(stderrPipe) < 0) {
-        result.stderr = "Failed to create stderr pipe";
-        close(stdoutPipe[0]); close(stdoutPipe[1]);
-        return result;
-    }
-
-    pid_t pid = fork();
-    if (pid < 0) {
-        result.stderr = "Fork failed";
-        close(stdoutPipe[0]); close(stdoutPipe[1]);
-        close(stderrPipe[0]); close(stderrPipe[1]);
-        return result;
-    }
-
-    if (pid == 0) {
-        // Child process
-        close(stdoutPipe[0]);
-        close(stderrPipe[0]);
-        dup2(stdoutPipe[1], STDOUT_FILENO);
-        dup2(stderrPipe[1], STDERR_FILENO);
-        close(stdoutPipe[1]);
-        close(stderrPipe[1]);
-
-        // Build C-style args array
-        std::vector<char*> cargs;
-        for (const auto& arg : args) {
-            cargs.push_back(const_cast<char*>(arg.c_str()));
-        }
-        cargs.push_back(nullptr);
-
-        // Execute directly without shell (prevents command injection)
-        execvp(cargs[0], cargs.data());
-        _exit(127);
-    }
-
-    // Parent process
-    close(stdoutPipe[1]);
-    close(stderrPipe[1]);
-
-    // Set non-blocking with error check
-    if (fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK) == -1 ||
-        fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK) == -1) {
-        // Continue anyway, might cause hangs but better than failing
-    }
-
-    // Poll for output with timeout
-    struct pollfd fds[2];
-    fds[0].fd = stdoutPipe[0];
-    fds[0].events = POLLIN;
-    fds[1].fd = stderrPipe[0];
-    fds[1].events = POLLIN;
-
-    auto startTime = std::chrono::steady_clock::now();
-    char buffer[4096];
-    bool timedOut = false;
-    bool outputTruncated = false;
-
-    while (true) {
-        auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - startTime).count();
-
-        if (elapsedMs >= timeoutMs) {
-            timedOut = true;
-            kill(pid, SIGTERM);
-            break;
-        }
-
-        // Safe remaining time calculation
-        long remainingMs = timeoutMs - elapsedMs;
-        if (remainingMs < 0) remainingMs = 0;
-        int pollTimeout = static_cast<int>(std::min(remainingMs, (long)100));
-
-        int ret = poll(fds, 2, pollTimeout);
-
-        if (ret > 0) {
-            if (fds[0].revents & POLLIN) {
-                ssize_t n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0 && !outputTruncated) {
-                    buffer[n] = '\0';
-                    if (result.stdout.size() + n < MAX_SNAP_OUTPUT_SIZE) {
-                        result.stdout += buffer;
-                    } else {
-                        outputTruncated = true;
-                    }
-                }
-            }
-            if (fds[1].revents & POLLIN) {
-                ssize_t n = read(stderrPipe[0], buffer, sizeof(buffer) - 1);
-                if (n > 0 && !outputTruncated) {
-                    buffer[n] = '\0';
-                    if (result.stderr.size() + n < MAX_SNAP_OUTPUT_SIZE) {
-                        result.stderr += buffer;
-                    } else {
-                        outputTruncated = true;
-                    }
-                }
-            }
-        }
-
-        // Check if child has exited
-        int status;
-        pid_t w = waitpid(pid, &status, WNOHANG);
-        if (w > 0) {
-            // Read any remaining output
-            while (true) {
-                ssize_t n = read(stdoutPipe[0], buffer, sizeof(buffer) - 1);
-                if (n <= 0) break;
-                if (!outputTruncated && result.stdout.size() + n < MAX_SNAP_OUTPUT_SIZE) {
-                    buffer[n] = '\0';
-                    result.stdout += buffer;
-                }
-            }
-            while (true) {
-                ssize_t n = read(stderrPipe[0], buffer, sizeof(buffer) - 1);
-                if (n <= 0) break;
-                if (!outputTruncated && result.stderr.size() + n < MAX_SNAP_OUTPUT_SIZE) {
-                    buffer[n] = '\0';
-                    result.stderr += buffer;
-                }
-            }
-
-            if (WIFEXITED(status)) {
-                result.exitCode = WEXITSTATUS(status);
-            }
-            break;
-        }
-    }
-
-    close(stdoutPipe[0]);
-    close(stderrPipe[0]);
-
-    if (timedOut) {
-        // Properly reap zombie process
-        int status;
-        int waitAttempts = 0;
-        while (waitpid(pid, &status, WNOHANG) == 0 && waitAttempts < 50) {
-            usleep(100000);  // 100ms
-            waitAttempts++;
-        }
-        if (waitAttempts >= 50) {
-            kill(pid, SIGKILL);
-            waitpid(pid, &status, 0);
-        }
-        result.exitCode = -1;
-        result.stderr = "Command timed out";
-    }
-
-    return result;
+    return toResult(snap()->enable(snapName));
 }
 
-// Legacy shell-based command execution (DEPRECATED - use executeCommandArgs)
-// Kept for backward compatibility with existing callers
-SnapProvider::CommandResult SnapProvider::executeCommand(
-    const std::string& command,
-    int timeoutMs)
+ProviderResult SnapProvider::disable(const string& snapName)
 {
-    // For safety, parse the command and use the arg-based version
-    // This is a simple tokenizer - doesn't handle all shell syntax
-    std::vector<std::string> args;
-    args.push_back("/bin/sh");
-    args.push_back("-c");
-    args.push_back(command);
-    return executeCommandArgs(args, timeoutMs);
+    return toResult(snap()->disable(snapName));
 }
 
-std::vector<UnifiedPackage> SnapProvider::parseSnapList(
-    const std::string& output)
+ProviderResult SnapProvider::revert(const string& snapName)
 {
-    std::vector<UnifiedPackage> packages;
-    std::istringstream stream(output);
-    std::string line;
-
-    // Skip header line
-    std::getline(stream, line);
-
-    while (std::getline(stream, line)) {
-        if (line.empty()) continue;
-
-        // Format: Name  Version  Rev  Tracking  Publisher  Notes
-        std::istringstream lineStream(line);
-        std::string name, version, rev, tracking, publisher, notes;
-
-        lineStream >> name >> version >> rev >> tracking >> publisher;
-        std::getline(lineStream, notes);
-
-        if (!name.empty()) {
-            UnifiedPackage pkg;
-            pkg.id = name;
-            pkg.name = name;
-            pkg.providerId = "snap";
-            pkg.installedVersion = version;
-            pkg.status = InstallStatus::INSTALLED;
-
-            // Parse publisher for verification status
-            bool verified = (publisher.find("**") != std::string::npos ||
-                            publisher.find("*") != std::string::npos);
-            std::string cleanPublisher = publisher;
-            cleanPublisher.erase(
-                std::remove(cleanPublisher.begin(), cleanPublisher.end(), '*'),
-                cleanPublisher.end());
-
-            pkg.trustLevel = determineTrustLevel(cleanPublisher, verified);
-
-            // Parse confinement from notes
-            if (notes.find("classic") != std::string::npos) {
-                pkg.confinement = ConfinementLevel::CLASSIC;
-            } else if (notes.find("devmode") != std::string::npos) {
-                pkg.confinement = ConfinementLevel::DEVMODE;
-            } else {
-                pkg.confinement = ConfinementLevel::STRICT;
-            }
-
-            packages.push_back(pkg);
-        }
-    }
-
-    return packages;
+    return toResult(snap()->revert(snapName));
 }
 
-std::vector<UnifiedPackage> SnapProvider::parseSnapFind(
-    const std::string& output)
+ProviderResult SnapProvider::holdUpdates(const string& snapName, bool hold)
 {
-    std::vector<UnifiedPackage> packages;
-    std::istringstream stream(output);
-    std::string line;
-
-    // Skip header line
-    std::getline(stream, line);
-
-    while (std::getline(stream, line)) {
-        if (line.empty()) continue;
-
-        // Format: Name  Version  Publisher  Notes  Summary
-        std::istringstream lineStream(line);
-        std::string name, version, publisher, notes;
-
-        lineStream >> name >> version >> publisher >> notes;
-
-        // Rest is summary
-        std::string summary;
-        std::getline(lineStream, summary);
-        // Trim leading whitespace
-        size_t start = summary.find_first_not_of(" \t");
-        if (start != std::string::npos) {
-            summary = summary.substr(start);
-        }
-
-        if (!name.empty()) {
-            UnifiedPackage pkg;
-            pkg.id = name;
-            pkg.name = name;
-            pkg.providerId = "snap";
-            pkg.availableVersion = version;
-            pkg.summary = summary;
-            pkg.status = InstallStatus::NOT_INSTALLED;
-
-            // Parse publisher
-            bool verified = (publisher.find("**") != std::string::npos ||
-                            publisher.find("*") != std::string::npos);
-            std::string cleanPublisher = publisher;
-            cleanPublisher.erase(
-                std::remove(cleanPublisher.begin(), cleanPublisher.end(), '*'),
-                cleanPublisher.end());
-
-            pkg.trustLevel = determineTrustLevel(cleanPublisher, verified);
-
-            packages.push_back(pkg);
-        }
-    }
-
-    return packages;
-}
-
-std::optional<UnifiedPackage> SnapProvider::parseSnapInfo(
-    const std::string& output)
-{
-    UnifiedPackage pkg;
-    pkg.providerId = "snap";
-
-    std::istringstream stream(output);
-    std::string line;
-
-    while (std::getline(stream, line)) {
-        size_t colonPos = line.find(':');
-        if (colonPos == std::string::npos) continue;
-
-        std::string key = line.substr(0, colonPos);
-        std::string value = line.substr(colonPos + 1);
-
-        // Trim whitespace
-        while (!value.empty() && (value[0] == ' ' || value[0] == '\t')) {
-            value = value.substr(1);
-        }
-
-        if (key == "name") {
-            pkg.id = value;
-            pkg.name = value;
-        } else if (key == "summary") {
-            pkg.summary = value;
-        } else if (key == "publisher") {
-            bool verified = (value.find("**") != std::string::npos ||
-                            value.find("*") != std::string::npos);
-            std::string cleanPublisher = value;
-            cleanPublisher.erase(
-                std::remove(cleanPublisher.begin(), cleanPublisher.end(), '*'),
-                cleanPublisher.end());
-            pkg.trustLevel = determineTrustLevel(cleanPublisher, verified);
-
-            pkg.metadata.developer = cleanPublisher;
-        } else if (key == "store-url") {
-            pkg.metadata.homepage = value;
-        } else if (key == "contact") {
-            pkg.metadata.supportUrl = value;
-        } else if (key == "license") {
-            pkg.metadata.license = value;
-        } else if (key == "description") {
-            pkg.description = value;
-        } else if (key == "confinement") {
-            pkg.confinement = parseConfinement(value);
-        } else if (key == "installed") {
-            // Parse installed version
-            std::istringstream vs(value);
-            std::string ver;
-            vs >> ver;
-            pkg.installedVersion = ver;
-            pkg.status = InstallStatus::INSTALLED;
-        } else if (key == "snap-id") {
-            // Store for unique identification
-        }
-    }
-
-    if (pkg.id.empty()) {
-        return std::nullopt;
-    }
-
-    return pkg;
-}
-
-bool SnapProvider::isValidSnapName(const std::string& name) {
-    if (name.empty() || name.length() > 40) return false;
-
-    // Snap names must be lowercase, start with letter, contain only
-    // letters, digits, and hyphens (not at start/end or consecutive)
-    static std::regex snapNameRegex("^[a-z][a-z0-9]*(-[a-z0-9]+)*$");
-    return std::regex_match(name, snapNameRegex);
-}
-
-TrustLevel SnapProvider::determineTrustLevel(
-    const std::string& publisher,
-    bool isVerified)
-{
-    std::string lowerPublisher = publisher;
-    std::transform(lowerPublisher.begin(), lowerPublisher.end(),
-                  lowerPublisher.begin(), ::tolower);
-
-    if (_verifiedPublishers.count(lowerPublisher) > 0) {
-        return TrustLevel::OFFICIAL;
-    }
-
-    if (isVerified) {
-        return TrustLevel::VERIFIED;
-    }
-
-    return TrustLevel::COMMUNITY;
-}
-
-ConfinementLevel SnapProvider::parseConfinement(const std::string& confStr) {
-    if (confStr == "strict") return ConfinementLevel::STRICT;
-    if (confStr == "classic") return ConfinementLevel::CLASSIC;
-    if (confStr == "devmode") return ConfinementLevel::DEVMODE;
-    return ConfinementLevel::UNKNOWN;
-}
-
-void SnapProvider::reportProgress(double fraction, const std::string& status) {
-    if (_progressCallback) {
-        _progressCallback(fraction, status);
-    }
+    return toResult(snap()->holdUpdates(snapName, hold));
 }
 
 } // namespace PolySynaptic
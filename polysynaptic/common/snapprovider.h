@@ -2,8 +2,9 @@
  *
  * Copyright (c) 2024 PolySynaptic Contributors
  *
- * This file implements the PackageSourceProvider interface for Snap packages.
- * It uses the snap CLI tool to interact with the snapd daemon.
+ * This file implements the PackageSourceProvider interface for Snap
+ * packages, as a view of the process's SnapBackend: the snapd client,
+ * the snap CLI and the caches are the backend's.
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -14,21 +15,22 @@
 #ifndef _SNAPPROVIDER_H_
 #define _SNAPPROVIDER_H_
 
-#include "packagesourceprovider.h"
-#include "structuredlog.h"
+#include "backendprovider.h"
+#include "snapbackend.h"
 
 #include <set>
-#include <regex>
 
 namespace PolySynaptic {
 
 /**
  * SnapProvider - Snap package source provider
  *
- * This provider uses the snap CLI to search, install, and manage
- * Snap packages through the unified PackageSourceProvider interface.
+ * Searches, installs and manages snaps through SnapBackend::shared(),
+ * adding the trust and confinement the provider interface has on top
+ * of what the backend reports. The "channel" install option picks the
+ * channel to install from.
  */
-class SnapProvider : public PackageSourceProvider {
+class SnapProvider : public BackendProvider {
 public:
     SnapProvider();
     ~SnapProvider() override = default;
@@ -37,76 +39,13 @@ public:
     // Provider Identity
     // ========================================================================
 
-    std::string getId() const override { return "snap"; }
-    std::string getName() const override { return "Snap"; }
-    std::string getDescription() const override {
-        return "Canonical's universal package manager";
-    }
-    std::string getIconName() const override { return "snap-symbolic"; }
-
-    // ========================================================================
-    // Availability & Configuration
-    // ========================================================================
-
-    bool isAvailable() const override;
-    ProviderStatus getStatus() const override;
-    bool configure() override;
-
-    // ========================================================================
-    // Package Operations
-    // ========================================================================
-
-    std::vector<UnifiedPackage> search(
-        const std::string& query,
-        const SearchOptions& options = SearchOptions()) override;
-
-    std::vector<UnifiedPackage> getInstalled() override;
-    std::vector<UnifiedPackage> getUpdatable() override;
-
-    std::optional<UnifiedPackage> getPackageDetails(
-        const std::string& packageId) override;
-
-    // ========================================================================
-    // Install/Remove Operations
-    // ========================================================================
-
-    OperationResult install(
-        const std::string& packageId,
-        const InstallOptions& options = InstallOptions()) override;
-
-    OperationResult remove(
-        const std::string& packageId,
-        const RemoveOptions& options = RemoveOptions()) override;
-
-    OperationResult update(
-        const std::string& packageId) override;
-
-    // ========================================================================
-    // Batch Operations
-    // ========================================================================
-
-    bool supportsBatchOperations() const override { return false; }
-
-    // ========================================================================
-    // Repository Management (Snap Channels)
-    // ========================================================================
-
-    bool supportsRepositories() const override { return false; }
+    ProviderCapabilities getCapabilities() const override;
 
     // ========================================================================
     // Trust & Security
     // ========================================================================
 
-    TrustLevel getTrustLevel(const std::string& packageId) override;
-    PackagePermissions getPermissions(const std::string& packageId) override;
-
-    // ========================================================================
-    // Progress Callbacks
-    // ========================================================================
-
-    void setProgressCallback(ProgressCallback callback) override {
-        _progressCallback = std::move(callback);
-    }
+    TrustLevel getDefaultTrustLevel() const override { return TrustLevel::COMMUNITY; }
 
     // ========================================================================
     // Snap-Specific Methods
@@ -115,98 +54,43 @@ public:
     /**
      * Get available channels for a snap
      */
-    std::vector<std::string> getChannels(const std::string& snapName);
+    vector<string> getChannels(const string& snapName);
 
     /**
      * Switch to a different channel
      */
-    OperationResult switchChannel(const std::string& snapName,
-                                   const std::string& channel);
-
-    /**
-     * Connect a plug to a slot
-     */
-    OperationResult connectPlug(const std::string& snap,
-                                const std::string& plug,
-                                const std::string& targetSnap,
-                                const std::string& slot);
-
-    /**
-     * Disconnect a plug
-     */
-    OperationResult disconnectPlug(const std::string& snap,
-                                   const std::string& plug);
-
-    /**
-     * Get connection status for a snap
-     */
-    std::vector<std::pair<std::string, bool>> getConnections(
-        const std::string& snapName);
+    ProviderResult switchChannel(const string& snapName, const string& channel);
 
     /**
-     * Enable a disabled snap
+     * Interface connections, see SnapBackend::connectPlug()
      */
-    OperationResult enable(const std::string& snapName);
+    ProviderResult connectPlug(const string& snapName, const string& plug,
+                               const string& targetSnap = "", const string& slot = "");
+    ProviderResult disconnectPlug(const string& snapName, const string& plug);
+    vector<pair<string, bool>> getConnections(const string& snapName);
 
     /**
-     * Disable a snap (without removing)
+     * Enable, disable or revert a snap
      */
-    OperationResult disable(const std::string& snapName);
+    ProviderResult enable(const string& snapName);
+    ProviderResult disable(const string& snapName);
+    ProviderResult revert(const string& snapName);
 
     /**
-     * Revert to previous revision
+     * Hold or release a snap's automatic refreshes
      */
-    OperationResult revert(const std::string& snapName);
+    ProviderResult holdUpdates(const string& snapName, bool hold);
 
-    /**
-     * Hold/unhold updates for a snap
-     */
-    OperationResult holdUpdates(const std::string& snapName, bool hold);
+protected:
+    void fill(UnifiedPackage& pkg, const PackageInfo& info) const override;
 
 private:
-    ProgressCallback _progressCallback;
-    std::set<std::string> _verifiedPublishers;
-
-    // CLI execution helper
-    struct CommandResult {
-        int exitCode;
-        std::string stdout;
-        std::string stderr;
-    };
-
-    // Safe argument-based execution (no shell - prevents command injection)
-    CommandResult executeCommandArgs(const std::vector<std::string>& args,
-                                      int timeoutMs = 30000);
-    // Legacy shell-based execution (DEPRECATED - wraps executeCommandArgs)
-    CommandResult executeCommand(const std::string& command,
-                                  int timeoutMs = 30000);
-
-    // Parse snap list output
-    std::vector<UnifiedPackage> parseSnapList(const std::string& output);
+    SnapBackend* snap() const { return static_cast<SnapBackend*>(_engine.get()); }
 
-    // Parse snap find output
-    std::vector<UnifiedPackage> parseSnapFind(const std::string& output);
-
-    // Parse snap info output
-    std::optional<UnifiedPackage> parseSnapInfo(const std::string& output);
-
-    // Validate snap name
-    bool isValidSnapName(const std::string& name);
-
-    // Determine trust level
-    TrustLevel determineTrustLevel(const std::string& publisher,
-                                   bool isVerified);
-
-    // Determine confinement level
-    ConfinementLevel parseConfinement(const std::string& confStr);
-
-    // Report progress
-    void reportProgress(double fraction, const std::string& status);
+    // Publishers whose snaps count as official, lower case
+    set<string> _verifiedPublishers;
 };
 
-// Register Snap provider with the registry
-REGISTER_PROVIDER(SnapProvider, "snap");
-
 } // namespace PolySynaptic
 
 #endif // _SNAPPROVIDER_H_
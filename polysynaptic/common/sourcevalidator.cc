@@ -0,0 +1,262 @@
+/* sourcevalidator.cc - Checking a repository before its indexes are fetched
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "sourcevalidator.h"
+#include "mirrorprobe.h"
+#include "subprocess.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+using Status = SourceValidation::Status;
+
+const int GPG_TIMEOUT_SECONDS = 20;
+
+bool endsWith(const string& s, const string& suffix)
+{
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isFile(const string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// A file in /tmp that goes away with it
+class TempFile {
+public:
+    TempFile()
+    {
+        char name[] = "/tmp/polysynaptic-source-XXXXXX";
+        int fd = mkstemp(name);
+        if (fd >= 0) {
+            close(fd);
+            _path = name;
+        }
+    }
+    ~TempFile()
+    {
+        if (!_path.empty()) unlink(_path.c_str());
+    }
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    const string& path() const { return _path; }
+
+    bool write(const string& data)
+    {
+        FILE *f = _path.empty() ? nullptr : fopen(_path.c_str(), "w");
+        if (!f) return false;
+        bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+        return fclose(f) == 0 && ok;
+    }
+
+private:
+    string _path;
+};
+
+string firstLine(const string& text)
+{
+    string line = text.substr(0, text.find('\n'));
+    return line.empty() ? "gpgv failed" : line;
+}
+
+SourceValidation failed(Status status, const string& error, double latencyMs = 0)
+{
+    SourceValidation v;
+    v.status = status;
+    v.error = error;
+    v.latencyMs = latencyMs;
+    return v;
+}
+
+// A mirror that answered with an HTTP error has no such file
+bool answered(const MirrorResult& result)
+{
+    return result.error.compare(0, 11, "HTTP status") == 0;
+}
+
+} // anonymous namespace
+
+SourceValidator::SourceValidator(unsigned parallel)
+    : _pool(max(parallel, 1u))
+{
+}
+
+future<SourceValidation> SourceValidator::submit(const SourceCheck& check)
+{
+    return _pool.submit(TaskPriority::NORMAL, [check]() {
+        return validate(check);
+    });
+}
+
+string SourceValidator::releasePath(const string& dist, const string& file)
+{
+    // flat repositories have theirs next to the indexes
+    if (endsWith(dist, "/")) {
+        return (dist == "./" ? "" : dist) + file;
+    }
+    return "dists/" + dist + "/" + file;
+}
+
+string SourceValidator::option(const string& options, const string& name)
+{
+    istringstream in(options);
+    string word;
+    while (in >> word) {
+        if (word.compare(0, name.size() + 1, name + "=") == 0) {
+            return word.substr(name.size() + 1);
+        }
+    }
+    return "";
+}
+
+vector<string> SourceValidator::keyrings(const SourceCheck& check,
+                                         const string& trustedDir,
+                                         const string& trustedFile)
+{
+    vector<string> files;
+
+    // signed-by is a list of keyring files, or of fingerprints, which
+    // have to be in the trusted keyrings anyway
+    string signedBy = option(check.options, "signed-by");
+    if (!signedBy.empty() && signedBy[0] == '/') {
+        istringstream in(signedBy);
+        string file;
+        while (getline(in, file, ',')) {
+            if (!file.empty()) files.push_back(file);
+        }
+        return files;
+    }
+
+    if (isFile(trustedFile)) {
+        files.push_back(trustedFile);
+    }
+    DIR *dir = opendir(trustedDir.c_str());
+    if (dir) {
+        vector<string> parts;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string name = entry->d_name;
+            if (endsWith(name, ".gpg") || endsWith(name, ".asc")) {
+                parts.push_back(trustedDir + "/" + name);
+            }
+        }
+        closedir(dir);
+        sort(parts.begin(), parts.end());
+        files.insert(files.end(), parts.begin(), parts.end());
+    }
+    return files;
+}
+
+SourceValidation SourceValidator::validate(const SourceCheck& check)
+{
+    if (check.uri.compare(0, 7, "http://") != 0) {
+        return failed(Status::UNCHECKED, "only http:// sources can be checked");
+    }
+
+    string release, signature;
+    MirrorResult fetched = MirrorProbe::measure(check.uri,
+        releasePath(check.dist, "InRelease"), MirrorProbe::PROBE_TIMEOUT_MS, &release);
+    double latencyMs = fetched.latencyMs;
+    if (!fetched.healthy && !answered(fetched)) {
+        return failed(Status::UNREACHABLE, fetched.error);
+    }
+    if (!fetched.healthy) {
+        // older repositories sign the Release file separately
+        release.clear();
+        fetched = MirrorProbe::measure(check.uri, releasePath(check.dist, "Release"),
+                                       MirrorProbe::PROBE_TIMEOUT_MS, &release);
+        if (!fetched.healthy) {
+            return failed(answered(fetched) ? Status::NO_RELEASE : Status::UNREACHABLE,
+                          fetched.error, latencyMs);
+        }
+        MirrorResult signed_ = MirrorProbe::measure(check.uri,
+            releasePath(check.dist, "Release.gpg"), MirrorProbe::PROBE_TIMEOUT_MS,
+            &signature);
+        if (!signed_.healthy) {
+            return failed(Status::BAD_SIGNATURE, "the Release file is not signed",
+                          latencyMs);
+        }
+    }
+    if (fetched.bytes >= MirrorProbe::MAX_PROBE_BYTES) {
+        return failed(Status::UNCHECKED, "the Release file is too large to check",
+                      latencyMs);
+    }
+
+    string gpgv = Subprocess::findProgram("gpgv");
+    if (gpgv.empty()) {
+        return failed(Status::UNCHECKED, "gpgv is not installed", latencyMs);
+    }
+
+    // gpgv only reads binary keyrings; armored ones are converted first
+    vector<unique_ptr<TempFile> > dearmored;
+    vector<string> args = {gpgv};
+    for (const string& keyring : keyrings(check)) {
+        string file = keyring;
+        if (endsWith(keyring, ".asc")) {
+            dearmored.emplace_back(new TempFile());
+            Subprocess::Options options;
+            options.timeoutSeconds = GPG_TIMEOUT_SECONDS;
+            Subprocess::Result result = Subprocess::run(
+                {"gpg", "--batch", "--yes", "--dearmor", "-o",
+                 dearmored.back()->path(), keyring}, options);
+            if (result.exitCode != 0) continue;
+            file = dearmored.back()->path();
+        }
+        args.push_back("--keyring");
+        args.push_back(file);
+    }
+    if (args.size() == 1) {
+        return failed(Status::BAD_SIGNATURE, "no trusted keys to check it with",
+                      latencyMs);
+    }
+
+    TempFile releaseFile, signatureFile;
+    if (!releaseFile.write(release) ||
+        (!signature.empty() && !signatureFile.write(signature))) {
+        return failed(Status::UNCHECKED, "cannot write a temporary file", latencyMs);
+    }
+    if (!signature.empty()) {
+        args.push_back(signatureFile.path());
+    }
+    args.push_back(releaseFile.path());
+
+    Subprocess::Options options;
+    options.timeoutSeconds = GPG_TIMEOUT_SECONDS;
+    Subprocess::Result result = Subprocess::run(args, options);
+    if (!result.started) {
+        return failed(Status::UNCHECKED, result.error, latencyMs);
+    }
+    if (result.exitCode != 0) {
+        return failed(Status::BAD_SIGNATURE, firstLine(result.stderr), latencyMs);
+    }
+
+    SourceValidation valid;
+    valid.status = Status::VALID;
+    valid.latencyMs = latencyMs;
+    return valid;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
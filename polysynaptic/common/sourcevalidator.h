@@ -0,0 +1,112 @@
+/* sourcevalidator.h - Checking a repository before its indexes are fetched
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the checks the repository editor runs on the
+ * sources that were added, enabled or edited. Each one's Release file
+ * is fetched the way MirrorProbe measures a mirror, and its signature
+ * checked with gpgv against the keys APT would use for it, so a
+ * mistyped, dead or unsigned repository shows up as soon as it is
+ * entered, rather than when a full reload of every source times out.
+ * The sources that passed can then be updated on their own.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SOURCEVALIDATOR_H_
+#define _SOURCEVALIDATOR_H_
+
+#include "taskpool.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * SourceCheck - What is needed of a sources.list entry to check it
+ */
+struct SourceCheck {
+    string uri;
+    string dist;                    // "stable", or "path/" for a flat repository
+    string options;                 // Inside the [ ], "signed-by=... arch=..."
+};
+
+/**
+ * SourceValidation - How one source did
+ */
+struct SourceValidation {
+    enum class Status {
+        VALID,                      // Release fetched and signed by a trusted key
+        UNREACHABLE,                // No answer from the host
+        NO_RELEASE,                 // Answered, but has no Release file there
+        BAD_SIGNATURE,              // Not signed by a trusted key
+        UNCHECKED                   // Cannot be checked from here (https, file...)
+    };
+
+    Status status = Status::UNCHECKED;
+    string error;                   // Why not VALID
+    double latencyMs = 0;           // Connect round trip, when it answered
+};
+
+/**
+ * SourceValidator - Checks sources on a few threads
+ *
+ *     future<SourceValidation> done = validator.submit(check);
+ *
+ * Only http:// sources can be fetched, as for MirrorProbe; others are
+ * UNCHECKED with the reason. InRelease is tried first, then Release
+ * with Release.gpg.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class SourceValidator {
+public:
+    explicit SourceValidator(unsigned parallel = 4);
+
+    SourceValidator(const SourceValidator&) = delete;
+    SourceValidator& operator=(const SourceValidator&) = delete;
+
+    future<SourceValidation> submit(const SourceCheck& check);
+
+    /**
+     * Check one source now, on the calling thread
+     */
+    static SourceValidation validate(const SourceCheck& check);
+
+    /**
+     * The file under the source's URI its Release file is at, e.g.
+     * "dists/stable/InRelease"
+     */
+    static string releasePath(const string& dist, const string& file);
+
+    /**
+     * The value of an option ("signed-by", "arch"...) in the [ ] of an
+     * entry, "" if it has none
+     */
+    static string option(const string& options, const string& name);
+
+    /**
+     * The keyrings a source's signatures are checked against: its
+     * signed-by files, or every keyring APT trusts
+     */
+    static vector<string> keyrings(const SourceCheck& check,
+                                   const string& trustedDir = "/etc/apt/trusted.gpg.d",
+                                   const string& trustedFile = "/etc/apt/trusted.gpg");
+
+private:
+    TaskPool _pool;
+};
+
+} // namespace PolySynaptic
+
+#endif // _SOURCEVALIDATOR_H_
+
+// vim:ts=4:sw=4:et
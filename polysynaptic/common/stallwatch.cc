@@ -0,0 +1,300 @@
+/* stallwatch.cc - Notices when the main loop stops running
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "stallwatch.h"
+#include "latency.h"
+#include "metrics.h"
+#include "structuredlog.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <signal.h>
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#define HAVE_STALL_BACKTRACE 1
+#endif
+
+namespace PolySynaptic {
+
+namespace {
+
+const size_t MAX_STALLS = 32;
+
+// Frames of the log entry; the full backtrace stays in the event
+const size_t LOGGED_FRAMES = 16;
+
+#ifdef HAVE_STALL_BACKTRACE
+const int MAX_FRAMES = 48;
+
+// Filled by the watched thread in the signal handler; only one
+// capture runs at a time, from the watchdog thread
+void *s_frames[MAX_FRAMES];
+std::atomic<int> s_frameCount(-1);
+
+int backtraceSignal()
+{
+    return SIGRTMIN + 3;
+}
+
+void onBacktraceSignal(int)
+{
+    s_frameCount.store(backtrace(s_frames, MAX_FRAMES), std::memory_order_release);
+}
+#endif
+
+} // anonymous namespace
+
+// ============================================================================
+// StallWatchdog
+// ============================================================================
+
+StallWatchdog::StallWatchdog()
+    : _lastBeat(0), _running(false), _thresholdMs(200),
+#ifdef HAVE_STALL_BACKTRACE
+      _backtraces(true),
+#else
+      _backtraces(false),
+#endif
+      _watched(), _watchedThread(0), _stopping(false), _inStall(false), _count(0)
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+}
+
+StallWatchdog& StallWatchdog::instance()
+{
+    static StallWatchdog watchdog;
+    return watchdog;
+}
+
+void StallWatchdog::start(double thresholdMs)
+{
+    if (_running.load()) {
+        return;
+    }
+
+    _watched = pthread_self();
+    _watchedThread = Tracer::threadNumber();
+    Tracer::watchThisThread();
+    _thresholdMs = thresholdMs;
+
+#ifdef HAVE_STALL_BACKTRACE
+    if (_backtraces) {
+        struct sigaction action = {};
+        action.sa_handler = onBacktraceSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(backtraceSignal(), &action, nullptr);
+        // The first call loads libgcc, which must not happen in the handler
+        backtrace(s_frames, 1);
+    }
+#endif
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = false;
+        _inStall = false;
+    }
+    _lastBeat.store(Tracer::nowMicros());
+    _running.store(true);
+    _thread = std::thread(&StallWatchdog::watchLoop, this);
+}
+
+void StallWatchdog::stop()
+{
+    if (!_running.load()) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    _thread.join();
+    _running.store(false);
+}
+
+void StallWatchdog::heartbeat()
+{
+    _lastBeat.store(Tracer::nowMicros(), std::memory_order_relaxed);
+}
+
+void StallWatchdog::setTracePath(const string& path)
+{
+    lock_guard<mutex> lock(_mutex);
+    _tracePath = path;
+}
+
+vector<StallEvent> StallWatchdog::recentStalls() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return vector<StallEvent>(_stalls.begin(), _stalls.end());
+}
+
+uint64_t StallWatchdog::stallCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _count;
+}
+
+void StallWatchdog::watchLoop()
+{
+    // A few looks per threshold, so a stall is caught close to its start
+    auto period = std::chrono::microseconds(
+        std::max<int64_t>(5000, static_cast<int64_t>(_thresholdMs * 1000 / 4)));
+    int64_t threshold = static_cast<int64_t>(_thresholdMs * 1000);
+
+    while (true) {
+        bool inStall;
+        int64_t stallStart = 0;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _wakeup.wait_for(lock, period, [this]() { return _stopping; });
+            if (_stopping) {
+                return;
+            }
+            inStall = _inStall;
+            if (inStall) {
+                stallStart = _stalls.back().startMicros;
+            }
+        }
+
+        int64_t last = _lastBeat.load(std::memory_order_relaxed);
+        if (inStall && last != stallStart) {
+            end(last);
+        } else if (!inStall && Tracer::nowMicros() - last > threshold) {
+            begin(last);
+        }
+    }
+}
+
+void StallWatchdog::begin(int64_t lastBeat)
+{
+    StallEvent event;
+    event.startMicros = lastBeat;
+    event.operation = Tracer::watchedSpan();
+    event.ongoing = true;
+    if (_backtraces) {
+        event.backtrace = captureBacktrace();
+    }
+
+    static MetricCounter& stalls = MetricsRegistry::instance()
+        .counter("polysynaptic_mainloop_stalls", "Main loop stalls");
+    stalls.inc();
+
+    // Logged now too, in case the loop never comes back
+    LogBuilder(LogLevel::WARN)
+        .component("Stall")
+        .operation(event.operation)
+        .message("Main loop not responding")
+        .emit();
+
+    lock_guard<mutex> lock(_mutex);
+    _stalls.push_back(std::move(event));
+    if (_stalls.size() > MAX_STALLS) {
+        _stalls.pop_front();
+    }
+    _inStall = true;
+    _count++;
+}
+
+void StallWatchdog::end(int64_t lastBeat)
+{
+    StallEvent event;
+    string tracePath;
+    {
+        lock_guard<mutex> lock(_mutex);
+        StallEvent& stall = _stalls.back();
+        stall.ms = (lastBeat - stall.startMicros) / 1000.0;
+        stall.ongoing = false;
+        event = stall;
+        _inStall = false;
+        tracePath = _tracePath;
+    }
+
+    auto micros = std::chrono::microseconds(lastBeat - event.startMicros);
+    LatencyRegistry::instance().histogram("MainLoop", "stall").record(micros);
+
+    string frames;
+    for (size_t i = 0; i < event.backtrace.size() && i < LOGGED_FRAMES; i++) {
+        frames += (i ? "\n" : "") + event.backtrace[i];
+    }
+    LogBuilder entry(LogLevel::WARN);
+    entry.component("Stall")
+         .operation(event.operation)
+         .duration(std::chrono::duration_cast<std::chrono::milliseconds>(micros));
+    if (!frames.empty()) {
+        entry.field("backtrace", frames);
+    }
+    entry.message("Main loop stalled for " +
+                  std::to_string(static_cast<long>(event.ms)) + " ms")
+         .emit();
+
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.isEnabled()) {
+        return;
+    }
+    TraceSpan span;
+    span.id = tracer.nextSpanId();
+    span.name = "stall";
+    span.category = "mainloop";
+    span.detail = event.operation;
+    span.startMicros = event.startMicros;
+    span.durationMicros = micros.count();
+    span.thread = _watchedThread;
+    tracer.record(std::move(span));
+    if (!tracePath.empty() && !tracer.exportChromeTrace(tracePath)) {
+        LOG_WARN("Could not write the stall trace to " + tracePath);
+    }
+}
+
+vector<string> StallWatchdog::captureBacktrace()
+{
+    vector<string> frames;
+#ifdef HAVE_STALL_BACKTRACE
+    s_frameCount.store(-1);
+    if (pthread_kill(_watched, backtraceSignal()) != 0) {
+        return frames;
+    }
+
+    // The handler runs as soon as the thread is scheduled, even when
+    // it is blocked in a system call
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    int count;
+    while ((count = s_frameCount.load(std::memory_order_acquire)) < 0 &&
+           std::chrono::steady_clock::now() < until) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (count <= 0) {
+        return frames;
+    }
+
+    char **symbols = backtrace_symbols(s_frames, count);
+    if (!symbols) {
+        return frames;
+    }
+    // The first two are the handler and the signal trampoline
+    for (int i = 2; i < count; i++) {
+        frames.push_back(symbols[i]);
+    }
+    free(symbols);
+#endif
+    return frames;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,126 @@
+/* stallwatch.h - Notices when the main loop stops running
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the watchdog behind the "window hangs" reports
+ * we cannot reproduce. The main loop beats a few times a frame; a
+ * thread of its own notices when the beats stop for longer than the
+ * threshold, and notes what the main thread was doing (its innermost
+ * trace span, traced or not) and where (a backtrace taken with a
+ * signal). Each stall is logged as a "Stall" entry with its duration,
+ * kept in the "MainLoop" latency histogram the metrics exports carry,
+ * listed by the debug panel's stalls command and, while tracing is
+ * on, saved with the spans around it as a Chrome trace.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _STALLWATCH_H_
+#define _STALLWATCH_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * StallEvent - One stretch of time the main loop did not run
+ */
+struct StallEvent {
+    int64_t startMicros = 0;            // Steady clock, the last beat before
+    double ms = 0;                      // Beat to beat, at most a beat too long
+    string operation;                   // Innermost span then, "" outside any
+    vector<string> backtrace;           // Of the main thread, innermost first
+    bool ongoing = false;               // Not over yet
+};
+
+/**
+ * StallWatchdog - Watches the heartbeat of one thread
+ *
+ *     StallWatchdog::instance().start(200);            // on the main thread
+ *     g_timeout_add(StallWatchdog::BEAT_MS, beat, NULL); // beat() calls heartbeat()
+ *
+ * Thread Safety:
+ *   start() is called on the thread to watch; the rest from any thread.
+ */
+class StallWatchdog {
+public:
+    // How often the watched loop should beat
+    static const unsigned BEAT_MS = 50;
+
+    static StallWatchdog& instance();
+
+    /**
+     * Watch the calling thread; a stall is a gap between heartbeats of
+     * more than thresholdMs
+     */
+    void start(double thresholdMs = 200);
+    void stop();
+    bool isRunning() const { return _running.load(); }
+
+    /**
+     * The watched loop ran; cheap enough for every iteration
+     */
+    void heartbeat();
+
+    /**
+     * Take a backtrace of the watched thread when a stall starts; on
+     * by default where the C library can
+     */
+    void setBacktraces(bool enabled) { _backtraces = enabled; }
+
+    /**
+     * Where the trace of each stall is written while tracing is on,
+     * replacing the one before; "" for nowhere
+     */
+    void setTracePath(const string& path);
+
+    // The newest stalls, oldest first, the one still going included
+    vector<StallEvent> recentStalls() const;
+    uint64_t stallCount() const;
+
+private:
+    StallWatchdog();
+    ~StallWatchdog();
+    StallWatchdog(const StallWatchdog&) = delete;
+    StallWatchdog& operator=(const StallWatchdog&) = delete;
+
+    void watchLoop();
+    void begin(int64_t lastBeat);
+    void end(int64_t lastBeat);
+    vector<string> captureBacktrace();
+
+    std::atomic<int64_t> _lastBeat;     // Steady clock micros
+    std::atomic<bool> _running;
+    double _thresholdMs;
+    bool _backtraces;
+    pthread_t _watched;
+    uint32_t _watchedThread;            // Tracer's number for it
+    std::thread _thread;
+
+    mutable std::mutex _mutex;          // Guards everything below
+    std::condition_variable _wakeup;
+    bool _stopping;
+    bool _inStall;
+    deque<StallEvent> _stalls;
+    uint64_t _count;
+    string _tracePath;
+};
+
+} // namespace PolySynaptic
+
+#endif // _STALLWATCH_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,265 @@
+/* startupprofile.cc - Time from launch until the main window is usable
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "startupprofile.h"
+#include "structuredlog.h"
+#include "latency.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sys/resource.h>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// StartupUsage
+// ============================================================================
+
+StartupUsage StartupUsage::ofThisThread()
+{
+    struct rusage ru;
+#ifdef RUSAGE_THREAD
+    int who = RUSAGE_THREAD;
+#else
+    int who = RUSAGE_SELF;
+#endif
+    StartupUsage usage;
+    if (getrusage(who, &ru) != 0) {
+        return usage;
+    }
+    // Block counts are in 512-byte units
+    usage.minorFaults = ru.ru_minflt;
+    usage.majorFaults = ru.ru_majflt;
+    usage.readBytes = static_cast<int64_t>(ru.ru_inblock) * 512;
+    usage.writtenBytes = static_cast<int64_t>(ru.ru_oublock) * 512;
+    return usage;
+}
+
+StartupUsage StartupUsage::operator-(const StartupUsage& before) const
+{
+    StartupUsage delta;
+    delta.minorFaults = minorFaults - before.minorFaults;
+    delta.majorFaults = majorFaults - before.majorFaults;
+    delta.readBytes = readBytes - before.readBytes;
+    delta.writtenBytes = writtenBytes - before.writtenBytes;
+    return delta;
+}
+
+// ============================================================================
+// StartupProfile
+// ============================================================================
+
+StartupProfile::StartupProfile()
+    : _start(std::chrono::steady_clock::now()), _last(_start),
+      _lastUsage(StartupUsage::ofThisThread()), _reporting(false),
+      _interactiveMs(0), _finished(false)
+{
+}
+
+StartupProfile& StartupProfile::instance()
+{
+    static StartupProfile profile;
+    return profile;
+}
+
+void StartupProfile::enableReport()
+{
+    _reporting = true;
+    Tracer::instance().setEnabled(true);
+}
+
+bool StartupProfile::isFinished() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _finished;
+}
+
+vector<StartupPhase> StartupProfile::phases() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _phases;
+}
+
+double StartupProfile::elapsedMs() const
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - _start).count();
+}
+
+void StartupProfile::mark(const char *phase)
+{
+    auto now = std::chrono::steady_clock::now();
+    StartupUsage usage = StartupUsage::ofThisThread();
+
+    StartupPhase done;
+    done.name = phase;
+    done.startMs = std::chrono::duration<double, std::milli>(_last - _start).count();
+    done.ms = std::chrono::duration<double, std::milli>(now - _last).count();
+    done.usage = usage - _lastUsage;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_finished) {
+            return;
+        }
+        _phases.push_back(done);
+    }
+
+    LatencyRegistry::instance().histogram("Startup", phase).record(now - _last);
+    trace(done);
+    _last = now;
+    _lastUsage = usage;
+}
+
+void StartupProfile::record(const char *phase, double startMs, const StartupUsage& usage)
+{
+    StartupPhase done;
+    done.name = phase;
+    done.startMs = startMs;
+    done.ms = elapsedMs() - startMs;
+    done.usage = usage;
+    done.background = true;
+    {
+        lock_guard<mutex> lock(_mutex);
+        _phases.push_back(done);
+    }
+    trace(done);
+}
+
+int StartupProfile::begin(const char *phase)
+{
+    StartupPhase running;
+    running.name = phase;
+    running.startMs = elapsedMs();
+    running.background = true;
+
+    lock_guard<mutex> lock(_mutex);
+    if (_finished) {
+        return -1;
+    }
+    _phases.push_back(running);
+    return static_cast<int>(_phases.size() - 1);
+}
+
+void StartupProfile::end(int index, const StartupUsage& usage)
+{
+    StartupPhase done;
+    {
+        lock_guard<mutex> lock(_mutex);
+        StartupPhase& phase = _phases[index];
+        phase.ms = elapsedMs() - phase.startMs;
+        phase.usage = usage;
+        done = phase;
+    }
+    trace(done);
+}
+
+void StartupProfile::trace(const StartupPhase& phase) const
+{
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.isEnabled()) {
+        return;
+    }
+
+    TraceSpan span;
+    span.id = tracer.nextSpanId();
+    span.name = phase.name;
+    span.category = "startup";
+    span.startMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+        _start.time_since_epoch()).count() + static_cast<int64_t>(phase.startMs * 1000);
+    span.durationMicros = static_cast<int64_t>(phase.ms * 1000);
+    span.thread = Tracer::threadNumber();
+    span.counters.emplace_back("minorFaults", phase.usage.minorFaults);
+    span.counters.emplace_back("majorFaults", phase.usage.majorFaults);
+    span.counters.emplace_back("readBytes", phase.usage.readBytes);
+    span.counters.emplace_back("writtenBytes", phase.usage.writtenBytes);
+    tracer.record(std::move(span));
+}
+
+void StartupProfile::finish()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_finished) {
+            return;
+        }
+        _finished = true;
+    }
+
+    auto total = std::chrono::steady_clock::now() - _start;
+    _interactiveMs = std::chrono::duration<double, std::milli>(total).count();
+    LatencyRegistry::instance().histogram("Startup", "interactive").record(total);
+    if (!Logger::instance().isEnabled(LogLevel::INFO)) {
+        return;
+    }
+
+    LogBuilder entry(LogLevel::INFO);
+    entry.component("Startup")
+         .duration(std::chrono::duration_cast<std::chrono::milliseconds>(total));
+    for (const auto& phase : phases()) {
+        if (phase.background) {
+            continue;
+        }
+        entry.field(string(phase.name) + "Ms", std::to_string(static_cast<long>(phase.ms)));
+    }
+    entry.message("Interface ready").emit();
+}
+
+string StartupProfile::report() const
+{
+    vector<StartupPhase> all = phases();
+    stable_sort(all.begin(), all.end(),
+                [](const StartupPhase& a, const StartupPhase& b) { return a.startMs < b.startMs; });
+
+    char line[160];
+    snprintf(line, sizeof(line), "Startup profile: interactive after %.1f ms\n", _interactiveMs);
+    string out = line;
+    snprintf(line, sizeof(line), "%-16s %9s %9s %8s %8s %10s %10s\n",
+             "phase", "start ms", "ms", "minflt", "majflt", "read KB", "write KB");
+    out += line;
+
+    for (const auto& phase : all) {
+        string name = string(phase.background ? "  " : "") + phase.name;
+        if (phase.isRunning()) {
+            snprintf(line, sizeof(line), "%-16s %9.1f %9s\n",
+                     name.c_str(), phase.startMs, "running");
+        } else {
+            snprintf(line, sizeof(line), "%-16s %9.1f %9.1f %8lld %8lld %10lld %10lld\n",
+                     name.c_str(), phase.startMs, phase.ms,
+                     static_cast<long long>(phase.usage.minorFaults),
+                     static_cast<long long>(phase.usage.majorFaults),
+                     static_cast<long long>(phase.usage.readBytes / 1024),
+                     static_cast<long long>(phase.usage.writtenBytes / 1024));
+        }
+        out += line;
+    }
+    out += "Indented phases ran beside the others; faults and I/O are per thread.\n";
+    return out;
+}
+
+// ============================================================================
+// ScopedStartupPhase
+// ============================================================================
+
+ScopedStartupPhase::ScopedStartupPhase(const char *phase)
+    : _index(StartupProfile::instance().begin(phase)),
+      _before(StartupUsage::ofThisThread())
+{
+}
+
+ScopedStartupPhase::~ScopedStartupPhase()
+{
+    if (_index >= 0) {
+        StartupProfile::instance().end(_index, StartupUsage::ofThisThread() - _before);
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,167 @@
+/* startupprofile.h - Time from launch until the main window is usable
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the startup timeline: main() marks the end of
+ * each step (configuration, option restore, backends, GtkBuilder, main
+ * window, cache, views), and the work startup leaves to other threads
+ * (the Xapian open, the backend probes) and the first frame are timed
+ * beside them. The time until the interface is unlocked is logged once
+ * and kept in the latency registry as the "Startup" histograms, so
+ * changes to the startup order can be measured rather than guessed.
+ * With --profile-startup every phase is also a trace span, and a
+ * report of each phase's time, page faults and disk I/O is printed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _STARTUPPROFILE_H_
+#define _STARTUPPROFILE_H_
+
+#include "tracing.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * StartupUsage - Page faults and disk I/O over some stretch of time
+ */
+struct StartupUsage {
+    int64_t minorFaults = 0;
+    int64_t majorFaults = 0;            // Faults that read from disk
+    int64_t readBytes = 0;              // Block I/O, not page-cache hits
+    int64_t writtenBytes = 0;
+
+    /**
+     * Totals of the calling thread so far, or of the whole process
+     * where per-thread usage is not available
+     */
+    static StartupUsage ofThisThread();
+
+    StartupUsage operator-(const StartupUsage& before) const;
+};
+
+/**
+ * StartupPhase - One phase of the startup
+ */
+struct StartupPhase {
+    const char *name = "";              // String literals only
+    double startMs = 0;                 // Since the clock started
+    double ms = -1;                     // -1 while still running
+    StartupUsage usage;
+    bool background = false;            // Ran beside the marked phases
+
+    bool isRunning() const { return ms < 0; }
+};
+
+/**
+ * StartupProfile - Phases of one startup
+ *
+ * The clock starts when instance() is first called, which should be
+ * the first thing main() does.
+ *
+ * Thread Safety:
+ *   mark() and finish() are for the main thread; background phases
+ *   may begin and end on any thread.
+ */
+class StartupProfile {
+public:
+    static StartupProfile& instance();
+
+    /**
+     * Record every phase as a trace span (turning tracing on) and keep
+     * what report() needs; --profile-startup
+     */
+    void enableReport();
+    bool isReporting() const { return _reporting; }
+
+    /**
+     * End the current phase; its time runs from the previous mark
+     */
+    void mark(const char *phase);
+
+    /**
+     * A phase beside the marked ones, from startMs until now; the
+     * usage is what the thread it ran on spent
+     */
+    void record(const char *phase, double startMs, const StartupUsage& usage);
+
+    /**
+     * The interface is usable: log the phases and the total once
+     */
+    void finish();
+
+    bool isFinished() const;
+
+    // In the order they were recorded
+    vector<StartupPhase> phases() const;
+
+    // Since instance() was first called
+    double elapsedMs() const;
+
+    /**
+     * A table of every phase with its time, faults and I/O
+     */
+    string report() const;
+
+private:
+    friend class ScopedStartupPhase;
+
+    StartupProfile();
+
+    // A background phase that is running; its index, or -1 once
+    // startup is over
+    int begin(const char *phase);
+    void end(int index, const StartupUsage& usage);
+
+    void trace(const StartupPhase& phase) const;
+
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last;
+    StartupUsage _lastUsage;
+    bool _reporting;
+    double _interactiveMs;              // Set by finish()
+
+    mutable std::mutex _mutex;          // Guards the two below
+    vector<StartupPhase> _phases;
+    bool _finished;
+};
+
+/**
+ * ScopedStartupPhase - Times a background phase of the startup
+ *
+ *     _pool.submit(TaskPriority::BACKGROUND, [backend]() {
+ *         ScopedStartupPhase phase("snap-probe");
+ *         return backend->isAvailable();
+ *     });
+ *
+ * Does nothing once the interface is usable.
+ */
+class ScopedStartupPhase {
+public:
+    explicit ScopedStartupPhase(const char *phase);
+    ~ScopedStartupPhase();
+
+    ScopedStartupPhase(const ScopedStartupPhase&) = delete;
+    ScopedStartupPhase& operator=(const ScopedStartupPhase&) = delete;
+
+private:
+    int _index;
+    StartupUsage _before;
+};
+
+} // namespace PolySynaptic
+
+#endif // _STARTUPPROFILE_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,346 @@
+/* storeindex.cc - Local search index of snap and flatpak store metadata
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "storeindex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+namespace PolySynaptic {
+
+namespace {
+
+const BackendType INDEXED_BACKENDS[] = {
+    BackendType::APT, BackendType::SNAP, BackendType::FLATPAK
+};
+
+string fold(const string& s)
+{
+    string out(s);
+    for (auto& c : out) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return out;
+}
+
+// The folded texts a package is searched by
+void foldTexts(const PackageInfo& pkg, string& name, string& full)
+{
+    name = fold(pkg.name + " " + pkg.id);
+    full = name + " " + fold(pkg.summary) + " " +
+           fold(pkg.keywords) + " " + fold(pkg.section);
+}
+
+bool containsAll(const string& text, const vector<string>& terms)
+{
+    for (const auto& term : terms) {
+        if (text.find(term) == string::npos) return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Persistence
+// ============================================================================
+
+bool StoreIndex::load(const string& path)
+{
+    PackageCatalog catalog;
+    if (!catalog.load(path)) {
+        return false;
+    }
+
+    map<BackendType, Section> sections;
+    for (BackendType backend : INDEXED_BACKENDS) {
+        if (!catalog.hasSection(backend)) continue;
+        Section& section = sections[backend];
+        section.generation = catalog.getGeneration(backend);
+        section.packages = catalog.getPackages(backend);
+        build(section);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _sections.swap(sections);
+    return true;
+}
+
+bool StoreIndex::loadSection(const string& path, BackendType backend,
+                             const string& generation)
+{
+    PackageCatalog catalog;
+    if (!catalog.load(path) || !catalog.hasSection(backend) ||
+        catalog.getGeneration(backend) != generation) {
+        return false;
+    }
+
+    // Build outside the lock like update()
+    Section section;
+    section.generation = generation;
+    section.packages = catalog.getPackages(backend);
+    build(section);
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _sections[backend] = std::move(section);
+    return true;
+}
+
+bool StoreIndex::save(const string& path) const
+{
+    PackageCatalog catalog;
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        for (const auto& entry : _sections) {
+            catalog.update(entry.first, entry.second.generation, entry.second.packages);
+        }
+    }
+    return catalog.save(path);
+}
+
+// ============================================================================
+// Sections
+// ============================================================================
+
+bool StoreIndex::hasSection(BackendType backend) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _sections.count(backend) > 0;
+}
+
+string StoreIndex::getGeneration(BackendType backend) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _sections.find(backend);
+    return it != _sections.end() ? it->second.generation : string();
+}
+
+size_t StoreIndex::size(BackendType backend) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _sections.find(backend);
+    return it != _sections.end() ? it->second.packages.size() : 0;
+}
+
+void StoreIndex::update(BackendType backend, const string& generation,
+                        const vector<PackageInfo>& packages)
+{
+    // Build outside the lock; searches keep using the old section
+    Section section;
+    section.generation = generation;
+    section.packages = packages;
+    build(section);
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _sections[backend] = std::move(section);
+}
+
+CatalogDelta StoreIndex::refresh(BackendType backend, const string& generation,
+                                 const vector<PackageInfo>& packages)
+{
+    // Outside the lock like update(), from a copy of what is searched now
+    Section before;
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        auto it = _sections.find(backend);
+        if (it != _sections.end()) {
+            before.packages = it->second.packages;
+            before.nameText = it->second.nameText;
+            before.fullText = it->second.fullText;
+        }
+    }
+
+    CatalogDelta delta = PackageCatalog::diff(before.packages, packages);
+    unordered_set<uint64_t> differ;
+    for (const auto* list : {&delta.added, &delta.changed}) {
+        for (const auto& pkg : *list) {
+            differ.insert(pkg.identity());
+        }
+    }
+    unordered_map<uint64_t, size_t> held;
+    held.reserve(before.packages.size());
+    for (size_t i = 0; i < before.packages.size(); i++) {
+        held.emplace(before.packages[i].identity(), i);
+    }
+
+    Section section;
+    section.generation = generation;
+    section.packages = packages;
+    section.nameText.resize(packages.size());
+    section.fullText.resize(packages.size());
+    for (size_t i = 0; i < packages.size(); i++) {
+        const PackageInfo& pkg = packages[i];
+        auto it = held.find(pkg.identity());
+        if (it != held.end() && differ.count(pkg.identity()) == 0) {
+            const PackageInfo& old = before.packages[it->second];
+            if (old.keywords == pkg.keywords && old.section == pkg.section) {
+                section.nameText[i] = before.nameText[it->second];
+                section.fullText[i] = before.fullText[it->second];
+                continue;
+            }
+            delta.changed.push_back(pkg);
+        }
+        foldTexts(pkg, section.nameText[i], section.fullText[i]);
+    }
+
+    if (delta.empty()) {
+        std::unique_lock<std::shared_mutex> lock(_mutex);
+        _sections[backend].generation = generation;
+        return delta;
+    }
+
+    index(section);
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _sections[backend] = std::move(section);
+    return delta;
+}
+
+void StoreIndex::build(Section& section)
+{
+    size_t count = section.packages.size();
+    section.nameText.resize(count);
+    section.fullText.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        foldTexts(section.packages[i], section.nameText[i], section.fullText[i]);
+    }
+    index(section);
+}
+
+void StoreIndex::index(Section& section)
+{
+    size_t count = section.packages.size();
+    section.nameIndex.clear();
+    section.fullIndex.clear();
+    section.byId.clear();
+    section.byId.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        section.nameIndex.add(i, section.nameText[i].c_str());
+        section.fullIndex.add(i, section.fullText[i].c_str());
+        section.byId.emplace(section.packages[i].id, i);
+    }
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+
+vector<PackageInfo> StoreIndex::search(BackendType backend,
+                                       const SearchOptions& options) const
+{
+    vector<PackageInfo> results;
+
+    vector<string> terms;
+    istringstream words(fold(options.query));
+    string word;
+    while (words >> word) {
+        terms.push_back(word);
+    }
+    if (terms.empty()) {
+        return results;
+    }
+    string query = fold(options.query);
+
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _sections.find(backend);
+    if (it == _sections.end()) {
+        return results;
+    }
+    const Section& section = it->second;
+
+    const bool descriptions = options.searchDescriptions;
+    const RTrigramIndex& index = descriptions ? section.fullIndex : section.nameIndex;
+    const vector<string>& texts = descriptions ? section.fullText : section.nameText;
+
+    vector<unsigned int> candidates;
+    bool all = !index.candidates(terms, candidates);
+    size_t total = all ? section.packages.size() : candidates.size();
+
+    // (rank, position) of every match; lower ranks are better
+    vector<pair<int, unsigned int>> matches;
+    for (size_t i = 0; i < total; i++) {
+        unsigned int pos = all ? i : candidates[i];
+        if (!containsAll(texts[pos], terms)) continue;
+
+        string name = fold(section.packages[pos].name);
+        string id = fold(section.packages[pos].id);
+        int rank;
+        if (name == query || id == query) {
+            rank = 0;
+        } else if (name.compare(0, query.size(), query) == 0 ||
+                   id.compare(0, query.size(), query) == 0) {
+            rank = 1;
+        } else if (containsAll(section.nameText[pos], terms)) {
+            rank = 2;
+        } else {
+            rank = 3;
+        }
+        matches.push_back({rank, pos});
+    }
+
+    sort(matches.begin(), matches.end());
+
+    size_t limit = matches.size();
+    if (options.maxResults > 0 && limit > static_cast<size_t>(options.maxResults)) {
+        limit = options.maxResults;
+    }
+    results.reserve(limit);
+    for (size_t i = 0; i < limit; i++) {
+        results.push_back(section.packages[matches[i].second]);
+    }
+
+    return results;
+}
+
+// ============================================================================
+// Lookup
+// ============================================================================
+
+void StoreIndex::forEach(BackendType backend,
+                         const function<void(const PackageInfo&)>& fn) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _sections.find(backend);
+    if (it == _sections.end()) {
+        return;
+    }
+    for (const auto& pkg : it->second.packages) {
+        fn(pkg);
+    }
+}
+
+vector<PackageInfo> StoreIndex::lookup(BackendType backend,
+                                       const vector<string>& ids) const
+{
+    vector<PackageInfo> results;
+
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _sections.find(backend);
+    if (it == _sections.end()) {
+        return results;
+    }
+    const Section& section = it->second;
+
+    results.reserve(ids.size());
+    for (const auto& id : ids) {
+        auto pos = section.byId.find(id);
+        if (pos != section.byId.end()) {
+            results.push_back(section.packages[pos->second]);
+        }
+    }
+    return results;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
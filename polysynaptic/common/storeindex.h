@@ -0,0 +1,136 @@
+/* storeindex.h - Local search index of snap and flatpak store metadata
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements a local full-text index over the packages the
+ * Snap Store and the Flatpak remotes offer, so interactive searches do
+ * not have to spawn `snap find` or `flatpak search` for every keystroke.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _STOREINDEX_H_
+#define _STOREINDEX_H_
+
+#include "ipackagebackend.h"
+#include "packagecatalog.h"
+#include "rtrigramindex.h"
+
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace PolySynaptic {
+
+/**
+ * StoreIndex - Searchable copy of every backend's store listing
+ *
+ * Each backend section holds the packages from
+ * IPackageBackend::getStoreCatalog() with the generation stamp they
+ * were fetched under. Name, id, summary, keywords and categories
+ * (PackageInfo::section) are searchable; a trigram index narrows every
+ * query down before the exact case-insensitive match.
+ *
+ * Sections are persisted through PackageCatalog, so the index is
+ * usable right after startup and only refetched when a backend's
+ * generation changes.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread; searches share a lock,
+ *   updates take it exclusively.
+ */
+class StoreIndex {
+public:
+    StoreIndex() = default;
+
+    /**
+     * Load the sections saved by save(), replacing the current ones
+     */
+    bool load(const string& path);
+
+    /**
+     * Write all sections to disk atomically
+     */
+    bool save(const string& path) const;
+
+    /**
+     * Replace one backend's section with the one saved in path, if it
+     * was saved under generation; the other sections are kept
+     */
+    bool loadSection(const string& path, BackendType backend,
+                     const string& generation);
+
+    bool hasSection(BackendType backend) const;
+    string getGeneration(BackendType backend) const;
+    size_t size(BackendType backend) const;
+
+    /**
+     * Replace a backend's section
+     */
+    void update(BackendType backend, const string& generation,
+                const vector<PackageInfo>& packages);
+
+    /**
+     * Bring a backend's section to packages under a new generation,
+     * folding the text of only the packages that were added or changed
+     * since; returns those and the ones that went away, empty when
+     * nothing but the generation moved
+     *
+     * Keywords and categories count as changes here, since they are
+     * searched.
+     */
+    CatalogDelta refresh(BackendType backend, const string& generation,
+                         const vector<PackageInfo>& packages);
+
+    /**
+     * Packages of one backend matching every term of options.query
+     *
+     * Names and ids always count; summaries, keywords and categories
+     * only with options.searchDescriptions. Exact name matches come
+     * first, then name prefixes, then other name matches, then the
+     * rest. installedOnly and availableOnly are left to the caller,
+     * since the index does not know what is installed.
+     */
+    vector<PackageInfo> search(BackendType backend,
+                               const SearchOptions& options) const;
+
+    /**
+     * Call fn on every package of a backend's section, holding the
+     * shared lock
+     */
+    void forEach(BackendType backend,
+                 const function<void(const PackageInfo&)>& fn) const;
+
+    /**
+     * The packages of a backend with these ids, in the order asked;
+     * ids the section does not hold are left out
+     */
+    vector<PackageInfo> lookup(BackendType backend,
+                               const vector<string>& ids) const;
+
+private:
+    struct Section {
+        string generation;
+        vector<PackageInfo> packages;
+        vector<string> nameText;        // Folded "name id" per package
+        vector<string> fullText;        // Folded name, id, summary, ...
+        RTrigramIndex nameIndex;
+        RTrigramIndex fullIndex;
+        unordered_map<string, unsigned int> byId;
+    };
+
+    map<BackendType, Section> _sections;
+    mutable std::shared_mutex _mutex;
+
+    static void build(Section& section);
+    static void index(Section& section);
+};
+
+} // namespace PolySynaptic
+
+#endif // _STOREINDEX_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,81 @@
+/* stringpool.cc - Process-wide string interning implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "stringpool.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+
+namespace PolySynaptic {
+
+namespace {
+
+struct Pool {
+    std::shared_mutex mutex;
+    std::unordered_set<std::string> values;     // Node based, addresses are stable
+    const std::string* empty;
+
+    Pool() {
+        empty = &*values.insert(std::string()).first;
+    }
+};
+
+Pool& pool()
+{
+    // Leaked on purpose: handles may outlive static destruction
+    static Pool* instance = new Pool();
+    return *instance;
+}
+
+} // anonymous namespace
+
+const std::string* StringPool::intern(const std::string& value)
+{
+    if (value.empty()) {
+        return empty();
+    }
+
+    Pool& p = pool();
+    {
+        std::shared_lock<std::shared_mutex> lock(p.mutex);
+        auto it = p.values.find(value);
+        if (it != p.values.end()) {
+            return &*it;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(p.mutex);
+    return &*p.values.insert(value).first;
+}
+
+const std::string* StringPool::intern(const char* value)
+{
+    if (value == nullptr || *value == '\0') {
+        return empty();
+    }
+    return intern(std::string(value));
+}
+
+const std::string* StringPool::empty()
+{
+    return pool().empty;
+}
+
+size_t StringPool::size()
+{
+    Pool& p = pool();
+    std::shared_lock<std::shared_mutex> lock(p.mutex);
+    return p.values.size();
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,106 @@
+/* stringpool.h - Process-wide string interning for PolySynaptic
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements interning for package fields that take their
+ * values from a small vocabulary (sections, architectures, remotes,
+ * channels, ...). Each distinct value is stored once and packages hold
+ * a pointer-sized handle to it.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _STRINGPOOL_H_
+#define _STRINGPOOL_H_
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace PolySynaptic {
+
+/**
+ * StringPool - Process-wide set of interned strings
+ *
+ * Interned strings are never freed, so handles stay valid for the
+ * lifetime of the process. Only intern values from bounded
+ * vocabularies.
+ *
+ * Thread Safety:
+ *   intern() may be called from any thread.
+ */
+class StringPool {
+public:
+    /**
+     * Get the pooled copy of a value, adding it if needed
+     */
+    static const std::string* intern(const std::string& value);
+    static const std::string* intern(const char* value);
+
+    /**
+     * The pooled empty string
+     */
+    static const std::string* empty();
+
+    /**
+     * Number of distinct values interned so far
+     */
+    static size_t size();
+};
+
+/**
+ * InternedString - Pointer-sized handle to a pooled string
+ *
+ * Behaves like a const std::string for reading and converts from
+ * std::string and C strings on assignment. Equal handles point to the
+ * same pooled string, so comparing two handles is a pointer compare.
+ */
+class InternedString {
+public:
+    InternedString() : _str(StringPool::empty()) {}
+    InternedString(const std::string& value) : _str(StringPool::intern(value)) {}
+    InternedString(const char* value) : _str(StringPool::intern(value)) {}
+
+    operator const std::string&() const { return *_str; }
+    const std::string& str() const { return *_str; }
+
+    const char* c_str() const { return _str->c_str(); }
+    bool empty() const { return _str->empty(); }
+    size_t size() const { return _str->size(); }
+
+    bool operator==(const InternedString& other) const { return _str == other._str; }
+    bool operator!=(const InternedString& other) const { return _str != other._str; }
+    bool operator<(const InternedString& other) const { return *_str < *other._str; }
+
+    bool operator==(const std::string& other) const { return *_str == other; }
+    bool operator!=(const std::string& other) const { return *_str != other; }
+    bool operator==(const char* other) const { return std::strcmp(_str->c_str(), other) == 0; }
+    bool operator!=(const char* other) const { return !(*this == other); }
+
+private:
+    const std::string* _str;
+};
+
+inline bool operator==(const std::string& a, const InternedString& b) { return b == a; }
+inline bool operator!=(const std::string& a, const InternedString& b) { return b != a; }
+inline bool operator==(const char* a, const InternedString& b) { return b == a; }
+inline bool operator!=(const char* a, const InternedString& b) { return b != a; }
+
+inline std::string operator+(const std::string& a, const InternedString& b) { return a + b.str(); }
+inline std::string operator+(const InternedString& a, const std::string& b) { return a.str() + b; }
+inline std::string operator+(const char* a, const InternedString& b) { return a + b.str(); }
+inline std::string operator+(const InternedString& a, const char* b) { return a.str() + b; }
+
+inline std::ostream& operator<<(std::ostream& out, const InternedString& value)
+{
+    return out << value.str();
+}
+
+} // namespace PolySynaptic
+
+#endif // _STRINGPOOL_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,1050 @@
+/* structuredlog.cc - Log queue and writer thread
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "config.h"
+#include "structuredlog.h"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstring>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace PolySynaptic {
+
+namespace {
+
+// Room for a burst of provider debug output while the writer catches up
+const size_t QUEUE_CAPACITY = 2048;
+
+// Entries handed to the sinks per call
+const size_t BATCH_SIZE = 128;
+
+// A wakeup lost to the race in writerLoop() costs at most this long
+const std::chrono::milliseconds WRITER_INTERVAL(200);
+
+// What one call site may log before it is limited; a remote-ls in
+// verbose mode stays readable, a page of its lines get through
+const double DEFAULT_RATE_PER_SECOND = 50;
+const double DEFAULT_BURST = 200;
+
+// How often the writer reports suppressed entries
+const std::chrono::seconds SUMMARY_INTERVAL(1);
+
+// A key not seen this long is forgotten
+const std::chrono::seconds KEY_IDLE(60);
+
+// Read and gzipped per FileSink::maintain() call
+const size_t COMPRESS_SLICE = 1 << 20;
+
+// Where a FileSink line has its timestamp: {"timestamp":"2024-...
+const size_t STAMP_OFFSET = 14;
+const size_t STAMP_SECONDS = 19;
+
+std::string isoSeconds(time_t time)
+{
+    struct tm utc;
+    gmtime_r(&time, &utc);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+    return stamp;
+}
+
+// The time of a FileSink line, 0 if it has none
+time_t lineTime(const std::string& line)
+{
+    if (line.size() < STAMP_OFFSET + STAMP_SECONDS ||
+        line.compare(0, STAMP_OFFSET, "{\"timestamp\":\"") != 0) {
+        return 0;
+    }
+    struct tm utc;
+    memset(&utc, 0, sizeof(utc));
+    if (!strptime(line.c_str() + STAMP_OFFSET, "%Y-%m-%dT%H:%M:%S", &utc)) {
+        return 0;
+    }
+    return timegm(&utc);
+}
+
+// Every line of a segment or live file, compressed or not
+template <class Fn>
+void forEachLine(const std::string& path, bool compressed, Fn fn)
+{
+    std::string line;
+    if (compressed) {
+#ifdef HAVE_ZLIB
+        gzFile in = gzopen(path.c_str(), "rb");
+        if (!in) {
+            return;
+        }
+        char buf[64 * 1024];
+        while (gzgets(in, buf, sizeof(buf))) {
+            line += buf;
+            if (!line.empty() && line.back() == '\n') {
+                line.pop_back();
+                fn(line);
+                line.clear();
+            }
+        }
+        gzclose(in);
+#endif
+    } else {
+        std::ifstream in(path.c_str());
+        while (std::getline(in, line)) {
+            fn(line);
+        }
+        return;
+    }
+    if (!line.empty()) {
+        fn(line);
+    }
+}
+
+// 12304 as "12,304"
+std::string withSeparators(uint64_t n)
+{
+    std::string digits = std::to_string(n);
+    std::string out;
+    for (size_t i = 0; i < digits.size(); i++) {
+        if (i > 0 && (digits.size() - i) % 3 == 0) {
+            out += ',';
+        }
+        out += digits[i];
+    }
+    return out;
+}
+
+// Cheap enough to call for every DEBUG entry; quality hardly matters
+double nextSample()
+{
+    static std::atomic<uint64_t> seeds(0x9e3779b97f4a7c15ULL);
+    thread_local uint64_t state =
+        seeds.fetch_add(0x9e3779b97f4a7c15ULL, std::memory_order_relaxed) ^
+        static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return ((state * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // anonymous namespace
+
+// ============================================================================
+// Log Queue
+// ============================================================================
+
+LogQueue::LogQueue(size_t capacity)
+    : _tail(0), _head(0)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _mask = size - 1;
+
+    _slots.reset(new Slot[size]);
+    for (size_t i = 0; i < size; i++) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool LogQueue::push(LogEntry& entry)
+{
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = _slots[pos & _mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.entry = std::move(entry);
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // Still holds the entry from one lap ago
+            return false;
+        } else {
+            pos = _tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool LogQueue::pop(LogEntry& entry)
+{
+    Slot& slot = _slots[_head & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+        return false;
+    }
+    entry = std::move(slot.entry);
+    slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+    _head++;
+    return true;
+}
+
+// ============================================================================
+// Memory Sink
+// ============================================================================
+
+MemorySink::MemorySink(size_t maxEntries)
+    : _slots(std::max<size_t>(maxEntries, 1))
+{
+}
+
+void MemorySink::write(const LogEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    appendLocked(entry);
+}
+
+void MemorySink::writeBatch(const std::vector<LogEntry>& entries)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& entry : entries) {
+        appendLocked(entry);
+    }
+}
+
+void MemorySink::appendLocked(const LogEntry& entry)
+{
+    if (_size == _slots.size()) {
+        evictOldestLocked();
+    }
+
+    // Assigning into the slot reuses the buffers of the entry it held
+    uint64_t seq = _written++;
+    _slots[seq % _slots.size()] = entry;
+    _size++;
+
+    _byLevel[std::min(static_cast<int>(entry.level), LEVEL_COUNT - 1)].push_back(seq);
+    if (!entry.provider.empty()) {
+        _byProvider[entry.provider].push_back(seq);
+    }
+}
+
+// The oldest entry is at the front of its index lists
+void MemorySink::evictOldestLocked()
+{
+    const LogEntry& entry = _slots[oldestLocked() % _slots.size()];
+
+    _byLevel[std::min(static_cast<int>(entry.level), LEVEL_COUNT - 1)].pop_front();
+    if (!entry.provider.empty()) {
+        auto it = _byProvider.find(entry.provider);
+        it->second.pop_front();
+        if (it->second.empty()) {
+            _byProvider.erase(it);
+        }
+    }
+    _size--;
+}
+
+bool MemorySink::matches(const LogEntry& entry, const Query& query) const
+{
+    if (entry.level < query.minLevel) return false;
+    if (!query.provider.empty() && entry.provider != query.provider) return false;
+    if (!query.operation.empty() && entry.operation != query.operation) return false;
+    return true;
+}
+
+size_t MemorySink::read(Cursor& cursor, const Visitor& visit, size_t limit) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Query& query = cursor.query;
+    uint64_t from = std::max(cursor.next, oldestLocked());
+    size_t visited = 0;
+
+    // False once the read has to stop
+    auto step = [&](uint64_t seq) {
+        cursor.next = seq + 1;
+        const LogEntry& entry = _slots[seq % _slots.size()];
+        if (!matches(entry, query)) return true;
+        visited++;
+        return visit(seq, entry) && (limit == 0 || visited < limit);
+    };
+    auto start = [from](const std::deque<uint64_t>& seqs) {
+        return std::lower_bound(seqs.begin(), seqs.end(), from);
+    };
+
+    if (!query.provider.empty()) {
+        // One provider's entries, whatever else the query asks
+        auto it = _byProvider.find(query.provider);
+        if (it != _byProvider.end()) {
+            for (auto i = start(it->second); i != it->second.end(); i++) {
+                if (!step(*i)) return visited;
+            }
+        }
+    } else if (query.minLevel > LogLevel::DEBUG) {
+        // Merge the lists of the levels asked for
+        using Range = std::pair<std::deque<uint64_t>::const_iterator,
+                                std::deque<uint64_t>::const_iterator>;
+        std::vector<Range> ranges;
+        for (int level = static_cast<int>(query.minLevel); level < LEVEL_COUNT; level++) {
+            ranges.emplace_back(start(_byLevel[level]), _byLevel[level].end());
+        }
+        while (true) {
+            Range* best = nullptr;
+            for (auto& range : ranges) {
+                if (range.first != range.second &&
+                    (!best || *range.first < *best->first)) {
+                    best = &range;
+                }
+            }
+            if (!best) break;
+            if (!step(*best->first++)) return visited;
+        }
+    } else {
+        for (uint64_t seq = from; seq < _written; seq++) {
+            if (!step(seq)) return visited;
+        }
+    }
+
+    cursor.next = _written;
+    return visited;
+}
+
+size_t MemorySink::count(const Query& query) const
+{
+    if (query.operation.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!query.provider.empty() && query.minLevel == LogLevel::DEBUG) {
+            auto it = _byProvider.find(query.provider);
+            return it != _byProvider.end() ? it->second.size() : 0;
+        }
+        if (query.provider.empty()) {
+            size_t total = 0;
+            for (int level = static_cast<int>(query.minLevel); level < LEVEL_COUNT; level++) {
+                total += _byLevel[level].size();
+            }
+            return total;
+        }
+    }
+
+    Cursor cursor(query);
+    return read(cursor, [](uint64_t, const LogEntry&) { return true; });
+}
+
+std::vector<LogEntry> MemorySink::getEntries(size_t count) const
+{
+    uint64_t since = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (count > 0 && count < _size) {
+            since = _written - count;
+        }
+    }
+
+    std::vector<LogEntry> entries;
+    Cursor cursor(Query(), since);
+    read(cursor, [&entries](uint64_t, const LogEntry& entry) {
+        entries.push_back(entry);
+        return true;
+    });
+    return entries;
+}
+
+std::vector<LogEntry> MemorySink::getEntriesFiltered(
+    LogLevel minLevel, const std::string& provider,
+    const std::string& operation) const
+{
+    Query query;
+    query.minLevel = minLevel;
+    query.provider = provider;
+    query.operation = operation;
+
+    std::vector<LogEntry> entries;
+    Cursor cursor(query);
+    read(cursor, [&entries](uint64_t, const LogEntry& entry) {
+        entries.push_back(entry);
+        return true;
+    });
+    return entries;
+}
+
+std::vector<LogEntry> MemorySink::getEntriesSince(uint64_t seq, uint64_t& first) const
+{
+    std::vector<LogEntry> entries;
+    bool found = false;
+    Cursor cursor(Query(), seq);
+    read(cursor, [&](uint64_t at, const LogEntry& entry) {
+        if (!found) {
+            first = at;
+            found = true;
+        }
+        entries.push_back(entry);
+        return true;
+    });
+    if (!found) {
+        first = cursor.next;
+    }
+    return entries;
+}
+
+void MemorySink::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _size = 0;
+    for (auto& level : _byLevel) {
+        level.clear();
+    }
+    _byProvider.clear();
+}
+
+void MemorySink::setCapacity(size_t maxEntries)
+{
+    maxEntries = std::max<size_t>(maxEntries, 1);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (maxEntries == _slots.size()) {
+        return;
+    }
+    while (_size > maxEntries) {
+        evictOldestLocked();
+    }
+
+    // Entries live at their sequence number modulo the slot count
+    std::vector<LogEntry> slots(maxEntries);
+    for (uint64_t seq = oldestLocked(); seq < _written; seq++) {
+        slots[seq % maxEntries] = std::move(_slots[seq % _slots.size()]);
+    }
+    _slots.swap(slots);
+}
+
+size_t MemorySink::memoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Overwritten slots keep their buffers, so every slot counts
+    size_t bytes = _slots.capacity() * sizeof(LogEntry);
+    for (const auto& entry : _slots) {
+        bytes += heapBytes(entry.message) +
+                 heapBytes(entry.provider) + heapBytes(entry.operation) +
+                 heapBytes(entry.packageId) + heapBytes(entry.component) +
+                 heapBytes(entry.errorCode) + heapBytes(entry.rawStderr);
+        for (const auto& field : entry.fields) {
+            bytes += sizeof(field) + heapBytes(field.first) +
+                     heapBytes(field.second);
+        }
+    }
+
+    size_t indexed = 0;
+    for (const auto& level : _byLevel) {
+        indexed += level.size();
+    }
+    for (const auto& provider : _byProvider) {
+        bytes += heapBytes(provider.first) + sizeof(provider);
+        indexed += provider.second.size();
+    }
+    return bytes + indexed * sizeof(uint64_t);
+}
+
+// ============================================================================
+// File Sink
+// ============================================================================
+
+FileSink::FileSink(const std::string& path)
+    : FileSink(path, Rotation())
+{
+}
+
+FileSink::FileSink(const std::string& path, const Rotation& rotation)
+    : _path(path), _rotation(rotation)
+{
+    open();
+}
+
+FileSink::~FileSink()
+{
+    // What was renamed is whole; only its .gz is left unfinished
+    while (_compressIn) {
+        compressSlice();
+    }
+    if (_file.is_open()) {
+        _file.close();
+    }
+}
+
+void FileSink::open()
+{
+    _file.open(_path, std::ios::app);
+    _bytes = 0;
+    _first = _last = 0;
+
+    struct stat st;
+    if (stat(_path.c_str(), &st) == 0 && st.st_size > 0) {
+        _bytes = st.st_size;
+        _last = st.st_mtime;
+        std::ifstream in(_path.c_str());
+        std::string line;
+        if (std::getline(in, line)) {
+            _first = lineTime(line);
+        }
+        if (_first == 0 || _first > _last) {
+            _first = _last;
+        }
+    }
+}
+
+void FileSink::append(time_t first, time_t last)
+{
+    _file.write(_buffer.data(), _buffer.size());
+    _bytes += _buffer.size();
+    if (_first == 0 || first < _first) {
+        _first = first;
+    }
+    _last = std::max(_last, last);
+}
+
+void FileSink::write(const LogEntry& entry)
+{
+    if (!_file.is_open()) {
+        return;
+    }
+    _buffer.clear();
+    entry.appendJson(_buffer);
+    _buffer += '\n';
+    time_t time = std::chrono::system_clock::to_time_t(entry.timestamp);
+    append(time, time);
+}
+
+void FileSink::writeBatch(const std::vector<LogEntry>& entries)
+{
+    if (!_file.is_open() || entries.empty()) {
+        return;
+    }
+    _buffer.clear();
+    for (const auto& entry : entries) {
+        entry.appendJson(_buffer);
+        _buffer += '\n';
+    }
+    append(std::chrono::system_clock::to_time_t(entries.front().timestamp),
+           std::chrono::system_clock::to_time_t(entries.back().timestamp));
+}
+
+void FileSink::flush()
+{
+    if (_file.is_open()) {
+        _file.flush();
+    }
+}
+
+void FileSink::maintain()
+{
+    // One thing per call: first the segment already being compressed
+    if (_compressIn) {
+        compressSlice();
+        return;
+    }
+
+    bool full = _rotation.maxBytes > 0 && _bytes >= _rotation.maxBytes;
+    bool old = _rotation.maxAge.count() > 0 && _bytes > 0 &&
+               _last - _first >= _rotation.maxAge.count();
+    if (full || old) {
+        rotate();
+    }
+}
+
+void FileSink::rotate()
+{
+    while (_compressIn) {
+        compressSlice();
+    }
+    if (_bytes == 0) {
+        return;
+    }
+    _file.close();
+
+    // Two rotations within a second must not share a name
+    time_t last = _last;
+    std::string segment;
+    struct stat st;
+    do {
+        segment = _path + "." + std::to_string(_first) + "-" + std::to_string(last++);
+    } while (stat(segment.c_str(), &st) == 0 ||
+             stat((segment + ".gz").c_str(), &st) == 0);
+
+    bool renamed = ::rename(_path.c_str(), segment.c_str()) == 0;
+    open();
+    if (renamed && _rotation.compress) {
+        startCompression(segment);
+    }
+    prune();
+}
+
+void FileSink::startCompression(const std::string& segment)
+{
+#ifdef HAVE_ZLIB
+    _compressIn = fopen(segment.c_str(), "rb");
+    if (!_compressIn) {
+        return;
+    }
+    _compressOut = gzopen((segment + ".gz.tmp").c_str(), "wb6");
+    if (!_compressOut) {
+        fclose(_compressIn);
+        _compressIn = nullptr;
+        return;
+    }
+    _compressing = segment;
+#else
+    (void) segment;
+#endif
+}
+
+void FileSink::compressSlice()
+{
+#ifdef HAVE_ZLIB
+    gzFile out = static_cast<gzFile>(_compressOut);
+    char buf[64 * 1024];
+    size_t done = 0;
+    bool failed = false;
+    while (done < COMPRESS_SLICE) {
+        size_t n = fread(buf, 1, sizeof(buf), _compressIn);
+        if (n == 0) {
+            break;
+        }
+        if (gzwrite(out, buf, n) != static_cast<int>(n)) {
+            failed = true;
+            break;
+        }
+        done += n;
+    }
+    if (!failed && done == COMPRESS_SLICE) {
+        return;
+    }
+
+    failed = failed || ferror(_compressIn);
+    fclose(_compressIn);
+    _compressIn = nullptr;
+    failed = gzclose(out) != Z_OK || failed;
+    _compressOut = nullptr;
+
+    std::string tmp = _compressing + ".gz.tmp";
+    if (failed) {
+        // The plain segment stays, and is exported as it is
+        unlink(tmp.c_str());
+    } else if (::rename(tmp.c_str(), (_compressing + ".gz").c_str()) == 0) {
+        unlink(_compressing.c_str());
+    }
+    _compressing.clear();
+    prune();
+#endif
+}
+
+void FileSink::prune()
+{
+    std::vector<Segment> all = segments(_path);
+    uint64_t total = 0;
+    for (const auto& segment : all) {
+        total += segment.bytes;
+    }
+
+    size_t count = all.size();
+    for (const auto& segment : all) {
+        if (count <= _rotation.maxSegments &&
+            (_rotation.maxTotalBytes == 0 || total <= _rotation.maxTotalBytes)) {
+            break;
+        }
+        // Still being read for compression
+        if (segment.path == _compressing) {
+            continue;
+        }
+        if (unlink(segment.path.c_str()) == 0) {
+            count--;
+            total -= segment.bytes;
+        }
+    }
+}
+
+std::vector<FileSink::Segment> FileSink::segments(const std::string& path)
+{
+    std::vector<Segment> found;
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    std::string prefix = (slash == std::string::npos ? path : path.substr(slash + 1)) + ".";
+
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return found;
+    }
+    while (struct dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        // <first>-<last>, then .gz or nothing
+        long long first, last;
+        int used = 0;
+        if (sscanf(name.c_str() + prefix.size(), "%lld-%lld%n", &first, &last, &used) != 2) {
+            continue;
+        }
+        std::string rest = name.substr(prefix.size() + used);
+        if (!rest.empty() && rest != ".gz") {
+            continue;
+        }
+
+        Segment segment;
+        segment.path = dir + "/" + name;
+        segment.first = static_cast<time_t>(first);
+        segment.last = static_cast<time_t>(last);
+        segment.compressed = !rest.empty();
+        struct stat st;
+        if (stat(segment.path.c_str(), &st) == 0) {
+            segment.bytes = st.st_size;
+        }
+        found.push_back(segment);
+    }
+    closedir(d);
+
+    std::sort(found.begin(), found.end(), [](const Segment& a, const Segment& b) {
+        return a.first != b.first ? a.first < b.first : a.last < b.last;
+    });
+    return found;
+}
+
+long FileSink::exportRange(const std::string& path, time_t from, time_t to,
+                           const std::string& outPath)
+{
+    std::ofstream out(outPath.c_str(), std::ios::trunc);
+    if (!out) {
+        return -1;
+    }
+
+    // The stamps sort as text, so lines are compared without parsing
+    std::string low = isoSeconds(from);
+    std::string high = isoSeconds(to);
+    long count = 0;
+    auto copy = [&](const std::string& line) {
+        if (line.size() >= STAMP_OFFSET + STAMP_SECONDS &&
+            line.compare(STAMP_OFFSET, STAMP_SECONDS, low) >= 0 &&
+            line.compare(STAMP_OFFSET, STAMP_SECONDS, high) <= 0) {
+            out << line << '\n';
+            count++;
+        }
+    };
+
+    for (const auto& segment : segments(path)) {
+        if (segment.last >= from && segment.first <= to) {
+            forEachLine(segment.path, segment.compressed, copy);
+        }
+    }
+    forEachLine(path, false, copy);
+
+    out.close();
+    return out.fail() ? -1 : count;
+}
+
+// ============================================================================
+// Log Limiter
+// ============================================================================
+
+LogLimiter::LogLimiter()
+    : _perSecond(DEFAULT_RATE_PER_SECOND), _burst(DEFAULT_BURST), _suppressed(0)
+{
+    _sampleRates[0].store(1.0);
+    _sampleRates[1].store(1.0);
+}
+
+void LogLimiter::setRateLimit(double perSecond, double burst)
+{
+    _perSecond.store(perSecond > 0 ? perSecond : 0, std::memory_order_relaxed);
+    _burst.store(burst >= 1 ? burst : 1, std::memory_order_relaxed);
+}
+
+void LogLimiter::setSampleRate(LogLevel level, double rate)
+{
+    if (level <= LogLevel::INFO) {
+        _sampleRates[static_cast<int>(level)].store(
+            std::min(1.0, std::max(0.0, rate)), std::memory_order_relaxed);
+    }
+}
+
+double LogLimiter::getSampleRate(LogLevel level) const
+{
+    if (level <= LogLevel::INFO) {
+        return _sampleRates[static_cast<int>(level)].load(std::memory_order_relaxed);
+    }
+    return 1.0;
+}
+
+std::string LogLimiter::messageTemplate(const std::string& message)
+{
+    std::string text;
+    text.reserve(message.size());
+    for (size_t i = 0; i < message.size(); i++) {
+        if (isdigit(static_cast<unsigned char>(message[i]))) {
+            if (text.empty() || text.back() != '#') {
+                text += '#';
+            }
+        } else {
+            text += message[i];
+        }
+    }
+    return text;
+}
+
+uint64_t LogLimiter::keyOf(const LogEntry& entry)
+{
+    // FNV-1a of what messageTemplate() would give, without building it
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](unsigned char c) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    };
+    for (char c : entry.provider) mix(c);
+    mix(0);
+    for (char c : entry.operation) mix(c);
+    mix(0);
+    bool inNumber = false;
+    for (char c : entry.message) {
+        bool digit = isdigit(static_cast<unsigned char>(c));
+        if (!digit || !inNumber) {
+            mix(digit ? '#' : c);
+        }
+        inNumber = digit;
+    }
+    return hash;
+}
+
+bool LogLimiter::admit(LogEntry& entry, Clock::time_point now)
+{
+    if (entry.level >= LogLevel::ERROR) {
+        return true;
+    }
+
+    double rate = getSampleRate(entry.level);
+    if (rate < 1.0) {
+        if (nextSample() >= rate) {
+            return false;
+        }
+        char text[16];
+        snprintf(text, sizeof(text), "%g", rate);
+        entry.fields["sampleRate"] = text;
+    }
+
+    double perSecond = _perSecond.load(std::memory_order_relaxed);
+    if (perSecond <= 0) {
+        return true;
+    }
+    double burst = _burst.load(std::memory_order_relaxed);
+
+    uint64_t key = keyOf(entry);
+    Shard& shard = _shards[key % SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.keys.find(key);
+    if (it == shard.keys.end()) {
+        KeyState fresh;
+        fresh.tokens = burst;
+        fresh.refilled = now;
+        fresh.level = entry.level;
+        fresh.provider = entry.provider;
+        fresh.operation = entry.operation;
+        fresh.text = messageTemplate(entry.message);
+        it = shard.keys.emplace(key, std::move(fresh)).first;
+    }
+
+    KeyState& state = it->second;
+    state.lastSeen = now;
+    double elapsed = std::chrono::duration<double>(now - state.refilled).count();
+    state.tokens = std::min(burst, state.tokens + elapsed * perSecond);
+    state.refilled = now;
+    if (state.tokens >= 1) {
+        state.tokens -= 1;
+        return true;
+    }
+    state.suppressed++;
+    _suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::vector<LogEntry> LogLimiter::summarize(Clock::time_point now)
+{
+    std::vector<LogEntry> notes;
+    for (Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.keys.begin(); it != shard.keys.end();) {
+            KeyState& state = it->second;
+            if (state.suppressed > 0) {
+                LogEntry note;
+                note.level = state.level;
+                note.component = "Logger";
+                note.provider = state.provider;
+                note.operation = state.operation;
+                note.message = "Suppressed " + withSeparators(state.suppressed) +
+                               (state.suppressed == 1 ? " similar message"
+                                                      : " similar messages");
+                note.fields["suppressed"] = std::to_string(state.suppressed);
+                note.fields["template"] = state.text;
+                notes.push_back(std::move(note));
+                state.suppressed = 0;
+                ++it;
+            } else if (now - state.lastSeen > KEY_IDLE) {
+                it = shard.keys.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return notes;
+}
+
+void LogLimiter::clear()
+{
+    for (Shard& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.keys.clear();
+    }
+}
+
+// ============================================================================
+// Logger
+// ============================================================================
+
+Logger::Logger()
+    : _minLevel(LogLevel::INFO), _queue(QUEUE_CAPACITY), _dropped(0),
+      _reportedDropped(0), _sleeping(false), _stopping(false)
+{
+    // Default sinks
+    _memorySink = std::make_shared<MemorySink>(1000);
+    _sinks.push_back(_memorySink);
+    std::weak_ptr<MemorySink> sink = _memorySink;
+    _memorySinkAccount.assign("log buffer",
+        [sink](MemoryUsage& usage) {
+            if (auto s = sink.lock()) {
+                usage.bytes = s->memoryBytes();
+                usage.items = s->size();
+            }
+        });
+    _sinks.push_back(std::make_shared<ConsoleSink>());
+    _batch.reserve(BATCH_SIZE + 1);
+
+    _writer = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _stopping = true;
+    }
+    _wakeup.notify_one();
+    _writer.join();
+
+    // Whatever came in while the writer was stopping
+    flush();
+}
+
+void Logger::addSink(std::shared_ptr<LogSink> sink)
+{
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _sinks.push_back(std::move(sink));
+}
+
+void Logger::enqueue(LogEntry& entry)
+{
+    if (!_limiter.admit(entry)) {
+        return;
+    }
+
+    if (!_queue.push(entry)) {
+        if (entry.level != LogLevel::FATAL) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // The last words before an abort are worth waiting for
+        flush();
+        if (!_queue.push(entry)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (entry.level == LogLevel::FATAL) {
+        flush();
+    } else if (_sleeping.exchange(false)) {
+        _wakeup.notify_one();
+    }
+}
+
+void Logger::flush()
+{
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    drainLocked();
+    for (auto& sink : _sinks) {
+        sink->flush();
+    }
+}
+
+void Logger::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(_wakeMutex);
+    while (!_stopping) {
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> write(_writeMutex);
+            drainLocked();
+            for (auto& sink : _sinks) {
+                sink->maintain();
+            }
+        }
+        lock.lock();
+
+        // A producer that pushed between the drain and this store sent
+        // no wakeup, and one clearing the flag without the lock can
+        // still slip past the wait; the timeout covers both
+        _sleeping = true;
+        _wakeup.wait_for(lock, WRITER_INTERVAL,
+                         [this] { return _stopping || !_sleeping; });
+        _sleeping = false;
+    }
+}
+
+void Logger::drainLocked()
+{
+    LogEntry entry;
+    for (;;) {
+        _batch.clear();
+        while (_batch.size() < BATCH_SIZE && _queue.pop(entry)) {
+            _batch.push_back(std::move(entry));
+        }
+
+        uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped != _reportedDropped) {
+            LogEntry note;
+            note.level = LogLevel::WARN;
+            note.component = "Logger";
+            note.message = "Log queue full, dropped " +
+                           std::to_string(dropped - _reportedDropped) + " entries";
+            note.fields["dropped"] = std::to_string(dropped);
+            _batch.push_back(std::move(note));
+            _reportedDropped = dropped;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - _lastSummary >= SUMMARY_INTERVAL) {
+            for (auto& note : _limiter.summarize(now)) {
+                _batch.push_back(std::move(note));
+            }
+            _lastSummary = now;
+        }
+
+        if (_batch.empty()) {
+            return;
+        }
+        for (auto& sink : _sinks) {
+            sink->writeBatch(_batch);
+        }
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -9,6 +9,8 @@
  *   - Contextual fields (provider, operation, package)
  *   - Duration tracking
  *   - Debug panel integration
+ *   - Callers only queue entries; a writer thread formats and writes them
+ *   - Per call site rate limits and DEBUG sampling, with summaries
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -19,18 +21,28 @@
 #ifndef _STRUCTUREDLOG_H_
 #define _STRUCTUREDLOG_H_
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
 #include <chrono>
 #include <mutex>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
 #include <functional>
 #include <memory>
 #include <iomanip>
 #include <ctime>
 #include <deque>
+#include <unordered_map>
+
+#include "memoryusage.h"
 
 namespace PolySynaptic {
 
@@ -61,8 +73,78 @@ inline const char* logLevelToString(LogLevel level) {
 // Log Entry
 // ============================================================================
 
+/**
+ * Append s to out as the inside of a JSON string
+ */
+inline void appendJsonEscaped(std::string& out, const std::string& s) {
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                // Bytes of UTF-8 sequences pass through unchanged
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x",
+                             static_cast<unsigned char>(c));
+                    out += code;
+                } else {
+                    out += c;
+                }
+        }
+    }
+}
+
+/**
+ * LogFields - Extra key/value pairs of an entry, in insertion order
+ *
+ * Entries carry a handful of fields at most, so they sit in one flat
+ * array, allocated on the first field, instead of a node per field.
+ */
+class LogFields {
+public:
+    using value_type = std::pair<std::string, std::string>;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    std::string& operator[](const std::string& key) {
+        for (auto& item : _items) {
+            if (item.first == key) return item.second;
+        }
+        _items.emplace_back(key, std::string());
+        return _items.back().second;
+    }
+
+    const_iterator find(const std::string& key) const {
+        for (auto it = _items.begin(); it != _items.end(); ++it) {
+            if (it->first == key) return it;
+        }
+        return _items.end();
+    }
+
+    size_t count(const std::string& key) const {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    const_iterator begin() const { return _items.begin(); }
+    const_iterator end() const { return _items.end(); }
+    size_t size() const { return _items.size(); }
+    bool empty() const { return _items.empty(); }
+
+private:
+    std::vector<value_type> _items;
+};
+
 /**
  * LogEntry - Single log entry with structured fields
+ *
+ * Nothing is formatted until a sink asks for text, which happens on
+ * the Logger's writer thread; filtered entries are never built at all
+ * when they go through the LOG macros.
  */
 struct LogEntry {
     // Timestamp
@@ -89,7 +171,7 @@ struct LogEntry {
     std::chrono::milliseconds duration{0};
 
     // Arbitrary key-value data
-    std::map<std::string, std::string> fields;
+    LogFields fields;
 
     // Default constructor
     LogEntry()
@@ -99,48 +181,65 @@ struct LogEntry {
 
     // Convert to JSON string
     std::string toJson() const {
-        std::ostringstream json;
-        json << "{";
+        std::string json;
+        json.reserve(160 + message.size());
+        appendJson(json);
+        return json;
+    }
 
+    // Append the JSON object to out, without a trailing newline
+    void appendJson(std::string& out) const {
         // Timestamp
         auto time = std::chrono::system_clock::to_time_t(timestamp);
         auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
             timestamp.time_since_epoch()) % 1000;
-        json << "\"timestamp\":\"";
-        json << std::put_time(std::gmtime(&time), "%Y-%m-%dT%H:%M:%S");
-        json << "." << std::setfill('0') << std::setw(3) << ms.count() << "Z\"";
+        struct tm utc;
+        gmtime_r(&time, &utc);
+        char stamp[32];
+        size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        snprintf(stamp + len, sizeof(stamp) - len, ".%03dZ",
+                 static_cast<int>(ms.count()));
 
-        // Level
-        json << ",\"level\":\"" << logLevelToString(level) << "\"";
+        out += "{\"timestamp\":\"";
+        out += stamp;
+        out += "\",\"level\":\"";
+        out += logLevelToString(level);
+        out += '"';
 
-        // Message
-        json << ",\"message\":\"" << escapeJson(message) << "\"";
+        appendJsonField(out, "message", message);
 
         // Optional fields
         if (!provider.empty())
-            json << ",\"provider\":\"" << escapeJson(provider) << "\"";
+            appendJsonField(out, "provider", provider);
         if (!operation.empty())
-            json << ",\"operation\":\"" << escapeJson(operation) << "\"";
+            appendJsonField(out, "operation", operation);
         if (!packageId.empty())
-            json << ",\"packageId\":\"" << escapeJson(packageId) << "\"";
+            appendJsonField(out, "packageId", packageId);
         if (!component.empty())
-            json << ",\"component\":\"" << escapeJson(component) << "\"";
+            appendJsonField(out, "component", component);
         if (!errorCode.empty())
-            json << ",\"errorCode\":\"" << escapeJson(errorCode) << "\"";
+            appendJsonField(out, "errorCode", errorCode);
         if (!rawStderr.empty())
-            json << ",\"stderr\":\"" << escapeJson(rawStderr) << "\"";
-        if (exitCode != 0)
-            json << ",\"exitCode\":" << exitCode;
-        if (duration.count() > 0)
-            json << ",\"durationMs\":" << duration.count();
+            appendJsonField(out, "stderr", rawStderr);
+        if (exitCode != 0) {
+            out += ",\"exitCode\":";
+            out += std::to_string(exitCode);
+        }
+        if (duration.count() > 0) {
+            out += ",\"durationMs\":";
+            out += std::to_string(duration.count());
+        }
 
         // Custom fields
         for (const auto& [key, value] : fields) {
-            json << ",\"" << escapeJson(key) << "\":\"" << escapeJson(value) << "\"";
+            out += ",\"";
+            appendJsonEscaped(out, key);
+            out += "\":\"";
+            appendJsonEscaped(out, value);
+            out += '"';
         }
 
-        json << "}";
-        return json.str();
+        out += '}';
     }
 
     // Human-readable format for UI
@@ -174,27 +273,13 @@ struct LogEntry {
     }
 
 private:
-    static std::string escapeJson(const std::string& s) {
-        std::ostringstream escaped;
-        for (char c : s) {
-            switch (c) {
-                case '"':  escaped << "\\\""; break;
-                case '\\': escaped << "\\\\"; break;
-                case '\b': escaped << "\\b"; break;
-                case '\f': escaped << "\\f"; break;
-                case '\n': escaped << "\\n"; break;
-                case '\r': escaped << "\\r"; break;
-                case '\t': escaped << "\\t"; break;
-                default:
-                    if (c < 0x20) {
-                        escaped << "\\u" << std::hex << std::setfill('0')
-                                << std::setw(4) << static_cast<int>(c);
-                    } else {
-                        escaped << c;
-                    }
-            }
-        }
-        return escaped.str();
+    static void appendJsonField(std::string& out, const char* key,
+                                const std::string& value) {
+        out += ",\"";
+        out += key;
+        out += "\":\"";
+        appendJsonEscaped(out, value);
+        out += '"';
     }
 };
 
@@ -210,38 +295,113 @@ public:
     virtual ~LogSink() = default;
     virtual void write(const LogEntry& entry) = 0;
     virtual void flush() {}
+
+    /**
+     * Write a run of entries, oldest first
+     *
+     * The Logger's writer thread hands entries over in batches; sinks
+     * that lock or do I/O per entry override this to do it once.
+     */
+    virtual void writeBatch(const std::vector<LogEntry>& entries) {
+        for (const auto& entry : entries) {
+            write(entry);
+        }
+    }
+
+    /**
+     * Housekeeping too slow for write(), such as rotating a file
+     *
+     * Only the writer thread calls it, between batches and never from
+     * Logger::flush(); each call should do a bounded amount of work.
+     */
+    virtual void maintain() {}
 };
 
 /**
- * FileSink - Write logs to a file
+ * FileSink - Write logs to a file as JSON lines, rotating it
+ *
+ * Once the live file holds Rotation::maxBytes or its entries span
+ * maxAge, it is renamed to a segment named after the time range of
+ * its entries, path.<first>-<last> in seconds since the epoch, and
+ * gzipped a slice per maintain() call, so the writer is never held up
+ * for long. The oldest segments go beyond maxSegments or
+ * maxTotalBytes. exportRange() reads only the segments whose range
+ * overlaps the one asked for.
+ *
+ * Thread Safety:
+ *   Like every sink, only called by one thread at a time; the static
+ *   methods may run alongside it.
  */
 class FileSink : public LogSink {
 public:
-    explicit FileSink(const std::string& path) : _path(path) {
-        _file.open(path, std::ios::app);
-    }
-
-    ~FileSink() override {
-        if (_file.is_open()) {
-            _file.close();
-        }
-    }
-
-    void write(const LogEntry& entry) override {
-        if (_file.is_open()) {
-            _file << entry.toJson() << "\n";
-        }
-    }
-
-    void flush() override {
-        if (_file.is_open()) {
-            _file.flush();
-        }
-    }
+    struct Rotation {
+        uint64_t maxBytes = 16 << 20;               // 0 for no limit
+        std::chrono::seconds maxAge{24 * 3600};    // 0 for no limit
+        size_t maxSegments = 8;
+        uint64_t maxTotalBytes = 64 << 20;          // The segments together
+        bool compress = true;                       // Where zlib is built in
+    };
+
+    struct Segment {
+        std::string path;
+        time_t first = 0;                           // Of its entries
+        time_t last = 0;
+        uint64_t bytes = 0;
+        bool compressed = false;
+    };
+
+    explicit FileSink(const std::string& path);
+    FileSink(const std::string& path, const Rotation& rotation);
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void write(const LogEntry& entry) override;
+    void writeBatch(const std::vector<LogEntry>& entries) override;
+    void flush() override;
+    void maintain() override;
+
+    /**
+     * Start a new live file now, compressing the old one to the end
+     */
+    void rotate();
+
+    const std::string& getPath() const { return _path; }
+
+    /**
+     * The rotated segments of the log at path, oldest first
+     */
+    static std::vector<Segment> segments(const std::string& path);
+
+    /**
+     * Copy the entries of the log at path logged from..to, inclusive,
+     * to outPath as JSON lines, oldest segment first
+     *
+     * @return Number of entries written, -1 if outPath cannot be
+     */
+    static long exportRange(const std::string& path, time_t from, time_t to,
+                            const std::string& outPath);
 
 private:
+    void open();
+    void append(time_t first, time_t last);
+    void startCompression(const std::string& segment);
+    void compressSlice();
+    void prune();
+
     std::string _path;
+    Rotation _rotation;
     std::ofstream _file;
+    std::string _buffer;            // Reused for the formatted lines
+    uint64_t _bytes = 0;            // In the live file
+    time_t _first = 0;              // Range of the live file's entries
+    time_t _last = 0;
+
+    // The segment being compressed, a slice at a time
+    std::string _compressing;
+    FILE *_compressIn = nullptr;
+    void *_compressOut = nullptr;   // gzFile
 };
 
 /**
@@ -256,68 +416,283 @@ public:
 
 /**
  * MemorySink - Keep logs in memory for debug panel
+ *
+ * A ring of slots allocated up front; once it is full every write
+ * overwrites the oldest entry in place. Every entry ever written has a
+ * sequence number, counting from 0, and entry seq lives in slot
+ * seq % capacity.
+ *
+ * Next to the ring, the sequence numbers of the held entries are kept
+ * per level and per provider, so a filtered read only visits the
+ * entries of the levels or the provider asked for. Reads go through a
+ * Cursor and hand out references to the slots, under the sink's lock;
+ * nothing is copied unless the caller copies it.
  */
 class MemorySink : public LogSink {
 public:
-    explicit MemorySink(size_t maxEntries = 1000) : _maxEntries(maxEntries) {}
-
-    void write(const LogEntry& entry) override {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _entries.push_back(entry);
-        while (_entries.size() > _maxEntries) {
-            _entries.pop_front();
-        }
-    }
-
-    std::vector<LogEntry> getEntries(size_t count = 0) const {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (count == 0 || count >= _entries.size()) {
-            return std::vector<LogEntry>(_entries.begin(), _entries.end());
-        }
-        auto start = _entries.end() - count;
-        return std::vector<LogEntry>(start, _entries.end());
-    }
+    /**
+     * Which entries a cursor visits
+     */
+    struct Query {
+        LogLevel minLevel = LogLevel::DEBUG;
+        std::string provider;       // Empty for all
+        std::string operation;      // Empty for all
+    };
+
+    /**
+     * Position of a reader in the ring
+     *
+     * A cursor starts at the oldest entry (or at the sequence number it
+     * is given) and is advanced by read(). Entries overwritten before
+     * the cursor reaches them are skipped.
+     */
+    struct Cursor {
+        Query query;
+        uint64_t next = 0;          // Sequence number to look at next
+
+        Cursor() = default;
+        explicit Cursor(const Query& q, uint64_t since = 0)
+            : query(q), next(since) {}
+    };
+
+    // Called with each matching entry; false stops the read
+    using Visitor = std::function<bool(uint64_t seq, const LogEntry& entry)>;
+
+    explicit MemorySink(size_t maxEntries = 1000);
+
+    void write(const LogEntry& entry) override;
+    void writeBatch(const std::vector<LogEntry>& entries) override;
+
+    /**
+     * Visit the matching entries after the cursor, oldest first
+     *
+     * The visitor runs with the sink locked, so it must not log.
+     *
+     * @param limit At most this many entries, 0 for all
+     * @return      Entries visited
+     */
+    size_t read(Cursor& cursor, const Visitor& visit, size_t limit = 0) const;
+
+    /**
+     * Number of held entries matching a query, without visiting them
+     * when the indexes alone answer it
+     */
+    size_t count(const Query& query) const;
+
+    std::vector<LogEntry> getEntries(size_t count = 0) const;
 
     std::vector<LogEntry> getEntriesFiltered(
         LogLevel minLevel = LogLevel::DEBUG,
         const std::string& provider = "",
-        const std::string& operation = "") const
-    {
+        const std::string& operation = "") const;
+
+    /**
+     * Entries written since a sequence number, for readers that follow
+     * the ring
+     *
+     * @param seq   First sequence number wanted
+     * @param first Set to the sequence number of the first entry returned
+     * @return      The entries, oldest first; the next call passes
+     *              first + size()
+     */
+    std::vector<LogEntry> getEntriesSince(uint64_t seq, uint64_t& first) const;
+
+    /**
+     * Sequence number the next entry will get
+     */
+    uint64_t written() const {
         std::lock_guard<std::mutex> lock(_mutex);
-        std::vector<LogEntry> filtered;
-        for (const auto& entry : _entries) {
-            if (entry.level < minLevel) continue;
-            if (!provider.empty() && entry.provider != provider) continue;
-            if (!operation.empty() && entry.operation != operation) continue;
-            filtered.push_back(entry);
-        }
-        return filtered;
+        return _written;
     }
 
-    void clear() {
+    void clear();
+
+    size_t size() const {
         std::lock_guard<std::mutex> lock(_mutex);
-        _entries.clear();
+        return _size;
     }
 
-    size_t size() const {
+    size_t capacity() const {
         std::lock_guard<std::mutex> lock(_mutex);
-        return _entries.size();
+        return _slots.size();
     }
 
+    /**
+     * Keep at most maxEntries, dropping the oldest; the slots are
+     * reallocated, so shrinking frees the buffers of the dropped ones
+     */
+    void setCapacity(size_t maxEntries);
+
+    /**
+     * Bytes held by the slots, their strings and the indexes
+     */
+    size_t memoryBytes() const;
+
 private:
-    size_t _maxEntries;
-    std::deque<LogEntry> _entries;
+    static const int LEVEL_COUNT = 5;
+
+    std::vector<LogEntry> _slots;
+    size_t _size = 0;               // Held entries, the newest _size
+    uint64_t _written = 0;
+
+    // Sequence numbers of the held entries, ascending
+    std::deque<uint64_t> _byLevel[LEVEL_COUNT];
+    std::map<std::string, std::deque<uint64_t>> _byProvider;
+
     mutable std::mutex _mutex;
+
+    void appendLocked(const LogEntry& entry);
+    void evictOldestLocked();
+    uint64_t oldestLocked() const { return _written - _size; }
+    bool matches(const LogEntry& entry, const Query& query) const;
 };
 
 // ============================================================================
 // Logger
 // ============================================================================
 
+/**
+ * LogQueue - Bounded ring of entries, many producers, one consumer
+ *
+ * push() claims a slot with a single compare-and-swap and never waits
+ * or allocates; when the ring is full it fails and the entry stays
+ * with the caller. pop() must only run on one thread at a time.
+ */
+class LogQueue {
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+     */
+    explicit LogQueue(size_t capacity);
+
+    LogQueue(const LogQueue&) = delete;
+    LogQueue& operator=(const LogQueue&) = delete;
+
+    /**
+     * Move entry into the ring; false (entry untouched) if it is full
+     */
+    bool push(LogEntry& entry);
+
+    /**
+     * Move the oldest entry out; false if there is none
+     */
+    bool pop(LogEntry& entry);
+
+    size_t capacity() const { return _mask + 1; }
+
+private:
+    struct Slot {
+        // pos when free for the push at pos, pos + 1 once it is filled
+        std::atomic<size_t> sequence;
+        LogEntry entry;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _tail;  // Next slot to claim
+    alignas(64) size_t _head;               // Next slot to read
+};
+
+// ============================================================================
+// Rate Limiting
+// ============================================================================
+
+/**
+ * LogLimiter - Keeps one chatty call site from flooding the sinks
+ *
+ * Entries are keyed by provider, operation and message template, the
+ * message with its numbers left out, so "Parsed line 12" and "Parsed
+ * line 13" share a key. Each key may log a burst, then so many per
+ * second; the rest are counted, and summarize() turns the counts into
+ * "Suppressed 12,304 similar messages" entries. DEBUG and INFO can
+ * also be sampled, keeping each entry with the given probability and
+ * marking it with a sampleRate field. ERROR and FATAL always pass.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class LogLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    LogLimiter();
+
+    /**
+     * Let each key log burst entries, then perSecond; 0 for no limit
+     */
+    void setRateLimit(double perSecond, double burst);
+    double getRateLimit() const { return _perSecond.load(std::memory_order_relaxed); }
+
+    /**
+     * Keep DEBUG or INFO entries with probability rate; 1 keeps all
+     */
+    void setSampleRate(LogLevel level, double rate);
+    double getSampleRate(LogLevel level) const;
+
+    /**
+     * Whether entry is to be logged; may add its sampleRate field
+     */
+    bool admit(LogEntry& entry, Clock::time_point now = Clock::now());
+
+    /**
+     * An entry per key that had some suppressed since the last call;
+     * keys quiet for a minute are forgotten
+     */
+    std::vector<LogEntry> summarize(Clock::time_point now = Clock::now());
+
+    // Entries held back by the rate limit since startup
+    uint64_t getSuppressedCount() const {
+        return _suppressed.load(std::memory_order_relaxed);
+    }
+
+    void clear();
+
+    // The message with each run of digits as "#"
+    static std::string messageTemplate(const std::string& message);
+
+private:
+    struct KeyState {
+        double tokens = 0;
+        Clock::time_point refilled;
+        Clock::time_point lastSeen;
+        uint64_t suppressed = 0;
+        LogLevel level = LogLevel::DEBUG;
+        std::string provider;
+        std::string operation;
+        std::string text;               // messageTemplate()
+    };
+
+    // Keys are hashed apart so logging threads rarely share a lock
+    static const size_t SHARDS = 8;
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, KeyState> keys;
+    };
+
+    static uint64_t keyOf(const LogEntry& entry);
+
+    Shard _shards[SHARDS];
+    std::atomic<double> _perSecond;
+    std::atomic<double> _burst;
+    std::atomic<double> _sampleRates[2];    // DEBUG, INFO
+    std::atomic<uint64_t> _suppressed;
+};
+
 /**
  * Logger - Main logging class
  *
- * Thread-safe singleton with multiple sinks.
+ * Singleton with multiple sinks. log() only queues the entry; a
+ * writer thread formats and writes queued entries in batches, so a
+ * slow sink never holds up the thread that logs. When the queue is
+ * full entries are dropped rather than waited for; the number lost is
+ * reported by getDroppedCount() and in a WARN entry from the writer.
+ * Entries get past getLimiter() first, and its summaries are written
+ * by the writer once a second.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. Sinks are only called
+ *   from one thread at a time, either the writer or one calling
+ *   flush().
  */
 class Logger {
 public:
@@ -327,28 +702,31 @@ public:
     }
 
     // Add a sink
-    void addSink(std::shared_ptr<LogSink> sink) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _sinks.push_back(std::move(sink));
-    }
+    void addSink(std::shared_ptr<LogSink> sink);
 
     // Set minimum log level
     void setMinLevel(LogLevel level) {
-        _minLevel = level;
+        _minLevel.store(level, std::memory_order_relaxed);
     }
 
     LogLevel getMinLevel() const {
-        return _minLevel;
+        return _minLevel.load(std::memory_order_relaxed);
+    }
+
+    bool isEnabled(LogLevel level) const {
+        return level >= getMinLevel();
     }
 
     // Log an entry
     void log(const LogEntry& entry) {
-        if (entry.level < _minLevel) return;
+        if (!isEnabled(entry.level)) return;
+        LogEntry copy(entry);
+        enqueue(copy);
+    }
 
-        std::lock_guard<std::mutex> lock(_mutex);
-        for (auto& sink : _sinks) {
-            sink->write(entry);
-        }
+    void log(LogEntry&& entry) {
+        if (!isEnabled(entry.level)) return;
+        enqueue(entry);
     }
 
     // Convenience methods
@@ -359,40 +737,65 @@ public:
     void fatal(const std::string& msg) { log(LogLevel::FATAL, msg); }
 
     void log(LogLevel level, const std::string& msg) {
+        if (!isEnabled(level)) return;
         LogEntry entry;
         entry.level = level;
         entry.message = msg;
-        log(entry);
+        enqueue(entry);
     }
 
-    // Flush all sinks
-    void flush() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        for (auto& sink : _sinks) {
-            sink->flush();
-        }
+    /**
+     * Write everything queued so far and flush all sinks
+     *
+     * Blocks until done; readers of a MemorySink call this first to
+     * see their own entries.
+     */
+    void flush();
+
+    // Entries lost to a full queue since startup
+    uint64_t getDroppedCount() const {
+        return _dropped.load(std::memory_order_relaxed);
     }
 
+    // Rate limits and sampling of what is logged
+    LogLimiter& getLimiter() { return _limiter; }
+
     // Get memory sink for debug panel
     std::shared_ptr<MemorySink> getMemorySink() {
         return _memorySink;
     }
 
 private:
-    Logger() : _minLevel(LogLevel::INFO) {
-        // Default sinks
-        _memorySink = std::make_shared<MemorySink>(1000);
-        _sinks.push_back(_memorySink);
-        _sinks.push_back(std::make_shared<ConsoleSink>());
-    }
+    Logger();
+    ~Logger();
 
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
-    std::mutex _mutex;
+    void enqueue(LogEntry& entry);
+    void writerLoop();
+    void drainLocked();
+
+    std::atomic<LogLevel> _minLevel;
+    LogLimiter _limiter;
+    LogQueue _queue;
+    std::atomic<uint64_t> _dropped;
+
+    // Held by whoever drains the queue into the sinks
+    std::mutex _writeMutex;
     std::vector<std::shared_ptr<LogSink>> _sinks;
     std::shared_ptr<MemorySink> _memorySink;
-    LogLevel _minLevel;
+    MemoryAccount _memorySinkAccount;
+    std::vector<LogEntry> _batch;
+    uint64_t _reportedDropped;
+    std::chrono::steady_clock::time_point _lastSummary;
+
+    // Waking the writer
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeup;
+    std::atomic<bool> _sleeping;
+    bool _stopping;
+    std::thread _writer;
 };
 
 // ============================================================================
@@ -401,6 +804,10 @@ private:
 
 /**
  * LogBuilder - Fluent interface for building log entries
+ *
+ * Use it through LOG(level), which skips the whole chain, arguments
+ * included, when the level is filtered out. The setters take their
+ * strings by value so temporaries are moved, not copied.
  */
 class LogBuilder {
 public:
@@ -408,38 +815,38 @@ public:
         _entry.level = level;
     }
 
-    LogBuilder& message(const std::string& msg) {
-        _entry.message = msg;
+    LogBuilder& message(std::string msg) {
+        _entry.message = std::move(msg);
         return *this;
     }
 
-    LogBuilder& provider(const std::string& p) {
-        _entry.provider = p;
+    LogBuilder& provider(std::string p) {
+        _entry.provider = std::move(p);
         return *this;
     }
 
-    LogBuilder& operation(const std::string& op) {
-        _entry.operation = op;
+    LogBuilder& operation(std::string op) {
+        _entry.operation = std::move(op);
         return *this;
     }
 
-    LogBuilder& package(const std::string& pkg) {
-        _entry.packageId = pkg;
+    LogBuilder& package(std::string pkg) {
+        _entry.packageId = std::move(pkg);
         return *this;
     }
 
-    LogBuilder& component(const std::string& comp) {
-        _entry.component = comp;
+    LogBuilder& component(std::string comp) {
+        _entry.component = std::move(comp);
         return *this;
     }
 
-    LogBuilder& errorCode(const std::string& code) {
-        _entry.errorCode = code;
+    LogBuilder& errorCode(std::string code) {
+        _entry.errorCode = std::move(code);
         return *this;
     }
 
-    LogBuilder& stderr(const std::string& err) {
-        _entry.rawStderr = err;
+    LogBuilder& stderr(std::string err) {
+        _entry.rawStderr = std::move(err);
         return *this;
     }
 
@@ -453,13 +860,13 @@ public:
         return *this;
     }
 
-    LogBuilder& field(const std::string& key, const std::string& value) {
-        _entry.fields[key] = value;
+    LogBuilder& field(const std::string& key, std::string value) {
+        _entry.fields[key] = std::move(value);
         return *this;
     }
 
     void emit() {
-        Logger::instance().log(_entry);
+        Logger::instance().log(std::move(_entry));
     }
 
     LogEntry build() const {
@@ -491,6 +898,8 @@ public:
     {}
 
     ~ScopedLogTimer() {
+        if (!Logger::instance().isEnabled(_level)) return;
+
         auto end = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - _start);
 
@@ -525,13 +934,22 @@ private:
 // Convenience Macros
 // ============================================================================
 
-#define LOG_DEBUG(msg) PolySynaptic::Logger::instance().debug(msg)
-#define LOG_INFO(msg)  PolySynaptic::Logger::instance().info(msg)
-#define LOG_WARN(msg)  PolySynaptic::Logger::instance().warn(msg)
-#define LOG_ERROR(msg) PolySynaptic::Logger::instance().error(msg)
-#define LOG_FATAL(msg) PolySynaptic::Logger::instance().fatal(msg)
+// msg, and everything chained after LOG(level) up to emit(), is only
+// evaluated when the level is enabled
+
+#define LOG_AT(level, msg) \
+    (PolySynaptic::Logger::instance().isEnabled(level) \
+         ? PolySynaptic::Logger::instance().log(level, msg) : (void)0)
+
+#define LOG_DEBUG(msg) LOG_AT(PolySynaptic::LogLevel::DEBUG, msg)
+#define LOG_INFO(msg)  LOG_AT(PolySynaptic::LogLevel::INFO, msg)
+#define LOG_WARN(msg)  LOG_AT(PolySynaptic::LogLevel::WARN, msg)
+#define LOG_ERROR(msg) LOG_AT(PolySynaptic::LogLevel::ERROR, msg)
+#define LOG_FATAL(msg) LOG_AT(PolySynaptic::LogLevel::FATAL, msg)
 
-#define LOG(level) PolySynaptic::LogBuilder(level)
+#define LOG(level) \
+    !PolySynaptic::Logger::instance().isEnabled(level) ? (void)0 : \
+        PolySynaptic::LogBuilder(level)
 
 } // namespace PolySynaptic
 
@@ -0,0 +1,481 @@
+/* subprocess.cc - Running the snap and flatpak command line tools
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "subprocess.h"
+#include "metrics.h"
+#include "processgovernor.h"
+#include "structuredlog.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace PolySynaptic {
+
+namespace {
+
+// Bytes asked of each read(); pipes hold 64 KiB by default
+const size_t READ_CHUNK = 64 * 1024;
+
+// How often a cancellation callback is asked
+const int CANCEL_CHECK_MS = 100;
+
+// Without a pidfd, how often to look for the exit once the pipes closed
+const int REAP_CHECK_MS = 10;
+
+// Without a pidfd, how long to trust the pipes to report the exit
+const int PIPE_WAIT_MS = 1000;
+
+// Between SIGTERM and SIGKILL for a child we gave up on
+const int KILL_GRACE_MS = 5000;
+
+// How often a preempted command is started again before it is let finish
+const int MAX_PREEMPTIONS = 3;
+
+double toMs(const struct timeval& tv)
+{
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// -1 where the kernel or libc does not have pidfds
+int openPidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/**
+ * One output pipe of the child
+ */
+struct Stream {
+    int fd = -1;
+    string *out = nullptr;
+    uint64_t *bytes = nullptr;
+    const Subprocess::OutputCallback *callback = nullptr;
+    bool keep = true;
+
+    // Read what is there; false once the pipe is at end of file
+    bool drain(vector<char>& buffer, size_t maxOutput, bool& truncated) {
+        for (;;) {
+            ssize_t n = read(fd, buffer.data(), buffer.size());
+            if (n > 0) {
+                *bytes += n;
+                if (callback && *callback) {
+                    (*callback)(buffer.data(), n);
+                }
+                if (keep && maxOutput == 0) {
+                    out->append(buffer.data(), n);
+                } else if (keep) {
+                    size_t room = out->size() < maxOutput ? maxOutput - out->size() : 0;
+                    out->append(buffer.data(), std::min(room, static_cast<size_t>(n)));
+                    truncated = truncated || static_cast<size_t>(n) > room;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: drained for now; 0 or another error: finished
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+int exitCodeOf(int status)
+{
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return -1;
+}
+
+} // anonymous namespace
+
+void ProcessUsage::setRusage(const struct rusage& usage)
+{
+    userMs = toMs(usage.ru_utime);
+    systemMs = toMs(usage.ru_stime);
+    maxRssKb = usage.ru_maxrss;
+}
+
+void ProcessUsage::report(ScopedSpan& span, const char *backend,
+                          const vector<string>& args, int exitCode) const
+{
+    span.setCounter("wallUs", static_cast<int64_t>(wallMs * 1000));
+    span.setCounter("userUs", static_cast<int64_t>(userMs * 1000));
+    span.setCounter("sysUs", static_cast<int64_t>(systemMs * 1000));
+    span.setCounter("maxRssKb", maxRssKb);
+    span.setCounter("stdoutBytes", static_cast<int64_t>(stdoutBytes));
+    span.setCounter("stderrBytes", static_cast<int64_t>(stderrBytes));
+
+    LOG(LogLevel::DEBUG)
+        .provider(backend)
+        .operation(args.size() > 1 ? args[1] : args[0])
+        .component("Subprocess")
+        .exitCode(exitCode)
+        .duration(std::chrono::milliseconds(static_cast<long>(wallMs)))
+        .field("userMs", std::to_string(static_cast<long>(userMs)))
+        .field("sysMs", std::to_string(static_cast<long>(systemMs)))
+        .field("maxRssKb", std::to_string(maxRssKb))
+        .field("stdoutBytes", std::to_string(stdoutBytes))
+        .field("stderrBytes", std::to_string(stderrBytes))
+        .message("Command finished")
+        .emit();
+}
+
+// ============================================================================
+// Running
+// ============================================================================
+
+Subprocess::Result Subprocess::run(const vector<string>& args, const Options& options)
+{
+    if (options.lowPriority) {
+        static const string nicePath = findProgram("nice");
+        static const string ionicePath = findProgram("ionice");
+        vector<string> niced;
+        if (!nicePath.empty()) {
+            niced.insert(niced.end(), {nicePath, "-n", "19"});
+        }
+        if (!ionicePath.empty()) {
+            niced.insert(niced.end(), {ionicePath, "-c", "3"});
+        }
+        niced.insert(niced.end(), args.begin(), args.end());
+
+        Options plain = options;
+        plain.lowPriority = false;
+        return run(niced, plain);
+    }
+
+    if (!options.pool) {
+        return spawn(args, options);
+    }
+
+    // Output passed on already cannot be taken back for a second run
+    bool preemptible = options.preemptible && !options.onStdout;
+    ProcessPriority priority = ProcessGovernor::currentPriority();
+    const function<bool()>& cancelled = options.cancelled;
+
+    for (int attempt = 0; ; attempt++) {
+        ProcessGovernor::Slot slot(options.pool, priority,
+                                   preemptible && attempt < MAX_PREEMPTIONS, cancelled);
+        if (!slot.acquired()) {
+            Result result;
+            result.cancelled = true;
+            result.error = "Command cancelled";
+            return result;
+        }
+        if (!slot.preemptible()) {
+            return spawn(args, options);
+        }
+
+        Options governed = options;
+        governed.cancelled = [&slot, &cancelled]() {
+            return slot.preempted() || (cancelled && cancelled());
+        };
+        Result result = spawn(args, governed);
+        if (!result.cancelled || !slot.preempted() || (cancelled && cancelled())) {
+            return result;
+        }
+        // Stopped for an interactive command; wait for a slot again
+    }
+}
+
+Subprocess::Result Subprocess::spawn(const vector<string>& args, const Options& options)
+{
+    Result result;
+    if (args.empty()) {
+        result.error = "No command specified";
+        return result;
+    }
+
+    string tool = args[0].substr(args[0].rfind('/') + 1);
+    MetricsRegistry::instance()
+        .counter("polysynaptic_subprocesses", "Subprocesses started, by tool",
+                 {{"tool", tool}})
+        .inc();
+
+    // Close-on-exec, so children forked by other threads at the same
+    // time cannot hold our pipes open
+    int stdoutPipe[2];
+    int stderrPipe[2];
+    if (pipe2(stdoutPipe, O_CLOEXEC) != 0) {
+        result.error = "Failed to create stdout pipe";
+        return result;
+    }
+    if (pipe2(stderrPipe, O_CLOEXEC) != 0) {
+        result.error = "Failed to create stderr pipe";
+        close(stdoutPipe[0]);
+        close(stdoutPipe[1]);
+        return result;
+    }
+
+    vector<char*> cargs;
+    for (const auto& arg : args) {
+        cargs.push_back(const_cast<char*>(arg.c_str()));
+    }
+    cargs.push_back(nullptr);
+
+    // posix_spawn rather than fork: glibc starts the child with vfork
+    // semantics, so the page tables of the apt cache, the Xapian
+    // database and the GTK heap are not copied for every command
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdoutPipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stderrPipe[1], STDERR_FILENO);
+
+    // The GUI ignores SIGPIPE; the tools should not inherit that
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    auto startTime = std::chrono::steady_clock::now();
+    pid_t pid;
+    int spawnError = posix_spawnp(&pid, cargs[0], &actions, &attr, cargs.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    close(stdoutPipe[1]);
+    close(stderrPipe[1]);
+    if (spawnError != 0) {
+        result.error = "Failed to execute " + args[0] + ": " + strerror(spawnError);
+        close(stdoutPipe[0]);
+        close(stderrPipe[0]);
+        return result;
+    }
+    result.started = true;
+
+    Stream streams[2];
+    streams[0].fd = stdoutPipe[0];
+    streams[0].out = &result.stdout;
+    streams[0].bytes = &result.usage.stdoutBytes;
+    streams[0].callback = &options.onStdout;
+    streams[0].keep = options.keepStdout;
+    streams[1].fd = stderrPipe[0];
+    streams[1].out = &result.stderr;
+    streams[1].bytes = &result.usage.stderrBytes;
+    for (auto& stream : streams) {
+        fcntl(stream.fd, F_SETFL, O_NONBLOCK);
+    }
+    if (options.keepStdout) {
+        result.stdout.reserve(READ_CHUNK);
+    }
+    vector<char> buffer(READ_CHUNK);
+
+    int pidfd = openPidfd(pid);
+    auto deadline = startTime + std::chrono::seconds(
+        options.timeoutSeconds > 0 ? options.timeoutSeconds : 60);
+
+    struct rusage usage = {};
+    int status = 0;
+    bool reaped = false;
+
+    auto tryReap = [&](int flags) {
+        pid_t w;
+        do {
+            w = wait4(pid, &status, flags, &usage);
+        } while (w < 0 && errno == EINTR);
+        reaped = w == pid;
+        return reaped;
+    };
+
+    while (!reaped) {
+        if (options.cancelled && options.cancelled()) {
+            result.cancelled = true;
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            result.timedOut = true;
+            break;
+        }
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - now).count() + 1;
+        int timeout = static_cast<int>(std::min(remaining, static_cast<long>(INT_MAX)));
+        if (options.cancelled) {
+            timeout = std::min(timeout, CANCEL_CHECK_MS);
+        }
+
+        pollfd fds[3];
+        int count = 0;
+        int pidIndex = -1;
+        for (auto& stream : streams) {
+            if (stream.fd >= 0) {
+                fds[count].fd = stream.fd;
+                fds[count].events = POLLIN;
+                fds[count].revents = 0;
+                count++;
+            }
+        }
+        if (pidfd >= 0) {
+            pidIndex = count;
+            fds[count].fd = pidfd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            count++;
+        } else if (count == 0) {
+            // Both pipes are closed, only the exit is left to see
+            timeout = std::min(timeout, REAP_CHECK_MS);
+        } else {
+            // A grandchild holding the pipes would hide the exit
+            timeout = std::min(timeout, PIPE_WAIT_MS);
+        }
+
+        int ret = poll(fds, count, timeout);
+        if (ret < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (auto& stream : streams) {
+            if (stream.fd >= 0 && !stream.drain(buffer, options.maxOutput, result.truncated)) {
+                stream.close();
+            }
+        }
+
+        bool exited = pidIndex >= 0 ? (ret > 0 && fds[pidIndex].revents != 0)
+                                    : count == 0 || ret == 0;
+        if (exited && tryReap(WNOHANG)) {
+            // A grandchild may still hold the pipes; take what is left
+            // and do not wait for it
+            for (auto& stream : streams) {
+                if (stream.fd >= 0) {
+                    stream.drain(buffer, options.maxOutput, result.truncated);
+                }
+            }
+        }
+    }
+
+    if (!reaped) {
+        kill(pid, SIGTERM);
+        auto killDeadline = std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(KILL_GRACE_MS);
+        while (!tryReap(WNOHANG) && std::chrono::steady_clock::now() < killDeadline) {
+            if (pidfd >= 0) {
+                pollfd fd = { pidfd, POLLIN, 0 };
+                poll(&fd, 1, REAP_CHECK_MS * 10);
+            } else {
+                usleep(REAP_CHECK_MS * 1000);
+            }
+        }
+        if (!reaped) {
+            kill(pid, SIGKILL);
+            tryReap(0);
+        }
+    }
+
+    for (auto& stream : streams) {
+        stream.close();
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+
+    result.exitCode = (result.timedOut || result.cancelled) ? -1 : exitCodeOf(status);
+    result.usage.wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - startTime).count();
+    result.usage.setRusage(usage);
+    return result;
+}
+
+string Subprocess::findProgram(const string& name)
+{
+    auto isExecutable = [](const string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+               access(path.c_str(), X_OK) == 0;
+    };
+
+    if (name.empty()) {
+        return "";
+    }
+    if (name.find('/') != string::npos) {
+        return isExecutable(name) ? name : "";
+    }
+
+    const char *path = getenv("PATH");
+    string dirs = path != nullptr ? path : "/usr/local/bin:/usr/bin:/bin";
+    size_t start = 0;
+    for (;;) {
+        size_t colon = dirs.find(':', start);
+        string dir = dirs.substr(start, colon == string::npos ? string::npos : colon - start);
+        string candidate = (dir.empty() ? "." : dir) + "/" + name;
+        if (isExecutable(candidate)) {
+            return candidate;
+        }
+        if (colon == string::npos) {
+            return "";
+        }
+        start = colon + 1;
+    }
+}
+
+// ============================================================================
+// Line Splitting
+// ============================================================================
+
+void LineSplitter::feed(const char *data, size_t size)
+{
+    const char *end = data + size;
+    while (data < end) {
+        const char *newline = static_cast<const char *>(memchr(data, '\n', end - data));
+        if (newline == nullptr) {
+            _line.append(data, end);
+            return;
+        }
+        _line.append(data, newline);
+        _onLine(_line);
+        _line.clear();
+        data = newline + 1;
+    }
+}
+
+void LineSplitter::finish()
+{
+    if (!_line.empty()) {
+        _onLine(_line);
+        _line.clear();
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
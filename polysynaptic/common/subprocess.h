@@ -0,0 +1,139 @@
+/* subprocess.h - Running the snap and flatpak command line tools
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the child process runner the CLI backends
+ * share. It sleeps until a pipe has data or the child exits, reads in
+ * large chunks, and measures what each child used, so a slow call can
+ * be put down to the tool itself, to waiting on it, or to parsing its
+ * output.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SUBPROCESS_H_
+#define _SUBPROCESS_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct rusage;
+
+using namespace std;
+
+namespace PolySynaptic {
+
+class ScopedSpan;
+
+/**
+ * ProcessUsage - What one child process cost
+ */
+struct ProcessUsage {
+    double wallMs = 0;          // Fork to reap
+    double userMs = 0;          // CPU time of the child itself
+    double systemMs = 0;
+    long maxRssKb = 0;          // Peak resident set
+    uint64_t stdoutBytes = 0;   // Read from the pipes, truncated or not
+    uint64_t stderrBytes = 0;
+
+    /**
+     * Take the CPU times and peak RSS from wait4()'s rusage
+     */
+    void setRusage(const struct rusage& usage);
+
+    /**
+     * Attach to the command's trace span and log it at DEBUG level
+     */
+    void report(ScopedSpan& span, const char *backend,
+                const vector<string>& args, int exitCode) const;
+};
+
+/**
+ * Subprocess - Run a command, collecting its output
+ *
+ * The pipes and, where the kernel has pidfds, the child itself are
+ * watched with poll(), so output is picked up as it arrives and the
+ * call returns as soon as the child has exited and the pipes are
+ * drained. Only a cancellation callback makes it wake up on its own,
+ * to ask the callback.
+ *
+ * The command is started with posix_spawn, never through a shell;
+ * a program that cannot be executed is reported in Result::error.
+ */
+class Subprocess {
+public:
+    using OutputCallback = std::function<void(const char *data, size_t size)>;
+
+    struct Options {
+        int timeoutSeconds = 60;
+        std::function<bool()> cancelled;
+        OutputCallback onStdout;        // Each chunk of stdout as it is read
+        bool keepStdout = true;         // Also collect stdout in the Result
+        size_t maxOutput = 0;           // Per stream, 0 for no limit
+        const char *pool = nullptr;     // ProcessGovernor pool to wait for a slot in
+        bool preemptible = false;       // A background run may be stopped and redone
+        bool lowPriority = false;       // Run under nice and idle-class ionice
+    };
+
+    struct Result {
+        bool started = false;           // Spawned; else error says why
+        bool timedOut = false;
+        bool cancelled = false;
+        bool truncated = false;         // maxOutput was hit
+        int exitCode = -1;              // 128 + signal if killed
+        string stdout;
+        string stderr;
+        string error;                   // Why it did not start
+        ProcessUsage usage;
+    };
+
+    /**
+     * With a pool, waits for a slot of the ProcessGovernor at the
+     * thread's priority first. With lowPriority the command is started
+     * through nice and ionice, where installed, so whatever it runs in
+     * turn - setuid helpers included - inherits the priority. A preemptible background run stopped
+     * for an interactive one is started again, unless its output was
+     * already streamed to onStdout; that run is not preemptible.
+     */
+    static Result run(const vector<string>& args, const Options& options);
+
+    /**
+     * Full path of an executable as execvp would find it, "" if none;
+     * looks through PATH without starting `which`
+     */
+    static string findProgram(const string& name);
+
+private:
+    static Result spawn(const vector<string>& args, const Options& options);
+};
+
+/**
+ * LineSplitter - Cuts output arriving in chunks into complete lines
+ *
+ * Each line is passed on without its newline as soon as the newline
+ * arrives; finish() passes on a last line that had none.
+ */
+class LineSplitter {
+public:
+    using LineCallback = std::function<void(const string& line)>;
+
+    explicit LineSplitter(LineCallback onLine) : _onLine(std::move(onLine)) {}
+
+    void feed(const char *data, size_t size);
+    void finish();
+
+private:
+    LineCallback _onLine;
+    string _line;           // Reused; holds the incomplete tail between chunks
+};
+
+} // namespace PolySynaptic
+
+#endif // _SUBPROCESS_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,185 @@
+/* taskgraph.cc - Dependency-ordered refresh steps on two kinds of thread
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "taskgraph.h"
+#include "structuredlog.h"
+#include "tracing.h"
+
+#include <chrono>
+#include <exception>
+#include <string>
+
+namespace PolySynaptic {
+
+struct TaskGraph::State {
+    TaskPool& pool;
+    Dispatcher toMain;
+    TaskPriority priority;
+
+    mutable std::mutex mutex;           // Guards the steps once started
+    std::vector<Step> steps;
+    size_t remaining = 0;
+    bool started = false;
+    std::function<void()> finished;
+    std::chrono::steady_clock::time_point startTime;
+    uint64_t parentSpan = 0;            // What start() had open
+
+    State(TaskPool& p, Dispatcher d, TaskPriority prio)
+        : pool(p), toMain(std::move(d)), priority(prio) {}
+};
+
+TaskGraph::TaskGraph(TaskPool& pool, Dispatcher toMain, TaskPriority priority)
+    : _state(std::make_shared<State>(pool, std::move(toMain), priority))
+{
+}
+
+int TaskGraph::add(const char *name, Affinity where, std::function<void()> fn,
+                   const std::vector<int>& after)
+{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    int id = static_cast<int>(_state->steps.size());
+
+    Step step;
+    step.name = name;
+    step.where = where;
+    step.fn = std::move(fn);
+    for (int dep : after) {
+        // Only earlier steps, which keeps the graph free of cycles
+        if (dep < 0 || dep >= id) {
+            continue;
+        }
+        _state->steps[dep].dependents.push_back(id);
+        step.waitingFor++;
+    }
+    _state->steps.push_back(std::move(step));
+    return id;
+}
+
+void TaskGraph::setFinished(std::function<void()> fn)
+{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    _state->finished = std::move(fn);
+}
+
+void TaskGraph::start()
+{
+    std::vector<int> ready;
+    std::function<void()> finished;
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        if (_state->started) {
+            return;
+        }
+        _state->started = true;
+        _state->startTime = std::chrono::steady_clock::now();
+        _state->parentSpan = Tracer::currentSpan();
+        _state->remaining = _state->steps.size();
+        for (size_t i = 0; i < _state->steps.size(); i++) {
+            if (_state->steps[i].waitingFor == 0) {
+                ready.push_back(static_cast<int>(i));
+            }
+        }
+        if (_state->remaining == 0) {
+            finished = std::move(_state->finished);
+        }
+    }
+
+    for (int step : ready) {
+        schedule(_state, step);
+    }
+    if (finished) {
+        finished();
+    }
+}
+
+bool TaskGraph::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->started && _state->remaining == 0;
+}
+
+double TaskGraph::doneAtMs(int step) const
+{
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    if (step < 0 || step >= static_cast<int>(_state->steps.size())) {
+        return -1;
+    }
+    return _state->steps[step].doneAtMs;
+}
+
+void TaskGraph::schedule(const std::shared_ptr<State>& state, int step)
+{
+    if (state->steps[step].where == MAIN) {
+        state->toMain([state, step]() { run(state, step); });
+        return;
+    }
+    state->pool.submit(state->priority, [state, step]() {
+        run(state, step);
+        return true;
+    });
+}
+
+void TaskGraph::run(const std::shared_ptr<State>& state, int step)
+{
+    std::function<void()> fn;
+    const char *name;
+    Affinity where;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        fn = std::move(state->steps[step].fn);
+        name = state->steps[step].name;
+        where = state->steps[step].where;
+    }
+
+    {
+        ScopedSpan span(name, "refresh", state->parentSpan);
+        try {
+            if (fn) {
+                fn();
+            }
+        } catch (const std::exception& e) {
+            LOG_WARN(std::string("Refresh step ") + name + " failed: " + e.what());
+        } catch (...) {
+            LOG_WARN(std::string("Refresh step ") + name + " failed");
+        }
+    }
+
+    std::vector<int> ready;
+    std::function<void()> finished;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        Step& done = state->steps[step];
+        done.doneAtMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - state->startTime).count();
+        for (int next : done.dependents) {
+            if (--state->steps[next].waitingFor == 0) {
+                ready.push_back(next);
+            }
+        }
+        if (--state->remaining == 0) {
+            finished = std::move(state->finished);
+        }
+    }
+
+    for (int next : ready) {
+        schedule(state, next);
+    }
+    if (finished) {
+        if (where == MAIN) {
+            finished();
+        } else {
+            state->toMain(finished);
+        }
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,115 @@
+/* taskgraph.h - Dependency-ordered refresh steps on two kinds of thread
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the executor the main window finishes a commit
+ * with. Reopening the APT cache, reading the marks back, restoring the
+ * views, the Xapian update and the Snap and Flatpak revalidation used
+ * to run one after the other; most of them only need one or two of
+ * the others to be done. Each step names the steps it waits for and
+ * whether it must run on the main thread; the others run on a pool,
+ * so `snap list` and `flatpak list` go on while the cache is reopened.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _TASKGRAPH_H_
+#define _TASKGRAPH_H_
+
+#include "asyncbackend.h"
+#include "taskpool.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace PolySynaptic {
+
+/**
+ * TaskGraph - Runs steps once the steps they depend on are done
+ *
+ *     TaskGraph graph(pool, RGMainLoopDispatcher());
+ *     int reopen = graph.add("reopen", TaskGraph::MAIN, reopenCache);
+ *     int snaps = graph.add("snaps", TaskGraph::POOL, revalidateSnaps);
+ *     graph.add("views", TaskGraph::MAIN, restoreViews, {reopen});
+ *     graph.add("unified", TaskGraph::MAIN, reloadUnified, {reopen, snaps});
+ *     graph.start();
+ *
+ * Steps may only depend on steps added before them, so a graph cannot
+ * have cycles. A step that throws is logged and counts as done; the
+ * steps after it still run. The graph keeps itself alive until its
+ * last step is done, so the TaskGraph object may go away after start().
+ *
+ * Thread Safety:
+ *   add() and start() are for the thread that built the graph; the
+ *   steps run on the main thread through the dispatcher, or on the
+ *   pool. POOL steps must not wait on other tasks of the same pool.
+ */
+class TaskGraph {
+public:
+    enum Affinity {
+        MAIN,           // Through the dispatcher (GTK, the package lister)
+        POOL            // On a pool worker
+    };
+
+    /**
+     * @param toMain Runs MAIN steps, and setFinished(), on the main
+     *               thread; RGMainLoopDispatcher() in the GTK UI
+     */
+    TaskGraph(TaskPool& pool, Dispatcher toMain,
+              TaskPriority priority = TaskPriority::NORMAL);
+
+    /**
+     * Add a step
+     *
+     * @param name String literal, for the trace and the log
+     * @param after Steps that must be done before this one starts
+     * @return The step's id, for the after lists of later steps
+     */
+    int add(const char *name, Affinity where, std::function<void()> fn,
+            const std::vector<int>& after = {});
+
+    /**
+     * Called on the main thread once every step is done
+     */
+    void setFinished(std::function<void()> fn);
+
+    /**
+     * Start every step that waits for nothing; only once
+     */
+    void start();
+
+    bool isFinished() const;
+
+    /**
+     * Milliseconds from start() until the step was done, -1 while not;
+     * for the log and the tests
+     */
+    double doneAtMs(int step) const;
+
+private:
+    struct Step {
+        const char *name;
+        Affinity where;
+        std::function<void()> fn;
+        std::vector<int> dependents;
+        int waitingFor = 0;             // Steps left before this one starts
+        double doneAtMs = -1;
+    };
+
+    struct State;
+    std::shared_ptr<State> _state;
+
+    static void schedule(const std::shared_ptr<State>& state, int step);
+    static void run(const std::shared_ptr<State>& state, int step);
+};
+
+} // namespace PolySynaptic
+
+#endif // _TASKGRAPH_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,112 @@
+/* taskpool.cc - Bounded worker pool implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "taskpool.h"
+#include "processgovernor.h"
+
+#include <algorithm>
+
+namespace PolySynaptic {
+
+TaskPool::TaskPool(unsigned workers)
+    : _stopping(false)
+{
+    if (workers == 0) {
+        // One worker per backend plus one spare is plenty; the work is
+        // mostly waiting on subprocesses and sockets
+        workers = std::min(std::max(std::thread::hardware_concurrency(), 2u), 4u);
+    }
+
+    for (unsigned i = 0; i < workers; i++) {
+        _workers.emplace_back(&TaskPool::workerLoop, this);
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+
+    // Resolve whatever never got a worker so no caller waits forever
+    for (auto& queue : _queues) {
+        for (auto& task : queue) {
+            task.run(true);
+        }
+        queue.clear();
+    }
+}
+
+size_t TaskPool::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (const auto& queue : _queues) {
+        count += queue.size();
+    }
+    return count;
+}
+
+void TaskPool::enqueue(TaskPriority priority, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopping) {
+            task.run(true);
+            return;
+        }
+        task.priority = priority;
+        _queues[static_cast<int>(priority)].push_back(std::move(task));
+    }
+    _wakeup.notify_one();
+}
+
+void TaskPool::workerLoop()
+{
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait(lock, [this]() {
+                return _stopping || !_queues[0].empty() ||
+                       !_queues[1].empty() || !_queues[2].empty();
+            });
+
+            if (_stopping) {
+                return;
+            }
+
+            for (auto& queue : _queues) {
+                if (!queue.empty()) {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                    break;
+                }
+            }
+        }
+
+        // The commands the task starts wait for their slot at its
+        // priority; a foreground load has the user waiting as well
+        ProcessGovernor::PriorityScope scope(
+            task.priority == TaskPriority::BACKGROUND ? ProcessPriority::BACKGROUND
+                                                      : ProcessPriority::INTERACTIVE);
+        task.run(task.token.isCancelled());
+    }
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,168 @@
+/* taskpool.h - Bounded worker pool for PolySynaptic backend fan-out
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements a small fixed-size thread pool with task
+ * priorities and cooperative cancellation. BackendManager owns one and
+ * routes every per-backend query through it, so the number of threads
+ * stays constant no matter how often the UI asks.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _TASKPOOL_H_
+#define _TASKPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace PolySynaptic {
+
+// ============================================================================
+// Priorities and Cancellation
+// ============================================================================
+
+/**
+ * TaskPriority - Scheduling class of a pool task
+ *
+ * Queued tasks of a higher class always start before lower ones.
+ * Running tasks are never preempted.
+ */
+enum class TaskPriority {
+    INTERACTIVE = 0,    // The user is waiting (search as you type)
+    NORMAL = 1,         // Foreground loads (installed/upgradable lists)
+    BACKGROUND = 2      // Cache refresh, revalidation
+};
+
+/**
+ * CancellationToken - Shared flag for cooperative cancellation
+ *
+ * Tasks still queued when their token is cancelled are not run at all
+ * and yield a default constructed result. Running tasks observe the
+ * token through isCancelled(), usually via a ProgressCallback that
+ * returns false once cancelled.
+ */
+class CancellationToken {
+public:
+    CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { _cancelled->store(true); }
+    bool isCancelled() const { return _cancelled->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+};
+
+// ============================================================================
+// Task Pool
+// ============================================================================
+
+/**
+ * TaskPool - Fixed number of workers draining a priority queue
+ *
+ * Thread Safety:
+ *   submit() may be called from any thread. Tasks must
+ *   not block waiting on other tasks of the same pool.
+ */
+class TaskPool {
+public:
+    /**
+     * @param workers Number of worker threads (0 = pick from hardware)
+     */
+    explicit TaskPool(unsigned workers = 0);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * Queue a task
+     *
+     * @return Future for the task result. If the token was cancelled
+     *         before the task started, the result is default constructed.
+     */
+    template <typename F>
+    auto submit(TaskPriority priority, const CancellationToken& token, F&& fn)
+        -> std::future<typename std::result_of<F()>::type>;
+
+    /**
+     * Queue a task that cannot be cancelled
+     */
+    template <typename F>
+    auto submit(TaskPriority priority, F&& fn)
+        -> std::future<typename std::result_of<F()>::type> {
+        return submit(priority, CancellationToken(), std::forward<F>(fn));
+    }
+
+    unsigned getWorkerCount() const { return _workers.size(); }
+
+    /**
+     * Number of tasks queued but not yet started
+     */
+    size_t getPendingCount() const;
+
+private:
+    struct Task {
+        CancellationToken token;
+        std::function<void(bool cancelled)> run;
+        TaskPriority priority = TaskPriority::NORMAL;
+    };
+
+    std::vector<std::thread> _workers;
+    std::deque<Task> _queues[3];        // Indexed by TaskPriority
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+
+    void enqueue(TaskPriority priority, Task task);
+    void workerLoop();
+};
+
+// ============================================================================
+// Template Implementation
+// ============================================================================
+
+template <typename F>
+auto TaskPool::submit(TaskPriority priority, const CancellationToken& token, F&& fn)
+    -> std::future<typename std::result_of<F()>::type>
+{
+    using R = typename std::result_of<F()>::type;
+
+    auto promise = std::make_shared<std::promise<R>>();
+    auto future = promise->get_future();
+    auto body = std::make_shared<typename std::decay<F>::type>(std::forward<F>(fn));
+
+    Task task;
+    task.token = token;
+    task.run = [promise, body](bool cancelled) {
+        try {
+            if (cancelled) {
+                promise->set_value(R());
+            } else {
+                promise->set_value((*body)());
+            }
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    };
+
+    enqueue(priority, std::move(task));
+    return future;
+}
+
+} // namespace PolySynaptic
+
+#endif // _TASKPOOL_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,218 @@
+/* tracing.cc - Nested timing spans for backend operations
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "tracing.h"
+#include "structuredlog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+namespace PolySynaptic {
+
+namespace {
+
+// A few minutes of busy searching; older spans are dropped first
+const size_t MAX_SPANS = 100000;
+
+thread_local uint64_t t_currentSpan = 0;
+
+// The thread watchThisThread() was called on, and its innermost span
+thread_local bool t_watched = false;
+std::atomic<const char *> g_watchedSpan(nullptr);
+
+} // anonymous namespace
+
+// ============================================================================
+// Tracer
+// ============================================================================
+
+Tracer::Tracer()
+    : _enabled(false), _nextId(1)
+{
+}
+
+Tracer& Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+int64_t Tracer::nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t Tracer::threadNumber()
+{
+    static std::atomic<uint32_t> next(1);
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+uint64_t Tracer::currentSpan()
+{
+    return t_currentSpan;
+}
+
+void Tracer::watchThisThread()
+{
+    t_watched = true;
+}
+
+const char *Tracer::watchedSpan()
+{
+    const char *name = g_watchedSpan.load(std::memory_order_acquire);
+    return name ? name : "";
+}
+
+void Tracer::record(TraceSpan&& span)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _spans.push_back(std::move(span));
+    if (_spans.size() > MAX_SPANS) {
+        _spans.pop_front();
+    }
+}
+
+vector<TraceSpan> Tracer::getSpans() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return vector<TraceSpan>(_spans.begin(), _spans.end());
+}
+
+size_t Tracer::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _spans.size();
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _spans.clear();
+}
+
+string Tracer::toChromeTrace(const vector<TraceSpan>& spans)
+{
+    string pid = std::to_string(getpid());
+
+    // Complete ("X") events; the viewers nest them by time per thread
+    string out = "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& span : spans) {
+        if (!first) out += ',';
+        first = false;
+
+        out += "\n{\"name\":\"";
+        out += span.name;
+        if (!span.detail.empty()) {
+            out += ": ";
+            appendJsonEscaped(out, span.detail);
+        }
+        out += "\",\"cat\":\"";
+        out += span.category;
+        out += "\",\"ph\":\"X\",\"ts\":";
+        out += std::to_string(span.startMicros);
+        out += ",\"dur\":";
+        out += std::to_string(span.durationMicros);
+        out += ",\"pid\":";
+        out += pid;
+        out += ",\"tid\":";
+        out += std::to_string(span.thread);
+        out += ",\"args\":{\"id\":";
+        out += std::to_string(span.id);
+        out += ",\"parent\":";
+        out += std::to_string(span.parent);
+        for (const auto& counter : span.counters) {
+            out += ",\"";
+            out += counter.first;
+            out += "\":";
+            out += std::to_string(counter.second);
+        }
+        out += "}}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+bool Tracer::exportChromeTrace(const string& path) const
+{
+    string json = toChromeTrace(getSpans());
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// ============================================================================
+// Scoped Span
+// ============================================================================
+
+ScopedSpan::ScopedSpan(const char *name, const char *category)
+    : _outer(0), _watchedOuter(nullptr), _watched(false)
+{
+    publish(name);
+    if (Tracer::instance().isEnabled()) {
+        open(name, category, t_currentSpan);
+    }
+}
+
+ScopedSpan::ScopedSpan(const char *name, const char *category, uint64_t parent)
+    : _outer(0), _watchedOuter(nullptr), _watched(false)
+{
+    publish(name);
+    if (Tracer::instance().isEnabled()) {
+        open(name, category, parent);
+    }
+}
+
+void ScopedSpan::publish(const char *name)
+{
+    if (t_watched) {
+        _watchedOuter = g_watchedSpan.exchange(name, std::memory_order_acq_rel);
+        _watched = true;
+    }
+}
+
+void ScopedSpan::open(const char *name, const char *category, uint64_t parent)
+{
+    _span.id = Tracer::instance().nextSpanId();
+    _span.parent = parent;
+    _span.name = name;
+    _span.category = category;
+    _span.thread = Tracer::threadNumber();
+    _span.startMicros = Tracer::nowMicros();
+
+    _outer = t_currentSpan;
+    t_currentSpan = _span.id;
+}
+
+ScopedSpan::~ScopedSpan()
+{
+    if (_watched) {
+        g_watchedSpan.store(_watchedOuter, std::memory_order_release);
+    }
+    if (!isActive()) {
+        return;
+    }
+    _span.durationMicros = Tracer::nowMicros() - _span.startMicros;
+    t_currentSpan = _outer;
+    Tracer::instance().record(std::move(_span));
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,169 @@
+/* tracing.h - Nested timing spans for backend operations
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements lightweight trace spans: a ScopedSpan times the
+ * block it lives in and remembers the span it was opened in, so a
+ * unified search shows up as search -> backend -> subprocess -> parse
+ * with the time of each step. Finished spans are kept in memory and
+ * exported as Chrome trace-event JSON (chrome://tracing, Perfetto,
+ * speedscope), which draws them as a flame graph per thread.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _TRACING_H_
+#define _TRACING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * TraceSpan - One finished span
+ */
+struct TraceSpan {
+    uint64_t id = 0;
+    uint64_t parent = 0;            // 0 for a root span
+    const char *name = "";          // String literals only
+    const char *category = "";
+    string detail;                  // Command line, backend, query...
+    int64_t startMicros = 0;        // Steady clock
+    int64_t durationMicros = 0;
+    uint32_t thread = 0;            // Small per-process thread number
+
+    // Measurements attached to the span (key literals only)
+    vector<pair<const char *, int64_t>> counters;
+};
+
+/**
+ * Tracer - Collects the spans of the whole process
+ *
+ * Disabled by default; then a ScopedSpan costs one atomic load, and
+ * on the watched thread two atomic stores. The newest spans are kept
+ * up to a fixed count.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread.
+ */
+class Tracer {
+public:
+    static Tracer& instance();
+
+    void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+    void record(TraceSpan&& span);
+
+    /**
+     * A fresh span id, for spans built by hand rather than timed by a
+     * ScopedSpan
+     */
+    uint64_t nextSpanId() { return _nextId.fetch_add(1, std::memory_order_relaxed); }
+    vector<TraceSpan> getSpans() const;
+    size_t size() const;
+    void clear();
+
+    /**
+     * Write the recorded spans as a Chrome trace-event JSON file
+     */
+    bool exportChromeTrace(const string& path) const;
+
+    /**
+     * The spans as a Chrome trace-event JSON document
+     */
+    static string toChromeTrace(const vector<TraceSpan>& spans);
+
+    static int64_t nowMicros();
+    static uint32_t threadNumber();
+
+    /**
+     * Innermost span open on this thread, 0 if none
+     *
+     * Work handed to another thread captures this and passes it to
+     * the ScopedSpan there, which keeps the nesting across the pool.
+     */
+    static uint64_t currentSpan();
+
+    /**
+     * Publish the innermost span of the calling thread, tracing on or
+     * off, so a watchdog on another thread can tell what it is doing
+     */
+    static void watchThisThread();
+
+    /**
+     * Name of the innermost span open on the watched thread, "" if none
+     */
+    static const char *watchedSpan();
+
+private:
+    friend class ScopedSpan;
+
+    Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    std::atomic<bool> _enabled;
+    std::atomic<uint64_t> _nextId;
+
+    mutable std::mutex _mutex;
+    std::deque<TraceSpan> _spans;
+};
+
+/**
+ * ScopedSpan - Times the enclosing block
+ *
+ * Does nothing if tracing is off when it is created. Build expensive
+ * details only when isActive():
+ *
+ *     ScopedSpan span("subprocess", "flatpak");
+ *     if (span.isActive()) span.setDetail(args[0] + " " + args[1]);
+ */
+class ScopedSpan {
+public:
+    // Child of the innermost span open on this thread
+    ScopedSpan(const char *name, const char *category);
+
+    // Child of parent, which may have been opened on another thread
+    ScopedSpan(const char *name, const char *category, uint64_t parent);
+
+    ~ScopedSpan();
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+    bool isActive() const { return _span.id != 0; }
+    uint64_t id() const { return _span.id; }
+
+    void setDetail(string detail) { _span.detail = std::move(detail); }
+
+    void setCounter(const char *key, int64_t value) {
+        if (isActive()) _span.counters.emplace_back(key, value);
+    }
+
+private:
+    TraceSpan _span;
+    uint64_t _outer;
+    const char *_watchedOuter;      // Set on the watched thread only
+    bool _watched;
+
+    void publish(const char *name);
+    void open(const char *name, const char *category, uint64_t parent);
+};
+
+} // namespace PolySynaptic
+
+#endif // _TRACING_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,241 @@
+/* transactionjournal.cc - What a commit had left to do, kept on disk
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "transactionjournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace PolySynaptic {
+
+namespace {
+
+const char JOURNAL_MAGIC[] = "# PolySynaptic transaction journal 1";
+
+using Type = Transaction::Operation::Type;
+using State = TransactionJournal::State;
+
+const char* stateName(State state)
+{
+    switch (state) {
+        case State::DONE:    return "done";
+        case State::FAILED:  return "failed";
+        default:             return "pending";
+    }
+}
+
+const char* typeName(Type type)
+{
+    switch (type) {
+        case Type::REMOVE:   return "remove";
+        case Type::UPDATE:   return "update";
+        default:             return "install";
+    }
+}
+
+// The fields are tab separated, one operation per line
+string field(const string& value)
+{
+    string out = value;
+    replace(out.begin(), out.end(), '\t', ' ');
+    replace(out.begin(), out.end(), '\n', ' ');
+    return out;
+}
+
+vector<string> split(const string& line)
+{
+    vector<string> fields;
+    size_t begin = 0;
+    while (true) {
+        size_t tab = line.find('\t', begin);
+        fields.push_back(line.substr(begin, tab - begin));
+        if (tab == string::npos) {
+            return fields;
+        }
+        begin = tab + 1;
+    }
+}
+
+} // anonymous namespace
+
+TransactionJournal::TransactionJournal(const string& path)
+    : _path(path)
+{
+    ifstream in(_path.c_str());
+    if (in) {
+        parse(in, _entries);
+    }
+}
+
+void TransactionJournal::write(ostream& out, const vector<Entry>& entries)
+{
+    out << JOURNAL_MAGIC << "\n";
+    for (const auto& entry : entries) {
+        const Transaction::Operation& op = entry.op;
+        out << stateName(entry.state) << "\t"
+            << backendTypeToBadge(op.backend) << "\t"
+            << typeName(op.type) << "\t"
+            << (op.purge ? "purge" : "-") << "\t"
+            << field(op.packageId) << "\t"
+            << field(op.packageName) << "\t"
+            << field(op.target) << "\n";
+    }
+}
+
+bool TransactionJournal::parse(istream& in, vector<Entry>& entries)
+{
+    entries.clear();
+    string line;
+    if (!getline(in, line) || line != JOURNAL_MAGIC) {
+        return false;
+    }
+    while (getline(in, line)) {
+        vector<string> f = split(line);
+        if (f.size() != 7 || f[4].empty()) {
+            continue;
+        }
+
+        Entry entry;
+        Transaction::Operation& op = entry.op;
+        if (f[0] == "done") entry.state = State::DONE;
+        else if (f[0] == "failed") entry.state = State::FAILED;
+        else if (f[0] != "pending") continue;
+
+        if (f[1] == "deb") op.backend = BackendType::APT;
+        else if (f[1] == "snap") op.backend = BackendType::SNAP;
+        else if (f[1] == "flatpak") op.backend = BackendType::FLATPAK;
+        else continue;
+
+        if (f[2] == "install") op.type = Type::INSTALL;
+        else if (f[2] == "remove") op.type = Type::REMOVE;
+        else if (f[2] == "update") op.type = Type::UPDATE;
+        else continue;
+
+        op.purge = f[3] == "purge";
+        op.packageId = f[4];
+        op.packageName = f[5];
+        op.target = f[6];
+        op.identity = packageIdentity(op.backend, op.packageId);
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+bool TransactionJournal::saveLocked()
+{
+    if (_entries.empty()) {
+        return unlink(_path.c_str()) == 0 || errno == ENOENT;
+    }
+
+    ostringstream text;
+    write(text, _entries);
+    string data = text.str();
+
+    // Synced before the rename, so a power loss cannot leave an empty
+    // journal in place of the old one
+    string tmp = _path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::write(fd, data.data(), data.size()) == (ssize_t) data.size();
+    ok = fsync(fd) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), _path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TransactionJournal::record(const vector<Transaction::Operation>& ops)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    // A backend's new share replaces whatever it had left before
+    _entries.erase(remove_if(_entries.begin(), _entries.end(),
+                             [&ops](const Entry& entry) {
+                                 for (const auto& op : ops) {
+                                     if (op.backend == entry.op.backend) return true;
+                                 }
+                                 return false;
+                             }),
+                   _entries.end());
+    for (const auto& op : ops) {
+        Entry entry;
+        entry.op = op;
+        entry.op.identity = packageIdentity(op.backend, op.packageId);
+        _entries.push_back(entry);
+    }
+    return saveLocked();
+}
+
+bool TransactionJournal::checkpoint(BackendType backend, const vector<string>& ids,
+                                    State state)
+{
+    lock_guard<mutex> lock(_mutex);
+    for (const auto& id : ids) {
+        uint64_t identity = packageIdentity(backend, id);
+        for (auto& entry : _entries) {
+            if (entry.op.identity == identity) {
+                entry.state = state;
+            }
+        }
+    }
+    return saveLocked();
+}
+
+void TransactionJournal::complete(BackendType backend)
+{
+    lock_guard<mutex> lock(_mutex);
+    size_t before = _entries.size();
+    _entries.erase(remove_if(_entries.begin(), _entries.end(),
+                             [backend](const Entry& entry) {
+                                 return entry.op.backend == backend;
+                             }),
+                   _entries.end());
+    if (_entries.size() != before) {
+        saveLocked();
+    }
+}
+
+void TransactionJournal::discard()
+{
+    lock_guard<mutex> lock(_mutex);
+    _entries.clear();
+    saveLocked();
+}
+
+vector<TransactionJournal::Entry> TransactionJournal::entries() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _entries;
+}
+
+Transaction TransactionJournal::unfinished() const
+{
+    lock_guard<mutex> lock(_mutex);
+    Transaction tx;
+    for (const auto& entry : _entries) {
+        if (entry.state != State::DONE) {
+            tx.operations.push_back(entry.op);
+        }
+    }
+    return tx;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,113 @@
+/* transactionjournal.h - What a commit had left to do, kept on disk
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the journal that lets an interrupted commit be
+ * picked up where it stopped. The operations of a Transaction are
+ * written out before they run, and each one's state is checkpointed as
+ * its batch finishes, so after a crash, a power loss or a cancel the
+ * next start knows which operations never completed. Resuming queues
+ * only those again; what was already fetched (the archives APT keeps,
+ * the objects in a Flatpak repo, snapd's downloads) is not fetched
+ * twice.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _TRANSACTIONJOURNAL_H_
+#define _TRANSACTIONJOURNAL_H_
+
+#include "backendmanager.h"
+
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace PolySynaptic {
+
+/**
+ * TransactionJournal - The operations of unfinished commits, by backend
+ *
+ *     journal.record(ops);                       // before they run
+ *     journal.checkpoint(backend, ids, DONE);    // as each batch ends
+ *     journal.complete(backend);                 // the run is over
+ *
+ * Each backend's share is recorded and completed on its own, since the
+ * backends commit side by side and APT through its own path. Every
+ * change rewrites the file (a temporary one, synced and renamed over
+ * it), so a crash leaves either the old journal or the new one.
+ *
+ * Thread Safety:
+ *   All methods are thread-safe.
+ */
+class TransactionJournal {
+public:
+    enum class State {
+        PENDING,                    // Not known to have run
+        DONE,
+        FAILED                      // Ran and failed; worth another try
+    };
+
+    struct Entry {
+        Transaction::Operation op;
+        State state = State::PENDING;
+    };
+
+    /**
+     * Over the journal at path, loading what it holds from a previous run
+     */
+    explicit TransactionJournal(const string& path);
+
+    /**
+     * Record ops as pending, in place of what their backends had
+     */
+    bool record(const vector<Transaction::Operation>& ops);
+
+    /**
+     * Set the state of backend's operations on ids and write it out
+     */
+    bool checkpoint(BackendType backend, const vector<string>& ids, State state);
+
+    /**
+     * Drop backend's share; the file goes once no backend has one
+     */
+    void complete(BackendType backend);
+
+    /**
+     * Drop everything, as when the user declines to resume
+     */
+    void discard();
+
+    vector<Entry> entries() const;
+
+    /**
+     * The operations that did not get done, in the order recorded
+     */
+    Transaction unfinished() const;
+
+    /**
+     * Text form, one operation per line; parse() skips lines it does
+     * not understand and returns false only if it is not a journal
+     */
+    static void write(ostream& out, const vector<Entry>& entries);
+    static bool parse(istream& in, vector<Entry>& entries);
+
+private:
+    string _path;
+    mutable mutex _mutex;
+    vector<Entry> _entries;
+
+    bool saveLocked();
+};
+
+} // namespace PolySynaptic
+
+#endif // _TRANSACTIONJOURNAL_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,226 @@
+/* updatechecker.cc - Background checks for upgradable packages
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "updatechecker.h"
+#include "processgovernor.h"
+
+#include <algorithm>
+
+namespace PolySynaptic {
+
+UpdateChecker::UpdateChecker(TaskPool& pool,
+                             std::chrono::seconds baseInterval,
+                             std::chrono::seconds maxInterval)
+    : _pool(pool)
+    , _baseInterval(baseInterval)
+    , _shared(make_shared<Shared>())
+{
+    _shared->maxInterval = max(maxInterval, baseInterval);
+}
+
+UpdateChecker::~UpdateChecker()
+{
+    cancel();
+}
+
+void UpdateChecker::addSource(BackendType backend, Source check,
+                              std::chrono::seconds baseInterval, bool onPoller)
+{
+    lock_guard<mutex> lock(_shared->lock);
+    SourceState& state = _shared->sources[backend];
+    state.check = std::move(check);
+    state.onPoller = onPoller;
+    state.baseInterval = baseInterval.count() > 0 ? baseInterval : _baseInterval;
+    state.interval = state.baseInterval;
+    state.due = Clock::time_point();
+}
+
+void UpdateChecker::setChangedCallback(ChangedCallback callback)
+{
+    lock_guard<mutex> lock(_shared->lock);
+    _shared->changed = std::move(callback);
+}
+
+// ============================================================================
+// Scheduling
+// ============================================================================
+
+int UpdateChecker::poll(Clock::time_point now)
+{
+    vector<pair<BackendType, Source>> here;
+    int started = 0;
+    {
+        lock_guard<mutex> lock(_shared->lock);
+        if (_shared->token.isCancelled()) {
+            return 0;
+        }
+
+        for (auto& entry : _shared->sources) {
+            SourceState& state = entry.second;
+            if (state.running || now < state.due) {
+                continue;
+            }
+            state.started = now;
+            state.running = true;
+            state.rerun = false;
+            _shared->running++;
+            if (state.onPoller) {
+                here.push_back(make_pair(entry.first, state.check));
+            } else {
+                start(entry.first, state);
+            }
+            started++;
+        }
+    }
+
+    // Without the lock, so they may call back into the checker
+    for (const auto& check : here) {
+        run(_shared, check.first, check.second);
+    }
+    return started;
+}
+
+// Called with the lock held
+void UpdateChecker::start(BackendType backend, SourceState& state)
+{
+    shared_ptr<Shared> shared = _shared;
+    Source check = state.check;
+    _pool.submit(TaskPriority::BACKGROUND, [shared, backend, check]() {
+        run(shared, backend, check);
+        return 0;
+    });
+}
+
+void UpdateChecker::run(const shared_ptr<Shared>& shared, BackendType backend,
+                        const Source& check)
+{
+    // Also on the poller, which may be a thread the user waits on
+    ProcessGovernor::PriorityScope scope(ProcessPriority::BACKGROUND);
+    vector<PackageInfo> packages;
+    bool ok = !shared->token.isCancelled() && check(packages, shared->token);
+    finished(shared, backend, ok && !shared->token.isCancelled(), packages);
+}
+
+void UpdateChecker::finished(const shared_ptr<Shared>& shared, BackendType backend,
+                             bool ok, vector<PackageInfo>& packages)
+{
+    ChangedCallback changed;
+    {
+        lock_guard<mutex> lock(shared->lock);
+        SourceState& state = shared->sources[backend];
+        state.running = false;
+
+        if (ok) {
+            vector<string> print = fingerprint(packages);
+            if (state.checked && print == state.fingerprint) {
+                // Nothing new; ask less often
+                state.interval = min(state.interval * 2, shared->maxInterval);
+            } else {
+                state.interval = state.baseInterval;
+                state.fingerprint.swap(print);
+                state.packages.swap(packages);
+                state.checked = true;
+                changed = shared->changed;
+            }
+        } else {
+            state.interval = state.baseInterval;
+        }
+
+        // Counted from the poll that started it, like the intervals
+        state.due = state.rerun ? Clock::time_point() : state.started + state.interval;
+        state.rerun = false;
+    }
+
+    if (changed) {
+        changed(backend);
+    }
+
+    // Only idle once the callback is done with the new answer
+    {
+        lock_guard<mutex> lock(shared->lock);
+        shared->running--;
+    }
+    shared->idle.notify_all();
+}
+
+void UpdateChecker::invalidate(BackendType backend)
+{
+    lock_guard<mutex> lock(_shared->lock);
+    auto it = _shared->sources.find(backend);
+    if (it == _shared->sources.end()) {
+        return;
+    }
+    SourceState& state = it->second;
+    state.interval = state.baseInterval;
+    state.due = Clock::time_point();
+    // The running check may have read the state from before the change
+    if (state.running) {
+        state.rerun = true;
+    }
+}
+
+void UpdateChecker::cancel()
+{
+    _shared->token.cancel();
+}
+
+bool UpdateChecker::waitIdle(int timeoutMs)
+{
+    unique_lock<mutex> lock(_shared->lock);
+    return _shared->idle.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                  [this]() { return _shared->running == 0; });
+}
+
+// ============================================================================
+// Snapshot
+// ============================================================================
+
+vector<PackageInfo> UpdateChecker::getSnapshot(BackendType backend) const
+{
+    lock_guard<mutex> lock(_shared->lock);
+    auto it = _shared->sources.find(backend);
+    return it == _shared->sources.end() ? vector<PackageInfo>() : it->second.packages;
+}
+
+int UpdateChecker::getCount(BackendType backend) const
+{
+    lock_guard<mutex> lock(_shared->lock);
+    auto it = _shared->sources.find(backend);
+    return it == _shared->sources.end() ? 0 : it->second.packages.size();
+}
+
+bool UpdateChecker::hasChecked(BackendType backend) const
+{
+    lock_guard<mutex> lock(_shared->lock);
+    auto it = _shared->sources.find(backend);
+    return it != _shared->sources.end() && it->second.checked;
+}
+
+std::chrono::seconds UpdateChecker::getInterval(BackendType backend) const
+{
+    lock_guard<mutex> lock(_shared->lock);
+    auto it = _shared->sources.find(backend);
+    return it == _shared->sources.end() ? std::chrono::seconds(0) : it->second.interval;
+}
+
+vector<string> UpdateChecker::fingerprint(const vector<PackageInfo>& packages)
+{
+    vector<string> print;
+    print.reserve(packages.size());
+    for (const auto& pkg : packages) {
+        print.push_back(pkg.id + '\n' + pkg.version);
+    }
+    sort(print.begin(), print.end());
+    return print;
+}
+
+} // namespace PolySynaptic
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,170 @@
+/* updatechecker.h - Background checks for upgradable packages
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file provides the UpdateChecker that asks every backend for its
+ * upgradable packages on a pool at background priority, on a schedule
+ * that backs off while nothing changes, and keeps the last answers so
+ * update counts and lists can be shown without waiting for a backend.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _UPDATECHECKER_H_
+#define _UPDATECHECKER_H_
+
+#include "ipackagebackend.h"
+#include "taskpool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+namespace PolySynaptic {
+
+/**
+ * UpdateChecker - Cached upgradable state of several backends
+ *
+ * Each backend is a source that is asked at most once at a time: a
+ * check requested while one is running is folded into it, with one
+ * more check afterwards if the request came from invalidate(). After
+ * a check whose answer equals the previous one the wait before the
+ * next is doubled, up to the maximum; a changed answer, a failed
+ * check or invalidate() goes back to the base interval.
+ *
+ * The checker has no timer of its own. The owner calls poll() every
+ * now and then - the GUI from its main loop - and the checks that are
+ * due are started.
+ *
+ * Thread Safety:
+ *   All methods may be called from any thread. The changed callback
+ *   runs on the worker thread that finished the check.
+ */
+class UpdateChecker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Fills packages and returns true, or returns false if the backend
+    // could not be asked (the previous answer is kept)
+    using Source = function<bool(vector<PackageInfo>& packages,
+                                 const CancellationToken& token)>;
+    using ChangedCallback = function<void(BackendType backend)>;
+
+    /**
+     * @param pool Pool the checks run on; only kept by reference, so it
+     *             may be constructed after the checker
+     * @param baseInterval Wait after a changed answer, unless the
+     *             source has its own
+     * @param maxInterval Longest wait the backoff reaches
+     */
+    UpdateChecker(TaskPool& pool,
+                  std::chrono::seconds baseInterval,
+                  std::chrono::seconds maxInterval);
+    ~UpdateChecker();
+
+    UpdateChecker(const UpdateChecker&) = delete;
+    UpdateChecker& operator=(const UpdateChecker&) = delete;
+
+    /**
+     * Register the check of a backend; it is due at once
+     *
+     * @param baseInterval Overrides the checker's, if not 0
+     * @param onPoller Run the check in poll() on the calling thread
+     *                 instead of on the pool, for state only that thread
+     *                 may read (APT's depcache belongs to the main loop)
+     */
+    void addSource(BackendType backend, Source check,
+                   std::chrono::seconds baseInterval = std::chrono::seconds(0),
+                   bool onPoller = false);
+
+    /**
+     * Called whenever a backend's upgradable packages changed
+     */
+    void setChangedCallback(ChangedCallback callback);
+
+    /**
+     * Start the checks that are due at now
+     *
+     * @return Number of checks started
+     */
+    int poll(Clock::time_point now = Clock::now());
+
+    /**
+     * Forget the schedule of a backend, after something changed its
+     * packages or their sources; its next poll() checks it again
+     */
+    void invalidate(BackendType backend);
+
+    /**
+     * Stop the running checks through their tokens and start no more;
+     * done by the destructor
+     */
+    void cancel();
+
+    /**
+     * Wait until no check is running
+     *
+     * @return False if checks were still running after timeoutMs
+     */
+    bool waitIdle(int timeoutMs);
+
+    // The last answer of a backend
+    vector<PackageInfo> getSnapshot(BackendType backend) const;
+
+    // Number of upgradable packages of a backend in the last answer
+    int getCount(BackendType backend) const;
+
+    // Whether a backend has answered at least once
+    bool hasChecked(BackendType backend) const;
+
+    // Current wait after a check of a backend
+    std::chrono::seconds getInterval(BackendType backend) const;
+
+private:
+    struct SourceState {
+        Source check;
+        bool onPoller = false;
+        std::chrono::seconds baseInterval;
+        std::chrono::seconds interval;
+        Clock::time_point due;
+        Clock::time_point started;  // poll time of the last check
+        bool running = false;
+        bool rerun = false;         // invalidated while running
+        bool checked = false;
+        vector<PackageInfo> packages;
+        vector<string> fingerprint; // sorted ids and versions of packages
+    };
+
+    // Everything a running check touches; the checks hold it too, so
+    // the checker may go away before they finish
+    struct Shared {
+        std::chrono::seconds maxInterval;
+        CancellationToken token;
+        mutable mutex lock;
+        std::condition_variable idle;
+        map<BackendType, SourceState> sources;
+        int running = 0;
+        ChangedCallback changed;
+    };
+
+    TaskPool& _pool;
+    std::chrono::seconds _baseInterval;
+    shared_ptr<Shared> _shared;
+
+    void start(BackendType backend, SourceState& state);
+    static void run(const shared_ptr<Shared>& shared, BackendType backend,
+                    const Source& check);
+    static void finished(const shared_ptr<Shared>& shared, BackendType backend,
+                         bool ok, vector<PackageInfo>& packages);
+    static vector<string> fingerprint(const vector<PackageInfo>& packages);
+};
+
+} // namespace PolySynaptic
+
+#endif // _UPDATECHECKER_H_
+
+// vim:ts=4:sw=4:et
@@ -29,6 +29,12 @@
 #include "rconfiguration.h"
 #include "raptoptions.h"
 #include "rpackagelister.h"
+#include "startupprofile.h"
+#include "perfdiagnosis.h"
+#include "stallwatch.h"
+#include "metrics.h"
+#include "rgframetiming.h"
+#include "structuredlog.h"
 #include <cmath>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/cmndline.h>
@@ -87,7 +93,10 @@ bool ShowHelp(CommandLine & CmdL)
       _("--task-window Open with task window\n") <<
       _("--add-cdrom Add a cdrom at startup (needs path for cdrom)\n") <<
       _("--ask-cdrom Ask for adding a cdrom and exit\n") <<
-      _("--test-me-harder  Run test in a loop\n");
+      _("--test-me-harder  Run test in a loop\n") <<
+      _("--refresh-shared-cache  Update the store cache shared by all users and exit\n") <<
+      _("--profile-startup  Print the time, page faults and I/O of each startup phase\n") <<
+      _("--diagnose-performance  Time the package backends on this machine, print a report and exit\n");
    exit(0);
 }
 
@@ -131,6 +140,12 @@ CommandLine::Args Args[] = {
    , {
    0, "test-me-harder", "Volatile::TestMeHarder", 0}
    , {
+   0, "refresh-shared-cache", "Volatile::RefreshSharedCache", 0}
+   , {
+   0, "profile-startup", "Volatile::ProfileStartup", 0}
+   , {
+   0, "diagnose-performance", "Volatile::DiagnosePerformance", 0}
+   , {
    'o', "option", 0, CommandLine::ArbItem}
    , {
    0, 0, 0, 0}
@@ -224,6 +239,30 @@ void update_check(RGMainWindow *mainWindow, RPackageLister *lister)
 }
 
 
+// the first frame of the main window, timed from show()
+static double first_frame_start;
+static StartupUsage first_frame_usage;
+
+static void first_frame_painted(GdkFrameClock *clock, gpointer data)
+{
+   g_signal_handlers_disconnect_by_func(clock, (gpointer)first_frame_painted, data);
+   StartupProfile::instance().record("first-frame", first_frame_start,
+                                     StartupUsage::ofThisThread() - first_frame_usage);
+}
+
+static gboolean print_startup_report(gpointer data)
+{
+   std::cout << StartupProfile::instance().report() << std::flush;
+   return FALSE;
+}
+
+static gboolean stall_heartbeat(gpointer data)
+{
+   StallWatchdog::instance().heartbeat();
+   return TRUE;
+}
+
+
 // lock stuff
 static int sigterm_unix_signal_pipe_fds[2];
 static GIOChannel *sigterm_iochn;
@@ -398,8 +437,69 @@ void check_and_aquire_lock()
    }
 }
 
+// Refresh the store index shared by all users and exit; run by the
+// polysynaptic-cached unit, so there is no display to open
+static int RefreshSharedCache()
+{
+   if (getuid() != 0) {
+      std::cerr << _("The shared cache can only be refreshed as root") << std::endl;
+      return 1;
+   }
+   if (!RInitConfiguration("polysynaptic.conf")) {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   BackendManager manager(NULL);
+   OperationResult result = manager.refreshSharedStoreIndex();
+   std::cout << result.message << std::endl;
+   return result.success ? 0 : 1;
+}
+
+// Time the cache and every backend on this machine and print the
+// report to attach to a bug; like the cache refresh, without a display
+static int DiagnosePerformance()
+{
+   if (!RInitConfiguration("polysynaptic.conf")) {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   RPackageLister *lister = new RPackageLister();
+   PerfDiagnosis diagnosis;
+   diagnosis.addProbe("APT", "cache-open", [lister](string &detail) {
+      if (!lister->openCache()) {
+         _error->Discard();
+         detail = "could not open the package cache";
+         return false;
+      }
+      detail = to_string(lister->packagesSize()) + " packages";
+      return true;
+   }, PerfDiagnosis::hintFor(BackendType::APT, "cache-open"));
+#ifdef HAVE_XAPIAN
+   diagnosis.addProbe("Xapian", "xapian-query", [lister](string &detail) {
+      vector<RPackage *> matches;
+      if (!lister->searchPackages("editor", matches, 100)) {
+         detail = "no index to search";
+         return false;
+      }
+      detail = to_string(matches.size()) + " matches";
+      return true;
+   }, "the index is missing or outdated; run update-apt-xapian-index");
+#endif
+
+   BackendManager manager(lister);
+   for (IPackageBackend *backend : manager.getAllBackends())
+      diagnosis.addBackend(backend);
+
+   std::cout << PerfDiagnosis::report(diagnosis.run()) << std::flush;
+   return 0;
+}
+
 int main(int argc, char **argv)
 {
+   StartupProfile &startup = StartupProfile::instance();
+
 #ifdef ENABLE_NLS
    bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
    bindtextdomain(GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR);
@@ -410,6 +510,16 @@ int main(int argc, char **argv)
 #endif
 #endif
 
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--refresh-shared-cache") == 0)
+         return RefreshSharedCache();
+      if (strcmp(argv[i], "--diagnose-performance") == 0)
+         return DiagnosePerformance();
+      // before the command line is parsed, so its phases are traced too
+      if (strcmp(argv[i], "--profile-startup") == 0)
+         startup.enableReport();
+   }
+
    if (!gtk_init_check(&argc, &argv)) {
       std::cout <<
          _("Failed to initialize GTK.\n") <<
@@ -418,6 +528,7 @@ int main(int argc, char **argv)
          _("Please restart your session without Wayland, or run PolySynaptic without root permission\n");
       exit(1);
    };
+   startup.mark("gtk");
    //XSynchronize(dpy, 1);
    
    // read the cmdline
@@ -443,12 +554,37 @@ int main(int argc, char **argv)
 					   "create a download script "
 					   "for them.")));
    }
+   startup.mark("cmdline");
 
    if (!RInitConfiguration("polysynaptic.conf")) {
       RGUserDialog userDialog;
       userDialog.showErrors();
       exit(1);
    }
+   startup.mark("config");
+
+   // pkgcache.bin and the Xapian index are read ahead on a worker
+   // while the options, the window and the backends are set up
+   RPackageLister::prefetchCacheFiles();
+
+   // verbose provider logging stays affordable with these
+   LogLimiter &limiter = Logger::instance().getLimiter();
+   limiter.setRateLimit(_config->FindI("Synaptic::Log::RatePerSecond", 50),
+                        _config->FindI("Synaptic::Log::Burst", 200));
+   limiter.setSampleRate(LogLevel::DEBUG,
+      atof(_config->Find("Synaptic::Log::DebugSampleRate", "1").c_str()));
+
+   // rotated and compressed by the log writer, so kiosks can keep it on
+   string logFile = _config->Find("Synaptic::Log::File", "");
+   if (!logFile.empty()) {
+      FileSink::Rotation rotation;
+      rotation.maxBytes = (uint64_t) _config->FindI("Synaptic::Log::MaxFileMB", 16) << 20;
+      rotation.maxAge = std::chrono::hours(_config->FindI("Synaptic::Log::MaxFileHours", 24));
+      rotation.maxSegments = _config->FindI("Synaptic::Log::KeepSegments", 8);
+      rotation.maxTotalBytes = (uint64_t) _config->FindI("Synaptic::Log::MaxTotalMB", 64) << 20;
+      rotation.compress = _config->FindB("Synaptic::Log::Compress", true);
+      Logger::instance().addSink(std::make_shared<FileSink>(logFile, rotation));
+   }
 
    bool UpdateMode = _config->FindB("Volatile::Update-Mode",false);
    bool NonInteractive = _config->FindB("Volatile::Non-Interactive", false);
@@ -461,17 +597,25 @@ int main(int argc, char **argv)
    _roptions->restore();
 
    SetLanguages();
+   startup.mark("options");
 
    // init the static pkgStatus class. this loads the status pixmaps 
    // and colors
    RGPackageStatus::pkgStatus.init();
 
+   // starts opening the xapian index on a worker thread
    RPackageLister *packageLister = new RPackageLister();
+   startup.mark("lister");
 
    // Create BackendManager for multi-backend support (APT, Snap, Flatpak)
+   // and let the pool find snap and flatpak while the window is built
+   // and the cache is opened
    BackendManager *backendManager = new BackendManager(packageLister);
+   backendManager->probeBackendsInBackground();
+   startup.mark("backends");
 
    RGMainWindow *mainWindow = new RGMainWindow(packageLister, backendManager, "main");
+   startup.mark("mainwindow");
 
    // install a sigusr1 signal handler and put window into 
    // foreground when called. use the io_watch trick because gtk is not
@@ -507,10 +651,18 @@ int main(int argc, char **argv)
    
    if(_config->FindB("Volatile::HideMainwindow", false))
       mainWindow->hide();
-   else
+   else {
+      first_frame_start = startup.elapsedMs();
+      first_frame_usage = StartupUsage::ofThisThread();
       mainWindow->show();
+      GdkFrameClock *clock = gtk_widget_get_frame_clock(mainWindow->window());
+      if (clock != NULL)
+         g_signal_connect(clock, "after-paint",
+                          G_CALLBACK(first_frame_painted), NULL);
+   }
 
    RGFlushInterface();
+   startup.mark("shown");
 
    mainWindow->setInterfaceLocked(true);
 
@@ -534,6 +686,7 @@ int main(int argc, char **argv)
       mainWindow->restoreState();
       mainWindow->showErrors();
       mainWindow->setTreeLocked(false);
+      startup.mark("restore");
    }
    
    if (_config->FindB("Volatile::startInRepositories", false)) {
@@ -559,6 +712,11 @@ int main(int argc, char **argv)
    }
 
    mainWindow->setInterfaceLocked(false);
+   if(!UpdateMode) {
+      startup.finish();
+      if (startup.isReporting())
+         g_idle_add(print_startup_report, NULL);
+   }
 
    if(UpdateMode) {
       mainWindow->cbUpdateClicked(NULL, mainWindow);
@@ -610,13 +768,31 @@ int main(int argc, char **argv)
       mainWindow->cbProceedClicked(NULL, mainWindow);
    } else {
       welcome_dialog(mainWindow);
+      mainWindow->resumeInterruptedTransaction();
       gtk_widget_grab_focus( GTK_WIDGET(gtk_builder_get_object(
                                           mainWindow->getGtkBuilder(),
                                           "entry_fast_search")));
 #if 0
       update_check(mainWindow, packageLister);
 #endif 
+      // the hangs only some people see are logged with where they were
+      int stallMs = _config->FindI("Synaptic::StallThresholdMs", 200);
+      if (stallMs > 0) {
+         StallWatchdog &watchdog = StallWatchdog::instance();
+         watchdog.setTracePath(RStateDir() + "/last-stall-trace.json");
+         watchdog.start(stallMs);
+         g_timeout_add(StallWatchdog::BEAT_MS, stall_heartbeat, NULL);
+      }
+      RGWatchFrames(mainWindow->window());
+
+      // for a node exporter's textfile collector; off unless configured
+      string metricsFile = _config->Find("Synaptic::Metrics::File", "");
+      if (!metricsFile.empty()) {
+         int interval = _config->FindI("Synaptic::Metrics::IntervalSeconds", 15);
+         MetricsRegistry::instance().startExport(metricsFile, interval > 0 ? interval : 15);
+      }
       gtk_main();
+      MetricsRegistry::instance().stopExport();
    }
 
    return 0;
@@ -24,6 +24,7 @@
 #include <cassert>
 #include "gtkpkglist.h"
 #include "rgutils.h"
+#include "rgframetiming.h"
 #include "rgpackagestatus.h"
 #include "rpackagelister.h"
 
@@ -147,6 +148,55 @@ void RPackageListActorPkgList::run(vector<RPackage *> &List, int listEvent)
    }
 }
 
+// rows are deleted from the bottom up, so the old positions of the
+// ones above stay valid, then inserted top down at their new ones
+void RPackageListActorPkgList::run(const RPackageListChange &change)
+{
+   static GtkTreeIter iter;
+
+   if (change.removed.empty() == false) {
+      vector<int> positions;
+      RPackageSet removed;
+      for (unsigned int i = 0; i < change.removed.size(); i++)
+         removed.insert((*change.removed[i]->package())->ID);
+      for (unsigned int j = 0; j < _lastDisplayList.size(); j++)
+         if (removed.contains((*_lastDisplayList[j]->package())->ID))
+            positions.push_back(j);
+      for (int i = (int)positions.size() - 1; i >= 0; i--) {
+         GtkTreePath *path = gtk_tree_path_new();
+         gtk_tree_path_append_index(path, positions[i]);
+         gtk_tree_model_row_deleted(GTK_TREE_MODEL(_pkgList), path);
+         gtk_tree_path_free(path);
+      }
+   }
+
+   for (unsigned int i = 0; i < change.added.size(); i++) {
+      int j = _lister->getViewPackageIndex(change.added[i]);
+      GtkTreePath *path = gtk_tree_path_new();
+      gtk_tree_path_append_index(path, j);
+      iter.user_data = change.added[i];
+      iter.user_data2 = GINT_TO_POINTER(j);
+      iter.stamp = 140677;
+      gtk_tree_model_row_inserted(GTK_TREE_MODEL(_pkgList), path, &iter);
+      gtk_tree_path_free(path);
+   }
+
+   // only the rows whose status changed are redrawn
+   for (unsigned int i = 0; i < change.changed.size(); i++) {
+      RPackage *pkg = change.changed[i].pkg;
+      int j = _lister->getViewPackageIndex(pkg);
+      if (j == -1)
+         continue;
+      gtk_pkg_list_invalidate(_pkgList, pkg);
+      GtkTreePath *path = gtk_tree_path_new();
+      gtk_tree_path_append_index(path, j);
+      iter.user_data = pkg;
+      iter.user_data2 = GINT_TO_POINTER(j);
+      gtk_tree_model_row_changed(GTK_TREE_MODEL(_pkgList), path, &iter);
+      gtk_tree_path_free(path);
+   }
+}
+
 GType gtk_pkg_list_get_type(void)
 {
    static GType pkg_list_type = 0;
@@ -239,6 +289,7 @@ static void gtk_pkg_list_init(GtkPkgList *pkg_list)
    pkg_list->column_headers[9] = G_TYPE_STRING;
    pkg_list->column_headers[10] = GDK_TYPE_RGBA;
    pkg_list->column_headers[11] = G_TYPE_POINTER;
+   pkg_list->rows = new vector<GtkPkgListRow>;
 }
 
 /**
@@ -258,13 +309,62 @@ GtkPkgList *gtk_pkg_list_new(RPackageLister *lister)
 }
 
 
+void gtk_pkg_list_invalidate(GtkPkgList *pkg_list, RPackage *pkg)
+{
+   g_return_if_fail(GTK_IS_PKG_LIST(pkg_list));
+
+   vector<GtkPkgListRow> &rows = *pkg_list->rows;
+   if (pkg == NULL) {
+      rows.clear();
+      return;
+   }
+   unsigned int id = (*pkg->package())->ID;
+   if (id < rows.size())
+      rows[id].filled = false;
+}
+
+// the row of pkg, (re)filled if it was never asked for or went stale:
+// the name and installed size only change with the cache, the rest
+// with the candidate version
+static GtkPkgListRow &gtk_pkg_list_get_row(GtkPkgList *pkg_list,
+                                           RPackage *pkg)
+{
+   vector<GtkPkgListRow> &rows = *pkg_list->rows;
+   unsigned int id = (*pkg->package())->ID;
+   if (id >= rows.size())
+      rows.resize(id + 1);
+
+   GtkPkgListRow &row = rows[id];
+   unsigned long generation = pkg_list->_lister->getCacheGeneration();
+   const char *candidate = pkg->availableVersion();
+   if (row.filled && row.generation == generation &&
+       row.candidate == candidate)
+      return row;
+
+   const char *str = utf8(pkg->name());
+   row.name = str != NULL ? str : "";
+   str = utf8(pkg->summary());
+   row.summary = str != NULL ? str : "";
+   row.size.clear();
+   if (pkg->installedVersion())
+      row.size = SizeToStr(pkg->installedSize());
+   row.downloadSize = SizeToStr(pkg->availablePackageSize());
+   row.component = pkg->component();
+
+   row.filled = true;
+   row.generation = generation;
+   row.candidate = candidate;
+   return row;
+}
+
 static void gtk_pkg_list_finalize(GObject *object)
 {
-   //  GtkPkgList *pkg_list = GTK_PKG_LIST (object);
+   GtkPkgList *pkg_list = GTK_PKG_LIST (object);
 
 
    /* give back all memory */
-
+   delete pkg_list->rows;
+   pkg_list->rows = NULL;
 
    /* must chain up */
    (*parent_class->finalize) (object);
@@ -404,22 +504,22 @@ gtk_pkg_list_get_value(GtkTreeModel *tree_model,
       return;
    }
 
-   std::string cppstr;
    const gchar *str;
    switch (column) {
       case NAME_COLUMN:
-         str = utf8(pkg->name());
-         g_value_set_string(value, str);
+         g_value_set_string(value,
+                            gtk_pkg_list_get_row(pkg_list, pkg).name.c_str());
          break;
       case PKG_SIZE_COLUMN:
-         if (pkg->installedVersion()) {
-            cppstr = SizeToStr(pkg->installedSize());
-            g_value_set_string(value, cppstr.c_str());
-         }
+       {
+         GtkPkgListRow &row = gtk_pkg_list_get_row(pkg_list, pkg);
+         if (!row.size.empty())
+            g_value_set_string(value, row.size.c_str());
          break;
+       }
       case PKG_DOWNLOAD_SIZE_COLUMN:
-	 cppstr = SizeToStr(pkg->availablePackageSize());
-	 g_value_set_string(value, cppstr.c_str());
+	 g_value_set_string(value,
+	                    gtk_pkg_list_get_row(pkg_list, pkg).downloadSize.c_str());
          break;
       case SECTION_COLUMN:
 	 str = pkg->section();
@@ -427,9 +527,8 @@ gtk_pkg_list_get_value(GtkTreeModel *tree_model,
 	    g_value_set_string(value, str);
 	 break;
       case COMPONENT_COLUMN:
-         cppstr = pkg->component();
-	 if(cppstr.c_str() != NULL)
-	    g_value_set_string(value, cppstr.c_str());
+	 g_value_set_string(value,
+	                    gtk_pkg_list_get_row(pkg_list, pkg).component.c_str());
 	 break;
       case INSTALLED_VERSION_COLUMN:
          str = pkg->installedVersion();
@@ -440,15 +539,15 @@ gtk_pkg_list_get_value(GtkTreeModel *tree_model,
          g_value_set_string(value, str);
          break;
       case DESCR_COLUMN:
-         str = utf8(pkg->summary());
-         g_value_set_string(value, str);
+         g_value_set_string(value,
+                            gtk_pkg_list_get_row(pkg_list, pkg).summary.c_str());
          break;
       case PKG_COLUMN:
          g_value_set_pointer(value, pkg);
          break;
       case COLOR_COLUMN:
        {
-	  if(_config->FindB("Synaptic::UseStatusColors", TRUE) == FALSE) 
+	  if(!RGPackageStatus::pkgStatus.useStatusColors())
 	     return;
           GdkRGBA *bg;
           bg = RGPackageStatus::pkgStatus.getBgColor(pkg);
@@ -634,6 +733,7 @@ static void gtk_pkg_list_set_sort_column_id(GtkTreeSortable *sortable,
 
    pkg_list->sort_column_id = sort_column_id;
    pkg_list->order = order;
+   RGNoteViewChange("sort");
 
    gtk_tree_sortable_sort_column_changed(sortable);
    gtk_pkg_list_sort(pkg_list);
@@ -37,12 +37,29 @@
 typedef struct _GtkPkgList GtkPkgList;
 typedef struct _GtkPkgListClass GtkPkgListClass;
 
+// the converted texts of one row, filled the first time GTK asks for
+// any of them; candidate and generation tell when they went stale
+struct GtkPkgListRow {
+   bool filled;
+   const char *candidate;           // availableVersion() when filled
+   unsigned long generation;        // the lister's cache generation
+   string name;
+   string summary;
+   string size;                     // empty if not installed
+   string downloadSize;
+   string component;
+
+   GtkPkgListRow() : filled(false), candidate(NULL), generation(0) {}
+};
 
 struct _GtkPkgList {
    GObject parent;
 
    RPackageLister *_lister;
 
+   // by package id, see gtk_pkg_list_invalidate()
+   vector<GtkPkgListRow> *rows;
+
    gint n_columns;
    GType column_headers[N_COLUMNS];
    // sortable
@@ -57,6 +74,8 @@ struct _GtkPkgListClass {
 
 GType gtk_pkg_list_get_type();
 GtkPkgList *gtk_pkg_list_new(RPackageLister *lister);
+// drop the cached texts of pkg, or of every row if pkg is NULL
+void gtk_pkg_list_invalidate(GtkPkgList *pkg_list, RPackage *pkg);
 
 class RCacheActorPkgList : public RCacheActor {
 
@@ -86,6 +105,7 @@ class RPackageListActorPkgList:public RPackageListActor {
    public:
 
    virtual void run(vector<RPackage *> &List, int listEvent);
+   virtual void run(const RPackageListChange &change);
 
    RPackageListActorPkgList(RPackageLister *lister,
                             GtkPkgList *pkgList,
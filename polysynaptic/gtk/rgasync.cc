@@ -0,0 +1,35 @@
+/* rgasync.cc - Main loop delivery of asynchronous backend results
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include <glib.h>
+
+#include "rgasync.h"
+
+static gboolean runTask(gpointer data)
+{
+    std::function<void()> *task = (std::function<void()> *) data;
+    (*task)();
+    return FALSE;
+}
+
+static void freeTask(gpointer data)
+{
+    delete (std::function<void()> *) data;
+}
+
+PolySynaptic::Dispatcher RGMainLoopDispatcher()
+{
+    return [](std::function<void()> task) {
+        g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, runTask,
+                        new std::function<void()>(std::move(task)), freeTask);
+    };
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,28 @@
+/* rgasync.h - Main loop delivery of asynchronous backend results
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file provides the Dispatcher the GTK UI gives BackendManager,
+ * so completion callbacks of asynchronous backend calls run on the
+ * main loop and may touch widgets.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RGASYNC_H_
+#define _RGASYNC_H_
+
+#include "asyncbackend.h"
+
+/**
+ * A Dispatcher posting each task to the default main context as an
+ * idle callback, in the order they were posted
+ */
+PolySynaptic::Dispatcher RGMainLoopDispatcher();
+
+#endif // _RGASYNC_H_
+
+// vim:ts=4:sw=4:et
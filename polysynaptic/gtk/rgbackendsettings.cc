@@ -167,6 +167,28 @@ void RGBackendSettingsWindow::createWidgets()
     gtk_notebook_append_page(GTK_NOTEBOOK(notebook), flatpakPage,
                              gtk_label_new("Flatpak"));
 
+    // ========================================================================
+    // Updates Tab
+    // ========================================================================
+    GtkWidget* updatesPage = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
+    gtk_container_set_border_width(GTK_CONTAINER(updatesPage), 10);
+
+    _predownloadCheck = gtk_check_button_new_with_label(
+        "Download updates in the background");
+    gtk_box_pack_start(GTK_BOX(updatesPage), _predownloadCheck, FALSE, FALSE, 0);
+
+    GtkWidget* updatesDesc = gtk_label_new(
+        "Pending APT and Flatpak updates are fetched at idle priority while "
+        "they wait to be applied, so applying them does not wait for the "
+        "download. Nothing is fetched on a metered connection. Snaps are "
+        "downloaded by snapd itself.");
+    gtk_label_set_line_wrap(GTK_LABEL(updatesDesc), TRUE);
+    gtk_label_set_xalign(GTK_LABEL(updatesDesc), 0);
+    gtk_box_pack_start(GTK_BOX(updatesPage), updatesDesc, FALSE, FALSE, 10);
+
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), updatesPage,
+                             gtk_label_new("Updates"));
+
     // ========================================================================
     // Dialog buttons
     // ========================================================================
@@ -234,6 +256,9 @@ void RGBackendSettingsWindow::loadCurrentSettings()
         }
     }
 
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(_predownloadCheck),
+                                 _manager->isPredownloadEnabled());
+
     populateFlatpakRemotes();
 }
 
@@ -326,6 +351,9 @@ void RGBackendSettingsWindow::applySettings()
     _manager->setBackendEnabled(BackendType::FLATPAK,
         gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(_flatpakEnabledCheck)));
 
+    _manager->setPredownloadEnabled(
+        gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(_predownloadCheck)));
+
     // Apply Flatpak settings
     auto* flatpak = _manager->getFlatpakBackend();
     if (flatpak && flatpak->isAvailable()) {
@@ -54,6 +54,8 @@ private:
     GtkWidget* _flatpakRemoteCombo;
     GtkWidget* _flatpakScopeCombo;
 
+    GtkWidget* _predownloadCheck;
+
     GtkWidget* _applyButton;
     GtkWidget* _closeButton;
 
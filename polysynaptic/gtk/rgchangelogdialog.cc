@@ -19,17 +19,247 @@
  */
 
 #include "rgchangelogdialog.h"
+#include "rgpkgdetails.h"
+#include "changelogreader.h"
+
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/version.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+
+// the buffer gets this much per idle call, and a scroll near the end
+// this much of the entries older than the installed version
+static const size_t ChunkBytes = 32 * 1024;
+static const size_t OlderPageBytes = 128 * 1024;
+
+// a download still running is read along this often
+static const guint PollMs = 150;
+
+// what the dialog, the media callback and the main loop sources share;
+// the dialog may be gone before the download is done
+struct ChangelogStream {
+   int refs;
+   RPackage *pkg;                 // only while the dialog is up
+   GtkTextBuffer *buffer;
+   GtkAdjustment *scroll;
+   PolySynaptic::ChangelogReader reader;
+   int fd;                       // on the file as it downloads
+   bool closed;
+   bool cleared;                 // the placeholder text is gone
+   deque<string> queued;         // for the buffer, in order
+   deque<string> older;          // held back until scrolled to
+   guint pollId;
+   guint idleId;
+
+   ChangelogStream(RPackage *package, GtkTextBuffer *textBuffer,
+                   GtkAdjustment *adjustment, const string &installed)
+      : refs(1), pkg(package), buffer(textBuffer), scroll(adjustment),
+        reader(installed, [](const string &a, const string &b) {
+           return _system->VS->CmpVersion(a.c_str(), b.c_str());
+        }),
+        fd(-1), closed(false), cleared(false), pollId(0), idleId(0)
+   {
+      g_object_ref(buffer);
+      g_object_ref(scroll);
+   }
+};
+
+static ChangelogStream *refStream(ChangelogStream *stream)
+{
+   stream->refs++;
+   return stream;
+}
+
+static void unrefStream(gpointer data)
+{
+   ChangelogStream *stream = (ChangelogStream *)data;
+   if (--stream->refs > 0)
+      return;
+   if (stream->fd >= 0)
+      close(stream->fd);
+   g_object_unref(stream->buffer);
+   g_object_unref(stream->scroll);
+   delete stream;
+}
+
+static void setChangelogText(GtkTextBuffer *buffer, const char *text)
+{
+   GtkTextIter start,end;
+   gtk_text_buffer_get_start_iter (buffer, &start);
+   gtk_text_buffer_get_end_iter(buffer,&end);
+   gtk_text_buffer_delete(buffer,&start,&end);
+   gtk_text_buffer_insert_at_cursor(buffer, text, -1);
+}
+
+// line by line, like the buffer was filled before
+static string changelogUtf8(const string &text)
+{
+   string out;
+   out.reserve(text.size());
+   size_t begin = 0;
+   while (begin < text.size()) {
+      size_t end = text.find('\n', begin);
+      string line = text.substr(begin, end == string::npos ? string::npos
+                                                           : end - begin);
+      // no need to free str later, it is allocated in a static buffer
+      const char *str = utf8(line.c_str());
+      if (str != NULL)
+         out += str;
+      if (end == string::npos)
+         break;
+      out += '\n';
+      begin = end + 1;
+   }
+   return out;
+}
+
+static gboolean cbAppendChunk(gpointer data)
+{
+   ChangelogStream *stream = (ChangelogStream *)data;
+
+   if (!stream->cleared) {
+      setChangelogText(stream->buffer, "");
+      stream->cleared = true;
+   }
+
+   // whole lines, so no character is cut in two
+   string chunk;
+   while (!stream->queued.empty() && chunk.size() < ChunkBytes) {
+      string &text = stream->queued.front();
+      size_t room = ChunkBytes - chunk.size();
+      size_t cut = text.size() <= room ? string::npos : text.rfind('\n', room);
+      if (cut == string::npos && (text.size() <= room || chunk.empty())) {
+         chunk += text;
+         stream->queued.pop_front();
+      } else if (cut != string::npos) {
+         chunk.append(text, 0, cut + 1);
+         text.erase(0, cut + 1);
+      } else {
+         break;
+      }
+   }
+
+   GtkTextIter end;
+   gtk_text_buffer_get_end_iter(stream->buffer, &end);
+   gtk_text_buffer_insert(stream->buffer, &end, chunk.c_str(), chunk.size());
+
+   if (!stream->queued.empty())
+      return TRUE;
+   stream->idleId = 0;
+   return FALSE;
+}
+
+static void scheduleAppend(ChangelogStream *stream)
+{
+   if (stream->idleId != 0 || stream->queued.empty())
+      return;
+   stream->idleId = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, cbAppendChunk,
+                                    refStream(stream), unrefStream);
+}
+
+// the entries older than the installed version, a page at a time
+static void appendOlder(ChangelogStream *stream)
+{
+   size_t bytes = 0;
+   while (!stream->older.empty() && bytes < OlderPageBytes) {
+      bytes += stream->older.front().size();
+      stream->queued.push_back(stream->older.front());
+      stream->older.pop_front();
+   }
+   scheduleAppend(stream);
+}
+
+static void takeEntries(ChangelogStream *stream)
+{
+   PolySynaptic::ChangelogReader::Entry entry;
+   while (stream->reader.next(entry)) {
+      string text = changelogUtf8(entry.text);
+      if (entry.newer)
+         stream->queued.push_back(text);
+      else
+         stream->older.push_back(text);
+   }
+   scheduleAppend(stream);
+}
+
+static void readAvailable(ChangelogStream *stream)
+{
+   char buf[64 * 1024];
+   ssize_t got;
+   while ((got = read(stream->fd, buf, sizeof(buf))) > 0)
+      stream->reader.feed(buf, got);
+   takeEntries(stream);
+}
+
+static gboolean cbPollDownload(gpointer data)
+{
+   ChangelogStream *stream = (ChangelogStream *)data;
+
+   if (stream->fd < 0) {
+      string partial = RGPkgDetailsWindow::partialMedia(
+         PolySynaptic::MediaKind::CHANGELOG, stream->pkg);
+      if (!partial.empty())
+         stream->fd = open(partial.c_str(), O_RDONLY | O_CLOEXEC);
+   }
+   if (stream->fd >= 0)
+      readAvailable(stream);
+   return TRUE;
+}
+
+static void cbScrolled(GtkAdjustment *adjustment, void *data)
+{
+   ChangelogStream *stream = (ChangelogStream *)data;
+
+   // within a page of the end, and nothing on its way already
+   double value = gtk_adjustment_get_value(adjustment);
+   double page = gtk_adjustment_get_page_size(adjustment);
+   double upper = gtk_adjustment_get_upper(adjustment);
+   if (value + 2 * page >= upper && stream->queued.empty())
+      appendOlder(stream);
+}
+
+// data is a referenced ChangelogStream, the dialog may be gone already
+static void cbChangelogReady(const string &filename, void *data)
+{
+   ChangelogStream *stream = (ChangelogStream *)data;
+
+   if (stream->pollId != 0) {
+      g_source_remove(stream->pollId);
+      stream->pollId = 0;
+   }
+   if (stream->closed) {
+      unrefStream(stream);
+      return;
+   }
+
+   // a file read along is renamed, not replaced, so it reads on
+   if (!filename.empty()) {
+      if (stream->fd < 0)
+         stream->fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+      if (stream->fd >= 0)
+         readAvailable(stream);
+   }
+   stream->reader.finish();
+   takeEntries(stream);
+
+   if (filename.empty()) {
+      const char *failed = "Failed to download the list of changes. \n"
+                           "Please check your Internet connection.\n";
+      if (stream->cleared || !stream->queued.empty()) {
+         stream->queued.push_back(string("\n") + failed);
+         scheduleAppend(stream);
+      } else {
+         setChangelogText(stream->buffer, failed);
+         stream->cleared = true;
+      }
+   }
+   unrefStream(stream);
+}
 
 void ShowChangelogDialog(RGWindow *me, RPackage *pkg)
 {
-   RGFetchProgress *status = new RGFetchProgress(me);;
-   status->setDescription(_("Downloading Changelog"),
-			  _("The changelog contains information about the"
-             " changes and closed bugs in each version of"
-             " the package."));
-   pkgAcquire fetcher(status);
-   string filename = pkg->getChangelogFile(&fetcher);
-   
    RGGtkBuilderUserDialog dia(me,"changelog");
 
    // set title
@@ -48,24 +278,46 @@ void ShowChangelogDialog(RGWindow *me, RPackage *pkg)
                                      "textview_changelog"));
    assert(textview);
    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(textview));
-   GtkTextIter start,end;
-   gtk_text_buffer_get_start_iter (buffer, &start);
-   gtk_text_buffer_get_end_iter(buffer,&end);
-   gtk_text_buffer_delete(buffer,&start,&end);
-   
-   ifstream in(filename.c_str());
-   string s;
-   while(getline(in, s)) {
-      // no need to free str later, it is allocated in a static buffer
-      const char *str = utf8(s.c_str());
-      if(str!=NULL)
-	 gtk_text_buffer_insert_at_cursor(buffer, str, -1);
-      gtk_text_buffer_insert_at_cursor(buffer, "\n", -1);
+
+   // no need to translate this, the changelog is in english anyway
+   string uri = pkg->getChangelogURI();
+   if (uri.empty()) {
+      string msg = string("This change is not coming from a source that "
+                          "supports changelogs.\n\n"
+                          "Failed to fetch the changelog for ") +
+                   pkg->name() + "\n";
+      setChangelogText(buffer, msg.c_str());
+      dia.run();
+      return;
    }
+
+   // shown as it downloads, the part since the installed version
+   // first; the older entries follow as the view is scrolled down
+   setChangelogText(buffer, _("Downloading Changelog"));
+   GtkAdjustment *scroll = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(textview));
+   const char *installed = pkg->installedVersion();
+   ChangelogStream *stream = new ChangelogStream(pkg, buffer, scroll,
+                                                 installed ? installed : "");
+   gulong scrolled = g_signal_connect(G_OBJECT(scroll), "value-changed",
+                                      G_CALLBACK(cbScrolled), stream);
+   gulong resized = g_signal_connect(G_OBJECT(scroll), "changed",
+                                     G_CALLBACK(cbScrolled), stream);
+   stream->pollId = g_timeout_add_full(G_PRIORITY_DEFAULT, PollMs,
+                                       cbPollDownload, refStream(stream),
+                                       unrefStream);
+   RGPkgDetailsWindow::requestMedia(PolySynaptic::MediaKind::CHANGELOG,
+                                    pkg, cbChangelogReady, refStream(stream));
    
    dia.run();
 
-   // clean up
-   delete status;
-   unlink(filename.c_str());
+   stream->closed = true;
+   g_signal_handler_disconnect(scroll, scrolled);
+   g_signal_handler_disconnect(scroll, resized);
+   if (stream->pollId != 0)
+      g_source_remove(stream->pollId);
+   stream->pollId = 0;
+   if (stream->idleId != 0)
+      g_source_remove(stream->idleId);
+   stream->idleId = 0;
+   unrefStream(stream);
 }
@@ -42,6 +42,7 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/install-progress.h>
+#include <apt-pkg/strutl.h>
 #include <gtk/gtk.h>
 
 #include <unistd.h>
@@ -55,13 +56,12 @@
 
 #include "i18n.h"
 
-void RGDebInstallProgress::child_exited(VteTerminal *vteterminal,
-					gint ret,
+void RGDebInstallProgress::child_exited(GPid pid, gint status,
 					gpointer data)
 {
    RGDebInstallProgress *me = (RGDebInstallProgress*)data;
 
-   me->res = (pkgPackageManager::OrderResult)WEXITSTATUS(ret);
+   me->res = (pkgPackageManager::OrderResult)WEXITSTATUS(status);
    me->child_has_exited=true;
 }
 
@@ -277,9 +277,9 @@ void RGDebInstallProgress::conffile(gchar *conffile, gchar *status)
 
    int res = dia.run(NULL,true);
    if(res ==  GTK_RESPONSE_YES)
-      vte_terminal_feed_child(VTE_TERMINAL(_term), "y\n",2);
+      _feed->write("y\n",2);
    else
-      vte_terminal_feed_child(VTE_TERMINAL(_term), "n\n",2);
+      _feed->write("n\n",2);
 
    // update the "action" clock
    last_term_action = time(NULL);
@@ -322,6 +322,7 @@ bool RGDebInstallProgress::close()
 
 RGDebInstallProgress::~RGDebInstallProgress()
 {
+   delete _feed;
    delete _userDialog;
    g_object_unref(_cssProvider);
 }
@@ -330,13 +331,18 @@ RGDebInstallProgress::RGDebInstallProgress(RGMainWindow *main,
 					   RPackageLister *lister)
 
    : RInstallProgress(), RGGtkBuilderWindow(main, "rgdebinstall_progress"),
-     _totalActions(0), _progress(0), _sock(0), _userDialog(0)
+     _totalActions(0), _progress(0), _feed(0), _sock(0), _userDialog(0),
+     _statusChannel(0), _statusWatch(0), _frameTimeout(0), _tickTimeout(0),
+     _pendingFraction(-1), _history(0), _predictedTotal(0), _packageStart(0),
+     _shownFraction(0)
 
 {
    // timeout in sec until the expander is expanded 
    // (bigger nowdays because of the gconf stuff)
    _terminalTimeout=_config->FindI("Synaptic::TerminalTimeout",120);
 
+   if (main->getBackendManager())
+      _history = &main->getBackendManager()->getOperationHistory();
    prepare(lister);
    setTitle(_("Applying Changes"));
 
@@ -368,7 +374,7 @@ RGDebInstallProgress::RGDebInstallProgress(RGMainWindow *main,
    GtkWidget *scrollbar = gtk_scrollbar_new (GTK_ORIENTATION_VERTICAL,
                                              gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(VTE_TERMINAL(_term))));
    gtk_widget_set_can_focus (scrollbar, FALSE);
-   vte_terminal_set_scrollback_lines(VTE_TERMINAL(_term), 10000);
+   _feed = new RGTermFeed(VTE_TERMINAL(_term));
 
    const char *s;
    if(_config->FindB("Synaptic::useUserTerminalFont")) {
@@ -419,9 +425,11 @@ RGDebInstallProgress::RGDebInstallProgress(RGMainWindow *main,
    g_signal_connect(gtk_builder_get_object(_builder, "button_close"),
                     "clicked",
                     G_CALLBACK(cbClose), this);
-   g_signal_connect(VTE_TERMINAL(_term), "child-exited",
-		    G_CALLBACK(child_exited),
-		    this);
+   // a collapsed terminal is not drawn to at all
+   GtkWidget *expander = GTK_WIDGET(gtk_builder_get_object(_builder, "expander_terminal"));
+   _feed->setRendering(gtk_expander_get_expanded(GTK_EXPANDER(expander)));
+   g_signal_connect(expander, "notify::expanded",
+		    G_CALLBACK(expander_callback), this);
 
    if(_userDialog == NULL)
       _userDialog = new RGUserDialog(this);
@@ -445,6 +453,15 @@ void RGDebInstallProgress::content_changed(GObject *object,
    me->last_term_action = time(NULL);
 }
 
+void RGDebInstallProgress::expander_callback(GObject *object,
+					     GParamSpec *param_spec,
+					     gpointer data)
+{
+   RGDebInstallProgress *me = (RGDebInstallProgress*)data;
+
+   me->_feed->setRendering(gtk_expander_get_expanded(GTK_EXPANDER(object)));
+}
+
 gboolean RGDebInstallProgress::key_press_event(GtkWidget *widget, 
                                                GdkEventKey *event, 
                                                gpointer user_data)
@@ -519,113 +536,215 @@ void RGDebInstallProgress::terminalAction(GtkWidget *terminal,
    }
 }
 
-void RGDebInstallProgress::updateInterface()
+// dpkg writes a status line per package stage, thousands of them on a
+// big upgrade; they are read in bulk as they arrive and only the last
+// state of each frame is drawn
+static const int STATUS_FRAME_MS = 1000/25;
+
+void RGDebInstallProgress::readStatus()
 {
-   char buf[2];
-   static char line[1024] = "";
-   int i=0;
+   char buf[65536];
+   ssize_t len;
 
-   while (1) {
+   while ((len = read(_childin, buf, sizeof(buf))) > 0) {
+      _statusBuffer.append(buf, len);
+      // update the time we last saw some action
+      last_term_action = time(NULL);
+   }
 
-      // This algorithm should be improved (it's the same as the rpm one ;)
-      int len = read(_childin, buf, 1);
+   // parse every complete line in place, keep the rest for next time
+   size_t begin = 0, end;
+   while ((end = _statusBuffer.find('\n', begin)) != string::npos) {
+      _statusBuffer[end] = 0;
+      parseStatusLine(&_statusBuffer[begin]);
+      begin = end + 1;
+   }
+   _statusBuffer.erase(0, begin);
+}
 
-      // nothing was read
-      if(len < 1) 
-	 break;
+// status:pkg:percent:message, where the message may contain ':'
+void RGDebInstallProgress::parseStatusLine(char *line)
+{
+   gchar *split[4] = { line, NULL, NULL, NULL };
+   for (int i = 1; i < 4; i++) {
+      split[i] = strchr(split[i - 1], ':');
+      if (split[i] == NULL)
+         break;
+      *split[i]++ = 0;
+   }
 
-      // update the time we last saw some action
-      last_term_action = time(NULL);
+   // major problem here, we got unexpected input. should _never_ happen
+   if (split[1] == NULL)
+      return;
+
+   gchar *status = g_strstrip(split[0]);
+   gchar *pkg = g_strstrip(split[1]);
+   gchar *percent = split[2] ? g_strstrip(split[2]) : NULL;
+   gchar *str = split[3] ? g_strstrip(split[3]) : NULL;
+
+   // first check for errors and conf-file prompts
+   if(strstr(status, "pmerror") != NULL) { 
+      // error from dpkg, needs to be parsed different
+      gchar *msg = g_strdup_printf(_("Error in package %s"), pkg);
+      _pendingStatus = msg;
+      g_free(msg);
+      string err = pkg + string(": ") + (str ? str : "");
+      _error->Error("%s",utf8(err.c_str()));
+      str = NULL;
+   } else if(strstr(status, "pmrecover") != NULL) { 
+      // running dpkg --configure -a
+      _pendingStatus = _("Trying to recover from package failure");
+      str = NULL;
+   } else if(strstr(status, "pmconffile") != NULL && str != NULL) {
+      // conffile-request from dpkg, needs to be parsed different;
+      // show what came before the prompt first
+      flushFrame();
+      conffile(pkg, str);
+   } else {
+      _startCounting = true;
+      notePackage(pkg);
+   }
+
+   if (percent != NULL)
+      _pendingFraction = atof(percent)/100.0;
+   if (str != NULL)
+      _pendingStatus = utf8(str);
 
-      if( buf[0] == '\n') {
-	 //cout << "got line: " << line << endl;
-	 
-	 gchar **split = g_strsplit(line, ":",4);
-	 gchar *status = g_strstrip(split[0]);
-	 gchar *pkg = g_strstrip(split[1]);
-	 gchar *percent = g_strstrip(split[2]);
-	 gchar *str = g_strdup(g_strstrip(split[3]));
-
-	 // major problem here, we got unexpected input. should _never_ happen
-	 if(!(pkg && status))
-	    continue;
-
-	 // first check for errors and conf-file prompts
-	 if(strstr(status, "pmerror") != NULL) { 
-	    // error from dpkg, needs to be parsed different
-	    str = g_strdup_printf(_("Error in package %s"), split[1]);
-	    gtk_label_set_text(GTK_LABEL(_label_status), str);
-	    string err = split[1] + string(": ") + split[3];
-	    _error->Error("%s",utf8(err.c_str()));
-	 // first check for errors and conf-file prompts
-	 } else if(strstr(status, "pmrecover") != NULL) { 
-	    // running dpkg --configure -a
-	    str = g_strdup(_("Trying to recover from package failure"));
-	    gtk_label_set_text(GTK_LABEL(_label_status), str);
-	 } else if(strstr(status, "pmconffile") != NULL) {
-	    // conffile-request from dpkg, needs to be parsed different
-	    //cout << split[2] << " " << split[3] << endl;
-	    conffile(pkg, split[3]);
-	 } else {
-	    _startCounting = true;
-            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(_pbarTotal), 0);
-	 }
-
-	 // reset the urgency hint, something changed on the terminal
-	 if(gtk_window_get_urgency_hint(GTK_WINDOW(_win)))
-	    gtk_window_set_urgency_hint(GTK_WINDOW(_win), FALSE);
-
-	 float val = atof(percent)/100.0;
- 	 //cout << "progress: " << val << endl;
-         if (fabs(val-gtk_progress_bar_get_fraction(GTK_PROGRESS_BAR(_pbarTotal))) > 0.1)
-            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(_pbarTotal), val);
-
-	 if(str!=NULL)
-	    gtk_label_set_text(GTK_LABEL(_label_status),utf8(str));
-	 
-	 // clean-up
-	 g_strfreev(split);
-	 g_free(str);
-	 line[0] = 0;
+   queueFrame();
+}
+
+// dpkg goes over the packages more than once (unpacking all of them,
+// then configuring them); the time until the next line goes to the
+// package this one is about
+void RGDebInstallProgress::notePackage(const char *pkg)
+{
+   gint64 now = g_get_monotonic_time();
+   if (!_currentPackage.empty())
+      _spent[_currentPackage] += (now - _packageStart) / 1e6;
+   _currentPackage = pkg;
+   _packageStart = now;
+}
+
+// each package counts for up to its predicted time until it is done;
+// left is the predicted time the others still have
+double RGDebInstallProgress::predictedFraction(double &left)
+{
+   double done = 0;
+   for (map<string, double>::iterator it = _predicted.begin();
+        it != _predicted.end(); it++) {
+      map<string, double>::iterator spent = _spent.find(it->first);
+      if (spent != _spent.end())
+         done += MIN(spent->second, it->second);
+   }
+   left = MAX(_predictedTotal - done, 0.0);
+   return done / _predictedTotal;
+}
+
+void RGDebInstallProgress::queueFrame()
+{
+   if (_frameTimeout == 0)
+      _frameTimeout = g_timeout_add(STATUS_FRAME_MS, cbFrame, this);
+}
+
+void RGDebInstallProgress::flushFrame()
+{
+   if (_frameTimeout != 0) {
+      g_source_remove(_frameTimeout);
+      _frameTimeout = 0;
+   }
+
+   // reset the urgency hint, something changed on the terminal
+   if(gtk_window_get_urgency_hint(GTK_WINDOW(_win)))
+      gtk_window_set_urgency_hint(GTK_WINDOW(_win), FALSE);
+
+   if (_pendingFraction >= 0 && _predictedTotal > 0) {
+      // by the predicted time, not dpkg's count of stages
+      double left;
+      _shownFraction = MAX(_shownFraction, predictedFraction(left));
+      gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(_pbarTotal),
+                                    CLAMP(_shownFraction, 0.0, 1.0));
+      if (left >= 1) {
+         gchar *text = g_strdup_printf(_("About %s remaining"),
+                                       TimeToStr((unsigned long)left).c_str());
+         gtk_progress_bar_set_text(GTK_PROGRESS_BAR(_pbarTotal), text);
+         gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(_pbarTotal), TRUE);
+         g_free(text);
       } else {
-	 buf[1] = 0;
-	 strcat(line, buf);
-      }      
+         gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(_pbarTotal), FALSE);
+      }
+      _pendingFraction = -1;
+   } else if (_pendingFraction >= 0) {
+      gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(_pbarTotal),
+                                    CLAMP(_pendingFraction, 0.0, 1.0));
+      _pendingFraction = -1;
+   }
+   if (!_pendingStatus.empty()) {
+      gtk_label_set_text(GTK_LABEL(_label_status), _pendingStatus.c_str());
+      _pendingStatus.clear();
+   }
+}
+
+gboolean RGDebInstallProgress::cbStatusReadable(GIOChannel *source,
+                                                GIOCondition cond,
+                                                gpointer data)
+{
+   RGDebInstallProgress *me = (RGDebInstallProgress*)data;
+
+   me->readStatus();
+   if (cond & (G_IO_HUP | G_IO_ERR)) {
+      // the writer is gone, nothing more will come
+      me->_statusWatch = 0;
+      return FALSE;
    }
+   return TRUE;
+}
 
+gboolean RGDebInstallProgress::cbFrame(gpointer data)
+{
+   RGDebInstallProgress *me = (RGDebInstallProgress*)data;
+
+   me->_frameTimeout = 0;
+   me->flushFrame();
+   return FALSE;
+}
+
+gboolean RGDebInstallProgress::cbTick(gpointer data)
+{
+   RGDebInstallProgress *me = (RGDebInstallProgress*)data;
    time_t now = time(NULL);
 
-   if(!_startCounting) {
-      usleep(100000);
-      gtk_progress_bar_pulse (GTK_PROGRESS_BAR(_pbarTotal));
+   // the terminal only sees the output while it is expanded
+   if (me->_feed->lastOutput() > me->last_term_action)
+      me->last_term_action = me->_feed->lastOutput();
+
+   if(!me->_startCounting) {
+      gtk_progress_bar_pulse (GTK_PROGRESS_BAR(me->_pbarTotal));
       // wait until we get the first message from apt
-      last_term_action = now;
+      me->last_term_action = now;
    }
 
-
-   if ((now - last_term_action) > _terminalTimeout) {
+   if ((now - me->last_term_action) > me->_terminalTimeout) {
       // get some debug info
-      const gchar *s = gtk_label_get_text(GTK_LABEL(_label_status));
+      const gchar *s = gtk_label_get_text(GTK_LABEL(me->_label_status));
       g_warning("no statusfd changes/content updates in terminal for %i" 
-		" seconds",_terminalTimeout);
+		" seconds",me->_terminalTimeout);
       g_warning("TerminalTimeout in step: %s", s);
       // now expand the terminal
       GtkWidget *w;
-      w = GTK_WIDGET(gtk_builder_get_object(_builder, "expander_terminal"));
+      w = GTK_WIDGET(gtk_builder_get_object(me->_builder, "expander_terminal"));
       gtk_expander_set_expanded(GTK_EXPANDER(w), TRUE);
-      last_term_action = time(NULL);
+      me->last_term_action = time(NULL);
       // try to get the attention of the user
-      gtk_window_set_urgency_hint(GTK_WINDOW(_win), TRUE);
+      gtk_window_set_urgency_hint(GTK_WINDOW(me->_win), TRUE);
    } 
+   return TRUE;
+}
 
-
-   if (gtk_events_pending()) {
-      while (gtk_events_pending())
-         gtk_main_iteration();
-   } else {
-      // 25fps
-      usleep(1000000/25);
-   }
+void RGDebInstallProgress::updateInterface()
+{
+   // sleeps until the status pipe, the terminal, a timer or the user
+   // has something for us
+   g_main_context_iteration(NULL, TRUE);
 }
 
 pkgPackageManager::OrderResult RGDebInstallProgress::start(pkgPackageManager *pm,
@@ -680,18 +799,10 @@ pkgPackageManager::OrderResult RGDebInstallProgress::start(pkgPackageManager *pm
 
       _exit(res);
    }
-   // parent: assign pty to the vte terminal
-   GError *err = NULL;
-   VtePty *pty = vte_pty_new_foreign_sync(master, NULL, &err);
-   if (err != NULL) {
-      std::cerr << "failed to create new pty: " << err->message << std::endl;
-      g_error_free (err);
-      return pkgPackageManager::Failed;
-   }
-   vte_terminal_set_pty(VTE_TERMINAL(_term), pty);
-   // FIXME: is there a race here? i.e. what if the child is dead before
-   //        we can set it?
-   vte_terminal_watch_child(VTE_TERMINAL(_term), _child_id);
+   // parent: the terminal gets what the child prints a frame at a time
+   _feed->attach(master);
+   // also reaps a child that is already gone
+   g_child_watch_add(_child_id, child_exited, this);
 
    _childin = ipc_recv_fd();
    if(_childin < 0) {
@@ -708,10 +819,35 @@ pkgPackageManager::OrderResult RGDebInstallProgress::start(pkgPackageManager *pm
    _numPackages = numPackages;
    _numPackagesTotal = numPackagesTotal;
 
+   _statusBuffer.clear();
+   if (_childin >= 0) {
+      _statusChannel = g_io_channel_unix_new(_childin);
+      _statusWatch = g_io_add_watch(_statusChannel,
+                                    (GIOCondition)(G_IO_IN | G_IO_HUP | G_IO_ERR),
+                                    cbStatusReadable, this);
+   }
+   // pulses until the first status line, and watches for a stuck terminal
+   _tickTimeout = g_timeout_add(100, cbTick, this);
+
    startUpdate();
    while(!child_has_exited)
       updateInterface();
 
+   // whatever the child wrote before it exited
+   if (_statusWatch != 0) {
+      g_source_remove(_statusWatch);
+      _statusWatch = 0;
+      readStatus();
+   }
+   if (_statusChannel != NULL) {
+      g_io_channel_unref(_statusChannel);
+      _statusChannel = NULL;
+   }
+   g_source_remove(_tickTimeout);
+   _tickTimeout = 0;
+   flushFrame();
+   _feed->detach();
+
    finishUpdate();
 
    ::close(_childin);
@@ -724,13 +860,41 @@ pkgPackageManager::OrderResult RGDebInstallProgress::start(pkgPackageManager *pm
 
 
 
+void RGDebInstallProgress::pulse()
+{
+   gtk_label_set_text(GTK_LABEL(_label_status), _("Waiting for downloads..."));
+   gtk_progress_bar_pulse(GTK_PROGRESS_BAR(_pbarTotal));
+   RGFlushInterface();
+}
+
 void RGDebInstallProgress::finishUpdate()
 {
+   // between pipelined runs nothing is being installed
+   notePackage("");
+
+   // pipelined commit: keep the window open for the next run
+   if (_partialRun && res == pkgPackageManager::Incomplete) {
+      RGFlushInterface();
+      return;
+   }
+
    if (_startCounting) {
       gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(_pbarTotal), 1.0);
    }
    RGFlushInterface();
 
+   // what dpkg took for each package, the archives being fetched already
+   if (_history != NULL && res == pkgPackageManager::Completed) {
+      for (map<string, double>::iterator it = _spent.begin();
+           it != _spent.end(); it++) {
+         map<string, PolySynaptic::Transaction::Operation>::iterator op =
+            _planned.find(it->first);
+         if (op != _planned.end())
+            _history->record(op->second, it->second, 0);
+      }
+      _history->save();
+   }
+
    GtkWidget *_closeB = GTK_WIDGET(gtk_builder_get_object(_builder, "button_close"));
    gtk_widget_set_sensitive(_closeB, TRUE);
 
@@ -826,6 +990,31 @@ void RGDebInstallProgress::prepare(RPackageLister *lister)
    gtk_label_set_markup(GTK_LABEL(l), msg);
    g_free(msg);
 
+   if (_history == NULL)
+      return;
+   typedef PolySynaptic::Transaction::Operation Operation;
+   for (int i = 0; i < lister->packagesSize(); i++) {
+      RPackage *pkg = lister->getPackage(i);
+      int flags = pkg->getFlags();
+      Operation op;
+      op.backend = PolySynaptic::BackendType::APT;
+      op.packageId = op.packageName = pkg->name();
+      if (flags & RPackage::FRemove) {
+         op.type = Operation::Type::REMOVE;
+         op.purge = (flags & RPackage::FPurge) != 0;
+      } else if (flags & (RPackage::FUpgrade | RPackage::FDowngrade)) {
+         op.type = Operation::Type::UPDATE;
+      } else if (flags & (RPackage::FNewInstall | RPackage::FReInstall)) {
+         op.type = Operation::Type::INSTALL;
+      } else {
+         continue;
+      }
+      // the download is over by the time dpkg runs
+      op.downloadSize = 0;
+      _planned[op.packageId] = op;
+      _predicted[op.packageId] = _history->estimate(op);
+      _predictedTotal += _predicted[op.packageId];
+   }
 }
 
 #endif
@@ -31,6 +31,8 @@
 #include "rinstallprogress.h"
 #include "rggtkbuilderwindow.h"
 #include "rguserdialog.h"
+#include "rgtermfeed.h"
+#include "operationhistory.h"
 #include<map>
 #include <vte/vte.h>
 
@@ -79,6 +81,8 @@ class RGDebInstallProgress:public RInstallProgress, public RGGtkBuilderWindow
 
    GtkWidget *_pbarTotal;
    GtkWidget *_term;
+   // what the child prints, fed to _term only while it is expanded
+   RGTermFeed *_feed;
    GtkWidget *_autoClose; // checkbutton
 
    GtkWidget *_popupMenu; // Popup menu of the terminal
@@ -111,8 +115,41 @@ class RGDebInstallProgress:public RInstallProgress, public RGGtkBuilderWindow
    pid_t _child_id;
    pkgPackageManager::OrderResult res;
    bool child_has_exited;
-   static void child_exited(VteTerminal *vteterminal, gint ret,
-			    gpointer data);
+
+   // the dpkg status pipe, read whenever it has data; what arrived
+   // after the last complete line waits in _statusBuffer
+   GIOChannel *_statusChannel;
+   guint _statusWatch;
+   string _statusBuffer;
+
+   // what the status lines asked to show, put on screen once a frame
+   guint _frameTimeout;
+   guint _tickTimeout;
+   double _pendingFraction;
+   string _pendingStatus;
+
+   // what each marked package is predicted to take and has taken; the
+   // bar goes by the predictions, and the time taken is recorded
+   PolySynaptic::OperationHistory *_history;
+   map<string, PolySynaptic::Transaction::Operation> _planned;
+   map<string, double> _predicted;
+   map<string, double> _spent;
+   double _predictedTotal;
+   string _currentPackage;
+   gint64 _packageStart;
+   double _shownFraction;
+
+   void readStatus();
+   void parseStatusLine(char *line);
+   void queueFrame();
+   void flushFrame();
+   void notePackage(const char *pkg);
+   double predictedFraction(double &left);
+   static gboolean cbStatusReadable(GIOChannel *source, GIOCondition cond,
+                                    gpointer data);
+   static gboolean cbFrame(gpointer data);
+   static gboolean cbTick(gpointer data);
+   static void child_exited(GPid pid, gint status, gpointer data);
    static void terminalAction(GtkWidget *terminal, TermAction action);
 
    GtkCssProvider *_cssProvider;
@@ -121,6 +158,7 @@ class RGDebInstallProgress:public RInstallProgress, public RGGtkBuilderWindow
    virtual void startUpdate();
    virtual void updateInterface();
    virtual void finishUpdate();
+   virtual void pulse();
    virtual bool close();
 
    virtual pkgPackageManager::OrderResult start(pkgPackageManager *pm,
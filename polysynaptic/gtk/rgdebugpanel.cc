@@ -9,23 +9,90 @@
  */
 
 #include "rgdebugpanel.h"
-
+#include "binarylog.h"
+#include "tracing.h"
+#include "latency.h"
+#include "memoryusage.h"
+#include "stallwatch.h"
+#include "metrics.h"
+#include "frametiming.h"
+
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <cstdlib>
+#include <ctime>
 
 namespace PolySynaptic {
 
+// The log view keeps this many entries, and takes new ones this often
+static const size_t LOG_VIEW_MAX_ROWS = 10000;
+static const guint LOG_FRAME_MS = 1000 / 25;
+
+static std::string formatBytes(uint64_t bytes) {
+    std::ostringstream ss;
+    if (bytes >= 1024 * 1024) {
+        ss << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " MB";
+    } else if (bytes >= 1024) {
+        ss << std::fixed << std::setprecision(1) << bytes / 1024.0 << " KB";
+    } else {
+        ss << bytes << " B";
+    }
+    return ss.str();
+}
+
+// "now", "-90m", "-2h", "-1d" or a UTC time like 2024-10-14T09:30
+static bool parseLogTime(const std::string& text, time_t& time) {
+    time_t now = ::time(nullptr);
+    if (text == "now") {
+        time = now;
+        return true;
+    }
+    if (text.size() > 2 && text[0] == '-') {
+        char unit = text.back();
+        long n = std::atol(text.substr(1, text.size() - 2).c_str());
+        long scale = unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0;
+        if (scale == 0 || n <= 0) return false;
+        time = now - n * scale;
+        return true;
+    }
+    struct tm utc = {};
+    const char* end = strptime(text.c_str(), "%Y-%m-%dT%H:%M", &utc);
+    if (!end) return false;
+    if (*end == ':') {
+        end = strptime(end + 1, "%S", &utc);
+        if (!end) return false;
+    }
+    if (*end != '\0') return false;
+    time = timegm(&utc);
+    return true;
+}
+
 // ============================================================================
 // RGDebugPanel Implementation
 // ============================================================================
 
 RGDebugPanel::RGDebugPanel() {
     buildUI();
+    // Owned here, so it outlives the dialogs that show it
+    g_object_ref_sink(_notebook);
     registerCommands();
+
+    // Follow the logger's own buffer until told otherwise
+    updateLogs(Logger::instance().getMemorySink());
 }
 
-RGDebugPanel::~RGDebugPanel() {}
+RGDebugPanel::~RGDebugPanel() {
+    if (_latencyTimer != 0) {
+        g_source_remove(_latencyTimer);
+    }
+    if (_logFrameTimer != 0) {
+        g_source_remove(_logFrameTimer);
+    }
+    gtk_widget_destroy(_notebook);
+    g_object_unref(_notebook);
+}
 
 void RGDebugPanel::buildUI() {
     _notebook = gtk_notebook_new();
@@ -103,17 +170,32 @@ void RGDebugPanel::buildLogTab() {
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled),
                                     GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
 
-    _logView = gtk_text_view_new();
-    _logBuffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(_logView));
-    gtk_text_view_set_editable(GTK_TEXT_VIEW(_logView), FALSE);
-    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(_logView), GTK_WRAP_WORD_CHAR);
-    gtk_text_view_set_monospace(GTK_TEXT_VIEW(_logView), TRUE);
-
-    createTextTags();
+    // One line per entry at a fixed height, so the view only asks the
+    // model for the rows on screen
+    _logList = rg_log_list_new(LOG_VIEW_MAX_ROWS);
+    _logView = gtk_tree_view_new_with_model(GTK_TREE_MODEL(_logList));
+    g_object_unref(_logList);
+    gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(_logView), FALSE);
+    gtk_tree_view_set_enable_search(GTK_TREE_VIEW(_logView), FALSE);
+
+    GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+    g_object_set(renderer, "family", "Monospace", nullptr);
+    GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes(
+        "Log", renderer,
+        "text", LOG_COL_TEXT,
+        "foreground", LOG_COL_FOREGROUND,
+        "cell-background", LOG_COL_BACKGROUND,
+        "weight", LOG_COL_WEIGHT,
+        nullptr);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(_logView), column);
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(_logView), TRUE);
 
     gtk_container_add(GTK_CONTAINER(scrolled), _logView);
     gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
 
+    _logFrameTimer = g_timeout_add(LOG_FRAME_MS, onLogFrame, this);
+
     // Add to notebook
     GtkWidget* tabLabel = gtk_label_new("Logs");
     gtk_notebook_append_page(GTK_NOTEBOOK(_notebook), vbox, tabLabel);
@@ -255,8 +337,79 @@ void RGDebugPanel::buildMetricsTab() {
     addMetric("Memory Usage:", "memory_usage");
     addMetric("Active Operations:", "active_ops");
 
+    // Latency percentiles per backend and operation
+    GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_box_pack_start(GTK_BOX(vbox), _metricsGrid, FALSE, FALSE, 0);
+
+    GtkWidget* scrolled = gtk_scrolled_window_new(nullptr, nullptr);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled),
+                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+
+    _latencyStore = gtk_list_store_new(7,
+        G_TYPE_STRING,   // Backend
+        G_TYPE_STRING,   // Operation
+        G_TYPE_UINT64,   // Count
+        G_TYPE_STRING,   // p50
+        G_TYPE_STRING,   // p95
+        G_TYPE_STRING,   // p99
+        G_TYPE_STRING);  // Max
+
+    GtkWidget* tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(_latencyStore));
+    g_object_unref(_latencyStore);
+
+    const char* titles[] = { "Backend", "Operation", "Count", "p50", "p95", "p99", "Max" };
+    for (int i = 0; i < 7; i++) {
+        GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+        if (i >= 2) {
+            g_object_set(renderer, "xalign", 1.0, nullptr);
+        }
+        GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes(
+            titles[i], renderer, "text", i, nullptr);
+        if (i == 1) {
+            gtk_tree_view_column_set_expand(column, TRUE);
+        }
+        gtk_tree_view_append_column(GTK_TREE_VIEW(tree), column);
+    }
+
+    gtk_container_add(GTK_CONTAINER(scrolled), tree);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+    // Memory held per subsystem
+    GtkWidget* memoryScrolled = gtk_scrolled_window_new(nullptr, nullptr);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(memoryScrolled),
+                                    GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+
+    _memoryStore = gtk_list_store_new(3,
+        G_TYPE_STRING,   // Subsystem
+        G_TYPE_UINT64,   // Items
+        G_TYPE_STRING);  // Size
+
+    GtkWidget* memoryTree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(_memoryStore));
+    g_object_unref(_memoryStore);
+
+    const char* memoryTitles[] = { "Subsystem", "Items", "Size" };
+    for (int i = 0; i < 3; i++) {
+        GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+        if (i >= 1) {
+            g_object_set(renderer, "xalign", 1.0, nullptr);
+        }
+        GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes(
+            memoryTitles[i], renderer, "text", i, nullptr);
+        if (i == 0) {
+            gtk_tree_view_column_set_expand(column, TRUE);
+        }
+        gtk_tree_view_append_column(GTK_TREE_VIEW(memoryTree), column);
+    }
+
+    gtk_container_add(GTK_CONTAINER(memoryScrolled), memoryTree);
+    gtk_box_pack_start(GTK_BOX(vbox), memoryScrolled, TRUE, TRUE, 0);
+
+    _latencyTimer = g_timeout_add_seconds(1, onLatencyTimer, this);
+    updateLatencies();
+    updateMemory();
+
     GtkWidget* tabLabel = gtk_label_new("Metrics");
-    gtk_notebook_append_page(GTK_NOTEBOOK(_notebook), _metricsGrid, tabLabel);
+    gtk_notebook_append_page(GTK_NOTEBOOK(_notebook), vbox, tabLabel);
 }
 
 void RGDebugPanel::showDialog(GtkWindow* parent) {
@@ -296,34 +449,22 @@ void RGDebugPanel::showDialog(GtkWindow* parent) {
 void RGDebugPanel::updateLogs(std::shared_ptr<MemorySink> sink) {
     if (!sink) return;
 
-    auto entries = sink->getEntriesFiltered(_minLevel, _providerFilter, _operationFilter);
-
-    // Clear and repopulate
-    gtk_text_buffer_set_text(_logBuffer, "", 0);
-
-    for (const auto& entry : entries) {
-        appendLogText(entry);
-    }
-
-    if (_autoScroll) {
-        scrollToEnd();
+    // A new sink is read from its oldest entry; the same one goes on
+    // from where the last frame stopped
+    if (sink != _logSink) {
+        _logSink = sink;
+        _logSinkSeq = 0;
     }
+    flushLogs();
 }
 
 void RGDebugPanel::addLogEntry(const LogEntry& entry) {
-    if (entry.level < _minLevel) return;
-    if (!_providerFilter.empty() && entry.provider != _providerFilter) return;
-    if (!_operationFilter.empty() && entry.operation != _operationFilter) return;
-
-    appendLogText(entry);
-
-    if (_autoScroll) {
-        scrollToEnd();
-    }
+    _pendingLogs.push_back(entry);
 }
 
 void RGDebugPanel::clearLogs() {
-    gtk_text_buffer_set_text(_logBuffer, "", 0);
+    flushLogs();
+    rg_log_list_clear(_logList, GTK_TREE_VIEW(_logView));
 }
 
 void RGDebugPanel::setMinLogLevel(LogLevel level) {
@@ -347,24 +488,28 @@ bool RGDebugPanel::exportLogs(const std::string& path, bool asJson) {
         return false;
     }
 
-    GtkTextIter start, end;
-    gtk_text_buffer_get_bounds(_logBuffer, &start, &end);
-    char* text = gtk_text_buffer_get_text(_logBuffer, &start, &end, FALSE);
+    // What the view shows, filters applied
+    flushLogs();
+    auto entries = rg_log_list_visible_entries(_logList);
 
     if (asJson) {
         file << "[";
-        // Would need to parse and convert to JSON array
-        // For now, just output as text wrapped in JSON
-        file << "{\"logs\":\"" << text << "\"}";
-        file << "]";
+        for (size_t i = 0; i < entries.size(); i++) {
+            file << (i > 0 ? ",\n" : "\n") << entries[i]->toJson();
+        }
+        file << "\n]\n";
     } else {
-        file << text;
+        for (const LogEntry* entry : entries) {
+            file << entry->toReadable() << "\n";
+        }
     }
 
-    g_free(text);
     file.close();
+    return !file.fail();
+}
 
-    return true;
+bool RGDebugPanel::exportTrace(const std::string& path) {
+    return Tracer::instance().exportChromeTrace(path);
 }
 
 std::string RGDebugPanel::executeCommand(const std::string& command) {
@@ -431,51 +576,129 @@ void RGDebugPanel::updateMetrics(const PerformanceMetrics& metrics) {
     gtk_label_set_text(GTK_LABEL(_metricLabels["active_ops"]), ss.str().c_str());
 }
 
-void RGDebugPanel::createTextTags() {
-    gtk_text_buffer_create_tag(_logBuffer, "debug",
-        "foreground", "#888888", nullptr);
-    gtk_text_buffer_create_tag(_logBuffer, "info",
-        "foreground", "#000000", nullptr);
-    gtk_text_buffer_create_tag(_logBuffer, "warn",
-        "foreground", "#f57c00", "weight", PANGO_WEIGHT_BOLD, nullptr);
-    gtk_text_buffer_create_tag(_logBuffer, "error",
-        "foreground", "#d32f2f", "weight", PANGO_WEIGHT_BOLD, nullptr);
-    gtk_text_buffer_create_tag(_logBuffer, "fatal",
-        "foreground", "#ffffff", "background", "#d32f2f",
-        "weight", PANGO_WEIGHT_BOLD, nullptr);
-}
-
-const char* RGDebugPanel::getTagForLevel(LogLevel level) {
-    switch (level) {
-        case LogLevel::DEBUG: return "debug";
-        case LogLevel::INFO: return "info";
-        case LogLevel::WARN: return "warn";
-        case LogLevel::ERROR: return "error";
-        case LogLevel::FATAL: return "fatal";
+void RGDebugPanel::updateLatencies() {
+    auto format = [](double ms) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(ms < 10 ? 2 : 0) << ms << " ms";
+        return ss.str();
+    };
+
+    gtk_list_store_clear(_latencyStore);
+    for (const auto& entry : LatencyRegistry::instance().snapshot()) {
+        if (entry.stats.count == 0) continue;
+
+        GtkTreeIter iter;
+        gtk_list_store_append(_latencyStore, &iter);
+        gtk_list_store_set(_latencyStore, &iter,
+            0, entry.backend.c_str(),
+            1, entry.operation.c_str(),
+            2, static_cast<guint64>(entry.stats.count),
+            3, format(entry.stats.p50).c_str(),
+            4, format(entry.stats.p95).c_str(),
+            5, format(entry.stats.p99).c_str(),
+            6, format(entry.stats.max).c_str(),
+            -1);
+    }
+
+    // Painting, as the main window's frame clock measures it
+    FrameTiming& frames = FrameTiming::instance();
+    if (frames.frames() > 0) {
+        LatencyStats paint = LatencyRegistry::instance().histogram("Frames", "paint").stats();
+        std::string text = format(paint.p50) + " median, " + format(paint.p95) + " p95, " +
+                           std::to_string(frames.droppedFrames()) + " frames dropped";
+        gtk_label_set_text(GTK_LABEL(_metricLabels["ui_render_time"]), text.c_str());
     }
-    return "info";
 }
 
-void RGDebugPanel::appendLogText(const LogEntry& entry) {
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(_logBuffer, &end);
+bool RGDebugPanel::exportLatencies(const std::string& path) {
+    return LatencyRegistry::instance().exportJson(path);
+}
+
+void RGDebugPanel::updateMemory() {
+    uint64_t inMemory = 0;
+
+    gtk_list_store_clear(_memoryStore);
+    for (const auto& usage : MemoryRegistry::instance().snapshot()) {
+        std::string size = formatBytes(usage.bytes);
+        if (usage.onDisk) {
+            size += " on disk";
+        } else {
+            inMemory += usage.bytes;
+        }
+
+        GtkTreeIter iter;
+        gtk_list_store_append(_memoryStore, &iter);
+        gtk_list_store_set(_memoryStore, &iter,
+            0, usage.subsystem.c_str(),
+            1, static_cast<guint64>(usage.items),
+            2, size.c_str(),
+            -1);
+    }
+
+    gtk_label_set_text(GTK_LABEL(_metricLabels["memory_usage"]),
+                       (formatBytes(inMemory) + " accounted").c_str());
+}
+
+bool RGDebugPanel::exportMemory(const std::string& path) {
+    return MemoryRegistry::instance().exportJson(path);
+}
+
+gboolean RGDebugPanel::onLatencyTimer(gpointer data) {
+    auto* self = static_cast<RGDebugPanel*>(data);
+    self->updateLatencies();
+    self->updateMemory();
+    return G_SOURCE_CONTINUE;
+}
+
+void RGDebugPanel::flushLogs() {
+    std::vector<LogEntry> batch;
+    if (_logSink && _logSink->written() != _logSinkSeq) {
+        uint64_t first = 0;
+        batch = _logSink->getEntriesSince(_logSinkSeq, first);
+        _logSinkSeq = first + batch.size();
+    }
+    if (!_pendingLogs.empty()) {
+        batch.insert(batch.end(), _pendingLogs.begin(), _pendingLogs.end());
+        _pendingLogs.clear();
+    }
+    if (batch.empty()) return;
 
-    std::string text = entry.toReadable() + "\n";
-    gtk_text_buffer_insert_with_tags_by_name(
-        _logBuffer, &end, text.c_str(), -1,
-        getTagForLevel(entry.level), nullptr);
+    rg_log_list_append(_logList, batch, rg_log_list_next_seq(_logList));
+
+    if (_autoScroll) {
+        scrollToEnd();
+    }
 }
 
 void RGDebugPanel::applyLogFilters() {
-    // Re-filter would require re-fetching from source
-    // For now, just mark that filters changed
+    RGLogFilter filter;
+    filter.minLevel = _minLevel;
+    filter.provider = _providerFilter;
+    filter.operation = _operationFilter;
+    filter.search = _searchFilter;
+
+    flushLogs();
+    rg_log_list_set_filter(_logList, filter, GTK_TREE_VIEW(_logView));
+
+    if (_autoScroll) {
+        scrollToEnd();
+    }
 }
 
 void RGDebugPanel::scrollToEnd() {
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(_logBuffer, &end);
-    gtk_text_view_scroll_to_iter(GTK_TEXT_VIEW(_logView), &end,
-                                  0.0, FALSE, 0.0, 0.0);
+    gint rows = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(_logList), nullptr);
+    if (rows == 0) return;
+
+    GtkTreePath* path = gtk_tree_path_new_from_indices(rows - 1, -1);
+    gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(_logView), path, nullptr,
+                                 FALSE, 0.0, 0.0);
+    gtk_tree_path_free(path);
+}
+
+gboolean RGDebugPanel::onLogFrame(gpointer data) {
+    auto* self = static_cast<RGDebugPanel*>(data);
+    self->flushLogs();
+    return G_SOURCE_CONTINUE;
 }
 
 void RGDebugPanel::onLevelChanged(GtkComboBox* combo, gpointer data) {
@@ -501,7 +724,10 @@ void RGDebugPanel::onProviderChanged(GtkComboBox* combo, gpointer data) {
 }
 
 void RGDebugPanel::onSearchChanged(GtkSearchEntry* entry, gpointer data) {
-    // Implement search filtering
+    auto* self = static_cast<RGDebugPanel*>(data);
+
+    self->_searchFilter = gtk_entry_get_text(GTK_ENTRY(entry));
+    self->applyLogFilters();
 }
 
 void RGDebugPanel::onClearClicked(GtkButton* button, gpointer data) {
@@ -569,7 +795,18 @@ void RGDebugPanel::registerCommands() {
                "  clear         - Clear console\n"
                "  search <term> - Search packages\n"
                "  info <pkg>    - Show package info\n"
-               "  loglevel <n>  - Set log level (0-4)\n";
+               "  loglevel <n>  - Set log level (0-4)\n"
+               "  loglimit [<per second> <burst> | sample <rate>] - Limit chatty messages\n"
+               "  logslice <from> <to> <file> - Save the log file's entries in a time range\n"
+               "  convertlog <binary> <json> - Convert a binary log to JSON lines\n"
+               "  trace on|off|clear - Record operation spans\n"
+               "  trace export <file> - Save spans as Chrome trace JSON\n"
+               "  latency clear|export <file> - Reset or save latency histograms\n"
+               "  memory [export <file>] - Show or save memory per subsystem\n"
+               "  trim          - Drop the caches that can be rebuilt\n"
+               "  diagnose      - Time every backend here against its budget\n"
+               "  stalls [full] - Show when the main loop stopped, and where\n"
+               "  metrics [export <file>] - Show or save the OpenMetrics text\n";
     };
 
     _commands["clear"] = [this](const std::vector<std::string>&) {
@@ -589,13 +826,176 @@ void RGDebugPanel::registerCommands() {
         try {
             int level = std::stoi(args[0]);
             if (level >= 0 && level <= 4) {
-                _minLevel = static_cast<LogLevel>(level);
+                setMinLogLevel(static_cast<LogLevel>(level));
                 return "Log level set to " + std::to_string(level);
             }
         } catch (...) {}
 
         return std::string("Invalid level. Use 0-4.");
     };
+
+    _commands["loglimit"] = [](const std::vector<std::string>& args) {
+        LogLimiter& limiter = Logger::instance().getLimiter();
+        if (args.empty()) {
+            std::ostringstream ss;
+            ss << limiter.getRateLimit() << " per second per message, DEBUG sampled at "
+               << limiter.getSampleRate(LogLevel::DEBUG) << ", "
+               << limiter.getSuppressedCount() << " suppressed";
+            return ss.str();
+        }
+
+        try {
+            if (args[0] == "sample" && args.size() == 2) {
+                limiter.setSampleRate(LogLevel::DEBUG, std::stod(args[1]));
+                return "DEBUG sampled at " + args[1];
+            }
+            if (args.size() == 2) {
+                limiter.setRateLimit(std::stod(args[0]), std::stod(args[1]));
+                return "Limited to " + args[0] + " per second, bursts of " + args[1];
+            }
+        } catch (...) {}
+
+        return std::string("Usage: loglimit [<per second> <burst> | sample <rate>]");
+    };
+
+    _commands["logslice"] = [this](const std::vector<std::string>& args) {
+        if (_logFile.empty()) {
+            return std::string("No log file is being written");
+        }
+        time_t from, to;
+        if (args.size() != 3 || !parseLogTime(args[0], from) || !parseLogTime(args[1], to)) {
+            return std::string("Usage: logslice <from> <to> <file>, times as now, -30m, "
+                               "-2h, -1d or 2024-10-14T09:30 (UTC)");
+        }
+        long count = FileSink::exportRange(_logFile, from, to, args[2]);
+        if (count < 0) {
+            return "Could not write " + args[2];
+        }
+        return "Wrote " + std::to_string(count) + " entries to " + args[2];
+    };
+
+    _commands["convertlog"] = [](const std::vector<std::string>& args) {
+        if (args.size() != 2) {
+            return std::string("Usage: convertlog <binary> <json>");
+        }
+        long count = convertBinaryLog(args[0], args[1]);
+        if (count < 0) {
+            return "Could not convert " + args[0];
+        }
+        return "Wrote " + std::to_string(count) + " entries to " + args[1];
+    };
+
+    _commands["trace"] = [this](const std::vector<std::string>& args) {
+        Tracer& tracer = Tracer::instance();
+        if (args.empty()) {
+            return std::string(tracer.isEnabled() ? "Tracing on, " : "Tracing off, ") +
+                   std::to_string(tracer.size()) + " spans recorded";
+        }
+        if (args[0] == "on" || args[0] == "off") {
+            tracer.setEnabled(args[0] == "on");
+            return "Tracing " + args[0];
+        }
+        if (args[0] == "clear") {
+            tracer.clear();
+            return std::string("Trace cleared");
+        }
+        if (args[0] == "export" && args.size() == 2) {
+            if (!exportTrace(args[1])) {
+                return "Could not write " + args[1];
+            }
+            return "Wrote " + std::to_string(tracer.size()) + " spans to " + args[1];
+        }
+        return std::string("Usage: trace on|off|clear|export <file>");
+    };
+
+    _commands["latency"] = [this](const std::vector<std::string>& args) {
+        if (args.size() == 1 && args[0] == "clear") {
+            LatencyRegistry::instance().clear();
+            updateLatencies();
+            return std::string("Latency histograms cleared");
+        }
+        if (args.size() == 2 && args[0] == "export") {
+            if (!exportLatencies(args[1])) {
+                return "Could not write " + args[1];
+            }
+            return "Wrote latency histograms to " + args[1];
+        }
+        return std::string("Usage: latency clear|export <file>");
+    };
+
+    _commands["memory"] = [this](const std::vector<std::string>& args) {
+        if (args.size() == 2 && args[0] == "export") {
+            if (!exportMemory(args[1])) {
+                return "Could not write " + args[1];
+            }
+            return "Wrote memory usage to " + args[1];
+        }
+        if (!args.empty()) {
+            return std::string("Usage: memory [export <file>]");
+        }
+
+        std::ostringstream ss;
+        for (const auto& usage : MemoryRegistry::instance().snapshot()) {
+            ss << std::left << std::setw(24) << usage.subsystem
+               << std::right << std::setw(10) << usage.items << "  "
+               << formatBytes(usage.bytes)
+               << (usage.onDisk ? " on disk" : "")
+               << (usage.trimmable ? " (trimmable)" : "") << "\n";
+        }
+        return ss.str();
+    };
+
+    _commands["diagnose"] = [this](const std::vector<std::string>&) {
+        if (!_diagnosis) {
+            return std::string("No backends to diagnose");
+        }
+        return _diagnosis();
+    };
+
+    _commands["stalls"] = [](const std::vector<std::string>& args) {
+        StallWatchdog& watchdog = StallWatchdog::instance();
+        if (!watchdog.isRunning()) {
+            return std::string("The stall watchdog is not running");
+        }
+        bool full = !args.empty() && args[0] == "full";
+
+        std::ostringstream ss;
+        ss << watchdog.stallCount() << " stalls since startup\n";
+        for (const auto& stall : watchdog.recentStalls()) {
+            if (stall.ongoing) {
+                ss << "  still stalled";
+            } else {
+                ss << "  " << static_cast<long>(stall.ms) << " ms";
+            }
+            ss << " in " << (stall.operation.empty() ? "(no span)" : stall.operation) << "\n";
+            size_t frames = full ? stall.backtrace.size()
+                                 : std::min<size_t>(stall.backtrace.size(), 3);
+            for (size_t i = 0; i < frames; i++) {
+                ss << "      " << stall.backtrace[i] << "\n";
+            }
+        }
+        return ss.str();
+    };
+
+    _commands["metrics"] = [](const std::vector<std::string>& args) {
+        MetricsRegistry& metrics = MetricsRegistry::instance();
+        if (args.empty()) {
+            return metrics.toOpenMetrics();
+        }
+        if (args[0] == "export" && args.size() == 2) {
+            if (!metrics.writeFile(args[1])) {
+                return "Could not write " + args[1];
+            }
+            return "Wrote metrics to " + args[1];
+        }
+        return std::string("Usage: metrics [export <file>]");
+    };
+
+    _commands["trim"] = [this](const std::vector<std::string>&) {
+        uint64_t freed = MemoryRegistry::instance().trim();
+        updateMemory();
+        return "Freed " + formatBytes(freed);
+    };
 }
 
 // ============================================================================
@@ -21,6 +21,7 @@
 #include <memory>
 
 #include "structuredlog.h"
+#include "rgloglist.h"
 
 namespace PolySynaptic {
 
@@ -28,7 +29,8 @@ namespace PolySynaptic {
  * RGDebugPanel - GTK widget for debugging and log viewing
  *
  * Features:
- *   - Real-time log viewer with filtering
+ *   - Real-time log viewer with filtering, over a list model that only
+ *     formats the rows on screen
  *   - Provider status monitoring
  *   - Command execution console
  *   - Performance metrics
@@ -49,17 +51,17 @@ public:
     void showDialog(GtkWindow* parent);
 
     /**
-     * Update log display from memory sink
+     * Follow a memory sink; its new entries are shown once a frame
      */
     void updateLogs(std::shared_ptr<MemorySink> sink);
 
     /**
-     * Add a log entry manually
+     * Add a log entry manually, shown with the next frame
      */
     void addLogEntry(const LogEntry& entry);
 
     /**
-     * Clear all logs
+     * Clear all logs shown so far
      */
     void clearLogs();
 
@@ -83,6 +85,32 @@ public:
      */
     bool exportLogs(const std::string& path, bool asJson = true);
 
+    /**
+     * Export the recorded trace spans as Chrome trace-event JSON
+     */
+    bool exportTrace(const std::string& path);
+
+    /**
+     * Export the latency histograms, raw buckets included
+     */
+    bool exportLatencies(const std::string& path);
+
+    /**
+     * Export the memory accounted per subsystem
+     */
+    bool exportMemory(const std::string& path);
+
+    /**
+     * What the console's diagnose command runs: the report of a
+     * PerfDiagnosis over the owner's backends
+     */
+    void setDiagnosis(std::function<std::string()> run) { _diagnosis = std::move(run); }
+
+    /**
+     * The FileSink log the console's logslice command reads
+     */
+    void setLogFile(const std::string& path) { _logFile = path; }
+
     /**
      * Execute a debug command
      */
@@ -116,13 +144,23 @@ public:
     };
     void updateMetrics(const PerformanceMetrics& metrics);
 
+    /**
+     * Refresh the latency table; runs every second while the panel lives
+     */
+    void updateLatencies();
+
+    /**
+     * Refresh the memory table, on the same timer as the latencies
+     */
+    void updateMemory();
+
 private:
     // Main notebook with tabs
     GtkWidget* _notebook = nullptr;
 
     // Log viewer tab
     GtkWidget* _logView = nullptr;
-    GtkTextBuffer* _logBuffer = nullptr;
+    RGLogList* _logList = nullptr;
     GtkWidget* _levelCombo = nullptr;
     GtkWidget* _providerCombo = nullptr;
     GtkWidget* _searchEntry = nullptr;
@@ -142,12 +180,25 @@ private:
     // Metrics tab
     GtkWidget* _metricsGrid = nullptr;
     std::map<std::string, GtkWidget*> _metricLabels;
+    GtkListStore* _latencyStore = nullptr;
+    GtkListStore* _memoryStore = nullptr;
+    guint _latencyTimer = 0;
 
     // State
     LogLevel _minLevel = LogLevel::DEBUG;
     std::string _providerFilter;
     std::string _operationFilter;
+    std::string _searchFilter;
     bool _autoScroll = true;
+    std::function<std::string()> _diagnosis;
+    std::string _logFile;
+
+    // Entries reach the view in one batch per frame: those written to
+    // the followed sink since _logSinkSeq, and those added by hand
+    std::shared_ptr<MemorySink> _logSink;
+    uint64_t _logSinkSeq = 0;
+    std::vector<LogEntry> _pendingLogs;
+    guint _logFrameTimer = 0;
 
     // Build UI
     void buildUI();
@@ -157,14 +208,10 @@ private:
     void buildMetricsTab();
 
     // Log display helpers
-    void appendLogText(const LogEntry& entry);
+    void flushLogs();
     void applyLogFilters();
     void scrollToEnd();
 
-    // Text tags for log levels
-    void createTextTags();
-    const char* getTagForLevel(LogLevel level);
-
     // Signal handlers
     static void onLevelChanged(GtkComboBox* combo, gpointer data);
     static void onProviderChanged(GtkComboBox* combo, gpointer data);
@@ -173,6 +220,8 @@ private:
     static void onExportClicked(GtkButton* button, gpointer data);
     static void onAutoScrollToggled(GtkToggleButton* button, gpointer data);
     static void onCommandActivate(GtkEntry* entry, gpointer data);
+    static gboolean onLatencyTimer(gpointer data);
+    static gboolean onLogFrame(gpointer data);
 
     // Console commands
     std::map<std::string, std::function<std::string(const std::vector<std::string>&)>>
@@ -70,8 +70,12 @@ bool RGFetchProgress::close()
 }
 
 RGFetchProgress::RGFetchProgress(RGWindow *win)
-   : RGGtkBuilderWindow(win, "fetch"), _cursorDirty(false), _sock(NULL)
+   : RGGtkBuilderWindow(win, "fetch"), _cursorDirty(false), _sock(NULL),
+     _scrollRow(-1), _lastRedraw(0)
 {
+   _redrawInterval =
+      (gint64)_config->FindI("Synaptic::Fetch::RedrawInterval", 250) * 1000;
+
    GtkCellRenderer *renderer;
    GtkTreeViewColumn *column;
 
@@ -231,12 +235,36 @@ void RGFetchProgress::updateStatus(pkgAcquire::ItemDesc & Itm, int status)
       _items.push_back(item);
       Itm.Owner->ID = _items.size();
       refreshTable(Itm.Owner->ID - 1, true);
+      _scrollRow = Itm.Owner->ID - 1;
    } else if (_items[Itm.Owner->ID - 1].status != status) {
+      // redrawn by the next flushTable(), not once per status change
       _items[Itm.Owner->ID - 1].status = status;
-      refreshTable(Itm.Owner->ID - 1, false);
+      _dirtyRows.insert(Itm.Owner->ID - 1);
+      _scrollRow = Itm.Owner->ID - 1;
    }
 }
 
+void RGFetchProgress::flushTable(bool force)
+{
+   gint64 now = g_get_monotonic_time();
+   if (!force && now - _lastRedraw < _redrawInterval)
+      return;
+   _lastRedraw = now;
+
+   for (set<int>::iterator I = _dirtyRows.begin(); I != _dirtyRows.end(); I++)
+      refreshTable(*I, false);
+   _dirtyRows.clear();
+
+   // scroll once per redraw instead of once per row
+   if (_scrollRow >= 0 && !_cursorDirty) {
+      GtkTreePath *path = gtk_tree_path_new_from_indices(_scrollRow, -1);
+      gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(_table),
+                                   path, NULL, TRUE, 0.0, 0.0);
+      gtk_tree_path_free(path);
+   }
+   _scrollRow = -1;
+}
+
 
 void RGFetchProgress::IMSHit(pkgAcquire::ItemDesc & Itm)
 {
@@ -296,6 +324,7 @@ bool RGFetchProgress::Pulse(pkgAcquire *Owner)
    if (fabsf(percent-
             gtk_progress_bar_get_fraction(GTK_PROGRESS_BAR(_mainProgressBar))*100.0) < 0.1) 
    {
+      flushTable(false);
       RGFlushInterface();
       return !_cancelled;
    }
@@ -323,6 +352,7 @@ bool RGFetchProgress::Pulse(pkgAcquire *Owner)
          updateStatus(*I->CurrentItem, 100);
 
    }
+   flushTable(false);
 
    unsigned long ETA;
    if (CurrentCPS > 0)
@@ -360,6 +390,8 @@ void RGFetchProgress::Start()
    //cout << "RGFetchProgress::Start()" << endl;
    pkgAcquireStatus::Start();
    _cancelled = false;
+   _dirtyRows.clear();
+   _scrollRow = -1;
 
    RGFlushInterface();
 }
@@ -368,6 +400,7 @@ void RGFetchProgress::Start()
 void RGFetchProgress::Stop()
 {
    //cout << "RGFetchProgress::Stop()" << endl;
+   flushTable(true);
    RGFlushInterface();
    if(_sock != NULL) {
       gtk_widget_destroy(_sock);
@@ -435,18 +468,10 @@ void RGFetchProgress::refreshTable(int row, bool append)
 {
    //cout << "RGFetchProgress::refreshTable() " << row << endl;
    GtkTreeIter iter;
-   GtkTreePath *path;
 
    // find the right iter
    if (append == true) {
       gtk_list_store_insert(_tableListStore, &iter, row);
-      if(!_cursorDirty) {
-	 path = gtk_tree_path_new();
-	 gtk_tree_path_append_index(path, row);
-	 gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(_table),
-				      path, NULL, TRUE, 0.0, 0.0);
-	 gtk_tree_path_free(path);
-      }
    } else {
       gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(_tableListStore),
                                     &iter, NULL, row);
@@ -459,11 +484,6 @@ void RGFetchProgress::refreshTable(int row, bool append)
                       FETCH_SIZE_COLUMN, _items[row].size.c_str(),
                       FETCH_DESCR_COLUMN, _items[row].descr.c_str(),
                       FETCH_URL_COLUMN, _items[row].uri.c_str(), -1);
-   path = gtk_tree_model_get_path(GTK_TREE_MODEL(_tableListStore), &iter);
-   if(!_cursorDirty)
-      gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(_table),
-				   path, NULL, TRUE, 0.0, 0.0);
-   gtk_tree_path_free(path);
 }
 
 // vim:sts=4:sw=4
@@ -45,7 +45,13 @@ class RGFetchProgress : public pkgAcquireStatus, public RGGtkBuilderWindow {
 
    GtkWidget *_table;
    GtkListStore *_tableListStore;
-   set<int> _tableRows;
+
+   // rows whose status changed since the table was last redrawn;
+   // Synaptic::Fetch::RedrawInterval (ms) throttles the redraws
+   set<int> _dirtyRows;
+   int _scrollRow;
+   gint64 _lastRedraw;
+   gint64 _redrawInterval;
 
    GtkWidget *_mainProgressBar; // GtkProgressBar
 
@@ -69,6 +75,7 @@ class RGFetchProgress : public pkgAcquireStatus, public RGGtkBuilderWindow {
    char *getStatusStr(int status);
    int getStatusPercent(int status);
    void refreshTable(int row, bool append = false);
+   void flushTable(bool force);
    //GdkPixmap *statusDraw(int width, int height, int status);
 
  public:
@@ -26,6 +26,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 #include "config.h"
 #include "rpackageview.h"
 #include "rgfiltermanager.h"
@@ -50,7 +51,8 @@
 RGFilterManagerWindow::RGFilterManagerWindow(RGWindow *win,
                                              RPackageViewFilter *filterview)
 : RGGtkBuilderWindow(win, "filters"), _selectedPath(NULL),
-  _selectedFilter(NULL), _filterview(filterview)
+  _selectedFilter(NULL), _filterview(filterview), _previewLabel(NULL),
+  _previewTimeout(0), _previewIdle(0), _previewPos(0), _previewCount(0)
 {
    GtkListStore *comboStore;
    GtkTreeIter comboIter;
@@ -254,12 +256,160 @@ RGFilterManagerWindow::RGFilterManagerWindow(RGWindow *win,
    gtk_notebook_remove_page(GTK_NOTEBOOK(notebook), 3);
 #endif
 
+   // the live preview, below the editor; every edit restarts it
+   _previewLabel = gtk_label_new("");
+   gtk_label_set_xalign(GTK_LABEL(_previewLabel), 0.0);
+   gtk_label_set_ellipsize(GTK_LABEL(_previewLabel), PANGO_ELLIPSIZE_END);
+   gtk_box_pack_start(GTK_BOX(gtk_builder_get_object(_builder, "dialog-vbox1")),
+                      _previewLabel, FALSE, FALSE, 6);
+   gtk_widget_show(_previewLabel);
+
+   for (int i = 0; i < NrOfStatusBits; i++)
+      g_signal_connect_swapped(_statusB[i], "toggled",
+                               G_CALLBACK(filterEdited), this);
+   g_signal_connect_swapped(gtk_tree_view_get_selection(GTK_TREE_VIEW(_sectionList)),
+                            "changed", G_CALLBACK(filterEdited), this);
+   const char *toggles[] = { "radiobutton_incl", "radiobutton_properties_and",
+                             "radiobutton_properties_or" };
+   for (unsigned int i = 0; i < G_N_ELEMENTS(toggles); i++)
+      g_signal_connect_swapped(gtk_builder_get_object(_builder, toggles[i]),
+                               "toggled", G_CALLBACK(filterEdited), this);
+   // rows are set by patternChanged(), patternNew() and patternDelete()
+   const char *rowSignals[] = { "row-changed", "row-inserted", "row-deleted" };
+   for (unsigned int i = 0; i < G_N_ELEMENTS(rowSignals); i++)
+      g_signal_connect_swapped(_patternListStore, rowSignals[i],
+                               G_CALLBACK(filterEdited), this);
+
    // set the details filter to not sesitive
    gtk_widget_set_sensitive(_filterDetailsBox, false);
 
    skipTaskbar(true);
 }
 
+// whether two pattern filters hold the same patterns, so the results
+// the one of the preview keeps per package are still good
+static bool samePatterns(RPatternPackageFilter &a, RPatternPackageFilter &b)
+{
+   if (a.count() != b.count() || a.getAndMode() != b.getAndMode())
+      return false;
+   for (int i = 0; i < a.count(); i++) {
+      RPatternPackageFilter::DepType typeA, typeB;
+      string patternA, patternB;
+      bool exclusiveA, exclusiveB;
+      a.getPattern(i, typeA, patternA, exclusiveA);
+      b.getPattern(i, typeB, patternB, exclusiveB);
+      if (typeA != typeB || patternA != patternB || exclusiveA != exclusiveB)
+         return false;
+   }
+   return true;
+}
+
+void RGFilterManagerWindow::filterEdited(gpointer data)
+{
+   RGFilterManagerWindow *me = (RGFilterManagerWindow *) data;
+   me->schedulePreview();
+}
+
+void RGFilterManagerWindow::schedulePreview()
+{
+   if (_selectedFilter == NULL)
+      return;
+
+   // typing a pattern edits it on every key; wait for a pause
+   if (_previewTimeout != 0)
+      g_source_remove(_previewTimeout);
+   _previewTimeout = g_timeout_add(250, cbPreviewStart, this);
+}
+
+void RGFilterManagerWindow::stopPreview()
+{
+   if (_previewTimeout != 0) {
+      g_source_remove(_previewTimeout);
+      _previewTimeout = 0;
+   }
+   if (_previewIdle != 0) {
+      g_source_remove(_previewIdle);
+      _previewIdle = 0;
+   }
+}
+
+gboolean RGFilterManagerWindow::cbPreviewStart(gpointer data)
+{
+   RGFilterManagerWindow *me = (RGFilterManagerWindow *) data;
+   me->_previewTimeout = 0;
+
+   me->getSectionFilter(me->_preview.section);
+   me->getStatusFilter(me->_preview.status);
+
+   // the pattern filter keeps what every package it saw gave, as bits
+   // by package id; only setting other patterns starts that over, so
+   // editing the status or sections does not rerun the regexps
+   RPatternPackageFilter edited;
+   me->getPatternFilter(edited);
+   if (!samePatterns(edited, me->_preview.pattern))
+      me->getPatternFilter(me->_preview.pattern);
+
+   me->_previewPos = 0;
+   me->_previewCount = 0;
+   me->_previewSample.clear();
+   if (me->_previewIdle == 0)
+      me->_previewIdle = g_idle_add(cbPreviewSlice, me);
+   return FALSE;
+}
+
+gboolean RGFilterManagerWindow::cbPreviewSlice(gpointer data)
+{
+   RGFilterManagerWindow *me = (RGFilterManagerWindow *) data;
+
+   // a slice has to leave the editor responsive even when every package
+   // reads its records
+   const unsigned int SliceSize = 2000;
+   const unsigned int SampleSize = 5;
+
+   const vector<RPackage *> &packages = me->_filterview->allPackages();
+   unsigned int end = min<size_t>(me->_previewPos + SliceSize, packages.size());
+   for (; me->_previewPos < end; me->_previewPos++) {
+      RPackage *pkg = packages[me->_previewPos];
+      if (pkg == NULL || !me->_preview.apply(pkg))
+         continue;
+      if (me->_previewSample.size() < SampleSize)
+         me->_previewSample.push_back(pkg->name());
+      me->_previewCount++;
+   }
+
+   bool done = me->_previewPos >= packages.size();
+   me->showPreview(done);
+   if (done) {
+      me->_previewIdle = 0;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+void RGFilterManagerWindow::showPreview(bool done)
+{
+   string sample;
+   for (unsigned int i = 0; i < _previewSample.size(); i++) {
+      if (i > 0)
+         sample += ", ";
+      sample += _previewSample[i];
+   }
+   if (done && _previewCount > _previewSample.size())
+      sample += ", ...";
+
+   gchar *text;
+   if (done)
+      text = g_strdup_printf(ngettext("%u package matches: %s",
+                                      "%u packages match: %s",
+                                      _previewCount),
+                             _previewCount, sample.c_str());
+   else
+      text = g_strdup_printf(_("%u packages match so far: %s"),
+                             _previewCount, sample.c_str());
+   gtk_label_set_text(GTK_LABEL(_previewLabel), text);
+   g_free(text);
+}
+
 void RGFilterManagerWindow::filterNameChanged(GObject *o, gpointer data)
 {
    RGFilterManagerWindow *me = (RGFilterManagerWindow *) data;
@@ -525,6 +675,7 @@ void RGFilterManagerWindow::selectAction(GtkTreeSelection *selection,
       gtk_tree_selection_unselect_all(select);
       gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object
                                (me->_builder, "hbox_pattern")), false);
+      me->schedulePreview();
    } else {
       gtk_widget_set_sensitive(me->_filterDetailsBox, false);
    }
@@ -894,6 +1045,8 @@ void RGFilterManagerWindow::cancelAction(GtkWidget *self, void *data)
       delete filter;
    }
 
+   me->stopPreview();
+
    // restore the old filters
    RFilter *filter;
    for (i = 0; i < me->_saveFilters.size(); i++) {
@@ -909,6 +1062,7 @@ void RGFilterManagerWindow::okAction(GtkWidget *self, void *data)
    RGFilterManagerWindow *me = (RGFilterManagerWindow *) data;
    //cout << "void RGFilterManagerWindow::okAction()"<<endl;
 
+   me->stopPreview();
    me->applyFilterAction(self, data);
    me->_filterview->storeFilters();
    me->close();
@@ -79,6 +79,7 @@ static char *DepOptions[] = {
    _("Dependent packages"),   // Reverse Depends
    _("Origin"),                 // Origin (e.g. security.debian.org)
    _("Component"),                 // Component (e.g. main, universe)
+   _("Installed files"),           // paths in the dpkg file lists
    NULL
 };
 
@@ -180,6 +181,26 @@ class RGFilterManagerWindow:public RGGtkBuilderWindow {
    RPackageViewFilter *_filterview;
    vector<RFilter *> _saveFilters;
 
+   // live preview of the filter being edited: a moment after the last
+   // edit it is run over the packages a slice at a time from the main
+   // loop, which shares the package records with the main view, and
+   // only the count and a few names are shown; the main view is not
+   // touched until the filter is applied
+   RFilter _preview;
+   GtkWidget *_previewLabel;
+   guint _previewTimeout;
+   guint _previewIdle;
+   unsigned int _previewPos;
+   unsigned int _previewCount;
+   vector<string> _previewSample;
+   void schedulePreview();
+   void stopPreview();
+   void showPreview(bool done);
+   // connected swapped, so any signal can call it
+   static void filterEdited(gpointer data);
+   static gboolean cbPreviewStart(gpointer data);
+   static gboolean cbPreviewSlice(gpointer data);
+
 #ifdef HAVE_DEBTAGS
    // the tags stuff
    GtkTreeView *_availableTagsView;
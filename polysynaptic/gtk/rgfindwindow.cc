@@ -48,6 +48,10 @@ int RGFindWindow::getSearchType()
    int searchType;
    searchType = gtk_combo_box_get_active(GTK_COMBO_BOX(_comboSearchType));
 
+   // the entries up to "Provided packages" are in DepType order
+   if (searchType == RPatternPackageFilter::Conflicts)
+      searchType = RPatternPackageFilter::Files;
+
    return searchType;
 }
 
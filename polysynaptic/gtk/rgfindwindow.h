@@ -35,6 +35,7 @@ static char *SearchTypes[] = {
    _("Version"),
    _("Dependencies"),           // depends, predepends etc
    _("Provided packages"),      // provides and name
+   _("Installed files"),        // paths in the dpkg file lists
    NULL
 };
 
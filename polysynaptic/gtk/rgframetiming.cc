@@ -0,0 +1,59 @@
+/* rgframetiming.cc - Frame clock timing of the main window
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "rgframetiming.h"
+#include "frametiming.h"
+
+// The clock of the watched window, once it is realized
+static GdkFrameClock *watchedClock = NULL;
+
+static void onAfterPaint(GdkFrameClock *clock, gpointer)
+{
+    gint64 frameStart = gdk_frame_clock_get_frame_time(clock);
+    gint64 refresh = 0;
+    gint64 presentation = 0;
+    gdk_frame_clock_get_refresh_info(clock, frameStart, &refresh, &presentation);
+
+    PolySynaptic::FrameTiming::instance().frameCompleted(
+        frameStart, g_get_monotonic_time(), refresh);
+}
+
+static void onRealize(GtkWidget *window, gpointer)
+{
+    GdkFrameClock *clock = gtk_widget_get_frame_clock(window);
+    if (clock == NULL || clock == watchedClock) {
+        return;
+    }
+    if (watchedClock != NULL) {
+        g_signal_handlers_disconnect_by_func(watchedClock, (gpointer) onAfterPaint, NULL);
+        g_object_unref(watchedClock);
+    }
+    watchedClock = (GdkFrameClock *) g_object_ref(clock);
+    g_signal_connect(clock, "after-paint", G_CALLBACK(onAfterPaint), NULL);
+}
+
+void RGWatchFrames(GtkWidget *window)
+{
+    g_signal_connect(window, "realize", G_CALLBACK(onRealize), NULL);
+    if (gtk_widget_get_realized(window)) {
+        onRealize(window, NULL);
+    }
+}
+
+void RGNoteViewChange(const char *operation)
+{
+    if (watchedClock == NULL) {
+        return;
+    }
+    PolySynaptic::FrameTiming::instance().modelChanged(operation, g_get_monotonic_time());
+    gdk_frame_clock_request_phase(watchedClock, GDK_FRAME_CLOCK_PHASE_PAINT);
+}
+
+// vim:ts=4:sw=4:et
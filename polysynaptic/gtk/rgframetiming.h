@@ -0,0 +1,33 @@
+/* rgframetiming.h - Frame clock timing of the main window
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file connects FrameTiming to the frame clock of the main window
+ * and gives the views the call that notes a change of their model.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RGFRAMETIMING_H_
+#define _RGFRAMETIMING_H_
+
+#include <gtk/gtk.h>
+
+/**
+ * Time every frame window paints, from when it is realized on
+ */
+void RGWatchFrames(GtkWidget *window);
+
+/**
+ * The rows a view shows changed for operation ("search results",
+ * "filter", "sort"...); the next frame is timed from now and asked for
+ * even when nothing visible changed
+ */
+void RGNoteViewChange(const char *operation);
+
+#endif // _RGFRAMETIMING_H_
+
+// vim:ts=4:sw=4:et
@@ -62,6 +62,16 @@ class RGGtkBuilderWindow:public RGWindow {
 		    bool useMarkup=false);
 
    GtkBuilder* getGtkBuilder() {return _builder;};
+
+   // windows and dialogs most sessions never open are built, and their
+   // .ui file parsed, on first use and kept afterwards:
+   //    lazy(me->_tasksWin, me)->show();
+   template <class Window, class... Args>
+   static Window *lazy(Window *&slot, Args... args) {
+      if (slot == NULL)
+	 slot = new Window(args...);
+      return slot;
+   }
 };
 
 #endif
@@ -0,0 +1,266 @@
+/* rgiconcache.cc - Icons of the package lists, decoded off the main loop
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "rgiconcache.h"
+#include "rgasync.h"
+
+#include <algorithm>
+#include <iostream>
+
+using PolySynaptic::TaskPriority;
+
+// Decoding is I/O and inflate bound; two workers keep a scroll fed
+static const unsigned DECODE_WORKERS = 2;
+
+RGIconCache& RGIconCache::instance()
+{
+    static RGIconCache cache;
+    return cache;
+}
+
+RGIconCache::RGIconCache()
+    : _capacity(DEFAULT_CAPACITY), _generation(0), _pool(DECODE_WORKERS)
+{
+    g_signal_connect(gtk_icon_theme_get_default(), "changed",
+                     G_CALLBACK(onThemeChanged), this);
+}
+
+RGIconCache::~RGIconCache()
+{
+    // The process is exiting; the workers' late results are dropped
+    // with the main loop that would have delivered them
+    for (auto& entry : _entries) {
+        if (entry.second.pixbuf) {
+            g_object_unref(entry.second.pixbuf);
+        }
+    }
+    for (auto& placeholder : _placeholders) {
+        g_object_unref(placeholder.second);
+    }
+}
+
+string RGIconCache::keyFor(const string& name, int size, int scale)
+{
+    return name + "@" + to_string(size) + "x" + to_string(scale);
+}
+
+static void freeIconInfo(GtkIconInfo *info)
+{
+#if GTK_CHECK_VERSION(3, 8, 0)
+    g_object_unref(info);
+#else
+    gtk_icon_info_free(info);
+#endif
+}
+
+// ============================================================================
+// Lookups
+// ============================================================================
+
+GdkPixbuf *RGIconCache::lookup(const string& name, int size, int scale,
+                               bool *loading)
+{
+    if (loading) {
+        *loading = false;
+    }
+
+    string key = keyFor(name, size, scale);
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+        return found->second.pixbuf ? (GdkPixbuf *) g_object_ref(found->second.pixbuf)
+                                    : nullptr;
+    }
+
+    if (_pending.count(key)) {
+        if (loading) {
+            *loading = true;
+        }
+        return nullptr;
+    }
+
+    int px = size * scale;
+    GtkIconInfo *info = gtk_icon_theme_lookup_icon(gtk_icon_theme_get_default(),
+                                                   name.c_str(), px,
+                                                   GTK_ICON_LOOKUP_USE_BUILTIN);
+    if (!info) {
+        insert(key, nullptr);
+        return nullptr;
+    }
+
+    const gchar *filename = gtk_icon_info_get_filename(info);
+    if (!filename) {
+        // Built into GTK and already in memory; nothing to decode
+        GdkPixbuf *pixbuf = gtk_icon_info_load_icon(info, nullptr);
+        freeIconInfo(info);
+        insert(key, pixbuf);
+        return pixbuf ? (GdkPixbuf *) g_object_ref(pixbuf) : nullptr;
+    }
+
+    string path = filename;
+    freeIconInfo(info);
+
+    _pending[key];
+    if (loading) {
+        *loading = true;
+    }
+
+    unsigned generation = _generation;
+    _pool.submit(TaskPriority::INTERACTIVE, [this, key, path, px, generation]() {
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_size(path.c_str(), px, px,
+                                                             nullptr);
+        RGMainLoopDispatcher()([this, key, generation, pixbuf]() {
+            decoded(key, generation, pixbuf);
+        });
+        return 0;
+    });
+    return nullptr;
+}
+
+void RGIconCache::whenLoaded(const string& name, int size, int scale,
+                             function<void()> ready)
+{
+    auto pending = _pending.find(keyFor(name, size, scale));
+    if (pending != _pending.end()) {
+        pending->second.push_back(std::move(ready));
+    } else {
+        RGMainLoopDispatcher()(std::move(ready));
+    }
+}
+
+GdkPixbuf *RGIconCache::load(const string& name, int size, int scale)
+{
+    string key = keyFor(name, size, scale);
+    auto found = _entries.find(key);
+    if (found != _entries.end() && found->second.pixbuf) {
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+        return (GdkPixbuf *) g_object_ref(found->second.pixbuf);
+    }
+
+    // Also when a decode is on its way or the icon was missing: the
+    // caller cannot wait, and wants the theme's error
+    GError *error = nullptr;
+    GdkPixbuf *pixbuf = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
+                                                 name.c_str(), size * scale,
+                                                 (GtkIconLookupFlags) 0, &error);
+    if (!pixbuf) {
+        cerr << "Warning, failed to load: " << name << " "
+             << (error ? error->message : "") << endl;
+        if (error) {
+            g_error_free(error);
+        }
+        return nullptr;
+    }
+
+    insert(key, pixbuf);
+    return (GdkPixbuf *) g_object_ref(pixbuf);
+}
+
+GdkPixbuf *RGIconCache::placeholder(int size, int scale)
+{
+    int px = size * scale;
+    GdkPixbuf *&blank = _placeholders[px];
+    if (!blank) {
+        blank = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, px, px);
+        gdk_pixbuf_fill(blank, 0);
+    }
+    return (GdkPixbuf *) g_object_ref(blank);
+}
+
+// ============================================================================
+// Storage
+// ============================================================================
+
+void RGIconCache::insert(const string& key, GdkPixbuf *pixbuf)
+{
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        if (found->second.pixbuf) {
+            g_object_unref(found->second.pixbuf);
+        }
+        found->second.pixbuf = pixbuf;
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+    } else {
+        _lru.push_front(key);
+        _entries[key] = Entry{pixbuf, _lru.begin()};
+    }
+
+    trim();
+}
+
+void RGIconCache::trim()
+{
+    while (_entries.size() > _capacity && !_lru.empty()) {
+        auto victim = _entries.find(_lru.back());
+        if (victim->second.pixbuf) {
+            g_object_unref(victim->second.pixbuf);
+        }
+        _entries.erase(victim);
+        _lru.pop_back();
+    }
+}
+
+void RGIconCache::decoded(const string& key, unsigned generation, GdkPixbuf *pixbuf)
+{
+    if (generation != _generation) {
+        // Decoded from the previous theme; its waiters were told by clear()
+        if (pixbuf) {
+            g_object_unref(pixbuf);
+        }
+        return;
+    }
+
+    vector<function<void()>> waiters;
+    auto pending = _pending.find(key);
+    if (pending != _pending.end()) {
+        waiters.swap(pending->second);
+        _pending.erase(pending);
+    }
+
+    insert(key, pixbuf);
+    for (auto& ready : waiters) {
+        ready();
+    }
+}
+
+void RGIconCache::setCapacity(size_t icons)
+{
+    _capacity = max<size_t>(icons, 1);
+    trim();
+}
+
+void RGIconCache::clear()
+{
+    _generation++;
+
+    for (auto& entry : _entries) {
+        if (entry.second.pixbuf) {
+            g_object_unref(entry.second.pixbuf);
+        }
+    }
+    _entries.clear();
+    _lru.clear();
+
+    // Rows waiting for an icon redraw and look it up in the new theme
+    map<string, vector<function<void()>>> pending;
+    pending.swap(_pending);
+    for (auto& waiters : pending) {
+        for (auto& ready : waiters.second) {
+            RGMainLoopDispatcher()(std::move(ready));
+        }
+    }
+}
+
+void RGIconCache::onThemeChanged(GtkIconTheme *theme, gpointer data)
+{
+    ((RGIconCache *) data)->clear();
+}
+
+// vim:ts=4:sw=4:et
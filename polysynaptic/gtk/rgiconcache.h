@@ -0,0 +1,126 @@
+/* rgiconcache.h - Icons of the package lists, decoded off the main loop
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the one place list rows get their icons from.
+ * Loading a themed icon reads and decodes an image file, which is too
+ * slow to do for every row GTK draws; here each icon is decoded once,
+ * on a worker thread, and kept while it is in use, and a row whose
+ * icon is not ready yet shows a blank of the same size meanwhile.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RGICONCACHE_H_
+#define _RGICONCACHE_H_
+
+#include <gtk/gtk.h>
+
+#include "taskpool.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * RGIconCache - Decoded theme icons by name, size and scale
+ *
+ *     bool loading;
+ *     GdkPixbuf *icon = RGIconCache::instance().lookup(name, 16, 1, &loading);
+ *     if (!icon && loading)
+ *         RGIconCache::instance().whenLoaded(name, 16, 1, redrawRow);
+ *     if (!icon)
+ *         icon = RGIconCache::instance().placeholder(16, 1);
+ *
+ * The theme is asked for the icon's file on the main loop, which only
+ * reads the theme's cache, and the file is decoded on a worker. Any
+ * number of lookups of one icon share a single decode. The most
+ * recently used icons are kept, up to the capacity; icons the theme
+ * does not have are remembered as missing. A change of the icon theme
+ * drops them all.
+ *
+ * Pixbufs are returned as new references; an evicted icon stays valid
+ * for whoever still holds one.
+ *
+ * Thread Safety:
+ *   Main loop only, like the rest of GTK.
+ */
+class RGIconCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 256;
+
+    static RGIconCache& instance();
+
+    RGIconCache(const RGIconCache&) = delete;
+    RGIconCache& operator=(const RGIconCache&) = delete;
+
+    /**
+     * The icon at size pixels (times scale), or nullptr if it is not
+     * decoded yet - then its decode is started, and loading set - or
+     * the theme has no such icon
+     */
+    GdkPixbuf *lookup(const string& name, int size, int scale = 1,
+                      bool *loading = nullptr);
+
+    /**
+     * Call ready on the main loop once, when the icon's decode is done,
+     * or soon if it is not being decoded
+     */
+    void whenLoaded(const string& name, int size, int scale, function<void()> ready);
+
+    /**
+     * The icon, decoded now on this thread if it is not cached; for
+     * window icons and others needed at once
+     */
+    GdkPixbuf *load(const string& name, int size, int scale = 1);
+
+    /**
+     * A transparent image of the size, shared by all its users
+     */
+    GdkPixbuf *placeholder(int size, int scale = 1);
+
+    void setCapacity(size_t icons);
+    size_t getCount() const { return _entries.size(); }
+
+    /**
+     * Forget every icon, as on a theme change
+     */
+    void clear();
+
+private:
+    RGIconCache();
+    ~RGIconCache();
+
+    struct Entry {
+        GdkPixbuf *pixbuf;                  // nullptr if the theme has none
+        list<string>::iterator use;         // Position in _lru
+    };
+
+    list<string> _lru;                      // Keys, most recent first
+    map<string, Entry> _entries;
+    map<string, vector<function<void()>>> _pending;    // Waiters of each decode
+    map<int, GdkPixbuf *> _placeholders;    // By pixel size
+    size_t _capacity;
+    unsigned _generation;                   // Bumped by clear()
+
+    // Last, so the workers stop before anything they use goes away
+    PolySynaptic::TaskPool _pool;
+
+    static string keyFor(const string& name, int size, int scale);
+    void insert(const string& key, GdkPixbuf *pixbuf);     // Takes the reference
+    void trim();                            // Evict down to the capacity
+    void decoded(const string& key, unsigned generation, GdkPixbuf *pixbuf);
+
+    static void onThemeChanged(GtkIconTheme *theme, gpointer data);
+};
+
+#endif // _RGICONCACHE_H_
+
+// vim:ts=4:sw=4:et
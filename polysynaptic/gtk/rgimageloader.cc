@@ -0,0 +1,180 @@
+/* rgimageloader.cc - Screenshots and slides, decoded off the main loop
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "rgimageloader.h"
+#include "rgasync.h"
+
+#include <algorithm>
+
+using PolySynaptic::TaskPriority;
+
+// One image at a time is being looked at; a second worker decodes the
+// next one meanwhile
+static const unsigned DECODE_WORKERS = 2;
+
+RGImageLoader& RGImageLoader::instance()
+{
+    static RGImageLoader loader;
+    return loader;
+}
+
+RGImageLoader::RGImageLoader()
+    : _capacity(DEFAULT_CAPACITY), _nextTicket(1), _pool(DECODE_WORKERS)
+{
+}
+
+RGImageLoader::~RGImageLoader()
+{
+    // The process is exiting; late results go with the main loop
+    for (auto& entry : _entries) {
+        if (entry.second.pixbuf) {
+            g_object_unref(entry.second.pixbuf);
+        }
+    }
+}
+
+string RGImageLoader::keyFor(const string& path, int maxWidth, int maxHeight)
+{
+    return path + "@" + to_string(maxWidth) + "x" + to_string(maxHeight);
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+unsigned RGImageLoader::request(const string& path, int maxWidth, int maxHeight,
+                                Ready ready)
+{
+    unsigned ticket = _nextTicket++;
+    _waiting.insert(ticket);
+    string key = keyFor(path, maxWidth, maxHeight);
+
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+        GdkPixbuf *pixbuf = found->second.pixbuf;
+        if (pixbuf) {
+            g_object_ref(pixbuf);
+        }
+        // Still from the main loop, so the caller is set up by then
+        RGMainLoopDispatcher()([this, ticket, pixbuf, ready]() {
+            if (_waiting.erase(ticket)) {
+                ready(pixbuf);
+            } else if (pixbuf) {
+                g_object_unref(pixbuf);
+            }
+        });
+        return ticket;
+    }
+
+    bool started = _pending.count(key) > 0;
+    _pending[key].push_back(make_pair(ticket, std::move(ready)));
+    if (!started) {
+        decode(key, path, maxWidth, maxHeight);
+    }
+    return ticket;
+}
+
+void RGImageLoader::cancel(unsigned ticket)
+{
+    _waiting.erase(ticket);
+}
+
+void RGImageLoader::preload(const string& path, int maxWidth, int maxHeight)
+{
+    string key = keyFor(path, maxWidth, maxHeight);
+    if (_entries.count(key) || _pending.count(key)) {
+        return;
+    }
+    _pending[key];
+    decode(key, path, maxWidth, maxHeight);
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+void RGImageLoader::decode(const string& key, const string& path,
+                           int maxWidth, int maxHeight)
+{
+    _pool.submit(TaskPriority::INTERACTIVE, [this, key, path, maxWidth, maxHeight]() {
+        GdkPixbuf *pixbuf;
+        if (maxWidth > 0 || maxHeight > 0) {
+            pixbuf = gdk_pixbuf_new_from_file_at_scale(path.c_str(),
+                                                       maxWidth > 0 ? maxWidth : -1,
+                                                       maxHeight > 0 ? maxHeight : -1,
+                                                       TRUE, nullptr);
+        } else {
+            pixbuf = gdk_pixbuf_new_from_file(path.c_str(), nullptr);
+        }
+        RGMainLoopDispatcher()([this, key, pixbuf]() {
+            decoded(key, pixbuf);
+        });
+        return 0;
+    });
+}
+
+void RGImageLoader::decoded(const string& key, GdkPixbuf *pixbuf)
+{
+    vector<pair<unsigned, Ready>> waiters;
+    auto pending = _pending.find(key);
+    if (pending != _pending.end()) {
+        waiters.swap(pending->second);
+        _pending.erase(pending);
+    }
+
+    insert(key, pixbuf);
+    for (auto& waiter : waiters) {
+        if (_waiting.erase(waiter.first)) {
+            waiter.second(pixbuf ? (GdkPixbuf *) g_object_ref(pixbuf) : nullptr);
+        }
+    }
+}
+
+// ============================================================================
+// Storage
+// ============================================================================
+
+void RGImageLoader::insert(const string& key, GdkPixbuf *pixbuf)
+{
+    auto found = _entries.find(key);
+    if (found != _entries.end()) {
+        if (found->second.pixbuf) {
+            g_object_unref(found->second.pixbuf);
+        }
+        found->second.pixbuf = pixbuf;
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+    } else {
+        _lru.push_front(key);
+        _entries[key] = Entry{pixbuf, _lru.begin()};
+    }
+
+    trim();
+}
+
+void RGImageLoader::trim()
+{
+    while (_entries.size() > _capacity && !_lru.empty()) {
+        auto victim = _entries.find(_lru.back());
+        if (victim->second.pixbuf) {
+            g_object_unref(victim->second.pixbuf);
+        }
+        _entries.erase(victim);
+        _lru.pop_back();
+    }
+}
+
+void RGImageLoader::setCapacity(size_t images)
+{
+    _capacity = max<size_t>(images, 1);
+    trim();
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,126 @@
+/* rgimageloader.h - Screenshots and slides, decoded off the main loop
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file implements the decoding of the large images the UI shows:
+ * the slideshow while packages install and the package screenshots.
+ * gtk_image_set_from_file() reads, inflates and scales an image on the
+ * main loop, which for a full screenshot takes long enough to see, and
+ * the slideshow runs exactly while an install keeps the UI busy. Here
+ * the images are decoded on a worker and handed to the image widget
+ * only once they are ready; the few that are likely next are decoded
+ * ahead and kept.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RGIMAGELOADER_H_
+#define _RGIMAGELOADER_H_
+
+#include <gtk/gtk.h>
+
+#include "taskpool.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * RGImageLoader - Decoded image files by path and bounding size
+ *
+ *     unsigned ticket = RGImageLoader::instance().request(file, 0, 0,
+ *         [image](GdkPixbuf *pixbuf) {
+ *             if (pixbuf) {
+ *                 gtk_image_set_from_pixbuf(image, pixbuf);
+ *                 g_object_unref(pixbuf);
+ *             }
+ *         });
+ *     RGImageLoader::instance().preload(nextFile, 0, 0);
+ *     ...
+ *     RGImageLoader::instance().cancel(ticket);   // before image goes
+ *
+ * A size of 0 leaves that side as the file has it; otherwise the image
+ * is scaled down to fit, keeping its aspect. Requests and preloads of
+ * one image share a single decode. The most recently used images are
+ * kept, up to the capacity.
+ *
+ * Thread Safety:
+ *   Main loop only, like the rest of GTK; the ready callbacks run on
+ *   it too, never from within request().
+ */
+class RGImageLoader {
+public:
+    // A slide or two and the screenshots around the selected row
+    static const size_t DEFAULT_CAPACITY = 8;
+
+    /**
+     * Receives a new reference to the image, or nullptr if it could not
+     * be decoded
+     */
+    using Ready = function<void(GdkPixbuf *pixbuf)>;
+
+    static RGImageLoader& instance();
+
+    RGImageLoader(const RGImageLoader&) = delete;
+    RGImageLoader& operator=(const RGImageLoader&) = delete;
+
+    /**
+     * Decode the image unless it is kept already, and call ready from
+     * the main loop with it
+     *
+     * @return Ticket for cancel()
+     */
+    unsigned request(const string& path, int maxWidth, int maxHeight, Ready ready);
+
+    /**
+     * Drop the ready callback of a request that is not done yet; the
+     * decode itself runs on and the image is kept
+     */
+    void cancel(unsigned ticket);
+
+    /**
+     * Decode the image for a request likely to come
+     */
+    void preload(const string& path, int maxWidth, int maxHeight);
+
+    void setCapacity(size_t images);
+    size_t getCount() const { return _entries.size(); }
+
+private:
+    RGImageLoader();
+    ~RGImageLoader();
+
+    struct Entry {
+        GdkPixbuf *pixbuf;                  // nullptr if it failed
+        list<string>::iterator use;         // Position in _lru
+    };
+
+    list<string> _lru;                      // Keys, most recent first
+    map<string, Entry> _entries;
+    map<string, vector<pair<unsigned, Ready>>> _pending;    // Waiters of each decode
+    set<unsigned> _waiting;                 // Tickets not done or cancelled
+    size_t _capacity;
+    unsigned _nextTicket;
+
+    // Last, so the workers stop before anything they use goes away
+    PolySynaptic::TaskPool _pool;
+
+    static string keyFor(const string& path, int maxWidth, int maxHeight);
+    void decode(const string& key, const string& path, int maxWidth, int maxHeight);
+    void decoded(const string& key, GdkPixbuf *pixbuf);
+    void insert(const string& key, GdkPixbuf *pixbuf);     // Takes the reference
+    void trim();
+};
+
+#endif // _RGIMAGELOADER_H_
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,452 @@
+/* rgloglist.cc - Log entry list model implementation
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include "rgloglist.h"
+
+#include <algorithm>
+#include <cctype>
+
+// ============================================================================
+// Helper Functions
+// ============================================================================
+
+static string fold(const string& s)
+{
+    string out(s);
+    for (auto& c : out) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return out;
+}
+
+// Everything the search box matches against, lowercased once
+static string folded_text(const LogEntry& entry)
+{
+    string text;
+    text.reserve(entry.message.size() + 32);
+    text += entry.message;
+    for (const string* field : { &entry.provider, &entry.operation,
+                                 &entry.packageId, &entry.component,
+                                 &entry.errorCode }) {
+        if (!field->empty()) {
+            text += '\n';
+            text += *field;
+        }
+    }
+    return fold(text);
+}
+
+// The search is folded once by the caller
+static bool passes(const RGLogRow& row, const RGLogFilter& filter,
+                   const string& search)
+{
+    const LogEntry& entry = row.entry;
+    if (entry.level < filter.minLevel) return false;
+    if (!filter.provider.empty() && entry.provider != filter.provider) return false;
+    if (!filter.operation.empty() && entry.operation != filter.operation) return false;
+    return search.empty() || row.folded.find(search) != string::npos;
+}
+
+// ============================================================================
+// GObject Type Registration
+// ============================================================================
+
+static void rg_log_list_tree_model_init(GtkTreeModelIface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(RGLogList, rg_log_list, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, rg_log_list_tree_model_init))
+
+static void rg_log_list_init(RGLogList* list)
+{
+    list->rows = new deque<RGLogRow>();
+    list->first_seq = 0;
+    list->max_rows = 10000;
+    list->visible = new deque<guint64>();
+    list->filter = new RGLogFilter();
+}
+
+static void rg_log_list_finalize(GObject* object)
+{
+    RGLogList* list = RG_LOG_LIST(object);
+
+    delete list->rows;
+    delete list->visible;
+    delete list->filter;
+
+    G_OBJECT_CLASS(rg_log_list_parent_class)->finalize(object);
+}
+
+static void rg_log_list_class_init(RGLogListClass* klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = rg_log_list_finalize;
+}
+
+// ============================================================================
+// Rows
+// ============================================================================
+
+// Iterators hold the offset of the row in list->rows, which stays put
+// until rows are dropped from the front; every drop is signalled
+static void set_iter(GtkTreeIter* iter, const RGLogList* list, guint64 seq)
+{
+    iter->stamp = 1;
+    iter->user_data = GSIZE_TO_POINTER((gsize)(seq - list->first_seq));
+    iter->user_data2 = nullptr;
+    iter->user_data3 = nullptr;
+}
+
+static guint64 iter_seq(const RGLogList* list, GtkTreeIter* iter)
+{
+    return list->first_seq + GPOINTER_TO_SIZE(iter->user_data);
+}
+
+static const RGLogRow* row_of(const RGLogList* list, GtkTreeIter* iter)
+{
+    gsize offset = GPOINTER_TO_SIZE(iter->user_data);
+    return offset < list->rows->size() ? &(*list->rows)[offset] : nullptr;
+}
+
+static void emit_row_inserted(RGLogList* list, gint row, guint64 seq)
+{
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    GtkTreeIter iter;
+    set_iter(&iter, list, seq);
+
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(list), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_deleted(RGLogList* list, gint row)
+{
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(list), path);
+    gtk_tree_path_free(path);
+}
+
+// Drop the oldest row, and its visible row if it had one
+static void drop_front(RGLogList* list)
+{
+    bool shown = !list->visible->empty() &&
+                 list->visible->front() == list->first_seq;
+    list->rows->pop_front();
+    list->first_seq++;
+    if (shown) {
+        list->visible->pop_front();
+        emit_row_deleted(list, 0);
+    }
+}
+
+// Replace the visible rows without a signal per row
+static void swap_visible(RGLogList* list, deque<guint64>& visible,
+                         GtkTreeView* view)
+{
+    bool attached = view && gtk_tree_view_get_model(view) == GTK_TREE_MODEL(list);
+
+    if (attached) {
+        g_object_ref(list);
+        gtk_tree_view_set_model(view, nullptr);
+        list->visible->swap(visible);
+        gtk_tree_view_set_model(view, GTK_TREE_MODEL(list));
+        g_object_unref(list);
+        return;
+    }
+
+    // Nobody attached through a view: signal it the slow way
+    while (!list->visible->empty()) {
+        list->visible->pop_back();
+        emit_row_deleted(list, list->visible->size());
+    }
+    for (guint64 seq : visible) {
+        list->visible->push_back(seq);
+        emit_row_inserted(list, list->visible->size() - 1, seq);
+    }
+}
+
+// ============================================================================
+// TreeModel Interface
+// ============================================================================
+
+static gint rg_log_list_get_n_columns(GtkTreeModel* model)
+{
+    return LOG_NUM_COLS;
+}
+
+static GType rg_log_list_get_column_type(GtkTreeModel* model, gint column)
+{
+    switch (column) {
+        case LOG_COL_TEXT:
+        case LOG_COL_FOREGROUND:
+        case LOG_COL_BACKGROUND:
+            return G_TYPE_STRING;
+        case LOG_COL_WEIGHT:
+            return G_TYPE_INT;
+        case LOG_COL_ENTRY_PTR:
+            return G_TYPE_POINTER;
+        default:
+            return G_TYPE_INVALID;
+    }
+}
+
+static gboolean rg_log_list_get_iter(GtkTreeModel* model,
+                                     GtkTreeIter* iter,
+                                     GtkTreePath* path)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+
+    if (gtk_tree_path_get_depth(path) != 1) return FALSE;
+
+    gint row = gtk_tree_path_get_indices(path)[0];
+    if (row < 0 || row >= (gint)list->visible->size()) return FALSE;
+
+    set_iter(iter, list, (*list->visible)[row]);
+    return TRUE;
+}
+
+static GtkTreePath* rg_log_list_get_path(GtkTreeModel* model,
+                                         GtkTreeIter* iter)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+    guint64 seq = iter_seq(list, iter);
+
+    auto it = lower_bound(list->visible->begin(), list->visible->end(), seq);
+    if (it == list->visible->end() || *it != seq) return nullptr;
+
+    GtkTreePath* path = gtk_tree_path_new();
+    gtk_tree_path_append_index(path, it - list->visible->begin());
+    return path;
+}
+
+// Only rows on screen get here, so this is where the text is built
+static void rg_log_list_get_value(GtkTreeModel* model,
+                                  GtkTreeIter* iter,
+                                  gint column,
+                                  GValue* value)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+    const RGLogRow* row = row_of(list, iter);
+
+    g_value_init(value, rg_log_list_get_column_type(model, column));
+    if (!row) return;
+
+    const LogEntry& entry = row->entry;
+    switch (column) {
+        case LOG_COL_TEXT:
+            g_value_set_string(value, entry.toReadable().c_str());
+            break;
+
+        case LOG_COL_FOREGROUND:
+            switch (entry.level) {
+                case LogLevel::DEBUG: g_value_set_string(value, "#888888"); break;
+                case LogLevel::WARN:  g_value_set_string(value, "#f57c00"); break;
+                case LogLevel::ERROR: g_value_set_string(value, "#d32f2f"); break;
+                case LogLevel::FATAL: g_value_set_string(value, "#ffffff"); break;
+                default: break;     // Theme colour
+            }
+            break;
+
+        case LOG_COL_BACKGROUND:
+            if (entry.level == LogLevel::FATAL) {
+                g_value_set_string(value, "#d32f2f");
+            }
+            break;
+
+        case LOG_COL_WEIGHT:
+            g_value_set_int(value, entry.level >= LogLevel::WARN
+                                   ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
+            break;
+
+        case LOG_COL_ENTRY_PTR:
+            g_value_set_pointer(value, (gpointer)&entry);
+            break;
+    }
+}
+
+static gboolean rg_log_list_iter_next(GtkTreeModel* model, GtkTreeIter* iter)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+
+    auto it = upper_bound(list->visible->begin(), list->visible->end(),
+                          iter_seq(list, iter));
+    if (it == list->visible->end()) return FALSE;
+
+    set_iter(iter, list, *it);
+    return TRUE;
+}
+
+static gboolean rg_log_list_iter_children(GtkTreeModel* model,
+                                          GtkTreeIter* iter,
+                                          GtkTreeIter* parent)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+
+    if (parent != nullptr || list->visible->empty()) return FALSE;
+
+    set_iter(iter, list, list->visible->front());
+    return TRUE;
+}
+
+static gboolean rg_log_list_iter_has_child(GtkTreeModel* model,
+                                           GtkTreeIter* iter)
+{
+    return FALSE;  // Flat list
+}
+
+static gint rg_log_list_iter_n_children(GtkTreeModel* model,
+                                        GtkTreeIter* iter)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+
+    if (iter != nullptr) return 0;
+    return list->visible->size();
+}
+
+static gboolean rg_log_list_iter_nth_child(GtkTreeModel* model,
+                                           GtkTreeIter* iter,
+                                           GtkTreeIter* parent,
+                                           gint n)
+{
+    RGLogList* list = RG_LOG_LIST(model);
+
+    if (parent != nullptr) return FALSE;
+    if (n < 0 || n >= (gint)list->visible->size()) return FALSE;
+
+    set_iter(iter, list, (*list->visible)[n]);
+    return TRUE;
+}
+
+static gboolean rg_log_list_iter_parent(GtkTreeModel* model,
+                                        GtkTreeIter* iter,
+                                        GtkTreeIter* child)
+{
+    return FALSE;  // Flat list, no parents
+}
+
+static GtkTreeModelFlags rg_log_list_get_flags(GtkTreeModel* model)
+{
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static void rg_log_list_tree_model_init(GtkTreeModelIface* iface)
+{
+    iface->get_flags = rg_log_list_get_flags;
+    iface->get_n_columns = rg_log_list_get_n_columns;
+    iface->get_column_type = rg_log_list_get_column_type;
+    iface->get_iter = rg_log_list_get_iter;
+    iface->get_path = rg_log_list_get_path;
+    iface->get_value = rg_log_list_get_value;
+    iface->iter_next = rg_log_list_iter_next;
+    iface->iter_children = rg_log_list_iter_children;
+    iface->iter_has_child = rg_log_list_iter_has_child;
+    iface->iter_n_children = rg_log_list_iter_n_children;
+    iface->iter_nth_child = rg_log_list_iter_nth_child;
+    iface->iter_parent = rg_log_list_iter_parent;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+RGLogList* rg_log_list_new(size_t max_rows)
+{
+    RGLogList* list = RG_LOG_LIST(g_object_new(RG_TYPE_LOG_LIST, nullptr));
+    list->max_rows = max(max_rows, (size_t)1);
+    return list;
+}
+
+guint64 rg_log_list_next_seq(RGLogList* list)
+{
+    return list->first_seq + list->rows->size();
+}
+
+void rg_log_list_append(RGLogList* list, const vector<LogEntry>& entries,
+                        guint64 first_seq)
+{
+    guint64 next = rg_log_list_next_seq(list);
+    guint64 end = first_seq + entries.size();
+    if (end <= next) return;
+
+    // The sink dropped entries we never saw; what is held can stay, but
+    // the sequence numbers must stay contiguous
+    if (first_seq > next) {
+        while (!list->rows->empty()) {
+            drop_front(list);
+        }
+        list->first_seq = first_seq;
+        next = first_seq;
+    }
+
+    // Only the newest max_rows can be kept, so make room first and
+    // never insert a row only to drop it again
+    size_t skip = next - first_seq;
+    size_t count = entries.size() - skip;
+    if (count > list->max_rows) {
+        skip += count - list->max_rows;
+        count = list->max_rows;
+        while (!list->rows->empty()) {
+            drop_front(list);
+        }
+        list->first_seq = first_seq + skip;
+    }
+    while (list->rows->size() + count > list->max_rows) {
+        drop_front(list);
+    }
+
+    string search = fold(list->filter->search);
+    for (size_t i = skip; i < entries.size(); i++) {
+        RGLogRow row;
+        row.entry = entries[i];
+        row.folded = folded_text(row.entry);
+        list->rows->push_back(move(row));
+
+        if (passes(list->rows->back(), *list->filter, search)) {
+            guint64 seq = first_seq + i;
+            list->visible->push_back(seq);
+            emit_row_inserted(list, list->visible->size() - 1, seq);
+        }
+    }
+}
+
+void rg_log_list_set_filter(RGLogList* list, const RGLogFilter& filter,
+                            GtkTreeView* view)
+{
+    *list->filter = filter;
+
+    // The filter index is rebuilt from the folded text, no row is
+    // formatted for it
+    string search = fold(filter.search);
+    deque<guint64> visible;
+    for (size_t i = 0; i < list->rows->size(); i++) {
+        if (passes((*list->rows)[i], filter, search)) {
+            visible.push_back(list->first_seq + i);
+        }
+    }
+    swap_visible(list, visible, view);
+}
+
+void rg_log_list_clear(RGLogList* list, GtkTreeView* view)
+{
+    deque<guint64> none;
+    swap_visible(list, none, view);
+
+    list->first_seq = rg_log_list_next_seq(list);
+    list->rows->clear();
+}
+
+vector<const LogEntry*> rg_log_list_visible_entries(RGLogList* list)
+{
+    vector<const LogEntry*> entries;
+    entries.reserve(list->visible->size());
+    for (guint64 seq : *list->visible) {
+        entries.push_back(&(*list->rows)[seq - list->first_seq].entry);
+    }
+    return entries;
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,112 @@
+/* rgloglist.h - Log entry list model for the debug panel
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file provides a GtkTreeModel over the entries of a MemorySink,
+ * so the debug panel can show tens of thousands of log lines while
+ * only formatting the ones on screen.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _RGLOGLIST_H_
+#define _RGLOGLIST_H_
+
+#include <gtk/gtk.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "structuredlog.h"
+
+using namespace PolySynaptic;
+
+/**
+ * RGLogList - GTK TreeModel for log entries
+ *
+ * The model keeps a bounded copy of the entries it was given, each with
+ * its sequence number from the sink, and the sequence numbers of the
+ * ones passing the filter. Rows are those sequence numbers; the text of
+ * a row is only built when the view asks for it, which with a fixed
+ * height view is only for the rows on screen.
+ */
+
+// Column definitions for the log list
+enum LogListCols {
+    LOG_COL_TEXT,               // Readable line
+    LOG_COL_FOREGROUND,         // Colour of the level
+    LOG_COL_BACKGROUND,         // Background of the level, or NULL
+    LOG_COL_WEIGHT,             // Pango weight of the level
+    LOG_COL_ENTRY_PTR,          // Pointer to the LogEntry
+    LOG_NUM_COLS
+};
+
+/**
+ * RGLogFilter - Which entries the list shows
+ */
+struct RGLogFilter {
+    LogLevel minLevel = LogLevel::DEBUG;
+    string provider;            // Empty for all
+    string operation;           // Empty for all
+    string search;              // Case-insensitive substring, empty for all
+};
+
+// GObject type registration
+#define RG_TYPE_LOG_LIST (rg_log_list_get_type())
+#define RG_LOG_LIST(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), RG_TYPE_LOG_LIST, RGLogList))
+
+typedef struct _RGLogList RGLogList;
+typedef struct _RGLogListClass RGLogListClass;
+
+struct RGLogRow {
+    LogEntry entry;
+    string folded;              // Lowercased searchable text
+};
+
+struct _RGLogList {
+    GObject parent;
+
+    // Entries kept, oldest first; the first has sequence number first_seq
+    deque<RGLogRow>* rows;
+    guint64 first_seq;
+    size_t max_rows;
+
+    // Sequence numbers of the rows passing the filter, ascending
+    deque<guint64>* visible;
+    RGLogFilter* filter;
+};
+
+struct _RGLogListClass {
+    GObjectClass parent_class;
+};
+
+GType rg_log_list_get_type();
+RGLogList* rg_log_list_new(size_t max_rows);
+
+// Append entries, the first with sequence number first_seq; entries
+// already held are skipped. Rows pushed out of the list are signalled
+// deleted and new rows passing the filter inserted, all in one batch.
+void rg_log_list_append(RGLogList* list, const vector<LogEntry>& entries,
+                        guint64 first_seq);
+
+// Sequence number the next appended entry should have
+guint64 rg_log_list_next_seq(RGLogList* list);
+
+// Show only the entries passing filter. The visible rows are rebuilt
+// from the held entries, with the model detached from view (if given)
+// meanwhile so it does not get a signal per row.
+void rg_log_list_set_filter(RGLogList* list, const RGLogFilter& filter,
+                            GtkTreeView* view = nullptr);
+
+// Drop every row; later appends continue after the last sequence number
+void rg_log_list_clear(RGLogList* list, GtkTreeView* view = nullptr);
+
+// The entries passing the filter, oldest first
+vector<const LogEntry*> rg_log_list_visible_entries(RGLogList* list);
+
+#endif // _RGLOGLIST_H_
+
+// vim:ts=4:sw=4:et
@@ -21,10 +21,9 @@
  */
 
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
-#include <map>
-#include <utility>
-#include <apt-pkg/fileutl.h>
+#include <fstream>
 
 #include "config.h"
 #include "rglogview.h"
@@ -38,81 +37,153 @@ enum { COLUMN_LOG_DAY,
        COLUMN_LOG_TYPE, 
        N_LOG_COLUMNS };
 
-enum { LOG_TYPE_TOPLEVEL, LOG_TYPE_FILE };
+// a month not expanded yet holds one placeholder, so it has an expander
+enum { LOG_TYPE_TOPLEVEL, LOG_TYPE_FILE, LOG_TYPE_PLACEHOLDER };
 
-void RGLogView::readLogs()
+static int monthKey(const struct tm &when)
+{
+   return (when.tm_year + 1900) * 100 + when.tm_mon + 1;
+}
+
+// utf8() gives NULL for what it cannot convert
+static string escapable(const char *str)
 {
-   map<int, GtkTreeIter> history_map;
-   int history_key;
+   const char *converted = utf8(str);
+   return converted != NULL ? converted : "";
+}
+
+void RGLogView::appendLog(GtkTreeStore *store, GtkTreeIter *month,
+                          const RHistoryIndex::Entry &log)
+{
+   char str[128];
+   strftime(str, sizeof(str), "%x %R", &log.when);
+   string markup = MarkupEscapeString(escapable(str));
+   if (!log.names.empty()) {
+      string names = log.names;
+      if (log.packages > RHistoryIndex::MaxNames)
+         names += ", \u2026";
+      markup += "\n<small>" + MarkupEscapeString(escapable(names.c_str())) +
+                "</small>";
+   }
+
+   GtkTreeIter date_iter;
+   gtk_tree_store_append(store, &date_iter, month);
+   gtk_tree_store_set(store, &date_iter,
+                      COLUMN_LOG_DAY, markup.c_str(),
+                      COLUMN_LOG_FILENAME, log.file.c_str(),
+                      COLUMN_LOG_TYPE, LOG_TYPE_FILE,
+                      -1);
+}
 
+GtkTreeModel *RGLogView::buildModel(const vector<const RHistoryIndex::Entry *> &logs,
+                                    bool lazy)
+{
    GtkTreeStore *store = gtk_tree_store_new(N_LOG_COLUMNS, 
 					    G_TYPE_STRING,
 					    G_TYPE_STRING,
 					    G_TYPE_INT);
-   
-   GtkTreeIter month_iter;  /* Parent iter */
-   GtkTreeIter date_iter;  /* Child iter  */
 
-   unsigned int year, month, day, hour, min, sec;
+   // newest first, so each month's logs are together
+   GtkTreeIter month_iter;
+   int month = 0;
    char str[128];
-   const gchar *logfile;
-   GDir *dir = g_dir_open(RLogDir().c_str(), 0, NULL);
-   while((logfile=g_dir_read_name(dir)) != NULL) {
-      if(sscanf(logfile, "%4u-%2u-%2u.%2u%2u%2u.log", 
-		&year, &month, &day, &hour, &min, &sec) != 6)
-	 continue;
-
-      struct tm t;
-      t.tm_year = year-1900;
-      t.tm_mon = month-1;
-      t.tm_mday = day;
-      t.tm_hour = hour;
-      t.tm_min = min;
-      t.tm_sec = sec;
-      GDate *date = g_date_new_dmy(day, (GDateMonth)month, year);
-      // need to convert here:
-      // glib: 1=Monday to 7=Sunday 
-      // libc: 0=Sunday to 6=Saturday
-      t.tm_wday = g_date_get_weekday(date); 
-      t.tm_wday %= 7;
-
-      history_key = year*100+month;
-      if(history_map.count(history_key) == 0) {
-	 gtk_tree_store_append(store, &month_iter, NULL); 
-	 strftime(str, 128, "%B %Y", &t);
-	 gchar *sort_key = g_strdup_printf("%i", history_key);
-	 gtk_tree_store_set (store, &month_iter,
-			     COLUMN_LOG_DAY, utf8(str),
-			     COLUMN_LOG_FILENAME, sort_key, 
-			     COLUMN_LOG_TYPE, LOG_TYPE_TOPLEVEL, 
-			     -1);
-	 g_free(sort_key);
-	 history_map.insert(std::make_pair(history_key,month_iter));
-      } else {
-	 month_iter = history_map[history_key];
+   for (unsigned int i = 0; i < logs.size(); i++) {
+      const RHistoryIndex::Entry &log = *logs[i];
+      int key = monthKey(log.when);
+      if (key != month) {
+         month = key;
+         strftime(str, sizeof(str), "%B %Y", &log.when);
+         gchar *sort_key = g_strdup_printf("%i", key);
+         gtk_tree_store_append(store, &month_iter, NULL);
+         gtk_tree_store_set(store, &month_iter,
+                            COLUMN_LOG_DAY, utf8(str),
+                            COLUMN_LOG_FILENAME, sort_key,
+                            COLUMN_LOG_TYPE, LOG_TYPE_TOPLEVEL,
+                            -1);
+         g_free(sort_key);
+
+         if (lazy) {
+            GtkTreeIter placeholder;
+            gtk_tree_store_append(store, &placeholder, &month_iter);
+            gtk_tree_store_set(store, &placeholder,
+                               COLUMN_LOG_DAY, "",
+                               COLUMN_LOG_FILENAME, "",
+                               COLUMN_LOG_TYPE, LOG_TYPE_PLACEHOLDER,
+                               -1);
+         }
       }
-
-      strftime(str, 512, "%x %R", &t);
-      gtk_tree_store_append (store, &date_iter, &month_iter);
-      gtk_tree_store_set (store, &date_iter,
-			  COLUMN_LOG_DAY, utf8(str),
-			  COLUMN_LOG_FILENAME, logfile, 
-			  COLUMN_LOG_TYPE, LOG_TYPE_FILE, 
-			  -1);
-      g_free(date);
+      if (!lazy)
+         appendLog(store, &month_iter, log);
    }
-   g_dir_close(dir);
 
    GtkTreeModel *sort_model;
-   /* Create the first tree */
    sort_model = gtk_tree_model_sort_new_with_model(GTK_TREE_MODEL(store));
+   g_object_unref(store);
 
    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sort_model),
 					 COLUMN_LOG_FILENAME, 
 					 GTK_SORT_DESCENDING);
-   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), 
-			   GTK_TREE_MODEL(sort_model));
-   _realModel = sort_model;
+   return sort_model;
+}
+
+void RGLogView::readLogs()
+{
+   // the index is brought up to date here, which only reads the logs
+   // written without it
+   _history.load();
+
+   _months.clear();
+   vector<const RHistoryIndex::Entry *> logs;
+   const vector<RHistoryIndex::Entry> &entries = _history.entries();
+   for (unsigned int i = 0; i < entries.size(); i++) {
+      logs.push_back(&entries[i]);
+      _months[monthKey(entries[i].when)].push_back(&entries[i]);
+   }
+
+   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), NULL);
+   if (_foundModel != NULL) {
+      g_object_unref(_foundModel);
+      _foundModel = NULL;
+   }
+   if (_realModel != NULL)
+      g_object_unref(_realModel);
+   _realModel = buildModel(logs, true);
+   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), _realModel);
+}
+
+gboolean RGLogView::cbTestExpandRow(GtkTreeView *view, GtkTreeIter *iter,
+                                    GtkTreePath *path, gpointer data)
+{
+   RGLogView *me = (RGLogView*)data;
+
+   // the search results are complete already
+   GtkTreeModel *model = gtk_tree_view_get_model(view);
+   if (model != me->_realModel)
+      return FALSE;
+
+   GtkTreeIter month, child;
+   gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT(model),
+                                                  &month, iter);
+   GtkTreeModel *storeModel =
+      gtk_tree_model_sort_get_model(GTK_TREE_MODEL_SORT(model));
+   GtkTreeStore *store = GTK_TREE_STORE(storeModel);
+
+   int type = LOG_TYPE_FILE;
+   if (gtk_tree_model_iter_children(storeModel, &child, &month))
+      gtk_tree_model_get(storeModel, &child, COLUMN_LOG_TYPE, &type, -1);
+   if (type != LOG_TYPE_PLACEHOLDER)
+      return FALSE;
+
+   gchar *sort_key = NULL;
+   gtk_tree_model_get(storeModel, &month, COLUMN_LOG_FILENAME, &sort_key, -1);
+   const vector<const RHistoryIndex::Entry *> &logs =
+      me->_months[atoi(sort_key)];
+   g_free(sort_key);
+
+   for (unsigned int i = 0; i < logs.size(); i++)
+      me->appendLog(store, &month, *logs[i]);
+   gtk_tree_store_remove(store, &child);
+   return FALSE;
 }
 
 void RGLogView::cbCloseClicked(GtkWidget *self, void *data)
@@ -131,15 +202,19 @@ void RGLogView::cbTreeSelectionChanged(GtkTreeSelection *selection,
    GtkTreeModel *model;
    GtkTextIter start, end;
    gchar *file = NULL;
+   int type;
 
    if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
 	 GtkTextBuffer *buffer;
 	 GtkTextIter start,end;
 
-	 gtk_tree_model_get (model, &iter, COLUMN_LOG_FILENAME, &file, -1);
-	 // the months do not have a valid file 
-	 if(!FileExists(RLogDir()+string(file)))
+	 gtk_tree_model_get (model, &iter, COLUMN_LOG_FILENAME, &file, 
+			     COLUMN_LOG_TYPE, &type, -1);
+	 // the months do not have a file 
+	 if(type != LOG_TYPE_FILE) {
+	    g_free(file);
 	    return;
+	 }
 
 	 buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(me->_textView));
 	 gtk_text_buffer_get_start_iter (buffer, &start);
@@ -175,53 +250,6 @@ void RGLogView::cbTreeSelectionChanged(GtkTreeSelection *selection,
    }
 }
 
-gboolean RGLogView::filter_func(GtkTreeModel *model, GtkTreeIter *iter,
-				gpointer data)
-{
-   RGLogView *me = (RGLogView*)data;
-   gchar *file;
-   int type;
-   string s;
-
-   gtk_tree_model_get(model, iter, 
-		      COLUMN_LOG_FILENAME, &file, 
-		      COLUMN_LOG_TYPE, &type,
-		      -1);
-
-   if(type == LOG_TYPE_TOPLEVEL)
-      return TRUE;
-
-
-   string logfile = RLogDir() + string(file);
-
-   ifstream in(logfile.c_str());
-   if(!in) {
-      g_warning("can't open logfile: %s",logfile.c_str());
-      return FALSE;
-   }
-   while(getline(in, s)) {
-      if(s.find(me->findStr) != string::npos) {
-	 return TRUE;
-      }
-   }
-
-   return FALSE;
-}
-
-gboolean empty_row_filter_func(GtkTreeModel *model, GtkTreeIter *iter, 
-			       gpointer data)
-{
-   int type;
-
-   gtk_tree_model_get(model, iter, COLUMN_LOG_TYPE, &type, -1);
-   // top-level expander
-   if(type == LOG_TYPE_TOPLEVEL) {
-      return gtk_tree_model_iter_has_child(model, iter);
-   }
-
-   return TRUE;
-}
-
 void RGLogView::clearLogBuf()
 {
    GtkTextBuffer *buffer;
@@ -245,12 +273,8 @@ void RGLogView::cbButtonFind(GtkWidget *self, void *data)
 {
    //cout << "RGLogView::cbButtonFind()" << endl;
    RGLogView *me = (RGLogView*)data;
-   GtkTreeModel *filter_model, *empty_row_filter;
-   GtkTreeIter iter; 
-   gchar *file;
 
-   GtkTreeModel *model = me->_realModel;
-   if(model == NULL) {
+   if(me->_realModel == NULL) {
       g_warning("model==NULL in cbButtonFind");
       return;
    }
@@ -262,23 +286,22 @@ void RGLogView::cbButtonFind(GtkWidget *self, void *data)
    if(strlen(me->findStr) == 0) {
       me->findStr = NULL;
       gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), me->_realModel);
+      if(me->_foundModel != NULL) {
+	 g_object_unref(me->_foundModel);
+	 me->_foundModel = NULL;
+      }
       return;
    } 
-     
-   // filter for the search string
-   filter_model=(GtkTreeModel*)gtk_tree_model_filter_new(model, NULL);
-   gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(filter_model), 
-					  me->filter_func, me, NULL);
 
-   // filter out empty nodes
-   empty_row_filter=(GtkTreeModel*)gtk_tree_model_filter_new(filter_model, NULL);
-   gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(empty_row_filter), 
-					  empty_row_filter_func, me, NULL);
-   gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), empty_row_filter);
+   // the index settles most searches without opening the logs
+   vector<const RHistoryIndex::Entry *> found = me->_history.search(me->findStr);
+   GtkTreeModel *model = me->buildModel(found, false);
+   gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), model);
+   if(me->_foundModel != NULL)
+      g_object_unref(me->_foundModel);
+   me->_foundModel = model;
 
-
-   int toplevel_children = gtk_tree_model_iter_n_children(empty_row_filter, NULL);
-   if(toplevel_children == 0) {
+   if(found.empty()) {
       me->appendLogBuf(_("Not found"));
    } else {
       me->appendLogBuf(_("Expression was found, please see the list "
@@ -297,7 +320,8 @@ void RGLogView::show()
 }
 
 RGLogView::RGLogView(RGWindow *parent)
-   : RGGtkBuilderWindow(parent, "logview"), findStr(NULL)
+   : RGGtkBuilderWindow(parent, "logview"), findStr(NULL),
+     _realModel(NULL), _foundModel(NULL), _history(RLogDir())
 {
    GtkWidget *vbox = GTK_WIDGET(gtk_builder_get_object(_builder, "vbox_main"));
    assert(vbox);
@@ -335,6 +359,9 @@ RGLogView::RGLogView(RGWindow *parent)
    g_signal_connect(G_OBJECT(select), "changed",
 		    G_CALLBACK (cbTreeSelectionChanged),
 		    this);
+   g_signal_connect(G_OBJECT(_treeView), "test-expand-row",
+		    G_CALLBACK (cbTestExpandRow),
+		    this);
    _textView = GTK_WIDGET(gtk_builder_get_object(_builder, "textview_log"));
    assert(_textView);
 
@@ -347,3 +374,11 @@ RGLogView::RGLogView(RGWindow *parent)
 					  "background", "yellow", NULL); 
 
 }
+
+RGLogView::~RGLogView()
+{
+   if (_realModel != NULL)
+      g_object_unref(_realModel);
+   if (_foundModel != NULL)
+      g_object_unref(_foundModel);
+}
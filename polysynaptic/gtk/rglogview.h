@@ -25,6 +25,9 @@
 #define _RGLOGVIEW_H_
 
 #include "rggtkbuilderwindow.h"
+#include "rhistoryindex.h"
+
+#include <map>
 
 
 class RGLogView : public RGGtkBuilderWindow {
@@ -33,8 +36,8 @@ class RGLogView : public RGGtkBuilderWindow {
    static void cbButtonFind(GtkWidget *self, void *data);
    static void cbTreeSelectionChanged(GtkTreeSelection *selection, 
 				      gpointer data);
-   static gboolean filter_func(GtkTreeModel *model, GtkTreeIter *iter,
-			       gpointer data);
+   static gboolean cbTestExpandRow(GtkTreeView *view, GtkTreeIter *iter,
+                                   GtkTreePath *path, gpointer data);
 
    // some widgets
    GtkWidget *_treeView;
@@ -45,6 +48,19 @@ class RGLogView : public RGGtkBuilderWindow {
    // data
    const gchar *findStr;
    GtkTreeModel *_realModel;
+   GtkTreeModel *_foundModel;
+
+   // the logs, from the index the lister keeps next to them; each
+   // month's rows are only made when it is expanded
+   RHistoryIndex _history;
+   map<int, vector<const RHistoryIndex::Entry *> > _months;
+
+   // a sorted tree of months and their logs, with a placeholder row in
+   // each month instead of its logs if lazy
+   GtkTreeModel *buildModel(const vector<const RHistoryIndex::Entry *> &logs,
+                            bool lazy);
+   void appendLog(GtkTreeStore *store, GtkTreeIter *month,
+                  const RHistoryIndex::Entry &log);
 
    // set new logbuffer text
    void clearLogBuf();
@@ -56,7 +72,7 @@ class RGLogView : public RGGtkBuilderWindow {
    virtual void show();
    void readLogs();
 
-   virtual ~RGLogView() {};
+   virtual ~RGLogView();
 };
 
 
@@ -36,7 +36,9 @@
 #include <cmath>
 #include <algorithm>
 #include <fstream>
+#include <future>
 #include <sstream>
+#include <thread>
 #include <time.h>
 
 #include <sys/types.h>
@@ -62,6 +64,16 @@
 #include "rgpreferenceswindow.h"
 #include "rgbackendsettings.h"
 #include "rgsummarywindow.h"
+#include "desiredstate.h"
+#include "taskgraph.h"
+#include "operationhistory.h"
+#include "popularityindex.h"
+#include "startupprofile.h"
+#include "structuredlog.h"
+#include "latency.h"
+#include "memoryusage.h"
+#include "perfdiagnosis.h"
+#include "rgdebugpanel.h"
 #include "rgchangeswindow.h"
 #include "rgcdscanner.h"
 #include "rgpkgcdrom.h"
@@ -76,6 +88,8 @@
 #include "rgdebinstallprogress.h"
 #include "rgterminstallprogress.h"
 #include "rgutils.h"
+#include "rgasync.h"
+#include "rgframetiming.h"
 #include "sections_trans.h"
 #include "rgpkgtreeview.h"
 
@@ -106,11 +120,63 @@ enum { DEP_NAME_COLUMN,         /* text */
 };                              /* additional info (install 
                                    not installed) as text */
 
+enum { UNMET_TEXT_COLUMN,
+   UNMET_PKG_COLUMN             /* RPackage of a package row, NULL below */
+};
+
+// the unmet dialog opens with every package expanded up to this many
+static const unsigned int UNMET_EXPANDED_MAX = 10;
+
+// what a selected package allows, as counted in RGMainWindow::_selection
+enum { SELECTION_KEEP = 1 << 0,
+   SELECTION_INSTALL = 1 << 1,
+   SELECTION_REINSTALL = 1 << 2,
+   SELECTION_UPGRADE = 1 << 3,
+   SELECTION_REMOVE = 1 << 4,
+   SELECTION_PURGE = 1 << 5,
+   SELECTION_INSTALLED = 1 << 6   /* help and reconfigure */
+};
+
+static unsigned int selectionMask(RPackage *pkg)
+{
+   int flags = pkg->getFlags();
+   unsigned int mask = 0;
+
+   // a pinned package takes no actions
+   if (flags & RPackage::FPinned)
+      return 0;
+
+   // unmark if a action is performed with the pkg
+   if((flags & RPackage::FInstall)   || (flags & RPackage::FNewInstall) ||
+      (flags & RPackage::FReInstall) || (flags & RPackage::FUpgrade) ||
+      (flags & RPackage::FDowngrade) || (flags & RPackage::FRemove) ||
+      (flags & RPackage::FPurge))
+      mask |= SELECTION_KEEP;
+   // install if not installed
+   if(!(flags & RPackage::FInstalled))
+      mask |= SELECTION_INSTALL;
+   // reinstall if installed and installable and not outdated
+   if(flags & RPackage::FInstalled
+      && !(flags & RPackage::FNotInstallable)
+      && !(flags & RPackage::FOutdated))
+      mask |= SELECTION_REINSTALL;
+   // upgrade if outdated
+   if(flags & RPackage::FOutdated)
+      mask |= SELECTION_UPGRADE;
+   if(flags & RPackage::FInstalled)
+      mask |= SELECTION_REMOVE | SELECTION_INSTALLED;
+   // purge if installed or has residual config
+   if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
+      mask |= SELECTION_PURGE;
+   return mask;
+}
+
 GtkCssProvider *RGMainWindow::_fastSearchCssProvider = NULL;
 
 void RGMainWindow::changeView(int view, string subView)
 {
-   if(_config->FindB("Debug::Synaptic::View",false))
+   PolySynaptic::ScopedSpan span("changeView", "ui");
+   if(RSettings().debugView)
       ioprintf(clog, "RGMainWindow::changeView(): view '%i' subView '%s'\n",
 	       view, subView.size() > 0 ? subView.c_str() : "(empty)");
 
@@ -127,12 +193,7 @@ void RGMainWindow::changeView(int view, string subView)
    _blockActions = TRUE;
    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(_viewButtons[view]), TRUE);
 
-   // we need to set a empty model first so that gtklistview
-   // can do its cleanup, if we do not do that, then the cleanup
-   // code in gtktreeview gets confused and throws
-   // Gtk-CRITICAL **: gtk_tree_view_unref_tree_helper: assertion `node != NULL' failed
-   // at us, see LP: #38397 for more information
-   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), NULL);
+   detachPackageList();
       
    RPackage *pkg = selectedPackage();
 
@@ -175,7 +236,7 @@ void RGMainWindow::changeView(int view, string subView)
 void RGMainWindow::refreshSubViewList()
 {
    string selected = selectedSubView();
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "RGMainWindow::refreshSubViewList(): selectedView '%s'\n", 
 	       selected.size() > 0 ? selected.c_str() : "(empty)");
 
@@ -285,10 +346,15 @@ bool RGMainWindow::showErrors()
 
 void RGMainWindow::notifyChange(RPackage *pkg)
 {
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "RGMainWindow::notifyChange(): '%s'\n",
 	       pkg != NULL ? pkg->name() : "(no pkg)");
 
+   // other rows only go stale with their candidate version or the
+   // cache, which they check themselves
+   if (_pkgList != NULL && GTK_IS_PKG_LIST(_pkgList))
+      gtk_pkg_list_invalidate(GTK_PKG_LIST(_pkgList), pkg);
+
    if (pkg != NULL)
       refreshTable(pkg);
 
@@ -306,8 +372,225 @@ void RGMainWindow::forgetNewPackages()
    _roptions->forgetNewPackages();
 }
 
+void RGMainWindow::queueThumbnailPrefetch()
+{
+   // thumbnails are only shown inline
+   if (_unifiedViewMode || _thumbnailPrefetchId != 0 ||
+       !_config->FindB("Synaptic::InlineScreenshots"))
+      return;
+   _thumbnailPrefetchId = g_timeout_add(300, prefetchVisibleThumbnails, this);
+}
+
+gboolean RGMainWindow::pollUpdateChecks(void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+
+   // the APT check reads the depcache here; not while it is in use
+   if (!me->_interfaceLocked && me->_lister->getCache() != NULL)
+      me->_backendManager->pollUpdateChecks();
+   return TRUE;
+}
+
+// the popularity datasets PackageRanker scores with: the last index is
+// mapped now, new datasets are fetched in the background every few days.
+// off unless asked for: the search results do not go through the ranker,
+// so nothing shown would use what this downloads (as root) from outside
+static void startPopularityRefresh()
+{
+   if (!_config->FindB("Synaptic::Popularity::Enabled", false))
+      return;
+
+   string dir = RStateDir() + "/popularity";
+   PolySynaptic::PopularityIndex::loadShared(
+      PolySynaptic::PopularityIndex::indexPath(dir));
+
+   vector<PolySynaptic::PopularityIndex::Dataset> datasets = {
+      {PolySynaptic::PopularityIndex::POPCON,
+       _config->Find("Synaptic::Popularity::Popcon",
+                     "https://popcon.debian.org/by_inst")},
+      {PolySynaptic::PopularityIndex::FLATHUB,
+       _config->Find("Synaptic::Popularity::Flathub",
+                     "https://flathub.org/stats/%Y/%m/%d.json")},
+      // the store publishes no install counts; a mirror of some may be set
+      {PolySynaptic::PopularityIndex::SNAP,
+       _config->Find("Synaptic::Popularity::Snap", "")},
+   };
+   int maxAge = _config->FindI("Synaptic::Popularity::RefreshDays", 7) * 24 * 3600;
+
+   // never freed, a download still running must not hold up the exit
+   static PolySynaptic::TaskPool *pool = new PolySynaptic::TaskPool(1);
+   pool->submit(PolySynaptic::TaskPriority::BACKGROUND, [dir, datasets, maxAge]() {
+      PolySynaptic::PopularityIndex::refresh(dir, datasets, RGFetchFile, maxAge);
+      return 0;
+   });
+}
+
+void RGMainWindow::cbNetworkMetered(GObject *monitor, GParamSpec *pspec,
+                                    void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+
+#if GLIB_CHECK_VERSION(2, 46, 0)
+   me->_backendManager->setConnectionMetered(
+      g_network_monitor_get_network_metered(G_NETWORK_MONITOR(monitor)));
+#endif
+}
+
+void RGMainWindow::cbLowMemoryWarning(GObject *monitor, int level, void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+
+#if GLIB_CHECK_VERSION(2, 64, 0)
+   if (!me->_backendManager->isLowMemoryMode() &&
+       level < G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL)
+      return;
+#endif
+   uint64_t freed = PolySynaptic::MemoryRegistry::instance().trim();
+   LOG_INFO("Low memory: released " + to_string(freed / 1024) + " KB of caches");
+}
+
+void RGMainWindow::fetchUnifiedDetails(const PolySynaptic::PackageInfo &pkg)
+{
+   string key = pkg.getUniqueKey();
+   if (key == _detailsKey)
+      return;
+
+   // the row before is of no interest any more
+   cancelUnifiedDetails();
+   _detailsKey = key;
+
+   PolySynaptic::IAsyncPackageBackend *backend =
+      _backendManager->getAsyncBackend(pkg.backend);
+   if (backend == NULL)
+      return;
+   _detailsCall = backend->getPackageDetails(pkg.id,
+      [this, key](const PolySynaptic::PackageInfo &details) {
+         // it may have been on its way to the main loop when the
+         // selection moved on
+         if (key != _detailsKey)
+            return;
+         _details = details;
+         _detailsFetched = true;
+         cbSelectedRow(gtk_tree_view_get_selection(GTK_TREE_VIEW(_treeView)), this);
+      });
+}
+
+void RGMainWindow::cancelUnifiedDetails()
+{
+   _detailsCall.cancel();
+   _detailsKey.clear();
+   _details = PolySynaptic::PackageInfo();
+   _detailsFetched = false;
+}
+
+gboolean RGMainWindow::checkExternalChanges(void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+
+   // while locked the changes are likely our own; they are read, and
+   // dropped, once the commit has reloaded everything
+   if (me->_interfaceLocked)
+      return TRUE;
+
+   vector<PolySynaptic::BackendType> changed =
+      me->_backendManager->checkExternalChanges();
+   if (changed.empty())
+      return TRUE;
+
+   if (find(changed.begin(), changed.end(),
+            PolySynaptic::BackendType::APT) != changed.end() &&
+       me->_lister->getCache() != NULL) {
+      // reloading would drop the marks, so only without any
+      int installed, broken, toInstall, toRemove;
+      double size;
+      me->_lister->getStats(installed, broken, toInstall, toRemove, size);
+      if (toInstall + toRemove == 0) {
+         me->setInterfaceLocked(TRUE);
+         me->_lister->unregisterObserver(me);
+         me->setTreeLocked(TRUE);
+         // dpkg may still be writing; the next change tries again
+         if (!me->_lister->openCache())
+            me->showErrors();
+         me->_lister->registerObserver(me);
+         me->setTreeLocked(FALSE);
+         me->refreshTable();
+         me->refreshSubViewList();
+         me->setInterfaceLocked(FALSE);
+         me->setStatusText();
+      }
+   }
+
+   me->loadUnifiedInstalledPackages();
+   return TRUE;
+}
+
+void RGMainWindow::queueSummaryPrecompute()
+{
+   // restarted by every change, so a run of marks is summed up once
+   if (_summaryPrecomputeId != 0)
+      g_source_remove(_summaryPrecomputeId);
+   _summaryPrecomputeId = g_timeout_add(500, precomputeSummary, this);
+}
+
+gboolean RGMainWindow::precomputeSummary(void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   me->_summaryPrecomputeId = 0;
+
+   // the depcache is the main loop's, so this runs here, between
+   // events; the snap and flatpak sizes come in on the pool
+   if (!me->_interfaceLocked && me->_lister->getCache() != NULL)
+      me->_lister->precomputeSummary();
+   if (me->_backendManager)
+      me->_backendManager->prefetchTransactionDetails();
+   return FALSE;
+}
+
+void RGMainWindow::cbPackageListScrolled(GtkAdjustment *adjustment, void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   me->queueThumbnailPrefetch();
+}
+
+gboolean RGMainWindow::prefetchVisibleThumbnails(void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   me->_thumbnailPrefetchId = 0;
+
+   GtkTreePath *start, *end;
+   if (me->_unifiedViewMode || me->_pkgList == NULL ||
+       !gtk_tree_view_get_visible_range(GTK_TREE_VIEW(me->_treeView),
+                                        &start, &end))
+      return FALSE;
+
+   vector<RPackage *> packages;
+   GtkTreeIter iter;
+   bool ok = gtk_tree_model_get_iter(me->_pkgList, &iter, start);
+   while (ok) {
+      RPackage *pkg = NULL;
+      gtk_tree_model_get(me->_pkgList, &iter, PKG_COLUMN, &pkg, -1);
+      if (pkg != NULL)
+         packages.push_back(pkg);
+
+      GtkTreePath *path = gtk_tree_model_get_path(me->_pkgList, &iter);
+      bool last = gtk_tree_path_compare(path, end) >= 0;
+      gtk_tree_path_free(path);
+      if (last)
+         break;
+      ok = gtk_tree_model_iter_next(me->_pkgList, &iter);
+   }
+   gtk_tree_path_free(start);
+   gtk_tree_path_free(end);
+
+   RGPkgDetailsWindow::prefetchThumbnails(packages);
+   return FALSE;
+}
+
 void RGMainWindow::refreshTable(RPackage *selectedPkg, bool setAdjustment)
 {
+   PolySynaptic::ScopedSpan span("refreshTable", "ui");
+   RGNoteViewChange("package list");
+
    // Skip legacy APT refresh logic when in unified view mode
    if (_unifiedViewMode) {
       gtk_widget_queue_draw(_treeView);
@@ -315,27 +598,28 @@ void RGMainWindow::refreshTable(RPackage *selectedPkg, bool setAdjustment)
       return;
    }
 
-   if(_config->FindB("Debug::Synaptic::View",false))
+   if(RSettings().debugView)
       ioprintf(clog, "RGMainWindow::refreshTable(): pkg: '%s' adjust '%i'\n",
 	       selectedPkg != NULL ? selectedPkg->name() : "(no pkg)",
 	       setAdjustment);
 
    const gchar *str = gtk_entry_get_text(GTK_ENTRY(_entry_fast_search));
    if(str != NULL && strlen(str) > 1) {
-      if(_config->FindB("Debug::Synaptic::View",false))
+      if(RSettings().debugView)
 	 cerr << "RGMainWindow::refreshTable: rerun limitBySearch" << endl;
+      // the model sends no signals for this, so a view still showing
+      // it needs to pick up a different row count from scratch
+      int rows = _lister->viewPackagesSize();
       _lister->limitBySearch(str);
+      if (_lister->viewPackagesSize() != rows)
+         detachPackageList();
    }
 
-   if(_pkgList == NULL)
-   {
-      _pkgList = GTK_TREE_MODEL(gtk_pkg_list_new(_lister));
-      gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView),
-                              GTK_TREE_MODEL(_pkgList));
-   }
+   attachPackageList();
 
    // debian bug #747566
    gtk_widget_queue_draw(_treeView);
+   queueThumbnailPrefetch();
 
 #if 0
    // set selected pkg to be selected again
@@ -370,6 +654,69 @@ void RGMainWindow::refreshTable(RPackage *selectedPkg, bool setAdjustment)
    setStatusText();
 }
 
+gboolean RGMainWindow::cbSelectRow(GtkTreeSelection *selection,
+                                   GtkTreeModel *model, GtkTreePath *path,
+                                   gboolean selected, void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   GtkTreeIter iter;
+   RPackage *pkg = NULL;
+
+   if (me->_unifiedViewMode || model != me->_pkgList ||
+       !gtk_tree_model_get_iter(model, &iter, path))
+      return TRUE;
+   gtk_tree_model_get(model, &iter, PKG_COLUMN, &pkg, -1);
+   if (pkg == NULL)
+      return TRUE;
+
+   // called before the row changes, selected is what it was
+   if (selected) {
+      me->_selection.remove(pkg);
+   } else {
+      me->_selection.add(pkg, selectionMask(pkg));
+      me->_selectionLast = pkg;
+   }
+   return TRUE;
+}
+
+void RGMainWindow::syncSelection(GtkTreeSelection *selection)
+{
+   GtkTreeIter iter;
+   RPackage *pkg;
+
+   _selection.clear();
+   _selectionLast = NULL;
+   _selectionFlagsGeneration = _lister->getFlagsGeneration();
+   _selectionCacheGeneration = _lister->getCacheGeneration();
+
+   GList *list = gtk_tree_selection_get_selected_rows(selection, &_pkgList);
+   for (GList *li = list; li != NULL; li = g_list_next(li)) {
+      if (!gtk_tree_model_get_iter(_pkgList, &iter, (GtkTreePath *) li->data))
+         continue;
+      pkg = NULL;
+      gtk_tree_model_get(_pkgList, &iter, PKG_COLUMN, &pkg, -1);
+      if (pkg == NULL)
+         continue;
+      _selection.add(pkg, selectionMask(pkg));
+      // the last row, as before there was a count
+      _selectionLast = pkg;
+   }
+   g_list_foreach(list, (void (*)(void *, void *))gtk_tree_path_free, NULL);
+   g_list_free(list);
+}
+
+unsigned int RGMainWindow::selectionActions()
+{
+   // marks change what the selected packages allow, not which they are
+   if (_selectionFlagsGeneration != _lister->getFlagsGeneration()) {
+      _selection.refresh([](const void *key) {
+         return selectionMask((RPackage *) key);
+      });
+      _selectionFlagsGeneration = _lister->getFlagsGeneration();
+   }
+   return _selection.actions();
+}
+
 void RGMainWindow::updatePackageInfo(RPackage *pkg)
 {
    if (_blockActions)
@@ -403,8 +750,12 @@ void RGMainWindow::updatePackageInfo(RPackage *pkg)
    setStatusText();
 
    // return if no pkg is selected
-   if (!pkg) 
+   if (!pkg) {
+      RGPkgDetailsWindow::forgetPackage(this);
+      if (_pkgDetails != NULL)
+         RGPkgDetailsWindow::forgetPackage(_pkgDetails);
       return;
+   }
 
 //    cout <<   pkg->label() << endl;
 //    cout <<   pkg->component() << endl;
@@ -453,39 +804,28 @@ void RGMainWindow::updatePackageInfo(RPackage *pkg)
       gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(_autoM), false);
    _blockActions = false;
 
-   // enable unmark if a action is performed with the pkg
-   if((flags & RPackage::FInstall)   || (flags & RPackage::FNewInstall) || 
-      (flags & RPackage::FReInstall) || (flags & RPackage::FUpgrade) || 
-      (flags & RPackage::FDowngrade) || (flags & RPackage::FRemove) || 
-      (flags & RPackage::FPurge))
+   // what any of the selected packages allows, or pkg alone when it
+   // is not one of them; the debconf check waits for the click
+   unsigned int actions = _selection.contains(pkg) ? selectionActions()
+                                                    : selectionMask(pkg);
+   if(actions & SELECTION_KEEP)
       gtk_widget_set_sensitive(_keepM, TRUE);
-   // enable install if outdated or not insalled
-   if(!(flags & RPackage::FInstalled))
+   if(actions & SELECTION_INSTALL)
       gtk_widget_set_sensitive(_installM, TRUE);
-   // enable reinstall if installed and installable and not outdated
-   if(flags & RPackage::FInstalled 
-      && !(flags & RPackage::FNotInstallable)
-      && !(flags & RPackage::FOutdated))
+   if(actions & SELECTION_REINSTALL)
       gtk_widget_set_sensitive(_reinstallM, TRUE);
-   // enable upgrade is outdated
-   if(flags & RPackage::FOutdated)
+   if(actions & SELECTION_UPGRADE)
       gtk_widget_set_sensitive(_pkgupgradeM, TRUE);
-   // enable remove if package is installed
-   if(flags & RPackage::FInstalled)
+   if(actions & SELECTION_REMOVE)
       gtk_widget_set_sensitive(_removeM, TRUE);
-
-   // enable purge if package is installed or has residual config
-   if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
+   if(actions & SELECTION_PURGE)
       gtk_widget_set_sensitive(_purgeM, TRUE);
-   // enable help if package is installed
-   if( flags & RPackage::FInstalled)
+   if(actions & SELECTION_INSTALLED) {
       gtk_widget_set_sensitive(_pkgHelpM, TRUE);
-   // enable debconf if package is installed and depends on debconf
-   if( flags & RPackage::FInstalled && (pkg->dependsOn("debconf") || 
-					pkg->dependsOn("debconf-i18n")))
-       gtk_widget_set_sensitive(_pkgReconfigureM, TRUE);
+      gtk_widget_set_sensitive(_pkgReconfigureM, TRUE);
+   }
 
-   if(pkg->getAvailableVersions().size() > 1)
+   if(pkg->availableVersionCount() > 1)
       gtk_widget_set_sensitive(_overrideVersionM, TRUE);
 
 }
@@ -575,7 +915,7 @@ void RGMainWindow::cbInstallFromVersion(GtkWidget *self, void *data)
                                                     (dia.getGtkBuilder(),
                                                      "combobox_available_versions"));
    int canidateNr = 0;
-   vector<pair<string, string> > versions = pkg->getAvailableVersions();
+   const vector<pair<string, string> > &versions = pkg->getAvailableVersions();
    for(unsigned int i=0;i<versions.size();i++) {
       gchar *str = g_strdup_printf("%s (%s)", 
 				   versions[i].first.c_str(), 
@@ -677,62 +1017,65 @@ void RGMainWindow::pkgAction(RGPkgAction action)
    RPackage *pkg = NULL;
    int flags;
 
-   while (li != NULL) {
-      pkgDepCache::ActionGroup group(*_lister->getCache()->deps());
-      gtk_tree_model_get_iter(_pkgList, &iter, (GtkTreePath *) (li->data));
-      gtk_tree_model_get(_pkgList, &iter, PKG_COLUMN, &pkg, -1);
-      li = g_list_next(li);
-      if (pkg == NULL)
-         continue;
+   // one action group and one resolver run for the whole selection
+   {
+      RPackageLister::MarkBatch batch(_lister);
+      while (li != NULL) {
+         gtk_tree_model_get_iter(_pkgList, &iter, (GtkTreePath *) (li->data));
+         gtk_tree_model_get(_pkgList, &iter, PKG_COLUMN, &pkg, -1);
+         li = g_list_next(li);
+         if (pkg == NULL)
+            continue;
+
+         flags = pkg->getFlags();
 
-      flags = pkg->getFlags();
-
-      pkg->setNotify(false);
-
-      // needed for the stateChange 
-      exclude.push_back(pkg);
-      switch (action) {
-         case PKG_KEEP:        // keep
-            pkgKeepHelper(pkg);
-            break;
-         case PKG_INSTALL:     // install
-            // install only if not installed or outdated (upgrade)
-            if(!(flags & RPackage::FInstalled) 
-               || (flags & RPackage::FOutdated)) {
-               instPkgs.push_back(pkg);
+         pkg->setNotify(false);
+
+         // needed for the stateChange 
+         exclude.push_back(pkg);
+         switch (action) {
+            case PKG_KEEP:        // keep
+               pkgKeepHelper(pkg);
+               break;
+            case PKG_INSTALL:     // install
+               // install only if not installed or outdated (upgrade)
+               if(!(flags & RPackage::FInstalled) 
+                  || (flags & RPackage::FOutdated)) {
+                  instPkgs.push_back(pkg);
+                  pkgInstallHelper(pkg, false);
+               }
+               break;
+            case PKG_INSTALL_FROM_VERSION:     // install with specific version
                pkgInstallHelper(pkg, false);
-            }
-            break;
-         case PKG_INSTALL_FROM_VERSION:     // install with specific version
-            pkgInstallHelper(pkg, false);
-            break;
-         case PKG_REINSTALL:      // reinstall
-            // Only reinstall installable packages and non outdated packages
-            if(flags & RPackage::FInstalled 
-               && !(flags & RPackage::FNotInstallable)
-               && !(flags & RPackage::FOutdated)) {
-               instPkgs.push_back(pkg);
-               pkgInstallHelper(pkg, false, true);
-            }
-            break;
-         case PKG_DELETE:      // delete
-            if(flags & RPackage::FInstalled)
-               pkgRemoveHelper(pkg);
-            break;
-         case PKG_PURGE:       // purge
-            if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
-               pkgRemoveHelper(pkg, true);
-            break;
-         case PKG_DELETE_WITH_DEPS:
-            if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
-               pkgRemoveHelper(pkg, true, true);
-            break;
-         default:
-            cout << "uh oh!!!!!!!!!" << endl;
-            break;
-      }
+               break;
+            case PKG_REINSTALL:      // reinstall
+               // Only reinstall installable packages and non outdated packages
+               if(flags & RPackage::FInstalled 
+                  && !(flags & RPackage::FNotInstallable)
+                  && !(flags & RPackage::FOutdated)) {
+                  instPkgs.push_back(pkg);
+                  pkgInstallHelper(pkg, false, true);
+               }
+               break;
+            case PKG_DELETE:      // delete
+               if(flags & RPackage::FInstalled)
+                  pkgRemoveHelper(pkg);
+               break;
+            case PKG_PURGE:       // purge
+               if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
+                  pkgRemoveHelper(pkg, true);
+               break;
+            case PKG_DELETE_WITH_DEPS:
+               if(flags & RPackage::FInstalled || flags & RPackage::FResidualConfig)
+                  pkgRemoveHelper(pkg, true, true);
+               break;
+            default:
+               cout << "uh oh!!!!!!!!!" << endl;
+               break;
+         }
 
-      pkg->setNotify(true);
+         pkg->setNotify(true);
+      }
    }
 
    // Do it just once, otherwise it'd kill a long installation list.
@@ -771,48 +1114,181 @@ void RGMainWindow::pkgAction(RGPkgAction action)
    refreshTable(pkg);
 }
 
+gboolean RGMainWindow::cbUnmetTestExpandRow(GtkTreeView *treeview,
+                                            GtkTreeIter *iter,
+                                            GtkTreePath *path, void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   GtkTreeModel *model = gtk_tree_view_get_model(treeview);
+   GtkTreeStore *store = GTK_TREE_STORE(model);
+
+   GtkTreeIter child;
+   RPackage *below = NULL;
+   if (!gtk_tree_model_iter_children(model, &child, iter))
+      return FALSE;
+   gtk_tree_model_get(model, &child, UNMET_PKG_COLUMN, &below, -1);
+   // the placeholder is the only child that names its package
+   if (below == NULL)
+      return FALSE;
+
+   istringstream reason(me->_lister->getBrokenReason(below));
+   string line;
+   while (getline(reason, line)) {
+      if (line.find_first_not_of(" \t") == string::npos)
+         continue;
+      GtkTreeIter row;
+      gtk_tree_store_append(store, &row, iter);
+      gtk_tree_store_set(store, &row,
+                         UNMET_TEXT_COLUMN, utf8(line.c_str()),
+                         UNMET_PKG_COLUMN, NULL, -1);
+   }
+   gtk_tree_store_remove(store, &child);
+   return FALSE;
+}
+
+static void cbResolveResponse(GtkDialog *dialog, gint response, void *data)
+{
+   *(bool *) data = true;
+   gtk_widget_hide(GTK_WIDGET(dialog));
+}
+
+bool RGMainWindow::resolveWithProgress(RPackageLister::ResolveKind kind,
+                                       const char *what, bool &cancelled)
+{
+   RPackageLister::pkgState state;
+   _lister->saveState(state);
+   cancelled = false;
+
+   // nothing on the main thread reads the depcache while the worker
+   // changes it: the timers wait out the lock, and the list is detached
+   setTreeLocked(TRUE);
+
+   GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(_win),
+                                              GTK_DIALOG_DESTROY_WITH_PARENT,
+                                              GTK_MESSAGE_OTHER,
+                                              GTK_BUTTONS_CANCEL,
+                                              "%s", what);
+   GtkWidget *progress = gtk_progress_bar_new();
+   gtk_box_pack_start(GTK_BOX(gtk_message_dialog_get_message_area(
+                                 GTK_MESSAGE_DIALOG(dialog))),
+                      progress, FALSE, FALSE, 0);
+   g_signal_connect(G_OBJECT(dialog), "response",
+                    G_CALLBACK(cbResolveResponse), &cancelled);
+   gtk_widget_show_all(dialog);
+
+   // apt's error stack is the thread's own; the worker's messages are
+   // handed back to be shown from here
+   vector<pair<bool, string> > messages;
+   auto done = std::async(std::launch::async, [this, kind, &messages]() {
+      bool res = _lister->resolve(kind);
+      while (!_error->empty()) {
+         string message;
+         bool isError = _error->PopMessage(message);
+         messages.push_back(make_pair(isError, message));
+      }
+      return res;
+   });
+   while (done.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+      if (!cancelled)
+         gtk_progress_bar_pulse(GTK_PROGRESS_BAR(progress));
+      RGFlushInterface();
+   }
+   bool res = done.get();
+   gtk_widget_destroy(dialog);
+
+   if (cancelled) {
+      // the flags it compares with are the ones before the resolver ran
+      _lister->invalidateStateFlags();
+      _lister->restoreState(state);
+      res = false;
+   } else {
+      for (unsigned int i = 0; i < messages.size(); i++) {
+         if (messages[i].first)
+            _error->Error("%s", messages[i].second.c_str());
+         else
+            _error->Warning("%s", messages[i].second.c_str());
+      }
+      _lister->resolved(kind);
+   }
+
+   setTreeLocked(FALSE);
+   return res;
+}
+
 bool RGMainWindow::checkForFailedInst(vector<RPackage *> instPkgs)
 {
-   string failedReason;
-   bool failed = false;
+   vector<RPackage *> failed;
    for (unsigned int i = 0; i < instPkgs.size(); i++) {
       RPackage *pkg = instPkgs[i];
       if (pkg == NULL)
 	 continue;
-      if (!(pkg->getFlags() & RPackage::FInstall)) {
-	 failed = true;
-	 failedReason += string(pkg->name()) + ":\n";
-	 failedReason += pkg->showWhyInstBroken();
-	 failedReason += "\n";
-	 pkg->setKeep();
-	 pkg->unsetVersion();
-	 _lister->notifyChange(pkg);
-      }
+      if (!(pkg->getFlags() & RPackage::FInstall))
+	 failed.push_back(pkg);
    }
-   if (failed) {
+   if (failed.empty())
+      return false;
+
+   // the explanations are worked out from the depcache as the failed
+   // marks left it, so the dialog comes before the packages are kept;
+   // each one is only formatted once its row is expanded
+   {
       RGGtkBuilderUserDialog dia(this,"unmet");
       GtkWidget *tv = GTK_WIDGET(gtk_builder_get_object(dia.getGtkBuilder(),
-					                "textview"));
-      GtkTextBuffer *tb = gtk_text_view_get_buffer(GTK_TEXT_VIEW(tv));
-      gtk_text_buffer_set_text(tb, utf8(failedReason.c_str()), -1);
+					                "treeview_unmet"));
+      GtkTreeStore *store = gtk_tree_store_new(2, G_TYPE_STRING,
+                                               G_TYPE_POINTER);
+      for (unsigned int i = 0; i < failed.size(); i++) {
+         GtkTreeIter row, placeholder;
+         gtk_tree_store_append(store, &row, NULL);
+         gtk_tree_store_set(store, &row,
+                            UNMET_TEXT_COLUMN, failed[i]->name(),
+                            UNMET_PKG_COLUMN, failed[i], -1);
+         gtk_tree_store_append(store, &placeholder, &row);
+         gtk_tree_store_set(store, &placeholder,
+                            UNMET_TEXT_COLUMN, "",
+                            UNMET_PKG_COLUMN, failed[i], -1);
+      }
+      gtk_tree_view_set_model(GTK_TREE_VIEW(tv), GTK_TREE_MODEL(store));
+      g_object_unref(store);
+
+      GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+      GtkTreeViewColumn *column =
+         gtk_tree_view_column_new_with_attributes("", renderer,
+                                                  "text", UNMET_TEXT_COLUMN,
+                                                  NULL);
+      gtk_tree_view_append_column(GTK_TREE_VIEW(tv), column);
+      g_signal_connect(G_OBJECT(tv), "test-expand-row",
+                       G_CALLBACK(cbUnmetTestExpandRow), this);
+      if (failed.size() <= UNMET_EXPANDED_MAX)
+         gtk_tree_view_expand_all(GTK_TREE_VIEW(tv));
+
       dia.run();
-      // we informaed the user about the problem, we can clear the
-      // apt error stack
-      // CHECKME: is this discard here really needed?
-      _error->Discard();
    }
-      
-   return failed;
+   // we informaed the user about the problem, we can clear the
+   // apt error stack
+   // CHECKME: is this discard here really needed?
+   _error->Discard();
+
+   // one notification for all of them rather than one per package
+   RPackageLister::MarkBatch batch(_lister);
+   for (unsigned int i = 0; i < failed.size(); i++) {
+      failed[i]->setKeep();
+      failed[i]->unsetVersion();
+      _lister->notifyChange(failed[i]);
+   }
+   return true;
 }
 
 RGMainWindow::RGMainWindow(RPackageLister *packLister, PolySynaptic::BackendManager *backendMgr, string name)
    : RGGtkBuilderWindow(NULL, name), _lister(packLister), _backendManager(backendMgr),
      _backendFilterBar(nullptr), _backendStatusBar(nullptr),
-     _pkgList(0), _treeView(0), _tasksWin(0), _iconLegendPanel(0), _pkgDetails(0),
+     _pkgList(0), _treeView(0), _tasksWin(0), _taskList(0), _iconLegendPanel(0), _pkgDetails(0),
      _logView(0), _installProgress(0), _fetchProgress(0),
      _fastSearchEventID(-1)
 {
    assert(_win);
+   // RGGtkBuilderWindow has loaded the interface by now
+   PolySynaptic::StartupProfile::instance().mark("builder");
 
    _blockActions = false;
    _unsavedChanges = false;
@@ -829,11 +1305,34 @@ RGMainWindow::RGMainWindow(RPackageLister *packLister, PolySynaptic::BackendMana
    if (!_backendManager) {
       _backendManager = new PolySynaptic::BackendManager(_lister);
    }
+   // asynchronous backend calls complete on the main loop
+   _backendManager->setDispatcher(RGMainLoopDispatcher());
+   // store searches answer locally once the index is current
+   _backendManager->refreshStoreIndex();
    _backendFilterBar = NULL;
    _unifiedPkgList = NULL;
    _unifiedPopupMenu = NULL;
+   _unifiedLoadSerial = 0;
    _unifiedViewMode = true;  // PolySynaptic: Default to unified view showing all sources
+   _unifiedMemoryAccount.assign("unified packages",
+      [this](PolySynaptic::MemoryUsage &usage) {
+         PolySynaptic::PackageSnapshotPtr snapshot = _unifiedPublisher.current();
+         usage.bytes = snapshot->memoryBytes();
+         usage.items = snapshot->size();
+      });
    _xapianChildWatchId = 0;
+#ifdef HAVE_XAPIAN
+   _xapianBuilder = NULL;
+   _xapianBuildWatchId = 0;
+#endif
+   _thumbnailPrefetchId = 0;
+   _summaryPrecomputeId = 0;
+   _detailsFetched = false;
+   _selectionLast = NULL;
+   _selectionFlagsGeneration = 0;
+   _selectionCacheGeneration = 0;
+   _updateCheckId = 0;
+   _externalChangesId = 0;
 
    // create all the interface stuff
    buildInterface();
@@ -853,6 +1352,40 @@ RGMainWindow::RGMainWindow(RPackageLister *packLister, PolySynaptic::BackendMana
             gtk_box_pack_end(GTK_BOX(parent), _backendStatusBar->getWidget(), FALSE, FALSE, 5);
          }
       }
+
+      // its update counts follow the background checks
+      _backendManager->setUpdatesChangedCallback(
+         [this](PolySynaptic::BackendType) { _backendStatusBar->refresh(); });
+      // snapd pushes how its changes move; a finished one is read back
+      // right away instead of at the next look at the watches
+      _backendManager->setSnapChangeCallback(
+         [this](const PolySynaptic::SnapChangeEvent &event) {
+            string text = event.change.summary;
+            if (event.state == PolySynaptic::SnapChangeEvent::State::FAILED)
+               text += _(" failed");
+            setStatusText(const_cast<char*>(text.c_str()));
+            if (event.isReady())
+               checkExternalChanges(this);
+         });
+      _updateCheckId = g_timeout_add_seconds(60, pollUpdateChecks, this);
+      // one non-blocking read of the watches when nothing changed
+      _externalChangesId = g_timeout_add_seconds(2, checkExternalChanges, this);
+      startPopularityRefresh();
+      _backendManager->setPopularityRanking(
+         _config->FindB("Synaptic::Popularity::Enabled", false));
+#if GLIB_CHECK_VERSION(2, 46, 0)
+      GNetworkMonitor *network = g_network_monitor_get_default();
+      cbNetworkMetered(G_OBJECT(network), NULL, this);
+      g_signal_connect(network, "notify::network-metered",
+                       G_CALLBACK(cbNetworkMetered), this);
+#endif
+#if GLIB_CHECK_VERSION(2, 64, 0)
+      // a reference kept for the life of the process, like the network
+      // monitor's default instance
+      GMemoryMonitor *memory = g_memory_monitor_dup_default();
+      g_signal_connect(memory, "low-memory-warning",
+                       G_CALLBACK(cbLowMemoryWarning), this);
+#endif
    }
 
    packLister->setUserDialog(_userDialog);
@@ -876,6 +1409,7 @@ RGMainWindow::RGMainWindow(RPackageLister *packLister, PolySynaptic::BackendMana
    _aboutPanel = NULL;
    _fmanagerWin = NULL;
    _backendSettingsWin = NULL;
+   _debugPanel = NULL;
 
    GValue value = { 0, };
    g_value_init(&value, G_TYPE_STRING);
@@ -902,6 +1436,42 @@ RGMainWindow::~RGMainWindow()
       g_source_remove(_xapianChildWatchId);
       _xapianChildWatchId = 0;
    }
+#ifdef HAVE_XAPIAN
+   if (_xapianBuildWatchId != 0) {
+      g_source_remove(_xapianBuildWatchId);
+      _xapianBuildWatchId = 0;
+   }
+   // cancels a build still running, keeping the index as it was
+   delete _xapianBuilder;
+   _xapianBuilder = NULL;
+#endif
+   delete _taskList;
+   _taskList = NULL;
+   if (_thumbnailPrefetchId != 0) {
+      g_source_remove(_thumbnailPrefetchId);
+      _thumbnailPrefetchId = 0;
+   }
+   if (_summaryPrecomputeId != 0) {
+      g_source_remove(_summaryPrecomputeId);
+      _summaryPrecomputeId = 0;
+   }
+   _detailsCall.cancel();
+   if (_updateCheckId != 0) {
+      g_source_remove(_updateCheckId);
+      _updateCheckId = 0;
+   }
+   if (_externalChangesId != 0) {
+      g_source_remove(_externalChangesId);
+      _externalChangesId = 0;
+   }
+   if (_backendManager) {
+      _backendManager->setUpdatesChangedCallback(nullptr);
+      _backendManager->setSnapChangeCallback(nullptr);
+   }
+   // Searches still running must not deliver to this window
+   for (auto &search : _allBackendsSearches) {
+      search.cancel();
+   }
 
    // Disconnect signal handlers to prevent callbacks on destroyed objects
    for (const auto& pair : _widgetSignalHandlers) {
@@ -943,13 +1513,17 @@ RGMainWindow::~RGMainWindow()
 gboolean RGMainWindow::xapianDoIndexUpdate(void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
-   if(_config->FindB("Debug::Synaptic::Xapian",false))
+   if(RSettings().debugXapian)
       std::cerr << "xapianDoIndexUpdate()" << std::endl;
 
    // no need to update if we run non-interactive
    if(_config->FindB("Volatile::Non-Interactive", false) == true)
       return false;
 
+   // a rebuild is already running, its end reopens the index anyway
+   if(me->_xapianChildWatchId != 0 || me->_xapianBuildWatchId != 0)
+      return false;
+
    // check if we need a update
    if(!me->_lister->xapianIndexNeedsUpdate()) {
       // if the cache is not open, check back when it is
@@ -958,15 +1532,50 @@ gboolean RGMainWindow::xapianDoIndexUpdate(void *data)
       return false;
    }
 
-   // do not run if we don't have it
-   if(!FileExists("/usr/sbin/update-apt-xapian-index"))
-      return false;
    // no permission
    if (getuid() != 0)
       return false;
 
-   // if we make it to this point, we need a xapian update
-   if(_config->FindB("Debug::Synaptic::Xapian",false))
+   // built here, on worker threads, from the open cache and the
+   // catalog of the other backends
+   if(RPackageLister::nativeXapianIndex()) {
+      if(RSettings().debugXapian)
+         std::cerr << "building the xapian index" << std::endl;
+      vector<RXapianDocument> documents;
+      me->_lister->xapianDocuments(documents);
+      PolySynaptic::BackendFilter others;
+      others.includeApt = false;
+      for (const auto &info :
+              me->_backendManager->getCachedInstalledPackages(others)) {
+         RXapianDocument doc;
+         doc.source = PolySynaptic::backendTypeToBadge(info.backend);
+         doc.name = info.name;
+         doc.summary = info.summary;
+         doc.description = info.description;
+         doc.section = info.section.str();
+         documents.push_back(doc);
+      }
+
+      if (me->_xapianBuilder == NULL)
+         me->_xapianBuilder =
+            new RXapianIndexBuilder(RPackageLister::xapianIndexDir());
+      me->_xapianBuilder->start(documents);
+      me->_xapianBuildWatchId = g_timeout_add(500, xapianIndexBuildPoll, me);
+      gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(me->_builder,
+							  "label_fast_search")),
+			 _("Rebuilding search index"));
+      return false;
+   }
+
+   // do not run if we don't have it
+   if(!FileExists("/usr/sbin/update-apt-xapian-index"))
+      return false;
+
+   // if we make it to this point, we need a xapian update. --update
+   // only reindexes the packages that changed since the last run and
+   // commits a new revision; the lister keeps reading the old one
+   // until xapianIndexUpdateFinished() swaps it in
+   if(RSettings().debugXapian)
       std::cerr << "running update-apt-xapian-index" << std::endl;
    GPid pid;
    const char *argp[] = {"/usr/bin/nice",
@@ -979,12 +1588,10 @@ gboolean RGMainWindow::xapianDoIndexUpdate(void *data)
 		    NULL, NULL, &pid, NULL)) {
       // Store watch ID so we can cancel in destructor if window closes
       me->_xapianChildWatchId = g_child_watch_add(pid, (GChildWatchFunc)xapianIndexUpdateFinished, me);
+      // searching stays available against the current index
       gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(me->_builder, 
 							  "label_fast_search")),
 			 _("Rebuilding search index"));
-      gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object
-                                          (me->_builder, "toolbar_filter")), FALSE);
-
    }
    return false;
 }
@@ -995,6 +1602,27 @@ gboolean RGMainWindow::xapianDoIndexUpdate(void *data)
 }
 #endif
 
+#ifdef HAVE_XAPIAN
+gboolean RGMainWindow::xapianIndexBuildPoll(void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
+   if (me->_xapianBuilder->isRunning())
+      return TRUE;
+   me->_xapianBuildWatchId = 0;
+
+   if(RSettings().debugXapian)
+      std::cerr << "xapianIndexBuildPoll: "
+		<< me->_xapianBuilder->succeeded() << std::endl;
+   // as after update-apt-xapian-index: a failed build left the old one
+   if (me->_xapianBuilder->succeeded())
+      me->_lister->openXapianIndex();
+   gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(me->_builder,
+						     "label_fast_search")),
+		      _("Quick filter"));
+   return FALSE;
+}
+#endif
+
 void RGMainWindow::xapianIndexUpdateFinished(GPid pid, gint status, void* data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
@@ -1002,17 +1630,17 @@ void RGMainWindow::xapianIndexUpdateFinished(GPid pid, gint status, void* data)
    // Clear the watch ID since this callback is being invoked
    me->_xapianChildWatchId = 0;
 
-   if(_config->FindB("Debug::Synaptic::Xapian",false))
+   if(RSettings().debugXapian)
       std::cerr << "xapianIndexUpdateFinished: "
 		<< WEXITSTATUS(status) << std::endl;
 #ifdef HAVE_XAPIAN
-   me->_lister->openXapianIndex();
+   // swap in the new revision; after a failed run the old one stays
+   if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+      me->_lister->openXapianIndex();
 #endif
    gtk_label_set_text(GTK_LABEL(gtk_builder_get_object(me->_builder,
 						     "label_fast_search")),
 		      _("Quick filter"));
-   gtk_widget_set_sensitive(GTK_WIDGET(gtk_builder_get_object
-                            (me->_builder, "toolbar_filter")), TRUE);
    g_spawn_close_pid(pid);
 }
 
@@ -1157,6 +1785,10 @@ void RGMainWindow::buildInterface()
                     "activate",
                     G_CALLBACK(cbShowBackendSettingsWindow), this);
 
+   g_signal_connect(gtk_builder_get_object(_builder, "menu_debug_panel"),
+                    "activate",
+                    G_CALLBACK(cbShowDebugPanel), this);
+
    g_signal_connect(gtk_builder_get_object(_builder, "menu_exit"),
                     "activate",
                     G_CALLBACK(closeWin), this);
@@ -1216,6 +1848,10 @@ void RGMainWindow::buildInterface()
                       "activate",
                       G_CALLBACK(cbSaveAsClicked), this);
 
+   g_signal_connect(gtk_builder_get_object(_builder, "menu_apply_state"),
+                    "activate",
+                    G_CALLBACK(cbApplyStateClicked), this);
+
    g_signal_connect(gtk_builder_get_object(_builder, "generate_download_script1"),
                     "activate",
                     G_CALLBACK(cbGenerateDownloadScriptClicked), this);
@@ -1281,8 +1917,14 @@ void RGMainWindow::buildInterface()
                               (_builder, "separator_debian")));
 #endif
    
-   if(!FileExists(_config->Find("Synaptic::taskHelperProg","/usr/bin/tasksel")))
+   string tasksel = _config->Find("Synaptic::taskHelperProg","/usr/bin/tasksel");
+   if(!FileExists(tasksel)) {
       gtk_widget_hide(GTK_WIDGET(gtk_builder_get_object(_builder, "menu_tasks")));
+   } else {
+      // read while nobody waits for it, the tasks window shows it as is
+      _taskList = new RTaskList(tasksel);
+      _taskList->prefetch();
+   }
 
    button = GTK_WIDGET(gtk_builder_get_object(_builder, "button_update"));
    gtk_widget_set_tooltip_text(button,
@@ -1454,8 +2096,12 @@ void RGMainWindow::buildInterface()
    //gtk_tree_selection_set_mode (select, GTK_SELECTION_MULTIPLE);
    g_signal_connect(G_OBJECT(select), "changed",
                     G_CALLBACK(cbSelectedRow), this);
+   gtk_tree_selection_set_select_function(select, cbSelectRow, this, NULL);
    g_signal_connect(G_OBJECT(_treeView), "row-activated",
                     G_CALLBACK(cbPackageListRowActivated), this);
+   g_signal_connect(G_OBJECT(gtk_scrollable_get_vadjustment(
+                       GTK_SCROLLABLE(_treeView))), "value-changed",
+                    G_CALLBACK(cbPackageListScrolled), this);
 
    g_signal_connect(gtk_builder_get_object(_builder, "add_cdrom"),
                     "activate",
@@ -1686,7 +2332,8 @@ void RGMainWindow::buildInterface()
 
    // only enable fast search if its usable
 #ifdef HAVE_XAPIAN
-   if(!FileExists("/usr/sbin/update-apt-xapian-index"))
+   if(!RPackageLister::nativeXapianIndex() &&
+      !FileExists("/usr/sbin/update-apt-xapian-index"))
 #endif
    {
       gtk_widget_hide(GTK_WIDGET(
@@ -1701,6 +2348,14 @@ void RGMainWindow::buildInterface()
        [this](const PolySynaptic::BackendFilter& filter) {
            this->onBackendFilterChanged(filter);
        });
+   _backendFilterBar->setRefineCallback(
+       [this](const PolySynaptic::ResultQuery& query) {
+           this->onUnifiedRefineChanged(query);
+       });
+   _backendFilterBar->setCategoryCallback(
+       [this](int category) {
+           this->onUnifiedCategoryChanged(category);
+       });
 
    // Add a toggle button for unified view mode
    GtkWidget *unifiedToggle = gtk_check_button_new_with_label(_("Unified View"));
@@ -1839,13 +2494,33 @@ void RGMainWindow::setStatusText(char *text)
       gtk_widget_set_sensitive(_proceedM, (toInstall + toRemove) != 0);
    }
    _unsavedChanges = ((toInstall + toRemove) != 0);
+   if (_unsavedChanges)
+      queueSummaryPrecompute();
 
    gtk_widget_queue_draw(_statusL);
 }
 
 
+// what was measured this session, for whoever asked for it to be kept;
+// the histograms go with their raw buckets, to be aggregated over runs
+static void writeSessionReports()
+{
+   string latencyFile = _config->Find("Synaptic::Latency::File", "");
+   if (!latencyFile.empty() &&
+       !PolySynaptic::LatencyRegistry::instance().exportJson(latencyFile))
+      cerr << "Could not write " << latencyFile << endl;
+
+   string memoryFile = _config->Find("Synaptic::Memory::File", "");
+   if (!memoryFile.empty() &&
+       !PolySynaptic::MemoryRegistry::instance().exportJson(memoryFile))
+      cerr << "Could not write " << memoryFile << endl;
+}
+
 void RGMainWindow::saveState()
 {
+   // every way out of the main window passes here
+   writeSessionReports();
+
    if (_config->FindB("Volatile::NoStateSaving", false) == true)
       return;
 
@@ -1967,18 +2642,40 @@ void RGMainWindow::setTreeLocked(bool flag)
 {
    if (flag == true) {
       updatePackageInfo(NULL);
-      gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), NULL);
+      detachPackageList();
    } else {
-      // PolySynaptic: Restore the correct model based on view mode
-      if (_unifiedViewMode && _unifiedPkgList) {
-         gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView),
-                                 GTK_TREE_MODEL(_unifiedPkgList));
-      } else {
-         gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), _pkgList);
-      }
+      attachPackageList();
    }
 }
 
+void RGMainWindow::detachPackageList()
+{
+   // we need to set a empty model first so that gtklistview
+   // can do its cleanup, if we do not do that, then the cleanup
+   // code in gtktreeview gets confused and throws
+   // Gtk-CRITICAL **: gtk_tree_view_unref_tree_helper: assertion `node != NULL' failed
+   // at us, see LP: #38397 for more information
+   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), NULL);
+}
+
+void RGMainWindow::attachPackageList()
+{
+   GtkTreeModel *model;
+   // PolySynaptic: Restore the correct model based on view mode
+   if (_unifiedViewMode) {
+      if (_unifiedPkgList == NULL)
+         return;
+      model = GTK_TREE_MODEL(_unifiedPkgList);
+   } else {
+      if (_pkgList == NULL)
+         _pkgList = GTK_TREE_MODEL(gtk_pkg_list_new(_lister));
+      model = _pkgList;
+   }
+
+   if (gtk_tree_view_get_model(GTK_TREE_VIEW(_treeView)) != model)
+      gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView), model);
+}
+
 
 
 // --------------------------------------------------------------------------
@@ -2175,10 +2872,7 @@ void RGMainWindow::cbTasksClicked(GtkWidget *self, void *data)
 
    me->setBusyCursor(true);
 
-   if (me->_tasksWin == NULL) {   
-      me->_tasksWin = new RGTasksWin(me);
-   }
-   me->_tasksWin->show();
+   lazy(me->_tasksWin, me, me->_taskList)->show();
 
    me->setBusyCursor(false);
 }
@@ -2218,14 +2912,74 @@ void RGMainWindow::cbOpenClicked(GtkWidget *self, void *data)
       me->_lister->readSelections(in);
       me->askStateChange(state);
 
-      // refresh to ensure that broken dependencies are displayed
-      me->_lister->registerObserver(me);
-      me->refreshTable();
-      me->refreshSubViewList();
-      me->setStatusText();
-      me->setInterfaceLocked(FALSE);
+      // refresh to ensure that broken dependencies are displayed
+      me->_lister->registerObserver(me);
+      me->refreshTable();
+      me->refreshSubViewList();
+      me->setStatusText();
+      me->setInterfaceLocked(FALSE);
+   }
+   gtk_widget_destroy(filesel);
+}
+
+void RGMainWindow::cbApplyStateClicked(GtkWidget *self, void *data)
+{
+   RGMainWindow *me = (RGMainWindow*)data;
+
+   if (!me->_backendManager)
+      return;
+
+   GtkWidget *filesel;
+   filesel = gtk_file_chooser_dialog_new(_("Apply package list"),
+					 GTK_WINDOW(me->window()),
+					 GTK_FILE_CHOOSER_ACTION_OPEN,
+					 _("_Cancel"), GTK_RESPONSE_CANCEL,
+					 _("_Open"), GTK_RESPONSE_ACCEPT,
+					 NULL);
+   if (gtk_dialog_run(GTK_DIALOG(filesel)) != GTK_RESPONSE_ACCEPT) {
+      gtk_widget_destroy(filesel);
+      return;
+   }
+   gchar *file = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(filesel));
+   gtk_widget_destroy(filesel);
+
+   PolySynaptic::DesiredState desired;
+   string error;
+   ifstream in(file);
+   bool parsed = in && desired.parse(in, error);
+   if (!parsed) {
+      gchar *msg = g_strdup_printf(_("Can't read %s\n%s"), file, error.c_str());
+      me->_userDialog->error(msg);
+      g_free(msg);
+      g_free(file);
+      return;
+   }
+   g_free(file);
+
+   me->setInterfaceLocked(TRUE);
+   me->setStatusText(_("Comparing the package list with the system..."));
+   RGFlushInterface();
+
+   PolySynaptic::Reconciliation plan = desired.reconcile(*me->_backendManager);
+
+   if (!plan.unavailable.empty()) {
+      string msg = _("These packages are skipped, their backend is not available:\n");
+      for (const auto &want : plan.unavailable)
+         msg += "   " + want.id + "\n";
+      me->_userDialog->warning(msg.c_str());
    }
-   gtk_widget_destroy(filesel);
+
+   me->queuePlannedOperations(plan.transaction);
+
+   me->refreshTable();
+   me->setStatusText();
+   me->setInterfaceLocked(FALSE);
+
+   if (plan.transaction.empty()) {
+      me->_userDialog->message(_("The system already matches the package list."));
+      return;
+   }
+   cbProceedClicked(self, data);
 }
 
 void RGMainWindow::cbSaveClicked(GtkWidget *self, void *data)
@@ -2286,22 +3040,34 @@ void RGMainWindow::cbShowConfigWindow(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_configWin == NULL) {
-      me->_configWin = new RGPreferencesWindow(me, me->_lister);
-   }
-
-   me->_configWin->show();
+   lazy(me->_configWin, me, me->_lister)->show();
 }
 
 void RGMainWindow::cbShowBackendSettingsWindow(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_backendSettingsWin == NULL) {
-      me->_backendSettingsWin = new RGBackendSettingsWindow(me, me->_backendManager);
-   }
+   lazy(me->_backendSettingsWin, me, me->_backendManager)->run();
+}
+
+void RGMainWindow::cbShowDebugPanel(GtkWidget *self, void *data)
+{
+   RGMainWindow *me = (RGMainWindow *) data;
 
-   me->_backendSettingsWin->run();
+   if (me->_debugPanel == NULL) {
+      me->_debugPanel = new PolySynaptic::RGDebugPanel();
+      // the console's diagnose times this window's backends, like
+      // --diagnose-performance does from the command line
+      me->_debugPanel->setDiagnosis([me]() {
+         PolySynaptic::PerfDiagnosis diagnosis;
+         for (PolySynaptic::IPackageBackend *backend :
+              me->_backendManager->getAllBackends())
+            diagnosis.addBackend(backend);
+         return PolySynaptic::PerfDiagnosis::report(diagnosis.run());
+      });
+      me->_debugPanel->setLogFile(_config->Find("Synaptic::Log::File", ""));
+   }
+   me->_debugPanel->showDialog(GTK_WINDOW(me->_win));
 }
 
 void RGMainWindow::cbToggleUnifiedView(GtkWidget *self, void *data)
@@ -2345,15 +3111,28 @@ void RGMainWindow::cbToggleUnifiedView(GtkWidget *self, void *data)
 void RGMainWindow::onBackendFilterChanged(const PolySynaptic::BackendFilter& filter)
 {
    if (!_unifiedViewMode) return;
+   RGNoteViewChange("filter");
 
    // Update the unified list filter
    if (_unifiedPkgList) {
-      rg_unified_pkg_list_set_filter(_unifiedPkgList, filter);
+      rg_unified_pkg_list_set_filter(_unifiedPkgList, filter,
+                                     GTK_TREE_VIEW(_treeView));
+   }
+
+   // Leaving a backend out only hides rows that are already here
+   if ((!filter.includeApt || _unifiedFetchFilter.includeApt) &&
+       (!filter.includeSnap || _unifiedFetchFilter.includeSnap) &&
+       (!filter.includeFlatpak || _unifiedFetchFilter.includeFlatpak)) {
+      onUnifiedRefineChanged(_backendFilterBar->getRefinement());
+      return;
    }
 
-   // Re-search or reload installed packages
+   // Re-search, relist the category or reload installed packages
    const gchar *searchText = gtk_entry_get_text(GTK_ENTRY(_entry_fast_search));
-   if (searchText && strlen(searchText) > 0) {
+   int category = _backendFilterBar->getCategory();
+   if (category >= 0 && !(searchText && strlen(searchText) > 0)) {
+      loadUnifiedCategory(static_cast<PolySynaptic::Category>(category));
+   } else if (searchText && strlen(searchText) > 0) {
       // Re-search with new filter
       doUnifiedSearch(searchText);
    } else {
@@ -2362,11 +3141,76 @@ void RGMainWindow::onBackendFilterChanged(const PolySynaptic::BackendFilter& fil
    }
 }
 
+void RGMainWindow::onUnifiedRefineChanged(const PolySynaptic::ResultQuery& query)
+{
+   if (!_unifiedViewMode || !_unifiedPkgList) return;
+   RGNoteViewChange("refine");
+
+   // Answered from the packages already fetched, nothing is searched
+   rg_unified_pkg_list_set_refinement(_unifiedPkgList, query,
+                                      GTK_TREE_VIEW(_treeView));
+
+   PolySynaptic::PackageSnapshotPtr shown =
+      rg_unified_pkg_list_get_packages(_unifiedPkgList);
+   gchar *statusText = g_strdup_printf(_("%d of %zu packages shown"),
+       rg_unified_pkg_list_n_visible(_unifiedPkgList),
+       shown ? shown->size() : (size_t) 0);
+   setStatusText(statusText);
+   g_free(statusText);
+}
+
+void RGMainWindow::onUnifiedCategoryChanged(int category)
+{
+   if (!_unifiedViewMode) return;
+
+   if (category >= 0) {
+      loadUnifiedCategory(static_cast<PolySynaptic::Category>(category));
+   } else {
+      loadUnifiedInstalledPackages();
+   }
+}
+
+void RGMainWindow::loadUnifiedCategory(PolySynaptic::Category category)
+{
+   if (!_unifiedViewMode || !_backendManager) return;
+
+   PolySynaptic::BackendFilter filter = PolySynaptic::BackendFilter::All();
+   if (_backendFilterBar) {
+      filter = _backendFilterBar->getFilter();
+   }
+
+   // Any view change makes an outstanding revalidation or search stale
+   unsigned serial = ++_unifiedLoadSerial;
+   _unifiedFetchFilter = filter;
+   _backendManager->cancelSearch();
+
+   // From the category index and the caches; no backend is asked
+   vector<PolySynaptic::PackageInfo> packages =
+      _backendManager->getCategoryPackages(category, filter);
+   _backendManager->trimForList(packages);
+   PolySynaptic::PackageSnapshotPtr shown =
+      _unifiedPublisher.publish(std::move(packages), serial);
+   updateUnifiedTreeView();
+
+   gchar *statusText;
+   if (!_backendManager->getCategoryIndex()) {
+      statusText = g_strdup(_("Package categories are still being indexed"));
+   } else {
+      statusText = g_strdup_printf(_("%zu packages in %s"),
+          shown->size(),
+          PolySynaptic::CategoryIndex::name(category));
+   }
+   setStatusText(statusText);
+   g_free(statusText);
+}
+
 void RGMainWindow::doUnifiedSearch(const string& query)
 {
+   PolySynaptic::ScopedSpan span("doUnifiedSearch", "ui");
    if (!_unifiedViewMode || !_backendManager) return;
 
-   setBusyCursor(true);
+   // Results of anything started before this are now stale
+   unsigned serial = ++_unifiedLoadSerial;
 
    // Get the current filter from the filter bar
    PolySynaptic::BackendFilter filter = PolySynaptic::BackendFilter::All();
@@ -2374,6 +3218,8 @@ void RGMainWindow::doUnifiedSearch(const string& query)
       filter = _backendFilterBar->getFilter();
    }
 
+   _unifiedFetchFilter = filter;
+
    // Create search options
    PolySynaptic::SearchOptions options;
    options.query = query;
@@ -2381,24 +3227,73 @@ void RGMainWindow::doUnifiedSearch(const string& query)
    options.searchDescriptions = true;
    options.maxResults = 200;
 
-   // Perform unified search across all backends
-   _unifiedPackages = _backendManager->searchPackages(options, filter);
-
-   // Update the tree view with results
-   updateUnifiedTreeView();
+   // Search all backends without blocking the main loop; this also
+   // cancels whatever the previous keystroke started. Each backend's
+   // results are published as soon as they arrive, so APT does not
+   // wait for the store queries; the first starts the new list in
+   // place of the previous query's rows.
+   setStatusText(const_cast<char*>(_("Searching all package sources...")));
+   _backendManager->startSearch(options, filter,
+      [this, serial](uint64_t session,
+                     const vector<PolySynaptic::PackageInfo> &) {
+         // Every backend has answered; if none had anything, the
+         // previous rows still have to go
+         if (_unifiedPublisher.current()->generation() < serial)
+            _unifiedPublisher.publish(vector<PolySynaptic::PackageInfo>(), serial);
+
+         UnifiedSearchDelivery *job = new UnifiedSearchDelivery;
+         job->win = this;
+         job->serial = serial;
+         job->session = session;
+         job->partial = false;
+         g_idle_add(applyUnifiedSearchResults, job);
+      },
+      [this, serial](uint64_t session, PolySynaptic::BackendType,
+                     const vector<PolySynaptic::PackageInfo> &results) {
+         vector<PolySynaptic::PackageInfo> listed = results;
+         _backendManager->trimForList(listed);
+         _unifiedPublisher.append(listed, serial);
+
+         UnifiedSearchDelivery *job = new UnifiedSearchDelivery;
+         job->win = this;
+         job->serial = serial;
+         job->session = session;
+         job->partial = true;
+         g_idle_add(applyUnifiedSearchResults, job);
+      });
+}
 
-   setBusyCursor(false);
+gboolean RGMainWindow::applyUnifiedSearchResults(gpointer data)
+{
+   UnifiedSearchDelivery *job = (UnifiedSearchDelivery *) data;
+   RGMainWindow *me = job->win;
+
+   // Both checks matter: the session may have been superseded by a
+   // newer search, the serial by an installed-package load
+   if (job->serial == me->_unifiedLoadSerial && me->_unifiedViewMode &&
+       me->_backendManager->isCurrentSearch(job->session)) {
+      RGNoteViewChange("search results");
+      // Whatever was published by now, so a later delivery may find
+      // its results shown already
+      me->updateUnifiedTreeView();
+
+      PolySynaptic::PackageSnapshotPtr found = me->_unifiedPublisher.current();
+      gchar *statusText = g_strdup_printf(
+          job->partial ? _("%zu packages found so far...")
+                       : _("%zu packages found across all sources"),
+          found->size());
+      me->setStatusText(statusText);
+      g_free(statusText);
+   }
 
-   // Update status text
-   gchar *statusText = g_strdup_printf(
-       _("%zu packages found across all sources"), _unifiedPackages.size());
-   setStatusText(statusText);
-   g_free(statusText);
+   delete job;
+   return FALSE;
 }
 
 void RGMainWindow::loadUnifiedInstalledPackages()
 {
    if (!_unifiedViewMode || !_backendManager) return;
+   PolySynaptic::ScopedSpan span("loadUnifiedInstalledPackages", "ui");
 
    setBusyCursor(true);
 
@@ -2408,8 +3303,34 @@ void RGMainWindow::loadUnifiedInstalledPackages()
       filter = _backendFilterBar->getFilter();
    }
 
-   // Get installed packages from selected backends
-   _unifiedPackages = _backendManager->getInstalledPackages(filter);
+   // Any view change makes an outstanding revalidation or search stale
+   unsigned serial = ++_unifiedLoadSerial;
+   _unifiedFetchFilter = filter;
+   _backendManager->cancelSearch();
+
+   // APT shares the package lister with the main loop, so it is
+   // revalidated here; it is in-process and cheap when unchanged
+   PolySynaptic::BackendFilter aptFilter = filter;
+   aptFilter.includeSnap = aptFilter.includeFlatpak = false;
+   if (aptFilter.includeApt)
+      _backendManager->revalidateInstalledPackages(aptFilter);
+
+   // Paint from the persistent catalog first
+   vector<PolySynaptic::PackageInfo> packages =
+      _backendManager->getCachedInstalledPackages(filter);
+
+   PolySynaptic::BackendFilter externalFilter = filter;
+   externalFilter.includeApt = false;
+
+   bool cold = packages.empty();
+   if (cold) {
+      // Nothing cached yet, so there is nothing to paint early
+      _backendManager->revalidateInstalledPackages(externalFilter);
+      packages = _backendManager->getCachedInstalledPackages(filter);
+   }
+   _backendManager->trimForList(packages);
+   PolySynaptic::PackageSnapshotPtr shown =
+      _unifiedPublisher.publish(std::move(packages), serial);
 
    // Update the tree view with results
    updateUnifiedTreeView();
@@ -2418,31 +3339,77 @@ void RGMainWindow::loadUnifiedInstalledPackages()
 
    // Update status text
    gchar *statusText = g_strdup_printf(
-       _("%zu installed packages from selected sources"), _unifiedPackages.size());
+       _("%zu installed packages from selected sources"), shown->size());
    setStatusText(statusText);
    g_free(statusText);
+
+   if (cold || (!externalFilter.includeSnap && !externalFilter.includeFlatpak))
+      return;
+
+   // Revalidate Snap and Flatpak in the background; the revised list
+   // is built and published there, and the main loop only signals the
+   // rows that differ
+   PolySynaptic::BackendManager *manager = _backendManager;
+   std::thread([this, manager, externalFilter, serial]() {
+      PolySynaptic::CatalogDelta delta =
+         manager->revalidateInstalledPackages(externalFilter);
+      manager->trimForList(delta.added);
+      manager->trimForList(delta.changed);
+
+      UnifiedRevalidation *job = new UnifiedRevalidation;
+      job->win = this;
+      job->serial = serial;
+      job->changed = !delta.empty() &&
+         _unifiedPublisher.applyDelta(delta, serial)->generation() == serial;
+      g_idle_add(applyUnifiedRevalidation, job);
+   }).detach();
+}
+
+gboolean RGMainWindow::applyUnifiedRevalidation(gpointer data)
+{
+   UnifiedRevalidation *job = (UnifiedRevalidation *) data;
+   RGMainWindow *me = job->win;
+
+   if (job->serial == me->_unifiedLoadSerial && me->_unifiedViewMode &&
+       job->changed) {
+      me->updateUnifiedTreeView();
+
+      gchar *statusText = g_strdup_printf(
+          _("%zu installed packages from selected sources"),
+          me->_unifiedPublisher.current()->size());
+      me->setStatusText(statusText);
+      g_free(statusText);
+   }
+
+   delete job;
+   return FALSE;
 }
 
 void RGMainWindow::updateUnifiedTreeView()
 {
    if (!_unifiedPkgList) return;
+   RGNoteViewChange("package list");
 
-   // Set the package data
-   rg_unified_pkg_list_set_packages(_unifiedPkgList, &_unifiedPackages);
+   // Whoever published it trimmed it for the list in low-memory mode
+   PolySynaptic::PackageSnapshotPtr latest = _unifiedPublisher.current();
+   GtkTreeView *view = GTK_TREE_VIEW(_treeView);
 
-   // Set the tree view to use the unified model
-   gtk_tree_view_set_model(GTK_TREE_VIEW(_treeView),
-                           GTK_TREE_MODEL(_unifiedPkgList));
+   if (gtk_tree_view_get_model(view) == GTK_TREE_MODEL(_unifiedPkgList)) {
+      // Already shown: signal only the rows that changed
+      if (latest != rg_unified_pkg_list_get_packages(_unifiedPkgList))
+         rg_unified_pkg_list_set_packages(_unifiedPkgList, latest, view);
+   } else {
+      // Nothing listens yet, so this is a plain swap
+      rg_unified_pkg_list_set_packages(_unifiedPkgList, latest);
+      gtk_tree_view_set_model(view, GTK_TREE_MODEL(_unifiedPkgList));
+   }
 }
 
 void RGMainWindow::cbShowSetOptWindow(GtkWidget *self, void *data)
 {
    RGMainWindow *win = (RGMainWindow *) data;
 
-   if (win->_setOptWin == NULL)
-      win->_setOptWin = new RGSetOptWindow(win);
-
-   win->_setOptWin->show();
+   lazy(win->_setOptWin, win)->show();
 }
 
 void RGMainWindow::cbDetailsWindow(GtkWidget *self, void *data)
@@ -2454,10 +3421,7 @@ void RGMainWindow::cbDetailsWindow(GtkWidget *self, void *data)
    if (pkg == NULL) 
       return;
 
-   if(me->_pkgDetails == NULL)
-      me->_pkgDetails = new RGPkgDetailsWindow(me);
-
-   RGPkgDetailsWindow::fillInValues(me->_pkgDetails, pkg, true);
+   RGPkgDetailsWindow::fillInValues(lazy(me->_pkgDetails, me), pkg, true);
    me->_pkgDetails->show();
 }
 
@@ -2482,6 +3446,8 @@ void RGMainWindow::cbShowSourcesWindow(GtkWidget *self, void *data)
    // FIXME: make this all go into the repository window
    bool Changed = false;
    bool ForceReload = _config->FindB("Synaptic::UpdateAfterSrcChange",false);
+   // the entries the editor checked; only they need fetching
+   vector<string> Validated;
    
    if(!g_file_test("/usr/bin/software-properties-gtk", 
 		   G_FILE_TEST_IS_EXECUTABLE) 
@@ -2489,6 +3455,8 @@ void RGMainWindow::cbShowSourcesWindow(GtkWidget *self, void *data)
    {
       RGRepositoryEditor w(me);
       Changed = w.Run();
+      if (Changed)
+         Validated = w.ValidatedSources();
    } else {
       // use gnome-software-properties window
       me->setInterfaceLocked(TRUE);
@@ -2516,7 +3484,7 @@ void RGMainWindow::cbShowSourcesWindow(GtkWidget *self, void *data)
 
    // auto update after repostitory change
    if (Changed == true && ForceReload) {
-      me->cbUpdateClicked(NULL, data);
+      me->reloadPackageInformation(Validated);
    } else if(Changed == true && 
 	     _config->FindB("Synaptic::AskForUpdateAfterSrcChange",true)) {
       // ask for update after repo change
@@ -2548,7 +3516,7 @@ void RGMainWindow::cbShowSourcesWindow(GtkWidget *self, void *data)
 	    _config->Set("Synaptic::AskForUpdateAfterSrcChange", false);
       }
       if (response == GTK_RESPONSE_ACCEPT) {
-         me->cbUpdateClicked(NULL, data);
+         me->reloadPackageInformation(Validated);
       }
       gtk_widget_destroy (dialog);
    }
@@ -2585,11 +3553,7 @@ void RGMainWindow::cbFindToolClicked(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_findWin == NULL) {
-      me->_findWin = new RGFindWindow(me);
-   }
-   
-   me->_findWin->selectText();
+   lazy(me->_findWin, me)->selectText();
    int res = gtk_dialog_run(GTK_DIALOG(me->_findWin->window()));
    if (res == GTK_RESPONSE_OK) {
 
@@ -2663,18 +3627,14 @@ void RGMainWindow::cbShowIconLegendPanel(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_iconLegendPanel == NULL)
-      me->_iconLegendPanel = new RGIconLegendPanel(me);
-   me->_iconLegendPanel->show();
+   lazy(me->_iconLegendPanel, me)->show();
 }
 
 void RGMainWindow::cbViewLogClicked(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_logView == NULL)
-      me->_logView = new RGLogView(me);
-   me->_logView->readLogs();
+   lazy(me->_logView, me)->readLogs();
    me->_logView->show();
 }
 
@@ -2730,11 +3690,7 @@ void RGMainWindow::cbShowFilterManagerWindow(GtkWidget *self, void *data)
 
    RGMainWindow *me = (RGMainWindow *) data;
 
-   if (me->_fmanagerWin == NULL) {
-      me->_fmanagerWin = new RGFilterManagerWindow(me, me->_lister->filterView());
-   }
-
-   me->_fmanagerWin->readFilters();
+   lazy(me->_fmanagerWin, me, me->_lister->filterView())->readFilters();
    int res = gtk_dialog_run(GTK_DIALOG(me->_fmanagerWin->window()));
    if(res == GTK_RESPONSE_OK) {
       me->setInterfaceLocked(TRUE);
@@ -2766,6 +3722,7 @@ void RGMainWindow::cbSelectedRow(GtkTreeSelection *selection, gpointer data)
       list = li = gtk_tree_selection_get_selected_rows(selection, &model);
 
       if (li == NULL) {
+         me->cancelUnifiedDetails();
          gtk_text_buffer_set_text(me->_pkgCommonTextBuffer,
              _("No package selected."), -1);
          return;
@@ -2787,6 +3744,21 @@ void RGMainWindow::cbSelectedRow(GtkTreeSelection *selection, gpointer data)
 
       if (pkgInfo == NULL) return;
 
+      // APT's details are in the open cache; the others' take a snap
+      // info or flatpak info, so the summary shows until they are in
+      string description = pkgInfo->description.empty() ? pkgInfo->summary
+                                                        : pkgInfo->description;
+      if (pkgInfo->backend == PolySynaptic::BackendType::APT) {
+         me->cancelUnifiedDetails();
+         me->_backendManager->resolveDetails(*pkgInfo);
+         if (!pkgInfo->description.empty())
+            description = pkgInfo->description;
+      } else {
+         me->fetchUnifiedDetails(*pkgInfo);
+         if (me->_detailsFetched && !me->_details.description.empty())
+            description = me->_details.description;
+      }
+
       // Display unified package info in the text buffer
       gchar *info = g_strdup_printf(
           "%s\n\n"
@@ -2798,7 +3770,7 @@ void RGMainWindow::cbSelectedRow(GtkTreeSelection *selection, gpointer data)
           PolySynaptic::backendTypeToString(pkgInfo->backend),
           pkgInfo->getDisplayVersion().c_str(),
           PolySynaptic::installStatusToString(pkgInfo->installStatus),
-          pkgInfo->description.empty() ? pkgInfo->summary.c_str() : pkgInfo->description.c_str()
+          description.c_str()
       );
       gtk_text_buffer_set_text(me->_pkgCommonTextBuffer, info, -1);
       g_free(info);
@@ -2807,32 +3779,25 @@ void RGMainWindow::cbSelectedRow(GtkTreeSelection *selection, gpointer data)
    }
 
    // Legacy APT package selection
-   RPackage *pkg;
-
    if (me->_pkgList == NULL) {
       cerr << "selectedRow(): me->_pkgTree == NULL " << endl;
       return;
    }
-   list = li = gtk_tree_selection_get_selected_rows(selection, &me->_pkgList);
+
+   // the rows cbSelectRow() saw come and go, unless GTK changed the
+   // selection wholesale or the rows are other packages now
+   if (me->_selectionCacheGeneration != me->_lister->getCacheGeneration() ||
+       gtk_tree_selection_count_selected_rows(selection) !=
+       (int) me->_selection.size() ||
+       !me->_selection.contains(me->_selectionLast))
+      me->syncSelection(selection);
 
    // list is empty
-   if (li == NULL) {
+   if (me->_selectionLast == NULL) {
       me->updatePackageInfo(NULL);
       return;
    }
-   // we are only interested in the last element
-   li = g_list_last(li);
-   gtk_tree_model_get_iter(me->_pkgList, &iter, (GtkTreePath *) (li->data));
-
-   gtk_tree_model_get(me->_pkgList, &iter, PKG_COLUMN, &pkg, -1);
-   if (pkg == NULL)
-      return;
-
-   // free the list
-   g_list_foreach(list, (void (*)(void *, void *))gtk_tree_path_free, NULL);
-   g_list_free(list);
-
-   me->updatePackageInfo(pkg);
+   me->updatePackageInfo(me->_selectionLast);
 }
 
 void RGMainWindow::cbClearAllChangesClicked(GtkWidget *self, void *data)
@@ -2895,8 +3860,16 @@ void RGMainWindow::cbPkgReconfigureClicked(GtkWidget *self, void *data)
    RGMainWindow *me = (RGMainWindow *) data;
    //cout << "RGMainWindow::pkgReconfigureClicked()" << endl;
 
-   if(me->selectedPackage() == NULL)
+   RPackage *selected = me->selectedPackage();
+   if(selected == NULL)
+      return;
+
+   // only packages that use debconf have anything to reconfigure
+   if(!selected->dependsOn("debconf") && !selected->dependsOn("debconf-i18n")) {
+      me->_userDialog->error(_("This package does not use debconf, "
+                               "there is nothing to reconfigure."));
       return;
+   }
 
    RPackage *pkg = NULL;
    pkg = me->_lister->getPackage("libgnome2-perl");
@@ -2975,12 +3948,7 @@ void RGMainWindow::cbChangedSubView(GtkTreeSelection *selection,
       return;
 
    me->setBusyCursor(true);
-   // we need to set a empty model first so that gtklistview
-   // can do its cleanup, if we do not do that, then the cleanup
-   // code in gtktreeview gets confused and throws
-   // Gtk-CRITICAL **: gtk_tree_view_unref_tree_helper: assertion `node != NULL' failed
-   // at us, see LP: #38397 for more information
-   gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), NULL);
+   me->detachPackageList();
 
    string selected = MarkupUnescapeString(me->selectedSubView());
    me->_lister->setSubView(utf8(selected.c_str()));
@@ -3018,11 +3986,19 @@ void RGMainWindow::cbProceedClicked(GtkWidget *self, void *data)
    int toInstall, toRemove;
    double size;
    me->_lister->getStats(installed, broken, toInstall, toRemove, size);
-   if((toInstall + toRemove) == 0)
+
+   // PolySynaptic: Snap and Flatpak operations queued beside the marks
+   PolySynaptic::Transaction backendOps;
+   if (me->_backendManager) {
+      backendOps = me->_backendManager->getCurrentTransaction();
+      me->_backendManager->fillDownloadSizes(backendOps);
+   }
+   bool aptChanges = (toInstall + toRemove) > 0;
+   if (!aptChanges && backendOps.empty())
       return;
 
    // check whether we can really do it
-   if (!me->_lister->check()) {
+   if (aptChanges && !me->_lister->check()) {
       me->_userDialog->error(_("Could not apply changes!\n"
                                "Fix broken packages first."));
       return;
@@ -3034,13 +4010,19 @@ void RGMainWindow::cbProceedClicked(GtkWidget *self, void *data)
    if(unAuthenticated ||
       _config->FindB("Volatile::Non-Interactive", false) == false) {
       // show a summary of what's gonna happen
-      RGSummaryWindow summ(me, me->_lister);
+      RGSummaryWindow summ(me, me->_lister, &backendOps);
       if (!summ.showAndConfirm()) {
          // canceled operation
          return;
       }
    }
 
+   if (!aptChanges) {
+      me->commitBackendTransaction();
+      me->loadUnifiedInstalledPackages();
+      return;
+   }
+
    me->setInterfaceLocked(TRUE);
    me->updatePackageInfo(NULL);
 
@@ -3096,8 +4078,20 @@ void RGMainWindow::cbProceedClicked(GtkWidget *self, void *data)
 #endif // HAVE_RPM
    me->_installProgress = dynamic_cast<RGWindow*>(iprogress);
 
-   //bool result = me->_lister->commitChanges(fprogress, iprogress);
-   me->_lister->commitChanges(fprogress, iprogress);
+   // a background download holds the archive cache lock
+   if (me->_backendManager)
+      me->_backendManager->cancelPredownloads();
+
+   // journaled, so a commit cut short can be picked up at the next start
+   if (me->_backendManager)
+      me->_backendManager->recordAptCommit(markedAptOperations(me->_lister));
+   bool committed = me->_lister->commitChanges(fprogress, iprogress);
+
+   // the rate of this fetch goes into the estimates of the next commit
+   if (me->_backendManager)
+      me->_backendManager->getOperationHistory().recordThroughput(
+         PolySynaptic::BackendType::APT, fprogress->FetchedBytes,
+         fprogress->ElapsedTime);
 
    // FIXME: move this into the terminal class
 #ifdef HAVE_TERMINAL
@@ -3119,6 +4113,13 @@ void RGMainWindow::cbProceedClicked(GtkWidget *self, void *data)
    } else {
       _error->Discard();
    }
+
+   if (committed && me->_backendManager)
+      me->_backendManager->completeAptCommit();
+
+   // the debs are in, so snaps and flatpaks needing them can follow
+   me->commitBackendTransaction();
+
    if (_config->FindB("Volatile::Non-Interactive", false) == true) {
       return;
    }
@@ -3131,30 +4132,232 @@ void RGMainWindow::cbProceedClicked(GtkWidget *self, void *data)
       exit(0);
    }
 
-   if (_config->FindB("Volatile::Download-Only", false) == false) {
+   string selections = file;
+   g_free((void *)file);
+   me->refreshAfterCommit(selections);
+}
+
+// After a commit the cache reopen, the marks and the views are steps on
+// the main loop, one after the other, while Snap and Flatpak are asked
+// for their installed packages beside them; the window is usable once
+// the views are back, the unified list follows when everything is in
+void RGMainWindow::refreshAfterCommit(const string &selections)
+{
+   // never freed, like the other window pools; the steps fan out
+   // through the manager's pool and must not wait inside it
+   static PolySynaptic::TaskPool *pool = new PolySynaptic::TaskPool(2);
+   PolySynaptic::TaskGraph graph(*pool, RGMainLoopDispatcher());
+   bool reopen = _config->FindB("Volatile::Download-Only", false) == false;
+
+   int cache = graph.add("reopen", PolySynaptic::TaskGraph::MAIN, [this, reopen]() {
+      if (!reopen)
+         return;
       // reset the cache
-      if (!me->_lister->openCache()) {
-         me->showErrors();
+      if (!_lister->openCache()) {
+         showErrors();
          exit(1);
       }
+      if (_backendManager)
+         _backendManager->invalidateUpdateCheck(PolySynaptic::BackendType::APT);
+   });
+
+   int marks = graph.add("selections", PolySynaptic::TaskGraph::MAIN, [this, selections]() {
+      // reread saved selections
+      ifstream in(selections.c_str());
+      if (!in != 0) {
+         _error->Error(_("Can't read %s"), selections.c_str());
+         _userDialog->showErrors();
+         return;
+      }
+      _lister->readSelections(in);
+      unlink(selections.c_str());
+   }, {cache});
+
+#ifdef HAVE_XAPIAN
+   // only spawns the indexer; the pkgcache it compares with is new
+   graph.add("xapian", PolySynaptic::TaskGraph::MAIN, [this]() {
+      xapianDoIndexUpdate(this);
+   }, {cache});
+#endif
+
+   int views = graph.add("views", PolySynaptic::TaskGraph::MAIN, [this]() {
+      setTreeLocked(FALSE);
+      refreshTable();
+      refreshSubViewList();
+      // what the watches saw was this commit, and is being reloaded
+      if (_backendManager)
+         _backendManager->checkExternalChanges();
+      setInterfaceLocked(FALSE);
+      updatePackageInfo(NULL);
+   }, {marks});
+
+   if (!_backendManager) {
+      graph.start();
+      return;
    }
-   // reread saved selections
-   ifstream in(file);
-   if (!in != 0) {
-      _error->Error(_("Can't read %s"), file);
-      me->_userDialog->showErrors();
+
+   // snap list and flatpak list, side by side, off the main loop; the
+   // sources pane counts are updated with them
+   PolySynaptic::BackendManager *manager = _backendManager;
+   int external = graph.add("external", PolySynaptic::TaskGraph::POOL, [manager]() {
+      PolySynaptic::BackendFilter filter;
+      filter.includeApt = false;
+      manager->revalidateInstalledPackages(filter);
+   });
+
+   // the catalog is current now, so this paints without asking again
+   graph.add("unified", PolySynaptic::TaskGraph::MAIN, [this]() {
+      loadUnifiedInstalledPackages();
+   }, {views, external});
+
+   graph.start();
+}
+
+void RGMainWindow::queuePlannedOperations(const PolySynaptic::Transaction &tx)
+{
+   // APT changes become marks, set in one action group, and the rest is
+   // queued; the summary then shows both before anything is committed
+   bool aptMarks = false;
+   for (const auto &op : tx.operations) {
+      if (op.backend != PolySynaptic::BackendType::APT)
+         continue;
+      _backendManager->queueOperation(op);
+      aptMarks = true;
+   }
+   if (aptMarks) {
+      _lister->unregisterObserver(this);
+      PolySynaptic::TransactionResult marked =
+         _backendManager->commitTransaction();
+      _lister->registerObserver(this);
+      if (!marked.success) {
+         string msg = _("Some APT changes could not be marked:\n");
+         for (const auto &err : marked.errors)
+            msg += "   " + err.first + ": " + err.second + "\n";
+         _userDialog->warning(msg.c_str());
+      }
+   }
+   for (const auto &op : tx.operations) {
+      if (op.backend != PolySynaptic::BackendType::APT)
+         _backendManager->queueOperation(op);
+   }
+   _backendManager->prefetchTransactionDetails();
+}
+
+// the marks the Synaptic commit carries out, as operations to journal;
+// dependencies are left for the resolver to bring in again, and
+// reinstalls have nothing to resume to
+static vector<PolySynaptic::Transaction::Operation>
+markedAptOperations(RPackageLister *lister)
+{
+   typedef PolySynaptic::Transaction::Operation Operation;
+   vector<Operation> ops;
+   for (int i = 0; i < lister->packagesSize(); i++) {
+      RPackage *pkg = lister->getPackage(i);
+      int flags = pkg->getFlags();
+      Operation op;
+      op.backend = PolySynaptic::BackendType::APT;
+      op.packageId = op.packageName = pkg->name();
+      if (flags & RPackage::FRemove) {
+         op.type = Operation::Type::REMOVE;
+         op.purge = (flags & RPackage::FPurge) != 0;
+      } else if ((flags & RPackage::FNewInstall) && !(flags & RPackage::FIsAuto)) {
+         op.type = Operation::Type::INSTALL;
+      } else if (flags & (RPackage::FUpgrade | RPackage::FDowngrade)) {
+         op.type = Operation::Type::UPDATE;
+      } else {
+         continue;
+      }
+      // a chosen version has to be chosen again
+      if (op.type != Operation::Type::REMOVE &&
+          (flags & (RPackage::FOverrideVersion | RPackage::FDowngrade)) &&
+          pkg->availableVersion() != NULL)
+         op.target = pkg->availableVersion();
+      ops.push_back(op);
+   }
+   return ops;
+}
+
+void RGMainWindow::resumeInterruptedTransaction()
+{
+   if (!_backendManager)
+      return;
+   PolySynaptic::Transaction left = _backendManager->getInterruptedTransaction();
+   if (left.empty())
+      return;
+
+   const unsigned int shown = 10;
+   string msg = _("Applying the last changes was interrupted before "
+                  "these were done:\n\n");
+   for (unsigned int i = 0; i < left.operations.size() && i < shown; i++) {
+      const PolySynaptic::Transaction::Operation &op = left.operations[i];
+      msg += "   " + op.packageName + " (" +
+             PolySynaptic::backendTypeToString(op.backend) + ")\n";
+   }
+   if (left.operations.size() > shown) {
+      gchar *more = g_strdup_printf(_("   and %u more\n"),
+                                    (unsigned int)(left.operations.size() - shown));
+      msg += more;
+      g_free(more);
+   }
+   msg += _("\nApply them now? What was already downloaded is not "
+            "downloaded again.");
+   if (!_userDialog->confirm(msg.c_str())) {
+      _backendManager->discardInterruptedTransaction();
       return;
    }
-   me->_lister->readSelections(in);
-   unlink(file);
-   g_free((void *)file);
 
+   setInterfaceLocked(TRUE);
+   queuePlannedOperations(left);
+   refreshTable();
+   setInterfaceLocked(FALSE);
+   cbProceedClicked(NULL, this);
+}
 
-   me->setTreeLocked(FALSE);
-   me->refreshTable();
-   me->refreshSubViewList();
-   me->setInterfaceLocked(FALSE);
-   me->updatePackageInfo(NULL);
+void RGMainWindow::commitBackendTransaction()
+{
+   if (!_backendManager || !_backendManager->hasQueuedOperations())
+      return;
+
+   setInterfaceLocked(TRUE);
+   setStatusText(_("Applying Snap and Flatpak changes..."));
+
+   // The backends report from their own threads; their latest message
+   // is shown from here while the main loop keeps running
+   mutex statusMutex;
+   string status;
+   auto done = std::async(std::launch::async, [&]() {
+      return _backendManager->commitTransaction(
+         [&](double, const string &message) {
+            lock_guard<mutex> lock(statusMutex);
+            status = message;
+            return true;
+         });
+   });
+   while (done.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+      {
+         lock_guard<mutex> lock(statusMutex);
+         double eta = _backendManager->getCommitEta();
+         if (!status.empty() && eta >= 1) {
+            gchar *text = g_strdup_printf(_("%s (%s remaining)"), status.c_str(),
+                                          TimeToStr((unsigned long)eta).c_str());
+            setStatusText(text);
+            g_free(text);
+         } else if (!status.empty())
+            setStatusText((char *)status.c_str());
+      }
+      RGFlushInterface();
+   }
+   PolySynaptic::TransactionResult result = done.get();
+
+   setInterfaceLocked(FALSE);
+   setStatusText((char *)result.getSummary().c_str());
+
+   if (!result.success) {
+      string msg = _("Some changes could not be applied:\n");
+      for (const auto &err : result.errors)
+         msg += "   " + err.first + ": " + err.second + "\n";
+      _userDialog->error(msg.c_str());
+   }
 }
 
 void RGMainWindow::cbShowWelcomeDialog(GtkWidget *self, void *data)
@@ -3184,7 +4387,10 @@ gboolean RGMainWindow::xapianDoSearch(void *data)
          if (_fastSearchCssProvider != NULL) {
             gtk_style_context_remove_provider(styleContext, GTK_STYLE_PROVIDER(_fastSearchCssProvider));
          }
-         me->_unifiedPackages.clear();
+         unsigned serial = ++me->_unifiedLoadSerial;
+         if (me->_backendManager)
+            me->_backendManager->cancelSearch();
+         me->_unifiedPublisher.publish(vector<PolySynaptic::PackageInfo>(), serial);
          me->updateUnifiedTreeView();
          me->setStatusText(const_cast<char*>(_("Enter search terms to search all package sources")));
       } else if (strlen(str) > 1) {
@@ -3205,11 +4411,13 @@ gboolean RGMainWindow::xapianDoSearch(void *data)
       // reset the color
       gtk_style_context_remove_provider(styleContext, GTK_STYLE_PROVIDER(_fastSearchCssProvider));
       // if the user has cleared the search, refresh the view
-      // Gtk-CRITICAL :: gtk_tree_view_unref_tree_helper: assertion `node != NULL' failed
-      // at us, see LP: #38397 for more information
-      gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), NULL);
+      me->detachPackageList();
       me->_lister->reapplyFilter();
       me->refreshTable();
+      for (auto &search : me->_allBackendsSearches) {
+         search.cancel();
+      }
+      me->_allBackendsSearches.clear();
       me->_unifiedSearchResults.clear();
       me->setBusyCursor(false);
    } else if(strlen(str) > 1) {
@@ -3217,7 +4425,7 @@ gboolean RGMainWindow::xapianDoSearch(void *data)
       // char searches tend to be very slow
       me->setBusyCursor(true);
       RGFlushInterface();
-      gtk_tree_view_set_model(GTK_TREE_VIEW(me->_treeView), NULL);
+      me->detachPackageList();
       me->refreshTable();
       // set color to a light yellow to make it more obvious that a search
       // is performed
@@ -3253,9 +4461,31 @@ void RGMainWindow::searchAllBackends(const string& query)
    options.searchDescriptions = true;
    options.maxResults = 100;  // Limit results per backend
 
-   // Search in background thread would be better, but for now do synchronously
-   _unifiedSearchResults = _backendManager->searchPackages(options, filter, nullptr);
+   // Search in the background; each backend's results are added as
+   // they arrive, on the main loop. This supersedes the previous query.
+   for (auto &search : _allBackendsSearches) {
+      search.cancel();
+   }
+   _allBackendsSearches.clear();
+   _unifiedSearchResults.clear();
+
+   for (PolySynaptic::BackendType type : {PolySynaptic::BackendType::SNAP,
+                                          PolySynaptic::BackendType::FLATPAK}) {
+      PolySynaptic::IAsyncPackageBackend *backend =
+         filter.includes(type) ? _backendManager->getAsyncBackend(type) : NULL;
+      if (backend == NULL)
+         continue;
+      _allBackendsSearches.push_back(backend->searchPackages(options,
+         [this, query](const vector<PolySynaptic::PackageInfo> &results) {
+            _unifiedSearchResults.insert(_unifiedSearchResults.end(),
+                                         results.begin(), results.end());
+            showAllBackendsCounts(query);
+         }));
+   }
+}
 
+void RGMainWindow::showAllBackendsCounts(const string& query)
+{
    // Log results
    int snapCount = 0, flatpakCount = 0;
    for (const auto& pkg : _unifiedSearchResults) {
@@ -3284,28 +4514,47 @@ void RGMainWindow::cbSearchEntryChanged(GtkWidget *edit, void *data)
       g_source_remove(me->_fastSearchEventID);
       me->_fastSearchEventID = -1;
    }
-   me->_fastSearchEventID = g_timeout_add(500, xapianDoSearch, me);
+
+   // The unified search runs off the main loop and supersedes itself,
+   // so it can afford a much shorter debounce; stop the previous
+   // query's subprocesses right away
+   int delay = 500;
+   if (me->_unifiedViewMode && me->_backendManager) {
+      me->_backendManager->cancelSearch();
+      delay = _config->FindI("Synaptic::UnifiedSearchDelay", 150);
+   }
+   me->_fastSearchEventID = g_timeout_add(delay, xapianDoSearch, me);
 }
 
 void RGMainWindow::cbUpdateClicked(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
 
+   me->reloadPackageInformation();
+}
+
+void RGMainWindow::reloadPackageInformation(const vector<string> &sources)
+{
    // need to delete dialogs, as they might have data pointing
    // to old stuff
-//xxx    delete me->_fmanagerWin;
-   me->_fmanagerWin = NULL;
+//xxx    delete _fmanagerWin;
+   _fmanagerWin = NULL;
 
-   RGFetchProgress *progress=me->_fetchProgress= new RGFetchProgress(me);
-   progress->setDescription(_("Downloading Package Information"),
-			    _("The repositories will be checked for new, removed "
-               "or upgraded software packages."));
+   RGFetchProgress *progress=_fetchProgress= new RGFetchProgress(this);
+   if (sources.empty())
+      progress->setDescription(_("Downloading Package Information"),
+                               _("The repositories will be checked for new, removed "
+                                 "or upgraded software packages."));
+   else
+      progress->setDescription(_("Downloading Package Information"),
+                               _("The changed repositories will be checked "
+                                 "for software packages."));
 
-   me->setStatusText(_("Reloading package information..."));
+   setStatusText(_("Reloading package information..."));
 
-   me->setInterfaceLocked(TRUE);
-   me->setTreeLocked(TRUE);
-   me->_lister->unregisterObserver(me);
+   setInterfaceLocked(TRUE);
+   setTreeLocked(TRUE);
+   _lister->unregisterObserver(this);
 
    // save to temporary file
    const gchar *file =
@@ -3313,66 +4562,96 @@ void RGMainWindow::cbUpdateClicked(GtkWidget *self, void *data)
    ofstream out(file);
    if (!out != 0) {
       _error->Error(_("Can't write %s"), file);
-      me->_userDialog->showErrors();
+      _userDialog->showErrors();
       return;
    }
-   me->_lister->writeSelections(out, false);
+   _lister->writeSelections(out, false);
 
    // update cache and forget about the previous new packages 
    // (only if no error occurred)
    string error;
-   if (!me->_lister->updateCache(progress,error)) {
-      RGGtkBuilderUserDialog dia(me,"update_failed");
+   if (!_lister->updateCache(progress, error, sources)) {
+      RGGtkBuilderUserDialog dia(this,"update_failed");
       GtkWidget *tv = GTK_WIDGET(gtk_builder_get_object(dia.getGtkBuilder(),
                                                         "textview"));
       GtkTextBuffer *tb = gtk_text_view_get_buffer(GTK_TEXT_VIEW(tv));
       gtk_text_buffer_set_text(tb, utf8(error.c_str()), -1);
       dia.run();
-   } else {
-      me->forgetNewPackages();
+   } else if (sources.empty()) {
+      // a reload of a few sources is not a full one, for the "new"
+      // packages and the update reminder
+      forgetNewPackages();
       _config->Set("Synaptic::update::last",time(NULL));
    }
    delete progress;
-   me->_fetchProgress=NULL;
+   _fetchProgress=NULL;
 
    // show errors and warnings (like the gpg failures for the package list)
-   me->showErrors();
+   showErrors();
+
+   // every index got an IMS hit: the open cache (and the marks) are
+   // still current, so skip the reopen and the view rebuild
+   if (!_lister->indexesChanged()) {
+      unlink(file);
+      g_free((void *)file);
+      setTreeLocked(FALSE);
+      setInterfaceLocked(FALSE);
+      setStatusText();
+      return;
+   }
 
-   if(!me->_lister->openCache()) {
-      me->showErrors();
+   if(!_lister->openCache()) {
+      showErrors();
       exit(1);
    }
+   if (_backendManager) {
+      _backendManager->invalidateUpdateCheck(PolySynaptic::BackendType::APT);
+      // new sections may have come with the indexes
+      _backendManager->refreshCategoryIndex();
+   }
    // reread saved selections
    ifstream in(file);
    if (!in != 0) {
       _error->Error(_("Can't read %s"), file);
-      me->_userDialog->showErrors();
+      _userDialog->showErrors();
       return;
    }
-   me->_lister->readSelections(in);
+   _lister->readSelections(in);
    unlink(file);
    g_free((void *)file);
 
+   // the new lists are loaded; the watches saw them come in
+   if (_backendManager)
+      _backendManager->checkExternalChanges();
+
    // check if the index needs to be rebuild
-   me->xapianDoIndexUpdate(me);
+   xapianDoIndexUpdate(this);
 
-   me->setTreeLocked(FALSE);
-   me->refreshTable();
-   me->refreshSubViewList();
-   me->setInterfaceLocked(FALSE);
-   me->setStatusText();
+   setTreeLocked(FALSE);
+   refreshTable();
+   refreshSubViewList();
+   setInterfaceLocked(FALSE);
+   setStatusText();
 }
 
 void RGMainWindow::cbFixBrokenClicked(GtkWidget *self, void *data)
 {
    RGMainWindow *me = (RGMainWindow *) data;
    RPackage *pkg = me->selectedPackage();
+   bool cancelled = false;
+   bool res = true;
 
-   bool res = me->_lister->fixBroken();
    me->setInterfaceLocked(TRUE);
+   // nothing to resolve when nothing is broken
+   if (!me->_lister->check())
+      res = me->resolveWithProgress(RPackageLister::RESOLVE_FIX_BROKEN,
+                                    _("Resolving dependency problems..."),
+                                    cancelled);
    me->refreshTable(pkg);
 
-   if (!res)
+   if (cancelled)
+      me->setStatusText();
+   else if (!res)
       me->setStatusText(_("Failed to resolve dependency problems!"));
    else
       me->setStatusText(_("Successfully fixed dependency problems"));
@@ -3448,10 +4727,17 @@ void RGMainWindow::cbUpgradeClicked(GtkWidget *self, void *data)
    RPackageLister::pkgState state;
    me->_lister->saveState(state);
 
-   if (dist_upgrade)
-      res = me->_lister->distUpgrade();
-   else
-      res = me->_lister->upgrade();
+   bool cancelled;
+   res = me->resolveWithProgress(dist_upgrade ?
+                                 RPackageLister::RESOLVE_DIST_UPGRADE :
+                                 RPackageLister::RESOLVE_UPGRADE,
+                                 _("Marking all available upgrades..."),
+                                 cancelled);
+   if (cancelled) {
+      me->setStatusText();
+      me->setInterfaceLocked(FALSE);
+      return;
+   }
 
    if(me->askStateChange(state))
    {
@@ -3793,6 +5079,7 @@ void RGMainWindow::unifiedPkgInstall(const PolySynaptic::PackageInfo& pkg)
 
    if (result.success) {
       setStatusText((char*)(_("Installed: ") + pkg.name).c_str());
+      _backendManager->invalidateUpdateCheck(pkg.backend);
       // Refresh the package list
       loadUnifiedInstalledPackages();
    } else {
@@ -3831,6 +5118,7 @@ void RGMainWindow::unifiedPkgRemove(const PolySynaptic::PackageInfo& pkg)
 
    if (result.success) {
       setStatusText((char*)(_("Removed: ") + pkg.name).c_str());
+      _backendManager->invalidateUpdateCheck(pkg.backend);
       // Refresh the package list
       loadUnifiedInstalledPackages();
    } else {
@@ -3926,22 +5214,28 @@ void RGMainWindow::selectToInstall(vector<string> packagenames)
    me->_lister->saveState(state);
    me->_lister->notifyCachePreChange();
 
-   for(unsigned int i=0;i<packagenames.size();i++) {
-      RPackage *newpkg = (RPackage *) me->_lister->getPackage(packagenames[i]);
-      if (newpkg) {
-	 // only install the package if it is not already installed or if
-	 // it is outdated
-	 if(!(newpkg->getFlags()&RPackage::FInstalled) ||
-	     (newpkg->getFlags()&RPackage::FOutdated)) {
-	    // actual action
-	    newpkg->setNotify(false);
-	    me->pkgInstallHelper(newpkg);
-	    newpkg->setNotify(true);
-	    //exclude.push_back(newpkg);
-	    instPkgs.push_back(newpkg);
+   {
+      RPackageLister::MarkBatch batch(me->_lister);
+      for(unsigned int i=0;i<packagenames.size();i++) {
+	 RPackage *newpkg = (RPackage *) me->_lister->getPackage(packagenames[i]);
+	 if (newpkg) {
+	    // only install the package if it is not already installed or if
+	    // it is outdated
+	    if(!(newpkg->getFlags()&RPackage::FInstalled) ||
+	       (newpkg->getFlags()&RPackage::FOutdated)) {
+	       // actual action
+	       newpkg->setNotify(false);
+	       me->pkgInstallHelper(newpkg, false);
+	       newpkg->setNotify(true);
+	       //exclude.push_back(newpkg);
+	       instPkgs.push_back(newpkg);
+	    }
 	 }
       }
    }
+   // once for every package, after the batch has resolved them
+   if (!me->_lister->check())
+      me->_lister->fixBroken();
 
    // ask for additional changes
    me->setBusyCursor(true);
@@ -4061,20 +5355,21 @@ void RGMainWindow::cbAddDownloadedFilesClicked(GtkWidget *self, void *data)
       me->_userDialog->error(_("Please select a directory"));
       return;
    }
-   // now read the dir for debs
+   // now read the dir for debs, and add them all in one go
    const gchar *file;
-   string pkgname;
+   vector<string> archives, pkgnames;
    stringstream pkgs;
    GDir *dir = g_dir_open(path, 0, NULL);
    while ( (file=g_dir_read_name(dir)) != NULL) {
-      if(g_pattern_match_simple("*_*.deb", file)) {
-	 if(me->_lister->addArchiveToCache(string(path)+"/"+string(file),
-					   pkgname))
-	    pkgs << pkgname << "\t install" << endl;
-      }
+      if(g_pattern_match_simple("*_*.deb", file))
+	 archives.push_back(string(path)+"/"+string(file));
    }
    g_dir_close(dir);
 
+   me->_lister->addArchivesToCache(archives, pkgnames);
+   for (const string &pkgname : pkgnames)
+      pkgs << pkgname << "\t install" << endl;
+
    // and set what we found as selection
    pkgs.seekg(0);
    if (pkgs.str() == "")
@@ -30,6 +30,7 @@
 using namespace std;
 
 #include "rpackagelister.h"
+#include "rselectioncounts.h"
 
 #include <gtk/gtk.h>
 #include <vector>
@@ -56,6 +57,7 @@ class RGFindWindow;
 class RGSetOptWindow;
 class RGAboutPanel;
 class RGBackendSettingsWindow;
+namespace PolySynaptic { class RGDebugPanel; }
 
 class RGUserDialog;
 class RGCacheProgress;
@@ -95,6 +97,8 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
 
    // Cached multi-backend search results
    vector<PolySynaptic::PackageInfo> _unifiedSearchResults;
+   vector<PolySynaptic::AsyncPackages> _allBackendsSearches;
+   void showAllBackendsCounts(const string& query);
 
    // Signal handler IDs for cleanup
    vector<gulong> _signalHandlerIds;
@@ -102,6 +106,67 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
 
    // Xapian index update tracking (to cancel on destruction)
    guint _xapianChildWatchId;
+#ifdef HAVE_XAPIAN
+   // the native rebuild, polled until it is done
+   RXapianIndexBuilder *_xapianBuilder;
+   guint _xapianBuildWatchId;
+   static gboolean xapianIndexBuildPoll(void *data);
+#endif
+
+   // thumbnails of the visible rows are fetched once scrolling settles
+   guint _thumbnailPrefetchId;
+   void queueThumbnailPrefetch();
+   static gboolean prefetchVisibleThumbnails(void *data);
+   static void cbPackageListScrolled(GtkAdjustment *adjustment, void *data);
+
+   // upgradable packages are checked in the background; this timer
+   // starts the checks that are due
+   guint _updateCheckId;
+   static gboolean pollUpdateChecks(void *data);
+
+   // changes other tools make to the installed packages are picked
+   // up from the backend manager's inotify watches
+   guint _externalChangesId;
+   static gboolean checkExternalChanges(void *data);
+
+   // background downloads of pending updates stop on a metered link
+   static void cbNetworkMetered(GObject *monitor, GParamSpec *pspec, void *data);
+
+   // the trimmable caches are dropped when the system runs low on
+   // memory; in low-memory mode at every warning
+   static void cbLowMemoryWarning(GObject *monitor, int level, void *data);
+
+   // the details of a selected Snap or Flatpak row are fetched off the
+   // main loop while its summary shows; moving the selection cancels
+   // the fetch, and one that finishes is shown only if its row is still
+   // the selected one
+   PolySynaptic::AsyncCall<PolySynaptic::PackageInfo> _detailsCall;
+   string _detailsKey;
+   PolySynaptic::PackageInfo _details;
+   bool _detailsFetched;
+   void fetchUnifiedDetails(const PolySynaptic::PackageInfo &pkg);
+   void cancelUnifiedDetails();
+
+   // the summary of the marks is worked out once marking settles, so
+   // the summary window opens with it at hand
+   guint _summaryPrecomputeId;
+   void queueSummaryPrecompute();
+   static gboolean precomputeSummary(void *data);
+
+   // the selected packages of the list by the actions they allow, kept
+   // up to date by cbSelectRow() as single rows come and go; GTK's own
+   // select-all and unselect-all do not ask it, so a count that does
+   // not match the selection's any more (or a cache reopen) lists the
+   // selection again in syncSelection()
+   RSelectionCounts _selection;
+   RPackage *_selectionLast;
+   unsigned long _selectionFlagsGeneration;
+   unsigned long _selectionCacheGeneration;
+   void syncSelection(GtkTreeSelection *selection);
+   unsigned int selectionActions();
+   static gboolean cbSelectRow(GtkTreeSelection *selection,
+                               GtkTreeModel *model, GtkTreePath *path,
+                               gboolean selected, void *data);
 
    // interface stuff
    GtkToolbarStyle _toolbarStyle; // hide, small, normal toolbar
@@ -146,6 +211,7 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    RGSetOptWindow *_setOptWin;
    RGAboutPanel *_aboutPanel;
    RGTasksWin *_tasksWin;
+   RTaskList *_taskList;
    RGIconLegendPanel *_iconLegendPanel;
    RGPkgDetailsWindow *_pkgDetails;
    RGLogView *_logView;
@@ -153,11 +219,31 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    RGFetchProgress *_fetchProgress;
    RGWindow *_installProgress;
    RGBackendSettingsWindow *_backendSettingsWin;
+   PolySynaptic::RGDebugPanel *_debugPanel;
 
    // PolySynaptic multi-backend support (unified view mode)
    RGUnifiedPkgList *_unifiedPkgList;
-   vector<PolySynaptic::PackageInfo> _unifiedPackages;
+   PolySynaptic::SnapshotPublisher _unifiedPublisher;  // Built off the main loop
+   PolySynaptic::MemoryAccount _unifiedMemoryAccount;
    bool _unifiedViewMode;  // true = unified view, false = legacy APT-only
+   unsigned _unifiedLoadSerial;  // Bumped whenever the unified list is replaced;
+                                 // the generation of what is published
+   PolySynaptic::BackendFilter _unifiedFetchFilter;  // Backends they came from
+
+   // Result of a search session, handed to the main loop
+   struct UnifiedSearchDelivery {
+      RGMainWindow *win;
+      unsigned serial;
+      uint64_t session;
+      bool partial;                 // One backend's results, more to come
+   };
+
+   // Result of a background catalog revalidation, handed to the main loop
+   struct UnifiedRevalidation {
+      RGMainWindow *win;
+      unsigned serial;
+      bool changed;                 // Published a revised list
+   };
 
    // fast search stuff
    int _fastSearchEventID;
@@ -193,6 +279,19 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    bool askStateChange(RPackageLister::pkgState, 
                        const vector<RPackage *> &exclude = vector<RPackage*>());
    bool checkForFailedInst(vector<RPackage *> instPkgs);
+   // the resolver run of kind on a worker, under a pulsing dialog whose
+   // Cancel undoes it once it is through (apt's resolver cannot stop
+   // halfway); false if it failed or was cancelled
+   bool resolveWithProgress(RPackageLister::ResolveKind kind,
+                            const char *what, bool &cancelled);
+   // the unmet dependencies of a failed package, filled in when its
+   // row in the unmet dialog is first expanded
+   static gboolean cbUnmetTestExpandRow(GtkTreeView *treeview,
+                                        GtkTreeIter *iter,
+                                        GtkTreePath *path, void *data);
+   // fetch the package information of every source, or of just those
+   // sources.list lines, and reopen the cache if it changed
+   void reloadPackageInformation(const vector<string> &sources = vector<string>());
    void pkgInstallHelper(RPackage *pkg, bool fixBroken = true, 
 			 bool reInstall = false);
    void pkgRemoveHelper(RPackage *pkg, bool purge = false,
@@ -202,6 +301,13 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    // PolySynaptic: Unified view package operations
    void unifiedPkgInstall(const PolySynaptic::PackageInfo& pkg);
    void unifiedPkgRemove(const PolySynaptic::PackageInfo& pkg);
+   // Commit the Snap and Flatpak operations queued in the manager
+   void commitBackendTransaction();
+   // Mark the APT operations of tx (in one action group) and queue the
+   // rest, for the summary to show before anything is committed
+   void queuePlannedOperations(const PolySynaptic::Transaction &tx);
+   // Reload everything a commit changed; see refreshAfterCommit()
+   void refreshAfterCommit(const string &selections);
    void buildUnifiedPopupMenu();
    PolySynaptic::PackageInfo* selectedUnifiedPackage();
 
@@ -247,6 +353,12 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
 
    void setInterfaceLocked(bool flag);
    void setTreeLocked(bool flag);
+
+   // take the package model off the tree view while all its rows are
+   // replaced, and give it back; the fixed-height view then rebuilds
+   // its rows in one pass instead of following row signals
+   void detachPackageList();
+   void attachPackageList();
    void rebuildTreeView() {
       buildTreeView();
    };
@@ -257,6 +369,8 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    void activeWindowToForeground();
 
    void saveState();
+   // offer to pick up the commit an earlier run did not finish
+   void resumeInterruptedTransaction();
    bool restoreState();
 
    bool showErrors();
@@ -307,6 +421,7 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    static void cbOpenClicked(GtkWidget *self, void *data);
    static void cbSaveClicked(GtkWidget *self, void *data);
    static void cbSaveAsClicked(GtkWidget *self, void *data);
+   static void cbApplyStateClicked(GtkWidget *self, void *data);
    string selectionsFilename;
    bool saveFullState;
    static void cbGenerateDownloadScriptClicked(GtkWidget *self, void *data);
@@ -341,10 +456,16 @@ class RGMainWindow : public RGGtkBuilderWindow, public RPackageObserver {
    static void cbShowSetOptWindow(GtkWidget *self, void *data);
    static void cbShowSourcesWindow(GtkWidget *self, void *data);
    static void cbShowBackendSettingsWindow(GtkWidget *self, void *data);
+   static void cbShowDebugPanel(GtkWidget *self, void *data);
    static void cbToggleUnifiedView(GtkWidget *self, void *data);
    void onBackendFilterChanged(const PolySynaptic::BackendFilter& filter);
+   void onUnifiedRefineChanged(const PolySynaptic::ResultQuery& query);
+   void onUnifiedCategoryChanged(int category);
+   void loadUnifiedCategory(PolySynaptic::Category category);
    void doUnifiedSearch(const string& query);
+   static gboolean applyUnifiedSearchResults(gpointer data);
    void loadUnifiedInstalledPackages();
+   static gboolean applyUnifiedRevalidation(gpointer data);
    void updateUnifiedTreeView();
    static void cbMenuToolbarClicked(GtkWidget *self, void *data);
 
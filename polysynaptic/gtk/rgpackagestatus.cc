@@ -28,6 +28,8 @@
 
 #include "rgutils.h"
 #include "rgpackagestatus.h"
+#include "rpackagelister.h"
+#include "rconfiguration.h"
 
 // RPackageStatus stuff
 RGPackageStatus RGPackageStatus::pkgStatus;
@@ -80,17 +82,42 @@ void RGPackageStatus::init()
 
    initColors();
    initPixbufs();
+   reloadPreferences();
 }
 
+void RGPackageStatus::reloadPreferences()
+{
+   _useStatusColors = RSettings().useStatusColors;
+}
+
+const RGPackageStatus::cachedStatus &RGPackageStatus::cached(RPackage *pkg)
+{
+   // generation 0 is never current, so new entries start out stale
+   unsigned int id = (*pkg->package())->ID;
+   if (id >= _cache.size()) {
+      cachedStatus none = { 0, 0, false };
+      _cache.resize(id + 1, none);
+   }
+
+   cachedStatus &entry = _cache[id];
+   unsigned long generation =
+      pkg->_lister != NULL ? pkg->_lister->getFlagsGeneration() : 0;
+   if (entry.generation != generation || generation == 0) {
+      entry.status = getStatus(pkg);
+      entry.supported = isSupported(pkg);
+      entry.generation = generation;
+   }
+   return entry;
+}
 
 GdkRGBA *RGPackageStatus::getBgColor(RPackage *pkg)
 {
-   return StatusColors[getStatus(pkg)];
+   return StatusColors[cached(pkg).status];
 }
 
 GdkPixbuf *RGPackageStatus::getSupportedPix(RPackage *pkg)
 {
-   if(isSupported(pkg))
+   if(cached(pkg).supported)
       return supportedPix;
    else
       return NULL;
@@ -98,7 +125,7 @@ GdkPixbuf *RGPackageStatus::getSupportedPix(RPackage *pkg)
 
 GdkPixbuf *RGPackageStatus::getPixbuf(RPackage *pkg)
 {
-   return StatusPixbuf[getStatus(pkg)];
+   return StatusPixbuf[cached(pkg).status];
 }
 
 void RGPackageStatus::setColor(int i, GdkRGBA * new_color)
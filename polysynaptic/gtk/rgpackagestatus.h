@@ -24,6 +24,8 @@
 #define _RGPACKAGESTATUS_H_
 
 
+#include <vector>
+
 #include "rpackage.h"
 #include "rpackagestatus.h"
 
@@ -34,6 +36,20 @@ class RGPackageStatus : public RPackageStatus {
 
    GdkPixbuf *supportedPix;
 
+   // Synaptic::UseStatusColors, read by reloadPreferences()
+   bool _useStatusColors;
+
+   // status and support of every package asked about, by package id;
+   // an entry is valid while its generation is the lister's flags
+   // generation
+   struct cachedStatus {
+      unsigned long generation;
+      signed char status;
+      bool supported;
+   };
+   vector<cachedStatus> _cache;
+   const cachedStatus &cached(RPackage *pkg);
+
    void initColors();
    void initPixbufs();
 
@@ -42,7 +58,11 @@ class RGPackageStatus : public RPackageStatus {
    static RGPackageStatus pkgStatus;
 
    virtual void init();
-   
+
+   // the colour preferences changed
+   void reloadPreferences();
+   bool useStatusColors() { return _useStatusColors; }
+
    // this is what the package listers use
    GdkRGBA *getBgColor(RPackage *pkg);
    GdkPixbuf *getSupportedPix(RPackage *pkg);
@@ -31,7 +31,15 @@
 #include "rpackage.h"
 #include "rgpackagestatus.h"
 #include "rgchangelogdialog.h"
+#include "rgimageloader.h"
 #include "sections_trans.h"
+#include "rconfiguration.h"
+#include "memoryusage.h"
+
+#include <apt-pkg/fileutl.h>
+
+// half the image loader, the rest is for the screenshot shown and slides
+static const unsigned int THUMBNAILS_DECODED_AHEAD = 4;
 
 RGPkgDetailsWindow::RGPkgDetailsWindow(RGWindow *parent)
    : RGGtkBuilderWindow(parent, "details")
@@ -71,6 +79,98 @@ RGPkgDetailsWindow::RGPkgDetailsWindow(RGWindow *parent)
                     G_CALLBACK(cbOpenLink), NULL);
 }
 
+PolySynaptic::MediaCache &RGPkgDetailsWindow::mediaCache()
+{
+   // never freed, a download still running must not hold up the exit
+   static PolySynaptic::MediaCache *cache = new PolySynaptic::MediaCache(
+      RStateDir() + "/media",
+      (uint64_t)_config->FindI("Synaptic::MediaCacheSize", 32) * 1024 * 1024,
+      RGFetchFile);
+   // the cache keeps files, not memory, so its bytes are reported on disk
+   static int memoryHandle = PolySynaptic::MemoryRegistry::instance().add(
+      "screenshot cache", [](PolySynaptic::MemoryUsage &usage) {
+         usage.bytes = cache->getSize();
+         usage.items = cache->getEntryCount();
+         usage.onDisk = true;
+      });
+   (void)memoryHandle;
+   return *cache;
+}
+
+struct MediaDelivery {
+   RGPkgDetailsWindow::MediaReady ready;
+   void *data;
+   string file;
+};
+
+static gboolean deliverMedia(gpointer data)
+{
+   MediaDelivery *job = (MediaDelivery *)data;
+   job->ready(job->file, job->data);
+   delete job;
+   return FALSE;
+}
+
+// media are kept per candidate version
+static string mediaVersion(RPackage *pkg)
+{
+   return pkg->availableVersion() != NULL ? pkg->availableVersion() : "";
+}
+
+void RGPkgDetailsWindow::requestMedia(PolySynaptic::MediaKind kind,
+                                      RPackage *pkg,
+                                      MediaReady ready, void *data)
+{
+   string version = mediaVersion(pkg);
+
+   string uri;
+   if (kind == PolySynaptic::MediaKind::CHANGELOG)
+      uri = pkg->getChangelogURI();
+   else
+      uri = pkg->getScreenshotURI(kind == PolySynaptic::MediaKind::THUMBNAIL);
+
+   // even a cached file goes through the main loop, so ready() never
+   // runs before the caller has set up its widgets
+   mediaCache().request(kind, pkg->name(), version, uri,
+                        PolySynaptic::TaskPriority::INTERACTIVE,
+                        [ready, data](const string &file) {
+      MediaDelivery *job = new MediaDelivery;
+      job->ready = ready;
+      job->data = data;
+      job->file = file;
+      g_idle_add(deliverMedia, job);
+   });
+}
+
+string RGPkgDetailsWindow::partialMedia(PolySynaptic::MediaKind kind,
+                                        RPackage *pkg)
+{
+   return mediaCache().partialFile(kind, pkg->name(), mediaVersion(pkg));
+}
+
+void RGPkgDetailsWindow::prefetchThumbnails(const vector<RPackage *> &packages)
+{
+   for (unsigned int i = 0; i < packages.size(); i++) {
+      RPackage *pkg = packages[i];
+      mediaCache().prefetch(PolySynaptic::MediaKind::THUMBNAIL, pkg->name(),
+                            mediaVersion(pkg), pkg->getScreenshotURI(true));
+   }
+
+   // the thumbnails already on disk around the selection are decoded
+   // ahead too, as far as the image loader keeps them
+   unsigned int decoded = 0;
+   for (unsigned int i = 0; i < packages.size() &&
+        decoded < THUMBNAILS_DECODED_AHEAD; i++) {
+      string file = mediaCache().lookup(PolySynaptic::MediaKind::THUMBNAIL,
+                                        packages[i]->name(),
+                                        mediaVersion(packages[i]));
+      if (file.empty())
+         continue;
+      RGImageLoader::instance().preload(file, 0, 0);
+      decoded++;
+   }
+}
+
 void RGPkgDetailsWindow::cbCloseClicked(GtkWidget *self, void *data)
 {
    RGPkgDetailsWindow *me = static_cast<RGPkgDetailsWindow*>(data);
@@ -133,12 +233,46 @@ void RGPkgDetailsWindow::cbShowBigScreenshot(GtkWidget *box,
    doShowBigScreenshot(pkg);
 }
 
+// data is a referenced GtkImage showing a placeholder until now
+void RGPkgDetailsWindow::cbScreenshotReady(const string &file, void *data)
+{
+   GtkWidget *img = GTK_WIDGET(data);
+
+   // the window may have been closed in the meantime
+   if (gtk_widget_get_parent(img) == NULL) {
+      g_object_unref(img);
+      return;
+   }
+   if (file.empty()) {
+      gtk_image_set_from_icon_name(GTK_IMAGE(img), "image-missing",
+                                   GTK_ICON_SIZE_DIALOG);
+      g_object_unref(img);
+      return;
+   }
+
+   // decoding a full screenshot on the main loop shows, so the
+   // placeholder stays until a worker is done with it
+   RGImageLoader::instance().request(file, 0, 0, [img](GdkPixbuf *pixbuf) {
+      if (gtk_widget_get_parent(img) != NULL) {
+         if (pixbuf != NULL)
+            gtk_image_set_from_pixbuf(GTK_IMAGE(img), pixbuf);
+         else
+            gtk_image_set_from_icon_name(GTK_IMAGE(img), "image-missing",
+                                         GTK_ICON_SIZE_DIALOG);
+      }
+      if (pixbuf != NULL)
+         g_object_unref(pixbuf);
+      g_object_unref(img);
+   });
+}
+
 void RGPkgDetailsWindow::doShowBigScreenshot(RPackage *pkg)
 {
-   RGFetchProgress *status = new RGFetchProgress(NULL);;
-   pkgAcquire fetcher(status);
-   string filename = pkg->getScreenshotFile(&fetcher, false);
-   GtkWidget *img = gtk_image_new_from_file(filename.c_str());
+   GtkWidget *img = gtk_image_new_from_icon_name("image-loading",
+                                                 GTK_ICON_SIZE_DIALOG);
+   g_object_ref(img);
+   requestMedia(PolySynaptic::MediaKind::SCREENSHOT, pkg,
+                cbScreenshotReady, img);
    GtkWidget *win = gtk_dialog_new();
    gtk_window_set_default_size(GTK_WINDOW(win), 500, 400);
    gtk_dialog_add_button(GTK_DIALOG(win), _("_Close"), GTK_RESPONSE_CLOSE);
@@ -162,12 +296,13 @@ void RGPkgDetailsWindow::cbShowScreenshot(GtkWidget *button, void *data)
       // hide button
       gtk_widget_hide(button);
       
-      // get screenshot
-      RGFetchProgress *status = new RGFetchProgress(NULL);;
-      pkgAcquire fetcher(status);
-      string filename = si->pkg->getScreenshotFile(&fetcher);
+      // get screenshot, a placeholder shows until it's there
       GtkWidget *event = gtk_event_box_new();
-      GtkWidget *img = gtk_image_new_from_file(filename.c_str());
+      GtkWidget *img = gtk_image_new_from_icon_name("image-loading",
+                                                    GTK_ICON_SIZE_DIALOG);
+      g_object_ref(img);
+      requestMedia(PolySynaptic::MediaKind::THUMBNAIL, si->pkg,
+                   cbScreenshotReady, img);
       gtk_container_add(GTK_CONTAINER(event), img);
       g_signal_connect(G_OBJECT(event), "button_press_event", 
                        G_CALLBACK(cbShowBigScreenshot), 
@@ -210,6 +345,93 @@ gboolean RGPkgDetailsWindow::cbOpenHomepage(GtkWidget *button, void* data)
    return TRUE;
 }
 
+// which page a part of the details is on: the page that holds the widget
+static const struct {
+   int part;
+   const char *widget;
+} detailsParts[] = {
+   { RGPkgDetailsWindow::PART_COMMON, "textview_pkgcommon" },
+   { RGPkgDetailsWindow::PART_DESCRIPTION, "text_descr" },
+   { RGPkgDetailsWindow::PART_DEPENDS, "notebook_dep_tab" },
+   { RGPkgDetailsWindow::PART_FILES, "textview_files" },
+   { RGPkgDetailsWindow::PART_VERSIONS, "treeview_versions" },
+};
+
+static void freeLazyDetails(gpointer data)
+{
+   RGPkgDetailsWindow::LazyDetails *lazy =
+      (RGPkgDetailsWindow::LazyDetails *)data;
+   if (lazy->deferredId != 0)
+      g_source_remove(lazy->deferredId);
+   delete lazy;
+}
+
+// the main window shows the details in notebook_pkginfo, the
+// properties window in notebook_info
+static GtkNotebook *detailsNotebook(RGGtkBuilderWindow *me)
+{
+   GObject *notebook = gtk_builder_get_object(me->getGtkBuilder(),
+                                              "notebook_pkginfo");
+   if (notebook == NULL)
+      notebook = gtk_builder_get_object(me->getGtkBuilder(), "notebook_info");
+   return notebook != NULL ? GTK_NOTEBOOK(notebook) : NULL;
+}
+
+RGPkgDetailsWindow::LazyDetails *
+RGPkgDetailsWindow::lazyDetails(RGGtkBuilderWindow *me)
+{
+   GObject *builder = G_OBJECT(me->getGtkBuilder());
+   LazyDetails *lazy = (LazyDetails *)g_object_get_data(builder,
+                                                        "lazy-details");
+   if (lazy == NULL) {
+      lazy = new LazyDetails;
+      lazy->win = me;
+      lazy->pkg = NULL;
+      lazy->filled = 0;
+      lazy->serial = 0;
+      lazy->deferredId = 0;
+      g_object_set_data_full(builder, "lazy-details", lazy, freeLazyDetails);
+
+      GtkNotebook *notebook = detailsNotebook(me);
+      if (notebook != NULL)
+         g_signal_connect(G_OBJECT(notebook), "switch-page",
+                          G_CALLBACK(cbPageSwitched), lazy);
+   }
+   return lazy;
+}
+
+int RGPkgDetailsWindow::partsOnPage(RGGtkBuilderWindow *me, GtkWidget *page)
+{
+   GtkNotebook *notebook = detailsNotebook(me);
+   if (notebook == NULL)
+      return PART_ALL;
+   if (page == NULL)
+      page = gtk_notebook_get_nth_page(notebook,
+                                       gtk_notebook_get_current_page(notebook));
+   if (page == NULL)
+      return PART_ALL;
+
+   int parts = 0;
+   for (unsigned int i = 0; i < G_N_ELEMENTS(detailsParts); i++) {
+      GObject *widget = gtk_builder_get_object(me->getGtkBuilder(),
+                                               detailsParts[i].widget);
+      if (widget != NULL && (GTK_WIDGET(widget) == page ||
+                             gtk_widget_is_ancestor(GTK_WIDGET(widget), page)))
+         parts |= detailsParts[i].part;
+   }
+   return parts;
+}
+
+void RGPkgDetailsWindow::cbPageSwitched(GtkNotebook *notebook, GtkWidget *page,
+                                        guint nr, void *data)
+{
+   LazyDetails *lazy = (LazyDetails *)data;
+
+   // "switch-page" comes before the notebook changes its current page
+   if (lazy->pkg != NULL)
+      fillInParts(lazy, partsOnPage(lazy->win, page));
+}
+
 void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me, 
                                       RPackage *pkg,
 				      bool setTitle)
@@ -224,6 +446,64 @@ void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me,
       g_free(str);
    }
 
+   // only what is on screen now, the other pages follow when shown
+   LazyDetails *lazy = lazyDetails(me);
+   lazy->pkg = pkg;
+   lazy->filled = 0;
+   lazy->serial++;
+
+   // the labels and the description are cheap; dependencies, files and
+   // versions wait until the selection stops moving, so holding down a
+   // cursor key does not compute them for every row passed
+   int parts = partsOnPage(me, NULL);
+   fillInParts(lazy, parts & PART_CHEAP);
+   if (lazy->deferredId != 0) {
+      g_source_remove(lazy->deferredId);
+      lazy->deferredId = 0;
+   }
+   if (parts & ~PART_CHEAP)
+      lazy->deferredId = g_timeout_add(150, cbFillInDeferred, lazy);
+}
+
+gboolean RGPkgDetailsWindow::cbFillInDeferred(gpointer data)
+{
+   LazyDetails *lazy = (LazyDetails *)data;
+   lazy->deferredId = 0;
+   if (lazy->pkg != NULL)
+      fillInParts(lazy, partsOnPage(lazy->win, NULL));
+   return FALSE;
+}
+
+void RGPkgDetailsWindow::forgetPackage(RGGtkBuilderWindow *me)
+{
+   LazyDetails *lazy = lazyDetails(me);
+   lazy->pkg = NULL;
+   lazy->serial++;
+   if (lazy->deferredId != 0) {
+      g_source_remove(lazy->deferredId);
+      lazy->deferredId = 0;
+   }
+}
+
+void RGPkgDetailsWindow::fillInParts(LazyDetails *lazy, int parts)
+{
+   parts &= ~lazy->filled;
+   lazy->filled |= parts;
+
+   if (parts & PART_COMMON)
+      fillInCommon(lazy->win, lazy->pkg);
+   if (parts & PART_DESCRIPTION)
+      fillInDescription(lazy->win, lazy->pkg);
+   if (parts & PART_DEPENDS)
+      fillInDepends(lazy->win, lazy->pkg);
+   if (parts & PART_FILES)
+      fillInFiles(lazy);
+   if (parts & PART_VERSIONS)
+      fillInVersions(lazy->win, lazy->pkg);
+}
+
+void RGPkgDetailsWindow::fillInCommon(RGGtkBuilderWindow *me, RPackage *pkg)
+{
    char *pkg_summary = g_strdup_printf("%s\n%s",
 					     pkg->name(), pkg->summary());
    me->setTextView("textview_pkgcommon", pkg_summary, true);
@@ -255,7 +535,11 @@ void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me,
    me->setLabel("label_latest_size", pkg->availableInstalledSize());
    me->setLabel("label_latest_download_size", pkg->availablePackageSize());
    me->setLabel("label_source", pkg->srcPackage());
+}
 
+void RGPkgDetailsWindow::fillInDescription(RGGtkBuilderWindow *me,
+                                           RPackage *pkg)
+{
    // format description nicely and use emblems
    GtkWidget *textview;
    GtkTextBuffer *buf;
@@ -349,8 +633,10 @@ void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me,
    gtk_text_buffer_insert(buf, &it, "\n", 1);
    s = utf8(pkg->description());
    gtk_text_buffer_insert(buf, &it, s, -1);
-   
+}
 
+void RGPkgDetailsWindow::fillInDepends(RGGtkBuilderWindow *me, RPackage *pkg)
+{
    // build dependency lists
    vector<DepInformation> deps;
    deps = pkg->enumDeps();
@@ -366,20 +652,56 @@ void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me,
    
    // provides
    me->setTreeList("treeview_provides", pkg->provides());
+}
+
+// the file list is read by a worker, the text view gets it on the main
+// loop unless another package has been selected by then
+struct FileListDelivery {
+   RGPkgDetailsWindow::LazyDetails *lazy;
+   unsigned int serial;
+   string files;
+};
 
+gboolean RGPkgDetailsWindow::deliverFileList(gpointer data)
+{
+   FileListDelivery *job = (FileListDelivery *)data;
+   if (job->serial == job->lazy->serial)
+      job->lazy->win->setTextView("textview_files", job->files.c_str());
+   delete job;
+   return FALSE;
+}
 
-   // file list
+void RGPkgDetailsWindow::fillInFiles(LazyDetails *lazy)
+{
 #ifndef HAVE_RPM
+   RGGtkBuilderWindow *me = lazy->win;
    gtk_widget_show(GTK_WIDGET(gtk_builder_get_object
                               (me->getGtkBuilder(),
                                "scrolledwindow_filelist")));
-   me->setTextView("textview_files", pkg->installedFiles());
+   me->setTextView("textview_files", "");
+
+   // one worker is plenty, stale requests are dropped when delivered
+   static PolySynaptic::TaskPool *pool = new PolySynaptic::TaskPool(1);
+   string path = lazy->pkg->installedFilesPath();
+   unsigned int serial = lazy->serial;
+   pool->submit(PolySynaptic::TaskPriority::INTERACTIVE,
+                [lazy, serial, path]() {
+      FileListDelivery *job = new FileListDelivery;
+      job->lazy = lazy;
+      job->serial = serial;
+      job->files = RPackage::readInstalledFiles(path);
+      g_idle_add(deliverFileList, job);
+      return true;
+   });
 #endif
+}
 
+void RGPkgDetailsWindow::fillInVersions(RGGtkBuilderWindow *me, RPackage *pkg)
+{
    // versions
    gchar *str;
    vector<string> list;
-   vector<pair<string,string> > versions = pkg->getAvailableVersions();
+   const vector<pair<string,string> > &versions = pkg->getAvailableVersions();
    for(int i=0;i<versions.size();i++) {
       // TRANSLATORS: this the format of the available versions in 
       // the "Properties/Available versions" window
@@ -392,13 +714,6 @@ void RGPkgDetailsWindow::fillInValues(RGGtkBuilderWindow *me,
       g_free(str);
    }
    me->setTreeList("treeview_versions", list);
-
-   /*
-   g_signal_connect(gtk_builder_get_object
-                    (me->getGtkBuilder(), "combobox_depends"),
-                    "changed",
-                    G_CALLBACK(cbDependsMenuChanged), me);
-   */
 }
 
 void RGPkgDetailsWindow::cbDependsMenuChanged(GtkWidget *self, void *data)
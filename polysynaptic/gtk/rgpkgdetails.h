@@ -27,8 +27,31 @@
 #include <gtk/gtk.h>
 #include "rpackage.h"
 #include "rggtkbuilderwindow.h"
+#include "mediacache.h"
 
 class RGPkgDetailsWindow : public RGGtkBuilderWindow {
+
+ public:
+   // the parts of the details, each filled in when its page is shown
+   enum {
+      PART_COMMON = 1 << 0,        // labels, textview_pkgcommon
+      PART_DESCRIPTION = 1 << 1,
+      PART_DEPENDS = 1 << 2,       // dependencies, rdepends, provides
+      PART_FILES = 1 << 3,
+      PART_VERSIONS = 1 << 4,
+      PART_CHEAP = PART_COMMON | PART_DESCRIPTION,
+      PART_ALL = (1 << 5) - 1
+   };
+
+   // what a window shows and which parts of it are filled in already;
+   // kept on the window's GtkBuilder
+   struct LazyDetails {
+      RGGtkBuilderWindow *win;
+      RPackage *pkg;
+      int filled;
+      unsigned int serial;         // bumped for every new package
+      guint deferredId;
+   };
    
  protected:
    // used for the screenshot parameter passing
@@ -48,11 +71,45 @@ class RGPkgDetailsWindow : public RGGtkBuilderWindow {
    static gboolean cbOpenHomepage(GtkWidget *button, void *data);
    static gboolean cbOpenLink(GtkWidget *button, gchar *uri, void *data);
    static void doShowBigScreenshot(RPackage *pkg);
+   static void cbScreenshotReady(const string &file, void *data);
+
+   static LazyDetails *lazyDetails(RGGtkBuilderWindow *me);
+   // the parts on page, or on the current page if page is NULL
+   static int partsOnPage(RGGtkBuilderWindow *me, GtkWidget *page);
+   static void cbPageSwitched(GtkNotebook *notebook, GtkWidget *page,
+                              guint nr, void *data);
+   static gboolean cbFillInDeferred(gpointer data);
+   static void fillInParts(LazyDetails *lazy, int parts);
+   static void fillInCommon(RGGtkBuilderWindow *me, RPackage *pkg);
+   static void fillInDescription(RGGtkBuilderWindow *me, RPackage *pkg);
+   static void fillInDepends(RGGtkBuilderWindow *me, RPackage *pkg);
+   static void fillInFiles(LazyDetails *lazy);
+   static gboolean deliverFileList(gpointer data);
+   static void fillInVersions(RGGtkBuilderWindow *me, RPackage *pkg);
 
  public:
    RGPkgDetailsWindow(RGWindow *parent);
    static void fillInValues(RGGtkBuilderWindow *me, RPackage *pkg, 
 			    bool setTitle=false);
+   // no package is shown anymore, don't fill in pages for the old one
+   static void forgetPackage(RGGtkBuilderWindow *me);
+
+   // screenshots and changelogs, downloaded in the background
+   static PolySynaptic::MediaCache &mediaCache();
+
+   // get the screenshot, thumbnail or changelog of pkg without blocking;
+   // ready(file, data) is called from the main loop once it is there,
+   // with an empty file if the download failed
+   typedef void (*MediaReady)(const string &file, void *data);
+   static void requestMedia(PolySynaptic::MediaKind kind, RPackage *pkg,
+                            MediaReady ready, void *data);
+
+   // the file a requested download of pkg is being written to, for
+   // reading along; empty until it starts and once it is done
+   static string partialMedia(PolySynaptic::MediaKind kind, RPackage *pkg);
+
+   // start on the thumbnails of the packages the user is looking at
+   static void prefetchThumbnails(const vector<RPackage *> &packages);
    ~RGPkgDetailsWindow();
 };
 #endif
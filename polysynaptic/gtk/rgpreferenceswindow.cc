@@ -327,6 +327,8 @@ void RGPreferencesWindow::saveColors()
    RGPackageStatus::pkgStatus.saveColors();
    newval = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(_optionUseStatusColors));
    _config->Set("Synaptic::UseStatusColors", newval ? "true" : "false");
+   RReloadSettings();
+   RGPackageStatus::pkgStatus.reloadPreferences();
 }
 
 void RGPreferencesWindow::saveFiles()
@@ -479,6 +481,11 @@ void RGPreferencesWindow::clearCacheAction(GtkWidget *self, void *data)
    RGPreferencesWindow *me = (RGPreferencesWindow *) data;
 
    me->_lister->cleanPackageCache(true);
+
+   // and what the snap and flatpak backends keep unused
+   PolySynaptic::BackendManager *manager = me->_mainWin->getBackendManager();
+   if (manager != NULL)
+      manager->cleanCaches(PolySynaptic::RetentionPolicy::everything());
 }
 
 void RGPreferencesWindow::readGeneral()
@@ -28,12 +28,15 @@
 #include <apt-pkg/sourcelist.h>
 #include <glib.h>
 #include <cassert>
+#include <chrono>
+#include <future>
 
 #include <gdk/gdk.h>
 
 #include "rgrepositorywin.h"
 #include "rguserdialog.h"
 #include "rgutils.h"
+#include "mirrorprobe.h"
 #include "config.h"
 #include "i18n.h"
 
@@ -68,6 +71,7 @@ enum {
    SECTIONS_COLUMN,
    RECORD_COLUMN,
    DISABLED_COLOR_COLUMN,
+   VALIDATION_COLUMN,
    N_SOURCES_COLUMNS
 };
 
@@ -76,6 +80,54 @@ enum {
    COL_TYPE,
 };
 
+using PolySynaptic::SourceCheck;
+using PolySynaptic::SourceValidation;
+using PolySynaptic::SourceValidator;
+
+// outlives the editor, so closing it never waits for a check
+static SourceValidator &Validator()
+{
+   static SourceValidator validator;
+   return validator;
+}
+
+// the record as a sources.list line
+static string SourceLine(SourcesList::SourceRecord *rec)
+{
+   string line = rec->GetType();
+   if (rec->VendorID.empty() == false)
+      line += " [" + rec->VendorID + "]";
+   line += " " + rec->URI + " " + rec->Dist;
+   for (unsigned int J = 0; J < rec->NumSections; J++)
+      line += " " + rec->Sections[J];
+   return line;
+}
+
+static string ValidationText(const SourceValidation &result)
+{
+   gchar *text = NULL;
+   switch (result.status) {
+      case SourceValidation::Status::VALID:
+         text = g_strdup_printf(_("OK (%.0f ms)"), result.latencyMs);
+         break;
+      case SourceValidation::Status::UNREACHABLE:
+         text = g_strdup_printf(_("Unreachable: %s"), result.error.c_str());
+         break;
+      case SourceValidation::Status::NO_RELEASE:
+         text = g_strdup_printf(_("No Release file: %s"), result.error.c_str());
+         break;
+      case SourceValidation::Status::BAD_SIGNATURE:
+         text = g_strdup_printf(_("Not trusted: %s"), result.error.c_str());
+         break;
+      case SourceValidation::Status::UNCHECKED:
+         text = g_strdup_printf(_("Not checked: %s"), result.error.c_str());
+         break;
+   }
+   string out = text ? text : "";
+   g_free(text);
+   return out;
+}
+
 void RGRepositoryEditor::item_toggled(GtkCellRendererToggle *cell, 
 				       gchar *path_str, gpointer data)
 {
@@ -112,6 +164,10 @@ void RGRepositoryEditor::item_toggled(GtkCellRendererToggle *cell,
    gtk_list_store_set(GTK_LIST_STORE(model), &iter,
                       STATUS_COLUMN, toggle_item, -1);
 
+   SourcesList::SourceRecord *rec;
+   gtk_tree_model_get(model, &iter, RECORD_COLUMN, &rec, -1);
+   me->Validate(rec, toggle_item);
+
    me->_dirty = true;
 
    /* clean up */
@@ -121,7 +177,8 @@ void RGRepositoryEditor::item_toggled(GtkCellRendererToggle *cell,
 
 
 RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)
-   : RGGtkBuilderWindow(parent, "repositories"), _dirty(false)
+   : RGGtkBuilderWindow(parent, "repositories"), _dirty(false),
+     _checkTimeout(0)
 {
    //cout << "RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)"<<endl;
    assert(_win);
@@ -141,7 +198,8 @@ RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)
                                           G_TYPE_STRING,
                                           G_TYPE_STRING,
                                           G_TYPE_STRING,
-                                          G_TYPE_POINTER, GDK_TYPE_RGBA);
+                                          G_TYPE_POINTER, GDK_TYPE_RGBA,
+                                          G_TYPE_STRING);
 
    _sourcesListView = GTK_WIDGET(gtk_builder_get_object(_builder, "treeview_repositories"));
    gtk_tree_view_set_model(GTK_TREE_VIEW(_sourcesListView),
@@ -215,6 +273,16 @@ RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)
                                                      NULL);
    gtk_tree_view_append_column(GTK_TREE_VIEW(_sourcesListView), column);
 
+   // result of checking the changed entries
+   renderer = gtk_cell_renderer_text_new();
+   g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+   column = gtk_tree_view_column_new_with_attributes(_("Check"),
+                                                     renderer,
+                                                     "text", VALIDATION_COLUMN,
+                                                     NULL);
+   gtk_tree_view_column_set_expand(column, TRUE);
+   gtk_tree_view_append_column(GTK_TREE_VIEW(_sourcesListView), column);
+
    GtkTreeSelection *select;
    select = gtk_tree_view_get_selection(GTK_TREE_VIEW(_sourcesListView));
    gtk_tree_selection_set_mode(select, GTK_SELECTION_SINGLE);
@@ -372,6 +440,14 @@ RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)
                     G_CALLBACK(DoRemove), this);
    gtk_widget_set_sensitive(_deleteBut, FALSE);
 
+   _mirrorBut = GTK_WIDGET(gtk_builder_get_object(_builder,
+                                                  "button_fastest_mirror"));
+   assert(_mirrorBut);
+   g_signal_connect(_mirrorBut,
+                    "clicked",
+                    G_CALLBACK(DoFastestMirror), this);
+   gtk_widget_set_sensitive(_mirrorBut, FALSE);
+
    _editTable = GTK_WIDGET(gtk_builder_get_object(_builder, "table_edit"));
    assert(_editTable);
    gtk_widget_set_sensitive(_editTable, FALSE);
@@ -385,6 +461,8 @@ RGRepositoryEditor::RGRepositoryEditor(RGWindow *parent)
 RGRepositoryEditor::~RGRepositoryEditor()
 {
    //gtk_widget_destroy(_win);
+   if (_checkTimeout != 0)
+      g_source_remove(_checkTimeout);
    delete _userDialog;
 }
 
@@ -628,6 +706,117 @@ void RGRepositoryEditor::doEdit()
                       DISABLED_COLOR_COLUMN,
                       (rec->Type & SourcesList::Disabled ? &_gray : NULL), -1);
 
+   Validate(rec, status);
+}
+
+void RGRepositoryEditor::Validate(SourcesList::SourceRecord *rec, bool enabled)
+{
+   string line = SourceLine(rec);
+
+   // only entries that apt will fetch, and that differ from the saved
+   // list, are worth a check
+   bool wanted = enabled && rec->URI.empty() == false &&
+                 rec->Dist.empty() == false &&
+                 (rec->Type & (SourcesList::Deb | SourcesList::DebSrc)) != 0;
+   for (SourcesListIter it = _savedList.SourceRecords.begin();
+        wanted && it != _savedList.SourceRecords.end(); it++) {
+      if (((*it)->Type & (SourcesList::Comment | SourcesList::Disabled)) == 0 &&
+          SourceLine(*it) == line)
+         wanted = false;
+   }
+   if (!wanted) {
+      _pending.erase(rec);
+      _checked.erase(rec);
+      SetValidationText(rec, "");
+      return;
+   }
+
+   map<SourcesList::SourceRecord *, PendingCheck>::iterator pending =
+      _pending.find(rec);
+   if (pending != _pending.end() && pending->second.first == line)
+      return;
+   map<SourcesList::SourceRecord *, SourceCheckResult>::iterator checked =
+      _checked.find(rec);
+   if (checked != _checked.end() && checked->second.first == line) {
+      SetValidationText(rec, ValidationText(checked->second.second));
+      return;
+   }
+
+   SourceCheck check;
+   check.uri = rec->URI;
+   check.dist = rec->Dist;
+   check.options = rec->VendorID;
+   _checked.erase(rec);
+   _pending[rec] = PendingCheck(line, Validator().submit(check));
+   SetValidationText(rec, _("Checking..."));
+
+   if (_checkTimeout == 0)
+      _checkTimeout = g_timeout_add(200, PollValidation, this);
+}
+
+void RGRepositoryEditor::CollectValidation()
+{
+   map<SourcesList::SourceRecord *, PendingCheck>::iterator it = _pending.begin();
+   while (it != _pending.end()) {
+      future<SourceValidation> &done = it->second.second;
+      if (done.wait_for(chrono::seconds(0)) != future_status::ready) {
+         it++;
+         continue;
+      }
+      SourceValidation result = done.get();
+      _checked[it->first] = SourceCheckResult(it->second.first, result);
+      SetValidationText(it->first, ValidationText(result));
+      _pending.erase(it++);
+   }
+}
+
+gboolean RGRepositoryEditor::PollValidation(gpointer data)
+{
+   RGRepositoryEditor *me = (RGRepositoryEditor *) data;
+
+   me->CollectValidation();
+   if (me->_pending.empty()) {
+      me->_checkTimeout = 0;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+void RGRepositoryEditor::SetValidationText(SourcesList::SourceRecord *rec,
+                                           const string &text)
+{
+   GtkTreeModel *model = GTK_TREE_MODEL(_sourcesListStore);
+   GtkTreeIter iter;
+   for (gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
+        valid; valid = gtk_tree_model_iter_next(model, &iter)) {
+      SourcesList::SourceRecord *row;
+      gtk_tree_model_get(model, &iter, RECORD_COLUMN, &row, -1);
+      if (row == rec) {
+         gtk_list_store_set(_sourcesListStore, &iter,
+                            VALIDATION_COLUMN, utf8(text.c_str()), -1);
+         return;
+      }
+   }
+}
+
+vector<string> RGRepositoryEditor::ValidatedSources()
+{
+   vector<string> lines;
+   for (SourcesListIter it = _lst.SourceRecords.begin();
+        it != _lst.SourceRecords.end(); it++) {
+      if ((*it)->Type & (SourcesList::Comment | SourcesList::Disabled))
+         continue;
+      map<SourcesList::SourceRecord *, SourceCheckResult>::iterator checked =
+         _checked.find(*it);
+      if (checked == _checked.end() || checked->second.first != SourceLine(*it))
+         continue;
+      // one that could not be checked still needs the full reload
+      if (checked->second.second.status == SourceValidation::Status::UNCHECKED)
+         return vector<string>();
+      if (checked->second.second.status == SourceValidation::Status::VALID)
+         lines.push_back(checked->second.first);
+   }
+   return lines;
 }
 
 void RGRepositoryEditor::DoRemove(GtkWidget *, gpointer data)
@@ -644,6 +833,8 @@ void RGRepositoryEditor::DoRemove(GtkWidget *, gpointer data)
       gtk_tree_model_get(GTK_TREE_MODEL(me->_sourcesListStore), &iter, RECORD_COLUMN, &rec, -1);
       assert(rec);
 
+      me->_pending.erase(rec);
+      me->_checked.erase(rec);
       me->_lst.RemoveSource(rec);
       if (me->_lastIter != NULL)
 	gtk_tree_iter_free(me->_lastIter);
@@ -653,11 +844,113 @@ void RGRepositoryEditor::DoRemove(GtkWidget *, gpointer data)
    me->_dirty=true;
 }
 
+void RGRepositoryEditor::DoFastestMirror(GtkWidget *, gpointer data)
+{
+   RGRepositoryEditor *me = (RGRepositoryEditor *) data;
+   using PolySynaptic::MirrorProbe;
+   using PolySynaptic::MirrorResult;
+
+   if (me->_lastIter == NULL)
+      return;
+   me->doEdit();
+
+   SourcesList::SourceRecord *rec;
+   gtk_tree_model_get(GTK_TREE_MODEL(me->_sourcesListStore), me->_lastIter,
+                      RECORD_COLUMN, &rec, -1);
+   assert(rec);
+
+   // the current mirror competes with the listed ones; a listed mirror
+   // that does not carry this distribution fails its probe
+   vector<string> candidates;
+   candidates.push_back(rec->URI);
+   string listFile = _config->Find("Synaptic::MirrorList",
+                                   "/etc/polysynaptic/mirrors.list");
+   vector<string> listed = MirrorProbe::readMirrorList(listFile);
+   candidates.insert(candidates.end(), listed.begin(), listed.end());
+   if (listed.empty()) {
+      gchar *msg = g_strdup_printf(_("There are no mirrors to compare with.
+
+"
+                                     "List them one per line in %s."),
+                                   listFile.c_str());
+      me->_userDialog->message(msg, RUserDialog::DialogInfo);
+      g_free(msg);
+      return;
+   }
+
+   // kept between dialogs, so asking again within the hour is instant
+   static MirrorProbe probe;
+   string probePath = "dists/" + rec->Dist + "/InRelease";
+
+   me->setBusyCursor(true);
+   gtk_widget_set_sensitive(me->_win, FALSE);
+   future<vector<MirrorResult> > ranked =
+      async(launch::async, [&]() { return probe.probe(candidates, probePath); });
+   while (ranked.wait_for(chrono::milliseconds(50)) != future_status::ready)
+      RGFlushInterface();
+   vector<MirrorResult> results = ranked.get();
+   gtk_widget_set_sensitive(me->_win, TRUE);
+   me->setBusyCursor(false);
+
+   if (results.empty() || !results[0].healthy) {
+      me->_userDialog->message(_("None of the mirrors could be reached."),
+                               RUserDialog::DialogWarning);
+      return;
+   }
+   const MirrorResult &best = results[0];
+   if (best.uri == rec->URI) {
+      me->_userDialog->message(_("The current mirror is already the fastest."),
+                               RUserDialog::DialogInfo);
+      return;
+   }
+
+   gchar *msg = g_strdup_printf(_("The fastest mirror is %s "
+                                  "(%.0f ms, %.1f MB/s).
+
+"
+                                  "Use it for every repository on %s?"),
+                                best.uri.c_str(), best.firstByteMs,
+                                best.bytesPerSecond / 1e6, rec->URI.c_str());
+   bool replace = me->_userDialog->confirm(msg);
+   g_free(msg);
+   if (!replace)
+      return;
+
+   me->_lst.ReplaceURI(rec->URI, best.uri);
+   gtk_entry_set_text(GTK_ENTRY(me->_entryURI), utf8(rec->URI.c_str()));
+
+   /* repaint screen */
+   GtkTreeModel *model = GTK_TREE_MODEL(me->_sourcesListStore);
+   GtkTreeIter iter;
+   for (gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
+        valid; valid = gtk_tree_model_iter_next(model, &iter)) {
+      SourcesList::SourceRecord *row;
+      gtk_tree_model_get(model, &iter, RECORD_COLUMN, &row, -1);
+      gtk_list_store_set(me->_sourcesListStore, &iter,
+                         URI_COLUMN, utf8(row->URI.c_str()), -1);
+   }
+   me->_dirty = true;
+}
+
 void RGRepositoryEditor::DoOK(GtkWidget *, gpointer data)
 {
    RGRepositoryEditor *me = (RGRepositoryEditor *) data;
 
    me->doEdit();
+
+   // the checks still running decide which entries get updated
+   if (me->_pending.empty() == false) {
+      me->setBusyCursor(true);
+      gtk_widget_set_sensitive(me->_win, FALSE);
+      while (me->_pending.empty() == false) {
+         RGFlushInterface();
+         me->CollectValidation();
+         g_usleep(50000);
+      }
+      gtk_widget_set_sensitive(me->_win, TRUE);
+      me->setBusyCursor(false);
+   }
+
    me->_lst.UpdateSources();
 
    // check if we actually can parse the sources.list
@@ -693,6 +986,7 @@ void RGRepositoryEditor::SelectionChanged(GtkTreeSelection *selection,
    gtk_widget_set_sensitive(me->_upBut, TRUE);
    gtk_widget_set_sensitive(me->_downBut, TRUE);
    gtk_widget_set_sensitive(me->_deleteBut, TRUE);
+   gtk_widget_set_sensitive(me->_mirrorBut, TRUE);
    
    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
       me->doEdit();             // save the old row
@@ -742,6 +1036,7 @@ void RGRepositoryEditor::SelectionChanged(GtkTreeSelection *selection,
       gtk_widget_set_sensitive(me->_upBut, FALSE);
       gtk_widget_set_sensitive(me->_downBut, FALSE);
       gtk_widget_set_sensitive(me->_deleteBut, FALSE);
+      gtk_widget_set_sensitive(me->_mirrorBut, FALSE);
    }
 }
 
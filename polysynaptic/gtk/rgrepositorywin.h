@@ -32,6 +32,11 @@
 #include "rggtkbuilderwindow.h"
 
 #include "rguserdialog.h"
+#include "sourcevalidator.h"
+
+#include <future>
+#include <map>
+#include <vector>
 
 typedef list<SourcesList::SourceRecord *>::iterator SourcesListIter;
 typedef list<SourcesList::VendorRecord *>::iterator VendorsListIter;
@@ -59,6 +64,7 @@ class RGRepositoryEditor:RGGtkBuilderWindow {
    GtkWidget *_upBut;
    GtkWidget *_downBut;
    GtkWidget *_deleteBut;
+   GtkWidget *_mirrorBut;
 
    RGUserDialog *_userDialog;
 
@@ -66,14 +72,28 @@ class RGRepositoryEditor:RGGtkBuilderWindow {
    bool _dirty;
    GdkColor _gray;
 
+   // the sources added, enabled or edited are checked in the
+   // background, keyed by the line that was checked
+   typedef pair<string, future<PolySynaptic::SourceValidation> > PendingCheck;
+   typedef pair<string, PolySynaptic::SourceValidation> SourceCheckResult;
+   map<SourcesList::SourceRecord *, PendingCheck> _pending;
+   map<SourcesList::SourceRecord *, SourceCheckResult> _checked;
+   guint _checkTimeout;
+
    void UpdateVendorMenu();
    int VendorMenuIndex(string VendorID);
 
+   void Validate(SourcesList::SourceRecord *rec, bool enabled);
+   void CollectValidation();
+   void SetValidationText(SourcesList::SourceRecord *rec, const string &text);
+   static gboolean PollValidation(gpointer data);
+
    // static event handlers
    static void DoClear(GtkWidget *, gpointer);
    static void DoAdd(GtkWidget *, gpointer);
    static void DoUpDown(GtkWidget *, gpointer);
    static void DoRemove(GtkWidget *, gpointer);
+   static void DoFastestMirror(GtkWidget *, gpointer);
    static void DoOK(GtkWidget *, gpointer);
    static void DoCancel(GtkWidget *, gpointer);
    static void VendorsWindow(GtkWidget *, gpointer);
@@ -92,6 +112,11 @@ class RGRepositoryEditor:RGGtkBuilderWindow {
    ~RGRepositoryEditor();
 
    bool Run();
+
+   // the entries that passed their check, as sources.list lines, for
+   // an update of just those; none if a changed entry could not be
+   // checked
+   vector<string> ValidatedSources();
 };
 
 #endif
@@ -8,11 +8,12 @@
 #include <vector>
 
 #include "rgslideshow.h"
+#include "rgimageloader.h"
 
 using namespace std;
 
 RGSlideShow::RGSlideShow(GtkImage * image, string imgPath)
-: _image(image), _totalSteps(0), _currentStep(0)
+: _image(image), _totalSteps(0), _currentStep(0), _wanted(-1), _ticket(0)
 {
    DIR *dir = opendir(imgPath.c_str());
    struct dirent *entry;
@@ -22,10 +23,17 @@ RGSlideShow::RGSlideShow(GtkImage * image, string imgPath)
          if (entry->d_name[0] != '.')
             _imageFileList.push_back(imgPath + entry->d_name);
       }
+      closedir(dir);
    }
    sort(_imageFileList.begin(), _imageFileList.end());
 }
 
+RGSlideShow::~RGSlideShow()
+{
+   // the image goes with us, a slide still decoding must not reach it
+   RGImageLoader::instance().cancel(_ticket);
+}
+
 void RGSlideShow::step()
 {
    _currentStep += 1;
@@ -42,7 +50,24 @@ void RGSlideShow::refresh()
 	 if (current >= _imageFileList.size())
 	    current = _imageFileList.size() - 1;
       }
-      gtk_image_set_from_file(_image, _imageFileList[current].c_str());
+      // most steps stay on the same slide
+      if (current == _wanted)
+         return;
+      _wanted = current;
+
+      // decoded on a worker; the next slide is decoded ahead meanwhile
+      RGImageLoader &loader = RGImageLoader::instance();
+      loader.cancel(_ticket);
+      GtkImage *image = _image;
+      _ticket = loader.request(_imageFileList[current], 0, 0,
+                               [image](GdkPixbuf *pixbuf) {
+         if (pixbuf) {
+            gtk_image_set_from_pixbuf(image, pixbuf);
+            g_object_unref(pixbuf);
+         }
+      });
+      if (current + 1 < (int)_imageFileList.size())
+         loader.preload(_imageFileList[current + 1], 0, 0);
    }
 }
 
@@ -35,6 +35,11 @@ class RGSlideShow {
    int _currentStep;
    vector<string> _imageFileList;
 
+   // the slide asked for last, and its decode while it is on its way;
+   // the image keeps the one before until then
+   int _wanted;
+   unsigned _ticket;
+
  public:
 
    void step();
@@ -44,6 +49,7 @@ class RGSlideShow {
    };
 
    RGSlideShow(GtkImage * image, string imgPath);
+   ~RGSlideShow();
 };
 
 #endif
@@ -111,6 +111,23 @@ void RGSourcesPane::updateSource(const std::string& id, const SourceItem& source
     updateRowAppearance(id);
 }
 
+void RGSourcesPane::setCounts(const std::string& id, int installed,
+                              int upgradable, int available) {
+    auto rowIt = _sourceRows.find(id);
+    if (rowIt == _sourceRows.end()) return;
+
+    for (auto& source : _sources) {
+        if (source.id == id) {
+            source.installedCount = installed;
+            source.upgradableCount = upgradable;
+            source.packageCount = available;
+            gtk_label_set_text(GTK_LABEL(rowIt->second.countLabel),
+                               countText(source).c_str());
+            break;
+        }
+    }
+}
+
 std::vector<std::string> RGSourcesPane::getEnabledSources() const {
     std::vector<std::string> enabled;
 
@@ -231,9 +248,7 @@ GtkWidget* RGSourcesPane::createSourceRow(const SourceItem& source) {
     gtk_box_pack_start(GTK_BOX(row), rowData.nameLabel, TRUE, TRUE, 0);
 
     // Count label
-    std::ostringstream countText;
-    countText << "(" << source.installedCount << "/" << source.packageCount << ")";
-    rowData.countLabel = gtk_label_new(countText.str().c_str());
+    rowData.countLabel = gtk_label_new(countText(source).c_str());
     gtk_widget_set_opacity(rowData.countLabel, 0.6);
     gtk_box_pack_start(GTK_BOX(row), rowData.countLabel, FALSE, FALSE, 0);
 
@@ -277,6 +292,18 @@ GtkWidget* RGSourcesPane::createSourceRow(const SourceItem& source) {
     return row;
 }
 
+std::string RGSourcesPane::countText(const SourceItem& source) {
+    auto count = [](int n) { return n < 0 ? std::string("?") : std::to_string(n); };
+
+    std::ostringstream text;
+    text << "(" << count(source.installedCount) << "/" << count(source.packageCount);
+    if (source.upgradableCount > 0) {
+        text << ", " << source.upgradableCount << " updates";
+    }
+    text << ")";
+    return text.str();
+}
+
 void RGSourcesPane::updateRowAppearance(const std::string& id) {
     auto rowIt = _sourceRows.find(id);
     if (rowIt == _sourceRows.end()) return;
@@ -299,9 +326,7 @@ void RGSourcesPane::updateRowAppearance(const std::string& id) {
         GTK_TOGGLE_BUTTON(row.checkBox), source->enabled);
 
     // Update count
-    std::ostringstream countText;
-    countText << "(" << source->installedCount << "/" << source->packageCount << ")";
-    gtk_label_set_text(GTK_LABEL(row.countLabel), countText.str().c_str());
+    gtk_label_set_text(GTK_LABEL(row.countLabel), countText(*source).c_str());
 
     // Update status icon
     const char* statusIcon = getStatusIcon(source->available, row.loading,
@@ -33,8 +33,9 @@ struct SourceItem {
     std::string iconName;
     bool enabled = true;
     bool available = true;
-    int packageCount = 0;
+    int packageCount = 0;       // Negative counts are not known yet
     int installedCount = 0;
+    int upgradableCount = 0;
     std::string statusMessage;
 };
 
@@ -67,6 +68,13 @@ public:
      */
     void updateSource(const std::string& id, const SourceItem& source);
 
+    /**
+     * Update only a source's counts, as BackendManager reports them
+     * through its source counts callback; touches the count label alone
+     */
+    void setCounts(const std::string& id, int installed, int upgradable,
+                   int available);
+
     /**
      * Get enabled sources
      */
@@ -175,6 +183,9 @@ private:
     // Update row appearance
     void updateRowAppearance(const std::string& id);
 
+    // Text of a row's count label
+    static std::string countText(const SourceItem& source);
+
     // Signal handlers
     static void onCheckToggled(GtkToggleButton* button, gpointer data);
     static void onSettingsClicked(GtkButton* button, gpointer data);
@@ -37,10 +37,46 @@
 
 #include "rgsummarywindow.h"
 #include "rguserdialog.h"
+#include "backendmanager.h"
 
 #include "i18n.h"
 
 
+// One line on a queued Snap or Flatpak operation, as markup
+static gchar *describeBackendOp(const PolySynaptic::Transaction::Operation &op)
+{
+   using Type = PolySynaptic::Transaction::Operation::Type;
+   const char *name = op.packageName.c_str();
+   const char *target = op.target.c_str();
+
+   switch (op.type) {
+      case Type::INSTALL:
+         if (!op.target.empty())
+            return g_markup_printf_escaped(_("<b>%s</b> (<i>%s</i>) will be installed"),
+                                           name, target);
+         return g_markup_printf_escaped(_("<b>%s</b> will be installed"), name);
+      case Type::UPDATE:
+         if (!op.target.empty())
+            return g_markup_printf_escaped(_("<b>%s</b> will be moved to <i>%s</i>"),
+                                           name, target);
+         return g_markup_printf_escaped(_("<b>%s</b> will be upgraded"), name);
+      case Type::REMOVE:
+         if (op.purge)
+            return g_markup_printf_escaped(_("<b>%s</b> will be removed with its data"),
+                                           name);
+         return g_markup_printf_escaped(_("<b>%s</b> will be removed"), name);
+   }
+   return g_strdup(name);
+}
+
+int RGSummaryWindow::backendOpsCount(RGSummaryWindow *me)
+{
+   if (me->_backendOps == NULL)
+      return 0;
+   return me->_backendOps->operations.size() -
+      me->_backendOps->getOperationsForBackend(PolySynaptic::BackendType::APT).size();
+}
+
 void RGSummaryWindow::buildTree(RGSummaryWindow *me)
 {
    RPackageLister *lister = me->_lister;
@@ -194,6 +230,30 @@ void RGSummaryWindow::buildTree(RGSummaryWindow *me)
   }
 
 
+   // PolySynaptic: queued operations of the other backends, per backend
+   if (backendOpsCount(me) > 0) {
+      for (PolySynaptic::BackendType type : {PolySynaptic::BackendType::SNAP,
+                                             PolySynaptic::BackendType::FLATPAK}) {
+         vector<PolySynaptic::Transaction::Operation> ops =
+            me->_backendOps->getOperationsForBackend(type);
+         if (ops.empty())
+            continue;
+
+         gchar *title = g_strdup_printf(_("%s changes"),
+                                        PolySynaptic::backendTypeToString(type));
+         gtk_tree_store_append(me->_treeStore, &iter, NULL);
+         gtk_tree_store_set(me->_treeStore, &iter, PKG_COLUMN, title, -1);
+         g_free(title);
+
+         for (const auto &op : ops) {
+            gchar *line = describeBackendOp(op);
+            gtk_tree_store_append(me->_treeStore, &iter_child, &iter);
+            gtk_tree_store_set(me->_treeStore, &iter_child, PKG_COLUMN, line, -1);
+            g_free(line);
+         }
+      }
+   }
+
    if (held.size() > 0) {
       gtk_tree_store_append(me->_treeStore, &iter, NULL);
       gtk_tree_store_set(me->_treeStore, &iter,
@@ -300,6 +360,17 @@ void RGSummaryWindow::buildLabel(RGSummaryWindow *me)
        g_free(str);
    }
 
+   if (backendOpsCount(me) > 0) {
+      for (const auto &op : me->_backendOps->operations) {
+         if (op.backend == PolySynaptic::BackendType::APT)
+            continue;
+         str = describeBackendOp(op);
+         text += str;
+         text += "\n";
+         g_free(str);
+      }
+   }
+
    gtk_label_set_markup(GTK_LABEL(info), text.c_str());
 }
 
@@ -326,13 +397,15 @@ void RGSummaryWindow::clickedDetails(GtkWidget *self, void *data)
 }
 
 
-RGSummaryWindow::RGSummaryWindow(RGWindow *wwin, RPackageLister *lister)
+RGSummaryWindow::RGSummaryWindow(RGWindow *wwin, RPackageLister *lister,
+                                 const PolySynaptic::Transaction *backendOps)
 : RGGtkBuilderWindow(wwin, "summary")
 {
    GtkWidget *button;
 
    _potentialBreak = false;
    _lister = lister;
+   _backendOps = backendOps;
 
    setTitle(_("Summary"));
    //gtk_window_set_default_size(GTK_WINDOW(_win), 400, 250);
@@ -451,8 +524,16 @@ RGSummaryWindow::RGSummaryWindow(RGWindow *wwin, RPackageLister *lister)
       g_string_append_printf(msg, str, essential);
       _potentialBreak = true;
    }
+   int backendOps = backendOpsCount(this);
+   if (backendOps) {
+      char *str = ngettext("%d Snap or Flatpak change will be applied\n",
+                           "%d Snap and Flatpak changes will be applied\n",
+                           backendOps);
+      g_string_append_printf(msg, str, backendOps);
+   }
+
    // remove the trailing newline of msg
-   if (msg->str[msg->len - 1] == '\n')
+   if (msg->len > 0 && msg->str[msg->len - 1] == '\n')
       msg = g_string_truncate(msg, msg->len - 1);
 
    /* this stuff goes to the msg_space string */
@@ -465,6 +546,11 @@ RGSummaryWindow::RGSummaryWindow(RGWindow *wwin, RPackageLister *lister)
       sizeChange = -sizeChange;
    }
 
+   // snap and flatpak sizes the backends reported ahead of time
+   if (_backendOps != NULL) {
+      for (const auto &op : _backendOps->operations)
+         dlSize += op.downloadSize;
+   }
    g_string_append_printf(msg_space, _("\n%s have to be downloaded"),
                              SizeToStr(dlSize).c_str());
    
@@ -31,6 +31,10 @@
 
 class RPackageLister;
 
+namespace PolySynaptic {
+struct Transaction;
+}
+
 
 class RGSummaryWindow:public RGGtkBuilderWindow {
    GtkWidget *_topF;
@@ -39,6 +43,7 @@ class RGSummaryWindow:public RGGtkBuilderWindow {
    GtkWidget *_summarySpaceL;
    bool _potentialBreak;
    RPackageLister *_lister;
+   const PolySynaptic::Transaction *_backendOps;
    GtkWidget *_dlonlyB;
    GtkWidget *_checkSigsB;
 
@@ -52,9 +57,13 @@ class RGSummaryWindow:public RGGtkBuilderWindow {
    static void buildTree(RGSummaryWindow *me);
    static void buildLabel(RGSummaryWindow *me);
    static void clickedDetails(GtkWidget *w, void *data);
+   static int backendOpsCount(RGSummaryWindow *me);
 
  public:
-   RGSummaryWindow(RGWindow *win, RPackageLister *lister);
+   // backendOps, if given, are the Snap and Flatpak operations queued
+   // to run after the APT changes
+   RGSummaryWindow(RGWindow *win, RPackageLister *lister,
+                   const PolySynaptic::Transaction *backendOps = NULL);
 
    bool showAndConfirm();
 };
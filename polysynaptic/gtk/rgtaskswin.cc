@@ -125,14 +125,9 @@ void RGTasksWin::cbButtonDetailsClicked(GtkWidget *self, void *data)
    gtk_tree_model_get(GTK_TREE_MODEL(me->_store), &iter,
 		      TASK_NAME_COLUMN, &str, -1);
 
-   // ask tasksel about the selected task
-   string cmd = _config->Find("Synaptic::taskHelperProg", "/usr/bin/tasksel") + " --task-desc " + string(str);
-   string taskDescr;
-   char buf[255];
-   FILE *f=popen(cmd.c_str(), "r");
-   while(fgets(buf, 254, f) != NULL) {
-      taskDescr += string(buf);
-   }
+   // translated as tasksel --task-desc does
+   string taskDescr = dgettext("debian-tasks",
+                               me->_tasks->description(str).c_str());
 
    // display the result in a nice dialog
    RGGtkBuilderUserDialog dia(me, "task_descr");
@@ -205,8 +200,8 @@ void RGTasksWin::selection_changed_callback(GtkTreeSelection *selection,
 }
 
 
-RGTasksWin::RGTasksWin(RGWindow *parent) 
-   : RGGtkBuilderWindow(parent, "tasks")
+RGTasksWin::RGTasksWin(RGWindow *parent, RTaskList *tasks)
+   : RGGtkBuilderWindow(parent, "tasks"), _tasks(tasks)
 {
    _mainWin = (RGMainWindow *)parent;
    _detailsButton = GTK_WIDGET(gtk_builder_get_object(_builder,
@@ -220,35 +215,20 @@ RGTasksWin::RGTasksWin(RGWindow *parent)
 						     G_TYPE_STRING);
    
    // fiel in tasks
-   char buf[255];
-   gchar **strArray;
-   string cmd = _config->Find("Synaptic::taskHelperProg", "/usr/bin/tasksel") + " --list-tasks";
-   FILE *f = popen(cmd.c_str(),"r");
-
-   while(fgets(buf,254,f) != NULL) {
-      bool installed = false;
-
-      strArray = g_strsplit(buf, "\t", 2);
-      g_strstrip(strArray[1]);
-      if(strArray[0][0] == 'i')
-	 installed = true;
-
-      char *name = strArray[0];
-      name+=2;
-
+   const vector<RTaskList::Task> &list = _tasks->tasks();
+   for (unsigned int i = 0; i < list.size(); i++) {
+      const RTaskList::Task &task = list[i];
       GtkTreeIter iter;
       gtk_list_store_append (store, &iter);
       // you can't uninstall a task for now from synaptic, we make
       // tasks that are already installed insensitive
       gtk_list_store_set (store, &iter,
-			  TASK_CHECKBOX_COLUMN, installed,
-			  TASK_SENSITIVE_COLUMN, !installed,
-			  TASK_NAME_COLUMN, name,
-			  TASK_DESCR_COLUMN, strArray[1],
+			  TASK_CHECKBOX_COLUMN, task.installed,
+			  TASK_SENSITIVE_COLUMN, !task.installed,
+			  TASK_NAME_COLUMN, task.name.c_str(),
+			  TASK_DESCR_COLUMN, task.summary.c_str(),
 			  -1);
-      g_strfreev(strArray);
    }
-   pclose(f);
    GtkWidget *tree;
    GtkTreeSelection * select;
 
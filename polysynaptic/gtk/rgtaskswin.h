@@ -25,12 +25,14 @@
 #define _RGTASKSWIN_H_
 
 #include "rggtkbuilderwindow.h"
+#include "rtasklist.h"
 
 class RGMainWindow;
 
 class RGTasksWin : public RGGtkBuilderWindow {
  protected:
    RGMainWindow *_mainWin;
+   RTaskList *_tasks;
    GtkListStore *_store;
    GtkWidget *_taskView;
    GtkWidget *_detailsButton;
@@ -47,7 +49,7 @@ class RGTasksWin : public RGGtkBuilderWindow {
 
 
  public:
-   RGTasksWin(RGWindow *parent);
+   RGTasksWin(RGWindow *parent, RTaskList *tasks);
    virtual ~ RGTasksWin() {
    };
 };
@@ -0,0 +1,238 @@
+/* rgtermfeed.cc - Package manager output for the terminal widget
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+#include "config.h"
+
+#ifdef HAVE_TERMINAL
+
+#include "rgtermfeed.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <apt-pkg/configuration.h>
+
+// reads per wakeup at most, so a child that never stops printing does
+// not keep the main loop from the rest of its sources
+static const int MaxReads = 16;
+
+RGTermFeed::RGTermFeed(VteTerminal *term)
+   : _term(term), _master(-1), _channel(NULL), _watch(0), _frameTimeout(0),
+     _render(true), _lastOutput(0), _pendingLines(0)
+{
+   _scrollback = _config->FindI("Synaptic::TerminalScrollback", 10000);
+   vte_terminal_set_scrollback_lines(_term, _scrollback);
+
+   _commitHandler = g_signal_connect(_term, "commit",
+                                     G_CALLBACK(cbCommit), this);
+   _sizeHandler = g_signal_connect_after(_term, "size-allocate",
+                                         G_CALLBACK(cbSizeAllocate), this);
+}
+
+RGTermFeed::~RGTermFeed()
+{
+   if (_watch != 0)
+      g_source_remove(_watch);
+   if (_frameTimeout != 0)
+      g_source_remove(_frameTimeout);
+   if (_channel != NULL)
+      g_io_channel_unref(_channel);
+   g_signal_handler_disconnect(_term, _commitHandler);
+   g_signal_handler_disconnect(_term, _sizeHandler);
+}
+
+void RGTermFeed::attach(int master)
+{
+   _master = master;
+   fcntl(_master, F_SETFL, fcntl(_master, F_GETFL) | O_NONBLOCK);
+   updateSize();
+
+   _pending.clear();
+   _pendingLines = 0;
+   _lastOutput = time(NULL);
+
+   _channel = g_io_channel_unix_new(_master);
+   _watch = g_io_add_watch(_channel,
+                           (GIOCondition)(G_IO_IN | G_IO_HUP | G_IO_ERR),
+                           cbReadable, this);
+}
+
+void RGTermFeed::detach()
+{
+   if (_watch != 0) {
+      g_source_remove(_watch);
+      _watch = 0;
+      // whatever the child printed before it exited; a daemon it started
+      // may still hold the pty, so stop at the first empty read
+      while (readPty(true))
+         ;
+   }
+   if (_channel != NULL) {
+      g_io_channel_unref(_channel);
+      _channel = NULL;
+   }
+   if (_frameTimeout != 0) {
+      g_source_remove(_frameTimeout);
+      _frameTimeout = 0;
+   }
+   if (_render)
+      flush();
+   _master = -1;
+}
+
+void RGTermFeed::setRendering(bool render)
+{
+   _render = render;
+   if (_render) {
+      // bounded by the scrollback, so all of it in one go
+      flush();
+   } else if (_frameTimeout != 0) {
+      g_source_remove(_frameTimeout);
+      _frameTimeout = 0;
+   }
+}
+
+void RGTermFeed::write(const char *data, size_t size)
+{
+   while (_master >= 0 && size > 0) {
+      ssize_t n = ::write(_master, data, size);
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+      data += n;
+      size -= n;
+   }
+}
+
+bool RGTermFeed::readPty(bool all)
+{
+   char buf[64 * 1024];
+   bool more = true, got = false;
+   for (int reads = 0; all || reads < MaxReads; reads++) {
+      ssize_t n = read(_master, buf, sizeof(buf));
+      if (n > 0) {
+         _pending.append(buf, n);
+         _pendingLines += count(buf, buf + n, '\n');
+         got = true;
+         continue;
+      }
+      if (n < 0 && errno == EINTR)
+         continue;
+      // EIO once the last holder of the other side closed it
+      more = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+      break;
+   }
+   if (!got)
+      return all ? false : more;
+
+   _lastOutput = time(NULL);
+   trim();
+   if (_render && _frameTimeout == 0)
+      _frameTimeout = g_timeout_add(FrameMs, cbFrame, this);
+   return more;
+}
+
+void RGTermFeed::trim()
+{
+   // a negative scrollback is an unlimited one
+   if (_scrollback < 0)
+      return;
+
+   // what the terminal would have scrolled away anyway; cut with some
+   // slack, so a steady stream is not cut on every read
+   long keep = _scrollback + vte_terminal_get_row_count(_term);
+   if (_pendingLines <= keep + keep / 4)
+      return;
+
+   long drop = _pendingLines - keep;
+   size_t pos = 0;
+   while (drop > 0 && (pos = _pending.find('\n', pos)) != string::npos) {
+      pos++;
+      drop--;
+   }
+   _pending.erase(0, pos);
+   _pendingLines = keep;
+}
+
+void RGTermFeed::flush()
+{
+   if (_pending.empty())
+      return;
+   vte_terminal_feed(_term, _pending.data(), _pending.size());
+   _pending.clear();
+   _pendingLines = 0;
+}
+
+void RGTermFeed::updateSize()
+{
+   if (_master < 0)
+      return;
+
+   // the terminal has no pty of its own to tell
+   struct winsize size;
+   size.ws_row = vte_terminal_get_row_count(_term);
+   size.ws_col = vte_terminal_get_column_count(_term);
+   size.ws_xpixel = size.ws_ypixel = 0;
+   ioctl(_master, TIOCSWINSZ, &size);
+}
+
+gboolean RGTermFeed::cbReadable(GIOChannel *source, GIOCondition cond,
+                                gpointer data)
+{
+   RGTermFeed *me = (RGTermFeed *)data;
+
+   if (!me->readPty(false) || (cond & G_IO_ERR)) {
+      me->_watch = 0;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+gboolean RGTermFeed::cbFrame(gpointer data)
+{
+   RGTermFeed *me = (RGTermFeed *)data;
+
+   me->_frameTimeout = 0;
+   me->flush();
+   return FALSE;
+}
+
+void RGTermFeed::cbCommit(VteTerminal *term, gchar *text, guint size,
+                          gpointer data)
+{
+   RGTermFeed *me = (RGTermFeed *)data;
+   me->write(text, size);
+}
+
+void RGTermFeed::cbSizeAllocate(GtkWidget *widget, GdkRectangle *allocation,
+                                gpointer data)
+{
+   RGTermFeed *me = (RGTermFeed *)data;
+   me->updateSize();
+}
+
+#endif
+
+// vim:ts=3:sw=3:et
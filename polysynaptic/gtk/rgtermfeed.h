@@ -0,0 +1,105 @@
+/* rgtermfeed.h - Package manager output for the terminal widget
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ */
+
+
+#ifndef _RGTERMFEED_H_
+#define _RGTERMFEED_H_
+
+#include "config.h"
+
+#ifdef HAVE_TERMINAL
+
+#include <time.h>
+#include <string>
+
+#include <vte/vte.h>
+
+using namespace std;
+
+// Reads the pty of the package manager instead of handing it to the
+// terminal, and feeds the terminal what arrived at most once a frame, so
+// a maintainer script printing thousands of lines costs a redraw per
+// frame and not one per read. What the user types in the terminal goes
+// back to the pty.
+//
+// While not rendering (the terminal is collapsed) nothing is fed at all;
+// the output waits, cut down to what the scrollback could still show,
+// until rendering is turned back on.
+class RGTermFeed {
+ public:
+   // output reaching the terminal at most this often
+   static const unsigned int FrameMs = 1000 / 25;
+
+   // sets the terminal's scrollback from Synaptic::TerminalScrollback
+   RGTermFeed(VteTerminal *term);
+   ~RGTermFeed();
+
+   // start reading the master side of a pty, made nonblocking
+   void attach(int master);
+   // take what is still in the pty, feed everything and stop reading;
+   // the master stays open
+   void detach();
+
+   void setRendering(bool render);
+   bool rendering() const { return _render; }
+
+   // send to the child, as if typed in the terminal
+   void write(const char *data, size_t size);
+
+   // when the child last printed something, fed or not
+   time_t lastOutput() const { return _lastOutput; }
+
+ private:
+   VteTerminal *_term;
+   int _master;
+   GIOChannel *_channel;
+   guint _watch;
+   guint _frameTimeout;
+   gulong _commitHandler;
+   gulong _sizeHandler;
+   bool _render;
+   time_t _lastOutput;
+
+   // read but not fed yet, and how many lines it holds
+   string _pending;
+   long _pendingLines;
+   long _scrollback;
+
+   // false once the pty has nothing more to give; with all, once a read
+   // comes back empty
+   bool readPty(bool all);
+   void trim();
+   void flush();
+   void updateSize();
+
+   static gboolean cbReadable(GIOChannel *source, GIOCondition cond,
+                              gpointer data);
+   static gboolean cbFrame(gpointer data);
+   static void cbCommit(VteTerminal *term, gchar *text, guint size,
+                        gpointer data);
+   static void cbSizeAllocate(GtkWidget *widget, GdkRectangle *allocation,
+                              gpointer data);
+};
+
+#endif
+
+#endif
+
+// vim:ts=3:sw=3:et
@@ -70,7 +70,7 @@ RGTermInstallProgress::RGTermInstallProgress(RGMainWindow *main)
    _scrollbar = gtk_scrollbar_new (GTK_ORIENTATION_VERTICAL,
                                    gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(VTE_TERMINAL(_term))));
    gtk_widget_set_can_focus (_scrollbar, FALSE);
-   vte_terminal_set_scrollback_lines(VTE_TERMINAL(_term), 10000);
+   _feed = new RGTermFeed(VTE_TERMINAL(_term));
 
    const char *s;
    if(_config->FindB("Synaptic::useUserTerminalFont")) {
@@ -103,14 +103,18 @@ RGTermInstallProgress::RGTermInstallProgress(RGMainWindow *main)
       gtk_widget_hide(_closeOnF);
 }
 
+RGTermInstallProgress::~RGTermInstallProgress()
+{
+   delete _feed;
+}
 
-void RGTermInstallProgress::child_exited(VteTerminal *vteterminal,
-					gint ret,
+
+void RGTermInstallProgress::child_exited(GPid pid, gint status,
 					gpointer data)
 {
    RGTermInstallProgress *me = (RGTermInstallProgress*)data;
 
-   me->res = (pkgPackageManager::OrderResult)WEXITSTATUS(ret);
+   me->res = (pkgPackageManager::OrderResult)WEXITSTATUS(status);
    me->child_has_exited=true;
 }
 
@@ -121,10 +125,7 @@ void RGTermInstallProgress::startUpdate()
    gtk_widget_show_all(win);
 
    child_has_exited=false;
-   g_signal_connect(VTE_TERMINAL(_term), "child-exited",
-		    G_CALLBACK(child_exited),
-		    this);
- 
+
    show();
 
    gtk_label_set_markup(GTK_LABEL(_statusL), _("<i>Running...</i>"));
@@ -232,19 +233,10 @@ RGTermInstallProgress::start(pkgPackageManager *pm,
       res = pm->DoInstallPostFork(&progress);
       _exit(res);
    }
-   // parent: assign pty to the vte terminal
-   GError *err = NULL;
-   VtePty *pty = vte_pty_new_foreign_sync(master, NULL, &err);
-   if (err != NULL) {
-      std::cerr << "failed to create new pty: " << err->message << std::endl;
-      g_error_free (err);
-      return pkgPackageManager::Failed;
-   }
-
-   vte_terminal_set_pty(VTE_TERMINAL(_term), pty);
-   // FIXME: is there a race here? i.e. what if the child is dead before
-   //        we can set it?
-   vte_terminal_watch_child(VTE_TERMINAL(_term), _child_id);
+   // parent: the terminal gets what the child prints a frame at a time
+   _feed->attach(master);
+   // also reaps a child that is already gone
+   g_child_watch_add(_child_id, child_exited, this);
 
    startUpdate();
    // make sure that the child has really exited and we catched the
@@ -252,6 +244,7 @@ RGTermInstallProgress::start(pkgPackageManager *pm,
    while(!child_has_exited)
       updateInterface();
 
+   _feed->detach();
    finishUpdate();
 
    ::close(master);
@@ -261,12 +254,9 @@ RGTermInstallProgress::start(pkgPackageManager *pm,
 
 void RGTermInstallProgress::updateInterface()
 {    
-   if (gtk_events_pending()) {
-      while (gtk_events_pending()) gtk_main_iteration();
-   } else {
-      // 0.1 secs 
-      usleep(10000);
-   }
+   // sleeps until the pty, a timer, the child watch or the user has
+   // something for us
+   g_main_context_iteration(NULL, TRUE);
 }
 
 
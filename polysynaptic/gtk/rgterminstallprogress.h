@@ -29,6 +29,7 @@
 #include "rgmainwindow.h"
 #include "rinstallprogress.h"
 #include "rgwindow.h"
+#include "rgtermfeed.h"
 
 #include <vte/vte.h>
 
@@ -39,14 +40,14 @@ class RGTermInstallProgress : public RInstallProgress, public RGGtkBuilderWindow
   GtkWidget *_closeB;
   GtkWidget *_closeOnF;
   GtkWidget *_sock;
+  RGTermFeed *_feed;
 
   pkgPackageManager::OrderResult res;
   static gboolean zvtFocus (GtkWidget *widget, GdkEventButton *event, gpointer user_data);
 
 protected:
   bool child_has_exited;
-  static void child_exited(VteTerminal *vteterminal, gint ret,
-			   gpointer data);
+  static void child_exited(GPid pid, gint status, gpointer data);
   virtual void startUpdate();
   virtual void updateInterface();
   virtual void finishUpdate();
@@ -57,7 +58,7 @@ protected:
 
 public:
    RGTermInstallProgress(RGMainWindow *main);
-   ~RGTermInstallProgress() {};
+   ~RGTermInstallProgress();
 
    virtual pkgPackageManager::OrderResult start(pkgPackageManager *pm,
 		   				int numPackages = 0,
@@ -9,11 +9,18 @@
  */
 
 #include "rgunifiedview.h"
+#include "rgiconcache.h"
+#include "rgframetiming.h"
 #include "rgutils.h"
+#include "rparallel.h"
+#include "rsortcmp.h"
 
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
 
 // ============================================================================
 // Helper Functions
@@ -59,21 +66,26 @@ string format_size(long bytes)
 
 void get_backend_badge_color(BackendType backend, GdkRGBA* color)
 {
+    // Asked for every badge drawn, so parsed once
+    static const GdkRGBA colors[] = {
+        {0xA8 / 255.0, 0x00 / 255.0, 0x30 / 255.0, 1.0},   // APT: Debian red
+        {0xE9 / 255.0, 0x54 / 255.0, 0x20 / 255.0, 1.0},   // Snap: Ubuntu orange
+        {0x4A / 255.0, 0x90 / 255.0, 0xD9 / 255.0, 1.0},   // Flatpak: Flathub blue
+        {0x88 / 255.0, 0x88 / 255.0, 0x88 / 255.0, 1.0},
+    };
+
     switch (backend) {
         case BackendType::APT:
-            // Debian red
-            gdk_rgba_parse(color, "#A80030");
+            *color = colors[0];
             break;
         case BackendType::SNAP:
-            // Ubuntu orange
-            gdk_rgba_parse(color, "#E95420");
+            *color = colors[1];
             break;
         case BackendType::FLATPAK:
-            // Flathub blue
-            gdk_rgba_parse(color, "#4A90D9");
+            *color = colors[2];
             break;
         default:
-            gdk_rgba_parse(color, "#888888");
+            *color = colors[3];
             break;
     }
 }
@@ -91,16 +103,383 @@ G_DEFINE_TYPE_WITH_CODE(RGUnifiedPkgList, rg_unified_pkg_list, G_TYPE_OBJECT,
 
 static void rg_unified_pkg_list_init(RGUnifiedPkgList* list)
 {
+    list->snapshot = new PackageSnapshotPtr();
     list->packages = nullptr;
+    list->summaries = new unordered_map<gint, string>();
+    list->filled = new unordered_map<gint, PackageInfo>();
+    list->visible = new vector<gint>();
+    list->stamps = new vector<UnifiedRowStamp>();
+    list->row_of = new vector<gint>();
     list->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
     list->sort_order = GTK_SORT_ASCENDING;
     list->filter = BackendFilter::All();
+    list->results = new ResultFilter();
+    list->refine = new ResultQuery();
     list->manager = nullptr;
+
+    // The packages are the publisher's; the row tables and what was
+    // resolved of the packages are the model's
+    list->memory_handle = MemoryRegistry::instance().add("unified list model",
+        [list](MemoryUsage& usage) {
+            usage.bytes = list->visible->capacity() * sizeof(gint) +
+                          list->stamps->capacity() * sizeof(UnifiedRowStamp) +
+                          list->row_of->capacity() * sizeof(gint);
+            for (const auto& stamp : *list->stamps) {
+                usage.bytes += heapBytes(stamp.key);
+            }
+            for (const auto& summary : *list->summaries) {
+                usage.bytes += sizeof(summary) + heapBytes(summary.second);
+            }
+            for (const auto& filled : *list->filled) {
+                usage.bytes += sizeof(gint) + filled.second.memoryBytes();
+            }
+            usage.bytes += list->results->memoryBytes();
+            usage.items = list->visible->size();
+        });
+}
+
+static void rg_unified_pkg_list_finalize(GObject* object)
+{
+    RGUnifiedPkgList* list = RG_UNIFIED_PKG_LIST(object);
+
+    MemoryRegistry::instance().remove(list->memory_handle);
+    delete list->snapshot;
+    delete list->summaries;
+    delete list->filled;
+    delete list->visible;
+    delete list->stamps;
+    delete list->row_of;
+    delete list->results;
+    delete list->refine;
+
+    G_OBJECT_CLASS(rg_unified_pkg_list_parent_class)->finalize(object);
 }
 
 static void rg_unified_pkg_list_class_init(RGUnifiedPkgListClass* klass)
 {
-    // No special class initialization needed
+    G_OBJECT_CLASS(klass)->finalize = rg_unified_pkg_list_finalize;
+}
+
+// ============================================================================
+// Visible Row Table
+// ============================================================================
+
+// Visible row of a raw vector index, or -1 if the package is filtered out
+static gint visible_row_of(const RGUnifiedPkgList* list, gint raw_idx)
+{
+    const vector<gint>& row_of = *list->row_of;
+    if (raw_idx < 0 || raw_idx >= (gint)row_of.size()) return -1;
+    return row_of[raw_idx];
+}
+
+// Rebuild the display row of every raw index after visible changed
+static void index_rows(RGUnifiedPkgList* list)
+{
+    const vector<gint>& visible = *list->visible;
+    vector<gint>& row_of = *list->row_of;
+    row_of.assign(list->packages ? list->packages->size() : 0, -1);
+    for (gint row = 0; row < (gint)visible.size(); row++) {
+        row_of[visible[row]] = row;
+    }
+}
+
+// Below this many rows per thread a sort is not worth splitting
+static const unsigned int PARALLEL_SORT_MIN_ROWS = 8192;
+
+/**
+ * RowSortKey - One visible row as a sort sees it
+ *
+ * Small and flat, so the sort moves these and never PackageInfo
+ * structs; the name points into a table the sort owns.
+ */
+struct RowSortKey {
+    long key;                   // Backend, size or status
+    const char* name;           // Lowercased name, or a version
+    gint raw;                   // Index into the package vector
+};
+
+struct RowSortByRaw {
+    int operator()(const RowSortKey& x, const RowSortKey& y) const {
+        return x.raw - y.raw;
+    }
+};
+
+// The key, then the name, then the raw index, so the order is total
+// and the same every time
+typedef sortThen<sortByKey, sortThen<sortByName, RowSortByRaw>> RowSortCmp;
+
+/**
+ * Put raw indices into the order of a sort column
+ *
+ * The keys are gathered once, and large tables are sorted in parallel
+ * chunks. Descending reverses the whole comparison, ties included. An
+ * unsorted column leaves the indices ascending.
+ */
+static void sort_rows(const vector<PackageInfo>& packages,
+                      gint column, GtkSortType order,
+                      vector<gint>& visible)
+{
+    if (column < 0) {
+        // GTK_TREE_SORTABLE_UNSORTED/DEFAULT_SORT_COLUMN_ID
+        sort(visible.begin(), visible.end());
+        return;
+    }
+
+    vector<string> names(visible.size());
+    vector<RowSortKey> keys(visible.size());
+    for (size_t row = 0; row < visible.size(); row++) {
+        const PackageInfo& pkg = packages[visible[row]];
+        RowSortKey& key = keys[row];
+        switch (column) {
+            case UPKG_COL_BACKEND_BADGE:
+            case UPKG_COL_BACKEND_TYPE:
+                key.key = static_cast<long>(pkg.backend);
+                break;
+            case UPKG_COL_SIZE:
+                key.key = pkg.downloadSize;
+                break;
+            case UPKG_COL_STATUS:
+            case UPKG_COL_SUPPORTED_ICON:
+                key.key = static_cast<long>(pkg.installStatus);
+                break;
+            default:
+                key.key = 0;
+                break;
+        }
+        if (column == UPKG_COL_INSTALLED_VERSION) {
+            key.name = pkg.installedVersion.c_str();
+        } else if (column == UPKG_COL_AVAILABLE_VERSION) {
+            key.name = pkg.version.c_str();
+        } else {
+            names[row] = pkg.name;
+            for (char& c : names[row]) {
+                c = tolower((unsigned char)c);
+            }
+            key.name = names[row].c_str();
+        }
+        key.raw = visible[row];
+    }
+
+    if (order == GTK_SORT_DESCENDING) {
+        RParallelSort(keys, sortLess<sortReverse<RowSortCmp>>(), PARALLEL_SORT_MIN_ROWS);
+    } else {
+        RParallelSort(keys, sortLess<RowSortCmp>(), PARALLEL_SORT_MIN_ROWS);
+    }
+
+    for (size_t row = 0; row < keys.size(); row++) {
+        visible[row] = keys[row].raw;
+    }
+}
+
+// The refinement, with the backends the filter bar leaves out taken out
+static ResultQuery row_query(const RGUnifiedPkgList* list)
+{
+    ResultQuery query = *list->refine;
+    for (BackendType type : {BackendType::APT, BackendType::SNAP, BackendType::FLATPAK}) {
+        if (!list->filter.includes(type)) {
+            query.backends &= ~ResultQuery::backendBit(type);
+        }
+    }
+    query.backends &= ~ResultQuery::backendBit(BackendType::UNKNOWN);
+    return query;
+}
+
+static UnifiedRowStamp make_row_stamp(const PackageInfo& pkg)
+{
+    UnifiedRowStamp stamp;
+    stamp.key = pkg.id;
+    stamp.key += ':';
+    stamp.key += backendTypeToString(pkg.backend);
+
+    hash<string> h;
+    size_t state = h(pkg.name);
+    state = state * 31 + h(pkg.version);
+    state = state * 31 + h(pkg.installedVersion);
+    state = state * 31 + h(pkg.summary);
+    state = state * 31 + static_cast<size_t>(pkg.installStatus);
+    state = state * 31 + static_cast<size_t>(pkg.downloadSize);
+    stamp.state = state;
+    return stamp;
+}
+
+// The rows of list->packages as the filter, refinement and sort order
+// have them; the packages must be indexed in list->results
+static void build_rows(const RGUnifiedPkgList* list,
+                       vector<gint>& visible,
+                       vector<UnifiedRowStamp>& stamps)
+{
+    visible.clear();
+    stamps.clear();
+    if (!list->packages) return;
+
+    list->results->matches(row_query(list), visible);
+
+    sort_rows(*list->packages, list->sort_column_id, list->sort_order, visible);
+
+    stamps.reserve(visible.size());
+    for (gint raw_idx : visible) {
+        stamps.push_back(make_row_stamp((*list->packages)[raw_idx]));
+    }
+}
+
+static void emit_row_inserted(RGUnifiedPkgList* list, gint row, gint raw_idx)
+{
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    GtkTreeIter iter;
+    iter.stamp = 1;
+    iter.user_data = GINT_TO_POINTER(raw_idx);  // Store actual vector index
+    iter.user_data2 = nullptr;
+    iter.user_data3 = nullptr;
+
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(list), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_deleted(RGUnifiedPkgList* list, gint row)
+{
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(list), path);
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_changed(RGUnifiedPkgList* list, gint row, gint raw_idx)
+{
+    GtkTreePath* path = gtk_tree_path_new_from_indices(row, -1);
+    GtkTreeIter iter;
+    iter.stamp = 1;
+    iter.user_data = GINT_TO_POINTER(raw_idx);
+    iter.user_data2 = nullptr;
+    iter.user_data3 = nullptr;
+
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(list), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+/**
+ * RowDiff - Minimal signal plan between two visible row tables
+ *
+ * Rows are matched by package identity. A matched row is kept only if
+ * it stays in order with the previously kept row, so the plan never
+ * needs rows-reordered; anything else becomes a delete plus an insert.
+ */
+struct RowDiff {
+    vector<bool> oldKept;       // Per old row
+    vector<bool> newKept;       // Per new row
+    vector<gint> keptNewRow;    // Per old row, new position if kept
+    size_t kept = 0;
+
+    size_t cost(size_t oldCount, size_t newCount) const {
+        return (oldCount - kept) + (newCount - kept);
+    }
+};
+
+static RowDiff diff_rows(const vector<UnifiedRowStamp>& oldStamps,
+                         const vector<UnifiedRowStamp>& newStamps)
+{
+    RowDiff diff;
+    diff.oldKept.assign(oldStamps.size(), false);
+    diff.newKept.assign(newStamps.size(), false);
+    diff.keptNewRow.assign(oldStamps.size(), -1);
+
+    unordered_map<string, gint> newRowByKey;
+    newRowByKey.reserve(newStamps.size());
+    for (gint j = 0; j < (gint)newStamps.size(); j++) {
+        newRowByKey.emplace(newStamps[j].key, j);
+    }
+
+    gint lastKept = -1;
+    for (gint i = 0; i < (gint)oldStamps.size(); i++) {
+        auto it = newRowByKey.find(oldStamps[i].key);
+        if (it != newRowByKey.end() && it->second > lastKept) {
+            diff.oldKept[i] = true;
+            diff.newKept[it->second] = true;
+            diff.keptNewRow[i] = it->second;
+            lastKept = it->second;
+            diff.kept++;
+        }
+    }
+
+    return diff;
+}
+
+// Whether anything (normally a GtkTreeView) listens to row signals
+static bool has_row_listeners(RGUnifiedPkgList* list)
+{
+    static guint insertedId = g_signal_lookup("row-inserted", GTK_TYPE_TREE_MODEL);
+    static guint deletedId = g_signal_lookup("row-deleted", GTK_TYPE_TREE_MODEL);
+    static guint changedId = g_signal_lookup("row-changed", GTK_TYPE_TREE_MODEL);
+
+    return g_signal_has_handler_pending(list, insertedId, 0, FALSE) ||
+           g_signal_has_handler_pending(list, deletedId, 0, FALSE) ||
+           g_signal_has_handler_pending(list, changedId, 0, FALSE);
+}
+
+// Past this many signals a full model swap is cheaper than the diff
+static const size_t REATTACH_THRESHOLD = 2000;
+
+/**
+ * Switch the model to a new row table with as few signals as possible
+ *
+ * The caller has already pointed list->packages at the new data. When
+ * a view is given and the diff is both large and mostly churn, the
+ * model is detached from it and reattached instead of signalling.
+ */
+static void apply_rows(RGUnifiedPkgList* list,
+                       vector<gint>& newVisible,
+                       vector<UnifiedRowStamp>& newStamps,
+                       GtkTreeView* view)
+{
+    if (!has_row_listeners(list)) {
+        list->visible->swap(newVisible);
+        list->stamps->swap(newStamps);
+        index_rows(list);
+        return;
+    }
+
+    RowDiff diff = diff_rows(*list->stamps, newStamps);
+    size_t cost = diff.cost(list->stamps->size(), newStamps.size());
+
+    if (view && gtk_tree_view_get_model(view) == GTK_TREE_MODEL(list) &&
+        cost > REATTACH_THRESHOLD && cost > diff.kept) {
+        g_object_ref(list);
+        gtk_tree_view_set_model(view, nullptr);
+        list->visible->swap(newVisible);
+        list->stamps->swap(newStamps);
+        index_rows(list);
+        gtk_tree_view_set_model(view, GTK_TREE_MODEL(list));
+        g_object_unref(list);
+        return;
+    }
+
+    vector<UnifiedRowStamp> oldStamps;
+    oldStamps.swap(*list->stamps);
+
+    // Deletions from the end so earlier rows keep their positions
+    for (gint i = (gint)oldStamps.size() - 1; i >= 0; i--) {
+        if (!diff.oldKept[i]) {
+            emit_row_deleted(list, i);
+        }
+    }
+
+    list->visible->swap(newVisible);
+    list->stamps->swap(newStamps);
+    index_rows(list);
+
+    // Insertions in ascending order land every row at its final place
+    for (gint j = 0; j < (gint)list->visible->size(); j++) {
+        if (!diff.newKept[j]) {
+            emit_row_inserted(list, j, (*list->visible)[j]);
+        }
+    }
+
+    // Kept rows only need a redraw if their contents changed
+    for (gint i = 0; i < (gint)oldStamps.size(); i++) {
+        if (!diff.oldKept[i]) continue;
+        gint j = diff.keptNewRow[i];
+        if (oldStamps[i].state != (*list->stamps)[j].state) {
+            emit_row_changed(list, j, (*list->visible)[j]);
+        }
+    }
 }
 
 // TreeModel interface: Get column count
@@ -149,25 +528,13 @@ static gboolean rg_unified_pkg_list_get_iter(GtkTreeModel* model,
     if (depth != 1) return FALSE;
 
     gint visible_row = indices[0];
-    if (visible_row < 0) return FALSE;
-
-    // Find the nth visible package (same logic as iter_nth_child)
-    gint count = 0;
-    for (gint i = 0; i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (list->filter.includes(pkg.backend)) {
-            if (count == visible_row) {
-                iter->stamp = 1;
-                iter->user_data = GINT_TO_POINTER(i);
-                iter->user_data2 = nullptr;
-                iter->user_data3 = nullptr;
-                return TRUE;
-            }
-            count++;
-        }
-    }
+    if (visible_row < 0 || visible_row >= (gint)list->visible->size()) return FALSE;
 
-    return FALSE;
+    iter->stamp = 1;
+    iter->user_data = GINT_TO_POINTER((*list->visible)[visible_row]);
+    iter->user_data2 = nullptr;
+    iter->user_data3 = nullptr;
+    return TRUE;
 }
 
 // TreeModel interface: Get path from iterator
@@ -179,20 +546,54 @@ static GtkTreePath* rg_unified_pkg_list_get_path(GtkTreeModel* model,
     RGUnifiedPkgList* list = RG_UNIFIED_PKG_LIST(model);
     gint raw_idx = GPOINTER_TO_INT(iter->user_data);
 
-    // Count how many visible packages come before this one
-    gint visible_row = 0;
-    for (gint i = 0; i < raw_idx && i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (list->filter.includes(pkg.backend)) {
-            visible_row++;
-        }
-    }
+    gint visible_row = visible_row_of(list, raw_idx);
+    if (visible_row < 0) return nullptr;
 
     GtkTreePath* path = gtk_tree_path_new();
     gtk_tree_path_append_index(path, visible_row);
     return path;
 }
 
+// The model's own copy of a shown package, which its callers may
+// resolve; the snapshot's element is never written
+static PackageInfo& filled_package(RGUnifiedPkgList* list, gint idx)
+{
+    auto it = list->filled->find(idx);
+    if (it == list->filled->end()) {
+        PackageInfo copy = (*list->packages)[idx];
+        auto summary = list->summaries->find(idx);
+        if (summary != list->summaries->end()) {
+            copy.summary = summary->second;
+            copy.deferredFields &= ~PackageInfo::DEFER_SUMMARY;
+        }
+        it = list->filled->emplace(idx, std::move(copy)).first;
+    }
+    return it->second;
+}
+
+// APT leaves the summary to be read from its records on the first
+// request, so only rows actually shown pay for it
+static const string& row_summary(RGUnifiedPkgList* list, gint idx)
+{
+    const PackageInfo& pkg = (*list->packages)[idx];
+    if (!pkg.isDeferred(PackageInfo::DEFER_SUMMARY)) {
+        return pkg.summary;
+    }
+
+    auto filled = list->filled->find(idx);
+    if (filled != list->filled->end()) {
+        filled->second.resolve(PackageInfo::DEFER_SUMMARY);
+        return filled->second.summary;
+    }
+    auto it = list->summaries->find(idx);
+    if (it == list->summaries->end()) {
+        PackageInfo copy = pkg;
+        copy.resolve(PackageInfo::DEFER_SUMMARY);
+        it = list->summaries->emplace(idx, std::move(copy.summary)).first;
+    }
+    return it->second;
+}
+
 // TreeModel interface: Get value at iterator/column
 static void rg_unified_pkg_list_get_value(GtkTreeModel* model,
                                            GtkTreeIter* iter,
@@ -211,18 +612,26 @@ static void rg_unified_pkg_list_get_value(GtkTreeModel* model,
     switch (column) {
         case UPKG_COL_SUPPORTED_ICON:
             g_value_init(value, GDK_TYPE_PIXBUF);
-            // Load icon based on status
+            // Drawn once decoded; a blank of the same size until then
             {
                 const char* iconName = get_status_icon_name(pkg.installStatus);
-                GdkPixbuf* pixbuf = gtk_icon_theme_load_icon(
-                    gtk_icon_theme_get_default(),
-                    iconName, 16, GTK_ICON_LOOKUP_USE_BUILTIN, nullptr);
-                if (pixbuf) {
-                    g_value_take_object(value, pixbuf);
-                } else {
-                    // Fallback: set to NULL if icon not found
-                    g_value_set_object(value, nullptr);
+                RGIconCache& icons = RGIconCache::instance();
+                bool loading = false;
+                GdkPixbuf* pixbuf = icons.lookup(iconName, 16, 1, &loading);
+                if (!pixbuf && loading) {
+                    g_object_ref(list);
+                    icons.whenLoaded(iconName, 16, 1, [list, idx]() {
+                        gint row = list->packages ? visible_row_of(list, idx) : -1;
+                        if (row >= 0) {
+                            emit_row_changed(list, row, idx);
+                        }
+                        g_object_unref(list);
+                    });
+                }
+                if (!pixbuf) {
+                    pixbuf = icons.placeholder(16, 1);
                 }
+                g_value_take_object(value, pixbuf);
             }
             break;
 
@@ -248,7 +657,7 @@ static void rg_unified_pkg_list_get_value(GtkTreeModel* model,
 
         case UPKG_COL_DESCRIPTION:
             g_value_init(value, G_TYPE_STRING);
-            g_value_set_string(value, pkg.summary.c_str());
+            g_value_set_string(value, row_summary(list, idx).c_str());
             break;
 
         case UPKG_COL_SIZE:
@@ -263,9 +672,10 @@ static void rg_unified_pkg_list_get_value(GtkTreeModel* model,
 
         case UPKG_COL_PACKAGE_PTR:
             g_value_init(value, G_TYPE_POINTER);
-            // Return pointer to the actual element in the vector, not to local reference
-            // The vector is owned by the model and remains valid while the model exists
-            g_value_set_pointer(value, (gpointer)&((*list->packages)[idx]));
+            // The model's copy, valid until a snapshot that does not
+            // extend this one is set; callers may fill in its deferred
+            // fields
+            g_value_set_pointer(value, (gpointer)&filled_package(list, idx));
             break;
 
         case UPKG_COL_BACKEND_TYPE:
@@ -283,20 +693,13 @@ static gboolean rg_unified_pkg_list_iter_next(GtkTreeModel* model,
 
     if (!list->packages) return FALSE;
 
-    gint idx = GPOINTER_TO_INT(iter->user_data);
-    idx++;
-
-    // Skip filtered packages
-    while (idx < (gint)list->packages->size()) {
-        const PackageInfo& pkg = (*list->packages)[idx];
-        if (list->filter.includes(pkg.backend)) {
-            iter->user_data = GINT_TO_POINTER(idx);
-            return TRUE;
-        }
-        idx++;
-    }
+    // The raw index shown in the row below this one
+    const vector<gint>& visible = *list->visible;
+    gint row = visible_row_of(list, GPOINTER_TO_INT(iter->user_data));
+    if (row < 0 || row + 1 >= (gint)visible.size()) return FALSE;
 
-    return FALSE;
+    iter->user_data = GINT_TO_POINTER(visible[row + 1]);
+    return TRUE;
 }
 
 // TreeModel interface: Get first child
@@ -307,19 +710,11 @@ static gboolean rg_unified_pkg_list_iter_children(GtkTreeModel* model,
     RGUnifiedPkgList* list = RG_UNIFIED_PKG_LIST(model);
 
     if (parent != nullptr) return FALSE;  // Flat list, no children
-    if (!list->packages || list->packages->empty()) return FALSE;
-
-    // Find first non-filtered package
-    for (gint i = 0; i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (list->filter.includes(pkg.backend)) {
-            iter->stamp = 1;
-            iter->user_data = GINT_TO_POINTER(i);
-            return TRUE;
-        }
-    }
+    if (!list->packages || list->visible->empty()) return FALSE;
 
-    return FALSE;
+    iter->stamp = 1;
+    iter->user_data = GINT_TO_POINTER(list->visible->front());
+    return TRUE;
 }
 
 // TreeModel interface: Check if has children
@@ -338,15 +733,7 @@ static gint rg_unified_pkg_list_iter_n_children(GtkTreeModel* model,
     if (iter != nullptr) return 0;  // No children for rows
     if (!list->packages) return 0;
 
-    // Count non-filtered packages
-    gint count = 0;
-    for (const auto& pkg : *list->packages) {
-        if (list->filter.includes(pkg.backend)) {
-            count++;
-        }
-    }
-
-    return count;
+    return list->visible->size();
 }
 
 // TreeModel interface: Get nth child
@@ -359,22 +746,11 @@ static gboolean rg_unified_pkg_list_iter_nth_child(GtkTreeModel* model,
 
     if (parent != nullptr) return FALSE;
     if (!list->packages) return FALSE;
+    if (n < 0 || n >= (gint)list->visible->size()) return FALSE;
 
-    // Find nth non-filtered package
-    gint count = 0;
-    for (gint i = 0; i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (list->filter.includes(pkg.backend)) {
-            if (count == n) {
-                iter->stamp = 1;
-                iter->user_data = GINT_TO_POINTER(i);
-                return TRUE;
-            }
-            count++;
-        }
-    }
-
-    return FALSE;
+    iter->stamp = 1;
+    iter->user_data = GINT_TO_POINTER((*list->visible)[n]);
+    return TRUE;
 }
 
 // TreeModel interface: Get parent
@@ -429,9 +805,38 @@ static void rg_unified_pkg_list_set_sort_column_id(GtkTreeSortable* sortable,
 
     list->sort_column_id = sort_column_id;
     list->sort_order = order;
+    RGNoteViewChange("sort");
+
+    if (list->packages && !list->visible->empty()) {
+        vector<gint> sorted(*list->visible);
+        sort_rows(*list->packages, sort_column_id, order, sorted);
+
+        // new_order[new row] = old row, as rows-reordered wants it; the
+        // stamps travel with their rows
+        gint count = sorted.size();
+        vector<gint> new_order(count);
+        vector<UnifiedRowStamp> stamps(count);
+        bool moved = false;
+        for (gint row = 0; row < count; row++) {
+            gint old_row = (*list->row_of)[sorted[row]];
+            new_order[row] = old_row;
+            stamps[row] = std::move((*list->stamps)[old_row]);
+            moved = moved || old_row != row;
+        }
+
+        list->visible->swap(sorted);
+        list->stamps->swap(stamps);
+        index_rows(list);
+
+        // The rows keep their contents, so this is the only signal
+        if (moved) {
+            GtkTreePath* path = gtk_tree_path_new();
+            gtk_tree_model_rows_reordered(GTK_TREE_MODEL(list), path, nullptr,
+                                          new_order.data());
+            gtk_tree_path_free(path);
+        }
+    }
 
-    // TODO: Actually sort the data
-    // For now, emit signal so view updates
     gtk_tree_sortable_sort_column_changed(sortable);
 }
 
@@ -457,120 +862,105 @@ RGUnifiedPkgList* rg_unified_pkg_list_new(BackendManager* manager)
     return list;
 }
 
-void rg_unified_pkg_list_set_packages(RGUnifiedPkgList* list, vector<PackageInfo>* packages)
+// New rows after every existing visible row, from raw index first on;
+// the order of an unsorted list
+static void append_rows(RGUnifiedPkgList* list, gint first)
 {
-    GtkTreeModel* model = GTK_TREE_MODEL(list);
-
-    // If we had old data, emit row-deleted for all old rows first
-    if (list->packages && !list->packages->empty()) {
-        // Count old visible rows (respecting filter)
-        gint oldCount = 0;
-        for (const auto& pkg : *list->packages) {
-            if (list->filter.includes(pkg.backend)) {
-                oldCount++;
-            }
-        }
-        // Emit deletion signals in reverse order (required by GTK)
-        for (gint i = oldCount - 1; i >= 0; i--) {
-            GtkTreePath* path = gtk_tree_path_new_from_indices(i, -1);
-            gtk_tree_model_row_deleted(model, path);
-            gtk_tree_path_free(path);
-        }
-    }
-
-    // Set new packages
-    list->packages = packages;
-
-    // Emit row-inserted for all new visible rows
-    if (list->packages && !list->packages->empty()) {
-        gint visibleIdx = 0;
-        for (gint i = 0; i < (gint)list->packages->size(); i++) {
-            const PackageInfo& pkg = (*list->packages)[i];
-            if (list->filter.includes(pkg.backend)) {
-                GtkTreePath* path = gtk_tree_path_new_from_indices(visibleIdx, -1);
-                GtkTreeIter iter;
-                iter.stamp = 1;
-                iter.user_data = GINT_TO_POINTER(i);  // Store actual vector index
-                iter.user_data2 = nullptr;
-                iter.user_data3 = nullptr;
-
-                gtk_tree_model_row_inserted(model, path, &iter);
-                gtk_tree_path_free(path);
-                visibleIdx++;
-            }
+    ResultQuery query = row_query(list);
+    list->row_of->resize(list->packages->size(), -1);
+    for (gint i = first; i < (gint)list->packages->size(); i++) {
+        const PackageInfo& pkg = (*list->packages)[i];
+        if (list->results->includes(query, i)) {
+            (*list->row_of)[i] = list->visible->size();
+            list->visible->push_back(i);
+            list->stamps->push_back(make_row_stamp(pkg));
+            emit_row_inserted(list, list->visible->size() - 1, i);
         }
     }
 }
 
-void rg_unified_pkg_list_set_filter(RGUnifiedPkgList* list, const BackendFilter& filter)
+void rg_unified_pkg_list_set_packages(RGUnifiedPkgList* list,
+                                      PackageSnapshotPtr snapshot,
+                                      GtkTreeView* view)
 {
-    if (!list->packages || list->packages->empty()) {
-        list->filter = filter;
-        return;
+    // The stamps of the last signalled state are what the diff runs
+    // against, so the shown snapshot may go as soon as it is replaced
+    PackageSnapshotPtr shown = *list->snapshot;
+    bool extends = snapshot && shown && snapshot->extends(*shown);
+    gint first = shown ? shown->size() : 0;
+
+    *list->snapshot = snapshot;
+    list->packages = snapshot ? &snapshot->packages() : nullptr;
+    if (!extends) {
+        // Raw indices name other packages now
+        list->summaries->clear();
+        list->filled->clear();
     }
-
-    GtkTreeModel* model = GTK_TREE_MODEL(list);
-    BackendFilter oldFilter = list->filter;
-
-    // Calculate old visible count
-    gint oldCount = 0;
-    for (const auto& pkg : *list->packages) {
-        if (oldFilter.includes(pkg.backend)) {
-            oldCount++;
-        }
+    if (!snapshot) {
+        list->results->clear();
+    } else if (extends) {
+        list->results->append(*list->packages);
+    } else {
+        list->results->index(*list->packages);
     }
 
-    // Emit deletion signals for old visible rows (in reverse order)
-    for (gint i = oldCount - 1; i >= 0; i--) {
-        GtkTreePath* path = gtk_tree_path_new_from_indices(i, -1);
-        gtk_tree_model_row_deleted(model, path);
-        gtk_tree_path_free(path);
+    if (extends && list->sort_column_id < 0) {
+        append_rows(list, first);
+        return;
     }
 
-    // Apply new filter
+    // Sorted, the existing rows keep their relative order, so the
+    // diff of an extension is only the insertions at the sorted places
+    vector<gint> visible;
+    vector<UnifiedRowStamp> stamps;
+    build_rows(list, visible, stamps);
+    apply_rows(list, visible, stamps, extends ? nullptr : view);
+}
+
+PackageSnapshotPtr rg_unified_pkg_list_get_packages(RGUnifiedPkgList* list)
+{
+    return *list->snapshot;
+}
+
+void rg_unified_pkg_list_set_filter(RGUnifiedPkgList* list,
+                                    const BackendFilter& filter,
+                                    GtkTreeView* view)
+{
     list->filter = filter;
 
-    // Emit insertion signals for new visible rows
-    gint visibleIdx = 0;
-    for (gint i = 0; i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (filter.includes(pkg.backend)) {
-            GtkTreePath* path = gtk_tree_path_new_from_indices(visibleIdx, -1);
-            GtkTreeIter iter;
-            iter.stamp = 1;
-            iter.user_data = GINT_TO_POINTER(i);
-            iter.user_data2 = nullptr;
-            iter.user_data3 = nullptr;
-
-            gtk_tree_model_row_inserted(model, path, &iter);
-            gtk_tree_path_free(path);
-            visibleIdx++;
-        }
-    }
+    vector<gint> visible;
+    vector<UnifiedRowStamp> stamps;
+    build_rows(list, visible, stamps);
+    apply_rows(list, visible, stamps, view);
+}
+
+void rg_unified_pkg_list_set_refinement(RGUnifiedPkgList* list,
+                                        const ResultQuery& query,
+                                        GtkTreeView* view)
+{
+    if (*list->refine == query) return;
+    *list->refine = query;
+
+    vector<gint> visible;
+    vector<UnifiedRowStamp> stamps;
+    build_rows(list, visible, stamps);
+    apply_rows(list, visible, stamps, view);
+}
+
+gint rg_unified_pkg_list_n_visible(RGUnifiedPkgList* list)
+{
+    return list->visible->size();
 }
 
 void rg_unified_pkg_list_refresh(RGUnifiedPkgList* list)
 {
     if (!list->packages || list->packages->empty()) return;
 
-    GtkTreeModel* model = GTK_TREE_MODEL(list);
-
     // Emit row-changed for all visible rows to refresh the display
-    gint visibleIdx = 0;
-    for (gint i = 0; i < (gint)list->packages->size(); i++) {
-        const PackageInfo& pkg = (*list->packages)[i];
-        if (list->filter.includes(pkg.backend)) {
-            GtkTreePath* path = gtk_tree_path_new_from_indices(visibleIdx, -1);
-            GtkTreeIter iter;
-            iter.stamp = 1;
-            iter.user_data = GINT_TO_POINTER(i);
-            iter.user_data2 = nullptr;
-            iter.user_data3 = nullptr;
-
-            gtk_tree_model_row_changed(model, path, &iter);
-            gtk_tree_path_free(path);
-            visibleIdx++;
-        }
+    for (gint row = 0; row < (gint)list->visible->size(); row++) {
+        gint raw_idx = (*list->visible)[row];
+        (*list->stamps)[row] = make_row_stamp((*list->packages)[raw_idx]);
+        emit_row_changed(list, row, raw_idx);
     }
 }
 
@@ -578,6 +968,53 @@ void rg_unified_pkg_list_refresh(RGUnifiedPkgList* list)
 // RGBackendFilterBar
 // ============================================================================
 
+/**
+ * RefineChoice - One entry of a refinement combo and the values it keeps
+ */
+struct RefineChoice {
+    const char* label;
+    unsigned mask;
+};
+
+static const RefineChoice STATUS_CHOICES[] = {
+    { "Any status",     ResultQuery::STATUS_ANY },
+    { "Installed",      ResultQuery::STATUS_INSTALLED | ResultQuery::STATUS_UPDATABLE },
+    { "Updates",        ResultQuery::STATUS_UPDATABLE },
+    { "Not installed",  ResultQuery::STATUS_AVAILABLE },
+};
+
+static const RefineChoice CONFINEMENT_CHOICES[] = {
+    { "Any confinement", ResultQuery::CONFINEMENT_ANY },
+    { "Sandboxed",       ResultQuery::CONFINEMENT_STRICT },
+    { "Classic",         ResultQuery::CONFINEMENT_CLASSIC | ResultQuery::CONFINEMENT_DEVMODE },
+    { "Unconfined",      ResultQuery::CONFINEMENT_NONE },
+};
+
+static const RefineChoice TRUST_CHOICES[] = {
+    { "Any source",      ~0u },
+    { "Verified",        ResultQuery::trustBit(TrustLevel::VERIFIED) |
+                         ResultQuery::trustBit(TrustLevel::OFFICIAL) |
+                         ResultQuery::trustBit(TrustLevel::SYSTEM) },
+    { "Official",        ResultQuery::trustBit(TrustLevel::OFFICIAL) |
+                         ResultQuery::trustBit(TrustLevel::SYSTEM) },
+};
+
+static GtkWidget* refine_combo(const RefineChoice* choices, size_t count)
+{
+    GtkWidget* combo = gtk_combo_box_text_new();
+    for (size_t i = 0; i < count; i++) {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), choices[i].label);
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+    return combo;
+}
+
+static unsigned refine_mask(GtkWidget* combo, const RefineChoice* choices, size_t count)
+{
+    gint active = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+    return active >= 0 && (size_t)active < count ? choices[active].mask : choices[0].mask;
+}
+
 RGBackendFilterBar::RGBackendFilterBar(BackendManager* manager)
     : _manager(manager)
 {
@@ -607,6 +1044,32 @@ RGBackendFilterBar::RGBackendFilterBar(BackendManager* manager)
     g_signal_connect(_flatpakCheck, "toggled", G_CALLBACK(onToggled), this);
     gtk_box_pack_start(GTK_BOX(_container), _flatpakCheck, FALSE, FALSE, 0);
 
+    // Filter within results
+    _refineEntry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(_refineEntry), "Filter results");
+    gtk_entry_set_width_chars(GTK_ENTRY(_refineEntry), 14);
+    g_signal_connect(_refineEntry, "search-changed", G_CALLBACK(onRefineChanged), this);
+    gtk_box_pack_start(GTK_BOX(_container), _refineEntry, FALSE, FALSE, 0);
+
+    _statusCombo = refine_combo(STATUS_CHOICES, G_N_ELEMENTS(STATUS_CHOICES));
+    _confinementCombo = refine_combo(CONFINEMENT_CHOICES, G_N_ELEMENTS(CONFINEMENT_CHOICES));
+    _trustCombo = refine_combo(TRUST_CHOICES, G_N_ELEMENTS(TRUST_CHOICES));
+    for (GtkWidget* combo : {_statusCombo, _confinementCombo, _trustCombo}) {
+        g_signal_connect(combo, "changed", G_CALLBACK(onRefineChanged), this);
+        gtk_box_pack_start(GTK_BOX(_container), combo, FALSE, FALSE, 0);
+    }
+
+    // Browse by category, across every source
+    _categoryCombo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(_categoryCombo), "All categories");
+    for (unsigned c = 0; c < static_cast<unsigned>(Category::COUNT); c++) {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(_categoryCombo),
+                                       CategoryIndex::name(static_cast<Category>(c)));
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(_categoryCombo), 0);
+    g_signal_connect(_categoryCombo, "changed", G_CALLBACK(onCategoryChanged), this);
+    gtk_box_pack_start(GTK_BOX(_container), _categoryCombo, FALSE, FALSE, 0);
+
     updateAvailability();
 
     gtk_widget_show_all(_container);
@@ -658,6 +1121,40 @@ void RGBackendFilterBar::updateAvailability()
     }
 }
 
+ResultQuery RGBackendFilterBar::getRefinement() const
+{
+    ResultQuery query;
+    query.text = gtk_entry_get_text(GTK_ENTRY(_refineEntry));
+    query.statuses = refine_mask(_statusCombo, STATUS_CHOICES,
+                                 G_N_ELEMENTS(STATUS_CHOICES));
+    query.confinements = refine_mask(_confinementCombo, CONFINEMENT_CHOICES,
+                                     G_N_ELEMENTS(CONFINEMENT_CHOICES));
+    query.trusts = refine_mask(_trustCombo, TRUST_CHOICES,
+                               G_N_ELEMENTS(TRUST_CHOICES));
+    return query;
+}
+
+void RGBackendFilterBar::onRefineChanged(GtkWidget* widget, gpointer userData)
+{
+    RGBackendFilterBar* self = static_cast<RGBackendFilterBar*>(userData);
+    if (self->_refineCallback) {
+        self->_refineCallback(self->getRefinement());
+    }
+}
+
+int RGBackendFilterBar::getCategory() const
+{
+    return gtk_combo_box_get_active(GTK_COMBO_BOX(_categoryCombo)) - 1;
+}
+
+void RGBackendFilterBar::onCategoryChanged(GtkComboBox* combo, gpointer userData)
+{
+    RGBackendFilterBar* self = static_cast<RGBackendFilterBar*>(userData);
+    if (self->_categoryCallback) {
+        self->_categoryCallback(self->getCategory());
+    }
+}
+
 void RGBackendFilterBar::onToggled(GtkToggleButton* button, gpointer userData)
 {
     RGBackendFilterBar* self = static_cast<RGBackendFilterBar*>(userData);
@@ -706,6 +1203,10 @@ void RGBackendStatusBar::createStatusIcon(GtkWidget** widget, const char* iconNa
 
     gtk_box_pack_start(GTK_BOX(*widget), icon, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(*widget), text, FALSE, FALSE, 0);
+
+    // refresh() adds the update count to the name
+    g_object_set_data(G_OBJECT(*widget), "label", text);
+    g_object_set_data_full(G_OBJECT(*widget), "name", g_strdup(label), g_free);
 }
 
 void RGBackendStatusBar::updateStatusIcon(GtkWidget* widget, bool available, const string& tooltip)
@@ -736,6 +1237,17 @@ void RGBackendStatusBar::refresh()
             tooltip = status.unavailableReason;
         }
 
+        // From the last background check; never waits for the backend
+        string text = (const char*)g_object_get_data(G_OBJECT(widget), "name");
+        int updates = status.available ? _manager->getCachedUpgradeCount(status.type) : -1;
+        if (updates > 0) {
+            text += " (" + to_string(updates) + ")";
+            tooltip += "\n" + to_string(updates) +
+                       (updates == 1 ? " update available" : " updates available");
+        }
+        gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(widget), "label")),
+                           text.c_str());
+
         updateStatusIcon(widget, status.available, tooltip);
     }
 }
@@ -15,8 +15,11 @@
 #define _RGUNIFIEDVIEW_H_
 
 #include <gtk/gtk.h>
+#include <unordered_map>
 #include "rggtkbuilderwindow.h"
 #include "backendmanager.h"
+#include "packagesnapshot.h"
+#include "resultfilter.h"
 
 using namespace PolySynaptic;
 
@@ -46,24 +49,57 @@ enum UnifiedPkgListCols {
 #define RG_TYPE_UNIFIED_PKG_LIST (rg_unified_pkg_list_get_type())
 #define RG_UNIFIED_PKG_LIST(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), RG_TYPE_UNIFIED_PKG_LIST, RGUnifiedPkgList))
 
+/**
+ * UnifiedRowStamp - Identity and content hash of a displayed row
+ */
+struct UnifiedRowStamp {
+    string key;                 // id:backend
+    size_t state;               // Hash of the displayed fields
+};
+
 typedef struct _RGUnifiedPkgList RGUnifiedPkgList;
 typedef struct _RGUnifiedPkgListClass RGUnifiedPkgListClass;
 
 struct _RGUnifiedPkgList {
     GObject parent;
 
-    // Package data
-    vector<PackageInfo>* packages;
-
-    // Sorting
+    // Package data: the snapshot shown, and its packages
+    PackageSnapshotPtr* snapshot;
+    const vector<PackageInfo>* packages;
+
+    // What was resolved of the snapshot's deferred fields, by raw
+    // index: the summaries of the rows drawn, and whole copies of the
+    // packages handed out through UPKG_COL_PACKAGE_PTR. The model's
+    // own, on the main loop; kept while the shown snapshot extends
+    // the one they were read from
+    unordered_map<gint, string>* summaries;
+    unordered_map<gint, PackageInfo>* filled;
+
+    // Raw indices of the rows passing the filter in display order
+    // (ascending while unsorted), the stamps they had when last
+    // signalled, and the display row of every raw index (-1 if
+    // filtered out); kept in step by every update
+    vector<gint>* visible;
+    vector<UnifiedRowStamp>* stamps;
+    vector<gint>* row_of;
+
+    // Sorting; only the row tables are permuted, never the packages
     gint sort_column_id;
     GtkSortType sort_order;
 
     // Backend filter
     BackendFilter filter;
 
+    // Refinement within the fetched packages, answered from an index
+    // of them rebuilt whenever they are set
+    ResultFilter* results;
+    ResultQuery* refine;
+
     // Backend manager reference
     BackendManager* manager;
+
+    // MemoryRegistry handle of the row tables
+    int memory_handle;
 };
 
 struct _RGUnifiedPkgListClass {
@@ -73,11 +109,31 @@ struct _RGUnifiedPkgListClass {
 GType rg_unified_pkg_list_get_type();
 RGUnifiedPkgList* rg_unified_pkg_list_new(BackendManager* manager);
 
-// Set the package data to display
-void rg_unified_pkg_list_set_packages(RGUnifiedPkgList* list, vector<PackageInfo>* packages);
+// Show a package snapshot. Only the rows that differ from the
+// displayed ones are signalled; if a view is given and most rows
+// change, the model is detached from it and reattached instead. A
+// snapshot that extends the shown one only has its new packages
+// indexed, and while unsorted they are inserted after the others.
+void rg_unified_pkg_list_set_packages(RGUnifiedPkgList* list,
+                                      PackageSnapshotPtr snapshot,
+                                      GtkTreeView* view = nullptr);
+
+// The snapshot shown, or nullptr before the first
+PackageSnapshotPtr rg_unified_pkg_list_get_packages(RGUnifiedPkgList* list);
 
-// Set the backend filter
-void rg_unified_pkg_list_set_filter(RGUnifiedPkgList* list, const BackendFilter& filter);
+// Set the backend filter (same signalling rules as set_packages)
+void rg_unified_pkg_list_set_filter(RGUnifiedPkgList* list,
+                                    const BackendFilter& filter,
+                                    GtkTreeView* view = nullptr);
+
+// Narrow the rows to those of the packages the query keeps, without
+// fetching anything (same signalling rules as set_packages)
+void rg_unified_pkg_list_set_refinement(RGUnifiedPkgList* list,
+                                        const ResultQuery& query,
+                                        GtkTreeView* view = nullptr);
+
+// Number of packages shown out of those set
+gint rg_unified_pkg_list_n_visible(RGUnifiedPkgList* list);
 
 // Refresh the view
 void rg_unified_pkg_list_refresh(RGUnifiedPkgList* list);
@@ -85,7 +141,8 @@ void rg_unified_pkg_list_refresh(RGUnifiedPkgList* list);
 /**
  * RGBackendFilterBar - Backend filter toggle widget
  *
- * Provides checkboxes for enabling/disabling each backend in searches.
+ * Provides checkboxes for enabling/disabling each backend in searches,
+ * and the "filter within results" controls that narrow what was found.
  */
 class RGBackendFilterBar {
 public:
@@ -109,23 +166,50 @@ public:
         _changedCallback = callback;
     }
 
+    // Get the refinement within the results (text, status, confinement
+    // and trust); the backends are the filter's business
+    ResultQuery getRefinement() const;
+
+    // Set callback for refinement changes
+    void setRefineCallback(function<void(const ResultQuery&)> callback) {
+        _refineCallback = callback;
+    }
+
+    // Get the category picked to browse, -1 for none
+    int getCategory() const;
+
+    // Set callback for picking a category (-1 when set back to none)
+    void setCategoryCallback(function<void(int)> callback) {
+        _categoryCallback = callback;
+    }
+
 private:
     BackendManager* _manager;
     GtkWidget* _container;
     GtkWidget* _aptCheck;
     GtkWidget* _snapCheck;
     GtkWidget* _flatpakCheck;
+    GtkWidget* _refineEntry;
+    GtkWidget* _statusCombo;
+    GtkWidget* _confinementCombo;
+    GtkWidget* _trustCombo;
+    GtkWidget* _categoryCombo;
 
     function<void(const BackendFilter&)> _changedCallback;
+    function<void(const ResultQuery&)> _refineCallback;
+    function<void(int)> _categoryCallback;
 
     static void onToggled(GtkToggleButton* button, gpointer userData);
     void handleToggle();
+    static void onRefineChanged(GtkWidget* widget, gpointer userData);
+    static void onCategoryChanged(GtkComboBox* combo, gpointer userData);
 };
 
 /**
  * RGBackendStatusBar - Backend status indicator
  *
- * Shows the status of each backend with icons and tooltips.
+ * Shows the status of each backend with icons and tooltips, and the
+ * number of updates the background checks last found.
  */
 class RGBackendStatusBar {
 public:
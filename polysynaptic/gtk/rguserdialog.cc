@@ -231,25 +231,12 @@ void RGGtkBuilderUserDialog::init(const char *name)
 {
    gchar *main_widget = NULL;
    guint builder_status;
-   GError* error = NULL;
 
    //cerr << "RGGtkBuilderUserDialog::init() '" << name << "'" << endl;
 
    builder = gtk_builder_new();
-   std::string filename = std::string("gtkbuilder/dialog_")+name+std::string(".ui");
    main_widget = g_strdup_printf("dialog_%s", name);
-   if (FileExists(filename)) {
-      if (!gtk_builder_add_from_file (builder, filename.c_str(), &error)) {
-         g_warning ("Couldn't load builder file: %s", error->message);
-         g_error_free (error);
-      }
-   } else {
-      filename = std::string(SYNAPTIC_GTKBUILDERDIR "dialog_") + name + std::string(".ui");
-      if (!gtk_builder_add_from_file (builder, filename.c_str(), &error)) {
-         g_warning ("Couldn't load builder file: %s", error->message);
-         g_error_free (error);
-      }
-   }
+   RGAddBuilderFile(builder, std::string("dialog_") + name + ".ui");
    _dialog = GTK_WIDGET(gtk_builder_get_object(builder, main_widget));
    assert(_dialog);
    GdkPixbuf *icon = get_gdk_pixbuf( "polysynaptic" );
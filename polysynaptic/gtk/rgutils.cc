@@ -21,6 +21,7 @@
  */
 
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/acquire.h>
 
 #include <gdk/gdkx.h>
 #include <gtk/gtk.h>
@@ -34,24 +35,16 @@
 
 #include "i18n.h"
 #include "rgutils.h"
+#include "rgiconcache.h"
+#include "pkg_acqfile.h"
 
 
 // helper
 GdkPixbuf *
 get_gdk_pixbuf(const gchar *name, int size)
 {
-   GtkIconTheme *theme;
-   GdkPixbuf *pixbuf;
-   GError *error = NULL;
-
-   theme = gtk_icon_theme_get_default();
-   pixbuf = gtk_icon_theme_load_icon(theme, name, size, 
-				     (GtkIconLookupFlags)0, &error);
-   if (pixbuf == NULL) 
-      std::cerr << "Warning, failed to load: " << name 
-		<< error->message << std::endl;
-
-   return pixbuf;
+   // Shared with the package lists; warns itself on failure
+   return RGIconCache::instance().load(name, size);
 }
 
 GtkWidget *get_gtk_image(const gchar *name, int size)
@@ -111,6 +104,42 @@ std::string SizeToStr(double Size)
    return S;
 }
 
+bool RGAddBuilderFile(GtkBuilder *builder, const std::string &file)
+{
+   GError *error = NULL;
+   gboolean added;
+
+   // for development
+   std::string local = "gtkbuilder/" + file;
+   if (FileExists(local)) {
+      added = gtk_builder_add_from_file(builder, local.c_str(), &error);
+   } else {
+      std::string resource = "/org/polysynaptic/gtkbuilder/" + file;
+      added = gtk_builder_add_from_resource(builder, resource.c_str(), &error);
+   }
+   if (!added) {
+      g_warning("Couldn't load builder file: %s", error->message);
+      g_error_free(error);
+   }
+   return added;
+}
+
+bool RGFetchFile(const std::string &uri, const std::string &dest)
+{
+   // no progress, nobody is waiting in front of a dialog
+   pkgAcquire fetcher;
+   new pkgAcqFileSane(&fetcher, uri, HashStringList(), 0, uri,
+                      flNotDir(dest), "", dest);
+   if (fetcher.Run() != pkgAcquire::Continue)
+      return false;
+   for (pkgAcquire::ItemIterator I = fetcher.ItemsBegin();
+        I != fetcher.ItemsEnd(); I++) {
+      if ((*I)->Status != pkgAcquire::Item::StatDone)
+         return false;
+   }
+   return true;
+}
+
 bool RunAsSudoUserCommand(std::vector<const gchar*> cmd)
 {
    std::vector<const gchar*> prefix;
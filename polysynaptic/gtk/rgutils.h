@@ -57,6 +57,15 @@ GdkPixbuf *get_gdk_pixbuf(const gchar *name, int size=48);
 std::string SizeToStr(double Bytes);
 bool RunAsSudoUserCommand(std::vector<const gchar *> cmd);
 
+// download uri to dest through APT's methods, without any progress;
+// may be called from any thread
+bool RGFetchFile(const std::string &uri, const std::string &dest);
+
+// add the .ui file (e.g. "window_main.ui") to builder: from the
+// gtkbuilder/ directory when run from the source tree, else from the
+// resource bundle linked into the binary
+bool RGAddBuilderFile(GtkBuilder *builder, const std::string &file);
+
 std::string MarkupEscapeString(std::string str);
 std::string MarkupUnescapeString(std::string str);
 
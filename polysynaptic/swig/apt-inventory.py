@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+import synaptic_common
+import array
+import sys
+
+# FIXME: wrap this somewhere
+_error = synaptic_common._GetErrorObj()
+synaptic_common.RInitSystem()
+
+lister = synaptic_common.RPackageLister()
+lister.setProgressMeter(synaptic_common.SwigOpProgress())
+
+if not lister.openCache(False, False):
+    print "error opening cache file"
+    _error.DumpErrors()
+    sys.exit(1)
+
+# one call for the whole cache instead of one per field and package
+columns = synaptic_common.RPackageColumns()
+columns.fill(lister)
+names = columns.getNames()
+installed = columns.getInstalledVersions()
+flags = array.array('i')
+flags.fromstring(str(columns.flagsBuffer()))
+sizes = array.array('l')
+sizes.fromstring(str(columns.installedSizesBuffer()))
+
+FInstalled = synaptic_common.RPackage.FInstalled
+for i in range(columns.size()):
+    if flags[i] & FInstalled:
+        print "%s\t%s\t%i" % (names[i], installed[i], sizes[i])
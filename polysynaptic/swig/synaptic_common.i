@@ -24,4 +24,42 @@
 
 
 
-%template(RPackageVector) vector<RPackage *>;
\ No newline at end of file
+%template(RPackageVector) vector<RPackage *>;
+%template(StringVector) vector<string>;
+%template(IntVector) vector<int>;
+%template(LongVector) vector<long>;
+
+%{
+// a read-only buffer over memory the caller keeps alive
+static PyObject *RSwigBuffer(const void *data, size_t bytes)
+{
+   static char none;
+   if (bytes == 0)
+      data = &none;
+#if PY_MAJOR_VERSION >= 3
+   return PyMemoryView_FromMemory((char *)data, bytes, PyBUF_READ);
+#else
+   return PyBuffer_FromMemory((void *)data, bytes);
+#endif
+}
+%}
+
+// the columns in one transition each: the strings as tuples, the
+// numbers as buffers into the columns (keep the columns object alive
+// while using them, e.g. numpy.frombuffer(c.flagsBuffer(), "i"))
+%extend RPackageColumns {
+   vector<string> getNames() { return $self->names; }
+   vector<string> getVersions() { return $self->versions; }
+   vector<string> getInstalledVersions() { return $self->installedVersions; }
+   PyObject *flagsBuffer() {
+      return RSwigBuffer($self->flags.data(), $self->flags.size() * sizeof(int));
+   }
+   PyObject *installedSizesBuffer() {
+      return RSwigBuffer($self->installedSizes.data(),
+                         $self->installedSizes.size() * sizeof(long));
+   }
+   PyObject *downloadSizesBuffer() {
+      return RSwigBuffer($self->downloadSizes.data(),
+                         $self->downloadSizes.size() * sizeof(long));
+   }
+};
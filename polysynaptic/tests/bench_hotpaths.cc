@@ -0,0 +1,995 @@
+/* bench_hotpaths.cc - Microbenchmarks for PolySynaptic hot paths
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file times the code paths that dominate list loading, searching
+ * and filtering. Every benchmark runs over synthetic fixtures built from
+ * a fixed seed, so numbers are comparable between runs and machines.
+ * The APT benchmarks use the system package cache and are reported as
+ * skipped when it cannot be opened.
+ *
+ * Each result is printed as one JSON object per line:
+ *   {"benchmark":"...","items":N,"reps":R,"min_ns":...,"median_ns":...,
+ *    "mean_ns":...,"ns_per_item":...}
+ *
+ * With --counters each timed repetition is also counted by the CPU's
+ * performance counters (perf_event_open, user space only), and the
+ * mean per repetition and per item is added to the line:
+ *   "cycles":...,"instructions":...,"cache_misses":...,
+ *   "branch_misses":...,"ipc":...,"cycles_per_item":...,
+ *   "instructions_per_item":...,"cache_misses_per_item":...,
+ *   "branch_misses_per_item":...
+ * Where the kernel refuses them (perf_event_paranoid, containers) the
+ * lines carry "counters":"unavailable" instead.
+ *
+ * --save-baseline FILE also writes every sample to FILE, the baseline
+ * (format version 1, one header line and a line per benchmark).
+ * --compare FILE runs the benchmarks again and adds to each line the
+ * change of the median against FILE with a 95% bootstrap confidence
+ * interval:
+ *   "baseline_median_ns":...,"change_pct":...,"ci_low_pct":...,
+ *   "ci_high_pct":...,"verdict":"regression|improvement|unchanged"
+ * A change counts only when the whole interval lies beyond
+ * --threshold percent (5 by default). A last line sums up the run, and
+ * the exit status is 1 if anything regressed, so a build can be gated
+ * on it:
+ *   make bench-baseline            # on the reference build
+ *   make bench-compare             # on the candidate, same machine
+ *
+ * To run the benchmarks:
+ *   make bench
+ *   ./bench_hotpaths [--reps N] [--scale N] [--filter SUBSTRING]
+ *                    [--synth-max PACKAGES] [--counters]
+ *                    [--save-baseline FILE | --compare FILE]
+ *                    [--threshold PERCENT]
+ *
+ * The synth_* benchmarks run at 10k, 100k and 1M packages (it stops at
+ * --synth-max, 100000 by default) over SynthBackend catalogs.
+ *
+ * The parse_* benchmarks run the snap and flatpak parsers over the
+ * samples of parsercorpus.h, store-sized listings and other locales,
+ * fed in pipe-sized reads, and report "mb_per_s" and "rows_per_s" as
+ * well; parse_*_bytewise feed the pathological samples a byte at a
+ * time.
+ *
+ * The large_archive_* benchmarks build the name structures the lister
+ * keeps per package for 500k synthetic names, the size of a cache with
+ * several architectures, many PPAs and the source lists enabled: the
+ * name index of every open and the set of known names a reopen checks
+ * for new packages, next to the set<string> that set used to be.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include <apt-pkg/init.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/progress.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "rpackagelister.h"
+#include "rpackageview.h"
+#include "rpackagefilter.h"
+#include "rnameindex.h"
+#include "rnameset.h"
+#include "backendmanager.h"
+#include "packagecatalog.h"
+#include "packageranking.h"
+#include "snapbackend.h"
+#include "snapdclient.h"
+#include "flatpakbackend.h"
+#include "flatpakengine.h"
+#include "rgunifiedview.h"
+#include "synthbackend.h"
+#include "parsercorpus.h"
+
+using namespace std;
+using namespace PolySynaptic;
+
+// ============================================================================
+// Benchmark Harness
+// ============================================================================
+
+static int g_reps = 15;
+static int g_scale = 1;
+static string g_filter;
+static size_t g_synthMax = 100000;
+static bool g_counters = false;
+
+// Results are folded into this so the optimizer cannot drop the work
+static volatile size_t g_sink = 0;
+
+static bool selected(const string& name)
+{
+    return g_filter.empty() || name.find(g_filter) != string::npos;
+}
+
+static void reportSkipped(const string& name, const string& reason)
+{
+    if (!selected(name)) return;
+    cout << "{\"benchmark\":\"" << name << "\",\"skipped\":\"" << reason
+         << "\"}" << endl;
+}
+
+/**
+ * Cycles, instructions, cache misses and branch misses of this thread
+ *
+ * One perf event group, so the four are counted over the same
+ * instructions; scaled up if the kernel had to multiplex them.
+ */
+class PerfCounters {
+public:
+    static const int COUNT = 4;
+    static const char* const NAMES[COUNT];
+
+    PerfCounters() : _fds{-1, -1, -1, -1}, _sums{0, 0, 0, 0} {
+#ifdef __linux__
+        static const uint64_t configs[COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < COUNT; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP |
+                               PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            _fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, _fds[0], 0);
+            if (_fds[i] < 0) {
+                close();
+                return;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters() { close(); }
+
+    bool available() const { return _fds[0] >= 0; }
+
+    void start() {
+#ifdef __linux__
+        ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Add what was counted since start() to the sums
+    void stop() {
+#ifdef __linux__
+        ioctl(_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t data[3 + COUNT];      // nr, enabled, running, values
+        if (read(_fds[0], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            return;
+        }
+        double scale = double(data[1]) / double(data[2]);
+        for (int i = 0; i < COUNT; i++) {
+            _sums[i] += data[3 + i] * scale;
+        }
+#endif
+    }
+
+    double sum(int i) const { return _sums[i]; }
+
+private:
+    int _fds[COUNT];
+    double _sums[COUNT];
+
+    void close() {
+#ifdef __linux__
+        for (int i = COUNT - 1; i >= 0; i--) {
+            if (_fds[i] >= 0) ::close(_fds[i]);
+            _fds[i] = -1;
+        }
+#endif
+    }
+};
+
+const char* const PerfCounters::NAMES[PerfCounters::COUNT] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+};
+
+// ============================================================================
+// Baselines
+// ============================================================================
+
+static const int BASELINE_FORMAT = 1;
+
+static string g_saveBaseline;
+static string g_compareWith;
+static double g_threshold = 5;          // Percent
+static ofstream g_baselineOut;
+
+struct BaselineResult {
+    size_t items = 0;
+    vector<double> samples;             // Sorted
+};
+static map<string, BaselineResult> g_baseline;
+
+static int g_compared = 0;
+static int g_regressions = 0;
+static int g_improvements = 0;
+
+// The text after "key": on a baseline line, or npos
+static size_t findValue(const string& line, const char* key)
+{
+    string needle = string("\"") + key + "\":";
+    size_t at = line.find(needle);
+    return at == string::npos ? at : at + needle.size();
+}
+
+static bool loadBaseline(const string& path)
+{
+    ifstream in(path);
+    string line;
+    if (!in || !getline(in, line)) {
+        return false;
+    }
+    size_t at = findValue(line, "baseline_format");
+    if (at == string::npos || atoi(line.c_str() + at) != BASELINE_FORMAT) {
+        return false;
+    }
+
+    while (getline(in, line)) {
+        size_t name = findValue(line, "benchmark");
+        size_t items = findValue(line, "items");
+        size_t samples = findValue(line, "samples_ns");
+        if (name == string::npos || items == string::npos ||
+            samples == string::npos || line[name] != '"') {
+            continue;
+        }
+        BaselineResult& result = g_baseline[line.substr(name + 1, line.find('"', name + 1) - name - 1)];
+        result.items = strtoul(line.c_str() + items, nullptr, 10);
+        const char* p = line.c_str() + samples + 1;
+        while (*p && *p != ']') {
+            char* end;
+            double value = strtod(p, &end);
+            if (end == p) break;
+            result.samples.push_back(value);
+            p = *end == ',' ? end + 1 : end;
+        }
+        sort(result.samples.begin(), result.samples.end());
+    }
+    return true;
+}
+
+static void saveBaselineHeader()
+{
+    g_baselineOut << "{\"baseline_format\":" << BASELINE_FORMAT
+                  << ",\"reps\":" << g_reps << ",\"scale\":" << g_scale
+                  << "}" << endl;
+}
+
+static void saveBaselineResult(const string& name, size_t items,
+                               const vector<double>& samples)
+{
+    ostringstream out;
+    out.setf(ios::fixed);
+    out.precision(0);
+    out << "{\"benchmark\":\"" << name << "\",\"items\":" << items
+        << ",\"samples_ns\":[";
+    for (size_t i = 0; i < samples.size(); i++) {
+        out << (i ? "," : "") << samples[i];
+    }
+    out << "]}";
+    g_baselineOut << out.str() << endl;
+}
+
+static double medianOf(vector<double>& values)
+{
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+/**
+ * The change of the median against the baseline, with a 95% bootstrap
+ * confidence interval, as JSON fields
+ *
+ * Both sample sets are resampled with a fixed seed, so the same
+ * samples always give the same interval.
+ */
+static string compareWithBaseline(const string& name, size_t items,
+                                  const vector<double>& samples)
+{
+    auto found = g_baseline.find(name);
+    if (found == g_baseline.end() || found->second.samples.empty()) {
+        return ",\"verdict\":\"no_baseline\"";
+    }
+    const BaselineResult& base = found->second;
+    if (base.items != items) {
+        return ",\"verdict\":\"incomparable\"";
+    }
+
+    const int RESAMPLES = 2000;
+    mt19937 rng(42);
+    vector<double> ratios;
+    ratios.reserve(RESAMPLES);
+    vector<double> a(base.samples.size());
+    vector<double> b(samples.size());
+    uniform_int_distribution<size_t> pickA(0, a.size() - 1);
+    uniform_int_distribution<size_t> pickB(0, b.size() - 1);
+    for (int r = 0; r < RESAMPLES; r++) {
+        for (auto& v : a) v = base.samples[pickA(rng)];
+        for (auto& v : b) v = samples[pickB(rng)];
+        double baseMedian = medianOf(a);
+        if (baseMedian > 0) ratios.push_back(medianOf(b) / baseMedian);
+    }
+    if (ratios.empty()) {
+        return ",\"verdict\":\"incomparable\"";
+    }
+    sort(ratios.begin(), ratios.end());
+    double low = ratios[size_t(ratios.size() * 0.025)];
+    double high = ratios[min(ratios.size() - 1, size_t(ratios.size() * 0.975))];
+
+    double baseMedian = base.samples[base.samples.size() / 2];
+    double median = samples[samples.size() / 2];
+    double limit = g_threshold / 100;
+    const char* verdict = "unchanged";
+    if (low > 1 + limit) {
+        verdict = "regression";
+        g_regressions++;
+    } else if (high < 1 - limit) {
+        verdict = "improvement";
+        g_improvements++;
+    }
+    g_compared++;
+
+    ostringstream out;
+    out.setf(ios::fixed);
+    out.precision(0);
+    out << ",\"baseline_median_ns\":" << baseMedian;
+    out.precision(2);
+    out << ",\"change_pct\":" << (baseMedian > 0 ? (median / baseMedian - 1) * 100 : 0.0)
+        << ",\"ci_low_pct\":" << (low - 1) * 100
+        << ",\"ci_high_pct\":" << (high - 1) * 100
+        << ",\"verdict\":\"" << verdict << "\"";
+    return out.str();
+}
+
+/**
+ * Time fn over g_reps repetitions after one warm-up run
+ *
+ * setup runs before every repetition and is not timed. Parsers pass
+ * the bytes they read, for their throughput.
+ */
+static void runBench(const string& name, size_t items,
+                     const function<void()>& setup,
+                     const function<void()>& fn,
+                     size_t bytes = 0)
+{
+    if (!selected(name)) return;
+
+    if (setup) setup();
+    fn();
+
+    unique_ptr<PerfCounters> counters;
+    if (g_counters) counters.reset(new PerfCounters());
+    bool counting = counters && counters->available();
+
+    vector<double> samples;
+    samples.reserve(g_reps);
+    for (int i = 0; i < g_reps; i++) {
+        if (setup) setup();
+        if (counting) counters->start();
+        auto start = chrono::steady_clock::now();
+        fn();
+        auto end = chrono::steady_clock::now();
+        if (counting) counters->stop();
+        samples.push_back(chrono::duration<double, nano>(end - start).count());
+    }
+
+    sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) sum += s;
+    double median = samples[samples.size() / 2];
+
+    ostringstream out;
+    out.setf(ios::fixed);
+    out.precision(0);
+    out << "{\"benchmark\":\"" << name << "\""
+        << ",\"items\":" << items
+        << ",\"reps\":" << g_reps
+        << ",\"min_ns\":" << samples.front()
+        << ",\"median_ns\":" << median
+        << ",\"mean_ns\":" << sum / samples.size();
+    out.precision(2);
+    out << ",\"ns_per_item\":" << (items > 0 ? median / items : 0.0);
+    if (bytes > 0 && median > 0) {
+        out << ",\"bytes\":" << bytes
+            << ",\"mb_per_s\":" << bytes / median * 1e9 / (1 << 20);
+        out.precision(0);
+        out << ",\"rows_per_s\":" << items / median * 1e9;
+        out.precision(2);
+    }
+    if (counting) {
+        out.precision(0);
+        for (int c = 0; c < PerfCounters::COUNT; c++) {
+            out << ",\"" << PerfCounters::NAMES[c] << "\":"
+                << counters->sum(c) / g_reps;
+        }
+        out.precision(2);
+        out << ",\"ipc\":" << (counters->sum(0) > 0 ? counters->sum(1) / counters->sum(0) : 0.0);
+        for (int c = 0; c < PerfCounters::COUNT; c++) {
+            out << ",\"" << PerfCounters::NAMES[c] << "_per_item\":"
+                << (items > 0 ? counters->sum(c) / g_reps / items : 0.0);
+        }
+    } else if (g_counters) {
+        out << ",\"counters\":\"unavailable\"";
+    }
+    if (!g_compareWith.empty()) {
+        out << compareWithBaseline(name, items, samples);
+    }
+    out << "}";
+    cout << out.str() << endl;
+
+    if (g_baselineOut.is_open()) {
+        saveBaselineResult(name, items, samples);
+    }
+}
+
+static void runBench(const string& name, size_t items,
+                     const function<void()>& fn)
+{
+    runBench(name, items, nullptr, fn);
+}
+
+// ============================================================================
+// Synthetic Fixtures
+// ============================================================================
+
+static const char* const WORDS[] = {
+    "audio", "browser", "editor", "image", "media", "office", "player",
+    "python", "rust", "shell", "terminal", "video", "viewer", "web", "gtk",
+    "kde", "libre", "open", "code", "studio", "tools", "utils", "server"
+};
+static const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static string makeName(mt19937& rng, size_t i)
+{
+    uniform_int_distribution<size_t> word(0, WORD_COUNT - 1);
+    return string(WORDS[word(rng)]) + "-" + WORDS[word(rng)] + to_string(i);
+}
+
+static string makeSummary(mt19937& rng)
+{
+    uniform_int_distribution<size_t> word(0, WORD_COUNT - 1);
+    string s;
+    for (int i = 0; i < 8; i++) {
+        if (i) s += " ";
+        s += WORDS[word(rng)];
+    }
+    return s;
+}
+
+/**
+ * Packages of all three backends, with some names shared across backends
+ */
+static vector<PackageInfo> makePackages(size_t count, unsigned seed)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<int> backend(0, 2);
+    uniform_int_distribution<int> installed(0, 3);
+    uniform_int_distribution<int64_t> size(1 << 10, 1 << 28);
+
+    vector<PackageInfo> packages;
+    packages.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        BackendType type = static_cast<BackendType>(backend(rng));
+        // Every fifth package reuses an earlier name on another backend
+        string name = (i % 5 == 4) ? packages[i - 3].name : makeName(rng, i);
+
+        PackageInfo pkg(name, name, type);
+        pkg.summary = makeSummary(rng);
+        pkg.version = to_string(i % 17) + "." + to_string(i % 7);
+        if (installed(rng) == 0) {
+            pkg.installStatus = InstallStatus::INSTALLED;
+            pkg.installedVersion = pkg.version;
+        }
+        pkg.downloadSize = size(rng);
+        pkg.installedSize = pkg.downloadSize * 3;
+        packages.push_back(pkg);
+    }
+    return packages;
+}
+
+/**
+ * A snapd /v2/find response body
+ */
+static string makeSnapdFindBody(size_t count, unsigned seed)
+{
+    mt19937 rng(seed);
+    ostringstream body;
+    body << "{\"type\":\"sync\",\"status-code\":200,\"status\":\"OK\",\"result\":[";
+    for (size_t i = 0; i < count; i++) {
+        if (i) body << ",";
+        string name = makeName(rng, i);
+        body << "{\"id\":\"id" << i << "\",\"name\":\"" << name << "\","
+             << "\"title\":\"" << name << "\",\"version\":\"1." << i % 30 << "\","
+             << "\"revision\":\"" << 100 + i << "\","
+             << "\"summary\":\"" << makeSummary(rng) << "\","
+             << "\"description\":\"" << makeSummary(rng) << " "
+             << makeSummary(rng) << "\","
+             << "\"status\":\"available\",\"confinement\":\"strict\","
+             << "\"download-size\":" << 4096 * (i + 1) << ","
+             << "\"publisher\":{\"id\":\"p\",\"username\":\"pub" << i % 50
+             << "\",\"validation\":\"verified\"},"
+             << "\"channels\":{\"latest/stable\":{\"version\":\"1." << i % 30
+             << "\",\"size\":1},\"latest/edge\":{\"version\":\"2.0\"}},"
+             << "\"apps\":[{\"name\":\"" << name << "\"}]}";
+    }
+    body << "]}";
+    return body.str();
+}
+
+/**
+ * Flatpak remote refs as the engine reports them
+ */
+static vector<FlatpakRefInfo> makeFlatpakRefs(size_t count, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<FlatpakRefInfo> refs(count);
+    for (size_t i = 0; i < count; i++) {
+        FlatpakRefInfo& ref = refs[i];
+        ref.appId = "org.example." + makeName(rng, i);
+        ref.name = makeName(rng, i);
+        ref.summary = makeSummary(rng);
+        ref.version = "3." + to_string(i % 11);
+        ref.branch = "stable";
+        ref.arch = "x86_64";
+        ref.origin = "flathub";
+        ref.ref = "app/" + ref.appId + "/x86_64/stable";
+        ref.runtimeRef = "org.gnome.Platform/x86_64/45";
+        ref.downloadSize = 1024 * (i + 1);
+    }
+    return refs;
+}
+
+// ============================================================================
+// Backend Benchmarks
+// ============================================================================
+
+static void benchBackends()
+{
+    const size_t count = 5000 * g_scale;
+
+    // Live replacement of `snap find` output parsing
+    string body = makeSnapdFindBody(count, 1);
+    runBench("snapd_parse_find", count, [&]() {
+        vector<SnapdSnap> snaps;
+        string error;
+        SnapdClient::parseSnapList(body, snaps, error);
+        for (const auto& snap : snaps) {
+            g_sink += SnapBackend::fromSnapdSnap(snap, true).name.size();
+        }
+    });
+
+    // Live replacement of `flatpak remote-ls` output parsing
+    vector<FlatpakRefInfo> refs = makeFlatpakRefs(count, 2);
+    runBench("flatpak_from_refs", count, [&]() {
+        for (const auto& ref : refs) {
+            g_sink += FlatpakBackend::fromFlatpakRef(ref).id.size();
+        }
+    });
+
+    // Merge, sort and cut of the per-backend search answers
+    vector<PackageInfo> packages = makePackages(count, 3);
+    vector<vector<PackageInfo>> perBackend;
+    SearchOptions options;
+    options.maxResults = 0;
+    runBench("merge_search_results", count, [&]() {
+        perBackend.assign(3, vector<PackageInfo>());
+        for (const auto& pkg : packages) {
+            perBackend[static_cast<int>(pkg.backend)].push_back(pkg);
+        }
+    }, [&]() {
+        g_sink += BackendManager::mergeSearchResults(perBackend, options).size();
+    });
+
+    // Revalidation diff of the warm-start catalog
+    vector<PackageInfo> before = makePackages(count, 4);
+    vector<PackageInfo> after = before;
+    for (size_t i = 0; i < after.size(); i += 10) {
+        after[i].installedVersion = "changed";
+    }
+    runBench("catalog_diff", count, [&]() {
+        g_sink += PackageCatalog::diff(before, after).size();
+    });
+
+    // Relevance of every candidate of a unified search
+    runBench("search_relevance", count, [&]() {
+        for (const auto& pkg : packages) {
+            g_sink += BackendManager::searchRelevance(pkg, "editor");
+        }
+    });
+
+    // Ranking of the providers of one app, done per displayed page
+    static const SourceType SOURCES[] = {SourceType::APT, SourceType::SNAP, SourceType::FLATPAK};
+    vector<UnifiedPackage> unified;
+    unified.reserve(packages.size());
+    for (const auto& pkg : packages) {
+        UnifiedPackage u(pkg.id, pkg.name, SOURCES[static_cast<int>(pkg.backend) % 3]);
+        u.summary = pkg.summary;
+        u.availableVersion = pkg.version;
+        u.downloadSize = pkg.downloadSize;
+        unified.push_back(u);
+    }
+    PackageRanker ranker;
+    runBench("rank_batch", count, [&]() {
+        g_sink += ranker.rankBatch(unified).size();
+    });
+
+    // The warm start reads the catalog before any backend answers
+    string catalogPath = "/tmp/bench-polysynaptic-catalog-" + to_string(getpid());
+    PackageCatalog saved;
+    saved.update(BackendType::APT, "bench", before);
+    saved.save(catalogPath);
+    runBench("startup_catalog_load", count, [&]() {
+        PackageCatalog catalog;
+        catalog.load(catalogPath);
+        g_sink += catalog.getPackages(BackendType::APT).size();
+    });
+    unlink(catalogPath.c_str());
+}
+
+// ============================================================================
+// Unified View Benchmarks
+// ============================================================================
+
+static void benchUnifiedView()
+{
+    const size_t count = 20000 * g_scale;
+
+    vector<PackageInfo> first = makePackages(count, 5);
+    vector<PackageInfo> second = makePackages(count, 6);
+    SnapshotPublisher publisher;
+    uint64_t generation = 0;
+
+    RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+
+    // A full replacement of the displayed rows
+    bool flip = false;
+    runBench("unified_list_populate", count, [&]() {
+        publisher.publish(flip ? second : first, ++generation);
+        flip = !flip;
+    }, [&]() {
+        rg_unified_pkg_list_set_packages(list, publisher.current());
+    });
+
+    // Backend filter narrowing (every APT row disappears)
+    runBench("unified_list_filter", count, [&]() {
+        rg_unified_pkg_list_set_filter(list, BackendFilter::All());
+        rg_unified_pkg_list_set_packages(list, publisher.publish(first, ++generation));
+    }, [&]() {
+        BackendFilter filter;
+        filter.includeApt = false;
+        rg_unified_pkg_list_set_filter(list, filter);
+    });
+
+    g_object_unref(list);
+}
+
+// ============================================================================
+// Scaling Benchmarks
+// ============================================================================
+
+/**
+ * The backend-facing paths over synthetic catalogs of growing size
+ *
+ * Each size is the total over the three backends, split as on a typical
+ * desktop: most packages from APT, the rest from the stores.
+ */
+static void benchSynthetic()
+{
+    for (size_t total : {size_t(10000), size_t(100000), size_t(1000000)}) {
+        if (total > g_synthMax) break;
+        const string suffix = "_" + to_string(total);
+
+        vector<unique_ptr<SynthBackend>> backends;
+        const struct { BackendType type; double share; } split[] = {
+            {BackendType::APT, 0.8},
+            {BackendType::SNAP, 0.1},
+            {BackendType::FLATPAK, 0.1},
+        };
+        unsigned seed = 10;
+        for (const auto& part : split) {
+            SynthConfig config;
+            config.type = part.type;
+            config.count = (size_t)(total * part.share);
+            config.seed = seed++;
+            backends.push_back(make_unique<SynthBackend>(config));
+        }
+
+        // Fan a search out as BackendManager does and merge the answers
+        SearchOptions options;
+        options.query = "media";
+        options.maxResults = 200;
+        runBench("synth_search_merge" + suffix, total, [&]() {
+            vector<vector<PackageInfo>> perBackend(backends.size());
+            vector<thread> workers;
+            for (size_t b = 0; b < backends.size(); b++) {
+                workers.emplace_back([&, b]() {
+                    perBackend[b] = backends[b]->searchPackages(options);
+                });
+            }
+            for (auto& worker : workers) worker.join();
+            g_sink += BackendManager::mergeSearchResults(perBackend, options).size();
+        });
+
+        // Every package through the merge, as an unlimited listing does
+        vector<vector<PackageInfo>> perBackend;
+        SearchOptions unlimited;
+        unlimited.maxResults = 0;
+        runBench("synth_merge_all" + suffix, total, [&]() {
+            perBackend.clear();
+            for (const auto& backend : backends) {
+                perBackend.push_back(backend->catalog());
+            }
+        }, [&]() {
+            g_sink += BackendManager::mergeSearchResults(perBackend, unlimited).size();
+        });
+
+        vector<PackageInfo> all;
+        for (const auto& backend : backends) {
+            all.insert(all.end(), backend->catalog().begin(),
+                       backend->catalog().end());
+        }
+
+        // Warm-start revalidation after one package in fifty changed
+        vector<PackageInfo> changed = all;
+        for (size_t i = 0; i < changed.size(); i += 50) {
+            changed[i].installedVersion = "changed";
+        }
+        runBench("synth_catalog_diff" + suffix, total, [&]() {
+            g_sink += PackageCatalog::diff(all, changed).size();
+        });
+
+        RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+        SnapshotPublisher publisher;
+        uint64_t generation = 0;
+        runBench("synth_unified_populate" + suffix, total, [&]() {
+            rg_unified_pkg_list_set_packages(list, nullptr);
+            publisher.publish(all, ++generation);
+        }, [&]() {
+            rg_unified_pkg_list_set_packages(list, publisher.current());
+        });
+        g_object_unref(list);
+    }
+}
+
+// ============================================================================
+// Parser Benchmarks
+// ============================================================================
+
+static void benchParsers()
+{
+    vector<CorpusSample> samples = ParserCorpus::realWorld(g_scale);
+    for (auto& sample : ParserCorpus::locales()) samples.push_back(sample);
+    for (auto& sample : ParserCorpus::pathological()) samples.push_back(sample);
+
+    for (const auto& sample : samples) {
+        runBench("parse_" + sample.name, sample.rows, nullptr, [&]() {
+            g_sink += ParserCorpus::parse(sample, 4096);
+        }, sample.text.size());
+    }
+    for (const auto& sample : ParserCorpus::pathological()) {
+        runBench("parse_" + sample.name + "_bytewise", sample.rows, nullptr, [&]() {
+            g_sink += ParserCorpus::parse(sample, 1);
+        }, sample.text.size());
+    }
+}
+
+// ============================================================================
+// Large Archive Benchmarks
+// ============================================================================
+
+static void benchLargeArchive()
+{
+    const size_t total = 500000;
+    const string suffix = "_" + to_string(total);
+
+    mt19937 rng(30);
+    vector<string> names;
+    names.reserve(total);
+    for (size_t i = 0; i < total; i++) {
+        names.push_back(makeName(rng, i));
+    }
+
+    // What every openCache() builds
+    runBench("large_archive_name_index" + suffix, total, [&]() {
+        RNameIndex index;
+        for (size_t i = 0; i < names.size(); i++) {
+            index.add(i, names[i].c_str());
+        }
+        index.finish();
+        g_sink += index.size();
+    });
+
+    // A reopen checks every name against the known ones and adds the
+    // new; here one in a hundred is new
+    vector<string> reopened = names;
+    for (size_t i = 0; i < reopened.size(); i += 100) {
+        reopened[i] += "-new";
+    }
+    RNameSet known;
+    runBench("large_archive_new_names" + suffix, total, [&]() {
+        known.clear();
+        for (const auto& name : names) known.add(name.c_str());
+        known.finish();
+    }, [&]() {
+        for (const auto& name : reopened) {
+            if (!known.seen(name.c_str())) known.add(name.c_str());
+        }
+        known.finish();
+        g_sink += known.size();
+    });
+
+    set<string> knownStrings;
+    runBench("large_archive_new_names_string_set" + suffix, total, [&]() {
+        knownStrings = set<string>(names.begin(), names.end());
+    }, [&]() {
+        for (const auto& name : reopened) {
+            if (knownStrings.find(name) == knownStrings.end())
+                knownStrings.insert(name);
+        }
+        g_sink += knownStrings.size();
+    });
+
+    if (selected("large_archive_memory" + suffix)) {
+        cout << "{\"benchmark\":\"large_archive_memory" << suffix << "\""
+             << ",\"items\":" << known.size()
+             << ",\"known_names_bytes\":" << known.memoryBytes() << "}" << endl;
+    }
+}
+
+// ============================================================================
+// APT Benchmarks
+// ============================================================================
+
+static void benchApt()
+{
+    pkgInitConfig(*_config);
+    pkgInitSystem(*_config, _system);
+
+    RPackageLister lister;
+    if (!lister.openCache()) {
+        reportSkipped("apt_sort_packages", "cannot open the apt cache");
+        reportSkipped("apt_reapply_filter", "cannot open the apt cache");
+        reportSkipped("apt_search_add_package", "cannot open the apt cache");
+        return;
+    }
+
+    size_t count = lister.getPackages().size();
+    lister.reapplyFilter();
+
+    static const struct {
+        const char* name;
+        RPackageLister::listSortMode mode;
+    } modes[] = {
+        {"apt_sort_packages_name", RPackageLister::LIST_SORT_NAME_ASC},
+        {"apt_sort_packages_size", RPackageLister::LIST_SORT_SIZE_DES},
+        {"apt_sort_packages_section", RPackageLister::LIST_SORT_SECTION_ASC},
+        {"apt_sort_packages_status", RPackageLister::LIST_SORT_STATUS_ASC},
+        {"apt_sort_packages_version", RPackageLister::LIST_SORT_VERSION_ASC},
+    };
+    for (const auto& m : modes) {
+        // Download size order is unrelated to every timed mode
+        runBench(m.name, count, [&]() {
+            lister.sortPackages(RPackageLister::LIST_SORT_DLSIZE_ASC);
+        }, [&]() {
+            lister.sortPackages(m.mode);
+            g_sink += lister.viewPackagesSize();
+        });
+    }
+
+    runBench("apt_reapply_filter", count, [&]() {
+        lister.reapplyFilter();
+        g_sink += lister.viewPackagesSize();
+    });
+
+    // setSearch runs addPackage over every package of the view
+    RPackageViewSearch search(lister.getPackages());
+    OpProgress progress;
+    runBench("apt_search_add_package", count, [&]() {
+        g_sink += search.setSearch("bench", RPatternPackageFilter::Description,
+                                   "library", progress);
+    });
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv)
+{
+    // GObject types only, no display is needed
+    gtk_init_check(&argc, &argv);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            g_reps = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            g_scale = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            g_filter = argv[++i];
+        } else if (strcmp(argv[i], "--synth-max") == 0 && i + 1 < argc) {
+            g_synthMax = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            g_counters = true;
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            g_saveBaseline = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            g_compareWith = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            g_threshold = max(0.0, atof(argv[++i]));
+        } else {
+            cerr << "usage: " << argv[0]
+                 << " [--reps N] [--scale N] [--filter SUBSTRING]"
+                 << " [--synth-max PACKAGES] [--counters]"
+                 << " [--save-baseline FILE | --compare FILE]"
+                 << " [--threshold PERCENT]" << endl;
+            return 2;
+        }
+    }
+
+    if (!g_compareWith.empty() && !loadBaseline(g_compareWith)) {
+        cerr << g_compareWith << ": not a baseline of format "
+             << BASELINE_FORMAT << endl;
+        return 2;
+    }
+    if (!g_saveBaseline.empty()) {
+        g_baselineOut.open(g_saveBaseline);
+        if (!g_baselineOut) {
+            cerr << g_saveBaseline << ": cannot be written" << endl;
+            return 2;
+        }
+        saveBaselineHeader();
+    }
+
+    benchBackends();
+    benchUnifiedView();
+    benchSynthetic();
+    benchParsers();
+    benchLargeArchive();
+    benchApt();
+
+    if (!g_compareWith.empty()) {
+        cout << "{\"compared\":" << g_compared
+             << ",\"regressions\":" << g_regressions
+             << ",\"improvements\":" << g_improvements
+             << ",\"threshold_pct\":" << g_threshold << "}" << endl;
+        return g_regressions > 0 ? 1 : 0;
+    }
+    return 0;
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,567 @@
+/* bench_ui_latency.cc - End-to-end latency of scripted unified view journeys
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file drives the widgets of the unified view the way a user does
+ * and reports how long each step keeps the user waiting. The window is
+ * assembled from the same parts RGMainWindow uses in unified mode: the
+ * entry_fast_search entry, an RGBackendFilterBar and an RGUnifiedPkgList
+ * shown in a GtkTreeView. The main window itself needs an opened APT
+ * cache and its GtkBuilder files, so the results come from fake
+ * backends instead. Each fake answers from a fixed-seed catalog on its
+ * own thread after a configurable delay, so runs are repeatable.
+ *
+ * A step is timed from the input event to the moment the main loop has
+ * no more work: every backend that was asked has delivered, and every
+ * pending idle and redraw has been processed.
+ *
+ * Journeys: launch, type_query (one step per keystroke into
+ * entry_fast_search), toggle_source (each filter bar source off and on
+ * again), sort_column, mark_packages (100 rows) and open_details.
+ *
+ * Each step is printed as one JSON object per line:
+ *   {"journey":"...","step":"...","samples":N,"p50_ms":...,"p90_ms":...,
+ *    "p99_ms":...,"max_ms":...}
+ *
+ * It needs a display; under CI use xvfb-run. To run it:
+ *   make bench-ui
+ *   ./bench_ui_latency [--runs N] [--scale N] [--filter SUBSTRING]
+ *                      [--apt-delay MS] [--snap-delay MS] [--flatpak-delay MS]
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <gtk/gtk.h>
+
+#include "backendmanager.h"
+#include "rgunifiedview.h"
+
+using namespace std;
+using namespace PolySynaptic;
+
+// ============================================================================
+// Options
+// ============================================================================
+
+static int g_runs = 5;
+static int g_scale = 1;
+static string g_filter;
+static int g_delayMs[3] = {20, 250, 400};   // APT, Snap, Flatpak
+
+static bool selected(const string& journey)
+{
+    return g_filter.empty() || journey.find(g_filter) != string::npos;
+}
+
+// ============================================================================
+// Latency Recording
+// ============================================================================
+
+// Samples in milliseconds by journey, then step; steps print in the
+// order they were first recorded
+static vector<pair<string, string>> g_order;
+static map<pair<string, string>, vector<double>> g_samples;
+
+static void record(const string& journey, const string& step, double ms)
+{
+    auto key = make_pair(journey, step);
+    auto [it, inserted] = g_samples.try_emplace(key);
+    if (inserted) g_order.push_back(key);
+    it->second.push_back(ms);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+static void report()
+{
+    for (const auto& key : g_order) {
+        vector<double> samples = g_samples[key];
+        sort(samples.begin(), samples.end());
+
+        ostringstream out;
+        out.setf(ios::fixed);
+        out.precision(2);
+        out << "{\"journey\":\"" << key.first << "\""
+            << ",\"step\":\"" << key.second << "\""
+            << ",\"samples\":" << samples.size()
+            << ",\"p50_ms\":" << percentile(samples, 50)
+            << ",\"p90_ms\":" << percentile(samples, 90)
+            << ",\"p99_ms\":" << percentile(samples, 99)
+            << ",\"max_ms\":" << samples.back()
+            << "}";
+        cout << out.str() << endl;
+    }
+}
+
+// ============================================================================
+// Fake Backends
+// ============================================================================
+
+static const char* const WORDS[] = {
+    "audio", "browser", "editor", "image", "media", "office", "player",
+    "python", "rust", "shell", "terminal", "video", "viewer", "web", "gtk",
+    "kde", "libre", "open", "code", "studio", "tools", "utils", "server"
+};
+static const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+/**
+ * FakeBackend - Answers searches from a fixed catalog after a delay
+ */
+struct FakeBackend {
+    BackendType type;
+    vector<PackageInfo> catalog;
+
+    FakeBackend(BackendType t, size_t count, unsigned seed) : type(t)
+    {
+        mt19937 rng(seed);
+        uniform_int_distribution<size_t> word(0, WORD_COUNT - 1);
+        uniform_int_distribution<int> installed(0, 3);
+        uniform_int_distribution<long> size(1 << 10, 1 << 28);
+
+        catalog.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            string name = string(WORDS[word(rng)]) + "-" + WORDS[word(rng)] +
+                          to_string(i);
+            PackageInfo pkg(name, name, type);
+            for (int w = 0; w < 8; w++) {
+                if (w) pkg.summary += " ";
+                pkg.summary += WORDS[word(rng)];
+            }
+            pkg.version = to_string(i % 17) + "." + to_string(i % 7);
+            if (installed(rng) == 0) {
+                pkg.installStatus = InstallStatus::INSTALLED;
+                pkg.installedVersion = pkg.version;
+            }
+            pkg.downloadSize = size(rng);
+            pkg.installedSize = pkg.downloadSize * 3;
+            catalog.push_back(pkg);
+        }
+    }
+
+    // Runs on a worker thread; an empty query lists what is installed
+    vector<PackageInfo> search(const string& query, size_t maxResults) const
+    {
+        this_thread::sleep_for(chrono::milliseconds(g_delayMs[(int)type]));
+
+        vector<PackageInfo> results;
+        for (const auto& pkg : catalog) {
+            bool match = query.empty()
+                ? pkg.installStatus == InstallStatus::INSTALLED
+                : (pkg.name.find(query) != string::npos ||
+                   pkg.summary.find(query) != string::npos);
+            if (!match) continue;
+            results.push_back(pkg);
+            if (maxResults > 0 && results.size() >= maxResults) break;
+        }
+        return results;
+    }
+};
+
+// ============================================================================
+// Unified View Fixture
+// ============================================================================
+
+/**
+ * UnifiedFixture - The unified view widgets wired like RGMainWindow
+ *
+ * Searches fan out to the fake backends and are delivered with
+ * g_idle_add(); the first answer replaces the rows, later ones are
+ * appended, as in RGMainWindow::applyUnifiedSearchResults().
+ */
+struct UnifiedFixture {
+    vector<FakeBackend> backends;
+
+    GtkWidget* window = nullptr;
+    GtkWidget* entry = nullptr;
+    GtkTreeView* view = nullptr;
+    RGBackendFilterBar* filterBar = nullptr;
+    RGUnifiedPkgList* list = nullptr;
+
+    SnapshotPublisher publisher;
+    unsigned serial = 0;
+    bool painted = false;
+    atomic<int> pending{0};
+
+    struct Delivery {
+        UnifiedFixture* fixture;
+        unsigned serial;
+        vector<PackageInfo> results;
+    };
+
+    UnifiedFixture()
+    {
+        size_t count = 4000 * g_scale;
+        backends.emplace_back(BackendType::APT, count * 5, 1);
+        backends.emplace_back(BackendType::SNAP, count, 2);
+        backends.emplace_back(BackendType::FLATPAK, count, 3);
+    }
+
+    ~UnifiedFixture()
+    {
+        drain();
+        if (window) gtk_widget_destroy(window);
+        delete filterBar;
+        if (list) g_object_unref(list);
+    }
+
+    void build()
+    {
+        window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_window_set_default_size(GTK_WINDOW(window), 1000, 700);
+        GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+        gtk_container_add(GTK_CONTAINER(window), box);
+
+        entry = gtk_search_entry_new();
+        gtk_widget_set_name(entry, "entry_fast_search");
+        g_signal_connect(entry, "changed", G_CALLBACK(onSearchChanged), this);
+        gtk_box_pack_start(GTK_BOX(box), entry, FALSE, FALSE, 0);
+
+        filterBar = new RGBackendFilterBar(nullptr);
+        filterBar->setChangedCallback([this](const BackendFilter& filter) {
+            rg_unified_pkg_list_set_filter(list, filter, view);
+            search(gtk_entry_get_text(GTK_ENTRY(entry)));
+        });
+        gtk_box_pack_start(GTK_BOX(box), filterBar->getWidget(), FALSE, FALSE, 0);
+
+        list = rg_unified_pkg_list_new(nullptr);
+        view = GTK_TREE_VIEW(gtk_tree_view_new());
+        static const struct { const char* title; int column; } columns[] = {
+            {"Package", UPKG_COL_PACKAGE_NAME},
+            {"Source", UPKG_COL_BACKEND_BADGE},
+            {"Installed", UPKG_COL_INSTALLED_VERSION},
+            {"Available", UPKG_COL_AVAILABLE_VERSION},
+            {"Size", UPKG_COL_SIZE},
+            {"Description", UPKG_COL_DESCRIPTION},
+        };
+        for (const auto& c : columns) {
+            GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes(
+                c.title, gtk_cell_renderer_text_new(), "text", c.column, nullptr);
+            gtk_tree_view_column_set_sort_column_id(column, c.column);
+            gtk_tree_view_append_column(view, column);
+        }
+        gtk_tree_selection_set_mode(gtk_tree_view_get_selection(view),
+                                    GTK_SELECTION_MULTIPLE);
+
+        GtkWidget* scroll = gtk_scrolled_window_new(nullptr, nullptr);
+        gtk_container_add(GTK_CONTAINER(scroll), GTK_WIDGET(view));
+        gtk_box_pack_start(GTK_BOX(box), scroll, TRUE, TRUE, 0);
+
+        gtk_widget_show_all(window);
+    }
+
+    // Start a search superseding the previous one; an empty query loads
+    // the installed packages
+    void search(const string& query)
+    {
+        unsigned mySerial = ++serial;
+        painted = false;
+
+        BackendFilter filter = filterBar->getFilter();
+        for (const auto& backend : backends) {
+            if (!filter.includes(backend.type)) continue;
+            pending++;
+            const FakeBackend* b = &backend;
+            thread([this, b, query, mySerial]() {
+                Delivery* job = new Delivery;
+                job->fixture = this;
+                job->serial = mySerial;
+                job->results = b->search(query, 200);
+                g_idle_add(applyResults, job);
+            }).detach();
+        }
+    }
+
+    static gboolean applyResults(gpointer data)
+    {
+        Delivery* job = (Delivery*)data;
+        UnifiedFixture* me = job->fixture;
+
+        if (job->serial == me->serial) {
+            if (!me->painted) {
+                me->publisher.publish(std::move(job->results), job->serial);
+                me->painted = true;
+            } else {
+                me->publisher.append(job->results, job->serial);
+            }
+            me->show();
+        }
+        me->pending--;
+
+        delete job;
+        return FALSE;
+    }
+
+    // As RGMainWindow::updateUnifiedTreeView()
+    void show()
+    {
+        PackageSnapshotPtr latest = publisher.current();
+        if (gtk_tree_view_get_model(view) == GTK_TREE_MODEL(list)) {
+            if (latest != rg_unified_pkg_list_get_packages(list)) {
+                rg_unified_pkg_list_set_packages(list, latest, view);
+            }
+        } else {
+            rg_unified_pkg_list_set_packages(list, latest);
+            gtk_tree_view_set_model(view, GTK_TREE_MODEL(list));
+        }
+    }
+
+    static void onSearchChanged(GtkEditable* editable, gpointer data)
+    {
+        UnifiedFixture* me = (UnifiedFixture*)data;
+        me->search(gtk_entry_get_text(GTK_ENTRY(editable)));
+    }
+
+    // Run the main loop until every delivery has arrived and nothing
+    // else is queued, including the redraws the step caused
+    void drain()
+    {
+        while (pending > 0) {
+            gtk_main_iteration_do(TRUE);
+        }
+        if (window) {
+            gtk_widget_queue_draw(window);
+        }
+        while (gtk_events_pending()) {
+            gtk_main_iteration_do(FALSE);
+        }
+    }
+
+    int rowCount()
+    {
+        return gtk_tree_model_iter_n_children(GTK_TREE_MODEL(list), nullptr);
+    }
+};
+
+/**
+ * Time action() plus the main loop work it causes
+ */
+static void step(UnifiedFixture& fixture, const string& journey,
+                 const string& name, const function<void()>& action)
+{
+    auto start = chrono::steady_clock::now();
+    action();
+    fixture.drain();
+    auto end = chrono::steady_clock::now();
+    record(journey, name, chrono::duration<double, milli>(end - start).count());
+}
+
+// ============================================================================
+// Journeys
+// ============================================================================
+
+static void journeyLaunch()
+{
+    if (!selected("launch")) return;
+
+    // The catalogs are fixtures, not startup work
+    UnifiedFixture fixture;
+    auto start = chrono::steady_clock::now();
+    fixture.build();
+    fixture.search("");
+    fixture.drain();
+    auto end = chrono::steady_clock::now();
+    record("launch", "first_paint",
+           chrono::duration<double, milli>(end - start).count());
+}
+
+static void journeyTypeQuery(UnifiedFixture& fixture)
+{
+    if (!selected("type_query")) return;
+
+    static const char* const query = "media player";
+    gtk_entry_set_text(GTK_ENTRY(fixture.entry), "");
+    fixture.drain();
+
+    string typed;
+    for (const char* c = query; *c; c++) {
+        typed += *c;
+        step(fixture, "type_query", "keystroke", [&]() {
+            gtk_entry_set_text(GTK_ENTRY(fixture.entry), typed.c_str());
+        });
+    }
+}
+
+static void journeyToggleSource(UnifiedFixture& fixture)
+{
+    if (!selected("toggle_source")) return;
+
+    static const struct { const char* name; BackendType type; } sources[] = {
+        {"apt", BackendType::APT},
+        {"snap", BackendType::SNAP},
+        {"flatpak", BackendType::FLATPAK},
+    };
+    for (const auto& source : sources) {
+        BackendFilter filter = BackendFilter::All();
+        switch (source.type) {
+            case BackendType::APT: filter.includeApt = false; break;
+            case BackendType::SNAP: filter.includeSnap = false; break;
+            default: filter.includeFlatpak = false; break;
+        }
+        step(fixture, "toggle_source", string(source.name) + "_off", [&]() {
+            fixture.filterBar->setFilter(filter);
+        });
+        step(fixture, "toggle_source", string(source.name) + "_on", [&]() {
+            fixture.filterBar->setFilter(BackendFilter::All());
+        });
+    }
+}
+
+static void journeySortColumn(UnifiedFixture& fixture)
+{
+    if (!selected("sort_column")) return;
+
+    GtkTreeSortable* sortable = GTK_TREE_SORTABLE(fixture.list);
+    for (int col = 0; col < 6; col++) {
+        GtkTreeViewColumn* column = gtk_tree_view_get_column(fixture.view, col);
+        string title = gtk_tree_view_column_get_title(column);
+        int sortColumn = gtk_tree_view_column_get_sort_column_id(column);
+        step(fixture, "sort_column", title + "_asc", [&]() {
+            gtk_tree_sortable_set_sort_column_id(sortable, sortColumn,
+                                                 GTK_SORT_ASCENDING);
+        });
+        step(fixture, "sort_column", title + "_desc", [&]() {
+            gtk_tree_sortable_set_sort_column_id(sortable, sortColumn,
+                                                 GTK_SORT_DESCENDING);
+        });
+    }
+}
+
+static void journeyMarkPackages(UnifiedFixture& fixture)
+{
+    if (!selected("mark_packages")) return;
+
+    GtkTreeModel* model = GTK_TREE_MODEL(fixture.list);
+    GtkTreeSelection* selection = gtk_tree_view_get_selection(fixture.view);
+    int rows = fixture.rowCount();
+    for (int i = 0; i < 100 && i < rows; i++) {
+        step(fixture, "mark_packages", "mark", [&]() {
+            GtkTreePath* path = gtk_tree_path_new_from_indices(i, -1);
+            gtk_tree_selection_unselect_all(selection);
+            gtk_tree_selection_select_path(selection, path);
+            gtk_tree_view_scroll_to_cell(fixture.view, path, nullptr, FALSE, 0, 0);
+
+            GtkTreeIter iter;
+            if (gtk_tree_model_get_iter(model, &iter, path)) {
+                PackageInfo* pkg = nullptr;
+                gtk_tree_model_get(model, &iter, UPKG_COL_PACKAGE_PTR, &pkg, -1);
+                if (pkg) pkg->isMarkedForInstall = true;
+                gtk_tree_model_row_changed(model, path, &iter);
+            }
+            gtk_tree_path_free(path);
+        });
+    }
+}
+
+static void journeyOpenDetails(UnifiedFixture& fixture)
+{
+    if (!selected("open_details")) return;
+
+    GtkTreeModel* model = GTK_TREE_MODEL(fixture.list);
+    int rows = fixture.rowCount();
+    for (int i = 0; i < 10 && i < rows; i++) {
+        GtkWidget* dialog = nullptr;
+        step(fixture, "open_details", "open", [&]() {
+            GtkTreeIter iter;
+            PackageInfo* pkg = nullptr;
+            if (gtk_tree_model_iter_nth_child(model, &iter, nullptr, i)) {
+                gtk_tree_model_get(model, &iter, UPKG_COL_PACKAGE_PTR, &pkg, -1);
+            }
+            if (!pkg) return;
+
+            // Stands in for the details window: one label per field
+            dialog = gtk_dialog_new();
+            gtk_window_set_transient_for(GTK_WINDOW(dialog),
+                                         GTK_WINDOW(fixture.window));
+            GtkWidget* area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+            const string fields[] = {
+                pkg->name, pkg->version, pkg->installedVersion,
+                format_size(pkg->downloadSize), pkg->summary, pkg->description
+            };
+            for (const auto& field : fields) {
+                gtk_box_pack_start(GTK_BOX(area), gtk_label_new(field.c_str()),
+                                   FALSE, FALSE, 0);
+            }
+            gtk_widget_show_all(dialog);
+        });
+        if (dialog) {
+            gtk_widget_destroy(dialog);
+            fixture.drain();
+        }
+    }
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char** argv)
+{
+    if (!gtk_init_check(&argc, &argv)) {
+        cout << "{\"journey\":\"all\",\"skipped\":\"no display\"}" << endl;
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            g_runs = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            g_scale = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            g_filter = argv[++i];
+        } else if (strcmp(argv[i], "--apt-delay") == 0 && i + 1 < argc) {
+            g_delayMs[(int)BackendType::APT] = max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--snap-delay") == 0 && i + 1 < argc) {
+            g_delayMs[(int)BackendType::SNAP] = max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--flatpak-delay") == 0 && i + 1 < argc) {
+            g_delayMs[(int)BackendType::FLATPAK] = max(0, atoi(argv[++i]));
+        } else {
+            cerr << "usage: " << argv[0]
+                 << " [--runs N] [--scale N] [--filter SUBSTRING]"
+                 << " [--apt-delay MS] [--snap-delay MS] [--flatpak-delay MS]"
+                 << endl;
+            return 2;
+        }
+    }
+
+    for (int run = 0; run < g_runs; run++) {
+        journeyLaunch();
+
+        // The other journeys start from a launched window
+        UnifiedFixture fixture;
+        fixture.build();
+        fixture.search("");
+        fixture.drain();
+
+        journeyTypeQuery(fixture);
+        journeyToggleSource(fixture);
+        journeySortColumn(fixture);
+        journeyMarkPackages(fixture);
+        journeyOpenDetails(fixture);
+    }
+
+    report();
+    return 0;
+}
+
+// vim:ts=4:sw=4:et
@@ -0,0 +1,458 @@
+/* parsercorpus.h - Snap and Flatpak CLI output corpus for parser tests
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file rebuilds, from a fixed seed, the outputs the snap and
+ * flatpak parsers read: snap's column-aligned tables (find, list,
+ * refresh --list), flatpak's tab-separated --columns listings (search,
+ * list, remote-ls of a whole remote) and snapd's JSON. The shapes
+ * follow the real tools: snap pads every column to its widest cell
+ * plus two spaces and translates its headers, flatpak never pads and
+ * leaves empty columns empty. On top of store-sized listings it holds
+ * the outputs that have broken parsers before: other locales, very
+ * wide cells, Windows line ends, missing columns, a cut-off last line
+ * and lines far longer than a pipe buffer. Each sample knows how many
+ * packages a correct parser finds in it, so a parser rewrite can be
+ * checked against all of them and timed on the same inputs.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _PARSERCORPUS_H_
+#define _PARSERCORPUS_H_
+
+#include "snapbackend.h"
+#include "flatpakbackend.h"
+#include "snapdclient.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace PolySynaptic {
+
+/**
+ * CorpusSample - One captured-shape output and what it holds
+ */
+struct CorpusSample {
+    enum class Format {
+        SNAP_FIND,
+        SNAP_LIST,
+        SNAP_REFRESH,
+        FLATPAK_SEARCH,
+        FLATPAK_LIST,
+        FLATPAK_UPDATES,    // remote-ls, the columns of --updates
+        SNAPD_JSON          // GET /v2/find
+    };
+
+    std::string name;
+    Format format;
+    std::string text;
+    size_t rows;            // Packages a correct parser reports
+};
+
+/**
+ * ParserCorpus - Builds the samples and runs them through the parsers
+ *
+ *     for (const CorpusSample& sample : ParserCorpus::pathological())
+ *         ASSERT_EQ(ParserCorpus::parse(sample, 1), sample.rows);
+ */
+class ParserCorpus {
+public:
+    /**
+     * Store-sized listings: the whole Snap Store's answer to a broad
+     * find, a machine's snap list, the whole of Flathub's remote-ls,
+     * a flatpak search and the same through snapd's JSON; scale
+     * multiplies the package counts
+     */
+    static std::vector<CorpusSample> realWorld(size_t scale = 1)
+    {
+        std::vector<CorpusSample> samples;
+        samples.push_back(snapFind("snap_find_store", 12000 * scale, 1, LOCALE_C));
+        samples.push_back(snapList("snap_list", 400 * scale, 2));
+        samples.push_back(snapRefresh("snap_refresh_list", 60 * scale, 3));
+        samples.push_back(flatpakRemoteLs("flatpak_remote_ls_flathub", 4500 * scale, 4));
+        samples.push_back(flatpakSearch("flatpak_search", 3000 * scale, 5, false));
+        samples.push_back(flatpakList("flatpak_list", 300 * scale, 6));
+        samples.push_back(snapdFind("snapd_find_json", 12000 * scale, 7));
+        return samples;
+    }
+
+    /**
+     * Localized and oddly shaped outputs a parser must read the same
+     */
+    static std::vector<CorpusSample> locales()
+    {
+        std::vector<CorpusSample> samples;
+        samples.push_back(snapFind("snap_find_fr", 500, 11, LOCALE_FR));
+        samples.push_back(snapFind("snap_find_ja", 500, 12, LOCALE_JA));
+        samples.push_back(snapFind("snap_find_wide", 200, 13, LOCALE_WIDE));
+        samples.push_back(flatpakSearch("flatpak_search_utf8", 500, 14, true));
+        return samples;
+    }
+
+    /**
+     * Inputs that have broken line and column parsing before
+     */
+    static std::vector<CorpusSample> pathological()
+    {
+        using Format = CorpusSample::Format;
+        std::vector<CorpusSample> samples;
+
+        // Nothing but the header, or nothing at all
+        samples.push_back({"snap_find_header_only", Format::SNAP_FIND,
+                           "Name  Version  Publisher  Notes  Summary\n", 0});
+        samples.push_back({"flatpak_list_empty", Format::FLATPAK_LIST, "", 0});
+
+        // What refresh --list says when nothing is to be updated
+        samples.push_back({"snap_refresh_up_to_date", Format::SNAP_REFRESH,
+                           "All snaps up to date.\n", 0});
+
+        // Windows line ends, blank and whitespace-only lines
+        samples.push_back({"snap_find_crlf", Format::SNAP_FIND,
+                           "Name   Version  Publisher  Notes  Summary\r\n"
+                           "hello  2.10     canonical  -      GNU Hello\r\n"
+                           "\r\n"
+                           "   \r\n"
+                           "code   1.85     vscode     classic  Code editing\r\n", 2});
+        samples.push_back({"flatpak_list_crlf", Format::FLATPAK_LIST,
+                           "org.a.App\tApp\t1.0\tstable\tflathub\r\n"
+                           "\r\n"
+                           "org.b.App\tB\r\n", 2});
+
+        // The last line cut off where the pipe closed; what is left of
+        // it is still a package, by name
+        samples.push_back({"snap_list_truncated", Format::SNAP_LIST,
+                           "Name    Version  Rev   Tracking       Publisher  Notes\n"
+                           "core20  2023     2105  latest/stable  canonical  base\n"
+                           "firef", 2});
+
+        // Columns missing from the right, lines too short to keep and
+        // a line of empty columns
+        samples.push_back({"flatpak_missing_columns", Format::FLATPAK_SEARCH,
+                           "org.a.App\tA\tSummary\t1.0\tflathub\n"
+                           "org.b.App\tB\tSummary\t2.0\n"
+                           "org.c.App\tC\tSummary\n"
+                           "\t\t\t\t\n"
+                           "org.d.App\n", 2});
+
+        // Tabs inside a snap table, and a row reduced to its name
+        samples.push_back({"snap_find_tabs", Format::SNAP_FIND,
+                           "Name\tVersion\tPublisher\tNotes\tSummary\n"
+                           "hello\t2.10\tcanonical\t-\tGNU\tHello\n"
+                           "lonely\n", 2});
+
+        // One summary far longer than a pipe buffer
+        samples.push_back({"snap_find_huge_line", Format::SNAP_FIND,
+                           "Name   Version  Publisher  Notes  Summary\n"
+                           "hello  2.10     canonical  -      " + std::string(1 << 20, 'x') + "\n", 1});
+        samples.push_back({"flatpak_huge_line", Format::FLATPAK_SEARCH,
+                           "org.a.App\tA\t" + std::string(1 << 20, 'y') + "\t1.0\tflathub\n", 1});
+
+        // Stray control bytes
+        samples.push_back({"flatpak_control_bytes", Format::FLATPAK_LIST,
+                           std::string("org.a.App\tA\x01\x7f\t1.0\n", 18) +
+                           std::string("org.b\0App\tB\n", 12), 2});
+        return samples;
+    }
+
+    /**
+     * The packages the parser for sample.format finds in it, fed in
+     * pieces of chunk bytes (0 for all at once)
+     */
+    static size_t parse(const CorpusSample& sample, size_t chunk = 0)
+    {
+        using Format = CorpusSample::Format;
+        size_t rows = 0;
+        auto count = [&rows](PackageInfo&&) { rows++; };
+
+        switch (sample.format) {
+        case Format::SNAP_FIND:
+        case Format::SNAP_LIST:
+        case Format::SNAP_REFRESH: {
+            SnapOutputParser parser(snapTable(sample.format), count);
+            feed(parser, sample.text, chunk);
+            parser.finish();
+            break;
+        }
+        case Format::FLATPAK_SEARCH:
+        case Format::FLATPAK_LIST:
+        case Format::FLATPAK_UPDATES: {
+            FlatpakOutputParser parser(flatpakTable(sample.format), count);
+            feed(parser, sample.text, chunk);
+            parser.finish();
+            break;
+        }
+        case Format::SNAPD_JSON: {
+            std::vector<SnapdSnap> snaps;
+            std::string error;
+            if (SnapdClient::parseSnapList(sample.text, snaps, error)) {
+                for (const auto& snap : snaps) {
+                    count(SnapBackend::fromSnapdSnap(snap, true));
+                }
+            }
+            break;
+        }
+        }
+        return rows;
+    }
+
+private:
+    enum Locale { LOCALE_C, LOCALE_FR, LOCALE_JA, LOCALE_WIDE };
+
+    static const char* word(std::mt19937& rng)
+    {
+        static const char* const WORDS[] = {
+            "audio", "browser", "editor", "image", "media", "office",
+            "player", "python", "shell", "terminal", "video", "viewer",
+            "web", "notes", "music", "games", "chat", "mail", "maps"
+        };
+        std::uniform_int_distribution<size_t> pick(0, sizeof(WORDS) / sizeof(WORDS[0]) - 1);
+        return WORDS[pick(rng)];
+    }
+
+    static std::string summary(std::mt19937& rng, Locale locale)
+    {
+        static const char* const FR[] = {
+            "Éditeur de texte léger", "Lecteur multimédia", "Navigateur Web rapide",
+            "Gestionnaire de tâches", "Client de messagerie sécurisé"
+        };
+        static const char* const JA[] = {
+            "軽量テキストエディタ",
+            "メディアプレーヤー",
+            "高速なウェブブラウザ"
+        };
+        std::uniform_int_distribution<size_t> pick(0, 4);
+        switch (locale) {
+        case LOCALE_FR:
+            return FR[pick(rng)];
+        case LOCALE_JA:
+            return JA[pick(rng) % 3];
+        case LOCALE_WIDE: {
+            std::string s;
+            for (int i = 0; i < 120; i++) {
+                s += i ? " " : "";
+                s += word(rng);
+            }
+            return s;
+        }
+        case LOCALE_C:
+            break;
+        }
+        std::string s = word(rng);
+        for (int i = 0; i < 6; i++) {
+            s += " ";
+            s += word(rng);
+        }
+        return s;
+    }
+
+    // Columns padded to the widest cell plus two spaces, as snap's
+    // tabwriter does; the last column is not padded
+    static std::string alignColumns(const std::vector<std::vector<std::string>>& rows)
+    {
+        std::vector<size_t> widths;
+        for (const auto& row : rows) {
+            widths.resize(std::max(widths.size(), row.size()), 0);
+            for (size_t c = 0; c + 1 < row.size(); c++) {
+                widths[c] = std::max(widths[c], row[c].size());
+            }
+        }
+        std::string out;
+        for (const auto& row : rows) {
+            for (size_t c = 0; c < row.size(); c++) {
+                out += row[c];
+                if (c + 1 < row.size()) {
+                    out.append(widths[c] + 2 - row[c].size(), ' ');
+                }
+            }
+            out += '\n';
+        }
+        return out;
+    }
+
+    static CorpusSample snapFind(const std::string& name, size_t count,
+                                 unsigned seed, Locale locale)
+    {
+        std::mt19937 rng(seed);
+        std::vector<std::vector<std::string>> rows;
+        if (locale == LOCALE_FR) {
+            rows.push_back({"Nom", "Version", "Éditeur", "Notes", "Résumé"});
+        } else if (locale == LOCALE_JA) {
+            rows.push_back({"名前", "バージョン",
+                            "発行元", "注記", "概要"});
+        } else {
+            rows.push_back({"Name", "Version", "Publisher", "Notes", "Summary"});
+        }
+        // Verified publishers are starred, or ticked in a UTF-8 locale
+        const char* verified = locale == LOCALE_C ? "**" : "✓";
+        for (size_t i = 0; i < count; i++) {
+            std::string snap = std::string(word(rng)) + "-" + word(rng) + std::to_string(i);
+            if (locale == LOCALE_WIDE) {
+                snap += "-with-a-very-long-name";
+            }
+            rows.push_back({snap,
+                            std::to_string(i % 9) + "." + std::to_string(i % 31) + "-beta",
+                            std::string("pub") + std::to_string(i % 70) + (i % 3 ? "" : verified),
+                            i % 11 ? "-" : "classic",
+                            summary(rng, locale)});
+        }
+        return {name, CorpusSample::Format::SNAP_FIND, alignColumns(rows), count};
+    }
+
+    static CorpusSample snapList(const std::string& name, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<std::vector<std::string>> rows;
+        rows.push_back({"Name", "Version", "Rev", "Tracking", "Publisher", "Notes"});
+        static const char* const NOTES[] = {"-", "base", "classic", "snapd", "disabled,classic"};
+        for (size_t i = 0; i < count; i++) {
+            rows.push_back({std::string(word(rng)) + std::to_string(i),
+                            "2024." + std::to_string(i % 12),
+                            std::to_string(1000 + i),
+                            i % 7 ? "latest/stable" : "latest/edge/fix-" + std::to_string(i),
+                            std::string("pub") + std::to_string(i % 40),
+                            NOTES[i % 5]});
+        }
+        return {name, CorpusSample::Format::SNAP_LIST, alignColumns(rows), count};
+    }
+
+    static CorpusSample snapRefresh(const std::string& name, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<std::vector<std::string>> rows;
+        rows.push_back({"Name", "Version", "Rev", "Size", "Publisher", "Notes"});
+        for (size_t i = 0; i < count; i++) {
+            rows.push_back({std::string(word(rng)) + std::to_string(i),
+                            "1." + std::to_string(i),
+                            std::to_string(2000 + i),
+                            std::to_string(10 + i % 300) + "MB",
+                            std::string("pub") + std::to_string(i % 40),
+                            "-"});
+        }
+        return {name, CorpusSample::Format::SNAP_REFRESH, alignColumns(rows), count};
+    }
+
+    static std::string appId(std::mt19937& rng, size_t i)
+    {
+        return std::string(i % 4 ? "org." : "io.github.") + word(rng) + "." +
+               word(rng) + std::to_string(i);
+    }
+
+    // Apps followed by the runtimes and extensions a full remote-ls
+    // also lists
+    static CorpusSample flatpakRemoteLs(const std::string& name, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::string out;
+        for (size_t i = 0; i < count; i++) {
+            bool runtime = i % 3 == 0;
+            std::string id = runtime ? "org.freedesktop.Platform.GL." + std::string(word(rng)) + std::to_string(i)
+                                     : appId(rng, i);
+            out += id + "\t" + word(rng) + "\t" +
+                   (i % 5 ? std::to_string(i % 40) + ".0" : "") + "\t" +
+                   (runtime ? std::to_string(20 + i % 5) + ".08" : "stable") + "\tflathub\n";
+        }
+        return {name, CorpusSample::Format::FLATPAK_UPDATES, out, count};
+    }
+
+    static CorpusSample flatpakSearch(const std::string& name, size_t count,
+                                      unsigned seed, bool utf8)
+    {
+        std::mt19937 rng(seed);
+        std::string out;
+        for (size_t i = 0; i < count; i++) {
+            std::string title = word(rng);
+            if (utf8) {
+                title += i % 2 ? " édition \U0001F3B5" : " مشغل";
+            }
+            out += appId(rng, i) + "\t" + title + "\t" +
+                   summary(rng, utf8 ? LOCALE_JA : LOCALE_C) + "\t" +
+                   std::to_string(i % 30) + "." + std::to_string(i % 7) + "\t" +
+                   (i % 4 ? "flathub" : "flathub,fedora") + "\n";
+        }
+        return {name, CorpusSample::Format::FLATPAK_SEARCH, out, count};
+    }
+
+    static CorpusSample flatpakList(const std::string& name, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::string out;
+        for (size_t i = 0; i < count; i++) {
+            out += appId(rng, i) + "\t" + word(rng) + "\t" + std::to_string(i % 20) +
+                   ".1\tstable\t" + (i % 5 ? "flathub" : "flathub-beta") + "\t" +
+                   std::to_string(1 + i % 900) + ".4 MB\n";
+        }
+        return {name, CorpusSample::Format::FLATPAK_LIST, out, count};
+    }
+
+    static CorpusSample snapdFind(const std::string& name, size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::ostringstream body;
+        body << "{\"type\":\"sync\",\"status-code\":200,\"status\":\"OK\",\"result\":[";
+        for (size_t i = 0; i < count; i++) {
+            std::string snap = std::string(word(rng)) + "-" + word(rng) + std::to_string(i);
+            body << (i ? "," : "")
+                 << "{\"id\":\"id" << i << "\",\"name\":\"" << snap << "\","
+                 << "\"version\":\"1." << i % 30 << "\",\"revision\":\"" << 100 + i << "\","
+                 << "\"summary\":\"" << summary(rng, LOCALE_C) << "\","
+                 << "\"description\":\"" << summary(rng, LOCALE_WIDE) << "\\n\\u00e9\","
+                 << "\"status\":\"available\",\"confinement\":\""
+                 << (i % 11 ? "strict" : "classic") << "\","
+                 << "\"download-size\":" << 4096 * (i + 1) << ","
+                 << "\"publisher\":{\"id\":\"p\",\"username\":\"pub" << i % 70
+                 << "\",\"validation\":\"" << (i % 3 ? "unproven" : "verified") << "\"},"
+                 << "\"channels\":{\"latest/stable\":{\"version\":\"1." << i % 30
+                 << "\",\"size\":1}},\"apps\":[{\"name\":\"" << snap << "\"}]}";
+        }
+        body << "]}";
+        return {name, CorpusSample::Format::SNAPD_JSON, body.str(), count};
+    }
+
+    static SnapOutputParser::Table snapTable(CorpusSample::Format format)
+    {
+        switch (format) {
+        case CorpusSample::Format::SNAP_LIST:
+            return SnapOutputParser::Table::LIST;
+        case CorpusSample::Format::SNAP_REFRESH:
+            return SnapOutputParser::Table::REFRESH_LIST;
+        default:
+            return SnapOutputParser::Table::FIND;
+        }
+    }
+
+    static FlatpakOutputParser::Table flatpakTable(CorpusSample::Format format)
+    {
+        switch (format) {
+        case CorpusSample::Format::FLATPAK_LIST:
+            return FlatpakOutputParser::Table::LIST;
+        case CorpusSample::Format::FLATPAK_UPDATES:
+            return FlatpakOutputParser::Table::UPDATES;
+        default:
+            return FlatpakOutputParser::Table::SEARCH;
+        }
+    }
+
+    template <typename Parser>
+    static void feed(Parser& parser, const std::string& text, size_t chunk)
+    {
+        if (chunk == 0) {
+            chunk = text.size();
+        }
+        for (size_t at = 0; at < text.size(); at += chunk) {
+            parser.feed(text.data() + at, std::min(chunk, text.size() - at));
+        }
+    }
+};
+
+} // namespace PolySynaptic
+
+#endif // _PARSERCORPUS_H_
+
+// vim:ts=4:sw=4:et
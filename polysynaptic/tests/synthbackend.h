@@ -0,0 +1,305 @@
+/* synthbackend.h - Synthetic package backend for scaling tests
+ *
+ * Copyright (c) 2024 PolySynaptic Contributors
+ *
+ * This file provides an IPackageBackend that answers from a generated
+ * catalog of any size, with injected latency and jitter, so callers of
+ * the backend interface can be measured at 10k to 1M packages without
+ * apt, snapd or flatpak.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ */
+
+#ifndef _SYNTHBACKEND_H_
+#define _SYNTHBACKEND_H_
+
+#include "ipackagebackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace PolySynaptic {
+
+/**
+ * SynthConfig - Shape of a synthetic catalog
+ *
+ * The defaults approximate a desktop system: a few percent installed,
+ * a few of those with updates, sizes log-normally spread around a
+ * megabyte, Zipf-distributed words in names and summaries.
+ */
+struct SynthConfig {
+    BackendType type = BackendType::APT;
+    size_t count = 10000;
+    unsigned seed = 1;
+
+    double installedRatio = 0.06;   // Share of packages installed
+    double upgradableRatio = 0.1;   // Share of installed with an update
+    double sharedNameRatio = 0.05;  // Share named after a common app, so
+                                    // other backends have it too
+
+    int latencyMs = 0;              // Added to every query
+    int jitterMs = 0;               // Uniform extra latency, 0..jitterMs
+};
+
+/**
+ * SynthBackend - IPackageBackend over a generated catalog
+ *
+ * Generation is deterministic for a given configuration. Searches are
+ * substring matches on names and summaries. Install, remove and update
+ * change the catalog in place and always succeed.
+ */
+class SynthBackend : public IPackageBackend {
+public:
+    explicit SynthBackend(const SynthConfig& config)
+        : _config(config)
+        , _jitter(config.seed ^ 0x9e3779b9u)
+    {
+        generate();
+    }
+
+    const SynthConfig& getConfig() const { return _config; }
+    const vector<PackageInfo>& catalog() const { return _catalog; }
+
+    // ========================================================================
+    // IPackageBackend
+    // ========================================================================
+
+    BackendType getType() const override { return _config.type; }
+    string getName() const override {
+        return string("Synthetic ") + backendTypeToString(_config.type);
+    }
+    bool isAvailable() const override { return true; }
+    string getUnavailableReason() const override { return ""; }
+    string getVersion() const override { return "1.0"; }
+
+    vector<PackageInfo> searchPackages(
+        const SearchOptions& options,
+        ProgressCallback progress = nullptr) override
+    {
+        if (!delay(options.isCancelled)) return {};
+
+        lock_guard<mutex> lock(_mutex);
+        vector<PackageInfo> results;
+        for (const auto& pkg : _catalog) {
+            if (options.installedOnly && !pkg.isInstalled()) continue;
+            if (options.availableOnly && pkg.isInstalled()) continue;
+            if (!options.query.empty() &&
+                !(options.searchNames &&
+                  pkg.name.find(options.query) != string::npos) &&
+                !(options.searchDescriptions &&
+                  pkg.summary.find(options.query) != string::npos)) {
+                continue;
+            }
+            results.push_back(pkg);
+            if (options.maxResults > 0 &&
+                (int)results.size() >= options.maxResults) {
+                break;
+            }
+        }
+        return results;
+    }
+
+    vector<PackageInfo> getInstalledPackages(
+        ProgressCallback progress = nullptr) override
+    {
+        delay(nullptr);
+
+        lock_guard<mutex> lock(_mutex);
+        vector<PackageInfo> results;
+        for (const auto& pkg : _catalog) {
+            if (pkg.isInstalled()) results.push_back(pkg);
+        }
+        return results;
+    }
+
+    PackageInfo getPackageDetails(const string& packageId) override
+    {
+        delay(nullptr);
+
+        lock_guard<mutex> lock(_mutex);
+        auto it = _byId.find(packageId);
+        return it != _byId.end() ? _catalog[it->second] : PackageInfo();
+    }
+
+    InstallStatus getInstallStatus(const string& packageId) override
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _byId.find(packageId);
+        return it != _byId.end() ? _catalog[it->second].installStatus
+                                 : InstallStatus::UNKNOWN;
+    }
+
+    vector<PackageInfo> getUpgradablePackages(
+        ProgressCallback progress = nullptr) override
+    {
+        delay(nullptr);
+
+        lock_guard<mutex> lock(_mutex);
+        vector<PackageInfo> results;
+        for (const auto& pkg : _catalog) {
+            if (pkg.installStatus == InstallStatus::UPDATE_AVAILABLE) {
+                results.push_back(pkg);
+            }
+        }
+        return results;
+    }
+
+    OperationResult installPackage(const string& packageId,
+                                   ProgressCallback progress = nullptr) override
+    {
+        return change(packageId, InstallStatus::INSTALLED);
+    }
+
+    OperationResult removePackage(const string& packageId,
+                                  bool purge = false,
+                                  ProgressCallback progress = nullptr) override
+    {
+        return change(packageId, InstallStatus::NOT_INSTALLED);
+    }
+
+    OperationResult updatePackage(const string& packageId,
+                                  ProgressCallback progress = nullptr) override
+    {
+        return change(packageId, InstallStatus::INSTALLED);
+    }
+
+    OperationResult refreshCache(ProgressCallback progress = nullptr) override
+    {
+        delay(nullptr);
+        return OperationResult::Success();
+    }
+
+private:
+    SynthConfig _config;
+    vector<PackageInfo> _catalog;
+    unordered_map<string, size_t> _byId;
+    mt19937 _jitter;
+    mutex _mutex;
+
+    // Sleep for the configured latency in short slices, so a cancelled
+    // search returns early; false if it was cancelled
+    bool delay(const function<bool()>& isCancelled)
+    {
+        int ms = _config.latencyMs;
+        if (_config.jitterMs > 0) {
+            lock_guard<mutex> lock(_mutex);
+            ms += uniform_int_distribution<int>(0, _config.jitterMs)(_jitter);
+        }
+
+        auto until = chrono::steady_clock::now() + chrono::milliseconds(ms);
+        while (chrono::steady_clock::now() < until) {
+            if (isCancelled && isCancelled()) return false;
+            this_thread::sleep_for(min<chrono::steady_clock::duration>(
+                chrono::milliseconds(5), until - chrono::steady_clock::now()));
+        }
+        return !(isCancelled && isCancelled());
+    }
+
+    OperationResult change(const string& packageId, InstallStatus status)
+    {
+        delay(nullptr);
+
+        lock_guard<mutex> lock(_mutex);
+        auto it = _byId.find(packageId);
+        if (it == _byId.end()) {
+            return OperationResult::Failure("Unknown package: " + packageId);
+        }
+        PackageInfo& pkg = _catalog[it->second];
+        pkg.installStatus = status;
+        pkg.installedVersion = status == InstallStatus::NOT_INSTALLED
+                             ? "" : pkg.version;
+        return OperationResult::Success();
+    }
+
+    void generate()
+    {
+        static const char* const words[] = {
+            "lib", "gtk", "python3", "data", "dev", "common", "utils", "doc",
+            "qt", "plugin", "media", "audio", "video", "editor", "viewer",
+            "server", "client", "tools", "fonts", "theme", "game", "rust",
+            "perl", "driver", "firmware", "shell", "office", "image", "web",
+            "network", "terminal", "browser", "player", "studio", "kde"
+        };
+        static const char* const apps[] = {
+            "firefox", "chromium", "vlc", "gimp", "inkscape", "blender",
+            "libreoffice", "thunderbird", "audacity", "krita", "obs-studio",
+            "spotify", "code", "discord", "telegram-desktop", "steam"
+        };
+        static const char* const sections[] = {
+            "libs", "utils", "devel", "doc", "admin", "net", "graphics",
+            "sound", "video", "games", "text", "web", "python", "x11", "misc"
+        };
+        const size_t wordCount = sizeof(words) / sizeof(words[0]);
+        const size_t appCount = sizeof(apps) / sizeof(apps[0]);
+        const size_t sectionCount = sizeof(sections) / sizeof(sections[0]);
+
+        // Zipf weights: a few words account for most of the text
+        vector<double> weights(wordCount);
+        for (size_t i = 0; i < wordCount; i++) weights[i] = 1.0 / (i + 1);
+
+        mt19937 rng(_config.seed);
+        discrete_distribution<size_t> word(weights.begin(), weights.end());
+        discrete_distribution<size_t> section(weights.begin(),
+                                              weights.begin() + sectionCount);
+        uniform_real_distribution<double> chance(0.0, 1.0);
+        uniform_int_distribution<size_t> app(0, appCount - 1);
+        uniform_int_distribution<int> nameWords(1, 3);
+        uniform_int_distribution<int> summaryWords(3, 12);
+        uniform_int_distribution<int> versionPart(0, 30);
+        lognormal_distribution<double> size(13.8, 1.6);   // ~1 MB median
+
+        _catalog.reserve(_config.count);
+        _byId.reserve(_config.count);
+        for (size_t i = 0; i < _config.count; i++) {
+            string name;
+            if (chance(rng) < _config.sharedNameRatio) {
+                name = apps[app(rng)];
+            } else {
+                for (int w = nameWords(rng); w > 0; w--) {
+                    if (!name.empty()) name += "-";
+                    name += words[word(rng)];
+                }
+            }
+            // Ids stay unique within the backend
+            string id = name + "-" + to_string(i);
+
+            PackageInfo pkg(id, name, _config.type);
+            for (int w = summaryWords(rng); w > 0; w--) {
+                if (!pkg.summary.empty()) pkg.summary += " ";
+                pkg.summary += words[word(rng)];
+            }
+            pkg.section = sections[section(rng)];
+            pkg.version = to_string(versionPart(rng) % 10) + "." +
+                          to_string(versionPart(rng)) + "-" +
+                          to_string(versionPart(rng) % 5 + 1);
+            pkg.downloadSize = (long)min(size(rng), 4e9);
+            pkg.installedSize = pkg.downloadSize * 3;
+            pkg.installStatus = InstallStatus::NOT_INSTALLED;
+            if (chance(rng) < _config.installedRatio) {
+                pkg.installStatus = InstallStatus::INSTALLED;
+                pkg.installedVersion = pkg.version;
+                if (chance(rng) < _config.upgradableRatio) {
+                    pkg.installStatus = InstallStatus::UPDATE_AVAILABLE;
+                    pkg.installedVersion = "0." + pkg.version;
+                }
+            }
+
+            _byId.emplace(id, _catalog.size());
+            _catalog.push_back(move(pkg));
+        }
+    }
+};
+
+} // namespace PolySynaptic
+
+#endif // _SYNTHBACKEND_H_
+
+// vim:ts=4:sw=4:et
@@ -22,6 +22,7 @@
 #include "snapbackend.h"
 #include "flatpakbackend.h"
 #include "backendmanager.h"
+#include "perfdiagnosis.h"
 
 using namespace std;
 using namespace PolySynaptic;
@@ -410,6 +411,30 @@ void diagnoseBackendManager() {
     }
 }
 
+// ============================================================================
+// Timing Diagnostics
+// ============================================================================
+
+void diagnoseTiming() {
+    printHeader("TIMING DIAGNOSTICS");
+
+    BackendManager manager(nullptr);
+    PerfDiagnosis diagnosis;
+    for (auto* backend : manager.getEnabledBackends()) {
+        diagnosis.addBackend(backend);
+    }
+
+    vector<DiagnosisResult> results = diagnosis.run();
+    cout << PerfDiagnosis::report(results);
+
+    const DiagnosisResult* worst = PerfDiagnosis::slowest(results);
+    if (worst && worst->ok) {
+        diagWarn(worst->component + " " + worst->operation + " is over its budget");
+    } else if (!worst) {
+        diagPass("Every backend operation is within its budget");
+    }
+}
+
 // ============================================================================
 // Summary
 // ============================================================================
@@ -455,6 +480,7 @@ int main(int argc, char** argv)
     diagnoseSnap();
     diagnoseFlatpak();
     diagnoseBackendManager();
+    diagnoseTiming();
     printSummary();
 
     return g_failCount > 0 ? 1 : 0;
@@ -17,11 +17,80 @@
 #include <iostream>
 #include <cassert>
 #include <sstream>
+#include <fstream>
+#include <thread>
+#include <map>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <poll.h>
 
 #include "ipackagebackend.h"
 #include "snapbackend.h"
+#include "snapdclient.h"
+#include "snaplocalstate.h"
 #include "flatpakbackend.h"
+#include "flatpakmetadata.h"
+#include "snapprovider.h"
+#include "appstreamindex.h"
+#include "packagecatalog.h"
+#include "rtrigramindex.h"
+#include "rnameindex.h"
+#include "rnameset.h"
+#include "rtextscan.h"
+#include "rsearchcache.h"
+#include "rarena.h"
+#include "rpackageset.h"
+#include "rviewsnapshot.h"
+#include "rfileindex.h"
+#include "rhistoryindex.h"
+#include "rcommitlog.h"
+#include "storeindex.h"
+#include "taskpool.h"
+#include "singleflight.h"
+#include "taskgraph.h"
+#include "asyncbackend.h"
+#include "progressaggregator.h"
+#include "updatechecker.h"
+#include "predownloadqueue.h"
+#include "desiredstate.h"
+#include "mediacache.h"
+#include "changelogreader.h"
+#include "packagesnapshot.h"
+#include "mirrorprobe.h"
+#include "sourcevalidator.h"
+#include "popularityindex.h"
+#include "packageranking.h"
+#include "cacheretention.h"
+#include "resultfilter.h"
+#include "categoryindex.h"
 #include "backendmanager.h"
+#include "transactionjournal.h"
+#include "operationhistory.h"
+#include "fuzzyindex.h"
+#include "snapchangewatcher.h"
+#include "structuredlog.h"
+#include "binarylog.h"
+#include "tracing.h"
+#include "latency.h"
+#include "memoryusage.h"
+#include "subprocess.h"
+#include "processgovernor.h"
+#include "probecache.h"
+#include "startupprofile.h"
+#include "perfdiagnosis.h"
+#include "stallwatch.h"
+#include "metrics.h"
+#include "frametiming.h"
+#include "rrecordcache.h"
+#include "rtasklist.h"
+#include "rautoremove.h"
+#include "rselectioncounts.h"
+#include "synthbackend.h"
+#include "parsercorpus.h"
 
 using namespace std;
 using namespace PolySynaptic;
@@ -141,6 +210,33 @@ TEST(PackageInfo_GetUniqueKey) {
     ASSERT_EQ(snap_pkg.getUniqueKey(), "firefox:Snap");
 }
 
+TEST(PackageInfo_Identity) {
+    PackageInfo apt_pkg("firefox", "Firefox", BackendType::APT);
+    PackageInfo snap_pkg("firefox", "Firefox", BackendType::SNAP);
+    PackageInfo renamed("firefox", "Firefox Web Browser", BackendType::APT);
+
+    // Backend and ID, like getUniqueKey(), without building the string
+    ASSERT_NE(apt_pkg.identity(), snap_pkg.identity());
+    ASSERT_EQ(apt_pkg.identity(), renamed.identity());
+    ASSERT_EQ(apt_pkg.identity(), packageIdentity(BackendType::APT, "firefox"));
+    ASSERT_NE(packageIdentity(BackendType::APT, "vim"),
+              packageIdentity(BackendType::APT, "vim-tiny"));
+}
+
+TEST(PackageInfo_InternedFields) {
+    PackageInfo a("vlc", "VLC", BackendType::FLATPAK);
+    PackageInfo b("gimp", "GIMP", BackendType::FLATPAK);
+    a.remote = "flathub";
+    b.remote = string("flat") + "hub";
+
+    // Equal values share one pooled string
+    ASSERT_EQ(&a.remote.str(), &b.remote.str());
+    ASSERT_TRUE(a.remote == b.remote);
+    ASSERT_EQ(a.remote, "flathub");
+    ASSERT_TRUE(a.branch.empty());
+    ASSERT_EQ(string(a.remote) + "/stable", "flathub/stable");
+}
+
 // ============================================================================
 // BackendType Tests
 // ============================================================================
@@ -330,6 +426,287 @@ TEST(SnapBackend_ValidSnapNames) {
     ASSERT_EQ(backend.getName(), "Snap");
 }
 
+// ============================================================================
+// snapd REST Client Tests
+// ============================================================================
+
+TEST(SnapdClient_ParseSnapList) {
+    string body =
+        "{\"type\":\"sync\",\"status-code\":200,\"status\":\"OK\",\"result\":["
+        "{\"id\":\"abc\",\"name\":\"hello\",\"version\":\"2.10\",\"revision\":\"38\","
+        "\"summary\":\"GNU Hello, the \\\"hello world\\\" snap\",\"status\":\"active\","
+        "\"confinement\":\"strict\",\"installed-size\":98304,"
+        "\"publisher\":{\"id\":\"x\",\"username\":\"canonical\",\"validation\":\"verified\"},"
+        "\"channels\":{\"latest/stable\":{\"version\":\"2.10\",\"size\":1},"
+        "\"latest/edge\":{\"version\":\"2.11\"}},\"apps\":[{\"name\":\"hello\"}]},"
+        "{\"name\":\"code\",\"version\":\"1.85\",\"confinement\":\"classic\",\"status\":\"available\"}"
+        "]}";
+
+    vector<SnapdSnap> snaps;
+    string error;
+    ASSERT_TRUE(SnapdClient::parseSnapList(body, snaps, error));
+    ASSERT_EQ(snaps.size(), 2u);
+
+    ASSERT_EQ(snaps[0].name, "hello");
+    ASSERT_EQ(snaps[0].summary, "GNU Hello, the \"hello world\" snap");
+    ASSERT_EQ(snaps[0].publisher, "canonical");
+    ASSERT_TRUE(snaps[0].isPublisherVerified());
+    ASSERT_TRUE(snaps[0].isInstalled());
+    ASSERT_EQ(snaps[0].installedSize, 98304);
+    ASSERT_EQ(snaps[0].channels.size(), 2u);
+    ASSERT_EQ(snaps[0].channels["latest/edge"], "2.11");
+
+    PackageInfo info = SnapBackend::fromSnapdSnap(snaps[1]);
+    ASSERT_EQ(info.backend, BackendType::SNAP);
+    ASSERT_TRUE(info.isClassic);
+    ASSERT_EQ(info.installStatus, InstallStatus::NOT_INSTALLED);
+}
+
+TEST(SnapLocalState_ReadsMountsAndState) {
+    SnapYaml yaml(
+        "name: hello\n"
+        "version: '2.10'\n"
+        "summary: \"GNU Hello, the \\\"hello world\\\" snap\"\n"
+        "title: Hello # not part of it\n"
+        "description: |\n"
+        "  Prints a friendly greeting.\n"
+        "\n"
+        "  Also a tutorial.\n"
+        "confinement: strict\n"
+        "apps:\n"
+        "  hello:\n"
+        "    command: bin/hello\n"
+        "license: >\n"
+        "  GPL-3.0\n"
+        "  or later\n");
+    ASSERT_EQ(yaml.get("version"), "2.10");
+    ASSERT_EQ(yaml.get("summary"), "GNU Hello, the \"hello world\" snap");
+    ASSERT_EQ(yaml.get("title"), "Hello");
+    ASSERT_EQ(yaml.get("description"), "Prints a friendly greeting.\n\nAlso a tutorial.");
+    ASSERT_EQ(yaml.get("license"), "GPL-3.0 or later");
+    ASSERT_FALSE(yaml.has("apps"));
+    ASSERT_FALSE(yaml.has("command"));
+
+    string root = "/tmp/polysynaptic-test-snaps-" + std::to_string(getpid());
+    string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    string setup = "mkdir -p " + root + "/snap/hello/38/meta " + root + "/snap/bin " +
+                   root + "/snaps && ln -s 38 " + root + "/snap/hello/current";
+    ASSERT_EQ(system(setup.c_str()), 0);
+    {
+        std::ofstream(root + "/snap/hello/38/meta/snap.yaml")
+            << "name: hello\nversion: 2.10\nsummary: GNU Hello\n";
+        std::ofstream(root + "/snaps/hello_38.snap") << "0123456789";
+        std::ofstream(root + "/state.json")
+            << "{\"data\":{\"auth\":{},\"snaps\":{\"hello\":{\"type\":\"app\","
+               "\"sequence\":[{\"name\":\"hello\",\"snap-id\":\"old\",\"revision\":\"37\"},"
+               "{\"name\":\"hello\",\"snap-id\":\"abc\",\"revision\":\"38\","
+               "\"channel\":\"latest/stable\"}],\"active\":true,\"current\":\"38\","
+               "\"channel\":\"latest/stable\",\"devmode\":true}}},\"changes\":{}}";
+    }
+
+    vector<SnapdSnap> snaps;
+    SnapLocalState local(root + "/snap", root + "/state.json", root + "/snaps");
+    ASSERT_TRUE(local.listInstalled(snaps));
+    ASSERT_EQ(snaps.size(), 1u);
+    ASSERT_EQ(snaps[0].name, "hello");
+    ASSERT_EQ(snaps[0].version, "2.10");
+    ASSERT_EQ(snaps[0].revision, "38");
+    ASSERT_EQ(snaps[0].id, "abc");
+    ASSERT_EQ(snaps[0].trackingChannel, "latest/stable");
+    ASSERT_TRUE(snaps[0].devmode);
+    ASSERT_TRUE(snaps[0].isInstalled());
+    ASSERT_EQ(snaps[0].installedSize, 10);
+
+    // Without the state file the mounts still give the list
+    SnapLocalState unprivileged(root + "/snap", root + "/missing.json", root + "/snaps");
+    ASSERT_TRUE(unprivileged.listInstalled(snaps));
+    ASSERT_EQ(snaps.size(), 1u);
+    ASSERT_TRUE(snaps[0].id.empty());
+
+    ASSERT_FALSE(SnapLocalState(root + "/nothing").listInstalled(snaps));
+    system(cleanup.c_str());
+}
+
+TEST(SnapBackend_SummaryRecord) {
+    SnapdSnap snap;
+    snap.name = "hello";
+    snap.summary = "GNU Hello";
+    snap.description = "Prints a friendly greeting.";
+    snap.storeUrl = "https://snapcraft.io/hello";
+
+    PackageInfo full = SnapBackend::fromSnapdSnap(snap);
+    ASSERT_EQ(full.description, snap.description);
+    ASSERT_EQ(full.homepage, snap.storeUrl);
+    ASSERT_FALSE(full.isDeferred(PackageInfo::DEFER_ALL));
+
+    PackageInfo summary = SnapBackend::fromSnapdSnap(snap, true);
+    ASSERT_EQ(summary.summary, "GNU Hello");
+    ASSERT_TRUE(summary.description.empty());
+    ASSERT_TRUE(summary.homepage.empty());
+    ASSERT_EQ(summary.deferredFields, unsigned(PackageInfo::DEFER_DETAILS));
+}
+
+TEST(SnapdClient_ParseError) {
+    string body =
+        "{\"type\":\"error\",\"status-code\":404,\"status\":\"Not Found\","
+        "\"result\":{\"message\":\"snap not installed\",\"kind\":\"snap-not-found\"}}";
+
+    SnapdSnap snap;
+    string error;
+    ASSERT_FALSE(SnapdClient::parseSnap(body, snap, error));
+    ASSERT_EQ(error, "snap not installed");
+
+    ASSERT_FALSE(SnapdClient::parseSnap("{\"result\":[1,", snap, error));
+}
+
+TEST(SnapdClient_ParseChanges) {
+    string body =
+        "{\"type\":\"sync\",\"status-code\":200,\"status\":\"OK\",\"result\":["
+        "{\"id\":\"42\",\"kind\":\"install-snap\",\"summary\":\"Install \\\"vlc\\\" snap\","
+        "\"status\":\"Doing\",\"ready\":false,"
+        "\"tasks\":["
+        "{\"kind\":\"prerequisites\",\"status\":\"Done\",\"progress\":{\"done\":1,\"total\":1}},"
+        "{\"kind\":\"download-snap\",\"summary\":\"Download snap \\\"vlc\\\"\","
+        "\"status\":\"Doing\",\"progress\":{\"label\":\"vlc\",\"done\":50,\"total\":100}},"
+        "{\"kind\":\"mount-snap\",\"status\":\"Do\",\"progress\":{\"done\":0,\"total\":1}},"
+        "{\"kind\":\"link-snap\",\"status\":\"Do\"}],"
+        "\"data\":{\"snap-names\":[\"vlc\"]}}]}";
+
+    vector<SnapdChange> changes;
+    string error;
+    ASSERT_TRUE(SnapdClient::parseChanges(body, changes, error));
+    ASSERT_EQ(changes.size(), 1u);
+    ASSERT_EQ(changes[0].id, "42");
+    ASSERT_FALSE(changes[0].ready);
+    ASSERT_EQ(changes[0].snapNames.size(), 1u);
+    ASSERT_EQ(changes[0].snapNames[0], "vlc");
+    ASSERT_EQ(changes[0].tasks.size(), 4u);
+    ASSERT_EQ(changes[0].tasks[1].done, 50);
+    ASSERT_TRUE(changes[0].tasks[0].isFinished());
+    ASSERT_FALSE(changes[0].tasks[2].isFinished());
+
+    // One task done, one half way, two to go
+    ASSERT_EQ((int)(SnapBackend::changeFraction(changes[0]) * 1000), 375);
+}
+
+TEST(SnapdClient_ParseNotices) {
+    string body =
+        "{\"type\":\"sync\",\"status-code\":200,\"status\":\"OK\",\"result\":["
+        "{\"id\":\"7\",\"user-id\":null,\"type\":\"change-update\",\"key\":\"42\","
+        "\"first-occurred\":\"2024-03-01T10:00:00Z\","
+        "\"last-occurred\":\"2024-03-01T10:00:02.5Z\",\"occurrences\":3,"
+        "\"last-data\":{\"kind\":\"install-snap\"}}]}";
+
+    vector<SnapdNotice> notices;
+    string error;
+    ASSERT_TRUE(SnapdClient::parseNotices(body, notices, error));
+    ASSERT_EQ(notices.size(), 1u);
+    ASSERT_EQ(notices[0].type, "change-update");
+    ASSERT_EQ(notices[0].key, "42");
+    ASSERT_EQ(notices[0].lastOccurred, "2024-03-01T10:00:02.5Z");
+}
+
+TEST(SnapdClient_FindReadsItsOwnStatus) {
+    // A snapd that has nothing for "missing" and fails every other query
+    string path = "/tmp/test-polysynaptic-snapd-" + to_string(getpid()) + ".socket";
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    ASSERT_EQ(bind(fd, (sockaddr*) &addr, sizeof(addr)), 0);
+    listen(fd, 8);
+
+    atomic<bool> stopping{false};
+    std::thread server([fd, &stopping]() {
+        while (!stopping) {
+            pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, 20) <= 0) continue;
+            int client = accept(fd, nullptr, nullptr);
+            if (client < 0) continue;
+            char request[1024];
+            ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+            request[max<ssize_t>(n, 0)] = 0;
+            bool missing = string(request).find("GET /v2/find?q=missing ") == 0;
+            string body = missing
+                ? "{\"type\":\"error\",\"status-code\":404,\"status\":\"Not Found\","
+                  "\"result\":{\"message\":\"No matching snaps\"}}"
+                : "{\"type\":\"error\",\"status-code\":500,"
+                  "\"status\":\"Internal Server Error\",\"result\":{\"message\":\"boom\"}}";
+            string reply = string(missing ? "HTTP/1.1 404 Not Found\r\n"
+                                          : "HTTP/1.1 500 Internal Server Error\r\n") +
+                           "Content-Type: application/json\r\n"
+                           "Content-Length: " + to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+            send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+            close(client);
+        }
+    });
+
+    // The 404 is taken from find()'s own request, whatever the other
+    // thread's requests left as the last status meanwhile
+    SnapdClient client(path);
+    atomic<int> wrong{0};
+    std::thread other([&client, &wrong]() {
+        vector<SnapdSnap> snaps;
+        for (int i = 0; i < 50; i++) {
+            if (client.find("broken", snaps)) wrong++;
+        }
+    });
+    for (int i = 0; i < 50; i++) {
+        vector<SnapdSnap> snaps(1);
+        if (!client.find("missing", snaps) || !snaps.empty()) wrong++;
+    }
+    other.join();
+
+    stopping = true;
+    server.join();
+    close(fd);
+    unlink(path.c_str());
+    ASSERT_EQ(wrong.load(), 0);
+}
+
+TEST(SnapChangeWatcher_ReportsEachStateOnce) {
+    SnapChangeWatcher watcher("/nonexistent/snapd.socket");
+
+    SnapdChange change;
+    change.id = "42";
+    change.kind = "install-snap";
+    change.status = "Doing";
+    change.snapNames = {"vlc"};
+    SnapdTask download;
+    download.kind = "download-snap";
+    download.status = "Doing";
+    change.tasks = {download};
+
+    SnapChangeEvent event;
+    ASSERT_TRUE(watcher.noteChange(change, event));
+    ASSERT_TRUE(event.state == SnapChangeEvent::State::RUNNING);
+    ASSERT_FALSE(event.isReady());
+
+    // A repeated notice for nothing new
+    ASSERT_FALSE(watcher.noteChange(change, event));
+
+    change.status = "Done";
+    change.ready = true;
+    change.tasks[0].status = "Done";
+    ASSERT_TRUE(watcher.noteChange(change, event));
+    ASSERT_TRUE(event.state == SnapChangeEvent::State::DONE);
+    ASSERT_EQ((int)event.fraction, 1);
+    ASSERT_EQ(event.change.snapNames[0], "vlc");
+
+    change.status = "Error";
+    ASSERT_TRUE(SnapChangeWatcher::stateOf(change) == SnapChangeEvent::State::FAILED);
+}
+
+TEST(SnapdClient_UrlEncode) {
+    ASSERT_EQ(SnapdClient::urlEncode("vlc"), "vlc");
+    ASSERT_EQ(SnapdClient::urlEncode("text editor"), "text%20editor");
+    ASSERT_EQ(SnapdClient::urlEncode("a&b=c"), "a%26b%3Dc");
+}
+
 // ============================================================================
 // FlatpakBackend Validation Tests
 // ============================================================================
@@ -359,40 +736,4266 @@ TEST(FlatpakBackend_DefaultRemote) {
     ASSERT_EQ(backend.getDefaultRemote(), "custom");
 }
 
+TEST(FlatpakBackend_FromFlatpakRef) {
+    FlatpakRefInfo ref;
+    ref.appId = "org.gnome.Calculator";
+    ref.name = "Calculator";
+    ref.version = "45.0";
+    ref.branch = "stable";
+    ref.origin = "flathub";
+    ref.ref = "app/org.gnome.Calculator/x86_64/stable";
+    ref.installedSize = 4096;
+    ref.installed = true;
+
+    PackageInfo info = FlatpakBackend::fromFlatpakRef(ref);
+    ASSERT_EQ(info.backend, BackendType::FLATPAK);
+    ASSERT_EQ(info.id, "org.gnome.Calculator");
+    ASSERT_EQ(info.name, "Calculator");
+    ASSERT_EQ(info.remote, "flathub");
+    ASSERT_EQ(info.installedVersion, "45.0");
+    ASSERT_EQ(info.installStatus, InstallStatus::INSTALLED);
+
+    ref.installed = false;
+    ref.name.clear();
+    info = FlatpakBackend::fromFlatpakRef(ref);
+    ASSERT_EQ(info.name, "org.gnome.Calculator");
+    ASSERT_EQ(info.installStatus, InstallStatus::NOT_INSTALLED);
+}
+
+TEST(FlatpakMetadataIndex_ParsesDeploysOnce) {
+    FlatpakAppMetadata parsed;
+    ASSERT_TRUE(FlatpakMetadataIndex::parse(
+        "[Application]\n"
+        "name=org.example.Editor\n"
+        "runtime=org.gnome.Platform/x86_64/45\n"
+        "\n"
+        "[Context]\n"
+        "shared=network;ipc;\n"
+        "sockets=wayland;fallback-x11;pulseaudio;\n"
+        "devices=dri;\n"
+        "filesystems=xdg-documents;!home;host:ro;\n"
+        "\n"
+        "[Session Bus Policy]\n"
+        "org.freedesktop.Flatpak=talk\n", parsed));
+    ASSERT_EQ(parsed.appId, "org.example.Editor");
+    ASSERT_EQ(parsed.runtime, "org.gnome.Platform/x86_64/45");
+    ASSERT_TRUE(parsed.permissions.hasNetworkAccess);
+    ASSERT_TRUE(parsed.permissions.hasDisplayAccess);
+    ASSERT_TRUE(parsed.permissions.hasAudioAccess);
+    ASSERT_TRUE(parsed.permissions.hasGpuAccess);
+    ASSERT_TRUE(parsed.permissions.hasFileSystemAccess);
+    ASSERT_FALSE(parsed.permissions.hasSessionBusAccess);
+    ASSERT_TRUE(parsed.escapesSandbox);
+    ASSERT_EQ(parsed.permissions.customPermissions.size(), 2u);
+
+    FlatpakAppMetadata runtime;
+    ASSERT_FALSE(FlatpakMetadataIndex::parse("[Runtime]\nname=org.gnome.Platform\n", runtime));
+
+    string dir = "/tmp/test-polysynaptic-flatpak-meta-" + to_string(getpid());
+    string cleanup = "rm -rf " + dir;
+    system(cleanup.c_str());
+    auto deploy = [&](const string& installation, const string& app,
+                      const string& checksum, const string& context) {
+        string branch = dir + "/" + installation + "/app/" + app + "/x86_64/stable";
+        string cmd = "mkdir -p " + branch + "/" + checksum + " && ln -sfn " + checksum +
+                     " " + branch + "/active";
+        ASSERT_EQ(system(cmd.c_str()), 0);
+        ofstream(branch + "/" + checksum + "/metadata")
+            << "[Application]\nname=" << app << "\n[Context]\n" << context << "\n";
+    };
+    deploy("user", "org.a.A", "aaa", "shared=network;");
+    deploy("system", "org.a.A", "bbb", "devices=all;");
+    deploy("system", "org.b.B", "ccc", "sockets=x11;");
+
+    FlatpakMetadataIndex index({dir + "/user", dir + "/system"}, 1);
+    auto a = index.find("org.a.A");
+    ASSERT_TRUE(a != nullptr);
+    ASSERT_TRUE(a->userInstallation);
+    ASSERT_TRUE(a->permissions.hasNetworkAccess);
+    ASSERT_FALSE(a->permissions.hasDeviceAccess);
+    ASSERT_TRUE(index.find("org.b.B", "stable")->permissions.hasDisplayAccess);
+    ASSERT_TRUE(index.find("org.b.B", "beta") == nullptr);
+    ASSERT_EQ(index.apps().size(), 3u);
+    ASSERT_EQ(index.parsedCount(), 3u);
+
+    // A rescan parses only the deploy that changed
+    deploy("system", "org.b.B", "ddd", "sockets=x11;\nshared=network;");
+    index.invalidate();
+    ASSERT_TRUE(index.find("org.b.B")->permissions.hasNetworkAccess);
+    ASSERT_EQ(index.parsedCount(), 4u);
+    ASSERT_EQ(index.apps().size(), 3u);
+
+    system(cleanup.c_str());
+}
+
+TEST(FlatpakBackend_ListsRemotesApartAndCaches) {
+    // A flatpak on PATH that answers from a script and logs its calls
+    string dir = "/tmp/test-polysynaptic-flatpak-" + to_string(getpid());
+    string userDir = dir + "/user";
+    string systemDir = dir + "/system";
+    mkdir(dir.c_str(), 0700);
+    for (const string& base : {userDir, systemDir}) {
+        mkdir(base.c_str(), 0700);
+        ofstream(base + "/.changed");
+    }
+    for (const string& remote : {userDir + "/appstream/flathub", userDir + "/appstream/corp",
+                                 systemDir + "/appstream/fedora"}) {
+        mkdir(remote.substr(0, remote.rfind('/')).c_str(), 0700);
+        mkdir(remote.c_str(), 0700);
+        mkdir((remote + "/x86_64").c_str(), 0700);
+        ofstream(remote + "/x86_64/active");
+    }
+    {
+        ofstream script(dir + "/flatpak");
+        script << "#!/bin/sh\n"
+               << "echo \"$*\" >> " << dir << "/log\n"
+               << "case \"$*\" in\n"
+               << "  --version) echo 'Flatpak 1.14.4' ;;\n"
+               << "  'remotes --user --columns=name') printf 'flathub\\ncorp\\n' ;;\n"
+               << "  'remotes --system --columns=name') echo fedora ;;\n"
+               << "  *--updates*flathub) printf 'org.a.A\\tA\\t2\\tstable\\tflathub\\n' ;;\n"
+               << "  *--updates*corp) printf 'org.b.B\\tB\\t3\\tstable\\tcorp\\n' ;;\n"
+               << "  *--updates*fedora) printf 'org.a.A\\tA\\t1\\tstable\\tfedora\\n"
+               << "org.c.C\\tC\\t4\\tstable\\tfedora\\n' ;;\n"
+               << "esac\n";
+    }
+    chmod((dir + "/flatpak").c_str(), 0755);
+    string path = getenv("PATH") ? getenv("PATH") : "";
+    setenv("PATH", (dir + ":" + path).c_str(), 1);
+    setenv("FLATPAK_USER_DIR", userDir.c_str(), 1);
+    setenv("FLATPAK_SYSTEM_DIR", systemDir.c_str(), 1);
+
+    auto remoteLists = [&]() {
+        ifstream log(dir + "/log");
+        string line;
+        int count = 0;
+        while (getline(log, line)) {
+            if (line.find("remote-ls") == 0) count++;
+        }
+        return count;
+    };
+
+    FlatpakBackend backend;
+    backend.setUseEngine(false);
+    vector<PackageInfo> updates = backend.getUpgradablePackages();
+
+    // One listing per remote; the user installation wins for org.a.A
+    ASSERT_EQ(remoteLists(), 3);
+    ASSERT_EQ(updates.size(), 3u);
+    map<string, string> versions;
+    for (const auto& pkg : updates) versions[pkg.id] = pkg.version;
+    ASSERT_EQ(versions["org.a.A"], string("2"));
+    ASSERT_EQ(versions["org.c.C"], string("4"));
+
+    // Unchanged appstream answers from the cache; a new one lists that remote
+    ASSERT_EQ(backend.getUpgradablePackages().size(), 3u);
+    ASSERT_EQ(remoteLists(), 3);
+    unlink((userDir + "/appstream/corp/x86_64/active").c_str());
+    usleep(10000);
+    ofstream(userDir + "/appstream/corp/x86_64/active");
+    ASSERT_EQ(backend.getUpgradablePackages().size(), 3u);
+    ASSERT_EQ(remoteLists(), 4);
+
+    setenv("PATH", path.c_str(), 1);
+    unsetenv("FLATPAK_USER_DIR");
+    unsetenv("FLATPAK_SYSTEM_DIR");
+    system(("rm -rf " + dir).c_str());
+}
+
+TEST(AppstreamIndex_CollectionAndDep11) {
+    string dir = "/tmp/test-polysynaptic-appstream-" + to_string(getpid());
+    string active = dir + "/appstream/flathub/x86_64/active";
+    for (const string& d : {dir, dir + "/appstream", dir + "/appstream/flathub",
+                            dir + "/appstream/flathub/x86_64", active}) {
+        mkdir(d.c_str(), 0700);
+    }
+    {
+        ofstream xml(active + "/appstream.xml");
+        xml << "<?xml version=\"1.0\"?>\n"
+            << "<!-- flatpak -->\n"
+            << "<components version=\"0.8\" media_baseurl=\"https://media.example/\">\n"
+            << " <component type=\"desktop-application\">\n"
+            << "  <id>org.example.Paint.desktop</id>\n"
+            << "  <bundle type=\"flatpak\">app/org.example.Paint/x86_64/stable</bundle>\n"
+            << "  <description><p>Draw <em>things</em></p></description>\n"
+            << "  <categories><category>Graphics</category><category>2DGraphics</category></categories>\n"
+            << "  <keywords><keyword>draw</keyword><keyword xml:lang=\"de\">malen</keyword>"
+            << "<keyword>R&amp;D</keyword></keywords>\n"
+            << "  <keywords xml:lang=\"fr\"><keyword>dessin</keyword></keywords>\n"
+            << "  <screenshots>\n"
+            << "   <screenshot><image type=\"thumbnail\" width=\"224\">shots/2-small.png</image></screenshot>\n"
+            << "   <screenshot type=\"default\"><caption>Main</caption>"
+            << "<image type=\"thumbnail\">shots/1-small.png</image>"
+            << "<image type=\"source\"><![CDATA[shots/1.png]]></image></screenshot>\n"
+            << "  </screenshots>\n"
+            << " </component>\n"
+            << " <component type=\"runtime\"><id>org.example.Platform</id>"
+            << "<bundle type=\"flatpak\">runtime/org.example.Platform/x86_64/1</bundle></component>\n"
+            << "</components>\n";
+    }
+    // The gzipped copy next to it is not read
+    ofstream(active + "/appstream.xml.gz") << "not gzip";
+    string yaml = dir + "/Components-amd64.yml";
+    {
+        ofstream out(yaml);
+        out << "---\n"
+            << "File: DEP-11\n"
+            << "MediaBaseUrl: https://dist.example/media\n"
+            << "---\n"
+            << "Type: desktop-application\n"
+            << "ID: org.example.Paint.desktop\n"
+            << "Package: paint-from-distro\n"
+            << "---\n"
+            << "Type: desktop-application\n"
+            << "ID: org.gnome.Editor.desktop\n"
+            << "Package: gnome-editor\n"
+            << "Categories:\n"
+            << "- Utility\n"
+            << "- 'TextEditor'\n"
+            << "Keywords:\n"
+            << "  C:\n"
+            << "  - text\n"
+            << "  de:\n"
+            << "  - Text\n"
+            << "Screenshots:\n"
+            << "- default: true\n"
+            << "  caption:\n"
+            << "    C: Window\n"
+            << "  thumbnails:\n"
+            << "  - url: editor/624x351.png\n"
+            << "    width: 624\n"
+            << "  source-image:\n"
+            << "    url: editor/orig.png\n"
+            << "- thumbnails:\n"
+            << "  - url: https://elsewhere.example/2.png\n";
+    }
+
+    setenv("FLATPAK_USER_DIR", dir.c_str(), 1);
+    vector<string> files = AppstreamIndex::catalogFiles();
+    unsetenv("FLATPAK_USER_DIR");
+    ASSERT_FALSE(files.empty());
+    ASSERT_TRUE(files[0] == active + "/appstream.xml");
+    ASSERT_TRUE(find(files.begin(), files.end(), active + "/appstream.xml.gz") == files.end());
+
+    AppstreamIndex index;
+    ASSERT_TRUE(index.addFile(files[0]));
+    ASSERT_TRUE(index.addFile(yaml));
+    ASSERT_FALSE(index.addFile(dir + "/missing.xml"));
+    index.finish();
+
+    // The flatpak entry came first; runtimes are keyed by their <id>
+    ASSERT_EQ(index.size(), 3u);
+    AppstreamIndex::Component paint = index.find("org.example.Paint");
+    ASSERT_TRUE(bool(paint));
+    ASSERT_TRUE(paint.package().empty());
+    ASSERT_TRUE(paint.joined(AppstreamIndex::CATEGORIES, ';') == "Graphics;2DGraphics");
+    ASSERT_TRUE(paint.joined(AppstreamIndex::KEYWORDS, ' ') == "draw R&D");
+    ASSERT_EQ(paint.count(AppstreamIndex::SCREENSHOTS), 2u);
+    ASSERT_TRUE(paint.item(AppstreamIndex::SCREENSHOTS, 0) == "https://media.example/shots/1.png");
+    ASSERT_TRUE(paint.item(AppstreamIndex::SCREENSHOTS, 1) == "https://media.example/shots/2-small.png");
+    ASSERT_TRUE(bool(index.find("org.example.Platform.desktop")));
+    ASSERT_FALSE(bool(index.findPackage("paint-from-distro")));
+
+    AppstreamIndex::Component editor = index.findPackage("gnome-editor");
+    ASSERT_TRUE(bool(editor));
+    ASSERT_TRUE(editor.id() == "org.gnome.Editor");
+    ASSERT_TRUE(editor.joined(AppstreamIndex::CATEGORIES, ',') == "Utility,TextEditor");
+    ASSERT_TRUE(editor.joined(AppstreamIndex::KEYWORDS, ',') == "text");
+    ASSERT_EQ(editor.count(AppstreamIndex::SCREENSHOTS), 2u);
+    ASSERT_TRUE(editor.item(AppstreamIndex::SCREENSHOTS, 0) == "https://dist.example/media/editor/orig.png");
+    ASSERT_TRUE(editor.item(AppstreamIndex::SCREENSHOTS, 1) == "https://elsewhere.example/2.png");
+
+    // Joined with backend records: Flatpak by id, APT by name, Snap never
+    PackageInfo flatpak("org.example.Paint", "Paint", BackendType::FLATPAK);
+    index.enrich(flatpak);
+    ASSERT_TRUE(flatpak.keywords == "draw R&D");
+    ASSERT_TRUE(flatpak.section == "Graphics;2DGraphics");
+    PackageInfo apt("gnome-editor", "gnome-editor", BackendType::APT);
+    apt.section = "editors";
+    index.enrich(apt);
+    ASSERT_TRUE(apt.keywords == "text");
+    ASSERT_TRUE(apt.section == "editors");
+    PackageInfo snap("gnome-editor", "gnome-editor", BackendType::SNAP);
+    ASSERT_FALSE(bool(index.lookup(snap)));
+    ASSERT_EQ(BackendManager::searchRelevance(apt, "text"), 1);
+
+    system(("rm -rf " + dir).c_str());
+}
+
 // ============================================================================
-// BackendManager Tests (without real backends)
+// PackageCatalog Tests
 // ============================================================================
 
-TEST(BackendManager_Creation) {
-    BackendManager manager(nullptr);
+static PackageInfo makeCatalogPackage(const string& id, BackendType backend,
+                                      const string& version)
+{
+    PackageInfo pkg;
+    pkg.id = id;
+    pkg.name = id;
+    pkg.backend = backend;
+    pkg.version = version;
+    pkg.installedVersion = version;
+    pkg.installStatus = InstallStatus::INSTALLED;
+    return pkg;
+}
 
-    // Without a lister, APT backend shouldn't be available
-    auto statuses = manager.getBackendStatuses();
-    ASSERT_TRUE(statuses.size() >= 2);  // At least Snap and Flatpak
+TEST(PackageCatalog_SaveLoad) {
+    string path = "/tmp/test-polysynaptic-catalog-" + to_string(getpid()) + ".bin";
+
+    PackageInfo snap = makeCatalogPackage("firefox", BackendType::SNAP, "120.0");
+    snap.channel = "latest/stable";
+    snap.isClassic = true;
+    snap.installedSize = 123456789;
+
+    PackageCatalog catalog;
+    catalog.update(BackendType::SNAP, "gen-1", {snap});
+    catalog.update(BackendType::FLATPAK, "",
+                   {makeCatalogPackage("org.gnome.Calculator", BackendType::FLATPAK, "45.0")});
+    ASSERT_TRUE(catalog.save(path));
+
+    PackageCatalog loaded;
+    ASSERT_TRUE(loaded.load(path));
+    unlink(path.c_str());
+
+    ASSERT_TRUE(loaded.hasSection(BackendType::SNAP));
+    ASSERT_FALSE(loaded.hasSection(BackendType::APT));
+    ASSERT_EQ(loaded.getGeneration(BackendType::SNAP), "gen-1");
+    ASSERT_EQ(loaded.getPackages(BackendType::SNAP).size(), 1u);
+    ASSERT_EQ(loaded.getPackages(BackendType::FLATPAK).size(), 1u);
+
+    const PackageInfo& pkg = loaded.getPackages(BackendType::SNAP)[0];
+    ASSERT_EQ(pkg.id, "firefox");
+    ASSERT_EQ(pkg.backend, BackendType::SNAP);
+    ASSERT_EQ(pkg.channel, "latest/stable");
+    ASSERT_EQ(pkg.installStatus, InstallStatus::INSTALLED);
+    ASSERT_EQ(pkg.installedSize, 123456789);
+    ASSERT_TRUE(pkg.isClassic);
+
+    ASSERT_FALSE(loaded.load("/nonexistent/polysynaptic-catalog.bin"));
 }
 
-TEST(BackendManager_EnableDisable) {
-    BackendManager manager(nullptr);
+TEST(PackageCatalog_DiffAndApply) {
+    vector<PackageInfo> before = {
+        makeCatalogPackage("vlc", BackendType::SNAP, "3.0"),
+        makeCatalogPackage("core22", BackendType::SNAP, "20240101"),
+        makeCatalogPackage("vlc", BackendType::APT, "3.0"),
+    };
+    vector<PackageInfo> after = {
+        makeCatalogPackage("vlc", BackendType::SNAP, "3.1"),
+        makeCatalogPackage("vlc", BackendType::APT, "3.0"),
+        makeCatalogPackage("spotify", BackendType::SNAP, "1.2"),
+    };
 
-    manager.setBackendEnabled(BackendType::SNAP, false);
-    ASSERT_FALSE(manager.isBackendEnabled(BackendType::SNAP));
+    CatalogDelta delta = PackageCatalog::diff(before, after);
+    ASSERT_EQ(delta.added.size(), 1u);
+    ASSERT_EQ(delta.added[0].id, "spotify");
+    ASSERT_EQ(delta.changed.size(), 1u);
+    ASSERT_EQ(delta.changed[0].version, "3.1");
+    ASSERT_EQ(delta.removed.size(), 1u);
+    ASSERT_EQ(delta.removed[0].id, "core22");
 
-    manager.setBackendEnabled(BackendType::SNAP, true);
-    ASSERT_TRUE(manager.isBackendEnabled(BackendType::SNAP));
+    PackageCatalog::applyDelta(before, delta);
+    ASSERT_EQ(before.size(), 3u);
+    ASSERT_EQ(before[0].version, "3.1");
+    ASSERT_EQ(before[1].backend, BackendType::APT);
+    ASSERT_EQ(before[2].id, "spotify");
+
+    ASSERT_TRUE(PackageCatalog::diff(after, after).empty());
 }
 
-TEST(BackendManager_TransactionQueue) {
-    BackendManager manager(nullptr);
+TEST(SnapshotPublisher_GenerationsAndAppends) {
+    SnapshotPublisher publisher;
+    PackageSnapshotPtr empty = publisher.current();
+    ASSERT_TRUE(empty->empty());
 
-    ASSERT_FALSE(manager.hasQueuedOperations());
+    PackageSnapshotPtr first = publisher.publish(
+        {makeCatalogPackage("vlc", BackendType::SNAP, "3.0")}, 2);
+    ASSERT_EQ(publisher.current(), first);
+    ASSERT_EQ(first->generation(), 2u);
 
-    PackageInfo pkg("test", "Test", BackendType::SNAP);
-    manager.queueInstall(pkg);
+    // Appends keep the packages already there and the lineage
+    PackageSnapshotPtr grown = publisher.append(
+        {makeCatalogPackage("vlc", BackendType::APT, "3.0")}, 2);
+    ASSERT_EQ(grown->size(), 2u);
+    ASSERT_TRUE(grown->extends(*first));
+    ASSERT_FALSE(first->extends(*grown));
+    ASSERT_EQ(first->size(), 1u);
+    ASSERT_EQ((*grown)[1].backend, BackendType::APT);
 
-    ASSERT_TRUE(manager.hasQueuedOperations());
+    // A late result of an older load changes nothing
+    ASSERT_EQ(publisher.publish({}, 1), grown);
+    ASSERT_EQ(publisher.append({makeCatalogPackage("gimp", BackendType::SNAP, "2")}, 1),
+              grown);
 
-    manager.clearTransaction();
-    ASSERT_FALSE(manager.hasQueuedOperations());
+    CatalogDelta delta;
+    delta.changed.push_back(makeCatalogPackage("vlc", BackendType::SNAP, "3.1"));
+    PackageSnapshotPtr revised = publisher.applyDelta(delta, 2);
+    ASSERT_EQ(revised->size(), 2u);
+    ASSERT_EQ((*revised)[0].version, "3.1");
+    ASSERT_FALSE(revised->extends(*grown));
+    ASSERT_EQ((*grown)[0].version, "3.0");
+    ASSERT_EQ(publisher.applyDelta(delta, 1), revised);
+
+    // The first append of a newer load starts its list
+    PackageSnapshotPtr next = publisher.append(
+        {makeCatalogPackage("gimp", BackendType::FLATPAK, "2.10")}, 3);
+    ASSERT_EQ(next->size(), 1u);
+    ASSERT_FALSE(next->extends(*revised));
+}
+
+TEST(SnapshotPublisher_ConcurrentAppends) {
+    SnapshotPublisher publisher;
+    publisher.publish({}, 1);
+
+    const int threads = 4, each = 50;
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&publisher, t]() {
+            for (int i = 0; i < each; i++) {
+                publisher.append({makeCatalogPackage(to_string(t) + "-" + to_string(i),
+                                                     BackendType::SNAP, "1")}, 1);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // None lost, each thread's in its order
+    PackageSnapshotPtr all = publisher.current();
+    ASSERT_EQ(all->size(), (size_t)(threads * each));
+    vector<int> seen(threads, 0);
+    for (const auto& pkg : all->packages()) {
+        int t = stoi(pkg.id.substr(0, pkg.id.find('-')));
+        ASSERT_EQ(pkg.id, to_string(t) + "-" + to_string(seen[t]));
+        seen[t]++;
+    }
+}
+
+TEST(PackageCatalog_DeferredFields) {
+    string path = "/tmp/test-polysynaptic-deferred-" + to_string(getpid()) + ".bin";
+
+    PackageInfo lazy = makeCatalogPackage("vlc", BackendType::APT, "3.0");
+    lazy.deferredFields = PackageInfo::DEFER_ALL;
+
+    PackageCatalog catalog;
+    catalog.update(BackendType::APT, "gen-1", {lazy});
+    ASSERT_TRUE(catalog.save(path));
+
+    PackageCatalog loaded;
+    ASSERT_TRUE(loaded.load(path));
+    unlink(path.c_str());
+    ASSERT_EQ(loaded.getPackages(BackendType::APT)[0].deferredFields,
+              static_cast<unsigned>(PackageInfo::DEFER_ALL));
+
+    // A summary that was never fetched does not count as a change
+    PackageInfo resolved = makeCatalogPackage("vlc", BackendType::APT, "3.0");
+    resolved.summary = "multimedia player";
+    ASSERT_TRUE(PackageCatalog::diff({lazy}, {resolved}).empty());
+
+    // Without a source, resolving just clears the requested bits
+    lazy.resolve(PackageInfo::DEFER_SUMMARY);
+    ASSERT_FALSE(lazy.isDeferred(PackageInfo::DEFER_SUMMARY));
+    ASSERT_TRUE(lazy.isDeferred(PackageInfo::DEFER_DESCRIPTION));
+}
+
+// ============================================================================
+// Search Index Tests
+// ============================================================================
+
+TEST(TrigramIndex_Candidates) {
+    RTrigramIndex index;
+    index.add(0, "Firefox web browser");
+    index.add(1, NULL);
+    index.add(2, "firewall configuration");
+    index.add(3, "FireFox ESR");
+    ASSERT_EQ(index.size(), 4u);
+
+    vector<unsigned int> result;
+    ASSERT_TRUE(index.candidates({"FIREFOX"}, result));
+    ASSERT_EQ(result.size(), 2u);
+    ASSERT_EQ(result[0], 0u);
+    ASSERT_EQ(result[1], 3u);
+
+    // every term has to match
+    ASSERT_TRUE(index.candidates({"fire", "wall"}, result));
+    ASSERT_EQ(result.size(), 1u);
+    ASSERT_EQ(result[0], 2u);
+
+    ASSERT_TRUE(index.candidates({"chromium"}, result));
+    ASSERT_TRUE(result.empty());
+
+    // too short to narrow anything down
+    ASSERT_FALSE(index.candidates({"fi", ""}, result));
+}
+
+TEST(NameIndex_PrefixAndExact) {
+    RNameIndex index;
+    index.add(0, "vim");
+    index.add(1, "Vim-gtk3");
+    index.add(2, "nano");
+    index.add(3, "vim");        // a second arch of vim
+    index.add(4, "vimdiff");
+    index.add(5, NULL);
+    index.finish();
+    ASSERT_EQ(index.size(), 5u);
+
+    ASSERT_EQ(index.find("nano"), 2);
+    // the first of equal names wins, and exact means exact
+    ASSERT_EQ(index.find("vim"), 0);
+    ASSERT_EQ(index.find("vim-gtk3"), -1);
+    ASSERT_EQ(index.find("emacs"), -1);
+
+    vector<unsigned int> ids;
+    index.withPrefix("VIM", ids);
+    ASSERT_EQ(ids.size(), 4u);
+    ASSERT_EQ(ids[0], 0u);
+    ASSERT_EQ(ids[1], 3u);
+    ASSERT_EQ(ids[2], 1u);
+    ASSERT_EQ(ids[3], 4u);
+
+    index.withPrefix("x", ids);
+    ASSERT_TRUE(ids.empty());
+    index.withPrefix("", ids);
+    ASSERT_EQ(ids.size(), 5u);
+}
+
+TEST(NameSet_SeenAfterFinish) {
+    RNameSet names;
+    names.add("vim");
+    names.add("nano");
+    names.add("vim");           // a second arch of vim
+    ASSERT_FALSE(names.seen("vim"));
+    names.finish();
+    ASSERT_EQ(names.size(), 2u);
+    ASSERT_TRUE(names.seen("vim"));
+    ASSERT_TRUE(names.seen("nano"));
+    ASSERT_FALSE(names.seen("Vim"));
+
+    // a reopen merges the new names in
+    names.add("emacs");
+    names.add("nano");
+    names.finish();
+    ASSERT_EQ(names.size(), 3u);
+    ASSERT_TRUE(names.seen("emacs"));
+    ASSERT_TRUE(names.seen("vim"));
+    ASSERT_FALSE(names.seen("vim-gtk3"));
+
+    names.clear();
+    ASSERT_EQ(names.size(), 0u);
+    ASSERT_FALSE(names.seen("vim"));
+}
+
+TEST(TextScan_RankedHits) {
+    RTextScan scan;
+    scan.add("vim", "Vi IMproved - enhanced vi editor");
+    scan.add("neovim", "heavily refactored vim fork");
+    scan.add("vim-gtk3", "Vi IMproved - enhanced vi editor - with GTK3 GUI");
+    scan.add("nano", "small, friendly text EDITOR inspired by Pico");
+    scan.add("emacs", "GNU Emacs editor");
+
+    vector<RTextScan::Hit> hits;
+    // Exact name first, then name prefix, then anywhere in the name,
+    // then summary only
+    scan.search({"VIM"}, 0, hits, 1);
+    ASSERT_EQ(hits.size(), 3u);
+    ASSERT_EQ(hits[0].id, 0u);
+    ASSERT_EQ(hits[1].id, 2u);
+    ASSERT_EQ(hits[2].id, 1u);
+
+    // Every term must match, within one record
+    scan.search({"editor", "gnu"}, 0, hits, 1);
+    ASSERT_EQ(hits.size(), 1u);
+    ASSERT_EQ(hits[0].id, 4u);
+    scan.search({"pico", "emacs"}, 0, hits, 1);
+    ASSERT_TRUE(hits.empty());
+
+    // Terms don't match across the name and the summary
+    scan.search({"nanosmall"}, 0, hits, 1);
+    ASSERT_TRUE(hits.empty());
+
+    scan.search({"editor"}, 2, hits, 1);
+    ASSERT_EQ(hits.size(), 2u);
+
+    // Split across threads, the result is the same
+    RTextScan big;
+    for (int i = 0; i < 20000; i++) {
+        big.add(("pkg" + to_string(i)).c_str(), i % 7 == 0 ? "a needle here" : "hay");
+    }
+    vector<RTextScan::Hit> one, many;
+    big.search({"needle"}, 0, one, 1);
+    big.search({"needle"}, 0, many, 4);
+    ASSERT_EQ(one.size(), 2858u);
+    ASSERT_EQ(many.size(), one.size());
+    ASSERT_EQ(many[100].id, one[100].id);
+}
+
+TEST(SearchCache_LeastRecentlyUsed) {
+    RSearchCache<int> cache(2);
+    cache.put("fire", 1);
+    cache.put("firef", 2);
+    ASSERT_TRUE(cache.find("fire") != nullptr);
+
+    // "firef" is now the oldest entry and goes first
+    cache.put("firefox", 3);
+    ASSERT_EQ(cache.size(), 2u);
+    ASSERT_TRUE(cache.find("firef") == nullptr);
+    ASSERT_EQ(*cache.find("fire"), 1);
+    ASSERT_EQ(cache.begin()->first, "fire");
+
+    cache.put("firefox", 4);
+    ASSERT_EQ(*cache.find("firefox"), 4);
+    ASSERT_EQ(cache.size(), 2u);
+
+    cache.erase("firefox");
+    cache.erase("missing");
+    ASSERT_EQ(cache.size(), 1u);
+    ASSERT_TRUE(cache.find("firefox") == nullptr);
+
+    cache.clear();
+    ASSERT_TRUE(cache.find("fire") == nullptr);
+}
+
+TEST(ViewSnapshot_RoundTripAndStamp) {
+    string dir = "/tmp/test-polysynaptic-views-" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    string cacheFile = dir + "/pkgcache.bin";
+    string path = dir + "/viewsnapshot.bin";
+    ofstream(cacheFile.c_str()) << "cache";
+
+    string stamp = RViewSnapshot::stampFiles({cacheFile, dir + "/missing"});
+    ASSERT_TRUE(stamp.find("/missing@-") != string::npos);
+
+    RViewSnapshot snapshot;
+    RViewSnapshot::SubViews sections;
+    sections["Editors"] = {3, 1, 7};
+    sections["Games"] = {};
+    snapshot.set("Sections", sections);
+    ASSERT_TRUE(snapshot.save(path, stamp));
+
+    RViewSnapshot loaded;
+    ASSERT_TRUE(loaded.load(path, stamp));
+    ASSERT_TRUE(loaded.find("Origin") == nullptr);
+    const RViewSnapshot::SubViews* subviews = loaded.find("Sections");
+    ASSERT_TRUE(subviews != nullptr);
+    ASSERT_EQ(subviews->size(), 2u);
+    ASSERT_EQ(subviews->at("Editors").size(), 3u);
+    ASSERT_EQ(subviews->at("Editors")[2], 7u);
+
+    // A rebuilt cache makes the snapshot stale
+    ofstream(cacheFile.c_str()) << "rebuilt cache";
+    string newStamp = RViewSnapshot::stampFiles({cacheFile, dir + "/missing"});
+    ASSERT_TRUE(newStamp != stamp);
+    ASSERT_FALSE(loaded.load(path, newStamp));
+    ASSERT_TRUE(loaded.empty());
+
+    // Truncated files are rejected
+    truncate(path.c_str(), 30);
+    ASSERT_FALSE(loaded.load(path, stamp));
+
+    unlink(path.c_str());
+    unlink(cacheFile.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(FileIndex_OwnersAndRefresh) {
+    string dir = "/tmp/test-polysynaptic-files-" + to_string(getpid());
+    string info = dir + "/info";
+    string bin = dir + "/bin";
+    mkdir(dir.c_str(), 0700);
+    mkdir(info.c_str(), 0700);
+    mkdir(bin.c_str(), 0700);
+    ofstream(info + "/vim.list") << "/.\n/usr\n/usr/bin\n/usr/bin/vim\n";
+    ofstream(info + "/nano.list") << "/.\n/usr\n/usr/bin\n/usr/bin/nano\n";
+    ofstream(bin + "/firefox.geckodriver") << "";
+    // Not a file list
+    ofstream(info + "/vim.md5sums") << "/usr/bin/vim\n";
+
+    RFileIndex::ExportDir snap = {bin, "snap:", '.'};
+    RFileIndex index;
+    string cache = dir + "/fileindex.bin";
+    index.configure(info, {snap}, cache);
+    index.ensure();
+    ASSERT_EQ(index.size(), 9u);
+
+    vector<string> owners = index.owners("/usr/bin");
+    ASSERT_EQ(owners.size(), 2u);
+    ASSERT_TRUE(owners[0] == "nano" && owners[1] == "vim");
+    ASSERT_TRUE(index.owners("/usr/bin/vi").empty());
+    owners = index.owners(bin + "/firefox.geckodriver");
+    ASSERT_EQ(owners.size(), 1u);
+    ASSERT_TRUE(owners[0] == "snap:firefox");
+
+    set<string> found;
+    index.ownersContaining({"BIN/", "an"}, found);
+    ASSERT_EQ(found.size(), 1u);
+    ASSERT_TRUE(*found.begin() == "nano");
+
+    // Nothing changed, nothing is reread
+    ASSERT_FALSE(index.refresh());
+
+    // A removed and a changed list
+    unlink((info + "/nano.list").c_str());
+    ofstream(info + "/vim.list") << "/.\n/usr\n/usr/bin\n/usr/bin/vim\n/usr/bin/vimdiff\n";
+    ASSERT_TRUE(index.refresh());
+    ASSERT_EQ(index.owners("/usr/bin").size(), 1u);
+    ASSERT_EQ(index.owners("/usr/bin/vimdiff").size(), 1u);
+    ASSERT_TRUE(index.owners("/usr/bin/nano").empty());
+
+    // The saved index maps back and needs no rereading
+    ASSERT_TRUE(index.save(cache));
+    RFileIndex loaded;
+    ASSERT_TRUE(loaded.load(cache));
+    ASSERT_EQ(loaded.size(), index.size());
+    ASSERT_EQ(loaded.owners("/usr/bin/vimdiff").size(), 1u);
+    loaded.configure(info, {snap}, "");
+    ASSERT_FALSE(loaded.refresh());
+
+    // Broken files are rejected
+    truncate(cache.c_str(), 40);
+    ASSERT_FALSE(loaded.load(cache));
+
+    unlink(cache.c_str());
+    unlink((info + "/vim.list").c_str());
+    unlink((info + "/vim.md5sums").c_str());
+    unlink((bin + "/firefox.geckodriver").c_str());
+    rmdir(info.c_str());
+    rmdir(bin.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(Arena_ReusesSlots) {
+    RArena<string> arena(4);
+    arena.reserve(3);
+    string* a = arena.create("apt");
+    string* b = arena.create("snap");
+    string* c = arena.create("flatpak");
+    ASSERT_EQ(arena.size(), 3u);
+
+    // reserved objects are laid out next to each other
+    ASSERT_TRUE(reinterpret_cast<char*>(c) - reinterpret_cast<char*>(b) ==
+                reinterpret_cast<char*>(b) - reinterpret_cast<char*>(a));
+
+    // a destroyed object's slot goes to the next one
+    arena.destroy(b);
+    ASSERT_EQ(arena.size(), 2u);
+    string* d = arena.create("deb");
+    ASSERT_TRUE(d == b);
+    ASSERT_EQ(*d, "deb");
+    ASSERT_EQ(*a, "apt");
+
+    // past the reservation the arena grows by whole chunks
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(arena.create("x") != nullptr);
+    }
+    ASSERT_EQ(arena.size(), 13u);
+
+    arena.destroy(a);
+    arena.destroy(c);
+    arena.destroy(d);
+    arena.release();
+    ASSERT_EQ(arena.size(), 0u);
+}
+
+TEST(PackageSet_Combine) {
+    RPackageSet section;
+    for (unsigned int id : {1u, 5u, 64u, 130u, 200u}) {
+        section.insert(id);
+    }
+    RPackageSet status(256);
+    for (unsigned int id : {5u, 63u, 130u, 201u}) {
+        status.insert(id);
+    }
+    ASSERT_EQ(section.count(), 5u);
+    ASSERT_TRUE(section.contains(64));
+    ASSERT_FALSE(section.contains(65));
+    ASSERT_FALSE(section.contains(100000));
+
+    section.intersect(status);
+    vector<unsigned int> ids;
+    section.forEach([&ids](unsigned int id) { ids.push_back(id); });
+    ASSERT_EQ(ids.size(), 2u);
+    ASSERT_EQ(ids[0], 5u);
+    ASSERT_EQ(ids[1], 130u);
+
+    section.erase(5);
+    section.unite(status);
+    ASSERT_EQ(section.count(), 4u);
+
+    section.clear();
+    ASSERT_TRUE(section.empty());
+}
+
+TEST(StoreIndex_SearchAndPersist) {
+    string path = "/tmp/test-polysynaptic-store-" + to_string(getpid()) + ".bin";
+
+    PackageInfo player = makeCatalogPackage("org.videolan.VLC", BackendType::FLATPAK, "3.0");
+    player.name = "VLC";
+    player.summary = "Multimedia player";
+    player.keywords = "video dvd";
+    PackageInfo editor = makeCatalogPackage("org.kde.kdenlive", BackendType::FLATPAK, "24.02");
+    editor.name = "Kdenlive";
+    editor.summary = "Video editor";
+    PackageInfo vlcPlugin = makeCatalogPackage("vlc-plugin", BackendType::FLATPAK, "1.0");
+
+    StoreIndex index;
+    index.update(BackendType::FLATPAK, "stamp-1", {player, editor, vlcPlugin});
+    ASSERT_TRUE(index.hasSection(BackendType::FLATPAK));
+    ASSERT_FALSE(index.hasSection(BackendType::SNAP));
+
+    // Names only unless descriptions are searched
+    SearchOptions options;
+    options.query = "editor";
+    options.searchDescriptions = false;
+    ASSERT_TRUE(index.search(BackendType::FLATPAK, options).empty());
+    options.searchDescriptions = true;
+    ASSERT_EQ(index.search(BackendType::FLATPAK, options).size(), 1u);
+
+    // The exact name ranks above a prefix match
+    options.query = "VLC";
+    auto results = index.search(BackendType::FLATPAK, options);
+    ASSERT_EQ(results.size(), 2u);
+    ASSERT_EQ(results[0].id, "org.videolan.VLC");
+    ASSERT_EQ(results[1].id, "vlc-plugin");
+
+    ASSERT_TRUE(index.save(path));
+    StoreIndex loaded;
+    ASSERT_TRUE(loaded.load(path));
+    unlink(path.c_str());
+    ASSERT_EQ(loaded.getGeneration(BackendType::FLATPAK), "stamp-1");
+    ASSERT_EQ(loaded.size(BackendType::FLATPAK), 3u);
+
+    options.query = "dvd";
+    results = loaded.search(BackendType::FLATPAK, options);
+    ASSERT_EQ(results.size(), 1u);
+    ASSERT_EQ(results[0].keywords, "video dvd");
+}
+
+TEST(StoreIndex_LoadSharedSection) {
+    string path = "/tmp/test-polysynaptic-shared-" + to_string(getpid()) + ".bin";
+
+    StoreIndex shared;
+    shared.update(BackendType::FLATPAK, "stamp-2",
+                  {makeCatalogPackage("org.gimp.GIMP", BackendType::FLATPAK, "2.10")});
+    shared.update(BackendType::SNAP, "names-1",
+                  {makeCatalogPackage("vlc", BackendType::SNAP, "3.0")});
+    ASSERT_TRUE(shared.save(path));
+
+    StoreIndex session;
+    session.update(BackendType::SNAP, "names-0",
+                   {makeCatalogPackage("old", BackendType::SNAP, "1.0")});
+
+    // Only a section written for the generation the session sees
+    ASSERT_FALSE(session.loadSection(path, BackendType::FLATPAK, "stamp-1"));
+    ASSERT_FALSE(session.hasSection(BackendType::FLATPAK));
+    ASSERT_TRUE(session.loadSection(path, BackendType::FLATPAK, "stamp-2"));
+    unlink(path.c_str());
+    ASSERT_FALSE(session.loadSection(path, BackendType::SNAP, "names-1"));
+
+    ASSERT_EQ(session.size(BackendType::FLATPAK), 1u);
+    ASSERT_EQ(session.getGeneration(BackendType::SNAP), "names-0");
+
+    SearchOptions options;
+    options.query = "gimp";
+    ASSERT_EQ(session.search(BackendType::FLATPAK, options).size(), 1u);
+}
+
+TEST(StoreIndex_RefreshAppliesOnlyChanges) {
+    PackageInfo gimp = makeCatalogPackage("org.gimp.GIMP", BackendType::FLATPAK, "2.10");
+    PackageInfo vlc = makeCatalogPackage("org.videolan.VLC", BackendType::FLATPAK, "3.0");
+    PackageInfo krita = makeCatalogPackage("org.kde.krita", BackendType::FLATPAK, "5.2");
+
+    StoreIndex index;
+    CatalogDelta delta = index.refresh(BackendType::FLATPAK, "stamp-1", {gimp, vlc});
+    ASSERT_EQ(delta.added.size(), 2u);
+
+    // The same apps under a new stamp: nothing to redo
+    delta = index.refresh(BackendType::FLATPAK, "stamp-2", {gimp, vlc});
+    ASSERT_TRUE(delta.empty());
+    ASSERT_EQ(index.getGeneration(BackendType::FLATPAK), "stamp-2");
+
+    // Keywords are searched, so a new one is a change
+    vlc.keywords = "dvd";
+    delta = index.refresh(BackendType::FLATPAK, "stamp-3", {vlc, krita});
+    ASSERT_EQ(delta.added.size(), 1u);
+    ASSERT_EQ(delta.changed.size(), 1u);
+    ASSERT_EQ(delta.changed[0].id, "org.videolan.VLC");
+    ASSERT_EQ(delta.removed.size(), 1u);
+    ASSERT_EQ(delta.removed[0].id, "org.gimp.GIMP");
+
+    SearchOptions options;
+    options.searchDescriptions = true;
+    options.query = "dvd";
+    ASSERT_EQ(index.search(BackendType::FLATPAK, options).size(), 1u);
+    options.query = "krita";
+    ASSERT_EQ(index.search(BackendType::FLATPAK, options).size(), 1u);
+    options.query = "gimp";
+    ASSERT_TRUE(index.search(BackendType::FLATPAK, options).empty());
+    ASSERT_EQ(index.lookup(BackendType::FLATPAK, {"org.kde.krita"}).size(), 1u);
+}
+
+// ============================================================================
+// TaskPool Tests
+// ============================================================================
+
+TEST(TaskPool_RunsTasks) {
+    TaskPool pool(2);
+    ASSERT_EQ(pool.getWorkerCount(), 2u);
+
+    vector<future<int>> futures;
+    for (int i = 0; i < 10; i++) {
+        futures.push_back(pool.submit(TaskPriority::NORMAL, [i]() { return i * i; }));
+    }
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(futures[i].get(), i * i);
+    }
+}
+
+TEST(TaskPool_PriorityAndCancellation) {
+    TaskPool pool(1);
+
+    // Hold the only worker so the following tasks queue up
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    auto blocker = pool.submit(TaskPriority::NORMAL, [opened]() { opened.wait(); return 0; });
+
+    mutex orderMutex;
+    vector<string> order;
+    auto record = [&order, &orderMutex](const string& name) {
+        lock_guard<mutex> lock(orderMutex);
+        order.push_back(name);
+        return name;
+    };
+
+    CancellationToken token;
+    auto background = pool.submit(TaskPriority::BACKGROUND, [&]() { return record("background"); });
+    auto cancelled = pool.submit(TaskPriority::INTERACTIVE, token, [&]() { return record("cancelled"); });
+    auto interactive = pool.submit(TaskPriority::INTERACTIVE, [&]() { return record("interactive"); });
+    token.cancel();
+
+    gate.set_value();
+    blocker.get();
+
+    ASSERT_EQ(interactive.get(), "interactive");
+    ASSERT_EQ(background.get(), "background");
+    ASSERT_EQ(cancelled.get(), "");
+    ASSERT_EQ(order.size(), 2u);
+    ASSERT_EQ(order[0], "interactive");
+    ASSERT_EQ(order[1], "background");
+}
+
+TEST(TaskGraph_RunsIndependentStepsTogether) {
+    TaskPool pool(2);
+
+    // The test thread stands in for the main loop
+    mutex mainMutex;
+    condition_variable mainWakeup;
+    deque<function<void()>> mainQueue;
+    TaskGraph graph(pool, [&](function<void()> step) {
+        lock_guard<mutex> lock(mainMutex);
+        mainQueue.push_back(step);
+        mainWakeup.notify_one();
+    });
+
+    thread::id mainThread = this_thread::get_id();
+    atomic<int> running(0);
+    atomic<bool> overlapped(true);
+    atomic<bool> onMain(true);
+    auto list = [&]() {
+        running++;
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (running.load() < 2 && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (running.load() < 2) overlapped = false;
+    };
+
+    int reopen = graph.add("reopen", TaskGraph::MAIN, [&]() {
+        if (this_thread::get_id() != mainThread) onMain = false;
+        throw runtime_error("cache is gone");
+    });
+    int snaps = graph.add("snaps", TaskGraph::POOL, list);
+    int flatpaks = graph.add("flatpaks", TaskGraph::POOL, list);
+    int views = graph.add("views", TaskGraph::MAIN, [&]() {
+        if (this_thread::get_id() != mainThread) onMain = false;
+    }, {reopen});
+    int unified = graph.add("unified", TaskGraph::MAIN, []() {}, {views, snaps, flatpaks});
+    bool finished = false;
+    graph.setFinished([&]() { finished = true; });
+    graph.start();
+
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (!finished && chrono::steady_clock::now() < deadline) {
+        function<void()> step;
+        {
+            unique_lock<mutex> lock(mainMutex);
+            mainWakeup.wait_for(lock, chrono::milliseconds(10),
+                                [&]() { return !mainQueue.empty(); });
+            if (mainQueue.empty()) continue;
+            step = mainQueue.front();
+            mainQueue.pop_front();
+        }
+        step();
+    }
+
+    ASSERT_TRUE(finished);
+    ASSERT_TRUE(graph.isFinished());
+    ASSERT_TRUE(overlapped.load());
+    ASSERT_TRUE(onMain.load());
+    // the failed reopen still let the views step run
+    ASSERT_TRUE(graph.doneAtMs(views) >= graph.doneAtMs(reopen));
+    ASSERT_TRUE(graph.doneAtMs(unified) >= graph.doneAtMs(views));
+    ASSERT_TRUE(graph.doneAtMs(unified) >= graph.doneAtMs(snaps));
+    ASSERT_TRUE(graph.doneAtMs(unified) >= graph.doneAtMs(flatpaks));
+}
+
+TEST(SingleFlight_SharesConcurrentRuns) {
+    SingleFlight<int> flights;
+    atomic<int> runs(0);
+
+    // Hold the first run until the second caller has joined it
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    auto slow = [&runs, opened]() { runs++; opened.wait(); return 42; };
+
+    auto first = async(launch::async, [&]() { return flights.run("snap\ninstalled", slow); });
+    while (runs.load() == 0) this_thread::yield();
+    auto second = async(launch::async, [&]() { return flights.run("snap\ninstalled", slow); });
+    while (flights.getJoinedCount() == 0) this_thread::yield();
+
+    // Another key is not held up
+    ASSERT_EQ(flights.run("flatpak\ninstalled", []() { return 7; }), 7);
+
+    gate.set_value();
+    ASSERT_EQ(first.get(), 42);
+    ASSERT_EQ(second.get(), 42);
+    ASSERT_EQ(runs.load(), 1);
+
+    // Once done, the next call runs again
+    ASSERT_EQ(flights.run("snap\ninstalled", []() { return 1; }), 1);
+    ASSERT_EQ(flights.getJoinedCount(), 1u);
+}
+
+// ============================================================================
+// UpdateChecker Tests
+// ============================================================================
+
+TEST(UpdateChecker_BacksOffWhileUnchanged) {
+    TaskPool pool(1);
+    UpdateChecker checker(pool, chrono::seconds(10), chrono::seconds(40));
+
+    vector<PackageInfo> upgradable = {PackageInfo("firefox", "Firefox", BackendType::SNAP)};
+    upgradable[0].version = "2.0";
+    atomic<int> calls(0);
+    atomic<int> changes(0);
+    checker.addSource(BackendType::SNAP,
+        [&](vector<PackageInfo>& packages, const CancellationToken&) {
+            calls++;
+            packages = upgradable;
+            return true;
+        });
+    checker.setChangedCallback([&](BackendType) { changes++; });
+
+    ASSERT_EQ(checker.getCount(BackendType::SNAP), 0);
+    ASSERT_FALSE(checker.hasChecked(BackendType::SNAP));
+
+    auto now = UpdateChecker::Clock::now();
+    ASSERT_EQ(checker.poll(now), 1);
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(checker.getCount(BackendType::SNAP), 1);
+    ASSERT_EQ(changes.load(), 1);
+    ASSERT_EQ(checker.getInterval(BackendType::SNAP).count(), 10);
+
+    // Not due yet, then due with the same answer: the wait doubles
+    ASSERT_EQ(checker.poll(now), 0);
+    ASSERT_EQ(checker.poll(now + chrono::seconds(11)), 1);
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(checker.getInterval(BackendType::SNAP).count(), 20);
+    ASSERT_EQ(checker.poll(now + chrono::seconds(25)), 0);
+    ASSERT_EQ(checker.poll(now + chrono::seconds(35)), 1);
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(checker.getInterval(BackendType::SNAP).count(), 40);
+    ASSERT_EQ(changes.load(), 1);
+
+    // Invalidating makes it due at once and resets the wait
+    checker.invalidate(BackendType::SNAP);
+    ASSERT_EQ(checker.getInterval(BackendType::SNAP).count(), 10);
+    ASSERT_EQ(checker.poll(now), 1);
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(calls.load(), 4);
+}
+
+TEST(UpdateChecker_ChangeAndFailure) {
+    TaskPool pool(1);
+    UpdateChecker checker(pool, chrono::seconds(10), chrono::seconds(80));
+
+    vector<PackageInfo> upgradable = {PackageInfo("org.gimp.GIMP", "GIMP", BackendType::FLATPAK)};
+    bool fail = false;
+    atomic<int> changes(0);
+    checker.addSource(BackendType::FLATPAK,
+        [&](vector<PackageInfo>& packages, const CancellationToken&) {
+            if (fail) return false;
+            packages = upgradable;
+            return true;
+        });
+    checker.setChangedCallback([&](BackendType) { changes++; });
+
+    auto now = UpdateChecker::Clock::now();
+    checker.poll(now);
+    ASSERT_TRUE(checker.waitIdle(5000));
+    checker.poll(now + chrono::seconds(11));
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(checker.getInterval(BackendType::FLATPAK).count(), 20);
+
+    // A new version is a change: back to the base interval
+    upgradable[0].version = "2.10.38";
+    checker.poll(now + chrono::seconds(100));
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(changes.load(), 2);
+    ASSERT_EQ(checker.getInterval(BackendType::FLATPAK).count(), 10);
+
+    // A failed check keeps the last answer
+    fail = true;
+    checker.poll(now + chrono::seconds(200));
+    ASSERT_TRUE(checker.waitIdle(5000));
+    ASSERT_EQ(checker.getCount(BackendType::FLATPAK), 1);
+    ASSERT_EQ(checker.getSnapshot(BackendType::FLATPAK)[0].version, "2.10.38");
+    ASSERT_EQ(checker.getSnapshot(BackendType::APT).size(), 0u);
+    ASSERT_EQ(changes.load(), 2);
+}
+
+// ============================================================================
+// PredownloadQueue Tests
+// ============================================================================
+
+// Downloads block while held, until released or stopped by the queue
+class PredownloadBackend : public SynthBackend {
+public:
+    PredownloadBackend() : SynthBackend(SynthConfig()) {}
+
+    bool supportsPredownload() const override { return true; }
+
+    OperationResult predownloadUpdates(const vector<string>& packageIds,
+                                       const function<bool()>& cancelled,
+                                       int rateLimitKBps) override {
+        unique_lock<mutex> lock(_lock);
+        calls++;
+        lastIds = packageIds;
+        lastRate = rateLimitKBps;
+        running = true;
+        _changed.notify_all();
+        while (held && !cancelled()) {
+            _changed.wait_for(lock, chrono::milliseconds(5));
+        }
+        bool stopped = held;
+        stops += stopped ? 1 : 0;
+        running = false;
+        _changed.notify_all();
+        return stopped ? OperationResult::Failure("Download cancelled")
+                       : OperationResult::Success("Downloaded");
+    }
+
+    void release() {
+        lock_guard<mutex> lock(_lock);
+        held = false;
+        _changed.notify_all();
+    }
+
+    bool waitRunning() {
+        unique_lock<mutex> lock(_lock);
+        return _changed.wait_for(lock, chrono::seconds(5), [this]() { return running; });
+    }
+
+    int calls = 0;
+    int stops = 0;
+    bool running = false;
+    bool held = true;
+    vector<string> lastIds;
+    int lastRate = 0;
+
+private:
+    mutex _lock;
+    condition_variable _changed;
+};
+
+static bool waitForCount(PredownloadQueue& queue, size_t count)
+{
+    for (int i = 0; i < 1000 && queue.getCount() != count; i++) {
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    return queue.getCount() == count;
+}
+
+TEST(PredownloadQueue_OneDownloadPerBackend) {
+    PredownloadBackend backend;
+    vector<string> pending = {"libc6", "firefox"};
+    TaskPool pool(2);
+    PredownloadQueue queue(pool,
+        [&](BackendType type) { return type == BackendType::APT ? &backend : nullptr; },
+        [&](BackendType) { return pending; });
+
+    // Off by default, and backends that are not there are skipped
+    queue.schedule(BackendType::APT);
+    ASSERT_EQ(queue.getCount(), 0u);
+    queue.setEnabled(true);
+    queue.setRateLimit(200);
+    queue.schedule(BackendType::SNAP);
+    ASSERT_EQ(queue.getCount(), 0u);
+
+    queue.schedule(BackendType::APT);
+    ASSERT_TRUE(backend.waitRunning());
+
+    // Newer sets while it runs fold into one more download after it
+    pending = {"libc6", "firefox", "bash"};
+    queue.schedule(BackendType::APT);
+    queue.schedule(BackendType::APT);
+    ASSERT_EQ(queue.getCount(), 1u);
+
+    backend.release();
+    ASSERT_TRUE(waitForCount(queue, 0));
+    ASSERT_EQ(backend.calls, 2);
+    ASSERT_EQ(backend.stops, 0);
+    ASSERT_EQ(backend.lastIds.size(), 3u);
+    ASSERT_EQ(backend.lastRate, 200);
+}
+
+TEST(PredownloadQueue_MeteredStopsDownloads) {
+    PredownloadBackend backend;
+    TaskPool pool(1);
+    PredownloadQueue queue(pool,
+        [&](BackendType) { return &backend; },
+        [](BackendType) { return vector<string>{"libc6"}; });
+    queue.setEnabled(true);
+
+    queue.schedule(BackendType::APT);
+    ASSERT_TRUE(backend.waitRunning());
+    queue.setMetered(true);
+    ASSERT_TRUE(waitForCount(queue, 0));
+    ASSERT_EQ(backend.stops, 1);
+
+    // Nothing starts while metered, and the next check after it does
+    queue.schedule(BackendType::APT);
+    ASSERT_EQ(queue.getCount(), 0u);
+    ASSERT_EQ(backend.calls, 1);
+    queue.setMetered(false);
+    backend.release();
+    queue.schedule(BackendType::APT);
+    ASSERT_TRUE(waitForCount(queue, 0));
+    ASSERT_EQ(backend.calls, 2);
+    ASSERT_EQ(backend.stops, 1);
+}
+
+TEST(PredownloadQueue_CancelWaitsForDownloads) {
+    PredownloadBackend backend;
+    TaskPool pool(1);
+    PredownloadQueue queue(pool,
+        [&](BackendType) { return &backend; },
+        [](BackendType) { return vector<string>{"libc6"}; });
+    queue.setEnabled(true);
+
+    // What a commit does first: once cancel() returns nothing writes
+    // the caches, the rerun that was due included
+    queue.schedule(BackendType::APT);
+    ASSERT_TRUE(backend.waitRunning());
+    queue.schedule(BackendType::APT);
+    queue.cancel();
+    ASSERT_EQ(queue.getCount(), 0u);
+    ASSERT_FALSE(backend.running);
+    ASSERT_EQ(backend.calls, 1);
+    ASSERT_EQ(backend.stops, 1);
+
+    // Downloads start again afterwards
+    backend.release();
+    queue.schedule(BackendType::APT);
+    ASSERT_TRUE(waitForCount(queue, 0));
+    ASSERT_EQ(backend.calls, 2);
+}
+
+// ============================================================================
+// MediaCache Tests
+// ============================================================================
+
+TEST(MediaCache_DedupAndEvict) {
+    string dir = "/tmp/test-polysynaptic-media-" + to_string(getpid());
+
+    // The fetcher holds every download until the gate opens
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    atomic<int> fetches(0);
+    auto fetcher = [&fetches, opened](const string& uri, const string& dest) {
+        opened.wait();
+        fetches++;
+        if (uri == "bad") return false;
+        ofstream out(dest.c_str());
+        out << string(100, 'x');
+        return true;
+    };
+
+    {
+        MediaCache cache(dir, 250, fetcher);
+
+        // Two requests for the same file share one download
+        mutex resultMutex;
+        vector<string> files;
+        promise<void> bothDone;
+        auto done = [&](const string& file) {
+            lock_guard<mutex> lock(resultMutex);
+            files.push_back(file);
+            if (files.size() == 2) bothDone.set_value();
+        };
+        cache.request(MediaKind::THUMBNAIL, "vlc", "3.0", "uri-vlc",
+                      TaskPriority::INTERACTIVE, done);
+        cache.request(MediaKind::THUMBNAIL, "vlc", "3.0", "uri-vlc",
+                      TaskPriority::INTERACTIVE, done);
+        ASSERT_TRUE(cache.isPending(MediaKind::THUMBNAIL, "vlc", "3.0"));
+        gate.set_value();
+        bothDone.get_future().wait();
+
+        ASSERT_EQ(fetches.load(), 1);
+        ASSERT_FALSE(files[0].empty());
+        ASSERT_EQ(files[0], files[1]);
+        ASSERT_EQ(cache.lookup(MediaKind::THUMBNAIL, "vlc", "3.0"), files[0]);
+
+        // Another version is another file; failures are not cached
+        ASSERT_TRUE(cache.lookup(MediaKind::THUMBNAIL, "vlc", "3.1").empty());
+        promise<string> failed;
+        cache.request(MediaKind::CHANGELOG, "gimp", "2.10", "bad",
+                      TaskPriority::INTERACTIVE,
+                      [&failed](const string& file) { failed.set_value(file); });
+        ASSERT_TRUE(failed.get_future().get().empty());
+        ASSERT_EQ(cache.getEntryCount(), 1u);
+
+        // Over the limit the least recently used file goes first
+        promise<void> second, third;
+        cache.request(MediaKind::CHANGELOG, "gimp", "2.10", "uri-gimp",
+                      TaskPriority::INTERACTIVE,
+                      [&second](const string&) { second.set_value(); });
+        second.get_future().wait();
+        ASSERT_FALSE(cache.lookup(MediaKind::THUMBNAIL, "vlc", "3.0").empty());
+        cache.request(MediaKind::SCREENSHOT, "inkscape", "1.2", "uri-inkscape",
+                      TaskPriority::INTERACTIVE,
+                      [&third](const string&) { third.set_value(); });
+        third.get_future().wait();
+        ASSERT_EQ(cache.getEntryCount(), 2u);
+        ASSERT_EQ(cache.getSize(), 200u);
+        ASSERT_TRUE(cache.lookup(MediaKind::CHANGELOG, "gimp", "2.10").empty());
+        ASSERT_FALSE(cache.lookup(MediaKind::THUMBNAIL, "vlc", "3.0").empty());
+    }
+
+    // The files and their order survive a restart
+    MediaCache reopened(dir, 250, fetcher);
+    ASSERT_EQ(reopened.getEntryCount(), 2u);
+    ASSERT_FALSE(reopened.lookup(MediaKind::SCREENSHOT, "inkscape", "1.2").empty());
+
+    unlink((dir + "/thumb_vlc_3.0").c_str());
+    unlink((dir + "/shot_inkscape_1.2").c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(MediaCache_PartialFileWhileFetching) {
+    string dir = "/tmp/test-polysynaptic-partial-" + to_string(getpid());
+
+    MediaCache* self = nullptr;
+    string seen;
+    auto fetcher = [&self, &seen](const string&, const string& dest) {
+        seen = self->partialFile(MediaKind::CHANGELOG, "linux", "6.8");
+        ofstream out(dest.c_str());
+        out << "linux (6.8-1) unstable; urgency=low\n";
+        return seen == dest;
+    };
+
+    MediaCache cache(dir, 0, fetcher);
+    self = &cache;
+    ASSERT_TRUE(cache.partialFile(MediaKind::CHANGELOG, "linux", "6.8").empty());
+
+    promise<string> done;
+    cache.request(MediaKind::CHANGELOG, "linux", "6.8", "uri-linux",
+                  TaskPriority::INTERACTIVE,
+                  [&done](const string& file) { done.set_value(file); });
+    string file = done.get_future().get();
+    ASSERT_FALSE(file.empty());
+    ASSERT_EQ(seen, file + ".part");
+    ASSERT_TRUE(cache.partialFile(MediaKind::CHANGELOG, "linux", "6.8").empty());
+
+    unlink(file.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(ChangelogReader_SplitsEntriesAcrossChunks) {
+    ASSERT_EQ(ChangelogReader::headerVersion("vlc (3.0.20-1) unstable; urgency=low"),
+              "3.0.20-1");
+    ASSERT_EQ(ChangelogReader::headerVersion("  * Fix (closes: #1); thanks"), "");
+    ASSERT_EQ(ChangelogReader::headerVersion(" -- Jane <j@x.org>  Mon, 1 Jan 2024"), "");
+
+    string text =
+        "vlc (3.0.21-1) unstable; urgency=medium\n"
+        "\n"
+        "  * New upstream release.\n"
+        "\n"
+        " -- Jane <j@x.org>  Mon, 01 Jul 2024 10:00:00 +0200\n"
+        "\n"
+        "vlc (3.0.20-1) unstable; urgency=low\n"
+        "\n"
+        "  * Older work.\n"
+        "vlc (3.0.19-1) unstable; urgency=low\n"
+        "  * Even older.";
+
+    // Plain string comparison stands in for APT's here
+    auto compare = [](const string& a, const string& b) { return a.compare(b); };
+    ChangelogReader reader("3.0.20-1", compare);
+
+    // In small pieces, lines cut in the middle
+    ChangelogReader::Entry entry;
+    for (size_t at = 0; at < text.size(); at += 7) {
+        reader.feed(text.data() + at, min<size_t>(7, text.size() - at));
+        if (at < 40) {
+            ASSERT_FALSE(reader.next(entry));
+        }
+    }
+    reader.finish();
+
+    vector<ChangelogReader::Entry> entries;
+    while (reader.next(entry)) {
+        entries.push_back(entry);
+    }
+    ASSERT_EQ(entries.size(), 3u);
+    ASSERT_EQ(entries[0].version, "3.0.21-1");
+    ASSERT_TRUE(entries[0].newer);
+    ASSERT_EQ(entries[1].version, "3.0.20-1");
+    ASSERT_FALSE(entries[1].newer);
+    ASSERT_FALSE(entries[2].newer);
+    ASSERT_TRUE(reader.reachedInstalled());
+    ASSERT_EQ(entries[0].text + entries[1].text + entries[2].text, text);
+
+    // Anything but a changelog is one entry, shown
+    ChangelogReader plain("1.0", compare);
+    string page = "Failed to fetch the changelog\n";
+    plain.feed(page.data(), page.size());
+    plain.finish();
+    ASSERT_TRUE(plain.next(entry));
+    ASSERT_TRUE(entry.version.empty());
+    ASSERT_TRUE(entry.newer);
+    ASSERT_EQ(entry.text, page);
+}
+
+// ============================================================================
+// BackendManager Tests (without real backends)
+// ============================================================================
+
+TEST(BackendManager_Creation) {
+    BackendManager manager(nullptr);
+
+    // Without a lister, APT backend shouldn't be available
+    auto statuses = manager.getBackendStatuses();
+    ASSERT_TRUE(statuses.size() >= 2);  // At least Snap and Flatpak
+}
+
+TEST(BackendManager_EnableDisable) {
+    BackendManager manager(nullptr);
+
+    manager.setBackendEnabled(BackendType::SNAP, false);
+    ASSERT_FALSE(manager.isBackendEnabled(BackendType::SNAP));
+
+    manager.setBackendEnabled(BackendType::SNAP, true);
+    ASSERT_TRUE(manager.isBackendEnabled(BackendType::SNAP));
+}
+
+TEST(BackendManager_TransactionQueue) {
+    BackendManager manager(nullptr);
+
+    ASSERT_FALSE(manager.hasQueuedOperations());
+
+    PackageInfo pkg("test", "Test", BackendType::SNAP);
+    manager.queueInstall(pkg);
+
+    ASSERT_TRUE(manager.hasQueuedOperations());
+
+    manager.clearTransaction();
+    ASSERT_FALSE(manager.hasQueuedOperations());
+}
+
+TEST(BackendManager_FillDownloadSizes) {
+    BackendManager manager(nullptr);
+
+    // APT sizes come from the lister and removals download nothing
+    Transaction tx;
+    Transaction::Operation op;
+    op.backend = BackendType::APT;
+    op.packageId = "vim";
+    tx.operations.push_back(op);
+    op.backend = BackendType::SNAP;
+    op.packageId = "firefox";
+    op.type = Transaction::Operation::Type::REMOVE;
+    tx.operations.push_back(op);
+    ASSERT_TRUE(manager.fillDownloadSizes(tx));
+    ASSERT_EQ(tx.operations[1].downloadSize, 0);
+
+    // Nothing fetched yet, so the install's size is unknown
+    op.packageId = "code";
+    op.type = Transaction::Operation::Type::INSTALL;
+    op.downloadSize = 42;
+    tx.operations.push_back(op);
+    ASSERT_FALSE(manager.fillDownloadSizes(tx));
+    ASSERT_EQ(tx.operations[2].downloadSize, 0);
+}
+
+TEST(BackendManager_UnqueueByIdentity) {
+    BackendManager manager(nullptr);
+
+    PackageInfo apt_pkg("firefox", "Firefox", BackendType::APT);
+    PackageInfo snap_pkg("firefox", "Firefox", BackendType::SNAP);
+    manager.queueInstall(apt_pkg);
+    manager.queueInstall(snap_pkg);
+
+    Transaction::Operation op;
+    op.backend = BackendType::FLATPAK;
+    op.packageId = "org.mozilla.firefox";
+    manager.queueOperation(op);
+
+    Transaction tx = manager.getCurrentTransaction();
+    ASSERT_EQ(tx.operations.size(), 3u);
+    ASSERT_TRUE(tx.contains(BackendType::FLATPAK, "org.mozilla.firefox"));
+    ASSERT_FALSE(tx.contains(BackendType::FLATPAK, "firefox"));
+
+    // Only the snap goes; the deb of the same name stays queued
+    manager.unqueue("firefox", BackendType::SNAP);
+    tx = manager.getCurrentTransaction();
+    ASSERT_EQ(tx.operations.size(), 2u);
+    ASSERT_TRUE(tx.contains(BackendType::APT, "firefox"));
+    ASSERT_FALSE(tx.contains(BackendType::SNAP, "firefox"));
+}
+
+TEST(BackendManager_LowMemoryTrimsListFields) {
+    BackendManager manager(nullptr);
+
+    PackageInfo snap("vlc", "VLC", BackendType::SNAP);
+    snap.summary = "multimedia player";
+    snap.description = string(300, 'd');
+    snap.homepage = "https://www.videolan.org/";
+    vector<PackageInfo> packages = {snap};
+
+    // Off by default
+    manager.trimForList(packages);
+    ASSERT_EQ(packages[0].description.size(), 300u);
+
+    string path = "/tmp/test-polysynaptic-lowmem-" + to_string(getpid()) + ".conf";
+    { ofstream(path) << "low_memory=true\n"; }
+    manager.loadConfiguration(path);
+    ASSERT_TRUE(manager.isLowMemoryMode());
+    ASSERT_EQ(Logger::instance().getMemorySink()->capacity(), 200u);
+
+    // What the list shows stays, the rest is left to resolveDetails()
+    manager.trimForList(packages);
+    ASSERT_TRUE(packages[0].description.empty());
+    ASSERT_TRUE(packages[0].homepage.empty());
+    ASSERT_EQ(packages[0].summary, "multimedia player");
+    ASSERT_TRUE(packages[0].isDeferred(PackageInfo::DEFER_DESCRIPTION));
+    ASSERT_TRUE(packages[0].isDeferred(PackageInfo::DEFER_HOMEPAGE));
+    ASSERT_TRUE(packages[0].deferredSource == nullptr);
+
+    { ofstream(path) << "low_memory=false\n"; }
+    manager.loadConfiguration(path);
+    ASSERT_FALSE(manager.isLowMemoryMode());
+    ASSERT_EQ(Logger::instance().getMemorySink()->capacity(), 1000u);
+    unlink(path.c_str());
+}
+
+TEST(BackendManager_SourceCountsStartUnknown) {
+    BackendManager manager(nullptr);
+
+    // Nothing has been loaded or checked, and asking asks no backend
+    SourceCounts counts = manager.getSourceCounts(BackendType::APT);
+    ASSERT_EQ(counts.installed, -1);
+    ASSERT_EQ(counts.upgradable, -1);
+    ASSERT_EQ(counts.available, -1);
+    ASSERT_TRUE(counts == SourceCounts());
+}
+
+TEST(BackendManager_SearchSessions) {
+    BackendManager manager(nullptr);
+    manager.setBackendEnabled(BackendType::SNAP, false);
+    manager.setBackendEnabled(BackendType::FLATPAK, false);
+
+    SearchOptions options;
+    options.query = "editor";
+
+    // With no backend to ask, a session delivers right away
+    int deliveries = 0;
+    uint64_t delivered = 0;
+    auto onResults = [&](uint64_t session, const vector<PackageInfo>& results) {
+        deliveries++;
+        delivered = session;
+        ASSERT_TRUE(results.empty());
+    };
+
+    uint64_t first = manager.startSearch(options, BackendFilter::All(), onResults);
+    uint64_t second = manager.startSearch(options, BackendFilter::All(), onResults);
+
+    ASSERT_TRUE(second > first);
+    ASSERT_FALSE(manager.isCurrentSearch(first));
+    ASSERT_TRUE(manager.isCurrentSearch(second));
+    ASSERT_EQ(deliveries, 2);
+    ASSERT_EQ(delivered, second);
+}
+
+TEST(BackendManager_MergeTopResults) {
+    auto result = [](const string& name, BackendType backend, const string& query) {
+        PackageInfo pkg(name, name, backend);
+        pkg.summary = "an editor";
+        pkg.relevance = BackendManager::searchRelevance(pkg, query);
+        return pkg;
+    };
+
+    ASSERT_TRUE(BackendManager::searchRelevance(result("vim", BackendType::APT, ""), "VIM") >
+                BackendManager::searchRelevance(result("vim-gtk3", BackendType::APT, ""), "vim"));
+    ASSERT_EQ(BackendManager::searchRelevance(result("nano", BackendType::APT, ""), "editor"), 1);
+
+    // APT answered in Xapian order; the best match wins across backends
+    vector<vector<PackageInfo>> perBackend(3);
+    perBackend[0] = {result("neovim", BackendType::APT, "vim"),
+                     result("vim", BackendType::APT, "vim"),
+                     result("nano", BackendType::APT, "vim")};
+    perBackend[1] = {result("gvim", BackendType::SNAP, "vim"),
+                     result("vim-editor", BackendType::SNAP, "vim")};
+
+    SearchOptions options;
+    options.maxResults = 3;
+    vector<PackageInfo> merged = BackendManager::mergeSearchResults(perBackend, options);
+    ASSERT_EQ(merged.size(), 3u);
+    ASSERT_EQ(merged[0].name, "vim");
+    ASSERT_EQ(merged[1].name, "vim-editor");
+    // Equal relevance goes by name
+    ASSERT_EQ(merged[2].name, "gvim");
+
+    options.maxResults = 0;
+    perBackend[0] = {result("a", BackendType::APT, "x")};
+    perBackend[1] = {};
+    perBackend[2] = {result("b", BackendType::FLATPAK, "x")};
+    ASSERT_EQ(BackendManager::mergeSearchResults(perBackend, options).size(), 2u);
+}
+
+// ============================================================================
+// Structured Log Tests
+// ============================================================================
+
+TEST(LogQueue_Bounded) {
+    LogQueue queue(3);
+    ASSERT_EQ(queue.capacity(), 4u);
+
+    for (int i = 0; i < 4; i++) {
+        LogEntry entry;
+        entry.message = "entry " + to_string(i);
+        ASSERT_TRUE(queue.push(entry));
+    }
+
+    // A full queue leaves the entry with the caller
+    LogEntry extra;
+    extra.message = "extra";
+    ASSERT_FALSE(queue.push(extra));
+    ASSERT_EQ(extra.message, "extra");
+
+    LogEntry out;
+    ASSERT_TRUE(queue.pop(out));
+    ASSERT_EQ(out.message, "entry 0");
+    ASSERT_TRUE(queue.push(extra));
+
+    for (int i = 1; i < 4; i++) {
+        ASSERT_TRUE(queue.pop(out));
+        ASSERT_EQ(out.message, "entry " + to_string(i));
+    }
+    ASSERT_TRUE(queue.pop(out));
+    ASSERT_EQ(out.message, "extra");
+    ASSERT_FALSE(queue.pop(out));
+}
+
+TEST(LogQueue_ConcurrentProducers) {
+    const int producers = 4;
+    const int perProducer = 500;
+    LogQueue queue(64);
+
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < perProducer; i++) {
+                LogEntry entry;
+                entry.exitCode = p * perProducer + i;
+                while (!queue.push(entry)) {
+                    this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Each producer's entries come out in the order it pushed them
+    vector<int> last(producers, -1);
+    int received = 0;
+    LogEntry entry;
+    while (received < producers * perProducer) {
+        if (!queue.pop(entry)) {
+            this_thread::yield();
+            continue;
+        }
+        int p = entry.exitCode / perProducer;
+        ASSERT_TRUE(entry.exitCode > last[p]);
+        last[p] = entry.exitCode;
+        received++;
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_FALSE(queue.pop(entry));
+}
+
+TEST(LogEntry_Json) {
+    LogEntry entry;
+    entry.level = LogLevel::WARN;
+    entry.message = "say \"hi\"\n\x01";
+    entry.provider = "Snap";
+    entry.exitCode = 2;
+    entry.fields["query"] = "caf\xc3\xa9";
+    entry.fields["count"] = "3";
+    entry.fields["query"] = "tea";
+
+    string json = entry.toJson();
+    ASSERT_TRUE(json.find("\"level\":\"WARN\"") != string::npos);
+    ASSERT_TRUE(json.find("\"message\":\"say \\\"hi\\\"\\n\\u0001\"") != string::npos);
+    ASSERT_TRUE(json.find("\"provider\":\"Snap\"") != string::npos);
+    ASSERT_TRUE(json.find("\"exitCode\":2") != string::npos);
+    // Fields keep their first position and their last value
+    ASSERT_TRUE(json.find("\"query\":\"tea\",\"count\":\"3\"}") != string::npos);
+    ASSERT_EQ(entry.fields.size(), 2u);
+}
+
+TEST(Logger_DisabledSkipsArguments) {
+    int evaluated = 0;
+    auto text = [&evaluated]() {
+        evaluated++;
+        return string("expensive");
+    };
+
+    Logger::instance().setMinLevel(LogLevel::INFO);
+    LOG(LogLevel::DEBUG).message(text()).field("key", text()).emit();
+    LOG_DEBUG(text());
+    ASSERT_EQ(evaluated, 0);
+}
+
+TEST(Logger_AsyncFlush) {
+    auto sink = make_shared<MemorySink>(100);
+    Logger::instance().addSink(sink);
+
+    LOG(LogLevel::DEBUG).message("below the minimum level").emit();
+    LOG(LogLevel::INFO)
+        .component("Test")
+        .message("queued for the writer")
+        .emit();
+
+    // flush() hands over everything queued so far
+    Logger::instance().flush();
+    auto entries = sink->getEntriesFiltered(LogLevel::DEBUG);
+    bool found = false;
+    for (const auto& entry : entries) {
+        ASSERT_NE(entry.message, "below the minimum level");
+        found = found || entry.message == "queued for the writer";
+    }
+    ASSERT_TRUE(found);
+    ASSERT_EQ(Logger::instance().getDroppedCount(), 0u);
+}
+
+TEST(LogLimiter_SuppressesAndSummarizes) {
+    LogLimiter limiter;
+    limiter.setRateLimit(10, 5);
+    auto start = LogLimiter::Clock::now();
+
+    auto line = [](int n, LogLevel level) {
+        LogEntry entry;
+        entry.level = level;
+        entry.provider = "Flatpak";
+        entry.operation = "search";
+        entry.message = "Parsed line " + std::to_string(n);
+        return entry;
+    };
+
+    int admitted = 0;
+    for (int i = 0; i < 12309; i++) {
+        LogEntry entry = line(i, LogLevel::DEBUG);
+        admitted += limiter.admit(entry, start);
+    }
+    ASSERT_EQ(admitted, 5);
+    ASSERT_EQ(limiter.getSuppressedCount(), 12304u);
+
+    // Another template has a budget of its own; errors are never held back
+    LogEntry other = line(1, LogLevel::DEBUG);
+    other.message = "Remote answered";
+    ASSERT_TRUE(limiter.admit(other, start));
+    LogEntry failure = line(1, LogLevel::ERROR);
+    ASSERT_TRUE(limiter.admit(failure, start));
+
+    vector<LogEntry> notes = limiter.summarize(start);
+    ASSERT_EQ(notes.size(), 1u);
+    ASSERT_EQ(notes[0].message, "Suppressed 12,304 similar messages");
+    ASSERT_EQ(notes[0].provider, "Flatpak");
+    ASSERT_EQ(notes[0].fields.find("template")->second, "Parsed line #");
+    ASSERT_TRUE(limiter.summarize(start).empty());
+
+    // A second later the key has refilled
+    admitted = 0;
+    for (int i = 0; i < 20; i++) {
+        LogEntry entry = line(i, LogLevel::DEBUG);
+        admitted += limiter.admit(entry, start + std::chrono::seconds(1));
+    }
+    ASSERT_EQ(admitted, 5);
+
+    limiter.setRateLimit(0, 1);
+    limiter.setSampleRate(LogLevel::DEBUG, 0);
+    LogEntry dropped = line(1, LogLevel::DEBUG);
+    ASSERT_FALSE(limiter.admit(dropped, start));
+    LogEntry info = line(1, LogLevel::INFO);
+    ASSERT_TRUE(limiter.admit(info, start));
+    ASSERT_TRUE(info.fields.find("sampleRate") == info.fields.end());
+
+    limiter.setSampleRate(LogLevel::DEBUG, 0.5);
+    int kept = 0;
+    for (int i = 0; i < 1000; i++) {
+        LogEntry entry = line(i, LogLevel::DEBUG);
+        if (limiter.admit(entry, start)) {
+            kept++;
+            ASSERT_EQ(entry.fields.find("sampleRate")->second, "0.5");
+        }
+    }
+    ASSERT_TRUE(kept > 350 && kept < 650);
+}
+
+TEST(FileSink_RotatesAndSlicesByTime) {
+    string dir = "/tmp/polysynaptic-test-filesink-" + std::to_string(getpid());
+    string cleanup = "rm -rf " + dir;
+    system(cleanup.c_str());
+    mkdir(dir.c_str(), 0755);
+    string path = dir + "/polysynaptic.log";
+
+    FileSink::Rotation rotation;
+    rotation.maxBytes = 1;
+    rotation.maxSegments = 2;
+    time_t base = 1700000000;
+
+    {
+        FileSink sink(path, rotation);
+        auto logAt = [&sink, base](int hour, const string& message) {
+            LogEntry entry;
+            entry.timestamp = std::chrono::system_clock::from_time_t(base + hour * 3600);
+            entry.message = message;
+            sink.write(entry);
+            sink.flush();
+        };
+
+        logAt(0, "first hour");
+        for (int i = 0; i < 64; i++) sink.maintain();
+        logAt(1, "second hour");
+        for (int i = 0; i < 64; i++) sink.maintain();
+        logAt(2, "third hour");
+        for (int i = 0; i < 64; i++) sink.maintain();
+
+        // Only two segments are kept; the oldest is gone
+        vector<FileSink::Segment> segments = FileSink::segments(path);
+        ASSERT_EQ(segments.size(), 2u);
+        ASSERT_EQ(segments[0].first, base + 3600);
+        ASSERT_EQ(segments[1].first, base + 7200);
+
+        logAt(3, "fourth hour, still live");
+    }
+
+    string out = dir + "/slice.jsonl";
+    ASSERT_EQ(FileSink::exportRange(path, base + 7200, base + 4 * 3600, out), 2);
+    std::ifstream in(out.c_str());
+    string slice((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(slice.find("third hour") != string::npos);
+    ASSERT_TRUE(slice.find("fourth hour") != string::npos);
+    ASSERT_TRUE(slice.find("second hour") == string::npos);
+
+    system(cleanup.c_str());
+}
+
+TEST(RRecordCache_ParsesFieldsOnce) {
+    RRecord rec("Package: foo\n"
+                "source: foo-src (1.0-1)\n"
+                "Maintainer: Jane Doe <jane@example.org>  \n"
+                "Description-md5: 0123456789abcdef\n"
+                "Description-de: Ein Paket\n"
+                " Mit einer langen\n"
+                " Beschreibung.\n"
+                "\n"
+                "Package: ignored\n");
+
+    ASSERT_EQ(rec.field("package"), string("foo"));
+    ASSERT_EQ(rec.field("MAINTAINER"), string("Jane Doe <jane@example.org>"));
+    ASSERT_EQ(rec.sourcePackage(), string("foo-src"));
+    ASSERT_EQ(rec.description(),
+              string("Ein Paket\n Mit einer langen\n Beschreibung."));
+    ASSERT_EQ(rec.shortDescription(), string("Ein Paket"));
+    ASSERT_FALSE(rec.has("Homepage"));
+    ASSERT_EQ(RRecord("Package: bar\n").sourcePackage(), string(""));
+
+    RRecordCache cache(2);
+    int reads = 0;
+    auto reader = [&reads](const char *name) {
+        return [&reads, name]() {
+            reads++;
+            return string("Package: ") + name + "\n";
+        };
+    };
+
+    ASSERT_EQ(cache.get(RRecordCache::key(1, 10), reader("a"))->field("Package"), string("a"));
+    ASSERT_EQ(cache.get(RRecordCache::key(1, 10), reader("a"))->field("Package"), string("a"));
+    ASSERT_EQ(reads, 1);
+
+    // "a" was used last, so "b" makes way for "c"
+    cache.get(RRecordCache::key(2, 10), reader("b"));
+    cache.get(RRecordCache::key(1, 10), reader("a"));
+    cache.get(RRecordCache::key(1, 20), reader("c"));
+    ASSERT_EQ(cache.size(), 2u);
+    ASSERT_EQ(reads, 3);
+    cache.get(RRecordCache::key(1, 10), reader("a"));
+    ASSERT_EQ(reads, 3);
+    cache.get(RRecordCache::key(2, 10), reader("b"));
+    ASSERT_EQ(reads, 4);
+
+    ASSERT_EQ(cache.hits(), 3u);
+    ASSERT_EQ(cache.misses(), 4u);
+    ASSERT_TRUE(cache.memoryBytes() > 0);
+
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0u);
+    ASSERT_EQ(cache.memoryBytes(), 0u);
+}
+
+TEST(RTaskList_ReadsListAndDescriptions) {
+    vector<RTaskList::Task> tasks;
+    RTaskList::parseList("u desktop\tDebian desktop environment\n"
+                         "i ssh-server\tSSH server\n"
+                         "garbage\n", tasks);
+    ASSERT_EQ(tasks.size(), 2u);
+    ASSERT_EQ(tasks[0].name, string("desktop"));
+    ASSERT_EQ(tasks[0].summary, string("Debian desktop environment"));
+    ASSERT_FALSE(tasks[0].installed);
+    ASSERT_TRUE(tasks[1].installed);
+
+    map<string, string> descriptions;
+    RTaskList::parseDescriptions("Task: ssh-server\n"
+                                 "Section: server\n"
+                                 "Description: SSH server\n"
+                                 " This task sets up your system\n"
+                                 " to be remotely accessed.\n"
+                                 "Key:\n"
+                                 "  openssh-server\n"
+                                 "\n"
+                                 "Task: no-description\n"
+                                 "Section: user\n", descriptions);
+    ASSERT_EQ(descriptions.size(), 1u);
+    ASSERT_EQ(descriptions["ssh-server"],
+              string("This task sets up your system to be remotely accessed."));
+
+    // the list comes from one run, the descriptions from the files
+    string dir = "/tmp/polysynaptic-tasks-" + to_string(getpid());
+    system(("mkdir -p " + dir).c_str());
+    ofstream(dir + "/debian-tasks.desc") << "Task: ssh-server\n"
+                                          << "Description: SSH server\n"
+                                          << " Remote access.\n";
+    RTaskList list("printf 'i ssh-server\\tSSH server\\n'; true", dir);
+    list.prefetch();
+    ASSERT_EQ(list.tasks().size(), 1u);
+    ASSERT_EQ(list.tasks()[0].name, string("ssh-server"));
+    ASSERT_EQ(list.description("ssh-server"), string("Remote access."));
+    system(("rm -rf " + dir).c_str());
+}
+
+namespace {
+
+// packages with a manual flag, installed or not, and what each keeps
+struct FakeAutoRemoveGraph : RAutoRemoveTracker::Graph {
+    vector<bool> installed;
+    vector<bool> manual;
+    vector<vector<unsigned int>> depends;
+
+    explicit FakeAutoRemoveGraph(unsigned int n)
+        : installed(n, true), manual(n, false), depends(n) {}
+
+    unsigned int size() override { return installed.size(); }
+    uint64_t state(unsigned int id) override {
+        return installed[id] | manual[id] << 1 | (uint64_t)depends[id].size() << 2;
+    }
+    bool isInstalled(unsigned int id) override { return installed[id]; }
+    bool isRoot(unsigned int id) override { return manual[id]; }
+    void kept(unsigned int id, vector<unsigned int> &out) override {
+        for (unsigned int d : depends[id]) {
+            if (installed[d]) out.push_back(d);
+        }
+    }
+    void keepers(unsigned int id, vector<unsigned int> &out) override {
+        for (unsigned int p = 0; p < depends.size(); p++) {
+            if (find(depends[p].begin(), depends[p].end(), id) != depends[p].end())
+                out.push_back(p);
+        }
+    }
+};
+
+} // anonymous namespace
+
+TEST(RAutoRemoveTracker_UpdatesTheNeighbourhood) {
+    // 0 (manual) -> 1 -> 2 <-> 3 (a cycle), 4 (manual) -> 3;
+    // 5 -> 6, neither kept by anything; 7..99 manual leaves
+    FakeAutoRemoveGraph graph(100);
+    graph.manual[0] = graph.manual[4] = true;
+    for (unsigned int i = 7; i < 100; i++) graph.manual[i] = true;
+    graph.depends[0] = {1};
+    graph.depends[1] = {2};
+    graph.depends[2] = {3};
+    graph.depends[3] = {2};
+    graph.depends[4] = {3};
+    graph.depends[5] = {6};
+
+    RAutoRemoveTracker tracker;
+    tracker.rebuild(graph);
+    ASSERT_TRUE((tracker.garbage() == vector<unsigned int>{5, 6}));
+
+    // 0 goes: 1 is garbage, the cycle is still kept by 4
+    graph.installed[0] = false;
+    tracker.update(graph);
+    ASSERT_TRUE((tracker.garbage() == vector<unsigned int>{1, 5, 6}));
+    ASSERT_TRUE(tracker.touched() < 10u);
+
+    // and 4: the cycle does not keep itself
+    graph.installed[4] = false;
+    tracker.update(graph);
+    ASSERT_TRUE((tracker.garbage() == vector<unsigned int>{1, 2, 3, 5, 6}));
+
+    // installing 5 by hand keeps 6 again
+    graph.manual[5] = true;
+    tracker.update(graph);
+    ASSERT_TRUE((tracker.garbage() == vector<unsigned int>{1, 2, 3}));
+
+    // a new dependency of a kept package, with nothing else changed,
+    // keeps what it pulls in as well
+    graph.depends[5] = {6, 1};
+    tracker.update(graph);
+    ASSERT_TRUE(tracker.garbage().empty());
+
+    // nothing changed, nothing looked at
+    tracker.update(graph);
+    ASSERT_EQ(tracker.touched(), 0u);
+
+    RAutoRemoveTracker fresh;
+    fresh.rebuild(graph);
+    ASSERT_TRUE(fresh.garbage() == tracker.garbage());
+}
+
+TEST(RSelectionCounts_KeepsTheMaskOfEachRow) {
+    int a = 0, b = 0, c = 0;
+    RSelectionCounts selection;
+    selection.add(&a, 1 | 2);
+    selection.add(&b, 2);
+    ASSERT_EQ(selection.size(), 2u);
+    ASSERT_EQ(selection.count(1), 2u);
+    ASSERT_EQ(selection.actions(), 3u);
+
+    // again with another mask replaces the first one
+    selection.add(&a, 4);
+    ASSERT_EQ(selection.size(), 2u);
+    ASSERT_EQ(selection.count(0), 0u);
+    ASSERT_EQ(selection.actions(), 2u | 4u);
+
+    // removed with the mask it was counted with
+    selection.remove(&b);
+    selection.remove(&c);
+    ASSERT_EQ(selection.actions(), 4u);
+    ASSERT_FALSE(selection.contains(&b));
+
+    selection.add(&c, 0);
+    selection.refresh([&c](const void *key) { return key == &c ? 8u : 0u; });
+    ASSERT_EQ(selection.actions(), 8u);
+    ASSERT_EQ(selection.count(3), 1u);
+
+    selection.clear();
+    ASSERT_EQ(selection.size(), 0u);
+    ASSERT_EQ(selection.actions(), 0u);
+}
+
+TEST(MemorySink_EntriesSince) {
+    MemorySink sink(4);
+    for (int i = 0; i < 3; i++) {
+        LogEntry entry;
+        entry.message = "entry " + to_string(i);
+        sink.write(entry);
+    }
+
+    uint64_t first = 0;
+    ASSERT_EQ(sink.getEntriesSince(1, first).size(), 2u);
+    ASSERT_EQ(first, 1u);
+
+    // Entries pushed out of the ring are skipped
+    vector<LogEntry> batch(3);
+    sink.writeBatch(batch);
+    vector<LogEntry> since = sink.getEntriesSince(0, first);
+    ASSERT_EQ(first, 2u);
+    ASSERT_EQ(since.size(), 4u);
+    ASSERT_EQ(since[0].message, "entry 2");
+
+    ASSERT_TRUE(sink.getEntriesSince(sink.written(), first).empty());
+    ASSERT_EQ(first, 6u);
+}
+
+TEST(MemorySink_IndexedCursor) {
+    MemorySink sink(8);
+    const LogLevel levels[] = { LogLevel::DEBUG, LogLevel::INFO,
+                                LogLevel::WARN, LogLevel::ERROR };
+    for (int i = 0; i < 12; i++) {
+        LogEntry entry;
+        entry.level = levels[i % 4];
+        entry.provider = i % 3 == 0 ? "Snap" : "APT";
+        entry.message = to_string(i);
+        sink.write(entry);
+    }
+    // Entries 0-3 were overwritten
+    ASSERT_EQ(sink.size(), 8u);
+    ASSERT_EQ(sink.capacity(), 8u);
+
+    MemorySink::Query warnings;
+    warnings.minLevel = LogLevel::WARN;
+    vector<string> seen;
+    MemorySink::Cursor cursor(warnings);
+    sink.read(cursor, [&seen](uint64_t, const LogEntry& entry) {
+        seen.push_back(entry.message);
+        return true;
+    });
+    ASSERT_EQ(seen.size(), 4u);
+    ASSERT_EQ(seen[0], "6");
+    ASSERT_EQ(seen[3], "11");
+    ASSERT_EQ(sink.count(warnings), 4u);
+
+    // A limited read resumes where it stopped
+    MemorySink::Query snap;
+    snap.provider = "Snap";
+    MemorySink::Cursor paged(snap);
+    seen.clear();
+    auto collect = [&seen](uint64_t, const LogEntry& entry) {
+        seen.push_back(entry.message);
+        return true;
+    };
+    ASSERT_EQ(sink.read(paged, collect, 1), 1u);
+    ASSERT_EQ(sink.read(paged, collect, 1), 1u);
+    ASSERT_EQ(seen.size(), 2u);
+    ASSERT_EQ(seen[1], "9");
+    ASSERT_EQ(sink.read(paged, collect), 0u);
+    ASSERT_EQ(sink.count(snap), 2u);
+
+    snap.minLevel = LogLevel::WARN;
+    ASSERT_EQ(sink.count(snap), 1u);
+    ASSERT_EQ(sink.getEntriesFiltered(LogLevel::ERROR, "APT").size(), 2u);
+
+    sink.clear();
+    ASSERT_EQ(sink.count(MemorySink::Query()), 0u);
+    ASSERT_TRUE(sink.getEntries().empty());
+}
+
+TEST(MemorySink_SetCapacity) {
+    MemorySink sink(8);
+    for (int i = 0; i < 6; i++) {
+        LogEntry entry;
+        entry.provider = i % 2 == 0 ? "Snap" : "APT";
+        entry.message = to_string(i);
+        sink.write(entry);
+    }
+
+    // Shrinking keeps the newest
+    sink.setCapacity(3);
+    ASSERT_EQ(sink.capacity(), 3u);
+    vector<LogEntry> entries = sink.getEntries();
+    ASSERT_EQ(entries.size(), 3u);
+    ASSERT_EQ(entries[0].message, "3");
+    ASSERT_EQ(entries[2].message, "5");
+    MemorySink::Query snap;
+    snap.provider = "Snap";
+    ASSERT_EQ(sink.count(snap), 1u);
+
+    // and the ring goes on from there
+    LogEntry entry;
+    entry.message = "6";
+    sink.write(entry);
+    entries = sink.getEntries();
+    ASSERT_EQ(entries.size(), 3u);
+    ASSERT_EQ(entries[0].message, "4");
+    ASSERT_EQ(entries[2].message, "6");
+
+    sink.setCapacity(5);
+    sink.write(entry);
+    ASSERT_EQ(sink.size(), 4u);
+    ASSERT_EQ(sink.getEntries()[0].message, "4");
+}
+
+TEST(BinaryLog_RoundTrip) {
+    string path = "/tmp/test-polysynaptic-log-" + to_string(getpid()) + ".bin";
+    string json = path + ".json";
+    unlink(path.c_str());
+
+    vector<LogEntry> written;
+    for (int run = 0; run < 2; run++) {
+        // A second sink on the same file starts a new segment
+        BinaryLogSink sink(path, 256);
+        ASSERT_TRUE(sink.isOpen());
+        for (int i = 0; i < 50; i++) {
+            LogEntry entry;
+            entry.level = i % 7 == 0 ? LogLevel::ERROR : LogLevel::DEBUG;
+            entry.provider = i % 2 ? "Snap" : "Flatpak";
+            entry.operation = "parse";
+            entry.message = "row " + to_string(i);
+            entry.exitCode = -i;
+            entry.duration = chrono::milliseconds(i);
+            entry.fields["line"] = "name\tversion " + to_string(i);
+            entry.fields["run"] = to_string(run);
+            sink.write(entry);
+            written.push_back(entry);
+        }
+    }
+
+    BinaryLogReader reader(path);
+    ASSERT_TRUE(reader.isValid());
+    LogEntry entry;
+    size_t count = 0;
+    while (reader.next(entry)) {
+        ASSERT_TRUE(count < written.size());
+        ASSERT_EQ(entry.toJson(), written[count].toJson());
+        count++;
+    }
+    ASSERT_EQ(count, written.size());
+
+    ASSERT_EQ(convertBinaryLog(path, json), static_cast<long>(written.size()));
+    ifstream in(json);
+    string line;
+    getline(in, line);
+    ASSERT_EQ(line, written[0].toJson());
+
+    // Not a binary log
+    ASSERT_EQ(convertBinaryLog(json, path + ".out"), -1);
+
+    unlink(path.c_str());
+    unlink(json.c_str());
+}
+
+TEST(BinaryLog_TruncatedTail) {
+    string path = "/tmp/test-polysynaptic-trunc-" + to_string(getpid()) + ".bin";
+    unlink(path.c_str());
+    {
+        BinaryLogSink sink(path);
+        for (int i = 0; i < 3; i++) {
+            LogEntry entry;
+            entry.message = "entry " + to_string(i);
+            sink.write(entry);
+        }
+    }
+
+    // Cut the last record short, as a crash mid-write would
+    struct stat st;
+    ASSERT_EQ(stat(path.c_str(), &st), 0);
+    ASSERT_EQ(truncate(path.c_str(), st.st_size - 2), 0);
+
+    BinaryLogReader reader(path);
+    LogEntry entry;
+    int count = 0;
+    while (reader.next(entry)) {
+        count++;
+    }
+    ASSERT_EQ(count, 2);
+    unlink(path.c_str());
+}
+
+// ============================================================================
+// Tracing Tests
+// ============================================================================
+
+TEST(Tracing_NestedSpans) {
+    Tracer& tracer = Tracer::instance();
+    tracer.clear();
+
+    {
+        ScopedSpan off("off", "test");
+        ASSERT_FALSE(off.isActive());
+    }
+    ASSERT_EQ(tracer.size(), 0u);
+
+    tracer.setEnabled(true);
+    uint64_t rootId, childId;
+    {
+        ScopedSpan root("root", "test");
+        rootId = root.id();
+        {
+            ScopedSpan child("child", "test");
+            child.setDetail("flatpak \"remote-ls\"");
+            childId = child.id();
+            ASSERT_EQ(Tracer::currentSpan(), childId);
+        }
+        ASSERT_EQ(Tracer::currentSpan(), rootId);
+
+        // Another thread names its parent explicitly
+        thread worker([rootId]() {
+            ScopedSpan task("task", "test", rootId);
+        });
+        worker.join();
+    }
+    tracer.setEnabled(false);
+    ASSERT_EQ(Tracer::currentSpan(), 0u);
+
+    vector<TraceSpan> spans = tracer.getSpans();
+    ASSERT_EQ(spans.size(), 3u);
+    // Recorded as they finish, innermost first
+    ASSERT_EQ(string(spans[0].name), "child");
+    ASSERT_EQ(spans[0].parent, rootId);
+    ASSERT_EQ(string(spans[1].name), "task");
+    ASSERT_EQ(spans[1].parent, rootId);
+    ASSERT_NE(spans[1].thread, spans[0].thread);
+    ASSERT_EQ(string(spans[2].name), "root");
+    ASSERT_EQ(spans[2].parent, 0u);
+    ASSERT_TRUE(spans[2].startMicros <= spans[0].startMicros);
+    ASSERT_TRUE(spans[2].durationMicros >= spans[0].durationMicros);
+
+    string json = Tracer::toChromeTrace(spans);
+    ASSERT_TRUE(json.find("\"traceEvents\"") != string::npos);
+    ASSERT_TRUE(json.find("\"name\":\"child: flatpak \\\"remote-ls\\\"\"") != string::npos);
+    ASSERT_TRUE(json.find("\"ph\":\"X\"") != string::npos);
+
+    tracer.clear();
+}
+
+TEST(ProcessUsage_Report) {
+    struct rusage ru = {};
+    ru.ru_utime.tv_sec = 1;
+    ru.ru_utime.tv_usec = 500000;
+    ru.ru_stime.tv_usec = 2000;
+    ru.ru_maxrss = 4096;
+
+    ProcessUsage usage;
+    usage.setRusage(ru);
+    usage.wallMs = 2000;
+    usage.stdoutBytes = 123;
+    ASSERT_TRUE(usage.userMs == 1500);
+    ASSERT_TRUE(usage.systemMs == 2);
+    ASSERT_EQ(usage.maxRssKb, 4096);
+
+    Tracer& tracer = Tracer::instance();
+    tracer.clear();
+    tracer.setEnabled(true);
+    {
+        ScopedSpan span("subprocess", "test");
+        usage.report(span, "Test", {"snap", "find"}, 0);
+    }
+    tracer.setEnabled(false);
+
+    vector<TraceSpan> spans = tracer.getSpans();
+    ASSERT_EQ(spans.size(), 1u);
+    bool found = false;
+    for (const auto& counter : spans[0].counters) {
+        if (string(counter.first) == "userUs") {
+            ASSERT_EQ(counter.second, 1500000);
+            found = true;
+        }
+    }
+    ASSERT_TRUE(found);
+    ASSERT_TRUE(Tracer::toChromeTrace(spans).find("\"stdoutBytes\":123") != string::npos);
+    tracer.clear();
+}
+
+TEST(Subprocess_Run) {
+    Subprocess::Options options;
+    options.timeoutSeconds = 10;
+    Subprocess::Result result = Subprocess::run(
+        {"sh", "-c", "echo out; echo err >&2; exit 3"}, options);
+    ASSERT_TRUE(result.started);
+    ASSERT_FALSE(result.timedOut);
+    ASSERT_EQ(result.exitCode, 3);
+    ASSERT_EQ(result.stdout, string("out\n"));
+    ASSERT_EQ(result.stderr, string("err\n"));
+    ASSERT_EQ(result.usage.stdoutBytes, 4u);
+
+    // posix_spawn reports a missing program instead of a child exiting 127
+    result = Subprocess::run({"/nonexistent/polysynaptic-test"}, options);
+    ASSERT_FALSE(result.started);
+    ASSERT_TRUE(result.error.find("No such file") != string::npos);
+}
+
+TEST(Subprocess_Timeout) {
+    Subprocess::Options options;
+    options.timeoutSeconds = 1;
+    auto start = std::chrono::steady_clock::now();
+    Subprocess::Result result = Subprocess::run({"sleep", "30"}, options);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(result.timedOut);
+    ASSERT_EQ(result.exitCode, -1);
+    ASSERT_TRUE(elapsed < std::chrono::seconds(10));
+}
+
+TEST(Subprocess_StreamsLargeOutput) {
+    size_t streamed = 0;
+    Subprocess::Options options;
+    options.timeoutSeconds = 10;
+    options.keepStdout = false;
+    options.onStdout = [&](const char *, size_t size) { streamed += size; };
+    Subprocess::Result result = Subprocess::run(
+        {"head", "-c", "1048576", "/dev/zero"}, options);
+    ASSERT_EQ(result.exitCode, 0);
+    ASSERT_EQ(streamed, 1048576u);
+    ASSERT_TRUE(result.stdout.empty());
+
+    // maxOutput keeps the first bytes and flags the rest
+    Subprocess::Options capped;
+    capped.maxOutput = 1000;
+    result = Subprocess::run({"head", "-c", "5000", "/dev/zero"}, capped);
+    ASSERT_TRUE(result.truncated);
+    ASSERT_EQ(result.stdout.size(), 1000u);
+    ASSERT_EQ(result.usage.stdoutBytes, 5000u);
+}
+
+TEST(LineSplitter_Chunks) {
+    vector<string> lines;
+    LineSplitter splitter([&](const string& line) { lines.push_back(line); });
+    splitter.feed("one\ntw", 6);
+    ASSERT_EQ(lines.size(), 1u);
+    splitter.feed("o\n\nthr", 6);
+    splitter.feed("ee", 2);
+    ASSERT_EQ(lines.size(), 3u);
+    splitter.finish();
+    ASSERT_EQ(lines.size(), 4u);
+    ASSERT_EQ(lines[1], string("two"));
+    ASSERT_TRUE(lines[2].empty());
+    ASSERT_EQ(lines[3], string("three"));
+}
+
+TEST(Subprocess_FindProgram) {
+    string sh = Subprocess::findProgram("sh");
+    ASSERT_FALSE(sh.empty());
+    ASSERT_TRUE(sh[0] == '/' && access(sh.c_str(), X_OK) == 0);
+    ASSERT_TRUE(Subprocess::findProgram("polysynaptic-no-such-tool").empty());
+    ASSERT_EQ(Subprocess::findProgram("/bin/sh"), string("/bin/sh"));
+}
+
+TEST(ProcessGovernor_PreemptsBackground) {
+    ProcessGovernor& governor = ProcessGovernor::instance();
+    governor.setLimit("test", 1);
+
+    // A background query holds the only slot...
+    Subprocess::Result background;
+    std::thread worker([&]() {
+        ProcessGovernor::PriorityScope scope(ProcessPriority::BACKGROUND);
+        Subprocess::Options options;
+        options.pool = "test";
+        options.preemptible = true;
+        background = Subprocess::run({"sleep", "1"}, options);
+    });
+    while (governor.getRunning("test") == 0) {
+        usleep(1000);
+    }
+
+    // ...is stopped for an interactive command, and then run again
+    uint64_t preempted = governor.getPreemptedCount();
+    Subprocess::Options options;
+    options.pool = "test";
+    auto start = std::chrono::steady_clock::now();
+    Subprocess::Result result = Subprocess::run({"echo", "now"}, options);
+    ASSERT_TRUE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(900));
+    ASSERT_EQ(result.stdout, string("now\n"));
+    ASSERT_EQ(governor.getPreemptedCount(), preempted + 1);
+
+    worker.join();
+    ASSERT_EQ(background.exitCode, 0);
+    ASSERT_FALSE(background.cancelled);
+    ASSERT_EQ(governor.getRunning("test"), 0);
+}
+
+// ============================================================================
+// Probe Cache Tests
+// ============================================================================
+
+TEST(ProbeCache_InvalidatedByWatchedFile) {
+    string dir = "/tmp/test-polysynaptic-probe-" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    string watched = dir + "/tool";
+
+    ProbeCache cache({watched, "/nonexistent-dir/tool"}, std::chrono::minutes(10));
+    ASSERT_TRUE(cache.isWatching());
+    ASSERT_FALSE(cache.isFresh());
+    cache.markFresh();
+    ASSERT_TRUE(cache.isFresh());
+
+    // Other files in the directory do not matter
+    ofstream((dir + "/other").c_str()) << "x";
+    ASSERT_TRUE(cache.isFresh());
+
+    ofstream(watched.c_str()) << "x";
+    ASSERT_FALSE(cache.isFresh());
+    cache.markFresh();
+    ASSERT_TRUE(cache.isFresh());
+
+    unlink(watched.c_str());
+    ASSERT_FALSE(cache.isFresh());
+
+    cache.markFresh();
+    cache.invalidate();
+    ASSERT_FALSE(cache.isFresh());
+
+    // Expiry without any change
+    ProbeCache shortLived({watched}, std::chrono::milliseconds(0));
+    shortLived.markFresh();
+    ASSERT_FALSE(shortLived.isFresh());
+
+    unlink((dir + "/other").c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(PathWatch_WholeDirectory) {
+    string dir = "/tmp/test-polysynaptic-watch-" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+
+    PathWatch watch({dir + "/", "/nonexistent-dir/"});
+    ASSERT_TRUE(watch.isWatching());
+    ASSERT_FALSE(watch.changed());
+
+    // Any entry counts, and each change is reported once
+    ofstream((dir + "/a_Packages").c_str()) << "x";
+    ASSERT_TRUE(watch.changed());
+    ASSERT_FALSE(watch.changed());
+
+    rename((dir + "/a_Packages").c_str(), (dir + "/b_Packages").c_str());
+    ASSERT_TRUE(watch.changed());
+
+    unlink((dir + "/b_Packages").c_str());
+    ASSERT_TRUE(watch.changed());
+    rmdir(dir.c_str());
+}
+
+TEST(StartupProfile_Phases) {
+    StartupProfile& startup = StartupProfile::instance();
+    LatencyRegistry::instance().clear();
+    startup.mark("config");
+    {
+        ScopedStartupPhase xapian("xapian");
+    }
+    startup.mark("cache");
+    startup.finish();
+    startup.mark("late");       // Ignored once finished
+    {
+        ScopedStartupPhase late("late");
+    }
+    startup.finish();
+
+    ASSERT_TRUE(startup.isFinished());
+    vector<StartupPhase> phases = startup.phases();
+    ASSERT_EQ(phases.size(), 3u);
+    ASSERT_EQ(string(phases[1].name), string("xapian"));
+    ASSERT_TRUE(phases[1].background);
+    ASSERT_FALSE(phases[1].isRunning());
+    ASSERT_EQ(string(phases[2].name), string("cache"));
+    ASSERT_FALSE(phases[2].background);
+    ASSERT_TRUE(phases[2].startMs >= phases[0].startMs + phases[0].ms);
+
+    string report = startup.report();
+    ASSERT_TRUE(report.find("cache") != string::npos);
+    ASSERT_TRUE(report.find("  xapian") != string::npos);
+    ASSERT_TRUE(report.find("late") == string::npos);
+    ASSERT_EQ(LatencyRegistry::instance().histogram("Startup", "interactive").count(), 1u);
+    ASSERT_EQ(LatencyRegistry::instance().histogram("Startup", "late").count(), 0u);
+}
+
+TEST(PerfDiagnosis_NamesTheSlowestComponent) {
+    SynthConfig config;
+    config.type = BackendType::SNAP;
+    config.count = 2000;
+    config.latencyMs = 20;
+    SynthBackend backend(config);
+
+    PerfDiagnosis diagnosis;
+    diagnosis.setBudget("installed", 5);
+    diagnosis.setBudget("search", 10000);
+    diagnosis.setBudget("details", 10000);
+    diagnosis.addBackend(&backend);
+    vector<DiagnosisResult> results = diagnosis.run();
+
+    ASSERT_EQ(results.size(), 4u);
+    ASSERT_EQ(results[1].operation, string("installed"));
+    ASSERT_TRUE(results[1].overBudget());
+    ASSERT_FALSE(results[2].overBudget());
+    ASSERT_FALSE(results[3].skipped);
+    ASSERT_TRUE(results[3].ok);
+    ASSERT_TRUE(PerfDiagnosis::slowest(results) == &results[1]);
+
+    string report = PerfDiagnosis::report(results);
+    ASSERT_TRUE(report.find("Slowest: Snap installed") != string::npos);
+    ASSERT_TRUE(report.find("snapd") != string::npos);
+
+    // A failure outranks any slowness
+    diagnosis.addProbe("Xapian", "xapian-query", [](string& detail) {
+        detail = "no index to search";
+        return false;
+    }, "run update-apt-xapian-index");
+    results = diagnosis.run();
+    ASSERT_EQ(results.size(), 5u);
+    report = PerfDiagnosis::report(results);
+    ASSERT_TRUE(report.find("Failed: Xapian xapian-query") != string::npos);
+    ASSERT_TRUE(report.find("update-apt-xapian-index") != string::npos);
+}
+
+TEST(StallWatchdog_NotesTheStalledOperation) {
+    StallWatchdog& watchdog = StallWatchdog::instance();
+    watchdog.start(30);
+    uint64_t before = watchdog.stallCount();
+
+    {
+        ScopedSpan span("slowStep", "test");
+        this_thread::sleep_for(chrono::milliseconds(120));
+    }
+    // Beat until the watchdog has seen the loop come back
+    for (int i = 0; i < 20; i++) {
+        watchdog.heartbeat();
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    watchdog.stop();
+
+    ASSERT_EQ(watchdog.stallCount(), before + 1);
+    StallEvent stall = watchdog.recentStalls().back();
+    ASSERT_FALSE(stall.ongoing);
+    ASSERT_EQ(stall.operation, string("slowStep"));
+    ASSERT_TRUE(stall.ms >= 100);
+#ifdef __GLIBC__
+    ASSERT_FALSE(stall.backtrace.empty());
+#endif
+    ASSERT_EQ(string(Tracer::watchedSpan()), string(""));
+}
+
+TEST(MetricsRegistry_OpenMetricsText) {
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    metrics.clear();
+    metrics.counter("polysynaptic_test_lookups", "Lookups",
+                    {{"cache", "say \"hi\""}, {"result", "hit"}}).inc(3);
+    metrics.gauge("polysynaptic_test_rows", "Rows").set(42);
+    LatencyRegistry::instance().histogram("MetricsTest", "probe").record(2000);
+
+    string text = metrics.toOpenMetrics();
+    ASSERT_TRUE(text.find("# TYPE polysynaptic_test_lookups counter\n") != string::npos);
+    ASSERT_TRUE(text.find("polysynaptic_test_lookups_total{cache=\"say \\\"hi\\\"\","
+                          "result=\"hit\"} 3\n") != string::npos);
+    ASSERT_TRUE(text.find("polysynaptic_test_rows 42\n") != string::npos);
+
+    string labels = "backend=\"MetricsTest\",operation=\"probe\"";
+    const char *name = "polysynaptic_operation_duration_seconds";
+    ASSERT_TRUE(text.find(string(name) + "_bucket{" + labels + ",le=\"0.001\"} 0\n") !=
+                string::npos);
+    ASSERT_TRUE(text.find(string(name) + "_bucket{" + labels + ",le=\"0.0025\"} 1\n") !=
+                string::npos);
+    ASSERT_TRUE(text.find(string(name) + "_bucket{" + labels + ",le=\"+Inf\"} 1\n") !=
+                string::npos);
+    ASSERT_TRUE(text.find(string(name) + "_count{" + labels + "} 1\n") != string::npos);
+    ASSERT_EQ(text.size() - 6, text.rfind("# EOF\n"));
+
+    string path = "/tmp/polysynaptic-test-metrics.prom";
+    ASSERT_TRUE(metrics.writeFile(path));
+    std::ifstream file(path.c_str());
+    string written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(written.find("polysynaptic_test_rows 42\n") != string::npos);
+    remove(path.c_str());
+}
+
+TEST(FrameTiming_AttributesFramesToTheChange) {
+    FrameTiming& timing = FrameTiming::instance();
+    timing.reset();
+    LatencyRegistry& latencies = LatencyRegistry::instance();
+
+    // The second change is painted by the same frame as the first
+    timing.modelChanged("test sort", 1000000);
+    timing.modelChanged("test filter", 1005000);
+    ASSERT_TRUE(timing.changePending());
+
+    // On screen 50 ms after the change: three refreshes missed
+    timing.frameCompleted(1040000, 1050000, 16000);
+    ASSERT_EQ(string("test sort"), timing.currentOperation());
+    ASSERT_EQ(3u, timing.droppedFrames());
+
+    // A gap of a refresh and a half between the frames after it
+    timing.frameCompleted(1066000, 1070000, 16000);
+    ASSERT_EQ(4u, timing.droppedFrames());
+
+    // Long after: idle, not dropped, and no longer the sort's
+    timing.frameCompleted(2000000, 2001000, 16000);
+    ASSERT_EQ(4u, timing.droppedFrames());
+    ASSERT_TRUE(timing.currentOperation().empty());
+    ASSERT_EQ(3u, timing.frames());
+    ASSERT_EQ(1.0, timing.lastFrameMs());
+
+    ASSERT_EQ(1u, latencies.histogram("Frames", "test sort").stats().count);
+    ASSERT_EQ(2u, latencies.histogram("Frames", "test sort paint").stats().count);
+    timing.reset();
+}
+
+// ============================================================================
+// Streaming Parser Tests
+// ============================================================================
+
+TEST(SnapOutputParser_ByteAtATime) {
+    string output =
+        "Name     Version  Publisher   Notes    Summary\n"
+        "hello    2.10     canonical*  -        GNU Hello, the \"hello world\" snap\n"
+        "\n"
+        "code     1.85     vscode*     classic  Code editing. Redefined.";
+
+    vector<PackageInfo> found;
+    SnapOutputParser parser(SnapOutputParser::Table::FIND,
+        [&](PackageInfo&& info) { found.push_back(std::move(info)); });
+    for (size_t i = 0; i < output.size(); i++) {
+        parser.feed(&output[i], 1);
+        if (i == output.find("code") - 1) {
+            ASSERT_EQ(found.size(), 1u);    // Emitted before the rest arrived
+        }
+    }
+    parser.finish();
+
+    ASSERT_EQ(found.size(), 2u);
+    ASSERT_EQ(found[0].id, string("hello"));
+    ASSERT_EQ(found[0].summary, string("GNU Hello, the \"hello world\" snap"));
+    ASSERT_EQ(found[0].publisher.str(), string("canonical*"));
+    ASSERT_TRUE(found[1].isClassic);
+    ASSERT_EQ(parser.count(), 2u);
+
+    size_t updates = 0;
+    SnapOutputParser refresh(SnapOutputParser::Table::REFRESH_LIST,
+        [&](PackageInfo&&) { updates++; });
+    string upToDate = "All snaps up to date.\nhello 2.10 1 canonical -\n";
+    refresh.feed(upToDate.data(), upToDate.size());
+    refresh.finish();
+    ASSERT_EQ(updates, 0u);
+}
+
+TEST(FlatpakOutputParser_Columns) {
+    string output =
+        "org.gnome.Calculator\tCalculator\t42.1\tstable\tflathub\t98.7 MB\n"
+        "org.short\n"
+        "org.gimp.GIMP\tGIMP\t\tbeta\n";
+
+    vector<PackageInfo> found;
+    FlatpakOutputParser parser(FlatpakOutputParser::Table::UPDATES,
+        [&](PackageInfo&& info) { found.push_back(std::move(info)); });
+    parser.feed(output.data(), 30);
+    ASSERT_TRUE(found.empty());
+    parser.feed(output.data() + 30, output.size() - 30);
+    parser.finish();
+
+    ASSERT_EQ(found.size(), 2u);
+    ASSERT_EQ(found[0].remote.str(), string("flathub"));
+    ASSERT_TRUE(found[0].installStatus == InstallStatus::UPDATE_AVAILABLE);
+    ASSERT_TRUE(found[1].version.empty());
+    ASSERT_EQ(found[1].branch.str(), string("beta"));
+
+    // Straight from the pipe, nothing collected
+    found.clear();
+    FlatpakOutputParser streamed(FlatpakOutputParser::Table::LIST,
+        [&](PackageInfo&& info) { found.push_back(std::move(info)); });
+    Subprocess::Options options;
+    options.keepStdout = false;
+    options.onStdout = [&](const char *data, size_t size) { streamed.feed(data, size); };
+    Subprocess::Result result = Subprocess::run(
+        {"sh", "-c", "for i in 1 2 3; do printf 'org.app%s\\tApp\\n' $i; done"}, options);
+    streamed.finish();
+    ASSERT_EQ(result.exitCode, 0);
+    ASSERT_EQ(found.size(), 3u);
+    ASSERT_EQ(found[2].id, string("org.app3"));
+}
+
+TEST(ParserCorpus_RowCounts) {
+    vector<CorpusSample> samples = ParserCorpus::realWorld();
+    for (auto& sample : ParserCorpus::locales()) samples.push_back(sample);
+    for (auto& sample : ParserCorpus::pathological()) samples.push_back(sample);
+
+    for (const auto& sample : samples) {
+        // At once, then in pipe-sized reads
+        ASSERT_EQ(ParserCorpus::parse(sample), sample.rows);
+        ASSERT_EQ(ParserCorpus::parse(sample, 4096), sample.rows);
+    }
+    for (const auto& sample : ParserCorpus::pathological()) {
+        ASSERT_EQ(ParserCorpus::parse(sample, 1), sample.rows);
+    }
+}
+
+TEST(SnapOutputParser_TranslatedHeader) {
+    string output =
+        "Nom    Version  Éditeur     Notes  Résumé\n"
+        "hello  2.10     canonical✓  -      Bonjour, le monde\n";
+
+    vector<PackageInfo> found;
+    SnapOutputParser parser(SnapOutputParser::Table::FIND,
+        [&](PackageInfo&& info) { found.push_back(std::move(info)); });
+    parser.feed(output.data(), output.size());
+    parser.finish();
+
+    ASSERT_EQ(found.size(), 1u);
+    ASSERT_EQ(found[0].id, string("hello"));
+    ASSERT_EQ(found[0].summary, string("Bonjour, le monde"));
+}
+
+TEST(FlatpakProgressParser_Steps) {
+    // Redrawn with carriage returns, as flatpak does without a terminal
+    string output =
+        "Looking for matches\u2026\n"
+        "Installing 1/2\u2026 \u2588\u2588\u2588       30%  1.2 MB/s  00:05\r"
+        "Installing 1/2\u2026 \u2588\u2588\u2588\u2588\u2588\u2588\u2588 100%  1.5 MB/s  00:00\n"
+        "Installing 2/2\u2026 \u2588         50%\r"
+        "error: No space left on device";
+
+    vector<double> fractions;
+    vector<string> messages;
+    FlatpakProgressParser parser([&](double fraction, const string& message) {
+        fractions.push_back(fraction);
+        messages.push_back(message);
+    });
+    for (size_t i = 0; i < output.size(); i += 7) {
+        parser.feed(output.data() + i, min<size_t>(7, output.size() - i));
+    }
+    parser.finish();
+
+    ASSERT_EQ(fractions.size(), 3u);
+    ASSERT_EQ((int)(fractions[0] * 100), 15);
+    ASSERT_EQ((int)(fractions[1] * 100), 50);
+    ASSERT_EQ((int)(fractions[2] * 100), 75);
+    ASSERT_EQ(messages[0], "Installing 1/2 (30%, 1.2 MB/s)");
+    ASSERT_EQ(messages[2], "Installing 2/2 (50%)");
+    ASSERT_EQ(parser.lastLine(), "error: No space left on device");
+}
+
+TEST(ProgressThrottle_RateAndCancel) {
+    int calls = 0;
+    bool keepGoing = true;
+    ProgressThrottle throttle([&](double, const string&) {
+        calls++;
+        return keepGoing;
+    }, 60000);
+
+    ASSERT_TRUE(throttle.report(0.1, "a"));
+    ASSERT_TRUE(throttle.report(0.2, "b"));
+    ASSERT_TRUE(throttle.report(0.3, "c"));
+    ASSERT_EQ(calls, 1);
+    ASSERT_TRUE(throttle.report(0.4, "d", true));
+    ASSERT_EQ(calls, 2);
+
+    keepGoing = false;
+    ASSERT_FALSE(throttle.report(0.5, "e", true));
+    ASSERT_TRUE(throttle.cancelled());
+    keepGoing = true;
+    ASSERT_FALSE(throttle.report(0.6, "f", true));
+    ASSERT_EQ(calls, 3);
+}
+
+// ============================================================================
+// Latency Histogram Tests
+// ============================================================================
+
+TEST(LatencyHistogram_Percentiles) {
+    // Every value lands in a bucket whose bound is within 1/16 of it
+    for (uint64_t v : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456ull, 1ull << 39}) {
+        int bucket = LatencyHistogram::bucketFor(v);
+        uint64_t upper = LatencyHistogram::bucketUpperBound(bucket);
+        ASSERT_TRUE(upper >= v);
+        ASSERT_TRUE(upper - v <= v / 16);
+        if (bucket > 0) {
+            ASSERT_TRUE(LatencyHistogram::bucketUpperBound(bucket - 1) < v);
+        }
+    }
+
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentile(50), 0u);
+
+    // 1..1000 ms, plus one slow outlier
+    for (uint64_t ms = 1; ms <= 1000; ms++) {
+        histogram.record(ms * 1000);
+    }
+    histogram.record(uint64_t(30) * 1000 * 1000);
+
+    LatencyStats stats = histogram.stats();
+    ASSERT_EQ(stats.count, 1001u);
+    ASSERT_TRUE(stats.p50 >= 500 && stats.p50 <= 500 * 1.07);
+    ASSERT_TRUE(stats.p95 >= 950 && stats.p95 <= 950 * 1.07);
+    ASSERT_TRUE(stats.p99 >= 990 && stats.p99 <= 990 * 1.07);
+    ASSERT_TRUE(stats.max == 30000);
+
+    LatencyHistogram other;
+    other.record(uint64_t(5));
+    other.merge(histogram);
+    ASSERT_EQ(other.count(), 1002u);
+    ASSERT_EQ(other.percentile(100), uint64_t(30) * 1000 * 1000);
+}
+
+TEST(LatencyRegistry_Export) {
+    LatencyRegistry& registry = LatencyRegistry::instance();
+    {
+        ScopedLatency latency("Test", "op \"quoted\"");
+    }
+    LatencyHistogram& same = registry.histogram("Test", "op \"quoted\"");
+    ASSERT_EQ(same.count(), 1u);
+
+    bool found = false;
+    for (const auto& entry : registry.snapshot()) {
+        found = found || (entry.backend == "Test" && entry.stats.count == 1);
+    }
+    ASSERT_TRUE(found);
+
+    string json = registry.toJson();
+    ASSERT_TRUE(json.find("\"operation\":\"op \\\"quoted\\\"\"") != string::npos);
+    ASSERT_TRUE(json.find("\"buckets\":[[") != string::npos);
+
+    registry.clear();
+    ASSERT_EQ(same.count(), 0u);
+}
+
+TEST(MemoryRegistry_SnapshotAndTrim) {
+    vector<string> cache = { string(100, 'a'), string(200, 'b') };
+    {
+        MemoryAccount account("test cache",
+            [&cache](MemoryUsage& usage) {
+                for (const auto& s : cache) usage.bytes += heapBytes(s);
+                usage.items += cache.size();
+            },
+            [&cache]() {
+                uint64_t freed = 0;
+                for (const auto& s : cache) freed += heapBytes(s);
+                cache.clear();
+                return freed;
+            });
+        MemoryAccount second("test cache", [](MemoryUsage& usage) {
+            usage.items += 1;
+        });
+
+        MemoryUsage found;
+        for (const auto& usage : MemoryRegistry::instance().snapshot()) {
+            if (usage.subsystem == "test cache") found = usage;
+        }
+        ASSERT_EQ(found.items, 3u);
+        ASSERT_TRUE(found.bytes >= 300);
+        ASSERT_TRUE(found.trimmable);
+        ASSERT_TRUE(MemoryRegistry::instance().toJson().find(
+            "\"subsystem\":\"test cache\"") != string::npos);
+
+        ASSERT_TRUE(MemoryRegistry::instance().trim() >= 300);
+        ASSERT_TRUE(cache.empty());
+    }
+
+    // Gone with its accounts
+    for (const auto& usage : MemoryRegistry::instance().snapshot()) {
+        ASSERT_FALSE(usage.subsystem == "test cache");
+    }
+}
+
+TEST(SynthBackend_CatalogAndLatency) {
+    SynthConfig config;
+    config.type = BackendType::SNAP;
+    config.count = 20000;
+    config.seed = 7;
+    SynthBackend backend(config);
+
+    // Same configuration, same catalog
+    SynthBackend again(config);
+    ASSERT_EQ(backend.catalog().size(), 20000u);
+    ASSERT_EQ(backend.catalog()[123].id, again.catalog()[123].id);
+    ASSERT_EQ(backend.catalog()[123].summary, again.catalog()[123].summary);
+
+    size_t installed = backend.getInstalledPackages().size();
+    ASSERT_TRUE(installed > 20000 * 0.04 && installed < 20000 * 0.08);
+    ASSERT_TRUE(backend.getUpgradablePackages().size() < installed);
+
+    SearchOptions options;
+    options.query = "firefox";
+    options.maxResults = 10;
+    vector<PackageInfo> hits = backend.searchPackages(options);
+    ASSERT_EQ(hits.size(), 10u);
+    ASSERT_TRUE(hits[0].backend == BackendType::SNAP);
+
+    // Operations change the catalog
+    string id = hits[0].id;
+    ASSERT_TRUE(backend.installPackage(id).success);
+    ASSERT_TRUE(backend.getInstallStatus(id) == InstallStatus::INSTALLED);
+    ASSERT_TRUE(backend.removePackage(id).success);
+    ASSERT_TRUE(backend.getInstallStatus(id) == InstallStatus::NOT_INSTALLED);
+    ASSERT_FALSE(backend.installPackage("missing").success);
+
+    // Latency is injected, and a cancelled search gives up early
+    config.count = 100;
+    config.latencyMs = 40;
+    config.jitterMs = 10;
+    SynthBackend slow(config);
+    auto start = chrono::steady_clock::now();
+    slow.getInstalledPackages();
+    ASSERT_TRUE(chrono::steady_clock::now() - start >= chrono::milliseconds(40));
+
+    options.isCancelled = []() { return true; };
+    start = chrono::steady_clock::now();
+    ASSERT_TRUE(slow.searchPackages(options).empty());
+    ASSERT_TRUE(chrono::steady_clock::now() - start < chrono::milliseconds(40));
+}
+
+struct SynthProvider : public BackendProvider {
+    using BackendProvider::BackendProvider;
+    ProviderCapabilities getCapabilities() const override { return ProviderCapabilities(); }
+    TrustLevel getDefaultTrustLevel() const override { return TrustLevel::COMMUNITY; }
+};
+
+TEST(BackendProvider_ViewOfEngine) {
+    SynthConfig config;
+    config.type = BackendType::SNAP;
+    config.count = 500;
+    auto engine = make_shared<SynthBackend>(config);
+    SynthProvider provider(engine, SourceType::SNAP);
+
+    SearchQuery query;
+    query.text = "firefox";
+    query.limit = 3;
+    vector<UnifiedPackage> first = provider.search(query);
+    ASSERT_EQ(first.size(), 3u);
+    ASSERT_TRUE(first[0].source == SourceType::SNAP);
+    query.offset = 1;
+    ASSERT_EQ(provider.search(query)[0].id, first[1].id);
+
+    // Operations reach the engine
+    ASSERT_TRUE(provider.install(first[0].id).success);
+    ASSERT_TRUE(engine->getInstallStatus(first[0].id) == InstallStatus::INSTALLED);
+    ASSERT_TRUE(provider.getPackageDetails(first[0].id).status == PackageStatus::INSTALLED);
+    ASSERT_FALSE(provider.install("missing").success);
+
+    // Both stacks share one engine per ecosystem
+    SnapProvider snap;
+    ASSERT_TRUE(snap.getEngine() == SnapBackend::shared().get());
+}
+
+TEST(ProgressAggregator_MergesAndCoalesces) {
+    // Deliveries queue here, as they would for the main loop
+    vector<function<void()>> queued;
+    vector<pair<double, string>> seen;
+    bool keepGoing = true;
+    ProgressAggregator aggregator(
+        [&](double fraction, const string& message) {
+            seen.push_back(make_pair(fraction, message));
+            return keepGoing;
+        },
+        [&](function<void()> task) { queued.push_back(std::move(task)); },
+        60000);
+    ProgressCallback apt = aggregator.source("APT", 3.0);
+    ProgressCallback snap = aggregator.source("Snap");
+
+    // Thousands of reports, one delivery on its way
+    std::thread other([&]() {
+        for (int i = 0; i <= 1000; i++) snap(i / 1000.0, "Snap step");
+    });
+    for (int i = 0; i <= 1000; i++) apt(i / 2000.0, "APT step");
+    other.join();
+    ASSERT_EQ(queued.size(), 1u);
+
+    // finish() supersedes it with the final state of both
+    aggregator.finish();
+    ASSERT_EQ(queued.size(), 2u);
+    for (auto& task : queued) task();
+    ASSERT_EQ(seen.size(), 1u);
+    ASSERT_TRUE(seen[0].first > 0.62 && seen[0].first < 0.63);
+    ASSERT_EQ(seen[0].second.substr(0, 1), string("["));
+
+    // Without a dispatcher the reporter delivers; false cancels them all
+    ProgressAggregator direct(
+        [&](double, const string&) { return false; }, nullptr, 0);
+    ProgressCallback first = direct.source();
+    ProgressCallback second = direct.source();
+    ASSERT_FALSE(first(0.5, "working"));
+    ASSERT_TRUE(direct.cancelled());
+    ASSERT_FALSE(second(0.1, ""));
+}
+
+TEST(AsyncBackendAdapter_DeliverAndCancel) {
+    SynthConfig config;
+    config.count = 2000;
+    config.latencyMs = 30;
+    SynthBackend backend(config);
+    TaskPool pool(1);
+
+    // Completions queue up like idle callbacks until the "main loop" runs
+    vector<function<void()>> mainLoop;
+    mutex loopMutex;
+    AsyncBackendAdapter async(&backend, pool, [&](function<void()> task) {
+        lock_guard<mutex> lock(loopMutex);
+        mainLoop.push_back(std::move(task));
+    });
+    auto runMainLoop = [&]() {
+        lock_guard<mutex> lock(loopMutex);
+        for (auto& task : mainLoop) task();
+        mainLoop.clear();
+    };
+
+    SearchOptions options;
+    options.query = "lib";
+    size_t delivered = 0;
+    AsyncPackages first = async.searchPackages(options,
+        [&](const vector<PackageInfo>& results) { delivered = results.size(); });
+    // Behind the first on the only worker, so cancelled before it runs
+    AsyncPackages second = async.searchPackages(options,
+        [&](const vector<PackageInfo>&) { delivered = 12345; });
+    second.cancel();
+
+    ASSERT_TRUE(first.waitFor(5000));
+    ASSERT_TRUE(second.waitFor(5000));
+    ASSERT_FALSE(first.get().empty());
+    ASSERT_TRUE(second.get().empty());
+    ASSERT_EQ(delivered, 0u);
+    runMainLoop();
+    ASSERT_EQ(delivered, first.get().size());
+
+    // Cancelled after finishing but before the main loop got to it
+    bool seen = false;
+    const string id = backend.catalog()[0].id;
+    AsyncCall<PackageInfo> details = async.getPackageDetails(id,
+        [&](const PackageInfo&) { seen = true; });
+    ASSERT_TRUE(details.waitFor(5000));
+    details.cancel();
+    runMainLoop();
+    ASSERT_FALSE(seen);
+    ASSERT_EQ(details.get().id, id);
+
+    // Operations go the same way
+    AsyncOperation install = async.installPackages({id});
+    ASSERT_TRUE(install.get().success);
+    ASSERT_TRUE(backend.getInstallStatus(id) == InstallStatus::INSTALLED);
+}
+
+// ============================================================================
+// DesiredState Tests
+// ============================================================================
+
+TEST(DesiredState_ParseAndPlan) {
+    DesiredState desired;
+    string error;
+
+    istringstream bad("apt htop\nsnap vlc sideways\n");
+    ASSERT_FALSE(desired.parse(bad, error));
+    ASSERT_NE(error.find("line 2"), string::npos);
+    istringstream twice("apt htop\ndeb htop absent\n");
+    ASSERT_FALSE(desired.parse(twice, error));
+    istringstream unknown("brew htop\n");
+    ASSERT_FALSE(desired.parse(unknown, error));
+
+    istringstream list(
+        "# fleet baseline\n"
+        "\n"
+        "apt      htop            present\n"
+        "apt      curl            latest   # keep current\n"
+        "apt      telnet          purged\n"
+        "snap     vlc             latest\n"
+        "snap     hello-world     absent\n"
+        "flatpak  org.gimp.GIMP\n");
+    ASSERT_TRUE(desired.parse(list, error));
+    ASSERT_EQ(desired.packages().size(), 6u);
+    ASSERT_TRUE(desired.packages()[5].state == DesiredPackage::State::PRESENT);
+    ASSERT_TRUE(desired.wantsLatest(BackendType::SNAP));
+    ASSERT_FALSE(desired.wantsLatest(BackendType::FLATPAK));
+    ASSERT_TRUE(desired.uses(BackendType::FLATPAK));
+
+    // curl is matched by name though its id carries the architecture
+    vector<PackageInfo> installed = {
+        PackageInfo("htop", "htop", BackendType::APT),
+        PackageInfo("curl:amd64", "curl", BackendType::APT),
+        PackageInfo("telnet", "telnet", BackendType::APT),
+        PackageInfo("vlc", "vlc", BackendType::SNAP),
+    };
+    vector<PackageInfo> upgradable = {
+        PackageInfo("curl:amd64", "curl", BackendType::APT),
+    };
+
+    size_t unchanged = 0;
+    Transaction plan = desired.plan(installed, upgradable, &unchanged);
+    using Type = Transaction::Operation::Type;
+    ASSERT_EQ(plan.operations.size(), 3u);
+    ASSERT_EQ(unchanged, 3u);
+    ASSERT_EQ(plan.operations[0].packageId, "curl");
+    ASSERT_TRUE(plan.operations[0].type == Type::UPDATE);
+    ASSERT_EQ(plan.operations[1].packageId, "telnet");
+    ASSERT_TRUE(plan.operations[1].type == Type::REMOVE && plan.operations[1].purge);
+    ASSERT_EQ(plan.operations[2].packageId, "org.gimp.GIMP");
+    ASSERT_TRUE(plan.operations[2].type == Type::INSTALL);
+    ASSERT_TRUE(plan.operations[2].backend == BackendType::FLATPAK);
+}
+
+TEST(DesiredState_PinnedEntries) {
+    DesiredState desired;
+    string error;
+
+    // Pins belong to one backend and to installed packages
+    istringstream wrongBackend("snap vlc version=3.0\n");
+    ASSERT_FALSE(desired.parse(wrongBackend, error));
+    istringstream removed("flatpak org.gimp.GIMP absent branch=beta\n");
+    ASSERT_FALSE(desired.parse(removed, error));
+    istringstream latestVersion("apt htop latest version=3.0\n");
+    ASSERT_FALSE(desired.parse(latestVersion, error));
+
+    ASSERT_TRUE(DesiredState::channelMatches("latest/stable", "stable"));
+    ASSERT_TRUE(DesiredState::channelMatches("3.x/stable", "3.x"));
+    ASSERT_FALSE(DesiredState::channelMatches("latest/stable", "beta"));
+
+    istringstream list(
+        "apt      htop            version=3.0.5-7\n"
+        "apt      curl            present  version=8.5.0-2\n"
+        "snap     vlc             latest   channel=beta\n"
+        "snap     lxd             channel=5.21\n"
+        "flatpak  org.gimp.GIMP   branch=beta\n");
+    ASSERT_TRUE(desired.parse(list, error));
+    ASSERT_EQ(desired.packages()[1].target(), "8.5.0-2");
+
+    PackageInfo htop("htop", "htop", BackendType::APT);
+    htop.installedVersion = "3.0.5-7";
+    PackageInfo curl("curl", "curl", BackendType::APT);
+    curl.installedVersion = "8.9.1-1";
+    PackageInfo vlc("vlc", "vlc", BackendType::SNAP);
+    vlc.channel = "latest/stable";
+    PackageInfo lxd("lxd", "lxd", BackendType::SNAP);
+    lxd.channel = "5.21/stable";
+
+    size_t unchanged = 0;
+    Transaction plan = desired.plan({htop, curl, vlc, lxd}, {}, &unchanged);
+    using Type = Transaction::Operation::Type;
+    ASSERT_EQ(unchanged, 2u);
+    ASSERT_EQ(plan.operations.size(), 3u);
+    ASSERT_EQ(plan.operations[0].packageId, "curl");
+    ASSERT_TRUE(plan.operations[0].type == Type::UPDATE);
+    ASSERT_EQ(plan.operations[0].target, "8.5.0-2");
+    ASSERT_EQ(plan.operations[1].target, "beta");
+    ASSERT_TRUE(plan.operations[2].type == Type::INSTALL);
+    ASSERT_EQ(plan.operations[2].target, "beta");
+}
+
+TEST(TransactionJournal_ResumesWhatWasLeft) {
+    using Type = Transaction::Operation::Type;
+    using State = TransactionJournal::State;
+    string path = "/tmp/test-polysynaptic-journal-" + to_string(getpid());
+    unlink(path.c_str());
+
+    auto op = [](BackendType backend, const string& id, Type type) {
+        Transaction::Operation o;
+        o.backend = backend;
+        o.packageId = id;
+        o.packageName = id;
+        o.type = type;
+        return o;
+    };
+    Transaction::Operation gimp = op(BackendType::FLATPAK, "org.gimp.GIMP", Type::INSTALL);
+    gimp.target = "beta";
+    Transaction::Operation vlc = op(BackendType::SNAP, "vlc", Type::REMOVE);
+    vlc.purge = true;
+
+    {
+        TransactionJournal journal(path);
+        ASSERT_TRUE(journal.unfinished().empty());
+        ASSERT_TRUE(journal.record({vlc, op(BackendType::SNAP, "lxd", Type::UPDATE), gimp}));
+        ASSERT_TRUE(journal.record({op(BackendType::APT, "htop", Type::INSTALL)}));
+        ASSERT_TRUE(journal.checkpoint(BackendType::SNAP, {"vlc"}, State::DONE));
+        ASSERT_TRUE(journal.checkpoint(BackendType::FLATPAK, {"org.gimp.GIMP"},
+                                       State::FAILED));
+    }
+
+    // A later start sees the state of the last checkpoint
+    TransactionJournal journal(path);
+    ASSERT_EQ(journal.entries().size(), 4u);
+    Transaction left = journal.unfinished();
+    ASSERT_EQ(left.operations.size(), 3u);
+    ASSERT_EQ(left.operations[0].packageId, "lxd");
+    ASSERT_TRUE(left.operations[0].type == Type::UPDATE);
+    ASSERT_EQ(left.operations[1].target, "beta");
+    ASSERT_TRUE(left.operations[1].identity ==
+                packageIdentity(BackendType::FLATPAK, "org.gimp.GIMP"));
+    ASSERT_TRUE(left.operations[2].backend == BackendType::APT);
+    ASSERT_TRUE(journal.entries()[0].op.purge);
+
+    // A backend's new share replaces its old one
+    journal.record({op(BackendType::SNAP, "core", Type::INSTALL)});
+    ASSERT_EQ(journal.unfinished().operations.size(), 3u);
+
+    journal.complete(BackendType::SNAP);
+    journal.complete(BackendType::FLATPAK);
+    ASSERT_EQ(access(path.c_str(), F_OK), 0);
+    journal.complete(BackendType::APT);
+    ASSERT_TRUE(access(path.c_str(), F_OK) != 0);
+
+    // Not a journal, or lines from a newer one
+    istringstream junk("apt htop\n");
+    vector<TransactionJournal::Entry> entries;
+    ASSERT_FALSE(TransactionJournal::parse(junk, entries));
+    istringstream mixed("# PolySynaptic transaction journal 1\n"
+                        "pending\tdeb\tinstall\t-\tcurl\tcurl\t\n"
+                        "paused\tdeb\tinstall\t-\tjq\tjq\t\n"
+                        "pending\trpm\tinstall\t-\tvim\tvim\t\n");
+    ASSERT_TRUE(TransactionJournal::parse(mixed, entries));
+    ASSERT_EQ(entries.size(), 1u);
+    ASSERT_EQ(entries[0].op.packageId, "curl");
+}
+
+TEST(OperationHistory_PredictsFromPastRuns) {
+    using Type = Transaction::Operation::Type;
+    string path = "/tmp/test-polysynaptic-history-" + to_string(getpid());
+    unlink(path.c_str());
+
+    auto op = [](BackendType backend, const string& id, Type type, long size) {
+        Transaction::Operation o;
+        o.backend = backend;
+        o.packageId = id;
+        o.type = type;
+        o.downloadSize = size;
+        return o;
+    };
+    const long MB = 1 << 20;
+    Transaction::Operation runtime = op(BackendType::FLATPAK, "org.gnome.Platform",
+                                        Type::INSTALL, 2048 * MB);
+    Transaction::Operation calc = op(BackendType::FLATPAK, "org.gnome.Calculator",
+                                     Type::INSTALL, 2 * MB);
+
+    {
+        OperationHistory history(path);
+        // Not seen yet: the backend's defaults, by size
+        ASSERT_FALSE(history.known(runtime));
+        ASSERT_TRUE(history.estimate(runtime) > 50 * history.estimate(calc));
+
+        // 100 MB in 30 s: 20 of them at 5 MB/s, past the 10 s to deploy
+        history.record(op(BackendType::FLATPAK, "org.kde.Platform", Type::INSTALL, 100 * MB),
+                       30);
+        ASSERT_TRUE(history.throughput(BackendType::FLATPAK) > 4.9 * MB);
+        ASSERT_TRUE(history.throughput(BackendType::FLATPAK) < 5.1 * MB);
+        history.record(runtime, 400);
+        ASSERT_TRUE(history.save());
+    }
+
+    // A later start predicts from both
+    OperationHistory history(path);
+    ASSERT_TRUE(history.known(runtime));
+    ASSERT_TRUE(history.estimate(runtime) > 399 && history.estimate(runtime) < 401);
+    runtime.downloadSize += 50 * MB;
+    ASSERT_TRUE(history.estimate(runtime) > 409 && history.estimate(runtime) < 411);
+
+    // Removals fetch nothing, and nothing is predicted to take no time
+    history.record(op(BackendType::SNAP, "vlc", Type::REMOVE, 0), 0);
+    ASSERT_TRUE(history.estimate(op(BackendType::SNAP, "vlc", Type::REMOVE, 0)) > 0.4);
+
+    // A dpkg run after the fetch: install time, no download
+    Transaction::Operation htop = op(BackendType::APT, "htop", Type::INSTALL, 0);
+    history.record(htop, 4, 0);
+    history.record(htop, 2, 0);
+    ASSERT_TRUE(history.estimate(htop) > 2.9 && history.estimate(htop) < 3.1);
+
+    // Not a history, or lines from a newer one
+    istringstream junk("op htop 3\n");
+    ASSERT_FALSE(history.parse(junk));
+    istringstream mixed("# PolySynaptic operation history 1\n"
+                        "rate\trpm\t100\t1\n"
+                        "op\tdeb\tinstall\tcurl\t7\t1\t-1\t3\n"
+                        "op\tdeb\tpin\tjq\t7\t1\t-1\t4\n");
+    ASSERT_TRUE(history.parse(mixed));
+    ASSERT_TRUE(history.known(op(BackendType::APT, "curl", Type::INSTALL, 0)));
+    ASSERT_FALSE(history.known(htop));
+    unlink(path.c_str());
+}
+
+TEST(FuzzyIndex_FindsNearNames) {
+    FuzzyIndex index;
+    index.add(BackendType::APT, "libreoffice", "libreoffice");
+    index.add(BackendType::APT, "libreoffice-writer", "libreoffice-writer");
+    index.add(BackendType::APT, "thunderbird", "thunderbird");
+    index.add(BackendType::FLATPAK, "org.libreoffice.LibreOffice", "LibreOffice");
+    index.add(BackendType::SNAP, "vlc", "vlc");
+    index.add(BackendType::APT, "gimp", "gimp");
+    for (int i = 0; i < 2000; i++) {
+        index.add(BackendType::APT, "libfiller" + to_string(i), "libfiller" + to_string(i));
+    }
+    ASSERT_TRUE(index.search("libreofice").empty());
+    index.build();
+
+    // A missing letter: both the deb and the flatpak, under one name
+    vector<FuzzyIndex::Match> found = index.search("libreofice");
+    ASSERT_EQ(found.size(), 2u);
+    ASSERT_EQ(found[0].name, "libreoffice");
+    ASSERT_EQ(found[0].distance, 1);
+    ASSERT_TRUE(found[1].backend == BackendType::FLATPAK);
+    ASSERT_EQ(found[1].id, "org.libreoffice.LibreOffice");
+
+    // Swapped letters are one edit; spaces and case do not count
+    found = index.search("Thunderbrid");
+    ASSERT_EQ(found.size(), 1u);
+    ASSERT_EQ(found[0].id, "thunderbird");
+    ASSERT_EQ(index.search("Libre Office").size(), 2u);
+
+    // Short queries allow one edit, the shortest none
+    ASSERT_EQ(index.search("gimq").size(), 1u);
+    ASSERT_TRUE(index.search("gmq").empty());
+    ASSERT_TRUE(index.search("vl").empty());
+    ASSERT_EQ(index.search("libfiller17", 3).size(), 3u);
+    ASSERT_EQ(index.search("libfiller17", 3)[0].id, "libfiller17");
+
+    ASSERT_EQ(FuzzyIndex::distance("thunderbird", "thunderbrid", 2), 1);
+    ASSERT_EQ(FuzzyIndex::distance("kitten", "sitting", 2), 3);
+    ASSERT_EQ(FuzzyIndex::normalize("Firefox-Browser"), "firefox");
+    ASSERT_TRUE(index.memoryBytes() > 0);
+}
+
+/**
+ * LoopbackMirror - An HTTP server on 127.0.0.1 serving one file
+ *
+ * The body is sent in chunks with a pause between them, to stand in
+ * for a slow mirror; any status but 200 answers every request with
+ * a 404.
+ */
+struct LoopbackMirror {
+    int fd;
+    int port;
+    atomic<int> connections{0};
+    atomic<bool> stopping{false};
+    std::thread server;
+
+    LoopbackMirror(const string& path, size_t bytes, int chunks, int pauseMs,
+                   int status = 200) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, (sockaddr*) &addr, sizeof(addr));
+        listen(fd, 8);
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr*) &addr, &len);
+        port = ntohs(addr.sin_port);
+
+        server = std::thread([this, path, bytes, chunks, pauseMs, status]() {
+            while (!stopping) {
+                pollfd pfd = {fd, POLLIN, 0};
+                if (poll(&pfd, 1, 20) <= 0) continue;
+                int client = accept(fd, nullptr, nullptr);
+                if (client < 0) continue;
+                connections++;
+
+                char request[1024];
+                ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+                request[max<ssize_t>(n, 0)] = 0;
+                bool found = status == 200 &&
+                    string(request).find("GET " + path + " ") == 0;
+                string head = found ? "HTTP/1.0 200 OK\r\n\r\n"
+                                    : "HTTP/1.0 404 Not Found\r\n\r\n";
+                send(client, head.data(), head.size(), MSG_NOSIGNAL);
+                for (int i = 0; found && i < chunks; i++) {
+                    if (i > 0) usleep(pauseMs * 1000);
+                    string chunk(bytes / chunks, 'x');
+                    send(client, chunk.data(), chunk.size(), MSG_NOSIGNAL);
+                }
+                close(client);
+            }
+        });
+    }
+
+    ~LoopbackMirror() {
+        stopping = true;
+        server.join();
+        close(fd);
+    }
+
+    string uri() const { return "http://127.0.0.1:" + to_string(port) + "/ubuntu/"; }
+};
+
+TEST(MirrorProbe_RanksAndCaches) {
+    const string file = "/ubuntu/dists/jammy/InRelease";
+    LoopbackMirror fast(file, 256 * 1024, 1, 0);
+    LoopbackMirror slow(file, 64 * 1024, 4, 100);
+    LoopbackMirror stale(file, 1024, 1, 0, 404);
+
+    // A port nothing listens on any more
+    int closed;
+    {
+        LoopbackMirror gone(file, 1, 1, 0);
+        closed = gone.port;
+    }
+    string refused = "http://127.0.0.1:" + to_string(closed) + "/ubuntu/";
+
+    MirrorProbe probe(4);
+    vector<string> mirrors = {slow.uri(), refused, "https://mirror.example/ubuntu/",
+                              fast.uri(), stale.uri(), fast.uri()};
+    vector<MirrorResult> ranked = probe.probe(mirrors, "dists/jammy/InRelease");
+
+    // One result per mirror, the healthy ones by speed
+    ASSERT_EQ(ranked.size(), 5u);
+    ASSERT_EQ(ranked[0].uri, fast.uri());
+    ASSERT_TRUE(ranked[0].healthy);
+    ASSERT_EQ(ranked[0].bytes, 256u * 1024);
+    ASSERT_EQ(ranked[1].uri, slow.uri());
+    ASSERT_TRUE(ranked[1].healthy);
+    ASSERT_TRUE(ranked[1].bytesPerSecond < ranked[0].bytesPerSecond);
+    for (size_t i = 2; i < ranked.size(); i++) {
+        ASSERT_FALSE(ranked[i].healthy);
+        ASSERT_FALSE(ranked[i].error.empty());
+    }
+    ASSERT_EQ(fast.connections.load(), 1);
+
+    MirrorResult result;
+    ASSERT_TRUE(probe.cached(stale.uri(), "dists/jammy/InRelease", result));
+    ASSERT_TRUE(result.error.find("404") != string::npos);
+
+    // Fresh results are reused until forced or expired
+    ranked = probe.probe({fast.uri(), slow.uri()}, "dists/jammy/InRelease");
+    ASSERT_EQ(ranked[0].uri, fast.uri());
+    ASSERT_EQ(fast.connections.load(), 1);
+    ASSERT_EQ(slow.connections.load(), 1);
+    probe.probe({fast.uri()}, "dists/jammy/InRelease", true);
+    ASSERT_EQ(fast.connections.load(), 2);
+    ASSERT_FALSE(probe.cached(fast.uri(), "dists/noble/InRelease", result));
+
+    // Mirror lists in APT's mirror method format
+    string list = "/tmp/test-polysynaptic-mirrors-" + to_string(getpid());
+    {
+        ofstream out(list.c_str());
+        out << "# office mirrors\n"
+            << "http://a.example/ubuntu/\tpriority:1\n"
+            << "\n"
+            << "  http://b.example/ubuntu/\n";
+    }
+    vector<string> listed = MirrorProbe::readMirrorList(list);
+    unlink(list.c_str());
+    ASSERT_EQ(listed.size(), 2u);
+    ASSERT_EQ(listed[0], "http://a.example/ubuntu/");
+    ASSERT_EQ(listed[1], "http://b.example/ubuntu/");
+}
+
+TEST(SourceValidator_ChecksReleaseFiles) {
+    using Status = SourceValidation::Status;
+
+    ASSERT_EQ(SourceValidator::releasePath("jammy", "InRelease"), "dists/jammy/InRelease");
+    ASSERT_EQ(SourceValidator::releasePath("./", "Release"), "Release");
+    ASSERT_EQ(SourceValidator::releasePath("amd64/", "Release.gpg"), "amd64/Release.gpg");
+
+    string options = "arch=amd64 signed-by=/usr/share/keyrings/a.gpg,/etc/b.gpg";
+    ASSERT_EQ(SourceValidator::option(options, "arch"), "amd64");
+    ASSERT_EQ(SourceValidator::option(options, "trusted"), "");
+
+    // signed-by files, or every trusted keyring
+    SourceCheck check;
+    check.options = options;
+    vector<string> keys = SourceValidator::keyrings(check);
+    ASSERT_EQ(keys.size(), 2u);
+    ASSERT_EQ(keys[1], "/etc/b.gpg");
+
+    string dir = "/tmp/test-polysynaptic-keyrings-" + to_string(getpid());
+    mkdir(dir.c_str(), 0700);
+    ofstream(dir + "/b.gpg");
+    ofstream(dir + "/a.asc");
+    ofstream(dir + "/README");
+    check.options = "signed-by=0123456789ABCDEF";
+    keys = SourceValidator::keyrings(check, dir, dir + "/none.gpg");
+    for (const char *name : {"/a.asc", "/b.gpg", "/README"}) {
+        unlink((dir + name).c_str());
+    }
+    rmdir(dir.c_str());
+    ASSERT_EQ(keys.size(), 2u);
+    ASSERT_EQ(keys[0], dir + "/a.asc");
+    ASSERT_EQ(keys[1], dir + "/b.gpg");
+
+    // Fetched, answered without one, or not there at all
+    LoopbackMirror serving("/ubuntu/dists/jammy/InRelease", 512, 1, 0);
+    LoopbackMirror empty("/ubuntu/dists/jammy/InRelease", 512, 1, 0, 404);
+    int closed;
+    {
+        LoopbackMirror gone("/", 1, 1, 0);
+        closed = gone.port;
+    }
+
+    SourceValidator validator(2);
+    SourceCheck unsigned_, missing, refused, secure;
+    unsigned_.uri = serving.uri();
+    missing.uri = empty.uri();
+    refused.uri = "http://127.0.0.1:" + to_string(closed) + "/ubuntu/";
+    secure.uri = "https://mirror.example/ubuntu/";
+    for (SourceCheck *c : {&unsigned_, &missing, &refused, &secure}) {
+        c->dist = "jammy";
+    }
+    auto first = validator.submit(unsigned_);
+    auto second = validator.submit(missing);
+    auto third = validator.submit(refused);
+
+    // Junk is never taken for signed, whether or not gpgv is here
+    SourceValidation result = first.get();
+    ASSERT_TRUE(result.status == Status::BAD_SIGNATURE ||
+                result.status == Status::UNCHECKED);
+    ASSERT_FALSE(result.error.empty());
+    ASSERT_TRUE(second.get().status == Status::NO_RELEASE);
+    ASSERT_EQ(empty.connections.load(), 2);
+    ASSERT_TRUE(third.get().status == Status::UNREACHABLE);
+    ASSERT_TRUE(SourceValidator::validate(secure).status == Status::UNCHECKED);
+}
+
+TEST(PopularityIndex_BuildsAndFinds) {
+    string dir = "/tmp/test-polysynaptic-popularity-" + to_string(getpid());
+
+    PopularityIndex::Builder builder;
+    size_t popcon = builder.addPopcon(
+        "#rank name                            inst  vote   old recent no-files (maintainer)\n"
+        "1     dpkg                            199000 180000 100 18000 900 (Dpkg Developers)\n"
+        "2     firefox-esr                     90000  50000  100 39000 900 (Mozilla Team)\n"
+        "3     obscure-tool                    3      1      1   1     0   (Someone)\n"
+        "------------------------------------------------------------------------\n"
+        "99999 Total                           200000 180000 100 18000 900\n");
+    ASSERT_EQ(popcon, 3u);
+
+    size_t flathub = builder.addFlathubStats(
+        "{\"date\": \"2024/05/01\", \"downloads\": 12,"
+        " \"refs\": {\"org.mozilla.firefox\": {\"x86_64\": [900, 300],"
+        " \"aarch64\": [100, 10]},"
+        " \"org.gimp.GIMP\": {\"x86_64\": [20, 5]}, \"org.empty.App\": {}},"
+        " \"countries\": {\"DE\": 4}}");
+    ASSERT_EQ(flathub, 3u);
+    ASSERT_EQ(builder.addFlathubStats("{\"refs\": {\"broken\": [}"), 0u);
+
+    ASSERT_EQ(builder.addCounts(PopularityIndex::SNAP,
+                                "# snap metrics\nfirefox 5000\nbogus\n"), 1u);
+
+    mkdir(dir.c_str(), 0755);
+    string path = PopularityIndex::indexPath(dir);
+    ASSERT_TRUE(builder.write(path));
+
+    PopularityIndex index;
+    ASSERT_TRUE(index.load(path));
+    ASSERT_EQ(index.size(), 7u);
+
+    double dpkg, firefox, obscure, gimp, snap;
+    ASSERT_TRUE(index.find(PopularityIndex::POPCON, "dpkg", dpkg));
+    ASSERT_TRUE(index.find(PopularityIndex::POPCON, "Firefox-ESR", firefox));
+    ASSERT_TRUE(index.find(PopularityIndex::POPCON, "obscure-tool", obscure));
+    ASSERT_EQ(dpkg, 1.0);
+    ASSERT_TRUE(firefox < dpkg && obscure < firefox);
+    ASSERT_TRUE(obscure > 0.0);
+
+    // Downloads of every architecture count; sources keep their own names
+    ASSERT_TRUE(index.find(PopularityIndex::FLATHUB, "org.mozilla.firefox", firefox));
+    ASSERT_EQ(firefox, 1.0);
+    ASSERT_TRUE(index.find(PopularityIndex::FLATHUB, "org.gimp.GIMP", gimp));
+    ASSERT_TRUE(gimp < firefox);
+    ASSERT_TRUE(index.find(PopularityIndex::SNAP, "firefox", snap));
+    ASSERT_FALSE(index.find(PopularityIndex::POPCON, "firefox", snap));
+    ASSERT_FALSE(index.find(PopularityIndex::SNAP, "dpkg", snap));
+    ASSERT_TRUE(index.hasSource(PopularityIndex::SNAP));
+    ASSERT_EQ(PopularityIndex::sourceFor("flatpak"), PopularityIndex::FLATHUB);
+
+    // Refreshing downloads only what is stale, and shares the result
+    int fetches = 0;
+    auto fetcher = [&fetches](const string& uri, const string& dest) {
+        fetches++;
+        ofstream out(dest.c_str());
+        out << (uri.find("2") != string::npos ? "firefox 10\n" : "");
+        return uri.find("missing") == string::npos;
+    };
+    vector<PopularityIndex::Dataset> datasets = {
+        {PopularityIndex::SNAP, "https://example.org/snap-%Y.txt"},
+        {PopularityIndex::FLATHUB, "https://example.org/missing"},
+    };
+    ASSERT_TRUE(PopularityIndex::refresh(dir, datasets, fetcher, 3600));
+    ASSERT_EQ(fetches, 2);
+    shared_ptr<const PopularityIndex> shared = PopularityIndex::peek();
+    ASSERT_EQ(shared->size(), 1u);
+    ASSERT_TRUE(shared->find(PopularityIndex::SNAP, "firefox", snap));
+    ASSERT_FALSE(shared->hasSource(PopularityIndex::POPCON));
+
+    ASSERT_TRUE(PopularityIndex::refresh(dir, datasets, fetcher, 3600));
+    ASSERT_EQ(fetches, 3);      // Only the one that failed
+
+    // Other files are not taken for an index
+    {
+        ofstream out(path.c_str());
+        out << "PSPOPUL";
+    }
+    ASSERT_FALSE(index.load(path));
+    ASSERT_TRUE(index.empty());
+    ASSERT_FALSE(index.find(PopularityIndex::SNAP, "firefox", snap));
+
+    unlink(path.c_str());
+    unlink((dir + "/snap.data").c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(BackendManager_PopularityBreaksTies) {
+    string dir = "/tmp/test-polysynaptic-popularity-rank-" + to_string(getpid());
+    mkdir(dir.c_str(), 0755);
+    string path = PopularityIndex::indexPath(dir);
+    PopularityIndex::Builder builder;
+    builder.add(PopularityIndex::POPCON, "vim", 90000);
+    builder.add(PopularityIndex::POPCON, "vim-tiny", 40);
+    builder.add(PopularityIndex::FLATHUB, "org.vim.Vim", 50);
+    builder.add(PopularityIndex::FLATHUB, "org.mozilla.firefox", 900000);
+    ASSERT_TRUE(builder.write(path));
+    PopularityIndex index;
+    ASSERT_TRUE(index.load(path));
+
+    PackageInfo vim("vim", "vim", BackendType::APT);
+    PackageInfo tiny("vim-tiny", "vim-tiny", BackendType::APT);
+    PackageInfo gtk("vim-gtk3", "vim-gtk3", BackendType::APT);
+    PackageInfo flatpak("org.vim.Vim", "vim", BackendType::FLATPAK);
+    PackageInfo nano("nano", "nano", BackendType::APT);
+
+    // Without the index only the match counts
+    ASSERT_EQ(BackendManager::searchRelevance(tiny, "vim"),
+              BackendManager::searchRelevance(gtk, "vim"));
+
+    // With it the popular one of equal matches goes first, a package
+    // missing from the dataset gains nothing, and no popularity makes
+    // up for a better kind of match or for none at all
+    int tinyScore = BackendManager::searchRelevance(tiny, "vim", &index);
+    int gtkScore = BackendManager::searchRelevance(gtk, "vim", &index);
+    ASSERT_TRUE(tinyScore >= gtkScore);
+    ASSERT_EQ(gtkScore, BackendManager::searchRelevance(gtk, "vim"));
+    ASSERT_EQ(BackendManager::searchRelevance(vim, "vim", &index),
+              100 + BackendManager::POPULARITY_POINTS);
+    ASSERT_TRUE(BackendManager::searchRelevance(flatpak, "vim", &index) >
+                BackendManager::searchRelevance(flatpak, "vim"));
+    ASSERT_TRUE(BackendManager::searchRelevance(vim, "vi", &index) <
+                BackendManager::searchRelevance(gtk, "vim-gtk3"));
+    ASSERT_EQ(BackendManager::searchRelevance(nano, "vim", &index), 0);
+
+    // Merged across backends, the more popular of equal matches leads
+    vector<vector<PackageInfo>> perBackend(2);
+    PackageInfo first = flatpak;
+    first.relevance = BackendManager::searchRelevance(first, "vim", &index);
+    PackageInfo second = vim;
+    second.relevance = BackendManager::searchRelevance(second, "vim", &index);
+    perBackend[0] = {first};
+    perBackend[1] = {second};
+    SearchOptions options;
+    vector<PackageInfo> merged = BackendManager::mergeSearchResults(perBackend, options);
+    ASSERT_EQ(merged.size(), 2u);
+    ASSERT_EQ(merged[0].backend, BackendType::APT);
+
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(HistoryIndex_ListsAndSearches) {
+    string dir = "/tmp/test-polysynaptic-history-" + to_string(getpid()) + "/";
+    mkdir(dir.c_str(), 0700);
+    auto writeLog = [&dir](const string& file, const string& text) {
+        ofstream out((dir + file).c_str());
+        out << text;
+    };
+
+    writeLog("2023-01-05.101500.log",
+             "Commit Log for Thu Jan  5 10:15:00 2023\n\n"
+             "Upgraded the following packages:\n"
+             "libc6 (2.36-8) to 2.36-9\n"
+             "firefox-esr (102.6) to 102.7\n");
+    writeLog("2024-03-01.080000.log",
+             "Commit Log for Fri Mar  1 08:00:00 2024\n\n"
+             "Installed the following packages:\n"
+             "gimp (2.10.34-1)\n");
+    writeLog("notes.txt", "not a log\n");
+
+    RHistoryIndex index(dir);
+    ASSERT_TRUE(index.load());
+    ASSERT_EQ(index.entries().size(), 2u);
+    const RHistoryIndex::Entry& newest = index.entries()[0];
+    ASSERT_EQ(newest.file, "2024-03-01.080000.log");
+    ASSERT_EQ(newest.when.tm_year, 124);
+    ASSERT_EQ(newest.when.tm_wday, 5);      // A Friday
+    ASSERT_EQ(newest.packages, 1u);
+    ASSERT_EQ(index.entries()[1].names, "libc6, firefox-esr");
+
+    // Searches match lines as before, words from the index alone
+    ASSERT_EQ(index.search("firefox").size(), 1u);
+    ASSERT_EQ(index.search("firefox")[0]->file, "2023-01-05.101500.log");
+    ASSERT_EQ(index.search("packages:").size(), 2u);
+    ASSERT_EQ(index.search("to 2.36-9").size(), 1u);
+    ASSERT_EQ(index.search("2.36-9 to").size(), 0u);
+    ASSERT_EQ(index.search("").size(), 2u);
+    ASSERT_EQ(index.search("vim").size(), 0u);
+
+    // A new log is appended; a deleted one is dropped on the next load
+    writeLog("2024-04-02.120000.log",
+             "Commit Log for Tue Apr  2 12:00:00 2024\n\n"
+             "Removed the following packages:\n"
+             "vim\n");
+    ASSERT_TRUE(index.add("2024-04-02.120000.log"));
+    ASSERT_EQ(index.search("vim").size(), 1u);
+    unlink((dir + "2023-01-05.101500.log").c_str());
+
+    RHistoryIndex reloaded(dir);
+    ASSERT_TRUE(reloaded.load());
+    ASSERT_EQ(reloaded.entries().size(), 2u);
+    ASSERT_EQ(reloaded.entries()[0].names, "vim");
+    ASSERT_EQ(reloaded.search("firefox").size(), 0u);
+
+    string text;
+    ASSERT_TRUE(reloaded.read(reloaded.entries()[1], text));
+    ASSERT_TRUE(text.find("gimp (2.10.34-1)") != string::npos);
+
+    // The rewritten index lists what is there, oldest first
+    ifstream saved((dir + RHistoryIndex::fileName()).c_str());
+    string first, second, extra;
+    getline(saved, first);
+    getline(saved, second);
+    ASSERT_EQ(first.substr(0, 21), "2024-03-01.080000.log");
+    ASSERT_EQ(second.substr(0, 21), "2024-04-02.120000.log");
+    ASSERT_FALSE(getline(saved, extra));
+
+    unlink((dir + "2024-03-01.080000.log").c_str());
+    unlink((dir + "2024-04-02.120000.log").c_str());
+    unlink((dir + "notes.txt").c_str());
+    unlink((dir + RHistoryIndex::fileName()).c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(CommitLog_StreamsAndIndexes) {
+    string dir = "/tmp/test-polysynaptic-commitlog-" + to_string(getpid()) + "/";
+    mkdir(dir.c_str(), 0700);
+
+    time_t when = time(NULL);
+    string name = RCommitLog::fileName(when);
+    {
+        RCommitLog log;
+        ASSERT_TRUE(log.open(dir, when));
+        log.section("\nUpgraded the following packages:\n");
+        log.package("libc6 (2.36-8) to 2.36-9");
+        log.package("firefox-esr (102.6) to 102.7");
+        log.note("Failed to fetch http://example.org/a.deb\n  404\n\n");
+
+        // Nothing is there under the log's name until it is closed
+        struct stat st;
+        ASSERT_TRUE(stat((dir + name).c_str(), &st) != 0);
+        ASSERT_TRUE(log.close());
+    }
+
+    // The text reads as makeCommitLog() used to build it
+    ifstream in((dir + name).c_str());
+    string header, blank, section, first;
+    getline(in, header);
+    getline(in, blank);
+    getline(in, blank);
+    getline(in, section);
+    getline(in, first);
+    ASSERT_EQ(header.substr(0, 15), "Commit Log for ");
+    ASSERT_EQ(section, "Upgraded the following packages:");
+    ASSERT_EQ(first, "libc6 (2.36-8) to 2.36-9");
+
+    // The recorded entry is what a scan of the file would find
+    RHistoryIndex index(dir);
+    ASSERT_TRUE(index.load());
+    ASSERT_EQ(index.entries().size(), 1u);
+    ASSERT_EQ(index.entries()[0].packages, 2u);
+    ASSERT_EQ(index.entries()[0].names, "libc6, firefox-esr");
+    ASSERT_EQ(index.search("404").size(), 1u);
+
+    // A log that is not closed leaves nothing
+    {
+        RCommitLog log;
+        ASSERT_TRUE(log.open(dir, when + 1));
+        log.package("vim");
+    }
+    struct stat st;
+    ASSERT_TRUE(stat((dir + RCommitLog::fileName(when + 1) + ".part").c_str(), &st) != 0);
+    ASSERT_TRUE(stat((dir + RCommitLog::fileName(when + 1)).c_str(), &st) != 0);
+
+    unlink((dir + name).c_str());
+    unlink((dir + RHistoryIndex::fileName()).c_str());
+    rmdir(dir.c_str());
+}
+
+// ============================================================================
+// Ranking and Duplicate Detection Tests
+// ============================================================================
+
+TEST(Ranking_BatchMatchesFullScores) {
+    PackageRanker ranker;
+
+    UnifiedPackage aptPkg("vlc", "VLC", SourceType::APT);
+    aptPkg.metadata.trustLevel = TrustLevel::OFFICIAL;
+
+    UnifiedPackage flatpakPkg("org.videolan.VLC", "VLC", SourceType::FLATPAK);
+    flatpakPkg.metadata.trustLevel = TrustLevel::COMMUNITY;
+    flatpakPkg.metadata.confinement = ConfinementLevel::STRICT;
+
+    vector<UnifiedPackage> packages = {aptPkg, flatpakPkg};
+    auto batch = ranker.rankBatch(packages);
+    auto full = ranker.rankPackages(packages);
+
+    ASSERT_EQ(batch.size(), 2u);
+    for (size_t i = 0; i < batch.size(); i++) {
+        ASSERT_EQ(batch[i].totalScore, full[i].totalScore);
+        ASSERT_EQ(packages[batch[i].index].id, full[i].packageId);
+    }
+
+    // The scoring kernel memoizes nothing
+    int before = ranker.explainPackage(aptPkg).totalScore;
+    aptPkg.metadata.trustLevel = TrustLevel::UNTRUSTED;
+    ASSERT_TRUE(ranker.explainPackage(aptPkg).totalScore < before);
+
+    // With a custom scorer, memoized components are recomputed once the
+    // metadata revision moves
+    aptPkg.metadata.trustLevel = TrustLevel::OFFICIAL;
+    ranker.setCustomScorer("Popularity", [](const UnifiedPackage&) { return 0.5; });
+    before = ranker.explainPackage(aptPkg).totalScore;
+    aptPkg.metadata.trustLevel = TrustLevel::UNTRUSTED;
+    ASSERT_EQ(ranker.explainPackage(aptPkg).totalScore, before);
+    aptPkg.metadata.revision++;
+    ASSERT_TRUE(ranker.explainPackage(aptPkg).totalScore < before);
+}
+
+TEST(Ranking_KernelMatchesCustomScorers) {
+    // A custom scorer with the built-in rule takes the dynamic path but
+    // must score exactly as the kernel does
+    vector<UnifiedPackage> packages;
+    const SourceType sources[] = {SourceType::APT, SourceType::FLATPAK,
+                                  SourceType::SNAP, SourceType::APPIMAGE};
+    const TrustLevel trust[] = {TrustLevel::OFFICIAL, TrustLevel::COMMUNITY,
+                                TrustLevel::UNTRUSTED};
+    const ConfinementLevel confinement[] = {ConfinementLevel::STRICT,
+                                            ConfinementLevel::NONE,
+                                            ConfinementLevel::DEVMODE};
+    for (SourceType source : sources) {
+        for (TrustLevel t : trust) {
+            for (ConfinementLevel c : confinement) {
+                string id = "pkg-" + to_string(packages.size());
+                UnifiedPackage pkg(id, id, source);
+                pkg.metadata.trustLevel = t;
+                pkg.metadata.confinement = c;
+                packages.push_back(pkg);
+            }
+        }
+    }
+
+    RankingConfig reordered;
+    reordered.providerPriority = {"flatpak", "snap", "apt"};
+    reordered.trustWeight = 0.5;
+
+    for (const RankingConfig& config : {RankingConfig(), reordered}) {
+        PackageRanker kernel(config);
+        PackageRanker dynamic(config);
+        kernel.setPopularityIndex(nullptr);
+        dynamic.setPopularityIndex(nullptr);
+        dynamic.setCustomScorer("Popularity", [](const UnifiedPackage&) { return 0.5; });
+
+        auto fast = kernel.rankBatch(packages);
+        auto slow = dynamic.rankBatch(packages);
+        ASSERT_EQ(fast.size(), slow.size());
+        for (size_t i = 0; i < fast.size(); i++) {
+            ASSERT_EQ(fast[i].index, slow[i].index);
+            ASSERT_EQ(fast[i].totalScore, slow[i].totalScore);
+        }
+        for (const auto& pkg : packages) {
+            auto a = kernel.explainPackage(pkg);
+            auto b = dynamic.explainPackage(pkg);
+            ASSERT_EQ(a.totalScore, b.totalScore);
+            ASSERT_EQ(kernel.rankScore(pkg), a.totalScore);
+            for (size_t c = 0; c < a.components.size(); c++) {
+                ASSERT_TRUE(a.components[c].rawScore == b.components[c].rawScore);
+            }
+        }
+    }
+}
+
+TEST(DuplicateDetector_KnownVariantsAndCache) {
+    DuplicateDetector detector;
+
+    UnifiedPackage spotify("com.spotify.Client", "Spotify", SourceType::FLATPAK);
+    UnifiedPackage spotifyDeb("spotify-client", "spotify-client", SourceType::APT);
+
+    ASSERT_EQ(detector.getCanonicalName(spotify), "spotify");
+    ASSERT_EQ(spotify.canonicalName, "spotify");
+    ASSERT_TRUE(detector.isSameApp(spotify, spotifyDeb));
+
+    // The cached key is used as is
+    spotify.canonicalName = "cached";
+    ASSERT_EQ(detector.getCanonicalName(spotify), "cached");
+}
+
+TEST(DuplicateStream_IncrementalGroups) {
+    auto ranker = std::make_shared<PackageRanker>();
+    DuplicateStream stream(ranker);
+
+    UnifiedPackage firefoxSnap("firefox", "Firefox", SourceType::SNAP);
+    UnifiedPackage vlc("vlc", "VLC", SourceType::APT);
+    UnifiedPackage firefoxApt("firefox", "Firefox", SourceType::APT);
+    UnifiedPackage firefoxFlatpak("org.mozilla.firefox", "Firefox", SourceType::FLATPAK);
+
+    auto update = stream.add(firefoxSnap);
+    ASSERT_TRUE(update.created);
+    ASSERT_FALSE(update.recommendedChanged);
+    ASSERT_FALSE(stream.groups()[0].recommended.has_value());
+
+    update = stream.add(vlc);
+    ASSERT_TRUE(update.created);
+    ASSERT_EQ(update.group, 1u);
+
+    // The second source makes it a duplicate with a recommendation
+    update = stream.add(firefoxApt);
+    ASSERT_FALSE(update.created);
+    ASSERT_EQ(update.group, 0u);
+    ASSERT_TRUE(update.recommendedChanged);
+    ASSERT_TRUE(stream.groups()[0].recommended.has_value());
+
+    stream.add(firefoxFlatpak);
+    ASSERT_EQ(stream.groups().size(), 2u);
+    ASSERT_EQ(stream.groups()[0].packages.size(), 3u);
+
+    // Same groups and winner as the batch pass
+    vector<UnifiedPackage> all = {firefoxSnap, vlc, firefoxApt, firefoxFlatpak};
+    DuplicateDetector detector(ranker);
+    auto batch = detector.findDuplicates(all);
+    auto streamed = stream.duplicates();
+    ASSERT_EQ(batch.size(), 1u);
+    ASSERT_EQ(streamed.size(), 1u);
+    ASSERT_EQ(streamed[0].canonicalName, "firefox");
+    ASSERT_EQ(batch[0].recommended->providerId, streamed[0].recommended->providerId);
+    ASSERT_EQ(streamed[0].recommended->providerId,
+              ranker->getBestPackage(streamed[0].packages)->providerId);
+
+    stream.clear();
+    ASSERT_EQ(stream.groups().size(), 0u);
+}
+
+TEST(CacheRetention_KeepsNewestHeldAndUnderCap) {
+    auto item = [](const string& name, const string& version, uint64_t size, time_t mtime) {
+        CachedItem i;
+        i.name = name;
+        i.version = version;
+        i.size = size;
+        i.mtime = mtime;
+        return i;
+    };
+    vector<CachedItem> items = {
+        item("libc6", "2.36-8", 100, 10),
+        item("libc6", "2.36-10", 100, 30),
+        item("libc6", "2.36-9", 100, 20),
+        item("vim", "9.0-1", 50, 5),
+        item("vim", "9.0-2", 50, 40),
+    };
+    items[3].held = true;
+    items[4].obsolete = true;
+    auto names = [](const vector<const CachedItem*>& chosen) {
+        string out;
+        for (const CachedItem* i : chosen) out += i->name + "=" + i->version + " ";
+        return out;
+    };
+
+    RetentionPolicy keepAll;
+    ASSERT_FALSE(keepAll.removesAnything());
+    ASSERT_TRUE(CacheRetention::select(items, keepAll).empty());
+
+    // By mtime; the held vim stays though it is the older one
+    RetentionPolicy newest;
+    newest.keepVersions = 1;
+    ASSERT_EQ(names(CacheRetention::select(items, newest)), "libc6=2.36-8 libc6=2.36-9 ");
+
+    // By version with a comparator: "2.36-10" is not the oldest
+    auto byNumber = [](const string& a, const string& b) {
+        return atoi(a.c_str() + a.rfind('-') + 1) - atoi(b.c_str() + b.rfind('-') + 1);
+    };
+    newest.keepVersions = 2;
+    ASSERT_EQ(names(CacheRetention::select(items, newest, byNumber)), "libc6=2.36-8 ");
+
+    RetentionPolicy obsolete;
+    obsolete.dropObsolete = true;
+    ASSERT_EQ(names(CacheRetention::select(items, obsolete)), "vim=9.0-2 ");
+
+    // The oldest go first until the rest fits; held ones never
+    RetentionPolicy capped;
+    capped.maxBytes = 200;
+    vector<const CachedItem*> chosen = CacheRetention::select(items, capped);
+    ASSERT_EQ(names(chosen), "libc6=2.36-8 libc6=2.36-9 ");
+    ASSERT_EQ(CacheRetention::totalSize(chosen), 200u);
+
+    ASSERT_EQ(CacheRetention::select(items, RetentionPolicy::everything()).size(), 5u);
+}
+
+TEST(CacheRetention_ScansArchives) {
+    string name, version, arch;
+    ASSERT_TRUE(CacheRetention::parseArchiveName("libc6_2.36-9_amd64.deb", name, version, arch));
+    ASSERT_EQ(name, "libc6");
+    ASSERT_EQ(version, "2.36-9");
+    ASSERT_EQ(arch, "amd64");
+    ASSERT_TRUE(CacheRetention::parseArchiveName("gimp_2%3a2.10.34-1_all.deb", name, version, arch));
+    ASSERT_EQ(version, "2:2.10.34-1");
+    ASSERT_FALSE(CacheRetention::parseArchiveName("lock", name, version, arch));
+    ASSERT_FALSE(CacheRetention::parseArchiveName("nounderscore.deb", name, version, arch));
+
+    string dir = "/tmp/test-polysynaptic-archives-" + to_string(getpid()) + "/";
+    mkdir(dir.c_str(), 0700);
+    for (const char* file : {"a_1_all.deb", "a_2_all.deb", "lock"}) {
+        ofstream((dir + file).c_str()) << "data";
+    }
+    vector<CachedItem> items;
+    ASSERT_TRUE(CacheRetention::scanArchives(dir, items));
+    ASSERT_EQ(items.size(), 2u);
+    ASSERT_EQ(items[0].size, 4u);
+
+    RetentionPolicy policy = RetentionPolicy::everything();
+    ASSERT_EQ(CacheRetention::removeFiles(CacheRetention::select(items, policy)), 8u);
+    items.clear();
+    ASSERT_TRUE(CacheRetention::scanArchives(dir, items));
+    ASSERT_TRUE(items.empty());
+
+    unlink((dir + "lock").c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(SnapBackend_ParsesDisabledRevisions) {
+    string output =
+        "Name    Version   Rev    Tracking       Publisher   Notes\n"
+        "core22  20240111  1122   latest/stable  canonical**  base,disabled\n"
+        "core22  20240408  1380   latest/stable  canonical**  base\n"
+        "firefox 124.0-1   3941   latest/stable  mozilla**    disabled\n"
+        "hello   2.10      x1     -              -            -\n";
+    vector<CachedItem> items = SnapBackend::parseDisabledRevisions(output);
+    ASSERT_EQ(items.size(), 2u);
+    ASSERT_EQ(items[0].name, "core22");
+    ASSERT_EQ(items[0].location, "1122");
+    ASSERT_EQ(items[1].name, "firefox");
+    ASSERT_EQ(items[1].version, "124.0-1");
+}
+
+TEST(SnapBackend_ParsesConnections) {
+    string output =
+        "Interface        Plug                      Slot              Notes\n"
+        "camera           firefox:camera            -                 -\n"
+        "home             firefox:home              :home             -\n"
+        "content[gnome]   firefox:gnome-42-2204     gnome-42-2204:gnome-42-2204  -\n"
+        "network          -                         :network          -\n";
+    auto connections = SnapBackend::parseConnections(output);
+    ASSERT_EQ(connections.size(), 3u);
+    ASSERT_EQ(connections[0].first, "camera");
+    ASSERT_FALSE(connections[0].second);
+    ASSERT_EQ(connections[1].first, "home");
+    ASSERT_TRUE(connections[1].second);
+    ASSERT_EQ(connections[2].first, "gnome-42-2204");
+    ASSERT_TRUE(connections[2].second);
+}
+
+TEST(FlatpakBackend_ParsesMetadata) {
+    string output =
+        "[Application]\n"
+        "name=org.gnome.Calculator\n"
+        "runtime=org.gnome.Platform/x86_64/46\n"
+        "\n"
+        "[Context]\n"
+        "shared=network;ipc;\n"
+        "filesystems=xdg-run/dconf;~/.config/dconf:ro;\n"
+        "[Environment]\n"
+        "GTK_USE_PORTAL=1\n";
+    auto metadata = FlatpakBackend::parseMetadata(output);
+    ASSERT_EQ(metadata.size(), 5u);
+    ASSERT_EQ(metadata["Application.runtime"], "org.gnome.Platform/x86_64/46");
+    ASSERT_EQ(metadata["Context.shared"], "network;ipc;");
+    ASSERT_EQ(metadata["Environment.GTK_USE_PORTAL"], "1");
+}
+
+TEST(ResultFilter_NarrowsByFacetAndText) {
+    vector<PackageInfo> packages;
+    PackageInfo vim("vim", "vim", BackendType::APT);
+    vim.summary = "Vi IMproved - enhanced vi editor";
+    vim.installStatus = InstallStatus::INSTALLED;
+    vim.origin = "Ubuntu";
+    packages.push_back(vim);
+    PackageInfo code("code", "code", BackendType::SNAP);
+    code.summary = "Code editing. Redefined.";
+    code.installStatus = InstallStatus::NOT_INSTALLED;
+    code.isClassic = true;
+    packages.push_back(code);
+    PackageInfo gedit("org.gnome.gedit", "Gedit", BackendType::FLATPAK);
+    gedit.summary = "Text Editor";
+    gedit.installStatus = InstallStatus::UPDATE_AVAILABLE;
+    packages.push_back(gedit);
+
+    ResultFilter filter;
+    filter.index(packages);
+    vector<int> rows;
+
+    ResultQuery query;
+    ASSERT_TRUE(query.keepsAll());
+    filter.matches(query, rows);
+    ASSERT_EQ(rows.size(), 3u);
+
+    query.text = "EDIT";
+    filter.matches(query, rows);
+    ASSERT_EQ(rows.size(), 3u);
+    query.text = "editor";
+    filter.matches(query, rows);
+    ASSERT_EQ(rows.size(), 2u);
+    ASSERT_EQ(rows[1], 2);
+
+    query.statuses = ResultQuery::STATUS_INSTALLED | ResultQuery::STATUS_UPDATABLE;
+    query.backends = ResultQuery::backendBit(BackendType::APT);
+    filter.matches(query, rows);
+    ASSERT_EQ(rows.size(), 1u);
+    ASSERT_EQ(rows[0], 0);
+    ASSERT_TRUE(filter.includes(query, 0));
+    ASSERT_FALSE(filter.includes(query, 2));
+
+    ResultQuery classic;
+    classic.confinements = ResultQuery::CONFINEMENT_CLASSIC;
+    filter.matches(classic, rows);
+    ASSERT_EQ(rows.size(), 1u);
+    ASSERT_EQ(rows[0], 1);
+
+    ResultQuery official;
+    official.trusts = ResultQuery::trustBit(TrustLevel::OFFICIAL);
+    filter.matches(official, rows);
+    ASSERT_EQ(rows.size(), 1u);
+
+    // Packages appended after a query are found by the next one
+    PackageInfo nano("nano", "nano", BackendType::APT);
+    nano.summary = "small, friendly text editor";
+    nano.installStatus = InstallStatus::NOT_INSTALLED;
+    packages.push_back(nano);
+    filter.append(packages);
+    ResultQuery text;
+    text.text = "editor";
+    filter.matches(text, rows);
+    ASSERT_EQ(rows.size(), 3u);
+    text.text = "text editor";
+    filter.matches(text, rows);
+    ASSERT_EQ(rows.size(), 2u);
+    ASSERT_EQ(rows[1], 3);
+}
+
+TEST(CategoryIndex_MapsEveryBackendOntoOneTaxonomy) {
+    using Mask = CategoryIndex::Mask;
+    const Mask games = CategoryIndex::bit(Category::GAMES);
+    const Mask office = CategoryIndex::bit(Category::OFFICE);
+
+    ASSERT_EQ(CategoryIndex::fromAptSection("universe/games"), games);
+    ASSERT_EQ(CategoryIndex::fromAptSection("libs"),
+              CategoryIndex::bit(Category::LIBRARIES));
+    ASSERT_EQ(CategoryIndex::fromAptSection("no-such-section"), 0u);
+    ASSERT_EQ(CategoryIndex::fromFreedesktop("BoardGame"), games);
+    ASSERT_EQ(CategoryIndex::fromDebtag("game::strategy"), games);
+    ASSERT_EQ(CategoryIndex::fromSnapSection("productivity"), office);
+
+    PackageInfo chess("gnome-chess", "gnome-chess", BackendType::APT);
+    chess.section = "universe/games";
+    PackageInfo sudoku("org.gnome.Sudoku", "Sudoku", BackendType::FLATPAK);
+    sudoku.section = "Game;LogicGame";
+    PackageInfo notes("notes", "notes", BackendType::SNAP);
+    notes.section = "games;productivity";
+
+    string path = "/tmp/test-polysynaptic-debtags-" + to_string(getpid());
+    {
+        ofstream out(path);
+        out << "libreoffice-calc: office::spreadsheet, role::program\n";
+    }
+    CategoryIndex::Debtags debtags = CategoryIndex::loadDebtags(path);
+    unlink(path.c_str());
+    PackageInfo calc("libreoffice-calc", "libreoffice-calc", BackendType::APT);
+    calc.section = "editors";
+    ASSERT_EQ(CategoryIndex::categoriesOf(calc, nullptr, &debtags),
+              office | CategoryIndex::bit(Category::UTILITIES));
+
+    CategoryIndex index;
+    ASSERT_TRUE(index.empty());
+    for (const PackageInfo* pkg : {&chess, &sudoku, &notes, &calc}) {
+        index.add(*pkg, CategoryIndex::categoriesOf(*pkg, nullptr, &debtags));
+    }
+    ASSERT_EQ(index.count(Category::GAMES), 3u);
+    ASSERT_EQ(index.ids(Category::GAMES, BackendType::FLATPAK).size(), 1u);
+    ASSERT_EQ(index.ids(Category::GAMES, BackendType::FLATPAK)[0], "org.gnome.Sudoku");
+    ASSERT_EQ(index.ids(Category::OFFICE, BackendType::SNAP)[0], "notes");
+    ASSERT_EQ(index.ids(Category::OFFICE, BackendType::APT)[0], "libreoffice-calc");
+    ASSERT_EQ(index.count(Category::FONTS), 0u);
 }
 
 // ============================================================================
@@ -376,6 +376,34 @@ TEST(Provider_RemoveSuccess) {
     ASSERT_TRUE(mock.getInstalled().empty());
 }
 
+// ============================================================================
+// Package Metadata Tests
+// ============================================================================
+
+TEST(Metadata_CompactFieldsCopyOnWrite) {
+    UnifiedPackage pkg;
+    pkg.metadata.editList(MetadataList::CATEGORIES).push_back("AudioVideo");
+    pkg.metadata.setText(MetadataText::CHANNEL, "latest/stable");
+    pkg.metadata.setCustom(MetadataKey("snap-base"), string("core22"));
+
+    UnifiedPackage copy = pkg;
+    copy.metadata.editList(MetadataList::CATEGORIES).push_back("Player");
+    copy.metadata.setText(MetadataText::CHANNEL, "latest/edge");
+
+    ASSERT_EQ(pkg.metadata.list(MetadataList::CATEGORIES).size(), 1u);
+    ASSERT_EQ(copy.metadata.list(MetadataList::CATEGORIES).size(), 2u);
+    ASSERT_TRUE(copy.metadata.list(MetadataList::CATEGORIES)[1] == "Player");
+    ASSERT_EQ(pkg.metadata.text(MetadataText::CHANNEL), "latest/stable");
+    ASSERT_EQ(copy.metadata.text(MetadataText::CHANNEL), "latest/edge");
+    ASSERT_TRUE(pkg.metadata.text(MetadataText::DONATION_URL).empty());
+
+    // Typed lookup by interned key
+    const string* base = copy.metadata.custom<string>(MetadataKey("snap-base"));
+    ASSERT_TRUE(base != nullptr);
+    ASSERT_EQ(*base, "core22");
+    ASSERT_TRUE(copy.metadata.custom<int64_t>(MetadataKey("snap-base")) == nullptr);
+}
+
 // ============================================================================
 // Package Ranking Tests
 // ============================================================================
@@ -539,6 +567,7 @@ TEST(Logging_MemorySink) {
     Logger::instance().addSink(sink);
 
     LOG_INFO("Memory sink test");
+    Logger::instance().flush();
 
     auto entries = sink->getEntries();
     ASSERT_GT(entries.size(), 0u);
@@ -0,0 +1,139 @@
+#include <apt-pkg/init.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/pkgsystem.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "rpackagelister.h"
+#include "rpackagecache.h"
+#include "rpackage.h"
+
+using namespace std;
+
+// app needs a mail-transport of version 2 or later: mta-new provides
+// it, mta-old provides an older one and is garbage. base-req is auto
+// and nothing needs it, but apt keeps required packages
+static const char *STATUS[][4] = {
+   // name, priority, depends, provides
+   { "app", "optional", "mail-transport (>= 2), editor", "" },
+   { "mta-new", "optional", "", "mail-transport (= 2)" },
+   { "mta-old", "optional", "", "mail-transport (= 1)" },
+   { "editor-a", "optional", "", "editor" },
+   { "base-req", "required", "", "" },
+   { "leftover", "optional", "", "" },
+};
+static const char *AUTO[] = { "mta-new", "mta-old", "editor-a", "base-req",
+                              "leftover" };
+
+static string writeFixture()
+{
+   char dir[] = "/tmp/test_rautoremove.XXXXXX";
+   if (mkdtemp(dir) == NULL)
+      return "";
+   string root = dir;
+   mkdir((root + "/lists").c_str(), 0755);
+   mkdir((root + "/sources.list.d").c_str(), 0755);
+   ofstream((root + "/sources.list").c_str());
+
+   ofstream status((root + "/status").c_str());
+   for (auto &pkg : STATUS) {
+      status << "Package: " << pkg[0] << "\n"
+             << "Status: install ok installed\n"
+             << "Priority: " << pkg[1] << "\n"
+             << "Section: misc\n"
+             << "Installed-Size: 1\n"
+             << "Maintainer: Test <test@example.org>\n"
+             << "Architecture: amd64\n"
+             << "Version: 1.0\n";
+      if (*pkg[2])
+         status << "Depends: " << pkg[2] << "\n";
+      if (*pkg[3])
+         status << "Provides: " << pkg[3] << "\n";
+      status << "Description: fixture package\n\n";
+   }
+
+   ofstream states((root + "/extended_states").c_str());
+   for (const char *name : AUTO)
+      states << "Package: " << name << "\nArchitecture: amd64\n"
+             << "Auto-Installed: 1\n\n";
+   return root;
+}
+
+// the tracker against a fresh MarkAndSweep() of the same marks
+static int compare(RPackageLister *lister, const set<string> &removed,
+                   const set<string> &expected)
+{
+   RPackageCache *cache = lister->getCache();
+   pkgDepCache fresh(&cache->deps()->GetCache(), cache->policy());
+   fresh.Init(NULL);
+   for (const string &name : removed)
+      fresh.MarkDelete(fresh.GetCache().FindPkg(name), false);
+   fresh.MarkAndSweep();
+
+   int failures = 0;
+   for (RPackage *pkg : lister->getPackages()) {
+      // apt also calls what is being removed garbage, the tracker not
+      if (removed.count(pkg->name()))
+         continue;
+      pkgCache::PkgIterator P = *pkg->package();
+      bool tracked = lister->isAutoRemovable(P->ID);
+      if (tracked != fresh[P].Garbage) {
+         cerr << "FAIL: " << pkg->name() << " is " << (tracked ? "" : "not ")
+              << "garbage to the tracker only" << endl;
+         failures++;
+      }
+      if (tracked != (expected.count(pkg->name()) > 0)) {
+         cerr << "FAIL: " << pkg->name() << " is " << (tracked ? "" : "not ")
+              << "garbage" << endl;
+         failures++;
+      }
+   }
+   return failures;
+}
+
+int main(int argc, char **argv)
+{
+   pkgInitConfig(*_config);
+
+   string root = writeFixture();
+   if (root.empty()) {
+      cerr << "no fixture directory, nothing tested" << endl;
+      return 1;
+   }
+   _config->Set("APT::Architecture", "amd64");
+   _config->Set("APT::Architectures::", "amd64");
+   _config->Set("Dir::State::status", root + "/status");
+   _config->Set("Dir::State::extended_states", root + "/extended_states");
+   _config->Set("Dir::State::lists", root + "/lists/");
+   _config->Set("Dir::Etc::sourcelist", root + "/sources.list");
+   _config->Set("Dir::Etc::sourceparts", root + "/sources.list.d/");
+   _config->Set("Dir::Cache::pkgcache", "");
+   _config->Set("Dir::Cache::srcpkgcache", "");
+   _config->Set("Debug::NoLocking", true);
+   _config->Set("Synaptic::IncrementalAutoRemove", true);
+   pkgInitSystem(*_config, _system);
+
+   RPackageLister *lister = new RPackageLister();
+   if (!lister->openCache()) {
+      cerr << "fixture cache did not open, nothing tested" << endl;
+      return 1;
+   }
+
+   int failures = compare(lister, set<string>(),
+                          { "mta-old", "leftover" });
+
+   // removing app leaves everything auto behind but base-req
+   set<string> removed = { "app" };
+   lister->getPackage("app")->setRemove();
+   lister->notifyChange(NULL);
+   failures += compare(lister, removed,
+                       { "mta-new", "mta-old", "editor-a", "leftover" });
+
+   cerr << (failures == 0 ? "autoremove: ok" : "autoremove: failed") << endl;
+   return failures == 0 ? 0 : 1;
+}
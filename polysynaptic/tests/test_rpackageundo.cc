@@ -0,0 +1,97 @@
+#include <apt-pkg/init.h>
+#include <iostream>
+
+#include "config.h"
+#include "rpackagelister.h"
+#include "rpackage.h"
+
+using namespace std;
+
+static vector<int> flagsOf(RPackageLister *lister)
+{
+   vector<int> flags;
+   for (RPackage *pkg : lister->getPackages())
+      flags.push_back(pkg->getFlags());
+   return flags;
+}
+
+// the packages whose flags differ between two states
+static int changed(const vector<int> &a, const vector<int> &b)
+{
+   int count = 0;
+   for (unsigned int i = 0; i < a.size(); i++)
+      if (a[i] != b[i])
+         count++;
+   return count;
+}
+
+int main(int argc, char **argv)
+{
+   pkgInitConfig(*_config);
+   pkgInitSystem(*_config, _system);
+
+   RPackageLister *lister = new RPackageLister();
+   lister->openCache();
+
+   // a package not installed yet that pulls in others
+   vector<int> base = flagsOf(lister);
+   RPackage *pkg = NULL;
+   vector<int> marked;
+   for (RPackage *candidate : lister->getPackages()) {
+      if (candidate->getFlags() & RPackage::FInstalled)
+         continue;
+      lister->saveUndoState();
+      candidate->setInstall();
+      lister->notifyChange(NULL);
+      marked = flagsOf(lister);
+      if (changed(base, marked) > 1) {
+         pkg = candidate;
+         break;
+      }
+      lister->undo();
+   }
+   if (pkg == NULL) {
+      cerr << "no package with dependencies to install, nothing tested" << endl;
+      return 0;
+   }
+   cerr << "marked " << pkg->name() << ", " << changed(base, marked)
+        << " packages changed" << endl;
+
+   // a second step on top, removing what the first one installed
+   lister->saveUndoState();
+   pkg->setRemove();
+   lister->notifyChange(NULL);
+   vector<int> removed = flagsOf(lister);
+
+   int failures = 0;
+
+   // each undo and redo lands on exactly the state of its side of the
+   // step, outside the step's own packages too
+   lister->undo();
+   if (changed(flagsOf(lister), marked) != 0) {
+      cerr << "FAIL: first undo left " << changed(flagsOf(lister), marked)
+           << " packages off" << endl;
+      failures++;
+   }
+   lister->undo();
+   if (changed(flagsOf(lister), base) != 0) {
+      cerr << "FAIL: second undo left " << changed(flagsOf(lister), base)
+           << " packages off" << endl;
+      failures++;
+   }
+   lister->redo();
+   if (changed(flagsOf(lister), marked) != 0) {
+      cerr << "FAIL: first redo left " << changed(flagsOf(lister), marked)
+           << " packages off" << endl;
+      failures++;
+   }
+   lister->redo();
+   if (changed(flagsOf(lister), removed) != 0) {
+      cerr << "FAIL: second redo left " << changed(flagsOf(lister), removed)
+           << " packages off" << endl;
+      failures++;
+   }
+
+   cerr << (failures == 0 ? "undo/redo: ok" : "undo/redo: failed") << endl;
+   return failures == 0 ? 0 : 1;
+}
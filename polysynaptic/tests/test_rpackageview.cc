@@ -23,4 +23,9 @@ int main(int argc, char **argv)
    unsigned long now = clock();
    lister->searchView()->setSearch("synaptic",  RPatternPackageFilter::Description, "synaptic", progress);
    cerr << "searching: " << float(clock()-now)/CLOCKS_PER_SEC << endl;
+
+   // the first search built the trigram index, this one only uses it
+   now = clock();
+   lister->searchView()->setSearch("synaptic",  RPatternPackageFilter::Description, "synaptic", progress);
+   cerr << "searching (indexed): " << float(clock()-now)/CLOCKS_PER_SEC << endl;
 }
@@ -20,6 +20,7 @@
 
 #include "rgunifiedview.h"
 #include "backendmanager.h"
+#include "synthbackend.h"
 
 using namespace std;
 using namespace PolySynaptic;
@@ -87,6 +88,27 @@ void on_row_changed(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, g
     g_changeSignals++;
 }
 
+void on_rows_reordered(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+                       gpointer new_order, gpointer data) {
+    (*(int*)data)++;
+}
+
+// A published list of its own, as a load publishes it
+static PackageSnapshotPtr snapshot_of(const vector<PackageInfo>& packages) {
+    static uint64_t generation = 0;
+    return make_shared<const PackageSnapshot>(packages, ++generation);
+}
+
+static string row_name(GtkTreeModel* model, gint row) {
+    GtkTreeIter iter;
+    if (!gtk_tree_model_iter_nth_child(model, &iter, nullptr, row)) return "";
+    GValue value = G_VALUE_INIT;
+    gtk_tree_model_get_value(model, &iter, UPKG_COL_PACKAGE_NAME, &value);
+    string name = g_value_get_string(&value);
+    g_value_unset(&value);
+    return name;
+}
+
 // ============================================================================
 // Tests
 // ============================================================================
@@ -109,7 +131,7 @@ TEST(SetPackages_EmitsInsertSignals) {
     packages.push_back(pkg3);
 
     // Set packages - this should emit row-inserted signals
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Verify signals were emitted
     cout << "(got " << g_insertSignals << " insert signals) ";
@@ -137,7 +159,7 @@ TEST(SetPackages_WithFilter_EmitsCorrectSignals) {
 
     // Reset counter and set packages
     g_insertSignals = 0;
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Should only emit 2 signals (Snap and Flatpak, not APT)
     cout << "(got " << g_insertSignals << " insert signals, expected 2) ";
@@ -156,7 +178,7 @@ TEST(SetFilter_EmitsDeleteAndInsertSignals) {
     packages.push_back(PackageInfo("firefox", "Firefox", BackendType::SNAP));
     packages.push_back(PackageInfo("apt-pkg", "APT Package", BackendType::APT));
     packages.push_back(PackageInfo("vlc", "VLC", BackendType::FLATPAK));
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Reset counters
     g_insertSignals = 0;
@@ -169,10 +191,17 @@ TEST(SetFilter_EmitsDeleteAndInsertSignals) {
     snapOnly.includeFlatpak = false;
     rg_unified_pkg_list_set_filter(list, snapOnly);
 
-    // Should have deleted 3 rows and inserted 1
+    // Only the two rows that disappear are signalled
     cout << "(got " << g_deleteSignals << " delete, " << g_insertSignals << " insert) ";
-    ASSERT_EQ(g_deleteSignals, 3);
-    ASSERT_EQ(g_insertSignals, 1);
+    ASSERT_EQ(g_deleteSignals, 2);
+    ASSERT_EQ(g_insertSignals, 0);
+
+    // Widening the filter again brings back exactly those rows
+    g_deleteSignals = 0;
+    rg_unified_pkg_list_set_filter(list, BackendFilter::All());
+    ASSERT_EQ(g_deleteSignals, 0);
+    ASSERT_EQ(g_insertSignals, 2);
+    ASSERT_EQ(gtk_tree_model_iter_n_children(GTK_TREE_MODEL(list), nullptr), 3);
 
     g_object_unref(list);
 }
@@ -184,7 +213,7 @@ TEST(TreeModel_IterNChildren) {
     packages.push_back(PackageInfo("pkg1", "Package 1", BackendType::SNAP));
     packages.push_back(PackageInfo("pkg2", "Package 2", BackendType::FLATPAK));
     packages.push_back(PackageInfo("pkg3", "Package 3", BackendType::APT));
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Check row count via TreeModel interface
     GtkTreeModel* model = GTK_TREE_MODEL(list);
@@ -202,7 +231,7 @@ TEST(TreeModel_GetValue_Name) {
     vector<PackageInfo> packages;
     packages.push_back(PackageInfo("test-snap", "Test Snap", BackendType::SNAP));
     packages.back().summary = "A test snap package";
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Get value via TreeModel interface
     GtkTreeModel* model = GTK_TREE_MODEL(list);
@@ -227,7 +256,7 @@ TEST(TreeModel_GetValue_BackendBadge) {
 
     vector<PackageInfo> packages;
     packages.push_back(PackageInfo("snap-pkg", "Snap Pkg", BackendType::SNAP));
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     GtkTreeModel* model = GTK_TREE_MODEL(list);
     GtkTreeIter iter;
@@ -252,7 +281,7 @@ TEST(TreeModel_IterNext) {
     packages.push_back(PackageInfo("pkg1", "First", BackendType::SNAP));
     packages.push_back(PackageInfo("pkg2", "Second", BackendType::FLATPAK));
     packages.push_back(PackageInfo("pkg3", "Third", BackendType::APT));
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     GtkTreeModel* model = GTK_TREE_MODEL(list);
     GtkTreeIter iter;
@@ -283,7 +312,7 @@ TEST(Refresh_EmitsChangeSignals) {
     vector<PackageInfo> packages;
     packages.push_back(PackageInfo("pkg1", "Package 1", BackendType::SNAP));
     packages.push_back(PackageInfo("pkg2", "Package 2", BackendType::FLATPAK));
-    rg_unified_pkg_list_set_packages(list, &packages);
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
 
     // Reset counter
     g_changeSignals = 0;
@@ -297,6 +326,227 @@ TEST(Refresh_EmitsChangeSignals) {
     g_object_unref(list);
 }
 
+TEST(AppendPackages_EmitsOnlyNewRows) {
+    RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+    g_signal_connect(list, "row-inserted", G_CALLBACK(on_row_inserted), nullptr);
+    g_signal_connect(list, "row-deleted", G_CALLBACK(on_row_deleted), nullptr);
+
+    BackendFilter noFlatpak;
+    noFlatpak.includeFlatpak = false;
+    rg_unified_pkg_list_set_filter(list, noFlatpak);
+
+    SnapshotPublisher publisher;
+    vector<PackageInfo> packages;
+    packages.push_back(PackageInfo("gimp", "GIMP", BackendType::APT));
+    packages.push_back(PackageInfo("vim", "Vim", BackendType::APT));
+    rg_unified_pkg_list_set_packages(list, publisher.publish(packages, 1));
+
+    g_insertSignals = 0;
+
+    // A later backend's results arrive
+    vector<PackageInfo> more;
+    more.push_back(PackageInfo("firefox", "Firefox", BackendType::SNAP));
+    more.push_back(PackageInfo("org.gnome.Calculator", "Calculator", BackendType::FLATPAK));
+    more.push_back(PackageInfo("vlc", "VLC", BackendType::SNAP));
+    rg_unified_pkg_list_set_packages(list, publisher.append(more, 1));
+
+    cout << "(got " << g_insertSignals << " insert, " << g_deleteSignals << " delete) ";
+    ASSERT_EQ(g_insertSignals, 2);
+    ASSERT_EQ(g_deleteSignals, 0);
+    ASSERT_EQ(rg_unified_pkg_list_get_packages(list)->size(), 5u);
+
+    GtkTreeModel* model = GTK_TREE_MODEL(list);
+    ASSERT_EQ(gtk_tree_model_iter_n_children(model, nullptr), 4);
+
+    // The last visible row is the last appended Snap
+    GtkTreeIter iter;
+    ASSERT_TRUE(gtk_tree_model_iter_nth_child(model, &iter, nullptr, 3));
+    GValue value = G_VALUE_INIT;
+    gtk_tree_model_get_value(model, &iter, UPKG_COL_PACKAGE_NAME, &value);
+    ASSERT_EQ(string(g_value_get_string(&value)), "VLC");
+    g_value_unset(&value);
+
+    g_object_unref(list);
+}
+
+TEST(SetPackages_DiffsAgainstDisplayedRows) {
+    RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+    g_signal_connect(list, "row-inserted", G_CALLBACK(on_row_inserted), nullptr);
+    g_signal_connect(list, "row-deleted", G_CALLBACK(on_row_deleted), nullptr);
+    g_signal_connect(list, "row-changed", G_CALLBACK(on_row_changed), nullptr);
+
+    vector<PackageInfo> packages;
+    packages.push_back(PackageInfo("firefox", "Firefox", BackendType::SNAP));
+    packages.push_back(PackageInfo("gimp", "GIMP", BackendType::APT));
+    packages.push_back(PackageInfo("vlc", "VLC", BackendType::FLATPAK));
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
+
+    g_insertSignals = 0;
+
+    // A revised list, as a revalidation publishes it
+    packages.erase(packages.begin());
+    packages[0].version = "2.10.38";
+    packages.push_back(PackageInfo("spotify", "Spotify", BackendType::SNAP));
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
+
+    cout << "(got " << g_deleteSignals << " delete, " << g_insertSignals
+         << " insert, " << g_changeSignals << " change) ";
+    ASSERT_EQ(g_deleteSignals, 1);
+    ASSERT_EQ(g_insertSignals, 1);
+    ASSERT_EQ(g_changeSignals, 1);
+
+    // Setting identical data is silent
+    g_insertSignals = g_deleteSignals = g_changeSignals = 0;
+    rg_unified_pkg_list_set_packages(list, snapshot_of(packages));
+    ASSERT_EQ(g_insertSignals + g_deleteSignals + g_changeSignals, 0);
+
+    g_object_unref(list);
+}
+
+TEST(SortColumn_OnlyReordersRows) {
+    RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+    int reorders = 0;
+    g_signal_connect(list, "row-inserted", G_CALLBACK(on_row_inserted), nullptr);
+    g_signal_connect(list, "row-deleted", G_CALLBACK(on_row_deleted), nullptr);
+    g_signal_connect(list, "row-changed", G_CALLBACK(on_row_changed), nullptr);
+    g_signal_connect(list, "rows-reordered", G_CALLBACK(on_rows_reordered), &reorders);
+
+    SnapshotPublisher publisher;
+    vector<PackageInfo> packages;
+    packages.push_back(PackageInfo("vim", "vim", BackendType::APT));
+    packages.push_back(PackageInfo("firefox", "Firefox", BackendType::SNAP));
+    packages.push_back(PackageInfo("gimp", "gimp", BackendType::FLATPAK));
+    PackageSnapshotPtr shown = publisher.publish(packages, 1);
+    rg_unified_pkg_list_set_packages(list, shown);
+    g_insertSignals = 0;
+
+    GtkTreeModel* model = GTK_TREE_MODEL(list);
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list),
+                                         UPKG_COL_PACKAGE_NAME, GTK_SORT_ASCENDING);
+
+    cout << "(got " << reorders << " reorder, " << g_insertSignals + g_deleteSignals +
+            g_changeSignals << " other) ";
+    ASSERT_EQ(reorders, 1);
+    ASSERT_EQ(g_insertSignals + g_deleteSignals + g_changeSignals, 0);
+
+    // Case is ignored and the snapshot itself is left as it was
+    ASSERT_EQ(row_name(model, 0), "Firefox");
+    ASSERT_EQ(row_name(model, 1), "gimp");
+    ASSERT_EQ(row_name(model, 2), "vim");
+    ASSERT_EQ((*shown)[0].name, "vim");
+
+    // Iteration follows the display order
+    GtkTreeIter iter;
+    ASSERT_TRUE(gtk_tree_model_iter_nth_child(model, &iter, nullptr, 0));
+    ASSERT_TRUE(gtk_tree_model_iter_next(model, &iter));
+    GtkTreePath* path = gtk_tree_model_get_path(model, &iter);
+    ASSERT_EQ(gtk_tree_path_get_indices(path)[0], 1);
+    gtk_tree_path_free(path);
+
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list),
+                                         UPKG_COL_BACKEND_BADGE, GTK_SORT_DESCENDING);
+    ASSERT_EQ(reorders, 2);
+    ASSERT_EQ(row_name(model, 0), "gimp");
+    ASSERT_EQ(row_name(model, 2), "vim");
+
+    // A late package is inserted where it sorts, the rest stay put
+    vector<PackageInfo> more;
+    more.push_back(PackageInfo("spotify", "Spotify", BackendType::SNAP));
+    rg_unified_pkg_list_set_packages(list, publisher.append(more, 1));
+    ASSERT_EQ(g_insertSignals, 1);
+    ASSERT_EQ(g_deleteSignals, 0);
+    // (descending reverses the name ties too)
+    ASSERT_EQ(row_name(model, 1), "Spotify");
+    ASSERT_EQ(row_name(model, 2), "Firefox");
+    ASSERT_EQ(row_name(model, 3), "vim");
+
+    g_object_unref(list);
+}
+
+// Fills deferred fields as APT does from its records, counting lookups
+class RecordsBackend : public SynthBackend {
+public:
+    RecordsBackend() : SynthBackend(SynthConfig()), lookups(0) {}
+
+    void resolveDeferredFields(PackageInfo& info, unsigned fields) override {
+        lookups++;
+        if (fields & PackageInfo::DEFER_SUMMARY) {
+            info.summary = "Summary of " + info.id;
+        }
+        if (fields & PackageInfo::DEFER_DESCRIPTION) {
+            info.description = "Description of " + info.id;
+        }
+    }
+
+    int lookups;
+};
+
+static PackageInfo deferred_package(const string& id, RecordsBackend* records) {
+    PackageInfo pkg(id, id, BackendType::APT);
+    pkg.deferredFields = PackageInfo::DEFER_SUMMARY | PackageInfo::DEFER_DESCRIPTION;
+    pkg.deferredSource = records;
+    return pkg;
+}
+
+static PackageInfo* package_ptr(GtkTreeModel* model, gint row) {
+    GtkTreeIter iter;
+    gtk_tree_model_iter_nth_child(model, &iter, nullptr, row);
+    GValue value = G_VALUE_INIT;
+    gtk_tree_model_get_value(model, &iter, UPKG_COL_PACKAGE_PTR, &value);
+    PackageInfo* pkg = static_cast<PackageInfo*>(g_value_get_pointer(&value));
+    g_value_unset(&value);
+    return pkg;
+}
+
+TEST(DeferredFields_ResolvedOnTheModelsCopy) {
+    RGUnifiedPkgList* list = rg_unified_pkg_list_new(nullptr);
+    GtkTreeModel* model = GTK_TREE_MODEL(list);
+    RecordsBackend records;
+
+    SnapshotPublisher publisher;
+    vector<PackageInfo> packages;
+    packages.push_back(deferred_package("vim", &records));
+    PackageSnapshotPtr shown = publisher.publish(packages, 1);
+    rg_unified_pkg_list_set_packages(list, shown);
+
+    // The summary is read once and kept by the model, not the snapshot
+    GtkTreeIter iter;
+    ASSERT_TRUE(gtk_tree_model_iter_nth_child(model, &iter, nullptr, 0));
+    for (int i = 0; i < 2; i++) {
+        GValue value = G_VALUE_INIT;
+        gtk_tree_model_get_value(model, &iter, UPKG_COL_DESCRIPTION, &value);
+        ASSERT_EQ(string(g_value_get_string(&value)), "Summary of vim");
+        g_value_unset(&value);
+    }
+    ASSERT_EQ(records.lookups, 1);
+    ASSERT_TRUE((*shown)[0].summary.empty());
+    ASSERT_TRUE((*shown)[0].isDeferred(PackageInfo::DEFER_SUMMARY));
+
+    // Callers get a copy to fill in, with what was read already
+    PackageInfo* pkg = package_ptr(model, 0);
+    ASSERT_TRUE(pkg != &(*shown)[0]);
+    ASSERT_EQ(pkg->summary, "Summary of vim");
+    pkg->resolve(PackageInfo::DEFER_DESCRIPTION);
+    ASSERT_EQ(pkg->description, "Description of vim");
+    ASSERT_EQ(records.lookups, 2);
+    ASSERT_TRUE((*shown)[0].description.empty());
+    ASSERT_TRUE((*shown)[0].isDeferred(PackageInfo::DEFER_DESCRIPTION));
+
+    // The copy outlives an append, but not a new list
+    vector<PackageInfo> more;
+    more.push_back(deferred_package("emacs", &records));
+    rg_unified_pkg_list_set_packages(list, publisher.append(more, 1));
+    ASSERT_TRUE(package_ptr(model, 0) == pkg);
+
+    shown = publisher.publish(packages, 2);
+    rg_unified_pkg_list_set_packages(list, shown);
+    pkg = package_ptr(model, 0);
+    ASSERT_TRUE(pkg->isDeferred(PackageInfo::DEFER_SUMMARY | PackageInfo::DEFER_DESCRIPTION));
+    ASSERT_TRUE((*shown)[0].isDeferred(PackageInfo::DEFER_SUMMARY));
+
+    g_object_unref(list);
+}
+
 // ============================================================================
 // Main
 // ============================================================================